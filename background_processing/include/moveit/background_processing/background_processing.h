@@ -39,10 +39,12 @@
 
 #include <deque>
 #include <string>
+#include <vector>
 #include <boost/thread.hpp>
 #include <boost/function.hpp>
-#include <boost/scoped_ptr.hpp>
+#include <boost/shared_ptr.hpp>
 #include <boost/noncopyable.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
 
 namespace moveit
 {
@@ -54,8 +56,9 @@ namespace tools
 {
 
 /** \brief This class provides simple API for executing background
-    jobs. A queue of jobs is created and the specified jobs are
-    executed in order, one at a time. */
+    jobs. Jobs are queued by priority and executed by a pool of worker
+    threads. With a single worker (the default), jobs of the same priority
+    are executed in order, one at a time. */
 class BackgroundProcessing : private boost::noncopyable
 {
 public:
@@ -71,27 +74,89 @@ public:
       COMPLETE
     };
 
+  /** \brief Priority classes for jobs. Queued jobs of a higher priority are always started before jobs of a lower priority */
+  enum JobPriority
+    {
+      HIGH = 0,
+      NORMAL = 1,
+      LOW = 2
+    };
+
+  /** \brief Statistics about the jobs of one priority class. Times are in seconds */
+  struct JobStatistics
+  {
+    JobStatistics() : completed_(0), removed_(0), total_wait_(0.0), max_wait_(0.0), total_run_(0.0)
+    {
+    }
+
+    /** \brief Average time completed jobs waited in the queue */
+    double getAverageWait() const
+    {
+      return completed_ > 0 ? total_wait_ / (double)completed_ : 0.0;
+    }
+
+    /** \brief Average execution time of completed jobs */
+    double getAverageRun() const
+    {
+      return completed_ > 0 ? total_run_ / (double)completed_ : 0.0;
+    }
+
+    /// Number of executed jobs
+    std::size_t completed_;
+
+    /// Number of jobs removed from the queue without execution (cleared, cancelled or superseded)
+    std::size_t removed_;
+
+    /// Total and longest time executed jobs waited in the queue
+    double total_wait_;
+    double max_wait_;
+
+    /// Total execution time of executed jobs
+    double total_run_;
+  };
+
   /** \brief The signature for callback triggered when job events take place: the event that took place and the name of the job */
   typedef boost::function<void(JobEvent, const std::string&)> JobUpdateCallback;
 
   /** \brief The signature for job callbacks */
   typedef boost::function<void()> JobCallback;
 
-  /** \brief Constructor. The background thread is activated automatically. */
-  BackgroundProcessing();
+  /** \brief Constructor. The \e workers background threads (at least one) are activated automatically. */
+  BackgroundProcessing(unsigned int workers = 1);
 
-  /** \brief Finishes currently executing job, clears the remaining queue. */
+  /** \brief Finishes currently executing jobs, clears the remaining queue. */
   ~BackgroundProcessing();
 
-  /** \brief Add a job to the queue of jobs to execute. A name is also specifies for the job */
+  /** \brief Add a job to the queue of jobs to execute, with normal priority. A name is also specifies for the job */
   void addJob(const JobCallback &job, const std::string &name);
 
-  /** \brief Get the size of the queue of jobs (includes currently processed job). */
+  /** \brief Add a job to the queue of jobs to execute with priority \e priority. If \e coalesce is true and a job with
+      the same name is waiting in the queue (of any priority), that job is replaced by \e job (latest wins): the new job
+      takes the place of the old one, and the old one is reported as removed. */
+  void addJob(const JobCallback &job, const std::string &name, JobPriority priority, bool coalesce = false);
+
+  /** \brief Remove the jobs named \e name that are waiting in the queue; jobs already executing are not affected.
+      Return the number of removed jobs */
+  std::size_t cancelJobs(const std::string &name);
+
+  /** \brief Get the size of the queue of jobs (includes currently processed jobs). */
   std::size_t getJobCount() const;
 
+  /** \brief Get the number of worker threads */
+  unsigned int getWorkerCount() const
+  {
+    return processing_threads_.size();
+  }
+
   /** \brief Clear the queue of jobs */
   void clear();
 
+  /** \brief Get the statistics for the jobs of priority \e priority */
+  JobStatistics getJobStatistics(JobPriority priority = NORMAL) const;
+
+  /** \brief Reset the statistics for all priorities */
+  void resetJobStatistics();
+
   /** \brief Set the callback to be triggered when events in JobEvent take place */
   void setJobUpdateEvent(const JobUpdateCallback &event);
 
@@ -100,17 +165,27 @@ public:
 
 private:
 
-  boost::scoped_ptr<boost::thread> processing_thread_;
+  static const unsigned int PRIORITY_COUNT = 3;
+
+  struct Job
+  {
+    JobCallback fn_;
+    std::string name_;
+    boost::posix_time::ptime enqueued_;
+  };
+
+  std::vector<boost::shared_ptr<boost::thread> > processing_threads_;
   bool run_processing_thread_;
 
   mutable boost::mutex action_lock_;
   boost::condition_variable new_action_condition_;
-  std::deque<JobCallback> actions_;
-  std::deque<std::string> action_names_;
+  std::deque<Job> actions_[PRIORITY_COUNT];
+  JobStatistics statistics_[PRIORITY_COUNT];
 
   JobUpdateCallback queue_change_event_;
 
-  bool processing_;
+  /// The number of jobs being executed
+  std::size_t processing_;
 
   void processingThread();
 };
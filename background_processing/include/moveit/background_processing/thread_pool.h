@@ -0,0 +1,170 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2013, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#ifndef MOVEIT_BACKGROUND_PROCESSING_THREAD_POOL_
+#define MOVEIT_BACKGROUND_PROCESSING_THREAD_POOL_
+
+#include <deque>
+#include <vector>
+#include <boost/thread.hpp>
+#include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/noncopyable.hpp>
+
+namespace moveit
+{
+namespace tools
+{
+
+/** \brief A flag that can be set from any thread to ask parallel work to stop early */
+class CancellationToken : private boost::noncopyable
+{
+public:
+
+  CancellationToken() : cancelled_(false)
+  {
+  }
+
+  void cancel()
+  {
+    cancelled_ = true;
+  }
+
+  void reset()
+  {
+    cancelled_ = false;
+  }
+
+  bool isCancelled() const
+  {
+    return cancelled_;
+  }
+
+private:
+
+  volatile bool cancelled_;
+};
+
+/** \brief A work-stealing pool of threads for fork-join parallelism inside MoveIt! algorithms.
+
+    One process-wide pool (Instance()) is meant to be shared by all parallel algorithms, so that nested or concurrent
+    parallel calls do not oversubscribe the cores. Each worker has its own task queue; idle workers steal tasks from
+    the others. Threads that wait for their tasks to finish (including the thread that calls parallelFor()) execute
+    pending tasks in the meantime, so parallel calls can be nested. Tasks should not block on each other. */
+class ThreadPool : private boost::noncopyable
+{
+public:
+
+  typedef boost::function<void(std::size_t)> IndexFn;
+  typedef boost::function<void(std::size_t, std::size_t)> RangeFn;
+
+  /** \brief Construct a pool that runs work on \e threads threads in total, counting the calling thread (so \e threads - 1
+      workers are started). If \e threads is 0, the number of hardware threads is used. If \e pin_threads is true, the
+      workers are bound to distinct cores (Linux only). */
+  ThreadPool(unsigned int threads = 0, bool pin_threads = false);
+
+  ~ThreadPool();
+
+  /** \brief Get the process-wide pool. It is constructed on first use, with the settings passed to Configure() if any */
+  static ThreadPool& Instance();
+
+  /** \brief Set the settings of the process-wide pool. This must be called before the first call to Instance(); return false
+      (and keep the existing pool) otherwise */
+  static bool Configure(unsigned int threads, bool pin_threads = false);
+
+  /** \brief The number of threads work is distributed over, including the calling thread */
+  unsigned int getThreadCount() const
+  {
+    return workers_.size() + 1;
+  }
+
+  /** \brief Call \e fn(i) for all \e i in [\e begin, \e end), in parallel, and wait for all calls to finish. Indices are
+      processed in chunks of at least \e grain. If \e cancel is given and gets cancelled, the remaining indices are skipped.
+      An exception thrown by \e fn cancels the remaining indices of this call; once all started calls have finished, the
+      first such exception is rethrown in the calling thread. Standard exceptions keep their standard type (see
+      boost::current_exception()). */
+  void parallelFor(std::size_t begin, std::size_t end, const IndexFn &fn, std::size_t grain = 1, CancellationToken *cancel = NULL);
+
+  /** \brief Same as parallelFor(), but \e fn(b, e) is called once per chunk [\e b, \e e) */
+  void parallelForRange(std::size_t begin, std::size_t end, const RangeFn &fn, std::size_t grain = 1, CancellationToken *cancel = NULL);
+
+  /** \brief Run \e count instances of \e fn concurrently (as far as threads are available) and wait for all of them.
+      This suits workers that pull items from a shared queue until it is empty. As for parallelFor(), the first exception
+      thrown by an instance is rethrown in the calling thread once all instances have finished. */
+  void runConcurrently(const boost::function<void()> &fn, unsigned int count);
+
+private:
+
+  struct TaskGroup;
+  struct TaskErrors;
+
+  struct Task
+  {
+    boost::function<void()> fn_;
+    TaskGroup *group_;
+  };
+
+  struct Worker
+  {
+    boost::mutex lock_;
+    std::deque<Task> tasks_;
+    boost::shared_ptr<boost::thread> thread_;
+  };
+
+  void workerThread(std::size_t index, bool pin);
+
+  void submit(const std::vector<Task> &tasks);
+
+  bool runOneTask(int own_index);
+
+  bool popTask(int own_index, Task &task);
+
+  void wait(TaskGroup &group);
+
+  std::vector<boost::shared_ptr<Worker> > workers_;
+
+  /// signalled when tasks are added or the pool stops
+  boost::mutex idle_lock_;
+  boost::condition_variable idle_condition_;
+  std::size_t queued_;
+  bool stop_;
+
+  /// where tasks submitted by threads outside the pool go next
+  std::size_t next_worker_;
+};
+
+}
+}
+
+#endif
@@ -33,23 +33,29 @@
  *********************************************************************/
 
 /* Author: Ioan Sucan */
-
 #include <moveit/background_processing/background_processing.h>
 #include <console_bridge/console.h>
 
-moveit::tools::BackgroundProcessing::BackgroundProcessing()
+moveit::tools::BackgroundProcessing::BackgroundProcessing(unsigned int workers)
 {
-  // spin a thread that will process user events
+  // spin the threads that will process user events
   run_processing_thread_ = true;
-  processing_ = false;
-  processing_thread_.reset(new boost::thread(boost::bind(&BackgroundProcessing::processingThread, this)));
+  processing_ = 0;
+  for (unsigned int i = 0 ; i < std::max(workers, 1u) ; ++i)
+    processing_threads_.push_back(boost::shared_ptr<boost::thread>(new boost::thread(boost::bind(&BackgroundProcessing::processingThread, this))));
 }
 
 moveit::tools::BackgroundProcessing::~BackgroundProcessing()
 {
-  run_processing_thread_ = false;
+  {
+    boost::mutex::scoped_lock _(action_lock_);
+    run_processing_thread_ = false;
+    for (unsigned int p = 0 ; p < PRIORITY_COUNT ; ++p)
+      actions_[p].clear();
+  }
   new_action_condition_.notify_all();
-  processing_thread_->join();
+  for (std::size_t i = 0 ; i < processing_threads_.size() ; ++i)
+    processing_threads_[i]->join();
 }
 
 void moveit::tools::BackgroundProcessing::processingThread()
@@ -58,72 +64,151 @@ void moveit::tools::BackgroundProcessing::processingThread()
 
   while (run_processing_thread_)
   {
-    while (actions_.empty() && run_processing_thread_)
+    // pick the oldest job of the highest priority
+    unsigned int p = 0;
+    while (p < PRIORITY_COUNT && actions_[p].empty())
+      ++p;
+    if (p == PRIORITY_COUNT)
+    {
       new_action_condition_.wait(ulock);
+      continue;
+    }
+
+    Job job = actions_[p].front();
+    actions_[p].pop_front();
+    processing_++;
 
-    while (!actions_.empty())
+    // make sure we are unlocked while we process the event
+    action_lock_.unlock();
+    boost::posix_time::ptime start = boost::posix_time::microsec_clock::universal_time();
+    try
     {
-      JobCallback fn = actions_.front();
-      std::string action_name = action_names_.front();
-      actions_.pop_front();
-      action_names_.pop_front();
-      processing_ = true;
-
-      // make sure we are unlocked while we process the event
-      action_lock_.unlock();
-      try
-      {
-        logDebug("Begin executing '%s'", action_name.c_str());
-        fn();
-        logDebug("Done executing '%s'", action_name.c_str());
-      }
-      catch(std::runtime_error &ex)
-      {
-        logError("Exception caught while processing action '%s': %s", action_name.c_str(), ex.what());
-      }
-      catch(...)
-      {
-        logError("Exception caught while processing action '%s'", action_name.c_str());
-      }
-      processing_ = false;
-      if (queue_change_event_)
-        queue_change_event_(COMPLETE, action_name);
-      action_lock_.lock();
+      logDebug("Begin executing '%s'", job.name_.c_str());
+      job.fn_();
+      logDebug("Done executing '%s'", job.name_.c_str());
     }
+    catch(std::runtime_error &ex)
+    {
+      logError("Exception caught while processing action '%s': %s", job.name_.c_str(), ex.what());
+    }
+    catch(...)
+    {
+      logError("Exception caught while processing action '%s'", job.name_.c_str());
+    }
+    boost::posix_time::ptime end = boost::posix_time::microsec_clock::universal_time();
+    if (queue_change_event_)
+      queue_change_event_(COMPLETE, job.name_);
+    action_lock_.lock();
+
+    processing_--;
+    double wait = (double)(start - job.enqueued_).total_microseconds() * 1e-6;
+    JobStatistics &stats = statistics_[p];
+    stats.completed_++;
+    stats.total_wait_ += wait;
+    if (wait > stats.max_wait_)
+      stats.max_wait_ = wait;
+    stats.total_run_ += (double)(end - start).total_microseconds() * 1e-6;
   }
 }
 
 void moveit::tools::BackgroundProcessing::addJob(const boost::function<void()> &job, const std::string &name)
 {
+  addJob(job, name, NORMAL, false);
+}
+
+void moveit::tools::BackgroundProcessing::addJob(const JobCallback &job, const std::string &name, JobPriority priority, bool coalesce)
+{
+  bool replaced = false;
   {
     boost::mutex::scoped_lock _(action_lock_);
-    actions_.push_back(job);
-    action_names_.push_back(name);
-    new_action_condition_.notify_all();
+    if (coalesce)
+      for (unsigned int p = 0 ; p < PRIORITY_COUNT && !replaced ; ++p)
+        for (std::deque<Job>::iterator it = actions_[p].begin() ; it != actions_[p].end() ; ++it)
+          if (it->name_ == name)
+          {
+            // keep the position (and waiting time) of the superseded job
+            it->fn_ = job;
+            statistics_[p].removed_++;
+            replaced = true;
+            break;
+          }
+    if (!replaced)
+    {
+      Job j;
+      j.fn_ = job;
+      j.name_ = name;
+      j.enqueued_ = boost::posix_time::microsec_clock::universal_time();
+      actions_[std::min((unsigned int)priority, PRIORITY_COUNT - 1)].push_back(j);
+    }
+    new_action_condition_.notify_one();
   }
   if (queue_change_event_)
+  {
+    if (replaced)
+      queue_change_event_(REMOVE, name);
     queue_change_event_(ADD, name);
+  }
+}
+
+std::size_t moveit::tools::BackgroundProcessing::cancelJobs(const std::string &name)
+{
+  std::size_t removed = 0;
+  {
+    boost::mutex::scoped_lock _(action_lock_);
+    for (unsigned int p = 0 ; p < PRIORITY_COUNT ; ++p)
+      for (std::deque<Job>::iterator it = actions_[p].begin() ; it != actions_[p].end() ; )
+        if (it->name_ == name)
+        {
+          it = actions_[p].erase(it);
+          statistics_[p].removed_++;
+          removed++;
+        }
+        else
+          ++it;
+  }
+  if (queue_change_event_)
+    for (std::size_t i = 0 ; i < removed ; ++i)
+      queue_change_event_(REMOVE, name);
+  return removed;
 }
 
 void moveit::tools::BackgroundProcessing::clear()
 {
-  bool update = false;
-  std::deque<std::string> removed;
+  std::deque<Job> removed;
   {
     boost::mutex::scoped_lock _(action_lock_);
-    update = !actions_.empty();
-    actions_.clear();
-    action_names_.swap(removed);
+    for (unsigned int p = 0 ; p < PRIORITY_COUNT ; ++p)
+    {
+      statistics_[p].removed_ += actions_[p].size();
+      removed.insert(removed.end(), actions_[p].begin(), actions_[p].end());
+      actions_[p].clear();
+    }
   }
-  if (update && queue_change_event_)
-    for (std::deque<std::string>::iterator it = removed.begin() ; it != removed.end() ; ++it)
-      queue_change_event_(REMOVE, *it);
+  if (queue_change_event_)
+    for (std::deque<Job>::iterator it = removed.begin() ; it != removed.end() ; ++it)
+      queue_change_event_(REMOVE, it->name_);
 }
 
 std::size_t moveit::tools::BackgroundProcessing::getJobCount() const
 {
   boost::mutex::scoped_lock _(action_lock_);
-  return actions_.size() + (processing_ ? 1 : 0);
+  std::size_t count = processing_;
+  for (unsigned int p = 0 ; p < PRIORITY_COUNT ; ++p)
+    count += actions_[p].size();
+  return count;
+}
+
+moveit::tools::BackgroundProcessing::JobStatistics moveit::tools::BackgroundProcessing::getJobStatistics(JobPriority priority) const
+{
+  boost::mutex::scoped_lock _(action_lock_);
+  return statistics_[std::min((unsigned int)priority, PRIORITY_COUNT - 1)];
+}
+
+void moveit::tools::BackgroundProcessing::resetJobStatistics()
+{
+  boost::mutex::scoped_lock _(action_lock_);
+  for (unsigned int p = 0 ; p < PRIORITY_COUNT ; ++p)
+    statistics_[p] = JobStatistics();
 }
 
 void moveit::tools::BackgroundProcessing::setJobUpdateEvent(const JobUpdateCallback &event)
@@ -0,0 +1,386 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2013, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#include <moveit/background_processing/thread_pool.h>
+#include <console_bridge/console.h>
+#include <boost/bind.hpp>
+#include <boost/exception_ptr.hpp>
+#include <algorithm>
+#include <stdexcept>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+struct moveit::tools::ThreadPool::TaskGroup
+{
+  TaskGroup(std::size_t pending) : pending_(pending)
+  {
+  }
+
+  boost::mutex lock_;
+  boost::condition_variable done_;
+  std::size_t pending_;
+};
+
+// the first exception thrown by the tasks of one call; cancelled_ is set once there is one
+struct moveit::tools::ThreadPool::TaskErrors
+{
+  void report()
+  {
+    boost::mutex::scoped_lock slock(lock_);
+    if (!first_)
+      first_ = boost::current_exception();
+    cancelled_.cancel();
+  }
+
+  void rethrow()
+  {
+    if (first_)
+      boost::rethrow_exception(first_);
+  }
+
+  boost::mutex lock_;
+  boost::exception_ptr first_;
+  CancellationToken cancelled_;
+};
+
+namespace
+{
+
+// the pool a thread works for, and its index in that pool
+struct WorkerIdentity
+{
+  const moveit::tools::ThreadPool *pool_;
+  int index_;
+};
+
+boost::thread_specific_ptr<WorkerIdentity>& getWorkerIdentity()
+{
+  static boost::thread_specific_ptr<WorkerIdentity> identity;
+  return identity;
+}
+
+struct PoolSettings
+{
+  PoolSettings() : threads_(0), pin_(false), pool_(NULL)
+  {
+  }
+
+  boost::mutex lock_;
+  unsigned int threads_;
+  bool pin_;
+  moveit::tools::ThreadPool *pool_;
+};
+
+PoolSettings& getPoolSettings()
+{
+  static PoolSettings settings;
+  return settings;
+}
+
+template<typename Errors>
+void runChunk(const moveit::tools::ThreadPool::RangeFn &fn, std::size_t begin, std::size_t end,
+              moveit::tools::CancellationToken *cancel, Errors *errors)
+{
+  if ((cancel && cancel->isCancelled()) || errors->cancelled_.isCancelled())
+    return;
+  try
+  {
+    fn(begin, end);
+  }
+  catch(...)
+  {
+    errors->report();
+  }
+}
+
+void loopIndices(const moveit::tools::ThreadPool::IndexFn &fn, moveit::tools::CancellationToken *cancel, std::size_t begin, std::size_t end)
+{
+  for (std::size_t i = begin ; i < end ; ++i)
+  {
+    if (cancel && cancel->isCancelled())
+      return;
+    fn(i);
+  }
+}
+
+void runInstance(const boost::function<void()> &fn, std::size_t, std::size_t)
+{
+  fn();
+}
+
+}
+
+moveit::tools::ThreadPool::ThreadPool(unsigned int threads, bool pin_threads) : queued_(0), stop_(false), next_worker_(0)
+{
+  if (threads == 0)
+    threads = std::max(1u, boost::thread::hardware_concurrency());
+  for (unsigned int i = 1 ; i < threads ; ++i)
+    workers_.push_back(boost::shared_ptr<Worker>(new Worker()));
+  for (std::size_t i = 0 ; i < workers_.size() ; ++i)
+    workers_[i]->thread_.reset(new boost::thread(boost::bind(&ThreadPool::workerThread, this, i, pin_threads)));
+}
+
+moveit::tools::ThreadPool::~ThreadPool()
+{
+  {
+    boost::mutex::scoped_lock slock(idle_lock_);
+    stop_ = true;
+  }
+  idle_condition_.notify_all();
+  for (std::size_t i = 0 ; i < workers_.size() ; ++i)
+    workers_[i]->thread_->join();
+}
+
+moveit::tools::ThreadPool& moveit::tools::ThreadPool::Instance()
+{
+  PoolSettings &settings = getPoolSettings();
+  boost::mutex::scoped_lock slock(settings.lock_);
+  // the shared pool is never destroyed, so it can be used until the process exits
+  if (!settings.pool_)
+    settings.pool_ = new ThreadPool(settings.threads_, settings.pin_);
+  return *settings.pool_;
+}
+
+bool moveit::tools::ThreadPool::Configure(unsigned int threads, bool pin_threads)
+{
+  PoolSettings &settings = getPoolSettings();
+  boost::mutex::scoped_lock slock(settings.lock_);
+  if (settings.pool_)
+  {
+    logWarn("The shared thread pool is already in use; its configuration cannot be changed");
+    return false;
+  }
+  settings.threads_ = threads;
+  settings.pin_ = pin_threads;
+  return true;
+}
+
+void moveit::tools::ThreadPool::workerThread(std::size_t index, bool pin)
+{
+  WorkerIdentity *identity = new WorkerIdentity();
+  identity->pool_ = this;
+  identity->index_ = index;
+  getWorkerIdentity().reset(identity);
+
+#ifdef __linux__
+  if (pin)
+  {
+    // the calling threads are not pinned; workers take the remaining cores
+    unsigned int cores = std::max(1u, boost::thread::hardware_concurrency());
+    cpu_set_t cpuset;
+    CPU_ZERO(&cpuset);
+    CPU_SET((index + 1) % cores, &cpuset);
+    if (pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpuset) != 0)
+      logWarn("Unable to set the affinity of thread pool worker %u", (unsigned int)index);
+  }
+#endif
+
+  while (true)
+  {
+    if (runOneTask(index))
+      continue;
+    boost::mutex::scoped_lock slock(idle_lock_);
+    while (queued_ == 0 && !stop_)
+      idle_condition_.wait(slock);
+    if (stop_ && queued_ == 0)
+      break;
+  }
+}
+
+bool moveit::tools::ThreadPool::popTask(int own_index, Task &task)
+{
+  bool found = false;
+  // own tasks are taken from the back (most recently forked), others' are stolen from the front
+  if (own_index >= 0)
+  {
+    Worker &w = *workers_[own_index];
+    boost::mutex::scoped_lock slock(w.lock_);
+    if (!w.tasks_.empty())
+    {
+      task = w.tasks_.back();
+      w.tasks_.pop_back();
+      found = true;
+    }
+  }
+  for (std::size_t k = 0 ; k < workers_.size() && !found ; ++k)
+  {
+    std::size_t victim = (own_index + 1 + k) % workers_.size();
+    if ((int)victim == own_index)
+      continue;
+    Worker &w = *workers_[victim];
+    boost::mutex::scoped_lock slock(w.lock_);
+    if (!w.tasks_.empty())
+    {
+      task = w.tasks_.front();
+      w.tasks_.pop_front();
+      found = true;
+    }
+  }
+  if (found)
+  {
+    boost::mutex::scoped_lock slock(idle_lock_);
+    queued_--;
+  }
+  return found;
+}
+
+bool moveit::tools::ThreadPool::runOneTask(int own_index)
+{
+  Task task;
+  if (!popTask(own_index, task))
+    return false;
+  task.fn_();
+  boost::mutex::scoped_lock slock(task.group_->lock_);
+  if (--task.group_->pending_ == 0)
+    task.group_->done_.notify_all();
+  return true;
+}
+
+void moveit::tools::ThreadPool::submit(const std::vector<Task> &tasks)
+{
+  WorkerIdentity *identity = getWorkerIdentity().get();
+  if (identity && identity->pool_ == this)
+  {
+    Worker &w = *workers_[identity->index_];
+    boost::mutex::scoped_lock slock(w.lock_);
+    w.tasks_.insert(w.tasks_.end(), tasks.begin(), tasks.end());
+  }
+  else
+  {
+    std::size_t first;
+    {
+      boost::mutex::scoped_lock slock(idle_lock_);
+      first = next_worker_;
+      next_worker_ = (next_worker_ + tasks.size()) % workers_.size();
+    }
+    for (std::size_t i = 0 ; i < tasks.size() ; ++i)
+    {
+      Worker &w = *workers_[(first + i) % workers_.size()];
+      boost::mutex::scoped_lock slock(w.lock_);
+      w.tasks_.push_back(tasks[i]);
+    }
+  }
+  {
+    boost::mutex::scoped_lock slock(idle_lock_);
+    queued_ += tasks.size();
+  }
+  idle_condition_.notify_all();
+}
+
+void moveit::tools::ThreadPool::wait(TaskGroup &group)
+{
+  WorkerIdentity *identity = getWorkerIdentity().get();
+  int own_index = identity && identity->pool_ == this ? identity->index_ : -1;
+  while (true)
+  {
+    {
+      boost::mutex::scoped_lock slock(group.lock_);
+      if (group.pending_ == 0)
+        return;
+    }
+    // help with pending work instead of blocking
+    if (!runOneTask(own_index))
+    {
+      boost::mutex::scoped_lock slock(group.lock_);
+      if (group.pending_ == 0)
+        return;
+      group.done_.timed_wait(slock, boost::posix_time::milliseconds(1));
+    }
+  }
+}
+
+void moveit::tools::ThreadPool::parallelForRange(std::size_t begin, std::size_t end, const RangeFn &fn, std::size_t grain, CancellationToken *cancel)
+{
+  if (end <= begin)
+    return;
+  std::size_t n = end - begin;
+  grain = std::max<std::size_t>(grain, 1);
+  // a few chunks per thread, so that stealing can balance uneven work
+  std::size_t chunks = std::min<std::size_t>((n + grain - 1) / grain, getThreadCount() * 4);
+  TaskErrors errors;
+  if (chunks <= 1 || workers_.empty())
+  {
+    runChunk(fn, begin, end, cancel, &errors);
+    errors.rethrow();
+    return;
+  }
+
+  std::size_t chunk_size = (n + chunks - 1) / chunks;
+  TaskGroup group(0);
+  std::vector<Task> tasks;
+  for (std::size_t b = begin ; b < end ; b += chunk_size)
+  {
+    Task t;
+    t.fn_ = boost::bind(&runChunk<TaskErrors>, boost::cref(fn), b, std::min(end, b + chunk_size), cancel, &errors);
+    t.group_ = &group;
+    tasks.push_back(t);
+  }
+  group.pending_ = tasks.size();
+  submit(tasks);
+  wait(group);
+  errors.rethrow();
+}
+
+void moveit::tools::ThreadPool::parallelFor(std::size_t begin, std::size_t end, const IndexFn &fn, std::size_t grain, CancellationToken *cancel)
+{
+  parallelForRange(begin, end, boost::bind(&loopIndices, boost::cref(fn), cancel, _1, _2), grain, cancel);
+}
+
+void moveit::tools::ThreadPool::runConcurrently(const boost::function<void()> &fn, unsigned int count)
+{
+  if (count == 0)
+    return;
+  // the calling thread runs one instance itself
+  TaskErrors errors;
+  RangeFn instance = boost::bind(&runInstance, boost::cref(fn), _1, _2);
+  if (count > 1 && !workers_.empty())
+  {
+    TaskGroup group(count - 1);
+    std::vector<Task> tasks(count - 1);
+    for (std::size_t i = 0 ; i < tasks.size() ; ++i)
+    {
+      tasks[i].fn_ = boost::bind(&runChunk<TaskErrors>, instance, 0, 1, (CancellationToken*)NULL, &errors);
+      tasks[i].group_ = &group;
+    }
+    submit(tasks);
+    runChunk(instance, 0, 1, NULL, &errors);
+    wait(group);
+  }
+  else
+    for (unsigned int i = 0 ; i < count ; ++i)
+      runChunk(instance, 0, 1, NULL, &errors);
+  errors.rethrow();
+}
@@ -0,0 +1,219 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2013, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+
+#include <gtest/gtest.h>
+#include <moveit/background_processing/thread_pool.h>
+#include <boost/bind.hpp>
+#include <boost/thread/mutex.hpp>
+#include <stdexcept>
+#include <vector>
+#include <set>
+
+namespace
+{
+
+void square(std::vector<int> *values, std::size_t i)
+{
+  (*values)[i] = (int)(i * i);
+}
+
+void addRange(boost::mutex *lock, std::size_t *sum, std::size_t begin, std::size_t end)
+{
+  std::size_t local = 0;
+  for (std::size_t i = begin ; i < end ; ++i)
+    local += i;
+  boost::mutex::scoped_lock slock(*lock);
+  *sum += local;
+}
+
+void throwAt(std::size_t at, std::size_t i)
+{
+  if (i == at)
+    throw std::runtime_error("failed index");
+}
+
+void cancelAt(moveit::tools::CancellationToken *cancel, std::size_t at, std::vector<int> *visited, std::size_t i)
+{
+  (*visited)[i] = 1;
+  if (i == at)
+    cancel->cancel();
+}
+
+// a nested parallel call from inside a task
+void nested(moveit::tools::ThreadPool *pool, std::vector<std::vector<int> > *values, std::size_t i)
+{
+  pool->parallelFor(0, (*values)[i].size(), boost::bind(&square, &(*values)[i], _1));
+}
+
+struct QueueWork
+{
+  QueueWork(std::size_t items) : next_(0), items_(items), done_(0)
+  {
+  }
+
+  void run()
+  {
+    while (true)
+    {
+      boost::mutex::scoped_lock slock(lock_);
+      if (next_ >= items_)
+        return;
+      next_++;
+      done_++;
+      threads_.insert(boost::this_thread::get_id());
+    }
+  }
+
+  boost::mutex lock_;
+  std::size_t next_;
+  std::size_t items_;
+  std::size_t done_;
+  std::set<boost::thread::id> threads_;
+};
+
+void throwAlways()
+{
+  throw std::invalid_argument("failed instance");
+}
+
+}
+
+TEST(ThreadPool, ParallelForVisitsEveryIndex)
+{
+  moveit::tools::ThreadPool pool(4);
+  EXPECT_EQ(4u, pool.getThreadCount());
+  std::vector<int> values(1000, -1);
+  pool.parallelFor(0, values.size(), boost::bind(&square, &values, _1), 7);
+  for (std::size_t i = 0 ; i < values.size() ; ++i)
+    EXPECT_EQ((int)(i * i), values[i]);
+}
+
+TEST(ThreadPool, ParallelForRangeCoversTheRangeOnce)
+{
+  moveit::tools::ThreadPool pool(3);
+  boost::mutex lock;
+  std::size_t sum = 0;
+  pool.parallelForRange(10, 1010, boost::bind(&addRange, &lock, &sum, _1, _2), 16);
+  std::size_t expected = 0;
+  for (std::size_t i = 10 ; i < 1010 ; ++i)
+    expected += i;
+  EXPECT_EQ(expected, sum);
+
+  // empty ranges do nothing
+  sum = 0;
+  pool.parallelForRange(5, 5, boost::bind(&addRange, &lock, &sum, _1, _2));
+  EXPECT_EQ(0u, sum);
+}
+
+TEST(ThreadPool, SingleThreadRunsOnTheCaller)
+{
+  moveit::tools::ThreadPool pool(1);
+  EXPECT_EQ(1u, pool.getThreadCount());
+  std::vector<int> values(100, -1);
+  pool.parallelFor(0, values.size(), boost::bind(&square, &values, _1));
+  for (std::size_t i = 0 ; i < values.size() ; ++i)
+    EXPECT_EQ((int)(i * i), values[i]);
+}
+
+TEST(ThreadPool, NestedCallsComplete)
+{
+  moveit::tools::ThreadPool pool(4);
+  std::vector<std::vector<int> > values(32, std::vector<int>(64, -1));
+  pool.parallelFor(0, values.size(), boost::bind(&nested, &pool, &values, _1));
+  for (std::size_t i = 0 ; i < values.size() ; ++i)
+    for (std::size_t j = 0 ; j < values[i].size() ; ++j)
+      EXPECT_EQ((int)(j * j), values[i][j]);
+}
+
+TEST(ThreadPool, ExceptionsReachTheCaller)
+{
+  moveit::tools::ThreadPool pool(4);
+  EXPECT_THROW(pool.parallelFor(0, 1000, boost::bind(&throwAt, 500, _1)), std::runtime_error);
+  EXPECT_THROW(pool.runConcurrently(&throwAlways, 4), std::invalid_argument);
+
+  // on a single thread as well
+  moveit::tools::ThreadPool single(1);
+  EXPECT_THROW(single.parallelFor(0, 10, boost::bind(&throwAt, 3, _1)), std::runtime_error);
+  EXPECT_THROW(single.runConcurrently(&throwAlways, 2), std::invalid_argument);
+
+  // the pool is still usable after a failed call
+  std::vector<int> values(100, -1);
+  pool.parallelFor(0, values.size(), boost::bind(&square, &values, _1));
+  for (std::size_t i = 0 ; i < values.size() ; ++i)
+    EXPECT_EQ((int)(i * i), values[i]);
+}
+
+TEST(ThreadPool, CancellationSkipsRemainingIndices)
+{
+  moveit::tools::ThreadPool pool(1);
+  moveit::tools::CancellationToken cancel;
+  std::vector<int> visited(100, 0);
+  pool.parallelFor(0, visited.size(), boost::bind(&cancelAt, &cancel, 10, &visited, _1), 1, &cancel);
+  EXPECT_TRUE(cancel.isCancelled());
+  for (std::size_t i = 0 ; i < visited.size() ; ++i)
+    EXPECT_EQ(i <= 10 ? 1 : 0, visited[i]);
+
+  // a token that is already cancelled skips everything
+  std::vector<int> values(100, -1);
+  moveit::tools::ThreadPool parallel(4);
+  parallel.parallelFor(0, values.size(), boost::bind(&square, &values, _1), 1, &cancel);
+  for (std::size_t i = 0 ; i < values.size() ; ++i)
+    EXPECT_EQ(-1, values[i]);
+}
+
+TEST(ThreadPool, RunConcurrentlyDrainsASharedQueue)
+{
+  moveit::tools::ThreadPool pool(4);
+  QueueWork work(10000);
+  pool.runConcurrently(boost::bind(&QueueWork::run, &work), 4);
+  EXPECT_EQ(10000u, work.done_);
+  EXPECT_GE(work.threads_.size(), 1u);
+  EXPECT_LE(work.threads_.size(), 4u);
+}
+
+TEST(ThreadPool, SharedInstance)
+{
+  moveit::tools::ThreadPool &pool = moveit::tools::ThreadPool::Instance();
+  EXPECT_EQ(&pool, &moveit::tools::ThreadPool::Instance());
+  EXPECT_GE(pool.getThreadCount(), 1u);
+  // the shared pool is in use, so it cannot be configured anymore
+  EXPECT_FALSE(moveit::tools::ThreadPool::Configure(2));
+}
+
+int main(int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
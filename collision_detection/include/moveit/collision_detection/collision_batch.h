@@ -0,0 +1,59 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2013, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+
+#ifndef MOVEIT_COLLISION_DETECTION_COLLISION_BATCH_
+#define MOVEIT_COLLISION_DETECTION_COLLISION_BATCH_
+
+#include <moveit/collision_detection/collision_common.h>
+#include <boost/function.hpp>
+#include <vector>
+
+namespace collision_detection
+{
+
+/** \brief Signature of a function that performs the collision check for the element at position \e index of a batch */
+typedef boost::function<void(std::size_t index, CollisionResult &res)> BatchCollisionCheckFn;
+
+/** \brief Call \e check for every index in [0, \e count) and store the results in \e res (resized to \e count).
+    The checks are distributed over \e thread_count threads (if 0, the size of the shared thread pool is used). Indices are
+    handed out in increasing order, so if \e stop_at_first_collision is true, no index after the first one found in
+    collision is checked; the results for the indices that are not checked are left cleared.
+    Return the lowest index of an element found in collision, or -1 if no collision was found. */
+int checkCollisionBatch(const BatchCollisionCheckFn &check, std::size_t count, std::vector<CollisionResult> &res,
+                        bool stop_at_first_collision = false, unsigned int thread_count = 0);
+
+}
+
+#endif
@@ -41,6 +41,7 @@
 #include <boost/function.hpp>
 #include <vector>
 #include <string>
+#include <limits>
 #include <map>
 #include <set>
 #include <Eigen/Core>
@@ -95,6 +96,35 @@ namespace collision_detection
     BodyType        body_type_2;
   };
 
+  /** \brief Definition of a contact point in which bodies are identified by the index of their id
+      (see AllowedCollisionMatrix::getNameIndex()), so that storing it does not allocate memory. The indices
+      denote the ids of the bodies as long as the collision geometry of the bodies exists */
+  struct FlatContact
+  {
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+    /** \brief contact position */
+    Eigen::Vector3d pos;
+
+    /** \brief normal unit vector at contact */
+    Eigen::Vector3d normal;
+
+    /** \brief depth (penetration between bodies) */
+    double          depth;
+
+    /** \brief The index of the id of the first body involved in the contact */
+    std::size_t     body_index_1;
+
+    /** \brief The type of the first body involved in the contact */
+    BodyType        body_type_1;
+
+    /** \brief The index of the id of the second body involved in the contact */
+    std::size_t     body_index_2;
+
+    /** \brief The type of the second body involved in the contact */
+    BodyType        body_type_2;
+  };
+
   /** \brief When collision costs are computed, this structure contains information about the partial cost incurred in a particular volume */
   struct CostSource
   {
@@ -149,9 +179,14 @@ namespace collision_detection
       distance = std::numeric_limits<double>::max();
       contact_count = 0;
       contacts.clear();
+      flat_contacts.clear();
       cost_sources.clear();
     }
 
+    /** \brief Fill \e contact_map with the contacts in flat_contacts, keyed by the pair of body ids.
+        The contents of \e contact_map are replaced. */
+    void getContactMap(ContactMap &contact_map) const;
+
     /** \brief True if collision was found, false otherwise */
     bool                 collision;
 
@@ -164,6 +199,11 @@ namespace collision_detection
     /** \brief A map returning the pairs of ids of the bodies in contact, plus information about the contacts themselves */
     ContactMap           contacts;
 
+    /** \brief The contacts found, if CollisionRequest::flat_contacts was set (contacts is then left empty). The memory
+        is kept by clear(), so a result that is reused for many checks does not allocate memory for contacts. Contacts
+        between the same pair of bodies are not necessarily consecutive. */
+    std::vector<FlatContact> flat_contacts;
+
     /** \brief When costs are computed, the individual cost sources are  */
     std::set<CostSource> cost_sources;
   };
@@ -178,6 +218,8 @@ namespace collision_detection
                          max_contacts_per_pair(1),
                          max_cost_sources(1),
                          min_cost_density(0.2),
+                         flat_contacts(false),
+                         cascade(false),
                          verbose(false)
     {
     }
@@ -207,6 +249,16 @@ namespace collision_detection
     /** \brief When costs are computed, this is the minimum cost density for a CostSource to be included in the results */
     double      min_cost_density;
 
+    /** \brief If true, contacts are stored in CollisionResult::flat_contacts rather than CollisionResult::contacts.
+        This avoids allocating memory for each contact; CollisionResult::getContactMap() converts the result when needed. */
+    bool        flat_contacts;
+
+    /** \brief If true, pairs of bodies that involve a mesh are first checked using convex hulls that contain the meshes
+        (computed once per shape, by the first request that uses them), and the meshes themselves are checked only if the
+        hulls intersect. This is faster when the bounding boxes of detailed meshes often overlap while the meshes do not;
+        the result is the same. */
+    bool        cascade;
+
     /** \brief Function call that decides whether collision detection should stop. */
     boost::function<bool(const CollisionResult&)>
                 is_done;
@@ -215,6 +267,102 @@ namespace collision_detection
     bool        verbose;
   };
 
+  /** \brief Representation of a distance query */
+  struct DistanceRequest
+  {
+    DistanceRequest() : max_distance(std::numeric_limits<double>::max()),
+                        stop_below_max_distance(false),
+                        enable_nearest_points(false),
+                        compute_link_distances(false)
+    {
+    }
+
+    /** \brief The group name to compute distances for (optional; if empty, assume the complete robot) */
+    std::string group_name;
+
+    /** \brief Distances larger than this are not computed: pairs of bodies whose bounding volumes are farther apart
+        are skipped, and if no pair is closer, the result is \e max_distance */
+    double      max_distance;
+
+    /** \brief If true, the query ends as soon as a pair of bodies closer than \e max_distance is found. The result is then the
+        distance of that pair, which is not necessarily the minimum; this is enough to decide whether the clearance exceeds
+        \e max_distance (e.g., a safety margin) */
+    bool        stop_below_max_distance;
+
+    /** \brief If true, the nearest points and the normal are computed for the reported pairs of bodies */
+    bool        enable_nearest_points;
+
+    /** \brief If true, the closest body to every robot link (and attached body) is reported in DistanceResult::link_distances,
+        from the same traversal as the minimum distance. Pairs are then skipped only if they are farther apart than the distances
+        already found for both their bodies (or than \e max_distance), and the query does not stop below \e max_distance */
+    bool        compute_link_distances;
+  };
+
+  /** \brief The closest pair of bodies found by a distance query */
+  struct DistanceResultsData
+  {
+    DistanceResultsData()
+    {
+      clear();
+    }
+
+    /** \brief Clear a previously stored result */
+    void clear()
+    {
+      distance = std::numeric_limits<double>::max();
+      nearest_points[0].setZero();
+      nearest_points[1].setZero();
+      normal.setZero();
+      body_names[0].clear();
+      body_names[1].clear();
+      body_types[0] = body_types[1] = BodyTypes::WORLD_OBJECT;
+    }
+
+    /** \brief The distance between the two bodies; negative values indicate penetration (the nearest points are then not computed) */
+    double          distance;
+
+    /** \brief The nearest points on the two bodies, in the model frame (if DistanceRequest::enable_nearest_points is set) */
+    Eigen::Vector3d nearest_points[2];
+
+    /** \brief The unit vector from the first nearest point to the second one (if DistanceRequest::enable_nearest_points is set);
+        moving the first body along this vector reduces the distance the fastest */
+    Eigen::Vector3d normal;
+
+    /** \brief The ids of the two bodies */
+    std::string     body_names[2];
+
+    /** \brief The types of the two bodies */
+    BodyType        body_types[2];
+  };
+
+  /** \brief Representation of the result of a distance query */
+  struct DistanceResult
+  {
+    DistanceResult() : distance(std::numeric_limits<double>::max())
+    {
+    }
+
+    /** \brief Clear a previously stored result */
+    void clear()
+    {
+      distance = std::numeric_limits<double>::max();
+      minimum_distance.clear();
+      link_distances.clear();
+    }
+
+    /** \brief The smallest distance found (see DistanceRequest for when this is not the minimum distance); negative values
+        indicate penetration */
+    double      distance;
+
+    /** \brief The pair of bodies at \e distance (not filled by backends that only compute distances) */
+    DistanceResultsData minimum_distance;
+
+    /** \brief If DistanceRequest::compute_link_distances is set, the closest body to each robot link or attached body found
+        below DistanceRequest::max_distance, keyed by the id of the robot body, which is always the first body of the pair
+        (not filled by backends that only compute distances) */
+    std::map<std::string, DistanceResultsData> link_distances;
+  };
+
 }
 
 #endif
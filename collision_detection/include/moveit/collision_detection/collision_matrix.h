@@ -40,6 +40,8 @@
 #include <moveit/collision_detection/collision_common.h>
 #include <moveit_msgs/AllowedCollisionMatrix.h>
 #include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/cstdint.hpp>
 #include <iostream>
 #include <vector>
 #include <string>
@@ -71,6 +73,78 @@ namespace collision_detection
   /** \brief Signature of predicate that decides whether a contact is allowed or not (when AllowedCollision::Type is CONDITIONAL) */
   typedef boost::function<bool(collision_detection::Contact&)> DecideContactFn;
 
+  /** @class CompiledAllowedCollisionMatrix
+   *  @brief A read-only snapshot of an AllowedCollisionMatrix, in which elements are referred to by their name index
+   *  (see AllowedCollisionMatrix::getNameIndex()). Queries for pairs of names are answered in constant time. */
+  class CompiledAllowedCollisionMatrix
+  {
+    friend class AllowedCollisionMatrix;
+
+  public:
+
+    /** @brief Same as AllowedCollisionMatrix::getAllowedCollision(), but for names identified by their indices */
+    bool getAllowedCollision(std::size_t index1, std::size_t index2, AllowedCollision::Type& allowed_collision) const
+    {
+      const int i1 = index1 < local_index_.size() ? local_index_[index1] : -1;
+      const int i2 = index2 < local_index_.size() ? local_index_[index2] : -1;
+      unsigned char v;
+      if (i1 >= 0 && i2 >= 0)
+        v = entries_[i1 * size_ + i2];
+      else
+        if (i1 >= 0)
+          v = default_entries_[i1];
+        else
+          if (i2 >= 0)
+            v = default_entries_[i2];
+          else
+            return false;
+      if (v == NOT_FOUND)
+        return false;
+      allowed_collision = static_cast<AllowedCollision::Type>(v);
+      return true;
+    }
+
+    /** @brief Same as AllowedCollisionMatrix::getAllowedCollision(), but for names identified by their indices. The
+     *  predicates of the pairs of type AllowedCollision::CONDITIONAL are kept in a table sorted by pair, so this costs
+     *  a binary search over the conditional pairs only */
+    bool getAllowedCollision(std::size_t index1, std::size_t index2, DecideContactFn &fn) const;
+
+    /** @brief Release the references to the name indices of the snapshot */
+    ~CompiledAllowedCollisionMatrix();
+
+  private:
+
+    static const unsigned char NOT_FOUND = 0xFF;
+
+    CompiledAllowedCollisionMatrix() : size_(0)
+    {
+    }
+
+    CompiledAllowedCollisionMatrix(const CompiledAllowedCollisionMatrix&);
+    CompiledAllowedCollisionMatrix& operator=(const CompiledAllowedCollisionMatrix&);
+
+    /// The name indices the snapshot holds a reference to (see AllowedCollisionMatrix::acquireNameIndex())
+    std::vector<std::size_t>   name_indices_;
+
+    /// The number of names known to the snapshot
+    std::size_t                size_;
+
+    /// For every name index, the position of the name in this snapshot (-1 if the name is not known)
+    std::vector<int>           local_index_;
+
+    /// A size_ x size_ matrix with the result of AllowedCollisionMatrix::getAllowedCollision() for pairs of known names
+    std::vector<unsigned char> entries_;
+
+    /// The result of AllowedCollisionMatrix::getAllowedCollision() for a known name paired with an unknown one
+    std::vector<unsigned char> default_entries_;
+
+    /// The predicates for the conditional entries, sorted by key: i * size_ + j for pairs of known names, and
+    /// size_ * size_ + i for the default of a known name i
+    std::vector<std::pair<std::size_t, DecideContactFn> > conditional_;
+  };
+
+  typedef boost::shared_ptr<const CompiledAllowedCollisionMatrix> CompiledAllowedCollisionMatrixConstPtr;
+
   /** @class AllowedCollisionMatrix
    *  @brief Definition of a structure for the allowed collision matrix. All elements in the collision world are referred to by their names.
    *   This class represents which collisions are allowed to happen and which are not. */
@@ -181,7 +255,15 @@ namespace collision_detection
     /** @brief Get the size of the allowed collision matrix (number of specified entries) */
     std::size_t getSize() const
     {
-      return entries_.size();
+      return data_->entries_.size();
+    }
+
+    /** @brief Get the version of the content of the matrix. Every modification assigns a new version, unique in the process;
+     *  copies have the version of the matrix they were copied from until they are modified. Matrices with the same
+     *  version have the same content. */
+    boost::uint64_t getVersion() const
+    {
+      return data_->version_;
     }
 
     /** @brief Set the default value for entries that include \e name. If such a default value is set, queries to getAllowedCollision() that include
@@ -233,14 +315,54 @@ namespace collision_detection
     /** @brief Print the allowed collision matrix */
     void print(std::ostream& out) const;
 
+    /** @brief Get the snapshot of this matrix that answers queries based on name indices. The snapshot is computed
+     *  when first needed and kept until the matrix is modified. This function is thread safe. */
+    CompiledAllowedCollisionMatrixConstPtr getCompiled() const;
+
+    /** @brief Get the index associated to a name. Indices are dense and start at 0; the same index is used for a name
+     *  in all instances of AllowedCollisionMatrix. The index of a name does not change as long as a reference to it is
+     *  held (see acquireNameIndex()); names nobody holds a reference to are forgotten once there are many of them,
+     *  and their indices are reused for other names. This function is thread safe. */
+    static std::size_t getNameIndex(const std::string &name);
+
+    /** @brief Same as getNameIndex(), but also take a reference to the index, so it keeps denoting \e name until
+     *  the matching releaseNameIndex(). This function is thread safe. */
+    static std::size_t acquireNameIndex(const std::string &name);
+
+    /** @brief Release a reference taken by acquireNameIndex(). This function is thread safe. */
+    static void releaseNameIndex(std::size_t index);
+
+    /** @brief Get the name associated to an index by getNameIndex(). An empty string is returned for unknown indices.
+     *  This function is thread safe. */
+    static std::string getNameFromIndex(std::size_t index);
+
   private:
 
-    std::map<std::string, std::map<std::string, AllowedCollision::Type> > entries_;
-    std::map<std::string, std::map<std::string, DecideContactFn> >        allowed_contacts_;
+    /** @brief The content of a matrix. It is shared by copies of the matrix, and copied when one of them is modified */
+    struct Data
+    {
+      Data();
+
+      std::map<std::string, std::map<std::string, AllowedCollision::Type> > entries_;
+      std::map<std::string, std::map<std::string, DecideContactFn> >        allowed_contacts_;
+
+      std::map<std::string, AllowedCollision::Type>                         default_entries_;
+      std::map<std::string, DecideContactFn>                                default_allowed_contacts_;
+
+      boost::uint64_t                                                       version_;
+
+      /// Computed when first needed; reset when the content changes
+      mutable CompiledAllowedCollisionMatrixConstPtr                        compiled_;
+      mutable boost::shared_ptr<const moveit_msgs::AllowedCollisionMatrix>  message_;
+    };
+
+    /** @brief Called before every modification: make the data unique to this matrix, assign a new version and drop the cached forms */
+    void modify();
 
-    std::map<std::string, AllowedCollision::Type>                         default_entries_;
-    std::map<std::string, DecideContactFn>                                default_allowed_contacts_;
+    void compile(CompiledAllowedCollisionMatrix &compiled) const;
+    void computeMessage(moveit_msgs::AllowedCollisionMatrix &msg) const;
 
+    boost::shared_ptr<Data> data_;
   };
 
   typedef boost::shared_ptr<AllowedCollisionMatrix> AllowedCollisionMatrixPtr;
@@ -166,6 +166,16 @@ namespace collision_detection
     virtual double distanceSelf(const robot_state::RobotState &state,
                                 const AllowedCollisionMatrix &acm) const = 0;
 
+    /** \brief Compute the distance to self-collision given the robot is at state \e state, as specified by \e req.
+        The default implementation computes the complete distance and clamps it to DistanceRequest::max_distance. */
+    virtual void distanceSelf(const DistanceRequest &req, DistanceResult &res, const robot_state::RobotState &state) const;
+
+    /** \brief Compute the distance to self-collision given the robot is at state \e state, as specified by \e req,
+        ignoring the distances between links that are allowed to always collide (as specified by \e acm).
+        The default implementation computes the complete distance and clamps it to DistanceRequest::max_distance. */
+    virtual void distanceSelf(const DistanceRequest &req, DistanceResult &res, const robot_state::RobotState &state,
+                              const AllowedCollisionMatrix &acm) const;
+
     /** \brief The distance to another robot instance.
         @param state The state of this robot to consider
         @param other_robot The other robot instance to measure distance to
@@ -235,6 +245,31 @@ namespace collision_detection
     /** @brief Get the link scaling as a vector of messages*/
     void getScale(std::vector<moveit_msgs::LinkScale> &scale) const;
 
+    /** @brief Check which of the points \e points (expressed in the model frame) are inside the robot at state \e state:
+     *  inside the shapes of the links with collision geometry, with their padding and scaling applied, or inside
+     *  the shapes of the attached bodies. Spheres, boxes, cylinders and the convex hulls of meshes are considered;
+     *  other shapes are ignored. Points outside the bounding box of the robot are rejected without further tests.
+     *  @param state The state of the robot (its collision body transforms must be up to date)
+     *  @param points The points to check
+     *  @param inside Filled with one flag per point
+     *  @param thread_count The number of threads to use; if 0, all the threads of the shared pool are used
+     *  @return The number of points inside the robot */
+    std::size_t checkPointsInside(const robot_state::RobotState &state, const EigenSTL::vector_Vector3d &points,
+                                  std::vector<bool> &inside, unsigned int thread_count = 1) const;
+
+    /** @brief Compute the signed distance from each of the points \e points (expressed in the model frame) to the
+     *  robot at state \e state, considering the same geometry as checkPointsInside(). Points inside the robot
+     *  get a negative distance. Distances larger than \e max_distance are not computed: \e max_distance is
+     *  reported instead. For meshes, the distance to the planes of the faces of the convex hull is used, which
+     *  is exact in front of the faces and a lower bound near the edges and vertices of the hull.
+     *  @param state The state of the robot (its collision body transforms must be up to date)
+     *  @param points The points to compute distances for
+     *  @param distances Filled with one distance per point
+     *  @param max_distance The largest distance of interest
+     *  @param thread_count The number of threads to use; if 0, all the threads of the shared pool are used */
+    void computePointDistances(const robot_state::RobotState &state, const EigenSTL::vector_Vector3d &points,
+                               std::vector<double> &distances, double max_distance, unsigned int thread_count = 1) const;
+
   protected:
 
     /** @brief When the scale or padding is changed for a set of links by any of the functions in this class, updatedPaddingOrScaling() function is called.
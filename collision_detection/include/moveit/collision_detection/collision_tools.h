@@ -38,6 +38,7 @@
 #define MOVEIT_COLLISION_DETECTION_COLLISION_TOOLS_
 
 #include <moveit/collision_detection/collision_common.h>
+#include <moveit/robot_state/robot_state.h>
 #include <moveit_msgs/CostSource.h>
 #include <moveit_msgs/ContactInformation.h>
 #include <visualization_msgs/MarkerArray.h>
@@ -70,14 +71,63 @@ void getCostMarkers(visualization_msgs::MarkerArray& arr,
 
 double getTotalCost(const std::set<CostSource> &cost_sources);
 
+/** \brief Accumulates cost sources (e.g., for all the waypoints of a trajectory), keeping only the \e max_sources
+    most costly ones. Memory use is bounded by \e max_sources, no matter how many sources are added. */
+class CostSourceAccumulator
+{
+public:
+
+  CostSourceAccumulator(std::size_t max_sources);
+
+  std::size_t getMaxCostSources() const
+  {
+    return max_sources_;
+  }
+
+  void add(const CostSource &cost_source);
+  void add(const std::set<CostSource> &cost_sources);
+
+  const std::set<CostSource>& getCostSources() const
+  {
+    return sources_;
+  }
+
+  /** \brief Exchange the accumulated sources with \e cost_sources */
+  void swap(std::set<CostSource> &cost_sources)
+  {
+    sources_.swap(cost_sources);
+  }
+
+  void clear()
+  {
+    sources_.clear();
+  }
+
+private:
+
+  std::size_t          max_sources_;
+  std::set<CostSource> sources_;
+};
+
 void removeCostSources(std::set<CostSource> &cost_sources, const std::set<CostSource> &cost_sources_to_remove, double overlap_fraction);
 void intersectCostSources(std::set<CostSource> &cost_sources, const std::set<CostSource> &a, const std::set<CostSource> &b);
+
+/** \brief Remove the cost sources that overlap a more costly cost source by at least \e overlap_fraction of the
+    volume of the more costly one. The kept sources are indexed in a grid, so each source is only compared to the
+    kept sources around it. */
 void removeOverlapping(std::set<CostSource> &cost_sources, double overlap_fraction);
 
 
 bool getSensorPositioning(geometry_msgs::Point &point,
                           const std::set<CostSource> &cost_sources);
 
+/** \brief Compute the gradient of the distance in \e data (computed with DistanceRequest::enable_nearest_points for \e state)
+    with respect to the variables of \e group, which must be a chain. The robot bodies of the pair that \e group moves
+    contribute through the Jacobians of their nearest points; the other bodies are considered fixed. Return false if the
+    gradient is not defined (penetration or touching bodies) or the Jacobian cannot be computed. */
+bool getDistanceGradient(const robot_state::RobotState &state, const robot_model::JointModelGroup *group,
+                         const DistanceResultsData &data, Eigen::VectorXd &gradient);
+
 void costSourceToMsg(const CostSource &cost_source, moveit_msgs::CostSource &msg);
 void contactToMsg(const Contact& contact, moveit_msgs::ContactInformation &msg);
 
@@ -40,6 +40,7 @@
 #include <boost/utility.hpp>
 
 #include <moveit/collision_detection/collision_matrix.h>
+#include <moveit/collision_detection/collision_batch.h>
 #include <moveit/collision_detection/collision_robot.h>
 #include <moveit/collision_detection/world.h>
 
@@ -120,6 +121,32 @@ namespace collision_detection
                                 const robot_state::RobotState &state2,
                                 const AllowedCollisionMatrix &acm) const;
 
+    /** \brief Check a batch of states for collisions (with itself or the world). The states are distributed over
+     *  \e thread_count threads (if 0, the number of hardware threads is used). The collision transforms of all the states
+     *  are expected to be up to date.
+     *  @param req A CollisionRequest object that encapsulates the collision request
+     *  @param res The collision results, one for each state
+     *  @param states The kinematic states for which checks are being made
+     *  @param stop_at_first_collision If true, no states after the first one found in collision are checked
+     *  @return The index of the first state found in collision, or -1 if all states are collision free */
+    int checkCollisionBatch(const CollisionRequest &req,
+                            std::vector<CollisionResult> &res,
+                            const CollisionRobot &robot,
+                            const std::vector<const robot_state::RobotState*> &states,
+                            bool stop_at_first_collision = false,
+                            unsigned int thread_count = 0) const;
+
+    /** \brief Check a batch of states for collisions (with itself or the world), taking into account the allowed
+     *  collision matrix. See the variant above for the meaning of the arguments.
+     *  @param acm The allowed collision matrix. */
+    int checkCollisionBatch(const CollisionRequest &req,
+                            std::vector<CollisionResult> &res,
+                            const CollisionRobot &robot,
+                            const std::vector<const robot_state::RobotState*> &states,
+                            const AllowedCollisionMatrix &acm,
+                            bool stop_at_first_collision = false,
+                            unsigned int thread_count = 0) const;
+
     /** \brief Check whether the robot model is in collision with the world. Any collisions between a robot link
      *  and the world are considered. Self collisions are not checked.
      *  @param req A CollisionRequest object that encapsulates the collision request
@@ -208,6 +235,30 @@ namespace collision_detection
                                  const robot_state::RobotState &state,
                                  const AllowedCollisionMatrix &acm) const = 0;
 
+    /** \brief Compute the distance between a robot and the world, as specified by \e req.
+     *  The default implementation computes the complete distance and clamps it to DistanceRequest::max_distance.
+     *  @param req A DistanceRequest object that encapsulates the distance request
+     *  @param res A DistanceResult object that encapsulates the distance result
+     *  @param robot The robot to check distance for
+     *  @param state The state for the robot to check distances from */
+    virtual void distanceRobot(const DistanceRequest &req,
+                               DistanceResult &res,
+                               const CollisionRobot &robot,
+                               const robot_state::RobotState &state) const;
+
+    /** \brief Compute the distance between a robot and the world, as specified by \e req.
+     *  The default implementation computes the complete distance and clamps it to DistanceRequest::max_distance.
+     *  @param req A DistanceRequest object that encapsulates the distance request
+     *  @param res A DistanceResult object that encapsulates the distance result
+     *  @param robot The robot to check distance for
+     *  @param state The state for the robot to check distances from
+     *  @param acm Using an allowed collision matrix has the effect of ignoring distances from links that are always allowed to be in collision. */
+    virtual void distanceRobot(const DistanceRequest &req,
+                               DistanceResult &res,
+                               const CollisionRobot &robot,
+                               const robot_state::RobotState &state,
+                               const AllowedCollisionMatrix &acm) const;
+
     /** \brief The shortest distance to another world instance (\e world) */
     virtual double distanceWorld(const CollisionWorld &world) const = 0;
 
@@ -0,0 +1,122 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2013, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#ifndef MOVEIT_COLLISION_DETECTION_CONSERVATIVE_MOTION_VALIDATOR_
+#define MOVEIT_COLLISION_DETECTION_CONSERVATIVE_MOTION_VALIDATOR_
+
+#include <moveit/collision_detection/collision_world.h>
+#include <boost/shared_ptr.hpp>
+#include <vector>
+
+namespace collision_detection
+{
+
+/** \brief Validate the straight line motion between two states (as computed by RobotState::interpolate()) from distance
+    queries instead of collision checks at a fixed resolution.
+
+    For every link, an upper bound on how far any point of its geometry can move along the motion is computed from the
+    displacement of the joints between the link and the root and from the distance of the geometry to those joints
+    (for prismatic joints further up the chain, their largest position is used). The distance to the world and to self
+    collision at a state then certifies a neighbourhood of that state along the motion as collision free: no point of
+    the robot can move further than the distance to the world, and two links cannot approach each other by more than twice
+    the largest link motion. Sub-intervals that are not certified by the states at their ends are split, so in open space
+    a motion needs only a few distance queries.
+
+    Sub-intervals along which no link moves by more than the resolution are accepted when the states at their ends are
+    collision free, as discrete collision checking at that resolution would. */
+class ConservativeMotionValidator
+{
+public:
+
+  ConservativeMotionValidator(const robot_model::RobotModelConstPtr &model);
+
+  /** \brief Set the largest link motion (in meters) along a sub-interval that is accepted once the states at its ends
+      are collision free (1 mm by default) */
+  void setResolution(double resolution)
+  {
+    resolution_ = resolution;
+  }
+
+  /** \brief Get the largest link motion (in meters) along a sub-interval that is accepted once the states at its ends
+      are collision free */
+  double getResolution() const
+  {
+    return resolution_;
+  }
+
+  /** \brief Check whether the motion from \e from to \e to is free of collisions between \e robot and \e world and of
+      self collisions, ignoring the collisions allowed by \e acm. If \e query_count is not NULL, it is set to the number of
+      states at which distances were computed. The padding and scaling of the links of \e robot are taken into account. */
+  bool isMotionValid(const CollisionWorld &world, const CollisionRobot &robot,
+                     const robot_state::RobotState &from, const robot_state::RobotState &to,
+                     const AllowedCollisionMatrix &acm, std::size_t *query_count = NULL) const;
+
+  /** \brief Compute the largest distance any point of the geometry of the robot (including attached bodies)
+      can move along the motion from \e from to \e to. If \e links is not NULL, only the links it marks (indexed by
+      LinkModel::getLinkIndex(), as JointModelGroup::getUpdatedLinkModelsWithGeometryMask()) and the bodies attached to
+      them are considered. */
+  double getMaximumMotion(const CollisionRobot &robot, const robot_state::RobotState &from, const robot_state::RobotState &to,
+                          const std::vector<bool> *links = NULL) const;
+
+private:
+
+  /** \brief The joints a link moves with: for each joint between the link and the root, the largest distance of the geometry
+      of the link to the origin of the joint, without the radius of the link (added per query, as it depends on padding
+      and attached bodies) */
+  struct LinkChain
+  {
+    const robot_model::LinkModel *link_;
+    std::vector<const robot_model::JointModel*> joints_;
+    std::vector<double> reach_;
+  };
+
+  /** \brief The clearance at a state: the distance to the world and half the distance to self collision;
+      negative if the state is in collision. Clearances above \e max_clearance are reported as \e max_clearance */
+  double computeClearance(const CollisionWorld &world, const CollisionRobot &robot, const robot_state::RobotState &state,
+                          const AllowedCollisionMatrix &acm, double max_clearance) const;
+
+  robot_model::RobotModelConstPtr robot_model_;
+  std::vector<LinkChain> chains_;
+
+  /** \brief The radius of the geometry of each link around the link origin, indexed by LinkModel::getLinkIndex() */
+  std::vector<double> link_radius_;
+  double resolution_;
+};
+
+typedef boost::shared_ptr<ConservativeMotionValidator> ConservativeMotionValidatorPtr;
+typedef boost::shared_ptr<const ConservativeMotionValidator> ConservativeMotionValidatorConstPtr;
+
+}
+
+#endif
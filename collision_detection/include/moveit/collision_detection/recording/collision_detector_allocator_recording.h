@@ -0,0 +1,90 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2013, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#ifndef MOVEIT_COLLISION_DETECTION_RECORDING_COLLISION_DETECTOR_ALLOCATOR_RECORDING_
+#define MOVEIT_COLLISION_DETECTION_RECORDING_COLLISION_DETECTOR_ALLOCATOR_RECORDING_
+
+#include <moveit/collision_detection/collision_detector_allocator.h>
+#include <moveit/collision_detection/recording/collision_world_recording.h>
+
+namespace collision_detection
+{
+
+/** \brief An allocator that wraps the worlds and robots of another allocator in CollisionWorldRecording and
+    CollisionRobotRecording instances, so that the queries run through them are written to a log that can later be
+    replayed against any collision detector (see replayCollisionQueryLog()). The name of the allocator is the name of
+    the wrapped allocator followed by "_RECORDING".
+
+    For example, to record the queries of a planning scene:
+    \code
+    scene->addCollisionDetector(CollisionDetectorAllocatorRecording::create(CollisionDetectorAllocatorFCL::create(),
+                                                                            scene->getRobotModel(), "queries.log"));
+    scene->setActiveCollisionDetector(CollisionDetectorAllocatorFCL::NAME_ + "_RECORDING");
+    \endcode */
+class CollisionDetectorAllocatorRecording : public CollisionDetectorAllocator
+{
+public:
+
+  CollisionDetectorAllocatorRecording(const CollisionDetectorAllocatorPtr &allocator, const CollisionQueryLogWriterPtr &log);
+
+  virtual const std::string& getName() const
+  {
+    return name_;
+  }
+
+  virtual CollisionWorldPtr allocateWorld(const WorldPtr& world) const;
+  virtual CollisionWorldPtr allocateWorld(const CollisionWorldConstPtr& orig, const WorldPtr& world) const;
+  virtual CollisionRobotPtr allocateRobot(const robot_model::RobotModelConstPtr& robot_model) const;
+  virtual CollisionRobotPtr allocateRobot(const CollisionRobotConstPtr& orig) const;
+
+  const CollisionQueryLogWriterPtr& getLog() const
+  {
+    return log_;
+  }
+
+  /** \brief Create an allocator that records the queries run through \e allocator to the file \e filename.
+      Returns an empty pointer if the file cannot be opened. */
+  static CollisionDetectorAllocatorPtr create(const CollisionDetectorAllocatorPtr &allocator,
+                                              const robot_model::RobotModelConstPtr &robot_model, const std::string &filename);
+
+private:
+
+  CollisionDetectorAllocatorPtr allocator_;
+  CollisionQueryLogWriterPtr    log_;
+  std::string                   name_;
+};
+
+}
+
+#endif
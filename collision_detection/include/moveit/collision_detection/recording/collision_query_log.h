@@ -0,0 +1,347 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2013, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#ifndef MOVEIT_COLLISION_DETECTION_RECORDING_COLLISION_QUERY_LOG_
+#define MOVEIT_COLLISION_DETECTION_RECORDING_COLLISION_QUERY_LOG_
+
+#include <moveit/collision_detection/collision_detector_allocator.h>
+#include <boost/thread/mutex.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <fstream>
+#include <vector>
+#include <map>
+
+namespace collision_detection
+{
+
+/** \brief The kinds of queries stored in a collision query log */
+namespace CollisionQueryTypes
+{
+enum Type
+  {
+    /** \brief CollisionWorld::checkRobotCollision() */
+    ROBOT_COLLISION,
+
+    /** \brief CollisionRobot::checkSelfCollision() */
+    SELF_COLLISION,
+
+    /** \brief CollisionWorld::distanceRobot() */
+    ROBOT_DISTANCE,
+
+    /** \brief CollisionRobot::distanceSelf() */
+    SELF_DISTANCE
+  };
+}
+
+/** \brief A collision or distance query, as stored in a collision query log.
+
+    The robot, world and allowed collision matrix the query was made with are referenced by the ids of snapshots
+    stored earlier in the same log (0 means none). States are stored as the positions of all the variables of the robot
+    model; attached bodies are not recorded. */
+struct RecordedCollisionQuery
+{
+  RecordedCollisionQuery() : type(CollisionQueryTypes::ROBOT_COLLISION), continuous(false), has_distance_request(false),
+                             robot_id(0), world_id(0), acm_id(0), initial_collision(false), collision(false),
+                             contact_count(0), distance(0.0), duration(0.0)
+  {
+  }
+
+  CollisionQueryTypes::Type type;
+
+  /** \brief True for continuous queries (between \e state1 and \e state2) */
+  bool                      continuous;
+
+  /** \brief True if the distance was requested with a DistanceRequest (\e distance_request); otherwise the variant
+      returning the distance was used */
+  bool                      has_distance_request;
+
+  boost::uint64_t           robot_id;
+  boost::uint64_t           world_id;
+  boost::uint64_t           acm_id;
+
+  /** \brief The request of collision queries; the is_done callback is not recorded */
+  CollisionRequest          collision_request;
+
+  /** \brief The request of distance queries, if \e has_distance_request is set */
+  DistanceRequest           distance_request;
+
+  std::vector<double>       state1;
+  std::vector<double>       state2;
+
+  /** \brief For collision queries, whether the result passed in already reported a collision (results accumulate,
+      e.g., when CollisionWorld::checkCollision() checks self collisions first) */
+  bool                      initial_collision;
+
+  /** \brief The outcome of the query: the collision flag and number of contacts added, for collision queries */
+  bool                      collision;
+  std::size_t               contact_count;
+
+  /** \brief The outcome of the query: the distance, for distance queries */
+  double                    distance;
+
+  /** \brief The time the query took (seconds) */
+  double                    duration;
+};
+
+/** \brief Writes collision queries to a binary log, along with snapshots of the robots, worlds and allowed
+    collision matrices they refer to. A snapshot is written the first time a query refers to a particular version of
+    its source. All functions are thread safe. Values are written in the byte order of the host. */
+class CollisionQueryLogWriter : private boost::noncopyable
+{
+public:
+
+  /** \brief Open \e filename for writing queries about robots of model \e robot_model. Check isOpen() for success. */
+  CollisionQueryLogWriter(const robot_model::RobotModelConstPtr &robot_model, const std::string &filename);
+
+  ~CollisionQueryLogWriter();
+
+  bool isOpen() const
+  {
+    return open_;
+  }
+
+  const std::string& getFilename() const
+  {
+    return filename_;
+  }
+
+  const robot_model::RobotModelConstPtr& getRobotModel() const
+  {
+    return robot_model_;
+  }
+
+  /** \brief Get the id of the snapshot of a world. \e source identifies the world (see newSourceId()) and \e version
+      must change whenever the world is modified; a new snapshot is written if this version was not written before. */
+  boost::uint64_t getWorldSnapshot(boost::uint64_t source, boost::uint64_t version, const World &world);
+
+  /** \brief Get the id of the snapshot of the padding and scaling of a robot; see getWorldSnapshot() */
+  boost::uint64_t getRobotSnapshot(boost::uint64_t source, boost::uint64_t version, const CollisionRobot &robot);
+
+  /** \brief Get the id of the snapshot of an allowed collision matrix, identified by its version (conditional entries
+      are recorded as never allowed) */
+  boost::uint64_t getACMSnapshot(const AllowedCollisionMatrix &acm);
+
+  /** \brief Write a query */
+  void writeQuery(const RecordedCollisionQuery &query);
+
+  /** \brief Get the number of queries written so far */
+  std::size_t getQueryCount() const;
+
+  void flush();
+
+  /** \brief Get a process-wide unique identifier for a source of snapshots */
+  static boost::uint64_t newSourceId();
+
+private:
+
+  robot_model::RobotModelConstPtr                    robot_model_;
+  std::string                                        filename_;
+  std::ofstream                                      out_;
+  bool                                               open_;
+  mutable boost::mutex                               lock_;
+  boost::uint64_t                                    next_snapshot_id_;
+  std::size_t                                        query_count_;
+
+  /** \brief For each source, the last version written and its snapshot id */
+  std::map<boost::uint64_t, std::pair<boost::uint64_t, boost::uint64_t> > snapshots_;
+
+  /** \brief Snapshot ids of the allowed collision matrices, by version */
+  std::map<boost::uint64_t, boost::uint64_t>         acm_snapshots_;
+};
+
+typedef boost::shared_ptr<CollisionQueryLogWriter> CollisionQueryLogWriterPtr;
+
+/** \brief Collects the data of one query while it runs and writes it to a log when it finishes */
+class CollisionQueryRecorder : private boost::noncopyable
+{
+public:
+
+  /** \brief Prepare the record of a query of \e type; \e state2 is NULL for discrete queries and \e acm is NULL if none is used */
+  CollisionQueryRecorder(CollisionQueryLogWriter &log, CollisionQueryTypes::Type type, boost::uint64_t robot_id, boost::uint64_t world_id,
+                         const robot_state::RobotState &state1, const robot_state::RobotState *state2, const AllowedCollisionMatrix *acm);
+
+  /** \brief Call right before running a collision query */
+  void start(const CollisionRequest &req, const CollisionResult &res);
+
+  /** \brief Call right before running a distance query; \e req is NULL for the variants that return the distance */
+  void start(const DistanceRequest *req);
+
+  /** \brief Call right after running a collision query */
+  void finish(const CollisionResult &res);
+
+  /** \brief Call right after running a distance query */
+  void finish(double distance);
+
+private:
+
+  CollisionQueryLogWriter &log_;
+  RecordedCollisionQuery   query_;
+  std::size_t              initial_contact_count_;
+  boost::posix_time::ptime start_;
+};
+
+/** \brief Reads the records of a log written by CollisionQueryLogWriter, in order */
+class CollisionQueryLogReader : private boost::noncopyable
+{
+public:
+
+  enum RecordType
+    {
+      WORLD_SNAPSHOT,
+      ROBOT_SNAPSHOT,
+      ACM_SNAPSHOT,
+      QUERY
+    };
+
+  /** \brief Open \e filename and read its header. Check isOpen() for success. */
+  CollisionQueryLogReader(const std::string &filename);
+
+  bool isOpen() const
+  {
+    return open_;
+  }
+
+  /** \brief The name of the robot model the queries were recorded for */
+  const std::string& getRobotModelName() const
+  {
+    return robot_model_name_;
+  }
+
+  /** \brief The names of the variables, in the order of the recorded states */
+  const std::vector<std::string>& getVariableNames() const
+  {
+    return variable_names_;
+  }
+
+  /** \brief Read the next record. Returns false at the end of the log or if the log is corrupt (see isCorrupt()). */
+  bool readNext(RecordType &type);
+
+  /** \brief True if reading stopped at an invalid or truncated record */
+  bool isCorrupt() const
+  {
+    return corrupt_;
+  }
+
+  /** \brief The id of the last snapshot read */
+  boost::uint64_t getSnapshotId() const
+  {
+    return snapshot_id_;
+  }
+
+  /** \brief The last world snapshot read */
+  const WorldPtr& getWorld() const
+  {
+    return world_;
+  }
+
+  /** \brief The last robot snapshot read: link paddings and scales */
+  const std::map<std::string, double>& getLinkPadding() const
+  {
+    return link_padding_;
+  }
+
+  const std::map<std::string, double>& getLinkScale() const
+  {
+    return link_scale_;
+  }
+
+  /** \brief The last allowed collision matrix snapshot read */
+  const AllowedCollisionMatrix& getACM() const
+  {
+    return acm_;
+  }
+
+  /** \brief The last query read */
+  const RecordedCollisionQuery& getQuery() const
+  {
+    return query_;
+  }
+
+private:
+
+  bool readWorld();
+  bool readRobot();
+  bool readACM();
+  bool readQuery();
+
+  std::ifstream                 in_;
+  bool                          open_;
+  bool                          corrupt_;
+  std::string                   robot_model_name_;
+  std::vector<std::string>      variable_names_;
+  boost::uint64_t               snapshot_id_;
+  WorldPtr                      world_;
+  std::map<std::string, double> link_padding_;
+  std::map<std::string, double> link_scale_;
+  AllowedCollisionMatrix        acm_;
+  RecordedCollisionQuery        query_;
+};
+
+/** \brief The outcome of replaying a recorded query */
+struct CollisionQueryReplayResult
+{
+  CollisionQueryReplayResult() : type(CollisionQueryTypes::ROBOT_COLLISION), recorded_collision(false), collision(false),
+                                 recorded_contact_count(0), contact_count(0), recorded_distance(0.0), distance(0.0),
+                                 recorded_duration(0.0), duration(0.0), mismatch(false)
+  {
+  }
+
+  CollisionQueryTypes::Type type;
+  bool                      recorded_collision;
+  bool                      collision;
+  std::size_t               recorded_contact_count;
+  std::size_t               contact_count;
+  double                    recorded_distance;
+  double                    distance;
+  double                    recorded_duration;
+  double                    duration;
+
+  /** \brief True if the collision flag differs, or the distances differ by more than the replay tolerance.
+      Contact counts are reported but not compared, since backends report contacts differently. */
+  bool                      mismatch;
+};
+
+/** \brief Re-run the queries of the log \e filename with the collision detectors of \e allocator, for robots of model
+    \e robot_model. Variables are matched to the recorded states by name; variables that were not recorded keep their
+    default values. One result is added to \e results for every query. Returns false if the log cannot be read
+    (queries replayed before a corrupt record are kept). */
+bool replayCollisionQueryLog(const std::string &filename, const robot_model::RobotModelConstPtr &robot_model,
+                             const CollisionDetectorAllocatorPtr &allocator, std::vector<CollisionQueryReplayResult> &results,
+                             double distance_tolerance = 1e-6);
+
+}
+
+#endif
@@ -0,0 +1,106 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2013, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#ifndef MOVEIT_COLLISION_DETECTION_RECORDING_COLLISION_ROBOT_RECORDING_
+#define MOVEIT_COLLISION_DETECTION_RECORDING_COLLISION_ROBOT_RECORDING_
+
+#include <moveit/collision_detection/collision_robot.h>
+#include <moveit/collision_detection/recording/collision_query_log.h>
+
+namespace collision_detection
+{
+
+/** \brief A CollisionRobot that forwards all calls to another CollisionRobot (the recorded robot) and writes the self
+    collision and self distance queries to a CollisionQueryLogWriter. Changes of padding and scaling are forwarded to
+    the recorded robot. Queries that involve another robot are forwarded but not recorded. */
+class CollisionRobotRecording : public CollisionRobot
+{
+public:
+
+  CollisionRobotRecording(const CollisionRobotPtr &robot, const CollisionQueryLogWriterPtr &log);
+
+  virtual void checkSelfCollision(const CollisionRequest &req, CollisionResult &res, const robot_state::RobotState &state) const;
+  virtual void checkSelfCollision(const CollisionRequest &req, CollisionResult &res, const robot_state::RobotState &state, const AllowedCollisionMatrix &acm) const;
+  virtual void checkSelfCollision(const CollisionRequest &req, CollisionResult &res, const robot_state::RobotState &state1, const robot_state::RobotState &state2) const;
+  virtual void checkSelfCollision(const CollisionRequest &req, CollisionResult &res, const robot_state::RobotState &state1, const robot_state::RobotState &state2, const AllowedCollisionMatrix &acm) const;
+
+  virtual void checkOtherCollision(const CollisionRequest &req, CollisionResult &res, const robot_state::RobotState &state,
+                                   const CollisionRobot &other_robot, const robot_state::RobotState &other_state) const;
+  virtual void checkOtherCollision(const CollisionRequest &req, CollisionResult &res, const robot_state::RobotState &state,
+                                   const CollisionRobot &other_robot, const robot_state::RobotState &other_state,
+                                   const AllowedCollisionMatrix &acm) const;
+  virtual void checkOtherCollision(const CollisionRequest &req, CollisionResult &res, const robot_state::RobotState &state1, const robot_state::RobotState &state2,
+                                   const CollisionRobot &other_robot, const robot_state::RobotState &other_state1, const robot_state::RobotState &other_state2) const;
+  virtual void checkOtherCollision(const CollisionRequest &req, CollisionResult &res, const robot_state::RobotState &state1, const robot_state::RobotState &state2,
+                                   const CollisionRobot &other_robot, const robot_state::RobotState &other_state1, const robot_state::RobotState &other_state2,
+                                   const AllowedCollisionMatrix &acm) const;
+
+  virtual double distanceSelf(const robot_state::RobotState &state) const;
+  virtual double distanceSelf(const robot_state::RobotState &state, const AllowedCollisionMatrix &acm) const;
+  virtual void distanceSelf(const DistanceRequest &req, DistanceResult &res, const robot_state::RobotState &state) const;
+  virtual void distanceSelf(const DistanceRequest &req, DistanceResult &res, const robot_state::RobotState &state,
+                            const AllowedCollisionMatrix &acm) const;
+
+  virtual double distanceOther(const robot_state::RobotState &state,
+                               const CollisionRobot &other_robot, const robot_state::RobotState &other_state) const;
+  virtual double distanceOther(const robot_state::RobotState &state, const CollisionRobot &other_robot,
+                               const robot_state::RobotState &other_state, const AllowedCollisionMatrix &acm) const;
+
+  /** \brief The robot the calls are forwarded to */
+  const CollisionRobotPtr& getRecordedRobot() const
+  {
+    return recorded_robot_;
+  }
+
+  /** \brief The id of the snapshot of the current padding and scaling in the log (written if needed) */
+  boost::uint64_t getSnapshotId() const;
+
+  /** \brief If \e robot is a CollisionRobotRecording, return the robot it records; otherwise return \e robot */
+  static const CollisionRobot& getRecordedRobot(const CollisionRobot &robot);
+
+protected:
+
+  virtual void updatedPaddingOrScaling(const std::vector<std::string> &links);
+
+private:
+
+  CollisionRobotPtr          recorded_robot_;
+  CollisionQueryLogWriterPtr log_;
+  boost::uint64_t            source_;
+  boost::uint64_t            version_;
+};
+
+}
+
+#endif
@@ -0,0 +1,94 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2013, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#ifndef MOVEIT_COLLISION_DETECTION_RECORDING_COLLISION_WORLD_RECORDING_
+#define MOVEIT_COLLISION_DETECTION_RECORDING_COLLISION_WORLD_RECORDING_
+
+#include <moveit/collision_detection/collision_world.h>
+#include <moveit/collision_detection/recording/collision_robot_recording.h>
+
+namespace collision_detection
+{
+
+/** \brief A CollisionWorld that forwards all calls to another CollisionWorld (the recorded world) and writes the robot
+    collision and robot distance queries to a CollisionQueryLogWriter, along with snapshots of the world they were
+    run against. Queries between two worlds are forwarded but not recorded. */
+class CollisionWorldRecording : public CollisionWorld
+{
+public:
+
+  CollisionWorldRecording(const CollisionWorldPtr &world, const CollisionQueryLogWriterPtr &log);
+  virtual ~CollisionWorldRecording();
+
+  virtual void checkRobotCollision(const CollisionRequest &req, CollisionResult &res, const CollisionRobot &robot, const robot_state::RobotState &state) const;
+  virtual void checkRobotCollision(const CollisionRequest &req, CollisionResult &res, const CollisionRobot &robot, const robot_state::RobotState &state, const AllowedCollisionMatrix &acm) const;
+  virtual void checkRobotCollision(const CollisionRequest &req, CollisionResult &res, const CollisionRobot &robot, const robot_state::RobotState &state1, const robot_state::RobotState &state2) const;
+  virtual void checkRobotCollision(const CollisionRequest &req, CollisionResult &res, const CollisionRobot &robot, const robot_state::RobotState &state1, const robot_state::RobotState &state2, const AllowedCollisionMatrix &acm) const;
+  virtual void checkWorldCollision(const CollisionRequest &req, CollisionResult &res, const CollisionWorld &other_world) const;
+  virtual void checkWorldCollision(const CollisionRequest &req, CollisionResult &res, const CollisionWorld &other_world, const AllowedCollisionMatrix &acm) const;
+
+  virtual double distanceRobot(const CollisionRobot &robot, const robot_state::RobotState &state) const;
+  virtual double distanceRobot(const CollisionRobot &robot, const robot_state::RobotState &state, const AllowedCollisionMatrix &acm) const;
+  virtual void distanceRobot(const DistanceRequest &req, DistanceResult &res, const CollisionRobot &robot, const robot_state::RobotState &state) const;
+  virtual void distanceRobot(const DistanceRequest &req, DistanceResult &res, const CollisionRobot &robot, const robot_state::RobotState &state,
+                             const AllowedCollisionMatrix &acm) const;
+  virtual double distanceWorld(const CollisionWorld &world) const;
+  virtual double distanceWorld(const CollisionWorld &world, const AllowedCollisionMatrix &acm) const;
+
+  virtual void setWorld(const WorldPtr& world);
+
+  /** \brief The world the calls are forwarded to */
+  const CollisionWorldPtr& getRecordedWorld() const
+  {
+    return recorded_world_;
+  }
+
+  /** \brief If \e world is a CollisionWorldRecording, return the world it records; otherwise return \e world */
+  static const CollisionWorld& getRecordedWorld(const CollisionWorld &world);
+
+private:
+
+  void notifyObjectChange(const ObjectConstPtr &obj, World::Action action);
+  boost::uint64_t getSnapshotId() const;
+
+  CollisionWorldPtr          recorded_world_;
+  CollisionQueryLogWriterPtr log_;
+  World::ObserverHandle      observer_handle_;
+  boost::uint64_t            source_;
+  boost::uint64_t            version_;
+};
+
+}
+
+#endif
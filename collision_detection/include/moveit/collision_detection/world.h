@@ -42,6 +42,7 @@
 #include <map>
 #include <boost/shared_ptr.hpp>
 #include <boost/function.hpp>
+#include <boost/cstdint.hpp>
 #include <Eigen/Geometry>
 #include <eigen_stl_containers/eigen_stl_vector_container.h>
 #include <geometric_shapes/shapes.h>
@@ -71,7 +72,14 @@ namespace collision_detection
     /** \brief A representation of an object */
     struct Object
     {
-      Object(const std::string &id) : id_(id) {}
+      Object(const std::string &id);
+
+      /** \brief Copies share the shapes and the version of \e other; their memory is accounted once for every copy */
+      Object(const Object &other);
+
+      ~Object();
+
+      Object& operator=(const Object &other);
 
       EIGEN_MAKE_ALIGNED_OPERATOR_NEW
 
@@ -95,6 +103,18 @@ namespace collision_detection
        *
        * @copydetails shapes_ */
       EigenSTL::vector_Affine3d          shape_poses_;
+
+      /** \brief The estimated memory of the shapes (octrees excluded) and of the octrees in shapes_,
+       * as last accounted for by the World (see moveit::tools::MemoryAccounting) */
+      std::size_t                        shape_bytes_;
+      std::size_t                        octree_bytes_;
+
+      /** \brief The version of the object. A new version, unique in the process, is assigned when the object is
+       * constructed and every time a World changes it; copies keep the version of the object they were copied from
+       * until they are changed. Objects with the same version have the same shapes and poses, so caches can check
+       * whether an object changed by comparing versions. Changes made to an object other than through a World
+       * do not update its version. */
+      boost::uint64_t                    version_;
     };
 
     typedef boost::shared_ptr<Object> ObjectPtr;
@@ -133,6 +153,22 @@ namespace collision_detection
     /** \brief Check if a particular object exists in the collision world*/
     bool hasObject(const std::string &id) const;
 
+    /** \brief Get the version of the world. It changes every time an object is added to, changed in or removed from
+     * the world, including during a batch (see beginBatch()). Versions are unique in the process: they are never
+     * reused, not even by other worlds, and a copy of a world has the version of the world it was copied from until
+     * either is changed. Worlds with the same version have the same objects. */
+    boost::uint64_t getVersion() const
+    {
+      return version_;
+    }
+
+    /** \brief Get the estimated memory used by the shapes of the objects in this world, separately for octrees
+     * (\e octree_bytes) and for all other shapes (\e shape_bytes). Shapes shared by several objects are counted for each of them. */
+    void getMemoryUsage(std::size_t &shape_bytes, std::size_t &octree_bytes) const;
+
+    /** \brief Estimate the memory used by a shape, in bytes */
+    static std::size_t getShapeMemoryUsage(const shapes::Shape &shape);
+
     /** \brief Add shapes to an object in the map.
      * This function makes repeated calls to addToObjectInternal() to add the
      * shapes one by one.
@@ -156,6 +192,18 @@ namespace collision_detection
                            const shapes::ShapeConstPtr &shape,
                            const Eigen::Affine3d &pose);
 
+    /** \brief Update the poses of all the shapes in an object, in the order of the shapes in the object.
+     * Only a MOVE_SHAPE action is reported to the observers, so they can update the poses they maintain
+     * without processing the shapes of the object again. Returns false if the object does not exist or
+     * the number of poses does not match the number of shapes. */
+    bool setShapePoses(const std::string &id,
+                       const EigenSTL::vector_Affine3d &poses);
+
+    /** \brief Make the object named \e obj->id_ in this world be \e obj, replacing the object with that name, if any.
+     * The object is shared (e.g., with the world it was taken from) rather than copied; it is copied only when it is
+     * modified later on. When the object replaces one with the same shapes, only a MOVE_SHAPE action is reported. */
+    void setObject(const ObjectConstPtr &obj);
+
     /** \brief Remove shape from object.
      * Shape equality is verified by comparing pointers. Ownership of the
      * object is renounced (i.e. object is deleted if no external references
@@ -214,12 +262,22 @@ namespace collision_detection
 
     typedef boost::function<void (const ObjectConstPtr&, Action)> ObserverCallbackFn;
 
+    /** \brief The objects that changed in a batch (see beginBatch()), with the actions that occurred on them */
+    typedef std::vector<std::pair<ObjectConstPtr, Action> > ObjectChanges;
+
+    typedef boost::function<void (const ObjectChanges&)> BatchObserverCallbackFn;
+
     /** \brief register a callback function for notification of changes.
      * \e callback will be called right after any change occurs to any Object.
      * \e observer is the object which is requesting the changes.  It is only
      * used for identifying the callback in removeObserver(). */
     ObserverHandle addObserver(const ObserverCallbackFn &callback);
 
+    /** \brief register a callback function for notification of changes, with a separate callback for batches of changes.
+     * \e callback is called for changes made outside of a batch; \e batch_callback is called once at the end of
+     * a batch, with all the changes made in it. */
+    ObserverHandle addObserver(const ObserverCallbackFn &callback, const BatchObserverCallbackFn &batch_callback);
+
     /** \brief remove a notifier callback */
     void removeObserver(const ObserverHandle observer_handle);
 
@@ -227,6 +285,43 @@ namespace collision_detection
      * Used which switching from one world to another. */
     void notifyObserverAllObjects(const ObserverHandle observer_handle, Action action) const;
 
+    /** \brief Start a batch of changes. Observers are not notified of the changes made until the matching
+     * commitBatch(); when the outermost batch is committed, each observer is notified once per changed object, with
+     * the actions accumulated during the batch (objects created and destroyed within the batch are not reported).
+     * The world itself is always up to date, but until the batch is committed the observers (e.g., collision worlds
+     * and planning scenes using this world) reflect the world as it was when the batch started. Batches can be nested. */
+    void beginBatch();
+
+    /** \brief End a batch of changes started with beginBatch(), notifying the observers if this is the outermost batch */
+    void commitBatch();
+
+    /** \brief Check whether changes are being batched */
+    bool inBatch() const
+    {
+      return batch_depth_ > 0;
+    }
+
+    /** \brief Batch the changes made to a world during the lifetime of an instance of this class */
+    class ScopedBatch
+    {
+    public:
+      ScopedBatch(World &world) : world_(world)
+      {
+        world_.beginBatch();
+      }
+
+      ~ScopedBatch()
+      {
+        world_.commitBatch();
+      }
+
+    private:
+      ScopedBatch(const ScopedBatch&);
+      ScopedBatch& operator=(const ScopedBatch&);
+
+      World &world_;
+    };
+
   private:
 
     /** notify all observers of a change */
@@ -241,6 +336,12 @@ namespace collision_detection
      * clone is made so that it can be safely modified later on. */
     void ensureUnique(ObjectPtr &obj);
 
+    /** \brief Assign a new version to \e obj, which must be known only to this world (see ensureUnique()) */
+    void updateVersion(const ObjectPtr &obj);
+
+    /** \brief Recompute the memory used by the shapes of \e obj and update the process-wide accounting */
+    void updateMemoryAccounting(const ObjectPtr &obj);
+
     /* Add a shape with no checking */
     virtual void addToObjectInternal(const ObjectPtr &obj,
                                      const shapes::ShapeConstPtr &shape,
@@ -250,6 +351,9 @@ namespace collision_detection
     /** The objects maintained in the world */
     std::map<std::string, ObjectPtr> objects_;
 
+    /** See getVersion() */
+    boost::uint64_t                  version_;
+
     /* observers to call when something changes */
     class Observer
     {
@@ -257,10 +361,26 @@ namespace collision_detection
       Observer(const ObserverCallbackFn &callback) :
         callback_(callback)
       {}
+      Observer(const ObserverCallbackFn &callback, const BatchObserverCallbackFn &batch_callback) :
+        callback_(callback), batch_callback_(batch_callback)
+      {}
       ObserverCallbackFn callback_;
+      BatchObserverCallbackFn batch_callback_;
     };
     std::vector<Observer*> observers_;
 
+    /* a change recorded during a batch */
+    struct PendingChange
+    {
+      ObjectConstPtr obj_;
+      int            action_;
+      bool           existed_;   // whether the object existed before the batch started
+    };
+
+    unsigned int                       batch_depth_;
+    std::vector<PendingChange>         pending_changes_;
+    std::map<std::string, std::size_t> pending_index_;   // index of each object id in pending_changes_
+
   };
 
   typedef boost::shared_ptr<World> WorldPtr;
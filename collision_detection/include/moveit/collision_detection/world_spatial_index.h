@@ -0,0 +1,148 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2013, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#ifndef MOVEIT_COLLISION_DETECTION_WORLD_SPATIAL_INDEX_
+#define MOVEIT_COLLISION_DETECTION_WORLD_SPATIAL_INDEX_
+
+#include <moveit/collision_detection/world.h>
+#include <set>
+#include <boost/weak_ptr.hpp>
+#include <boost/unordered_map.hpp>
+
+namespace collision_detection
+{
+
+  /** \brief Maintain the axis-aligned bounding boxes of the objects in a World, in a uniform grid, so that the objects
+   * in a region of space can be found without going through all the objects. The index is updated as the world
+   * changes, using the observer mechanism of the World. */
+  class WorldSpatialIndex
+  {
+  public:
+
+    /** \brief Constructor. \e cell_size is the size of the cells of the grid, in meters. */
+    WorldSpatialIndex(double cell_size = 0.5);
+
+    /** \brief Constructor. Index the objects of \e world, with cells of size \e cell_size */
+    WorldSpatialIndex(const WorldPtr &world, double cell_size = 0.5);
+
+    ~WorldSpatialIndex();
+
+    /** \brief Set the world to index. The objects of the previous world (if any) are removed from the index
+     * and all the objects of the new world are added */
+    void setWorld(const WorldPtr &world);
+
+    /** \brief Stop maintaining the index and erase its content */
+    void reset();
+
+    double getCellSize() const
+    {
+      return cell_size_;
+    }
+
+    /** \brief Get the ids of the objects whose bounding box intersects the box from \e min to \e max.
+     * Objects that are not bounded (e.g., planes) are always included. */
+    void getObjectsInBox(const Eigen::Vector3d &min, const Eigen::Vector3d &max, std::vector<std::string> &ids) const;
+
+    /** \brief Get the ids of the objects whose bounding box is within \e distance of \e point.
+     * Objects that are not bounded (e.g., planes) are always included. */
+    void getObjectsNear(const Eigen::Vector3d &point, double distance, std::vector<std::string> &ids) const;
+
+    /** \brief Get the bounding box of an object. Returns false if the object is not known or is not bounded. */
+    bool getObjectAABB(const std::string &id, Eigen::Vector3d &min, Eigen::Vector3d &max) const;
+
+    /** \brief The number of objects in the index */
+    std::size_t size() const
+    {
+      return entries_.size();
+    }
+
+  private:
+
+    struct Cell
+    {
+      Cell() : x_(0), y_(0), z_(0) {}
+      Cell(int x, int y, int z) : x_(x), y_(y), z_(z) {}
+      bool operator==(const Cell &other) const
+      {
+        return x_ == other.x_ && y_ == other.y_ && z_ == other.z_;
+      }
+      int x_, y_, z_;
+    };
+
+    struct CellHash
+    {
+      std::size_t operator()(const Cell &c) const;
+    };
+
+    struct Entry
+    {
+      Eigen::Vector3d min_;
+      Eigen::Vector3d max_;
+      bool bounded_;
+
+      /* the range of cells the object is stored in, if it is stored in the grid */
+      bool in_grid_;
+      Cell lo_;
+      Cell hi_;
+    };
+
+    /** \brief Notification function */
+    void notify(const World::ObjectConstPtr &obj, World::Action action);
+
+    void add(const World::Object &obj);
+    void remove(const std::string &id);
+
+    Cell getCell(const Eigen::Vector3d &p) const;
+
+    double cell_size_;
+
+    std::map<std::string, Entry> entries_;
+
+    /* the objects that cover a cell of the grid; objects spanning too many cells, and objects that are not
+       bounded, are kept out of the grid and listed in large_ instead */
+    boost::unordered_map<Cell, std::vector<std::string>, CellHash> cells_;
+    std::set<std::string> large_;
+
+    /* observer handle for world callback */
+    World::ObserverHandle observer_handle_;
+
+    /* used to unregister the notifier */
+    boost::weak_ptr<World> world_;
+  };
+
+  typedef boost::shared_ptr<WorldSpatialIndex> WorldSpatialIndexPtr;
+  typedef boost::shared_ptr<const WorldSpatialIndex> WorldSpatialIndexConstPtr;
+}
+
+#endif
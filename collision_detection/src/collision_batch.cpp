@@ -0,0 +1,114 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2013, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+
+#include <moveit/collision_detection/collision_batch.h>
+#include <moveit/background_processing/thread_pool.h>
+#include <boost/bind.hpp>
+#include <algorithm>
+
+namespace collision_detection
+{
+namespace
+{
+
+struct BatchData
+{
+  BatchData(const BatchCollisionCheckFn &check, std::size_t count, std::vector<CollisionResult> &res, bool stop_at_first_collision) :
+    check_(check), count_(count), res_(res), stop_at_first_collision_(stop_at_first_collision), next_(0), first_collision_(-1)
+  {
+  }
+
+  /// Get the next index to check; return false if there is nothing left to do
+  bool next(std::size_t &index)
+  {
+    boost::mutex::scoped_lock slock(lock_);
+    if (next_ >= count_ || (stop_at_first_collision_ && first_collision_ >= 0 && next_ > (std::size_t)first_collision_))
+      return false;
+    index = next_++;
+    return true;
+  }
+
+  void reportCollision(std::size_t index)
+  {
+    boost::mutex::scoped_lock slock(lock_);
+    if (first_collision_ < 0 || (int)index < first_collision_)
+      first_collision_ = index;
+  }
+
+  void run()
+  {
+    std::size_t index;
+    while (next(index))
+    {
+      check_(index, res_[index]);
+      if (res_[index].collision)
+        reportCollision(index);
+    }
+  }
+
+  const BatchCollisionCheckFn  &check_;
+  std::size_t                   count_;
+  std::vector<CollisionResult> &res_;
+  bool                          stop_at_first_collision_;
+
+  boost::mutex                  lock_;
+  std::size_t                   next_;
+  int                           first_collision_;
+};
+
+}
+}
+
+int collision_detection::checkCollisionBatch(const BatchCollisionCheckFn &check, std::size_t count, std::vector<CollisionResult> &res,
+                                             bool stop_at_first_collision, unsigned int thread_count)
+{
+  res.resize(count);
+  for (std::size_t i = 0 ; i < count ; ++i)
+    res[i].clear();
+
+  moveit::tools::ThreadPool &pool = moveit::tools::ThreadPool::Instance();
+  if (thread_count == 0 || thread_count > pool.getThreadCount())
+    thread_count = pool.getThreadCount();
+  if (thread_count > count)
+    thread_count = count;
+
+  BatchData data(check, count, res, stop_at_first_collision);
+  if (thread_count <= 1)
+    data.run();
+  else
+    // the calling thread is one of the workers
+    pool.runConcurrently(boost::bind(&BatchData::run, &data), thread_count);
+  return data.first_collision_;
+}
@@ -0,0 +1,57 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2013, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#include <moveit/collision_detection/collision_common.h>
+#include <moveit/collision_detection/collision_matrix.h>
+
+void collision_detection::CollisionResult::getContactMap(ContactMap &contact_map) const
+{
+  contact_map.clear();
+  for (std::size_t i = 0 ; i < flat_contacts.size() ; ++i)
+  {
+    const FlatContact &fc = flat_contacts[i];
+    Contact c;
+    c.pos = fc.pos;
+    c.normal = fc.normal;
+    c.depth = fc.depth;
+    c.body_name_1 = AllowedCollisionMatrix::getNameFromIndex(fc.body_index_1);
+    c.body_type_1 = fc.body_type_1;
+    c.body_name_2 = AllowedCollisionMatrix::getNameFromIndex(fc.body_index_2);
+    c.body_type_2 = fc.body_type_2;
+    if (c.body_name_1 < c.body_name_2)
+      contact_map[std::make_pair(c.body_name_1, c.body_name_2)].push_back(c);
+    else
+      contact_map[std::make_pair(c.body_name_2, c.body_name_1)].push_back(c);
+  }
+}
@@ -36,20 +36,26 @@
 
 #include <moveit/collision_detection/collision_matrix.h>
 #include <boost/bind.hpp>
+#include <boost/thread/mutex.hpp>
 #include <iomanip>
+#include <algorithm>
+#include <deque>
 
-collision_detection::AllowedCollisionMatrix::AllowedCollisionMatrix()
+collision_detection::AllowedCollisionMatrix::AllowedCollisionMatrix() :
+  data_(new Data())
 {
 }
 
-collision_detection::AllowedCollisionMatrix::AllowedCollisionMatrix(const std::vector<std::string>& names, bool allowed)
+collision_detection::AllowedCollisionMatrix::AllowedCollisionMatrix(const std::vector<std::string>& names, bool allowed) :
+  data_(new Data())
 {
   for (std::size_t i = 0 ; i < names.size() ; ++i)
     for (std::size_t j = i; j < names.size() ; ++j)
       setEntry(names[i], names[j], allowed);
 }
 
-collision_detection::AllowedCollisionMatrix::AllowedCollisionMatrix(const moveit_msgs::AllowedCollisionMatrix &msg)
+collision_detection::AllowedCollisionMatrix::AllowedCollisionMatrix(const moveit_msgs::AllowedCollisionMatrix &msg) :
+  data_(new Data())
 {
   if (msg.entry_names.size() != msg.entry_values.size() || msg.default_entry_names.size() != msg.default_entry_values.size())
     logError("The number of links does not match the number of entries in AllowedCollisionMatrix message");
@@ -67,18 +73,15 @@ collision_detection::AllowedCollisionMatrix::AllowedCollisionMatrix(const moveit
   }
 }
 
-collision_detection::AllowedCollisionMatrix::AllowedCollisionMatrix(const AllowedCollisionMatrix& acm)
+collision_detection::AllowedCollisionMatrix::AllowedCollisionMatrix(const AllowedCollisionMatrix& acm) :
+  data_(acm.data_)
 {
-  entries_ = acm.entries_;
-  allowed_contacts_ = acm.allowed_contacts_;
-  default_entries_ = acm.default_entries_;
-  default_allowed_contacts_ = acm.default_allowed_contacts_;
 }
 
 bool collision_detection::AllowedCollisionMatrix::getEntry(const std::string& name1, const std::string& name2, DecideContactFn &fn) const
 {
-  std::map<std::string, std::map<std::string, DecideContactFn> >::const_iterator it1 = allowed_contacts_.find(name1);
-  if (it1 == allowed_contacts_.end())
+  std::map<std::string, std::map<std::string, DecideContactFn> >::const_iterator it1 = data_->allowed_contacts_.find(name1);
+  if (it1 == data_->allowed_contacts_.end())
     return false;
   std::map<std::string, DecideContactFn>::const_iterator it2 = it1->second.find(name2);
   if (it2 == it1->second.end())
@@ -89,8 +92,8 @@ bool collision_detection::AllowedCollisionMatrix::getEntry(const std::string& na
 
 bool collision_detection::AllowedCollisionMatrix::getEntry(const std::string& name1, const std::string& name2, AllowedCollision::Type& allowed_collision) const
 {
-  std::map<std::string, std::map<std::string, AllowedCollision::Type> >::const_iterator it1 = entries_.find(name1);
-  if (it1 == entries_.end())
+  std::map<std::string, std::map<std::string, AllowedCollision::Type> >::const_iterator it1 = data_->entries_.find(name1);
+  if (it1 == data_->entries_.end())
     return false;
   std::map<std::string, AllowedCollision::Type>::const_iterator it2 = it1->second.find(name2);
   if (it2 == it1->second.end())
@@ -101,13 +104,13 @@ bool collision_detection::AllowedCollisionMatrix::getEntry(const std::string& na
 
 bool collision_detection::AllowedCollisionMatrix::hasEntry(const std::string& name) const
 {
-  return entries_.find(name) != entries_.end();
+  return data_->entries_.find(name) != data_->entries_.end();
 }
 
 bool collision_detection::AllowedCollisionMatrix::hasEntry(const std::string& name1, const std::string& name2) const
 {
-  std::map<std::string, std::map<std::string, AllowedCollision::Type> >::const_iterator it1 = entries_.find(name1);
-  if (it1 == entries_.end())
+  std::map<std::string, std::map<std::string, AllowedCollision::Type> >::const_iterator it1 = data_->entries_.find(name1);
+  if (it1 == data_->entries_.end())
     return false;
   std::map<std::string, AllowedCollision::Type>::const_iterator it2 = it1->second.find(name2);
   if (it2 == it1->second.end())
@@ -117,19 +120,20 @@ bool collision_detection::AllowedCollisionMatrix::hasEntry(const std::string& na
 
 void collision_detection::AllowedCollisionMatrix::setEntry(const std::string &name1, const std::string &name2, bool allowed)
 {
+  modify();
   const AllowedCollision::Type v = allowed ? AllowedCollision::ALWAYS : AllowedCollision::NEVER;
-  entries_[name1][name2] = entries_[name2][name1] = v;
+  data_->entries_[name1][name2] = data_->entries_[name2][name1] = v;
 
   // remove boost::function pointers, if any
-  std::map<std::string, std::map<std::string, DecideContactFn> >::iterator it = allowed_contacts_.find(name1);
-  if (it != allowed_contacts_.end())
+  std::map<std::string, std::map<std::string, DecideContactFn> >::iterator it = data_->allowed_contacts_.find(name1);
+  if (it != data_->allowed_contacts_.end())
   {
     std::map<std::string, DecideContactFn>::iterator jt = it->second.find(name2);
     if (jt != it->second.end())
       it->second.erase(jt);
   }
-  it = allowed_contacts_.find(name2);
-  if (it != allowed_contacts_.end())
+  it = data_->allowed_contacts_.find(name2);
+  if (it != data_->allowed_contacts_.end())
   {
     std::map<std::string, DecideContactFn>::iterator jt = it->second.find(name1);
     if (jt != it->second.end())
@@ -139,46 +143,49 @@ void collision_detection::AllowedCollisionMatrix::setEntry(const std::string &na
 
 void collision_detection::AllowedCollisionMatrix::setEntry(const std::string& name1, const std::string& name2, const DecideContactFn &fn)
 {
-  entries_[name1][name2] = entries_[name2][name1] = AllowedCollision::CONDITIONAL;
-  allowed_contacts_[name1][name2] = allowed_contacts_[name2][name1] = fn;
+  modify();
+  data_->entries_[name1][name2] = data_->entries_[name2][name1] = AllowedCollision::CONDITIONAL;
+  data_->allowed_contacts_[name1][name2] = data_->allowed_contacts_[name2][name1] = fn;
 }
 
 void collision_detection::AllowedCollisionMatrix::removeEntry(const std::string& name)
 {
-  entries_.erase(name);
-  allowed_contacts_.erase(name);
-  for (std::map<std::string, std::map<std::string, AllowedCollision::Type> >::iterator it = entries_.begin() ; it != entries_.end() ; ++it)
+  modify();
+  data_->entries_.erase(name);
+  data_->allowed_contacts_.erase(name);
+  for (std::map<std::string, std::map<std::string, AllowedCollision::Type> >::iterator it = data_->entries_.begin() ; it != data_->entries_.end() ; ++it)
     it->second.erase(name);
-  for (std::map<std::string, std::map<std::string, DecideContactFn> >::iterator it = allowed_contacts_.begin() ; it != allowed_contacts_.end() ; ++it)
+  for (std::map<std::string, std::map<std::string, DecideContactFn> >::iterator it = data_->allowed_contacts_.begin() ; it != data_->allowed_contacts_.end() ; ++it)
     it->second.erase(name);
 }
 
 void collision_detection::AllowedCollisionMatrix::removeEntry(const std::string& name1, const std::string &name2)
 {
-  std::map<std::string, std::map<std::string, AllowedCollision::Type> >::iterator jt = entries_.find(name1);
-  if (jt != entries_.end())
+  modify();
+  std::map<std::string, std::map<std::string, AllowedCollision::Type> >::iterator jt = data_->entries_.find(name1);
+  if (jt != data_->entries_.end())
   {
     std::map<std::string, AllowedCollision::Type>::iterator it = jt->second.find(name2);
     if (it != jt->second.end())
       jt->second.erase(it);
   }
-  jt = entries_.find(name2);
-  if (jt != entries_.end())
+  jt = data_->entries_.find(name2);
+  if (jt != data_->entries_.end())
   {
     std::map<std::string, AllowedCollision::Type>::iterator it = jt->second.find(name1);
     if (it != jt->second.end())
       jt->second.erase(it);
   }
 
-  std::map<std::string, std::map<std::string, DecideContactFn> >::iterator it = allowed_contacts_.find(name1);
-  if (it != allowed_contacts_.end())
+  std::map<std::string, std::map<std::string, DecideContactFn> >::iterator it = data_->allowed_contacts_.find(name1);
+  if (it != data_->allowed_contacts_.end())
   {
     std::map<std::string, DecideContactFn>::iterator jt = it->second.find(name2);
     if (jt != it->second.end())
       it->second.erase(jt);
   }
-  it = allowed_contacts_.find(name2);
-  if (it != allowed_contacts_.end())
+  it = data_->allowed_contacts_.find(name2);
+  if (it != data_->allowed_contacts_.end())
   {
     std::map<std::string, DecideContactFn>::iterator jt = it->second.find(name1);
     if (jt != it->second.end())
@@ -201,8 +208,10 @@ void collision_detection::AllowedCollisionMatrix::setEntry(const std::vector<std
 
 void collision_detection::AllowedCollisionMatrix::setEntry(const std::string& name, bool allowed)
 {
+  // make the data unique before iterating over it
+  modify();
   std::string last = name;
-  for (std::map<std::string, std::map<std::string, AllowedCollision::Type> >::iterator it = entries_.begin() ; it != entries_.end() ; ++it)
+  for (std::map<std::string, std::map<std::string, AllowedCollision::Type> >::iterator it = data_->entries_.begin() ; it != data_->entries_.end() ; ++it)
     if (name != it->first && last != it->first)
     {
       last = it->first;
@@ -212,29 +221,32 @@ void collision_detection::AllowedCollisionMatrix::setEntry(const std::string& na
 
 void collision_detection::AllowedCollisionMatrix::setEntry(bool allowed)
 {
+  modify();
   const AllowedCollision::Type v = allowed ? AllowedCollision::ALWAYS : AllowedCollision::NEVER;
-  for (std::map<std::string, std::map<std::string, AllowedCollision::Type> >::iterator it1 = entries_.begin() ; it1 != entries_.end() ; ++it1)
+  for (std::map<std::string, std::map<std::string, AllowedCollision::Type> >::iterator it1 = data_->entries_.begin() ; it1 != data_->entries_.end() ; ++it1)
     for (std::map<std::string, AllowedCollision::Type>::iterator it2 = it1->second.begin() ; it2 != it1->second.end() ; ++it2)
       it2->second = v;
 }
 
 void collision_detection::AllowedCollisionMatrix::setDefaultEntry(const std::string &name, bool allowed)
 {
+  modify();
   const AllowedCollision::Type v = allowed ? AllowedCollision::ALWAYS : AllowedCollision::NEVER;
-  default_entries_[name] = v;
-  default_allowed_contacts_.erase(name);
+  data_->default_entries_[name] = v;
+  data_->default_allowed_contacts_.erase(name);
 }
 
 void collision_detection::AllowedCollisionMatrix::setDefaultEntry(const std::string &name, const DecideContactFn &fn)
 {
-  default_entries_[name] = AllowedCollision::CONDITIONAL;
-  default_allowed_contacts_[name] = fn;
+  modify();
+  data_->default_entries_[name] = AllowedCollision::CONDITIONAL;
+  data_->default_allowed_contacts_[name] = fn;
 }
 
 bool collision_detection::AllowedCollisionMatrix::getDefaultEntry(const std::string &name, AllowedCollision::Type &allowed_collision) const
 {
-  std::map<std::string, AllowedCollision::Type>::const_iterator it = default_entries_.find(name);
-  if (it == default_entries_.end())
+  std::map<std::string, AllowedCollision::Type>::const_iterator it = data_->default_entries_.find(name);
+  if (it == data_->default_entries_.end())
     return false;
   allowed_collision = it->second;
   return true;
@@ -242,8 +254,8 @@ bool collision_detection::AllowedCollisionMatrix::getDefaultEntry(const std::str
 
 bool collision_detection::AllowedCollisionMatrix::getDefaultEntry(const std::string &name, DecideContactFn &fn) const
 {
-  std::map<std::string, DecideContactFn>::const_iterator it = default_allowed_contacts_.find(name);
-  if (it == default_allowed_contacts_.end())
+  std::map<std::string, DecideContactFn>::const_iterator it = data_->default_allowed_contacts_.find(name);
+  if (it == data_->default_allowed_contacts_.end())
     return false;
   fn = it->second;
   return true;
@@ -315,16 +327,279 @@ bool collision_detection::AllowedCollisionMatrix::getAllowedCollision(const std:
 
 void collision_detection::AllowedCollisionMatrix::clear()
 {
-  entries_.clear();
-  allowed_contacts_.clear();
-  default_entries_.clear();
-  default_allowed_contacts_.clear();
+  modify();
+  data_->entries_.clear();
+  data_->allowed_contacts_.clear();
+  data_->default_entries_.clear();
+  data_->default_allowed_contacts_.clear();
+}
+
+namespace collision_detection
+{
+namespace
+{
+struct NameIndexRegistry
+{
+  /* The number of names without references that are remembered; when there are more, the oldest ones are forgotten
+     and their indices are reused, so the registry does not grow with names that are no longer in use */
+  static const std::size_t MAX_UNREFERENCED_NAMES = 1024;
+
+  NameIndexRegistry() : unreferenced_count_(0)
+  {
+  }
+
+  std::size_t getIndex(const std::string &name)
+  {
+    std::map<std::string, std::size_t>::const_iterator it = index_.find(name);
+    if (it != index_.end())
+      return it->second;
+
+    std::size_t index;
+    if (free_.empty())
+    {
+      index = names_.size();
+      names_.push_back(name);
+      references_.push_back(0);
+      registered_.push_back(true);
+      queued_.push_back(false);
+    }
+    else
+    {
+      index = free_.back();
+      free_.pop_back();
+      names_[index] = name;
+      registered_[index] = true;
+    }
+    index_[name] = index;
+    becameUnreferenced(index);
+    return index;
+  }
+
+  void acquire(std::size_t index)
+  {
+    if (references_[index]++ == 0)
+      --unreferenced_count_;
+  }
+
+  void release(std::size_t index)
+  {
+    if (index < references_.size() && references_[index] > 0 && --references_[index] == 0)
+      becameUnreferenced(index);
+  }
+
+  void becameUnreferenced(std::size_t index)
+  {
+    ++unreferenced_count_;
+    if (!queued_[index])
+    {
+      queued_[index] = true;
+      unreferenced_.push_back(index);
+    }
+    // every unreferenced name is queued, so this finds enough of them
+    while (unreferenced_count_ > MAX_UNREFERENCED_NAMES)
+    {
+      std::size_t oldest = unreferenced_.front();
+      unreferenced_.pop_front();
+      queued_[oldest] = false;
+      if (references_[oldest] == 0 && registered_[oldest])
+      {
+        index_.erase(names_[oldest]);
+        names_[oldest].clear();
+        registered_[oldest] = false;
+        free_.push_back(oldest);
+        --unreferenced_count_;
+      }
+    }
+  }
+
+  boost::mutex                       lock_;
+  std::map<std::string, std::size_t> index_;
+  std::vector<std::string>           names_;
+  std::vector<std::size_t>           references_;
+  std::vector<bool>                  registered_;
+  std::vector<bool>                  queued_;
+  std::vector<std::size_t>           free_;
+
+  // indices that had no references when queued, oldest first
+  std::deque<std::size_t>            unreferenced_;
+  std::size_t                        unreferenced_count_;
+};
+
+NameIndexRegistry& getNameIndexRegistry()
+{
+  static NameIndexRegistry registry;
+  return registry;
+}
+
+boost::mutex& getCompileLock()
+{
+  static boost::mutex lock;
+  return lock;
+}
+
+boost::uint64_t newVersion()
+{
+  static boost::mutex lock;
+  static boost::uint64_t version = 0;
+  boost::mutex::scoped_lock slock(lock);
+  return ++version;
+}
+
+struct ConditionalKeyLess
+{
+  bool operator()(const std::pair<std::size_t, DecideContactFn> &a, std::size_t key) const
+  {
+    return a.first < key;
+  }
+};
+}
+}
+
+collision_detection::AllowedCollisionMatrix::Data::Data() :
+  version_(newVersion())
+{
+}
+
+void collision_detection::AllowedCollisionMatrix::modify()
+{
+  // the data may be shared with copies of this matrix; those keep the previous version
+  if (!data_.unique())
+    data_.reset(new Data(*data_));
+  data_->version_ = newVersion();
+  boost::mutex::scoped_lock slock(getCompileLock());
+  data_->compiled_.reset();
+  data_->message_.reset();
+}
+
+bool collision_detection::CompiledAllowedCollisionMatrix::getAllowedCollision(std::size_t index1, std::size_t index2, DecideContactFn &fn) const
+{
+  const int i1 = index1 < local_index_.size() ? local_index_[index1] : -1;
+  const int i2 = index2 < local_index_.size() ? local_index_[index2] : -1;
+  std::size_t key;
+  if (i1 >= 0 && i2 >= 0)
+    key = i1 * size_ + i2;
+  else
+    if (i1 >= 0)
+      key = size_ * size_ + i1;
+    else
+      if (i2 >= 0)
+        key = size_ * size_ + i2;
+      else
+        return false;
+  std::vector<std::pair<std::size_t, DecideContactFn> >::const_iterator it =
+    std::lower_bound(conditional_.begin(), conditional_.end(), key, ConditionalKeyLess());
+  if (it == conditional_.end() || it->first != key)
+    return false;
+  fn = it->second;
+  return true;
+}
+
+const unsigned char collision_detection::CompiledAllowedCollisionMatrix::NOT_FOUND;
+
+collision_detection::CompiledAllowedCollisionMatrix::~CompiledAllowedCollisionMatrix()
+{
+  for (std::size_t i = 0 ; i < name_indices_.size() ; ++i)
+    AllowedCollisionMatrix::releaseNameIndex(name_indices_[i]);
+}
+
+std::size_t collision_detection::AllowedCollisionMatrix::getNameIndex(const std::string &name)
+{
+  NameIndexRegistry &registry = getNameIndexRegistry();
+  boost::mutex::scoped_lock slock(registry.lock_);
+  return registry.getIndex(name);
+}
+
+std::size_t collision_detection::AllowedCollisionMatrix::acquireNameIndex(const std::string &name)
+{
+  NameIndexRegistry &registry = getNameIndexRegistry();
+  boost::mutex::scoped_lock slock(registry.lock_);
+  std::size_t index = registry.getIndex(name);
+  registry.acquire(index);
+  return index;
+}
+
+void collision_detection::AllowedCollisionMatrix::releaseNameIndex(std::size_t index)
+{
+  NameIndexRegistry &registry = getNameIndexRegistry();
+  boost::mutex::scoped_lock slock(registry.lock_);
+  registry.release(index);
+}
+
+std::string collision_detection::AllowedCollisionMatrix::getNameFromIndex(std::size_t index)
+{
+  NameIndexRegistry &registry = getNameIndexRegistry();
+  boost::mutex::scoped_lock slock(registry.lock_);
+  return index < registry.names_.size() ? registry.names_[index] : std::string();
+}
+
+collision_detection::CompiledAllowedCollisionMatrixConstPtr collision_detection::AllowedCollisionMatrix::getCompiled() const
+{
+  boost::mutex::scoped_lock slock(getCompileLock());
+  if (!data_->compiled_)
+  {
+    CompiledAllowedCollisionMatrix *compiled = new CompiledAllowedCollisionMatrix();
+    compile(*compiled);
+    data_->compiled_.reset(compiled);
+  }
+  return data_->compiled_;
+}
+
+void collision_detection::AllowedCollisionMatrix::compile(CompiledAllowedCollisionMatrix &compiled) const
+{
+  // the names for which a query can return something other than 'not found'
+  std::vector<std::string> names;
+  getAllEntryNames(names);
+  for (std::map<std::string, AllowedCollision::Type>::const_iterator it = data_->default_entries_.begin() ; it != data_->default_entries_.end() ; ++it)
+    if (data_->entries_.find(it->first) == data_->entries_.end())
+      names.push_back(it->first);
+
+  // the snapshot keeps the indices of its names from being reused while it exists
+  std::vector<std::size_t> &indices = compiled.name_indices_;
+  indices.resize(names.size());
+  std::size_t max_index = 0;
+  for (std::size_t i = 0 ; i < names.size() ; ++i)
+  {
+    indices[i] = acquireNameIndex(names[i]);
+    if (indices[i] + 1 > max_index)
+      max_index = indices[i] + 1;
+  }
+
+  compiled.size_ = names.size();
+  compiled.local_index_.assign(max_index, -1);
+  compiled.entries_.assign(names.size() * names.size(), CompiledAllowedCollisionMatrix::NOT_FOUND);
+  compiled.default_entries_.assign(names.size(), CompiledAllowedCollisionMatrix::NOT_FOUND);
+  for (std::size_t i = 0 ; i < names.size() ; ++i)
+  {
+    compiled.local_index_[indices[i]] = i;
+    AllowedCollision::Type type;
+    for (std::size_t j = 0 ; j < names.size() ; ++j)
+      if (getAllowedCollision(names[i], names[j], type))
+      {
+        compiled.entries_[i * names.size() + j] = type;
+        DecideContactFn fn;
+        if (type == AllowedCollision::CONDITIONAL && getAllowedCollision(names[i], names[j], fn))
+          compiled.conditional_.push_back(std::make_pair(i * names.size() + j, fn));
+      }
+  }
+
+  // keys for the defaults come after all the pairs, so the table stays sorted
+  for (std::size_t i = 0 ; i < names.size() ; ++i)
+  {
+    AllowedCollision::Type type;
+    if (getDefaultEntry(names[i], type))
+    {
+      compiled.default_entries_[i] = type;
+      DecideContactFn fn;
+      if (type == AllowedCollision::CONDITIONAL && getDefaultEntry(names[i], fn))
+        compiled.conditional_.push_back(std::make_pair(names.size() * names.size() + i, fn));
+    }
+  }
 }
 
 void collision_detection::AllowedCollisionMatrix::getAllEntryNames(std::vector<std::string>& names) const
 {
   names.clear();
-  for (std::map<std::string, std::map<std::string, AllowedCollision::Type> >::const_iterator it = entries_.begin() ; it != entries_.end() ; ++it)
+  for (std::map<std::string, std::map<std::string, AllowedCollision::Type> >::const_iterator it = data_->entries_.begin() ; it != data_->entries_.end() ; ++it)
     if (!names.empty() && names.back() == it->first)
       continue;
     else
@@ -332,6 +607,18 @@ void collision_detection::AllowedCollisionMatrix::getAllEntryNames(std::vector<s
 }
 
 void collision_detection::AllowedCollisionMatrix::getMessage(moveit_msgs::AllowedCollisionMatrix &msg) const
+{
+  boost::mutex::scoped_lock slock(getCompileLock());
+  if (!data_->message_)
+  {
+    moveit_msgs::AllowedCollisionMatrix *message = new moveit_msgs::AllowedCollisionMatrix();
+    computeMessage(*message);
+    data_->message_.reset(message);
+  }
+  msg = *data_->message_;
+}
+
+void collision_detection::AllowedCollisionMatrix::computeMessage(moveit_msgs::AllowedCollisionMatrix &msg) const
 {
   msg.entry_names.clear();
   msg.entry_values.clear();
@@ -40,6 +40,12 @@
 #include <octomap/math/Vector3.h>
 #include <octomap/math/Utils.h>
 #include <octomap/octomap.h>
+#include <moveit/background_processing/thread_pool.h>
+#include <boost/thread.hpp>
+#include <boost/bind.hpp>
+#include <boost/cstdint.hpp>
+#include <algorithm>
+#include <map>
 
 //static const double ISO_VALUE  = 0.5; // TODO magic number! (though, probably a good one).
 //static const double R_MULTIPLE = 1.5; // TODO magic number! (though, probably a good one).
@@ -70,13 +76,122 @@ bool sampleCloud(const octomap::point3d_list& cloud,
                  octomath::Vector3& gradient);
 
 
+namespace
+{
+
+// call fn for every index in [0, count), distributing the indices over thread_count threads of the shared pool (the calling
+// thread included)
+struct ParallelFor
+{
+  ParallelFor(const boost::function<void(std::size_t)> &fn, std::size_t count) : fn_(fn), count_(count), next_(0)
+  {
+  }
+
+  bool next(std::size_t &index)
+  {
+    boost::mutex::scoped_lock slock(lock_);
+    if (next_ >= count_)
+      return false;
+    index = next_++;
+    return true;
+  }
+
+  void work()
+  {
+    std::size_t index;
+    while (next(index))
+      fn_(index);
+  }
+
+  void run(unsigned int thread_count)
+  {
+    if (thread_count > count_)
+      thread_count = count_;
+    if (thread_count <= 1)
+      work();
+    else
+      moveit::tools::ThreadPool::Instance().runConcurrently(boost::bind(&ParallelFor::work, this), thread_count);
+  }
+
+  const boost::function<void(std::size_t)> &fn_;
+  std::size_t  count_;
+  boost::mutex lock_;
+  std::size_t  next_;
+};
+
+// the occupied cells in a bounding box of the octree; contacts whose bounding boxes cover the same range of
+// octree keys share the same cells
+struct Neighborhood
+{
+  octomath::Vector3    bbx_min_;
+  octomath::Vector3    bbx_max_;
+  octomap::point3d_list node_centers_;
+};
+
+struct RefineData
+{
+  void extract(std::size_t index)
+  {
+    Neighborhood &nb = neighborhoods_[index];
+    octomap::OcTreeBaseImpl<octomap::OcTreeNode, octomap::AbstractOccupancyOcTree>::leaf_bbx_iterator it = octree_->begin_leafs_bbx(nb.bbx_min_, nb.bbx_max_);
+    octomap::OcTreeBaseImpl<octomap::OcTreeNode, octomap::AbstractOccupancyOcTree>::leaf_bbx_iterator leafs_end = octree_->end_leafs_bbx();
+    for( ; it != leafs_end; ++it)
+      if(octree_->isNodeOccupied(*it)) // magic number!
+        nb.node_centers_.push_back(it.getCoordinate());
+  }
+
+  void refine(std::size_t index)
+  {
+    collision_detection::Contact &contact = *contacts_[index];
+    octomath::Vector3 contact_point(contact.pos[0], contact.pos[1], contact.pos[2]);
+    octomath::Vector3 contact_normal(contact.normal[0], contact.normal[1], contact.normal[2]);
+
+    octomath::Vector3 n;
+    double depth;
+    if(getMetaballSurfaceProperties(neighborhoods_[contact_neighborhood_[index]].node_centers_, cell_size_, iso_value_, metaball_radius_multiple_,
+                                    contact_point, n, depth, estimate_depth_))
+    {
+      // only modify normal if the refinement predicts a "very different" result.
+      double divergence = contact_normal.angleTo(n);
+      if(divergence > allowed_angle_divergence_)
+      {
+        modified_[index] = 1;
+        contact.normal = Eigen::Vector3d(n.x(), n.y(), n.z());
+      }
+
+      if(estimate_depth_)
+        contact.depth = depth;
+    }
+  }
+
+  boost::shared_ptr<const octomap::OcTree> octree_;
+  double cell_size_;
+  double allowed_angle_divergence_;
+  bool   estimate_depth_;
+  double iso_value_;
+  double metaball_radius_multiple_;
+
+  std::vector<Neighborhood>                neighborhoods_;
+  std::vector<collision_detection::Contact*> contacts_;
+  std::vector<std::size_t>                 contact_neighborhood_;
+  std::vector<char>                        modified_;
+};
+
+inline boost::uint64_t packKey(const octomap::OcTreeKey &key)
+{
+  return ((boost::uint64_t)key[0] << 32) | ((boost::uint64_t)key[1] << 16) | (boost::uint64_t)key[2];
+}
+
+}
+
 int collision_detection::refineContactNormals(const World::ObjectConstPtr& object,
                                               CollisionResult &res,
                                               double cell_bbx_search_distance,
                                               double allowed_angle_divergence,
                                               bool estimate_depth,
                                               double iso_value,
-                                              double metaball_radius_multiple)
+                                              double metaball_radius_multiple,
+                                              unsigned int thread_count)
 {
   if(!object)
   {
@@ -88,90 +203,67 @@ int collision_detection::refineContactNormals(const World::ObjectConstPtr& objec
     logWarn("There do not appear to be any contacts, so there is nothing to refine!");
     return 0;
   }
+  if(object->shapes_.empty())
+    return 0;
+  boost::shared_ptr<const shapes::OcTree> shape_octree = boost::dynamic_pointer_cast<const shapes::OcTree>(object->shapes_[0]);
+  if(!shape_octree)
+    return 0;
 
-  int modified = 0;
+  RefineData data;
+  data.octree_ = shape_octree->octree;
+  data.cell_size_ = data.octree_->getResolution();
+  data.allowed_angle_divergence_ = allowed_angle_divergence;
+  data.estimate_depth_ = estimate_depth;
+  data.iso_value_ = iso_value;
+  data.metaball_radius_multiple_ = metaball_radius_multiple;
 
-  // iterate through contacts
+  // collect the contacts with the octomap, and the neighborhoods they need
+  std::map<std::pair<boost::uint64_t, boost::uint64_t>, std::size_t> neighborhood_index;
   for( collision_detection::CollisionResult::ContactMap::iterator it = res.contacts.begin(); it != res.contacts.end(); ++it)
   {
-    std::string contact1 = it->first.first;
-    std::string contact2 = it->first.second;
-    std::string octomap_name = "";
+    if(it->first.first.find("octomap") == std::string::npos && it->first.second.find("octomap") == std::string::npos)
+      continue;
     std::vector<collision_detection::Contact>& contact_vector = it->second;
-
-    if(      contact1.find("octomap") != std::string::npos ) octomap_name = contact1;
-    else if( contact2.find("octomap") != std::string::npos ) octomap_name = contact2;
-    else
+    for(size_t contact_index = 0; contact_index < contact_vector.size(); contact_index++)
     {
-      continue;
-    }
+      const Eigen::Vector3d& point = contact_vector[contact_index].pos;
+      octomath::Vector3 contact_point(point[0], point[1], point[2]);
+      octomath::Vector3 diagonal = octomath::Vector3(1,1,1);
+      octomath::Vector3 bbx_min = contact_point - diagonal*data.cell_size_*cell_bbx_search_distance;
+      octomath::Vector3 bbx_max = contact_point + diagonal*data.cell_size_*cell_bbx_search_distance;
 
-    double cell_size = 0;
-    if(!object->shapes_.empty())
-    {
-      const shapes::ShapeConstPtr& shape = object->shapes_[0];
-      boost::shared_ptr<const shapes::OcTree> shape_octree = boost::dynamic_pointer_cast<const shapes::OcTree>(shape);
-      if(shape_octree)
+      // the bounding box search covers whole cells, so boxes that span the same keys produce the same cells
+      octomap::OcTreeKey key_min, key_max;
+      std::size_t index = data.neighborhoods_.size();
+      if(data.octree_->coordToKeyChecked(bbx_min, key_min) && data.octree_->coordToKeyChecked(bbx_max, key_max))
+      {
+        std::pair<std::map<std::pair<boost::uint64_t, boost::uint64_t>, std::size_t>::iterator, bool> ins =
+          neighborhood_index.insert(std::make_pair(std::make_pair(packKey(key_min), packKey(key_max)), index));
+        index = ins.first->second;
+      }
+      if(index == data.neighborhoods_.size())
       {
-        boost::shared_ptr<const octomap::OcTree> octree = shape_octree->octree;
-        cell_size = octree->getResolution();
-        for(size_t contact_index = 0; contact_index < contact_vector.size(); contact_index++)
-        {
-          const Eigen::Vector3d& point =   contact_vector[contact_index].pos;
-          const Eigen::Vector3d& normal =  contact_vector[contact_index].normal;
-
-          octomath::Vector3 contact_point(point[0], point[1], point[2]);
-          octomath::Vector3 contact_normal(normal[0], normal[1], normal[2]);
-          octomath::Vector3 diagonal = octomath::Vector3(1,1,1);
-          octomath::Vector3 bbx_min = contact_point - diagonal*cell_size*cell_bbx_search_distance;
-          octomath::Vector3 bbx_max = contact_point + diagonal*cell_size*cell_bbx_search_distance;
-          octomap::point3d_list node_centers;
-          octomap::OcTreeBaseImpl<octomap::OcTreeNode, octomap::AbstractOccupancyOcTree>::leaf_bbx_iterator it = octree->begin_leafs_bbx(bbx_min, bbx_max);
-          octomap::OcTreeBaseImpl<octomap::OcTreeNode, octomap::AbstractOccupancyOcTree>::leaf_bbx_iterator leafs_end = octree->end_leafs_bbx();
-          int count = 0;
-          for(  ; it != leafs_end; ++it)
-          {
-            octomap::point3d pt = it.getCoordinate();
-            //double prob = it->getOccupancy();
-            if(octree->isNodeOccupied(*it)) // magic number!
-            {
-              count++;
-              node_centers.push_back(pt);
-              //logInform("Adding point %d with prob %.3f at [%.3f, %.3f, %.3f]", count, prob, pt.x(), pt.y(), pt.z());
-            }
-          }
-          //logInform("Contact point at [%.3f, %.3f, %.3f], cell size %.3f, occupied cells %d",
-          //          contact_point.x(), contact_point.y(), contact_point.z(), cell_size, count);
-
-          //octree->getOccupiedLeafsBBX(node_centers, bbx_min, bbx_max);
-          //logError("bad stuff in collision_octomap_filter.cpp; need to port octomap call for groovy");
-
-          octomath::Vector3 n;
-          double depth;
-          if(getMetaballSurfaceProperties(node_centers, cell_size, iso_value, metaball_radius_multiple,
-                                          contact_point, n, depth, estimate_depth))
-          {
-            // only modify normal if the refinement predicts a "very different" result.
-            double divergence = contact_normal.angleTo(n);
-            if(divergence > allowed_angle_divergence)
-            {
-              modified++;
-//              logInform("Normals differ by %.3f, changing: [%.3f, %.3f, %.3f] -> [%.3f, %.3f, %.3f]",
-//                        divergence,
-//                        contact_normal.x(), contact_normal.y(), contact_normal.z(),
-//                        n.x(), n.y(), n.z());
-              contact_vector[contact_index].normal = Eigen::Vector3d(n.x(), n.y(), n.z());
-            }
-
-            if(estimate_depth)
-              contact_vector[contact_index].depth = depth;
-
-          }
-        }
+        data.neighborhoods_.resize(index + 1);
+        data.neighborhoods_[index].bbx_min_ = bbx_min;
+        data.neighborhoods_[index].bbx_max_ = bbx_max;
       }
+      data.contacts_.push_back(&contact_vector[contact_index]);
+      data.contact_neighborhood_.push_back(index);
     }
   }
-  return modified;
+  data.modified_.resize(data.contacts_.size(), 0);
+
+  unsigned int pool_threads = moveit::tools::ThreadPool::Instance().getThreadCount();
+  if (thread_count == 0 || thread_count > pool_threads)
+    thread_count = pool_threads;
+
+  // reading the octree and refining distinct contacts can be done concurrently
+  boost::function<void(std::size_t)> extract = boost::bind(&RefineData::extract, &data, _1);
+  ParallelFor(extract, data.neighborhoods_.size()).run(thread_count);
+  boost::function<void(std::size_t)> refine = boost::bind(&RefineData::refine, &data, _1);
+  ParallelFor(refine, data.contacts_.size()).run(thread_count);
+
+  return std::count(data.modified_.begin(), data.modified_.end(), 1);
 }
 
 bool getMetaballSurfaceProperties(const octomap::point3d_list& cloud,
@@ -35,7 +35,14 @@
 /* Author: Ioan Sucan */
 
 #include <moveit/collision_detection/collision_robot.h>
+#include <moveit/background_processing/thread_pool.h>
+#include <geometric_shapes/bodies.h>
+#include <boost/bind.hpp>
+#include <boost/thread/mutex.hpp>
 #include <limits>
+#include <algorithm>
+#include <deque>
+#include <cmath>
 
 static inline bool validateScale(double scale)
 {
@@ -251,6 +258,416 @@ void collision_detection::CollisionRobot::getScale(std::vector<moveit_msgs::Link
   }
 }
 
+void collision_detection::CollisionRobot::distanceSelf(const DistanceRequest &req, DistanceResult &res, const robot_state::RobotState &state) const
+{
+  res.distance = std::min(distanceSelf(state), req.max_distance);
+}
+
+void collision_detection::CollisionRobot::distanceSelf(const DistanceRequest &req, DistanceResult &res, const robot_state::RobotState &state,
+                                                       const AllowedCollisionMatrix &acm) const
+{
+  res.distance = std::min(distanceSelf(state, acm), req.max_distance);
+}
+
 void collision_detection::CollisionRobot::updatedPaddingOrScaling(const std::vector<std::string> &links)
 {
 }
+
+namespace collision_detection
+{
+namespace
+{
+
+// The planes of the faces of the convex hull of a mesh, in the frame of the mesh, with the normals pointing outwards
+struct HullPlanes
+{
+  EigenSTL::vector_Vector3d vertices_;
+  Eigen::Vector3d           center_;
+  EigenSTL::vector_Vector3d normals_;
+  std::vector<double>       offsets_;
+};
+
+typedef boost::shared_ptr<const HullPlanes> HullPlanesConstPtr;
+
+/* Convex hulls of the meshes used in point queries, by the address of the mesh. The mesh is kept alive by its entry, so
+   its address cannot be reused by a different mesh while it is in the cache. */
+struct HullCache
+{
+  static const std::size_t MAX_SIZE = 512;
+
+  boost::mutex lock_;
+  std::map<const shapes::Shape*, std::pair<shapes::ShapeConstPtr, HullPlanesConstPtr> > hulls_;
+  std::deque<const shapes::Shape*> order_;
+};
+
+HullCache& getHullCache()
+{
+  static HullCache cache;
+  return cache;
+}
+
+// returns an empty pointer if the hull cannot be computed
+HullPlanesConstPtr computeHullPlanes(const shapes::Mesh &mesh)
+{
+  bodies::ConvexMesh hull(&mesh);
+  const EigenSTL::vector_Vector3d &vertices = hull.getVertices();
+  const std::vector<unsigned int> &triangles = hull.getTriangles();
+  if (vertices.empty() || triangles.size() < 3)
+    return HullPlanesConstPtr();
+
+  boost::shared_ptr<HullPlanes> result(new HullPlanes());
+  result->vertices_ = vertices;
+  result->center_ = Eigen::Vector3d::Zero();
+  for (std::size_t i = 0 ; i < vertices.size() ; ++i)
+    result->center_ += vertices[i];
+  result->center_ /= (double)vertices.size();
+
+  for (std::size_t i = 0 ; i + 2 < triangles.size() ; i += 3)
+  {
+    const Eigen::Vector3d &a = vertices[triangles[i]];
+    Eigen::Vector3d n = (vertices[triangles[i + 1]] - a).cross(vertices[triangles[i + 2]] - a);
+    double l = n.norm();
+    if (l < std::numeric_limits<double>::epsilon())
+      continue;
+    n /= l;
+    if (n.dot(result->center_ - a) > 0.0)
+      n = -n;
+    double w = -n.dot(a);
+
+    // the triangles of one face of the hull all give the same plane
+    bool duplicate = false;
+    for (std::size_t j = 0 ; j < result->normals_.size() && !duplicate ; ++j)
+      duplicate = result->normals_[j].dot(n) > 1.0 - 1e-9 && std::fabs(result->offsets_[j] - w) < 1e-9;
+    if (!duplicate)
+    {
+      result->normals_.push_back(n);
+      result->offsets_.push_back(w);
+    }
+  }
+  if (result->normals_.empty())
+    return HullPlanesConstPtr();
+  return result;
+}
+
+HullPlanesConstPtr getHullPlanes(const shapes::ShapeConstPtr &shape)
+{
+  HullCache &cache = getHullCache();
+  {
+    boost::mutex::scoped_lock slock(cache.lock_);
+    std::map<const shapes::Shape*, std::pair<shapes::ShapeConstPtr, HullPlanesConstPtr> >::const_iterator it = cache.hulls_.find(shape.get());
+    if (it != cache.hulls_.end())
+      return it->second.second;
+  }
+
+  // the hull is computed outside the lock; meshes that have no hull are remembered too
+  HullPlanesConstPtr planes = computeHullPlanes(static_cast<const shapes::Mesh&>(*shape));
+  boost::mutex::scoped_lock slock(cache.lock_);
+  if (cache.hulls_.insert(std::make_pair(shape.get(), std::make_pair(shape, planes))).second)
+  {
+    cache.order_.push_back(shape.get());
+    while (cache.order_.size() > HullCache::MAX_SIZE)
+    {
+      cache.hulls_.erase(cache.order_.front());
+      cache.order_.pop_front();
+    }
+  }
+  return planes;
+}
+
+// A shape of the robot placed at the pose it has in some state, with its padding and scaling applied
+struct PointQueryBody
+{
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+  // the signed distance from \e point (in the model frame) to the shape
+  double signedDistance(const Eigen::Vector3d &point) const
+  {
+    const Eigen::Vector3d p = inverse_pose_ * point;
+    switch (type_)
+    {
+    case shapes::SPHERE:
+      return p.norm() - dims_[0];
+    case shapes::BOX:
+      {
+        const Eigen::Vector3d q = p.cwiseAbs() - dims_;
+        return q.cwiseMax(Eigen::Vector3d::Zero()).norm() + std::min(q.maxCoeff(), 0.0);
+      }
+    case shapes::CYLINDER:
+      {
+        const double radial = std::sqrt(p.x() * p.x() + p.y() * p.y()) - dims_[0];
+        const double axial = std::fabs(p.z()) - dims_[1];
+        const double r = std::max(radial, 0.0);
+        const double a = std::max(axial, 0.0);
+        return std::sqrt(r * r + a * a) + std::min(std::max(radial, axial), 0.0);
+      }
+    default:
+      {
+        const EigenSTL::vector_Vector3d &normals = hull_->normals_;
+        double d = -std::numeric_limits<double>::infinity();
+        for (std::size_t i = 0 ; i < normals.size() ; ++i)
+          d = std::max(d, normals[i].dot(p) + offsets_[i]);
+        return d;
+      }
+    }
+  }
+
+  // true if \e point is within \e margin of the bounding box of the shape
+  bool nearBoundingBox(const Eigen::Vector3d &point, double margin) const
+  {
+    return point.x() >= aabb_min_.x() - margin && point.x() <= aabb_max_.x() + margin &&
+      point.y() >= aabb_min_.y() - margin && point.y() <= aabb_max_.y() + margin &&
+      point.z() >= aabb_min_.z() - margin && point.z() <= aabb_max_.z() + margin;
+  }
+
+  shapes::ShapeType   type_;
+
+  // transform from the model frame to the frame of the shape
+  Eigen::Affine3d     inverse_pose_;
+
+  // radius for spheres; half extents for boxes; radius and half length for cylinders
+  Eigen::Vector3d     dims_;
+
+  // for meshes, the planes of the hull; the offsets include the scaling and padding
+  HullPlanesConstPtr  hull_;
+  std::vector<double> offsets_;
+
+  // the axis aligned bounding box of the shape, in the model frame
+  Eigen::Vector3d     aabb_min_;
+  Eigen::Vector3d     aabb_max_;
+};
+
+typedef std::vector<PointQueryBody, Eigen::aligned_allocator<PointQueryBody> > PointQueryBodies;
+
+void addPointQueryBody(const shapes::ShapeConstPtr &shape, const Eigen::Affine3d &pose, double scale, double padding,
+                       PointQueryBodies &bodies)
+{
+  PointQueryBody b;
+  Eigen::Vector3d center = Eigen::Vector3d::Zero();
+  Eigen::Vector3d extents;
+
+  // the padding and scaling are applied the same way geometric_shapes applies them to bodies
+  switch (shape->type)
+  {
+  case shapes::SPHERE:
+    b.dims_.setConstant(static_cast<const shapes::Sphere*>(shape.get())->radius * scale + padding);
+    extents = b.dims_;
+    break;
+  case shapes::BOX:
+    {
+      const double *size = static_cast<const shapes::Box*>(shape.get())->size;
+      b.dims_ = Eigen::Vector3d(size[0], size[1], size[2]) * (scale / 2.0) + Eigen::Vector3d::Constant(padding);
+      extents = b.dims_;
+    }
+    break;
+  case shapes::CYLINDER:
+    {
+      const shapes::Cylinder *cylinder = static_cast<const shapes::Cylinder*>(shape.get());
+      b.dims_ = Eigen::Vector3d(cylinder->radius * scale + padding, cylinder->length * scale / 2.0 + padding, 0.0);
+      extents = Eigen::Vector3d(b.dims_[0], b.dims_[0], b.dims_[1]);
+    }
+    break;
+  case shapes::MESH:
+    {
+      b.hull_ = getHullPlanes(shape);
+      if (!b.hull_)
+        return;
+      // scaling is about the center of the hull; padding moves every face outwards
+      const HullPlanes &hull = *b.hull_;
+      b.offsets_.resize(hull.offsets_.size());
+      for (std::size_t i = 0 ; i < hull.offsets_.size() ; ++i)
+        b.offsets_[i] = scale * hull.offsets_[i] - (1.0 - scale) * hull.normals_[i].dot(hull.center_) - padding;
+      Eigen::Vector3d lo = Eigen::Vector3d::Constant(std::numeric_limits<double>::infinity());
+      Eigen::Vector3d hi = -lo;
+      for (std::size_t i = 0 ; i < hull.vertices_.size() ; ++i)
+      {
+        const Eigen::Vector3d v = hull.center_ + (hull.vertices_[i] - hull.center_) * scale;
+        lo = lo.cwiseMin(v);
+        hi = hi.cwiseMax(v);
+      }
+      center = (lo + hi) / 2.0;
+      extents = (hi - lo) / 2.0 + Eigen::Vector3d::Constant(padding);
+    }
+    break;
+  default:
+    logDebug("Shapes of type %d are ignored by point queries", (int)shape->type);
+    return;
+  }
+
+  b.type_ = shape->type;
+  b.inverse_pose_ = pose.inverse(Eigen::Isometry);
+  const Eigen::Vector3d c = pose * center;
+  const Eigen::Vector3d e = pose.rotation().cwiseAbs() * extents;
+  b.aabb_min_ = c - e;
+  b.aabb_max_ = c + e;
+  bodies.push_back(b);
+}
+
+void getPointQueryBodies(const CollisionRobot &robot, const robot_state::RobotState &state, PointQueryBodies &bodies)
+{
+  const std::vector<const robot_model::LinkModel*> &links = robot.getRobotModel()->getLinkModelsWithCollisionGeometry();
+  for (std::size_t i = 0 ; i < links.size() ; ++i)
+  {
+    double scale = robot.getLinkScale(links[i]->getName());
+    double padding = robot.getLinkPadding(links[i]->getName());
+    const std::vector<shapes::ShapeConstPtr> &shapes = links[i]->getShapes();
+    for (std::size_t j = 0 ; j < shapes.size() ; ++j)
+      addPointQueryBody(shapes[j], state.getCollisionBodyTransform(links[i], j), scale, padding, bodies);
+  }
+
+  // attached bodies are not padded or scaled, as in collision checking
+  std::vector<const robot_state::AttachedBody*> ab;
+  state.getAttachedBodies(ab);
+  for (std::size_t i = 0 ; i < ab.size() ; ++i)
+  {
+    const std::vector<shapes::ShapeConstPtr> &shapes = ab[i]->getShapes();
+    const EigenSTL::vector_Affine3d &ab_t = ab[i]->getGlobalCollisionBodyTransforms();
+    for (std::size_t j = 0 ; j < shapes.size() ; ++j)
+      addPointQueryBody(shapes[j], ab_t[j], 1.0, 0.0, bodies);
+  }
+}
+
+struct PointQueryData
+{
+  // the number of points handed to a thread at once
+  static const std::size_t CHUNK_SIZE = 4096;
+
+  PointQueryData(const PointQueryBodies &bodies, const EigenSTL::vector_Vector3d &points, double max_distance,
+                 unsigned char *inside, double *distances) :
+    bodies_(bodies), points_(points), max_distance_(max_distance), inside_(inside), distances_(distances), next_(0)
+  {
+    // the bounding box of the whole robot rejects most points of a cloud at once
+    aabb_min_.setConstant(std::numeric_limits<double>::infinity());
+    aabb_max_ = -aabb_min_;
+    for (std::size_t i = 0 ; i < bodies_.size() ; ++i)
+    {
+      aabb_min_ = aabb_min_.cwiseMin(bodies_[i].aabb_min_);
+      aabb_max_ = aabb_max_.cwiseMax(bodies_[i].aabb_max_);
+    }
+  }
+
+  /// Get the next range of points to process; return false if there is nothing left to do
+  bool next(std::size_t &begin, std::size_t &end)
+  {
+    boost::mutex::scoped_lock slock(lock_);
+    if (next_ >= points_.size())
+      return false;
+    begin = next_;
+    end = std::min(next_ + CHUNK_SIZE, points_.size());
+    next_ = end;
+    return true;
+  }
+
+  bool nearRobot(const Eigen::Vector3d &p, double margin) const
+  {
+    return p.x() >= aabb_min_.x() - margin && p.x() <= aabb_max_.x() + margin &&
+      p.y() >= aabb_min_.y() - margin && p.y() <= aabb_max_.y() + margin &&
+      p.z() >= aabb_min_.z() - margin && p.z() <= aabb_max_.z() + margin;
+  }
+
+  bool inside(const Eigen::Vector3d &p) const
+  {
+    if (!nearRobot(p, 0.0))
+      return false;
+    for (std::size_t i = 0 ; i < bodies_.size() ; ++i)
+      if (bodies_[i].nearBoundingBox(p, 0.0) && bodies_[i].signedDistance(p) <= 0.0)
+        return true;
+    return false;
+  }
+
+  double distance(const Eigen::Vector3d &p) const
+  {
+    double d = max_distance_;
+    if (!nearRobot(p, d))
+      return d;
+    // only shapes whose bounding box is closer than the best distance so far can improve it
+    for (std::size_t i = 0 ; i < bodies_.size() ; ++i)
+      if (bodies_[i].nearBoundingBox(p, std::max(d, 0.0)))
+        d = std::min(d, bodies_[i].signedDistance(p));
+    return d;
+  }
+
+  void run()
+  {
+    std::size_t begin, end;
+    while (next(begin, end))
+      if (distances_)
+        for (std::size_t i = begin ; i < end ; ++i)
+          distances_[i] = distance(points_[i]);
+      else
+        for (std::size_t i = begin ; i < end ; ++i)
+          inside_[i] = inside(points_[i]) ? 1 : 0;
+  }
+
+  const PointQueryBodies          &bodies_;
+  const EigenSTL::vector_Vector3d &points_;
+  double                           max_distance_;
+  unsigned char                   *inside_;
+  double                          *distances_;
+  Eigen::Vector3d                  aabb_min_;
+  Eigen::Vector3d                  aabb_max_;
+
+  boost::mutex                     lock_;
+  std::size_t                      next_;
+};
+
+void runPointQuery(PointQueryData &data, unsigned int thread_count)
+{
+  std::size_t chunks = (data.points_.size() + PointQueryData::CHUNK_SIZE - 1) / PointQueryData::CHUNK_SIZE;
+  moveit::tools::ThreadPool &pool = moveit::tools::ThreadPool::Instance();
+  if (thread_count == 0 || thread_count > pool.getThreadCount())
+    thread_count = pool.getThreadCount();
+  if (thread_count > chunks)
+    thread_count = chunks;
+
+  if (thread_count <= 1)
+    data.run();
+  else
+    // the calling thread is one of the workers
+    pool.runConcurrently(boost::bind(&PointQueryData::run, &data), thread_count);
+}
+
+}
+}
+
+std::size_t collision_detection::CollisionRobot::checkPointsInside(const robot_state::RobotState &state, const EigenSTL::vector_Vector3d &points,
+                                                                   std::vector<bool> &inside, unsigned int thread_count) const
+{
+  inside.assign(points.size(), false);
+  if (points.empty())
+    return 0;
+
+  PointQueryBodies bodies;
+  getPointQueryBodies(*this, state, bodies);
+  if (bodies.empty())
+    return 0;
+
+  // std::vector<bool> cannot be written concurrently, so the threads fill bytes
+  std::vector<unsigned char> flags(points.size(), 0);
+  PointQueryData data(bodies, points, 0.0, &flags[0], NULL);
+  runPointQuery(data, thread_count);
+
+  std::size_t count = 0;
+  for (std::size_t i = 0 ; i < flags.size() ; ++i)
+    if (flags[i])
+    {
+      inside[i] = true;
+      ++count;
+    }
+  return count;
+}
+
+void collision_detection::CollisionRobot::computePointDistances(const robot_state::RobotState &state, const EigenSTL::vector_Vector3d &points,
+                                                                std::vector<double> &distances, double max_distance, unsigned int thread_count) const
+{
+  distances.assign(points.size(), max_distance);
+  if (points.empty())
+    return;
+
+  PointQueryBodies bodies;
+  getPointQueryBodies(*this, state, bodies);
+  if (bodies.empty())
+    return;
+
+  PointQueryData data(bodies, points, max_distance, NULL, &distances[0]);
+  runPointQuery(data, thread_count);
+}
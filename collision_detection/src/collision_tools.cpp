@@ -36,6 +36,63 @@
 
 #include <moveit/collision_detection/collision_tools.h>
 #include <eigen_conversions/eigen_msg.h>
+#include <boost/unordered_map.hpp>
+#include <boost/functional/hash.hpp>
+#include <limits>
+#include <cmath>
+
+namespace collision_detection
+{
+namespace
+{
+
+// cost sources that span more grid cells than this are not stored in the grid, but compared to every source
+const std::size_t MAX_COST_SOURCE_CELLS = 64;
+
+struct CostCell
+{
+  CostCell(int x, int y, int z) : x_(x), y_(y), z_(z) {}
+  bool operator==(const CostCell &other) const
+  {
+    return x_ == other.x_ && y_ == other.y_ && z_ == other.z_;
+  }
+  int x_, y_, z_;
+};
+
+struct CostCellHash
+{
+  std::size_t operator()(const CostCell &c) const
+  {
+    std::size_t seed = 0;
+    boost::hash_combine(seed, c.x_);
+    boost::hash_combine(seed, c.y_);
+    boost::hash_combine(seed, c.z_);
+    return seed;
+  }
+};
+
+int toCellIndex(double v)
+{
+  static const double limit = std::numeric_limits<int>::max() / 2;
+  return (int)std::max(-limit, std::min(limit, std::floor(v)));
+}
+
+// check if the box of \e other intersects the box of \e kept in at least \e overlap_fraction of the volume of \e kept
+bool overlapsEnough(const CostSource &kept, const CostSource &other, double overlap_fraction)
+{
+  double v = 1.0;
+  for (int i = 0 ; i < 3 ; ++i)
+  {
+    double d = std::min(kept.aabb_max[i], other.aabb_max[i]) - std::max(kept.aabb_min[i], other.aabb_min[i]);
+    if (d <= 0.0)
+      return false;
+    v *= d;
+  }
+  return v >= kept.getVolume() * overlap_fraction;
+}
+
+}
+}
 
 void collision_detection::getCostMarkers(visualization_msgs::MarkerArray& arr, const std::string& frame_id, std::set<CostSource> &cost_sources)
 {
@@ -152,6 +209,32 @@ double collision_detection::getTotalCost(const std::set<CostSource> &cost_source
 }
 
 
+collision_detection::CostSourceAccumulator::CostSourceAccumulator(std::size_t max_sources) :
+  max_sources_(max_sources)
+{
+}
+
+void collision_detection::CostSourceAccumulator::add(const CostSource &cost_source)
+{
+  // do not insert sources that would be removed right away
+  if (sources_.size() >= max_sources_ && (sources_.empty() || !(cost_source < *sources_.rbegin())))
+    return;
+  sources_.insert(cost_source);
+  while (sources_.size() > max_sources_)
+    sources_.erase(--sources_.end());
+}
+
+void collision_detection::CostSourceAccumulator::add(const std::set<CostSource> &cost_sources)
+{
+  for (std::set<CostSource>::const_iterator it = cost_sources.begin() ; it != cost_sources.end() ; ++it)
+  {
+    // the sources are sorted by decreasing cost, so once one is not kept, none of the following ones is
+    if (sources_.size() >= max_sources_ && (sources_.empty() || !(*it < *sources_.rbegin())))
+      break;
+    add(*it);
+  }
+}
+
 void collision_detection::intersectCostSources(std::set<CostSource> &cost_sources, const std::set<CostSource> &a, const std::set<CostSource> &b)
 {
   cost_sources.clear();
@@ -176,34 +259,87 @@ void collision_detection::intersectCostSources(std::set<CostSource> &cost_source
 
 void collision_detection::removeOverlapping(std::set<CostSource> &cost_sources, double overlap_fraction)
 {
-  double p[3], q[3];
-  for (std::set<CostSource>::iterator it = cost_sources.begin() ; it != cost_sources.end() ; ++it)
+  if (cost_sources.size() < 2)
+    return;
+
+  // the grid cell size is the average extent of the sources, so most sources cover a few cells
+  double cell_size = 0.0;
+  for (std::set<CostSource>::const_iterator it = cost_sources.begin() ; it != cost_sources.end() ; ++it)
+    cell_size += std::max(it->aabb_max[0] - it->aabb_min[0], std::max(it->aabb_max[1] - it->aabb_min[1], it->aabb_max[2] - it->aabb_min[2]));
+  cell_size /= cost_sources.size();
+  if (!(cell_size > 0.0))
+    return; // sources with no volume do not overlap
+
+  // the sources are visited in order of decreasing cost; a source is removed if it overlaps enough with a more
+  // costly source that is kept, so only the kept sources are indexed
+  std::vector<std::set<CostSource>::iterator> kept, remove;
+  std::vector<std::size_t> checked; // for each kept source, the last source it was compared to
+  boost::unordered_map<CostCell, std::vector<std::size_t>, CostCellHash> cells;
+  std::vector<std::size_t> large;
+  std::size_t visited = 0;
+
+  for (std::set<CostSource>::iterator it = cost_sources.begin() ; it != cost_sources.end() ; ++it, ++visited)
   {
-    double vol = it->getVolume() * overlap_fraction;
-    std::vector<std::set<CostSource>::iterator> remove;
-    std::set<CostSource>::iterator it1 = it;
-    for (std::set<CostSource>::iterator jt = ++it1 ; jt != cost_sources.end() ; ++jt)
+    int lo[3], hi[3];
+    std::size_t cell_count = 1;
+    for (int i = 0 ; i < 3 ; ++i)
     {
-      p[0] = std::max(it->aabb_min[0], jt->aabb_min[0]);
-      p[1] = std::max(it->aabb_min[1], jt->aabb_min[1]);
-      p[2] = std::max(it->aabb_min[2], jt->aabb_min[2]);
+      lo[i] = toCellIndex(it->aabb_min[i] / cell_size);
+      hi[i] = toCellIndex(it->aabb_max[i] / cell_size);
+      cell_count *= std::min<std::size_t>(MAX_COST_SOURCE_CELLS + 1, hi[i] - lo[i] + 1);
+    }
+    const bool in_grid = cell_count <= MAX_COST_SOURCE_CELLS;
 
-      q[0] = std::min(it->aabb_max[0], jt->aabb_max[0]);
-      q[1] = std::min(it->aabb_max[1], jt->aabb_max[1]);
-      q[2] = std::min(it->aabb_max[2], jt->aabb_max[2]);
+    bool overlaps = false;
+    for (std::size_t k = 0 ; k < large.size() && !overlaps ; ++k)
+      overlaps = overlapsEnough(*kept[large[k]], *it, overlap_fraction);
+    if (in_grid)
+    {
+      for (int x = lo[0] ; x <= hi[0] && !overlaps ; ++x)
+        for (int y = lo[1] ; y <= hi[1] && !overlaps ; ++y)
+          for (int z = lo[2] ; z <= hi[2] && !overlaps ; ++z)
+          {
+            boost::unordered_map<CostCell, std::vector<std::size_t>, CostCellHash>::const_iterator c = cells.find(CostCell(x, y, z));
+            if (c == cells.end())
+              continue;
+            for (std::size_t k = 0 ; k < c->second.size() && !overlaps ; ++k)
+            {
+              const std::size_t j = c->second[k];
+              if (checked[j] == visited)
+                continue;
+              checked[j] = visited;
+              overlaps = overlapsEnough(*kept[j], *it, overlap_fraction);
+            }
+          }
+    }
+    else
+      // a source outside the grid can overlap any kept source
+      for (std::size_t j = 0 ; j < kept.size() && !overlaps ; ++j)
+        overlaps = overlapsEnough(*kept[j], *it, overlap_fraction);
 
-      if (p[0] >= q[0] || p[1] >= q[1] || p[2] >= q[2])
-        continue;
+    if (overlaps)
+    {
+      remove.push_back(it);
+      continue;
+    }
 
-      double intersect_volume = (q[0] - p[0]) * (q[1] - p[1]) * (q[2] - p[2]);
-      if (intersect_volume >= vol)
-        remove.push_back(jt);
+    const std::size_t index = kept.size();
+    kept.push_back(it);
+    checked.push_back(visited);
+    if (in_grid)
+    {
+      for (int x = lo[0] ; x <= hi[0] ; ++x)
+        for (int y = lo[1] ; y <= hi[1] ; ++y)
+          for (int z = lo[2] ; z <= hi[2] ; ++z)
+            cells[CostCell(x, y, z)].push_back(index);
     }
-    for (std::size_t i = 0 ; i < remove.size() ; ++i)
-      cost_sources.erase(remove[i]);
+    else
+      large.push_back(index);
   }
-}
 
+  for (std::size_t i = 0 ; i < remove.size() ; ++i)
+    cost_sources.erase(remove[i]);
+}
 
 void collision_detection::removeCostSources(std::set<CostSource> &cost_sources, const std::set<CostSource> &cost_sources_to_remove, double overlap_fraction)
 {
@@ -257,6 +393,46 @@ void collision_detection::removeCostSources(std::set<CostSource> &cost_sources,
   }
 }
 
+bool collision_detection::getDistanceGradient(const robot_state::RobotState &state, const robot_model::JointModelGroup *group,
+                                              const DistanceResultsData &data, Eigen::VectorXd &gradient)
+{
+  gradient = Eigen::VectorXd::Zero(group->getVariableCount());
+  if (data.distance <= 0.0)
+    return false;
+
+  // the Jacobians are expressed in the frame of the parent link of the group
+  const robot_model::LinkModel *root_link = group->getJointModels()[0]->getParentLinkModel();
+  Eigen::Vector3d normal = root_link ? state.getGlobalLinkTransform(root_link).rotation().transpose() * data.normal : data.normal;
+
+  for (int i = 0 ; i < 2 ; ++i)
+  {
+    const robot_model::LinkModel *link = NULL;
+    if (data.body_types[i] == BodyTypes::ROBOT_LINK)
+      link = state.getRobotModel()->getLinkModel(data.body_names[i]);
+    else
+      if (data.body_types[i] == BodyTypes::ROBOT_ATTACHED)
+      {
+        const robot_state::AttachedBody *ab = state.getAttachedBody(data.body_names[i]);
+        if (ab)
+          link = ab->getAttachedLink();
+      }
+    if (!link || !group->isLinkUpdated(link->getName()))
+      continue;
+
+    Eigen::MatrixXd jacobian;
+    Eigen::Vector3d point = state.getGlobalLinkTransform(link).inverse() * data.nearest_points[i];
+    if (!state.getJacobian(group, link, point, jacobian))
+      return false;
+
+    // moving the first point along the normal reduces the distance, moving the second one increases it
+    if (i == 0)
+      gradient -= jacobian.topRows<3>().transpose() * normal;
+    else
+      gradient += jacobian.topRows<3>().transpose() * normal;
+  }
+  return true;
+}
+
 void collision_detection::costSourceToMsg(const CostSource &cost_source, moveit_msgs::CostSource &msg)
 {
   msg.cost_density = cost_source.cost;
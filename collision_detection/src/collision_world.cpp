@@ -36,6 +36,8 @@
 
 #include <moveit/collision_detection/collision_world.h>
 #include <geometric_shapes/shape_operations.h>
+#include <boost/bind.hpp>
+#include <algorithm>
 
 collision_detection::CollisionWorld::CollisionWorld() :
   world_(new World()),
@@ -58,14 +60,14 @@ collision_detection::CollisionWorld::CollisionWorld(const CollisionWorld &other,
 void collision_detection::CollisionWorld::checkCollision(const CollisionRequest &req, CollisionResult &res, const CollisionRobot &robot, const robot_state::RobotState &state) const
 {
   robot.checkSelfCollision(req, res, state);
-  if (!res.collision || (req.contacts && res.contacts.size() < req.max_contacts))
+  if (!res.collision || (req.contacts && res.contact_count < req.max_contacts))
     checkRobotCollision(req, res, robot, state);
 }
 
 void collision_detection::CollisionWorld::checkCollision(const CollisionRequest &req, CollisionResult &res, const CollisionRobot &robot, const robot_state::RobotState &state, const AllowedCollisionMatrix &acm) const
 {
   robot.checkSelfCollision(req, res, state, acm);
-  if (!res.collision || (req.contacts && res.contacts.size() < req.max_contacts))
+  if (!res.collision || (req.contacts && res.contact_count < req.max_contacts))
     checkRobotCollision(req, res, robot, state, acm);
 }
 
@@ -73,7 +75,7 @@ void collision_detection::CollisionWorld::checkCollision(const CollisionRequest
                                                          const robot_state::RobotState &state1, const robot_state::RobotState &state2) const
 {
   robot.checkSelfCollision(req, res, state1, state2);
-  if (!res.collision || (req.contacts && res.contacts.size() < req.max_contacts))
+  if (!res.collision || (req.contacts && res.contact_count < req.max_contacts))
     checkRobotCollision(req, res, robot, state1, state2);
 }
 
@@ -81,10 +83,55 @@ void collision_detection::CollisionWorld::checkCollision(const CollisionRequest
                                                          const robot_state::RobotState &state1, const robot_state::RobotState &state2, const AllowedCollisionMatrix &acm) const
 {
   robot.checkSelfCollision(req, res, state1, state2, acm);
-  if (!res.collision || (req.contacts && res.contacts.size() < req.max_contacts))
+  if (!res.collision || (req.contacts && res.contact_count < req.max_contacts))
     checkRobotCollision(req, res, robot, state1, state2, acm);
 }
 
+void collision_detection::CollisionWorld::distanceRobot(const DistanceRequest &req, DistanceResult &res, const CollisionRobot &robot,
+                                                        const robot_state::RobotState &state) const
+{
+  res.distance = std::min(distanceRobot(robot, state), req.max_distance);
+}
+
+void collision_detection::CollisionWorld::distanceRobot(const DistanceRequest &req, DistanceResult &res, const CollisionRobot &robot,
+                                                        const robot_state::RobotState &state, const AllowedCollisionMatrix &acm) const
+{
+  res.distance = std::min(distanceRobot(robot, state, acm), req.max_distance);
+}
+
+namespace collision_detection
+{
+namespace
+{
+void checkBatchElement(const CollisionWorld *world, const CollisionRequest *req, const CollisionRobot *robot,
+                       const std::vector<const robot_state::RobotState*> *states, const AllowedCollisionMatrix *acm,
+                       std::size_t index, CollisionResult &res)
+{
+  if (acm)
+    world->checkCollision(*req, res, *robot, *(*states)[index], *acm);
+  else
+    world->checkCollision(*req, res, *robot, *(*states)[index]);
+}
+}
+}
+
+int collision_detection::CollisionWorld::checkCollisionBatch(const CollisionRequest &req, std::vector<CollisionResult> &res, const CollisionRobot &robot,
+                                                             const std::vector<const robot_state::RobotState*> &states,
+                                                             bool stop_at_first_collision, unsigned int thread_count) const
+{
+  return collision_detection::checkCollisionBatch(boost::bind(&checkBatchElement, this, &req, &robot, &states,
+                                                              static_cast<const AllowedCollisionMatrix*>(NULL), _1, _2),
+                                                  states.size(), res, stop_at_first_collision, thread_count);
+}
+
+int collision_detection::CollisionWorld::checkCollisionBatch(const CollisionRequest &req, std::vector<CollisionResult> &res, const CollisionRobot &robot,
+                                                             const std::vector<const robot_state::RobotState*> &states, const AllowedCollisionMatrix &acm,
+                                                             bool stop_at_first_collision, unsigned int thread_count) const
+{
+  return collision_detection::checkCollisionBatch(boost::bind(&checkBatchElement, this, &req, &robot, &states, &acm, _1, _2),
+                                                  states.size(), res, stop_at_first_collision, thread_count);
+}
+
 void collision_detection::CollisionWorld::setWorld(const WorldPtr& world)
 {
   world_ = world;
@@ -0,0 +1,314 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2013, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#include <moveit/collision_detection/conservative_motion_validator.h>
+#include <geometric_shapes/shapes.h>
+#include <boost/math/constants/constants.hpp>
+#include <limits>
+#include <algorithm>
+#include <cmath>
+
+namespace collision_detection
+{
+namespace
+{
+
+// the distance of the farthest point of a shape to its origin
+double computeShapeRadius(const shapes::Shape *shape)
+{
+  switch (shape->type)
+  {
+  case shapes::SPHERE:
+    return static_cast<const shapes::Sphere*>(shape)->radius;
+  case shapes::BOX:
+    {
+      const double *size = static_cast<const shapes::Box*>(shape)->size;
+      return 0.5 * sqrt(size[0] * size[0] + size[1] * size[1] + size[2] * size[2]);
+    }
+  case shapes::CYLINDER:
+    {
+      const shapes::Cylinder *c = static_cast<const shapes::Cylinder*>(shape);
+      return sqrt(c->radius * c->radius + 0.25 * c->length * c->length);
+    }
+  case shapes::CONE:
+    {
+      const shapes::Cone *c = static_cast<const shapes::Cone*>(shape);
+      return sqrt(c->radius * c->radius + 0.25 * c->length * c->length);
+    }
+  case shapes::MESH:
+    {
+      const shapes::Mesh *m = static_cast<const shapes::Mesh*>(shape);
+      double r2 = 0.0;
+      for (unsigned int i = 0 ; i < m->vertex_count ; ++i)
+      {
+        const double *v = m->vertices + 3 * i;
+        r2 = std::max(r2, v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+      }
+      return sqrt(r2);
+    }
+  default:
+    // planes and octrees are not bounded
+    return std::numeric_limits<double>::infinity();
+  }
+}
+
+double computeShapesRadius(const std::vector<shapes::ShapeConstPtr> &shapes, const EigenSTL::vector_Affine3d &poses)
+{
+  double radius = 0.0;
+  for (std::size_t i = 0 ; i < shapes.size() ; ++i)
+    radius = std::max(radius, poses[i].translation().norm() + computeShapeRadius(shapes[i].get()));
+  return radius;
+}
+
+double largestAbsolutePosition(const robot_model::VariableBounds &b)
+{
+  if (!b.position_bounded_)
+    return std::numeric_limits<double>::infinity();
+  return std::max(fabs(b.min_position_), fabs(b.max_position_));
+}
+
+// the largest distance by which a joint can move the origin of its child link away from the joint origin
+double computeLargestTranslation(const robot_model::JointModel *joint)
+{
+  const robot_model::JointModel::Bounds &bounds = joint->getVariableBounds();
+  switch (joint->getType())
+  {
+  case robot_model::JointModel::PRISMATIC:
+    return largestAbsolutePosition(bounds[0]);
+  case robot_model::JointModel::PLANAR:
+    return sqrt(pow(largestAbsolutePosition(bounds[0]), 2) + pow(largestAbsolutePosition(bounds[1]), 2));
+  case robot_model::JointModel::FLOATING:
+    return sqrt(pow(largestAbsolutePosition(bounds[0]), 2) + pow(largestAbsolutePosition(bounds[1]), 2) +
+                pow(largestAbsolutePosition(bounds[2]), 2));
+  default:
+    return 0.0;
+  }
+}
+
+// split the motion of a joint between two positions into translation and rotation (angle)
+void computeJointMotion(const robot_model::JointModel *joint, const double *a, const double *b, double &translation, double &rotation)
+{
+  translation = rotation = 0.0;
+  switch (joint->getType())
+  {
+  case robot_model::JointModel::REVOLUTE:
+    rotation = fabs(joint->distance(a, b));
+    break;
+  case robot_model::JointModel::PRISMATIC:
+    translation = fabs(b[0] - a[0]);
+    break;
+  case robot_model::JointModel::PLANAR:
+    {
+      translation = sqrt((b[0] - a[0]) * (b[0] - a[0]) + (b[1] - a[1]) * (b[1] - a[1]));
+      const double pi = boost::math::constants::pi<double>();
+      rotation = fmod(fabs(b[2] - a[2]), 2.0 * pi);
+      if (rotation > pi)
+        rotation = 2.0 * pi - rotation;
+    }
+    break;
+  case robot_model::JointModel::FLOATING:
+    {
+      translation = sqrt((b[0] - a[0]) * (b[0] - a[0]) + (b[1] - a[1]) * (b[1] - a[1]) + (b[2] - a[2]) * (b[2] - a[2]));
+      const double dq = fabs(a[3] * b[3] + a[4] * b[4] + a[5] * b[5] + a[6] * b[6]);
+      rotation = dq < 1.0 ? 2.0 * acos(dq) : 0.0;
+    }
+    break;
+  default:
+    break;
+  }
+}
+
+struct Interval
+{
+  Interval(double t0, double c0, double t1, double c1) : t0_(t0), c0_(c0), t1_(t1), c1_(c1)
+  {
+  }
+
+  double t0_, c0_;
+  double t1_, c1_;
+};
+
+// sub-intervals shorter than this (as a fraction of the motion) are not split further
+const double MIN_INTERVAL = 1e-6;
+}
+}
+
+collision_detection::ConservativeMotionValidator::ConservativeMotionValidator(const robot_model::RobotModelConstPtr &model) :
+  robot_model_(model), resolution_(1e-3)
+{
+  const std::vector<const robot_model::LinkModel*> &links = robot_model_->getLinkModels();
+  link_radius_.resize(links.size(), 0.0);
+  for (std::size_t i = 0 ; i < links.size() ; ++i)
+  {
+    link_radius_[links[i]->getLinkIndex()] = computeShapesRadius(links[i]->getShapes(), links[i]->getCollisionOriginTransforms());
+
+    // walk up to the root; the axes of the parent joint of a link pass through the origin of the link
+    LinkChain chain;
+    chain.link_ = links[i];
+    double reach = 0.0;
+    for (const robot_model::LinkModel *link = links[i] ; link && link->getParentJointModel() ; link = link->getParentLinkModel())
+    {
+      const robot_model::JointModel *joint = link->getParentJointModel();
+      if (joint->getType() != robot_model::JointModel::FIXED)
+      {
+        chain.joints_.push_back(joint);
+        chain.reach_.push_back(reach);
+      }
+      reach += link->getJointOriginTransform().translation().norm() + computeLargestTranslation(joint);
+    }
+    if (!chain.joints_.empty())
+      chains_.push_back(chain);
+  }
+}
+
+double collision_detection::ConservativeMotionValidator::getMaximumMotion(const CollisionRobot &robot,
+                                                                             const robot_state::RobotState &from,
+                                                                             const robot_state::RobotState &to,
+                                                                             const std::vector<bool> *links) const
+{
+  const std::vector<const robot_model::JointModel*> &joints = robot_model_->getJointModels();
+  std::vector<double> translation(joints.size(), 0.0);
+  std::vector<double> rotation(joints.size(), 0.0);
+  for (std::size_t i = 0 ; i < joints.size() ; ++i)
+    computeJointMotion(joints[i], from.getJointPositions(joints[i]), to.getJointPositions(joints[i]),
+                       translation[joints[i]->getJointIndex()], rotation[joints[i]->getJointIndex()]);
+
+  std::vector<const robot_state::AttachedBody*> attached_bodies;
+  from.getAttachedBodies(attached_bodies);
+
+  double motion = 0.0;
+  for (std::size_t i = 0 ; i < chains_.size() ; ++i)
+  {
+    const LinkChain &chain = chains_[i];
+    if (links && !(*links)[chain.link_->getLinkIndex()])
+      continue;
+
+    // scaling is about the origin of the shapes, so scaling the radius around the link origin is conservative
+    double radius = link_radius_[chain.link_->getLinkIndex()];
+    if (radius > 0.0)
+      radius = radius * std::max(1.0, robot.getLinkScale(chain.link_->getName())) + robot.getLinkPadding(chain.link_->getName());
+    for (std::size_t j = 0 ; j < attached_bodies.size() ; ++j)
+      if (attached_bodies[j]->getAttachedLink() == chain.link_)
+        radius = std::max(radius, computeShapesRadius(attached_bodies[j]->getShapes(), attached_bodies[j]->getFixedTransforms()));
+    if (radius <= 0.0)
+      continue;
+
+    double link_motion = 0.0;
+    for (std::size_t j = 0 ; j < chain.joints_.size() ; ++j)
+    {
+      const int index = chain.joints_[j]->getJointIndex();
+      link_motion += translation[index];
+      // joints that do not rotate are skipped, as the reach past joints with unbounded translation is infinite
+      if (rotation[index] > 0.0)
+        link_motion += rotation[index] * (chain.reach_[j] + radius);
+    }
+    motion = std::max(motion, link_motion);
+  }
+  return motion;
+}
+
+double collision_detection::ConservativeMotionValidator::computeClearance(const CollisionWorld &world, const CollisionRobot &robot,
+                                                                             const robot_state::RobotState &state,
+                                                                             const AllowedCollisionMatrix &acm,
+                                                                             double max_clearance) const
+{
+  // clearances above the motion certify the whole motion, so larger distances are not computed
+  DistanceRequest req;
+  DistanceResult world_res, self_res;
+  req.max_distance = max_clearance;
+  world.distanceRobot(req, world_res, robot, state, acm);
+  // two links approach each other at most by the sum of their motions
+  req.max_distance = 2.0 * std::min(max_clearance, world_res.distance);
+  robot.distanceSelf(req, self_res, state, acm);
+  double clearance = std::min(world_res.distance, self_res.distance / 2.0);
+  if (clearance > 0.0)
+    return clearance;
+
+  // touching geometry (or a collision checker that does not compute distances) gives a distance of 0
+  CollisionRequest creq;
+  CollisionResult cres;
+  world.checkCollision(creq, cres, robot, state, acm);
+  return cres.collision ? -1.0 : 0.0;
+}
+
+bool collision_detection::ConservativeMotionValidator::isMotionValid(const CollisionWorld &world, const CollisionRobot &robot,
+                                                                        const robot_state::RobotState &from, const robot_state::RobotState &to,
+                                                                        const AllowedCollisionMatrix &acm, std::size_t *query_count) const
+{
+  const double motion = getMaximumMotion(robot, from, to);
+  const double max_clearance = std::max(motion, resolution_);
+
+  std::size_t queries = 2;
+  double c_from = computeClearance(world, robot, from, acm, max_clearance);
+  double c_to = c_from < 0.0 ? -1.0 : computeClearance(world, robot, to, acm, max_clearance);
+  if (c_from < 0.0 || c_to < 0.0)
+  {
+    if (query_count)
+      *query_count = c_from < 0.0 ? 1 : 2;
+    return false;
+  }
+
+  robot_state::RobotState state(from);
+  bool valid = true;
+
+  // the sub-intervals are examined from the start of the motion on, so collisions close to the start are found first
+  std::vector<Interval> stack(1, Interval(0.0, c_from, 1.0, c_to));
+  while (!stack.empty())
+  {
+    Interval in = stack.back();
+    stack.pop_back();
+
+    // the clearance of each end certifies the part of the sub-interval along which no link can move by more than the clearance
+    const double m = motion * (in.t1_ - in.t0_);
+    if (in.c0_ + in.c1_ >= m || m <= resolution_ || in.t1_ - in.t0_ <= MIN_INTERVAL)
+      continue;
+
+    const double t = (in.t0_ + in.t1_) / 2.0;
+    from.interpolate(to, t, state);
+    state.update();
+    double c = computeClearance(world, robot, state, acm, max_clearance);
+    ++queries;
+    if (c < 0.0)
+    {
+      valid = false;
+      break;
+    }
+    stack.push_back(Interval(t, c, in.t1_, in.c1_));
+    stack.push_back(Interval(in.t0_, in.c0_, t, c));
+  }
+
+  if (query_count)
+    *query_count = queries;
+  return valid;
+}
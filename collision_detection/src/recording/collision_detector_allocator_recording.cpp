@@ -0,0 +1,76 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2013, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#include <moveit/collision_detection/recording/collision_detector_allocator_recording.h>
+
+collision_detection::CollisionDetectorAllocatorRecording::CollisionDetectorAllocatorRecording(const CollisionDetectorAllocatorPtr &allocator,
+                                                                                              const CollisionQueryLogWriterPtr &log) :
+  allocator_(allocator), log_(log), name_(allocator->getName() + "_RECORDING")
+{
+}
+
+collision_detection::CollisionWorldPtr collision_detection::CollisionDetectorAllocatorRecording::allocateWorld(const WorldPtr& world) const
+{
+  return CollisionWorldPtr(new CollisionWorldRecording(allocator_->allocateWorld(world), log_));
+}
+
+collision_detection::CollisionWorldPtr collision_detection::CollisionDetectorAllocatorRecording::allocateWorld(const CollisionWorldConstPtr& orig,
+                                                                                                               const WorldPtr& world) const
+{
+  const CollisionWorldRecording *recording = dynamic_cast<const CollisionWorldRecording*>(orig.get());
+  CollisionWorldConstPtr recorded = recording ? CollisionWorldConstPtr(recording->getRecordedWorld()) : orig;
+  return CollisionWorldPtr(new CollisionWorldRecording(allocator_->allocateWorld(recorded, world), log_));
+}
+
+collision_detection::CollisionRobotPtr collision_detection::CollisionDetectorAllocatorRecording::allocateRobot(const robot_model::RobotModelConstPtr& robot_model) const
+{
+  return CollisionRobotPtr(new CollisionRobotRecording(allocator_->allocateRobot(robot_model), log_));
+}
+
+collision_detection::CollisionRobotPtr collision_detection::CollisionDetectorAllocatorRecording::allocateRobot(const CollisionRobotConstPtr& orig) const
+{
+  const CollisionRobotRecording *recording = dynamic_cast<const CollisionRobotRecording*>(orig.get());
+  CollisionRobotConstPtr recorded = recording ? CollisionRobotConstPtr(recording->getRecordedRobot()) : orig;
+  return CollisionRobotPtr(new CollisionRobotRecording(allocator_->allocateRobot(recorded), log_));
+}
+
+collision_detection::CollisionDetectorAllocatorPtr
+collision_detection::CollisionDetectorAllocatorRecording::create(const CollisionDetectorAllocatorPtr &allocator,
+                                                                 const robot_model::RobotModelConstPtr &robot_model, const std::string &filename)
+{
+  CollisionQueryLogWriterPtr log(new CollisionQueryLogWriter(robot_model, filename));
+  if (!log->isOpen())
+    return CollisionDetectorAllocatorPtr();
+  return CollisionDetectorAllocatorPtr(new CollisionDetectorAllocatorRecording(allocator, log));
+}
@@ -0,0 +1,913 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2013, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#include <moveit/collision_detection/recording/collision_query_log.h>
+#include <geometric_shapes/shapes.h>
+#include <octomap/octomap.h>
+#include <console_bridge/console.h>
+#include <sstream>
+#include <limits>
+#include <cmath>
+
+namespace collision_detection
+{
+namespace
+{
+
+const char LOG_MAGIC[4] = { 'M', 'V', 'C', 'Q' };
+const boost::uint32_t LOG_FORMAT_VERSION = 1;
+
+// record tags
+const char WORLD_RECORD = 'W';
+const char ROBOT_RECORD = 'R';
+const char ACM_RECORD = 'A';
+const char QUERY_RECORD = 'Q';
+
+// bits of the flags of a query record
+const boost::uint8_t QUERY_CONTINUOUS = 1;
+const boost::uint8_t QUERY_DISTANCE_REQUEST = 2;
+const boost::uint8_t QUERY_INITIAL_COLLISION = 4;
+const boost::uint8_t QUERY_COLLISION = 8;
+
+// strings and arrays longer than this indicate a corrupt log
+const boost::uint32_t MAX_ELEMENTS = 1u << 30;
+
+template<typename T>
+void write(std::ostream &out, const T &value)
+{
+  out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+void writeString(std::ostream &out, const std::string &s)
+{
+  write(out, (boost::uint32_t)s.size());
+  out.write(s.data(), s.size());
+}
+
+void writePose(std::ostream &out, const Eigen::Affine3d &pose)
+{
+  for (int i = 0 ; i < 3 ; ++i)
+    write(out, pose.translation()[i]);
+  for (int i = 0 ; i < 3 ; ++i)
+    for (int j = 0 ; j < 3 ; ++j)
+      write(out, pose.linear()(i, j));
+}
+
+void writeDoubleMap(std::ostream &out, const std::map<std::string, double> &values)
+{
+  write(out, (boost::uint32_t)values.size());
+  for (std::map<std::string, double>::const_iterator it = values.begin() ; it != values.end() ; ++it)
+  {
+    writeString(out, it->first);
+    write(out, it->second);
+  }
+}
+
+void writeShape(std::ostream &out, const shapes::Shape &shape)
+{
+  write(out, (boost::uint8_t)shape.type);
+  switch (shape.type)
+  {
+  case shapes::SPHERE:
+    write(out, static_cast<const shapes::Sphere&>(shape).radius);
+    break;
+  case shapes::BOX:
+    for (int i = 0 ; i < 3 ; ++i)
+      write(out, static_cast<const shapes::Box&>(shape).size[i]);
+    break;
+  case shapes::CYLINDER:
+    write(out, static_cast<const shapes::Cylinder&>(shape).radius);
+    write(out, static_cast<const shapes::Cylinder&>(shape).length);
+    break;
+  case shapes::CONE:
+    write(out, static_cast<const shapes::Cone&>(shape).radius);
+    write(out, static_cast<const shapes::Cone&>(shape).length);
+    break;
+  case shapes::PLANE:
+    {
+      const shapes::Plane &plane = static_cast<const shapes::Plane&>(shape);
+      write(out, plane.a);
+      write(out, plane.b);
+      write(out, plane.c);
+      write(out, plane.d);
+    }
+    break;
+  case shapes::MESH:
+    {
+      const shapes::Mesh &mesh = static_cast<const shapes::Mesh&>(shape);
+      write(out, (boost::uint32_t)mesh.vertex_count);
+      write(out, (boost::uint32_t)mesh.triangle_count);
+      out.write(reinterpret_cast<const char*>(mesh.vertices), sizeof(double) * 3 * mesh.vertex_count);
+      for (unsigned int i = 0 ; i < 3 * mesh.triangle_count ; ++i)
+        write(out, (boost::uint32_t)mesh.triangles[i]);
+    }
+    break;
+  case shapes::OCTREE:
+    {
+      const shapes::OcTree &octree = static_cast<const shapes::OcTree&>(shape);
+      std::stringstream data;
+      if (octree.octree)
+        octree.octree->write(data);
+      writeString(out, data.str());
+    }
+    break;
+  default:
+    break;
+  }
+}
+
+template<typename T>
+bool read(std::istream &in, T &value)
+{
+  in.read(reinterpret_cast<char*>(&value), sizeof(T));
+  return in.good();
+}
+
+bool readCount(std::istream &in, boost::uint32_t &count)
+{
+  return read(in, count) && count <= MAX_ELEMENTS;
+}
+
+bool readString(std::istream &in, std::string &s)
+{
+  boost::uint32_t size;
+  if (!readCount(in, size))
+    return false;
+  s.resize(size);
+  if (size > 0)
+    in.read(&s[0], size);
+  return in.good();
+}
+
+bool readPose(std::istream &in, Eigen::Affine3d &pose)
+{
+  pose.setIdentity();
+  for (int i = 0 ; i < 3 ; ++i)
+    if (!read(in, pose.translation()[i]))
+      return false;
+  for (int i = 0 ; i < 3 ; ++i)
+    for (int j = 0 ; j < 3 ; ++j)
+      if (!read(in, pose.linear()(i, j)))
+        return false;
+  return true;
+}
+
+bool readDoubleMap(std::istream &in, std::map<std::string, double> &values)
+{
+  values.clear();
+  boost::uint32_t count;
+  if (!readCount(in, count))
+    return false;
+  for (boost::uint32_t i = 0 ; i < count ; ++i)
+  {
+    std::string name;
+    double value;
+    if (!readString(in, name) || !read(in, value))
+      return false;
+    values[name] = value;
+  }
+  return true;
+}
+
+shapes::ShapeConstPtr readShape(std::istream &in)
+{
+  boost::uint8_t type;
+  if (!read(in, type))
+    return shapes::ShapeConstPtr();
+  switch (type)
+  {
+  case shapes::SPHERE:
+    {
+      double r;
+      if (read(in, r))
+        return shapes::ShapeConstPtr(new shapes::Sphere(r));
+    }
+    break;
+  case shapes::BOX:
+    {
+      double x, y, z;
+      if (read(in, x) && read(in, y) && read(in, z))
+        return shapes::ShapeConstPtr(new shapes::Box(x, y, z));
+    }
+    break;
+  case shapes::CYLINDER:
+    {
+      double r, l;
+      if (read(in, r) && read(in, l))
+        return shapes::ShapeConstPtr(new shapes::Cylinder(r, l));
+    }
+    break;
+  case shapes::CONE:
+    {
+      double r, l;
+      if (read(in, r) && read(in, l))
+        return shapes::ShapeConstPtr(new shapes::Cone(r, l));
+    }
+    break;
+  case shapes::PLANE:
+    {
+      double a, b, c, d;
+      if (read(in, a) && read(in, b) && read(in, c) && read(in, d))
+        return shapes::ShapeConstPtr(new shapes::Plane(a, b, c, d));
+    }
+    break;
+  case shapes::MESH:
+    {
+      boost::uint32_t vertex_count, triangle_count;
+      if (!readCount(in, vertex_count) || !readCount(in, triangle_count))
+        break;
+      shapes::Mesh *mesh = new shapes::Mesh(vertex_count, triangle_count);
+      shapes::ShapeConstPtr result(mesh);
+      in.read(reinterpret_cast<char*>(mesh->vertices), sizeof(double) * 3 * vertex_count);
+      for (unsigned int i = 0 ; i < 3 * triangle_count && in.good() ; ++i)
+      {
+        boost::uint32_t v;
+        if (read(in, v) && v < vertex_count)
+          mesh->triangles[i] = v;
+        else
+          in.setstate(std::ios::failbit);
+      }
+      if (!in.good())
+        break;
+      mesh->computeTriangleNormals();
+      mesh->computeVertexNormals();
+      return result;
+    }
+  case shapes::OCTREE:
+    {
+      std::string data;
+      if (!readString(in, data))
+        break;
+      std::istringstream data_stream(data);
+      octomap::AbstractOcTree *tree = data.empty() ? NULL : octomap::AbstractOcTree::read(data_stream);
+      octomap::OcTree *octree = dynamic_cast<octomap::OcTree*>(tree);
+      if (!octree)
+      {
+        delete tree;
+        logError("Unable to read octree from collision query log");
+        break;
+      }
+      return shapes::ShapeConstPtr(new shapes::OcTree(boost::shared_ptr<const octomap::OcTree>(octree)));
+    }
+  default:
+    logError("Unknown shape type %d in collision query log", (int)type);
+    break;
+  }
+  return shapes::ShapeConstPtr();
+}
+
+void writeCollisionRequest(std::ostream &out, const CollisionRequest &req)
+{
+  writeString(out, req.group_name);
+  boost::uint8_t bits = (req.distance ? 1 : 0) | (req.cost ? 2 : 0) | (req.contacts ? 4 : 0) | (req.flat_contacts ? 8 : 0) | (req.verbose ? 16 : 0);
+  write(out, bits);
+  write(out, (boost::uint32_t)req.max_contacts);
+  write(out, (boost::uint32_t)req.max_contacts_per_pair);
+  write(out, (boost::uint32_t)req.max_cost_sources);
+  write(out, req.min_cost_density);
+}
+
+bool readCollisionRequest(std::istream &in, CollisionRequest &req)
+{
+  boost::uint8_t bits;
+  boost::uint32_t max_contacts, max_contacts_per_pair, max_cost_sources;
+  if (!readString(in, req.group_name) || !read(in, bits) || !read(in, max_contacts) || !read(in, max_contacts_per_pair) ||
+      !read(in, max_cost_sources) || !read(in, req.min_cost_density))
+    return false;
+  req.distance = bits & 1;
+  req.cost = bits & 2;
+  req.contacts = bits & 4;
+  req.flat_contacts = bits & 8;
+  req.verbose = bits & 16;
+  req.max_contacts = max_contacts;
+  req.max_contacts_per_pair = max_contacts_per_pair;
+  req.max_cost_sources = max_cost_sources;
+  return true;
+}
+
+void writeDistanceRequest(std::ostream &out, const DistanceRequest &req)
+{
+  writeString(out, req.group_name);
+  write(out, req.max_distance);
+  boost::uint8_t bits = (req.stop_below_max_distance ? 1 : 0) | (req.enable_nearest_points ? 2 : 0) | (req.compute_link_distances ? 4 : 0);
+  write(out, bits);
+}
+
+bool readDistanceRequest(std::istream &in, DistanceRequest &req)
+{
+  boost::uint8_t bits;
+  if (!readString(in, req.group_name) || !read(in, req.max_distance) || !read(in, bits))
+    return false;
+  req.stop_below_max_distance = bits & 1;
+  req.enable_nearest_points = bits & 2;
+  req.compute_link_distances = bits & 4;
+  return true;
+}
+
+boost::mutex source_id_lock;
+boost::uint64_t source_id_counter = 0;
+
+}
+}
+
+collision_detection::CollisionQueryLogWriter::CollisionQueryLogWriter(const robot_model::RobotModelConstPtr &robot_model, const std::string &filename) :
+  robot_model_(robot_model), filename_(filename), out_(filename.c_str(), std::ios::out | std::ios::binary | std::ios::trunc),
+  open_(false), next_snapshot_id_(1), query_count_(0)
+{
+  if (!out_.good())
+  {
+    logError("Unable to open collision query log '%s' for writing", filename.c_str());
+    return;
+  }
+  out_.write(LOG_MAGIC, sizeof(LOG_MAGIC));
+  write(out_, LOG_FORMAT_VERSION);
+  writeString(out_, robot_model_->getName());
+  const std::vector<std::string> &names = robot_model_->getVariableNames();
+  write(out_, (boost::uint32_t)names.size());
+  for (std::size_t i = 0 ; i < names.size() ; ++i)
+    writeString(out_, names[i]);
+  open_ = out_.good();
+}
+
+collision_detection::CollisionQueryLogWriter::~CollisionQueryLogWriter()
+{
+  out_.flush();
+}
+
+boost::uint64_t collision_detection::CollisionQueryLogWriter::newSourceId()
+{
+  boost::mutex::scoped_lock slock(source_id_lock);
+  return ++source_id_counter;
+}
+
+boost::uint64_t collision_detection::CollisionQueryLogWriter::getWorldSnapshot(boost::uint64_t source, boost::uint64_t version, const World &world)
+{
+  boost::mutex::scoped_lock slock(lock_);
+  std::map<boost::uint64_t, std::pair<boost::uint64_t, boost::uint64_t> >::iterator it = snapshots_.find(source);
+  if (it != snapshots_.end() && it->second.first == version)
+    return it->second.second;
+  if (!open_)
+    return 0;
+
+  boost::uint64_t id = next_snapshot_id_++;
+  out_.put(WORLD_RECORD);
+  write(out_, id);
+  write(out_, (boost::uint32_t)world.size());
+  for (World::const_iterator ob = world.begin() ; ob != world.end() ; ++ob)
+  {
+    writeString(out_, ob->first);
+    write(out_, (boost::uint32_t)ob->second->shapes_.size());
+    for (std::size_t i = 0 ; i < ob->second->shapes_.size() ; ++i)
+    {
+      writePose(out_, ob->second->shape_poses_[i]);
+      writeShape(out_, *ob->second->shapes_[i]);
+    }
+  }
+  snapshots_[source] = std::make_pair(version, id);
+  return id;
+}
+
+boost::uint64_t collision_detection::CollisionQueryLogWriter::getRobotSnapshot(boost::uint64_t source, boost::uint64_t version, const CollisionRobot &robot)
+{
+  boost::mutex::scoped_lock slock(lock_);
+  std::map<boost::uint64_t, std::pair<boost::uint64_t, boost::uint64_t> >::iterator it = snapshots_.find(source);
+  if (it != snapshots_.end() && it->second.first == version)
+    return it->second.second;
+  if (!open_)
+    return 0;
+
+  boost::uint64_t id = next_snapshot_id_++;
+  out_.put(ROBOT_RECORD);
+  write(out_, id);
+  writeDoubleMap(out_, robot.getLinkPadding());
+  writeDoubleMap(out_, robot.getLinkScale());
+  snapshots_[source] = std::make_pair(version, id);
+  return id;
+}
+
+boost::uint64_t collision_detection::CollisionQueryLogWriter::getACMSnapshot(const AllowedCollisionMatrix &acm)
+{
+  boost::mutex::scoped_lock slock(lock_);
+  std::map<boost::uint64_t, boost::uint64_t>::const_iterator it = acm_snapshots_.find(acm.getVersion());
+  if (it != acm_snapshots_.end())
+    return it->second;
+  if (!open_)
+    return 0;
+
+  moveit_msgs::AllowedCollisionMatrix msg;
+  acm.getMessage(msg);
+  boost::uint64_t id = next_snapshot_id_++;
+  out_.put(ACM_RECORD);
+  write(out_, id);
+  write(out_, (boost::uint32_t)msg.entry_names.size());
+  for (std::size_t i = 0 ; i < msg.entry_names.size() ; ++i)
+  {
+    writeString(out_, msg.entry_names[i]);
+    for (std::size_t j = 0 ; j < msg.entry_names.size() ; ++j)
+      out_.put(j < msg.entry_values[i].enabled.size() && msg.entry_values[i].enabled[j] ? 1 : 0);
+  }
+  write(out_, (boost::uint32_t)msg.default_entry_names.size());
+  for (std::size_t i = 0 ; i < msg.default_entry_names.size() ; ++i)
+  {
+    writeString(out_, msg.default_entry_names[i]);
+    out_.put(msg.default_entry_values[i] ? 1 : 0);
+  }
+  acm_snapshots_[acm.getVersion()] = id;
+  return id;
+}
+
+void collision_detection::CollisionQueryLogWriter::writeQuery(const RecordedCollisionQuery &query)
+{
+  boost::mutex::scoped_lock slock(lock_);
+  if (!open_)
+    return;
+  const std::size_t variable_count = robot_model_->getVariableCount();
+  if (query.state1.size() != variable_count || (query.continuous && query.state2.size() != variable_count))
+  {
+    logError("Recorded collision query has %u variables instead of %u. Not writing it.",
+             (unsigned int)query.state1.size(), (unsigned int)variable_count);
+    return;
+  }
+
+  out_.put(QUERY_RECORD);
+  write(out_, (boost::uint8_t)query.type);
+  boost::uint8_t flags = (query.continuous ? QUERY_CONTINUOUS : 0) | (query.has_distance_request ? QUERY_DISTANCE_REQUEST : 0) |
+    (query.initial_collision ? QUERY_INITIAL_COLLISION : 0) | (query.collision ? QUERY_COLLISION : 0);
+  write(out_, flags);
+  write(out_, query.robot_id);
+  write(out_, query.world_id);
+  write(out_, query.acm_id);
+  if (query.type == CollisionQueryTypes::ROBOT_COLLISION || query.type == CollisionQueryTypes::SELF_COLLISION)
+    writeCollisionRequest(out_, query.collision_request);
+  else
+    if (query.has_distance_request)
+      writeDistanceRequest(out_, query.distance_request);
+  out_.write(reinterpret_cast<const char*>(&query.state1[0]), sizeof(double) * variable_count);
+  if (query.continuous)
+    out_.write(reinterpret_cast<const char*>(&query.state2[0]), sizeof(double) * variable_count);
+  write(out_, (boost::uint32_t)query.contact_count);
+  write(out_, query.distance);
+  write(out_, query.duration);
+  ++query_count_;
+  if (!out_.good())
+  {
+    logError("Error writing collision query log '%s'. No more queries will be recorded.", filename_.c_str());
+    open_ = false;
+  }
+}
+
+std::size_t collision_detection::CollisionQueryLogWriter::getQueryCount() const
+{
+  boost::mutex::scoped_lock slock(lock_);
+  return query_count_;
+}
+
+void collision_detection::CollisionQueryLogWriter::flush()
+{
+  boost::mutex::scoped_lock slock(lock_);
+  out_.flush();
+}
+
+collision_detection::CollisionQueryRecorder::CollisionQueryRecorder(CollisionQueryLogWriter &log, CollisionQueryTypes::Type type,
+                                                                  boost::uint64_t robot_id, boost::uint64_t world_id,
+                                                                  const robot_state::RobotState &state1, const robot_state::RobotState *state2,
+                                                                  const AllowedCollisionMatrix *acm) :
+  log_(log), initial_contact_count_(0)
+{
+  query_.type = type;
+  query_.robot_id = robot_id;
+  query_.world_id = world_id;
+  query_.acm_id = acm ? log_.getACMSnapshot(*acm) : 0;
+  query_.state1.assign(state1.getVariablePositions(), state1.getVariablePositions() + state1.getVariableCount());
+  if (state2)
+  {
+    query_.continuous = true;
+    query_.state2.assign(state2->getVariablePositions(), state2->getVariablePositions() + state2->getVariableCount());
+  }
+}
+
+void collision_detection::CollisionQueryRecorder::start(const CollisionRequest &req, const CollisionResult &res)
+{
+  query_.collision_request = req;
+  query_.initial_collision = res.collision;
+  initial_contact_count_ = res.contact_count;
+  start_ = boost::posix_time::microsec_clock::universal_time();
+}
+
+void collision_detection::CollisionQueryRecorder::start(const DistanceRequest *req)
+{
+  if (req)
+  {
+    query_.has_distance_request = true;
+    query_.distance_request = *req;
+  }
+  start_ = boost::posix_time::microsec_clock::universal_time();
+}
+
+void collision_detection::CollisionQueryRecorder::finish(const CollisionResult &res)
+{
+  query_.duration = (boost::posix_time::microsec_clock::universal_time() - start_).total_microseconds() * 1e-6;
+  query_.collision = res.collision;
+  query_.contact_count = res.contact_count >= initial_contact_count_ ? res.contact_count - initial_contact_count_ : 0;
+  log_.writeQuery(query_);
+}
+
+void collision_detection::CollisionQueryRecorder::finish(double distance)
+{
+  query_.duration = (boost::posix_time::microsec_clock::universal_time() - start_).total_microseconds() * 1e-6;
+  query_.distance = distance;
+  log_.writeQuery(query_);
+}
+
+collision_detection::CollisionQueryLogReader::CollisionQueryLogReader(const std::string &filename) :
+  in_(filename.c_str(), std::ios::in | std::ios::binary), open_(false), corrupt_(false), snapshot_id_(0)
+{
+  char magic[sizeof(LOG_MAGIC)];
+  boost::uint32_t version, variable_count;
+  in_.read(magic, sizeof(magic));
+  if (!in_.good() || !std::equal(magic, magic + sizeof(magic), LOG_MAGIC))
+  {
+    logError("'%s' is not a collision query log", filename.c_str());
+    return;
+  }
+  if (!read(in_, version) || version != LOG_FORMAT_VERSION)
+  {
+    logError("Collision query log '%s' has unsupported format version %u", filename.c_str(), (unsigned int)version);
+    return;
+  }
+  if (!readString(in_, robot_model_name_) || !readCount(in_, variable_count))
+  {
+    logError("Collision query log '%s' has a corrupt header", filename.c_str());
+    return;
+  }
+  variable_names_.resize(variable_count);
+  for (boost::uint32_t i = 0 ; i < variable_count ; ++i)
+    if (!readString(in_, variable_names_[i]))
+    {
+      logError("Collision query log '%s' has a corrupt header", filename.c_str());
+      return;
+    }
+  open_ = true;
+}
+
+bool collision_detection::CollisionQueryLogReader::readNext(RecordType &type)
+{
+  if (!open_ || corrupt_)
+    return false;
+  int tag = in_.get();
+  if (tag == std::char_traits<char>::eof())
+    return false;
+
+  bool ok = false;
+  switch (tag)
+  {
+  case WORLD_RECORD:
+    type = WORLD_SNAPSHOT;
+    ok = readWorld();
+    break;
+  case ROBOT_RECORD:
+    type = ROBOT_SNAPSHOT;
+    ok = readRobot();
+    break;
+  case ACM_RECORD:
+    type = ACM_SNAPSHOT;
+    ok = readACM();
+    break;
+  case QUERY_RECORD:
+    type = QUERY;
+    ok = readQuery();
+    break;
+  default:
+    break;
+  }
+  if (!ok)
+  {
+    logError("Collision query log is corrupt or truncated (record type '%c')", (char)tag);
+    corrupt_ = true;
+  }
+  return ok;
+}
+
+bool collision_detection::CollisionQueryLogReader::readWorld()
+{
+  boost::uint32_t object_count;
+  if (!read(in_, snapshot_id_) || !readCount(in_, object_count))
+    return false;
+  // a new world for every snapshot, since the previous one may still be in use
+  world_.reset(new World());
+  for (boost::uint32_t i = 0 ; i < object_count ; ++i)
+  {
+    std::string id;
+    boost::uint32_t shape_count;
+    if (!readString(in_, id) || !readCount(in_, shape_count))
+      return false;
+    std::vector<shapes::ShapeConstPtr> shapes;
+    EigenSTL::vector_Affine3d poses;
+    for (boost::uint32_t j = 0 ; j < shape_count ; ++j)
+    {
+      Eigen::Affine3d pose;
+      if (!readPose(in_, pose))
+        return false;
+      shapes::ShapeConstPtr shape = readShape(in_);
+      if (!shape)
+        return false;
+      shapes.push_back(shape);
+      poses.push_back(pose);
+    }
+    world_->addToObject(id, shapes, poses);
+  }
+  return true;
+}
+
+bool collision_detection::CollisionQueryLogReader::readRobot()
+{
+  return read(in_, snapshot_id_) && readDoubleMap(in_, link_padding_) && readDoubleMap(in_, link_scale_);
+}
+
+bool collision_detection::CollisionQueryLogReader::readACM()
+{
+  boost::uint32_t count;
+  if (!read(in_, snapshot_id_) || !readCount(in_, count))
+    return false;
+  moveit_msgs::AllowedCollisionMatrix msg;
+  msg.entry_names.resize(count);
+  msg.entry_values.resize(count);
+  for (boost::uint32_t i = 0 ; i < count ; ++i)
+  {
+    if (!readString(in_, msg.entry_names[i]))
+      return false;
+    msg.entry_values[i].enabled.resize(count);
+    for (boost::uint32_t j = 0 ; j < count ; ++j)
+      msg.entry_values[i].enabled[j] = in_.get() == 1;
+  }
+  if (!readCount(in_, count))
+    return false;
+  msg.default_entry_names.resize(count);
+  msg.default_entry_values.resize(count);
+  for (boost::uint32_t i = 0 ; i < count ; ++i)
+  {
+    if (!readString(in_, msg.default_entry_names[i]))
+      return false;
+    msg.default_entry_values[i] = in_.get() == 1;
+  }
+  if (!in_.good())
+    return false;
+  acm_ = AllowedCollisionMatrix(msg);
+  return true;
+}
+
+bool collision_detection::CollisionQueryLogReader::readQuery()
+{
+  boost::uint8_t type, flags;
+  if (!read(in_, type) || !read(in_, flags) || type > CollisionQueryTypes::SELF_DISTANCE)
+    return false;
+  query_ = RecordedCollisionQuery();
+  query_.type = CollisionQueryTypes::Type(type);
+  query_.continuous = flags & QUERY_CONTINUOUS;
+  query_.has_distance_request = flags & QUERY_DISTANCE_REQUEST;
+  query_.initial_collision = flags & QUERY_INITIAL_COLLISION;
+  query_.collision = flags & QUERY_COLLISION;
+  if (!read(in_, query_.robot_id) || !read(in_, query_.world_id) || !read(in_, query_.acm_id))
+    return false;
+  if (query_.type == CollisionQueryTypes::ROBOT_COLLISION || query_.type == CollisionQueryTypes::SELF_COLLISION)
+  {
+    if (!readCollisionRequest(in_, query_.collision_request))
+      return false;
+  }
+  else
+    if (query_.has_distance_request && !readDistanceRequest(in_, query_.distance_request))
+      return false;
+
+  query_.state1.resize(variable_names_.size());
+  if (!query_.state1.empty())
+    in_.read(reinterpret_cast<char*>(&query_.state1[0]), sizeof(double) * query_.state1.size());
+  if (query_.continuous)
+  {
+    query_.state2.resize(variable_names_.size());
+    if (!query_.state2.empty())
+      in_.read(reinterpret_cast<char*>(&query_.state2[0]), sizeof(double) * query_.state2.size());
+  }
+  boost::uint32_t contact_count;
+  if (!read(in_, contact_count) || !read(in_, query_.distance) || !read(in_, query_.duration))
+    return false;
+  query_.contact_count = contact_count;
+  return true;
+}
+
+namespace collision_detection
+{
+namespace
+{
+
+void setRecordedState(robot_state::RobotState &state, const std::vector<int> &index, const std::vector<double> &values)
+{
+  for (std::size_t i = 0 ; i < index.size() ; ++i)
+    if (index[i] >= 0)
+      state.setVariablePosition(index[i], values[i]);
+  state.update();
+}
+
+template<typename T>
+const T* findSnapshot(const std::map<boost::uint64_t, T> &snapshots, boost::uint64_t id)
+{
+  typename std::map<boost::uint64_t, T>::const_iterator it = snapshots.find(id);
+  return it == snapshots.end() ? NULL : &it->second;
+}
+
+}
+}
+
+bool collision_detection::replayCollisionQueryLog(const std::string &filename, const robot_model::RobotModelConstPtr &robot_model,
+                                                  const CollisionDetectorAllocatorPtr &allocator, std::vector<CollisionQueryReplayResult> &results,
+                                                  double distance_tolerance)
+{
+  CollisionQueryLogReader reader(filename);
+  if (!reader.isOpen())
+    return false;
+  if (reader.getRobotModelName() != robot_model->getName())
+    logWarn("Collision queries in '%s' were recorded for robot model '%s', replaying them for '%s'",
+            filename.c_str(), reader.getRobotModelName().c_str(), robot_model->getName().c_str());
+
+  // map the recorded variables to the variables of the model
+  std::map<std::string, int> model_index;
+  for (std::size_t i = 0 ; i < robot_model->getVariableNames().size() ; ++i)
+    model_index[robot_model->getVariableNames()[i]] = i;
+  std::vector<int> index(reader.getVariableNames().size(), -1);
+  std::size_t unknown = 0;
+  for (std::size_t i = 0 ; i < index.size() ; ++i)
+  {
+    std::map<std::string, int>::const_iterator it = model_index.find(reader.getVariableNames()[i]);
+    if (it != model_index.end())
+      index[i] = it->second;
+    else
+      ++unknown;
+  }
+  if (unknown > 0)
+    logWarn("%u recorded variables are not known to robot model '%s' and are ignored", (unsigned int)unknown, robot_model->getName().c_str());
+
+  robot_state::RobotState state1(robot_model);
+  robot_state::RobotState state2(robot_model);
+  state1.setToDefaultValues();
+  state2.setToDefaultValues();
+
+  std::map<boost::uint64_t, CollisionWorldPtr> worlds;
+  std::map<boost::uint64_t, CollisionRobotPtr> robots;
+  std::map<boost::uint64_t, AllowedCollisionMatrix> acms;
+  CollisionRobotPtr default_robot = allocator->allocateRobot(robot_model);
+  std::size_t skipped = 0;
+
+  CollisionQueryLogReader::RecordType type;
+  while (reader.readNext(type))
+  {
+    if (type == CollisionQueryLogReader::WORLD_SNAPSHOT)
+    {
+      worlds[reader.getSnapshotId()] = allocator->allocateWorld(reader.getWorld());
+      continue;
+    }
+    if (type == CollisionQueryLogReader::ROBOT_SNAPSHOT)
+    {
+      CollisionRobotPtr robot = allocator->allocateRobot(robot_model);
+      robot->setLinkPadding(reader.getLinkPadding());
+      robot->setLinkScale(reader.getLinkScale());
+      robots[reader.getSnapshotId()] = robot;
+      continue;
+    }
+    if (type == CollisionQueryLogReader::ACM_SNAPSHOT)
+    {
+      acms[reader.getSnapshotId()] = reader.getACM();
+      continue;
+    }
+
+    const RecordedCollisionQuery &query = reader.getQuery();
+    const CollisionRobotPtr *robot_ptr = findSnapshot(robots, query.robot_id);
+    const CollisionRobot &robot = robot_ptr ? **robot_ptr : *default_robot;
+    const AllowedCollisionMatrix *acm = findSnapshot(acms, query.acm_id);
+    const CollisionWorldPtr *world_ptr = findSnapshot(worlds, query.world_id);
+    if ((query.acm_id && !acm) || (!world_ptr && (query.type == CollisionQueryTypes::ROBOT_COLLISION ||
+                                                  query.type == CollisionQueryTypes::ROBOT_DISTANCE)))
+    {
+      ++skipped;
+      continue;
+    }
+    setRecordedState(state1, index, query.state1);
+    if (query.continuous)
+      setRecordedState(state2, index, query.state2);
+
+    CollisionQueryReplayResult r;
+    r.type = query.type;
+    r.recorded_collision = query.collision;
+    r.recorded_contact_count = query.contact_count;
+    r.recorded_distance = query.distance;
+    r.recorded_duration = query.duration;
+
+    CollisionResult res;
+    DistanceResult dres;
+    boost::posix_time::ptime start = boost::posix_time::microsec_clock::universal_time();
+    switch (query.type)
+    {
+    case CollisionQueryTypes::ROBOT_COLLISION:
+      if (query.continuous)
+      {
+        if (acm)
+          (*world_ptr)->checkRobotCollision(query.collision_request, res, robot, state1, state2, *acm);
+        else
+          (*world_ptr)->checkRobotCollision(query.collision_request, res, robot, state1, state2);
+      }
+      else
+      {
+        if (acm)
+          (*world_ptr)->checkRobotCollision(query.collision_request, res, robot, state1, *acm);
+        else
+          (*world_ptr)->checkRobotCollision(query.collision_request, res, robot, state1);
+      }
+      break;
+    case CollisionQueryTypes::SELF_COLLISION:
+      if (query.continuous)
+      {
+        if (acm)
+          robot.checkSelfCollision(query.collision_request, res, state1, state2, *acm);
+        else
+          robot.checkSelfCollision(query.collision_request, res, state1, state2);
+      }
+      else
+      {
+        if (acm)
+          robot.checkSelfCollision(query.collision_request, res, state1, *acm);
+        else
+          robot.checkSelfCollision(query.collision_request, res, state1);
+      }
+      break;
+    case CollisionQueryTypes::ROBOT_DISTANCE:
+      if (query.has_distance_request)
+      {
+        if (acm)
+          (*world_ptr)->distanceRobot(query.distance_request, dres, robot, state1, *acm);
+        else
+          (*world_ptr)->distanceRobot(query.distance_request, dres, robot, state1);
+      }
+      else
+        dres.distance = acm ? (*world_ptr)->distanceRobot(robot, state1, *acm) : (*world_ptr)->distanceRobot(robot, state1);
+      break;
+    case CollisionQueryTypes::SELF_DISTANCE:
+      if (query.has_distance_request)
+      {
+        if (acm)
+          robot.distanceSelf(query.distance_request, dres, state1, *acm);
+        else
+          robot.distanceSelf(query.distance_request, dres, state1);
+      }
+      else
+        dres.distance = acm ? robot.distanceSelf(state1, *acm) : robot.distanceSelf(state1);
+      break;
+    }
+    r.duration = (boost::posix_time::microsec_clock::universal_time() - start).total_microseconds() * 1e-6;
+
+    if (query.type == CollisionQueryTypes::ROBOT_COLLISION || query.type == CollisionQueryTypes::SELF_COLLISION)
+    {
+      r.collision = res.collision;
+      r.contact_count = res.contact_count;
+      r.mismatch = (res.collision || query.initial_collision) != query.collision;
+    }
+    else
+    {
+      r.distance = dres.distance;
+      r.mismatch = r.distance != query.distance && !(std::fabs(r.distance - query.distance) <= distance_tolerance);
+    }
+    results.push_back(r);
+  }
+
+  if (skipped > 0)
+    logWarn("%u queries refer to snapshots missing from '%s' and were skipped", (unsigned int)skipped, filename.c_str());
+  return !reader.isCorrupt();
+}
@@ -0,0 +1,178 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2013, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#include <moveit/collision_detection/recording/collision_robot_recording.h>
+
+collision_detection::CollisionRobotRecording::CollisionRobotRecording(const CollisionRobotPtr &robot, const CollisionQueryLogWriterPtr &log) :
+  CollisionRobot(robot->getRobotModel()), recorded_robot_(robot), log_(log), source_(CollisionQueryLogWriter::newSourceId()), version_(0)
+{
+  link_padding_ = recorded_robot_->getLinkPadding();
+  link_scale_ = recorded_robot_->getLinkScale();
+}
+
+boost::uint64_t collision_detection::CollisionRobotRecording::getSnapshotId() const
+{
+  return log_->getRobotSnapshot(source_, version_, *this);
+}
+
+const collision_detection::CollisionRobot& collision_detection::CollisionRobotRecording::getRecordedRobot(const CollisionRobot &robot)
+{
+  const CollisionRobotRecording *recording = dynamic_cast<const CollisionRobotRecording*>(&robot);
+  return recording ? *recording->recorded_robot_ : robot;
+}
+
+void collision_detection::CollisionRobotRecording::updatedPaddingOrScaling(const std::vector<std::string> &links)
+{
+  std::map<std::string, double> padding;
+  std::map<std::string, double> scale;
+  for (std::size_t i = 0 ; i < links.size() ; ++i)
+  {
+    padding[links[i]] = getLinkPadding(links[i]);
+    scale[links[i]] = getLinkScale(links[i]);
+  }
+  recorded_robot_->setLinkPadding(padding);
+  recorded_robot_->setLinkScale(scale);
+  ++version_;
+}
+
+void collision_detection::CollisionRobotRecording::checkSelfCollision(const CollisionRequest &req, CollisionResult &res, const robot_state::RobotState &state) const
+{
+  CollisionQueryRecorder recorder(*log_, CollisionQueryTypes::SELF_COLLISION, getSnapshotId(), 0, state, NULL, NULL);
+  recorder.start(req, res);
+  recorded_robot_->checkSelfCollision(req, res, state);
+  recorder.finish(res);
+}
+
+void collision_detection::CollisionRobotRecording::checkSelfCollision(const CollisionRequest &req, CollisionResult &res, const robot_state::RobotState &state,
+                                                                      const AllowedCollisionMatrix &acm) const
+{
+  CollisionQueryRecorder recorder(*log_, CollisionQueryTypes::SELF_COLLISION, getSnapshotId(), 0, state, NULL, &acm);
+  recorder.start(req, res);
+  recorded_robot_->checkSelfCollision(req, res, state, acm);
+  recorder.finish(res);
+}
+
+void collision_detection::CollisionRobotRecording::checkSelfCollision(const CollisionRequest &req, CollisionResult &res, const robot_state::RobotState &state1,
+                                                                      const robot_state::RobotState &state2) const
+{
+  CollisionQueryRecorder recorder(*log_, CollisionQueryTypes::SELF_COLLISION, getSnapshotId(), 0, state1, &state2, NULL);
+  recorder.start(req, res);
+  recorded_robot_->checkSelfCollision(req, res, state1, state2);
+  recorder.finish(res);
+}
+
+void collision_detection::CollisionRobotRecording::checkSelfCollision(const CollisionRequest &req, CollisionResult &res, const robot_state::RobotState &state1,
+                                                                      const robot_state::RobotState &state2, const AllowedCollisionMatrix &acm) const
+{
+  CollisionQueryRecorder recorder(*log_, CollisionQueryTypes::SELF_COLLISION, getSnapshotId(), 0, state1, &state2, &acm);
+  recorder.start(req, res);
+  recorded_robot_->checkSelfCollision(req, res, state1, state2, acm);
+  recorder.finish(res);
+}
+
+void collision_detection::CollisionRobotRecording::checkOtherCollision(const CollisionRequest &req, CollisionResult &res, const robot_state::RobotState &state,
+                                                                       const CollisionRobot &other_robot, const robot_state::RobotState &other_state) const
+{
+  recorded_robot_->checkOtherCollision(req, res, state, getRecordedRobot(other_robot), other_state);
+}
+
+void collision_detection::CollisionRobotRecording::checkOtherCollision(const CollisionRequest &req, CollisionResult &res, const robot_state::RobotState &state,
+                                                                       const CollisionRobot &other_robot, const robot_state::RobotState &other_state,
+                                                                       const AllowedCollisionMatrix &acm) const
+{
+  recorded_robot_->checkOtherCollision(req, res, state, getRecordedRobot(other_robot), other_state, acm);
+}
+
+void collision_detection::CollisionRobotRecording::checkOtherCollision(const CollisionRequest &req, CollisionResult &res,
+                                                                       const robot_state::RobotState &state1, const robot_state::RobotState &state2,
+                                                                       const CollisionRobot &other_robot, const robot_state::RobotState &other_state1,
+                                                                       const robot_state::RobotState &other_state2) const
+{
+  recorded_robot_->checkOtherCollision(req, res, state1, state2, getRecordedRobot(other_robot), other_state1, other_state2);
+}
+
+void collision_detection::CollisionRobotRecording::checkOtherCollision(const CollisionRequest &req, CollisionResult &res,
+                                                                       const robot_state::RobotState &state1, const robot_state::RobotState &state2,
+                                                                       const CollisionRobot &other_robot, const robot_state::RobotState &other_state1,
+                                                                       const robot_state::RobotState &other_state2, const AllowedCollisionMatrix &acm) const
+{
+  recorded_robot_->checkOtherCollision(req, res, state1, state2, getRecordedRobot(other_robot), other_state1, other_state2, acm);
+}
+
+double collision_detection::CollisionRobotRecording::distanceSelf(const robot_state::RobotState &state) const
+{
+  CollisionQueryRecorder recorder(*log_, CollisionQueryTypes::SELF_DISTANCE, getSnapshotId(), 0, state, NULL, NULL);
+  recorder.start(NULL);
+  double d = recorded_robot_->distanceSelf(state);
+  recorder.finish(d);
+  return d;
+}
+
+double collision_detection::CollisionRobotRecording::distanceSelf(const robot_state::RobotState &state, const AllowedCollisionMatrix &acm) const
+{
+  CollisionQueryRecorder recorder(*log_, CollisionQueryTypes::SELF_DISTANCE, getSnapshotId(), 0, state, NULL, &acm);
+  recorder.start(NULL);
+  double d = recorded_robot_->distanceSelf(state, acm);
+  recorder.finish(d);
+  return d;
+}
+
+void collision_detection::CollisionRobotRecording::distanceSelf(const DistanceRequest &req, DistanceResult &res, const robot_state::RobotState &state) const
+{
+  CollisionQueryRecorder recorder(*log_, CollisionQueryTypes::SELF_DISTANCE, getSnapshotId(), 0, state, NULL, NULL);
+  recorder.start(&req);
+  recorded_robot_->distanceSelf(req, res, state);
+  recorder.finish(res.distance);
+}
+
+void collision_detection::CollisionRobotRecording::distanceSelf(const DistanceRequest &req, DistanceResult &res, const robot_state::RobotState &state,
+                                                                const AllowedCollisionMatrix &acm) const
+{
+  CollisionQueryRecorder recorder(*log_, CollisionQueryTypes::SELF_DISTANCE, getSnapshotId(), 0, state, NULL, &acm);
+  recorder.start(&req);
+  recorded_robot_->distanceSelf(req, res, state, acm);
+  recorder.finish(res.distance);
+}
+
+double collision_detection::CollisionRobotRecording::distanceOther(const robot_state::RobotState &state, const CollisionRobot &other_robot,
+                                                                   const robot_state::RobotState &other_state) const
+{
+  return recorded_robot_->distanceOther(state, getRecordedRobot(other_robot), other_state);
+}
+
+double collision_detection::CollisionRobotRecording::distanceOther(const robot_state::RobotState &state, const CollisionRobot &other_robot,
+                                                                   const robot_state::RobotState &other_state, const AllowedCollisionMatrix &acm) const
+{
+  return recorded_robot_->distanceOther(state, getRecordedRobot(other_robot), other_state, acm);
+}
@@ -0,0 +1,182 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2013, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#include <moveit/collision_detection/recording/collision_world_recording.h>
+#include <boost/bind.hpp>
+
+namespace collision_detection
+{
+namespace
+{
+boost::uint64_t robotSnapshotId(const CollisionRobot &robot)
+{
+  const CollisionRobotRecording *recording = dynamic_cast<const CollisionRobotRecording*>(&robot);
+  return recording ? recording->getSnapshotId() : 0;
+}
+}
+}
+
+collision_detection::CollisionWorldRecording::CollisionWorldRecording(const CollisionWorldPtr &world, const CollisionQueryLogWriterPtr &log) :
+  CollisionWorld(world->getWorld()), recorded_world_(world), log_(log), source_(CollisionQueryLogWriter::newSourceId()), version_(0)
+{
+  // the objects are not copied, so only the version of the world needs to be tracked
+  observer_handle_ = getWorld()->addObserver(boost::bind(&CollisionWorldRecording::notifyObjectChange, this, _1, _2));
+}
+
+collision_detection::CollisionWorldRecording::~CollisionWorldRecording()
+{
+  getWorld()->removeObserver(observer_handle_);
+}
+
+void collision_detection::CollisionWorldRecording::setWorld(const WorldPtr& world)
+{
+  if (world == getWorld())
+    return;
+  getWorld()->removeObserver(observer_handle_);
+  CollisionWorld::setWorld(world);
+  recorded_world_->setWorld(world);
+  observer_handle_ = getWorld()->addObserver(boost::bind(&CollisionWorldRecording::notifyObjectChange, this, _1, _2));
+  ++version_;
+}
+
+void collision_detection::CollisionWorldRecording::notifyObjectChange(const ObjectConstPtr &obj, World::Action action)
+{
+  ++version_;
+}
+
+boost::uint64_t collision_detection::CollisionWorldRecording::getSnapshotId() const
+{
+  return log_->getWorldSnapshot(source_, version_, *getWorld());
+}
+
+const collision_detection::CollisionWorld& collision_detection::CollisionWorldRecording::getRecordedWorld(const CollisionWorld &world)
+{
+  const CollisionWorldRecording *recording = dynamic_cast<const CollisionWorldRecording*>(&world);
+  return recording ? *recording->recorded_world_ : world;
+}
+
+void collision_detection::CollisionWorldRecording::checkRobotCollision(const CollisionRequest &req, CollisionResult &res, const CollisionRobot &robot,
+                                                                       const robot_state::RobotState &state) const
+{
+  CollisionQueryRecorder recorder(*log_, CollisionQueryTypes::ROBOT_COLLISION, robotSnapshotId(robot), getSnapshotId(), state, NULL, NULL);
+  recorder.start(req, res);
+  recorded_world_->checkRobotCollision(req, res, CollisionRobotRecording::getRecordedRobot(robot), state);
+  recorder.finish(res);
+}
+
+void collision_detection::CollisionWorldRecording::checkRobotCollision(const CollisionRequest &req, CollisionResult &res, const CollisionRobot &robot,
+                                                                       const robot_state::RobotState &state, const AllowedCollisionMatrix &acm) const
+{
+  CollisionQueryRecorder recorder(*log_, CollisionQueryTypes::ROBOT_COLLISION, robotSnapshotId(robot), getSnapshotId(), state, NULL, &acm);
+  recorder.start(req, res);
+  recorded_world_->checkRobotCollision(req, res, CollisionRobotRecording::getRecordedRobot(robot), state, acm);
+  recorder.finish(res);
+}
+
+void collision_detection::CollisionWorldRecording::checkRobotCollision(const CollisionRequest &req, CollisionResult &res, const CollisionRobot &robot,
+                                                                       const robot_state::RobotState &state1, const robot_state::RobotState &state2) const
+{
+  CollisionQueryRecorder recorder(*log_, CollisionQueryTypes::ROBOT_COLLISION, robotSnapshotId(robot), getSnapshotId(), state1, &state2, NULL);
+  recorder.start(req, res);
+  recorded_world_->checkRobotCollision(req, res, CollisionRobotRecording::getRecordedRobot(robot), state1, state2);
+  recorder.finish(res);
+}
+
+void collision_detection::CollisionWorldRecording::checkRobotCollision(const CollisionRequest &req, CollisionResult &res, const CollisionRobot &robot,
+                                                                       const robot_state::RobotState &state1, const robot_state::RobotState &state2,
+                                                                       const AllowedCollisionMatrix &acm) const
+{
+  CollisionQueryRecorder recorder(*log_, CollisionQueryTypes::ROBOT_COLLISION, robotSnapshotId(robot), getSnapshotId(), state1, &state2, &acm);
+  recorder.start(req, res);
+  recorded_world_->checkRobotCollision(req, res, CollisionRobotRecording::getRecordedRobot(robot), state1, state2, acm);
+  recorder.finish(res);
+}
+
+void collision_detection::CollisionWorldRecording::checkWorldCollision(const CollisionRequest &req, CollisionResult &res, const CollisionWorld &other_world) const
+{
+  recorded_world_->checkWorldCollision(req, res, getRecordedWorld(other_world));
+}
+
+void collision_detection::CollisionWorldRecording::checkWorldCollision(const CollisionRequest &req, CollisionResult &res, const CollisionWorld &other_world,
+                                                                       const AllowedCollisionMatrix &acm) const
+{
+  recorded_world_->checkWorldCollision(req, res, getRecordedWorld(other_world), acm);
+}
+
+double collision_detection::CollisionWorldRecording::distanceRobot(const CollisionRobot &robot, const robot_state::RobotState &state) const
+{
+  CollisionQueryRecorder recorder(*log_, CollisionQueryTypes::ROBOT_DISTANCE, robotSnapshotId(robot), getSnapshotId(), state, NULL, NULL);
+  recorder.start(NULL);
+  double d = recorded_world_->distanceRobot(CollisionRobotRecording::getRecordedRobot(robot), state);
+  recorder.finish(d);
+  return d;
+}
+
+double collision_detection::CollisionWorldRecording::distanceRobot(const CollisionRobot &robot, const robot_state::RobotState &state,
+                                                                   const AllowedCollisionMatrix &acm) const
+{
+  CollisionQueryRecorder recorder(*log_, CollisionQueryTypes::ROBOT_DISTANCE, robotSnapshotId(robot), getSnapshotId(), state, NULL, &acm);
+  recorder.start(NULL);
+  double d = recorded_world_->distanceRobot(CollisionRobotRecording::getRecordedRobot(robot), state, acm);
+  recorder.finish(d);
+  return d;
+}
+
+void collision_detection::CollisionWorldRecording::distanceRobot(const DistanceRequest &req, DistanceResult &res, const CollisionRobot &robot,
+                                                                 const robot_state::RobotState &state) const
+{
+  CollisionQueryRecorder recorder(*log_, CollisionQueryTypes::ROBOT_DISTANCE, robotSnapshotId(robot), getSnapshotId(), state, NULL, NULL);
+  recorder.start(&req);
+  recorded_world_->distanceRobot(req, res, CollisionRobotRecording::getRecordedRobot(robot), state);
+  recorder.finish(res.distance);
+}
+
+void collision_detection::CollisionWorldRecording::distanceRobot(const DistanceRequest &req, DistanceResult &res, const CollisionRobot &robot,
+                                                                 const robot_state::RobotState &state, const AllowedCollisionMatrix &acm) const
+{
+  CollisionQueryRecorder recorder(*log_, CollisionQueryTypes::ROBOT_DISTANCE, robotSnapshotId(robot), getSnapshotId(), state, NULL, &acm);
+  recorder.start(&req);
+  recorded_world_->distanceRobot(req, res, CollisionRobotRecording::getRecordedRobot(robot), state, acm);
+  recorder.finish(res.distance);
+}
+
+double collision_detection::CollisionWorldRecording::distanceWorld(const CollisionWorld &world) const
+{
+  return recorded_world_->distanceWorld(getRecordedWorld(world));
+}
+
+double collision_detection::CollisionWorldRecording::distanceWorld(const CollisionWorld &world, const AllowedCollisionMatrix &acm) const
+{
+  return recorded_world_->distanceWorld(getRecordedWorld(world), acm);
+}
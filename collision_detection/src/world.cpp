@@ -35,12 +35,68 @@
 /* Author: Acorn Pooley, Ioan Sucan */
 
 #include <moveit/collision_detection/world.h>
+#include <moveit/profiler/memory_accounting.h>
+#include <octomap/octomap.h>
 #include <console_bridge/console.h>
+#include <boost/thread/mutex.hpp>
 
-collision_detection::World::World()
+namespace collision_detection
+{
+namespace
+{
+
+// versions of objects and worlds come from one counter, so they are unique in the process
+boost::mutex version_lock;
+boost::uint64_t version_counter = 0;
+
+boost::uint64_t newVersion()
+{
+  boost::mutex::scoped_lock slock(version_lock);
+  return ++version_counter;
+}
+
+}
+}
+
+collision_detection::World::Object::Object(const std::string &id) :
+  id_(id), shape_bytes_(0), octree_bytes_(0), version_(newVersion())
+{
+}
+
+collision_detection::World::Object::Object(const Object &other) :
+  id_(other.id_), shapes_(other.shapes_), shape_poses_(other.shape_poses_),
+  shape_bytes_(other.shape_bytes_), octree_bytes_(other.octree_bytes_), version_(other.version_)
+{
+  moveit::tools::MemoryAccounting::Add(moveit::tools::MemoryAccounting::WORLD_OBJECTS, shape_bytes_);
+  moveit::tools::MemoryAccounting::Add(moveit::tools::MemoryAccounting::OCTOMAP, octree_bytes_);
+}
+
+collision_detection::World::Object::~Object()
+{
+  moveit::tools::MemoryAccounting::Release(moveit::tools::MemoryAccounting::WORLD_OBJECTS, shape_bytes_);
+  moveit::tools::MemoryAccounting::Release(moveit::tools::MemoryAccounting::OCTOMAP, octree_bytes_);
+}
+
+collision_detection::World::Object& collision_detection::World::Object::operator=(const Object &other)
+{
+  if (this != &other)
+  {
+    id_ = other.id_;
+    shapes_ = other.shapes_;
+    shape_poses_ = other.shape_poses_;
+    moveit::tools::MemoryAccounting::Add(moveit::tools::MemoryAccounting::WORLD_OBJECTS, (boost::int64_t)other.shape_bytes_ - (boost::int64_t)shape_bytes_);
+    moveit::tools::MemoryAccounting::Add(moveit::tools::MemoryAccounting::OCTOMAP, (boost::int64_t)other.octree_bytes_ - (boost::int64_t)octree_bytes_);
+    shape_bytes_ = other.shape_bytes_;
+    octree_bytes_ = other.octree_bytes_;
+    version_ = other.version_;
+  }
+  return *this;
+}
+
+collision_detection::World::World() : version_(0), batch_depth_(0)
 { }
 
-collision_detection::World::World(const World &other)
+collision_detection::World::World(const World &other) : version_(other.version_), batch_depth_(0)
 {
   objects_ = other.objects_;
 }
@@ -84,6 +140,8 @@ void collision_detection::World::addToObject(const std::string &id,
 
   for (std::size_t i = 0 ; i < shapes.size() ; ++i)
     addToObjectInternal(obj, shapes[i], poses[i]);
+  updateVersion(obj);
+  updateMemoryAccounting(obj);
 
   notify(obj, Action(action));
 }
@@ -102,6 +160,8 @@ void collision_detection::World::addToObject(const std::string &id,
 
   ensureUnique(obj);
   addToObjectInternal(obj, shape, pose);
+  updateVersion(obj);
+  updateMemoryAccounting(obj);
 
   notify(obj, Action(action));
 }
@@ -134,6 +194,71 @@ bool collision_detection::World::hasObject(const std::string &id) const
   return objects_.find(id) != objects_.end();
 }
 
+std::size_t collision_detection::World::getShapeMemoryUsage(const shapes::Shape &shape)
+{
+  switch (shape.type)
+  {
+  case shapes::MESH:
+    {
+      const shapes::Mesh &mesh = static_cast<const shapes::Mesh&>(shape);
+      std::size_t bytes = sizeof(shapes::Mesh) + mesh.vertex_count * 3 * sizeof(double) + mesh.triangle_count * 3 * sizeof(unsigned int);
+      if (mesh.triangle_normals)
+        bytes += mesh.triangle_count * 3 * sizeof(double);
+      if (mesh.vertex_normals)
+        bytes += mesh.vertex_count * 3 * sizeof(double);
+      return bytes;
+    }
+  case shapes::OCTREE:
+    {
+      const shapes::OcTree &octree = static_cast<const shapes::OcTree&>(shape);
+      return sizeof(shapes::OcTree) + (octree.octree ? octree.octree->memoryUsage() : 0);
+    }
+  case shapes::BOX:
+    return sizeof(shapes::Box);
+  case shapes::SPHERE:
+    return sizeof(shapes::Sphere);
+  case shapes::CYLINDER:
+    return sizeof(shapes::Cylinder);
+  case shapes::CONE:
+    return sizeof(shapes::Cone);
+  case shapes::PLANE:
+    return sizeof(shapes::Plane);
+  default:
+    return sizeof(shapes::Shape);
+  }
+}
+
+void collision_detection::World::updateVersion(const ObjectPtr &obj)
+{
+  obj->version_ = newVersion();
+}
+
+void collision_detection::World::updateMemoryAccounting(const ObjectPtr &obj)
+{
+  std::size_t shape_bytes = 0;
+  std::size_t octree_bytes = 0;
+  for (std::size_t i = 0 ; i < obj->shapes_.size() ; ++i)
+    if (obj->shapes_[i]->type == shapes::OCTREE)
+      octree_bytes += getShapeMemoryUsage(*obj->shapes_[i]);
+    else
+      shape_bytes += getShapeMemoryUsage(*obj->shapes_[i]);
+  moveit::tools::MemoryAccounting::Add(moveit::tools::MemoryAccounting::WORLD_OBJECTS, (boost::int64_t)shape_bytes - (boost::int64_t)obj->shape_bytes_);
+  moveit::tools::MemoryAccounting::Add(moveit::tools::MemoryAccounting::OCTOMAP, (boost::int64_t)octree_bytes - (boost::int64_t)obj->octree_bytes_);
+  obj->shape_bytes_ = shape_bytes;
+  obj->octree_bytes_ = octree_bytes;
+}
+
+void collision_detection::World::getMemoryUsage(std::size_t &shape_bytes, std::size_t &octree_bytes) const
+{
+  shape_bytes = 0;
+  octree_bytes = 0;
+  for (std::map<std::string, ObjectPtr>::const_iterator it = objects_.begin() ; it != objects_.end() ; ++it)
+  {
+    shape_bytes += it->second->shape_bytes_;
+    octree_bytes += it->second->octree_bytes_;
+  }
+}
+
 bool collision_detection::World::moveShapeInObject(const std::string &id,
                                                    const shapes::ShapeConstPtr &shape,
                                                    const Eigen::Affine3d &pose)
@@ -147,6 +272,7 @@ bool collision_detection::World::moveShapeInObject(const std::string &id,
       {
         ensureUnique(it->second);
         it->second->shape_poses_[i] = pose;
+        updateVersion(it->second);
 
         notify(it->second, MOVE_SHAPE);
         return true;
@@ -155,6 +281,46 @@ bool collision_detection::World::moveShapeInObject(const std::string &id,
   return false;
 }
 
+bool collision_detection::World::setShapePoses(const std::string &id,
+                                               const EigenSTL::vector_Affine3d &poses)
+{
+  std::map<std::string, ObjectPtr>::iterator it = objects_.find(id);
+  if (it == objects_.end())
+    return false;
+  if (it->second->shapes_.size() != poses.size())
+  {
+    logError("Number of poses (%u) does not match the number of shapes (%u) of object '%s'. Not moving.",
+             (unsigned int)poses.size(), (unsigned int)it->second->shapes_.size(), id.c_str());
+    return false;
+  }
+
+  ensureUnique(it->second);
+  it->second->shape_poses_ = poses;
+  updateVersion(it->second);
+
+  notify(it->second, MOVE_SHAPE);
+  return true;
+}
+
+void collision_detection::World::setObject(const ObjectConstPtr &obj)
+{
+  ObjectPtr& existing = objects_[obj->id_];
+  if (existing == obj)
+    return;
+
+  int action;
+  if (!existing)
+    action = CREATE | ADD_SHAPE;
+  else if (existing->shapes_ == obj->shapes_)
+    action = MOVE_SHAPE;
+  else
+    action = ADD_SHAPE | REMOVE_SHAPE;
+
+  existing = obj;
+  updateMemoryAccounting(existing);
+  notify(existing, Action(action));
+}
+
 bool collision_detection::World::removeShapeFromObject(const std::string &id,
                                                        const shapes::ShapeConstPtr &shape)
 {
@@ -176,6 +342,8 @@ bool collision_detection::World::removeShapeFromObject(const std::string &id,
         }
         else
         {
+          updateVersion(it->second);
+          updateMemoryAccounting(it->second);
           notify(it->second, REMOVE_SHAPE);
         }
         return true;
@@ -209,6 +377,14 @@ collision_detection::World::ObserverHandle collision_detection::World::addObserv
   return ObserverHandle(o);
 }
 
+collision_detection::World::ObserverHandle collision_detection::World::addObserver(const ObserverCallbackFn &callback,
+                                                                                   const BatchObserverCallbackFn &batch_callback)
+{
+  Observer *o = new Observer(callback, batch_callback);
+  observers_.push_back(o);
+  return ObserverHandle(o);
+}
+
 void collision_detection::World::removeObserver(ObserverHandle observer_handle)
 {
   for (std::vector<Observer*>::iterator obs = observers_.begin() ; obs != observers_.end() ; ++obs)
@@ -230,10 +406,77 @@ void collision_detection::World::notifyAll(Action action)
 
 void collision_detection::World::notify(const ObjectConstPtr& obj, Action action)
 {
+  // every change is notified, so this is where the version of the world changes
+  version_ = newVersion();
+  if (batch_depth_ > 0)
+  {
+    std::map<std::string, std::size_t>::iterator it = pending_index_.find(obj->id_);
+    if (it == pending_index_.end())
+    {
+      PendingChange change;
+      change.obj_ = obj;
+      change.action_ = action;
+      change.existed_ = !(action & CREATE);
+      pending_index_[obj->id_] = pending_changes_.size();
+      pending_changes_.push_back(change);
+    }
+    else
+    {
+      PendingChange &change = pending_changes_[it->second];
+      change.obj_ = obj;
+      // DESTROY is never combined with other actions; an object destroyed and created again is reported as created
+      if (action & DESTROY)
+        change.action_ = DESTROY;
+      else if (change.action_ == DESTROY)
+        change.action_ = action | CREATE;
+      else
+        change.action_ |= action;
+    }
+    return;
+  }
+
   for (std::vector<Observer*>::const_iterator obs = observers_.begin() ; obs != observers_.end() ; ++obs)
     (*obs)->callback_(obj, action);
 }
 
+void collision_detection::World::beginBatch()
+{
+  ++batch_depth_;
+}
+
+void collision_detection::World::commitBatch()
+{
+  if (batch_depth_ == 0)
+  {
+    logError("commitBatch() called without a matching beginBatch()");
+    return;
+  }
+  if (--batch_depth_ > 0)
+    return;
+
+  ObjectChanges changes;
+  changes.reserve(pending_changes_.size());
+  for (std::size_t i = 0 ; i < pending_changes_.size() ; ++i)
+  {
+    const PendingChange &change = pending_changes_[i];
+    // objects that only existed during the batch were never seen by the observers
+    if (change.action_ == DESTROY && !change.existed_)
+      continue;
+    changes.push_back(std::make_pair(change.obj_, Action(change.action_)));
+  }
+  pending_changes_.clear();
+  pending_index_.clear();
+  if (changes.empty())
+    return;
+
+  for (std::vector<Observer*>::const_iterator obs = observers_.begin() ; obs != observers_.end() ; ++obs)
+    if ((*obs)->batch_callback_)
+      (*obs)->batch_callback_(changes);
+    else
+      for (std::size_t i = 0 ; i < changes.size() ; ++i)
+        (*obs)->callback_(changes[i].first, changes[i].second);
+}
+
 void collision_detection::World::notifyObserverAllObjects(const ObserverHandle observer_handle, Action action) const
 {
   for (std::vector<Observer*>::const_iterator obs = observers_.begin() ; obs != observers_.end() ; ++obs)
@@ -0,0 +1,278 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2013, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#include <moveit/collision_detection/world_spatial_index.h>
+#include <geometric_shapes/shape_operations.h>
+#include <boost/functional/hash.hpp>
+#include <boost/bind.hpp>
+#include <algorithm>
+#include <limits>
+#include <cmath>
+
+namespace collision_detection
+{
+namespace
+{
+// objects that would be stored in more cells than this are kept out of the grid
+static const double MAX_CELLS_PER_OBJECT = 64.0;
+
+void updateBox(const Eigen::Vector3d &p, Eigen::Vector3d &min, Eigen::Vector3d &max)
+{
+  min = min.cwiseMin(p);
+  max = max.cwiseMax(p);
+}
+
+// the box centered at \e center, with half-sizes \e half, transformed by \e pose
+void updateBox(const Eigen::Affine3d &pose, const Eigen::Vector3d &center, const Eigen::Vector3d &half,
+               Eigen::Vector3d &min, Eigen::Vector3d &max)
+{
+  const Eigen::Vector3d c = pose * center;
+  const Eigen::Vector3d h = pose.rotation().cwiseAbs() * half;
+  updateBox(c - h, min, max);
+  updateBox(c + h, min, max);
+}
+
+// returns false if the shape is not bounded
+bool updateShapeBox(const shapes::Shape *shape, const Eigen::Affine3d &pose, Eigen::Vector3d &min, Eigen::Vector3d &max)
+{
+  if (shape->type == shapes::PLANE)
+    return false;
+
+  if (shape->type == shapes::MESH)
+  {
+    const shapes::Mesh *mesh = static_cast<const shapes::Mesh*>(shape);
+    for (unsigned int i = 0 ; i < mesh->vertex_count ; ++i)
+      updateBox(pose * Eigen::Vector3d(mesh->vertices[3 * i], mesh->vertices[3 * i + 1], mesh->vertices[3 * i + 2]), min, max);
+  }
+  else if (shape->type == shapes::OCTREE)
+  {
+    const shapes::OcTree *octree = static_cast<const shapes::OcTree*>(shape);
+    if (!octree->octree)
+      return true;
+    Eigen::Vector3d lo, hi;
+    octree->octree->getMetricMin(lo.x(), lo.y(), lo.z());
+    octree->octree->getMetricMax(hi.x(), hi.y(), hi.z());
+    updateBox(pose, (lo + hi) / 2.0, (hi - lo) / 2.0, min, max);
+  }
+  else
+    // the other shapes are centered at the origin of their frame
+    updateBox(pose, Eigen::Vector3d::Zero(), shapes::computeShapeExtents(shape) / 2.0, min, max);
+  return true;
+}
+
+int toCellIndex(double v)
+{
+  static const double limit = std::numeric_limits<int>::max() / 2;
+  return (int)std::max(-limit, std::min(limit, std::floor(v)));
+}
+}
+}
+
+std::size_t collision_detection::WorldSpatialIndex::CellHash::operator()(const Cell &c) const
+{
+  std::size_t seed = 0;
+  boost::hash_combine(seed, c.x_);
+  boost::hash_combine(seed, c.y_);
+  boost::hash_combine(seed, c.z_);
+  return seed;
+}
+
+collision_detection::WorldSpatialIndex::WorldSpatialIndex(double cell_size) :
+  cell_size_(cell_size)
+{
+}
+
+collision_detection::WorldSpatialIndex::WorldSpatialIndex(const WorldPtr &world, double cell_size) :
+  cell_size_(cell_size)
+{
+  setWorld(world);
+}
+
+collision_detection::WorldSpatialIndex::~WorldSpatialIndex()
+{
+  WorldPtr old_world = world_.lock();
+  if (old_world)
+    old_world->removeObserver(observer_handle_);
+}
+
+void collision_detection::WorldSpatialIndex::reset()
+{
+  WorldPtr old_world = world_.lock();
+  if (old_world)
+    old_world->removeObserver(observer_handle_);
+  world_.reset();
+
+  entries_.clear();
+  cells_.clear();
+  large_.clear();
+}
+
+void collision_detection::WorldSpatialIndex::setWorld(const WorldPtr &world)
+{
+  reset();
+
+  boost::weak_ptr<World>(world).swap(world_);
+  observer_handle_ = world->addObserver(boost::bind(&WorldSpatialIndex::notify, this, _1, _2));
+  world->notifyObserverAllObjects(observer_handle_, World::CREATE|World::ADD_SHAPE);
+}
+
+void collision_detection::WorldSpatialIndex::notify(const World::ObjectConstPtr &obj, World::Action action)
+{
+  remove(obj->id_);
+  if (action != World::DESTROY)
+    add(*obj);
+}
+
+collision_detection::WorldSpatialIndex::Cell collision_detection::WorldSpatialIndex::getCell(const Eigen::Vector3d &p) const
+{
+  return Cell(toCellIndex(p.x() / cell_size_), toCellIndex(p.y() / cell_size_), toCellIndex(p.z() / cell_size_));
+}
+
+void collision_detection::WorldSpatialIndex::add(const World::Object &obj)
+{
+  Entry &e = entries_[obj.id_];
+  e.min_ = Eigen::Vector3d::Constant(std::numeric_limits<double>::infinity());
+  e.max_ = -e.min_;
+  e.bounded_ = true;
+  for (std::size_t i = 0 ; i < obj.shapes_.size() ; ++i)
+    if (!updateShapeBox(obj.shapes_[i].get(), obj.shape_poses_[i], e.min_, e.max_))
+      e.bounded_ = false;
+
+  e.in_grid_ = false;
+  if (e.bounded_ && (e.min_.array() <= e.max_.array()).all())
+  {
+    e.lo_ = getCell(e.min_);
+    e.hi_ = getCell(e.max_);
+    e.in_grid_ = (double)(e.hi_.x_ - e.lo_.x_ + 1) * (double)(e.hi_.y_ - e.lo_.y_ + 1) * (double)(e.hi_.z_ - e.lo_.z_ + 1) <= MAX_CELLS_PER_OBJECT;
+  }
+
+  if (e.in_grid_)
+  {
+    for (int x = e.lo_.x_ ; x <= e.hi_.x_ ; ++x)
+      for (int y = e.lo_.y_ ; y <= e.hi_.y_ ; ++y)
+        for (int z = e.lo_.z_ ; z <= e.hi_.z_ ; ++z)
+          cells_[Cell(x, y, z)].push_back(obj.id_);
+  }
+  else
+    large_.insert(obj.id_);
+}
+
+void collision_detection::WorldSpatialIndex::remove(const std::string &id)
+{
+  std::map<std::string, Entry>::iterator it = entries_.find(id);
+  if (it == entries_.end())
+    return;
+
+  const Entry &e = it->second;
+  if (e.in_grid_)
+  {
+    for (int x = e.lo_.x_ ; x <= e.hi_.x_ ; ++x)
+      for (int y = e.lo_.y_ ; y <= e.hi_.y_ ; ++y)
+        for (int z = e.lo_.z_ ; z <= e.hi_.z_ ; ++z)
+        {
+          boost::unordered_map<Cell, std::vector<std::string>, CellHash>::iterator c = cells_.find(Cell(x, y, z));
+          if (c == cells_.end())
+            continue;
+          c->second.erase(std::remove(c->second.begin(), c->second.end(), id), c->second.end());
+          if (c->second.empty())
+            cells_.erase(c);
+        }
+  }
+  else
+    large_.erase(id);
+  entries_.erase(it);
+}
+
+void collision_detection::WorldSpatialIndex::getObjectsInBox(const Eigen::Vector3d &min, const Eigen::Vector3d &max,
+                                                             std::vector<std::string> &ids) const
+{
+  ids.clear();
+  const Cell lo = getCell(min);
+  const Cell hi = getCell(max);
+  const double cell_count = (double)(hi.x_ - lo.x_ + 1) * (double)(hi.y_ - lo.y_ + 1) * (double)(hi.z_ - lo.z_ + 1);
+
+  // when the box covers more cells than there are objects, it is cheaper to go through the objects
+  if (cell_count > (double)entries_.size())
+  {
+    for (std::map<std::string, Entry>::const_iterator it = entries_.begin() ; it != entries_.end() ; ++it)
+      if (!it->second.bounded_ || ((it->second.min_.array() <= max.array()).all() && (it->second.max_.array() >= min.array()).all()))
+        ids.push_back(it->first);
+    return;
+  }
+
+  std::vector<std::string> candidates(large_.begin(), large_.end());
+  for (int x = lo.x_ ; x <= hi.x_ ; ++x)
+    for (int y = lo.y_ ; y <= hi.y_ ; ++y)
+      for (int z = lo.z_ ; z <= hi.z_ ; ++z)
+      {
+        boost::unordered_map<Cell, std::vector<std::string>, CellHash>::const_iterator c = cells_.find(Cell(x, y, z));
+        if (c != cells_.end())
+          candidates.insert(candidates.end(), c->second.begin(), c->second.end());
+      }
+  std::sort(candidates.begin(), candidates.end());
+  candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+
+  for (std::size_t i = 0 ; i < candidates.size() ; ++i)
+  {
+    const Entry &e = entries_.find(candidates[i])->second;
+    if (!e.bounded_ || ((e.min_.array() <= max.array()).all() && (e.max_.array() >= min.array()).all()))
+      ids.push_back(candidates[i]);
+  }
+}
+
+void collision_detection::WorldSpatialIndex::getObjectsNear(const Eigen::Vector3d &point, double distance,
+                                                            std::vector<std::string> &ids) const
+{
+  const Eigen::Vector3d d = Eigen::Vector3d::Constant(distance);
+  std::vector<std::string> in_box;
+  getObjectsInBox(point - d, point + d, in_box);
+
+  ids.clear();
+  for (std::size_t i = 0 ; i < in_box.size() ; ++i)
+  {
+    const Entry &e = entries_.find(in_box[i])->second;
+    if (!e.bounded_ || (point.cwiseMax(e.min_).cwiseMin(e.max_) - point).squaredNorm() <= distance * distance)
+      ids.push_back(in_box[i]);
+  }
+}
+
+bool collision_detection::WorldSpatialIndex::getObjectAABB(const std::string &id, Eigen::Vector3d &min, Eigen::Vector3d &max) const
+{
+  std::map<std::string, Entry>::const_iterator it = entries_.find(id);
+  if (it == entries_.end() || !it->second.bounded_)
+    return false;
+  min = it->second.min_;
+  max = it->second.max_;
+  return true;
+}
@@ -0,0 +1,201 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2013, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#include <gtest/gtest.h>
+#include <moveit/collision_detection/collision_matrix.h>
+#include <sstream>
+#include <algorithm>
+
+static bool neverAllowed(collision_detection::Contact&)
+{
+  return false;
+}
+
+TEST(AllowedCollisionMatrix, CompiledMatchesNamedQueries)
+{
+  std::vector<std::string> names;
+  names.push_back("a");
+  names.push_back("b");
+  names.push_back("c");
+  collision_detection::AllowedCollisionMatrix acm(names, false);
+  acm.setEntry("a", "b", true);
+  acm.setEntry("b", "c", &neverAllowed);
+  acm.setDefaultEntry("d", true);
+
+  names.push_back("d");
+  names.push_back("unknown");
+
+  collision_detection::CompiledAllowedCollisionMatrixConstPtr compiled = acm.getCompiled();
+  for (std::size_t i = 0 ; i < names.size() ; ++i)
+    for (std::size_t j = 0 ; j < names.size() ; ++j)
+    {
+      collision_detection::AllowedCollision::Type t1, t2;
+      bool f1 = acm.getAllowedCollision(names[i], names[j], t1);
+      bool f2 = compiled->getAllowedCollision(collision_detection::AllowedCollisionMatrix::getNameIndex(names[i]),
+                                              collision_detection::AllowedCollisionMatrix::getNameIndex(names[j]), t2);
+      EXPECT_EQ(f1, f2);
+      if (f1 && f2)
+        EXPECT_EQ(t1, t2);
+    }
+}
+
+TEST(AllowedCollisionMatrix, CompiledIsUpdated)
+{
+  std::vector<std::string> names;
+  names.push_back("a");
+  names.push_back("b");
+  collision_detection::AllowedCollisionMatrix acm(names, false);
+  std::size_t a = collision_detection::AllowedCollisionMatrix::getNameIndex("a");
+  std::size_t b = collision_detection::AllowedCollisionMatrix::getNameIndex("b");
+  EXPECT_EQ(a, collision_detection::AllowedCollisionMatrix::getNameIndex("a"));
+
+  collision_detection::AllowedCollision::Type type;
+  EXPECT_TRUE(acm.getCompiled()->getAllowedCollision(a, b, type));
+  EXPECT_EQ(collision_detection::AllowedCollision::NEVER, type);
+
+  acm.setEntry("a", "b", true);
+  EXPECT_TRUE(acm.getCompiled()->getAllowedCollision(a, b, type));
+  EXPECT_EQ(collision_detection::AllowedCollision::ALWAYS, type);
+
+  acm.removeEntry("a", "b");
+  EXPECT_FALSE(acm.getCompiled()->getAllowedCollision(a, b, type));
+}
+
+TEST(AllowedCollisionMatrix, CompiledConditional)
+{
+  std::vector<std::string> names;
+  names.push_back("a");
+  names.push_back("b");
+  names.push_back("c");
+  collision_detection::AllowedCollisionMatrix acm(names, true);
+  // a function pointer would convert to bool and select the other overload
+  acm.setEntry("b", "c", collision_detection::DecideContactFn(&neverAllowed));
+  acm.setDefaultEntry("d", collision_detection::DecideContactFn(&neverAllowed));
+  std::size_t a = collision_detection::AllowedCollisionMatrix::getNameIndex("a");
+  std::size_t b = collision_detection::AllowedCollisionMatrix::getNameIndex("b");
+  std::size_t c = collision_detection::AllowedCollisionMatrix::getNameIndex("c");
+  std::size_t d = collision_detection::AllowedCollisionMatrix::getNameIndex("d");
+  std::size_t unknown = collision_detection::AllowedCollisionMatrix::getNameIndex("unknown");
+
+  collision_detection::CompiledAllowedCollisionMatrixConstPtr compiled = acm.getCompiled();
+  collision_detection::DecideContactFn fn;
+  collision_detection::Contact contact;
+  EXPECT_FALSE(compiled->getAllowedCollision(a, b, fn));
+  ASSERT_TRUE(compiled->getAllowedCollision(c, b, fn));
+  EXPECT_FALSE(fn(contact));
+  fn.clear();
+  ASSERT_TRUE(compiled->getAllowedCollision(d, unknown, fn));
+  EXPECT_FALSE(fn(contact));
+  EXPECT_TRUE(compiled->getAllowedCollision(a, d, fn));
+  EXPECT_FALSE(compiled->getAllowedCollision(unknown, unknown, fn));
+}
+
+TEST(AllowedCollisionMatrix, NameIndicesAreReclaimed)
+{
+  std::size_t kept = collision_detection::AllowedCollisionMatrix::acquireNameIndex("kept");
+  collision_detection::CompiledAllowedCollisionMatrixConstPtr compiled;
+  {
+    std::vector<std::string> names(1, "compiled");
+    collision_detection::AllowedCollisionMatrix acm(names, true);
+    compiled = acm.getCompiled();
+  }
+  std::size_t in_snapshot = collision_detection::AllowedCollisionMatrix::getNameIndex("compiled");
+
+  // names that are no longer referenced are forgotten, so their indices are reused
+  std::size_t max_index = 0;
+  for (int i = 0 ; i < 20000 ; ++i)
+  {
+    std::stringstream ss;
+    ss << "transient_" << i;
+    max_index = std::max(max_index, collision_detection::AllowedCollisionMatrix::getNameIndex(ss.str()));
+  }
+  EXPECT_LT(max_index, 5000u);
+
+  // referenced names keep their index
+  EXPECT_EQ(kept, collision_detection::AllowedCollisionMatrix::getNameIndex("kept"));
+  EXPECT_EQ("kept", collision_detection::AllowedCollisionMatrix::getNameFromIndex(kept));
+  EXPECT_EQ(in_snapshot, collision_detection::AllowedCollisionMatrix::getNameIndex("compiled"));
+  collision_detection::AllowedCollision::Type type;
+  EXPECT_TRUE(compiled->getAllowedCollision(in_snapshot, in_snapshot, type));
+  EXPECT_EQ(collision_detection::AllowedCollision::ALWAYS, type);
+
+  collision_detection::AllowedCollisionMatrix::releaseNameIndex(kept);
+  compiled.reset();
+}
+
+TEST(AllowedCollisionMatrix, SharedCopies)
+{
+  std::vector<std::string> names;
+  names.push_back("a");
+  names.push_back("b");
+  collision_detection::AllowedCollisionMatrix acm(names, false);
+  moveit_msgs::AllowedCollisionMatrix msg;
+  acm.getMessage(msg);
+  collision_detection::CompiledAllowedCollisionMatrixConstPtr compiled = acm.getCompiled();
+
+  // copies share the content and the cached forms until one of them changes
+  collision_detection::AllowedCollisionMatrix copy(acm);
+  EXPECT_EQ(acm.getVersion(), copy.getVersion());
+  EXPECT_EQ(compiled, copy.getCompiled());
+
+  copy.setEntry("a", "b", true);
+  EXPECT_NE(acm.getVersion(), copy.getVersion());
+  collision_detection::AllowedCollision::Type type;
+  ASSERT_TRUE(acm.getEntry("a", "b", type));
+  EXPECT_EQ(collision_detection::AllowedCollision::NEVER, type);
+  ASSERT_TRUE(copy.getEntry("a", "b", type));
+  EXPECT_EQ(collision_detection::AllowedCollision::ALWAYS, type);
+  EXPECT_EQ(compiled, acm.getCompiled());
+
+  moveit_msgs::AllowedCollisionMatrix copy_msg;
+  copy.getMessage(copy_msg);
+  ASSERT_EQ(2u, copy_msg.entry_values.size());
+  EXPECT_TRUE(copy_msg.entry_values[0].enabled[1]);
+  acm.getMessage(msg);
+  EXPECT_FALSE(msg.entry_values[0].enabled[1]);
+
+  // setting all the entries of a name on a shared matrix
+  collision_detection::AllowedCollisionMatrix other(acm);
+  other.setEntry("a", true);
+  ASSERT_TRUE(other.getEntry("a", "b", type));
+  EXPECT_EQ(collision_detection::AllowedCollision::ALWAYS, type);
+  ASSERT_TRUE(acm.getEntry("a", "b", type));
+  EXPECT_EQ(collision_detection::AllowedCollision::NEVER, type);
+}
+
+int main(int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
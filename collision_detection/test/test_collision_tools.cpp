@@ -0,0 +1,110 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2013, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#include <gtest/gtest.h>
+#include <moveit/collision_detection/collision_tools.h>
+
+static collision_detection::CostSource makeCostSource(double x, double y, double z, double size, double cost)
+{
+  collision_detection::CostSource cs;
+  cs.aabb_min[0] = x;
+  cs.aabb_min[1] = y;
+  cs.aabb_min[2] = z;
+  cs.aabb_max[0] = x + size;
+  cs.aabb_max[1] = y + size;
+  cs.aabb_max[2] = z + size;
+  cs.cost = cost;
+  return cs;
+}
+
+TEST(CostSourceAccumulator, KeepsMostCostly)
+{
+  std::set<collision_detection::CostSource> all;
+  collision_detection::CostSourceAccumulator acc(10);
+  for (int wp = 0 ; wp < 20 ; ++wp)
+  {
+    std::set<collision_detection::CostSource> sources;
+    for (int i = 0 ; i < 15 ; ++i)
+      sources.insert(makeCostSource(i, wp, 0.0, 0.1 + 0.01 * ((wp * 7 + i * 3) % 11), 0.5));
+    all.insert(sources.begin(), sources.end());
+    acc.add(sources);
+    EXPECT_LE(acc.getCostSources().size(), 10u);
+  }
+
+  std::set<collision_detection::CostSource> costs;
+  acc.swap(costs);
+  ASSERT_EQ(10u, costs.size());
+  std::set<collision_detection::CostSource>::const_iterator it = all.begin();
+  for (std::set<collision_detection::CostSource>::const_iterator jt = costs.begin() ; jt != costs.end() ; ++it, ++jt)
+  {
+    EXPECT_FALSE(*it < *jt);
+    EXPECT_FALSE(*jt < *it);
+  }
+}
+
+TEST(CostSources, RemoveOverlapping)
+{
+  std::set<collision_detection::CostSource> sources;
+  sources.insert(makeCostSource(0.0, 0.0, 0.0, 1.0, 1.0));
+  // overlaps the first source in half of its volume
+  sources.insert(makeCostSource(0.5, 0.0, 0.0, 1.0, 0.5));
+  // overlaps the first source in an eighth of its volume
+  sources.insert(makeCostSource(0.5, 0.5, 0.5, 0.9, 0.5));
+  // touches the first source without overlapping
+  sources.insert(makeCostSource(-1.0, 0.0, 0.0, 1.0, 0.5));
+  // far away
+  sources.insert(makeCostSource(10.0, 10.0, 10.0, 1.0, 0.5));
+  // a large source that contains everything is the most costly one
+  std::set<collision_detection::CostSource> with_large = sources;
+  with_large.insert(makeCostSource(-5.0, -5.0, -5.0, 20.0, 1.0));
+
+  collision_detection::removeOverlapping(sources, 0.4);
+  EXPECT_EQ(4u, sources.size());
+  EXPECT_TRUE(sources.find(makeCostSource(0.5, 0.0, 0.0, 1.0, 0.5)) == sources.end());
+
+  collision_detection::removeOverlapping(sources, 0.1);
+  EXPECT_EQ(3u, sources.size());
+
+  // the others overlap only a small fraction of the volume of the large source, so it does not remove them
+  collision_detection::removeOverlapping(with_large, 0.1);
+  EXPECT_EQ(4u, with_large.size());
+  collision_detection::removeOverlapping(with_large, 0.0);
+  EXPECT_EQ(1u, with_large.size());
+}
+
+int main(int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -36,6 +36,7 @@
 
 #include <gtest/gtest.h>
 #include <moveit/collision_detection/world.h>
+#include <moveit/profiler/memory_accounting.h>
 #include <boost/bind.hpp>
 
 
@@ -419,6 +420,246 @@ TEST(World, TrackChanges)
   EXPECT_EQ(4, ta3.cnt_);
 }
 
+TEST(World, SetShapePoses)
+{
+  collision_detection::World world;
+  shapes::ShapePtr ball(new shapes::Sphere(1.0));
+  shapes::ShapePtr box(new shapes::Box(1,2,3));
+  EigenSTL::vector_Affine3d poses(2, Eigen::Affine3d::Identity());
+  world.addToObject("obj", std::vector<shapes::ShapeConstPtr>(1, ball), EigenSTL::vector_Affine3d(1, poses[0]));
+  world.addToObject("obj", box, poses[1]);
+
+  // a copy shares the object, and must keep the old poses
+  collision_detection::World copy(world);
+
+  TestAction ta;
+  world.addObserver(boost::bind(TrackChangesNotify, &ta, _1, _2));
+
+  poses[0] = Eigen::Translation3d(1, 0, 0);
+  poses[1] = Eigen::Translation3d(0, 2, 0);
+  EXPECT_TRUE(world.setShapePoses("obj", poses));
+  EXPECT_EQ(1, ta.cnt_);
+  EXPECT_EQ(collision_detection::World::MOVE_SHAPE, ta.action_);
+  EXPECT_EQ("obj", ta.obj_.id_);
+  ASSERT_EQ(2, ta.obj_.shape_poses_.size());
+  EXPECT_DOUBLE_EQ(1.0, ta.obj_.shape_poses_[0].translation().x());
+  EXPECT_DOUBLE_EQ(2.0, ta.obj_.shape_poses_[1].translation().y());
+  EXPECT_EQ(box, ta.obj_.shapes_[1]);
+  EXPECT_DOUBLE_EQ(0.0, copy.getObject("obj")->shape_poses_[0].translation().x());
+
+  // the number of poses must match the number of shapes
+  EXPECT_FALSE(world.setShapePoses("obj", EigenSTL::vector_Affine3d(1, Eigen::Affine3d::Identity())));
+  EXPECT_FALSE(world.setShapePoses("missing", poses));
+  EXPECT_EQ(1, ta.cnt_);
+}
+
+TEST(World, SetObject)
+{
+  collision_detection::World world;
+  shapes::ShapePtr ball(new shapes::Sphere(1.0));
+  shapes::ShapePtr box(new shapes::Box(1,2,3));
+  world.addToObject("obj", ball, Eigen::Affine3d::Identity());
+
+  collision_detection::World other;
+  TestAction ta;
+  other.addObserver(boost::bind(TrackChangesNotify, &ta, _1, _2));
+
+  // a new object is created, and shared with the world it came from
+  other.setObject(world.getObject("obj"));
+  EXPECT_EQ(1, ta.cnt_);
+  EXPECT_EQ(collision_detection::World::CREATE | collision_detection::World::ADD_SHAPE, ta.action_);
+  EXPECT_EQ(world.getObject("obj"), other.getObject("obj"));
+
+  // setting the same object again is not a change
+  other.setObject(world.getObject("obj"));
+  EXPECT_EQ(1, ta.cnt_);
+
+  // only the poses changed
+  world.moveShapeInObject("obj", ball, Eigen::Affine3d(Eigen::Translation3d(1, 0, 0)));
+  EXPECT_DOUBLE_EQ(0.0, other.getObject("obj")->shape_poses_[0].translation().x());
+  other.setObject(world.getObject("obj"));
+  EXPECT_EQ(2, ta.cnt_);
+  EXPECT_EQ(collision_detection::World::MOVE_SHAPE, ta.action_);
+  EXPECT_DOUBLE_EQ(1.0, other.getObject("obj")->shape_poses_[0].translation().x());
+
+  // the shapes changed
+  world.addToObject("obj", box, Eigen::Affine3d::Identity());
+  other.setObject(world.getObject("obj"));
+  EXPECT_EQ(3, ta.cnt_);
+  EXPECT_EQ(collision_detection::World::ADD_SHAPE | collision_detection::World::REMOVE_SHAPE, ta.action_);
+  EXPECT_EQ(2, other.getObject("obj")->shapes_.size());
+}
+
+/* batch notification callback */
+static void TrackBatchNotify(
+              std::vector<std::pair<std::string, int> > *changes,
+              const collision_detection::World::ObjectChanges &batch)
+{
+  for (std::size_t i = 0 ; i < batch.size() ; ++i)
+    changes->push_back(std::make_pair(batch[i].first->id_, int(batch[i].second)));
+}
+
+TEST(World, BatchChanges)
+{
+  collision_detection::World world;
+  shapes::ShapePtr ball(new shapes::Sphere(1.0));
+  shapes::ShapePtr box(new shapes::Box(1,2,3));
+  world.addToObject("existing", ball, Eigen::Affine3d::Identity());
+  world.addToObject("removed", box, Eigen::Affine3d::Identity());
+
+  TestAction ta;
+  world.addObserver(boost::bind(TrackChangesNotify, &ta, _1, _2));
+  std::vector<std::pair<std::string, int> > changes;
+  TestAction batch_ta;
+  world.addObserver(boost::bind(TrackChangesNotify, &batch_ta, _1, _2), boost::bind(TrackBatchNotify, &changes, _1));
+
+  {
+    collision_detection::World::ScopedBatch batch(world);
+    EXPECT_TRUE(world.inBatch());
+    world.moveShapeInObject("existing", ball, Eigen::Affine3d(Eigen::Translation3d(0,0,1)));
+    world.moveShapeInObject("existing", ball, Eigen::Affine3d(Eigen::Translation3d(0,0,2)));
+    world.addToObject("existing", box, Eigen::Affine3d::Identity());
+    world.removeObject("removed");
+    world.addToObject("new", ball, Eigen::Affine3d::Identity());
+    world.moveShapeInObject("new", ball, Eigen::Affine3d(Eigen::Translation3d(0,0,1)));
+    world.addToObject("temporary", ball, Eigen::Affine3d::Identity());
+    world.removeObject("temporary");
+
+    // nested batches are committed with the outermost one
+    world.beginBatch();
+    world.addToObject("nested", box, Eigen::Affine3d::Identity());
+    world.commitBatch();
+
+    // the world is up to date, but nothing was reported yet
+    EXPECT_EQ(3, world.size());
+    EXPECT_EQ(0, ta.cnt_);
+    EXPECT_TRUE(changes.empty());
+  }
+
+  EXPECT_FALSE(world.inBatch());
+  // the plain observer is called once per changed object, the batch observer once with all changes
+  EXPECT_EQ(4, ta.cnt_);
+  EXPECT_EQ(0, batch_ta.cnt_);
+  ASSERT_EQ(4, changes.size());
+  EXPECT_EQ("existing", changes[0].first);
+  EXPECT_EQ(collision_detection::World::MOVE_SHAPE | collision_detection::World::ADD_SHAPE, changes[0].second);
+  EXPECT_EQ("removed", changes[1].first);
+  EXPECT_EQ(collision_detection::World::DESTROY, changes[1].second);
+  EXPECT_EQ("new", changes[2].first);
+  EXPECT_EQ(collision_detection::World::CREATE | collision_detection::World::ADD_SHAPE | collision_detection::World::MOVE_SHAPE, changes[2].second);
+  EXPECT_EQ("nested", changes[3].first);
+
+  // outside of batches, the notifications are immediate again
+  world.removeObject("nested");
+  EXPECT_EQ(5, ta.cnt_);
+  EXPECT_EQ(1, batch_ta.cnt_);
+  EXPECT_EQ(collision_detection::World::DESTROY, ta.action_);
+}
+
+TEST(World, MemoryUsage)
+{
+  typedef moveit::tools::MemoryAccounting MA;
+  const boost::int64_t initial = MA::Get(MA::WORLD_OBJECTS);
+
+  shapes::ShapePtr ball(new shapes::Sphere(1.0));
+  shapes::Mesh *mesh = new shapes::Mesh(30, 10);
+  shapes::ShapePtr mesh_shape(mesh);
+  const std::size_t ball_bytes = collision_detection::World::getShapeMemoryUsage(*ball);
+  const std::size_t mesh_bytes = collision_detection::World::getShapeMemoryUsage(*mesh);
+  EXPECT_GE(mesh_bytes, 30 * 3 * sizeof(double) + 10 * 3 * sizeof(unsigned int));
+
+  std::size_t shape_bytes, octree_bytes;
+  {
+    collision_detection::World world;
+    world.addToObject("ball", ball, Eigen::Affine3d::Identity());
+    world.addToObject("mesh", mesh_shape, Eigen::Affine3d::Identity());
+    world.getMemoryUsage(shape_bytes, octree_bytes);
+    EXPECT_EQ(ball_bytes + mesh_bytes, shape_bytes);
+    EXPECT_EQ(0, octree_bytes);
+    EXPECT_EQ(initial + ball_bytes + mesh_bytes, MA::Get(MA::WORLD_OBJECTS));
+
+    // copies of a world share their objects, which are accounted once
+    collision_detection::World copy(world);
+    EXPECT_EQ(initial + ball_bytes + mesh_bytes, MA::Get(MA::WORLD_OBJECTS));
+
+    // the mesh object of the copy is no longer shared once it is modified
+    copy.addToObject("mesh", ball, Eigen::Affine3d::Identity());
+    copy.getMemoryUsage(shape_bytes, octree_bytes);
+    EXPECT_EQ(2 * ball_bytes + mesh_bytes, shape_bytes);
+    EXPECT_EQ(initial + 2 * ball_bytes + 2 * mesh_bytes, MA::Get(MA::WORLD_OBJECTS));
+
+    world.removeShapeFromObject("mesh", mesh_shape);
+    world.getMemoryUsage(shape_bytes, octree_bytes);
+    EXPECT_EQ(ball_bytes, shape_bytes);
+    EXPECT_EQ(initial + 2 * ball_bytes + mesh_bytes, MA::Get(MA::WORLD_OBJECTS));
+  }
+  EXPECT_EQ(initial, MA::Get(MA::WORLD_OBJECTS));
+}
+
+TEST(World, Versions)
+{
+  collision_detection::World world;
+  shapes::ShapePtr ball(new shapes::Sphere(1.0));
+  shapes::ShapePtr box(new shapes::Box(1,2,3));
+
+  boost::uint64_t v0 = world.getVersion();
+  world.addToObject("ball", ball, Eigen::Affine3d::Identity());
+  boost::uint64_t v1 = world.getVersion();
+  EXPECT_NE(v0, v1);
+  boost::uint64_t ball_v1 = world.getObject("ball")->version_;
+
+  // changing one object does not change the version of the others
+  world.addToObject("box", box, Eigen::Affine3d::Identity());
+  EXPECT_NE(v1, world.getVersion());
+  EXPECT_EQ(ball_v1, world.getObject("ball")->version_);
+
+  // failed changes are not changes
+  boost::uint64_t v2 = world.getVersion();
+  EXPECT_FALSE(world.moveShapeInObject("ball", box, Eigen::Affine3d::Identity()));
+  EXPECT_FALSE(world.removeObject("none"));
+  EXPECT_EQ(v2, world.getVersion());
+
+  EXPECT_TRUE(world.moveShapeInObject("ball", ball, Eigen::Affine3d(Eigen::Translation3d(1, 0, 0))));
+  boost::uint64_t ball_v2 = world.getObject("ball")->version_;
+  EXPECT_NE(ball_v1, ball_v2);
+
+  // a copy has the versions of the original until either changes; versions are never reused
+  collision_detection::World copy(world);
+  EXPECT_EQ(world.getVersion(), copy.getVersion());
+  EXPECT_EQ(ball_v2, copy.getObject("ball")->version_);
+  copy.setShapePoses("ball", EigenSTL::vector_Affine3d(1, Eigen::Affine3d::Identity()));
+  EXPECT_NE(world.getVersion(), copy.getVersion());
+  EXPECT_NE(ball_v2, copy.getObject("ball")->version_);
+  EXPECT_EQ(ball_v2, world.getObject("ball")->version_);
+  world.setShapePoses("ball", EigenSTL::vector_Affine3d(1, Eigen::Affine3d::Identity()));
+  EXPECT_NE(world.getVersion(), copy.getVersion());
+  EXPECT_NE(world.getObject("ball")->version_, copy.getObject("ball")->version_);
+
+  // an object shared with another world keeps its version
+  collision_detection::World other;
+  other.setObject(world.getObject("box"));
+  EXPECT_EQ(world.getObject("box")->version_, other.getObject("box")->version_);
+
+  // an object removed and added again has a new version
+  boost::uint64_t box_v = world.getObject("box")->version_;
+  world.removeObject("box");
+  EXPECT_FALSE(world.hasObject("box"));
+  world.addToObject("box", box, Eigen::Affine3d::Identity());
+  EXPECT_NE(box_v, world.getObject("box")->version_);
+
+  // changes in a batch change the version right away
+  boost::uint64_t v3 = world.getVersion();
+  {
+    collision_detection::World::ScopedBatch batch(world);
+    world.removeObject("ball");
+    EXPECT_NE(v3, world.getVersion());
+  }
+
+  boost::uint64_t v4 = world.getVersion();
+  world.clearObjects();
+  EXPECT_NE(v4, world.getVersion());
+}
+
 int main(int argc, char **argv)
 {
   testing::InitGoogleTest(&argc, argv);
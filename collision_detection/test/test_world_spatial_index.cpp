@@ -0,0 +1,125 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2013, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#include <gtest/gtest.h>
+#include <moveit/collision_detection/world_spatial_index.h>
+#include <algorithm>
+
+static bool contains(const std::vector<std::string> &ids, const std::string &id)
+{
+  return std::find(ids.begin(), ids.end(), id) != ids.end();
+}
+
+TEST(WorldSpatialIndex, Queries)
+{
+  collision_detection::WorldPtr world(new collision_detection::World);
+  shapes::ShapePtr ball(new shapes::Sphere(0.5));
+  shapes::ShapePtr box(new shapes::Box(1, 2, 3));
+  world->addToObject("ball", ball, Eigen::Affine3d(Eigen::Translation3d(2, 0, 0)));
+
+  // objects already in the world are indexed
+  collision_detection::WorldSpatialIndex index(world, 0.5);
+  EXPECT_EQ(1, index.size());
+
+  world->addToObject("box", box, Eigen::Affine3d(Eigen::Translation3d(-3, 0, 0)));
+  world->addToObject("plane", shapes::ShapeConstPtr(new shapes::Plane(0, 0, 1, 0)), Eigen::Affine3d::Identity());
+  EXPECT_EQ(3, index.size());
+
+  Eigen::Vector3d min, max;
+  ASSERT_TRUE(index.getObjectAABB("box", min, max));
+  EXPECT_NEAR(-3.5, min.x(), 1e-9);
+  EXPECT_NEAR(-1.0, min.y(), 1e-9);
+  EXPECT_NEAR(1.5, max.z(), 1e-9);
+  EXPECT_FALSE(index.getObjectAABB("plane", min, max));
+  EXPECT_FALSE(index.getObjectAABB("missing", min, max));
+
+  std::vector<std::string> ids;
+  index.getObjectsInBox(Eigen::Vector3d(1, -1, -1), Eigen::Vector3d(3, 1, 1), ids);
+  EXPECT_EQ(2, ids.size());
+  EXPECT_TRUE(contains(ids, "ball"));
+  EXPECT_TRUE(contains(ids, "plane"));
+
+  // a box covering more cells than there are objects
+  index.getObjectsInBox(Eigen::Vector3d(-10, -10, -10), Eigen::Vector3d(10, 10, 10), ids);
+  EXPECT_EQ(3, ids.size());
+
+  index.getObjectsNear(Eigen::Vector3d(0, 0, 0), 1.6, ids);
+  EXPECT_TRUE(contains(ids, "ball"));
+  EXPECT_FALSE(contains(ids, "box"));
+  index.getObjectsNear(Eigen::Vector3d(0, 0, 0), 2.6, ids);
+  EXPECT_TRUE(contains(ids, "box"));
+
+  // the index follows the changes of the world
+  world->moveShapeInObject("ball", ball, Eigen::Affine3d(Eigen::Translation3d(5, 5, 5)));
+  index.getObjectsInBox(Eigen::Vector3d(1, -1, -1), Eigen::Vector3d(3, 1, 1), ids);
+  EXPECT_FALSE(contains(ids, "ball"));
+  index.getObjectsNear(Eigen::Vector3d(5, 5, 5), 0.1, ids);
+  EXPECT_TRUE(contains(ids, "ball"));
+
+  world->removeObject("ball");
+  EXPECT_EQ(2, index.size());
+  index.getObjectsNear(Eigen::Vector3d(5, 5, 5), 0.1, ids);
+  EXPECT_FALSE(contains(ids, "ball"));
+
+  // rotated shapes are bounded by the box of their rotated extents
+  world->addToObject("rotated", box, Eigen::Affine3d(Eigen::AngleAxisd(M_PI / 2.0, Eigen::Vector3d::UnitZ())));
+  ASSERT_TRUE(index.getObjectAABB("rotated", min, max));
+  EXPECT_NEAR(-1.0, min.x(), 1e-9);
+  EXPECT_NEAR(0.5, max.y(), 1e-9);
+
+  index.reset();
+  EXPECT_EQ(0, index.size());
+  world->addToObject("ball", ball, Eigen::Affine3d::Identity());
+  EXPECT_EQ(0, index.size());
+}
+
+TEST(WorldSpatialIndex, LargeObjects)
+{
+  collision_detection::WorldPtr world(new collision_detection::World);
+  collision_detection::WorldSpatialIndex index(world, 0.1);
+
+  // spans too many cells to be stored in the grid, but must still be found
+  world->addToObject("table", shapes::ShapeConstPtr(new shapes::Box(4, 4, 0.1)), Eigen::Affine3d::Identity());
+  std::vector<std::string> ids;
+  index.getObjectsNear(Eigen::Vector3d(1.9, 1.9, 0.1), 0.1, ids);
+  EXPECT_TRUE(contains(ids, "table"));
+  index.getObjectsNear(Eigen::Vector3d(1.9, 1.9, 1.0), 0.1, ids);
+  EXPECT_FALSE(contains(ids, "table"));
+}
+
+int main(int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
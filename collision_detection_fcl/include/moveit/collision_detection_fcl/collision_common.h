@@ -42,32 +42,75 @@
 #include <fcl/broadphase/broadphase.h>
 #include <fcl/collision.h>
 #include <fcl/distance.h>
+#include <boost/thread/mutex.hpp>
 #include <set>
 
 namespace collision_detection
 {
 
+struct FCLGeometry;
+
 struct CollisionGeometryData
 {
   CollisionGeometryData(const robot_model::LinkModel *link, int index)
     : type(BodyTypes::ROBOT_LINK)
     , shape_index(index)
+    , geometry(NULL)
+    , unpruned(NULL)
   {
     ptr.link = link;
+    name_index = AllowedCollisionMatrix::acquireNameIndex(getID());
   }
 
   CollisionGeometryData(const robot_state::AttachedBody *ab, int index)
     : type(BodyTypes::ROBOT_ATTACHED)
     , shape_index(index)
+    , geometry(NULL)
+    , unpruned(NULL)
   {
     ptr.ab = ab;
+    name_index = AllowedCollisionMatrix::acquireNameIndex(getID());
   }
 
   CollisionGeometryData(const World::Object *obj, int index)
     : type(BodyTypes::WORLD_OBJECT)
     , shape_index(index)
+    , geometry(NULL)
+    , unpruned(NULL)
   {
     ptr.obj = obj;
+    name_index = AllowedCollisionMatrix::acquireNameIndex(getID());
+  }
+
+  CollisionGeometryData(const CollisionGeometryData &other)
+    : type(other.type)
+    , shape_index(other.shape_index)
+    , name_index(AllowedCollisionMatrix::acquireNameIndex(other.getID()))
+    , geometry(other.geometry)
+    , unpruned(other.unpruned)
+    , ptr(other.ptr)
+  {
+  }
+
+  ~CollisionGeometryData()
+  {
+    AllowedCollisionMatrix::releaseNameIndex(name_index);
+  }
+
+  CollisionGeometryData& operator=(const CollisionGeometryData &other)
+  {
+    if (this != &other)
+    {
+      std::size_t index = AllowedCollisionMatrix::acquireNameIndex(other.getID());
+      AllowedCollisionMatrix::releaseNameIndex(name_index);
+      type = other.type;
+      shape_index = other.shape_index;
+      name_index = index;
+      geometry = other.geometry;
+      unpruned = other.unpruned;
+      ptr = other.ptr;
+    }
+    return *this;
   }
 
   const std::string& getID() const
@@ -106,6 +149,18 @@ struct CollisionGeometryData
   
   BodyType type;
   int shape_index;
+
+  /// The index of getID(), as given by AllowedCollisionMatrix::acquireNameIndex(); the reference is released on destruction
+  std::size_t name_index;
+
+  /// The FCLGeometry that owns this data (NULL if there is none); it provides the convex hulls used by
+  /// CollisionRequest::cascade (see FCLGeometry::getHullGeometry())
+  const FCLGeometry *geometry;
+
+  /// The octree this data belongs to, without skipping the nodes known to be free; used for world objects when
+  /// CollisionRequest::cost is set. Set for octrees only (NULL otherwise) and owned by the FCLGeometry
+  const fcl::CollisionGeometry *unpruned;
+
   union
   {
     const robot_model::LinkModel    *link;
@@ -117,13 +172,17 @@ struct CollisionGeometryData
 
 struct CollisionData
 {
-  CollisionData() : req_(NULL), active_components_only_(NULL), res_(NULL), acm_(NULL), done_(false)
+  CollisionData() : req_(NULL), active_components_only_(NULL), masked_objects_(NULL), res_(NULL), acm_(NULL), distance_threshold_(0.0),
+                    distance_req_(NULL), distance_res_(NULL), done_(false)
   {
   }
 
   CollisionData(const CollisionRequest *req, CollisionResult *res,
-                const AllowedCollisionMatrix *acm) : req_(req), active_components_only_(NULL), res_(res), acm_(acm), done_(false)
+                const AllowedCollisionMatrix *acm) : req_(req), active_components_only_(NULL), masked_objects_(NULL), res_(res), acm_(acm),
+                                                     distance_threshold_(0.0), distance_req_(NULL), distance_res_(NULL), done_(false)
   {
+    if (acm_)
+      compiled_acm_ = acm_->getCompiled();
   }
 
   ~CollisionData()
@@ -133,13 +192,26 @@ struct CollisionData
   /// Compute \e active_components_only_ based on \e req_
   void enableGroup(const robot_model::RobotModelConstPtr &kmodel);
 
+  /// Check if the robot link or attached body \e cgd refers to is considered for collision (see \e active_components_only_);
+  /// attached bodies are considered if the link they are attached to is. World objects are never active components.
+  bool isActiveComponent(const CollisionGeometryData *cgd) const
+  {
+    const robot_model::LinkModel *l = cgd->type == BodyTypes::ROBOT_LINK ? cgd->ptr.link :
+      (cgd->type == BodyTypes::ROBOT_ATTACHED ? cgd->ptr.ab->getAttachedLink() : NULL);
+    return l && (!active_components_only_ || (*active_components_only_)[l->getLinkIndex()]);
+  }
+
   /// The collision request passed by the user
   const CollisionRequest       *req_;
 
-  /// If the collision request includes a group name, this set contains the pointers to the link models that are considered for collision;
-  /// If the pointer is NULL, all collisions are considered.
-  const std::set<const robot_model::LinkModel*>
-                               *active_components_only_;
+  /// If the collision request includes a group name, this is a mask indexed by link index that marks the link models that are considered
+  /// for collision (see JointModelGroup::getUpdatedLinkModelsWithGeometryMask()); If the pointer is NULL, all collisions are considered.
+  const std::vector<bool>      *active_components_only_;
+
+  /// FCL objects that are ignored by the checks (e.g., objects of a shared broad phase that are overridden by a diff world);
+  /// If the pointer is NULL, no objects are ignored.
+  const std::set<const fcl::CollisionObject*>
+                               *masked_objects_;
 
   /// The user specified response location
   CollisionResult              *res_;
@@ -147,6 +219,19 @@ struct CollisionData
   /// The user specified collision matrix (may be NULL)
   const AllowedCollisionMatrix *acm_;
 
+  /// The snapshot of \e acm_ used for answering queries by name index (set only if \e acm_ is not NULL)
+  CompiledAllowedCollisionMatrixConstPtr compiled_acm_;
+
+  /// Distance queries (see distanceCallback()) are complete as soon as a distance below this value is found;
+  /// by default only penetration completes them
+  double                        distance_threshold_;
+
+  /// For distance queries, the request that specifies which pairs of bodies are reported (may be NULL)
+  const DistanceRequest        *distance_req_;
+
+  /// For distance queries, where the pairs of bodies are reported (may be NULL)
+  DistanceResult               *distance_res_;
+
   /// Flag indicating whether collision checking is complete
   bool                          done_;
 };
@@ -154,26 +239,32 @@ struct CollisionData
 
 struct FCLGeometry
 {
-  FCLGeometry()
+  FCLGeometry() : hull_computed_(false)
   {
   }
 
   FCLGeometry(fcl::CollisionGeometry *collision_geometry, const robot_model::LinkModel *link, int shape_index) :
-    collision_geometry_(collision_geometry), collision_geometry_data_(new CollisionGeometryData(link, shape_index))
+    collision_geometry_(collision_geometry), collision_geometry_data_(new CollisionGeometryData(link, shape_index)),
+    hull_computed_(false)
   {
     collision_geometry_->setUserData(collision_geometry_data_.get());
+    collision_geometry_data_->geometry = this;
   }
 
   FCLGeometry(fcl::CollisionGeometry *collision_geometry, const robot_state::AttachedBody *ab, int shape_index) :
-    collision_geometry_(collision_geometry), collision_geometry_data_(new CollisionGeometryData(ab, shape_index))
+    collision_geometry_(collision_geometry), collision_geometry_data_(new CollisionGeometryData(ab, shape_index)),
+    hull_computed_(false)
   {
     collision_geometry_->setUserData(collision_geometry_data_.get());
+    collision_geometry_data_->geometry = this;
   }
 
   FCLGeometry(fcl::CollisionGeometry *collision_geometry, const World::Object *obj, int shape_index) :
-    collision_geometry_(collision_geometry), collision_geometry_data_(new CollisionGeometryData(obj, shape_index))
+    collision_geometry_(collision_geometry), collision_geometry_data_(new CollisionGeometryData(obj, shape_index)),
+    hull_computed_(false)
   {
     collision_geometry_->setUserData(collision_geometry_data_.get());
+    collision_geometry_data_->geometry = this;
   }
 
   template<typename T>
@@ -183,11 +274,38 @@ struct FCLGeometry
       if (collision_geometry_data_->ptr.raw == reinterpret_cast<const void*>(data))
         return;
     collision_geometry_data_.reset(new CollisionGeometryData(data, shape_index));
+    collision_geometry_data_->geometry = this;
+    collision_geometry_data_->unpruned = unpruned_geometry_.get();
     collision_geometry_->setUserData(collision_geometry_data_.get());
+    if (unpruned_geometry_)
+      unpruned_geometry_->setUserData(collision_geometry_data_.get());
+  }
+
+  /** \brief Get a convex geometry that contains \e collision_geometry_, for CollisionRequest::cascade. The hull is
+      computed by the first call, for meshes only; NULL is returned for other shapes and meshes without a hull. */
+  const fcl::CollisionGeometry* getHullGeometry() const;
+
+  /** \brief Set the unpruned version of the octree \e collision_geometry_ (see CollisionGeometryData::unpruned) */
+  void setUnprunedGeometry(fcl::CollisionGeometry *unpruned_geometry)
+  {
+    unpruned_geometry_.reset(unpruned_geometry);
+    unpruned_geometry_->setUserData(collision_geometry_data_.get());
+    collision_geometry_data_->unpruned = unpruned_geometry;
   }
 
   boost::shared_ptr<fcl::CollisionGeometry> collision_geometry_;
   boost::shared_ptr<CollisionGeometryData>  collision_geometry_data_;
+
+  /// The octree without pruning of free nodes, used by CollisionRequest::cost; empty for other shapes
+  boost::shared_ptr<fcl::CollisionGeometry> unpruned_geometry_;
+
+private:
+
+  /// The convex hull of a mesh, computed by getHullGeometry(); it is not counted in the memory of the shape cache,
+  /// as most meshes are never checked in cascade mode
+  mutable boost::shared_ptr<fcl::CollisionGeometry> hull_geometry_;
+  mutable bool                                      hull_computed_;
+  mutable boost::mutex                              hull_lock_;
 };
 
 typedef boost::shared_ptr<FCLGeometry> FCLGeometryPtr;
@@ -209,10 +327,55 @@ struct FCLManager
   boost::shared_ptr<fcl::BroadPhaseCollisionManager> manager_;
 };
 
+/** \brief Collect the objects of \e fcl_obj that refer to active components of \e cd (see CollisionData::isActiveComponent()).
+    Return false if more than \e max_count objects are active; \e active is incomplete in that case. This allows pruning the
+    objects that cannot lead to reported collisions before querying the broad phase, when that is worth it */
+bool getActiveCollisionObjects(const CollisionData &cd, const FCLObject &fcl_obj, std::size_t max_count,
+                               std::vector<fcl::CollisionObject*> &active);
+
+/** \brief The interface conservativeAdvancement() uses to step along a motion, parametrized by time in [0, 1] */
+class ContinuousMotion
+{
+public:
+  virtual ~ContinuousMotion()
+  {
+  }
+
+  /** \brief Move to time \e t along the motion and perform a discrete collision check. Return true if in collision */
+  virtual bool check(double t) = 0;
+
+  /** \brief The distance to the nearest obstacle, at the time of the last call to check() */
+  virtual double distance() = 0;
+
+  /** \brief An upper bound on how far any point of the moving geometry travels between the time of the last call to
+      check() and time \e t; this is what the distance is compared against. */
+  virtual double motionBound(double t) = 0;
+};
+
+/** \brief Check a motion for collisions using conservative advancement: starting at time 0, after every collision-free
+    discrete check the time is advanced as much as possible while keeping the motion bound below the obstacle distance.
+    Return the time of the first state found to be in collision, or a negative value if the motion is collision free.
+    If the obstacle distance is so small that the motion bound exceeds it even for the smallest step, the motion cannot be
+    shown to be collision free and that time is returned as well, without the last discrete check having found a collision. */
+double conservativeAdvancement(ContinuousMotion &motion);
+
 bool collisionCallback(fcl::CollisionObject *o1, fcl::CollisionObject *o2, void *data);
 
+/** \brief Callback for a broad phase distance traversal. The result distance is the bound below which distances are
+    computed (pairs whose bounding boxes are farther apart are skipped), and is updated to the smallest
+    distance found. The traversal ends on penetration or when a distance below CollisionData::distance_threshold_ is found.
+    If CollisionData::distance_res_ is set, the closest pairs are reported there as well, as CollisionData::distance_req_ specifies. */
 bool distanceCallback(fcl::CollisionObject* o1, fcl::CollisionObject* o2, void *data, double& min_dist);
 
+/** \brief Prepare \e cd (whose result is set) for a distance traversal that answers \e req in \e res */
+void setDistanceRequest(const DistanceRequest &req, DistanceResult &res, CollisionData &cd);
+
+/** \brief Callback for a broad phase distance traversal that computes both the contacts (as collisionCallback() does) and the
+    minimum distance (as distanceCallback() does), so that a request with CollisionRequest::distance set needs a single traversal.
+    The result distance is expected to be initialized to the maximum double value. The traversal ends when the collision part
+    is done (\e done_ is set) and penetration is found (the distance is negative). */
+bool collisionDistanceCallback(fcl::CollisionObject* o1, fcl::CollisionObject* o2, void *data, double& min_dist);
+
 FCLGeometryConstPtr createCollisionGeometry(const shapes::ShapeConstPtr &shape,
                                             const robot_model::LinkModel *link,
                                             int shape_index);
@@ -228,8 +391,51 @@ FCLGeometryConstPtr createCollisionGeometry(const shapes::ShapeConstPtr &shape,
                                             const robot_state::AttachedBody *ab, int shape_index);
 FCLGeometryConstPtr createCollisionGeometry(const shapes::ShapeConstPtr &shape, double scale, double padding,
                                             const World::Object *obj);
+
+/** \brief Drop cached geometry of shapes that no longer exist. The work done by a call is bounded: a few entries of the cache are
+    examined each time, continuing from where the previous call stopped */
 void cleanCollisionGeometryCache();
 
+/** \brief Set the memory budget (in bytes) of the cache of geometry built by createCollisionGeometry(). When the estimated size of the
+    cached geometry exceeds the budget, the least recently used geometry is dropped from the cache; it is built again if needed.
+    The budget applies separately to the geometry of links, attached bodies and world objects. */
+void setCollisionGeometryCacheBudget(std::size_t bytes);
+
+/** \brief Get the memory budget (in bytes) of the cache of geometry built by createCollisionGeometry() */
+std::size_t getCollisionGeometryCacheBudget();
+
+/** \brief Get the estimated memory (in bytes) used by the geometry in the cache of createCollisionGeometry() */
+std::size_t getCollisionGeometryCacheSize();
+
+/** \brief Options for processing meshes before the collision geometry is built from them. By default meshes are used as they are. */
+struct MeshProcessingOptions
+{
+  MeshProcessingOptions() : max_error_(0.0), convex_hull_(false), min_triangles_(0)
+  {
+  }
+
+  /// If positive, meshes are simplified by merging vertices, so that no vertex moves by more than this distance (in meters)
+  double max_error_;
+
+  /// Replace meshes by their convex hull
+  bool convex_hull_;
+
+  /// Meshes with fewer triangles than this are used as they are
+  unsigned int min_triangles_;
+
+  /// If not empty, processed meshes are also stored in this directory, and loaded from it instead of being processed again
+  /// (e.g., by another process using the same meshes)
+  std::string cache_directory_;
+};
+
+/** \brief Set the processing applied to meshes from which collision geometry is built (for links, attached bodies and world objects
+    alike). Only geometry built after this call is affected. The processed meshes are cached by the hash of their content, so meshes
+    that are ingested again (e.g., the same object added to the world repeatedly) are processed only once. */
+void setMeshProcessingOptions(const MeshProcessingOptions &options);
+
+/** \brief Get the processing applied to meshes from which collision geometry is built */
+MeshProcessingOptions getMeshProcessingOptions();
+
 inline void transform2fcl(const Eigen::Affine3d &b, fcl::Transform3f &f)
 {
   Eigen::Quaterniond q(b.rotation());
@@ -257,6 +463,19 @@ inline void fcl2contact(const fcl::Contact &fc, Contact &c)
   c.body_type_2 = cgd2->type;
 }
 
+inline void fcl2contact(const fcl::Contact &fc, FlatContact &c)
+{
+  c.pos = Eigen::Vector3d(fc.pos[0], fc.pos[1], fc.pos[2]);
+  c.normal = Eigen::Vector3d(fc.normal[0], fc.normal[1], fc.normal[2]);
+  c.depth = fc.penetration_depth;
+  const CollisionGeometryData *cgd1 = static_cast<const CollisionGeometryData*>(fc.o1->getUserData());
+  c.body_index_1 = cgd1->name_index;
+  c.body_type_1 = cgd1->type;
+  const CollisionGeometryData *cgd2 = static_cast<const CollisionGeometryData*>(fc.o2->getUserData());
+  c.body_index_2 = cgd2->name_index;
+  c.body_type_2 = cgd2->type;
+}
+
 inline void fcl2costsource(const fcl::CostSource &fcs, CostSource& cs)
 {
   cs.aabb_min[0] = fcs.aabb_min[0];
@@ -38,10 +38,18 @@
 #define MOVEIT_COLLISION_DETECTION_FCL_COLLISION_ROBOT_
 
 #include <moveit/collision_detection_fcl/collision_common.h>
+#include <moveit/collision_detection/conservative_motion_validator.h>
+#include <boost/thread/mutex.hpp>
 
 namespace collision_detection
 {
 
+  /** \brief Collision checking for a robot using FCL.
+
+      The const checking functions can be called concurrently from multiple threads, as long as the robot itself
+      (padding & scaling) is not modified at the same time. Each thread uses its own broad-phase manager, kept between
+      calls and updated incrementally, and geometry is shared through a cache that threads only read from once the
+      geometry for the robot and its attached bodies was created. */
   class CollisionRobotFCL : public CollisionRobot
   {
     friend class CollisionWorldFCL;
@@ -70,16 +78,32 @@ namespace collision_detection
 
     virtual double distanceSelf(const robot_state::RobotState &state) const;
     virtual double distanceSelf(const robot_state::RobotState &state, const AllowedCollisionMatrix &acm) const;
+    virtual void distanceSelf(const DistanceRequest &req, DistanceResult &res, const robot_state::RobotState &state) const;
+    virtual void distanceSelf(const DistanceRequest &req, DistanceResult &res, const robot_state::RobotState &state,
+                              const AllowedCollisionMatrix &acm) const;
     virtual double distanceOther(const robot_state::RobotState &state,
                                  const CollisionRobot &other_robot, const robot_state::RobotState &other_state) const;
     virtual double distanceOther(const robot_state::RobotState &state, const CollisionRobot &other_robot,
                                  const robot_state::RobotState &other_state, const AllowedCollisionMatrix &acm) const;
 
+    /** \brief Compute an upper bound on the distance travelled by any point of the collision geometry of the robot
+        (including attached bodies) when moving along the interpolated path from \e state1 to \e state2. The bound is
+        computed in joint space, as ConservativeMotionValidator::getMaximumMotion() does, so it holds for every
+        intermediate state and only the joint values of the states are used. If \e group names a group of the model,
+        only the links the group updates (and the bodies attached to them) are considered, as for the collision
+        requests with that CollisionRequest::group_name. */
+    double getMotionBound(const robot_state::RobotState &state1, const robot_state::RobotState &state2,
+                          const std::string &group = std::string()) const;
+
   protected:
 
     virtual void updatedPaddingOrScaling(const std::vector<std::string> &links);
     void constructFCLObject(const robot_state::RobotState &state, FCLObject &fcl_obj) const;
     void allocSelfCollisionBroadPhase(const robot_state::RobotState &state, FCLManager &manager) const;
+
+    /** \brief Get the broad-phase manager maintained for the calling thread, with the transforms of its objects
+        updated to match \e state. Only objects whose transforms changed since the previous call are updated. */
+    FCLManager& getSelfCollisionBroadPhase(const robot_state::RobotState &state) const;
     void getAttachedBodyObjects(const robot_state::AttachedBody *ab, std::vector<FCLGeometryConstPtr> &geoms) const;
 
     void checkSelfCollisionHelper(const CollisionRequest &req, CollisionResult &res, const robot_state::RobotState &state,
@@ -87,11 +111,106 @@ namespace collision_detection
     void checkOtherCollisionHelper(const CollisionRequest &req, CollisionResult &res, const robot_state::RobotState &state,
                                    const CollisionRobot &other_robot, const robot_state::RobotState &other_state,
                                    const AllowedCollisionMatrix *acm) const;
+    void checkSelfCollisionHelper(const CollisionRequest &req, CollisionResult &res, const robot_state::RobotState &state1,
+                                  const robot_state::RobotState &state2, const AllowedCollisionMatrix *acm) const;
+    void checkOtherCollisionHelper(const CollisionRequest &req, CollisionResult &res, const robot_state::RobotState &state1,
+                                   const robot_state::RobotState &state2, const CollisionRobot &other_robot,
+                                   const robot_state::RobotState &other_state1, const robot_state::RobotState &other_state2,
+                                   const AllowedCollisionMatrix *acm) const;
     double distanceSelfHelper(const robot_state::RobotState &state, const AllowedCollisionMatrix *acm) const;
+    void distanceSelfHelper(const DistanceRequest &req, DistanceResult &res, const robot_state::RobotState &state,
+                            const AllowedCollisionMatrix *acm) const;
     double distanceOtherHelper(const robot_state::RobotState &state, const CollisionRobot &other_robot,
                                const robot_state::RobotState &other_state, const AllowedCollisionMatrix *acm) const;
 
+    /** \brief A pair of objects (indices into FCLObject::collision_objects_) that needs to be checked for self collision */
+    struct SelfCollisionPair
+    {
+      SelfCollisionPair(std::size_t first, std::size_t second) : first_(first), second_(second), hits_(0)
+      {
+      }
+
+      /// Pairs found in collision more often are ordered first
+      bool operator<(const SelfCollisionPair &other) const
+      {
+        return hits_ > other.hits_;
+      }
+
+      std::size_t  first_;
+      std::size_t  second_;
+
+      /// The number of times this pair was found in collision; pairs that collide often are checked first
+      unsigned int hits_;
+    };
+
+    /** \brief The broad-phase data kept alive between calls, for one thread */
+    struct SelfCollisionCache
+    {
+      SelfCollisionCache() : link_objects_count_(0), geoms_version_(0), attached_version_(0),
+                             plan_geoms_version_(0), plan_attached_version_(0), plan_valid_(false), plan_usable_(false), plan_checks_(0)
+      {
+      }
+
+      /// The manager and its objects; object_.collision_geometry_[i] corresponds to object_.collision_objects_[i]
+      FCLManager                manager_;
+
+      /// The transforms last set for each of the collision objects
+      EigenSTL::vector_Affine3d transforms_;
+
+      /// The number of objects (at the start of object_.collision_objects_) that correspond to robot links
+      std::size_t               link_objects_count_;
+
+      /// The value of geoms_version_ the link objects were constructed for
+      boost::uint64_t           geoms_version_;
+
+      /// Incremented every time the objects that correspond to attached bodies are replaced
+      unsigned int              attached_version_;
+
+      /// The pairs of objects that are not always allowed to collide by the ACM the plan was computed for
+      std::vector<SelfCollisionPair>         plan_;
+
+      /// The ACM snapshot the plan was computed for
+      CompiledAllowedCollisionMatrixConstPtr plan_acm_;
+
+      /// The values of geoms_version_ and attached_version_ the plan was computed for
+      boost::uint64_t           plan_geoms_version_;
+      unsigned int              plan_attached_version_;
+
+      /// True if plan_ corresponds to the current objects
+      bool                      plan_valid_;
+
+      /// True if the ACM excludes enough pairs for the plan to be cheaper than a broad-phase traversal
+      bool                      plan_usable_;
+
+      /// The number of checks performed using the plan since it was last reordered
+      unsigned int              plan_checks_;
+    };
+
+    /** \brief Get the broad-phase data of the calling thread for this instance, constructing it on first use */
+    SelfCollisionCache& getSelfCollisionCache() const;
+
+    /** \brief Recompute the self collision plan of \e cache if the ACM of \e cd or the objects in the cache changed.
+        Return true if the plan should be used instead of the broad phase. */
+    bool updateSelfCollisionPlan(SelfCollisionCache &cache, const CollisionData &cd) const;
+
+    /** \brief Check the pairs in the self collision plan of \e cache, in order of how often they were found in collision */
+    void checkSelfCollisionPlan(SelfCollisionCache &cache, CollisionData &cd) const;
+
     std::vector<FCLGeometryConstPtr> geoms_;
+
+    /// Changed to a value unique in the process every time geoms_ changes, so that cached broad-phase data is rebuilt
+    boost::uint64_t                  geoms_version_;
+
+    /// Computes the motion bounds used for continuous collision checking
+    ConservativeMotionValidatorConstPtr motion_validator_;
+
+    /// Unique in the process; the threads find their caches by this identifier, so an instance constructed
+    /// at the address of a destroyed one never sees the caches of the destroyed instance
+    boost::uint64_t                  instance_id_;
+
+    /// The caches of all the threads that used this instance; they are owned here so they are freed with the instance
+    mutable std::vector<boost::shared_ptr<SelfCollisionCache> > self_collision_caches_;
+    mutable boost::mutex                                        self_collision_caches_lock_;
   };
 
 }
@@ -40,10 +40,16 @@
 #include <moveit/collision_detection_fcl/collision_robot_fcl.h>
 #include <fcl/broadphase/broadphase.h>
 #include <boost/scoped_ptr.hpp>
+#include <set>
 
 namespace collision_detection
 {
 
+  /** \brief Collision checking for a world using FCL.
+
+      The const checking functions can be called concurrently from multiple threads, as long as the world is not
+      modified at the same time. The broad phase of the world is only read during checks, and the robot side of
+      each check uses the broad-phase manager CollisionRobotFCL maintains for the calling thread. */
   class CollisionWorldFCL : public CollisionWorld
   {
   public:
@@ -63,6 +69,9 @@ namespace collision_detection
 
     virtual double distanceRobot(const CollisionRobot &robot, const robot_state::RobotState &state) const;
     virtual double distanceRobot(const CollisionRobot &robot, const robot_state::RobotState &state, const AllowedCollisionMatrix &acm) const;
+    virtual void distanceRobot(const DistanceRequest &req, DistanceResult &res, const CollisionRobot &robot, const robot_state::RobotState &state) const;
+    virtual void distanceRobot(const DistanceRequest &req, DistanceResult &res, const CollisionRobot &robot, const robot_state::RobotState &state,
+                               const AllowedCollisionMatrix &acm) const;
     virtual double distanceWorld(const CollisionWorld &world) const;
     virtual double distanceWorld(const CollisionWorld &world, const AllowedCollisionMatrix &acm) const;
 
@@ -72,19 +81,68 @@ namespace collision_detection
 
     void checkWorldCollisionHelper(const CollisionRequest &req, CollisionResult &res, const CollisionWorld &other_world, const AllowedCollisionMatrix *acm) const;
     void checkRobotCollisionHelper(const CollisionRequest &req, CollisionResult &res, const CollisionRobot &robot, const robot_state::RobotState &state, const AllowedCollisionMatrix *acm) const;
+    void checkRobotCollisionHelper(const CollisionRequest &req, CollisionResult &res, const CollisionRobot &robot, const robot_state::RobotState &state1,
+                                   const robot_state::RobotState &state2, const AllowedCollisionMatrix *acm) const;
     double distanceRobotHelper(const CollisionRobot &robot, const robot_state::RobotState &state, const AllowedCollisionMatrix *acm) const;
+    void distanceRobotHelper(const DistanceRequest &req, DistanceResult &res, const CollisionRobot &robot, const robot_state::RobotState &state,
+                             const AllowedCollisionMatrix *acm) const;
     double distanceWorldHelper(const CollisionWorld &world, const AllowedCollisionMatrix *acm) const;
 
     void constructFCLObject(const World::Object *obj, FCLObject &fcl_obj) const;
     void updateFCLObject(const std::string &id);
 
+    /** \brief Update the transforms of the FCL objects of \e obj in place, when only the poses of its shapes changed.
+        The updated objects are appended to \e moved, so their broad phase nodes can be refit. Returns false
+        (and changes nothing) if the FCL objects cannot be updated in place and have to be constructed again */
+    bool moveFCLObject(const World::Object *obj, std::vector<fcl::CollisionObject*> &moved);
+
+    /** \brief A broad phase collision manager together with the FCL objects registered to it, by object id */
+    struct BroadPhase
+    {
+      BroadPhase();
+
+      /** \brief Copy the FCL objects of \e other and register them to a new manager */
+      BroadPhase(const BroadPhase &other);
+
+      boost::scoped_ptr<fcl::BroadPhaseCollisionManager> manager_;
+      std::map<std::string, FCLObject>                   fcl_objs_;
+    };
+
+    /** \brief Make sure \e broad_phase_ is not shared with any other world, so it can be modified */
+    void makeBroadPhaseUnique();
+
+    /** \brief Ignore the FCL objects of \e parent_broad_phase_ that correspond to object \e id, because the object changed in this world */
+    void maskParentObject(const std::string &id);
 
-    boost::scoped_ptr<fcl::BroadPhaseCollisionManager> manager_;
-    std::map<std::string, FCLObject >                  fcl_objs_;
+    /** \brief Get the broad phase managers that make up this world (at most 2); return their count */
+    std::size_t getManagers(fcl::BroadPhaseCollisionManager *managers[2]) const;
+
+    /** \brief Get the objects to ignore when checking this world against \e other_world; \e storage
+        is used if both worlds ignore objects. NULL is returned if no objects are to be ignored */
+    const std::set<const fcl::CollisionObject*>* getMaskedObjects(const CollisionWorldFCL &other_world,
+                                                                   std::set<const fcl::CollisionObject*> &storage) const;
+
+    /** \brief The objects owned by this world. For a world constructed as a copy of another one, these are only the objects
+        that changed after the copy was made. This is shared (read only) with the worlds constructed as copies of this one
+        and copied before it is modified if that is the case. */
+    boost::shared_ptr<BroadPhase>                      broad_phase_;
+
+    /** \brief For a world constructed as a copy of another world, the broad phase of the copied world, which is queried
+        directly instead of being re-created (NULL otherwise) */
+    boost::shared_ptr<const BroadPhase>                parent_broad_phase_;
+
+    /** \brief The ids of the objects in \e parent_broad_phase_ that are overridden or removed in this world */
+    std::set<std::string>                              masked_ids_;
+
+    /** \brief The FCL objects in \e parent_broad_phase_ that correspond to \e masked_ids_ */
+    std::set<const fcl::CollisionObject*>              masked_objects_;
 
   private:
     void initialize();
     void notifyObjectChange(const ObjectConstPtr& obj, World::Action action);
+
+    /** \brief Apply the changes of a batch of world updates, registering the new FCL objects to the manager at once */
+    void notifyObjectChanges(const World::ObjectChanges &changes);
     World::ObserverHandle observer_handle_;
   };
 
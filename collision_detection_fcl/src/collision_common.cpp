@@ -35,14 +35,122 @@
 /* Author: Ioan Sucan, Jia Pan */
 
 #include <moveit/collision_detection_fcl/collision_common.h>
+#include <moveit/profiler/memory_accounting.h>
 #include <fcl/BVH/BVH_model.h>
 #include <fcl/shape/geometric_shapes.h>
 #include <fcl/octree.h>
+#include <geometric_shapes/bodies.h>
+#include <boost/filesystem.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/thread/shared_mutex.hpp>
+#include <boost/thread/locks.hpp>
 #include <boost/thread/mutex.hpp>
+#include <boost/functional/hash.hpp>
+#include <boost/unordered_map.hpp>
+#include <boost/tuple/tuple.hpp>
+#include <boost/tuple/tuple_comparison.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <deque>
+#include <list>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <sstream>
 
 namespace collision_detection
 {
 
+namespace
+{
+// the margin added to the lower clamping bound of an octree, so that nodes at that bound count as free despite
+// rounding in the conversion from log-odds
+const double OCTREE_FREE_THRESHOLD_MARGIN = 1e-6;
+
+// Octrees of world objects are built to skip the nodes known to be free (see createCollisionGeometry()). For costs,
+// those cells still count as having uncertain occupancy, so when costs are requested an octree is collided as the
+// FCL octree over the same map with the default thresholds, which is built along with the pruned one. Return the
+// geometry to collide for o.
+const fcl::CollisionGeometry* getQueryGeometry(const fcl::CollisionObject *o, const CollisionGeometryData *cd, bool cost)
+{
+  return cost && cd->unpruned && cd->type == BodyTypes::WORLD_OBJECT ? cd->unpruned : o->getCollisionGeometry();
+}
+
+// true if FCL checks the geometry as a convex solid
+bool isConvexGeometry(const fcl::CollisionGeometry *g)
+{
+  switch (g->getNodeType())
+  {
+  case fcl::GEOM_BOX:
+  case fcl::GEOM_SPHERE:
+  case fcl::GEOM_CAPSULE:
+  case fcl::GEOM_CONE:
+  case fcl::GEOM_CYLINDER:
+  case fcl::GEOM_CONVEX:
+    return true;
+  default:
+    return false;
+  }
+}
+
+// for CollisionRequest::cascade: meshes are contained in their convex hulls, so if the hulls (or a hull and a convex
+// shape) do not intersect, neither do the meshes; pairs without a mesh, or with non-convex geometry such as planes
+// and octrees, are not rejected
+bool convexHullsDisjoint(const fcl::CollisionObject *o1, const CollisionGeometryData *cd1,
+                         const fcl::CollisionObject *o2, const CollisionGeometryData *cd2)
+{
+  bool mesh1 = o1->getObjectType() == fcl::OT_BVH && cd1->geometry;
+  bool mesh2 = o2->getObjectType() == fcl::OT_BVH && cd2->geometry;
+  const fcl::CollisionGeometry *g1 = o1->getCollisionGeometry();
+  const fcl::CollisionGeometry *g2 = o2->getCollisionGeometry();
+  // the hulls are computed on first use, so the other geometry is checked first
+  if ((!mesh1 && !mesh2) || (!mesh1 && !isConvexGeometry(g1)) || (!mesh2 && !isConvexGeometry(g2)))
+    return false;
+  if (mesh1 && !(g1 = cd1->geometry->getHullGeometry()))
+    return false;
+  if (mesh2 && !(g2 = cd2->geometry->getHullGeometry()))
+    return false;
+  fcl::CollisionResult result;
+  return fcl::collide(g1, o1->getTransform(), g2, o2->getTransform(), fcl::CollisionRequest(1, false), result) == 0;
+}
+
+// when contacts are stored in a flat buffer, memory for at most this many contacts is reserved ahead of time
+const std::size_t MAX_RESERVED_CONTACTS = 256;
+
+void addFlatContact(CollisionData *cdata, const fcl::Contact &fc)
+{
+  std::vector<FlatContact> &contacts = cdata->res_->flat_contacts;
+  if (contacts.capacity() == 0)
+    contacts.reserve(std::min(cdata->req_->max_contacts, MAX_RESERVED_CONTACTS));
+  contacts.resize(contacts.size() + 1);
+  fcl2contact(fc, contacts.back());
+}
+
+// the geometry of an object is contained in the sphere of radius aabb_radius around aabb_center (in the local frame),
+// so objects whose spheres do not intersect cannot be in collision; this is cheaper than the narrow phase, and
+// rejects pairs of rotated objects whose axis-aligned bounding boxes overlap even though the objects are far apart
+bool boundingSpheresDisjoint(const fcl::CollisionObject *o1, const fcl::CollisionObject *o2)
+{
+  const fcl::CollisionGeometry *g1 = o1->getCollisionGeometry();
+  const fcl::CollisionGeometry *g2 = o2->getCollisionGeometry();
+  fcl::Vec3f d = o1->getTransform().transform(g1->aabb_center) - o2->getTransform().transform(g2->aabb_center);
+  double r = g1->aabb_radius + g2->aabb_radius;
+  // for unbounded geometry (e.g., planes) the comparison is false, so such pairs are never rejected
+  return d.sqrLength() > r * r;
+}
+
+void addCostSource(CollisionData *cdata, const CostSource &cs)
+{
+  std::set<CostSource> &sources = cdata->res_->cost_sources;
+  // do not insert sources that would be removed right away
+  if (sources.size() >= cdata->req_->max_cost_sources && (sources.empty() || !(cs < *sources.rbegin())))
+    return;
+  sources.insert(cs);
+  while (sources.size() > cdata->req_->max_cost_sources)
+    sources.erase(--sources.end());
+}
+}
+
 bool collisionCallback(fcl::CollisionObject* o1, fcl::CollisionObject* o2, void *data)
 {
   CollisionData *cdata = reinterpret_cast<CollisionData*>(data);
@@ -54,18 +162,15 @@ bool collisionCallback(fcl::CollisionObject* o1, fcl::CollisionObject* o2, void
   // do not collision check geoms part of the same object / link / attached body
   if (cd1->sameObject(*cd2))
     return false;
-  
-  // If active components are specified
-  if (cdata->active_components_only_)
-  {
-    const robot_model::LinkModel *l1 = cd1->type == BodyTypes::ROBOT_LINK ? cd1->ptr.link : (cd1->type == BodyTypes::ROBOT_ATTACHED ? cd1->ptr.ab->getAttachedLink() : NULL);
-    const robot_model::LinkModel *l2 = cd2->type == BodyTypes::ROBOT_LINK ? cd2->ptr.link : (cd2->type == BodyTypes::ROBOT_ATTACHED ? cd2->ptr.ab->getAttachedLink() : NULL);
 
-    // If neither of the involved components is active
-    if ((!l1 || cdata->active_components_only_->find(l1) == cdata->active_components_only_->end()) &&
-        (!l2 || cdata->active_components_only_->find(l2) == cdata->active_components_only_->end()))
-      return false;
-  }
+  // do not check objects that are masked out
+  if (cdata->masked_objects_ && (cdata->masked_objects_->find(o1) != cdata->masked_objects_->end() ||
+                                 cdata->masked_objects_->find(o2) != cdata->masked_objects_->end()))
+    return false;
+  
+  // If active components are specified, and neither of the involved components is active
+  if (cdata->active_components_only_ && !cdata->isActiveComponent(cd1) && !cdata->isActiveComponent(cd2))
+    return false;
 
   // use the collision matrix (if any) to avoid certain collision checks
   DecideContactFn dcf;
@@ -73,7 +178,7 @@ bool collisionCallback(fcl::CollisionObject* o1, fcl::CollisionObject* o2, void
   if (cdata->acm_)
   {
     AllowedCollision::Type type;
-    bool found = cdata->acm_->getAllowedCollision(cd1->getID(), cd2->getID(), type);
+    bool found = cdata->compiled_acm_->getAllowedCollision(cd1->name_index, cd2->name_index, type);
     if (found)
     {
       // if we have an entry in the collision matrix, we read it
@@ -90,7 +195,7 @@ bool collisionCallback(fcl::CollisionObject* o1, fcl::CollisionObject* o2, void
       else
         if (type == AllowedCollision::CONDITIONAL)
         {
-          cdata->acm_->getAllowedCollision(cd1->getID(), cd2->getID(), dcf);
+          cdata->compiled_acm_->getAllowedCollision(cd1->name_index, cd2->name_index, dcf);
           if (cdata->req_->verbose)
             logDebug("Collision between '%s' and '%s' is conditionally allowed", cd1->getID().c_str(), cd2->getID().c_str());
         }
@@ -132,6 +237,10 @@ bool collisionCallback(fcl::CollisionObject* o1, fcl::CollisionObject* o2, void
   if (always_allow_collision)
     return false;
 
+  // cheap rejection of pairs that are clearly apart, before the narrow phase
+  if (boundingSpheresDisjoint(o1, o2))
+    return false;
+
   if (cdata->req_->verbose)
     logDebug("Actually checking collisions between %s and %s", cd1->getID().c_str(), cd2->getID().c_str());
 
@@ -140,8 +249,16 @@ bool collisionCallback(fcl::CollisionObject* o1, fcl::CollisionObject* o2, void
   if (cdata->req_->contacts)
     if (cdata->res_->contact_count < cdata->req_->max_contacts)
     {
-      std::size_t have;
-      if (cd1->getID() < cd2->getID())
+      std::size_t have = 0;
+      if (cdata->req_->flat_contacts)
+      {
+        const std::vector<FlatContact> &contacts = cdata->res_->flat_contacts;
+        for (std::size_t i = 0 ; i < contacts.size() ; ++i)
+          if ((contacts[i].body_index_1 == cd1->name_index && contacts[i].body_index_2 == cd2->name_index) ||
+              (contacts[i].body_index_1 == cd2->name_index && contacts[i].body_index_2 == cd1->name_index))
+            ++have;
+      }
+      else if (cd1->getID() < cd2->getID())
       {
         std::pair<std::string, std::string> cp(cd1->getID(), cd2->getID());
         have = cdata->res_->contacts.find(cp) != cdata->res_->contacts.end() ? cdata->res_->contacts[cp].size() : 0;
@@ -155,6 +272,13 @@ bool collisionCallback(fcl::CollisionObject* o1, fcl::CollisionObject* o2, void
         want_contact_count = std::min(cdata->req_->max_contacts_per_pair - have, cdata->req_->max_contacts - cdata->res_->contact_count);
     }
 
+  // in cascade mode, pairs that involve a mesh are first checked using convex hulls
+  if (cdata->req_->cascade && convexHullsDisjoint(o1, cd1, o2, cd2))
+    return false;
+
+  const fcl::CollisionGeometry *g1 = getQueryGeometry(o1, cd1, cdata->req_->cost);
+  const fcl::CollisionGeometry *g2 = getQueryGeometry(o2, cd2, cdata->req_->cost);
+
   if (dcf)
   {
     // if we have a decider for allowed contacts, we need to look at all the contacts
@@ -162,7 +286,7 @@ bool collisionCallback(fcl::CollisionObject* o1, fcl::CollisionObject* o2, void
     std::size_t num_max_cost_sources = cdata->req_->max_cost_sources;
     bool enable_contact = true;
     fcl::CollisionResult col_result;
-    int num_contacts = fcl::collide(o1, o2, fcl::CollisionRequest(std::numeric_limits<size_t>::max(), enable_contact, num_max_cost_sources, enable_cost), col_result);
+    int num_contacts = fcl::collide(g1, o1->getTransform(), g2, o2->getTransform(), fcl::CollisionRequest(std::numeric_limits<size_t>::max(), enable_contact, num_max_cost_sources, enable_cost), col_result);
     if (num_contacts > 0)
     {
       if (cdata->req_->verbose)
@@ -181,7 +305,10 @@ bool collisionCallback(fcl::CollisionObject* o1, fcl::CollisionObject* o2, void
           if (want_contact_count > 0)
           {
             --want_contact_count;
-            cdata->res_->contacts[pc].push_back(c);
+            if (cdata->req_->flat_contacts)
+              addFlatContact(cdata, col_result.getContact(i));
+            else
+              cdata->res_->contacts[pc].push_back(c);
             cdata->res_->contact_count++;
             if (cdata->req_->verbose)
               logInform("Found unacceptable contact between '%s' and '%s'. Contact was stored.",
@@ -208,9 +335,7 @@ bool collisionCallback(fcl::CollisionObject* o1, fcl::CollisionObject* o2, void
       for (std::size_t i = 0; i < cost_sources.size(); ++i)
       {
         fcl2costsource(cost_sources[i], cs);
-        cdata->res_->cost_sources.insert(cs);
-        while (cdata->res_->cost_sources.size() > cdata->req_->max_cost_sources)
-          cdata->res_->cost_sources.erase(--cdata->res_->cost_sources.end());
+        addCostSource(cdata, cs);
       }
     }
   }
@@ -224,7 +349,7 @@ bool collisionCallback(fcl::CollisionObject* o1, fcl::CollisionObject* o2, void
       bool enable_contact = true;
 
       fcl::CollisionResult col_result;
-      int num_contacts = fcl::collide(o1, o2, fcl::CollisionRequest(want_contact_count, enable_contact, num_max_cost_sources, enable_cost), col_result);
+      int num_contacts = fcl::collide(g1, o1->getTransform(), g2, o2->getTransform(), fcl::CollisionRequest(want_contact_count, enable_contact, num_max_cost_sources, enable_cost), col_result);
       if (num_contacts > 0)
       {
         int num_contacts_initial = num_contacts;
@@ -245,16 +370,22 @@ bool collisionCallback(fcl::CollisionObject* o1, fcl::CollisionObject* o2, void
                     cd2->getID().c_str(), cd2->getTypeString().c_str(),
                     num_contacts);
 
-        const std::pair<std::string, std::string> &pc = cd1->getID() < cd2->getID() ?
-          std::make_pair(cd1->getID(), cd2->getID()) : std::make_pair(cd2->getID(), cd1->getID());
         cdata->res_->collision = true;
-        for (int i = 0 ; i < num_contacts ; ++i)
+        if (cdata->req_->flat_contacts)
+          for (int i = 0 ; i < num_contacts ; ++i)
+            addFlatContact(cdata, col_result.getContact(i));
+        else
         {
-          Contact c;
-          fcl2contact(col_result.getContact(i), c);
-          cdata->res_->contacts[pc].push_back(c);
-          cdata->res_->contact_count++;
+          const std::pair<std::string, std::string> &pc = cd1->getID() < cd2->getID() ?
+            std::make_pair(cd1->getID(), cd2->getID()) : std::make_pair(cd2->getID(), cd1->getID());
+          for (int i = 0 ; i < num_contacts ; ++i)
+          {
+            Contact c;
+            fcl2contact(col_result.getContact(i), c);
+            cdata->res_->contacts[pc].push_back(c);
+          }
         }
+        cdata->res_->contact_count += num_contacts;
       }
 
       if (enable_cost)
@@ -266,9 +397,7 @@ bool collisionCallback(fcl::CollisionObject* o1, fcl::CollisionObject* o2, void
         for (std::size_t i = 0; i < cost_sources.size(); ++i)
         {
           fcl2costsource(cost_sources[i], cs);
-          cdata->res_->cost_sources.insert(cs);
-          while (cdata->res_->cost_sources.size() > cdata->req_->max_cost_sources)
-            cdata->res_->cost_sources.erase(--cdata->res_->cost_sources.end());
+          addCostSource(cdata, cs);
         }
       }
     }
@@ -278,7 +407,7 @@ bool collisionCallback(fcl::CollisionObject* o1, fcl::CollisionObject* o2, void
       std::size_t num_max_cost_sources = cdata->req_->max_cost_sources;
       bool enable_contact = false;
       fcl::CollisionResult col_result;
-      int num_contacts = fcl::collide(o1, o2, fcl::CollisionRequest(1, enable_contact, num_max_cost_sources, enable_cost), col_result);
+      int num_contacts = fcl::collide(g1, o1->getTransform(), g2, o2->getTransform(), fcl::CollisionRequest(1, enable_contact, num_max_cost_sources, enable_cost), col_result);
       if (num_contacts > 0)
       {
         cdata->res_->collision = true;
@@ -296,9 +425,7 @@ bool collisionCallback(fcl::CollisionObject* o1, fcl::CollisionObject* o2, void
         for (std::size_t i = 0; i < cost_sources.size(); ++i)
         {
           fcl2costsource(cost_sources[i], cs);
-          cdata->res_->cost_sources.insert(cs);
-          while (cdata->res_->cost_sources.size() > cdata->req_->max_cost_sources)
-            cdata->res_->cost_sources.erase(--cdata->res_->cost_sources.end());
+          addCostSource(cdata, cs);
         }
       }
     }
@@ -326,37 +453,214 @@ bool collisionCallback(fcl::CollisionObject* o1, fcl::CollisionObject* o2, void
   return cdata->done_;
 }
 
+/* The cache is split in shards, selected by the address of the shape, each with its own lock. Lookups of geometry
+   that already refers to the requested data (by far the most common case) only take a shared lock, so threads
+   that check for collisions in parallel do not wait for each other.
+
+   Entries are found by the address of their shape in a hash map, and are also linked in the order of their use,
+   so that the least recently used geometry can be dropped in constant time when the estimated size of the cached
+   geometry exceeds the memory budget. Entries of shapes that no longer exist are dropped when they are found, or by
+   a sweep that examines a few entries at a time, continuing where it last stopped, so the map is never scanned. */
 struct FCLShapeCache
 {
-  FCLShapeCache() : clean_count_(0) {}
+  struct Entry
+  {
+    boost::weak_ptr<const shapes::Shape> shape_;
+    FCLGeometryConstPtr geometry_;
+    std::size_t size_;
+    std::list<const shapes::Shape*>::iterator use_;
+  };
 
-  void bumpUseCount(bool force = false)
+  typedef boost::unordered_map<const shapes::Shape*, Entry> EntryMap;
+
+  struct Shard
   {
-    clean_count_++;
+    Shard() : size_(0), budget_(DEFAULT_BUDGET / SHARD_COUNT)
+    {
+      sweep_ = use_order_.end();
+    }
+
+    // the lock must be held (shared or unique). Entries of expired shapes are not returned; a live shape
+    // at the address of the entry is necessarily the shape the entry was built for
+    Entry* find(const shapes::Shape *shape)
+    {
+      EntryMap::iterator it = map_.find(shape);
+      return it != map_.end() && !it->second.shape_.expired() ? &it->second : NULL;
+    }
+
+    // mark an entry as the most recently used one; the shared lock is sufficient
+    void touch(Entry &entry)
+    {
+      boost::mutex::scoped_lock slock(use_lock_);
+      use_order_.splice(use_order_.begin(), use_order_, entry.use_);
+    }
+
+    // the unique lock must be held
+    void insert(const shapes::ShapeConstPtr &shape, const FCLGeometryConstPtr &geometry, std::size_t size)
+    {
+      EntryMap::iterator it = map_.find(shape.get());
+      if (it != map_.end())
+        erase(it);
+      Entry &entry = map_[shape.get()];
+      entry.shape_ = shape;
+      entry.geometry_ = geometry;
+      entry.size_ = size;
+      use_order_.push_front(shape.get());
+      entry.use_ = use_order_.begin();
+      size_ += size;
+      moveit::tools::MemoryAccounting::Add(moveit::tools::MemoryAccounting::COLLISION_GEOMETRY_CACHE, size);
+
+      removeExpired(EXPIRE_COUNT_PER_INSERT);
+      enforceBudget();
+    }
+
+    // remove the entry of a shape and return its geometry, if the geometry is not used anywhere else;
+    // the unique lock must be held
+    FCLGeometryConstPtr take(const shapes::Shape *shape, std::size_t &size)
+    {
+      EntryMap::iterator it = map_.find(shape);
+      if (it == map_.end() || it->second.shape_.expired() || !it->second.geometry_.unique())
+        return FCLGeometryConstPtr();
+      FCLGeometryConstPtr geometry = it->second.geometry_;
+      size = it->second.size_;
+      erase(it);
+      return geometry;
+    }
 
-    // clean-up for cache (we don't want to keep infinitely large number of weak ptrs stored)
-    if (clean_count_ > MAX_CLEAN_COUNT || force)
+    // examine up to \e count entries, continuing from where the previous call stopped, and drop the ones
+    // of expired shapes; the unique lock must be held
+    void removeExpired(std::size_t count)
     {
-      clean_count_ = 0;
-      unsigned int from = map_.size();
-      for (std::map<boost::weak_ptr<const shapes::Shape>, FCLGeometryConstPtr>::iterator it = map_.begin() ; it != map_.end() ; )
+      for (std::size_t i = 0 ; i < count && i < map_.size() ; ++i)
       {
-        std::map<boost::weak_ptr<const shapes::Shape>, FCLGeometryConstPtr>::iterator nit = it; ++nit;
-        if (it->first.expired())
-          map_.erase(it);
-        it = nit;
+        if (sweep_ == use_order_.end())
+          sweep_ = use_order_.begin();
+        EntryMap::iterator it = map_.find(*sweep_);
+        ++sweep_;
+        if (it->second.shape_.expired())
+          erase(it);
       }
-      //      logDebug("Cleaning up cache for FCL objects that correspond to static shapes. Cache size reduced from %u to %u", from, (unsigned int)map_.size());
     }
+
+    // drop the least recently used entries until the shard is within its budget; the most recently used
+    // entry is always kept. The unique lock must be held
+    void enforceBudget()
+    {
+      while (size_ > budget_ && map_.size() > 1)
+        erase(map_.find(use_order_.back()));
+    }
+
+    void erase(EntryMap::iterator it)
+    {
+      if (sweep_ == it->second.use_)
+        ++sweep_;
+      use_order_.erase(it->second.use_);
+      size_ -= it->second.size_;
+      moveit::tools::MemoryAccounting::Release(moveit::tools::MemoryAccounting::COLLISION_GEOMETRY_CACHE, it->second.size_);
+      map_.erase(it);
+    }
+
+    EntryMap map_;
+    std::list<const shapes::Shape*> use_order_;
+    std::list<const shapes::Shape*>::iterator sweep_;
+    std::size_t size_;
+    std::size_t budget_;
+    boost::shared_mutex lock_;
+    boost::mutex use_lock_;
+  };
+
+  FCLShapeCache() : budget_(DEFAULT_BUDGET)
+  {
   }
 
-  static const unsigned int MAX_CLEAN_COUNT = 100; // every this many uses of the cache, a cleaning operation is executed (this is only removal of expired entries)
-  std::map<boost::weak_ptr<const shapes::Shape>, FCLGeometryConstPtr> map_;
-  unsigned int clean_count_;
-  boost::mutex lock_;
+  Shard& getShard(const shapes::Shape *shape)
+  {
+    // the low bits of the address are the same for all shapes, due to alignment
+    return shards_[(reinterpret_cast<std::size_t>(shape) >> 4) % SHARD_COUNT];
+  }
+
+  void clean()
+  {
+    for (std::size_t i = 0 ; i < SHARD_COUNT ; ++i)
+    {
+      boost::unique_lock<boost::shared_mutex> ulock(shards_[i].lock_);
+      shards_[i].removeExpired(EXPIRE_COUNT_PER_CLEAN);
+    }
+  }
+
+  void setBudget(std::size_t budget)
+  {
+    budget_ = budget;
+    for (std::size_t i = 0 ; i < SHARD_COUNT ; ++i)
+    {
+      boost::unique_lock<boost::shared_mutex> ulock(shards_[i].lock_);
+      shards_[i].budget_ = budget / SHARD_COUNT;
+      shards_[i].enforceBudget();
+    }
+  }
+
+  std::size_t getSize()
+  {
+    std::size_t size = 0;
+    for (std::size_t i = 0 ; i < SHARD_COUNT ; ++i)
+    {
+      boost::shared_lock<boost::shared_mutex> slock(shards_[i].lock_);
+      size += shards_[i].size_;
+    }
+    return size;
+  }
+
+  static const std::size_t DEFAULT_BUDGET = 512 * 1024 * 1024; // bytes, for each combination of bounding volume and data type
+  static const std::size_t EXPIRE_COUNT_PER_INSERT = 2; // entries examined for expiry when an entry is added
+  static const std::size_t EXPIRE_COUNT_PER_CLEAN = 16; // entries of each shard examined for expiry by clean()
+  static const std::size_t SHARD_COUNT = 16;
+  Shard shards_[SHARD_COUNT];
+  std::size_t budget_;
 };
 
 
+namespace
+{
+bool isRobotBody(const CollisionGeometryData *cd)
+{
+  return cd->type == BodyTypes::ROBOT_LINK || cd->type == BodyTypes::ROBOT_ATTACHED;
+}
+
+// the distance below which a pair of bodies would change the per link distances of a query
+double linkDistanceBound(const CollisionData *cdata, const CollisionGeometryData *cd)
+{
+  if (!isRobotBody(cd))
+    return -std::numeric_limits<double>::infinity();
+  std::map<std::string, DistanceResultsData>::const_iterator it = cdata->distance_res_->link_distances.find(cd->getID());
+  return it == cdata->distance_res_->link_distances.end() ? cdata->distance_req_->max_distance : it->second.distance;
+}
+
+void setDistanceData(DistanceResultsData &data, double d, const CollisionGeometryData *cd1, const CollisionGeometryData *cd2,
+                     const fcl::DistanceResult &dist_result, bool nearest_points, bool swap)
+{
+  int i1 = swap ? 1 : 0;
+  int i2 = swap ? 0 : 1;
+  data.distance = d;
+  data.body_names[i1] = cd1->getID();
+  data.body_types[i1] = cd1->type;
+  data.body_names[i2] = cd2->getID();
+  data.body_types[i2] = cd2->type;
+  if (nearest_points)
+  {
+    // FCL reports the nearest points of the pair in the frame the objects are placed in, which is the model frame
+    for (int k = 0 ; k < 3 ; ++k)
+    {
+      data.nearest_points[i1][k] = dist_result.nearest_points[0][k];
+      data.nearest_points[i2][k] = dist_result.nearest_points[1][k];
+    }
+    if (d > 0.0)
+      data.normal = (data.nearest_points[1] - data.nearest_points[0]) / d;
+    else
+      data.normal.setZero();
+  }
+}
+}
+
 bool distanceCallback(fcl::CollisionObject* o1, fcl::CollisionObject* o2, void* data, double& min_dist)
 {
   CollisionData* cdata = reinterpret_cast<CollisionData*>(data);
@@ -364,19 +668,19 @@ bool distanceCallback(fcl::CollisionObject* o1, fcl::CollisionObject* o2, void*
   const CollisionGeometryData* cd1 = static_cast<const CollisionGeometryData*>(o1->getCollisionGeometry()->getUserData());
   const CollisionGeometryData* cd2 = static_cast<const CollisionGeometryData*>(o2->getCollisionGeometry()->getUserData());
 
-  // If active components are specified
-  if (cdata->active_components_only_)
+  // do not check objects that are masked out
+  if (cdata->masked_objects_ && (cdata->masked_objects_->find(o1) != cdata->masked_objects_->end() ||
+                                 cdata->masked_objects_->find(o2) != cdata->masked_objects_->end()))
   {
-    const robot_model::LinkModel *l1 = cd1->type == BodyTypes::ROBOT_LINK ? cd1->ptr.link : (cd1->type == BodyTypes::ROBOT_ATTACHED ? cd1->ptr.ab->getAttachedLink() : NULL);
-    const robot_model::LinkModel *l2 = cd2->type == BodyTypes::ROBOT_LINK ? cd2->ptr.link : (cd2->type == BodyTypes::ROBOT_ATTACHED ? cd2->ptr.ab->getAttachedLink() : NULL);
+    min_dist = cdata->res_->distance;
+    return cdata->done_;
+  }
 
-    // If neither of the involved components is active
-    if ((!l1 || cdata->active_components_only_->find(l1) == cdata->active_components_only_->end()) &&
-        (!l2 || cdata->active_components_only_->find(l2) == cdata->active_components_only_->end()))
-    {
-      min_dist = cdata->res_->distance;
-      return cdata->done_;
-    }
+  // If active components are specified, and neither of the involved components is active
+  if (cdata->active_components_only_ && !cdata->isActiveComponent(cd1) && !cdata->isActiveComponent(cd2))
+  {
+    min_dist = cdata->res_->distance;
+    return cdata->done_;
   }
 
   // use the collision matrix (if any) to avoid certain distance checks
@@ -385,7 +689,7 @@ bool distanceCallback(fcl::CollisionObject* o1, fcl::CollisionObject* o2, void*
   {
     AllowedCollision::Type type;
 
-    bool found = cdata->acm_->getAllowedCollision(cd1->getID(), cd2->getID(), type);
+    bool found = cdata->compiled_acm_->getAllowedCollision(cd1->name_index, cd2->name_index, type);
     if (found)
     {
       // if we have an entry in the collision matrix, we read it
@@ -432,22 +736,57 @@ bool distanceCallback(fcl::CollisionObject* o1, fcl::CollisionObject* o2, void*
     return cdata->done_;
   }
 
+  // pairs whose bounding boxes are farther apart than the distance found so far cannot reduce it; when per link
+  // distances are computed, res_->distance stays at the maximum distance and the bound depends on the pair
+  bool link_distances = cdata->distance_req_ && cdata->distance_req_->compute_link_distances;
+  double bound = link_distances ? std::max(linkDistanceBound(cdata, cd1), linkDistanceBound(cdata, cd2)) : cdata->res_->distance;
+  if (o1->getAABB().distance(o2->getAABB()) > bound)
+  {
+    min_dist = cdata->res_->distance;
+    return cdata->done_;
+  }
+
   if (cdata->req_->verbose)
     logDebug("Actually checking collisions between %s and %s", cd1->getID().c_str(), cd2->getID().c_str());
 
+  bool nearest_points = cdata->distance_req_ && cdata->distance_req_->enable_nearest_points;
   fcl::DistanceResult dist_result;
-  dist_result.update(cdata->res_->distance, NULL, NULL, fcl::DistanceResult::NONE, fcl::DistanceResult::NONE); // can be faster
-  double d = fcl::distance(o1, o2, fcl::DistanceRequest(), dist_result);
+  dist_result.update(bound, NULL, NULL, fcl::DistanceResult::NONE, fcl::DistanceResult::NONE); // can be faster
+  double d = fcl::distance(o1, o2, fcl::DistanceRequest(nearest_points), dist_result);
 
   if(d < 0)
   {
     cdata->done_ = true;
     cdata->res_->distance = -1;
+    if (cdata->distance_res_)
+    {
+      cdata->distance_res_->distance = -1;
+      setDistanceData(cdata->distance_res_->minimum_distance, -1, cd1, cd2, dist_result, false, false);
+    }
   }
   else
   {
-    if(cdata->res_->distance > d)
+    if (!link_distances && cdata->res_->distance > d)
       cdata->res_->distance = d;
+    if (d < cdata->distance_threshold_)
+      cdata->done_ = true;
+
+    if (cdata->distance_res_)
+    {
+      if (cdata->distance_res_->distance > d)
+      {
+        cdata->distance_res_->distance = d;
+        setDistanceData(cdata->distance_res_->minimum_distance, d, cd1, cd2, dist_result, nearest_points, false);
+      }
+      if (link_distances)
+      {
+        // the robot body is the first one of each reported pair
+        if (isRobotBody(cd1) && d < linkDistanceBound(cdata, cd1))
+          setDistanceData(cdata->distance_res_->link_distances[cd1->getID()], d, cd1, cd2, dist_result, nearest_points, false);
+        if (isRobotBody(cd2) && d < linkDistanceBound(cdata, cd2))
+          setDistanceData(cdata->distance_res_->link_distances[cd2->getID()], d, cd2, cd1, dist_result, nearest_points, true);
+      }
+    }
   }
 
   min_dist = cdata->res_->distance;
@@ -455,6 +794,44 @@ bool distanceCallback(fcl::CollisionObject* o1, fcl::CollisionObject* o2, void*
   return cdata->done_;
 }
 
+void setDistanceRequest(const DistanceRequest &req, DistanceResult &res, CollisionData &cd)
+{
+  res.clear();
+  res.distance = req.max_distance;
+  cd.res_->distance = req.max_distance;
+  if (req.stop_below_max_distance && !req.compute_link_distances)
+    cd.distance_threshold_ = req.max_distance;
+  cd.distance_req_ = &req;
+  cd.distance_res_ = &res;
+}
+
+bool collisionDistanceCallback(fcl::CollisionObject* o1, fcl::CollisionObject* o2, void *data, double& min_dist)
+{
+  CollisionData *cdata = reinterpret_cast<CollisionData*>(data);
+
+  // compute contacts until the collision part of the query is complete
+  if (!cdata->done_)
+    collisionCallback(o1, o2, data);
+  bool collision_done = cdata->done_;
+
+  // compute distances until penetration is found; as for separate distance queries, all links are
+  // considered (not only the ones of the requested group) and done_ is used to signal penetration
+  if (cdata->res_->distance >= 0.0)
+  {
+    const std::vector<bool> *active_components_only = cdata->active_components_only_;
+    cdata->active_components_only_ = NULL;
+    cdata->done_ = false;
+    distanceCallback(o1, o2, data, min_dist);
+    cdata->active_components_only_ = active_components_only;
+    cdata->done_ = collision_done;
+  }
+
+  // while contacts are still needed, keep the traversal visiting pairs with overlapping bounding boxes,
+  // even if the distance is already known to be 0 or negative
+  min_dist = collision_done ? cdata->res_->distance : std::max(cdata->res_->distance, std::numeric_limits<double>::epsilon());
+  return collision_done && cdata->res_->distance < 0.0;
+}
+
 /* We template the function so we get a different cache for each of the template arguments combinations */
 template<typename BV, typename T>
 FCLShapeCache& GetShapeCache()
@@ -463,6 +840,374 @@ FCLShapeCache& GetShapeCache()
   return cache;
 }
 
+namespace
+{
+// at most this many processed meshes are kept in the cache
+const std::size_t MAX_PROCESSED_MESHES = 128;
+
+struct VertexCluster
+{
+  VertexCluster() : sum_(0.0, 0.0, 0.0), count_(0), index_(0)
+  {
+  }
+  Eigen::Vector3d sum_;
+  unsigned int count_;
+  unsigned int index_;
+};
+
+struct ClusterHash
+{
+  std::size_t operator()(const boost::tuple<int, int, int> &c) const
+  {
+    std::size_t seed = 0;
+    boost::hash_combine(seed, c.get<0>());
+    boost::hash_combine(seed, c.get<1>());
+    boost::hash_combine(seed, c.get<2>());
+    return seed;
+  }
+};
+
+// simplify a mesh by clustering its vertices in a grid: the vertices in a cell are replaced by their mean, which is
+// within the diagonal of the cell, and the triangles that become degenerate are removed
+shapes::Mesh* clusterVertices(const shapes::Mesh &mesh, double max_error)
+{
+  const double cell = max_error / std::sqrt(3.0);
+  boost::unordered_map<boost::tuple<int, int, int>, VertexCluster, ClusterHash> clusters;
+  std::vector<VertexCluster*> vertex_cluster(mesh.vertex_count);
+  for (unsigned int i = 0 ; i < mesh.vertex_count ; ++i)
+  {
+    const Eigen::Vector3d v(mesh.vertices[3 * i], mesh.vertices[3 * i + 1], mesh.vertices[3 * i + 2]);
+    VertexCluster &c = clusters[boost::make_tuple((int)std::floor(v.x() / cell), (int)std::floor(v.y() / cell), (int)std::floor(v.z() / cell))];
+    c.sum_ += v;
+    c.count_++;
+    vertex_cluster[i] = &c;
+  }
+
+  std::vector<unsigned int> triangles;
+  std::set<boost::tuple<unsigned int, unsigned int, unsigned int> > seen;
+  unsigned int index = 0;
+  for (boost::unordered_map<boost::tuple<int, int, int>, VertexCluster, ClusterHash>::iterator it = clusters.begin() ; it != clusters.end() ; ++it)
+    it->second.index_ = index++;
+  for (unsigned int i = 0 ; i < mesh.triangle_count ; ++i)
+  {
+    unsigned int t[3];
+    for (int j = 0 ; j < 3 ; ++j)
+      t[j] = vertex_cluster[mesh.triangles[3 * i + j]]->index_;
+    if (t[0] == t[1] || t[1] == t[2] || t[0] == t[2])
+      continue;
+    unsigned int s[3] = { t[0], t[1], t[2] };
+    std::sort(s, s + 3);
+    if (!seen.insert(boost::make_tuple(s[0], s[1], s[2])).second)
+      continue;
+    triangles.insert(triangles.end(), t, t + 3);
+  }
+
+  shapes::Mesh *result = new shapes::Mesh(clusters.size(), triangles.size() / 3);
+  for (boost::unordered_map<boost::tuple<int, int, int>, VertexCluster, ClusterHash>::const_iterator it = clusters.begin() ; it != clusters.end() ; ++it)
+  {
+    const Eigen::Vector3d v = it->second.sum_ / (double)it->second.count_;
+    for (int j = 0 ; j < 3 ; ++j)
+      result->vertices[3 * it->second.index_ + j] = v[j];
+  }
+  std::copy(triangles.begin(), triangles.end(), result->triangles);
+  result->computeTriangleNormals();
+  return result;
+}
+
+// returns NULL if the hull cannot be computed
+shapes::Mesh* computeConvexHull(const shapes::Mesh &mesh)
+{
+  bodies::ConvexMesh hull(&mesh);
+  const EigenSTL::vector_Vector3d &vertices = hull.getVertices();
+  const std::vector<unsigned int> &triangles = hull.getTriangles();
+  if (vertices.empty() || triangles.empty())
+    return NULL;
+
+  shapes::Mesh *result = new shapes::Mesh(vertices.size(), triangles.size() / 3);
+  for (std::size_t i = 0 ; i < vertices.size() ; ++i)
+    for (int j = 0 ; j < 3 ; ++j)
+      result->vertices[3 * i + j] = vertices[i][j];
+  std::copy(triangles.begin(), triangles.begin() + 3 * result->triangle_count, result->triangles);
+  result->computeTriangleNormals();
+  return result;
+}
+
+// the arrays a fcl::Convex refers to; fcl::Convex does not copy or free them
+struct ConvexHullData
+{
+  ConvexHullData(const shapes::Mesh &hull) : points_(hull.vertex_count), normals_(hull.triangle_count),
+                                             distances_(hull.triangle_count), polygons_(4 * hull.triangle_count)
+  {
+    for (unsigned int i = 0 ; i < hull.vertex_count ; ++i)
+      points_[i] = fcl::Vec3f(hull.vertices[3 * i], hull.vertices[3 * i + 1], hull.vertices[3 * i + 2]);
+    fcl::Vec3f center;
+    for (unsigned int i = 0 ; i < hull.vertex_count ; ++i)
+      center += points_[i];
+    center *= 1.0 / (double)hull.vertex_count;
+    for (unsigned int i = 0 ; i < hull.triangle_count ; ++i)
+    {
+      const unsigned int *t = hull.triangles + 3 * i;
+      fcl::Vec3f n = (points_[t[1]] - points_[t[0]]).cross(points_[t[2]] - points_[t[0]]);
+      n.normalize();
+      // the planes face away from the inside of the hull
+      if (n.dot(points_[t[0]] - center) < 0.0)
+        n = -n;
+      normals_[i] = n;
+      distances_[i] = n.dot(points_[t[0]]);
+      polygons_[4 * i] = 3;
+      for (int j = 0 ; j < 3 ; ++j)
+        polygons_[4 * i + j + 1] = t[j];
+    }
+  }
+
+  std::vector<fcl::Vec3f> points_;
+  std::vector<fcl::Vec3f> normals_;
+  std::vector<fcl::FCL_REAL> distances_;
+  std::vector<int> polygons_;
+};
+
+// a convex hull that owns its arrays; the data is constructed before the fcl::Convex that refers to it
+class ConvexHullGeometry : private ConvexHullData, public fcl::Convex
+{
+public:
+
+  ConvexHullGeometry(const shapes::Mesh &hull) :
+    ConvexHullData(hull),
+    fcl::Convex(&normals_[0], &distances_[0], normals_.size(), &points_[0], points_.size(), &polygons_[0])
+  {
+  }
+};
+
+// the convex hull of a mesh, for CollisionRequest::cascade; returns NULL if the hull cannot be computed
+ConvexHullGeometry* createConvexHullGeometry(const shapes::Mesh &mesh)
+{
+  boost::scoped_ptr<shapes::Mesh> hull(computeConvexHull(mesh));
+  if (!hull || hull->vertex_count < 4 || hull->triangle_count < 4)
+    return NULL;
+  ConvexHullGeometry *g = new ConvexHullGeometry(*hull);
+  g->computeLocalAABB();
+  return g;
+}
+
+/* Processed meshes, by the hash of the content of the mesh they were computed from (with the sizes of the mesh, to make
+   collisions even less likely) and the options used. Meshes are usually recreated from the same data (e.g., when the same
+   collision object is sent again), so the cache cannot be keyed by the address of the shapes. */
+struct ProcessedMeshCache
+{
+  typedef boost::tuple<std::size_t, unsigned int, unsigned int> Key;
+
+  boost::mutex lock_;
+  MeshProcessingOptions options_;
+  std::map<Key, shapes::ShapeConstPtr> meshes_;
+  std::deque<Key> order_;
+};
+
+ProcessedMeshCache& getProcessedMeshCache()
+{
+  static ProcessedMeshCache cache;
+  return cache;
+}
+
+// apply the processing selected by \e options to a mesh
+shapes::ShapeConstPtr applyMeshProcessing(const shapes::ShapeConstPtr &shape, const MeshProcessingOptions &options)
+{
+  const shapes::Mesh *mesh = static_cast<const shapes::Mesh*>(shape.get());
+  shapes::ShapeConstPtr result = shape;
+  if (options.max_error_ > 0.0)
+  {
+    shapes::Mesh *simplified = clusterVertices(*mesh, options.max_error_);
+    // meshes smaller than the error would vanish
+    if (simplified->triangle_count > 0)
+      result.reset(simplified);
+    else
+      delete simplified;
+  }
+  if (options.convex_hull_)
+  {
+    shapes::Mesh *hull = computeConvexHull(*static_cast<const shapes::Mesh*>(result.get()));
+    if (hull)
+      result.reset(hull);
+    else
+      logWarn("Unable to compute the convex hull of a mesh with %u triangles. Using the mesh instead.", mesh->triangle_count);
+  }
+  logDebug("Mesh with %u triangles processed for collision checking: %u triangles remain",
+           mesh->triangle_count, static_cast<const shapes::Mesh*>(result.get())->triangle_count);
+
+  return result;
+}
+
+// identifies the files of processed meshes and the version of their format
+const char PROCESSED_MESH_MAGIC[] = "MIMESH";
+const boost::uint32_t PROCESSED_MESH_VERSION = 1;
+const boost::uint32_t PROCESSED_MESH_BYTE_ORDER = 0x01020304;
+
+std::string getProcessedMeshFile(const std::string &directory, const ProcessedMeshCache::Key &key)
+{
+  std::stringstream name;
+  name << std::hex << key.get<0>() << std::dec << "_" << key.get<1>() << "_" << key.get<2>() << ".mesh";
+  return (boost::filesystem::path(directory) / name.str()).string();
+}
+
+// returns NULL if the file does not exist or is not valid
+shapes::Mesh* loadProcessedMesh(const std::string &file)
+{
+  std::ifstream in(file.c_str(), std::ios::in | std::ios::binary);
+  if (!in.good())
+    return NULL;
+  char magic[sizeof(PROCESSED_MESH_MAGIC)];
+  boost::uint32_t header[4];
+  if (!in.read(magic, sizeof(magic)) || std::memcmp(magic, PROCESSED_MESH_MAGIC, sizeof(magic)) != 0 ||
+      !in.read(reinterpret_cast<char*>(header), sizeof(header)) ||
+      header[0] != PROCESSED_MESH_VERSION || header[1] != PROCESSED_MESH_BYTE_ORDER)
+  {
+    logWarn("Ignoring invalid processed mesh file '%s'", file.c_str());
+    return NULL;
+  }
+
+  std::auto_ptr<shapes::Mesh> mesh(new shapes::Mesh(header[2], header[3]));
+  if (!in.read(reinterpret_cast<char*>(mesh->vertices), 3 * header[2] * sizeof(double)) ||
+      !in.read(reinterpret_cast<char*>(mesh->triangles), 3 * header[3] * sizeof(unsigned int)))
+  {
+    logWarn("Ignoring truncated processed mesh file '%s'", file.c_str());
+    return NULL;
+  }
+  for (unsigned int i = 0 ; i < 3 * mesh->triangle_count ; ++i)
+    if (mesh->triangles[i] >= mesh->vertex_count)
+    {
+      logWarn("Ignoring invalid processed mesh file '%s'", file.c_str());
+      return NULL;
+    }
+  mesh->computeTriangleNormals();
+  return mesh.release();
+}
+
+void saveProcessedMesh(const std::string &file, const shapes::Mesh &mesh)
+{
+  // the mesh is written to a temporary file first, so other processes never read a partially written file
+  boost::filesystem::path path(file);
+  boost::filesystem::path tmp = path.parent_path() / boost::filesystem::unique_path("%%%%-%%%%-%%%%.tmp");
+  try
+  {
+    boost::filesystem::create_directories(path.parent_path());
+    {
+      std::ofstream out(tmp.string().c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+      boost::uint32_t header[4] = { PROCESSED_MESH_VERSION, PROCESSED_MESH_BYTE_ORDER, mesh.vertex_count, mesh.triangle_count };
+      out.write(PROCESSED_MESH_MAGIC, sizeof(PROCESSED_MESH_MAGIC));
+      out.write(reinterpret_cast<const char*>(header), sizeof(header));
+      out.write(reinterpret_cast<const char*>(mesh.vertices), 3 * mesh.vertex_count * sizeof(double));
+      out.write(reinterpret_cast<const char*>(mesh.triangles), 3 * mesh.triangle_count * sizeof(unsigned int));
+      if (!out.good())
+      {
+        out.close();
+        boost::filesystem::remove(tmp);
+        logWarn("Unable to write processed mesh file '%s'", file.c_str());
+        return;
+      }
+    }
+    boost::filesystem::rename(tmp, path);
+  }
+  catch (boost::filesystem::filesystem_error &ex)
+  {
+    logWarn("Unable to store processed mesh in '%s': %s", file.c_str(), ex.what());
+    boost::system::error_code ec;
+    boost::filesystem::remove(tmp, ec);
+  }
+}
+
+// returns the mesh to build collision geometry from, according to the mesh processing options
+shapes::ShapeConstPtr processMesh(const shapes::ShapeConstPtr &shape)
+{
+  const shapes::Mesh *mesh = static_cast<const shapes::Mesh*>(shape.get());
+  ProcessedMeshCache &cache = getProcessedMeshCache();
+  MeshProcessingOptions options;
+  {
+    boost::mutex::scoped_lock slock(cache.lock_);
+    options = cache.options_;
+  }
+  if ((options.max_error_ <= 0.0 && !options.convex_hull_) || mesh->triangle_count < options.min_triangles_ || mesh->vertex_count == 0)
+    return shape;
+
+  std::size_t hash = boost::hash_range(mesh->vertices, mesh->vertices + 3 * mesh->vertex_count);
+  boost::hash_range(hash, mesh->triangles, mesh->triangles + 3 * mesh->triangle_count);
+  boost::hash_combine(hash, options.max_error_);
+  boost::hash_combine(hash, options.convex_hull_);
+  const ProcessedMeshCache::Key key(hash, mesh->vertex_count, mesh->triangle_count);
+  {
+    boost::mutex::scoped_lock slock(cache.lock_);
+    std::map<ProcessedMeshCache::Key, shapes::ShapeConstPtr>::const_iterator it = cache.meshes_.find(key);
+    if (it != cache.meshes_.end())
+      return it->second;
+  }
+
+  // the processing is done without holding the lock, as it may take a while for large meshes
+  shapes::ShapeConstPtr result;
+  std::string file;
+  if (!options.cache_directory_.empty())
+  {
+    file = getProcessedMeshFile(options.cache_directory_, key);
+    result.reset(loadProcessedMesh(file));
+  }
+  if (!result)
+    result = applyMeshProcessing(shape, options);
+  boost::system::error_code ec;
+  if (!file.empty() && result != shape && !boost::filesystem::exists(file, ec))
+    saveProcessedMesh(file, *static_cast<const shapes::Mesh*>(result.get()));
+
+  boost::mutex::scoped_lock slock(cache.lock_);
+  if (cache.meshes_.insert(std::make_pair(key, result)).second)
+  {
+    cache.order_.push_back(key);
+    if (cache.order_.size() > MAX_PROCESSED_MESHES)
+    {
+      cache.meshes_.erase(cache.order_.front());
+      cache.order_.pop_front();
+    }
+  }
+  return result;
+}
+}
+
+const fcl::CollisionGeometry* FCLGeometry::getHullGeometry() const
+{
+  boost::mutex::scoped_lock slock(hull_lock_);
+  if (!hull_computed_)
+  {
+    hull_computed_ = true;
+    // meshes are the only BVH models created by createCollisionGeometry(); the hull is computed from the processed
+    // mesh the model was built from
+    if (collision_geometry_->getNodeType() == fcl::BV_OBBRSS)
+    {
+      const fcl::BVHModel<fcl::OBBRSS> *g = static_cast<const fcl::BVHModel<fcl::OBBRSS>*>(collision_geometry_.get());
+      if (g->num_vertices > 0 && g->num_tris > 0)
+      {
+        shapes::Mesh mesh(g->num_vertices, g->num_tris);
+        for (int i = 0 ; i < g->num_vertices ; ++i)
+          for (int j = 0 ; j < 3 ; ++j)
+            mesh.vertices[3 * i + j] = g->vertices[i][j];
+        for (int i = 0 ; i < g->num_tris ; ++i)
+          for (int j = 0 ; j < 3 ; ++j)
+            mesh.triangles[3 * i + j] = g->tri_indices[i][j];
+        hull_geometry_.reset(createConvexHullGeometry(mesh));
+      }
+    }
+  }
+  return hull_geometry_.get();
+}
+
+void setMeshProcessingOptions(const MeshProcessingOptions &options)
+{
+  ProcessedMeshCache &cache = getProcessedMeshCache();
+  boost::mutex::scoped_lock slock(cache.lock_);
+  cache.options_ = options;
+}
+
+MeshProcessingOptions getMeshProcessingOptions()
+{
+  ProcessedMeshCache &cache = getProcessedMeshCache();
+  boost::mutex::scoped_lock slock(cache.lock_);
+  return cache.options_;
+}
+
 template<typename T1, typename T2>
 struct IfSameType
 {
@@ -478,101 +1223,75 @@ struct IfSameType<T, T>
 template<typename BV, typename T>
 FCLGeometryConstPtr createCollisionGeometry(const shapes::ShapeConstPtr &shape, const T *data, int shape_index)
 {
-  FCLShapeCache &cache = GetShapeCache<BV, T>();
+  FCLShapeCache::Shard &cache = GetShapeCache<BV, T>().getShard(shape.get());
 
-  boost::weak_ptr<const shapes::Shape> wptr(shape);
   {
-    boost::mutex::scoped_lock slock(cache.lock_);
-    std::map<boost::weak_ptr<const shapes::Shape>, FCLGeometryConstPtr>::const_iterator cache_it = cache.map_.find(wptr);
-    if (cache_it != cache.map_.end())
+    boost::shared_lock<boost::shared_mutex> slock(cache.lock_);
+    FCLShapeCache::Entry *entry = cache.find(shape.get());
+    if (entry && entry->geometry_->collision_geometry_data_->ptr.raw == (void*)data)
     {
-      if (cache_it->second->collision_geometry_data_->ptr.raw == (void*)data)
+      //        logDebug("Collision data structures for object %s retrieved from cache.", entry->geometry_->collision_geometry_data_->getID().c_str());
+      cache.touch(*entry);
+      return entry->geometry_;
+    }
+  }
+  {
+    // the lookup is repeated, as the entry may have changed while no lock was held
+    boost::unique_lock<boost::shared_mutex> ulock(cache.lock_);
+    FCLShapeCache::Entry *entry = cache.find(shape.get());
+    if (entry)
+    {
+      if (entry->geometry_->collision_geometry_data_->ptr.raw == (void*)data)
       {
-        //        logDebug("Collision data structures for object %s retrieved from cache.", cache_it->second->collision_geometry_data_->getID().c_str());
-        return cache_it->second;
+        cache.touch(*entry);
+        return entry->geometry_;
       }
       else
-        if (cache_it->second.unique())
+        if (entry->geometry_.unique())
         {
-          const_cast<FCLGeometry*>(cache_it->second.get())->updateCollisionGeometryData(data, shape_index, false);
-          //          logDebug("Collision data structures for object %s retrieved from cache after updating the source object.", cache_it->second->collision_geometry_data_->getID().c_str());
-          return cache_it->second;
+          const_cast<FCLGeometry*>(entry->geometry_.get())->updateCollisionGeometryData(data, shape_index, false);
+          //          logDebug("Collision data structures for object %s retrieved from cache after updating the source object.", entry->geometry_->collision_geometry_data_->getID().c_str());
+          cache.touch(*entry);
+          return entry->geometry_;
         }
     }
   }
 
-  // attached objects could have previously been World::Object; we try to move them
-  // from their old cache to the new one, if possible. the code is not pretty, but should help
+  // attached objects could have previously been World::Object and world objects could have previously been
+  // attached objects; we try to move them from their old cache to the new one, if possible. this helps
   // when we attach/detach objects that are in the world
+  FCLShapeCache::Shard *othercache = NULL;
   if (IfSameType<T, robot_state::AttachedBody>::value == 1)
+    othercache = &GetShapeCache<BV, World::Object>().getShard(shape.get());
+  else
+    if (IfSameType<T, World::Object>::value == 1)
+      othercache = &GetShapeCache<BV, robot_state::AttachedBody>().getShard(shape.get());
+  if (othercache)
   {
-    // get the cache that corresponds to objects; maybe this attached object used to be a world object
-    FCLShapeCache &othercache = GetShapeCache<BV, World::Object>();
-
-    // attached bodies could be just moved from the environment.
-    othercache.lock_.lock(); // lock manually to avoid having 2 simultaneous locks active (avoids possible deadlock)
-    std::map<boost::weak_ptr<const shapes::Shape>, FCLGeometryConstPtr>::iterator cache_it = othercache.map_.find(wptr);
-    if (cache_it != othercache.map_.end())
+    FCLGeometryConstPtr obj_cache;
+    std::size_t size = 0;
     {
-      if (cache_it->second.unique())
-      {
-        // remove from old cache
-        FCLGeometryConstPtr obj_cache = cache_it->second;
-        othercache.map_.erase(cache_it);
-        othercache.lock_.unlock();
-
-        // update the CollisionGeometryData; nobody has a pointer to this, so we can safely modify it
-        const_cast<FCLGeometry*>(obj_cache.get())->updateCollisionGeometryData(data, shape_index, true);
-
-        //        logDebug("Collision data structures for attached body %s retrieved from the cache for world objects.", obj_cache->collision_geometry_data_->getID().c_str());
-
-        // add to the new cache
-        boost::mutex::scoped_lock slock(cache.lock_);
-        cache.map_[wptr] = obj_cache;
-        cache.bumpUseCount();
-        return obj_cache;
-      }
+      // the locks of the two caches are never held at the same time (avoids possible deadlock)
+      boost::unique_lock<boost::shared_mutex> olock(othercache->lock_);
+      obj_cache = othercache->take(shape.get(), size);
     }
-    othercache.lock_.unlock();
-  }
-  else
-    // world objects could have previously been attached objects; we try to move them
-    // from their old cache to the new one, if possible. the code is not pretty, but should help
-    // when we attach/detach objects that are in the world
-    if (IfSameType<T, World::Object>::value == 1)
+    if (obj_cache)
     {
-      // get the cache that corresponds to objects; maybe this attached object used to be a world object
-      FCLShapeCache &othercache = GetShapeCache<BV, robot_state::AttachedBody>();
+      // update the CollisionGeometryData; nobody has a pointer to this, so we can safely modify it
+      const_cast<FCLGeometry*>(obj_cache.get())->updateCollisionGeometryData(data, shape_index, true);
 
-      // attached bodies could be just moved from the environment.
-      othercache.lock_.lock(); // lock manually to avoid having 2 simultaneous locks active (avoids possible deadlock)
-      std::map<boost::weak_ptr<const shapes::Shape>, FCLGeometryConstPtr>::iterator cache_it = othercache.map_.find(wptr);
-      if (cache_it != othercache.map_.end())
-      {
-        if (cache_it->second.unique())
-        {
-          // remove from old cache
-          FCLGeometryConstPtr obj_cache = cache_it->second;
-          othercache.map_.erase(cache_it);
-          othercache.lock_.unlock();
-
-          // update the CollisionGeometryData; nobody has a pointer to this, so we can safely modify it
-          const_cast<FCLGeometry*>(obj_cache.get())->updateCollisionGeometryData(data, shape_index, true);
-
-          //          logDebug("Collision data structures for world object %s retrieved from the cache for attached bodies.",
-          //                   obj_cache->collision_geometry_data_->getID().c_str());
-
-          // add to the new cache
-          boost::mutex::scoped_lock slock(cache.lock_);
-          cache.map_[wptr] = obj_cache;
-          cache.bumpUseCount();
-          return obj_cache;
-        }
-      }
-      othercache.lock_.unlock();
+      //        logDebug("Collision data structures for object %s retrieved from the cache of the other object type.", obj_cache->collision_geometry_data_->getID().c_str());
+
+      // add to the new cache
+      boost::unique_lock<boost::shared_mutex> ulock(cache.lock_);
+      cache.insert(shape, obj_cache, size);
+      return obj_cache;
     }
+  }
 
   fcl::CollisionGeometry* cg_g = NULL;
+  fcl::OcTree *unpruned = NULL;
+  std::size_t size = 0; // estimate of the memory used by the geometry
   if (shape->type == shapes::PLANE) // shapes that directly produce CollisionGeometry
   {
     // handle cases individually
@@ -582,6 +1301,7 @@ FCLGeometryConstPtr createCollisionGeometry(const shapes::ShapeConstPtr &shape,
       {
         const shapes::Plane* p = static_cast<const shapes::Plane*>(shape.get());
         cg_g = new fcl::Plane(p->a, p->b, p->c, p->d);
+        size = sizeof(fcl::Plane);
       }
       break;
     default:
@@ -596,31 +1316,35 @@ FCLGeometryConstPtr createCollisionGeometry(const shapes::ShapeConstPtr &shape,
       {
         const shapes::Sphere* s = static_cast<const shapes::Sphere*>(shape.get());
         cg_g = new fcl::Sphere(s->radius);
+        size = sizeof(fcl::Sphere);
       }
       break;
     case shapes::BOX:
       {
         const shapes::Box* s = static_cast<const shapes::Box*>(shape.get());
-        const double* size = s->size;
-        cg_g = new fcl::Box(size[0], size[1], size[2]);
+        cg_g = new fcl::Box(s->size[0], s->size[1], s->size[2]);
+        size = sizeof(fcl::Box);
       }
       break;
     case shapes::CYLINDER:
       {
         const shapes::Cylinder* s = static_cast<const shapes::Cylinder*>(shape.get());
         cg_g = new fcl::Cylinder(s->radius, s->length);
+        size = sizeof(fcl::Cylinder);
       }
       break;
     case shapes::CONE:
       {
         const shapes::Cone* s = static_cast<const shapes::Cone*>(shape.get());
         cg_g = new fcl::Cone(s->radius, s->length);
+        size = sizeof(fcl::Cone);
       }
       break;
     case shapes::MESH:
       {
         fcl::BVHModel<BV>* g = new fcl::BVHModel<BV>();
-        const shapes::Mesh *mesh = static_cast<const shapes::Mesh*>(shape.get());
+        const shapes::ShapeConstPtr processed = processMesh(shape);
+        const shapes::Mesh *mesh = static_cast<const shapes::Mesh*>(processed.get());
         if (mesh->vertex_count > 0 && mesh->triangle_count > 0)
         {
           std::vector<fcl::Triangle> tri_indices(mesh->triangle_count);
@@ -635,13 +1359,27 @@ FCLGeometryConstPtr createCollisionGeometry(const shapes::ShapeConstPtr &shape,
           g->addSubModel(points, tri_indices);
           g->endModel();
         }
+        // vertices, triangles, bounding volume nodes and the primitive index of each triangle
+        size += sizeof(fcl::BVHModel<BV>) + g->num_vertices * sizeof(fcl::Vec3f) + g->num_tris * sizeof(fcl::Triangle) +
+          g->getNumBVs() * sizeof(fcl::BVNode<BV>) + g->num_tris * sizeof(unsigned int);
         cg_g = g;
       }
       break;
     case shapes::OCTREE:
       {
         const shapes::OcTree* g = static_cast<const shapes::OcTree*>(shape.get());
-        cg_g = new fcl::OcTree(g->octree);
+        fcl::OcTree *tree = new fcl::OcTree(g->octree);
+        // by default FCL considers no node free, so every query descends into all the known parts of the map; nodes
+        // whose occupancy reached the lower clamping bound are known to be free (for inner nodes, this holds for all
+        // their children), so they are skipped. Requests for costs use the map without this pruning (see getQueryGeometry())
+        tree->setFreeThres(std::min(g->octree->getClampingThresMin() + OCTREE_FREE_THRESHOLD_MARGIN,
+                                    g->octree->getOccupancyThres() - OCTREE_FREE_THRESHOLD_MARGIN));
+        cg_g = tree;
+        // the geometry may later be moved to an attached body, so the unpruned tree is kept for any octree
+        unpruned = new fcl::OcTree(g->octree);
+        unpruned->computeLocalAABB();
+        // the octree is shared with the shape and both trees, but the cache keeps it in memory
+        size = 2 * sizeof(fcl::OcTree) + g->octree->memoryUsage();
       }
       break;
     default:
@@ -652,10 +1390,11 @@ FCLGeometryConstPtr createCollisionGeometry(const shapes::ShapeConstPtr &shape,
   if (cg_g)
   {
     cg_g->computeLocalAABB();
-    FCLGeometryConstPtr res(new FCLGeometry(cg_g, data, shape_index));
-    boost::mutex::scoped_lock slock(cache.lock_);
-    cache.map_[wptr] = res;
-    cache.bumpUseCount();
+    FCLGeometryPtr res(new FCLGeometry(cg_g, data, shape_index));
+    if (unpruned)
+      res->setUnprunedGeometry(unpruned);
+    boost::unique_lock<boost::shared_mutex> ulock(cache.lock_);
+    cache.insert(shape, res, size + sizeof(FCLGeometry) + sizeof(CollisionGeometryData));
     return res;
   }
   return FCLGeometryConstPtr();
@@ -683,6 +1422,45 @@ FCLGeometryConstPtr createCollisionGeometry(const shapes::ShapeConstPtr &shape,
   return createCollisionGeometry<fcl::OBBRSS, World::Object>(shape, obj, 0);
 }
 
+/* The geometry of scaled or padded shapes, by the original shape, the scaling and the padding. Scaled shapes are copies
+   that are not kept anywhere else, so they cannot be found in the cache keyed by the address of the shapes; without this
+   cache, every change of padding would rebuild the geometry (e.g., BVH models of meshes), even when switching back
+   to a padding that was used before, or when other collision robots for the same model use the same padding. */
+struct PaddedShapeCache
+{
+  typedef boost::tuple<boost::weak_ptr<const shapes::Shape>, double, double> Key;
+
+  void clean()
+  {
+    boost::mutex::scoped_lock slock(lock_);
+    removeExpired();
+  }
+
+  // the lock must be held
+  void removeExpired()
+  {
+    for (std::map<Key, FCLGeometryConstPtr>::iterator it = map_.begin() ; it != map_.end() ; )
+      if (it->first.get<0>().expired())
+        map_.erase(it++);
+      else
+        ++it;
+    // many different paddings may be used over time; the geometry can always be built again
+    if (map_.size() > MAX_SIZE)
+      map_.clear();
+  }
+
+  static const std::size_t MAX_SIZE = 1024;
+  std::map<Key, FCLGeometryConstPtr> map_;
+  boost::mutex lock_;
+};
+
+template<typename BV, typename T>
+PaddedShapeCache& GetPaddedShapeCache()
+{
+  static PaddedShapeCache cache;
+  return cache;
+}
+
 template<typename BV, typename T>
 FCLGeometryConstPtr createCollisionGeometry(const shapes::ShapeConstPtr &shape, double scale, double padding, const T *data, int shape_index)
 {
@@ -690,9 +1468,27 @@ FCLGeometryConstPtr createCollisionGeometry(const shapes::ShapeConstPtr &shape,
     return createCollisionGeometry<BV, T>(shape, data, shape_index);
   else
   {
+    PaddedShapeCache &cache = GetPaddedShapeCache<BV, T>();
+    const PaddedShapeCache::Key key(boost::weak_ptr<const shapes::Shape>(shape), scale, padding);
+    {
+      boost::mutex::scoped_lock slock(cache.lock_);
+      std::map<PaddedShapeCache::Key, FCLGeometryConstPtr>::const_iterator it = cache.map_.find(key);
+      if (it != cache.map_.end() && it->second->collision_geometry_data_->ptr.raw == (void*)data &&
+          it->second->collision_geometry_data_->shape_index == shape_index)
+        return it->second;
+    }
+
     boost::shared_ptr<shapes::Shape> scaled_shape(shape->clone());
     scaled_shape->scaleAndPadd(scale, padding);
-    return createCollisionGeometry<BV, T>(scaled_shape, data, shape_index);
+    FCLGeometryConstPtr res = createCollisionGeometry<BV, T>(scaled_shape, data, shape_index);
+    if (res)
+    {
+      boost::mutex::scoped_lock slock(cache.lock_);
+      if (cache.map_.size() >= PaddedShapeCache::MAX_SIZE)
+        cache.removeExpired();
+      cache.map_[key] = res;
+    }
+    return res;
   }
 }
 
@@ -714,18 +1510,31 @@ FCLGeometryConstPtr createCollisionGeometry(const shapes::ShapeConstPtr &shape,
   return createCollisionGeometry<fcl::OBBRSS, World::Object>(shape, scale, padding, obj, 0);
 }
 
+void setCollisionGeometryCacheBudget(std::size_t bytes)
+{
+  GetShapeCache<fcl::OBBRSS, robot_model::LinkModel>().setBudget(bytes);
+  GetShapeCache<fcl::OBBRSS, World::Object>().setBudget(bytes);
+  GetShapeCache<fcl::OBBRSS, robot_state::AttachedBody>().setBudget(bytes);
+}
+
+std::size_t getCollisionGeometryCacheBudget()
+{
+  return GetShapeCache<fcl::OBBRSS, World::Object>().budget_;
+}
+
+std::size_t getCollisionGeometryCacheSize()
+{
+  return GetShapeCache<fcl::OBBRSS, robot_model::LinkModel>().getSize() +
+    GetShapeCache<fcl::OBBRSS, World::Object>().getSize() +
+    GetShapeCache<fcl::OBBRSS, robot_state::AttachedBody>().getSize();
+}
+
 void cleanCollisionGeometryCache()
 {
-  FCLShapeCache &cache1 = GetShapeCache<fcl::OBBRSS, World::Object>();
-  {
-    boost::mutex::scoped_lock slock(cache1.lock_);
-    cache1.bumpUseCount(true);
-  }
-  FCLShapeCache &cache2 = GetShapeCache<fcl::OBBRSS, robot_state::AttachedBody>();
-  {
-    boost::mutex::scoped_lock slock(cache2.lock_);
-    cache2.bumpUseCount(true);
-  }
+  GetShapeCache<fcl::OBBRSS, World::Object>().clean();
+  GetShapeCache<fcl::OBBRSS, robot_state::AttachedBody>().clean();
+  GetPaddedShapeCache<fcl::OBBRSS, World::Object>().clean();
+  GetPaddedShapeCache<fcl::OBBRSS, robot_state::AttachedBody>().clean();
 }
 
 }
@@ -733,11 +1542,55 @@ void cleanCollisionGeometryCache()
 void collision_detection::CollisionData::enableGroup(const robot_model::RobotModelConstPtr &kmodel)
 {
   if (kmodel->hasJointModelGroup(req_->group_name))
-    active_components_only_ = &kmodel->getJointModelGroup(req_->group_name)->getUpdatedLinkModelsWithGeometrySet();
+    active_components_only_ = &kmodel->getJointModelGroup(req_->group_name)->getUpdatedLinkModelsWithGeometryMask();
   else
     active_components_only_ = NULL;
 }
 
+bool collision_detection::getActiveCollisionObjects(const CollisionData &cd, const FCLObject &fcl_obj, std::size_t max_count,
+                                                    std::vector<fcl::CollisionObject*> &active)
+{
+  active.clear();
+  for (std::size_t i = 0 ; i < fcl_obj.collision_objects_.size() ; ++i)
+  {
+    fcl::CollisionObject *o = fcl_obj.collision_objects_[i].get();
+    if (cd.isActiveComponent(static_cast<const CollisionGeometryData*>(o->getCollisionGeometry()->getUserData())))
+    {
+      if (active.size() >= max_count)
+        return false;
+      active.push_back(o);
+    }
+  }
+  return true;
+}
+
+double collision_detection::conservativeAdvancement(ContinuousMotion &motion)
+{
+  // the smallest advance along the motion; this bounds the number of steps taken when the distance is (nearly) zero
+  static const double MIN_STEP = 1e-3;
+
+  double t = 0.0;
+  while (!motion.check(t))
+  {
+    if (t >= 1.0)
+      return -1.0;
+    double d = motion.distance();
+    double dt = 1.0 - t;
+    double b = motion.motionBound(t + dt);
+    while (b > d)
+    {
+      // the time is never advanced past what the bound allows; if not even the smallest step can be taken, the
+      // geometry is too close to an obstacle for the motion to be shown collision free
+      if (dt <= MIN_STEP)
+        return t;
+      dt = std::max(MIN_STEP, dt * std::min(0.9, d / b));
+      b = motion.motionBound(t + dt);
+    }
+    t = std::min(1.0, t + dt);
+  }
+  return t;
+}
+
 void collision_detection::FCLObject::registerTo(fcl::BroadPhaseCollisionManager *manager)
 {
   std::vector<fcl::CollisionObject*> collision_objects(collision_objects_.size());
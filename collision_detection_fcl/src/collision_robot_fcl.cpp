@@ -35,9 +35,160 @@
 /* Author: Ioan Sucan */
 
 #include <moveit/collision_detection_fcl/collision_robot_fcl.h>
+#include <moveit/profiler/profiler.h>
+#include <boost/thread/tss.hpp>
+#include <boost/weak_ptr.hpp>
+#include <algorithm>
+#include <map>
+
+namespace collision_detection
+{
+namespace
+{
+
+// the self collision plan is used only if it has at most this many pairs per object; otherwise, checking the
+// AABBs of all the pairs in the plan is likely to take longer than a broad-phase traversal
+const std::size_t MAX_PLAN_PAIRS_PER_OBJECT = 4;
+
+// the number of checks after which the self collision plan is reordered by the collisions found for each pair
+const unsigned int PLAN_REORDER_INTERVAL = 64;
+
+struct SelfCollisionMotion : public ContinuousMotion
+{
+  SelfCollisionMotion(const CollisionRobotFCL &robot, const CollisionRequest &req, CollisionResult &res,
+                      const robot_state::RobotState &state1, const robot_state::RobotState &state2,
+                      const AllowedCollisionMatrix *acm) :
+    robot_(robot), req_(req), res_(res), state1_(state1), state2_(state2), acm_(acm),
+    current_(state1), candidate_(state1)
+  {
+    // distances are computed separately, for every step
+    req_.distance = false;
+  }
+
+  virtual bool check(double t)
+  {
+    state1_.interpolate(state2_, t, current_);
+    current_.updateCollisionBodyTransforms();
+    if (acm_)
+      robot_.checkSelfCollision(req_, res_, current_, *acm_);
+    else
+      robot_.checkSelfCollision(req_, res_, current_);
+    return res_.collision;
+  }
+
+  virtual double distance()
+  {
+    // only the pairs that involve a link of the group are checked
+    DistanceRequest dreq;
+    dreq.group_name = req_.group_name;
+    DistanceResult dres;
+    if (acm_)
+      robot_.distanceSelf(dreq, dres, current_, *acm_);
+    else
+      robot_.distanceSelf(dreq, dres, current_);
+    return dres.distance;
+  }
+
+  virtual double motionBound(double t)
+  {
+    state1_.interpolate(state2_, t, candidate_);
+    // both bodies of a pair may be moving; one of them is a link of the group, the other can be any link
+    double bound = robot_.getMotionBound(current_, candidate_);
+    if (robot_.getRobotModel()->hasJointModelGroup(req_.group_name))
+      return bound + robot_.getMotionBound(current_, candidate_, req_.group_name);
+    return 2.0 * bound;
+  }
+
+  const CollisionRobotFCL        &robot_;
+  CollisionRequest                req_;
+  CollisionResult                &res_;
+  const robot_state::RobotState  &state1_;
+  const robot_state::RobotState  &state2_;
+  const AllowedCollisionMatrix   *acm_;
+  robot_state::RobotState         current_;
+  robot_state::RobotState         candidate_;
+};
+
+struct OtherCollisionMotion : public ContinuousMotion
+{
+  OtherCollisionMotion(const CollisionRobotFCL &robot, const CollisionRequest &req, CollisionResult &res,
+                       const robot_state::RobotState &state1, const robot_state::RobotState &state2,
+                       const CollisionRobotFCL &other_robot, const robot_state::RobotState &other_state1,
+                       const robot_state::RobotState &other_state2, const AllowedCollisionMatrix *acm) :
+    robot_(robot), other_robot_(other_robot), req_(req), res_(res), state1_(state1), state2_(state2),
+    other_state1_(other_state1), other_state2_(other_state2), acm_(acm),
+    current_(state1), candidate_(state1), other_current_(other_state1), other_candidate_(other_state1)
+  {
+    req_.distance = false;
+  }
+
+  virtual bool check(double t)
+  {
+    state1_.interpolate(state2_, t, current_);
+    current_.updateCollisionBodyTransforms();
+    other_state1_.interpolate(other_state2_, t, other_current_);
+    other_current_.updateCollisionBodyTransforms();
+    if (acm_)
+      robot_.checkOtherCollision(req_, res_, current_, other_robot_, other_current_, *acm_);
+    else
+      robot_.checkOtherCollision(req_, res_, current_, other_robot_, other_current_);
+    return res_.collision;
+  }
+
+  virtual double distance()
+  {
+    return acm_ ? robot_.distanceOther(current_, other_robot_, other_current_, *acm_) :
+      robot_.distanceOther(current_, other_robot_, other_current_);
+  }
+
+  virtual double motionBound(double t)
+  {
+    state1_.interpolate(state2_, t, candidate_);
+    other_state1_.interpolate(other_state2_, t, other_candidate_);
+    // the group only restricts the links of this robot; the distance covers all the links, so it is not larger than
+    // the distance of the checked pairs
+    return robot_.getMotionBound(current_, candidate_, req_.group_name) +
+      other_robot_.getMotionBound(other_current_, other_candidate_);
+  }
+
+  const CollisionRobotFCL        &robot_;
+  const CollisionRobotFCL        &other_robot_;
+  CollisionRequest                req_;
+  CollisionResult                &res_;
+  const robot_state::RobotState  &state1_;
+  const robot_state::RobotState  &state2_;
+  const robot_state::RobotState  &other_state1_;
+  const robot_state::RobotState  &other_state2_;
+  const AllowedCollisionMatrix   *acm_;
+  robot_state::RobotState         current_;
+  robot_state::RobotState         candidate_;
+  robot_state::RobotState         other_current_;
+  robot_state::RobotState         other_candidate_;
+};
+
+// geometry versions and instance identifiers come from one counter, so they are unique in the process
+boost::mutex version_lock;
+boost::uint64_t version_counter = 0;
+
+boost::uint64_t newVersion()
+{
+  boost::mutex::scoped_lock slock(version_lock);
+  return ++version_counter;
+}
+
+// the self collision caches of the calling thread, by instance identifier; the caches are owned by the
+// instances, so the entries of destroyed instances expire and are removed the next time a cache is added
+typedef std::map<boost::uint64_t, boost::weak_ptr<void> > ThreadSelfCollisionCaches;
+boost::thread_specific_ptr<ThreadSelfCollisionCaches> thread_self_collision_caches;
+
+}
+}
 
 collision_detection::CollisionRobotFCL::CollisionRobotFCL(const robot_model::RobotModelConstPtr &model, double padding, double scale) 
   : CollisionRobot(model, padding, scale)
+  , geoms_version_(newVersion())
+  , motion_validator_(new ConservativeMotionValidator(model))
+  , instance_id_(newVersion())
 {
   const std::vector<const robot_model::LinkModel*>& links = robot_model_->getLinkModelsWithCollisionGeometry();
   geoms_.resize(robot_model_->getLinkGeometryCount());
@@ -54,8 +205,12 @@ collision_detection::CollisionRobotFCL::CollisionRobotFCL(const robot_model::Rob
 }
 
 collision_detection::CollisionRobotFCL::CollisionRobotFCL(const CollisionRobotFCL &other) : CollisionRobot(other)
+  , motion_validator_(other.motion_validator_)
+  , instance_id_(newVersion())
 {
   geoms_ = other.geoms_;
+  geoms_version_ = other.geoms_version_;
+  // the cached broad-phase data is not shared; it is constructed on demand for this instance
 }
 
 void collision_detection::CollisionRobotFCL::getAttachedBodyObjects(const robot_state::AttachedBody *ab, std::vector<FCLGeometryConstPtr> &geoms) const
@@ -82,22 +237,25 @@ void collision_detection::CollisionRobotFCL::constructFCLObject(const robot_stat
       // the CollisionGeometryData is already stored in the class member geoms_, so we need not copy it
     }
   
+  if (!state.hasAttachedBodies())
+    return;
   std::vector<const robot_state::AttachedBody*> ab;
   state.getAttachedBodies(ab);
   for (std::size_t j = 0 ; j < ab.size() ; ++j)
   {
-    std::vector<FCLGeometryConstPtr> objs;
-    getAttachedBodyObjects(ab[j], objs);
+    const std::vector<shapes::ShapeConstPtr> &shapes = ab[j]->getShapes();
     const EigenSTL::vector_Affine3d &ab_t = ab[j]->getGlobalCollisionBodyTransforms();
-    for (std::size_t k = 0 ; k < objs.size() ; ++k)
-      if (objs[k]->collision_geometry_)
+    for (std::size_t k = 0 ; k < shapes.size() ; ++k)
+    {
+      FCLGeometryConstPtr g = createCollisionGeometry(shapes[k], ab[j], k);
+      if (g && g->collision_geometry_)
       {
-        fcl::CollisionObject *collObj = new fcl::CollisionObject(objs[k]->collision_geometry_, transform2fcl(ab_t[k]));
+        fcl::CollisionObject *collObj = new fcl::CollisionObject(g->collision_geometry_, transform2fcl(ab_t[k]));
         fcl_obj.collision_objects_.push_back(boost::shared_ptr<fcl::CollisionObject>(collObj));
-        // we copy the shared ptr to the CollisionGeometryData, as this is not stored by the class itself,
-        // and would be destroyed when objs goes out of scope.
-        fcl_obj.collision_geometry_.push_back(objs[k]);
+        // we copy the shared ptr to the CollisionGeometryData, as this is not stored by the class itself
+        fcl_obj.collision_geometry_.push_back(g);
       }
+    }
   }
 }
 
@@ -111,6 +269,221 @@ void collision_detection::CollisionRobotFCL::allocSelfCollisionBroadPhase(const
   // manager.manager_->update();
 }
 
+collision_detection::CollisionRobotFCL::SelfCollisionCache& collision_detection::CollisionRobotFCL::getSelfCollisionCache() const
+{
+  ThreadSelfCollisionCaches *caches = thread_self_collision_caches.get();
+  if (!caches)
+  {
+    caches = new ThreadSelfCollisionCaches();
+    thread_self_collision_caches.reset(caches);
+  }
+
+  ThreadSelfCollisionCaches::iterator it = caches->find(instance_id_);
+  if (it != caches->end())
+  {
+    // the instance is alive while it is being used, so the cache it owns is alive as well
+    boost::shared_ptr<void> cache = it->second.lock();
+    if (cache)
+      return *static_cast<SelfCollisionCache*>(cache.get());
+  }
+
+  // forget the caches of instances that were destroyed
+  for (ThreadSelfCollisionCaches::iterator jt = caches->begin() ; jt != caches->end() ; )
+    if (jt->second.expired())
+      caches->erase(jt++);
+    else
+      ++jt;
+
+  boost::shared_ptr<SelfCollisionCache> cache(new SelfCollisionCache());
+  {
+    boost::mutex::scoped_lock slock(self_collision_caches_lock_);
+    self_collision_caches_.push_back(cache);
+  }
+  (*caches)[instance_id_] = cache;
+  return *cache;
+}
+
+collision_detection::FCLManager& collision_detection::CollisionRobotFCL::getSelfCollisionBroadPhase(const robot_state::RobotState &state) const
+{
+  SelfCollisionCache *cache = &getSelfCollisionCache();
+  FCLManager &manager = cache->manager_;
+  FCLObject &obj = manager.object_;
+  std::vector<fcl::CollisionObject*> updated;
+
+  // (re)construct the objects for the links if this is the first call or if the link geometry changed
+  if (!manager.manager_ || cache->geoms_version_ != geoms_version_)
+  {
+    manager.manager_.reset(new fcl::DynamicAABBTreeCollisionManager());
+    obj.clear();
+    cache->transforms_.clear();
+    for (std::size_t i = 0 ; i < geoms_.size() ; ++i)
+      if (geoms_[i] && geoms_[i]->collision_geometry_)
+      {
+        const Eigen::Affine3d &t = state.getCollisionBodyTransform(geoms_[i]->collision_geometry_data_->ptr.link,
+                                                                   geoms_[i]->collision_geometry_data_->shape_index);
+        obj.collision_objects_.push_back(boost::shared_ptr<fcl::CollisionObject>(new fcl::CollisionObject(geoms_[i]->collision_geometry_, transform2fcl(t))));
+        obj.collision_geometry_.push_back(geoms_[i]);
+        cache->transforms_.push_back(t);
+      }
+    cache->link_objects_count_ = obj.collision_objects_.size();
+    cache->geoms_version_ = geoms_version_;
+    obj.registerTo(manager.manager_.get());
+  }
+  else
+    for (std::size_t i = 0 ; i < cache->link_objects_count_ ; ++i)
+    {
+      const CollisionGeometryData *cgd = obj.collision_geometry_[i]->collision_geometry_data_.get();
+      const Eigen::Affine3d &t = state.getCollisionBodyTransform(cgd->ptr.link, cgd->shape_index);
+      if (t.matrix() != cache->transforms_[i].matrix())
+      {
+        cache->transforms_[i] = t;
+        obj.collision_objects_[i]->setTransform(transform2fcl(t));
+        obj.collision_objects_[i]->computeAABB();
+        updated.push_back(obj.collision_objects_[i].get());
+      }
+    }
+
+  // the geometry for attached bodies is retrieved every time, as this also updates the data associated to the
+  // (shared) collision geometry so that it refers to the attached bodies of \e state
+  std::vector<FCLGeometryConstPtr> ab_geoms;
+  std::vector<const Eigen::Affine3d*> ab_transforms;
+  if (state.hasAttachedBodies())
+  {
+    std::vector<const robot_state::AttachedBody*> ab;
+    state.getAttachedBodies(ab);
+    for (std::size_t j = 0 ; j < ab.size() ; ++j)
+    {
+      const std::vector<shapes::ShapeConstPtr> &shapes = ab[j]->getShapes();
+      const EigenSTL::vector_Affine3d &ab_t = ab[j]->getGlobalCollisionBodyTransforms();
+      for (std::size_t k = 0 ; k < shapes.size() ; ++k)
+      {
+        FCLGeometryConstPtr g = createCollisionGeometry(shapes[k], ab[j], k);
+        if (g && g->collision_geometry_)
+        {
+          ab_geoms.push_back(g);
+          ab_transforms.push_back(&ab_t[k]);
+        }
+      }
+    }
+  }
+
+  bool same_attached = ab_geoms.size() + cache->link_objects_count_ == obj.collision_geometry_.size();
+  for (std::size_t k = 0 ; same_attached && k < ab_geoms.size() ; ++k)
+    if (ab_geoms[k] != obj.collision_geometry_[cache->link_objects_count_ + k])
+      same_attached = false;
+
+  if (same_attached)
+  {
+    for (std::size_t k = 0 ; k < ab_geoms.size() ; ++k)
+    {
+      std::size_t i = cache->link_objects_count_ + k;
+      if (ab_transforms[k]->matrix() != cache->transforms_[i].matrix())
+      {
+        cache->transforms_[i] = *ab_transforms[k];
+        obj.collision_objects_[i]->setTransform(transform2fcl(*ab_transforms[k]));
+        obj.collision_objects_[i]->computeAABB();
+        updated.push_back(obj.collision_objects_[i].get());
+      }
+    }
+    if (!updated.empty())
+      manager.manager_->update(updated);
+  }
+  else
+  {
+    // the set of attached bodies changed; replace the objects that correspond to attached bodies
+    for (std::size_t i = cache->link_objects_count_ ; i < obj.collision_objects_.size() ; ++i)
+      manager.manager_->unregisterObject(obj.collision_objects_[i].get());
+    obj.collision_objects_.resize(cache->link_objects_count_);
+    obj.collision_geometry_.resize(cache->link_objects_count_);
+    cache->transforms_.resize(cache->link_objects_count_);
+    if (!updated.empty())
+      manager.manager_->update(updated);
+    
+    std::vector<fcl::CollisionObject*> added;
+    for (std::size_t k = 0 ; k < ab_geoms.size() ; ++k)
+    {
+      fcl::CollisionObject *collObj = new fcl::CollisionObject(ab_geoms[k]->collision_geometry_, transform2fcl(*ab_transforms[k]));
+      obj.collision_objects_.push_back(boost::shared_ptr<fcl::CollisionObject>(collObj));
+      obj.collision_geometry_.push_back(ab_geoms[k]);
+      cache->transforms_.push_back(*ab_transforms[k]);
+      added.push_back(collObj);
+    }
+    if (!added.empty())
+      manager.manager_->registerObjects(added);
+    cache->attached_version_++;
+  }
+
+  return manager;
+}
+
+bool collision_detection::CollisionRobotFCL::updateSelfCollisionPlan(SelfCollisionCache &cache, const CollisionData &cd) const
+{
+  if (!cd.compiled_acm_)
+    return false;
+  if (cache.plan_valid_ && cache.plan_acm_ == cd.compiled_acm_ &&
+      cache.plan_geoms_version_ == cache.geoms_version_ && cache.plan_attached_version_ == cache.attached_version_)
+    return cache.plan_usable_;
+
+  const FCLObject &obj = cache.manager_.object_;
+  const std::size_t n = obj.collision_objects_.size();
+  cache.plan_.clear();
+  for (std::size_t i = 0 ; i < n ; ++i)
+  {
+    const CollisionGeometryData *cd1 = obj.collision_geometry_[i]->collision_geometry_data_.get();
+    for (std::size_t j = i + 1 ; j < n ; ++j)
+    {
+      // pairs of links can be excluded based on the ACM alone; attached bodies can change (e.g., their touch links)
+      // without their geometry changing, so pairs that involve attached bodies are always kept and filtered by
+      // the collision callback
+      if (j < cache.link_objects_count_)
+      {
+        const CollisionGeometryData *cd2 = obj.collision_geometry_[j]->collision_geometry_data_.get();
+        if (cd1->sameObject(*cd2))
+          continue;
+        AllowedCollision::Type type;
+        if (cd.compiled_acm_->getAllowedCollision(cd1->name_index, cd2->name_index, type) && type == AllowedCollision::ALWAYS)
+          continue;
+      }
+      cache.plan_.push_back(SelfCollisionPair(i, j));
+    }
+  }
+
+  cache.plan_acm_ = cd.compiled_acm_;
+  cache.plan_geoms_version_ = cache.geoms_version_;
+  cache.plan_attached_version_ = cache.attached_version_;
+  cache.plan_valid_ = true;
+  cache.plan_usable_ = cache.plan_.size() <= MAX_PLAN_PAIRS_PER_OBJECT * n;
+  cache.plan_checks_ = 0;
+  return cache.plan_usable_;
+}
+
+void collision_detection::CollisionRobotFCL::checkSelfCollisionPlan(SelfCollisionCache &cache, CollisionData &cd) const
+{
+  const FCLObject &obj = cache.manager_.object_;
+  for (std::size_t k = 0 ; !cd.done_ && k < cache.plan_.size() ; ++k)
+  {
+    SelfCollisionPair &p = cache.plan_[k];
+    fcl::CollisionObject *o1 = obj.collision_objects_[p.first_].get();
+    fcl::CollisionObject *o2 = obj.collision_objects_[p.second_].get();
+    if (!o1->getAABB().overlap(o2->getAABB()))
+      continue;
+    bool was_collision = cd.res_->collision;
+    std::size_t contact_count = cd.res_->contact_count;
+    collisionCallback(o1, o2, &cd);
+    if ((!was_collision && cd.res_->collision) || cd.res_->contact_count > contact_count)
+      p.hits_++;
+  }
+
+  if (++cache.plan_checks_ >= PLAN_REORDER_INTERVAL)
+  {
+    std::stable_sort(cache.plan_.begin(), cache.plan_.end());
+    // decay the counts so the order follows recent history
+    for (std::size_t k = 0 ; k < cache.plan_.size() ; ++k)
+      cache.plan_[k].hits_ /= 2;
+    cache.plan_checks_ = 0;
+  }
+}
+
 void collision_detection::CollisionRobotFCL::checkSelfCollision(const CollisionRequest &req, CollisionResult &res, const robot_state::RobotState &state) const
 {
   checkSelfCollisionHelper(req, res, state, NULL);
@@ -124,24 +497,64 @@ void collision_detection::CollisionRobotFCL::checkSelfCollision(const CollisionR
 
 void collision_detection::CollisionRobotFCL::checkSelfCollision(const CollisionRequest &req, CollisionResult &res, const robot_state::RobotState &state1, const robot_state::RobotState &state2) const
 {
-  logError("FCL continuous collision checking not yet implemented");
+  checkSelfCollisionHelper(req, res, state1, state2, NULL);
 }
 
 void collision_detection::CollisionRobotFCL::checkSelfCollision(const CollisionRequest &req, CollisionResult &res, const robot_state::RobotState &state1, const robot_state::RobotState &state2, const AllowedCollisionMatrix &acm) const
 {
-  logError("FCL continuous collision checking not yet implemented");
+  checkSelfCollisionHelper(req, res, state1, state2, &acm);
+}
+
+void collision_detection::CollisionRobotFCL::checkSelfCollisionHelper(const CollisionRequest &req, CollisionResult &res, const robot_state::RobotState &state1,
+                                                                      const robot_state::RobotState &state2, const AllowedCollisionMatrix *acm) const
+{
+  SelfCollisionMotion motion(*this, req, res, state1, state2, acm);
+  double t = conservativeAdvancement(motion);
+  if (t >= 0.0)
+  {
+    logDebug("Self collision found at time %lf along the motion", t);
+    // the motion could not be shown to be collision free
+    res.collision = true;
+  }
+  if (req.distance)
+    res.distance = res.collision ? 0.0 : std::min(distanceSelfHelper(state1, acm), distanceSelfHelper(state2, acm));
 }
 
 void collision_detection::CollisionRobotFCL::checkSelfCollisionHelper(const CollisionRequest &req, CollisionResult &res, const robot_state::RobotState &state,
                                                                       const AllowedCollisionMatrix *acm) const
 {
-  FCLManager manager;
-  allocSelfCollisionBroadPhase(state, manager);
+  MOVEIT_CORE_PROBE("CollisionRobotFCL::checkSelfCollisionHelper");
+  FCLManager &manager = getSelfCollisionBroadPhase(state);
   CollisionData cd(&req, &res, acm);
   cd.enableGroup(getRobotModel());
-  manager.manager_->collide(&cd, &collisionCallback);
   if (req.distance)
-    res.distance = distanceSelfHelper(state, acm);
+  {
+    // compute contacts and distance in one traversal
+    res.distance = std::numeric_limits<double>::max();
+    manager.manager_->distance(&cd, &collisionDistanceCallback);
+  }
+  else
+  {
+    // if only a few objects are relevant for the requested group, query the broad phase with those objects
+    // instead of performing a full self traversal; pairs of two active objects would be seen twice, so the
+    // objects that were already queried are masked out
+    std::vector<fcl::CollisionObject*> active;
+    if (cd.active_components_only_ && getActiveCollisionObjects(cd, manager.object_, manager.object_.collision_objects_.size() / 2, active))
+    {
+      std::set<const fcl::CollisionObject*> queried;
+      cd.masked_objects_ = &queried;
+      for (std::size_t i = 0 ; !cd.done_ && i < active.size() ; ++i)
+      {
+        manager.manager_->collide(active[i], &cd, &collisionCallback);
+        queried.insert(active[i]);
+      }
+    }
+    // if the ACM allows most pairs, check the remaining pairs directly instead of traversing the broad phase
+    else if (updateSelfCollisionPlan(getSelfCollisionCache(), cd))
+      checkSelfCollisionPlan(getSelfCollisionCache(), cd);
+    else
+      manager.manager_->collide(&cd, &collisionCallback);
+  }
 }
 
 void collision_detection::CollisionRobotFCL::checkOtherCollision(const CollisionRequest &req, CollisionResult &res, const robot_state::RobotState &state,
@@ -160,33 +573,67 @@ void collision_detection::CollisionRobotFCL::checkOtherCollision(const Collision
 void collision_detection::CollisionRobotFCL::checkOtherCollision(const CollisionRequest &req, CollisionResult &res, const robot_state::RobotState &state1, const robot_state::RobotState &state2,
                                                                  const CollisionRobot &other_robot, const robot_state::RobotState &other_state1, const robot_state::RobotState &other_state2) const
 {
-  logError("FCL continuous collision checking not yet implemented");
+  checkOtherCollisionHelper(req, res, state1, state2, other_robot, other_state1, other_state2, NULL);
 }
 
 void collision_detection::CollisionRobotFCL::checkOtherCollision(const CollisionRequest &req, CollisionResult &res, const robot_state::RobotState &state1, const robot_state::RobotState &state2,
                                                                  const CollisionRobot &other_robot, const robot_state::RobotState &other_state1, const robot_state::RobotState &other_state2,
                                                                  const AllowedCollisionMatrix &acm) const
 {
-  logError("FCL continuous collision checking not yet implemented");
+  checkOtherCollisionHelper(req, res, state1, state2, other_robot, other_state1, other_state2, &acm);
+}
+
+void collision_detection::CollisionRobotFCL::checkOtherCollisionHelper(const CollisionRequest &req, CollisionResult &res, const robot_state::RobotState &state1, const robot_state::RobotState &state2,
+                                                                       const CollisionRobot &other_robot, const robot_state::RobotState &other_state1, const robot_state::RobotState &other_state2,
+                                                                       const AllowedCollisionMatrix *acm) const
+{
+  const CollisionRobotFCL &fcl_rob = dynamic_cast<const CollisionRobotFCL&>(other_robot);
+  OtherCollisionMotion motion(*this, req, res, state1, state2, fcl_rob, other_state1, other_state2, acm);
+  double t = conservativeAdvancement(motion);
+  if (t >= 0.0)
+  {
+    logDebug("Collision with other robot found at time %lf along the motion", t);
+    // the motion could not be shown to be collision free
+    res.collision = true;
+  }
+  if (req.distance)
+    res.distance = res.collision ? 0.0 : std::min(distanceOtherHelper(state1, other_robot, other_state1, acm),
+                                                  distanceOtherHelper(state2, other_robot, other_state2, acm));
 }
 
 void collision_detection::CollisionRobotFCL::checkOtherCollisionHelper(const CollisionRequest &req, CollisionResult &res, const robot_state::RobotState &state,
                                                                        const CollisionRobot &other_robot, const robot_state::RobotState &other_state,
                                                                        const AllowedCollisionMatrix *acm) const
 {
-  FCLManager manager;
-  allocSelfCollisionBroadPhase(state, manager);
-
+  FCLManager &manager = getSelfCollisionBroadPhase(state);
   const CollisionRobotFCL &fcl_rob = dynamic_cast<const CollisionRobotFCL&>(other_robot);
-  FCLObject other_fcl_obj;
-  fcl_rob.constructFCLObject(other_state, other_fcl_obj);
 
   CollisionData cd(&req, &res, acm);
   cd.enableGroup(getRobotModel());
-  for (std::size_t i = 0 ; !cd.done_ && i < other_fcl_obj.collision_objects_.size() ; ++i)
-    manager.manager_->collide(other_fcl_obj.collision_objects_[i].get(), &cd, &collisionCallback);
   if (req.distance)
-    res.distance = distanceOtherHelper(state, other_robot, other_state, acm);
+    // compute contacts and distance in one traversal
+    res.distance = std::numeric_limits<double>::max();
+
+  // the broad phase maintained by the other robot for this thread is used, unless the other robot is this one
+  // (its broad phase then already corresponds to state)
+  if (&fcl_rob != this)
+  {
+    FCLManager &other_manager = fcl_rob.getSelfCollisionBroadPhase(other_state);
+    if (req.distance)
+      manager.manager_->distance(other_manager.manager_.get(), &cd, &collisionDistanceCallback);
+    else
+      manager.manager_->collide(other_manager.manager_.get(), &cd, &collisionCallback);
+    return;
+  }
+
+  FCLObject other_fcl_obj;
+  fcl_rob.constructFCLObject(other_state, other_fcl_obj);
+  if (req.distance)
+    for (std::size_t i = 0 ; !(cd.done_ && res.distance < 0.0) && i < other_fcl_obj.collision_objects_.size() ; ++i)
+      manager.manager_->distance(other_fcl_obj.collision_objects_[i].get(), &cd, &collisionDistanceCallback);
+  else
+    for (std::size_t i = 0 ; !cd.done_ && i < other_fcl_obj.collision_objects_.size() ; ++i)
+      manager.manager_->collide(other_fcl_obj.collision_objects_[i].get(), &cd, &collisionCallback);
 }
 
 void collision_detection::CollisionRobotFCL::updatedPaddingOrScaling(const std::vector<std::string> &links)
@@ -206,6 +653,15 @@ void collision_detection::CollisionRobotFCL::updatedPaddingOrScaling(const std::
     else
       logError("Updating padding or scaling for unknown link: '%s'", links[i].c_str());
   }
+  geoms_version_ = newVersion();
+}
+
+double collision_detection::CollisionRobotFCL::getMotionBound(const robot_state::RobotState &state1, const robot_state::RobotState &state2,
+                                                              const std::string &group) const
+{
+  const std::vector<bool> *links = getRobotModel()->hasJointModelGroup(group) ?
+    &getRobotModel()->getJointModelGroup(group)->getUpdatedLinkModelsWithGeometryMask() : NULL;
+  return motion_validator_->getMaximumMotion(*this, state1, state2, links);
 }
 
 double collision_detection::CollisionRobotFCL::distanceSelf(const robot_state::RobotState &state) const
@@ -219,20 +675,42 @@ double collision_detection::CollisionRobotFCL::distanceSelf(const robot_state::R
   return distanceSelfHelper(state, &acm);
 }
 
+void collision_detection::CollisionRobotFCL::distanceSelf(const DistanceRequest &req, DistanceResult &res,
+                                                          const robot_state::RobotState &state) const
+{
+  distanceSelfHelper(req, res, state, NULL);
+}
+
+void collision_detection::CollisionRobotFCL::distanceSelf(const DistanceRequest &req, DistanceResult &res,
+                                                          const robot_state::RobotState &state,
+                                                          const AllowedCollisionMatrix &acm) const
+{
+  distanceSelfHelper(req, res, state, &acm);
+}
+
 double collision_detection::CollisionRobotFCL::distanceSelfHelper(const robot_state::RobotState &state,
                                                                   const AllowedCollisionMatrix *acm) const
 {
-  FCLManager manager;
-  allocSelfCollisionBroadPhase(state, manager);
+  DistanceRequest req;
+  DistanceResult res;
+  distanceSelfHelper(req, res, state, acm);
+  return res.distance;
+}
 
-  CollisionRequest req;
-  CollisionResult res;
-  CollisionData cd(&req, &res, acm);
+void collision_detection::CollisionRobotFCL::distanceSelfHelper(const DistanceRequest &req, DistanceResult &res,
+                                                                const robot_state::RobotState &state,
+                                                                const AllowedCollisionMatrix *acm) const
+{
+  FCLManager &manager = getSelfCollisionBroadPhase(state);
+
+  CollisionRequest creq;
+  creq.group_name = req.group_name;
+  CollisionResult cres;
+  CollisionData cd(&creq, &cres, acm);
   cd.enableGroup(getRobotModel());
+  setDistanceRequest(req, res, cd);
 
   manager.manager_->distance(&cd, &distanceCallback);
-
-  return res.distance;
 }
 
 double collision_detection::CollisionRobotFCL::distanceOther(const robot_state::RobotState &state,
@@ -255,17 +733,23 @@ double collision_detection::CollisionRobotFCL::distanceOtherHelper(const robot_s
                                                                    const robot_state::RobotState &other_state,
                                                                    const AllowedCollisionMatrix *acm) const
 {
-  FCLManager manager;
-  allocSelfCollisionBroadPhase(state, manager);
-
+  FCLManager &manager = getSelfCollisionBroadPhase(state);
   const CollisionRobotFCL& fcl_rob = dynamic_cast<const CollisionRobotFCL&>(other_robot);
-  FCLObject other_fcl_obj;
-  fcl_rob.constructFCLObject(other_state, other_fcl_obj);
 
   CollisionRequest req;
   CollisionResult res;
   CollisionData cd(&req, &res, acm);
   cd.enableGroup(getRobotModel());
+
+  if (&fcl_rob != this)
+  {
+    FCLManager &other_manager = fcl_rob.getSelfCollisionBroadPhase(other_state);
+    manager.manager_->distance(other_manager.manager_.get(), &cd, &distanceCallback);
+    return res.distance;
+  }
+
+  FCLObject other_fcl_obj;
+  fcl_rob.constructFCLObject(other_state, other_fcl_obj);
   for(std::size_t i = 0; !cd.done_ && i < other_fcl_obj.collision_objects_.size(); ++i)
     manager.manager_->distance(other_fcl_obj.collision_objects_[i].get(), &cd, &distanceCallback);
 
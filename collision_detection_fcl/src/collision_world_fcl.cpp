@@ -35,48 +35,129 @@
 /* Author: Ioan Sucan */
 
 #include <moveit/collision_detection_fcl/collision_world_fcl.h>
+#include <moveit/profiler/profiler.h>
 #include <fcl/shape/geometric_shape_to_BVH_model.h>
 #include <fcl/traversal/traversal_node_bvhs.h>
 #include <fcl/traversal/traversal_node_setup.h>
 #include <fcl/collision_node.h>
 
-collision_detection::CollisionWorldFCL::CollisionWorldFCL() :
-  CollisionWorld()
+namespace collision_detection
+{
+namespace
+{
+
+struct RobotWorldCollisionMotion : public ContinuousMotion
 {
-  fcl::DynamicAABBTreeCollisionManager* m = new fcl::DynamicAABBTreeCollisionManager();
-  // m->tree_init_level = 2;
-  manager_.reset(m);
+  RobotWorldCollisionMotion(const CollisionWorldFCL &world, const CollisionRequest &req, CollisionResult &res,
+                            const CollisionRobotFCL &robot, const robot_state::RobotState &state1,
+                            const robot_state::RobotState &state2, const AllowedCollisionMatrix *acm) :
+    world_(world), req_(req), res_(res), robot_(robot), state1_(state1), state2_(state2), acm_(acm),
+    current_(state1), candidate_(state1)
+  {
+    // distances are computed separately, for every step
+    req_.distance = false;
+  }
+
+  virtual bool check(double t)
+  {
+    state1_.interpolate(state2_, t, current_);
+    current_.updateCollisionBodyTransforms();
+    if (acm_)
+      world_.checkRobotCollision(req_, res_, robot_, current_, *acm_);
+    else
+      world_.checkRobotCollision(req_, res_, robot_, current_);
+    return res_.collision;
+  }
+
+  virtual double distance()
+  {
+    // only the links of the group are checked
+    DistanceRequest dreq;
+    dreq.group_name = req_.group_name;
+    DistanceResult dres;
+    if (acm_)
+      world_.distanceRobot(dreq, dres, robot_, current_, *acm_);
+    else
+      world_.distanceRobot(dreq, dres, robot_, current_);
+    return dres.distance;
+  }
+
+  virtual double motionBound(double t)
+  {
+    state1_.interpolate(state2_, t, candidate_);
+    // the world does not move
+    return robot_.getMotionBound(current_, candidate_, req_.group_name);
+  }
+
+  const CollisionWorldFCL        &world_;
+  CollisionRequest                req_;
+  CollisionResult                &res_;
+  const CollisionRobotFCL        &robot_;
+  const robot_state::RobotState  &state1_;
+  const robot_state::RobotState  &state2_;
+  const AllowedCollisionMatrix   *acm_;
+  robot_state::RobotState         current_;
+  robot_state::RobotState         candidate_;
+};
+
+}
+}
+
+collision_detection::CollisionWorldFCL::BroadPhase::BroadPhase() :
+  manager_(new fcl::DynamicAABBTreeCollisionManager())
+{
+}
+
+collision_detection::CollisionWorldFCL::BroadPhase::BroadPhase(const BroadPhase &other) :
+  manager_(new fcl::DynamicAABBTreeCollisionManager()),
+  fcl_objs_(other.fcl_objs_)
+{
+  for (std::map<std::string, FCLObject>::iterator it = fcl_objs_.begin() ; it != fcl_objs_.end() ; ++it)
+    it->second.registerTo(manager_.get());
+  // manager_->update();
+}
 
+collision_detection::CollisionWorldFCL::CollisionWorldFCL() :
+  CollisionWorld(),
+  broad_phase_(new BroadPhase())
+{
   // request notifications about changes to new world
-  observer_handle_ = getWorld()->addObserver(boost::bind(&CollisionWorldFCL::notifyObjectChange, this, _1, _2));
+  observer_handle_ = getWorld()->addObserver(boost::bind(&CollisionWorldFCL::notifyObjectChange, this, _1, _2),
+                                              boost::bind(&CollisionWorldFCL::notifyObjectChanges, this, _1));
 }
 
 collision_detection::CollisionWorldFCL::CollisionWorldFCL(const WorldPtr& world) :
-  CollisionWorld(world)
+  CollisionWorld(world),
+  broad_phase_(new BroadPhase())
 {
-  fcl::DynamicAABBTreeCollisionManager* m = new fcl::DynamicAABBTreeCollisionManager();
-  // m->tree_init_level = 2;
-  manager_.reset(m);
-
   // request notifications about changes to new world
-  observer_handle_ = getWorld()->addObserver(boost::bind(&CollisionWorldFCL::notifyObjectChange, this, _1, _2));
+  observer_handle_ = getWorld()->addObserver(boost::bind(&CollisionWorldFCL::notifyObjectChange, this, _1, _2),
+                                              boost::bind(&CollisionWorldFCL::notifyObjectChanges, this, _1));
   getWorld()->notifyObserverAllObjects(observer_handle_, World::CREATE);
 }
 
 collision_detection::CollisionWorldFCL::CollisionWorldFCL(const CollisionWorldFCL &other, const WorldPtr& world) :
   CollisionWorld(other, world)
 {
-  fcl::DynamicAABBTreeCollisionManager* m = new fcl::DynamicAABBTreeCollisionManager();
-  // m->tree_init_level = 2;
-  manager_.reset(m);
-
-  fcl_objs_ = other.fcl_objs_;
-  for (std::map<std::string, FCLObject>::iterator it = fcl_objs_.begin() ; it != fcl_objs_.end() ; ++it)
-    it->second.registerTo(manager_.get());
-  // manager_->update();
+  // instead of registering all the objects of other to a new manager, query the broad phase of other directly;
+  // only the objects that change in this world are kept in broad_phase_
+  if (other.parent_broad_phase_)
+  {
+    // other is itself a copy; share its parent and copy the (usually few) objects that changed in other
+    parent_broad_phase_ = other.parent_broad_phase_;
+    masked_ids_ = other.masked_ids_;
+    masked_objects_ = other.masked_objects_;
+    broad_phase_.reset(new BroadPhase(*other.broad_phase_));
+  }
+  else
+  {
+    parent_broad_phase_ = other.broad_phase_;
+    broad_phase_.reset(new BroadPhase());
+  }
 
   // request notifications about changes to new world
-  observer_handle_ = getWorld()->addObserver(boost::bind(&CollisionWorldFCL::notifyObjectChange, this, _1, _2));
+  observer_handle_ = getWorld()->addObserver(boost::bind(&CollisionWorldFCL::notifyObjectChange, this, _1, _2),
+                                              boost::bind(&CollisionWorldFCL::notifyObjectChanges, this, _1));
 }
 
 collision_detection::CollisionWorldFCL::~CollisionWorldFCL()
@@ -96,27 +177,67 @@ void collision_detection::CollisionWorldFCL::checkRobotCollision(const Collision
 
 void collision_detection::CollisionWorldFCL::checkRobotCollision(const CollisionRequest &req, CollisionResult &res, const CollisionRobot &robot, const robot_state::RobotState &state1, const robot_state::RobotState &state2) const
 {
-  logError("FCL continuous collision checking not yet implemented");
+  checkRobotCollisionHelper(req, res, robot, state1, state2, NULL);
 }
 
 void collision_detection::CollisionWorldFCL::checkRobotCollision(const CollisionRequest &req, CollisionResult &res, const CollisionRobot &robot, const robot_state::RobotState &state1, const robot_state::RobotState &state2, const AllowedCollisionMatrix &acm) const
 {
-  logError("FCL continuous collision checking not yet implemented");
+  checkRobotCollisionHelper(req, res, robot, state1, state2, &acm);
+}
+
+void collision_detection::CollisionWorldFCL::checkRobotCollisionHelper(const CollisionRequest &req, CollisionResult &res, const CollisionRobot &robot, const robot_state::RobotState &state1,
+                                                                       const robot_state::RobotState &state2, const AllowedCollisionMatrix *acm) const
+{
+  const CollisionRobotFCL &robot_fcl = dynamic_cast<const CollisionRobotFCL&>(robot);
+  RobotWorldCollisionMotion motion(*this, req, res, robot_fcl, state1, state2, acm);
+  double t = conservativeAdvancement(motion);
+  if (t >= 0.0)
+  {
+    logDebug("Collision with the world found at time %lf along the motion", t);
+    // the motion could not be shown to be collision free
+    res.collision = true;
+  }
+  if (req.distance)
+    res.distance = res.collision ? 0.0 : std::min(distanceRobotHelper(robot, state1, acm), distanceRobotHelper(robot, state2, acm));
 }
 
 void collision_detection::CollisionWorldFCL::checkRobotCollisionHelper(const CollisionRequest &req, CollisionResult &res, const CollisionRobot &robot, const robot_state::RobotState &state, const AllowedCollisionMatrix *acm) const
 {
+  MOVEIT_CORE_PROBE("CollisionWorldFCL::checkRobotCollisionHelper");
   const CollisionRobotFCL &robot_fcl = dynamic_cast<const CollisionRobotFCL&>(robot);
-  FCLObject fcl_obj;
-  robot_fcl.constructFCLObject(state, fcl_obj);
+  // the robot objects are kept in a broad phase manager of their own, so the world can be checked
+  // with a single traversal of both trees instead of a separate query for every robot object
+  FCLManager &robot_fcl_manager = robot_fcl.getSelfCollisionBroadPhase(state);
+  fcl::BroadPhaseCollisionManager *robot_manager = robot_fcl_manager.manager_.get();
 
   CollisionData cd(&req, &res, acm);
   cd.enableGroup(robot.getRobotModel());
-  for (std::size_t i = 0 ; !cd.done_ && i < fcl_obj.collision_objects_.size() ; ++i)
-    manager_->collide(fcl_obj.collision_objects_[i].get(), &cd, &collisionCallback);
-
+  if (!masked_objects_.empty())
+    cd.masked_objects_ = &masked_objects_;
+  fcl::BroadPhaseCollisionManager *managers[2];
+  std::size_t manager_count = getManagers(managers);
   if (req.distance)
-    res.distance = distanceRobotHelper(robot, state, acm);
+  {
+    // compute contacts and distance in one traversal
+    res.distance = std::numeric_limits<double>::max();
+    for (std::size_t j = 0 ; !(cd.done_ && res.distance < 0.0) && j < manager_count ; ++j)
+      managers[j]->distance(robot_manager, &cd, &collisionDistanceCallback);
+  }
+  else
+  {
+    // if only a few robot objects are relevant for the requested group, query the world with those objects only
+    std::vector<fcl::CollisionObject*> active;
+    if (cd.active_components_only_ &&
+        getActiveCollisionObjects(cd, robot_fcl_manager.object_, robot_fcl_manager.object_.collision_objects_.size() / 2, active))
+    {
+      for (std::size_t j = 0 ; !cd.done_ && j < manager_count ; ++j)
+        for (std::size_t i = 0 ; !cd.done_ && i < active.size() ; ++i)
+          managers[j]->collide(active[i], &cd, &collisionCallback);
+    }
+    else
+      for (std::size_t j = 0 ; !cd.done_ && j < manager_count ; ++j)
+        managers[j]->collide(robot_manager, &cd, &collisionCallback);
+  }
 }
 
 void collision_detection::CollisionWorldFCL::checkWorldCollision(const CollisionRequest &req, CollisionResult &res, const CollisionWorld &other_world) const
@@ -133,7 +254,14 @@ void collision_detection::CollisionWorldFCL::checkWorldCollisionHelper(const Col
 {
   const CollisionWorldFCL &other_fcl_world = dynamic_cast<const CollisionWorldFCL&>(other_world);
   CollisionData cd(&req, &res, acm);
-  manager_->collide(other_fcl_world.manager_.get(), &cd, &collisionCallback);
+  std::set<const fcl::CollisionObject*> masked;
+  cd.masked_objects_ = getMaskedObjects(other_fcl_world, masked);
+  fcl::BroadPhaseCollisionManager *managers[2], *other_managers[2];
+  std::size_t manager_count = getManagers(managers);
+  std::size_t other_manager_count = other_fcl_world.getManagers(other_managers);
+  for (std::size_t i = 0 ; !cd.done_ && i < manager_count ; ++i)
+    for (std::size_t j = 0 ; !cd.done_ && j < other_manager_count ; ++j)
+      managers[i]->collide(other_managers[j], &cd, &collisionCallback);
 
   if (req.distance)
     res.distance = distanceWorldHelper(other_world, acm);
@@ -153,13 +281,58 @@ void collision_detection::CollisionWorldFCL::constructFCLObject(const World::Obj
   }
 }
 
+std::size_t collision_detection::CollisionWorldFCL::getManagers(fcl::BroadPhaseCollisionManager *managers[2]) const
+{
+  std::size_t count = 0;
+  if (!broad_phase_->fcl_objs_.empty())
+    managers[count++] = broad_phase_->manager_.get();
+  if (parent_broad_phase_)
+    managers[count++] = parent_broad_phase_->manager_.get();
+  return count;
+}
+
+const std::set<const fcl::CollisionObject*>*
+collision_detection::CollisionWorldFCL::getMaskedObjects(const CollisionWorldFCL &other_world,
+                                                         std::set<const fcl::CollisionObject*> &storage) const
+{
+  if (masked_objects_.empty())
+    return other_world.masked_objects_.empty() ? NULL : &other_world.masked_objects_;
+  if (other_world.masked_objects_.empty())
+    return &masked_objects_;
+  storage = masked_objects_;
+  storage.insert(other_world.masked_objects_.begin(), other_world.masked_objects_.end());
+  return &storage;
+}
+
+void collision_detection::CollisionWorldFCL::makeBroadPhaseUnique()
+{
+  // copy on write: the worlds constructed as copies of this one keep using the current broad phase
+  if (!broad_phase_.unique())
+    broad_phase_.reset(new BroadPhase(*broad_phase_));
+}
+
+void collision_detection::CollisionWorldFCL::maskParentObject(const std::string &id)
+{
+  if (!parent_broad_phase_ || !masked_ids_.insert(id).second)
+    return;
+  std::map<std::string, FCLObject>::const_iterator it = parent_broad_phase_->fcl_objs_.find(id);
+  if (it != parent_broad_phase_->fcl_objs_.end())
+    for (std::size_t i = 0 ; i < it->second.collision_objects_.size() ; ++i)
+      masked_objects_.insert(it->second.collision_objects_[i].get());
+}
+
 void collision_detection::CollisionWorldFCL::updateFCLObject(const std::string &id)
 {
+  maskParentObject(id);
+  makeBroadPhaseUnique();
+  std::map<std::string, FCLObject> &fcl_objs = broad_phase_->fcl_objs_;
+  fcl::BroadPhaseCollisionManager *manager = broad_phase_->manager_.get();
+
   // remove FCL objects that correspond to this object
-  std::map<std::string, FCLObject>::iterator jt = fcl_objs_.find(id);
-  if (jt != fcl_objs_.end())
+  std::map<std::string, FCLObject>::iterator jt = fcl_objs.find(id);
+  if (jt != fcl_objs.end())
   {
-    jt->second.unregisterFrom(manager_.get());
+    jt->second.unregisterFrom(manager);
     jt->second.clear();
   }
 
@@ -168,26 +341,51 @@ void collision_detection::CollisionWorldFCL::updateFCLObject(const std::string &
   if (it != getWorld()->end())
   {
     // construct FCL objects that correspond to this object
-    if (jt != fcl_objs_.end())
+    if (jt != fcl_objs.end())
     {
       constructFCLObject(it->second.get(), jt->second);
-      jt->second.registerTo(manager_.get());
+      jt->second.registerTo(manager);
     }
     else
     {
-      constructFCLObject(it->second.get(), fcl_objs_[id]);
-      fcl_objs_[id].registerTo(manager_.get());
+      constructFCLObject(it->second.get(), fcl_objs[id]);
+      fcl_objs[id].registerTo(manager);
     }
   }
   else
   {
-    if (jt != fcl_objs_.end())
-      fcl_objs_.erase(jt);
+    if (jt != fcl_objs.end())
+      fcl_objs.erase(jt);
   }
 
   // manager_->update();
 }
 
+bool collision_detection::CollisionWorldFCL::moveFCLObject(const World::Object *obj, std::vector<fcl::CollisionObject*> &moved)
+{
+  std::map<std::string, FCLObject>::iterator it = broad_phase_->fcl_objs_.find(obj->id_);
+  if (it == broad_phase_->fcl_objs_.end())
+    return false;
+
+  // the FCL objects can only be modified if no other broad phase uses them, and their
+  // geometry refers to this instance of the object (the world may have copied it on write)
+  FCLObject &fcl_obj = it->second;
+  if (fcl_obj.collision_objects_.size() != obj->shapes_.size())
+    return false;
+  for (std::size_t i = 0 ; i < fcl_obj.collision_objects_.size() ; ++i)
+    if (!fcl_obj.collision_objects_[i].unique() || fcl_obj.collision_geometry_[i]->collision_geometry_data_->ptr.obj != obj)
+      return false;
+
+  for (std::size_t i = 0 ; i < fcl_obj.collision_objects_.size() ; ++i)
+  {
+    fcl::CollisionObject *co = fcl_obj.collision_objects_[i].get();
+    co->setTransform(transform2fcl(obj->shape_poses_[i]));
+    co->computeAABB();
+    moved.push_back(co);
+  }
+  return true;
+}
+
 void collision_detection::CollisionWorldFCL::setWorld(const WorldPtr& world)
 {
   if (world == getWorld())
@@ -197,14 +395,17 @@ void collision_detection::CollisionWorldFCL::setWorld(const WorldPtr& world)
   getWorld()->removeObserver(observer_handle_);
 
   // clear out objects from old world
-  manager_->clear();
-  fcl_objs_.clear();
+  broad_phase_.reset(new BroadPhase());
+  parent_broad_phase_.reset();
+  masked_ids_.clear();
+  masked_objects_.clear();
   cleanCollisionGeometryCache();
 
   CollisionWorld::setWorld(world);
 
   // request notifications about changes to new world
-  observer_handle_ = getWorld()->addObserver(boost::bind(&CollisionWorldFCL::notifyObjectChange, this, _1, _2));
+  observer_handle_ = getWorld()->addObserver(boost::bind(&CollisionWorldFCL::notifyObjectChange, this, _1, _2),
+                                              boost::bind(&CollisionWorldFCL::notifyObjectChanges, this, _1));
 
   // get notifications any objects already in the new world
   getWorld()->notifyObserverAllObjects(observer_handle_, World::CREATE);
@@ -214,41 +415,121 @@ void collision_detection::CollisionWorldFCL::notifyObjectChange(const ObjectCons
 {
   if (action == World::DESTROY)
   {
-    std::map<std::string, FCLObject>::iterator it = fcl_objs_.find(obj->id_);
-    if (it != fcl_objs_.end())
+    maskParentObject(obj->id_);
+    std::map<std::string, FCLObject>::iterator it = broad_phase_->fcl_objs_.find(obj->id_);
+    if (it != broad_phase_->fcl_objs_.end())
     {
-      it->second.unregisterFrom(manager_.get());
+      makeBroadPhaseUnique();
+      it = broad_phase_->fcl_objs_.find(obj->id_);
+      it->second.unregisterFrom(broad_phase_->manager_.get());
       it->second.clear();
-      fcl_objs_.erase(it);
+      broad_phase_->fcl_objs_.erase(it);
     }
     cleanCollisionGeometryCache();
   }
   else
   {
+    if (action == World::MOVE_SHAPE)
+    {
+      makeBroadPhaseUnique();
+      std::vector<fcl::CollisionObject*> moved;
+      if (moveFCLObject(obj.get(), moved))
+      {
+        // refit the nodes of the moved objects instead of registering them again
+        broad_phase_->manager_->update(moved);
+        return;
+      }
+    }
     updateFCLObject(obj->id_);
     if (action & (World::DESTROY|World::REMOVE_SHAPE))
       cleanCollisionGeometryCache();
   }
 }
 
-double collision_detection::CollisionWorldFCL::distanceRobotHelper(const CollisionRobot &robot, const robot_state::RobotState &state, const AllowedCollisionMatrix *acm) const
+void collision_detection::CollisionWorldFCL::notifyObjectChanges(const World::ObjectChanges &changes)
 {
-  const CollisionRobotFCL& robot_fcl = dynamic_cast<const CollisionRobotFCL&>(robot);
-  FCLObject fcl_obj;
-  robot_fcl.constructFCLObject(state, fcl_obj);
+  makeBroadPhaseUnique();
+  std::map<std::string, FCLObject> &fcl_objs = broad_phase_->fcl_objs_;
+  fcl::BroadPhaseCollisionManager *manager = broad_phase_->manager_.get();
+
+  // when many objects change, registering all objects to an empty manager builds a balanced tree faster
+  // than updating the objects one by one
+  bool rebuild = changes.size() >= 16 && changes.size() * 4 >= fcl_objs.size();
+  if (rebuild)
+    manager->clear();
+
+  bool clean_cache = false;
+  FCLObject added;
+  std::vector<fcl::CollisionObject*> moved;
+  for (std::size_t i = 0 ; i < changes.size() ; ++i)
+  {
+    const ObjectConstPtr &obj = changes[i].first;
+    if (changes[i].second == World::MOVE_SHAPE && moveFCLObject(obj.get(), moved))
+      continue;
+    maskParentObject(obj->id_);
+    std::map<std::string, FCLObject>::iterator it = fcl_objs.find(obj->id_);
+    if (it != fcl_objs.end())
+    {
+      if (!rebuild)
+        it->second.unregisterFrom(manager);
+      it->second.clear();
+    }
+    if (changes[i].second == World::DESTROY)
+    {
+      if (it != fcl_objs.end())
+        fcl_objs.erase(it);
+      clean_cache = true;
+      continue;
+    }
+    if (changes[i].second & World::REMOVE_SHAPE)
+      clean_cache = true;
 
-  CollisionRequest req;
-  CollisionResult res;
-  CollisionData cd(&req, &res, acm);
-  cd.enableGroup(robot.getRobotModel());
+    FCLObject &fcl_obj = it != fcl_objs.end() ? it->second : fcl_objs[obj->id_];
+    constructFCLObject(obj.get(), fcl_obj);
+    if (!rebuild)
+      added.collision_objects_.insert(added.collision_objects_.end(), fcl_obj.collision_objects_.begin(), fcl_obj.collision_objects_.end());
+  }
 
-  for(std::size_t i = 0; !cd.done_ && i < fcl_obj.collision_objects_.size(); ++i)
-    manager_->distance(fcl_obj.collision_objects_[i].get(), &cd, &distanceCallback);
+  if (rebuild)
+    for (std::map<std::string, FCLObject>::const_iterator it = fcl_objs.begin() ; it != fcl_objs.end() ; ++it)
+      added.collision_objects_.insert(added.collision_objects_.end(), it->second.collision_objects_.begin(), it->second.collision_objects_.end());
+  added.registerTo(manager);
+  if (!rebuild && !moved.empty())
+    manager->update(moved);
 
+  if (clean_cache)
+    cleanCollisionGeometryCache();
+}
 
+double collision_detection::CollisionWorldFCL::distanceRobotHelper(const CollisionRobot &robot, const robot_state::RobotState &state, const AllowedCollisionMatrix *acm) const
+{
+  DistanceRequest req;
+  DistanceResult res;
+  distanceRobotHelper(req, res, robot, state, acm);
   return res.distance;
 }
 
+void collision_detection::CollisionWorldFCL::distanceRobotHelper(const DistanceRequest &req, DistanceResult &res, const CollisionRobot &robot,
+                                                                 const robot_state::RobotState &state, const AllowedCollisionMatrix *acm) const
+{
+  const CollisionRobotFCL& robot_fcl = dynamic_cast<const CollisionRobotFCL&>(robot);
+  fcl::BroadPhaseCollisionManager *robot_manager = robot_fcl.getSelfCollisionBroadPhase(state).manager_.get();
+
+  CollisionRequest creq;
+  creq.group_name = req.group_name;
+  CollisionResult cres;
+  CollisionData cd(&creq, &cres, acm);
+  cd.enableGroup(robot.getRobotModel());
+  setDistanceRequest(req, res, cd);
+  if (!masked_objects_.empty())
+    cd.masked_objects_ = &masked_objects_;
+
+  fcl::BroadPhaseCollisionManager *managers[2];
+  std::size_t manager_count = getManagers(managers);
+  for (std::size_t j = 0 ; !cd.done_ && j < manager_count ; ++j)
+    managers[j]->distance(robot_manager, &cd, &distanceCallback);
+}
+
 double collision_detection::CollisionWorldFCL::distanceRobot(const CollisionRobot &robot, const robot_state::RobotState &state) const
 {
   return distanceRobotHelper(robot, state, NULL);
@@ -259,6 +540,18 @@ double collision_detection::CollisionWorldFCL::distanceRobot(const CollisionRobo
   return distanceRobotHelper(robot, state, &acm);
 }
 
+void collision_detection::CollisionWorldFCL::distanceRobot(const DistanceRequest &req, DistanceResult &res, const CollisionRobot &robot,
+                                                           const robot_state::RobotState &state) const
+{
+  distanceRobotHelper(req, res, robot, state, NULL);
+}
+
+void collision_detection::CollisionWorldFCL::distanceRobot(const DistanceRequest &req, DistanceResult &res, const CollisionRobot &robot,
+                                                           const robot_state::RobotState &state, const AllowedCollisionMatrix &acm) const
+{
+  distanceRobotHelper(req, res, robot, state, &acm);
+}
+
 double collision_detection::CollisionWorldFCL::distanceWorld(const CollisionWorld &world) const
 {
   return distanceWorldHelper(world, NULL);
@@ -275,7 +568,14 @@ double collision_detection::CollisionWorldFCL::distanceWorldHelper(const Collisi
   CollisionRequest req;
   CollisionResult res;
   CollisionData cd(&req, &res, acm);
-  manager_->distance(other_fcl_world.manager_.get(), &cd, &distanceCallback);
+  std::set<const fcl::CollisionObject*> masked;
+  cd.masked_objects_ = getMaskedObjects(other_fcl_world, masked);
+  fcl::BroadPhaseCollisionManager *managers[2], *other_managers[2];
+  std::size_t manager_count = getManagers(managers);
+  std::size_t other_manager_count = other_fcl_world.getManagers(other_managers);
+  for (std::size_t i = 0 ; !cd.done_ && i < manager_count ; ++i)
+    for (std::size_t j = 0 ; !cd.done_ && j < other_manager_count ; ++j)
+      managers[i]->distance(other_managers[j], &cd, &distanceCallback);
 
   return res.distance;
 }
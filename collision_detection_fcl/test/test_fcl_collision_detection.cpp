@@ -39,6 +39,11 @@
 #include <moveit/robot_state/robot_state.h>
 #include <moveit/collision_detection_fcl/collision_world_fcl.h>
 #include <moveit/collision_detection_fcl/collision_robot_fcl.h>
+#include <moveit/collision_detection/conservative_motion_validator.h>
+#include <moveit/collision_detection/recording/collision_detector_allocator_recording.h>
+#include <moveit/collision_detection_fcl/collision_detector_allocator_fcl.h>
+#include <fcl/BVH/BVH_model.h>
+#include <octomap/octomap.h>
 
 #include <urdf_parser/urdf_parser.h>
 #include <geometric_shapes/shape_operations.h>
@@ -50,6 +55,10 @@
 #include <fstream>
 
 #include <boost/filesystem.hpp>
+#include <boost/thread.hpp>
+#include <boost/bind.hpp>
+#include <boost/aligned_storage.hpp>
+#include <boost/type_traits/alignment_of.hpp>
 
 typedef collision_detection::CollisionWorldFCL DefaultCWorldType;
 typedef collision_detection::CollisionRobotFCL DefaultCRobotType;
@@ -569,6 +578,1007 @@ TEST_F(FclCollisionDetectionTester, TestChangingShapeSize)
   }
 }
 
+TEST_F(FclCollisionDetectionTester, ContinuousCollisionWithWorld)
+{
+  robot_state::RobotState kstate1(kmodel_);
+  kstate1.setToDefaultValues();
+  kstate1.setVariablePosition("world_joint/x", -3.0);
+  kstate1.update();
+
+  robot_state::RobotState kstate2(kstate1);
+  kstate2.setVariablePosition("world_joint/x", 3.0);
+  kstate2.update();
+
+  Eigen::Affine3d pos = Eigen::Affine3d::Identity();
+  pos.translation().z() = 1.0;
+  cworld_->getWorld()->addToObject("box", shapes::ShapeConstPtr(new shapes::Box(.1, .1, .1)), pos);
+
+  collision_detection::CollisionRequest req;
+  collision_detection::CollisionResult res;
+  cworld_->checkRobotCollision(req, res, *crobot_, kstate1, *acm_);
+  ASSERT_FALSE(res.collision);
+  res.clear();
+  cworld_->checkRobotCollision(req, res, *crobot_, kstate2, *acm_);
+  ASSERT_FALSE(res.collision);
+
+  // the robot passes through the box when moving between the two states
+  res.clear();
+  cworld_->checkRobotCollision(req, res, *crobot_, kstate1, kstate2, *acm_);
+  EXPECT_TRUE(res.collision);
+
+  // moving the box out of the way makes the motion valid
+  cworld_->getWorld()->moveShapeInObject("box", cworld_->getWorld()->getObject("box")->shapes_[0], Eigen::Affine3d(Eigen::Translation3d(0.0, 10.0, 1.0)));
+  res.clear();
+  cworld_->checkRobotCollision(req, res, *crobot_, kstate1, kstate2, *acm_);
+  EXPECT_FALSE(res.collision);
+}
+
+TEST_F(FclCollisionDetectionTester, ContinuousSelfCollision)
+{
+  robot_state::RobotState kstate1(kmodel_);
+  kstate1.setToDefaultValues();
+  kstate1.setVariablePosition("r_wrist_roll_joint", 1.4);
+  kstate1.update();
+
+  // a long bar held by the right gripper; with the wrist rolled it points up and down, clear of the left arm
+  std::vector<shapes::ShapeConstPtr> shapes(1, shapes::ShapeConstPtr(new shapes::Box(.02, 1.0, .02)));
+  EigenSTL::vector_Affine3d poses(1, Eigen::Affine3d::Identity());
+  kstate1.attachBody("bar", shapes, poses, std::vector<std::string>(), "r_gripper_palm_link");
+  acm_->setEntry("bar", kmodel_->getLinkModelNames(), true);
+  std::vector<std::string> left_links;
+  for (std::size_t i = 0 ; i < kmodel_->getLinkModelNames().size() ; ++i)
+    if (kmodel_->getLinkModelNames()[i].compare(0, 2, "l_") == 0)
+      left_links.push_back(kmodel_->getLinkModelNames()[i]);
+  acm_->setEntry("bar", left_links, false);
+
+  robot_state::RobotState kstate2(kstate1);
+  kstate2.setVariablePosition("r_wrist_roll_joint", -1.4);
+  kstate2.update();
+
+  collision_detection::CollisionRequest req;
+  collision_detection::CollisionResult res;
+  crobot_->checkSelfCollision(req, res, kstate1, *acm_);
+  ASSERT_FALSE(res.collision);
+  res.clear();
+  crobot_->checkSelfCollision(req, res, kstate2, *acm_);
+  ASSERT_FALSE(res.collision);
+
+  // half way, the bar is horizontal and sweeps through the left arm
+  res.clear();
+  crobot_->checkSelfCollision(req, res, kstate1, kstate2, *acm_);
+  EXPECT_TRUE(res.collision);
+
+  // without the left arm in the way, the motion is collision free
+  acm_->setEntry("bar", left_links, true);
+  res.clear();
+  crobot_->checkSelfCollision(req, res, kstate1, kstate2, *acm_);
+  EXPECT_FALSE(res.collision);
+}
+
+TEST_F(FclCollisionDetectionTester, MotionBoundCoversIntermediateStates)
+{
+  DefaultCRobotType crobot(kmodel_);
+  robot_state::RobotState kstate1(kmodel_);
+  kstate1.setToDefaultValues();
+  kstate1.setVariablePosition("r_shoulder_pan_joint", -2.0);
+  kstate1.update();
+  robot_state::RobotState kstate2(kstate1);
+  kstate2.setVariablePosition("r_shoulder_pan_joint", 0.5);
+  kstate2.update();
+
+  // the gripper moves along an arc about the shoulder axis, which is longer than the distance between the end poses
+  Eigen::Vector3d d = kstate1.getGlobalLinkTransform("r_gripper_palm_link").translation() -
+    kstate1.getGlobalLinkTransform("r_shoulder_pan_link").translation();
+  double arc = 2.5 * Eigen::Vector2d(d.x(), d.y()).norm();
+  EXPECT_GE(crobot.getMotionBound(kstate1, kstate2), arc);
+
+  // the bound along a part of the motion is no larger than the bound of the whole motion
+  robot_state::RobotState kstate3(kstate1);
+  kstate1.interpolate(kstate2, 0.5, kstate3);
+  EXPECT_LE(crobot.getMotionBound(kstate1, kstate3), crobot.getMotionBound(kstate1, kstate2));
+  EXPECT_EQ(0.0, crobot.getMotionBound(kstate1, kstate1));
+
+  // restricted to a group, only the links the group updates count
+  EXPECT_EQ(crobot.getMotionBound(kstate1, kstate2), crobot.getMotionBound(kstate1, kstate2, "right_arm"));
+  EXPECT_EQ(0.0, crobot.getMotionBound(kstate1, kstate2, "left_arm"));
+}
+
+TEST_F(FclCollisionDetectionTester, OctomapCostsIncludeFreeCells)
+{
+  robot_state::RobotState kstate(kmodel_);
+  kstate.setToDefaultValues();
+  kstate.update();
+
+  // a map in which the space around the base has been observed to be free many times
+  boost::shared_ptr<octomap::OcTree> octree(new octomap::OcTree(0.1));
+  for (int k = 0 ; k < 20 ; ++k)
+    for (double x = -0.5 ; x <= 0.5 ; x += 0.1)
+      for (double y = -0.5 ; y <= 0.5 ; y += 0.1)
+        for (double z = 0.05 ; z <= 0.5 ; z += 0.1)
+          octree->updateNode(octomap::point3d(x, y, z), false);
+  octree->updateInnerOccupancy();
+  cworld_->getWorld()->addToObject("map", shapes::ShapeConstPtr(new shapes::OcTree(octree)), Eigen::Affine3d::Identity());
+
+  collision_detection::CollisionRequest req;
+  collision_detection::CollisionResult res;
+  cworld_->checkRobotCollision(req, res, *crobot_, kstate, *acm_);
+  EXPECT_FALSE(res.collision);
+
+  // the free cells are skipped when looking for collisions, but still produce cost sources
+  req.cost = true;
+  req.max_cost_sources = 10;
+  res.clear();
+  cworld_->checkRobotCollision(req, res, *crobot_, kstate, *acm_);
+  EXPECT_FALSE(res.collision);
+  EXPECT_FALSE(res.cost_sources.empty());
+}
+
+TEST_F(FclCollisionDetectionTester, CascadeMatchesExactChecks)
+{
+  shapes::ShapeConstPtr shape(shapes::createMeshFromResource("file://" + kinect_dae_file));
+  ASSERT_TRUE(shape);
+  Eigen::Affine3d pose = Eigen::Affine3d::Identity();
+  pose.translation().z() = 0.8;
+  cworld_->getWorld()->addToObject("kinect", shape, pose);
+
+  // the sensor is moved past the grippers, so the pairs range from clearly apart to deep in collision
+  robot_state::RobotState kstate(kmodel_);
+  kstate.setToDefaultValues();
+  collision_detection::CollisionRequest req;
+  collision_detection::CollisionRequest cascade_req;
+  cascade_req.cascade = true;
+  unsigned int collisions = 0;
+  for (double x = -1.0 ; x <= 1.5 ; x += 0.05)
+  {
+    pose.translation().x() = x;
+    cworld_->getWorld()->moveShapeInObject("kinect", shape, pose);
+    collision_detection::CollisionResult res;
+    collision_detection::CollisionResult cascade_res;
+    cworld_->checkRobotCollision(req, res, *crobot_, kstate, *acm_);
+    cworld_->checkRobotCollision(cascade_req, cascade_res, *crobot_, kstate, *acm_);
+    EXPECT_EQ(res.collision, cascade_res.collision) << "at x = " << x;
+    if (res.collision)
+      ++collisions;
+  }
+  EXPECT_GT(collisions, 0u);
+}
+
+TEST_F(FclCollisionDetectionTester, ConservativeMotionValidation)
+{
+  robot_state::RobotState kstate1(kmodel_);
+  kstate1.setToDefaultValues();
+  kstate1.setVariablePosition("world_joint/x", -3.0);
+  kstate1.update();
+
+  robot_state::RobotState kstate2(kstate1);
+  kstate2.setVariablePosition("world_joint/x", 3.0);
+  kstate2.update();
+
+  // the largest motion is at least the translation of the base
+  collision_detection::ConservativeMotionValidator validator(kmodel_);
+  EXPECT_GE(validator.getMaximumMotion(*crobot_, kstate1, kstate2), 6.0);
+  EXPECT_EQ(0.0, validator.getMaximumMotion(*crobot_, kstate1, kstate1));
+
+  Eigen::Affine3d pos = Eigen::Affine3d::Identity();
+  pos.translation().z() = 1.0;
+  cworld_->getWorld()->addToObject("box", shapes::ShapeConstPtr(new shapes::Box(.1, .1, .1)), pos);
+
+  // the robot passes through the box when moving between the two states
+  std::size_t queries = 0;
+  EXPECT_FALSE(validator.isMotionValid(*cworld_, *crobot_, kstate1, kstate2, *acm_, &queries));
+  EXPECT_GT(queries, 2u);
+
+  // far from the box, the distances at the ends of the motion are enough
+  cworld_->getWorld()->moveShapeInObject("box", cworld_->getWorld()->getObject("box")->shapes_[0], Eigen::Affine3d(Eigen::Translation3d(0.0, 10.0, 1.0)));
+  EXPECT_TRUE(validator.isMotionValid(*cworld_, *crobot_, kstate1, kstate2, *acm_, &queries));
+  EXPECT_EQ(2u, queries);
+
+  // close to the box, the motion is split, but still needs fewer queries than checks at the resolution
+  cworld_->getWorld()->moveShapeInObject("box", cworld_->getWorld()->getObject("box")->shapes_[0], Eigen::Affine3d(Eigen::Translation3d(0.0, 1.5, 1.0)));
+  EXPECT_TRUE(validator.isMotionValid(*cworld_, *crobot_, kstate1, kstate2, *acm_, &queries));
+  EXPECT_LT(queries, 6.0 / validator.getResolution());
+}
+
+TEST_F(FclCollisionDetectionTester, BoundedDistance)
+{
+  robot_state::RobotState kstate(kmodel_);
+  kstate.setToDefaultValues();
+  kstate.update();
+
+  Eigen::Affine3d pos = Eigen::Affine3d::Identity();
+  pos.translation().x() = 2.0;
+  pos.translation().z() = 1.0;
+  cworld_->getWorld()->addToObject("box", shapes::ShapeConstPtr(new shapes::Box(.1, .1, .1)), pos);
+  pos.translation().x() = 5.0;
+  cworld_->getWorld()->addToObject("far_box", shapes::ShapeConstPtr(new shapes::Box(.1, .1, .1)), pos);
+
+  double d = cworld_->distanceRobot(*crobot_, kstate, *acm_);
+  ASSERT_GT(d, 0.1);
+
+  // distances beyond the bound are not computed
+  collision_detection::DistanceRequest req;
+  collision_detection::DistanceResult res;
+  req.max_distance = d / 2.0;
+  cworld_->distanceRobot(req, res, *crobot_, kstate, *acm_);
+  EXPECT_EQ(d / 2.0, res.distance);
+
+  req.max_distance = d + 1.0;
+  res.clear();
+  cworld_->distanceRobot(req, res, *crobot_, kstate, *acm_);
+  EXPECT_NEAR(d, res.distance, 1e-9);
+
+  // the query may end at any pair below the threshold
+  req.stop_below_max_distance = true;
+  req.max_distance = d + 10.0;
+  res.clear();
+  cworld_->distanceRobot(req, res, *crobot_, kstate, *acm_);
+  EXPECT_GE(res.distance, d - 1e-9);
+  EXPECT_LT(res.distance, req.max_distance);
+
+  // the same holds for self distances
+  collision_detection::AllowedCollisionMatrix acm(*acm_);
+  acm.setEntry("r_gripper_palm_link", "l_gripper_palm_link", false);
+  double self_d = crobot_->distanceSelf(kstate, acm);
+  ASSERT_GT(self_d, 0.0);
+  req.stop_below_max_distance = false;
+  req.max_distance = self_d / 2.0;
+  res.clear();
+  crobot_->distanceSelf(req, res, kstate, acm);
+  EXPECT_EQ(self_d / 2.0, res.distance);
+  req.max_distance = self_d * 2.0;
+  res.clear();
+  crobot_->distanceSelf(req, res, kstate, acm);
+  EXPECT_NEAR(self_d, res.distance, 1e-9);
+}
+
+TEST_F(FclCollisionDetectionTester, LinkDistances)
+{
+  robot_state::RobotState kstate(kmodel_);
+  kstate.setToDefaultValues();
+  kstate.update();
+
+  Eigen::Affine3d pos = Eigen::Affine3d::Identity();
+  pos.translation().x() = 2.0;
+  pos.translation().z() = 1.0;
+  cworld_->getWorld()->addToObject("box", shapes::ShapeConstPtr(new shapes::Box(.1, .1, .1)), pos);
+
+  double d = cworld_->distanceRobot(*crobot_, kstate, *acm_);
+  ASSERT_GT(d, 0.1);
+
+  collision_detection::DistanceRequest req;
+  collision_detection::DistanceResult res;
+  req.max_distance = d + 10.0;
+  req.enable_nearest_points = true;
+  req.compute_link_distances = true;
+  cworld_->distanceRobot(req, res, *crobot_, kstate, *acm_);
+
+  // the per link traversal does not change the minimum distance
+  EXPECT_NEAR(d, res.distance, 1e-9);
+  EXPECT_NEAR(d, res.minimum_distance.distance, 1e-9);
+  EXPECT_NEAR(1.0, res.minimum_distance.normal.norm(), 1e-6);
+
+  ASSERT_FALSE(res.link_distances.empty());
+  double min_link_distance = std::numeric_limits<double>::max();
+  for (std::map<std::string, collision_detection::DistanceResultsData>::const_iterator it = res.link_distances.begin() ;
+       it != res.link_distances.end() ; ++it)
+  {
+    EXPECT_EQ(it->first, it->second.body_names[0]);
+    EXPECT_EQ(collision_detection::BodyTypes::ROBOT_LINK, it->second.body_types[0]);
+    EXPECT_EQ("box", it->second.body_names[1]);
+    EXPECT_GE(it->second.distance, d - 1e-9);
+    min_link_distance = std::min(min_link_distance, it->second.distance);
+  }
+  EXPECT_NEAR(d, min_link_distance, 1e-9);
+}
+
+TEST_F(FclCollisionDetectionTester, DiffWorldSharesBroadPhase)
+{
+  robot_state::RobotState kstate(kmodel_);
+  kstate.setToDefaultValues();
+  kstate.update();
+
+  Eigen::Affine3d pos = Eigen::Affine3d::Identity();
+  pos.translation().z() = 1.0;
+  Eigen::Affine3d far_away(Eigen::Translation3d(0.0, 10.0, 1.0));
+  collision_detection::WorldPtr world = cworld_->getWorld();
+  world->addToObject("box", shapes::ShapeConstPtr(new shapes::Box(.5, .5, .5)), pos);
+  world->addToObject("far_box", shapes::ShapeConstPtr(new shapes::Box(.5, .5, .5)), far_away);
+
+  collision_detection::WorldPtr diff_world(new collision_detection::World(*world));
+  DefaultCWorldType diff_cworld(dynamic_cast<const DefaultCWorldType&>(*cworld_), diff_world);
+
+  collision_detection::CollisionRequest req;
+  collision_detection::CollisionResult res;
+  diff_cworld.checkRobotCollision(req, res, *crobot_, kstate, *acm_);
+  EXPECT_TRUE(res.collision);
+
+  // moving the box in the diff does not affect the parent
+  diff_world->moveShapeInObject("box", diff_world->getObject("box")->shapes_[0], far_away);
+  res.clear();
+  diff_cworld.checkRobotCollision(req, res, *crobot_, kstate, *acm_);
+  EXPECT_FALSE(res.collision);
+  res.clear();
+  cworld_->checkRobotCollision(req, res, *crobot_, kstate, *acm_);
+  EXPECT_TRUE(res.collision);
+
+  // objects moved into collision in the diff are found, removed ones are not
+  diff_world->moveShapeInObject("far_box", diff_world->getObject("far_box")->shapes_[0], pos);
+  res.clear();
+  diff_cworld.checkRobotCollision(req, res, *crobot_, kstate, *acm_);
+  EXPECT_TRUE(res.collision);
+  diff_world->removeObject("far_box");
+  res.clear();
+  diff_cworld.checkRobotCollision(req, res, *crobot_, kstate, *acm_);
+  EXPECT_FALSE(res.collision);
+  EXPECT_LT(0.0, diff_cworld.distanceRobot(*crobot_, kstate, *acm_));
+
+  // a diff of the diff starts with the same objects
+  collision_detection::WorldPtr diff2_world(new collision_detection::World(*diff_world));
+  DefaultCWorldType diff2_cworld(diff_cworld, diff2_world);
+  res.clear();
+  diff2_cworld.checkRobotCollision(req, res, *crobot_, kstate, *acm_);
+  EXPECT_FALSE(res.collision);
+  diff2_world->moveShapeInObject("box", diff2_world->getObject("box")->shapes_[0], pos);
+  res.clear();
+  diff2_cworld.checkRobotCollision(req, res, *crobot_, kstate, *acm_);
+  EXPECT_TRUE(res.collision);
+  res.clear();
+  diff_cworld.checkRobotCollision(req, res, *crobot_, kstate, *acm_);
+  EXPECT_FALSE(res.collision);
+
+  // changing the parent after the diffs were made does not affect them
+  world->removeObject("box");
+  world->moveShapeInObject("far_box", world->getObject("far_box")->shapes_[0], pos);
+  res.clear();
+  cworld_->checkRobotCollision(req, res, *crobot_, kstate, *acm_);
+  EXPECT_TRUE(res.collision);
+  res.clear();
+  diff_cworld.checkRobotCollision(req, res, *crobot_, kstate, *acm_);
+  EXPECT_FALSE(res.collision);
+  res.clear();
+  diff2_cworld.checkRobotCollision(req, res, *crobot_, kstate, *acm_);
+  EXPECT_TRUE(res.collision);
+}
+
+TEST_F(FclCollisionDetectionTester, MoveObjectPoses)
+{
+  robot_state::RobotState kstate(kmodel_);
+  kstate.setToDefaultValues();
+  kstate.update();
+
+  EigenSTL::vector_Affine3d in_collision(1, Eigen::Affine3d(Eigen::Translation3d(0.0, 0.0, 1.0)));
+  EigenSTL::vector_Affine3d far_away(1, Eigen::Affine3d(Eigen::Translation3d(0.0, 10.0, 1.0)));
+  collision_detection::WorldPtr world = cworld_->getWorld();
+  world->addToObject("box", shapes::ShapeConstPtr(new shapes::Box(.5, .5, .5)), far_away[0]);
+
+  // poses that change repeatedly, as for a tracked object, update the collision world in place
+  collision_detection::CollisionRequest req;
+  collision_detection::CollisionResult res;
+  for (int i = 0 ; i < 10 ; ++i)
+  {
+    ASSERT_TRUE(world->setShapePoses("box", i % 2 ? far_away : in_collision));
+    res.clear();
+    cworld_->checkRobotCollision(req, res, *crobot_, kstate, *acm_);
+    EXPECT_EQ(i % 2 == 0, res.collision);
+  }
+
+  // moves within a batch are applied when it is committed
+  {
+    collision_detection::World::ScopedBatch batch(*world);
+    world->setShapePoses("box", far_away);
+    world->setShapePoses("box", in_collision);
+  }
+  res.clear();
+  cworld_->checkRobotCollision(req, res, *crobot_, kstate, *acm_);
+  EXPECT_TRUE(res.collision);
+
+  // moving an object in a diff does not move it in the parent, and moving it in the parent does not affect the diff
+  collision_detection::WorldPtr diff_world(new collision_detection::World(*world));
+  DefaultCWorldType diff_cworld(dynamic_cast<const DefaultCWorldType&>(*cworld_), diff_world);
+  diff_world->setShapePoses("box", far_away);
+  diff_world->setShapePoses("box", far_away);
+  res.clear();
+  diff_cworld.checkRobotCollision(req, res, *crobot_, kstate, *acm_);
+  EXPECT_FALSE(res.collision);
+  res.clear();
+  cworld_->checkRobotCollision(req, res, *crobot_, kstate, *acm_);
+  EXPECT_TRUE(res.collision);
+  world->setShapePoses("box", far_away);
+  diff_world->setShapePoses("box", in_collision);
+  res.clear();
+  cworld_->checkRobotCollision(req, res, *crobot_, kstate, *acm_);
+  EXPECT_FALSE(res.collision);
+  res.clear();
+  diff_cworld.checkRobotCollision(req, res, *crobot_, kstate, *acm_);
+  EXPECT_TRUE(res.collision);
+}
+
+TEST_F(FclCollisionDetectionTester, CollisionAndDistanceInOneQuery)
+{
+  robot_state::RobotState kstate(kmodel_);
+  kstate.setToDefaultValues();
+  kstate.update();
+
+  collision_detection::CollisionRequest req;
+  req.distance = true;
+  collision_detection::CollisionResult res;
+  crobot_->checkSelfCollision(req, res, kstate, *acm_);
+  EXPECT_FALSE(res.collision);
+  EXPECT_DOUBLE_EQ(crobot_->distanceSelf(kstate, *acm_), res.distance);
+
+  Eigen::Affine3d pos(Eigen::Translation3d(0.0, 2.0, 1.0));
+  cworld_->getWorld()->addToObject("box", shapes::ShapeConstPtr(new shapes::Box(.5, .5, .5)), pos);
+  res.clear();
+  cworld_->checkRobotCollision(req, res, *crobot_, kstate, *acm_);
+  EXPECT_FALSE(res.collision);
+  EXPECT_LT(0.0, res.distance);
+  EXPECT_DOUBLE_EQ(cworld_->distanceRobot(*crobot_, kstate, *acm_), res.distance);
+
+  // contacts are still reported when the distance is requested
+  pos.translation().y() = 0.0;
+  cworld_->getWorld()->moveShapeInObject("box", cworld_->getWorld()->getObject("box")->shapes_[0], pos);
+  req.contacts = true;
+  req.max_contacts = 10;
+  res.clear();
+  cworld_->checkRobotCollision(req, res, *crobot_, kstate, *acm_);
+  EXPECT_TRUE(res.collision);
+  EXPECT_LT(0u, res.contact_count);
+  EXPECT_DOUBLE_EQ(cworld_->distanceRobot(*crobot_, kstate, *acm_), res.distance);
+
+  collision_detection::CollisionRequest contacts_only_req = req;
+  contacts_only_req.distance = false;
+  collision_detection::CollisionResult contacts_only_res;
+  cworld_->checkRobotCollision(contacts_only_req, contacts_only_res, *crobot_, kstate, *acm_);
+  EXPECT_EQ(contacts_only_res.contact_count, res.contact_count);
+}
+
+TEST_F(FclCollisionDetectionTester, GroupSelfCollision)
+{
+  robot_state::RobotState kstate(kmodel_);
+  kstate.setToDefaultValues();
+
+  Eigen::Affine3d offset = Eigen::Affine3d::Identity();
+  offset.translation().x() = .01;
+  kstate.updateStateWithLinkAt("r_gripper_palm_link", Eigen::Affine3d::Identity());
+  kstate.updateStateWithLinkAt("l_gripper_palm_link", offset);
+  acm_->setEntry("r_gripper_palm_link", "l_gripper_palm_link", false);
+
+  collision_detection::CollisionRequest req;
+  req.contacts = true;
+  req.max_contacts = 100;
+  std::pair<std::string, std::string> palms("l_gripper_palm_link", "r_gripper_palm_link");
+
+  // the pair of palms is reported once, whichever of the arms is requested
+  req.group_name = "right_arm";
+  collision_detection::CollisionResult res;
+  crobot_->checkSelfCollision(req, res, kstate, *acm_);
+  EXPECT_TRUE(res.collision);
+  ASSERT_TRUE(res.contacts.find(palms) != res.contacts.end());
+  EXPECT_EQ(1u, res.contacts[palms].size());
+
+  req.group_name = "left_arm";
+  res.clear();
+  crobot_->checkSelfCollision(req, res, kstate, *acm_);
+  EXPECT_TRUE(res.collision);
+  ASSERT_TRUE(res.contacts.find(palms) != res.contacts.end());
+  EXPECT_EQ(1u, res.contacts[palms].size());
+
+  // all the contacts reported for a group are also reported when checking the whole robot
+  collision_detection::CollisionResult all_res;
+  req.group_name.clear();
+  crobot_->checkSelfCollision(req, all_res, kstate, *acm_);
+  EXPECT_LE(res.contact_count, all_res.contact_count);
+  for (collision_detection::CollisionResult::ContactMap::const_iterator it = res.contacts.begin() ; it != res.contacts.end() ; ++it)
+    EXPECT_TRUE(all_res.contacts.find(it->first) != all_res.contacts.end()) << it->first.first << " " << it->first.second;
+}
+
+TEST_F(FclCollisionDetectionTester, SelfCollisionPlan)
+{
+  robot_state::RobotState kstate(kmodel_);
+  kstate.setToDefaultValues();
+
+  Eigen::Affine3d offset = Eigen::Affine3d::Identity();
+  offset.translation().x() = .01;
+  kstate.updateStateWithLinkAt("base_link", Eigen::Affine3d::Identity());
+  kstate.updateStateWithLinkAt("base_bellow_link", offset);
+  kstate.updateStateWithLinkAt("r_gripper_palm_link", Eigen::Affine3d::Identity());
+  kstate.updateStateWithLinkAt("l_gripper_palm_link", offset);
+  acm_->setEntry("base_link", "base_bellow_link", false);
+  acm_->setEntry("r_gripper_palm_link", "l_gripper_palm_link", false);
+
+  collision_detection::CollisionRequest req;
+  req.contacts = true;
+  req.max_contacts = 100;
+  std::pair<std::string, std::string> base("base_bellow_link", "base_link");
+  std::pair<std::string, std::string> palms("l_gripper_palm_link", "r_gripper_palm_link");
+
+  // repeated checks reorder the pairs that are checked, but report the same contacts
+  for (int i = 0 ; i < 100 ; ++i)
+  {
+    collision_detection::CollisionResult res;
+    crobot_->checkSelfCollision(req, res, kstate, *acm_);
+    ASSERT_TRUE(res.collision);
+    EXPECT_EQ(2u, res.contacts.size());
+    EXPECT_TRUE(res.contacts.find(base) != res.contacts.end());
+    EXPECT_TRUE(res.contacts.find(palms) != res.contacts.end());
+  }
+
+  // changes to the matrix are taken into account
+  acm_->setEntry("base_link", "base_bellow_link", true);
+  collision_detection::CollisionResult res;
+  crobot_->checkSelfCollision(req, res, kstate, *acm_);
+  ASSERT_TRUE(res.collision);
+  EXPECT_EQ(1u, res.contacts.size());
+  EXPECT_TRUE(res.contacts.find(palms) != res.contacts.end());
+
+  acm_->setEntry("r_gripper_palm_link", "l_gripper_palm_link", true);
+  res.clear();
+  crobot_->checkSelfCollision(req, res, kstate, *acm_);
+  EXPECT_FALSE(res.collision);
+
+  // as are bodies attached to the robot, including changes to their touch links
+  std::vector<shapes::ShapeConstPtr> shapes(1, shapes::ShapeConstPtr(new shapes::Box(.1, .1, .1)));
+  EigenSTL::vector_Affine3d poses(1, Eigen::Affine3d::Identity());
+  std::vector<std::string> touch_links;
+  std::pair<std::string, std::string> box_l("box", "l_gripper_palm_link");
+  std::pair<std::string, std::string> box_r("box", "r_gripper_palm_link");
+  kstate.attachBody("box", shapes, poses, touch_links, "r_gripper_palm_link");
+  res.clear();
+  crobot_->checkSelfCollision(req, res, kstate, *acm_);
+  ASSERT_TRUE(res.collision);
+  EXPECT_TRUE(res.contacts.find(box_l) != res.contacts.end());
+  EXPECT_TRUE(res.contacts.find(box_r) != res.contacts.end());
+
+  kstate.clearAttachedBody("box");
+  touch_links.push_back("r_gripper_palm_link");
+  kstate.attachBody("box", shapes, poses, touch_links, "r_gripper_palm_link");
+  res.clear();
+  crobot_->checkSelfCollision(req, res, kstate, *acm_);
+  ASSERT_TRUE(res.collision);
+  EXPECT_TRUE(res.contacts.find(box_l) != res.contacts.end());
+  EXPECT_TRUE(res.contacts.find(box_r) == res.contacts.end());
+
+  kstate.clearAttachedBody("box");
+  res.clear();
+  crobot_->checkSelfCollision(req, res, kstate, *acm_);
+  EXPECT_FALSE(res.collision);
+}
+
+namespace
+{
+void checkInThread(const collision_detection::CollisionRobot *crobot, const collision_detection::CollisionWorld *cworld,
+                   const robot_model::RobotModelConstPtr &kmodel, const collision_detection::AllowedCollisionMatrix *acm,
+                   unsigned int *collisions)
+{
+  robot_state::RobotState kstate(kmodel);
+  kstate.setToDefaultValues();
+  Eigen::Affine3d offset = Eigen::Affine3d::Identity();
+  offset.translation().x() = .01;
+  kstate.updateStateWithLinkAt("r_gripper_palm_link", Eigen::Affine3d::Identity());
+  kstate.updateStateWithLinkAt("l_gripper_palm_link", offset);
+
+  // each thread attaches its own body, which creates collision geometry concurrently with the other threads
+  std::vector<shapes::ShapeConstPtr> shapes(1, shapes::ShapeConstPtr(new shapes::Box(.1, .1, .1)));
+  EigenSTL::vector_Affine3d poses(1, Eigen::Affine3d::Identity());
+  std::vector<std::string> touch_links(1, "r_gripper_palm_link");
+
+  *collisions = 0;
+  for (int i = 0 ; i < 50 ; ++i)
+  {
+    kstate.attachBody("box", shapes, poses, touch_links, "r_gripper_palm_link");
+    collision_detection::CollisionRequest req;
+    collision_detection::CollisionResult res;
+    crobot->checkSelfCollision(req, res, kstate, *acm);
+    if (res.collision)
+      (*collisions)++;
+    res.clear();
+    cworld->checkRobotCollision(req, res, *crobot, kstate, *acm);
+    if (res.collision)
+      (*collisions)++;
+    kstate.clearAttachedBody("box");
+  }
+}
+}
+
+TEST_F(FclCollisionDetectionTester, ConcurrentChecks)
+{
+  acm_->setEntry("r_gripper_palm_link", "l_gripper_palm_link", false);
+  Eigen::Affine3d pos = Eigen::Affine3d::Identity();
+  pos.translation().x() = 5.0;
+  cworld_->getWorld()->addToObject("far_box", shapes::ShapeConstPtr(new shapes::Box(.1, .1, .1)), pos);
+
+  const std::size_t thread_count = 4;
+  std::vector<unsigned int> collisions(thread_count);
+  boost::thread_group threads;
+  for (std::size_t i = 0 ; i < thread_count ; ++i)
+    threads.create_thread(boost::bind(&checkInThread, crobot_.get(), cworld_.get(), kmodel_, acm_.get(), &collisions[i]));
+  threads.join_all();
+
+  // every thread finds the self collision of the palms and nothing in the world
+  for (std::size_t i = 0 ; i < thread_count ; ++i)
+    EXPECT_EQ(50u, collisions[i]);
+}
+
+namespace
+{
+// runs self collision checks in one thread that outlives the robots it checks
+class SelfCollisionWorker
+{
+public:
+
+  SelfCollisionWorker() : robot_(NULL), state_(NULL), acm_(NULL), pending_(false), stop_(false), collision_(false)
+  {
+    thread_ = boost::thread(boost::bind(&SelfCollisionWorker::run, this));
+  }
+
+  ~SelfCollisionWorker()
+  {
+    {
+      boost::mutex::scoped_lock slock(lock_);
+      stop_ = true;
+    }
+    condition_.notify_all();
+    thread_.join();
+  }
+
+  bool check(const collision_detection::CollisionRobot *robot, const robot_state::RobotState *state,
+             const collision_detection::AllowedCollisionMatrix *acm)
+  {
+    boost::mutex::scoped_lock slock(lock_);
+    robot_ = robot;
+    state_ = state;
+    acm_ = acm;
+    pending_ = true;
+    condition_.notify_all();
+    while (pending_)
+      condition_.wait(slock);
+    return collision_;
+  }
+
+private:
+
+  void run()
+  {
+    boost::mutex::scoped_lock slock(lock_);
+    while (true)
+    {
+      while (!pending_ && !stop_)
+        condition_.wait(slock);
+      if (stop_)
+        return;
+      collision_detection::CollisionRequest req;
+      collision_detection::CollisionResult res;
+      robot_->checkSelfCollision(req, res, *state_, *acm_);
+      collision_ = res.collision;
+      pending_ = false;
+      condition_.notify_all();
+    }
+  }
+
+  const collision_detection::CollisionRobot           *robot_;
+  const robot_state::RobotState                       *state_;
+  const collision_detection::AllowedCollisionMatrix   *acm_;
+  bool                                                 pending_;
+  bool                                                 stop_;
+  bool                                                 collision_;
+  boost::mutex                                         lock_;
+  boost::condition_variable                            condition_;
+  boost::thread                                        thread_;
+};
+}
+
+TEST_F(FclCollisionDetectionTester, SelfCollisionCacheOfDestroyedRobot)
+{
+  robot_state::RobotState kstate(kmodel_);
+  kstate.setToDefaultValues();
+  kstate.update();
+  acm_->setEntry("r_gripper_palm_link", "l_gripper_palm_link", false);
+
+  // the padded robot is in collision, the unpadded one is not
+  DefaultCRobotType unpadded(kmodel_);
+  DefaultCRobotType padded(kmodel_, 0.5);
+  SelfCollisionWorker worker;
+  ASSERT_FALSE(worker.check(&unpadded, &kstate, acm_.get()));
+  ASSERT_TRUE(worker.check(&padded, &kstate, acm_.get()));
+
+  // robots constructed where a destroyed robot was must not use the caches the worker kept for that robot
+  boost::aligned_storage<sizeof(DefaultCRobotType), boost::alignment_of<DefaultCRobotType>::value> storage;
+  for (int i = 0 ; i < 4 ; ++i)
+  {
+    const DefaultCRobotType &source = i % 2 ? unpadded : padded;
+    DefaultCRobotType *robot = new (storage.address()) DefaultCRobotType(source);
+    EXPECT_EQ(i % 2 == 0, worker.check(robot, &kstate, acm_.get()));
+    robot->~DefaultCRobotType();
+
+    robot = new (storage.address()) DefaultCRobotType(kmodel_, i % 2 ? 0.5 : 0.0);
+    EXPECT_EQ(i % 2 == 1, worker.check(robot, &kstate, acm_.get()));
+    robot->~DefaultCRobotType();
+  }
+}
+
+TEST_F(FclCollisionDetectionTester, FlatContacts)
+{
+  robot_state::RobotState kstate(kmodel_);
+  kstate.setToDefaultValues();
+
+  Eigen::Affine3d offset = Eigen::Affine3d::Identity();
+  offset.translation().x() = .01;
+  kstate.updateStateWithLinkAt("base_link", Eigen::Affine3d::Identity());
+  kstate.updateStateWithLinkAt("base_bellow_link", offset);
+  kstate.updateStateWithLinkAt("r_gripper_palm_link", Eigen::Affine3d::Identity());
+  kstate.updateStateWithLinkAt("l_gripper_palm_link", offset);
+  acm_->setEntry("base_link", "base_bellow_link", false);
+  acm_->setEntry("r_gripper_palm_link", "l_gripper_palm_link", false);
+
+  collision_detection::CollisionRequest req;
+  req.contacts = true;
+  req.max_contacts = 10;
+  req.max_contacts_per_pair = 2;
+  collision_detection::CollisionResult res;
+  crobot_->checkSelfCollision(req, res, kstate, *acm_);
+  ASSERT_TRUE(res.collision);
+
+  req.flat_contacts = true;
+  collision_detection::CollisionResult flat_res;
+  crobot_->checkSelfCollision(req, flat_res, kstate, *acm_);
+  ASSERT_TRUE(flat_res.collision);
+  EXPECT_TRUE(flat_res.contacts.empty());
+  EXPECT_EQ(res.contact_count, flat_res.contact_count);
+  EXPECT_EQ(flat_res.contact_count, flat_res.flat_contacts.size());
+
+  // the flat contacts convert to the same map of contacts
+  collision_detection::CollisionResult::ContactMap contacts;
+  flat_res.getContactMap(contacts);
+  ASSERT_EQ(res.contacts.size(), contacts.size());
+  for (collision_detection::CollisionResult::ContactMap::const_iterator it = res.contacts.begin() ; it != res.contacts.end() ; ++it)
+  {
+    ASSERT_TRUE(contacts.find(it->first) != contacts.end());
+    EXPECT_EQ(it->second.size(), contacts[it->first].size());
+  }
+
+  // clearing the result keeps the memory for contacts
+  std::size_t capacity = flat_res.flat_contacts.capacity();
+  flat_res.clear();
+  EXPECT_TRUE(flat_res.flat_contacts.empty());
+  EXPECT_EQ(capacity, flat_res.flat_contacts.capacity());
+}
+
+TEST_F(FclCollisionDetectionTester, PaddedGeometryIsShared)
+{
+  const robot_model::LinkModel *link = kmodel_->getLinkModel("base_link");
+  ASSERT_FALSE(link->getShapes().empty());
+  const shapes::ShapeConstPtr &shape = link->getShapes()[0];
+
+  collision_detection::FCLGeometryConstPtr padded = collision_detection::createCollisionGeometry(shape, 1.0, 0.01, link, 0);
+  ASSERT_TRUE(padded);
+  collision_detection::FCLGeometryConstPtr other = collision_detection::createCollisionGeometry(shape, 1.0, 0.02, link, 0);
+  ASSERT_TRUE(other);
+  EXPECT_NE(padded, other);
+
+  // switching back to a padding used before does not build the geometry again
+  EXPECT_EQ(padded, collision_detection::createCollisionGeometry(shape, 1.0, 0.01, link, 0));
+  EXPECT_EQ(other, collision_detection::createCollisionGeometry(shape, 1.0, 0.02, link, 0));
+}
+
+TEST_F(FclCollisionDetectionTester, GeometryCacheBudget)
+{
+  collision_detection::World::Object obj("boxes");
+  std::vector<shapes::ShapeConstPtr> boxes;
+  std::vector<collision_detection::FCLGeometryConstPtr> geometry;
+  for (std::size_t i = 0 ; i < 64 ; ++i)
+  {
+    boxes.push_back(shapes::ShapeConstPtr(new shapes::Box(1.0, 1.0, 1.0)));
+    geometry.push_back(collision_detection::createCollisionGeometry(boxes.back(), &obj));
+    ASSERT_TRUE(geometry.back());
+  }
+  // everything fits in the default budget
+  for (std::size_t i = 0 ; i < boxes.size() ; ++i)
+    EXPECT_EQ(geometry[i], collision_detection::createCollisionGeometry(boxes[i], &obj));
+
+  // with the smallest budget, only the most recently used geometry of each shard of the cache is kept
+  std::size_t budget = collision_detection::getCollisionGeometryCacheBudget();
+  std::size_t size = collision_detection::getCollisionGeometryCacheSize();
+  collision_detection::setCollisionGeometryCacheBudget(0);
+  EXPECT_LT(collision_detection::getCollisionGeometryCacheSize(), size);
+  std::size_t rebuilt = 0;
+  for (std::size_t i = 0 ; i < boxes.size() ; ++i)
+  {
+    collision_detection::FCLGeometryConstPtr g = collision_detection::createCollisionGeometry(boxes[i], &obj);
+    ASSERT_TRUE(g);
+    if (g != geometry[i])
+      ++rebuilt;
+    EXPECT_EQ(g, collision_detection::createCollisionGeometry(boxes[i], &obj));
+  }
+  EXPECT_GT(rebuilt, 0u);
+  collision_detection::setCollisionGeometryCacheBudget(budget);
+  EXPECT_EQ(budget, collision_detection::getCollisionGeometryCacheBudget());
+
+  // geometry of shapes that no longer exist is eventually dropped
+  geometry.clear();
+  boxes.clear();
+  for (std::size_t i = 0 ; i < 16 ; ++i)
+    collision_detection::cleanCollisionGeometryCache();
+  EXPECT_LT(collision_detection::getCollisionGeometryCacheSize(), size);
+}
+
+TEST_F(FclCollisionDetectionTester, MeshProcessing)
+{
+  boost::filesystem::path path(boost::filesystem::current_path());
+  shapes::ShapeConstPtr kinect_shape(shapes::createMeshFromResource("file://"+path.string()+"/"+kinect_dae_file));
+  const shapes::Mesh *kinect_mesh = static_cast<const shapes::Mesh*>(kinect_shape.get());
+  collision_detection::World::Object obj("kinect");
+
+  // by default, meshes are used as they are
+  collision_detection::FCLGeometryConstPtr g = collision_detection::createCollisionGeometry(kinect_shape, &obj);
+  ASSERT_TRUE(g);
+  EXPECT_EQ(kinect_mesh->triangle_count, static_cast<const fcl::BVHModel<fcl::OBBRSS>*>(g->collision_geometry_.get())->num_tris);
+
+  collision_detection::MeshProcessingOptions options;
+  options.max_error_ = 0.02;
+  options.convex_hull_ = true;
+  collision_detection::setMeshProcessingOptions(options);
+
+  // a copy of the mesh has the same content, but not the same address
+  shapes::ShapeConstPtr copy(kinect_shape->clone());
+  g = collision_detection::createCollisionGeometry(copy, &obj);
+  collision_detection::setMeshProcessingOptions(collision_detection::MeshProcessingOptions());
+  ASSERT_TRUE(g);
+  int processed_tris = static_cast<const fcl::BVHModel<fcl::OBBRSS>*>(g->collision_geometry_.get())->num_tris;
+  EXPECT_GT(processed_tris, 0);
+  EXPECT_LT(processed_tris, (int)kinect_mesh->triangle_count);
+}
+
+TEST_F(FclCollisionDetectionTester, MeshProcessingCacheDirectory)
+{
+  boost::filesystem::path path(boost::filesystem::current_path());
+  shapes::ShapeConstPtr kinect_shape(shapes::createMeshFromResource("file://"+path.string()+"/"+kinect_dae_file));
+  collision_detection::World::Object obj("kinect");
+
+  boost::filesystem::path dir = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+  collision_detection::MeshProcessingOptions options;
+  options.convex_hull_ = true;
+  options.cache_directory_ = dir.string();
+  collision_detection::setMeshProcessingOptions(options);
+  collision_detection::FCLGeometryConstPtr g = collision_detection::createCollisionGeometry(kinect_shape, &obj);
+  ASSERT_TRUE(g);
+  int processed_tris = static_cast<const fcl::BVHModel<fcl::OBBRSS>*>(g->collision_geometry_.get())->num_tris;
+
+  // the processed mesh is stored, and used for meshes with the same content
+  ASSERT_TRUE(boost::filesystem::exists(dir));
+  EXPECT_EQ(1, std::distance(boost::filesystem::directory_iterator(dir), boost::filesystem::directory_iterator()));
+  shapes::ShapeConstPtr copy(kinect_shape->clone());
+  g = collision_detection::createCollisionGeometry(copy, &obj);
+  collision_detection::setMeshProcessingOptions(collision_detection::MeshProcessingOptions());
+  ASSERT_TRUE(g);
+  EXPECT_EQ(processed_tris, static_cast<const fcl::BVHModel<fcl::OBBRSS>*>(g->collision_geometry_.get())->num_tris);
+  boost::filesystem::remove_all(dir);
+}
+
+TEST_F(FclCollisionDetectionTester, RecordAndReplay)
+{
+  boost::filesystem::path log = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+  collision_detection::CollisionDetectorAllocatorPtr allocator =
+    collision_detection::CollisionDetectorAllocatorRecording::create(collision_detection::CollisionDetectorAllocatorFCL::create(), kmodel_, log.string());
+  ASSERT_TRUE(allocator);
+  EXPECT_EQ(collision_detection::CollisionDetectorAllocatorFCL::NAME_ + "_RECORDING", allocator->getName());
+
+  collision_detection::WorldPtr world(new collision_detection::World());
+  collision_detection::CollisionWorldPtr cworld = allocator->allocateWorld(world);
+  collision_detection::CollisionRobotPtr crobot = allocator->allocateRobot(kmodel_);
+
+  robot_state::RobotState kstate(kmodel_);
+  kstate.setToDefaultValues();
+  kstate.update();
+
+  Eigen::Affine3d pos = Eigen::Affine3d::Identity();
+  pos.translation().z() = 1.0;
+  world->addToObject("box", shapes::ShapeConstPtr(new shapes::Box(.1, .1, .1)), pos);
+
+  collision_detection::CollisionRequest req;
+  collision_detection::CollisionResult res;
+  cworld->checkRobotCollision(req, res, *crobot, kstate, *acm_);
+  bool free_collision = res.collision;
+  double free_distance = cworld->distanceRobot(*crobot, kstate, *acm_);
+
+  // the box is moved onto the base, so the world is recorded again
+  world->moveShapeInObject("box", world->getObject("box")->shapes_[0], Eigen::Affine3d::Identity());
+  res.clear();
+  cworld->checkRobotCollision(req, res, *crobot, kstate, *acm_);
+  EXPECT_TRUE(res.collision);
+
+  collision_detection::AllowedCollisionMatrix acm(*acm_);
+  acm.setEntry("r_gripper_palm_link", "l_gripper_palm_link", false);
+  double self_distance = crobot->distanceSelf(kstate, acm);
+
+  boost::shared_ptr<collision_detection::CollisionDetectorAllocatorRecording> recording =
+    boost::static_pointer_cast<collision_detection::CollisionDetectorAllocatorRecording>(allocator);
+  EXPECT_EQ(4u, recording->getLog()->getQueryCount());
+  recording->getLog()->flush();
+
+  std::vector<collision_detection::CollisionQueryReplayResult> results;
+  ASSERT_TRUE(collision_detection::replayCollisionQueryLog(log.string(), kmodel_, collision_detection::CollisionDetectorAllocatorFCL::create(), results));
+  ASSERT_EQ(4u, results.size());
+  EXPECT_EQ(collision_detection::CollisionQueryTypes::ROBOT_COLLISION, results[0].type);
+  EXPECT_EQ(free_collision, results[0].collision);
+  EXPECT_EQ(collision_detection::CollisionQueryTypes::ROBOT_DISTANCE, results[1].type);
+  EXPECT_NEAR(free_distance, results[1].distance, 1e-6);
+  EXPECT_TRUE(results[2].collision);
+  EXPECT_EQ(collision_detection::CollisionQueryTypes::SELF_DISTANCE, results[3].type);
+  EXPECT_NEAR(self_distance, results[3].distance, 1e-6);
+  for (std::size_t i = 0 ; i < results.size() ; ++i)
+    EXPECT_FALSE(results[i].mismatch);
+  boost::filesystem::remove(log);
+}
+
+TEST_F(FclCollisionDetectionTester, PointQueries)
+{
+  robot_state::RobotState kstate(kmodel_);
+  kstate.setToDefaultValues();
+
+  Eigen::Affine3d pos1 = Eigen::Affine3d::Identity();
+  pos1.translation().x() = 5.0;
+  kstate.updateStateWithLinkAt("r_gripper_palm_link", pos1);
+
+  // a box held 1m above the palm, away from every link
+  std::vector<shapes::ShapeConstPtr> shapes(1, shapes::ShapeConstPtr(new shapes::Box(.1, .1, .1)));
+  EigenSTL::vector_Affine3d poses(1, Eigen::Affine3d(Eigen::Translation3d(0.0, 0.0, 1.0)));
+  kstate.attachBody("box", shapes, poses, std::vector<std::string>(), "r_gripper_palm_link");
+  kstate.update();
+
+  EigenSTL::vector_Vector3d points;
+  points.push_back(Eigen::Vector3d(5.0, 0.0, 1.0));
+  points.push_back(Eigen::Vector3d(5.0, 0.0, 1.2));
+  points.push_back(Eigen::Vector3d(5.0, 0.0, 3.0));
+  points.push_back(Eigen::Vector3d(100.0, 0.0, 0.0));
+
+  std::vector<bool> inside;
+  EXPECT_EQ(1u, crobot_->checkPointsInside(kstate, points, inside));
+  ASSERT_EQ(points.size(), inside.size());
+  EXPECT_TRUE(inside[0]);
+  EXPECT_FALSE(inside[1]);
+  EXPECT_FALSE(inside[2]);
+  EXPECT_FALSE(inside[3]);
+
+  std::vector<double> distances;
+  crobot_->computePointDistances(kstate, points, distances, 1.0);
+  ASSERT_EQ(points.size(), distances.size());
+  EXPECT_NEAR(-0.05, distances[0], 1e-9);
+  EXPECT_NEAR(0.15, distances[1], 1e-9);
+  EXPECT_DOUBLE_EQ(1.0, distances[2]);
+  EXPECT_DOUBLE_EQ(1.0, distances[3]);
+
+  // a cloud around the robot: threads do not change the result, and the two queries agree
+  kstate.clearAttachedBody("box");
+  kstate.setToDefaultValues();
+  kstate.update();
+  points.clear();
+  for (int i = 0 ; i < 40 ; ++i)
+    for (int j = 0 ; j < 40 ; ++j)
+      for (int k = 0 ; k < 40 ; ++k)
+        points.push_back(Eigen::Vector3d(-1.0 + i * 0.05, -1.0 + j * 0.05, k * 0.05));
+
+  std::size_t count = crobot_->checkPointsInside(kstate, points, inside);
+  EXPECT_GT(count, 0u);
+  std::vector<bool> inside_threads;
+  EXPECT_EQ(count, crobot_->checkPointsInside(kstate, points, inside_threads, 0));
+  EXPECT_TRUE(inside == inside_threads);
+
+  crobot_->computePointDistances(kstate, points, distances, 0.5);
+  std::vector<double> distances_threads;
+  crobot_->computePointDistances(kstate, points, distances_threads, 0.5, 0);
+  EXPECT_TRUE(distances == distances_threads);
+  for (std::size_t i = 0 ; i < points.size() ; ++i)
+  {
+    EXPECT_EQ(inside[i], distances[i] <= 0.0);
+    EXPECT_LE(distances[i], 0.5);
+  }
+
+  // padding grows the robot
+  crobot_->setPadding(0.05);
+  std::vector<bool> inside_padded;
+  EXPECT_GT(crobot_->checkPointsInside(kstate, points, inside_padded), count);
+  crobot_->setPadding(0.0);
+}
 
 int main(int argc, char **argv)
 {
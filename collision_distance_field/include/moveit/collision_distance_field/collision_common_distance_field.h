@@ -0,0 +1,137 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2013, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+
+#ifndef MOVEIT_COLLISION_DISTANCE_FIELD_COLLISION_COMMON_DISTANCE_FIELD_
+#define MOVEIT_COLLISION_DISTANCE_FIELD_COLLISION_COMMON_DISTANCE_FIELD_
+
+#include <moveit/collision_detection/collision_common.h>
+#include <moveit/collision_detection/collision_matrix.h>
+#include <moveit/robot_state/robot_state.h>
+#include <geometric_shapes/shapes.h>
+#include <eigen_stl_containers/eigen_stl_vector_container.h>
+#include <set>
+
+namespace collision_detection
+{
+
+/** \brief A sphere, in the frame of the shape it approximates */
+struct CollisionSphere
+{
+  CollisionSphere(const Eigen::Vector3d &center, double radius) : center_(center), radius_(radius)
+  {
+  }
+
+  Eigen::Vector3d center_;
+  double          radius_;
+};
+
+/** \brief A robot link, an attached body or a world object, approximated by a set of spheres placed in the world frame */
+struct SphereBody
+{
+  SphereBody() : id_(NULL), type_(BodyTypes::ROBOT_LINK), link_(NULL), attached_body_(NULL), bound_radius_(0.0)
+  {
+  }
+
+  const std::string& getID() const
+  {
+    return *id_;
+  }
+
+  /// The name used for queries to the allowed collision matrix
+  const std::string               *id_;
+
+  BodyType                         type_;
+
+  /// The link for robot links, the link the body is attached to for attached bodies, NULL for world objects
+  const robot_model::LinkModel    *link_;
+
+  /// The attached body this instance represents (only set if type_ is ROBOT_ATTACHED)
+  const robot_state::AttachedBody *attached_body_;
+
+  EigenSTL::vector_Vector3d        centers_;
+  std::vector<double>              radii_;
+
+  /// A sphere that includes all the spheres of the body; this is what pairs of bodies are first tested with
+  Eigen::Vector3d                  bound_center_;
+  double                           bound_radius_;
+};
+
+/** \brief Cover the (scaled and padded) bounding box of \e shape with spheres, placed along the longest side of the box.
+    Spheres are represented exactly. Infinite shapes (planes) and octrees produce no spheres. */
+void computeShapeSpheres(const shapes::Shape *shape, double scale, double padding, std::vector<CollisionSphere> &spheres);
+
+/** \brief Append the spheres in \e spheres to \e body, transformed by \e pose */
+void addSpheresToBody(const std::vector<CollisionSphere> &spheres, const Eigen::Affine3d &pose, SphereBody &body);
+
+/** \brief Compute the bounding sphere of \e body from its spheres */
+void updateBoundingSphere(SphereBody &body);
+
+/** \brief Return true if collisions between \e b1 and \e b2 need not be checked: the bodies are the same, the allowed
+    collision matrix always allows the collision, a link touches an attached body that is allowed to touch it, or the
+    bodies are attached to the same link. If the matrix only allows some contacts, the decision function is stored in
+    \e dcf. \e acm may be NULL. */
+bool isCollisionAlwaysAllowed(const SphereBody &b1, const SphereBody &b2, const AllowedCollisionMatrix *acm,
+                              DecideContactFn &dcf, bool verbose);
+
+/** \brief Return the number of contacts that can still be stored in \e res for the pair (\e id1, \e id2) */
+std::size_t getWantedContactCount(const std::string &id1, const std::string &id2,
+                                  const CollisionRequest &req, const CollisionResult &res);
+
+/** \brief Record the collision described by \e contact in \e res, storing the contact if the request asks for it.
+    Return true if collision checking can stop */
+bool addCollision(const Contact &contact, const CollisionRequest &req, CollisionResult &res);
+
+/** \brief Check the spheres of \e b1 against those of \e b2 and record the collisions in \e res. If \e dcf is set,
+    only contacts it does not accept count as collisions. Return true if collision checking can stop */
+bool checkSphereBodies(const SphereBody &b1, const SphereBody &b2, const DecideContactFn &dcf,
+                       const CollisionRequest &req, CollisionResult &res);
+
+/** \brief Return the smallest signed distance between the surfaces of the spheres of \e b1 and those of \e b2;
+    only pairs of spheres that may be closer than \e bound are considered */
+double distanceSphereBodies(const SphereBody &b1, const SphereBody &b2, double bound);
+
+/** \brief Return the links considered for collision checking by \e req (the links with geometry updated by the group
+    of the request), or NULL if all links are considered */
+const std::set<const robot_model::LinkModel*>* getActiveLinks(const robot_model::RobotModel &model, const CollisionRequest &req);
+
+/** \brief Return true if \e body should be checked given the set of \e active links (which may be NULL) */
+inline bool isActiveBody(const SphereBody &body, const std::set<const robot_model::LinkModel*> *active)
+{
+  return !active || (body.link_ && active->find(body.link_) != active->end());
+}
+
+}
+
+#endif
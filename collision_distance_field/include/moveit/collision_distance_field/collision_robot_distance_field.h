@@ -0,0 +1,154 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2013, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+
+#ifndef MOVEIT_COLLISION_DISTANCE_FIELD_COLLISION_ROBOT_DISTANCE_FIELD_
+#define MOVEIT_COLLISION_DISTANCE_FIELD_COLLISION_ROBOT_DISTANCE_FIELD_
+
+#include <moveit/collision_detection/collision_robot.h>
+#include <moveit/collision_distance_field/collision_common_distance_field.h>
+#include <boost/thread/mutex.hpp>
+
+namespace collision_detection
+{
+
+  /** \brief A collision robot that approximates the collision geometry of every link and attached body by a small set of
+      spheres. Self collisions (and collisions with other robots) are computed between spheres; collisions with the
+      environment are computed by CollisionWorldDistanceField, by looking up the spheres in a distance field.
+
+      Because the spheres enclose the geometry they approximate, the checks are conservative: they can report
+      collisions that an exact checker would not report, but not the other way around. Continuous checks are performed
+      by discrete checks along the motion, at a resolution given by the radius of the smallest sphere. Cost sources are
+      not computed. */
+  class CollisionRobotDistanceField : public CollisionRobot
+  {
+  public:
+
+    CollisionRobotDistanceField(const robot_model::RobotModelConstPtr &kmodel, double padding = 0.0, double scale = 1.0);
+
+    CollisionRobotDistanceField(const CollisionRobotDistanceField &other);
+
+    virtual void checkSelfCollision(const CollisionRequest &req, CollisionResult &res, const robot_state::RobotState &state) const;
+    virtual void checkSelfCollision(const CollisionRequest &req, CollisionResult &res, const robot_state::RobotState &state, const AllowedCollisionMatrix &acm) const;
+    virtual void checkSelfCollision(const CollisionRequest &req, CollisionResult &res, const robot_state::RobotState &state1, const robot_state::RobotState &state2) const;
+    virtual void checkSelfCollision(const CollisionRequest &req, CollisionResult &res, const robot_state::RobotState &state1, const robot_state::RobotState &state2, const AllowedCollisionMatrix &acm) const;
+
+    virtual void checkOtherCollision(const CollisionRequest &req, CollisionResult &res, const robot_state::RobotState &state,
+                                     const CollisionRobot &other_robot, const robot_state::RobotState &other_state) const;
+    virtual void checkOtherCollision(const CollisionRequest &req, CollisionResult &res, const robot_state::RobotState &state,
+                                     const CollisionRobot &other_robot, const robot_state::RobotState &other_state,
+                                     const AllowedCollisionMatrix &acm) const;
+    virtual void checkOtherCollision(const CollisionRequest &req, CollisionResult &res, const robot_state::RobotState &state1, const robot_state::RobotState &state2,
+                                     const CollisionRobot &other_robot, const robot_state::RobotState &other_state1, const robot_state::RobotState &other_state2) const;
+    virtual void checkOtherCollision(const CollisionRequest &req, CollisionResult &res, const robot_state::RobotState &state1, const robot_state::RobotState &state2,
+                                     const CollisionRobot &other_robot, const robot_state::RobotState &other_state1, const robot_state::RobotState &other_state2,
+                                     const AllowedCollisionMatrix &acm) const;
+
+    virtual double distanceSelf(const robot_state::RobotState &state) const;
+    virtual double distanceSelf(const robot_state::RobotState &state, const AllowedCollisionMatrix &acm) const;
+    virtual double distanceOther(const robot_state::RobotState &state,
+                                 const CollisionRobot &other_robot, const robot_state::RobotState &other_state) const;
+    virtual double distanceOther(const robot_state::RobotState &state, const CollisionRobot &other_robot,
+                                 const robot_state::RobotState &other_state, const AllowedCollisionMatrix &acm) const;
+
+    /** \brief Fill \e bodies with the spheres of the links and attached bodies of the robot, placed according to the
+        collision body transforms of \e state (which need to be up to date). The order of the bodies and of their
+        spheres is the same for all states with the same attached bodies. */
+    void getSphereBodies(const robot_state::RobotState &state, std::vector<SphereBody> &bodies) const;
+
+    /** \brief Get the spheres approximating shape \e shape_index of \e link, in the frame of the shape */
+    const std::vector<CollisionSphere>& getLinkSpheres(const robot_model::LinkModel *link, std::size_t shape_index) const
+    {
+      return link_spheres_[link->getLinkIndex()][shape_index];
+    }
+
+    /** \brief The radius of the smallest sphere used for the links of the robot */
+    double getMinSphereRadius() const
+    {
+      return min_sphere_radius_;
+    }
+
+    /** \brief Compute the number of discrete checks needed to check the motion from \e state1 to \e state2 densely
+        enough, given the smallest sphere radius (the collision body transforms of both states need to be up to date) */
+    unsigned int getMotionCheckCount(const robot_state::RobotState &state1, const robot_state::RobotState &state2) const;
+
+  protected:
+
+    virtual void updatedPaddingOrScaling(const std::vector<std::string> &links);
+
+    void computeLinkSpheres(const robot_model::LinkModel *link);
+    void updateMinSphereRadius();
+
+    /** \brief Get the spheres approximating \e shape of an attached body, with scale \e scale and padding \e padding.
+        They are computed once and kept until the cache of attached body spheres fills up. */
+    boost::shared_ptr<const std::vector<CollisionSphere> > getAttachedShapeSpheres(const shapes::ShapeConstPtr &shape,
+                                                                                   double scale, double padding) const;
+
+    void checkSelfCollisionHelper(const CollisionRequest &req, CollisionResult &res, const robot_state::RobotState &state,
+                                  const AllowedCollisionMatrix *acm) const;
+    void checkOtherCollisionHelper(const CollisionRequest &req, CollisionResult &res, const robot_state::RobotState &state,
+                                   const CollisionRobot &other_robot, const robot_state::RobotState &other_state,
+                                   const AllowedCollisionMatrix *acm) const;
+    void checkSelfCollisionHelper(const CollisionRequest &req, CollisionResult &res, const robot_state::RobotState &state1,
+                                  const robot_state::RobotState &state2, const AllowedCollisionMatrix *acm) const;
+    void checkOtherCollisionHelper(const CollisionRequest &req, CollisionResult &res, const robot_state::RobotState &state1,
+                                   const robot_state::RobotState &state2, const CollisionRobot &other_robot,
+                                   const robot_state::RobotState &other_state1, const robot_state::RobotState &other_state2,
+                                   const AllowedCollisionMatrix *acm) const;
+    double distanceSelfHelper(const robot_state::RobotState &state, const AllowedCollisionMatrix *acm) const;
+    double distanceOtherHelper(const robot_state::RobotState &state, const CollisionRobot &other_robot,
+                               const robot_state::RobotState &other_state, const AllowedCollisionMatrix *acm) const;
+
+    /// The spheres of each link, indexed by link index and then by shape index
+    std::vector<std::vector<std::vector<CollisionSphere> > > link_spheres_;
+
+    double min_sphere_radius_;
+
+    /** \brief The spheres computed for a shape of an attached body; the shape is kept, so its address is not reused */
+    struct AttachedShapeSpheres
+    {
+      shapes::ShapeConstPtr                                  shape_;
+      double                                                 scale_;
+      double                                                 padding_;
+      boost::shared_ptr<const std::vector<CollisionSphere> > spheres_;
+    };
+
+    /// The spheres of the shapes of attached bodies, by shape
+    mutable std::map<const shapes::Shape*, AttachedShapeSpheres> attached_spheres_;
+    mutable boost::mutex                                        attached_spheres_lock_;
+  };
+
+}
+
+#endif
@@ -0,0 +1,188 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2013, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+
+#ifndef MOVEIT_COLLISION_DISTANCE_FIELD_COLLISION_WORLD_DISTANCE_FIELD_
+#define MOVEIT_COLLISION_DISTANCE_FIELD_COLLISION_WORLD_DISTANCE_FIELD_
+
+#include <moveit/collision_detection/collision_world.h>
+#include <moveit/collision_distance_field/collision_robot_distance_field.h>
+#include <moveit/distance_field/propagation_distance_field.h>
+#include <boost/thread/mutex.hpp>
+
+namespace collision_detection
+{
+
+  /** \brief A collision world that keeps the voxelized geometry of all world objects in a signed distance field, which
+      is updated incrementally as objects change. A robot represented by CollisionRobotDistanceField is in collision if
+      the distance to the nearest obstacle at the center of one of its spheres is less than the radius of the sphere.
+
+      Only the volume covered by the distance field is considered. Links whose collisions with some (but not all)
+      world objects are allowed by the allowed collision matrix, as well as spheres larger than the maximum propagation
+      distance, are checked against bounding spheres of the objects instead. Collisions between worlds are also only
+      checked with these bounding spheres. */
+  class CollisionWorldDistanceField : public CollisionWorld
+  {
+  public:
+
+    CollisionWorldDistanceField();
+    explicit CollisionWorldDistanceField(const WorldPtr& world);
+
+    /** \brief Construct a collision world with a distance field of dimensions \e size, with its minimum corner at
+        \e origin, with cells of size \e resolution and with distances propagated up to \e max_distance */
+    CollisionWorldDistanceField(const WorldPtr& world, const Eigen::Vector3d &size, const Eigen::Vector3d &origin,
+                                double resolution, double max_distance);
+
+    CollisionWorldDistanceField(const CollisionWorldDistanceField &other, const WorldPtr& world);
+    virtual ~CollisionWorldDistanceField();
+
+    virtual void checkRobotCollision(const CollisionRequest &req, CollisionResult &res, const CollisionRobot &robot, const robot_state::RobotState &state) const;
+    virtual void checkRobotCollision(const CollisionRequest &req, CollisionResult &res, const CollisionRobot &robot, const robot_state::RobotState &state, const AllowedCollisionMatrix &acm) const;
+    virtual void checkRobotCollision(const CollisionRequest &req, CollisionResult &res, const CollisionRobot &robot, const robot_state::RobotState &state1, const robot_state::RobotState &state2) const;
+    virtual void checkRobotCollision(const CollisionRequest &req, CollisionResult &res, const CollisionRobot &robot, const robot_state::RobotState &state1, const robot_state::RobotState &state2, const AllowedCollisionMatrix &acm) const;
+    virtual void checkWorldCollision(const CollisionRequest &req, CollisionResult &res, const CollisionWorld &other_world) const;
+    virtual void checkWorldCollision(const CollisionRequest &req, CollisionResult &res, const CollisionWorld &other_world, const AllowedCollisionMatrix &acm) const;
+
+    virtual double distanceRobot(const CollisionRobot &robot, const robot_state::RobotState &state) const;
+    virtual double distanceRobot(const CollisionRobot &robot, const robot_state::RobotState &state, const AllowedCollisionMatrix &acm) const;
+    virtual double distanceWorld(const CollisionWorld &world) const;
+    virtual double distanceWorld(const CollisionWorld &world, const AllowedCollisionMatrix &acm) const;
+
+    virtual void setWorld(const WorldPtr& world);
+
+    /** \brief For every sphere of \e robot at \e state (in the order given by CollisionRobotDistanceField::getSphereBodies()),
+        compute the distance from the surface of the sphere to the nearest obstacle and the gradient of the distance
+        field at the center of the sphere (zero if it is not known). This is what optimizing planners need to push a
+        robot out of collision. */
+    void getSphereDistances(const CollisionRobot &robot, const robot_state::RobotState &state,
+                            std::vector<double> &distances, EigenSTL::vector_Vector3d &gradients) const;
+
+    /** \brief Check many states of \e robot for collisions with the world at once, as checkRobotCollision() would
+        (only the group and the allowed collision matrix of the request are used; no contacts are computed). \e colliding
+        is set to 1 for the states in collision and 0 for the others. The spheres of all the states are placed first and
+        then looked up in the distance field in a single pass, so the cost per state is that of the lookups. States with
+        bodies that need to be checked against the bounding spheres of objects are checked one by one. */
+    void checkRobotCollisionBatch(const CollisionRequest &req, const CollisionRobot &robot,
+                                  const std::vector<const robot_state::RobotState*> &states, std::vector<unsigned char> &colliding) const;
+    void checkRobotCollisionBatch(const CollisionRequest &req, const CollisionRobot &robot,
+                                  const std::vector<const robot_state::RobotState*> &states, std::vector<unsigned char> &colliding,
+                                  const AllowedCollisionMatrix &acm) const;
+
+    /** \brief Get the distance field the world objects are represented in */
+    const distance_field::PropagationDistanceField& getDistanceField() const
+    {
+      return *distance_field_;
+    }
+
+  protected:
+
+    void checkRobotCollisionHelper(const CollisionRequest &req, CollisionResult &res, const CollisionRobot &robot, const robot_state::RobotState &state, const AllowedCollisionMatrix *acm) const;
+    void checkRobotCollisionHelper(const CollisionRequest &req, CollisionResult &res, const CollisionRobot &robot, const robot_state::RobotState &state1,
+                                   const robot_state::RobotState &state2, const AllowedCollisionMatrix *acm) const;
+    void checkWorldCollisionHelper(const CollisionRequest &req, CollisionResult &res, const CollisionWorld &other_world, const AllowedCollisionMatrix *acm) const;
+    double distanceRobotHelper(const CollisionRobot &robot, const robot_state::RobotState &state, const AllowedCollisionMatrix *acm) const;
+    double distanceWorldHelper(const CollisionWorld &world, const AllowedCollisionMatrix *acm) const;
+    void checkRobotCollisionBatchHelper(const CollisionRequest &req, const CollisionRobot &robot,
+                                        const std::vector<const robot_state::RobotState*> &states, std::vector<unsigned char> &colliding,
+                                        const AllowedCollisionMatrix *acm) const;
+
+    /** \brief How the world objects relate to a robot body, as the allowed collision matrix specifies */
+    struct BodyObjects
+    {
+      /// The objects the body is always allowed to collide with
+      std::vector<const SphereBody*> allowed_;
+
+      /// The objects the body is not always allowed to collide with, with the deciders of the conditionally allowed ones
+      std::vector<std::pair<const SphereBody*, DecideContactFn> > checked_;
+
+      /// True if the collisions with some of the objects in \e checked_ are conditionally allowed
+      bool conditional_;
+    };
+    typedef boost::shared_ptr<const BodyObjects> BodyObjectsConstPtr;
+
+    /** \brief Get how the world objects relate to the body called \e id. This is computed once for every body, version of
+        \e acm and state of the world objects, so checks need no allowed collision matrix lookups */
+    BodyObjectsConstPtr getBodyObjects(const std::string &id, const AllowedCollisionMatrix &acm) const;
+
+    /** \brief Find the world objects \e body needs to be checked against using their bounding spheres. Return false if
+        the distance field can be used for \e body instead: when no collision of \e body is allowed or, if \e collision
+        is true, when no sphere of \e body reaches the bounding spheres of the objects it is always allowed to collide
+        with (so any obstacle the distance field finds within the spheres is one of the other objects). */
+    bool getExplicitCheckObjects(const SphereBody &body, const AllowedCollisionMatrix *acm,
+                                 std::vector<std::pair<const SphereBody*, DecideContactFn> > &objects, bool collision) const;
+
+    /** \brief Get the world object whose bounding spheres are closest to \e point (NULL if there are no objects) and
+        the distance from \e point to the surface of the closest bounding sphere */
+    const SphereBody* getNearestObject(const Eigen::Vector3d &point, double &distance) const;
+
+    /** \brief Compute the linear indices of the cells of the distance field occupied by \e obj, and the bounding spheres of its shapes */
+    void computeObjectCells(const World::Object &obj, std::vector<int> &cells, SphereBody &bounds) const;
+
+    /** \brief Update the distance field for the object \e id, which now has geometry \e obj (NULL if the object was removed) */
+    void updateObject(const std::string &id, const World::Object *obj);
+
+    /** \brief Make sure the distance field is not shared with a copy of this world, before modifying it */
+    void ensureUniqueDistanceField();
+
+    Eigen::Vector3d size_;
+    Eigen::Vector3d origin_;
+    double          resolution_;
+    double          max_distance_;
+
+    /// The distance field; it is shared with copies of this world until one of them is modified
+    boost::shared_ptr<distance_field::PropagationDistanceField> distance_field_;
+
+    /// The sorted linear indices of the cells occupied by each object
+    std::map<std::string, std::vector<int> > object_cells_;
+
+    /// The number of objects occupying each cell that is marked as an obstacle in the distance field
+    std::map<int, unsigned int>              cell_counts_;
+
+    /// The bounding spheres of the shapes of each object
+    std::map<std::string, SphereBody>        object_bounds_;
+
+    /// The results of getBodyObjects(), by version of the allowed collision matrix and by body name; cleared when an
+    /// object changes
+    mutable std::map<boost::uint64_t, std::map<std::string, BodyObjectsConstPtr> > body_objects_;
+    mutable boost::mutex                                                          body_objects_lock_;
+
+  private:
+    void initialize(const Eigen::Vector3d &size, const Eigen::Vector3d &origin, double resolution, double max_distance);
+    void notifyObjectChange(const ObjectConstPtr& obj, World::Action action);
+    World::ObserverHandle observer_handle_;
+  };
+
+}
+
+#endif
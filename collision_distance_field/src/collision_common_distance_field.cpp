@@ -0,0 +1,265 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2013, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+
+#include <moveit/collision_distance_field/collision_common_distance_field.h>
+#include <geometric_shapes/shape_operations.h>
+#include <limits>
+#include <cmath>
+
+void collision_detection::computeShapeSpheres(const shapes::Shape *shape, double scale, double padding, std::vector<CollisionSphere> &spheres)
+{
+  Eigen::Vector3d center(0.0, 0.0, 0.0);
+  Eigen::Vector3d extents;
+  switch (shape->type)
+  {
+  case shapes::SPHERE:
+    spheres.push_back(CollisionSphere(center, static_cast<const shapes::Sphere*>(shape)->radius * scale + padding));
+    return;
+  case shapes::BOX:
+  case shapes::CYLINDER:
+  case shapes::CONE:
+    extents = shapes::computeShapeExtents(shape);
+    break;
+  case shapes::MESH:
+    {
+      const shapes::Mesh *mesh = static_cast<const shapes::Mesh*>(shape);
+      if (mesh->vertex_count == 0)
+        return;
+      Eigen::Vector3d vmin(mesh->vertices[0], mesh->vertices[1], mesh->vertices[2]);
+      Eigen::Vector3d vmax = vmin;
+      for (unsigned int i = 1 ; i < mesh->vertex_count ; ++i)
+      {
+        Eigen::Vector3d v(mesh->vertices[3 * i], mesh->vertices[3 * i + 1], mesh->vertices[3 * i + 2]);
+        vmin = vmin.cwiseMin(v);
+        vmax = vmax.cwiseMax(v);
+      }
+      center = (vmin + vmax) * 0.5 * scale;
+      extents = vmax - vmin;
+    }
+    break;
+  default:
+    return;
+  }
+  extents = extents * scale + Eigen::Vector3d::Constant(2.0 * padding);
+
+  // the spheres are stacked along the longest side of the box; each sphere covers a slab of the box
+  int axis;
+  double length = extents.maxCoeff(&axis);
+  double a = extents[(axis + 1) % 3];
+  double b = extents[(axis + 2) % 3];
+  double width = std::max(a, b);
+  unsigned int n = width > std::numeric_limits<double>::epsilon() ? std::max(1, (int)ceil(length / width)) : 1;
+  double step = length / (double)n;
+  double radius = 0.5 * sqrt(a * a + b * b + step * step);
+  for (unsigned int i = 0 ; i < n ; ++i)
+  {
+    Eigen::Vector3d c = center;
+    c[axis] += -0.5 * length + step * ((double)i + 0.5);
+    spheres.push_back(CollisionSphere(c, radius));
+  }
+}
+
+void collision_detection::addSpheresToBody(const std::vector<CollisionSphere> &spheres, const Eigen::Affine3d &pose, SphereBody &body)
+{
+  for (std::size_t i = 0 ; i < spheres.size() ; ++i)
+  {
+    body.centers_.push_back(pose * spheres[i].center_);
+    body.radii_.push_back(spheres[i].radius_);
+  }
+}
+
+void collision_detection::updateBoundingSphere(SphereBody &body)
+{
+  if (body.centers_.empty())
+  {
+    body.bound_center_.setZero();
+    body.bound_radius_ = 0.0;
+    return;
+  }
+  Eigen::Vector3d vmin = body.centers_[0] - Eigen::Vector3d::Constant(body.radii_[0]);
+  Eigen::Vector3d vmax = body.centers_[0] + Eigen::Vector3d::Constant(body.radii_[0]);
+  for (std::size_t i = 1 ; i < body.centers_.size() ; ++i)
+  {
+    vmin = vmin.cwiseMin(body.centers_[i] - Eigen::Vector3d::Constant(body.radii_[i]));
+    vmax = vmax.cwiseMax(body.centers_[i] + Eigen::Vector3d::Constant(body.radii_[i]));
+  }
+  body.bound_center_ = (vmin + vmax) * 0.5;
+  body.bound_radius_ = 0.0;
+  for (std::size_t i = 0 ; i < body.centers_.size() ; ++i)
+    body.bound_radius_ = std::max(body.bound_radius_, (body.centers_[i] - body.bound_center_).norm() + body.radii_[i]);
+}
+
+bool collision_detection::isCollisionAlwaysAllowed(const SphereBody &b1, const SphereBody &b2, const AllowedCollisionMatrix *acm,
+                                                   DecideContactFn &dcf, bool verbose)
+{
+  // do not check a body against itself
+  if (b1.type_ == b2.type_ && b1.id_ == b2.id_)
+    return true;
+
+  if (acm)
+  {
+    AllowedCollision::Type type;
+    if (acm->getAllowedCollision(b1.getID(), b2.getID(), type))
+    {
+      if (type == AllowedCollision::ALWAYS)
+      {
+        if (verbose)
+          logDebug("Collision between '%s' and '%s' is always allowed. No contacts are computed.", b1.getID().c_str(), b2.getID().c_str());
+        return true;
+      }
+      if (type == AllowedCollision::CONDITIONAL)
+      {
+        acm->getAllowedCollision(b1.getID(), b2.getID(), dcf);
+        if (verbose)
+          logDebug("Collision between '%s' and '%s' is conditionally allowed", b1.getID().c_str(), b2.getID().c_str());
+      }
+    }
+  }
+
+  // check if a link is touching an attached object
+  if (b1.type_ == BodyTypes::ROBOT_LINK && b2.type_ == BodyTypes::ROBOT_ATTACHED)
+  {
+    const std::set<std::string> &tl = b2.attached_body_->getTouchLinks();
+    if (tl.find(b1.getID()) != tl.end())
+      return true;
+  }
+  else
+    if (b2.type_ == BodyTypes::ROBOT_LINK && b1.type_ == BodyTypes::ROBOT_ATTACHED)
+    {
+      const std::set<std::string> &tl = b1.attached_body_->getTouchLinks();
+      if (tl.find(b2.getID()) != tl.end())
+        return true;
+    }
+
+  // bodies attached to the same link should not collide
+  if (b1.type_ == BodyTypes::ROBOT_ATTACHED && b2.type_ == BodyTypes::ROBOT_ATTACHED && b1.link_ == b2.link_)
+    return true;
+
+  return false;
+}
+
+std::size_t collision_detection::getWantedContactCount(const std::string &id1, const std::string &id2,
+                                                       const CollisionRequest &req, const CollisionResult &res)
+{
+  if (!req.contacts || res.contact_count >= req.max_contacts)
+    return 0;
+  CollisionResult::ContactMap::const_iterator it = res.contacts.find(id1 < id2 ? std::make_pair(id1, id2) : std::make_pair(id2, id1));
+  std::size_t have = it != res.contacts.end() ? it->second.size() : 0;
+  if (have >= req.max_contacts_per_pair)
+    return 0;
+  return std::min(req.max_contacts_per_pair - have, req.max_contacts - res.contact_count);
+}
+
+bool collision_detection::addCollision(const Contact &contact, const CollisionRequest &req, CollisionResult &res)
+{
+  res.collision = true;
+  if (getWantedContactCount(contact.body_name_1, contact.body_name_2, req, res) > 0)
+  {
+    res.contacts[contact.body_name_1 < contact.body_name_2 ?
+                 std::make_pair(contact.body_name_1, contact.body_name_2) :
+                 std::make_pair(contact.body_name_2, contact.body_name_1)].push_back(contact);
+    res.contact_count++;
+    if (req.verbose)
+      logInform("Found a contact between '%s' and '%s', which constitutes a collision. Contact was stored.",
+                contact.body_name_1.c_str(), contact.body_name_2.c_str());
+  }
+  else
+    if (req.verbose)
+      logInform("Found a contact between '%s' and '%s', which constitutes a collision. Contact information is not stored.",
+                contact.body_name_1.c_str(), contact.body_name_2.c_str());
+
+  if (!req.contacts || res.contact_count >= req.max_contacts)
+  {
+    if (req.verbose)
+      logInform("Collision checking is considered complete (collision was found and %u contacts are stored)",
+                (unsigned int)res.contact_count);
+    return true;
+  }
+  return req.is_done ? req.is_done(res) : false;
+}
+
+bool collision_detection::checkSphereBodies(const SphereBody &b1, const SphereBody &b2, const DecideContactFn &dcf,
+                                            const CollisionRequest &req, CollisionResult &res)
+{
+  if ((b1.bound_center_ - b2.bound_center_).squaredNorm() >= (b1.bound_radius_ + b2.bound_radius_) * (b1.bound_radius_ + b2.bound_radius_))
+    return false;
+
+  for (std::size_t i = 0 ; i < b1.centers_.size() ; ++i)
+    for (std::size_t j = 0 ; j < b2.centers_.size() ; ++j)
+    {
+      double r = b1.radii_[i] + b2.radii_[j];
+      Eigen::Vector3d dir = b2.centers_[j] - b1.centers_[i];
+      double d2 = dir.squaredNorm();
+      if (d2 >= r * r)
+        continue;
+      double d = sqrt(d2);
+      Contact c;
+      c.normal = d > std::numeric_limits<double>::epsilon() ? Eigen::Vector3d(dir / d) : Eigen::Vector3d(0.0, 0.0, 1.0);
+      c.depth = r - d;
+      c.pos = b1.centers_[i] + c.normal * (b1.radii_[i] - 0.5 * c.depth);
+      c.body_name_1 = b1.getID();
+      c.body_type_1 = b1.type_;
+      c.body_name_2 = b2.getID();
+      c.body_type_2 = b2.type_;
+
+      // if the contact is acceptable, keep looking
+      if (dcf && dcf(c))
+        continue;
+      if (addCollision(c, req, res))
+        return true;
+      // no more contacts are needed for this pair
+      if (getWantedContactCount(c.body_name_1, c.body_name_2, req, res) == 0)
+        return false;
+    }
+  return false;
+}
+
+double collision_detection::distanceSphereBodies(const SphereBody &b1, const SphereBody &b2, double bound)
+{
+  if ((b1.bound_center_ - b2.bound_center_).norm() - b1.bound_radius_ - b2.bound_radius_ >= bound)
+    return bound;
+  double d = bound;
+  for (std::size_t i = 0 ; i < b1.centers_.size() ; ++i)
+    for (std::size_t j = 0 ; j < b2.centers_.size() ; ++j)
+      d = std::min(d, (b2.centers_[j] - b1.centers_[i]).norm() - b1.radii_[i] - b2.radii_[j]);
+  return d;
+}
+
+const std::set<const robot_model::LinkModel*>* collision_detection::getActiveLinks(const robot_model::RobotModel &model, const CollisionRequest &req)
+{
+  if (model.hasJointModelGroup(req.group_name))
+    return &model.getJointModelGroup(req.group_name)->getUpdatedLinkModelsWithGeometrySet();
+  return NULL;
+}
@@ -0,0 +1,411 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2013, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+
+#include <moveit/collision_distance_field/collision_robot_distance_field.h>
+#include <limits>
+
+namespace collision_detection
+{
+namespace
+{
+
+// the upper bound on the number of discrete checks performed for a motion
+static const unsigned int MAX_MOTION_CHECKS = 1000;
+
+// the number of shapes of attached bodies whose spheres are cached; the cache is cleared when it is full
+static const std::size_t MAX_ATTACHED_SHAPES = 64;
+
+// the displacement bound for a point at distance r from the origin of a frame moving between poses a and b
+inline double poseMotionBound(const Eigen::Affine3d &a, const Eigen::Affine3d &b, double r)
+{
+  double angle = Eigen::AngleAxisd(a.linear().transpose() * b.linear()).angle();
+  return (b.translation() - a.translation()).norm() + angle * r;
+}
+
+inline double getSpheresExtent(const std::vector<CollisionSphere> &spheres)
+{
+  double r = 0.0;
+  for (std::size_t i = 0 ; i < spheres.size() ; ++i)
+    r = std::max(r, spheres[i].center_.norm() + spheres[i].radius_);
+  return r;
+}
+
+}
+}
+
+collision_detection::CollisionRobotDistanceField::CollisionRobotDistanceField(const robot_model::RobotModelConstPtr &kmodel, double padding, double scale)
+  : CollisionRobot(kmodel, padding, scale)
+{
+  link_spheres_.resize(robot_model_->getLinkModelCount());
+  const std::vector<const robot_model::LinkModel*> &links = robot_model_->getLinkModelsWithCollisionGeometry();
+  for (std::size_t i = 0 ; i < links.size() ; ++i)
+    computeLinkSpheres(links[i]);
+  updateMinSphereRadius();
+}
+
+collision_detection::CollisionRobotDistanceField::CollisionRobotDistanceField(const CollisionRobotDistanceField &other)
+  : CollisionRobot(other)
+  , link_spheres_(other.link_spheres_)
+  , min_sphere_radius_(other.min_sphere_radius_)
+{
+}
+
+void collision_detection::CollisionRobotDistanceField::computeLinkSpheres(const robot_model::LinkModel *link)
+{
+  double scale = getLinkScale(link->getName());
+  double padding = getLinkPadding(link->getName());
+  const std::vector<shapes::ShapeConstPtr> &shapes = link->getShapes();
+  std::vector<std::vector<CollisionSphere> > &spheres = link_spheres_[link->getLinkIndex()];
+  spheres.clear();
+  spheres.resize(shapes.size());
+  for (std::size_t j = 0 ; j < shapes.size() ; ++j)
+    computeShapeSpheres(shapes[j].get(), scale, padding, spheres[j]);
+}
+
+void collision_detection::CollisionRobotDistanceField::updateMinSphereRadius()
+{
+  min_sphere_radius_ = std::numeric_limits<double>::infinity();
+  for (std::size_t i = 0 ; i < link_spheres_.size() ; ++i)
+    for (std::size_t j = 0 ; j < link_spheres_[i].size() ; ++j)
+      for (std::size_t k = 0 ; k < link_spheres_[i][j].size() ; ++k)
+        min_sphere_radius_ = std::min(min_sphere_radius_, link_spheres_[i][j][k].radius_);
+}
+
+void collision_detection::CollisionRobotDistanceField::updatedPaddingOrScaling(const std::vector<std::string> &links)
+{
+  for (std::size_t i = 0 ; i < links.size() ; ++i)
+    if (robot_model_->hasLinkModel(links[i]))
+      computeLinkSpheres(robot_model_->getLinkModel(links[i]));
+  updateMinSphereRadius();
+}
+
+boost::shared_ptr<const std::vector<collision_detection::CollisionSphere> >
+collision_detection::CollisionRobotDistanceField::getAttachedShapeSpheres(const shapes::ShapeConstPtr &shape, double scale, double padding) const
+{
+  boost::mutex::scoped_lock slock(attached_spheres_lock_);
+  std::map<const shapes::Shape*, AttachedShapeSpheres>::iterator it = attached_spheres_.find(shape.get());
+  if (it != attached_spheres_.end() && it->second.scale_ == scale && it->second.padding_ == padding)
+    return it->second.spheres_;
+
+  boost::shared_ptr<std::vector<CollisionSphere> > spheres(new std::vector<CollisionSphere>());
+  computeShapeSpheres(shape.get(), scale, padding, *spheres);
+  if (it == attached_spheres_.end() && attached_spheres_.size() >= MAX_ATTACHED_SHAPES)
+    attached_spheres_.clear();
+  AttachedShapeSpheres &entry = attached_spheres_[shape.get()];
+  entry.shape_ = shape;
+  entry.scale_ = scale;
+  entry.padding_ = padding;
+  entry.spheres_ = spheres;
+  return spheres;
+}
+
+void collision_detection::CollisionRobotDistanceField::getSphereBodies(const robot_state::RobotState &state, std::vector<SphereBody> &bodies) const
+{
+  bodies.clear();
+  const std::vector<const robot_model::LinkModel*> &links = robot_model_->getLinkModelsWithCollisionGeometry();
+  bodies.reserve(links.size());
+  for (std::size_t i = 0 ; i < links.size() ; ++i)
+  {
+    const std::vector<std::vector<CollisionSphere> > &spheres = link_spheres_[links[i]->getLinkIndex()];
+    bodies.resize(bodies.size() + 1);
+    SphereBody &b = bodies.back();
+    b.id_ = &links[i]->getName();
+    b.type_ = BodyTypes::ROBOT_LINK;
+    b.link_ = links[i];
+    for (std::size_t j = 0 ; j < spheres.size() ; ++j)
+      addSpheresToBody(spheres[j], state.getCollisionBodyTransform(links[i], j), b);
+    if (b.centers_.empty())
+      bodies.pop_back();
+    else
+      updateBoundingSphere(b);
+  }
+
+  std::vector<const robot_state::AttachedBody*> ab;
+  state.getAttachedBodies(ab);
+  for (std::size_t i = 0 ; i < ab.size() ; ++i)
+  {
+    const std::vector<shapes::ShapeConstPtr> &shapes = ab[i]->getShapes();
+    const EigenSTL::vector_Affine3d &poses = ab[i]->getGlobalCollisionBodyTransforms();
+    double scale = getLinkScale(ab[i]->getName());
+    double padding = getLinkPadding(ab[i]->getName());
+    bodies.resize(bodies.size() + 1);
+    SphereBody &b = bodies.back();
+    b.id_ = &ab[i]->getName();
+    b.type_ = BodyTypes::ROBOT_ATTACHED;
+    b.link_ = ab[i]->getAttachedLink();
+    b.attached_body_ = ab[i];
+    for (std::size_t j = 0 ; j < shapes.size() ; ++j)
+      addSpheresToBody(*getAttachedShapeSpheres(shapes[j], scale, padding), poses[j], b);
+    if (b.centers_.empty())
+      bodies.pop_back();
+    else
+      updateBoundingSphere(b);
+  }
+}
+
+unsigned int collision_detection::CollisionRobotDistanceField::getMotionCheckCount(const robot_state::RobotState &state1, const robot_state::RobotState &state2) const
+{
+  double bound = 0.0;
+  const std::vector<const robot_model::LinkModel*> &links = robot_model_->getLinkModelsWithCollisionGeometry();
+  for (std::size_t i = 0 ; i < links.size() ; ++i)
+  {
+    const std::vector<std::vector<CollisionSphere> > &spheres = link_spheres_[links[i]->getLinkIndex()];
+    for (std::size_t j = 0 ; j < spheres.size() ; ++j)
+      bound = std::max(bound, poseMotionBound(state1.getCollisionBodyTransform(links[i], j),
+                                              state2.getCollisionBodyTransform(links[i], j), getSpheresExtent(spheres[j])));
+  }
+
+  // the bodies attached in both states; their spheres are computed with the scale and padding of the body
+  std::vector<const robot_state::AttachedBody*> ab;
+  state1.getAttachedBodies(ab);
+  for (std::size_t i = 0 ; i < ab.size() ; ++i)
+  {
+    const robot_state::AttachedBody *ab2 = state2.getAttachedBody(ab[i]->getName());
+    if (!ab2)
+      continue;
+    const std::vector<shapes::ShapeConstPtr> &shapes = ab[i]->getShapes();
+    for (std::size_t j = 0 ; j < shapes.size() ; ++j)
+    {
+      boost::shared_ptr<const std::vector<CollisionSphere> > spheres =
+        getAttachedShapeSpheres(shapes[j], getLinkScale(ab[i]->getName()), getLinkPadding(ab[i]->getName()));
+      bound = std::max(bound, poseMotionBound(ab[i]->getGlobalCollisionBodyTransforms()[j],
+                                              ab2->getGlobalCollisionBodyTransforms()[j], getSpheresExtent(*spheres)));
+    }
+  }
+
+  if (bound <= 0.0 || !(min_sphere_radius_ < std::numeric_limits<double>::infinity()))
+    return 2;
+  double steps = ceil(bound / min_sphere_radius_) + 1.0;
+  if (steps > MAX_MOTION_CHECKS)
+  {
+    logDebug("Motion needs %.0lf discrete checks; only %u are performed", steps, MAX_MOTION_CHECKS);
+    return MAX_MOTION_CHECKS;
+  }
+  return std::max(2u, (unsigned int)steps);
+}
+
+void collision_detection::CollisionRobotDistanceField::checkSelfCollision(const CollisionRequest &req, CollisionResult &res, const robot_state::RobotState &state) const
+{
+  checkSelfCollisionHelper(req, res, state, NULL);
+}
+
+void collision_detection::CollisionRobotDistanceField::checkSelfCollision(const CollisionRequest &req, CollisionResult &res, const robot_state::RobotState &state,
+                                                                          const AllowedCollisionMatrix &acm) const
+{
+  checkSelfCollisionHelper(req, res, state, &acm);
+}
+
+void collision_detection::CollisionRobotDistanceField::checkSelfCollision(const CollisionRequest &req, CollisionResult &res, const robot_state::RobotState &state1, const robot_state::RobotState &state2) const
+{
+  checkSelfCollisionHelper(req, res, state1, state2, NULL);
+}
+
+void collision_detection::CollisionRobotDistanceField::checkSelfCollision(const CollisionRequest &req, CollisionResult &res, const robot_state::RobotState &state1, const robot_state::RobotState &state2, const AllowedCollisionMatrix &acm) const
+{
+  checkSelfCollisionHelper(req, res, state1, state2, &acm);
+}
+
+void collision_detection::CollisionRobotDistanceField::checkSelfCollisionHelper(const CollisionRequest &req, CollisionResult &res, const robot_state::RobotState &state,
+                                                                                const AllowedCollisionMatrix *acm) const
+{
+  std::vector<SphereBody> bodies;
+  getSphereBodies(state, bodies);
+  const std::set<const robot_model::LinkModel*> *active = getActiveLinks(*robot_model_, req);
+
+  bool done = false;
+  for (std::size_t i = 0 ; i < bodies.size() && !done ; ++i)
+    for (std::size_t j = i + 1 ; j < bodies.size() && !done ; ++j)
+    {
+      if (!isActiveBody(bodies[i], active) && !isActiveBody(bodies[j], active))
+        continue;
+      DecideContactFn dcf;
+      if (isCollisionAlwaysAllowed(bodies[i], bodies[j], acm, dcf, req.verbose))
+        continue;
+      done = checkSphereBodies(bodies[i], bodies[j], dcf, req, res);
+    }
+
+  if (req.distance)
+    res.distance = distanceSelfHelper(state, acm);
+}
+
+void collision_detection::CollisionRobotDistanceField::checkSelfCollisionHelper(const CollisionRequest &req, CollisionResult &res, const robot_state::RobotState &state1,
+                                                                                const robot_state::RobotState &state2, const AllowedCollisionMatrix *acm) const
+{
+  CollisionRequest step_req = req;
+  step_req.distance = false;
+  unsigned int steps = getMotionCheckCount(state1, state2);
+  robot_state::RobotState current(state1);
+  for (unsigned int i = 0 ; i < steps && !res.collision ; ++i)
+  {
+    state1.interpolate(state2, (double)i / (double)(steps - 1), current);
+    current.updateCollisionBodyTransforms();
+    checkSelfCollisionHelper(step_req, res, current, acm);
+    if (res.collision)
+      logDebug("Self collision found at time %lf along the motion", (double)i / (double)(steps - 1));
+  }
+}
+
+void collision_detection::CollisionRobotDistanceField::checkOtherCollision(const CollisionRequest &req, CollisionResult &res, const robot_state::RobotState &state,
+                                                                           const CollisionRobot &other_robot, const robot_state::RobotState &other_state) const
+{
+  checkOtherCollisionHelper(req, res, state, other_robot, other_state, NULL);
+}
+
+void collision_detection::CollisionRobotDistanceField::checkOtherCollision(const CollisionRequest &req, CollisionResult &res, const robot_state::RobotState &state,
+                                                                           const CollisionRobot &other_robot, const robot_state::RobotState &other_state,
+                                                                           const AllowedCollisionMatrix &acm) const
+{
+  checkOtherCollisionHelper(req, res, state, other_robot, other_state, &acm);
+}
+
+void collision_detection::CollisionRobotDistanceField::checkOtherCollision(const CollisionRequest &req, CollisionResult &res, const robot_state::RobotState &state1, const robot_state::RobotState &state2,
+                                                                           const CollisionRobot &other_robot, const robot_state::RobotState &other_state1, const robot_state::RobotState &other_state2) const
+{
+  checkOtherCollisionHelper(req, res, state1, state2, other_robot, other_state1, other_state2, NULL);
+}
+
+void collision_detection::CollisionRobotDistanceField::checkOtherCollision(const CollisionRequest &req, CollisionResult &res, const robot_state::RobotState &state1, const robot_state::RobotState &state2,
+                                                                           const CollisionRobot &other_robot, const robot_state::RobotState &other_state1, const robot_state::RobotState &other_state2,
+                                                                           const AllowedCollisionMatrix &acm) const
+{
+  checkOtherCollisionHelper(req, res, state1, state2, other_robot, other_state1, other_state2, &acm);
+}
+
+void collision_detection::CollisionRobotDistanceField::checkOtherCollisionHelper(const CollisionRequest &req, CollisionResult &res, const robot_state::RobotState &state,
+                                                                                 const CollisionRobot &other_robot, const robot_state::RobotState &other_state,
+                                                                                 const AllowedCollisionMatrix *acm) const
+{
+  const CollisionRobotDistanceField &other = dynamic_cast<const CollisionRobotDistanceField&>(other_robot);
+  std::vector<SphereBody> bodies, other_bodies;
+  getSphereBodies(state, bodies);
+  other.getSphereBodies(other_state, other_bodies);
+  const std::set<const robot_model::LinkModel*> *active = getActiveLinks(*robot_model_, req);
+
+  bool done = false;
+  for (std::size_t i = 0 ; i < bodies.size() && !done ; ++i)
+  {
+    if (!isActiveBody(bodies[i], active))
+      continue;
+    for (std::size_t j = 0 ; j < other_bodies.size() && !done ; ++j)
+    {
+      DecideContactFn dcf;
+      if (isCollisionAlwaysAllowed(bodies[i], other_bodies[j], acm, dcf, req.verbose))
+        continue;
+      done = checkSphereBodies(bodies[i], other_bodies[j], dcf, req, res);
+    }
+  }
+
+  if (req.distance)
+    res.distance = distanceOtherHelper(state, other_robot, other_state, acm);
+}
+
+void collision_detection::CollisionRobotDistanceField::checkOtherCollisionHelper(const CollisionRequest &req, CollisionResult &res, const robot_state::RobotState &state1, const robot_state::RobotState &state2,
+                                                                                 const CollisionRobot &other_robot, const robot_state::RobotState &other_state1, const robot_state::RobotState &other_state2,
+                                                                                 const AllowedCollisionMatrix *acm) const
+{
+  const CollisionRobotDistanceField &other = dynamic_cast<const CollisionRobotDistanceField&>(other_robot);
+  CollisionRequest step_req = req;
+  step_req.distance = false;
+  unsigned int steps = std::max(getMotionCheckCount(state1, state2), other.getMotionCheckCount(other_state1, other_state2));
+  robot_state::RobotState current(state1);
+  robot_state::RobotState other_current(other_state1);
+  for (unsigned int i = 0 ; i < steps && !res.collision ; ++i)
+  {
+    double t = (double)i / (double)(steps - 1);
+    state1.interpolate(state2, t, current);
+    current.updateCollisionBodyTransforms();
+    other_state1.interpolate(other_state2, t, other_current);
+    other_current.updateCollisionBodyTransforms();
+    checkOtherCollisionHelper(step_req, res, current, other_robot, other_current, acm);
+    if (res.collision)
+      logDebug("Collision with other robot found at time %lf along the motion", t);
+  }
+}
+
+double collision_detection::CollisionRobotDistanceField::distanceSelf(const robot_state::RobotState &state) const
+{
+  return distanceSelfHelper(state, NULL);
+}
+
+double collision_detection::CollisionRobotDistanceField::distanceSelf(const robot_state::RobotState &state,
+                                                                      const AllowedCollisionMatrix &acm) const
+{
+  return distanceSelfHelper(state, &acm);
+}
+
+double collision_detection::CollisionRobotDistanceField::distanceSelfHelper(const robot_state::RobotState &state, const AllowedCollisionMatrix *acm) const
+{
+  std::vector<SphereBody> bodies;
+  getSphereBodies(state, bodies);
+  double d = std::numeric_limits<double>::max();
+  for (std::size_t i = 0 ; i < bodies.size() ; ++i)
+    for (std::size_t j = i + 1 ; j < bodies.size() ; ++j)
+    {
+      DecideContactFn dcf;
+      if (!isCollisionAlwaysAllowed(bodies[i], bodies[j], acm, dcf, false))
+        d = distanceSphereBodies(bodies[i], bodies[j], d);
+    }
+  return d;
+}
+
+double collision_detection::CollisionRobotDistanceField::distanceOther(const robot_state::RobotState &state, const CollisionRobot &other_robot,
+                                                                       const robot_state::RobotState &other_state) const
+{
+  return distanceOtherHelper(state, other_robot, other_state, NULL);
+}
+
+double collision_detection::CollisionRobotDistanceField::distanceOther(const robot_state::RobotState &state, const CollisionRobot &other_robot,
+                                                                       const robot_state::RobotState &other_state, const AllowedCollisionMatrix &acm) const
+{
+  return distanceOtherHelper(state, other_robot, other_state, &acm);
+}
+
+double collision_detection::CollisionRobotDistanceField::distanceOtherHelper(const robot_state::RobotState &state, const CollisionRobot &other_robot,
+                                                                             const robot_state::RobotState &other_state, const AllowedCollisionMatrix *acm) const
+{
+  const CollisionRobotDistanceField &other = dynamic_cast<const CollisionRobotDistanceField&>(other_robot);
+  std::vector<SphereBody> bodies, other_bodies;
+  getSphereBodies(state, bodies);
+  other.getSphereBodies(other_state, other_bodies);
+  double d = std::numeric_limits<double>::max();
+  for (std::size_t i = 0 ; i < bodies.size() ; ++i)
+    for (std::size_t j = 0 ; j < other_bodies.size() ; ++j)
+    {
+      DecideContactFn dcf;
+      if (!isCollisionAlwaysAllowed(bodies[i], other_bodies[j], acm, dcf, false))
+        d = distanceSphereBodies(bodies[i], other_bodies[j], d);
+    }
+  return d;
+}
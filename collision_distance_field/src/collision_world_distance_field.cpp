@@ -0,0 +1,746 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2013, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+
+#include <moveit/collision_distance_field/collision_world_distance_field.h>
+#include <moveit/collision_distance_field/collision_detector_allocator_distance_field.h>
+#include <moveit/distance_field/find_internal_points.h>
+#include <geometric_shapes/body_operations.h>
+#include <octomap/OcTree.h>
+#include <algorithm>
+#include <iterator>
+#include <limits>
+
+namespace collision_detection
+{
+namespace
+{
+
+// the volume covered by default: 3 x 3 x 4 meters, centered around the origin in X and Y, starting 1 meter below it
+static const double DEFAULT_SIZE_X = 3.0;
+static const double DEFAULT_SIZE_Y = 3.0;
+static const double DEFAULT_SIZE_Z = 4.0;
+static const double DEFAULT_ORIGIN_X = -1.5;
+static const double DEFAULT_ORIGIN_Y = -1.5;
+static const double DEFAULT_ORIGIN_Z = -1.0;
+static const double DEFAULT_RESOLUTION = 0.04;
+static const double DEFAULT_MAX_DISTANCE = 0.4;
+
+// the number of versions of the allowed collision matrix getBodyObjects() keeps results for
+static const std::size_t MAX_BODY_OBJECTS_VERSIONS = 4;
+
+inline int getCellIndex(const distance_field::DistanceField &df, int x, int y, int z)
+{
+  return (x * df.getYNumCells() + y) * df.getZNumCells() + z;
+}
+
+inline Eigen::Vector3d getCellCenter(const distance_field::DistanceField &df, int index)
+{
+  int z = index % df.getZNumCells();
+  int y = (index / df.getZNumCells()) % df.getYNumCells();
+  int x = index / (df.getZNumCells() * df.getYNumCells());
+  Eigen::Vector3d p;
+  df.gridToWorld(x, y, z, p.x(), p.y(), p.z());
+  return p;
+}
+
+}
+}
+
+collision_detection::CollisionWorldDistanceField::CollisionWorldDistanceField() :
+  CollisionWorld()
+{
+  initialize(Eigen::Vector3d(DEFAULT_SIZE_X, DEFAULT_SIZE_Y, DEFAULT_SIZE_Z),
+             Eigen::Vector3d(DEFAULT_ORIGIN_X, DEFAULT_ORIGIN_Y, DEFAULT_ORIGIN_Z),
+             DEFAULT_RESOLUTION, DEFAULT_MAX_DISTANCE);
+
+  // request notifications about changes to new world
+  observer_handle_ = getWorld()->addObserver(boost::bind(&CollisionWorldDistanceField::notifyObjectChange, this, _1, _2));
+}
+
+collision_detection::CollisionWorldDistanceField::CollisionWorldDistanceField(const WorldPtr& world) :
+  CollisionWorld(world)
+{
+  initialize(Eigen::Vector3d(DEFAULT_SIZE_X, DEFAULT_SIZE_Y, DEFAULT_SIZE_Z),
+             Eigen::Vector3d(DEFAULT_ORIGIN_X, DEFAULT_ORIGIN_Y, DEFAULT_ORIGIN_Z),
+             DEFAULT_RESOLUTION, DEFAULT_MAX_DISTANCE);
+
+  // request notifications about changes to new world
+  observer_handle_ = getWorld()->addObserver(boost::bind(&CollisionWorldDistanceField::notifyObjectChange, this, _1, _2));
+  getWorld()->notifyObserverAllObjects(observer_handle_, World::CREATE);
+}
+
+collision_detection::CollisionWorldDistanceField::CollisionWorldDistanceField(const WorldPtr& world, const Eigen::Vector3d &size, const Eigen::Vector3d &origin,
+                                                                             double resolution, double max_distance) :
+  CollisionWorld(world)
+{
+  initialize(size, origin, resolution, max_distance);
+
+  // request notifications about changes to new world
+  observer_handle_ = getWorld()->addObserver(boost::bind(&CollisionWorldDistanceField::notifyObjectChange, this, _1, _2));
+  getWorld()->notifyObserverAllObjects(observer_handle_, World::CREATE);
+}
+
+collision_detection::CollisionWorldDistanceField::CollisionWorldDistanceField(const CollisionWorldDistanceField &other, const WorldPtr& world) :
+  CollisionWorld(other, world),
+  size_(other.size_),
+  origin_(other.origin_),
+  resolution_(other.resolution_),
+  max_distance_(other.max_distance_),
+  distance_field_(other.distance_field_),
+  object_cells_(other.object_cells_),
+  cell_counts_(other.cell_counts_),
+  object_bounds_(other.object_bounds_)
+{
+  // the bodies refer to their names by pointer
+  for (std::map<std::string, SphereBody>::iterator it = object_bounds_.begin() ; it != object_bounds_.end() ; ++it)
+    it->second.id_ = &it->first;
+
+  // request notifications about changes to new world
+  observer_handle_ = getWorld()->addObserver(boost::bind(&CollisionWorldDistanceField::notifyObjectChange, this, _1, _2));
+}
+
+collision_detection::CollisionWorldDistanceField::~CollisionWorldDistanceField()
+{
+  getWorld()->removeObserver(observer_handle_);
+}
+
+void collision_detection::CollisionWorldDistanceField::initialize(const Eigen::Vector3d &size, const Eigen::Vector3d &origin, double resolution, double max_distance)
+{
+  size_ = size;
+  origin_ = origin;
+  resolution_ = resolution;
+  max_distance_ = max_distance;
+  distance_field_.reset(new distance_field::PropagationDistanceField(size.x(), size.y(), size.z(), resolution,
+                                                                     origin.x(), origin.y(), origin.z(), max_distance, true));
+}
+
+void collision_detection::CollisionWorldDistanceField::ensureUniqueDistanceField()
+{
+  if (distance_field_.use_count() <= 1)
+    return;
+  distance_field_.reset(new distance_field::PropagationDistanceField(size_.x(), size_.y(), size_.z(), resolution_,
+                                                                     origin_.x(), origin_.y(), origin_.z(), max_distance_, true));
+  EigenSTL::vector_Vector3d points;
+  points.reserve(cell_counts_.size());
+  for (std::map<int, unsigned int>::const_iterator it = cell_counts_.begin() ; it != cell_counts_.end() ; ++it)
+    points.push_back(getCellCenter(*distance_field_, it->first));
+  distance_field_->addPointsToField(points);
+}
+
+void collision_detection::CollisionWorldDistanceField::setWorld(const WorldPtr& world)
+{
+  if (world == getWorld())
+    return;
+
+  // turn off notifications about old world
+  getWorld()->removeObserver(observer_handle_);
+
+  // clear out objects from old world
+  object_cells_.clear();
+  cell_counts_.clear();
+  object_bounds_.clear();
+  initialize(size_, origin_, resolution_, max_distance_);
+
+  CollisionWorld::setWorld(world);
+
+  // request notifications about changes to new world
+  observer_handle_ = getWorld()->addObserver(boost::bind(&CollisionWorldDistanceField::notifyObjectChange, this, _1, _2));
+
+  // get notifications any objects already in the new world
+  getWorld()->notifyObserverAllObjects(observer_handle_, World::CREATE);
+}
+
+void collision_detection::CollisionWorldDistanceField::notifyObjectChange(const ObjectConstPtr& obj, World::Action action)
+{
+  updateObject(obj->id_, action == World::DESTROY ? NULL : obj.get());
+}
+
+void collision_detection::CollisionWorldDistanceField::computeObjectCells(const World::Object &obj, std::vector<int> &cells, SphereBody &bounds) const
+{
+  EigenSTL::vector_Vector3d points;
+  for (std::size_t i = 0 ; i < obj.shapes_.size() ; ++i)
+  {
+    const shapes::Shape *shape = obj.shapes_[i].get();
+    const Eigen::Affine3d &pose = obj.shape_poses_[i];
+    if (shape->type == shapes::OCTREE)
+    {
+      const octomap::OcTree *tree = static_cast<const shapes::OcTree*>(shape)->octree.get();
+      std::size_t first = points.size();
+      for (octomap::OcTree::leaf_iterator it = tree->begin_leafs(), end = tree->end_leafs() ; it != end ; ++it)
+      {
+        if (!tree->isNodeOccupied(*it))
+          continue;
+        if (it.getSize() <= resolution_)
+          points.push_back(pose * Eigen::Vector3d(it.getX(), it.getY(), it.getZ()));
+        else
+        {
+          // leaves larger than a cell are filled with points at the resolution of the field
+          double half = ceil(it.getSize() / resolution_) * resolution_ / 2.0;
+          for (double x = it.getX() - half ; x <= it.getX() + half ; x += resolution_)
+            for (double y = it.getY() - half ; y <= it.getY() + half ; y += resolution_)
+              for (double z = it.getZ() - half ; z <= it.getZ() + half ; z += resolution_)
+                points.push_back(pose * Eigen::Vector3d(x, y, z));
+        }
+      }
+      if (points.size() > first)
+      {
+        SphereBody leaves;
+        leaves.centers_.assign(points.begin() + first, points.end());
+        leaves.radii_.resize(leaves.centers_.size(), tree->getResolution() * 0.5);
+        updateBoundingSphere(leaves);
+        bounds.centers_.push_back(leaves.bound_center_);
+        bounds.radii_.push_back(leaves.bound_radius_);
+      }
+    }
+    else
+    {
+      if (shape->type == shapes::PLANE)
+        continue;
+      bodies::Body *body = bodies::createBodyFromShape(shape);
+      if (!body)
+        continue;
+      body->setPose(pose);
+      distance_field::findInternalPointsConvex(*body, resolution_, points);
+      bodies::BoundingSphere sphere;
+      body->computeBoundingSphere(sphere);
+      bounds.centers_.push_back(sphere.center);
+      bounds.radii_.push_back(sphere.radius);
+      delete body;
+    }
+  }
+  updateBoundingSphere(bounds);
+
+  cells.clear();
+  cells.reserve(points.size());
+  for (std::size_t i = 0 ; i < points.size() ; ++i)
+  {
+    int x, y, z;
+    if (distance_field_->worldToGrid(points[i].x(), points[i].y(), points[i].z(), x, y, z))
+      cells.push_back(getCellIndex(*distance_field_, x, y, z));
+  }
+  std::sort(cells.begin(), cells.end());
+  cells.erase(std::unique(cells.begin(), cells.end()), cells.end());
+}
+
+void collision_detection::CollisionWorldDistanceField::updateObject(const std::string &id, const World::Object *obj)
+{
+  ensureUniqueDistanceField();
+
+  std::vector<int> cells;
+  SphereBody bounds;
+  if (obj)
+    computeObjectCells(*obj, cells, bounds);
+
+  // only the cells that change occupancy are updated in the distance field
+  std::vector<int> removed, added;
+  std::map<std::string, std::vector<int> >::iterator it = object_cells_.find(id);
+  if (it != object_cells_.end())
+  {
+    std::set_difference(it->second.begin(), it->second.end(), cells.begin(), cells.end(), std::back_inserter(removed));
+    std::set_difference(cells.begin(), cells.end(), it->second.begin(), it->second.end(), std::back_inserter(added));
+  }
+  else
+    added = cells;
+
+  EigenSTL::vector_Vector3d remove_points, add_points;
+  for (std::size_t i = 0 ; i < removed.size() ; ++i)
+  {
+    std::map<int, unsigned int>::iterator c = cell_counts_.find(removed[i]);
+    if (c != cell_counts_.end() && --c->second == 0)
+    {
+      cell_counts_.erase(c);
+      remove_points.push_back(getCellCenter(*distance_field_, removed[i]));
+    }
+  }
+  for (std::size_t i = 0 ; i < added.size() ; ++i)
+    if (++cell_counts_[added[i]] == 1)
+      add_points.push_back(getCellCenter(*distance_field_, added[i]));
+
+  if (!remove_points.empty())
+    distance_field_->removePointsFromField(remove_points);
+  if (!add_points.empty())
+    distance_field_->addPointsToField(add_points);
+
+  if (cells.empty())
+  {
+    if (it != object_cells_.end())
+      object_cells_.erase(it);
+  }
+  else
+    object_cells_[id].swap(cells);
+
+  if (obj)
+  {
+    std::map<std::string, SphereBody>::iterator bt = object_bounds_.insert(std::make_pair(id, SphereBody())).first;
+    bt->second = bounds;
+    bt->second.id_ = &bt->first;
+    bt->second.type_ = BodyTypes::WORLD_OBJECT;
+  }
+  else
+    object_bounds_.erase(id);
+
+  // the cached relations refer to the bounding spheres of the objects
+  boost::mutex::scoped_lock slock(body_objects_lock_);
+  body_objects_.clear();
+}
+
+const collision_detection::SphereBody* collision_detection::CollisionWorldDistanceField::getNearestObject(const Eigen::Vector3d &point, double &distance) const
+{
+  const SphereBody *nearest = NULL;
+  distance = std::numeric_limits<double>::max();
+  for (std::map<std::string, SphereBody>::const_iterator it = object_bounds_.begin() ; it != object_bounds_.end() ; ++it)
+    for (std::size_t i = 0 ; i < it->second.centers_.size() ; ++i)
+    {
+      double d = (it->second.centers_[i] - point).norm() - it->second.radii_[i];
+      if (d < distance)
+      {
+        distance = d;
+        nearest = &it->second;
+      }
+    }
+  return nearest;
+}
+
+collision_detection::CollisionWorldDistanceField::BodyObjectsConstPtr
+collision_detection::CollisionWorldDistanceField::getBodyObjects(const std::string &id, const AllowedCollisionMatrix &acm) const
+{
+  boost::mutex::scoped_lock slock(body_objects_lock_);
+  std::map<boost::uint64_t, std::map<std::string, BodyObjectsConstPtr> >::iterator vt = body_objects_.find(acm.getVersion());
+  if (vt == body_objects_.end())
+  {
+    if (body_objects_.size() >= MAX_BODY_OBJECTS_VERSIONS)
+      body_objects_.clear();
+    vt = body_objects_.insert(std::make_pair(acm.getVersion(), std::map<std::string, BodyObjectsConstPtr>())).first;
+  }
+  BodyObjectsConstPtr &result = vt->second[id];
+  if (!result)
+  {
+    // touch links only relate robot bodies, so for world objects the matrix decides alone
+    boost::shared_ptr<BodyObjects> objects(new BodyObjects());
+    objects->conditional_ = false;
+    for (std::map<std::string, SphereBody>::const_iterator it = object_bounds_.begin() ; it != object_bounds_.end() ; ++it)
+    {
+      AllowedCollision::Type type;
+      if (acm.getAllowedCollision(id, it->first, type) && type == AllowedCollision::ALWAYS)
+        objects->allowed_.push_back(&it->second);
+      else
+      {
+        DecideContactFn dcf;
+        if (acm.getAllowedCollision(id, it->first, dcf) && dcf)
+          objects->conditional_ = true;
+        objects->checked_.push_back(std::make_pair(&it->second, dcf));
+      }
+    }
+    result = objects;
+  }
+  return result;
+}
+
+bool collision_detection::CollisionWorldDistanceField::getExplicitCheckObjects(const SphereBody &body, const AllowedCollisionMatrix *acm,
+                                                                               std::vector<std::pair<const SphereBody*, DecideContactFn> > &objects,
+                                                                               bool collision) const
+{
+  objects.clear();
+  if (!acm || object_bounds_.empty())
+    return false;
+  BodyObjectsConstPtr relation = getBodyObjects(body.getID(), *acm);
+  if (relation->allowed_.empty() && !relation->conditional_)
+    return false;
+  // nothing to check if all the collisions are allowed
+  if (relation->checked_.empty())
+    return true;
+
+  // the distance field cannot tell objects apart, but it can be used if the objects that could be confused with the
+  // ones the body may collide with are out of reach of its spheres
+  if (collision && !relation->conditional_)
+  {
+    bool clear = true;
+    for (std::size_t i = 0 ; i < relation->allowed_.size() && clear ; ++i)
+    {
+      const SphereBody &obj = *relation->allowed_[i];
+      // objects without bounding spheres (e.g., octrees) may still occupy cells of the distance field anywhere
+      if (obj.centers_.empty())
+      {
+        clear = false;
+        break;
+      }
+      if ((obj.bound_center_ - body.bound_center_).norm() >= obj.bound_radius_ + body.bound_radius_)
+        continue;
+      for (std::size_t k = 0 ; k < body.centers_.size() && clear ; ++k)
+      {
+        // spheres at least as large as the propagation distance are checked against the nearest object instead
+        if (body.radii_[k] >= max_distance_)
+          clear = false;
+        for (std::size_t j = 0 ; j < obj.centers_.size() && clear ; ++j)
+          if ((obj.centers_[j] - body.centers_[k]).norm() < obj.radii_[j] + body.radii_[k])
+            clear = false;
+      }
+    }
+    if (clear)
+      return false;
+  }
+
+  objects = relation->checked_;
+  return true;
+}
+
+void collision_detection::CollisionWorldDistanceField::checkRobotCollision(const CollisionRequest &req, CollisionResult &res, const CollisionRobot &robot, const robot_state::RobotState &state) const
+{
+  checkRobotCollisionHelper(req, res, robot, state, NULL);
+}
+
+void collision_detection::CollisionWorldDistanceField::checkRobotCollision(const CollisionRequest &req, CollisionResult &res, const CollisionRobot &robot, const robot_state::RobotState &state, const AllowedCollisionMatrix &acm) const
+{
+  checkRobotCollisionHelper(req, res, robot, state, &acm);
+}
+
+void collision_detection::CollisionWorldDistanceField::checkRobotCollision(const CollisionRequest &req, CollisionResult &res, const CollisionRobot &robot, const robot_state::RobotState &state1, const robot_state::RobotState &state2) const
+{
+  checkRobotCollisionHelper(req, res, robot, state1, state2, NULL);
+}
+
+void collision_detection::CollisionWorldDistanceField::checkRobotCollision(const CollisionRequest &req, CollisionResult &res, const CollisionRobot &robot, const robot_state::RobotState &state1, const robot_state::RobotState &state2, const AllowedCollisionMatrix &acm) const
+{
+  checkRobotCollisionHelper(req, res, robot, state1, state2, &acm);
+}
+
+void collision_detection::CollisionWorldDistanceField::checkRobotCollisionHelper(const CollisionRequest &req, CollisionResult &res, const CollisionRobot &robot,
+                                                                                 const robot_state::RobotState &state, const AllowedCollisionMatrix *acm) const
+{
+  const CollisionRobotDistanceField &robot_df = dynamic_cast<const CollisionRobotDistanceField&>(robot);
+  std::vector<SphereBody> bodies;
+  robot_df.getSphereBodies(state, bodies);
+  const std::set<const robot_model::LinkModel*> *active = getActiveLinks(*robot.getRobotModel(), req);
+
+  std::vector<std::pair<const SphereBody*, DecideContactFn> > objects;
+  bool done = false;
+  for (std::size_t i = 0 ; i < bodies.size() && !done ; ++i)
+  {
+    const SphereBody &body = bodies[i];
+    if (!isActiveBody(body, active))
+      continue;
+
+    // the distance field cannot tell objects apart, so bodies with allowed collisions are checked explicitly
+    if (getExplicitCheckObjects(body, acm, objects, true))
+    {
+      for (std::size_t j = 0 ; j < objects.size() && !done ; ++j)
+        done = checkSphereBodies(body, *objects[j].first, objects[j].second, req, res);
+      continue;
+    }
+
+    // without objects, the distance field has no obstacles
+    if (object_bounds_.empty())
+      break;
+
+    for (std::size_t k = 0 ; k < body.centers_.size() && !done ; ++k)
+    {
+      const Eigen::Vector3d &c = body.centers_[k];
+      double r = body.radii_[k];
+      double object_distance;
+      const SphereBody *nearest;
+
+      Contact contact;
+      if (r < max_distance_)
+      {
+        double gx, gy, gz;
+        bool in_bounds;
+        double d = distance_field_->getDistanceGradient(c.x(), c.y(), c.z(), gx, gy, gz, in_bounds);
+        if (!in_bounds)
+          d = distance_field_->getDistance(c.x(), c.y(), c.z());
+        if (d >= r)
+          continue;
+        // the object is only needed to name the contact
+        nearest = getNearestObject(c, object_distance);
+        if (!nearest)
+          break;
+        Eigen::Vector3d g(gx, gy, gz);
+        double gn = g.norm();
+        if (gn > std::numeric_limits<double>::epsilon())
+          contact.normal = -g / gn;
+        else
+          contact.normal = (nearest->bound_center_ - c).normalized();
+        contact.depth = r - d;
+        contact.pos = c + contact.normal * d;
+      }
+      else
+      {
+        // the distance field does not know about obstacles this far; use the bounding spheres of the objects
+        nearest = getNearestObject(c, object_distance);
+        if (!nearest)
+          break;
+        if (object_distance >= r)
+          continue;
+        contact.normal = (nearest->bound_center_ - c).normalized();
+        contact.depth = r - object_distance;
+        contact.pos = c + contact.normal * object_distance;
+      }
+      contact.body_name_1 = body.getID();
+      contact.body_type_1 = body.type_;
+      contact.body_name_2 = nearest->getID();
+      contact.body_type_2 = BodyTypes::WORLD_OBJECT;
+      done = addCollision(contact, req, res);
+    }
+  }
+
+  if (req.distance)
+    res.distance = distanceRobotHelper(robot, state, acm);
+}
+
+void collision_detection::CollisionWorldDistanceField::checkRobotCollisionHelper(const CollisionRequest &req, CollisionResult &res, const CollisionRobot &robot,
+                                                                                 const robot_state::RobotState &state1, const robot_state::RobotState &state2,
+                                                                                 const AllowedCollisionMatrix *acm) const
+{
+  const CollisionRobotDistanceField &robot_df = dynamic_cast<const CollisionRobotDistanceField&>(robot);
+  CollisionRequest step_req = req;
+  step_req.distance = false;
+  unsigned int steps = robot_df.getMotionCheckCount(state1, state2);
+  robot_state::RobotState current(state1);
+  for (unsigned int i = 0 ; i < steps && !res.collision ; ++i)
+  {
+    double t = (double)i / (double)(steps - 1);
+    state1.interpolate(state2, t, current);
+    current.updateCollisionBodyTransforms();
+    checkRobotCollisionHelper(step_req, res, robot, current, acm);
+    if (res.collision)
+      logDebug("Collision with the world found at time %lf along the motion", t);
+  }
+}
+
+void collision_detection::CollisionWorldDistanceField::checkWorldCollision(const CollisionRequest &req, CollisionResult &res, const CollisionWorld &other_world) const
+{
+  checkWorldCollisionHelper(req, res, other_world, NULL);
+}
+
+void collision_detection::CollisionWorldDistanceField::checkWorldCollision(const CollisionRequest &req, CollisionResult &res, const CollisionWorld &other_world, const AllowedCollisionMatrix &acm) const
+{
+  checkWorldCollisionHelper(req, res, other_world, &acm);
+}
+
+void collision_detection::CollisionWorldDistanceField::checkWorldCollisionHelper(const CollisionRequest &req, CollisionResult &res, const CollisionWorld &other_world,
+                                                                                 const AllowedCollisionMatrix *acm) const
+{
+  const CollisionWorldDistanceField &other = dynamic_cast<const CollisionWorldDistanceField&>(other_world);
+  bool done = false;
+  for (std::map<std::string, SphereBody>::const_iterator it = object_bounds_.begin() ; it != object_bounds_.end() && !done ; ++it)
+  {
+    // when checking a world against itself, every pair of objects is considered once
+    std::map<std::string, SphereBody>::const_iterator jt = &other == this ? it : other.object_bounds_.begin();
+    for (; jt != other.object_bounds_.end() && !done ; ++jt)
+    {
+      DecideContactFn dcf;
+      if (isCollisionAlwaysAllowed(it->second, jt->second, acm, dcf, req.verbose))
+        continue;
+      done = checkSphereBodies(it->second, jt->second, dcf, req, res);
+    }
+  }
+
+  if (req.distance)
+    res.distance = distanceWorldHelper(other_world, acm);
+}
+
+double collision_detection::CollisionWorldDistanceField::distanceRobot(const CollisionRobot &robot, const robot_state::RobotState &state) const
+{
+  return distanceRobotHelper(robot, state, NULL);
+}
+
+double collision_detection::CollisionWorldDistanceField::distanceRobot(const CollisionRobot &robot, const robot_state::RobotState &state, const AllowedCollisionMatrix &acm) const
+{
+  return distanceRobotHelper(robot, state, &acm);
+}
+
+double collision_detection::CollisionWorldDistanceField::distanceRobotHelper(const CollisionRobot &robot, const robot_state::RobotState &state,
+                                                                             const AllowedCollisionMatrix *acm) const
+{
+  double d = std::numeric_limits<double>::max();
+  if (object_bounds_.empty())
+    return d;
+
+  const CollisionRobotDistanceField &robot_df = dynamic_cast<const CollisionRobotDistanceField&>(robot);
+  std::vector<SphereBody> bodies;
+  robot_df.getSphereBodies(state, bodies);
+  std::vector<std::pair<const SphereBody*, DecideContactFn> > objects;
+  for (std::size_t i = 0 ; i < bodies.size() ; ++i)
+  {
+    const SphereBody &body = bodies[i];
+    if (getExplicitCheckObjects(body, acm, objects, false))
+    {
+      for (std::size_t j = 0 ; j < objects.size() ; ++j)
+        d = distanceSphereBodies(body, *objects[j].first, d);
+      continue;
+    }
+    for (std::size_t k = 0 ; k < body.centers_.size() ; ++k)
+    {
+      double fd = distance_field_->getDistance(body.centers_[k].x(), body.centers_[k].y(), body.centers_[k].z());
+      // beyond the propagation distance, only the bounding spheres of the objects are known
+      if (fd >= max_distance_)
+        getNearestObject(body.centers_[k], fd);
+      d = std::min(d, fd - body.radii_[k]);
+    }
+  }
+  return d;
+}
+
+double collision_detection::CollisionWorldDistanceField::distanceWorld(const CollisionWorld &world) const
+{
+  return distanceWorldHelper(world, NULL);
+}
+
+double collision_detection::CollisionWorldDistanceField::distanceWorld(const CollisionWorld &world, const AllowedCollisionMatrix &acm) const
+{
+  return distanceWorldHelper(world, &acm);
+}
+
+double collision_detection::CollisionWorldDistanceField::distanceWorldHelper(const CollisionWorld &world, const AllowedCollisionMatrix *acm) const
+{
+  const CollisionWorldDistanceField &other = dynamic_cast<const CollisionWorldDistanceField&>(world);
+  double d = std::numeric_limits<double>::max();
+  for (std::map<std::string, SphereBody>::const_iterator it = object_bounds_.begin() ; it != object_bounds_.end() ; ++it)
+  {
+    std::map<std::string, SphereBody>::const_iterator jt = &other == this ? it : other.object_bounds_.begin();
+    for (; jt != other.object_bounds_.end() ; ++jt)
+    {
+      DecideContactFn dcf;
+      if (!isCollisionAlwaysAllowed(it->second, jt->second, acm, dcf, false))
+        d = distanceSphereBodies(it->second, jt->second, d);
+    }
+  }
+  return d;
+}
+
+void collision_detection::CollisionWorldDistanceField::getSphereDistances(const CollisionRobot &robot, const robot_state::RobotState &state,
+                                                                          std::vector<double> &distances, EigenSTL::vector_Vector3d &gradients) const
+{
+  const CollisionRobotDistanceField &robot_df = dynamic_cast<const CollisionRobotDistanceField&>(robot);
+  std::vector<SphereBody> bodies;
+  robot_df.getSphereBodies(state, bodies);
+  distances.clear();
+  gradients.clear();
+  for (std::size_t i = 0 ; i < bodies.size() ; ++i)
+    for (std::size_t k = 0 ; k < bodies[i].centers_.size() ; ++k)
+    {
+      const Eigen::Vector3d &c = bodies[i].centers_[k];
+      Eigen::Vector3d g;
+      bool in_bounds;
+      double d = distance_field_->getDistanceGradient(c.x(), c.y(), c.z(), g.x(), g.y(), g.z(), in_bounds);
+      distances.push_back(d - bodies[i].radii_[k]);
+      gradients.push_back(g);
+    }
+}
+
+void collision_detection::CollisionWorldDistanceField::checkRobotCollisionBatch(const CollisionRequest &req, const CollisionRobot &robot,
+                                                                                const std::vector<const robot_state::RobotState*> &states,
+                                                                                std::vector<unsigned char> &colliding) const
+{
+  checkRobotCollisionBatchHelper(req, robot, states, colliding, NULL);
+}
+
+void collision_detection::CollisionWorldDistanceField::checkRobotCollisionBatch(const CollisionRequest &req, const CollisionRobot &robot,
+                                                                                const std::vector<const robot_state::RobotState*> &states,
+                                                                                std::vector<unsigned char> &colliding,
+                                                                                const AllowedCollisionMatrix &acm) const
+{
+  checkRobotCollisionBatchHelper(req, robot, states, colliding, &acm);
+}
+
+void collision_detection::CollisionWorldDistanceField::checkRobotCollisionBatchHelper(const CollisionRequest &req, const CollisionRobot &robot,
+                                                                                      const std::vector<const robot_state::RobotState*> &states,
+                                                                                      std::vector<unsigned char> &colliding,
+                                                                                      const AllowedCollisionMatrix *acm) const
+{
+  colliding.assign(states.size(), 0);
+  // without objects there is nothing to collide with (this is also what the check for a single state finds)
+  if (object_bounds_.empty())
+    return;
+
+  const CollisionRobotDistanceField &robot_df = dynamic_cast<const CollisionRobotDistanceField&>(robot);
+  const std::set<const robot_model::LinkModel*> *active = getActiveLinks(*robot.getRobotModel(), req);
+  CollisionRequest state_req;
+  state_req.group_name = req.group_name;
+
+  // place the spheres of all the states, remembering the state each sphere belongs to
+  EigenSTL::vector_Vector3d centers;
+  std::vector<double> radii;
+  std::vector<std::size_t> owners;
+  std::vector<SphereBody> bodies;
+  std::vector<std::pair<const SphereBody*, DecideContactFn> > objects;
+  for (std::size_t s = 0 ; s < states.size() ; ++s)
+  {
+    robot_df.getSphereBodies(*states[s], bodies);
+    std::size_t first = centers.size();
+    bool explicit_check = false;
+    for (std::size_t i = 0 ; i < bodies.size() && !explicit_check ; ++i)
+    {
+      const SphereBody &body = bodies[i];
+      if (!isActiveBody(body, active))
+        continue;
+      if (getExplicitCheckObjects(body, acm, objects, true))
+      {
+        // bodies allowed to collide with all the objects need no checks
+        if (objects.empty())
+          continue;
+        explicit_check = true;
+        break;
+      }
+      for (std::size_t k = 0 ; k < body.centers_.size() ; ++k)
+      {
+        if (body.radii_[k] >= max_distance_)
+        {
+          explicit_check = true;
+          break;
+        }
+        centers.push_back(body.centers_[k]);
+        radii.push_back(body.radii_[k]);
+        owners.push_back(s);
+      }
+    }
+
+    if (explicit_check)
+    {
+      centers.resize(first);
+      radii.resize(first);
+      owners.resize(first);
+      CollisionResult res;
+      checkRobotCollisionHelper(state_req, res, robot, *states[s], acm);
+      colliding[s] = res.collision ? 1 : 0;
+    }
+  }
+
+  // a single pass over the spheres of all the states
+  for (std::size_t i = 0 ; i < centers.size() ; ++i)
+    if (!colliding[owners[i]] && distance_field_->getDistance(centers[i].x(), centers[i].y(), centers[i].z()) < radii[i])
+      colliding[owners[i]] = 1;
+}
+
+const std::string collision_detection::CollisionDetectorAllocatorDistanceField::NAME_("DistanceField");
@@ -0,0 +1,157 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2013, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#include <moveit/collision_detection/recording/collision_query_log.h>
+#include <moveit/collision_detection/allvalid/collision_detector_allocator_allvalid.h>
+#include <moveit/collision_detection_fcl/collision_detector_allocator_fcl.h>
+#include <moveit/collision_distance_field/collision_detector_allocator_distance_field.h>
+#include <urdf_parser/urdf_parser.h>
+#include <fstream>
+#include <sstream>
+#include <cstdio>
+
+static const char* typeName(collision_detection::CollisionQueryTypes::Type type)
+{
+  switch (type)
+  {
+  case collision_detection::CollisionQueryTypes::ROBOT_COLLISION:
+    return "robot_collision";
+  case collision_detection::CollisionQueryTypes::SELF_COLLISION:
+    return "self_collision";
+  case collision_detection::CollisionQueryTypes::ROBOT_DISTANCE:
+    return "robot_distance";
+  case collision_detection::CollisionQueryTypes::SELF_DISTANCE:
+    return "self_distance";
+  }
+  return "unknown";
+}
+
+int main(int argc, char **argv)
+{
+  if (argc != 5 && argc != 6)
+  {
+    fprintf(stderr, "Usage: %s <urdf file> <srdf file> <query log> <fcl|distance_field|allvalid> [output csv file]\n", argv[0]);
+    return 1;
+  }
+
+  std::ifstream urdf_file(argv[1]);
+  if (!urdf_file.good())
+  {
+    fprintf(stderr, "Unable to read URDF file '%s'\n", argv[1]);
+    return 1;
+  }
+  std::stringstream urdf_string;
+  urdf_string << urdf_file.rdbuf();
+  boost::shared_ptr<urdf::ModelInterface> urdf_model = urdf::parseURDF(urdf_string.str());
+  if (!urdf_model)
+  {
+    fprintf(stderr, "Unable to parse URDF file '%s'\n", argv[1]);
+    return 1;
+  }
+  boost::shared_ptr<srdf::Model> srdf_model(new srdf::Model());
+  if (!srdf_model->initFile(*urdf_model, argv[2]))
+  {
+    fprintf(stderr, "Unable to parse SRDF file '%s'\n", argv[2]);
+    return 1;
+  }
+  robot_model::RobotModelConstPtr model(new robot_model::RobotModel(urdf_model, srdf_model));
+
+  std::string backend = argv[4];
+  collision_detection::CollisionDetectorAllocatorPtr allocator;
+  if (backend == "fcl")
+    allocator = collision_detection::CollisionDetectorAllocatorFCL::create();
+  else if (backend == "distance_field")
+    allocator = collision_detection::CollisionDetectorAllocatorDistanceField::create();
+  else if (backend == "allvalid")
+    allocator = collision_detection::CollisionDetectorAllocatorAllValid::create();
+  else
+  {
+    fprintf(stderr, "Unknown collision detector '%s'\n", argv[4]);
+    return 1;
+  }
+
+  std::vector<collision_detection::CollisionQueryReplayResult> results;
+  if (!collision_detection::replayCollisionQueryLog(argv[3], model, allocator, results))
+  {
+    fprintf(stderr, "Unable to replay collision query log '%s'\n", argv[3]);
+    return 1;
+  }
+
+  static const std::size_t TYPE_COUNT = 4;
+  std::size_t count[TYPE_COUNT] = { 0, 0, 0, 0 };
+  std::size_t mismatches[TYPE_COUNT] = { 0, 0, 0, 0 };
+  double recorded_time[TYPE_COUNT] = { 0.0, 0.0, 0.0, 0.0 };
+  double time[TYPE_COUNT] = { 0.0, 0.0, 0.0, 0.0 };
+  for (std::size_t i = 0 ; i < results.size() ; ++i)
+  {
+    std::size_t t = results[i].type;
+    count[t]++;
+    if (results[i].mismatch)
+      mismatches[t]++;
+    recorded_time[t] += results[i].recorded_duration;
+    time[t] += results[i].duration;
+  }
+
+  printf("Replayed %u queries with collision detector '%s'\n", (unsigned int)results.size(), allocator->getName().c_str());
+  printf("%-16s %10s %12s %12s %14s %14s %10s\n", "type", "queries", "recorded (s)", "replayed (s)",
+         "rec. mean (us)", "rep. mean (us)", "mismatches");
+  for (std::size_t t = 0 ; t < TYPE_COUNT ; ++t)
+  {
+    if (count[t] == 0)
+      continue;
+    printf("%-16s %10u %12.6f %12.6f %14.3f %14.3f %10u\n", typeName((collision_detection::CollisionQueryTypes::Type)t),
+           (unsigned int)count[t], recorded_time[t], time[t], 1e6 * recorded_time[t] / count[t], 1e6 * time[t] / count[t],
+           (unsigned int)mismatches[t]);
+  }
+
+  if (argc == 6)
+  {
+    std::ofstream out(argv[5]);
+    out << "index,type,recorded_collision,collision,recorded_contacts,contacts,recorded_distance,distance,recorded_duration,duration,mismatch" << std::endl;
+    for (std::size_t i = 0 ; i < results.size() ; ++i)
+    {
+      const collision_detection::CollisionQueryReplayResult &r = results[i];
+      out << i << "," << typeName(r.type) << "," << r.recorded_collision << "," << r.collision << ","
+          << r.recorded_contact_count << "," << r.contact_count << "," << r.recorded_distance << "," << r.distance << ","
+          << r.recorded_duration << "," << r.duration << "," << r.mismatch << std::endl;
+    }
+    if (!out.good())
+    {
+      fprintf(stderr, "Unable to write '%s'\n", argv[5]);
+      return 1;
+    }
+  }
+
+  return 0;
+}
@@ -0,0 +1,386 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2013, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+
+#include <moveit/test_resources/config.h>
+#include <moveit/robot_model/robot_model.h>
+#include <moveit/robot_state/robot_state.h>
+#include <moveit/collision_distance_field/collision_world_distance_field.h>
+#include <moveit/collision_distance_field/collision_robot_distance_field.h>
+
+#include <urdf_parser/urdf_parser.h>
+#include <geometric_shapes/shape_operations.h>
+
+#include <gtest/gtest.h>
+#include <fstream>
+#include <algorithm>
+
+#include <boost/filesystem.hpp>
+
+typedef collision_detection::CollisionWorldDistanceField DefaultCWorldType;
+typedef collision_detection::CollisionRobotDistanceField DefaultCRobotType;
+
+static std::string urdf_file = (boost::filesystem::path(MOVEIT_TEST_RESOURCES_DIR) / "urdf/robot.xml").string();
+static std::string srdf_file = (boost::filesystem::path(MOVEIT_TEST_RESOURCES_DIR) / "srdf/robot.xml").string();
+
+class DistanceFieldCollisionDetectionTester : public testing::Test
+{
+
+protected:
+
+  virtual void SetUp()
+  {
+    srdf_model_.reset(new srdf::Model());
+    std::string xml_string;
+    std::fstream xml_file(urdf_file.c_str(), std::fstream::in);
+
+    if (xml_file.is_open())
+    {
+      while ( xml_file.good() )
+      {
+        std::string line;
+        std::getline( xml_file, line);
+        xml_string += (line + "\n");
+      }
+      xml_file.close();
+      urdf_model_ = urdf::parseURDF(xml_string);
+      urdf_ok_ = urdf_model_;
+    }
+    else
+    {
+      EXPECT_EQ("FAILED TO OPEN FILE", urdf_file);
+      urdf_ok_ = false;
+    }
+    srdf_ok_ = srdf_model_->initFile(*urdf_model_, srdf_file);
+
+    kmodel_.reset(new robot_model::RobotModel(urdf_model_, srdf_model_));
+
+    acm_.reset(new collision_detection::AllowedCollisionMatrix(kmodel_->getLinkModelNames(), true));
+
+    crobot_.reset(new DefaultCRobotType(kmodel_));
+    cworld_.reset(new DefaultCWorldType());
+  }
+
+  virtual void TearDown()
+  {
+
+  }
+
+protected:
+
+  bool urdf_ok_;
+  bool srdf_ok_;
+
+  boost::shared_ptr<urdf::ModelInterface>  urdf_model_;
+  boost::shared_ptr<srdf::Model>           srdf_model_;
+
+  robot_model::RobotModelPtr               kmodel_;
+
+  boost::shared_ptr<collision_detection::CollisionRobot>        crobot_;
+  boost::shared_ptr<collision_detection::CollisionWorld>        cworld_;
+
+  collision_detection::AllowedCollisionMatrixPtr acm_;
+
+};
+
+TEST_F(DistanceFieldCollisionDetectionTester, InitOK)
+{
+  ASSERT_TRUE(urdf_ok_);
+  ASSERT_TRUE(srdf_ok_);
+}
+
+TEST_F(DistanceFieldCollisionDetectionTester, ShapeSpheres)
+{
+  std::vector<collision_detection::CollisionSphere> spheres;
+  shapes::Box box(0.4, 0.1, 0.1);
+  collision_detection::computeShapeSpheres(&box, 1.0, 0.0, spheres);
+  ASSERT_EQ(4u, spheres.size());
+
+  // every corner of the box is covered
+  for (int i = 0 ; i < 8 ; ++i)
+  {
+    Eigen::Vector3d corner(i & 1 ? 0.2 : -0.2, i & 2 ? 0.05 : -0.05, i & 4 ? 0.05 : -0.05);
+    bool covered = false;
+    for (std::size_t j = 0 ; j < spheres.size() ; ++j)
+      if ((spheres[j].center_ - corner).norm() <= spheres[j].radius_ + 1e-9)
+        covered = true;
+    EXPECT_TRUE(covered);
+  }
+
+  spheres.clear();
+  shapes::Sphere sphere(0.1);
+  collision_detection::computeShapeSpheres(&sphere, 2.0, 0.01, spheres);
+  ASSERT_EQ(1u, spheres.size());
+  EXPECT_NEAR(0.21, spheres[0].radius_, 1e-9);
+}
+
+TEST_F(DistanceFieldCollisionDetectionTester, LinksInCollision)
+{
+  collision_detection::CollisionRequest req;
+  robot_state::RobotState kstate(kmodel_);
+  kstate.setToDefaultValues();
+
+  Eigen::Affine3d offset = Eigen::Affine3d::Identity();
+  offset.translation().x() = .01;
+  kstate.updateStateWithLinkAt("r_gripper_palm_link", Eigen::Affine3d::Identity());
+  kstate.updateStateWithLinkAt("l_gripper_palm_link", offset);
+
+  collision_detection::CollisionResult res1;
+  crobot_->checkSelfCollision(req, res1, kstate, *acm_);
+  ASSERT_FALSE(res1.collision);
+
+  acm_->setEntry("r_gripper_palm_link", "l_gripper_palm_link", false);
+  collision_detection::CollisionResult res2;
+  crobot_->checkSelfCollision(req, res2, kstate, *acm_);
+  ASSERT_TRUE(res2.collision);
+  EXPECT_LT(crobot_->distanceSelf(kstate, *acm_), 0.0);
+}
+
+TEST_F(DistanceFieldCollisionDetectionTester, WorldObjects)
+{
+  robot_state::RobotState kstate(kmodel_);
+  kstate.setToDefaultValues();
+  kstate.update();
+
+  collision_detection::CollisionRequest req;
+  collision_detection::CollisionResult res;
+  cworld_->checkRobotCollision(req, res, *crobot_, kstate, *acm_);
+  ASSERT_FALSE(res.collision);
+
+  // a box where the gripper is
+  const Eigen::Affine3d &palm = kstate.getGlobalLinkTransform("r_gripper_palm_link");
+  cworld_->getWorld()->addToObject("box", shapes::ShapeConstPtr(new shapes::Box(.1, .1, .1)), palm);
+  res.clear();
+  req.contacts = true;
+  cworld_->checkRobotCollision(req, res, *crobot_, kstate, *acm_);
+  ASSERT_TRUE(res.collision);
+  ASSERT_FALSE(res.contacts.empty());
+  const std::pair<std::string, std::string> &pair = res.contacts.begin()->first;
+  EXPECT_TRUE(pair.first == "box" || pair.second == "box");
+  EXPECT_LT(cworld_->distanceRobot(*crobot_, kstate, *acm_), 0.0);
+
+  // the distances of spheres inside the box are negative
+  std::vector<double> distances;
+  EigenSTL::vector_Vector3d gradients;
+  static_cast<const DefaultCWorldType&>(*cworld_).getSphereDistances(*crobot_, kstate, distances, gradients);
+  ASSERT_EQ(distances.size(), gradients.size());
+  EXPECT_LT(*std::min_element(distances.begin(), distances.end()), 0.0);
+
+  // allowing the collision with the box is respected
+  acm_->setDefaultEntry("box", true);
+  res.clear();
+  cworld_->checkRobotCollision(req, res, *crobot_, kstate, *acm_);
+  EXPECT_FALSE(res.collision);
+  acm_->setDefaultEntry("box", false);
+
+  // moving the box away removes the collision
+  cworld_->getWorld()->moveShapeInObject("box", cworld_->getWorld()->getObject("box")->shapes_[0], Eigen::Affine3d(Eigen::Translation3d(1.2, 1.2, 2.8)));
+  res.clear();
+  cworld_->checkRobotCollision(req, res, *crobot_, kstate, *acm_);
+  EXPECT_FALSE(res.collision);
+  EXPECT_GT(cworld_->distanceRobot(*crobot_, kstate, *acm_), 0.0);
+
+  // and so does removing it
+  cworld_->getWorld()->moveShapeInObject("box", cworld_->getWorld()->getObject("box")->shapes_[0], palm);
+  res.clear();
+  cworld_->checkRobotCollision(req, res, *crobot_, kstate, *acm_);
+  EXPECT_TRUE(res.collision);
+  cworld_->getWorld()->removeObject("box");
+  res.clear();
+  cworld_->checkRobotCollision(req, res, *crobot_, kstate, *acm_);
+  EXPECT_FALSE(res.collision);
+}
+
+TEST_F(DistanceFieldCollisionDetectionTester, CopiedWorld)
+{
+  robot_state::RobotState kstate(kmodel_);
+  kstate.setToDefaultValues();
+  kstate.update();
+
+  const Eigen::Affine3d &palm = kstate.getGlobalLinkTransform("r_gripper_palm_link");
+  cworld_->getWorld()->addToObject("box", shapes::ShapeConstPtr(new shapes::Box(.1, .1, .1)), palm);
+
+  // the copy shares the distance field until one of the worlds changes
+  collision_detection::WorldPtr world(new collision_detection::World(*cworld_->getWorld()));
+  DefaultCWorldType copy(static_cast<const DefaultCWorldType&>(*cworld_), world);
+  collision_detection::CollisionRequest req;
+  collision_detection::CollisionResult res;
+  copy.checkRobotCollision(req, res, *crobot_, kstate, *acm_);
+  EXPECT_TRUE(res.collision);
+
+  world->removeObject("box");
+  res.clear();
+  copy.checkRobotCollision(req, res, *crobot_, kstate, *acm_);
+  EXPECT_FALSE(res.collision);
+  res.clear();
+  cworld_->checkRobotCollision(req, res, *crobot_, kstate, *acm_);
+  EXPECT_TRUE(res.collision);
+}
+
+TEST_F(DistanceFieldCollisionDetectionTester, ContinuousCollisionWithWorld)
+{
+  robot_state::RobotState kstate1(kmodel_);
+  kstate1.setToDefaultValues();
+  kstate1.setVariablePosition("world_joint/x", -3.0);
+  kstate1.update();
+
+  robot_state::RobotState kstate2(kstate1);
+  kstate2.setVariablePosition("world_joint/x", 3.0);
+  kstate2.update();
+
+  Eigen::Affine3d pos = Eigen::Affine3d::Identity();
+  pos.translation().z() = 1.0;
+  cworld_->getWorld()->addToObject("box", shapes::ShapeConstPtr(new shapes::Box(.1, .1, .1)), pos);
+
+  collision_detection::CollisionRequest req;
+  collision_detection::CollisionResult res;
+  cworld_->checkRobotCollision(req, res, *crobot_, kstate1, *acm_);
+  ASSERT_FALSE(res.collision);
+  res.clear();
+  cworld_->checkRobotCollision(req, res, *crobot_, kstate2, *acm_);
+  ASSERT_FALSE(res.collision);
+
+  // the robot passes through the box when moving between the two states
+  res.clear();
+  cworld_->checkRobotCollision(req, res, *crobot_, kstate1, kstate2, *acm_);
+  EXPECT_TRUE(res.collision);
+}
+
+TEST_F(DistanceFieldCollisionDetectionTester, BatchCollisionWithWorld)
+{
+  Eigen::Affine3d pos = Eigen::Affine3d::Identity();
+  pos.translation().z() = 1.0;
+  cworld_->getWorld()->addToObject("box", shapes::ShapeConstPtr(new shapes::Box(.1, .1, .1)), pos);
+
+  // states along a motion of the base through the box
+  std::vector<robot_state::RobotStatePtr> states;
+  std::vector<const robot_state::RobotState*> state_ptrs;
+  for (int i = 0 ; i <= 60 ; ++i)
+  {
+    robot_state::RobotStatePtr st(new robot_state::RobotState(kmodel_));
+    st->setToDefaultValues();
+    st->setVariablePosition("world_joint/x", -3.0 + 0.1 * i);
+    st->update();
+    states.push_back(st);
+    state_ptrs.push_back(st.get());
+  }
+
+  collision_detection::CollisionRequest req;
+  const DefaultCWorldType &world = static_cast<const DefaultCWorldType&>(*cworld_);
+  std::vector<unsigned char> colliding;
+  world.checkRobotCollisionBatch(req, *crobot_, state_ptrs, colliding, *acm_);
+  ASSERT_EQ(colliding.size(), states.size());
+
+  // the results are the same as when checking the states one by one
+  std::size_t count = 0;
+  for (std::size_t i = 0 ; i < states.size() ; ++i)
+  {
+    collision_detection::CollisionResult res;
+    cworld_->checkRobotCollision(req, res, *crobot_, *states[i], *acm_);
+    EXPECT_EQ(res.collision, colliding[i] != 0);
+    if (colliding[i])
+      ++count;
+  }
+  EXPECT_GT(count, 0);
+  EXPECT_LT(count, states.size());
+
+  // also when collisions with the box are only allowed for some links
+  acm_->setEntry("box", "r_gripper_palm_link", true);
+  world.checkRobotCollisionBatch(req, *crobot_, state_ptrs, colliding, *acm_);
+  for (std::size_t i = 0 ; i < states.size() ; ++i)
+  {
+    collision_detection::CollisionResult res;
+    cworld_->checkRobotCollision(req, res, *crobot_, *states[i], *acm_);
+    EXPECT_EQ(res.collision, colliding[i] != 0);
+  }
+}
+
+TEST_F(DistanceFieldCollisionDetectionTester, PartiallyAllowedObjects)
+{
+  robot_state::RobotState kstate(kmodel_);
+  kstate.setToDefaultValues();
+  kstate.update();
+
+  const Eigen::Affine3d &palm = kstate.getGlobalLinkTransform("r_gripper_palm_link");
+  cworld_->getWorld()->addToObject("near", shapes::ShapeConstPtr(new shapes::Box(.1, .1, .1)), palm);
+  cworld_->getWorld()->addToObject("far", shapes::ShapeConstPtr(new shapes::Box(.1, .1, .1)), Eigen::Affine3d(Eigen::Translation3d(1.2, 1.2, 2.8)));
+
+  // allowing the object far from the robot does not hide the contact with the one near it
+  acm_->setDefaultEntry("far", true);
+  collision_detection::CollisionRequest req;
+  req.contacts = true;
+  collision_detection::CollisionResult res;
+  cworld_->checkRobotCollision(req, res, *crobot_, kstate, *acm_);
+  ASSERT_TRUE(res.collision);
+  ASSERT_FALSE(res.contacts.empty());
+  const std::pair<std::string, std::string> &pair = res.contacts.begin()->first;
+  EXPECT_TRUE(pair.first == "near" || pair.second == "near");
+
+  // allowing the near object for the palm only leaves the contacts of the other links
+  acm_->setEntry("near", "r_gripper_palm_link", true);
+  res.clear();
+  cworld_->checkRobotCollision(req, res, *crobot_, kstate, *acm_);
+  for (collision_detection::CollisionResult::ContactMap::const_iterator it = res.contacts.begin() ; it != res.contacts.end() ; ++it)
+    EXPECT_TRUE(it->first.first != "r_gripper_palm_link" && it->first.second != "r_gripper_palm_link");
+
+  acm_->setDefaultEntry("near", true);
+  res.clear();
+  cworld_->checkRobotCollision(req, res, *crobot_, kstate, *acm_);
+  EXPECT_FALSE(res.collision);
+
+  // an attached body is checked against the world, also when its spheres are reused
+  std::vector<shapes::ShapeConstPtr> shapes(1, shapes::ShapeConstPtr(new shapes::Box(.1, .1, .1)));
+  EigenSTL::vector_Affine3d poses(1, Eigen::Affine3d::Identity());
+  kstate.attachBody("attached", shapes, poses, std::vector<std::string>(), "l_gripper_palm_link");
+  kstate.update();
+  cworld_->getWorld()->moveShapeInObject("far", cworld_->getWorld()->getObject("far")->shapes_[0],
+                                         kstate.getGlobalLinkTransform("l_gripper_palm_link"));
+  acm_->setDefaultEntry("far", false);
+  acm_->setEntry("far", kmodel_->getLinkModelNames(), true);
+  for (int i = 0 ; i < 2 ; ++i)
+  {
+    res.clear();
+    cworld_->checkRobotCollision(req, res, *crobot_, kstate, *acm_);
+    ASSERT_TRUE(res.collision);
+    ASSERT_FALSE(res.contacts.empty());
+    const std::pair<std::string, std::string> &attached_pair = res.contacts.begin()->first;
+    EXPECT_TRUE(attached_pair.first == "attached" || attached_pair.second == "attached");
+  }
+}
+
+int main(int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
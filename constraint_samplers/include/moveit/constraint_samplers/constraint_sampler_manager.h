@@ -90,6 +90,30 @@ public:
    */
   ConstraintSamplerPtr selectSampler(const planning_scene::PlanningSceneConstPtr &scene, const std::string &group_name, const moveit_msgs::Constraints &constr) const;
 
+  /**
+   * \brief Set the number of configured samplers kept for reuse by selectSampler()
+   *
+   * When the capacity is larger than 0, the samplers returned by
+   * selectSampler() are remembered together with the group name and
+   * the (serialized) constraints they were made for. A later call for
+   * the same robot model, group and constraints returns the same
+   * sampler instead of constructing and configuring a new one,
+   * provided the fixed transforms of the frames the constraints are
+   * expressed in did not change. The least recently used samplers are
+   * forgotten first. Cached samplers are shared between callers, so
+   * they must not be used by multiple threads at the same time; the
+   * cache is disabled by default.
+   *
+   * @param capacity The maximum number of samplers to keep (0 disables the cache)
+   */
+  void setSamplerCacheCapacity(std::size_t capacity);
+
+  /** \brief Get the maximum number of samplers kept for reuse */
+  std::size_t getSamplerCacheCapacity() const;
+
+  /** \brief Forget all the samplers kept for reuse */
+  void clearSamplerCache();
+
   /**
    * \brief Default logic to select a ConstraintSampler given a
    * constraints message.
@@ -131,7 +155,12 @@ public:
 
 private:
 
+  ConstraintSamplerPtr allocSampler(const planning_scene::PlanningSceneConstPtr &scene, const std::string &group_name, const moveit_msgs::Constraints &constr) const;
+
+  struct SamplerCache;
+
   std::vector<ConstraintSamplerAllocatorPtr> sampler_alloc_; /**< \brief Holds the constraint sampler allocators, which will be tested in order  */
+  boost::shared_ptr<SamplerCache>            sampler_cache_; /**< \brief The configured samplers kept for reuse; NULL until a capacity is set */
 };
 
 MOVEIT_CLASS_FORWARD(ConstraintSamplerManager);
@@ -38,6 +38,7 @@
 #define MOVEIT_CONSTRAINT_SAMPLERS_DEFAULT_CONSTRAINT_SAMPLERS_
 
 #include <moveit/constraint_samplers/constraint_sampler.h>
+#include <moveit/robot_model/quasi_random_sequence.h>
 #include <random_numbers/random_numbers.h>
 
 namespace constraint_samplers
@@ -68,7 +69,10 @@ public:
    */
   JointConstraintSampler(const planning_scene::PlanningSceneConstPtr &scene,
                          const std::string &group_name) :
-    ConstraintSampler(scene, group_name)
+    ConstraintSampler(scene, group_name),
+    use_quasi_random_(false),
+    quasi_random_type_(robot_model::QuasiRandomSequence::HALTON),
+    quasi_random_seed_(0)
   {
   }
   /**
@@ -147,6 +151,32 @@ public:
     return unbounded_.size();
   }
 
+  /**
+   * \brief Take the joint values from a low-discrepancy sequence
+   * instead of the random number generator, so that consecutive
+   * samples cover the allowed joint values more evenly.
+   *
+   * The sequence is sized for the configured constraints and restarts
+   * when the sampler is configured again.
+   *
+   * @param type The type of sequence to use
+   * @param seed The seed that randomizes the sequence (0 for the plain sequence)
+   */
+  void setQuasiRandomSequence(robot_model::QuasiRandomSequence::Type type, boost::uint32_t seed = 0)
+  {
+    quasi_random_type_ = type;
+    quasi_random_seed_ = seed;
+    use_quasi_random_ = true;
+    quasi_random_.reset();
+  }
+
+  /** \brief Go back to sampling joint values with the random number generator */
+  void clearQuasiRandomSequence()
+  {
+    use_quasi_random_ = false;
+    quasi_random_.reset();
+  }
+
 protected:
 
   /// \brief An internal structure used for maintaining constraints on a particular joint
@@ -191,6 +221,11 @@ protected:
   std::vector<const robot_model::JointModel*> unbounded_; /**< \brief The joints that are not bounded except by joint limits */
   std::vector<unsigned int>                       uindex_; /**< \brief The index of the unbounded joints in the joint state vector */
   std::vector<double>                             values_; /**< \brief Values associated with this group to avoid continuously reallocating */
+
+  bool                                            use_quasi_random_; /**< \brief True if samples are taken from a quasi-random sequence */
+  robot_model::QuasiRandomSequence::Type          quasi_random_type_; /**< \brief The type of the quasi-random sequence */
+  boost::uint32_t                                 quasi_random_seed_; /**< \brief The seed of the quasi-random sequence */
+  robot_model::QuasiRandomSequencePtr             quasi_random_; /**< \brief The quasi-random sequence, allocated at the first sample after configuration */
 };
 
 /**
@@ -295,7 +330,10 @@ public:
    */
   IKConstraintSampler(const planning_scene::PlanningSceneConstPtr &scene,
                       const std::string &group_name) :
-    ConstraintSampler(scene, group_name)
+    ConstraintSampler(scene, group_name),
+    use_quasi_random_(false),
+    quasi_random_type_(robot_model::QuasiRandomSequence::HALTON),
+    local_projection_iterations_(10)
   {
   }
 
@@ -441,8 +479,109 @@ public:
                       const robot_state::RobotState &reference_state,
                       unsigned int max_attempts);
 
+  /**
+   * \brief Project a state onto the constraints.
+   *
+   * States that are close to satisfying the constraints (e.g.,
+   * samples rejected during path-constrained planning) are first
+   * moved onto the constraints by a few damped Jacobian
+   * pseudoinverse steps that reduce the position and orientation
+   * errors of the constrained link (see
+   * setLocalProjectionIterations()). Only if that fails is IK called,
+   * seeded with the state, as sample() does.
+   *
+   * @param [in,out] state The state to project
+   * @param [in] max_attempts The maximum number of IK attempts if the local projection fails
+   *
+   * @return True if the state satisfies the constraints
+   */
   virtual bool project(robot_state::RobotState &state,
                        unsigned int max_attempts);
+
+  /** \brief Set the number of Jacobian steps project() takes before falling back to IK (0 disables the local projection) */
+  void setLocalProjectionIterations(unsigned int iterations)
+  {
+    local_projection_iterations_ = iterations;
+  }
+
+  unsigned int getLocalProjectionIterations() const
+  {
+    return local_projection_iterations_;
+  }
+
+  /** \brief Callback for the states produced by sampleBatch(), called as soon as each state is found. Calls are
+      never concurrent. If the callback returns false, sampling stops. */
+  typedef boost::function<bool(const robot_state::RobotState &state)> SampleCallbackFn;
+
+  /**
+   * \brief Produce up to \e count IK samples, using multiple threads.
+   *
+   * Each thread samples poses and calls IK as sample() does, but with
+   * its own solver instance (leased from the solver pool of the group,
+   * which grows to \e threads instances if needed) and its own random
+   * number generator (seeded from the one of the sampler). The threads
+   * come from the shared moveit::tools::ThreadPool. If no more solver
+   * instances are available, fewer threads are used. The group state validity callback, if
+   * set, is called from multiple threads and must be thread-safe.
+   *
+   * @param [out] states The states found, in the order they were found
+   * @param reference_state The state used for transforming the IK poses and as a template for the produced states
+   * @param count The number of states to produce
+   * @param threads The number of threads to use
+   * @param max_attempts The number of pose sampling and IK attempts allowed per requested state
+   * @param callback If set, called for each state as soon as it is found
+   *
+   * @return The number of states found
+   */
+  std::size_t sampleBatch(std::vector<robot_state::RobotStatePtr> &states, const robot_state::RobotState &reference_state,
+                          std::size_t count, unsigned int threads, unsigned int max_attempts,
+                          const SampleCallbackFn &callback = SampleCallbackFn());
+
+  /**
+   * \brief Take the pose samples from a low-discrepancy sequence
+   * instead of the random number generator, so that consecutive
+   * samples cover the constraint regions more evenly.
+   *
+   * The sequence has 6 dimensions: 3 for the position (a point in
+   * the bounding box of a constraint region is accepted if it is
+   * inside the region) and 3 for the orientation. sampleBatch() gives
+   * each thread its own sequence of the same type, seeded like the
+   * random number generator of the thread.
+   *
+   * @param type The type of sequence to use
+   * @param seed The seed that randomizes the sequence (0 for the plain sequence)
+   */
+  void setQuasiRandomSequence(robot_model::QuasiRandomSequence::Type type, boost::uint32_t seed = 0)
+  {
+    quasi_random_type_ = type;
+    use_quasi_random_ = true;
+    quasi_random_.reset(new robot_model::QuasiRandomSequence(type, 6, seed));
+  }
+
+  /** \brief Go back to sampling poses with the random number generator */
+  void clearQuasiRandomSequence()
+  {
+    use_quasi_random_ = false;
+    quasi_random_.reset();
+  }
+
+  /**
+   * \brief Get the reachability map used by the sampler, if any.
+   *
+   * The map is the one of the group (see
+   * robot_model::JointModelGroup::setReachabilityMap()), taken when
+   * the sampler is configured, if it is computed for the base and tip
+   * frames of the IK solver. Pose samples are then kept with a
+   * probability proportional to the number of orientations reachable
+   * in their voxel, and samples in unreachable voxels are discarded
+   * before calling IK. If no reachable voxel touches the position
+   * constraint region, sampling fails immediately.
+   */
+  const robot_model::ReachabilityMapConstPtr& getReachabilityMap() const
+  {
+    return reachability_map_;
+  }
+
   /**
    * \brief Returns a pose that falls within the constraint regions.
    *
@@ -490,6 +629,37 @@ protected:
    */
   bool callIK(const geometry_msgs::Pose &ik_query, const kinematics::KinematicsBase::IKCallbackFn &adapted_ik_validity_callback,
               double timeout, robot_state::RobotState &state, bool use_as_seed);
+
+  /** \brief Same as callIK() above, with the solver and random number generator specified explicitly */
+  bool callIK(const geometry_msgs::Pose &ik_query, const kinematics::KinematicsBase::IKCallbackFn &adapted_ik_validity_callback,
+              double timeout, robot_state::RobotState &state, bool use_as_seed,
+              const kinematics::KinematicsBase &solver, random_numbers::RandomNumberGenerator &rng) const;
+
+  /** \brief Same as samplePose(), with the random number generator and the quasi-random sequence (if any) specified explicitly */
+  bool samplePose(Eigen::Vector3d &pos, Eigen::Quaterniond &quat, const robot_state::RobotState &ks, unsigned int max_attempts,
+                  random_numbers::RandomNumberGenerator &rng, robot_model::QuasiRandomSequence *sequence) const;
+
+  /** \brief Sample a pose as samplePose() does, without considering the reachability map */
+  bool sampleCandidatePose(Eigen::Vector3d &pos, Eigen::Quaterniond &quat, const robot_state::RobotState &ks, unsigned int max_attempts,
+                           random_numbers::RandomNumberGenerator &rng, robot_model::QuasiRandomSequence *sequence) const;
+
+  /** \brief The local projection of project(): move \e state onto the constraints with damped Jacobian pseudoinverse
+      steps. Returns true if the resulting state satisfies the constraints and the group state validity callback */
+  bool projectLocally(robot_state::RobotState &state) const;
+
+  /** \brief Check if some voxel of the reachability map touches the position constraint region; true if there is no map */
+  bool isRegionReachable(const robot_state::RobotState &ks) const;
+
+  /** \brief Take a point inside \e body using \e sequence, also advancing the sequence for the orientation in \e
+      orientation_sample */
+  bool samplePointInside(const bodies::Body &body, unsigned int max_attempts, robot_model::QuasiRandomSequence &sequence,
+                         Eigen::Vector3d &pos, double *orientation_sample) const;
+
+  /** \brief The work done by each thread in sampleBatch() */
+  struct BatchData;
+  void sampleBatchWorker(BatchData *data, const std::vector<kinematics::KinematicsBaseConstPtr> *solvers,
+                         const std::vector<boost::uint32_t> *seeds, std::size_t thread) const;
+
   bool sampleHelper(robot_state::RobotState &state, const robot_state::RobotState &reference_state, unsigned int max_attempts, bool project);
   bool validate(robot_state::RobotState &state) const;
 
@@ -499,6 +669,13 @@ protected:
   double                                ik_timeout_; /**< \brief Holds the timeout associated with IK */
   std::string                           ik_frame_; /**< \brief Holds the base from of the IK solver */
   bool                                  transform_ik_; /**< \brief True if the frame associated with the kinematic model is different than the base frame of the IK solver */
+  bool                                  use_quasi_random_; /**< \brief True if pose samples are taken from a quasi-random sequence */
+  robot_model::QuasiRandomSequence::Type quasi_random_type_; /**< \brief The type of the quasi-random sequence */
+  robot_model::QuasiRandomSequencePtr   quasi_random_; /**< \brief The quasi-random sequence used by samplePose() */
+  robot_model::ReachabilityMapConstPtr  reachability_map_; /**< \brief The reachability map of the IK solver frames, if any */
+  std::vector<Eigen::Vector3d>          reachable_voxels_; /**< \brief The centers of the reachable voxels of the map, in the IK frame */
+  std::vector<bodies::BodyPtr>          padded_regions_; /**< \brief The constraint regions, padded to account for the voxel size and link offset */
+  unsigned int                          local_projection_iterations_; /**< \brief The number of Jacobian steps project() takes before calling IK */
 };
 
 
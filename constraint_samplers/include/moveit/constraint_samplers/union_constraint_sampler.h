@@ -99,9 +99,34 @@ public:
                          const std::string &group_name,
                          const std::vector<ConstraintSamplerPtr> &samplers);
 
+  /** \brief Statistics kept for a member sampler in adaptive mode */
+  struct SamplerStatistics
+  {
+    SamplerStatistics() : attempts_(0), successes_(0), time_(0.0)
+    {
+    }
+
+    /** \brief The fraction of the calls that produced a valid sample (1 if the sampler was not called yet) */
+    double getSuccessRate() const
+    {
+      return attempts_ ? (double)successes_ / (double)attempts_ : 1.0;
+    }
+
+    /** \brief The average time of a call, in seconds */
+    double getAverageTime() const
+    {
+      return attempts_ ? time_ / (double)attempts_ : 0.0;
+    }
+
+    unsigned int attempts_; /**< \brief The number of times the sampler was called */
+    unsigned int successes_; /**< \brief The number of calls that produced a valid sample */
+    double time_; /**< \brief The total time spent in the sampler, in seconds */
+  };
+
   /**
    * \brief Gets the sorted internal list of constraint samplers
    *
+   * In adaptive mode the order changes as samples are taken.
    *
    * @return The sorted internal list of constraint samplers
    */
@@ -110,6 +135,42 @@ public:
     return samplers_;
   }
 
+  /**
+   * \brief Enable or disable the adaptive mode.
+   *
+   * In adaptive mode the union keeps the success rate and the time
+   * per call of each member sampler. Every \e reorder_period samples,
+   * neighbouring samplers that do not depend on each other (their
+   * groups update disjoint sets of links, and neither has a frame
+   * dependency on links of the other) are reordered so that the ones
+   * with the smallest time per rejection come first: a sample that
+   * is going to fail fails as early and as cheaply as possible, which
+   * maximizes the number of valid samples per second. The order
+   * between dependent samplers is never changed. If a group state
+   * validity callback is set for the union, it is also called for
+   * the group of each member sampler right after that sampler
+   * succeeds, so states that are already invalid are rejected before
+   * running the remaining samplers.
+   *
+   * @param [in] flag True to enable the adaptive mode
+   * @param [in] reorder_period The number of samples between reorderings
+   */
+  void setAdaptive(bool flag, unsigned int reorder_period = 32);
+
+  bool isAdaptive() const
+  {
+    return adaptive_;
+  }
+
+  /** \brief Get the statistics of the member samplers, in the order of getSamplers() */
+  const std::vector<SamplerStatistics>& getStatistics() const
+  {
+    return statistics_;
+  }
+
+  /** \brief Forget the statistics of the member samplers */
+  void resetStatistics();
+
   /**
    * \brief No-op, as the union constraint sampler is for already
    * configured samplers
@@ -156,7 +217,17 @@ public:
 
 protected:
 
+  /** \brief Check if the samplers at \e i and \e i + 1 can be swapped without changing the samples */
+  bool canSwap(std::size_t i) const;
+
+  /** \brief Reorder independent neighbouring samplers according to their statistics */
+  void reorder();
+
   std::vector<ConstraintSamplerPtr> samplers_; /**< \brief Holder for sorted internal list of samplers*/
+  std::vector<SamplerStatistics>    statistics_; /**< \brief Statistics of the samplers, in the order of samplers_ */
+  bool                              adaptive_; /**< \brief True if the adaptive mode is enabled */
+  unsigned int                      reorder_period_; /**< \brief The number of samples between reorderings */
+  unsigned int                      samples_since_reorder_; /**< \brief The number of samples taken since the last reordering */
 };
 
 }
@@ -37,11 +37,165 @@
 #include <moveit/constraint_samplers/constraint_sampler_manager.h>
 #include <moveit/constraint_samplers/default_constraint_samplers.h>
 #include <moveit/constraint_samplers/union_constraint_sampler.h>
+#include <boost/thread/mutex.hpp>
+#include <boost/functional/hash.hpp>
 #include <sstream>
+#include <list>
+
+struct constraint_samplers::ConstraintSamplerManager::SamplerCache
+{
+  /* A frame the constraints were expressed in, and its transform if it was fixed */
+  struct FrameDependency
+  {
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+    std::string     frame_;
+    bool            fixed_;
+    Eigen::Affine3d transform_;
+  };
+
+  struct Entry
+  {
+    const robot_model::RobotModel                 *model_;     // kept alive by the scene of the sampler
+    std::string                                    group_;
+    std::size_t                                    hash_;
+    std::vector<uint8_t>                           message_;   // the serialized constraints message
+    std::vector<FrameDependency, Eigen::aligned_allocator<FrameDependency> > frames_;
+    ConstraintSamplerPtr                           sampler_;
+  };
+
+  SamplerCache() : capacity_(0)
+  {
+  }
+
+  void addFrame(Entry &entry, const robot_state::Transforms &tf, const std::string &frame) const
+  {
+    for (std::size_t i = 0 ; i < entry.frames_.size() ; ++i)
+      if (entry.frames_[i].frame_ == frame)
+        return;
+    FrameDependency dep;
+    dep.frame_ = frame;
+    dep.fixed_ = tf.isFixedFrame(frame);
+    if (dep.fixed_)
+      dep.transform_ = tf.getTransform(frame);
+    entry.frames_.push_back(dep);
+  }
+
+  /* The frames whose transforms the samplers use when they are configured */
+  void recordFrames(Entry &entry, const robot_state::Transforms &tf, const moveit_msgs::Constraints &constr) const
+  {
+    for (std::size_t i = 0 ; i < constr.position_constraints.size() ; ++i)
+      addFrame(entry, tf, constr.position_constraints[i].header.frame_id);
+    for (std::size_t i = 0 ; i < constr.orientation_constraints.size() ; ++i)
+      addFrame(entry, tf, constr.orientation_constraints[i].header.frame_id);
+  }
+
+  bool framesUnchanged(const Entry &entry, const robot_state::Transforms &tf) const
+  {
+    for (std::size_t i = 0 ; i < entry.frames_.size() ; ++i)
+    {
+      const FrameDependency &dep = entry.frames_[i];
+      if (tf.isFixedFrame(dep.frame_) != dep.fixed_)
+        return false;
+      if (dep.fixed_ && tf.getTransform(dep.frame_).matrix() != dep.transform_.matrix())
+        return false;
+    }
+    return true;
+  }
+
+  boost::mutex      lock_;
+  std::size_t       capacity_;
+  std::list<Entry>  entries_;      // most recently used first
+};
+
+void constraint_samplers::ConstraintSamplerManager::setSamplerCacheCapacity(std::size_t capacity)
+{
+  if (!sampler_cache_)
+  {
+    if (capacity == 0)
+      return;
+    sampler_cache_.reset(new SamplerCache());
+  }
+  boost::mutex::scoped_lock slock(sampler_cache_->lock_);
+  sampler_cache_->capacity_ = capacity;
+  while (sampler_cache_->entries_.size() > capacity)
+    sampler_cache_->entries_.pop_back();
+}
+
+std::size_t constraint_samplers::ConstraintSamplerManager::getSamplerCacheCapacity() const
+{
+  if (!sampler_cache_)
+    return 0;
+  boost::mutex::scoped_lock slock(sampler_cache_->lock_);
+  return sampler_cache_->capacity_;
+}
+
+void constraint_samplers::ConstraintSamplerManager::clearSamplerCache()
+{
+  if (sampler_cache_)
+  {
+    boost::mutex::scoped_lock slock(sampler_cache_->lock_);
+    sampler_cache_->entries_.clear();
+  }
+}
 
 constraint_samplers::ConstraintSamplerPtr constraint_samplers::ConstraintSamplerManager::selectSampler(const planning_scene::PlanningSceneConstPtr &scene,
                                                                                                        const std::string &group_name,
                                                                                                        const moveit_msgs::Constraints &constr) const
+{
+  if (!sampler_cache_ || getSamplerCacheCapacity() == 0)
+    return allocSampler(scene, group_name, constr);
+
+  SamplerCache &cache = *sampler_cache_;
+  const robot_state::Transforms &tf = scene->getTransforms();
+
+  SamplerCache::Entry entry;
+  entry.model_ = scene->getRobotModel().get();
+  entry.group_ = group_name;
+  entry.message_.resize(ros::serialization::serializationLength(constr));
+  if (!entry.message_.empty())
+  {
+    ros::serialization::OStream stream(&entry.message_[0], entry.message_.size());
+    ros::serialization::serialize(stream, constr);
+  }
+  entry.hash_ = boost::hash_range(entry.message_.begin(), entry.message_.end());
+  boost::hash_combine(entry.hash_, group_name);
+
+  {
+    boost::mutex::scoped_lock slock(cache.lock_);
+    for (std::list<SamplerCache::Entry>::iterator it = cache.entries_.begin() ; it != cache.entries_.end() ; ++it)
+      if (it->hash_ == entry.hash_ && it->model_ == entry.model_ && it->group_ == entry.group_ && it->message_ == entry.message_)
+      {
+        if (cache.framesUnchanged(*it, tf))
+        {
+          cache.entries_.splice(cache.entries_.begin(), cache.entries_, it);
+          return it->sampler_;
+        }
+        cache.entries_.erase(it);
+        break;
+      }
+  }
+
+  // configure the sampler outside the lock; samplers that could not be allocated are not remembered
+  ConstraintSamplerPtr sampler = allocSampler(scene, group_name, constr);
+  if (!sampler)
+    return sampler;
+  cache.recordFrames(entry, tf, constr);
+  entry.sampler_ = sampler;
+
+  boost::mutex::scoped_lock slock(cache.lock_);
+  if (cache.capacity_ > 0)
+  {
+    cache.entries_.push_front(entry);
+    if (cache.entries_.size() > cache.capacity_)
+      cache.entries_.pop_back();
+  }
+  return sampler;
+}
+
+constraint_samplers::ConstraintSamplerPtr constraint_samplers::ConstraintSamplerManager::allocSampler(const planning_scene::PlanningSceneConstPtr &scene,
+                                                                                                      const std::string &group_name,
+                                                                                                      const moveit_msgs::Constraints &constr) const
 {
   for (std::size_t i = 0 ; i < sampler_alloc_.size() ; ++i)
     if (sampler_alloc_[i]->canService(scene, group_name, constr))
@@ -35,10 +35,14 @@
 /* Author: Ioan Sucan */
 
 #include <moveit/constraint_samplers/default_constraint_samplers.h>
+#include <moveit/background_processing/thread_pool.h>
 #include <set>
 #include <cassert>
 #include <eigen_conversions/eigen_msg.h>
 #include <boost/bind.hpp>
+#include <boost/thread.hpp>
+#include <limits>
+#include <boost/math/constants/constants.hpp>
 
 bool constraint_samplers::JointConstraintSampler::configure(const moveit_msgs::Constraints &constr)
 {
@@ -149,6 +153,30 @@ bool constraint_samplers::JointConstraintSampler::sample(robot_state::RobotState
     return false;
   }
 
+  if (use_quasi_random_)
+  {
+    unsigned int dim = bounds_.size();
+    for (std::size_t i = 0 ; i < unbounded_.size() ; ++i)
+      dim += unbounded_[i]->getUnitSampleDimension();
+    if (!quasi_random_)
+      quasi_random_.reset(new robot_model::QuasiRandomSequence(quasi_random_type_, dim, quasi_random_seed_));
+    std::vector<double> u, v;
+    quasi_random_->next(u);
+    std::size_t k = 0;
+    for (std::size_t i = 0 ; i < unbounded_.size() ; ++i)
+    {
+      v.resize(unbounded_[i]->getVariableCount());
+      unbounded_[i]->getVariablePositionsFromUnitSample(&u[k], &v[0]);
+      k += unbounded_[i]->getUnitSampleDimension();
+      for (std::size_t j = 0 ; j < v.size() ; ++j)
+        values_[uindex_[i] + j] = v[j];
+    }
+    for (std::size_t i = 0 ; i < bounds_.size() ; ++i, ++k)
+      values_[bounds_[i].index_] = bounds_[i].min_bound_ + u[k] * (bounds_[i].max_bound_ - bounds_[i].min_bound_);
+    state.setJointGroupPositions(jmg_, values_);
+    return true;
+  }
+
   // sample the unbounded joints first (in case some joint variables are bounded)
   std::vector<double> v;
   for (std::size_t i = 0 ; i < unbounded_.size() ; ++i)
@@ -172,7 +200,19 @@ bool constraint_samplers::JointConstraintSampler::sample(robot_state::RobotState
 bool constraint_samplers::JointConstraintSampler::project(robot_state::RobotState &state,
                                                           unsigned int max_attempts)
 {
-  return sample(state, state, max_attempts);
+  if (!is_valid_)
+  {
+    logWarn("JointConstraintSampler not configured, won't project");
+    return false;
+  }
+
+  // the closest state that satisfies the constraints only differs in the constrained variables, which are clamped to
+  // their bounds; the unconstrained ones are kept
+  state.copyJointGroupPositions(jmg_, values_);
+  for (std::size_t i = 0 ; i < bounds_.size() ; ++i)
+    values_[bounds_[i].index_] = std::min(std::max(values_[bounds_[i].index_], bounds_[i].min_bound_), bounds_[i].max_bound_);
+  state.setJointGroupPositions(jmg_, values_);
+  return true;
 }
 
 void constraint_samplers::JointConstraintSampler::clear()
@@ -182,6 +222,7 @@ void constraint_samplers::JointConstraintSampler::clear()
   unbounded_.clear();
   uindex_.clear();
   values_.clear();
+  quasi_random_.reset();
 }
 
 constraint_samplers::IKSamplingPose::IKSamplingPose()
@@ -219,6 +260,9 @@ void constraint_samplers::IKConstraintSampler::clear()
   kb_.reset();
   ik_frame_ = "";
   transform_ik_ = false;
+  reachability_map_.reset();
+  reachable_voxels_.clear();
+  padded_regions_.clear();
 }
 
 bool constraint_samplers::IKConstraintSampler::configure(const IKSamplingPose &sp)
@@ -372,23 +416,130 @@ bool constraint_samplers::IKConstraintSampler::loadIKSolver()
              sampling_pose_.position_constraint_ ? sampling_pose_.position_constraint_->getLinkModel()->getName().c_str() : sampling_pose_.orientation_constraint_->getLinkModel()->getName().c_str(), kb_->getTipFrame().c_str());
     return false;
   }
+
+  // use the reachability map of the group only if it describes the frames of the solver
+  const robot_model::ReachabilityMapConstPtr &map = jmg_->getReachabilityMap();
+  if (map)
+  {
+    if (robot_state::Transforms::sameFrame(map->getBaseFrame(), ik_frame_) && robot_state::Transforms::sameFrame(map->getTipFrame(), kb_->getTipFrame()))
+    {
+      reachability_map_ = map;
+      std::vector<unsigned int> counts;
+      map->getVoxels(reachable_voxels_, counts);
+      if (sampling_pose_.position_constraint_)
+      {
+        // a voxel touches a region if its center is within half a voxel diagonal of the region; the point constrained
+        // by the region is also away from the tip by the link offset
+        double padding = 0.5 * sqrt(3.0) * map->getResolution();
+        if (sampling_pose_.position_constraint_->hasLinkOffset())
+          padding += sampling_pose_.position_constraint_->getLinkOffset().norm();
+        const std::vector<bodies::BodyPtr> &b = sampling_pose_.position_constraint_->getConstraintRegions();
+        for (std::size_t i = 0 ; i < b.size() ; ++i)
+          padded_regions_.push_back(b[i]->cloneAt(b[i]->getPose(), b[i]->getPadding() + padding, b[i]->getScale()));
+      }
+    }
+    else
+      logWarn("The reachability map of group '%s' is for frames '%s' and '%s', but the IK solver uses '%s' and '%s'. Ignoring the map.",
+              jmg_->getName().c_str(), map->getBaseFrame().c_str(), map->getTipFrame().c_str(), ik_frame_.c_str(), kb_->getTipFrame().c_str());
+  }
   return true;
 }
 
+bool constraint_samplers::IKConstraintSampler::isRegionReachable(const robot_state::RobotState &ks) const
+{
+  if (!reachability_map_ || padded_regions_.empty())
+    return true;
+
+  // the voxel centers are in the IK frame, the regions in the reference frame of the constraint
+  Eigen::Affine3d to_region = Eigen::Affine3d::Identity();
+  if (transform_ik_)
+    to_region = ks.getFrameTransform(ik_frame_);
+  if (sampling_pose_.position_constraint_->mobileReferenceFrame())
+    to_region = ks.getFrameTransform(sampling_pose_.position_constraint_->getReferenceFrame()).inverse() * to_region;
+
+  for (std::size_t i = 0 ; i < reachable_voxels_.size() ; ++i)
+  {
+    Eigen::Vector3d p = to_region * reachable_voxels_[i];
+    for (std::size_t j = 0 ; j < padded_regions_.size() ; ++j)
+      if (padded_regions_[j]->containsPoint(p))
+        return true;
+  }
+  return false;
+}
+
 bool constraint_samplers::IKConstraintSampler::samplePose(Eigen::Vector3d &pos, Eigen::Quaterniond &quat,
                                                           const robot_state::RobotState &ks,
                                                           unsigned int max_attempts)
 {
+  return samplePose(pos, quat, ks, max_attempts, random_number_generator_, quasi_random_.get());
+}
+
+bool constraint_samplers::IKConstraintSampler::samplePointInside(const bodies::Body &body, unsigned int max_attempts,
+                                                                 robot_model::QuasiRandomSequence &sequence,
+                                                                 Eigen::Vector3d &pos, double *orientation_sample) const
+{
+  // take points in the box around the bounding sphere until one is inside the body
+  bodies::BoundingSphere bs;
+  body.computeBoundingSphere(bs);
+  double u[6];
+  for (unsigned int i = 0 ; i < max_attempts ; ++i)
+  {
+    sequence.next(u);
+    pos = bs.center + bs.radius * Eigen::Vector3d(2.0 * u[0] - 1.0, 2.0 * u[1] - 1.0, 2.0 * u[2] - 1.0);
+    if (body.containsPoint(pos))
+    {
+      std::copy(u + 3, u + 6, orientation_sample);
+      return true;
+    }
+  }
+  return false;
+}
+
+bool constraint_samplers::IKConstraintSampler::samplePose(Eigen::Vector3d &pos, Eigen::Quaterniond &quat,
+                                                          const robot_state::RobotState &ks,
+                                                          unsigned int max_attempts,
+                                                          random_numbers::RandomNumberGenerator &rng,
+                                                          robot_model::QuasiRandomSequence *sequence) const
+{
+  if (!reachability_map_)
+    return sampleCandidatePose(pos, quat, ks, max_attempts, rng, sequence);
+
+  // keep samples with a probability proportional to the dexterity of their voxel; the sampled pose is in the IK frame, as the map
+  const double max_count = reachability_map_->getMaxOrientationCount();
+  for (unsigned int a = 0 ; a < max_attempts ; ++a)
+  {
+    if (!sampleCandidatePose(pos, quat, ks, max_attempts, rng, sequence))
+      return false;
+    unsigned int count = reachability_map_->getOrientationCount(pos);
+    if (count > 0 && rng.uniform01() * max_count < count)
+      return true;
+  }
+  if (verbose_)
+    logInform("IK constraint sampler was unable to produce a pose in the reachable workspace after %u attempts", max_attempts);
+  return false;
+}
+
+bool constraint_samplers::IKConstraintSampler::sampleCandidatePose(Eigen::Vector3d &pos, Eigen::Quaterniond &quat,
+                                                                   const robot_state::RobotState &ks,
+                                                                   unsigned int max_attempts,
+                                                                   random_numbers::RandomNumberGenerator &rng,
+                                                                   robot_model::QuasiRandomSequence *sequence) const
+{
+  // the values in [0, 1) used for the orientation
+  double u[6];
+  bool have_orientation_sample = false;
   if (sampling_pose_.position_constraint_)
   {
     const std::vector<bodies::BodyPtr> &b = sampling_pose_.position_constraint_->getConstraintRegions();
     if (!b.empty())
     {
       bool found = false;
-      std::size_t k = random_number_generator_.uniformInteger(0, b.size() - 1);
+      std::size_t k = rng.uniformInteger(0, b.size() - 1);
       for (std::size_t i = 0 ; i < b.size() ; ++i)
-        if (b[(i+k) % b.size()]->samplePointInside(random_number_generator_, max_attempts, pos))
+        if (sequence ? samplePointInside(*b[(i+k) % b.size()], max_attempts, *sequence, pos, u + 3) :
+            b[(i+k) % b.size()]->samplePointInside(rng, max_attempts, pos))
         {
+          have_orientation_sample = sequence != NULL;
           found = true;
           break;
         }
@@ -416,12 +567,16 @@ bool constraint_samplers::IKConstraintSampler::samplePose(Eigen::Vector3d &pos,
     pos = tempState.getGlobalLinkTransform(sampling_pose_.orientation_constraint_->getLinkModel()).translation();
   }
 
+  // when the position did not come from the sequence, take a point of the sequence for the orientation only
+  if (sequence && !have_orientation_sample)
+    sequence->next(u);
+
   if (sampling_pose_.orientation_constraint_)
   {
     // sample a rotation matrix within the allowed bounds
-    double angle_x = 2.0 * (random_number_generator_.uniform01() - 0.5) * (sampling_pose_.orientation_constraint_->getXAxisTolerance()-std::numeric_limits<double>::epsilon());
-    double angle_y = 2.0 * (random_number_generator_.uniform01() - 0.5) * (sampling_pose_.orientation_constraint_->getYAxisTolerance()-std::numeric_limits<double>::epsilon());
-    double angle_z = 2.0 * (random_number_generator_.uniform01() - 0.5) * (sampling_pose_.orientation_constraint_->getZAxisTolerance()-std::numeric_limits<double>::epsilon());
+    double angle_x = 2.0 * ((sequence ? u[3] : rng.uniform01()) - 0.5) * (sampling_pose_.orientation_constraint_->getXAxisTolerance()-std::numeric_limits<double>::epsilon());
+    double angle_y = 2.0 * ((sequence ? u[4] : rng.uniform01()) - 0.5) * (sampling_pose_.orientation_constraint_->getYAxisTolerance()-std::numeric_limits<double>::epsilon());
+    double angle_z = 2.0 * ((sequence ? u[5] : rng.uniform01()) - 0.5) * (sampling_pose_.orientation_constraint_->getZAxisTolerance()-std::numeric_limits<double>::epsilon());
     Eigen::Affine3d diff(Eigen::AngleAxisd(angle_x, Eigen::Vector3d::UnitX())
                          * Eigen::AngleAxisd(angle_y, Eigen::Vector3d::UnitY())
                          * Eigen::AngleAxisd(angle_z, Eigen::Vector3d::UnitZ()));
@@ -438,10 +593,22 @@ bool constraint_samplers::IKConstraintSampler::samplePose(Eigen::Vector3d &pos,
   }
   else
   {
-    // sample a random orientation
-    double q[4];
-    random_number_generator_.quaternion(q);
-    quat = Eigen::Quaterniond(q[3], q[0], q[1], q[2]);
+    if (sequence)
+    {
+      // uniform quaternion from the sequence (K. Shoemake, Uniform random rotations, Graphics Gems III)
+      double r1 = sqrt(1.0 - u[3]);
+      double r2 = sqrt(u[3]);
+      double t1 = 2.0 * boost::math::constants::pi<double>() * u[4];
+      double t2 = 2.0 * boost::math::constants::pi<double>() * u[5];
+      quat = Eigen::Quaterniond(cos(t2) * r2, sin(t1) * r1, cos(t1) * r1, sin(t2) * r2);
+    }
+    else
+    {
+      // sample a random orientation
+      double q[4];
+      rng.quaternion(q);
+      quat = Eigen::Quaterniond(q[3], q[0], q[1], q[2]);
+    }
   }
 
   // if there is an offset, we need to undo the induced rotation in the sampled transform origin (point)
@@ -493,6 +660,13 @@ bool constraint_samplers::IKConstraintSampler::sampleHelper(robot_state::RobotSt
   if (!is_valid_)
     return false;
 
+  if (!isRegionReachable(reference_state))
+  {
+    if (verbose_)
+      logInform("The position constraint region is outside the workspace reachable by group '%s'", jmg_->getName().c_str());
+    return false;
+  }
+
   kinematics::KinematicsBase::IKCallbackFn adapted_ik_validity_callback;
   if (group_state_validity_callback_)
     adapted_ik_validity_callback = boost::bind(&samplingIkCallbackFnAdapter, &state, jmg_, group_state_validity_callback_, _1, _2, _3);
@@ -527,9 +701,258 @@ bool constraint_samplers::IKConstraintSampler::sampleHelper(robot_state::RobotSt
 bool constraint_samplers::IKConstraintSampler::project(robot_state::RobotState &state,
                                                        unsigned int max_attempts)
 {
+  if (is_valid_ && local_projection_iterations_ > 0 && projectLocally(state))
+    return true;
   return sampleHelper(state, state, max_attempts, true);
 }
 
+namespace
+{
+// the Jacobian of a point on a link for the variables of a group, in the model frame
+bool computeModelFrameJacobian(const robot_state::RobotState &state, const robot_model::JointModelGroup *group,
+                               const robot_model::LinkModel *link, const Eigen::Vector3d &point, Eigen::MatrixXd &jacobian)
+{
+  if (!state.getJacobian(group, link, point, jacobian))
+    return false;
+  // the Jacobian is computed with respect to the parent link of the group's first joint
+  const robot_model::LinkModel *root = group->getJointModels()[0]->getParentLinkModel();
+  if (root)
+  {
+    const Eigen::Matrix3d &r = state.getGlobalLinkTransform(root).rotation();
+    jacobian.topRows(3) = r * jacobian.topRows(3);
+    jacobian.bottomRows(3) = r * jacobian.bottomRows(3);
+  }
+  return true;
+}
+}
+
+bool constraint_samplers::IKConstraintSampler::projectLocally(robot_state::RobotState &state) const
+{
+  const kinematic_constraints::PositionConstraint *pc = sampling_pose_.position_constraint_.get();
+  const kinematic_constraints::OrientationConstraint *oc = sampling_pose_.orientation_constraint_.get();
+  if (!jmg_->isChain() ||
+      (pc && !jmg_->isLinkUpdated(pc->getLinkModel()->getName())) ||
+      (oc && !jmg_->isLinkUpdated(oc->getLinkModel()->getName())))
+    return false;
+
+  // damping of the pseudoinverse, so steps stay small near singularities
+  static const double DAMPING = 1e-2;
+  Eigen::MatrixXd jac, tmp;
+  Eigen::VectorXd error(6);
+  std::vector<double> values;
+  for (unsigned int it = 0 ; ; ++it)
+  {
+    state.update();
+    bool pos_ok = !pc || pc->decide(state).satisfied;
+    bool rot_ok = !oc || oc->decide(state).satisfied;
+    if (pos_ok && rot_ok)
+    {
+      if (!group_state_validity_callback_)
+        return true;
+      state.copyJointGroupPositions(jmg_, values);
+      return group_state_validity_callback_(&state, jmg_, &values[0]);
+    }
+    if (it >= local_projection_iterations_)
+      return false;
+
+    // the error of the constrained link, towards the center of the closest region and the desired orientation;
+    // the satisfied parts of the constraints get a zero error, so they are kept
+    jac = Eigen::MatrixXd::Zero(6, jmg_->getVariableCount());
+    error.setZero();
+    if (pc)
+    {
+      if (!computeModelFrameJacobian(state, jmg_, pc->getLinkModel(), pc->getLinkOffset(), tmp))
+        return false;
+      jac.topRows(3) = tmp.topRows(3);
+      if (!pos_ok)
+      {
+        Eigen::Vector3d pt = state.getGlobalLinkTransform(pc->getLinkModel()) * pc->getLinkOffset();
+        const std::vector<bodies::BodyPtr> &b = pc->getConstraintRegions();
+        Eigen::Affine3d frame = pc->mobileReferenceFrame() ? state.getFrameTransform(pc->getReferenceFrame()) : Eigen::Affine3d::Identity();
+        double best = std::numeric_limits<double>::infinity();
+        for (std::size_t i = 0 ; i < b.size() ; ++i)
+        {
+          Eigen::Vector3d e = frame * b[i]->getPose().translation() - pt;
+          if (e.squaredNorm() < best)
+          {
+            best = e.squaredNorm();
+            error.head<3>() = e;
+          }
+        }
+      }
+    }
+    if (oc)
+    {
+      if (!computeModelFrameJacobian(state, jmg_, oc->getLinkModel(), Eigen::Vector3d(0.0, 0.0, 0.0), tmp))
+        return false;
+      jac.bottomRows(3) = tmp.bottomRows(3);
+      if (!rot_ok)
+      {
+        Eigen::Matrix3d desired = oc->getDesiredRotationMatrix();
+        if (oc->mobileReferenceFrame())
+          desired = state.getFrameTransform(oc->getReferenceFrame()).rotation() * desired;
+        Eigen::AngleAxisd aa(desired * state.getGlobalLinkTransform(oc->getLinkModel()).rotation().transpose());
+        error.tail<3>() = aa.angle() * aa.axis();
+      }
+    }
+
+    // damped least squares step: dq = J^T (J J^T + l^2 I)^-1 e
+    Eigen::MatrixXd jjt = jac * jac.transpose();
+    jjt.diagonal().array() += DAMPING * DAMPING;
+    Eigen::VectorXd step = jac.transpose() * jjt.ldlt().solve(error);
+    if (step.squaredNorm() < std::numeric_limits<double>::epsilon())
+      return false;
+    state.copyJointGroupPositions(jmg_, values);
+    for (std::size_t i = 0 ; i < values.size() ; ++i)
+      values[i] += step(i);
+    state.setJointGroupPositions(jmg_, values);
+    state.enforceBounds(jmg_);
+  }
+}
+
+struct constraint_samplers::IKConstraintSampler::BatchData
+{
+  BatchData() : found_(0), attempts_left_(0), stop_(false)
+  {
+  }
+
+  const robot_state::RobotState *reference_state_;
+  std::vector<robot_state::RobotStatePtr> *states_;
+  const SampleCallbackFn *callback_;
+  std::size_t count_;
+  unsigned int max_attempts_;
+
+  boost::mutex lock_;
+  std::size_t found_;
+  std::size_t attempts_left_;
+  bool stop_;
+};
+
+std::size_t constraint_samplers::IKConstraintSampler::sampleBatch(std::vector<robot_state::RobotStatePtr> &states,
+                                                                  const robot_state::RobotState &reference_state,
+                                                                  std::size_t count, unsigned int threads, unsigned int max_attempts,
+                                                                  const SampleCallbackFn &callback)
+{
+  states.clear();
+  if (!is_valid_ || count == 0 || max_attempts == 0)
+    return 0;
+
+  // the reference state is shared by all threads, so its transforms need to be up to date
+  robot_state::RobotState reference(reference_state);
+  reference.update();
+  if (!isRegionReachable(reference))
+  {
+    if (verbose_)
+      logInform("The position constraint region is outside the workspace reachable by group '%s'", jmg_->getName().c_str());
+    return 0;
+  }
+
+  BatchData data;
+  data.reference_state_ = &reference;
+  data.states_ = &states;
+  data.callback_ = &callback;
+  data.count_ = count;
+  data.max_attempts_ = max_attempts;
+  data.attempts_left_ = count * max_attempts;
+
+  // the first thread uses an instance leased from the pool of the group; the others lease more instances
+  // if they are available, and get new instances otherwise
+  threads = std::max(1u, threads);
+  if (count * max_attempts < threads)
+    threads = count * max_attempts;
+  // the threads come from the shared pool; their solver instances are leased from the pool of the group, which grows
+  // as needed, so the instances are allocated once and reused by later calls
+  moveit::tools::ThreadPool &pool = moveit::tools::ThreadPool::Instance();
+  threads = std::min(threads, pool.getThreadCount());
+  kinematics::KinematicsBaseConstPtr lease = jmg_->acquireSolverInstance();
+  std::vector<kinematics::KinematicsBaseConstPtr> solvers(1, lease ? lease : kb_);
+  const robot_model::SolverAllocatorFn &allocator = jmg_->getGroupKinematics().first.allocator_;
+  if (threads > 1 && (!allocator || !lease))
+    logWarn("No solver allocator for group '%s'. Sampling with one thread.", jmg_->getName().c_str());
+  else if (threads > 1)
+  {
+    std::vector<unsigned int> red_joints;
+    kb_->getRedundantJoints(red_joints);
+    jmg_->getSolverInstancePool()->tryAcquire(threads, red_joints, solvers);
+    if (solvers.size() < threads)
+      logDebug("Only %u kinematics solver instances are available for group '%s'. Sampling with %u threads.",
+               (unsigned int)solvers.size(), jmg_->getName().c_str(), (unsigned int)solvers.size());
+  }
+
+  // the seeds are drawn before the threads start, so the samples of each thread are reproducible
+  std::vector<boost::uint32_t> seeds(solvers.size());
+  for (std::size_t t = 0 ; t < seeds.size() ; ++t)
+    seeds[t] = random_number_generator_.uniformInteger(0, std::numeric_limits<int>::max());
+
+  pool.parallelFor(0, solvers.size(), boost::bind(&IKConstraintSampler::sampleBatchWorker, this, &data, &solvers, &seeds, _1));
+
+  return states.size();
+}
+
+void constraint_samplers::IKConstraintSampler::sampleBatchWorker(BatchData *data, const std::vector<kinematics::KinematicsBaseConstPtr> *solvers,
+                                                                 const std::vector<boost::uint32_t> *seeds, std::size_t thread) const
+{
+  const kinematics::KinematicsBase *solver = (*solvers)[thread].get();
+  boost::uint32_t seed = (*seeds)[thread];
+  random_numbers::RandomNumberGenerator rng(seed);
+  robot_model::QuasiRandomSequencePtr sequence;
+  if (use_quasi_random_)
+    sequence.reset(new robot_model::QuasiRandomSequence(quasi_random_type_, 6, seed));
+  robot_state::RobotStatePtr state(new robot_state::RobotState(*data->reference_state_));
+
+  kinematics::KinematicsBase::IKCallbackFn adapted_ik_validity_callback;
+  if (group_state_validity_callback_)
+    adapted_ik_validity_callback = boost::bind(&samplingIkCallbackFnAdapter, state.get(), jmg_, group_state_validity_callback_, _1, _2, _3);
+
+  while (true)
+  {
+    {
+      boost::mutex::scoped_lock slock(data->lock_);
+      if (data->stop_ || data->found_ >= data->count_ || data->attempts_left_ == 0)
+        break;
+      data->attempts_left_--;
+    }
+
+    Eigen::Vector3d point;
+    Eigen::Quaterniond quat;
+    if (!samplePose(point, quat, *data->reference_state_, data->max_attempts_, rng, sequence.get()))
+    {
+      if (verbose_)
+        logInform("IK constraint sampler was unable to produce a pose to run IK for");
+      boost::mutex::scoped_lock slock(data->lock_);
+      data->stop_ = true;
+      break;
+    }
+
+    geometry_msgs::Pose ik_query;
+    ik_query.position.x = point.x();
+    ik_query.position.y = point.y();
+    ik_query.position.z = point.z();
+    ik_query.orientation.x = quat.x();
+    ik_query.orientation.y = quat.y();
+    ik_query.orientation.z = quat.z();
+    ik_query.orientation.w = quat.w();
+
+    if (!callIK(ik_query, adapted_ik_validity_callback, ik_timeout_, *state, false, *solver, rng))
+      continue;
+
+    state->update();
+    boost::mutex::scoped_lock slock(data->lock_);
+    if (data->stop_ || data->found_ >= data->count_)
+      break;
+    data->found_++;
+    data->states_->push_back(state);
+    if (*data->callback_ && !(*data->callback_)(*state))
+      data->stop_ = true;
+    slock.unlock();
+
+    // the state that was found is now owned by the caller
+    state.reset(new robot_state::RobotState(*data->reference_state_));
+    if (group_state_validity_callback_)
+      adapted_ik_validity_callback = boost::bind(&samplingIkCallbackFnAdapter, state.get(), jmg_, group_state_validity_callback_, _1, _2, _3);
+  }
+}
+
 bool constraint_samplers::IKConstraintSampler::validate(robot_state::RobotState &state) const
 {
   state.update();
@@ -539,6 +962,15 @@ bool constraint_samplers::IKConstraintSampler::validate(robot_state::RobotState
 
 bool constraint_samplers::IKConstraintSampler::callIK(const geometry_msgs::Pose &ik_query, const kinematics::KinematicsBase::IKCallbackFn &adapted_ik_validity_callback,
                                                       double timeout, robot_state::RobotState &state, bool use_as_seed)
+{
+  // the solver is leased, so samplers for the same group can be used from different threads
+  kinematics::KinematicsBasePtr solver = jmg_->acquireSolverInstance();
+  return callIK(ik_query, adapted_ik_validity_callback, timeout, state, use_as_seed, solver ? *solver : *kb_, random_number_generator_);
+}
+
+bool constraint_samplers::IKConstraintSampler::callIK(const geometry_msgs::Pose &ik_query, const kinematics::KinematicsBase::IKCallbackFn &adapted_ik_validity_callback,
+                                                      double timeout, robot_state::RobotState &state, bool use_as_seed,
+                                                      const kinematics::KinematicsBase &solver, random_numbers::RandomNumberGenerator &rng) const
 {
   const std::vector<unsigned int>& ik_joint_bijection = jmg_->getKinematicsSolverJointBijection();
   std::vector<double> seed(ik_joint_bijection.size(), 0.0);
@@ -548,7 +980,7 @@ bool constraint_samplers::IKConstraintSampler::callIK(const geometry_msgs::Pose
     state.copyJointGroupPositions(jmg_, vals);
   else
     // sample a seed value
-    jmg_->getVariableRandomPositions(random_number_generator_, vals);
+    jmg_->getVariableRandomPositions(rng, vals);
 
   assert(vals.size() == ik_joint_bijection.size());
   for (std::size_t i = 0 ; i < ik_joint_bijection.size() ; ++i)
@@ -558,8 +990,8 @@ bool constraint_samplers::IKConstraintSampler::callIK(const geometry_msgs::Pose
   moveit_msgs::MoveItErrorCodes error;
 
   if (adapted_ik_validity_callback ?
-      kb_->searchPositionIK(ik_query, seed, timeout, ik_sol, adapted_ik_validity_callback, error) :
-      kb_->searchPositionIK(ik_query, seed, timeout, ik_sol, error))
+      solver.searchPositionIK(ik_query, seed, timeout, ik_sol, adapted_ik_validity_callback, error) :
+      solver.searchPositionIK(ik_query, seed, timeout, ik_sol, error))
   {
     assert(ik_sol.size() == ik_joint_bijection.size());
     std::vector<double> solution(ik_joint_bijection.size());
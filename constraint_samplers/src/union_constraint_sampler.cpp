@@ -36,7 +36,9 @@
 
 #include <moveit/constraint_samplers/union_constraint_sampler.h>
 #include <moveit/constraint_samplers/default_constraint_samplers.h>
+#include <ros/time.h>
 #include <algorithm>
+#include <limits>
 
 namespace constraint_samplers
 {
@@ -107,7 +109,8 @@ struct OrderSamplers
 
 constraint_samplers::UnionConstraintSampler::UnionConstraintSampler(const planning_scene::PlanningSceneConstPtr &scene, const std::string &group_name,
                                                                     const std::vector<ConstraintSamplerPtr> &samplers) :
-  ConstraintSampler(scene, group_name), samplers_(samplers)
+  ConstraintSampler(scene, group_name), samplers_(samplers),
+  adaptive_(false), reorder_period_(32), samples_since_reorder_(0)
 {
   // using stable sort to preserve order of equivalents
   std::stable_sort(samplers_.begin(), samplers_.end(), OrderSamplers());
@@ -122,21 +125,115 @@ constraint_samplers::UnionConstraintSampler::UnionConstraintSampler(const planni
   }
 }
 
+void constraint_samplers::UnionConstraintSampler::setAdaptive(bool flag, unsigned int reorder_period)
+{
+  adaptive_ = flag;
+  reorder_period_ = std::max(1u, reorder_period);
+  resetStatistics();
+}
+
+void constraint_samplers::UnionConstraintSampler::resetStatistics()
+{
+  statistics_.clear();
+  statistics_.resize(samplers_.size());
+  samples_since_reorder_ = 0;
+}
+
+bool constraint_samplers::UnionConstraintSampler::canSwap(std::size_t i) const
+{
+  const robot_model::JointModelGroup *a = samplers_[i]->getJointModelGroup();
+  const robot_model::JointModelGroup *b = samplers_[i + 1]->getJointModelGroup();
+
+  // the samplers must not overwrite each other's values
+  const std::vector<std::string> &blinks = b->getUpdatedLinkModelNames();
+  for (std::size_t j = 0 ; j < blinks.size() ; ++j)
+    if (a->isLinkUpdated(blinks[j]))
+      return false;
+
+  // and neither may depend on a frame the other one moves
+  const std::vector<std::string> &fda = samplers_[i]->getFrameDependency();
+  for (std::size_t j = 0 ; j < fda.size() ; ++j)
+    if (b->isLinkUpdated(fda[j]))
+      return false;
+  const std::vector<std::string> &fdb = samplers_[i + 1]->getFrameDependency();
+  for (std::size_t j = 0 ; j < fdb.size() ; ++j)
+    if (a->isLinkUpdated(fdb[j]))
+      return false;
+  return true;
+}
+
+namespace
+{
+// the expected time spent in a sampler for each sample it rejects; running samplers in increasing order of this value
+// minimizes the expected time until a sample is rejected
+double timePerRejection(const constraint_samplers::UnionConstraintSampler::SamplerStatistics &stats)
+{
+  double failure_rate = 1.0 - stats.getSuccessRate();
+  return failure_rate > 0.0 ? stats.getAverageTime() / failure_rate : std::numeric_limits<double>::infinity();
+}
+}
+
+void constraint_samplers::UnionConstraintSampler::reorder()
+{
+  // a single pass of bubble sort: the order adapts gradually, and only neighbours that do not depend on each other move
+  for (std::size_t i = 0 ; i + 1 < samplers_.size() ; ++i)
+    if (timePerRejection(statistics_[i + 1]) < timePerRejection(statistics_[i]) && canSwap(i))
+    {
+      logDebug("Union sampler for group '%s' now samples group '%s' before group '%s'", jmg_->getName().c_str(),
+               samplers_[i + 1]->getJointModelGroup()->getName().c_str(), samplers_[i]->getJointModelGroup()->getName().c_str());
+      std::swap(samplers_[i], samplers_[i + 1]);
+      std::swap(statistics_[i], statistics_[i + 1]);
+    }
+}
+
 bool constraint_samplers::UnionConstraintSampler::sample(robot_state::RobotState &state, const robot_state::RobotState &reference_state, unsigned int max_attempts)
 {
   state = reference_state;
   state.setToRandomPositions(jmg_);
-  
-  if (samplers_.size() >= 1)
+
+  if (!adaptive_)
   {
-    if (!samplers_[0]->sample(state, reference_state, max_attempts))
-      return false;
+    if (samplers_.size() >= 1)
+    {
+      if (!samplers_[0]->sample(state, reference_state, max_attempts))
+        return false;
+    }
+
+    for (std::size_t i = 1 ; i < samplers_.size() ; ++i)
+      if (!samplers_[i]->sample(state, state, max_attempts))
+        return false;
+
+    return true;
   }
-  
-  for (std::size_t i = 1 ; i < samplers_.size() ; ++i)
-    if (!samplers_[i]->sample(state, state, max_attempts))
+
+  if (statistics_.size() != samplers_.size())
+    resetStatistics();
+  if (++samples_since_reorder_ >= reorder_period_)
+  {
+    reorder();
+    samples_since_reorder_ = 0;
+  }
+
+  std::vector<double> values;
+  for (std::size_t i = 0 ; i < samplers_.size() ; ++i)
+  {
+    ros::WallTime start = ros::WallTime::now();
+    bool valid = samplers_[i]->sample(state, i == 0 ? reference_state : state, max_attempts);
+    if (valid && group_state_validity_callback_)
+    {
+      // reject states that are already invalid before running the remaining samplers
+      const robot_model::JointModelGroup *jmg = samplers_[i]->getJointModelGroup();
+      state.copyJointGroupPositions(jmg, values);
+      valid = group_state_validity_callback_(&state, jmg, values.empty() ? NULL : &values[0]);
+    }
+    SamplerStatistics &stats = statistics_[i];
+    stats.attempts_++;
+    stats.time_ += (ros::WallTime::now() - start).toSec();
+    if (!valid)
       return false;
-  
+    stats.successes_++;
+  }
+
   return true;
 }
 
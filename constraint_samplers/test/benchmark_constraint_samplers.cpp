@@ -0,0 +1,349 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2013, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+// Measures the throughput of the default constraint samplers on the PR2 model, for constraints of increasing
+// tightness. For every sampler and tightness level one CSV line is printed, reporting the number of valid samples
+// produced per second, the mean number of sampling attempts per valid sample and the number of IK calls made.
+//
+// Usage: benchmark_constraint_samplers [samples_per_case] [output_file]
+
+#include <moveit/test_resources/config.h>
+#include <moveit/planning_scene/planning_scene.h>
+#include <moveit/kinematic_constraints/kinematic_constraint.h>
+#include <moveit/constraint_samplers/default_constraint_samplers.h>
+#include <moveit/constraint_samplers/union_constraint_sampler.h>
+#include <urdf_parser/urdf_parser.h>
+#include <ros/time.h>
+#include <boost/bind.hpp>
+#include <boost/filesystem/path.hpp>
+#include <boost/lexical_cast.hpp>
+#include <fstream>
+#include <iostream>
+#include <cstdio>
+
+#include "pr2_arm_kinematics_plugin.h"
+
+namespace
+{
+
+// Forwards IK requests to the PR2 arm solver and counts them
+class CountingKinematicsPlugin : public pr2_arm_kinematics::PR2ArmKinematicsPlugin
+{
+public:
+
+  CountingKinematicsPlugin() : calls_(0)
+  {
+  }
+
+  virtual bool searchPositionIK(const geometry_msgs::Pose &ik_pose,
+                                const std::vector<double> &ik_seed_state,
+                                double timeout,
+                                std::vector<double> &solution,
+                                moveit_msgs::MoveItErrorCodes &error_code,
+                                const kinematics::KinematicsQueryOptions &options = kinematics::KinematicsQueryOptions()) const
+  {
+    ++calls_;
+    return pr2_arm_kinematics::PR2ArmKinematicsPlugin::searchPositionIK(ik_pose, ik_seed_state, timeout, solution, error_code, options);
+  }
+
+  virtual bool searchPositionIK(const geometry_msgs::Pose &ik_pose,
+                                const std::vector<double> &ik_seed_state,
+                                double timeout,
+                                std::vector<double> &solution,
+                                const IKCallbackFn &solution_callback,
+                                moveit_msgs::MoveItErrorCodes &error_code,
+                                const kinematics::KinematicsQueryOptions &options = kinematics::KinematicsQueryOptions()) const
+  {
+    ++calls_;
+    return pr2_arm_kinematics::PR2ArmKinematicsPlugin::searchPositionIK(ik_pose, ik_seed_state, timeout, solution, solution_callback, error_code, options);
+  }
+
+  std::size_t getCallCount() const
+  {
+    return calls_;
+  }
+
+  void resetCallCount()
+  {
+    calls_ = 0;
+  }
+
+private:
+
+  mutable std::size_t calls_;
+};
+
+typedef boost::shared_ptr<CountingKinematicsPlugin> CountingKinematicsPluginPtr;
+
+kinematics::KinematicsBasePtr getSolver(const kinematics::KinematicsBasePtr &solver, const robot_model::JointModelGroup *jmg)
+{
+  return solver;
+}
+
+struct Tightness
+{
+  const char *name_;
+  double joint_tolerance_;
+  double position_radius_;
+  double orientation_tolerance_;
+};
+
+const Tightness TIGHTNESS_LEVELS[] = { { "loose", 0.5, 0.2, 0.8 },
+                                       { "medium", 0.1, 0.05, 0.2 },
+                                       { "tight", 0.01, 0.005, 0.02 } };
+
+struct BenchmarkCase
+{
+  std::string name_;
+  constraint_samplers::ConstraintSamplerPtr sampler_;
+  kinematic_constraints::KinematicConstraintSetPtr constraints_;
+};
+
+moveit_msgs::JointConstraint makeJointConstraint(const std::string &joint, double position, double tolerance)
+{
+  moveit_msgs::JointConstraint jcm;
+  jcm.joint_name = joint;
+  jcm.position = position;
+  jcm.tolerance_above = tolerance;
+  jcm.tolerance_below = tolerance;
+  jcm.weight = 1.0;
+  return jcm;
+}
+
+moveit_msgs::PositionConstraint makePositionConstraint(const std::string &frame, const std::string &link, double radius)
+{
+  moveit_msgs::PositionConstraint pcm;
+  pcm.header.frame_id = frame;
+  pcm.link_name = link;
+  pcm.constraint_region.primitives.resize(1);
+  pcm.constraint_region.primitives[0].type = shape_msgs::SolidPrimitive::SPHERE;
+  pcm.constraint_region.primitives[0].dimensions.resize(1);
+  pcm.constraint_region.primitives[0].dimensions[0] = radius;
+  pcm.constraint_region.primitive_poses.resize(1);
+  pcm.constraint_region.primitive_poses[0].position.x = 0.55;
+  pcm.constraint_region.primitive_poses[0].position.y = 0.2;
+  pcm.constraint_region.primitive_poses[0].position.z = 1.25;
+  pcm.constraint_region.primitive_poses[0].orientation.w = 1.0;
+  pcm.weight = 1.0;
+  return pcm;
+}
+
+moveit_msgs::OrientationConstraint makeOrientationConstraint(const std::string &frame, const std::string &link, double tolerance)
+{
+  moveit_msgs::OrientationConstraint ocm;
+  ocm.header.frame_id = frame;
+  ocm.link_name = link;
+  ocm.orientation.w = 1.0;
+  ocm.absolute_x_axis_tolerance = tolerance;
+  ocm.absolute_y_axis_tolerance = tolerance;
+  ocm.absolute_z_axis_tolerance = tolerance;
+  ocm.weight = 1.0;
+  return ocm;
+}
+
+void makeCases(const planning_scene::PlanningScenePtr &scene, const Tightness &level, std::vector<BenchmarkCase> &cases)
+{
+  const robot_model::RobotModelConstPtr &model = scene->getRobotModel();
+  const robot_state::Transforms &tf = scene->getTransforms();
+  const std::string &frame = model->getModelFrame();
+
+  robot_state::RobotState default_state(model);
+  default_state.setToDefaultValues();
+
+  moveit_msgs::Constraints joint_constr;
+  const std::vector<std::string> &joints = model->getJointModelGroup("right_arm")->getActiveJointModelNames();
+  for (std::size_t i = 0 ; i < joints.size() ; ++i)
+    joint_constr.joint_constraints.push_back(makeJointConstraint(joints[i], default_state.getVariablePosition(joints[i]), level.joint_tolerance_));
+  moveit_msgs::PositionConstraint pcm = makePositionConstraint(frame, "l_wrist_roll_link", level.position_radius_);
+  moveit_msgs::OrientationConstraint ocm = makeOrientationConstraint(frame, "l_wrist_roll_link", level.orientation_tolerance_);
+
+  kinematic_constraints::PositionConstraint pc(model);
+  kinematic_constraints::OrientationConstraint oc(model);
+  pc.configure(pcm, tf);
+  oc.configure(ocm, tf);
+
+  BenchmarkCase c;
+
+  c.name_ = "joint";
+  c.constraints_.reset(new kinematic_constraints::KinematicConstraintSet(model));
+  c.constraints_->add(joint_constr, tf);
+  std::vector<kinematic_constraints::JointConstraint> jcs;
+  for (std::size_t i = 0 ; i < joint_constr.joint_constraints.size() ; ++i)
+  {
+    kinematic_constraints::JointConstraint jc(model);
+    jc.configure(joint_constr.joint_constraints[i]);
+    jcs.push_back(jc);
+  }
+  boost::shared_ptr<constraint_samplers::JointConstraintSampler> jsampler(new constraint_samplers::JointConstraintSampler(scene, "right_arm"));
+  jsampler->configure(jcs);
+  c.sampler_ = jsampler;
+  cases.push_back(c);
+
+  moveit_msgs::Constraints pos_constr;
+  pos_constr.position_constraints.push_back(pcm);
+  c.name_ = "position";
+  c.constraints_.reset(new kinematic_constraints::KinematicConstraintSet(model));
+  c.constraints_->add(pos_constr, tf);
+  boost::shared_ptr<constraint_samplers::IKConstraintSampler> psampler(new constraint_samplers::IKConstraintSampler(scene, "left_arm"));
+  psampler->configure(constraint_samplers::IKSamplingPose(pc));
+  c.sampler_ = psampler;
+  cases.push_back(c);
+
+  moveit_msgs::Constraints orient_constr;
+  orient_constr.orientation_constraints.push_back(ocm);
+  c.name_ = "orientation";
+  c.constraints_.reset(new kinematic_constraints::KinematicConstraintSet(model));
+  c.constraints_->add(orient_constr, tf);
+  boost::shared_ptr<constraint_samplers::IKConstraintSampler> osampler(new constraint_samplers::IKConstraintSampler(scene, "left_arm"));
+  osampler->configure(constraint_samplers::IKSamplingPose(oc));
+  c.sampler_ = osampler;
+  cases.push_back(c);
+
+  moveit_msgs::Constraints pose_constr = pos_constr;
+  pose_constr.orientation_constraints.push_back(ocm);
+  c.name_ = "pose";
+  c.constraints_.reset(new kinematic_constraints::KinematicConstraintSet(model));
+  c.constraints_->add(pose_constr, tf);
+  boost::shared_ptr<constraint_samplers::IKConstraintSampler> posesampler(new constraint_samplers::IKConstraintSampler(scene, "left_arm"));
+  posesampler->configure(constraint_samplers::IKSamplingPose(pc, oc));
+  c.sampler_ = posesampler;
+  cases.push_back(c);
+
+  // the torso is constrained by a joint sampler for the whole group, the left arm by an IK sampler
+  moveit_msgs::Constraints union_constr = pose_constr;
+  union_constr.joint_constraints.push_back(makeJointConstraint("torso_lift_joint", default_state.getVariablePosition("torso_lift_joint"),
+                                                               level.joint_tolerance_ * 0.1));
+  c.name_ = "union";
+  c.constraints_.reset(new kinematic_constraints::KinematicConstraintSet(model));
+  c.constraints_->add(union_constr, tf);
+  kinematic_constraints::JointConstraint torso(model);
+  torso.configure(union_constr.joint_constraints[0]);
+  boost::shared_ptr<constraint_samplers::JointConstraintSampler> tsampler(new constraint_samplers::JointConstraintSampler(scene, "arms_and_torso"));
+  tsampler->configure(std::vector<kinematic_constraints::JointConstraint>(1, torso));
+  boost::shared_ptr<constraint_samplers::IKConstraintSampler> usampler(new constraint_samplers::IKConstraintSampler(scene, "left_arm"));
+  usampler->configure(constraint_samplers::IKSamplingPose(pc, oc));
+  std::vector<constraint_samplers::ConstraintSamplerPtr> samplers;
+  samplers.push_back(tsampler);
+  samplers.push_back(usampler);
+  c.sampler_.reset(new constraint_samplers::UnionConstraintSampler(scene, "arms_and_torso", samplers));
+  cases.push_back(c);
+}
+
+}
+
+int main(int argc, char **argv)
+{
+  std::size_t samples = 200;
+  if (argc > 1)
+    samples = boost::lexical_cast<std::size_t>(argv[1]);
+  std::ofstream output_file;
+  if (argc > 2)
+  {
+    output_file.open(argv[2]);
+    if (!output_file.good())
+    {
+      std::cerr << "Unable to open '" << argv[2] << "' for writing" << std::endl;
+      return 1;
+    }
+  }
+  std::ostream &out = output_file.is_open() ? static_cast<std::ostream&>(output_file) : std::cout;
+
+  boost::shared_ptr<urdf::ModelInterface> urdf_model;
+  std::ifstream xml_file((boost::filesystem::path(MOVEIT_TEST_RESOURCES_DIR) / "urdf/robot.xml").string().c_str());
+  std::string xml_string((std::istreambuf_iterator<char>(xml_file)), std::istreambuf_iterator<char>());
+  urdf_model = urdf::parseURDF(xml_string);
+  if (!urdf_model)
+  {
+    std::cerr << "Unable to load the PR2 URDF from " << MOVEIT_TEST_RESOURCES_DIR << std::endl;
+    return 1;
+  }
+  boost::shared_ptr<srdf::Model> srdf_model(new srdf::Model());
+  srdf_model->initFile(*urdf_model, (boost::filesystem::path(MOVEIT_TEST_RESOURCES_DIR) / "srdf/robot.xml").string());
+  robot_model::RobotModelPtr model(new robot_model::RobotModel(urdf_model, srdf_model));
+
+  CountingKinematicsPluginPtr right_arm(new CountingKinematicsPlugin());
+  right_arm->setRobotModel(urdf_model);
+  right_arm->initialize("", "right_arm", "torso_lift_link", "r_wrist_roll_link", .01);
+  CountingKinematicsPluginPtr left_arm(new CountingKinematicsPlugin());
+  left_arm->setRobotModel(urdf_model);
+  left_arm->initialize("", "left_arm", "torso_lift_link", "l_wrist_roll_link", .01);
+
+  std::map<std::string, robot_model::SolverAllocatorFn> allocators;
+  allocators["right_arm"] = boost::bind(&getSolver, kinematics::KinematicsBasePtr(right_arm), _1);
+  allocators["left_arm"] = boost::bind(&getSolver, kinematics::KinematicsBasePtr(left_arm), _1);
+  model->setKinematicsAllocators(allocators);
+
+  planning_scene::PlanningScenePtr scene(new planning_scene::PlanningScene(model));
+
+  out << "sampler,group,tightness,attempts,samples,valid_samples,time,valid_samples_per_second,attempts_per_success,ik_calls" << std::endl;
+  for (std::size_t l = 0 ; l < sizeof(TIGHTNESS_LEVELS) / sizeof(TIGHTNESS_LEVELS[0]) ; ++l)
+  {
+    std::vector<BenchmarkCase> cases;
+    makeCases(scene, TIGHTNESS_LEVELS[l], cases);
+    for (std::size_t c = 0 ; c < cases.size() ; ++c)
+    {
+      robot_state::RobotState state(model);
+      state.setToDefaultValues();
+      state.update();
+      const robot_state::RobotState reference(state);
+
+      // every call to sample() is allowed a single attempt, so the number of calls is the number of attempts
+      right_arm->resetCallCount();
+      left_arm->resetCallCount();
+      std::size_t attempts = 0, successes = 0, valid = 0;
+      ros::WallTime start = ros::WallTime::now();
+      while (successes < samples && attempts < samples * 100)
+      {
+        ++attempts;
+        if (cases[c].sampler_->sample(state, reference, 1))
+        {
+          ++successes;
+          state.update();
+          if (cases[c].constraints_->decide(state).satisfied)
+            ++valid;
+        }
+      }
+      double duration = (ros::WallTime::now() - start).toSec();
+
+      char line[512];
+      snprintf(line, sizeof(line), "%s,%s,%s,%u,%u,%u,%lf,%lf,%lf,%u", cases[c].name_.c_str(), cases[c].sampler_->getGroupName().c_str(),
+               TIGHTNESS_LEVELS[l].name_, (unsigned int)attempts, (unsigned int)successes, (unsigned int)valid, duration,
+               duration > 0.0 ? valid / duration : 0.0, valid > 0 ? (double)attempts / (double)valid : 0.0,
+               (unsigned int)(right_arm->getCallCount() + left_arm->getCallCount()));
+      out << line << std::endl;
+    }
+  }
+
+  return 0;
+}
@@ -52,6 +52,7 @@
 #include <fstream>
 #include <boost/bind.hpp>
 #include <boost/filesystem/path.hpp>
+#include <boost/thread.hpp>
 
 #include "pr2_arm_kinematics_plugin.h"
 
@@ -283,6 +284,52 @@ TEST_F(LoadPlanningModelsPr2, JointConstraintsSamplerSimple)
   }
 }
 
+TEST_F(LoadPlanningModelsPr2, JointConstraintsSamplerQuasiRandom)
+{
+  robot_state::RobotState ks(kmodel);
+  ks.setToDefaultValues();
+
+  kinematic_constraints::JointConstraint jc(kmodel);
+  moveit_msgs::JointConstraint jcm;
+  jcm.joint_name = "r_shoulder_pan_joint";
+  jcm.position = 0.42;
+  jcm.tolerance_above = 0.01;
+  jcm.tolerance_below = 0.05;
+  jcm.weight = 1.0;
+  EXPECT_TRUE(jc.configure(jcm));
+  std::vector<kinematic_constraints::JointConstraint> js;
+  js.push_back(jc);
+
+  constraint_samplers::JointConstraintSampler jcs1(ps, "right_arm");
+  constraint_samplers::JointConstraintSampler jcs2(ps, "right_arm");
+  jcs1.setQuasiRandomSequence(robot_model::QuasiRandomSequence::SOBOL, 5);
+  jcs2.setQuasiRandomSequence(robot_model::QuasiRandomSequence::SOBOL, 5);
+  EXPECT_TRUE(jcs1.configure(js));
+  EXPECT_TRUE(jcs2.configure(js));
+
+  // the same sequence gives the same samples, and they satisfy the constraint
+  robot_state::RobotState ks2(ks);
+  std::vector<double> v1, v2;
+  for (int t = 0 ; t < 100 ; ++t)
+  {
+    EXPECT_TRUE(jcs1.sample(ks, ks, 1));
+    EXPECT_TRUE(jcs2.sample(ks2, ks2, 1));
+    EXPECT_TRUE(jc.decide(ks).satisfied);
+    ks.copyJointGroupPositions("right_arm", v1);
+    ks2.copyJointGroupPositions("right_arm", v2);
+    for (std::size_t i = 0 ; i < v1.size() ; ++i)
+      EXPECT_EQ(v1[i], v2[i]);
+  }
+
+  // a state of the whole group can be set from a sequence as well
+  const robot_model::JointModelGroup *jmg = kmodel->getJointModelGroup("right_arm");
+  robot_model::QuasiRandomSequence seq(robot_model::QuasiRandomSequence::HALTON, jmg->getUnitSampleDimension());
+  EXPECT_TRUE(ks.setToQuasiRandomPositions(jmg, seq));
+  EXPECT_TRUE(ks.satisfiesBounds(jmg));
+  robot_model::QuasiRandomSequence wrong(robot_model::QuasiRandomSequence::HALTON, jmg->getUnitSampleDimension() + 1);
+  EXPECT_FALSE(ks.setToQuasiRandomPositions(jmg, wrong));
+}
+
 TEST_F(LoadPlanningModelsPr2, IKConstraintsSamplerSimple)
 {
   robot_state::RobotState ks(kmodel);
@@ -350,6 +397,139 @@ TEST_F(LoadPlanningModelsPr2, IKConstraintsSamplerSimple)
 }
 
 
+TEST_F(LoadPlanningModelsPr2, IKConstraintsSamplerReachabilityMap)
+{
+  robot_state::RobotState ks(kmodel);
+  ks.setToDefaultValues();
+  ks.update();
+  robot_state::Transforms &tf = ps->getTransformsNonConst();
+
+  robot_model::JointModelGroup *jmg = kmodel->getJointModelGroup("left_arm");
+  robot_model::ReachabilityMapPtr map(new robot_model::ReachabilityMap("torso_lift_link", "l_wrist_roll_link", 0.1));
+  EXPECT_EQ(5000u, ks.addToReachabilityMap(jmg, *map, 5000));
+  EXPECT_GT(map->size(), 0u);
+  jmg->setReachabilityMap(map);
+
+  kinematic_constraints::PositionConstraint pc(kmodel);
+  moveit_msgs::PositionConstraint pcm;
+  pcm.header.frame_id = kmodel->getModelFrame();
+  pcm.link_name = "l_wrist_roll_link";
+  pcm.constraint_region.primitives.resize(1);
+  pcm.constraint_region.primitives[0].type = shape_msgs::SolidPrimitive::SPHERE;
+  pcm.constraint_region.primitives[0].dimensions.resize(1);
+  pcm.constraint_region.primitives[0].dimensions[0] = 0.1;
+  pcm.constraint_region.primitive_poses.resize(1);
+  pcm.constraint_region.primitive_poses[0].position.x = 0.55;
+  pcm.constraint_region.primitive_poses[0].position.y = 0.2;
+  pcm.constraint_region.primitive_poses[0].position.z = 1.25;
+  pcm.constraint_region.primitive_poses[0].orientation.w = 1.0;
+  pcm.weight = 1.0;
+  EXPECT_TRUE(pc.configure(pcm, tf));
+
+  constraint_samplers::IKConstraintSampler iks(ps, "left_arm");
+  EXPECT_TRUE(iks.configure(constraint_samplers::IKSamplingPose(pc)));
+  EXPECT_TRUE(iks.getReachabilityMap());
+
+  // the sampled poses are in reachable voxels
+  Eigen::Vector3d pos;
+  Eigen::Quaterniond quat;
+  for (int t = 0 ; t < 20 ; ++t)
+  {
+    ASSERT_TRUE(iks.samplePose(pos, quat, ks, 100));
+    EXPECT_GT(map->getOrientationCount(pos), 0u);
+  }
+
+  // a region out of reach is rejected without calling IK
+  pcm.constraint_region.primitive_poses[0].position.x = 5.0;
+  EXPECT_TRUE(pc.configure(pcm, tf));
+  EXPECT_TRUE(iks.configure(constraint_samplers::IKSamplingPose(pc)));
+  EXPECT_FALSE(iks.sample(ks, ks, 10));
+
+  // a map for other frames is ignored
+  jmg->setReachabilityMap(robot_model::ReachabilityMapPtr(new robot_model::ReachabilityMap("base_link", "l_wrist_roll_link")));
+  EXPECT_TRUE(iks.configure(constraint_samplers::IKSamplingPose(pc)));
+  EXPECT_FALSE(iks.getReachabilityMap());
+  jmg->setReachabilityMap(robot_model::ReachabilityMapConstPtr());
+}
+
+TEST_F(LoadPlanningModelsPr2, ConstraintSamplersProject)
+{
+  robot_state::RobotState ks(kmodel);
+  ks.setToDefaultValues();
+  ks.update();
+  robot_state::Transforms &tf = ps->getTransformsNonConst();
+
+  // joint constraints are projected by clamping the constrained variables only
+  kinematic_constraints::JointConstraint jc(kmodel);
+  moveit_msgs::JointConstraint jcm;
+  jcm.joint_name = "r_elbow_flex_joint";
+  jcm.position = -0.5;
+  jcm.tolerance_above = 0.01;
+  jcm.tolerance_below = 0.01;
+  jcm.weight = 1.0;
+  EXPECT_TRUE(jc.configure(jcm));
+  std::vector<kinematic_constraints::JointConstraint> js(1, jc);
+  constraint_samplers::JointConstraintSampler jcs(ps, "right_arm");
+  EXPECT_TRUE(jcs.configure(js));
+  ks.setVariablePosition("r_elbow_flex_joint", -1.0);
+  double pan = ks.getVariablePosition("r_shoulder_pan_joint");
+  EXPECT_TRUE(jcs.project(ks, 1));
+  EXPECT_TRUE(jc.decide(ks).satisfied);
+  EXPECT_NEAR(-0.51, ks.getVariablePosition("r_elbow_flex_joint"), 1e-9);
+  EXPECT_EQ(pan, ks.getVariablePosition("r_shoulder_pan_joint"));
+
+  // states close to the IK constraints are moved onto them by Jacobian steps
+  moveit_msgs::PositionConstraint pcm;
+  pcm.header.frame_id = kmodel->getModelFrame();
+  pcm.link_name = "l_wrist_roll_link";
+  pcm.constraint_region.primitives.resize(1);
+  pcm.constraint_region.primitives[0].type = shape_msgs::SolidPrimitive::SPHERE;
+  pcm.constraint_region.primitives[0].dimensions.resize(1);
+  pcm.constraint_region.primitives[0].dimensions[0] = 0.01;
+  pcm.constraint_region.primitive_poses.resize(1);
+  pcm.constraint_region.primitive_poses[0].position.x = 0.55;
+  pcm.constraint_region.primitive_poses[0].position.y = 0.2;
+  pcm.constraint_region.primitive_poses[0].position.z = 1.25;
+  pcm.constraint_region.primitive_poses[0].orientation.w = 1.0;
+  pcm.weight = 1.0;
+  moveit_msgs::OrientationConstraint ocm;
+  ocm.header.frame_id = kmodel->getModelFrame();
+  ocm.link_name = "l_wrist_roll_link";
+  ocm.orientation.w = 1.0;
+  ocm.absolute_x_axis_tolerance = 0.1;
+  ocm.absolute_y_axis_tolerance = 0.1;
+  ocm.absolute_z_axis_tolerance = 0.1;
+  ocm.weight = 1.0;
+  kinematic_constraints::PositionConstraint pc(kmodel);
+  EXPECT_TRUE(pc.configure(pcm, tf));
+  kinematic_constraints::OrientationConstraint oc(kmodel);
+  EXPECT_TRUE(oc.configure(ocm, tf));
+
+  constraint_samplers::IKConstraintSampler iks(ps, "left_arm");
+  EXPECT_TRUE(iks.configure(constraint_samplers::IKSamplingPose(pc, oc)));
+  EXPECT_EQ(10u, iks.getLocalProjectionIterations());
+  ASSERT_TRUE(iks.sample(ks, ks, 100));
+  EXPECT_TRUE(pc.decide(ks).satisfied);
+  EXPECT_TRUE(oc.decide(ks).satisfied);
+  std::vector<double> solution;
+  ks.copyJointGroupPositions("left_arm", solution);
+
+  // with IK disabled (no attempts), only the local projection can succeed
+  std::vector<double> values = solution;
+  for (std::size_t i = 0 ; i < values.size() ; ++i)
+    values[i] += (i % 2 ? 0.02 : -0.02);
+  ks.setJointGroupPositions("left_arm", values);
+  ks.enforceBounds(kmodel->getJointModelGroup("left_arm"));
+  ks.update();
+  EXPECT_TRUE(iks.project(ks, 0));
+  EXPECT_TRUE(pc.decide(ks).satisfied);
+  EXPECT_TRUE(oc.decide(ks).satisfied);
+
+  ks.setJointGroupPositions("left_arm", values);
+  iks.setLocalProjectionIterations(0);
+  EXPECT_FALSE(iks.project(ks, 0));
+}
+
 TEST_F(LoadPlanningModelsPr2, OrientationConstraintsSampler)
 {
   robot_state::RobotState ks(kmodel);
@@ -467,6 +647,244 @@ TEST_F(LoadPlanningModelsPr2, IKConstraintsSamplerValid)
   }
 }
 
+static bool countBatchSample(std::size_t *count, std::size_t limit, const robot_state::RobotState &)
+{
+  return ++(*count) < limit;
+}
+
+TEST_F(LoadPlanningModelsPr2, IKConstraintsSamplerBatch)
+{
+  robot_state::RobotState ks(kmodel);
+  ks.setToDefaultValues();
+
+  robot_state::Transforms &tf = ps->getTransformsNonConst();
+
+  kinematic_constraints::PositionConstraint pc(kmodel);
+  moveit_msgs::PositionConstraint pcm;
+  pcm.link_name = "l_wrist_roll_link";
+  pcm.header.frame_id = kmodel->getModelFrame();
+  pcm.constraint_region.primitives.resize(1);
+  pcm.constraint_region.primitives[0].type = shape_msgs::SolidPrimitive::SPHERE;
+  pcm.constraint_region.primitives[0].dimensions.resize(1);
+  pcm.constraint_region.primitives[0].dimensions[0] = 0.001;
+  pcm.constraint_region.primitive_poses.resize(1);
+  pcm.constraint_region.primitive_poses[0].position.x = 0.55;
+  pcm.constraint_region.primitive_poses[0].position.y = 0.2;
+  pcm.constraint_region.primitive_poses[0].position.z = 1.25;
+  pcm.constraint_region.primitive_poses[0].orientation.w = 1.0;
+  pcm.weight = 1.0;
+  EXPECT_TRUE(pc.configure(pcm, tf));
+
+  constraint_samplers::IKConstraintSampler iks(ps, "left_arm");
+  EXPECT_TRUE(iks.configure(constraint_samplers::IKSamplingPose(pc)));
+
+  // the solver allocator of the test returns the same solver instance every time, so only one thread is used
+  std::vector<robot_state::RobotStatePtr> states;
+  EXPECT_EQ(10, iks.sampleBatch(states, ks, 10, 1, 100));
+  ASSERT_EQ(10, states.size());
+  for (std::size_t i = 0 ; i < states.size() ; ++i)
+    EXPECT_TRUE(pc.decide(*states[i]).satisfied);
+  for (std::size_t i = 1 ; i < states.size() ; ++i)
+    EXPECT_NE(states[0].get(), states[i].get());
+
+  // the callback sees every state and can stop sampling
+  std::size_t seen = 0;
+  EXPECT_EQ(3, iks.sampleBatch(states, ks, 10, 1, 100, boost::bind(&countBatchSample, &seen, 3, _1)));
+  EXPECT_EQ(3, seen);
+  EXPECT_EQ(3, states.size());
+}
+
+static kinematics::KinematicsBasePtr allocateLeftArmSolver(const boost::shared_ptr<urdf::ModelInterface> &urdf_model)
+{
+  boost::shared_ptr<pr2_arm_kinematics::PR2ArmKinematicsPlugin> solver(new pr2_arm_kinematics::PR2ArmKinematicsPlugin);
+  solver->setRobotModel(urdf_model);
+  solver->initialize("", "left_arm", "torso_lift_link", "l_wrist_roll_link", .01);
+  return solver;
+}
+
+static void acquireSolver(const robot_model::KinematicsSolverPoolPtr &pool, kinematics::KinematicsBase **acquired)
+{
+  kinematics::KinematicsBasePtr solver = pool->acquire();
+  *acquired = solver.get();
+}
+
+TEST_F(LoadPlanningModelsPr2, SolverInstancePool)
+{
+  robot_model::JointModelGroup *jmg = kmodel->getJointModelGroup("left_arm");
+  EXPECT_EQ(1, jmg->getSolverInstancePoolSize());
+  kinematics::KinematicsBasePtr lease = jmg->acquireSolverInstance();
+  ASSERT_TRUE(lease);
+  EXPECT_EQ(jmg->getSolverInstance().get(), lease.get());
+  EXPECT_FALSE(jmg->tryAcquireSolverInstance());
+
+  // the allocator of the test returns the same instance every time, so the pool cannot grow
+  jmg->setSolverInstancePoolSize(2);
+  EXPECT_FALSE(jmg->tryAcquireSolverInstance());
+  EXPECT_EQ(1, jmg->getSolverInstancePool()->getSize());
+  lease.reset();
+  EXPECT_TRUE(jmg->tryAcquireSolverInstance());
+  EXPECT_EQ(0, jmg->getSolverInstancePool()->getLeasedCount());
+
+  // with an allocator that creates new instances, the pool grows lazily up to its maximum size
+  robot_model::KinematicsSolverPoolPtr pool(new robot_model::KinematicsSolverPool(pr2_kinematics_plugin_left_arm_,
+                                                                                   boost::bind(&allocateLeftArmSolver, urdf_model), 2));
+  EXPECT_EQ(1, pool->getSize());
+  kinematics::KinematicsBasePtr first = pool->acquire();
+  kinematics::KinematicsBasePtr second = pool->acquire();
+  ASSERT_TRUE(first && second);
+  EXPECT_NE(first.get(), second.get());
+  EXPECT_EQ(2, pool->getSize());
+  EXPECT_EQ(2, pool->getLeasedCount());
+  EXPECT_FALSE(pool->tryAcquire());
+
+  // a blocking lease waits for an instance to be returned
+  kinematics::KinematicsBase *acquired = NULL;
+  kinematics::KinematicsBase *expected = second.get();
+  boost::thread waiting(boost::bind(&acquireSolver, pool, &acquired));
+  boost::this_thread::sleep(boost::posix_time::milliseconds(50));
+  EXPECT_TRUE(acquired == NULL);
+  second.reset();
+  waiting.join();
+  EXPECT_EQ(expected, acquired);
+  EXPECT_EQ(1, pool->getLeasedCount());
+
+  pool->setDefaultTimeout(0.2);
+  EXPECT_NEAR(0.2, first->getDefaultTimeout(), 1e-12);
+  EXPECT_NEAR(0.2, expected->getDefaultTimeout(), 1e-12);
+}
+
+// give the left arm an allocator that creates new solver instances, so concurrent IK can use several of them
+static void useLeftArmSolverInstancePool(const robot_model::RobotModelPtr &kmodel, const boost::shared_ptr<urdf::ModelInterface> &urdf_model)
+{
+  std::map<std::string, robot_model::SolverAllocatorFn> allocators;
+  allocators["left_arm"] = boost::bind(&allocateLeftArmSolver, urdf_model);
+  kmodel->setKinematicsAllocators(allocators);
+  kmodel->getJointModelGroup("left_arm")->setSolverInstancePoolSize(4);
+}
+
+// a reachable configuration of the left arm
+static void setLeftArmConfiguration(robot_state::RobotState &state)
+{
+  state.setToDefaultValues();
+  state.setVariablePosition("l_shoulder_pan_joint", 0.5);
+  state.setVariablePosition("l_shoulder_lift_joint", 0.2);
+  state.setVariablePosition("l_upper_arm_roll_joint", 0.5);
+  state.setVariablePosition("l_elbow_flex_joint", -1.0);
+  state.setVariablePosition("l_forearm_roll_joint", 0.3);
+  state.setVariablePosition("l_wrist_flex_joint", -0.5);
+  state.setVariablePosition("l_wrist_roll_joint", 0.2);
+  state.update();
+}
+
+static bool rejectIKSolution(robot_state::RobotState *, const robot_model::JointModelGroup *, const double *)
+{
+  return false;
+}
+
+static double countIKCost(std::size_t *count, boost::mutex *lock, robot_state::RobotState *,
+                          const robot_model::JointModelGroup *, const double *values)
+{
+  boost::mutex::scoped_lock slock(*lock);
+  ++(*count);
+  return fabs(values[0]);
+}
+
+TEST_F(LoadPlanningModelsPr2, ParallelIK)
+{
+  useLeftArmSolverInstancePool(kmodel, urdf_model);
+  const robot_model::JointModelGroup *jmg = kmodel->getJointModelGroup("left_arm");
+
+  robot_state::RobotState ks(kmodel);
+  setLeftArmConfiguration(ks);
+  Eigen::Affine3d pose = ks.getGlobalLinkTransform("l_wrist_roll_link");
+
+  // the first solution found is used
+  ks.setToDefaultValues();
+  ks.update();
+  EXPECT_TRUE(ks.setFromIKParallel(jmg, pose, "l_wrist_roll_link", 4, 10, 0.1));
+  ks.update();
+  EXPECT_TRUE(ks.getGlobalLinkTransform("l_wrist_roll_link").isApprox(pose, 1e-3));
+
+  // with a cost function, all attempts are ranked
+  std::size_t count = 0;
+  boost::mutex lock;
+  ks.setToDefaultValues();
+  ks.update();
+  EXPECT_TRUE(ks.setFromIKParallel(jmg, pose, "l_wrist_roll_link", 4, 10, 0.1, robot_state::GroupStateValidityCallbackFn(),
+                                   boost::bind(&countIKCost, &count, &lock, _1, _2, _3)));
+  ks.update();
+  EXPECT_TRUE(ks.getGlobalLinkTransform("l_wrist_roll_link").isApprox(pose, 1e-3));
+  EXPECT_GT(count, 0);
+
+  // solutions the constraint rejects are not used, and neither are unreachable poses
+  robot_state::RobotState start(kmodel);
+  start.setToDefaultValues();
+  ks = start;
+  EXPECT_FALSE(ks.setFromIKParallel(jmg, pose, "l_wrist_roll_link", 4, 4, 0.05, &rejectIKSolution));
+  Eigen::Affine3d far = pose;
+  far.translation().x() += 10.0;
+  EXPECT_FALSE(ks.setFromIKParallel(jmg, far, "l_wrist_roll_link", 4, 4, 0.05));
+  EXPECT_EQ(0.0, ks.distance(start, jmg));
+
+  // all the leased solver instances are returned to the pool of the group
+  EXPECT_EQ(0, jmg->getSolverInstancePool()->getLeasedCount());
+}
+
+TEST_F(LoadPlanningModelsPr2, ParallelCartesianPath)
+{
+  useLeftArmSolverInstancePool(kmodel, urdf_model);
+  const robot_model::JointModelGroup *jmg = kmodel->getJointModelGroup("left_arm");
+  const robot_model::LinkModel *link = kmodel->getLinkModel("l_wrist_roll_link");
+
+  robot_state::RobotState start(kmodel);
+  setLeftArmConfiguration(start);
+
+  // a few waypoints along a straight line
+  EigenSTL::vector_Affine3d waypoints;
+  Eigen::Affine3d pose = start.getGlobalLinkTransform(link);
+  for (int i = 0 ; i < 4 ; ++i)
+  {
+    pose.translation().z() += 0.03;
+    waypoints.push_back(pose);
+  }
+
+  robot_state::CartesianPathOptions sequential_options;
+  robot_state::RobotState sequential(start);
+  std::vector<robot_state::RobotStatePtr> sequential_traj;
+  double sequential_fraction = sequential.computeCartesianPath(jmg, sequential_traj, link, waypoints, true, 0.01, 0.0, sequential_options);
+  ASSERT_NEAR(1.0, sequential_fraction, 1e-9);
+
+  // the concurrently solved segments join into the same path
+  robot_state::CartesianPathOptions parallel_options;
+  parallel_options.threads = 4;
+  robot_state::RobotState parallel(start);
+  std::vector<robot_state::RobotStatePtr> parallel_traj;
+  double parallel_fraction = parallel.computeCartesianPath(jmg, parallel_traj, link, waypoints, true, 0.01, 0.0, parallel_options);
+  EXPECT_NEAR(sequential_fraction, parallel_fraction, 1e-9);
+  ASSERT_FALSE(parallel_traj.empty());
+  parallel.update();
+  EXPECT_TRUE(parallel.getGlobalLinkTransform(link).isApprox(waypoints.back(), 1e-3));
+  EXPECT_TRUE(parallel_traj.back()->getGlobalLinkTransform(link).isApprox(waypoints.back(), 1e-3));
+
+  // consecutive states are close, so no segment was joined to one that took a different IK branch
+  for (std::size_t i = 1 ; i < parallel_traj.size() ; ++i)
+  {
+    EXPECT_LT((parallel_traj[i]->getGlobalLinkTransform(link).translation() -
+               parallel_traj[i - 1]->getGlobalLinkTransform(link).translation()).norm(), 0.01 + 1e-3);
+    EXPECT_LT(parallel_traj[i]->distance(*parallel_traj[i - 1], jmg), 0.5);
+  }
+  EXPECT_EQ(0, jmg->getSolverInstancePool()->getLeasedCount());
+
+  // the adaptive mode reaches the same end
+  parallel_options.adaptive = true;
+  parallel_options.max_joint_step = 0.5;
+  robot_state::RobotState adaptive(start);
+  std::vector<robot_state::RobotStatePtr> adaptive_traj;
+  EXPECT_NEAR(1.0, adaptive.computeCartesianPath(jmg, adaptive_traj, link, waypoints, true, 0.01, 0.0, parallel_options), 1e-9);
+  adaptive.update();
+  EXPECT_TRUE(adaptive.getGlobalLinkTransform(link).isApprox(waypoints.back(), 1e-3));
+}
+
 TEST_F(LoadPlanningModelsPr2, UnionConstraintSampler)
 {
   robot_state::RobotState ks(kmodel);
@@ -627,6 +1045,83 @@ TEST_F(LoadPlanningModelsPr2, UnionConstraintSampler)
   EXPECT_EQ(ikcs_test->getJointModelGroup()->getName(), "right_arm");
 }
 
+static bool rejectRightArm(robot_state::RobotState *state, const robot_model::JointModelGroup *jmg, const double *values)
+{
+  return jmg->getName() != "right_arm";
+}
+
+TEST_F(LoadPlanningModelsPr2, UnionConstraintSamplerAdaptive)
+{
+  robot_state::RobotState ks(kmodel);
+  ks.setToDefaultValues();
+  robot_state::RobotState ks_const(kmodel);
+  ks_const.setToDefaultValues();
+
+  kinematic_constraints::JointConstraint jcl(kmodel);
+  moveit_msgs::JointConstraint jcm;
+  jcm.joint_name = "l_elbow_flex_joint";
+  jcm.position = ks.getVariablePosition("l_elbow_flex_joint");
+  jcm.tolerance_above = 0.01;
+  jcm.tolerance_below = 0.01;
+  jcm.weight = 1.0;
+  EXPECT_TRUE(jcl.configure(jcm));
+  kinematic_constraints::JointConstraint jcr(kmodel);
+  jcm.joint_name = "r_elbow_flex_joint";
+  jcm.position = ks.getVariablePosition("r_elbow_flex_joint");
+  EXPECT_TRUE(jcr.configure(jcm));
+
+  std::vector<kinematic_constraints::JointConstraint> js;
+  js.push_back(jcl);
+  boost::shared_ptr<constraint_samplers::JointConstraintSampler> left(new constraint_samplers::JointConstraintSampler(ps, "left_arm"));
+  EXPECT_TRUE(left->configure(js));
+  js[0] = jcr;
+  boost::shared_ptr<constraint_samplers::JointConstraintSampler> right(new constraint_samplers::JointConstraintSampler(ps, "right_arm"));
+  EXPECT_TRUE(right->configure(js));
+
+  std::vector<constraint_samplers::ConstraintSamplerPtr> cspv;
+  cspv.push_back(right);
+  cspv.push_back(left);
+  constraint_samplers::UnionConstraintSampler ucs(ps, "arms", cspv);
+  ASSERT_EQ(2u, ucs.getSamplers().size());
+  EXPECT_EQ("left_arm", ucs.getSamplers()[0]->getJointModelGroup()->getName());
+
+  // without rejections, adaptive sampling gives the same valid samples
+  ucs.setAdaptive(true, 4);
+  EXPECT_TRUE(ucs.isAdaptive());
+  for (int t = 0 ; t < 20 ; ++t)
+  {
+    EXPECT_TRUE(ucs.sample(ks, ks_const, 10));
+    EXPECT_TRUE(jcl.decide(ks).satisfied);
+    EXPECT_TRUE(jcr.decide(ks).satisfied);
+  }
+  ASSERT_EQ(2u, ucs.getStatistics().size());
+  EXPECT_EQ(20u, ucs.getStatistics()[0].attempts_);
+  EXPECT_EQ(20u, ucs.getStatistics()[1].successes_);
+  EXPECT_EQ("left_arm", ucs.getSamplers()[0]->getJointModelGroup()->getName());
+
+  // the sampler whose states are always rejected moves first, so samples fail without sampling the other arm
+  ucs.setGroupStateValidityCallback(boost::bind(&rejectRightArm, _1, _2, _3));
+  ucs.resetStatistics();
+  for (int t = 0 ; t < 20 ; ++t)
+    EXPECT_FALSE(ucs.sample(ks, ks_const, 10));
+  EXPECT_EQ("right_arm", ucs.getSamplers()[0]->getJointModelGroup()->getName());
+  EXPECT_EQ(0u, ucs.getStatistics()[0].successes_);
+  EXPECT_LT(ucs.getStatistics()[1].attempts_, 20u);
+
+  // samplers that depend on each other keep their order
+  boost::shared_ptr<constraint_samplers::JointConstraintSampler> torso(new constraint_samplers::JointConstraintSampler(ps, "arms_and_torso"));
+  EXPECT_TRUE(torso->configure(js));
+  cspv.clear();
+  cspv.push_back(right);
+  cspv.push_back(torso);
+  constraint_samplers::UnionConstraintSampler ucs2(ps, "arms_and_torso", cspv);
+  ucs2.setAdaptive(true, 1);
+  ucs2.setGroupStateValidityCallback(boost::bind(&rejectRightArm, _1, _2, _3));
+  for (int t = 0 ; t < 10 ; ++t)
+    EXPECT_FALSE(ucs2.sample(ks, ks_const, 10));
+  EXPECT_EQ("arms_and_torso", ucs2.getSamplers()[0]->getJointModelGroup()->getName());
+}
+
 TEST_F(LoadPlanningModelsPr2, PoseConstraintSamplerManager)
 {
   robot_state::RobotState ks(kmodel);
@@ -1120,6 +1615,48 @@ TEST_F(LoadPlanningModelsPr2, SubgroupPoseConstraintsSampler)
   logInform("Success rate for IK Constraint Sampler with position & orientation constraints for both arms: %lf", (double)succ / (double)NT);
 }
 
+TEST_F(LoadPlanningModelsPr2, SamplerManagerCache)
+{
+  moveit_msgs::Constraints con;
+  con.joint_constraints.resize(1);
+  con.joint_constraints[0].joint_name = "l_shoulder_pan_joint";
+  con.joint_constraints[0].position = 0.54;
+  con.joint_constraints[0].tolerance_above = 0.01;
+  con.joint_constraints[0].tolerance_below = 0.01;
+  con.joint_constraints[0].weight = 1.0;
+
+  constraint_samplers::ConstraintSamplerManager csm;
+  EXPECT_EQ(0, csm.getSamplerCacheCapacity());
+  constraint_samplers::ConstraintSamplerPtr s1 = csm.selectSampler(ps, "left_arm", con);
+  constraint_samplers::ConstraintSamplerPtr s2 = csm.selectSampler(ps, "left_arm", con);
+  ASSERT_TRUE(s1 && s2);
+  EXPECT_NE(s1.get(), s2.get());
+
+  csm.setSamplerCacheCapacity(4);
+  s1 = csm.selectSampler(ps, "left_arm", con);
+  s2 = csm.selectSampler(ps, "left_arm", con);
+  ASSERT_TRUE(s1);
+  EXPECT_EQ(s1.get(), s2.get());
+
+  // a different message or group gives a different sampler
+  s2 = csm.selectSampler(ps, "arms", con);
+  ASSERT_TRUE(s2);
+  EXPECT_NE(s1.get(), s2.get());
+  con.joint_constraints[0].position = 0.5;
+  s2 = csm.selectSampler(ps, "left_arm", con);
+  ASSERT_TRUE(s2);
+  EXPECT_NE(s1.get(), s2.get());
+
+  // samplers that cannot be allocated are not cached
+  EXPECT_FALSE(csm.selectSampler(ps, "right_arm", con));
+
+  csm.clearSamplerCache();
+  con.joint_constraints[0].position = 0.54;
+  s2 = csm.selectSampler(ps, "left_arm", con);
+  ASSERT_TRUE(s2);
+  EXPECT_NE(s1.get(), s2.get());
+}
+
 int main(int argc, char **argv)
 {
   testing::InitGoogleTest(&argc, argv);
@@ -39,7 +39,10 @@
 
 #include <vector>
 #include <string>
+#include <map>
 #include <boost/shared_ptr.hpp>
+#include <boost/function.hpp>
+#include <boost/thread/mutex.hpp>
 #include <moveit_msgs/RobotTrajectory.h>
 
 /// Namespace for the base class of a MoveIt controller manager
@@ -98,6 +101,19 @@ class MoveItControllerHandle
 {
 public:
 
+  /** \brief How a segment passed to sendTrajectorySegment() is combined with the trajectory being executed */
+  enum SegmentMode
+    {
+      /** \brief The segment continues the trajectory sent so far: its first point must be later than
+          the last point sent */
+      APPEND_SEGMENT,
+
+      /** \brief The points sent so far that are not earlier than the first point of the segment are
+          discarded and the segment is executed instead. The first point of the segment must not be
+          due yet when the controller receives it */
+      REPLACE_TAIL
+    };
+
   /** \brief Each controller has a name. The handle is initialized with that name */
   MoveItControllerHandle(const std::string &name) : name_(name)
   {
@@ -116,6 +132,26 @@ public:
   /** \brief Send a trajectory to the controller. The controller is expected to execute the trajectory, but this function call should not block. Blocking is achievable by calling waitForExecution(). Return false when the controller cannot accept the trajectory. */
   virtual bool sendTrajectory(const moveit_msgs::RobotTrajectory &trajectory) = 0;
 
+  /** \brief Check if the controller accepts sendTrajectorySegment() calls */
+  virtual bool supportsTrajectoryStreaming() const
+  {
+    return false;
+  }
+
+  /** \brief Extend or modify the trajectory being executed, so that execution can start with a prefix of a
+      trajectory that is still being computed (sent with sendTrajectory()) and continue as the rest becomes
+      available. The joints of the segment must be the ones of the trajectory sent with sendTrajectory(), and the
+      time_from_start of its points is measured from the start of that trajectory. The controller moves from the
+      last point it keeps to the first point of the segment as it would between any two consecutive points, so the
+      caller is responsible for continuity of positions and velocities at the junction. If the execution completed
+      before the segment is received, the segment is rejected. This function should not block. Return false if
+      the segment cannot be accepted; the trajectory sent so far is then executed unchanged. Controllers that do
+      not support streaming (see supportsTrajectoryStreaming()) always return false. */
+  virtual bool sendTrajectorySegment(const moveit_msgs::RobotTrajectory &segment, SegmentMode mode)
+  {
+    return false;
+  }
+
   /** \brief Cancel the execution of any motion using this controller. Report false if canceling is not possible. If there is no execution in progress, this function is a no-op and returns true. */
   virtual bool cancelExecution() = 0;
 
@@ -161,10 +197,37 @@ public:
     /** \brief It is often the case that multiple controllers could be used to execute a motion. Marking a controller as default
         makes MoveIt prefer this controller when multiple options are available. */
     bool default_;
+
+    bool operator==(const ControllerState &other) const
+    {
+      return active_ == other.active_ && default_ == other.default_;
+    }
   };
 
+  /** \brief What is known about a controller: the joints it operates on and its state */
+  struct ControllerInformation
+  {
+    std::vector<std::string> joints_;
+    ControllerState state_;
+
+    bool operator==(const ControllerInformation &other) const
+    {
+      return joints_ == other.joints_ && state_ == other.state_;
+    }
+  };
+
+  /** \brief The information about all known controllers, by controller name */
+  typedef std::map<std::string, ControllerInformation> ControllersSnapshot;
+  typedef boost::shared_ptr<const ControllersSnapshot> ControllersSnapshotConstPtr;
+
+  /** \brief Called with the new snapshot when the known controllers or their state change */
+  typedef boost::function<void(const ControllersSnapshotConstPtr&)> ControllersChangedFn;
+
+  /** \brief Called with the result of switchControllersAsync() */
+  typedef boost::function<void(bool)> SwitchControllersDoneFn;
+
   /** \brief Default constructor. This needs to have no arguments so that the plugin system can construct the object. */
-  MoveItControllerManager()
+  MoveItControllerManager() : snapshot_maintained_(false)
   {
   }
 
@@ -189,6 +252,108 @@ public:
 
   /** \brief Activate and deactivate controllers */
   virtual bool switchControllers(const std::vector<std::string> &activate, const std::vector<std::string> &deactivate) = 0;
+
+  /** \brief Activate and deactivate controllers and call \e done with the result. The default implementation is
+      synchronous: it calls switchControllers(), invalidates the snapshot and calls \e done before it returns.
+      Implementations that talk to an asynchronous interface should override it so it returns right away. */
+  virtual void switchControllersAsync(const std::vector<std::string> &activate, const std::vector<std::string> &deactivate,
+                                      const SwitchControllersDoneFn &done)
+  {
+    bool result = switchControllers(activate, deactivate);
+    invalidateControllersSnapshot();
+    if (done)
+      done(result);
+  }
+
+  /** \brief Get a snapshot of the known controllers. Unless the implementation keeps the snapshot current (by calling
+      refreshControllersSnapshot() or setControllersSnapshot() when it learns of changes), the controllers are queried
+      on every call. Otherwise they are only queried if the snapshot was invalidated, and the call only reads
+      memory, so it is cheap enough to be made before every execution. */
+  ControllersSnapshotConstPtr getControllersSnapshot()
+  {
+    {
+      boost::mutex::scoped_lock slock(snapshot_lock_);
+      if (snapshot_ && snapshot_maintained_)
+        return snapshot_;
+    }
+    ControllersSnapshotConstPtr snapshot = queryControllersSnapshot();
+    storeControllersSnapshot(snapshot);
+    return snapshot;
+  }
+
+  /** \brief Query the known controllers, their joints and their state with the functions above and replace the
+      snapshot. Implementations call this function (or setControllersSnapshot()) when they learn that the
+      controllers changed; from then on, getControllersSnapshot() returns the stored snapshot. */
+  void refreshControllersSnapshot()
+  {
+    setControllersSnapshot(queryControllersSnapshot());
+  }
+
+  /** \brief Discard the snapshot, so the next call to getControllersSnapshot() queries the controllers again.
+      Call this after switching controllers with switchControllers(). */
+  void invalidateControllersSnapshot()
+  {
+    boost::mutex::scoped_lock slock(snapshot_lock_);
+    snapshot_.reset();
+  }
+
+  /** \brief Set the function called when the snapshot changes (replacing any previously set function) */
+  void setControllersChangedCallback(const ControllersChangedFn &callback)
+  {
+    boost::mutex::scoped_lock slock(snapshot_lock_);
+    changed_callback_ = callback;
+  }
+
+protected:
+
+  /** \brief Replace the snapshot and mark it as kept current by the implementation; if it differs from the previous
+      one, the changed callback is called */
+  void setControllersSnapshot(const ControllersSnapshotConstPtr &snapshot)
+  {
+    {
+      boost::mutex::scoped_lock slock(snapshot_lock_);
+      snapshot_maintained_ = true;
+    }
+    storeControllersSnapshot(snapshot);
+  }
+
+private:
+
+  ControllersSnapshotConstPtr queryControllersSnapshot()
+  {
+    boost::shared_ptr<ControllersSnapshot> snapshot(new ControllersSnapshot());
+    std::vector<std::string> names;
+    getControllersList(names);
+    for (std::size_t i = 0 ; i < names.size() ; ++i)
+    {
+      ControllerInformation &info = (*snapshot)[names[i]];
+      getControllerJoints(names[i], info.joints_);
+      info.state_ = getControllerState(names[i]);
+    }
+    return snapshot;
+  }
+
+  void storeControllersSnapshot(const ControllersSnapshotConstPtr &snapshot)
+  {
+    ControllersChangedFn callback;
+    {
+      boost::mutex::scoped_lock slock(snapshot_lock_);
+      bool changed = !last_snapshot_ || !snapshot || !(*last_snapshot_ == *snapshot);
+      snapshot_ = snapshot;
+      last_snapshot_ = snapshot;
+      if (!changed)
+        return;
+      callback = changed_callback_;
+    }
+    if (callback)
+      callback(snapshot);
+  }
+
+  boost::mutex                snapshot_lock_;
+  ControllersSnapshotConstPtr snapshot_;
+  ControllersSnapshotConstPtr last_snapshot_;
+  bool                        snapshot_maintained_;
+  ControllersChangedFn        changed_callback_;
 };
 
 typedef boost::shared_ptr<MoveItControllerManager> MoveItControllerManagerPtr;
@@ -40,6 +40,7 @@
 #include <moveit/distance_field/voxel_grid.h>
 #include <vector>
 #include <list>
+#include <map>
 #include <visualization_msgs/Marker.h>
 #include <visualization_msgs/MarkerArray.h>
 #include <Eigen/Core>
@@ -187,6 +188,26 @@ public:
    */
   void addOcTreeToField(const octomap::OcTree* octree);
 
+  /**
+   * \brief Updates the distance field with the changes recorded by
+   * the change detection of an octree (see
+   * octomap::OccupancyOcTreeBase::enableChangeDetection), rather than
+   * re-adding the whole octree.  Only the cells around the changed
+   * leaves are re-evaluated against the octree, with the same
+   * mapping of leaves to cells as \ref addOcTreeToField, and the
+   * cells whose occupancy differs are passed to a single call to
+   * \ref updatePointsInField.
+   *
+   * The field must previously reflect the octree as it was before the
+   * recorded changes, e.g. from an earlier call to \ref
+   * addOcTreeToField.  Resetting the change detection of the octree
+   * after the update is left to the caller, since the octree may have
+   * other consumers.
+   *
+   * @param [in] octree The octree whose changes to apply
+   */
+  void updateOcTreeChangesInField(const octomap::OcTree* octree);
+
   /**
    * \brief Moves the shape in the distance field from the old pose to
    * the new pose, removing points that are no longer obstacle points,
@@ -221,6 +242,120 @@ public:
   void removeShapeFromField(const shapes::Shape* shape,
                             const geometry_msgs::Pose& pose);
 
+  /**
+   * \brief Sets the number of threads used to find the points
+   * internal to a shape in \ref addShapeToField, \ref
+   * moveShapeInField and \ref removeShapeFromField.  The default is
+   * 1.
+   *
+   * @param [in] threads The number of threads (0 is treated as 1)
+   */
+  void setVoxelizationThreadCount(unsigned int threads)
+  {
+    voxelization_threads_ = threads > 0 ? threads : 1;
+  }
+
+  /**
+   * \brief Gets the number of threads used to find the points
+   * internal to a shape.
+   *
+   * @return The number of threads
+   */
+  unsigned int getVoxelizationThreadCount() const
+  {
+    return voxelization_threads_;
+  }
+
+  /**
+   * \brief Sets the number of threads used by \ref
+   * getIsoSurfaceMarkers, \ref getGradientMarkers and \ref
+   * getPlaneMarkers.  The threads come from the shared
+   * moveit::tools::ThreadPool, so at most its thread count is used.
+   * The cells are split in contiguous ranges, so the markers do not
+   * depend on the number of threads.  Since the
+   * cells are read concurrently, the field must not be modified while
+   * markers are generated.  The default is 1.
+   *
+   * @param [in] threads The number of threads (0 is treated as 1)
+   */
+  void setVisualizationThreadCount(unsigned int threads)
+  {
+    visualization_threads_ = threads > 0 ? threads : 1;
+  }
+
+  /**
+   * \brief Gets the number of threads used to generate markers.
+   *
+   * @return The number of threads
+   */
+  unsigned int getVisualizationThreadCount() const
+  {
+    return visualization_threads_;
+  }
+
+  /**
+   * \brief Sets the stride of the markers: only every \e stride-th
+   * cell along each axis is considered by \ref getIsoSurfaceMarkers,
+   * \ref getGradientMarkers and \ref getPlaneMarkers, and the cubes
+   * of the iso-surface and of the planes are scaled to \e stride
+   * cells, so large fields can be shown at a fraction of the cost.
+   * The default is 1 (every cell).
+   *
+   * @param [in] stride The stride (0 is treated as 1)
+   */
+  void setVisualizationStride(unsigned int stride)
+  {
+    visualization_stride_ = stride > 0 ? stride : 1;
+  }
+
+  /**
+   * \brief Gets the stride of the markers.
+   *
+   * @return The stride
+   */
+  unsigned int getVisualizationStride() const
+  {
+    return visualization_stride_;
+  }
+
+  /**
+   * \brief Enables caching the points internal to each shape, in the
+   * frame of the shape, so that adding, moving or removing a shape
+   * that has been seen before only transforms the cached points.
+   *
+   * Shapes are cached by pointer, so a shape must not be modified
+   * while it is cached; an entry is dropped when its shape is removed
+   * with \ref removeShapeFromField, and all of them when the cache is
+   * disabled or cleared.  The cached points are sampled at half the
+   * resolution so that rotated shapes leave no holes, which makes the
+   * obstacle cells at the surface of a shape differ slightly from the
+   * uncached voxelization.  Disabled by default.
+   *
+   * @param [in] cache Whether to cache the points of shapes
+   */
+  void setShapeCacheEnabled(bool cache)
+  {
+    cache_shape_points_ = cache;
+    if (!cache)
+      shape_points_cache_.clear();
+  }
+
+  /**
+   * \brief Whether the points internal to shapes are cached.
+   */
+  bool isShapeCacheEnabled() const
+  {
+    return cache_shape_points_;
+  }
+
+  /**
+   * \brief Drops the cached points of all the shapes.
+   */
+  void clearShapeCache()
+  {
+    shape_points_cache_.clear();
+  }
+
   /**
    * \brief Resets all points in the distance field to an uninitialize
    * value.
@@ -295,9 +430,48 @@ public:
    *
    * @return The distance to the closest occupied cell
    */
-  double getDistanceGradient(double x, double y, double z,
-                             double& gradient_x, double& gradient_y, double& gradient_z,
-                             bool& in_bounds) const;
+  virtual double getDistanceGradient(double x, double y, double z,
+                                     double& gradient_x, double& gradient_y, double& gradient_z,
+                                     bool& in_bounds) const;
+
+  /**
+   * \brief Gets the distances at a batch of world locations, using
+   * trilinear interpolation between the centers of the eight cells
+   * surrounding each point.  Points outside the field are assigned
+   * the uninitialized distance.
+   *
+   * This is meant for callers that query many points at once (e.g.
+   * the sphere centers of a robot, in an optimizing planner): the
+   * whole batch is handled in one call, and derived classes can
+   * override it to read their cells directly instead of through a
+   * virtual call per cell.
+   *
+   * @param [in] points The world locations to query
+   * @param [out] distances The interpolated distance at each point
+   *
+   * @return True if all points are inside the distance field
+   */
+  virtual bool getInterpolatedDistances(const EigenSTL::vector_Vector3d& points,
+                                        std::vector<double>& distances) const;
+
+  /**
+   * \brief Like \ref getInterpolatedDistances, but also computes the
+   * gradient of the interpolated distance at each point.  Unlike the
+   * gradient of \ref getDistanceGradient, this gradient is the exact
+   * derivative of the interpolated distance, and is defined up to the
+   * border of the field (in the outer half cell along an axis the
+   * distance is constant along that axis).  Points outside the field
+   * get a zero gradient.
+   *
+   * @param [in] points The world locations to query
+   * @param [out] distances The interpolated distance at each point
+   * @param [out] gradients The gradient of the interpolated distance at each point
+   *
+   * @return True if all points are inside the distance field
+   */
+  virtual bool getInterpolatedDistanceGradients(const EigenSTL::vector_Vector3d& points,
+                                                std::vector<double>& distances,
+                                                EigenSTL::vector_Vector3d& gradients) const;
   /**
    * \brief Gets the distance to the closest obstacle at the given
    * integer cell location. The particulars of this function are
@@ -580,6 +754,27 @@ public:
   virtual double getUninitializedDistance() const = 0;
 
 protected:
+  /**
+   * \brief Appends the points \ref addOcTreeToField adds for an
+   * occupied octree leaf with the given center and size.
+   */
+  virtual void getOcTreeLeafPoints(double x, double y, double z, double size,
+                           EigenSTL::vector_Vector3d& points) const;
+
+  /**
+   * \brief Whether \ref addOcTreeToField would mark the given
+   * (valid) cell as occupied for \e octree.  For leaves larger than
+   * a cell this tests against the extent of their expansion.
+   */
+  bool isOcTreeOccupyingCell(const octomap::OcTree* octree, int x, int y, int z) const;
+
+  /**
+   * \brief Appends the points internal to \e shape at \e pose, from
+   * the shape cache if it is enabled.
+   */
+  virtual void getShapePoints(const shapes::Shape* shape, const geometry_msgs::Pose& pose,
+                      EigenSTL::vector_Vector3d& points);
+
   /**
    * \brief Helper function that sets the point value and color given
    * the distance.
@@ -607,8 +802,101 @@ protected:
   double origin_y_;             /**< \brief Y origin of the distance field */
   double origin_z_;             /**< \brief Z origin of the distance field */
   double resolution_;           /**< \brief Resolution of the distance field */
-  int inv_twice_resolution_;    /**< \brief Computed value 1.0/(2.0*resolution_) */
+  double inv_twice_resolution_; /**< \brief Computed value 1.0/(2.0*resolution_) */
+  unsigned int voxelization_threads_; /**< \brief The number of threads used to find the points internal to a shape */
+  unsigned int visualization_threads_; /**< \brief The number of threads used to generate markers */
+  unsigned int visualization_stride_; /**< \brief Only every visualization_stride_-th cell along each axis is shown in markers */
+  bool cache_shape_points_;     /**< \brief Whether the points internal to shapes are cached */
+  std::map<const shapes::Shape*, EigenSTL::vector_Vector3d> shape_points_cache_; /**< \brief The points internal to each shape, in the frame of the shape */
+
+  /**
+   * \brief The implementation of the batch queries, for any functor
+   * \e cell_distance that, called with the (valid) indices x, y, z of
+   * a cell, returns the distance of that cell.  \e gradients may be
+   * NULL if they are not needed.
+   */
+  template <typename CellDistance>
+  bool interpolateDistances(const CellDistance& cell_distance,
+                            const EigenSTL::vector_Vector3d& points,
+                            std::vector<double>& distances,
+                            EigenSTL::vector_Vector3d* gradients) const;
 };
 
+template <typename CellDistance>
+bool DistanceField::interpolateDistances(const CellDistance& cell_distance,
+                                         const EigenSTL::vector_Vector3d& points,
+                                         std::vector<double>& distances,
+                                         EigenSTL::vector_Vector3d* gradients) const
+{
+  const int num_cells[3] = { getXNumCells(), getYNumCells(), getZNumCells() };
+  const double origin[3] = { origin_x_, origin_y_, origin_z_ };
+  const double oo_resolution = 1.0 / resolution_;
+  const double uninitialized = getUninitializedDistance();
+
+  distances.resize(points.size());
+  if (gradients)
+    gradients->resize(points.size());
+
+  bool all_in_bounds = true;
+  for (std::size_t i = 0 ; i < points.size() ; ++i)
+  {
+    // cells are centered at integer coordinates, so the field covers [-0.5, num_cells - 0.5) along each axis;
+    // in the outer half cell, the distance is held constant along that axis
+    int c[3];
+    double t[3];
+    bool clamped[3];
+    bool in_bounds = true;
+    for (int k = 0 ; k < 3 ; ++k)
+    {
+      double u = (points[i][k] - origin[k]) * oo_resolution;
+      if (!(u >= -0.5 && u < num_cells[k] - 0.5) || num_cells[k] < 2)
+      {
+        in_bounds = false;
+        break;
+      }
+      clamped[k] = u < 0.0 || u > num_cells[k] - 1;
+      u = std::min(std::max(u, 0.0), double(num_cells[k] - 1));
+      c[k] = std::min(int(u), num_cells[k] - 2);
+      t[k] = u - c[k];
+    }
+    if (!in_bounds)
+    {
+      distances[i] = uninitialized;
+      if (gradients)
+        (*gradients)[i].setZero();
+      all_in_bounds = false;
+      continue;
+    }
+
+    double d[2][2][2];
+    for (int dx = 0 ; dx < 2 ; ++dx)
+      for (int dy = 0 ; dy < 2 ; ++dy)
+        for (int dz = 0 ; dz < 2 ; ++dz)
+          d[dx][dy][dz] = cell_distance(c[0] + dx, c[1] + dy, c[2] + dz);
+
+    // interpolate along Z, then Y, then X
+    double d00 = d[0][0][0] + t[2] * (d[0][0][1] - d[0][0][0]);
+    double d01 = d[0][1][0] + t[2] * (d[0][1][1] - d[0][1][0]);
+    double d10 = d[1][0][0] + t[2] * (d[1][0][1] - d[1][0][0]);
+    double d11 = d[1][1][0] + t[2] * (d[1][1][1] - d[1][1][0]);
+    double d0 = d00 + t[1] * (d01 - d00);
+    double d1 = d10 + t[1] * (d11 - d10);
+    distances[i] = d0 + t[0] * (d1 - d0);
+
+    if (gradients)
+    {
+      Eigen::Vector3d& g = (*gradients)[i];
+      g.x() = (d1 - d0) * oo_resolution;
+      g.y() = ((1.0 - t[0]) * (d01 - d00) + t[0] * (d11 - d10)) * oo_resolution;
+      g.z() = ((1.0 - t[0]) * ((1.0 - t[1]) * (d[0][0][1] - d[0][0][0]) + t[1] * (d[0][1][1] - d[0][1][0])) +
+               t[0] * ((1.0 - t[1]) * (d[1][0][1] - d[1][0][0]) + t[1] * (d[1][1][1] - d[1][1][0]))) * oo_resolution;
+      for (int k = 0 ; k < 3 ; ++k)
+        if (clamped[k])
+          g[k] = 0.0;
+    }
+  }
+  return all_in_bounds;
+}
+
 }
 #endif
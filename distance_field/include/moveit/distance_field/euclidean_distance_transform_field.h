@@ -0,0 +1,252 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2013, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+
+#ifndef MOVEIT_DISTANCE_FIELD_EUCLIDEAN_DISTANCE_TRANSFORM_FIELD_
+#define MOVEIT_DISTANCE_FIELD_EUCLIDEAN_DISTANCE_TRANSFORM_FIELD_
+
+#include <moveit/distance_field/voxel_grid.h>
+#include <moveit/distance_field/distance_field.h>
+#include <vector>
+
+namespace distance_field
+{
+
+/**
+ * \brief A DistanceField implementation that computes exact
+ * Euclidean distances with a separable distance transform
+ * (Felzenszwalb and Huttenlocher).  The transform is run as three
+ * passes of one dimensional lower envelope computations, along Z,
+ * then Y, then X, so its cost is linear in the number of cells and
+ * independent of the number or arrangement of obstacles.
+ *
+ * Unlike the \ref PropagationDistanceField, no incremental state is
+ * kept: every call that changes the set of obstacle cells recomputes
+ * the whole field.  This makes the class a good fit for fields that
+ * are rebuilt from scratch (e.g. from a new sensor scan or octree)
+ * rather than edited a few cells at a time; callers should batch
+ * point changes into as few calls as possible.  The independent lines
+ * of each pass can be split across several threads (see \ref
+ * setThreadCount).
+ *
+ * Distances to obstacle cells are measured between cell centers and
+ * are capped at the maximum distance, so for the same input the
+ * results match the ones of a \ref PropagationDistanceField.  If
+ * negative distances are requested, obstacle cells hold the negated
+ * distance to the nearest unoccupied cell.
+ */
+class EuclideanDistanceTransformField: public DistanceField
+{
+public:
+
+  /**
+   * \brief Constructor that initializes entire distance field to
+   * empty - all cells will be assigned maximum distance values.
+   *
+   * @param [in] size_x The X dimension in meters of the volume to represent
+   * @param [in] size_y The Y dimension in meters of the volume to represent
+   * @param [in] size_z The Z dimension in meters of the volume to represent
+   * @param [in] resolution The resolution in meters of the volume
+   * @param [in] origin_x The minimum X point of the volume
+   * @param [in] origin_y The minimum Y point of the volume
+   * @param [in] origin_z The minimum Z point of the volume
+   *
+   * @param [in] max_distance Cells further than this distance from
+   * the nearest obstacle (or unoccupied cell, for negative distances)
+   * are assigned this distance.
+   *
+   * @param [in] compute_negative_distances Whether to compute
+   * negative distances inside obstacle volumes.  If false, all
+   * obstacle cells are assigned zero distance.
+   */
+  EuclideanDistanceTransformField(double size_x,
+                                  double size_y,
+                                  double size_z,
+                                  double resolution,
+                                  double origin_x, double origin_y, double origin_z,
+                                  double max_distance,
+                                  bool compute_negative_distances=false);
+
+  virtual ~EuclideanDistanceTransformField()
+  {
+  }
+
+  /**
+   * \brief Marks the cells containing \e points as obstacles and
+   * recomputes the field.  Points outside the volume are ignored.
+   */
+  virtual void addPointsToField(const EigenSTL::vector_Vector3d& points);
+
+  /**
+   * \brief Marks the cells containing \e points as free and
+   * recomputes the field.  Points outside the volume are ignored.
+   */
+  virtual void removePointsFromField(const EigenSTL::vector_Vector3d& points);
+
+  /**
+   * \brief Clears the cells of \e old_points, marks the cells of \e
+   * new_points as obstacles and recomputes the field once.
+   */
+  virtual void updatePointsInField(const EigenSTL::vector_Vector3d& old_points,
+                                   const EigenSTL::vector_Vector3d& new_points);
+
+  /**
+   * \brief Resets all cells to free; all distances become the
+   * maximum distance.
+   */
+  virtual void reset();
+
+  virtual double getDistance(double x, double y, double z) const;
+
+  virtual double getDistance(int x, int y, int z) const;
+
+  virtual bool isCellValid(int x, int y, int z) const;
+
+  virtual int getXNumCells() const;
+
+  virtual int getYNumCells() const;
+
+  virtual int getZNumCells() const;
+
+  virtual bool gridToWorld(int x, int y, int z, double& world_x, double& world_y, double& world_z) const;
+
+  virtual bool worldToGrid(double world_x, double world_y, double world_z, int& x, int& y, int& z) const;
+
+  /**
+   * \brief Writes the obstacle cells to a stream, in the same format
+   * as \ref PropagationDistanceField::writeToStream.
+   */
+  virtual bool writeToStream(std::ostream& stream) const;
+
+  /**
+   * \brief Reads obstacle cells written by \ref writeToStream (or by
+   * a \ref PropagationDistanceField) and recomputes the field.  The
+   * maximum distance and the negative distance setting are kept.
+   */
+  virtual bool readFromStream(std::istream& stream);
+
+  virtual double getUninitializedDistance() const
+  {
+    return max_distance_;
+  }
+
+  /**
+   * \brief Whether the cell at the given location is an obstacle cell
+   */
+  bool isCellOccupied(int x, int y, int z) const
+  {
+    return occupancy_grid_.getCell(x, y, z) != 0;
+  }
+
+  /**
+   * \brief Set the number of threads the transform passes are split
+   * across.  The threads come from the shared
+   * moveit::tools::ThreadPool, so at most its thread count is used.
+   * The default is 1; a value of 0 is treated as 1.
+   */
+  void setThreadCount(unsigned int threads)
+  {
+    threads_ = threads > 0 ? threads : 1;
+  }
+
+  /** \brief Get the number of threads used by the transform passes */
+  unsigned int getThreadCount() const
+  {
+    return threads_;
+  }
+
+  /** \brief Gets the maximum distance of the field */
+  double getMaxDistance() const
+  {
+    return max_distance_;
+  }
+
+private:
+
+  /** \brief Allocates the grids and clears the field; used by the constructor and \ref readFromStream */
+  void initialize();
+
+  /** \brief Sets the occupancy of the cells containing \e points, returning true if any cell changed */
+  bool setPointsOccupancy(const EigenSTL::vector_Vector3d& points, char occupied);
+
+  /** \brief Recomputes all distances from the occupancy grid */
+  void computeDistances();
+
+  /**
+   * \brief Computes squared distances, in cells, from every cell to
+   * the nearest cell whose occupancy equals \e target.  Cells with no
+   * such cell anywhere in the grid get a value larger than any
+   * distance in the grid.
+   */
+  void computeSquaredDistances(char target, std::vector<double>& sq_distances) const;
+
+  /** \brief Runs the one dimensional transform along \e axis over the lines [\e first_line, \e last_line) */
+  void transformLines(std::vector<double>* sq_distances, int axis, int first_line, int last_line) const;
+
+  /** \brief Number of cells along each axis, indexed by \ref Dimension */
+  int getNumCells(int axis) const
+  {
+    return occupancy_grid_.getNumCells(static_cast<Dimension>(axis));
+  }
+
+  /**
+   * \brief The squared distance cells start with when they are not
+   * a target of the transform; larger than any squared distance
+   * within the grid, but small enough to keep the parabola
+   * intersections exact.
+   */
+  double getFarSquaredDistance() const
+  {
+    double far = 1.0;
+    for (int a = DIM_X ; a <= DIM_Z ; ++a)
+      far += double(getNumCells(a)) * getNumCells(a);
+    return far;
+  }
+
+  /** \brief Index of cell (x, y, z) in \e distances_; cells are stored in the same order as in a \ref VoxelGrid */
+  std::size_t getIndex(int x, int y, int z) const
+  {
+    return (static_cast<std::size_t>(x) * getNumCells(DIM_Y) + y) * getNumCells(DIM_Z) + z;
+  }
+
+  VoxelGrid<char> occupancy_grid_; /**< \brief Non-zero for obstacle cells */
+  std::vector<float> distances_; /**< \brief Signed distance of each cell, in meters */
+  double max_distance_;         /**< \brief Distance assigned to cells far from obstacles */
+  bool compute_negative_;       /**< \brief Whether negative distances are computed for obstacle cells */
+  unsigned int threads_;        /**< \brief Number of threads the transform passes are split across */
+};
+
+}
+
+#endif
@@ -53,10 +53,15 @@ namespace distance_field
  * @param [in] resolution The resolution at which to test
  * @param [out] points The points internal to the body are appended to thiss
  *                   vector.
+ * @param [in] threads The number of threads (of the shared
+ *                   moveit::tools::ThreadPool) testing slices of the
+ *                   bounding box in parallel; the points appended are
+ *                   the same for any number of threads.
  */
 void findInternalPointsConvex(const bodies::Body& body,
                               double resolution,
-                              EigenSTL::vector_Vector3d& points);
+                              EigenSTL::vector_Vector3d& points,
+                              unsigned int threads = 1);
 
 }
 
@@ -0,0 +1,238 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2013, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#ifndef MOVEIT_DISTANCE_FIELD_MULTI_RESOLUTION_DISTANCE_FIELD_
+#define MOVEIT_DISTANCE_FIELD_MULTI_RESOLUTION_DISTANCE_FIELD_
+
+#include <moveit/distance_field/propagation_distance_field.h>
+#include <boost/shared_ptr.hpp>
+#include <vector>
+
+namespace distance_field
+{
+
+/**
+ * \brief A DistanceField made of a coarse \ref
+ * PropagationDistanceField covering the whole volume, and finer
+ * PropagationDistanceFields covering selected regions of it (e.g. the
+ * workspace of the arm of a mobile robot).
+ *
+ * Each refined region is stored in a field that extends past the
+ * region by the maximum distance, so the distances of the cells
+ * inside the region account for the obstacles next to it.  All
+ * obstacle changes are applied to every level.  Queries at world
+ * locations use the finest region containing the location, and the
+ * coarse field elsewhere, so memory and propagation at the fine
+ * resolution are only paid for inside the regions.
+ *
+ * The cell-based interface of \ref DistanceField (e.g. \ref
+ * getDistance(int, int, int), \ref getXNumCells, \ref gridToWorld)
+ * refers to the coarse field.  Regions should be added before any
+ * obstacle, since a new region starts empty.  Shapes are voxelized
+ * at the finest resolution of the regions.  \ref
+ * updateOcTreeChangesInField compares the octree against the coarse
+ * cells only, so it is only exact for the coarse field; \ref
+ * addOcTreeToField should be used after reset() when regions exist.
+ */
+class MultiResolutionDistanceField: public DistanceField
+{
+public:
+
+  /**
+   * \brief Constructor for the coarse field, which initially has no
+   * refined regions and no obstacles.
+   *
+   * @param [in] size_x The X dimension in meters of the volume to represent
+   * @param [in] size_y The Y dimension in meters of the volume to represent
+   * @param [in] size_z The Z dimension in meters of the volume to represent
+   * @param [in] resolution The resolution in meters of the coarse field
+   * @param [in] origin_x The minimum X point of the volume
+   * @param [in] origin_y The minimum Y point of the volume
+   * @param [in] origin_z The minimum Z point of the volume
+   * @param [in] max_distance The maximum distance of all levels
+   * @param [in] propagate_negative_distances Whether all levels propagate negative distances
+   */
+  MultiResolutionDistanceField(double size_x,
+                               double size_y,
+                               double size_z,
+                               double resolution,
+                               double origin_x, double origin_y, double origin_z,
+                               double max_distance,
+                               bool propagate_negative_distances=false);
+
+  virtual ~MultiResolutionDistanceField()
+  {
+  }
+
+  /**
+   * \brief Adds a region, given by its minimum and maximum corners,
+   * where distances are computed at \e resolution.  The region is
+   * clipped to the volume of the coarse field.  Returns false if the
+   * region is empty or if \e resolution is not finer than the coarse
+   * resolution.
+   */
+  bool addRefinedRegion(const Eigen::Vector3d& min_corner, const Eigen::Vector3d& max_corner, double resolution);
+
+  /** \brief Removes all refined regions */
+  void clearRefinedRegions();
+
+  /** \brief Gets the number of refined regions */
+  std::size_t getRefinedRegionCount() const
+  {
+    return regions_.size();
+  }
+
+  /** \brief Gets the resolution queries at the given location use */
+  double getResolutionAt(double x, double y, double z) const;
+
+  /** \brief Gets the coarse field */
+  const PropagationDistanceField& getCoarseField() const
+  {
+    return coarse_;
+  }
+
+  virtual void addPointsToField(const EigenSTL::vector_Vector3d& points);
+
+  virtual void removePointsFromField(const EigenSTL::vector_Vector3d& points);
+
+  virtual void updatePointsInField(const EigenSTL::vector_Vector3d& old_points,
+                                   const EigenSTL::vector_Vector3d& new_points);
+
+  /** \brief Removes all obstacles from all levels; the refined regions are kept */
+  virtual void reset();
+
+  /** \brief Gets the distance at the given location, from the finest level containing it */
+  virtual double getDistance(double x, double y, double z) const;
+
+  /** \brief Interpolates each point in the finest level containing it (see \ref DistanceField::getInterpolatedDistances) */
+  virtual bool getInterpolatedDistances(const EigenSTL::vector_Vector3d& points,
+                                        std::vector<double>& distances) const;
+
+  virtual bool getInterpolatedDistanceGradients(const EigenSTL::vector_Vector3d& points,
+                                                std::vector<double>& distances,
+                                                EigenSTL::vector_Vector3d& gradients) const;
+
+  virtual double getDistance(int x, int y, int z) const;
+
+  virtual bool isCellValid(int x, int y, int z) const;
+
+  virtual int getXNumCells() const;
+
+  virtual int getYNumCells() const;
+
+  virtual int getZNumCells() const;
+
+  virtual bool gridToWorld(int x, int y, int z, double& world_x, double& world_y, double& world_z) const;
+
+  virtual bool worldToGrid(double world_x, double world_y, double world_z, int& x, int& y, int& z) const;
+
+  /**
+   * \brief Writes the refined regions and the obstacle cells of all
+   * levels to a stream; each level is written in the format of \ref
+   * PropagationDistanceField::writeToStream.
+   */
+  virtual bool writeToStream(std::ostream& stream) const;
+
+  /**
+   * \brief Reads the regions and levels written by \ref
+   * writeToStream, replacing the current ones.  The maximum
+   * distance and the negative distance setting are kept.
+   */
+  virtual bool readFromStream(std::istream& stream);
+
+  virtual double getUninitializedDistance() const
+  {
+    return coarse_.getUninitializedDistance();
+  }
+
+protected:
+
+  /** \brief Voxelizes \e shape at the finest resolution of the regions */
+  virtual void getShapePoints(const shapes::Shape* shape, const geometry_msgs::Pose& pose,
+                              EigenSTL::vector_Vector3d& points);
+
+  /** \brief Expands octree leaves at the finest resolution of the regions */
+  virtual void getOcTreeLeafPoints(double x, double y, double z, double size,
+                                   EigenSTL::vector_Vector3d& points) const;
+
+private:
+
+  /** \brief A refined region and the field holding its distances */
+  struct Region
+  {
+    Eigen::Vector3d min_corner_;
+    Eigen::Vector3d max_corner_;
+    boost::shared_ptr<PropagationDistanceField> field_;
+
+    bool contains(double x, double y, double z) const
+    {
+      return x >= min_corner_.x() && x < max_corner_.x() &&
+        y >= min_corner_.y() && y < max_corner_.y() &&
+        z >= min_corner_.z() && z < max_corner_.z();
+    }
+
+    static bool isFiner(const Region& a, const Region& b)
+    {
+      return a.field_->getResolution() < b.field_->getResolution();
+    }
+  };
+
+  /** \brief Creates the field of \e region for its corners, padded by the maximum distance */
+  void allocateRegion(Region& region, double resolution) const;
+
+  /** \brief Sorts the regions from the finest to the coarsest resolution */
+  void sortRegions();
+
+  /** \brief The finest resolution of all levels */
+  double getFinestResolution() const
+  {
+    return regions_.empty() ? resolution_ : regions_.front().field_->getResolution();
+  }
+
+  /** \brief Index of the finest region containing the location, or the number of regions for the coarse field */
+  std::size_t getLevel(double x, double y, double z) const;
+
+  /** \brief Answers a batch query by querying the points of each level together; \e gradients may be NULL */
+  bool queryLevels(const EigenSTL::vector_Vector3d& points, std::vector<double>& distances,
+                   EigenSTL::vector_Vector3d* gradients) const;
+
+  double max_distance_;         /**< \brief The maximum distance of all levels */
+  bool propagate_negative_;     /**< \brief Whether all levels propagate negative distances */
+  PropagationDistanceField coarse_; /**< \brief The field covering the whole volume */
+  std::vector<Region> regions_; /**< \brief The refined regions, finest first */
+};
+
+}
+
+#endif
@@ -38,13 +38,24 @@
 #define MOVEIT_DISTANCE_FIELD_PROPAGATION_DISTANCE_FIELD_
 
 #include <moveit/distance_field/voxel_grid.h>
+#include <moveit/distance_field/sparse_voxel_grid.h>
 #include <moveit/distance_field/distance_field.h>
 #include <vector>
 #include <list>
+#include <algorithm>
 #include <Eigen/Core>
 #include <set>
+#include <map>
 #include <octomap/octomap.h>
 
+namespace boost
+{
+namespace iostreams
+{
+class mapped_file;
+}
+}
+
 namespace distance_field
 {
 
@@ -160,6 +171,13 @@ public:
    * \ref PropagationDistanceField description for more information on
    * the implications of this.
    *
+   * @param [in] sparse_storage Whether to store the cells in a \ref
+   * SparseVoxelGrid, which only allocates memory for the parts of the
+   * volume that distances are propagated to (within the maximum
+   * distance of obstacles).  Other cells read as the maximum distance.
+   * This suits large volumes with few obstacles; propagation is
+   * always serial with sparse storage.
+   *
    */
   PropagationDistanceField(double size_x,
                            double size_y,
@@ -167,7 +185,8 @@ public:
                            double resolution,
                            double origin_x, double origin_y, double origin_z,
                            double max_distance,
-                           bool propagate_negative_distances=false);
+                           bool propagate_negative_distances=false,
+                           bool sparse_storage=false);
 
   /**
    * \brief Constructor based on an OcTree and bounding box
@@ -330,6 +349,75 @@ public:
    */
   virtual double getDistance(int x, int y, int z) const;
 
+  /**
+   * \brief Gets trilinearly interpolated distances at a batch of
+   * points; see \ref DistanceField::getInterpolatedDistances.  Cells
+   * are read directly from the voxel grid.
+   */
+  virtual bool getInterpolatedDistances(const EigenSTL::vector_Vector3d& points,
+                                        std::vector<double>& distances) const;
+
+  /**
+   * \brief Gets trilinearly interpolated distances and their
+   * gradients at a batch of points; see \ref
+   * DistanceField::getInterpolatedDistanceGradients.  Cells are read
+   * directly from the voxel grid.
+   */
+  virtual bool getInterpolatedDistanceGradients(const EigenSTL::vector_Vector3d& points,
+                                                std::vector<double>& distances,
+                                                EigenSTL::vector_Vector3d& gradients) const;
+
+  /**
+   * \brief Gets the distance and the gradient at a location, as \ref
+   * DistanceField::getDistanceGradient.  If gradient caching is
+   * enabled (see \ref setGradientCaching), the gradient is read from
+   * the cache instead of being computed from six distances.
+   */
+  virtual double getDistanceGradient(double x, double y, double z,
+                                     double& gradient_x, double& gradient_y, double& gradient_z,
+                                     bool& in_bounds) const;
+
+  /**
+   * \brief Gets trilinearly interpolated distances at a batch of
+   * points, with gradients that are the trilinear interpolation of
+   * the central difference gradients of the cells around each point
+   * (one-sided differences at the border of the field).
+   *
+   * Unlike the gradients of \ref getInterpolatedDistanceGradients,
+   * which are discontinuous across cell faces, these gradients vary
+   * continuously with the location, which helps the convergence of
+   * optimizers.  The cell gradients are read from the gradient cache
+   * if it is enabled (see \ref setGradientCaching), and computed on
+   * the fly otherwise.  Points outside the field get the
+   * uninitialized distance and a zero gradient.
+   *
+   * @return True if all points are inside the distance field
+   */
+  bool getSmoothDistanceGradients(const EigenSTL::vector_Vector3d& points,
+                                  std::vector<double>& distances,
+                                  EigenSTL::vector_Vector3d& gradients) const;
+
+  /**
+   * \brief Enables or disables the gradient cache.
+   *
+   * The cache holds the gradient of every cell (12 bytes per cell)
+   * and is computed lazily, a block of cells at a time, the first
+   * time a gradient of the block is queried after the distances
+   * changed.  Since queries then write to the cache, concurrent
+   * queries from several threads are only safe after \ref
+   * updateGradientCache has been called.  Disabled by default.
+   */
+  void setGradientCaching(bool flag);
+
+  /** \brief Whether the gradient cache is enabled */
+  bool getGradientCaching() const
+  {
+    return !gradient_block_valid_.empty();
+  }
+
+  /** \brief Computes the cached gradients of all blocks that are not up to date (if caching is enabled) */
+  void updateGradientCache() const;
+
   virtual bool isCellValid(int x, int y, int z) const;
   virtual int getXNumCells() const;
   virtual int getYNumCells() const;
@@ -373,6 +461,76 @@ public:
    */
   virtual bool readFromStream(std::istream& stream);
 
+  /**
+   * \brief Writes the complete distance field, including all
+   * computed distances, to a binary file that \ref mapBinaryFile can
+   * map without any further processing.
+   *
+   * The file holds a versioned header with the size, resolution,
+   * origin, maximum distance and signedness of the field, followed by
+   * the voxels as stored in memory.  The format is only portable
+   * between hosts of the same byte order and voxel layout.
+   *
+   * @param [in] filename The file to write
+   *
+   * @return True if the file was written successfully; otherwise False.
+   */
+  bool writeToBinaryFile(const std::string& filename) const;
+
+  /**
+   * \brief Replaces the distance field by the one in a file written
+   * by \ref writeToBinaryFile.  The file is memory mapped and used
+   * directly as the voxel storage, so no propagation is needed and
+   * startup time does not depend on the size of the field.
+   *
+   * The mapping is private: pages are read from the file as they are
+   * accessed and shared by all processes mapping the same file, until
+   * a process modifies the field, which makes a private copy of the
+   * modified pages.  The file itself is never written.  The size,
+   * resolution, origin, maximum distance and signedness of the field
+   * are all taken from the file, and sparse storage is disabled.
+   *
+   * @param [in] filename The file to map
+   *
+   * @return True if the file was mapped successfully; otherwise
+   * False, and the field is left unchanged.
+   */
+  bool mapBinaryFile(const std::string& filename);
+
+  /**
+   * \brief Moves the volume of the field by a whole number of cells
+   * along each axis, e.g. to follow a mobile robot.
+   *
+   * No data is moved: the cells are addressed circularly (see \ref
+   * VoxelGrid::shift).  The cells that remain inside the volume keep
+   * their distances, the newly exposed cells start without obstacles,
+   * and distances are propagated again only for the cells whose
+   * closest obstacle (or unoccupied cell) left the volume and for
+   * the newly exposed cells, which are near the boundary of the
+   * previous volume.  The closest points stored in the cells are
+   * translated in a single pass over the grid.  Obstacles in the
+   * newly exposed cells must be added by the caller.  If the volume
+   * moves by its full size or more along an axis, the field is reset.
+   *
+   * Not supported with sparse storage.
+   *
+   * @param [in] dx The number of cells to move the origin by along X
+   * @param [in] dy The number of cells to move the origin by along Y
+   * @param [in] dz The number of cells to move the origin by along Z
+   *
+   * @return False if the field uses sparse storage, in which case
+   * nothing is done
+   */
+  bool shiftOrigin(int dx, int dy, int dz);
+
+  /**
+   * \brief Moves the volume by whole cells with \ref shiftOrigin, so
+   * that its center is as close as possible to the given location.
+   *
+   * @return As \ref shiftOrigin
+   */
+  bool recenter(double x, double y, double z);
+
   //passthrough docs to DistanceField
   virtual double getUninitializedDistance() const
   {
@@ -392,7 +550,7 @@ public:
    */
   const PropDistanceFieldVoxel& getCell(int x, int y, int z) const 
   {
-    return voxel_grid_->getCell(x, y, z);
+    return getVoxel(x, y, z);
   }
 
   /**
@@ -415,19 +573,19 @@ public:
    */
   const PropDistanceFieldVoxel* getNearestCell(int x, int y, int z, double& dist, Eigen::Vector3i& pos) const
   {
-    const PropDistanceFieldVoxel* cell = &voxel_grid_->getCell(x, y, z);
+    const PropDistanceFieldVoxel* cell = &getVoxel(x, y, z);
     if (cell->distance_square_ > 0)
     {
       dist = sqrt_table_[cell->distance_square_];
       pos = cell->closest_point_;
-      const PropDistanceFieldVoxel* ncell = &voxel_grid_->getCell(pos.x(), pos.y(), pos.z());
+      const PropDistanceFieldVoxel* ncell = &getVoxel(pos.x(), pos.y(), pos.z());
       return ncell == cell ? NULL : ncell;
     }
     if (cell->negative_distance_square_ > 0)
     {
       dist = -sqrt_table_[cell->negative_distance_square_];
       pos = cell->closest_negative_point_;
-      const PropDistanceFieldVoxel* ncell = &voxel_grid_->getCell(pos.x(), pos.y(), pos.z());
+      const PropDistanceFieldVoxel* ncell = &getVoxel(pos.x(), pos.y(), pos.z());
       return ncell == cell ? NULL : ncell;
     }
     dist = 0.0;
@@ -450,10 +608,160 @@ public:
     return max_distance_sq_;
   }
 
+  /**
+   * \brief Whether the cells are kept in sparse storage (see the
+   * constructor).
+   */
+  bool usesSparseStorage() const
+  {
+    return sparse_storage_;
+  }
+
+  /**
+   * \brief Gets the number of cells memory is allocated for.  This
+   * is the total number of cells, unless sparse storage is used.
+   */
+  std::size_t getAllocatedCellCount() const
+  {
+    if (sparse_grid_)
+      return sparse_grid_->getAllocatedBlockCount() * sparse_grid_->getBlockCellCount();
+    return (std::size_t)getXNumCells() * getYNumCells() * getZNumCells();
+  }
+
+  /**
+   * \brief Sets the identifier attached to the obstacle cells added
+   * from now on, by any of the functions that add points or shapes to
+   * the field.  A cell added again takes the identifier current at
+   * that time, and loses it when removed.  Identifiers are not
+   * written by \ref writeToStream or \ref writeToBinaryFile.
+   *
+   * Since every cell records its closest obstacle cell, this makes
+   * \ref getClosestObstacleId answer which obstacle is closest with
+   * a single lookup.  The distance to a particular obstacle that is
+   * not the closest one is not represented; use a separate field for
+   * it.
+   *
+   * @param [in] id The identifier, or \ref NO_OBSTACLE_ID (the
+   * default) to add untagged cells
+   */
+  void setObstacleId(int id)
+  {
+    obstacle_id_ = id;
+  }
+
+  /**
+   * \brief Gets the identifier attached to obstacle cells added from
+   * now on.
+   */
+  int getObstacleId() const
+  {
+    return obstacle_id_;
+  }
+
+  /**
+   * \brief Gets the identifier of the obstacle closest to a cell.
+   *
+   * x,y,z MUST be valid or data corruption (SEGFAULTS) will occur.
+   *
+   * @return The identifier set with \ref setObstacleId when the
+   * closest obstacle cell was added, or \ref NO_OBSTACLE_ID if it was
+   * untagged or no obstacle is within the maximum distance
+   */
+  int getClosestObstacleId(int x, int y, int z) const;
+
+  /**
+   * \brief Gets the identifier of the obstacle closest to a world
+   * location, and the distance to it, in a single lookup.
+   *
+   * @param [out] distance The distance at the location, as from \ref
+   * getDistance; the uninitialized distance if the location is
+   * outside the field
+   *
+   * @return As \ref getClosestObstacleId(int, int, int) const, or
+   * \ref NO_OBSTACLE_ID if the location is outside the field
+   */
+  int getClosestObstacleId(double x, double y, double z, double& distance) const;
+
+  static const int NO_OBSTACLE_ID = -1; /**< \brief Identifier of untagged obstacle cells */
+
+  /**
+   * \brief Sets the number of threads used to propagate distances.
+   *
+   * With more than one thread, the cells of every distance level are
+   * processed in parallel: the grid is split into slabs along X, and
+   * alternating slabs are processed at the same time, so no two
+   * threads update the same cell.  The threads come from the shared
+   * moveit::tools::ThreadPool, so at most its thread count is used.
+   * The default is 1 (serial propagation).  Grids too thin along X to give every thread two
+   * slabs at least two cells wide use fewer threads.
+   * Propagation is always serial with sparse storage.
+   *
+   * @param [in] threads The number of threads (0 is treated as 1)
+   */
+  void setPropagationThreadCount(unsigned int threads)
+  {
+    propagation_threads_ = threads > 0 ? threads : 1;
+  }
+
+  /**
+   * \brief Gets the number of threads used to propagate distances.
+   *
+   * @return The number of threads
+   */
+  unsigned int getPropagationThreadCount() const
+  {
+    return propagation_threads_;
+  }
+
 private:
 
   typedef std::set<Eigen::Vector3i, compareEigen_Vector3i> VoxelSet; /**< \brief Typedef for set of integer indices */
 
+  typedef int PropDistanceFieldVoxel::*VoxelIntMember; /**< \brief A distance or direction member of a voxel */
+  typedef Eigen::Vector3i PropDistanceFieldVoxel::*VoxelPointMember; /**< \brief A closest point member of a voxel */
+
+  struct SlabPropagation;
+
+  /// Reads cell distances for the batch queries, bypassing the virtual getDistance()
+  struct CellDistance;
+
+  /** \brief The cells along each axis of a block of the gradient cache is 2^GRADIENT_BLOCK_LOG2 */
+  static const int GRADIENT_BLOCK_LOG2 = 3;
+
+  /** \brief Marks all blocks of the gradient cache as out of date; called whenever distances change */
+  void invalidateGradientCache()
+  {
+    std::fill(gradient_block_valid_.begin(), gradient_block_valid_.end(), 0);
+  }
+
+  /** \brief Gets the cached gradient of a (valid) cell, computing the gradients of its block if needed */
+  const Eigen::Vector3f& getCachedGradient(int x, int y, int z) const;
+
+  /** \brief Computes the gradient of a (valid) cell by central differences, one-sided at the border of the field */
+  Eigen::Vector3f computeCellGradient(int x, int y, int z) const;
+
+  /** \brief Computes the gradients of the cells of block \e block (at block indices \e bx, \e by, \e bz) */
+  void computeGradientBlock(int bx, int by, int bz, std::size_t block) const;
+
+  /** \brief Gets the number of blocks of the gradient cache along \e dim */
+  int getGradientBlockCount(Dimension dim) const
+  {
+    return ((dim == DIM_X ? getXNumCells() : dim == DIM_Y ? getYNumCells() : getZNumCells()) +
+            (1 << GRADIENT_BLOCK_LOG2) - 1) >> GRADIENT_BLOCK_LOG2;
+  }
+
+  /**
+   * \brief Attaches the current obstacle identifier to a (valid)
+   * obstacle cell.
+   */
+  void tagObstacleVoxel(const Eigen::Vector3i& loc)
+  {
+    if (obstacle_id_ != NO_OBSTACLE_ID)
+      obstacle_ids_[loc] = obstacle_id_;
+    else if (!obstacle_ids_.empty())
+      obstacle_ids_.erase(loc);
+  }
+
   /**
    * \brief Initializes the field, resetting the voxel grid and
    * building a sqrt lookup table for efficiency based on
@@ -462,6 +770,13 @@ private:
    */
   void initialize();
 
+  /**
+   * \brief Computes the maximum squared distance in cells and the
+   * tables that depend on it (neighborhoods, bucket queues, sqrt
+   * table).
+   */
+  void initializeTables();
+
   /**
    * \brief Adds a valid set of integer points to the voxel grid
    *
@@ -476,6 +791,23 @@ private:
    */
   void removeObstacleVoxels(const std::vector<Eigen::Vector3i>& voxel_points);
 
+  /**
+   * \brief Resets the cells on \e stack and the cells around them
+   * whose closest obstacle is no longer an obstacle, and queues the
+   * cells next to them that still have a closest obstacle for
+   * positive propagation.  The cells on \e stack must already be
+   * reset.  \e stack is emptied.
+   */
+  void resetOrphanedVoxels(std::vector<Eigen::Vector3i>& stack);
+
+  /**
+   * \brief As \ref resetOrphanedVoxels, for negative distances:
+   * resets the cells whose closest unoccupied cell is no longer
+   * unoccupied and queues the cells next to them for negative
+   * propagation.
+   */
+  void resetOrphanedNegativeVoxels(std::vector<Eigen::Vector3i>& negative_stack);
+
   /**
    * \brief Propagates outward to the maximum distance given the
    * contents of the \ref bucket_queue_, and clears the \ref
@@ -492,6 +824,41 @@ private:
    */
   void propagateNegative();
 
+  /**
+   * \brief Propagates the contents of \e bucket_queue using
+   * \ref propagation_threads_ threads of the shared
+   * moveit::tools::ThreadPool, and clears \e bucket_queue.
+   * The members of the voxels that are updated are given by \e
+   * distance, \e closest and \e direction, so both positive and
+   * negative propagation use this function.
+   *
+   * @return False if the grid is too small to be split into slabs, in
+   * which case nothing is done
+   */
+  bool propagateInSlabs(std::vector<std::vector<Eigen::Vector3i> >& bucket_queue,
+                        VoxelIntMember distance, VoxelPointMember closest, VoxelIntMember direction);
+
+  /**
+   * \brief The work of one thread in a phase of \ref propagateInSlabs:
+   * processes the slab of parity \e parity assigned to the thread, at
+   * the current level
+   *
+   * @param sp The shared propagation state
+   * @param parity 0 for the even slabs, 1 for the odd slabs
+   * @param thread The index of the thread
+   */
+  void propagateSlabs(SlabPropagation& sp, unsigned int parity, std::size_t thread);
+
+  /**
+   * \brief Processes the cells of a slab at a distance level, reading from
+   * the queues of the slab and of its two neighbors
+   *
+   * @param sp The shared propagation state
+   * @param slab The slab to process
+   * @param level The distance level
+   */
+  void propagateSlab(SlabPropagation& sp, unsigned int slab, unsigned int level);
+
   /**
    * \brief Determines distance based on actual voxel data
    *
@@ -523,6 +890,21 @@ private:
    */
   Eigen::Vector3i getLocationDifference(int directionNumber) const;
 
+  /**
+   * \brief Gets a cell from whichever grid holds the data; with
+   * sparse storage, this allocates the block of the cell.
+   */
+  PropDistanceFieldVoxel& getVoxel(int x, int y, int z)
+  {
+    return sparse_grid_ ? sparse_grid_->getCell(x, y, z) : voxel_grid_->getCell(x, y, z);
+  }
+
+  const PropDistanceFieldVoxel& getVoxel(int x, int y, int z) const
+  {
+    return sparse_grid_ ? static_cast<const SparseVoxelGrid<PropDistanceFieldVoxel>&>(*sparse_grid_).getCell(x, y, z) :
+      voxel_grid_->getCell(x, y, z);
+  }
+
   /**
    * \brief Helper function for computing location and neighborhood
    * information in 27 connected voxel grid.
@@ -556,8 +938,20 @@ private:
 
   bool propagate_negative_;     /**< \brief Whether or not to propagate negative distances */
 
+  unsigned int propagation_threads_; /**< \brief The number of threads used to propagate distances */
+
+  bool sparse_storage_;         /**< \brief Whether the cells are kept in \e sparse_grid_ rather than \e voxel_grid_ */
+
+  int obstacle_id_;             /**< \brief The identifier attached to obstacle cells being added */
+
+  std::map<Eigen::Vector3i, int, compareEigen_Vector3i> obstacle_ids_; /**< \brief The identifiers of the tagged obstacle cells */
+
   boost::shared_ptr<VoxelGrid<PropDistanceFieldVoxel> > voxel_grid_; /**< \brief Actual container for distance data */
 
+  boost::shared_ptr<SparseVoxelGrid<PropDistanceFieldVoxel> > sparse_grid_; /**< \brief Container for distance data when sparse storage is used */
+
+  boost::shared_ptr<boost::iostreams::mapped_file> mapped_file_; /**< \brief The file \e voxel_grid_ uses as storage, if set by \ref mapBinaryFile */
+
   /// \brief Structure used to hold propagation frontier
   std::vector<std::vector<Eigen::Vector3i> > bucket_queue_; /**< \brief Data member that holds points from which to propagate, where each vector holds points that are a particular integer distance from the closest obstacle points*/
 
@@ -583,6 +977,9 @@ private:
   std::vector<std::vector<std::vector<Eigen::Vector3i > > > neighborhoods_;
 
   std::vector<Eigen::Vector3i > direction_number_to_direction_; /**< \brief Holds conversion from direction number to integer changes */
+
+  mutable std::vector<Eigen::Vector3f> gradient_cache_; /**< \brief The cached gradient of each cell, in the order of a \ref VoxelGrid */
+  mutable std::vector<char> gradient_block_valid_; /**< \brief Whether each block of \e gradient_cache_ is up to date; empty if caching is disabled */
 };
 
 ////////////////////////// inline functions follow ////////////////////////////////////////
@@ -0,0 +1,170 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2013, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#ifndef MOVEIT_DISTANCE_FIELD_QUANTIZED_DISTANCE_FIELD_
+#define MOVEIT_DISTANCE_FIELD_QUANTIZED_DISTANCE_FIELD_
+
+#include <moveit/distance_field/voxel_grid.h>
+#include <moveit/distance_field/distance_field.h>
+#include <boost/cstdint.hpp>
+#include <vector>
+
+namespace distance_field
+{
+
+/**
+ * \brief A compact, read-only copy of the distances of another
+ * DistanceField (e.g. a \ref PropagationDistanceField), for
+ * consumers that query a field many times between changes (such as
+ * optimizing planners).
+ *
+ * Each cell holds its signed distance quantized to 16 bits, in steps
+ * of the maximum distance divided by 32767, so the error of a
+ * distance is at most half a step and a cell takes 2 bytes instead
+ * of the 40 bytes of a \ref PropDistanceFieldVoxel.  No closest
+ * points are kept: gradients are computed by finite differences
+ * (\ref DistanceField::getDistanceGradient) or from the trilinear
+ * interpolation of the distances (\ref getInterpolatedDistanceGradients).
+ *
+ * The copy is made by \ref quantize, which should be called again
+ * after the source field changes.  Obstacles cannot be added to or
+ * removed from this field directly: the functions that would modify
+ * its obstacles report an error and leave the field unchanged.
+ */
+class QuantizedDistanceField: public DistanceField
+{
+public:
+
+  /**
+   * \brief Constructs a copy of the geometry and of the distances of
+   * \e field.  Distances are clamped to [-\e max_distance, \e
+   * max_distance], which is also the distance of cells outside the
+   * field.
+   */
+  QuantizedDistanceField(const DistanceField& field, double max_distance);
+
+  virtual ~QuantizedDistanceField()
+  {
+  }
+
+  /**
+   * \brief Copies the distances of \e field, which must have the same
+   * number of cells as this field.  Returns false (and leaves the
+   * field unchanged) otherwise.
+   */
+  bool quantize(const DistanceField& field);
+
+  /** \brief The difference between consecutive distances that can be represented */
+  double getQuantizationStep() const
+  {
+    return step_;
+  }
+
+  /** \brief Not supported: reports an error */
+  virtual void addPointsToField(const EigenSTL::vector_Vector3d& points);
+
+  /** \brief Not supported: reports an error */
+  virtual void removePointsFromField(const EigenSTL::vector_Vector3d& points);
+
+  /** \brief Not supported: reports an error */
+  virtual void updatePointsInField(const EigenSTL::vector_Vector3d& old_points,
+                                   const EigenSTL::vector_Vector3d& new_points);
+
+  /** \brief Sets all distances to the maximum distance */
+  virtual void reset();
+
+  virtual double getDistance(double x, double y, double z) const;
+
+  virtual double getDistance(int x, int y, int z) const;
+
+  virtual bool getInterpolatedDistances(const EigenSTL::vector_Vector3d& points,
+                                        std::vector<double>& distances) const;
+
+  virtual bool getInterpolatedDistanceGradients(const EigenSTL::vector_Vector3d& points,
+                                                std::vector<double>& distances,
+                                                EigenSTL::vector_Vector3d& gradients) const;
+
+  virtual bool isCellValid(int x, int y, int z) const;
+
+  virtual int getXNumCells() const;
+
+  virtual int getYNumCells() const;
+
+  virtual int getZNumCells() const;
+
+  virtual bool gridToWorld(int x, int y, int z, double& world_x, double& world_y, double& world_z) const;
+
+  virtual bool worldToGrid(double world_x, double world_y, double world_z, int& x, int& y, int& z) const;
+
+  /**
+   * \brief Writes the geometry, the maximum distance and the
+   * quantized distances to a stream (the distances are zlib
+   * compressed).
+   */
+  virtual bool writeToStream(std::ostream& stream) const;
+
+  /**
+   * \brief Reads a field written by \ref writeToStream, replacing the
+   * geometry, the maximum distance and the distances of this field.
+   */
+  virtual bool readFromStream(std::istream& stream);
+
+  virtual double getUninitializedDistance() const
+  {
+    return max_distance_;
+  }
+
+private:
+
+  /// Reads cell distances for the batch queries, bypassing the virtual getDistance()
+  struct CellDistance;
+
+  /** \brief Allocates the grid for the current geometry and computes the quantization step */
+  void initialize();
+
+  double decode(boost::int16_t value) const
+  {
+    return value * step_;
+  }
+
+  boost::int16_t encode(double distance) const;
+
+  VoxelGrid<boost::int16_t> grid_; /**< \brief The quantized distance of each cell */
+  double max_distance_;         /**< \brief Distances are clamped to this value (in absolute value) */
+  double step_;                 /**< \brief The distance one unit of a quantized value represents */
+};
+
+}
+
+#endif
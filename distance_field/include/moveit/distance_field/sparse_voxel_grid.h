@@ -0,0 +1,338 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2013, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+
+#ifndef MOVEIT_DISTANCE_FIELD_SPARSE_VOXEL_GRID_
+#define MOVEIT_DISTANCE_FIELD_SPARSE_VOXEL_GRID_
+
+#include <moveit/distance_field/voxel_grid.h>
+#include <vector>
+#include <cstddef>
+
+namespace distance_field
+{
+
+/**
+ * \brief SparseVoxelGrid holds a 3D, axis-aligned set of data at a
+ * given resolution, like \ref VoxelGrid, but only allocates storage
+ * for the parts of the volume that are written to.
+ *
+ * The volume is split into cubic blocks of 2^LOG2_BLOCK_SIZE cells
+ * per side.  A block is allocated, and filled with the value given
+ * to \ref reset, the first time one of its cells is accessed through
+ * a non-const function; const accesses to cells of blocks that were
+ * never allocated return that value without allocating.  Only a
+ * directory of one pointer per block is allocated up front.
+ *
+ * The class is not thread safe: concurrent non-const accesses may
+ * allocate the same block twice.
+ */
+template <typename T, int LOG2_BLOCK_SIZE = 3>
+class SparseVoxelGrid
+{
+public:
+  /**
+   * \brief Constructor for the SparseVoxelGrid.  The arguments are
+   * the same as for the \ref VoxelGrid constructor; no blocks are
+   * allocated, and all cells read as \e default_object until \ref
+   * reset is called.
+   */
+  SparseVoxelGrid(double size_x, double size_y, double size_z, double resolution,
+                  double origin_x, double origin_y, double origin_z, T default_object);
+
+  ~SparseVoxelGrid();
+
+  /**
+   * \brief Resize the grid.  This frees all blocks.
+   */
+  void resize(double size_x, double size_y, double size_z, double resolution,
+              double origin_x, double origin_y, double origin_z, T default_object);
+
+  /**
+   * \brief The value at a world location, or the default object
+   * if the location is not valid.  Never allocates.
+   */
+  const T& operator()(double x, double y, double z) const;
+
+  /**
+   * \brief Gets the value of a cell, allocating its block if needed.
+   * No validity check.
+   */
+  T& getCell(int x, int y, int z);
+
+  /**
+   * \brief Gets the value of a cell; cells of unallocated blocks
+   * return the value given to \ref reset.  No validity check.
+   */
+  const T& getCell(int x, int y, int z) const;
+
+  /** \brief Sets the value of a cell, allocating its block if needed.  No validity check. */
+  void setCell(int x, int y, int z, const T& obj);
+
+  /**
+   * \brief Frees all blocks; afterwards every cell reads as \e
+   * initial, and newly allocated blocks are filled with it.
+   */
+  void reset(const T& initial);
+
+  /** \brief Whether the block holding a (valid) cell is allocated */
+  bool isCellAllocated(int x, int y, int z) const;
+
+  /** \brief The number of allocated blocks */
+  std::size_t getAllocatedBlockCount() const
+  {
+    return allocated_blocks_;
+  }
+
+  /** \brief The number of cells in a block */
+  static int getBlockCellCount()
+  {
+    return 1 << (3*LOG2_BLOCK_SIZE);
+  }
+
+  double getSize(Dimension dim) const;
+  double getResolution() const;
+  double getOrigin(Dimension dim) const;
+  int getNumCells(Dimension dim) const;
+
+  /** \brief Converts grid coordinates to world coordinates, as \ref VoxelGrid::gridToWorld */
+  void gridToWorld(int x, int y, int z, double& world_x, double& world_y, double& world_z) const;
+
+  /** \brief Converts world coordinates to grid coordinates, as \ref VoxelGrid::worldToGrid */
+  bool worldToGrid(double world_x, double world_y, double world_z, int& x, int& y, int& z) const;
+
+  bool isCellValid(int x, int y, int z) const;
+
+private:
+  static const int MASK = (1 << LOG2_BLOCK_SIZE) - 1;
+
+  // the blocks are owned by the grid
+  SparseVoxelGrid(const SparseVoxelGrid&);
+  SparseVoxelGrid& operator=(const SparseVoxelGrid&);
+
+  /** \brief Frees all blocks */
+  void clearBlocks();
+
+  /** \brief Index of the block holding a cell, in \e blocks_ */
+  std::size_t blockRef(int x, int y, int z) const
+  {
+    return (static_cast<std::size_t>(x >> LOG2_BLOCK_SIZE)*blocks_[DIM_Y] + (y >> LOG2_BLOCK_SIZE))*blocks_[DIM_Z] + (z >> LOG2_BLOCK_SIZE);
+  }
+
+  /** \brief Index of a cell within its block */
+  static int cellRef(int x, int y, int z)
+  {
+    return ((x & MASK) << (2*LOG2_BLOCK_SIZE)) | ((y & MASK) << LOG2_BLOCK_SIZE) | (z & MASK);
+  }
+
+  int getCellFromLocation(Dimension dim, double loc) const;
+
+  std::vector<T*> data_;        /**< \brief One pointer per block, NULL for blocks that are not allocated */
+  std::size_t allocated_blocks_; /**< \brief The number of non-NULL entries of \e data_ */
+  T default_object_;            /**< \brief The object to return in case of out-of-bounds query */
+  T fill_object_;               /**< \brief The value of cells that were never written */
+  double size_[3];              /**< \brief The size of each dimension in meters (in Dimension order) */
+  double resolution_;           /**< \brief The resolution of each dimension in meters */
+  double oo_resolution_;        /**< \brief 1.0/resolution_ */
+  double origin_[3];            /**< \brief The origin (minumum point) of each dimension in meters (in Dimension order) */
+  double origin_minus_[3];      /**< \brief origin - 0.5/resolution */
+  int num_cells_[3];            /**< \brief The number of cells in each dimension (in Dimension order) */
+  int blocks_[3];               /**< \brief The number of blocks in each dimension (in Dimension order) */
+};
+
+//////////////////////////// template function definitions follow //////////////////
+
+template<typename T, int LOG2_BLOCK_SIZE>
+SparseVoxelGrid<T, LOG2_BLOCK_SIZE>::SparseVoxelGrid(double size_x, double size_y, double size_z, double resolution,
+                                                     double origin_x, double origin_y, double origin_z, T default_object)
+  : allocated_blocks_(0)
+{
+  resize(size_x, size_y, size_z, resolution, origin_x, origin_y, origin_z, default_object);
+}
+
+template<typename T, int LOG2_BLOCK_SIZE>
+SparseVoxelGrid<T, LOG2_BLOCK_SIZE>::~SparseVoxelGrid()
+{
+  clearBlocks();
+}
+
+template<typename T, int LOG2_BLOCK_SIZE>
+void SparseVoxelGrid<T, LOG2_BLOCK_SIZE>::resize(double size_x, double size_y, double size_z, double resolution,
+                                                 double origin_x, double origin_y, double origin_z, T default_object)
+{
+  clearBlocks();
+
+  size_[DIM_X] = size_x;
+  size_[DIM_Y] = size_y;
+  size_[DIM_Z] = size_z;
+  origin_[DIM_X] = origin_x;
+  origin_[DIM_Y] = origin_y;
+  origin_[DIM_Z] = origin_z;
+  resolution_ = resolution;
+  oo_resolution_ = 1.0 / resolution_;
+  std::size_t block_count = 1;
+  for (int i=DIM_X; i<=DIM_Z; ++i)
+  {
+    origin_minus_[i] = origin_[i] - 0.5 * resolution;
+    num_cells_[i] = size_[i] * oo_resolution_;
+    blocks_[i] = (num_cells_[i] + MASK) >> LOG2_BLOCK_SIZE;
+    block_count *= blocks_[i];
+  }
+
+  default_object_ = default_object;
+  fill_object_ = default_object;
+  data_.assign(block_count, static_cast<T*>(NULL));
+}
+
+template<typename T, int LOG2_BLOCK_SIZE>
+void SparseVoxelGrid<T, LOG2_BLOCK_SIZE>::clearBlocks()
+{
+  for (std::size_t i = 0 ; i < data_.size() ; ++i)
+  {
+    delete[] data_[i];
+    data_[i] = NULL;
+  }
+  moveit::tools::MemoryAccounting::Release(moveit::tools::MemoryAccounting::DISTANCE_FIELD,
+                                           sizeof(T) * getBlockCellCount() * allocated_blocks_);
+  allocated_blocks_ = 0;
+}
+
+template<typename T, int LOG2_BLOCK_SIZE>
+inline void SparseVoxelGrid<T, LOG2_BLOCK_SIZE>::reset(const T& initial)
+{
+  clearBlocks();
+  fill_object_ = initial;
+}
+
+template<typename T, int LOG2_BLOCK_SIZE>
+inline T& SparseVoxelGrid<T, LOG2_BLOCK_SIZE>::getCell(int x, int y, int z)
+{
+  T*& block = data_[blockRef(x, y, z)];
+  if (!block)
+  {
+    block = new T[getBlockCellCount()];
+    std::fill(block, block + getBlockCellCount(), fill_object_);
+    ++allocated_blocks_;
+    moveit::tools::MemoryAccounting::Add(moveit::tools::MemoryAccounting::DISTANCE_FIELD, sizeof(T) * getBlockCellCount());
+  }
+  return block[cellRef(x, y, z)];
+}
+
+template<typename T, int LOG2_BLOCK_SIZE>
+inline const T& SparseVoxelGrid<T, LOG2_BLOCK_SIZE>::getCell(int x, int y, int z) const
+{
+  const T* block = data_[blockRef(x, y, z)];
+  return block ? block[cellRef(x, y, z)] : fill_object_;
+}
+
+template<typename T, int LOG2_BLOCK_SIZE>
+inline void SparseVoxelGrid<T, LOG2_BLOCK_SIZE>::setCell(int x, int y, int z, const T& obj)
+{
+  getCell(x, y, z) = obj;
+}
+
+template<typename T, int LOG2_BLOCK_SIZE>
+inline bool SparseVoxelGrid<T, LOG2_BLOCK_SIZE>::isCellAllocated(int x, int y, int z) const
+{
+  return data_[blockRef(x, y, z)] != NULL;
+}
+
+template<typename T, int LOG2_BLOCK_SIZE>
+inline const T& SparseVoxelGrid<T, LOG2_BLOCK_SIZE>::operator()(double x, double y, double z) const
+{
+  int cell_x, cell_y, cell_z;
+  if (!worldToGrid(x, y, z, cell_x, cell_y, cell_z))
+    return default_object_;
+  return getCell(cell_x, cell_y, cell_z);
+}
+
+template<typename T, int LOG2_BLOCK_SIZE>
+inline bool SparseVoxelGrid<T, LOG2_BLOCK_SIZE>::isCellValid(int x, int y, int z) const
+{
+  return (
+      x>=0 && x<num_cells_[DIM_X] &&
+      y>=0 && y<num_cells_[DIM_Y] &&
+      z>=0 && z<num_cells_[DIM_Z]);
+}
+
+template<typename T, int LOG2_BLOCK_SIZE>
+inline double SparseVoxelGrid<T, LOG2_BLOCK_SIZE>::getSize(Dimension dim) const
+{
+  return size_[dim];
+}
+
+template<typename T, int LOG2_BLOCK_SIZE>
+inline double SparseVoxelGrid<T, LOG2_BLOCK_SIZE>::getResolution() const
+{
+  return resolution_;
+}
+
+template<typename T, int LOG2_BLOCK_SIZE>
+inline double SparseVoxelGrid<T, LOG2_BLOCK_SIZE>::getOrigin(Dimension dim) const
+{
+  return origin_[dim];
+}
+
+template<typename T, int LOG2_BLOCK_SIZE>
+inline int SparseVoxelGrid<T, LOG2_BLOCK_SIZE>::getNumCells(Dimension dim) const
+{
+  return num_cells_[dim];
+}
+
+template<typename T, int LOG2_BLOCK_SIZE>
+inline int SparseVoxelGrid<T, LOG2_BLOCK_SIZE>::getCellFromLocation(Dimension dim, double loc) const
+{
+  // see VoxelGrid::getCellFromLocation()
+  return int(floor((loc - origin_minus_[dim]) * oo_resolution_));
+}
+
+template<typename T, int LOG2_BLOCK_SIZE>
+inline void SparseVoxelGrid<T, LOG2_BLOCK_SIZE>::gridToWorld(int x, int y, int z, double& world_x, double& world_y, double& world_z) const
+{
+  world_x = origin_[DIM_X] + resolution_ * double(x);
+  world_y = origin_[DIM_Y] + resolution_ * double(y);
+  world_z = origin_[DIM_Z] + resolution_ * double(z);
+}
+
+template<typename T, int LOG2_BLOCK_SIZE>
+inline bool SparseVoxelGrid<T, LOG2_BLOCK_SIZE>::worldToGrid(double world_x, double world_y, double world_z, int& x, int& y, int& z) const
+{
+  x = getCellFromLocation(DIM_X, world_x);
+  y = getCellFromLocation(DIM_Y, world_y);
+  z = getCellFromLocation(DIM_Z, world_z);
+  return isCellValid(x, y, z);
+}
+
+} // namespace distance_field
+#endif
@@ -40,6 +40,7 @@
 #include <algorithm>
 #include <cmath>
 #include <Eigen/Core>
+#include <moveit/profiler/memory_accounting.h>
 
 namespace distance_field
 {
@@ -118,6 +119,23 @@ public:
   void resize(double size_x, double size_y, double size_z, double resolution,
     double origin_x, double origin_y, double origin_z, T default_object);
 
+  /**
+   * \brief Makes the grid use externally owned storage, e.g. a
+   * memory mapped file, instead of its own.  The current data is
+   * discarded.  \e data must hold \ref getStorageSize elements in
+   * the storage order of the grid and must outlive the grid
+   * (or the next call to \ref resize).
+   *
+   * @param [in] data The storage to use
+   */
+  void setExternalData(T* data);
+
+  /**
+   * \brief Gets the number of elements the grid stores (the number
+   * of cells).
+   */
+  int getStorageSize() const;
+
   /**
    * \brief Operator that gets the value of the given location (x, y,
    * z) given the discretization of the volume.  The location
@@ -184,6 +202,34 @@ public:
    */
   void reset(const T& initial);
 
+  /**
+   * \brief Moves the volume by a whole number of cells along each
+   * axis, without moving any data.
+   *
+   * The cells are addressed circularly in storage, so a cell that
+   * remains inside the volume keeps its content (at the index that
+   * now corresponds to its location), and the cells that leave the
+   * volume become the newly exposed cells at the opposite side.  The
+   * content of the newly exposed cells is left unchanged and must be
+   * initialized by the caller.
+   *
+   * @param [in] dx The number of cells to move the origin by along X
+   * @param [in] dy The number of cells to move the origin by along Y
+   * @param [in] dz The number of cells to move the origin by along Z
+   */
+  void shift(int dx, int dy, int dz);
+
+  /**
+   * \brief Gets the offset in storage of the cells along the given
+   * dimension, due to \ref shift.  Cell \e i along \e dim is stored
+   * where cell (i + offset) modulo the number of cells would be
+   * stored in an unshifted grid.
+   */
+  int getCellOffset(Dimension dim) const
+  {
+    return offset_[dim];
+  }
+
   /**
    * \brief Gets the size in arbitrary units of the indicated dimension
    *
@@ -285,6 +331,7 @@ public:
 
 protected:
   T* data_;                     /**< \brief Storage for the full set of data elements */
+  bool owns_data_;              /**< \brief Whether \e data_ was allocated by the grid */
   T default_object_;            /**< \brief The default object to return in case of out-of-bounds query */
   T*** data_ptrs_;              /**< \brief 3D array of pointers to the data elements */
   double size_[3];              /**< \brief The size of each dimension in meters (in Dimension order) */
@@ -294,9 +341,16 @@ protected:
   double origin_minus_[3];       /**< \brief origin - 0.5/resolution */
   int num_cells_[3];            /**< \brief The number of cells in each dimension (in Dimension order) */
   int num_cells_total_;         /**< \brief The total number of voxels in the grid */
+  int offset_[3];               /**< \brief The circular offset of the cells in storage, set by \ref shift */
   int stride1_;                 /**< \brief The step to take when stepping between consecutive X members in the 1D array */
   int stride2_;                 /**< \brief The step to take when stepping between consecutive Y members given an X in the 1D array */
 
+  /**
+   * \brief Frees \e data_ if it is owned by the grid (the storage size
+   * must still be the one it was allocated with)
+   */
+  void releaseData();
+
   /**
    * \brief Gets the 1D index into the array, with no validity check.
    *
@@ -340,14 +394,14 @@ protected:
 template<typename T>
 VoxelGrid<T>::VoxelGrid(double size_x, double size_y, double size_z, double resolution,
     double origin_x, double origin_y, double origin_z, T default_object)
-  : data_(NULL)
+  : data_(NULL), owns_data_(true)
 {
   resize(size_x, size_y, size_z, resolution, origin_x, origin_y, origin_z, default_object);
 }
 
 template<typename T>
 VoxelGrid<T>::VoxelGrid()
-  : data_(NULL)
+  : data_(NULL), owns_data_(true)
 {
   for (int i=DIM_X; i<=DIM_Z; ++i)
   {
@@ -355,6 +409,7 @@ VoxelGrid<T>::VoxelGrid()
     origin_[i] = 0;
     origin_minus_[i] = 0;
     num_cells_[i] = 0;
+    offset_[i] = 0;
   }
   resolution_ = 1.0;
   oo_resolution_ = 1.0 / resolution_;
@@ -367,8 +422,9 @@ template<typename T>
 void VoxelGrid<T>::resize(double size_x, double size_y, double size_z, double resolution,
     double origin_x, double origin_y, double origin_z, T default_object)
 {
-  delete[] data_;
+  releaseData();
   data_ = NULL;
+  owns_data_ = true;
 
   size_[DIM_X] = size_x;
   size_[DIM_Y] = size_y;
@@ -386,6 +442,7 @@ void VoxelGrid<T>::resize(double size_x, double size_y, double size_z, double re
   {
     num_cells_[i] = size_[i] * oo_resolution_;
     num_cells_total_ *= num_cells_[i];
+    offset_[i] = 0;
   }
 
   default_object_ = default_object;
@@ -395,13 +452,42 @@ void VoxelGrid<T>::resize(double size_x, double size_y, double size_z, double re
 
   // initialize the data:
   if (num_cells_total_ > 0)
+  {
     data_ = new T[num_cells_total_];
+    moveit::tools::MemoryAccounting::Add(moveit::tools::MemoryAccounting::DISTANCE_FIELD,
+                                         sizeof(T) * (std::size_t)num_cells_total_);
+  }
 }
 
 template<typename T>
 VoxelGrid<T>::~VoxelGrid()
 {
-  delete[] data_;
+  releaseData();
+}
+
+template<typename T>
+void VoxelGrid<T>::setExternalData(T* data)
+{
+  releaseData();
+  data_ = data;
+  owns_data_ = false;
+}
+
+template<typename T>
+void VoxelGrid<T>::releaseData()
+{
+  if (owns_data_ && data_)
+  {
+    delete[] data_;
+    moveit::tools::MemoryAccounting::Release(moveit::tools::MemoryAccounting::DISTANCE_FIELD,
+                                             sizeof(T) * (std::size_t)num_cells_total_);
+  }
+}
+
+template<typename T>
+inline int VoxelGrid<T>::getStorageSize() const
+{
+  return num_cells_total_;
 }
 
 template<typename T>
@@ -428,6 +514,16 @@ inline bool VoxelGrid<T>::isCellValid(Dimension dim, int cell) const
 template<typename T>
 inline int VoxelGrid<T>::ref(int x, int y, int z) const
 {
+  // the offsets are in [0, num_cells), so one subtraction wraps a valid index
+  x += offset_[DIM_X];
+  if (x >= num_cells_[DIM_X])
+    x -= num_cells_[DIM_X];
+  y += offset_[DIM_Y];
+  if (y >= num_cells_[DIM_Y])
+    y -= num_cells_[DIM_Y];
+  z += offset_[DIM_Z];
+  if (z >= num_cells_[DIM_Z])
+    z -= num_cells_[DIM_Z];
   return x*stride1_ + y*stride2_ + z;
 }
 
@@ -547,6 +643,19 @@ inline void VoxelGrid<T>::reset(const T& initial)
   std::fill(data_, data_ + num_cells_total_, initial);
 }
 
+template<typename T>
+void VoxelGrid<T>::shift(int dx, int dy, int dz)
+{
+  const int d[3] = { dx, dy, dz };
+  for (int i=DIM_X; i<=DIM_Z; ++i)
+  {
+    origin_[i] += d[i] * resolution_;
+    origin_minus_[i] = origin_[i] - 0.5 * resolution_;
+    if (num_cells_[i] > 0)
+      offset_[i] = ((offset_[i] + d[i]) % num_cells_[i] + num_cells_[i]) % num_cells_[i];
+  }
+}
+
 template<typename T>
 inline void VoxelGrid<T>::gridToWorld(int x, int y, int z, double& world_x, double& world_y, double& world_z) const
 {
@@ -36,11 +36,15 @@
 
 #include <moveit/distance_field/distance_field.h>
 #include <moveit/distance_field/find_internal_points.h>
+#include <moveit/background_processing/thread_pool.h>
 #include <geometric_shapes/body_operations.h>
 #include <eigen_conversions/eigen_msg.h>
 #include <console_bridge/console.h>
 #include <octomap/octomap.h>
 #include <octomap/OcTree.h>
+#include <boost/bind.hpp>
+#include <set>
+#include <algorithm>
 
 
 distance_field::DistanceField::DistanceField(double size_x, double size_y, double size_z, double resolution,
@@ -52,7 +56,11 @@ distance_field::DistanceField::DistanceField(double size_x, double size_y, doubl
   origin_y_(origin_y),
   origin_z_(origin_z),
   resolution_(resolution),
-  inv_twice_resolution_(1.0/(2.0*resolution_))
+  inv_twice_resolution_(1.0/(2.0*resolution_)),
+  voxelization_threads_(1),
+  visualization_threads_(1),
+  visualization_stride_(1),
+  cache_shape_points_(false)
 {
 }
 
@@ -86,6 +94,243 @@ double distance_field::DistanceField::getDistanceGradient(double x, double y, do
   return getDistance(gx,gy,gz);
 }
 
+namespace distance_field
+{
+namespace
+{
+
+/// Reads cell distances through the virtual DistanceField::getDistance()
+struct VirtualCellDistance
+{
+  VirtualCellDistance(const DistanceField &df) : df_(df)
+  {
+  }
+
+  double operator()(int x, int y, int z) const
+  {
+    return df_.getDistance(x, y, z);
+  }
+
+  const DistanceField &df_;
+};
+
+/// A box of cells visited with a stride along each axis; the cells are numbered in X, Y, Z order
+struct CellBox
+{
+  CellBox(int min_x, int min_y, int min_z, int max_x, int max_y, int max_z, int stride) : stride_(stride)
+  {
+    const int min[3] = { min_x, min_y, min_z };
+    const int max[3] = { max_x, max_y, max_z };
+    for (int k = 0 ; k < 3 ; ++k)
+    {
+      min_[k] = min[k];
+      count_[k] = max[k] >= min[k] ? (max[k] - min[k]) / stride + 1 : 0;
+    }
+  }
+
+  std::size_t size() const
+  {
+    return (std::size_t)count_[0] * count_[1] * count_[2];
+  }
+
+  void getCell(std::size_t i, int& x, int& y, int& z) const
+  {
+    z = min_[2] + (int)(i % count_[2]) * stride_;
+    i /= count_[2];
+    y = min_[1] + (int)(i % count_[1]) * stride_;
+    x = min_[0] + (int)(i / count_[1]) * stride_;
+  }
+
+  int min_[3];
+  int count_[3];
+  int stride_;
+};
+
+/// Runs \e worker on part \e part of \e parts contiguous ranges of the cells of \e box
+template <typename Worker, typename Output>
+void visitPart(const Worker* worker, const CellBox* box, std::size_t parts, std::vector<std::vector<Output> >* output, std::size_t part)
+{
+  (*worker)(*box, part * box->size() / parts, (part + 1) * box->size() / parts, &(*output)[part]);
+}
+
+/// Runs \e worker on contiguous ranges of the cells of \e box in \e threads threads of the shared pool, and appends
+/// their outputs to \e output in the order of the cells, so the result does not depend on the number of threads
+template <typename Worker, typename Output>
+void visitCells(const Worker& worker, const CellBox& box, unsigned int threads, std::vector<Output>& output)
+{
+  moveit::tools::ThreadPool& pool = moveit::tools::ThreadPool::Instance();
+  std::size_t num_cells = box.size();
+  std::size_t num_threads = std::min<std::size_t>(std::min(std::max(threads, 1u), pool.getThreadCount()), num_cells);
+  if (num_threads <= 1)
+  {
+    worker(box, 0, num_cells, &output);
+    return;
+  }
+
+  std::vector<std::vector<Output> > thread_output(num_threads);
+  pool.parallelFor(0, num_threads, boost::bind(&visitPart<Worker, Output>, &worker, &box, num_threads, &thread_output, _1));
+
+  std::size_t total = output.size();
+  for (std::size_t t = 0 ; t < num_threads ; ++t)
+    total += thread_output[t].size();
+  output.reserve(total);
+  for (std::size_t t = 0 ; t < num_threads ; ++t)
+    output.insert(output.end(), thread_output[t].begin(), thread_output[t].end());
+}
+
+/// Finds the centers of the cells with a distance in a range
+struct IsoSurfaceWorker
+{
+  IsoSurfaceWorker(const DistanceField &df, double min_distance, double max_distance) :
+    df_(df), min_distance_(min_distance), max_distance_(max_distance)
+  {
+  }
+
+  void operator()(const CellBox& box, std::size_t begin, std::size_t end, std::vector<geometry_msgs::Point>* points) const
+  {
+    for (std::size_t i = begin ; i < end ; ++i)
+    {
+      int x, y, z;
+      box.getCell(i, x, y, z);
+      double dist = df_.getDistance(x, y, z);
+      if (dist >= min_distance_ && dist <= max_distance_)
+      {
+        geometry_msgs::Point point;
+        df_.gridToWorld(x, y, z, point.x, point.y, point.z);
+        points->push_back(point);
+      }
+    }
+  }
+
+  const DistanceField &df_;
+  double min_distance_;
+  double max_distance_;
+};
+
+/// Makes an arrow marker for each cell with a distance in a range and a non-zero gradient; the ids are set by the caller
+struct GradientWorker
+{
+  GradientWorker(const DistanceField &df, double min_distance, double max_distance,
+                 const std::string& frame_id, const ros::Time& stamp) :
+    df_(df), min_distance_(min_distance), max_distance_(max_distance), frame_id_(frame_id), stamp_(stamp)
+  {
+  }
+
+  void operator()(const CellBox& box, std::size_t begin, std::size_t end,
+                  std::vector<visualization_msgs::Marker>* markers) const
+  {
+    for (std::size_t i = begin ; i < end ; ++i)
+    {
+      int x, y, z;
+      box.getCell(i, x, y, z);
+      double worldX, worldY, worldZ;
+      df_.gridToWorld(x, y, z, worldX, worldY, worldZ);
+
+      // the central differences of DistanceField only read distances, which is safe to do from several threads
+      double gradientX, gradientY, gradientZ;
+      bool in_bounds;
+      double distance = df_.DistanceField::getDistanceGradient(worldX, worldY, worldZ,
+                                                               gradientX, gradientY, gradientZ, in_bounds);
+      Eigen::Vector3d gradient(gradientX, gradientY, gradientZ);
+
+      if (in_bounds && distance >= min_distance_ && distance <= max_distance_ && gradient.norm() > 0)
+      {
+        visualization_msgs::Marker marker;
+
+        marker.header.frame_id = frame_id_;
+        marker.header.stamp = stamp_;
+
+        marker.ns = "distance_field_gradient";
+        marker.type = visualization_msgs::Marker::ARROW;
+        marker.action = visualization_msgs::Marker::ADD;
+
+        marker.pose.position.x = worldX;
+        marker.pose.position.y = worldY;
+        marker.pose.position.z = worldZ;
+
+        marker.scale.x = df_.getResolution();
+        marker.scale.y = df_.getResolution();
+        marker.scale.z = df_.getResolution();
+
+        marker.color.r = 0.0;
+        marker.color.g = 0.0;
+        marker.color.b = 1.0;
+        marker.color.a = 1.0;
+
+        markers->push_back(marker);
+      }
+    }
+  }
+
+  const DistanceField &df_;
+  double min_distance_;
+  double max_distance_;
+  const std::string &frame_id_;
+  const ros::Time &stamp_;
+};
+
+/// A cell of a plane marker
+struct ColoredPoint
+{
+  geometry_msgs::Point point;
+  std_msgs::ColorRGBA color;
+};
+
+/// Colors the valid cells by their distance
+struct PlaneWorker
+{
+  PlaneWorker(const DistanceField &df) : df_(df)
+  {
+  }
+
+  void operator()(const CellBox& box, std::size_t begin, std::size_t end, std::vector<ColoredPoint>* cells) const
+  {
+    for (std::size_t i = begin ; i < end ; ++i)
+    {
+      int x, y, z;
+      box.getCell(i, x, y, z);
+      if(!df_.isCellValid(x,y,z))
+      {
+        continue;
+      }
+      double dist = df_.getDistance(x, y, z);
+      ColoredPoint cell;
+      df_.gridToWorld(x, y, z, cell.point.x, cell.point.y, cell.point.z);
+      if(dist < 0.0)
+      {
+        cell.color.r = fmax(fmin(0.1/fabs(dist), 1.0), 0.0);
+        cell.color.g = fmax(fmin(0.05/fabs(dist), 1.0), 0.0);
+        cell.color.b = fmax(fmin(0.01/fabs(dist), 1.0), 0.0);
+      }
+      else
+      {
+        cell.color.b = fmax(fmin(0.1/(dist+0.001), 1.0),0.0);
+        cell.color.g = fmax(fmin(0.05/(dist+0.001), 1.0),0.0);
+        cell.color.r = fmax(fmin(0.01/(dist+0.001), 1.0),0.0);
+      }
+      cells->push_back(cell);
+    }
+  }
+
+  const DistanceField &df_;
+};
+
+}
+}
+
+bool distance_field::DistanceField::getInterpolatedDistances(const EigenSTL::vector_Vector3d& points,
+                                                             std::vector<double>& distances) const
+{
+  return interpolateDistances(VirtualCellDistance(*this), points, distances, NULL);
+}
+
+bool distance_field::DistanceField::getInterpolatedDistanceGradients(const EigenSTL::vector_Vector3d& points,
+                                                                     std::vector<double>& distances,
+                                                                     EigenSTL::vector_Vector3d& gradients) const
+{
+  return interpolateDistances(VirtualCellDistance(*this), points, distances, &gradients);
+}
+
 void distance_field::DistanceField::getIsoSurfaceMarkers(double min_distance, double max_distance,
                                          const std::string & frame_id, const ros::Time stamp,
                                          visualization_msgs::Marker& inf_marker) const
@@ -97,39 +342,17 @@ void distance_field::DistanceField::getIsoSurfaceMarkers(double min_distance, do
   inf_marker.id = 1;
   inf_marker.type = visualization_msgs::Marker::CUBE_LIST;
   inf_marker.action = visualization_msgs::Marker::MODIFY;
-  inf_marker.scale.x = resolution_;
-  inf_marker.scale.y = resolution_;
-  inf_marker.scale.z = resolution_;
+  inf_marker.scale.x = resolution_ * visualization_stride_;
+  inf_marker.scale.y = resolution_ * visualization_stride_;
+  inf_marker.scale.z = resolution_ * visualization_stride_;
   inf_marker.color.r = 1.0;
   inf_marker.color.g = 0.0;
   inf_marker.color.b = 0.0;
   inf_marker.color.a = 0.1;
   //inf_marker.lifetime = ros::Duration(30.0);
 
-  inf_marker.points.reserve(100000);
-  for (int x = 0; x < getXNumCells(); ++x)
-  {
-    for (int y = 0; y < getYNumCells(); ++y)
-    {
-      for (int z = 0; z < getZNumCells(); ++z)
-      {
-        double dist = getDistance(x,y,z);
-
-        if (dist >= min_distance && dist <= max_distance)
-        {
-          int last = inf_marker.points.size();
-          inf_marker.points.resize(last + 1);
-          double nx, ny, nz;
-          gridToWorld(x,y,z,
-                      nx, ny, nz);
-          Eigen::Translation3d vec(nx,ny,nz);
-          inf_marker.points[last].x = vec.x();
-          inf_marker.points[last].y = vec.y();
-          inf_marker.points[last].z = vec.z();
-        }
-      }
-    }
-  }
+  CellBox box(0, 0, 0, getXNumCells() - 1, getYNumCells() - 1, getZNumCells() - 1, visualization_stride_);
+  visitCells(IsoSurfaceWorker(*this, min_distance, max_distance), box, visualization_threads_, inf_marker.points);
 }
 
 void distance_field::DistanceField::getGradientMarkers(double min_distance,
@@ -138,64 +361,15 @@ void distance_field::DistanceField::getGradientMarkers(double min_distance,
                                        const ros::Time& stamp,
                                        visualization_msgs::MarkerArray& marker_array) const
 {
-  Eigen::Vector3d unitX(1, 0, 0);
-  Eigen::Vector3d unitY(0, 1, 0);
-  Eigen::Vector3d unitZ(0, 0, 1);
-
-  int id = 0;
+  std::vector<visualization_msgs::Marker> markers;
+  CellBox box(0, 0, 0, getXNumCells() - 1, getYNumCells() - 1, getZNumCells() - 1, visualization_stride_);
+  visitCells(GradientWorker(*this, min_distance, max_distance, frame_id, stamp), box, visualization_threads_, markers);
 
-  for (int x = 0; x < getXNumCells(); ++x)
+  marker_array.markers.reserve(marker_array.markers.size() + markers.size());
+  for (std::size_t i = 0 ; i < markers.size() ; ++i)
   {
-    for (int y = 0; y < getYNumCells(); ++y)
-    {
-      for (int z = 0; z < getZNumCells(); ++z)
-      {
-        double worldX, worldY, worldZ;
-        gridToWorld(x, y, z, worldX, worldY, worldZ);
-
-        double gradientX, gradientY, gradientZ;
-        bool in_bounds;
-        double distance = getDistanceGradient(worldX, worldY, worldZ, gradientX, gradientY, gradientZ, in_bounds);
-        Eigen::Vector3d gradient(gradientX, gradientY, gradientZ);
-
-        if (in_bounds && distance >= min_distance && distance <= max_distance && gradient.norm() > 0)
-        {
-          visualization_msgs::Marker marker;
-
-          marker.header.frame_id = frame_id;
-          marker.header.stamp = stamp;
-
-          marker.ns = "distance_field_gradient";
-          marker.id = id++;
-          marker.type = visualization_msgs::Marker::ARROW;
-          marker.action = visualization_msgs::Marker::ADD;
-
-          marker.pose.position.x = worldX;
-          marker.pose.position.y = worldY;
-          marker.pose.position.z = worldZ;
-
-          Eigen::Vector3d axis = gradient.cross(unitX).norm() > 0 ? gradient.cross(unitX) : unitY;
-          //double angle = -gradient.angle(unitX);
-          //Eigen::AngleAxisd rotation(angle, axis);
-
-          // marker.pose.orientation.x = rotation.rotation().x();
-          // marker.pose.orientation.y = rotation.rotation().y();
-          // marker.pose.orientation.z = rotation.rotation().z();
-          // marker.pose.orientation.w = rotation.rotation().w();
-
-          marker.scale.x = getResolution();
-          marker.scale.y = getResolution();
-          marker.scale.z = getResolution();
-
-          marker.color.r = 0.0;
-          marker.color.g = 0.0;
-          marker.color.b = 1.0;
-          marker.color.a = 1.0;
-
-          marker_array.markers.push_back(marker);
-        }
-      }
-    }
+    markers[i].id = i;
+    marker_array.markers.push_back(markers[i]);
   }
 }
 
@@ -210,14 +384,57 @@ void distance_field::DistanceField::addShapeToField(const shapes::Shape* shape,
     }
     addOcTreeToField(oc->octree.get());
   } else {
+    EigenSTL::vector_Vector3d point_vec;
+    getShapePoints(shape, pose, point_vec);
+    addPointsToField(point_vec);
+  }
+}
+
+void distance_field::DistanceField::getShapePoints(const shapes::Shape* shape,
+                                                   const geometry_msgs::Pose& pose,
+                                                   EigenSTL::vector_Vector3d& points)
+{
+  Eigen::Affine3d pose_e;
+  tf::poseMsgToEigen(pose, pose_e);
+
+  if (!cache_shape_points_)
+  {
     bodies::Body* body = bodies::createBodyFromShape(shape);
-    Eigen::Affine3d pose_e;
-    tf::poseMsgToEigen(pose, pose_e);
     body->setPose(pose_e);
-    EigenSTL::vector_Vector3d point_vec;
-    findInternalPointsConvex(*body, resolution_, point_vec);
+    findInternalPointsConvex(*body, resolution_, points, voxelization_threads_);
     delete body;
-    addPointsToField(point_vec);
+    return;
+  }
+
+  std::map<const shapes::Shape*, EigenSTL::vector_Vector3d>::iterator it = shape_points_cache_.find(shape);
+  if (it == shape_points_cache_.end())
+  {
+    bodies::Body* body = bodies::createBodyFromShape(shape);
+    it = shape_points_cache_.insert(std::make_pair(shape, EigenSTL::vector_Vector3d())).first;
+    findInternalPointsConvex(*body, resolution_ / 2.0, it->second, voxelization_threads_);
+    delete body;
+  }
+
+  // several cached points fall in each cell; keep one point per cell
+  int num_y = getYNumCells(), num_z = getZNumCells();
+  std::vector<long> cells;
+  cells.reserve(it->second.size());
+  for (std::size_t i = 0 ; i < it->second.size() ; ++i)
+  {
+    Eigen::Vector3d p = pose_e * it->second[i];
+    int x, y, z;
+    if (worldToGrid(p.x(), p.y(), p.z(), x, y, z))
+      cells.push_back(((long)x * num_y + y) * num_z + z);
+  }
+  std::sort(cells.begin(), cells.end());
+  cells.erase(std::unique(cells.begin(), cells.end()), cells.end());
+
+  points.reserve(points.size() + cells.size());
+  for (std::size_t i = 0 ; i < cells.size() ; ++i)
+  {
+    Eigen::Vector3d p;
+    gridToWorld(cells[i] / ((long)num_y * num_z), (cells[i] / num_z) % num_y, cells[i] % num_z, p.x(), p.y(), p.z());
+    points.push_back(p);
   }
 }
 
@@ -247,23 +464,99 @@ void distance_field::DistanceField::addOcTreeToField(const octomap::OcTree* octr
         end=octree->end_leafs_bbx(); it!= end; ++it)
   {
     if (octree->isNodeOccupied(*it))
-    {
-      if(it.getSize() <= resolution_) {
-        Eigen::Vector3d point(it.getX(), it.getY(), it.getZ());
-        points.push_back(point);
-      } else {
-        double ceil_val = ceil(it.getSize()/resolution_)*resolution_/2.0;
-        for(double x = it.getX()-ceil_val; x <= it.getX()+ceil_val; x += resolution_) {
-          for(double y = it.getY()-ceil_val; y <= it.getY()+ceil_val; y += resolution_) {
-            for(double z = it.getZ()-ceil_val; z <= it.getZ()+ceil_val; z += resolution_) {
-              points.push_back(Eigen::Vector3d(x,y,z));
-            }
-          }
+      getOcTreeLeafPoints(it.getX(), it.getY(), it.getZ(), it.getSize(), points);
+  }
+  addPointsToField(points);
+}
+
+void distance_field::DistanceField::getOcTreeLeafPoints(double x, double y, double z, double size,
+                                                        EigenSTL::vector_Vector3d& points) const
+{
+  if(size <= resolution_) {
+    points.push_back(Eigen::Vector3d(x,y,z));
+  } else {
+    double ceil_val = ceil(size/resolution_)*resolution_/2.0;
+    for(double px = x-ceil_val; px <= x+ceil_val; px += resolution_) {
+      for(double py = y-ceil_val; py <= y+ceil_val; py += resolution_) {
+        for(double pz = z-ceil_val; pz <= z+ceil_val; pz += resolution_) {
+          points.push_back(Eigen::Vector3d(px,py,pz));
         }
       }
     }
   }
-  addPointsToField(points);
+}
+
+bool distance_field::DistanceField::isOcTreeOccupyingCell(const octomap::OcTree* octree, int x, int y, int z) const
+{
+  double cx, cy, cz;
+  gridToWorld(x, y, z, cx, cy, cz);
+  // leaves larger than a cell are expanded up to a cell beyond their extent
+  octomap::point3d bbx_min(cx - resolution_, cy - resolution_, cz - resolution_);
+  octomap::point3d bbx_max(cx + resolution_, cy + resolution_, cz + resolution_);
+  double half = resolution_ / 2.0;
+  for(octomap::OcTree::leaf_bbx_iterator it = octree->begin_leafs_bbx(bbx_min,bbx_max),
+        end=octree->end_leafs_bbx(); it!= end; ++it)
+  {
+    if (!octree->isNodeOccupied(*it))
+      continue;
+    if (it.getSize() <= resolution_)
+    {
+      int lx, ly, lz;
+      if (worldToGrid(it.getX(), it.getY(), it.getZ(), lx, ly, lz) && lx == x && ly == y && lz == z)
+        return true;
+    }
+    else
+    {
+      double ceil_val = ceil(it.getSize()/resolution_)*resolution_/2.0 + half;
+      if (fabs(cx - it.getX()) <= ceil_val && fabs(cy - it.getY()) <= ceil_val && fabs(cz - it.getZ()) <= ceil_val)
+        return true;
+    }
+  }
+  return false;
+}
+
+void distance_field::DistanceField::updateOcTreeChangesInField(const octomap::OcTree* octree)
+{
+  // collect the cells the changed leaves map to, plus a one cell margin
+  // since (un)pruning a leaf can move the center its siblings map to
+  std::set<long> cells;
+  int num_x = getXNumCells(), num_y = getYNumCells(), num_z = getZNumCells();
+  double half = octree->getResolution() / 2.0;
+  for (octomap::KeyBoolMap::const_iterator it = octree->changedKeysBegin() ; it != octree->changedKeysEnd() ; ++it)
+  {
+    octomap::point3d center = octree->keyToCoord(it->first);
+    int min_x = std::max((int)floor((center.x() - half - origin_x_) / resolution_ + 0.5) - 1, 0);
+    int min_y = std::max((int)floor((center.y() - half - origin_y_) / resolution_ + 0.5) - 1, 0);
+    int min_z = std::max((int)floor((center.z() - half - origin_z_) / resolution_ + 0.5) - 1, 0);
+    int max_x = std::min((int)floor((center.x() + half - origin_x_) / resolution_ + 0.5) + 1, num_x - 1);
+    int max_y = std::min((int)floor((center.y() + half - origin_y_) / resolution_ + 0.5) + 1, num_y - 1);
+    int max_z = std::min((int)floor((center.z() + half - origin_z_) / resolution_ + 0.5) + 1, num_z - 1);
+    for (int x = min_x ; x <= max_x ; ++x)
+      for (int y = min_y ; y <= max_y ; ++y)
+        for (int z = min_z ; z <= max_z ; ++z)
+          cells.insert(((long)x * num_y + y) * num_z + z);
+  }
+
+  EigenSTL::vector_Vector3d removed_points;
+  EigenSTL::vector_Vector3d added_points;
+  for (std::set<long>::const_iterator it = cells.begin() ; it != cells.end() ; ++it)
+  {
+    int x = *it / ((long)num_y * num_z);
+    int y = (*it / num_z) % num_y;
+    int z = *it % num_z;
+    bool occupied = getDistance(x, y, z) <= 0.0;
+    if (occupied == isOcTreeOccupyingCell(octree, x, y, z))
+      continue;
+    Eigen::Vector3d point;
+    gridToWorld(x, y, z, point.x(), point.y(), point.z());
+    if (occupied)
+      removed_points.push_back(point);
+    else
+      added_points.push_back(point);
+  }
+
+  if (!removed_points.empty() || !added_points.empty())
+    updatePointsInField(removed_points, added_points);
 }
 
 void distance_field::DistanceField::moveShapeInField(const shapes::Shape* shape,
@@ -274,18 +567,10 @@ void distance_field::DistanceField::moveShapeInField(const shapes::Shape* shape,
     logWarn("Move shape not supported for Octree");
     return;
   }
-  bodies::Body* body = bodies::createBodyFromShape(shape);
-  Eigen::Affine3d old_pose_e;
-  tf::poseMsgToEigen(old_pose, old_pose_e);
-  body->setPose(old_pose_e);
   EigenSTL::vector_Vector3d old_point_vec;
-  findInternalPointsConvex(*body, resolution_, old_point_vec);
-  Eigen::Affine3d new_pose_e;
-  tf::poseMsgToEigen(new_pose, new_pose_e);
-  body->setPose(new_pose_e);
+  getShapePoints(shape, old_pose, old_point_vec);
   EigenSTL::vector_Vector3d new_point_vec;
-  findInternalPointsConvex(*body, resolution_, new_point_vec);
-  delete body;
+  getShapePoints(shape, new_pose, new_point_vec);
   updatePointsInField(old_point_vec,
                       new_point_vec);
 }
@@ -293,13 +578,9 @@ void distance_field::DistanceField::moveShapeInField(const shapes::Shape* shape,
 void distance_field::DistanceField::removeShapeFromField(const shapes::Shape* shape,
                                          const geometry_msgs::Pose& pose)
 {
-  bodies::Body* body = bodies::createBodyFromShape(shape);
-  Eigen::Affine3d pose_e;
-  tf::poseMsgToEigen(pose, pose_e);
-  body->setPose(pose_e);
   EigenSTL::vector_Vector3d point_vec;
-  findInternalPointsConvex(*body, resolution_, point_vec);
-  delete body;
+  getShapePoints(shape, pose, point_vec);
+  shape_points_cache_.erase(shape);
   removePointsFromField(point_vec);
 }
 
@@ -314,14 +595,11 @@ void distance_field::DistanceField::getPlaneMarkers(distance_field::PlaneVisuali
   plane_marker.id = 1;
   plane_marker.type = visualization_msgs::Marker::CUBE_LIST;
   plane_marker.action = visualization_msgs::Marker::ADD;
-  plane_marker.scale.x = resolution_;
-  plane_marker.scale.y = resolution_;
-  plane_marker.scale.z = resolution_;
+  plane_marker.scale.x = resolution_ * visualization_stride_;
+  plane_marker.scale.y = resolution_ * visualization_stride_;
+  plane_marker.scale.z = resolution_ * visualization_stride_;
   //plane_marker.lifetime = ros::Duration(30.0);
 
-  plane_marker.points.reserve(100000);
-  plane_marker.colors.reserve(100000);
-
   double minX = 0;
   double maxX = 0;
   double minY = 0;
@@ -378,41 +656,17 @@ void distance_field::DistanceField::getPlaneMarkers(distance_field::PlaneVisuali
   worldToGrid(minX,minY,minZ, minXCell, minYCell, minZCell);
   worldToGrid(maxX,maxY,maxZ, maxXCell, maxYCell, maxZCell);
   plane_marker.color.a = 1.0;
-  for(int x = minXCell; x <= maxXCell; ++x)
-  {
-    for(int y = minYCell; y <= maxYCell; ++y)
-    {
-      for(int z = minZCell; z <= maxZCell; ++z)
-      {
-        if(!isCellValid(x,y,z))
-        {
-          continue;
-        }
-        double dist = getDistance(x, y, z);
-        int last = plane_marker.points.size();
-        plane_marker.points.resize(last + 1);
-        plane_marker.colors.resize(last + 1);
-        double nx, ny, nz;
-        gridToWorld(x, y, z, nx, ny, nz);
-        Eigen::Vector3d vec(nx, ny, nz);
-        plane_marker.points[last].x = vec.x();
-        plane_marker.points[last].y = vec.y();
-        plane_marker.points[last].z = vec.z();
-        if(dist < 0.0)
-        {
-          plane_marker.colors[last].r = fmax(fmin(0.1/fabs(dist), 1.0), 0.0);
-          plane_marker.colors[last].g = fmax(fmin(0.05/fabs(dist), 1.0), 0.0);
-          plane_marker.colors[last].b = fmax(fmin(0.01/fabs(dist), 1.0), 0.0);
 
-        }
-        else
-        {
-          plane_marker.colors[last].b = fmax(fmin(0.1/(dist+0.001), 1.0),0.0);
-          plane_marker.colors[last].g = fmax(fmin(0.05/(dist+0.001), 1.0),0.0);
-          plane_marker.colors[last].r = fmax(fmin(0.01/(dist+0.001), 1.0),0.0);
-        }
-      }
-    }
+  std::vector<ColoredPoint> cells;
+  CellBox box(minXCell, minYCell, minZCell, maxXCell, maxYCell, maxZCell, visualization_stride_);
+  visitCells(PlaneWorker(*this), box, visualization_threads_, cells);
+
+  plane_marker.points.reserve(plane_marker.points.size() + cells.size());
+  plane_marker.colors.reserve(plane_marker.colors.size() + cells.size());
+  for (std::size_t i = 0 ; i < cells.size() ; ++i)
+  {
+    plane_marker.points.push_back(cells[i].point);
+    plane_marker.colors.push_back(cells[i].color);
   }
 }
 
@@ -0,0 +1,380 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2013, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+
+#include <moveit/distance_field/euclidean_distance_transform_field.h>
+#include <moveit/background_processing/thread_pool.h>
+#include <console_bridge/console.h>
+#include <boost/iostreams/filtering_stream.hpp>
+#include <boost/iostreams/filter/zlib.hpp>
+#include <boost/bind.hpp>
+#include <bitset>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace distance_field
+{
+
+namespace
+{
+
+/**
+ * Computes the one dimensional squared distance transform of the
+ * sampled function \e f of length \e n into \e d, as the lower
+ * envelope of the parabolas rooted at each sample.  \e v (size n)
+ * and \e z (size n + 1) are scratch space.
+ */
+void transformLine(const double *f, int n, double *d, int *v, double *z)
+{
+  int k = 0;
+  v[0] = 0;
+  z[0] = -std::numeric_limits<double>::infinity();
+  z[1] = std::numeric_limits<double>::infinity();
+  for (int q = 1; q < n; ++q)
+  {
+    double s = ((f[q] + q * q) - (f[v[k]] + v[k] * v[k])) / (2 * (q - v[k]));
+    while (s <= z[k])
+    {
+      --k;
+      s = ((f[q] + q * q) - (f[v[k]] + v[k] * v[k])) / (2 * (q - v[k]));
+    }
+    ++k;
+    v[k] = q;
+    z[k] = s;
+    z[k + 1] = std::numeric_limits<double>::infinity();
+  }
+
+  k = 0;
+  for (int q = 0; q < n; ++q)
+  {
+    while (z[k + 1] < q)
+      ++k;
+    double dq = q - v[k];
+    d[q] = dq * dq + f[v[k]];
+  }
+}
+
+}
+
+EuclideanDistanceTransformField::EuclideanDistanceTransformField(double size_x, double size_y, double size_z, double resolution,
+                                                                 double origin_x, double origin_y, double origin_z,
+                                                                 double max_distance,
+                                                                 bool compute_negative_distances)
+  : DistanceField(size_x, size_y, size_z, resolution, origin_x, origin_y, origin_z),
+    max_distance_(max_distance),
+    compute_negative_(compute_negative_distances),
+    threads_(1)
+{
+  initialize();
+}
+
+void EuclideanDistanceTransformField::initialize()
+{
+  occupancy_grid_.resize(size_x_, size_y_, size_z_, resolution_, origin_x_, origin_y_, origin_z_, 0);
+  reset();
+}
+
+void EuclideanDistanceTransformField::reset()
+{
+  occupancy_grid_.reset(0);
+  distances_.assign(static_cast<std::size_t>(getXNumCells()) * getYNumCells() * getZNumCells(), max_distance_);
+}
+
+bool EuclideanDistanceTransformField::setPointsOccupancy(const EigenSTL::vector_Vector3d& points, char occupied)
+{
+  bool changed = false;
+  for (std::size_t i = 0 ; i < points.size() ; ++i)
+  {
+    int x, y, z;
+    if (!occupancy_grid_.worldToGrid(points[i].x(), points[i].y(), points[i].z(), x, y, z))
+      continue;
+    char &cell = occupancy_grid_.getCell(x, y, z);
+    if (cell != occupied)
+    {
+      cell = occupied;
+      changed = true;
+    }
+  }
+  return changed;
+}
+
+void EuclideanDistanceTransformField::addPointsToField(const EigenSTL::vector_Vector3d& points)
+{
+  if (setPointsOccupancy(points, 1))
+    computeDistances();
+}
+
+void EuclideanDistanceTransformField::removePointsFromField(const EigenSTL::vector_Vector3d& points)
+{
+  if (setPointsOccupancy(points, 0))
+    computeDistances();
+}
+
+void EuclideanDistanceTransformField::updatePointsInField(const EigenSTL::vector_Vector3d& old_points,
+                                                          const EigenSTL::vector_Vector3d& new_points)
+{
+  bool removed = setPointsOccupancy(old_points, 0);
+  bool added = setPointsOccupancy(new_points, 1);
+  if (removed || added)
+    computeDistances();
+}
+
+void EuclideanDistanceTransformField::computeDistances()
+{
+  if (distances_.empty())
+    return;
+
+  std::vector<double> sq_distances;
+  computeSquaredDistances(1, sq_distances);
+  for (std::size_t i = 0 ; i < distances_.size() ; ++i)
+    distances_[i] = std::min(sqrt(sq_distances[i]) * resolution_, max_distance_);
+
+  if (!compute_negative_)
+    return;
+
+  // obstacle cells are assigned the negated distance to the nearest unoccupied cell
+  computeSquaredDistances(0, sq_distances);
+  for (int x = 0 ; x < getXNumCells() ; ++x)
+    for (int y = 0 ; y < getYNumCells() ; ++y)
+      for (int z = 0 ; z < getZNumCells() ; ++z)
+        if (isCellOccupied(x, y, z))
+        {
+          std::size_t i = getIndex(x, y, z);
+          distances_[i] = -std::min(sqrt(sq_distances[i]) * resolution_, max_distance_);
+        }
+}
+
+void EuclideanDistanceTransformField::computeSquaredDistances(char target, std::vector<double>& sq_distances) const
+{
+  const double far = getFarSquaredDistance();
+  sq_distances.resize(distances_.size());
+  for (int x = 0 ; x < getXNumCells() ; ++x)
+    for (int y = 0 ; y < getYNumCells() ; ++y)
+      for (int z = 0 ; z < getZNumCells() ; ++z)
+        sq_distances[getIndex(x, y, z)] = ((occupancy_grid_.getCell(x, y, z) != 0) == (target != 0)) ? 0.0 : far;
+
+  // Z first, since those lines are contiguous in memory and most of them are usually empty
+  static const int axes[3] = { DIM_Z, DIM_Y, DIM_X };
+  moveit::tools::ThreadPool& pool = moveit::tools::ThreadPool::Instance();
+  for (int a = 0 ; a < 3 ; ++a)
+  {
+    int lines = static_cast<int>(distances_.size() / getNumCells(axes[a]));
+    int threads = std::min(static_cast<int>(std::min(threads_, pool.getThreadCount())), lines);
+    if (threads <= 1)
+    {
+      transformLines(&sq_distances, axes[a], 0, lines);
+      continue;
+    }
+
+    // chunks of at least lines / threads lines, so at most threads of them run at the same time
+    pool.parallelForRange(0, lines, boost::bind(&EuclideanDistanceTransformField::transformLines, this, &sq_distances, axes[a], _1, _2),
+                          (lines + threads - 1) / threads);
+  }
+}
+
+void EuclideanDistanceTransformField::transformLines(std::vector<double>* sq_distances, int axis, int first_line, int last_line) const
+{
+  // the two axes other than the one being transformed, in storage order
+  int outer = axis == DIM_X ? DIM_Y : DIM_X;
+  int inner = axis == DIM_Z ? DIM_Y : DIM_Z;
+  int n = getNumCells(axis);
+  int n_inner = getNumCells(inner);
+  std::size_t stride = axis == DIM_Z ? 1 : (axis == DIM_Y ? getZNumCells() : static_cast<std::size_t>(getYNumCells()) * getZNumCells());
+
+  const double far = getFarSquaredDistance();
+  std::vector<double> f(n), d(n), z(n + 1);
+  std::vector<int> v(n);
+  double *data = &(*sq_distances)[0];
+  for (int line = first_line ; line < last_line ; ++line)
+  {
+    int cell[3];
+    cell[axis] = 0;
+    cell[outer] = line / n_inner;
+    cell[inner] = line % n_inner;
+    double *start = data + getIndex(cell[DIM_X], cell[DIM_Y], cell[DIM_Z]);
+
+    bool empty = true;
+    for (int q = 0 ; q < n ; ++q)
+    {
+      f[q] = start[q * stride];
+      if (f[q] < far)
+        empty = false;
+    }
+    // lines without a single target cell stay as they are
+    if (empty)
+      continue;
+
+    transformLine(&f[0], n, &d[0], &v[0], &z[0]);
+    for (int q = 0 ; q < n ; ++q)
+      start[q * stride] = d[q];
+  }
+}
+
+double EuclideanDistanceTransformField::getDistance(double x, double y, double z) const
+{
+  int cx, cy, cz;
+  if (!occupancy_grid_.worldToGrid(x, y, z, cx, cy, cz))
+    return max_distance_;
+  return distances_[getIndex(cx, cy, cz)];
+}
+
+double EuclideanDistanceTransformField::getDistance(int x, int y, int z) const
+{
+  if (!occupancy_grid_.isCellValid(x, y, z))
+    return max_distance_;
+  return distances_[getIndex(x, y, z)];
+}
+
+bool EuclideanDistanceTransformField::isCellValid(int x, int y, int z) const
+{
+  return occupancy_grid_.isCellValid(x, y, z);
+}
+
+int EuclideanDistanceTransformField::getXNumCells() const
+{
+  return occupancy_grid_.getNumCells(DIM_X);
+}
+
+int EuclideanDistanceTransformField::getYNumCells() const
+{
+  return occupancy_grid_.getNumCells(DIM_Y);
+}
+
+int EuclideanDistanceTransformField::getZNumCells() const
+{
+  return occupancy_grid_.getNumCells(DIM_Z);
+}
+
+bool EuclideanDistanceTransformField::gridToWorld(int x, int y, int z, double& world_x, double& world_y, double& world_z) const
+{
+  occupancy_grid_.gridToWorld(x, y, z, world_x, world_y, world_z);
+  return true;
+}
+
+bool EuclideanDistanceTransformField::worldToGrid(double world_x, double world_y, double world_z, int& x, int& y, int& z) const
+{
+  return occupancy_grid_.worldToGrid(world_x, world_y, world_z, x, y, z);
+}
+
+bool EuclideanDistanceTransformField::writeToStream(std::ostream& os) const
+{
+  os << "resolution: " << resolution_ << std::endl;
+  os << "size_x: " << size_x_ << std::endl;
+  os << "size_y: " << size_y_ << std::endl;
+  os << "size_z: " << size_z_ << std::endl;
+  os << "origin_x: " << origin_x_ << std::endl;
+  os << "origin_y: " << origin_y_ << std::endl;
+  os << "origin_z: " << origin_z_ << std::endl;
+
+  boost::iostreams::filtering_ostream out;
+  out.push(boost::iostreams::zlib_compressor());
+  out.push(os);
+
+  for (int x = 0 ; x < getXNumCells() ; ++x)
+    for (int y = 0 ; y < getYNumCells() ; ++y)
+      for (int z = 0 ; z < getZNumCells() ; z += 8)
+      {
+        std::bitset<8> bs(0);
+        int zv = std::min(8, getZNumCells() - z);
+        for (int zi = 0 ; zi < zv ; ++zi)
+          if (isCellOccupied(x, y, z + zi))
+            bs[zi] = 1;
+        char outchar = static_cast<char>(bs.to_ulong());
+        out.write(&outchar, sizeof(char));
+      }
+  out.flush();
+  return os.good();
+}
+
+bool EuclideanDistanceTransformField::readFromStream(std::istream& is)
+{
+  if (!is.good())
+    return false;
+
+  std::string temp;
+  is >> temp;
+  if (temp != "resolution:") return false;
+  is >> resolution_;
+  is >> temp;
+  if (temp != "size_x:") return false;
+  is >> size_x_;
+  is >> temp;
+  if (temp != "size_y:") return false;
+  is >> size_y_;
+  is >> temp;
+  if (temp != "size_z:") return false;
+  is >> size_z_;
+  is >> temp;
+  if (temp != "origin_x:") return false;
+  is >> origin_x_;
+  is >> temp;
+  if (temp != "origin_y:") return false;
+  is >> origin_y_;
+  is >> temp;
+  if (temp != "origin_z:") return false;
+  is >> origin_z_;
+
+  initialize();
+
+  // this should be newline
+  char nl;
+  is.get(nl);
+
+  boost::iostreams::filtering_istream in;
+  in.push(boost::iostreams::zlib_decompressor());
+  in.push(is);
+
+  for (int x = 0 ; x < getXNumCells() ; ++x)
+    for (int y = 0 ; y < getYNumCells() ; ++y)
+      for (int z = 0 ; z < getZNumCells() ; z += 8)
+      {
+        char inchar;
+        if (!in.good())
+        {
+          logError("Unexpected end of the distance field stream");
+          return false;
+        }
+        in.get(inchar);
+        std::bitset<8> inbit(static_cast<unsigned long>(static_cast<unsigned char>(inchar)));
+        int zv = std::min(8, getZNumCells() - z);
+        for (int zi = 0 ; zi < zv ; ++zi)
+          if (inbit[zi] == 1)
+            occupancy_grid_.getCell(x, y, z + zi) = 1;
+      }
+  computeDistances();
+  return true;
+}
+
+}
@@ -35,29 +35,84 @@
 /* Author: Acorn Pooley */
 
 #include <moveit/distance_field/find_internal_points.h>
+#include <moveit/background_processing/thread_pool.h>
+#include <boost/bind.hpp>
+#include <algorithm>
+
+namespace distance_field
+{
+namespace
+{
+
+struct GridExtents
+{
+  std::vector<double> xvals;
+  double yval_s, yval_e;
+  double zval_s, zval_e;
+  double resolution;
+};
+
+void findInternalPointsInSlices(const bodies::Body* body, const GridExtents* grid,
+                                std::size_t begin, std::size_t end,
+                                EigenSTL::vector_Vector3d* points)
+{
+  Eigen::Vector3d pt;
+  for(std::size_t i = begin; i < end; ++i) {
+    pt.x() = grid->xvals[i];
+    for(pt.y() = grid->yval_s; pt.y() <= grid->yval_e; pt.y() += grid->resolution) {
+      for(pt.z() = grid->zval_s; pt.z() <= grid->zval_e; pt.z() += grid->resolution) {
+        if(body->containsPoint(pt)) {
+          points->push_back(pt);
+        }
+      }
+    }
+  }
+}
+
+// part \e part of \e parts contiguous ranges of slices
+void findInternalPointsInPart(const bodies::Body* body, const GridExtents* grid, std::size_t parts,
+                              std::vector<EigenSTL::vector_Vector3d>* points, std::size_t part)
+{
+  findInternalPointsInSlices(body, grid, part * grid->xvals.size() / parts, (part + 1) * grid->xvals.size() / parts,
+                             &(*points)[part]);
+}
+
+}
+}
 
 void distance_field::findInternalPointsConvex(
       const bodies::Body& body,
       double resolution,
-      EigenSTL::vector_Vector3d& points)
+      EigenSTL::vector_Vector3d& points,
+      unsigned int threads)
 {
   bodies::BoundingSphere sphere;
   body.computeBoundingSphere(sphere);
+  GridExtents grid;
   double xval_s = std::floor((sphere.center.x() - sphere.radius - resolution) / resolution) * resolution;
-  double yval_s = std::floor((sphere.center.y() - sphere.radius - resolution) / resolution) * resolution;
-  double zval_s = std::floor((sphere.center.z() - sphere.radius - resolution) / resolution) * resolution;
+  grid.yval_s = std::floor((sphere.center.y() - sphere.radius - resolution) / resolution) * resolution;
+  grid.zval_s = std::floor((sphere.center.z() - sphere.radius - resolution) / resolution) * resolution;
   double xval_e = sphere.center.x() + sphere.radius + resolution;
-  double yval_e = sphere.center.y() + sphere.radius + resolution;
-  double zval_e = sphere.center.z() + sphere.radius + resolution;
-  Eigen::Vector3d pt;
-  for(pt.x() = xval_s; pt.x() <= xval_e; pt.x() += resolution) {
-    for(pt.y() = yval_s; pt.y() <= yval_e; pt.y() += resolution) {
-      for(pt.z() = zval_s; pt.z() <= zval_e; pt.z() += resolution) {
-        if(body.containsPoint(pt)) {
-          points.push_back(pt);
-        }
-      }
-    }
+  grid.yval_e = sphere.center.y() + sphere.radius + resolution;
+  grid.zval_e = sphere.center.z() + sphere.radius + resolution;
+  grid.resolution = resolution;
+
+  // the slice positions are accumulated as in a serial loop so that the
+  // points do not depend on the number of threads
+  for(double x = xval_s; x <= xval_e; x += resolution)
+    grid.xvals.push_back(x);
+
+  moveit::tools::ThreadPool& pool = moveit::tools::ThreadPool::Instance();
+  std::size_t num_threads = std::min<std::size_t>(std::min(std::max(threads, 1u), pool.getThreadCount()), grid.xvals.size());
+  if(num_threads <= 1) {
+    findInternalPointsInSlices(&body, &grid, 0, grid.xvals.size(), &points);
+    return;
   }
-}
 
+  std::vector<EigenSTL::vector_Vector3d> thread_points(num_threads);
+  pool.parallelFor(0, num_threads, boost::bind(&findInternalPointsInPart, &body, &grid, num_threads, &thread_points, _1));
+
+  // appending in slice order gives the same points as the serial loop
+  for(std::size_t t = 0; t < num_threads; ++t)
+    points.insert(points.end(), thread_points[t].begin(), thread_points[t].end());
+}
@@ -0,0 +1,367 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2013, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#include <moveit/distance_field/multi_resolution_distance_field.h>
+#include <moveit/distance_field/find_internal_points.h>
+#include <geometric_shapes/body_operations.h>
+#include <eigen_conversions/eigen_msg.h>
+#include <console_bridge/console.h>
+#include <algorithm>
+#include <sstream>
+#include <cmath>
+
+namespace distance_field
+{
+
+MultiResolutionDistanceField::MultiResolutionDistanceField(double size_x, double size_y, double size_z, double resolution,
+                                                           double origin_x, double origin_y, double origin_z,
+                                                           double max_distance,
+                                                           bool propagate_negative_distances)
+  : DistanceField(size_x, size_y, size_z, resolution, origin_x, origin_y, origin_z),
+    max_distance_(max_distance),
+    propagate_negative_(propagate_negative_distances),
+    coarse_(size_x, size_y, size_z, resolution, origin_x, origin_y, origin_z, max_distance, propagate_negative_distances)
+{
+}
+
+bool MultiResolutionDistanceField::addRefinedRegion(const Eigen::Vector3d& min_corner, const Eigen::Vector3d& max_corner,
+                                                    double resolution)
+{
+  if (!(resolution > 0.0 && resolution < resolution_))
+  {
+    logError("The resolution of a refined region (%lf) must be finer than the coarse resolution (%lf)", resolution, resolution_);
+    return false;
+  }
+
+  Region region;
+  const Eigen::Vector3d origin(origin_x_, origin_y_, origin_z_);
+  const Eigen::Vector3d end = origin + Eigen::Vector3d(size_x_, size_y_, size_z_);
+  region.min_corner_ = min_corner.cwiseMax(origin);
+  region.max_corner_ = max_corner.cwiseMin(end);
+  if ((region.max_corner_ - region.min_corner_).minCoeff() <= 0.0)
+  {
+    logError("A refined region must overlap the volume of the distance field");
+    return false;
+  }
+
+  allocateRegion(region, resolution);
+  regions_.push_back(region);
+  sortRegions();
+  return true;
+}
+
+void MultiResolutionDistanceField::allocateRegion(Region& region, double resolution) const
+{
+  // the padding makes the obstacles up to the maximum distance outside the region (and one more cell, for the
+  // interpolation at the border of the region) part of its field
+  const Eigen::Vector3d origin(origin_x_, origin_y_, origin_z_);
+  const Eigen::Vector3d end = origin + Eigen::Vector3d(size_x_, size_y_, size_z_);
+  const double padding = max_distance_ + resolution;
+  Eigen::Vector3d field_min = (region.min_corner_ - Eigen::Vector3d::Constant(padding)).cwiseMax(origin);
+  Eigen::Vector3d field_max = (region.max_corner_ + Eigen::Vector3d::Constant(padding)).cwiseMin(end);
+  Eigen::Vector3d size = field_max - field_min;
+  region.field_.reset(new PropagationDistanceField(size.x(), size.y(), size.z(), resolution,
+                                                   field_min.x(), field_min.y(), field_min.z(),
+                                                   max_distance_, propagate_negative_));
+}
+
+void MultiResolutionDistanceField::sortRegions()
+{
+  std::stable_sort(regions_.begin(), regions_.end(), Region::isFiner);
+}
+
+void MultiResolutionDistanceField::clearRefinedRegions()
+{
+  regions_.clear();
+}
+
+double MultiResolutionDistanceField::getResolutionAt(double x, double y, double z) const
+{
+  std::size_t level = getLevel(x, y, z);
+  return level < regions_.size() ? regions_[level].field_->getResolution() : resolution_;
+}
+
+std::size_t MultiResolutionDistanceField::getLevel(double x, double y, double z) const
+{
+  for (std::size_t i = 0 ; i < regions_.size() ; ++i)
+    if (regions_[i].contains(x, y, z))
+      return i;
+  return regions_.size();
+}
+
+void MultiResolutionDistanceField::addPointsToField(const EigenSTL::vector_Vector3d& points)
+{
+  coarse_.addPointsToField(points);
+  for (std::size_t i = 0 ; i < regions_.size() ; ++i)
+    regions_[i].field_->addPointsToField(points);
+}
+
+void MultiResolutionDistanceField::removePointsFromField(const EigenSTL::vector_Vector3d& points)
+{
+  coarse_.removePointsFromField(points);
+  for (std::size_t i = 0 ; i < regions_.size() ; ++i)
+    regions_[i].field_->removePointsFromField(points);
+}
+
+void MultiResolutionDistanceField::updatePointsInField(const EigenSTL::vector_Vector3d& old_points,
+                                                       const EigenSTL::vector_Vector3d& new_points)
+{
+  coarse_.updatePointsInField(old_points, new_points);
+  for (std::size_t i = 0 ; i < regions_.size() ; ++i)
+    regions_[i].field_->updatePointsInField(old_points, new_points);
+}
+
+void MultiResolutionDistanceField::reset()
+{
+  coarse_.reset();
+  for (std::size_t i = 0 ; i < regions_.size() ; ++i)
+    regions_[i].field_->reset();
+}
+
+double MultiResolutionDistanceField::getDistance(double x, double y, double z) const
+{
+  std::size_t level = getLevel(x, y, z);
+  if (level < regions_.size())
+    return regions_[level].field_->getDistance(x, y, z);
+  return coarse_.getDistance(x, y, z);
+}
+
+bool MultiResolutionDistanceField::queryLevels(const EigenSTL::vector_Vector3d& points, std::vector<double>& distances,
+                                               EigenSTL::vector_Vector3d* gradients) const
+{
+  distances.resize(points.size());
+  if (gradients)
+    gradients->resize(points.size());
+
+  // batch the points by level, so each level answers a single batch query
+  std::vector<std::vector<std::size_t> > index(regions_.size() + 1);
+  for (std::size_t i = 0 ; i < points.size() ; ++i)
+    index[getLevel(points[i].x(), points[i].y(), points[i].z())].push_back(i);
+
+  bool all_in_bounds = true;
+  EigenSTL::vector_Vector3d level_points;
+  std::vector<double> level_distances;
+  EigenSTL::vector_Vector3d level_gradients;
+  for (std::size_t l = 0 ; l < index.size() ; ++l)
+  {
+    if (index[l].empty())
+      continue;
+    const DistanceField& field = l < regions_.size() ? static_cast<const DistanceField&>(*regions_[l].field_) : coarse_;
+    level_points.resize(index[l].size());
+    for (std::size_t i = 0 ; i < index[l].size() ; ++i)
+      level_points[i] = points[index[l][i]];
+    if (gradients)
+      all_in_bounds &= field.getInterpolatedDistanceGradients(level_points, level_distances, level_gradients);
+    else
+      all_in_bounds &= field.getInterpolatedDistances(level_points, level_distances);
+    for (std::size_t i = 0 ; i < index[l].size() ; ++i)
+    {
+      distances[index[l][i]] = level_distances[i];
+      if (gradients)
+        (*gradients)[index[l][i]] = level_gradients[i];
+    }
+  }
+  return all_in_bounds;
+}
+
+bool MultiResolutionDistanceField::getInterpolatedDistances(const EigenSTL::vector_Vector3d& points,
+                                                            std::vector<double>& distances) const
+{
+  return queryLevels(points, distances, NULL);
+}
+
+bool MultiResolutionDistanceField::getInterpolatedDistanceGradients(const EigenSTL::vector_Vector3d& points,
+                                                                    std::vector<double>& distances,
+                                                                    EigenSTL::vector_Vector3d& gradients) const
+{
+  return queryLevels(points, distances, &gradients);
+}
+
+double MultiResolutionDistanceField::getDistance(int x, int y, int z) const
+{
+  return coarse_.getDistance(x, y, z);
+}
+
+bool MultiResolutionDistanceField::isCellValid(int x, int y, int z) const
+{
+  return coarse_.isCellValid(x, y, z);
+}
+
+int MultiResolutionDistanceField::getXNumCells() const
+{
+  return coarse_.getXNumCells();
+}
+
+int MultiResolutionDistanceField::getYNumCells() const
+{
+  return coarse_.getYNumCells();
+}
+
+int MultiResolutionDistanceField::getZNumCells() const
+{
+  return coarse_.getZNumCells();
+}
+
+bool MultiResolutionDistanceField::gridToWorld(int x, int y, int z, double& world_x, double& world_y, double& world_z) const
+{
+  return coarse_.gridToWorld(x, y, z, world_x, world_y, world_z);
+}
+
+bool MultiResolutionDistanceField::worldToGrid(double world_x, double world_y, double world_z, int& x, int& y, int& z) const
+{
+  return coarse_.worldToGrid(world_x, world_y, world_z, x, y, z);
+}
+
+void MultiResolutionDistanceField::getShapePoints(const shapes::Shape* shape, const geometry_msgs::Pose& pose,
+                                                  EigenSTL::vector_Vector3d& points)
+{
+  if (regions_.empty())
+  {
+    DistanceField::getShapePoints(shape, pose, points);
+    return;
+  }
+  Eigen::Affine3d pose_e;
+  tf::poseMsgToEigen(pose, pose_e);
+  bodies::Body* body = bodies::createBodyFromShape(shape);
+  body->setPose(pose_e);
+  findInternalPointsConvex(*body, getFinestResolution(), points, voxelization_threads_);
+  delete body;
+}
+
+void MultiResolutionDistanceField::getOcTreeLeafPoints(double x, double y, double z, double size,
+                                                       EigenSTL::vector_Vector3d& points) const
+{
+  double resolution = getFinestResolution();
+  if (size <= resolution)
+  {
+    points.push_back(Eigen::Vector3d(x, y, z));
+    return;
+  }
+  double ceil_val = ceil(size / resolution) * resolution / 2.0;
+  for (double px = x - ceil_val ; px <= x + ceil_val ; px += resolution)
+    for (double py = y - ceil_val ; py <= y + ceil_val ; py += resolution)
+      for (double pz = z - ceil_val ; pz <= z + ceil_val ; pz += resolution)
+        points.push_back(Eigen::Vector3d(px, py, pz));
+}
+
+bool MultiResolutionDistanceField::writeToStream(std::ostream& os) const
+{
+  // each level is written to its own buffer first, since the compressed streams of the levels cannot be read back
+  // one after the other from the same stream
+  std::vector<std::string> levels(regions_.size() + 1);
+  for (std::size_t l = 0 ; l < levels.size() ; ++l)
+  {
+    std::ostringstream level;
+    if (l < regions_.size())
+    {
+      const Region& r = regions_[l];
+      level << "region: " << r.min_corner_.x() << " " << r.min_corner_.y() << " " << r.min_corner_.z() << " "
+            << r.max_corner_.x() << " " << r.max_corner_.y() << " " << r.max_corner_.z() << std::endl;
+      r.field_->writeToStream(level);
+    }
+    else
+      coarse_.writeToStream(level);
+    levels[l] = level.str();
+  }
+
+  os << "regions: " << regions_.size() << std::endl;
+  for (std::size_t l = 0 ; l < levels.size() ; ++l)
+  {
+    os << "bytes: " << levels[l].size() << std::endl;
+    os.write(levels[l].data(), levels[l].size());
+  }
+  return os.good();
+}
+
+bool MultiResolutionDistanceField::readFromStream(std::istream& is)
+{
+  if (!is.good())
+    return false;
+
+  std::string temp;
+  std::size_t count = 0;
+  is >> temp;
+  if (temp != "regions:")
+    return false;
+  is >> count;
+
+  std::vector<Region> regions(count);
+  for (std::size_t l = 0 ; l <= count ; ++l)
+  {
+    std::size_t bytes = 0;
+    is >> temp;
+    if (temp != "bytes:")
+      return false;
+    is >> bytes;
+    char nl;
+    is.get(nl);
+    std::string data(bytes, '\0');
+    if (bytes > 0)
+      is.read(&data[0], bytes);
+    if (!is.good())
+      return false;
+
+    std::istringstream level(data);
+    if (l < count)
+    {
+      Region& r = regions[l];
+      level >> temp;
+      if (temp != "region:")
+        return false;
+      level >> r.min_corner_.x() >> r.min_corner_.y() >> r.min_corner_.z()
+            >> r.max_corner_.x() >> r.max_corner_.y() >> r.max_corner_.z();
+      // the size of the field is read from the stream; the allocated one is replaced
+      r.field_.reset(new PropagationDistanceField(resolution_, resolution_, resolution_, resolution_,
+                                                  origin_x_, origin_y_, origin_z_, max_distance_, propagate_negative_));
+      if (!level.good() || !r.field_->readFromStream(level))
+        return false;
+    }
+    else if (!coarse_.readFromStream(level))
+      return false;
+  }
+
+  size_x_ = coarse_.getSizeX();
+  size_y_ = coarse_.getSizeY();
+  size_z_ = coarse_.getSizeZ();
+  origin_x_ = coarse_.getOriginX();
+  origin_y_ = coarse_.getOriginY();
+  origin_z_ = coarse_.getOriginZ();
+  resolution_ = coarse_.getResolution();
+  inv_twice_resolution_ = 1.0 / (2.0 * resolution_);
+  regions_.swap(regions);
+  sortRegions();
+  return true;
+}
+
+}
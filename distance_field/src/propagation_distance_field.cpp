@@ -40,17 +40,57 @@
 #include <boost/iostreams/filtering_stream.hpp>
 #include <boost/iostreams/copy.hpp>
 #include <boost/iostreams/filter/zlib.hpp>
+#include <boost/iostreams/device/mapped_file.hpp>
+#include <moveit/background_processing/thread_pool.h>
+#include <boost/bind.hpp>
+#include <boost/cstdint.hpp>
+#include <fstream>
+#include <cstring>
+#include <cstdlib>
+#include <cmath>
 
 namespace distance_field
 {
 
+namespace
+{
+
+const char BINARY_FIELD_MAGIC[8] = { 'M', 'V', 'T', 'D', 'F', 'L', 'D', '\0' };
+const boost::uint32_t BINARY_FIELD_VERSION = 1;
+const boost::uint32_t BINARY_FIELD_BYTE_ORDER = 0x01020304;
+
+/// The header of the files written by PropagationDistanceField::writeToBinaryFile(); the voxels follow it
+struct BinaryFieldHeader
+{
+  char magic_[8];
+  boost::uint32_t version_;
+  boost::uint32_t byte_order_;
+  boost::uint32_t voxel_size_;
+  boost::uint32_t propagate_negative_;
+  boost::int32_t num_cells_[3];
+  boost::int32_t reserved_;
+  double size_[3];
+  double origin_[3];
+  double resolution_;
+  double max_distance_;
+  char padding_[24];
+};
+
+}
+
+const int PropagationDistanceField::NO_OBSTACLE_ID;
+
 PropagationDistanceField::PropagationDistanceField(double size_x, double size_y, double size_z,
                                                    double resolution,
                                                    double origin_x, double origin_y, double origin_z,
                                                    double max_distance,
-                                                   bool propagate_negative):
+                                                   bool propagate_negative,
+                                                   bool sparse_storage):
   DistanceField(size_x, size_y, size_z, resolution, origin_x, origin_y, origin_z),
   propagate_negative_(propagate_negative),
+  propagation_threads_(1),
+  sparse_storage_(sparse_storage),
+  obstacle_id_(NO_OBSTACLE_ID),
   max_distance_(max_distance)
 {
   initialize();
@@ -69,6 +109,9 @@ PropagationDistanceField::PropagationDistanceField(const octomap::OcTree& octree
                 bbx_min.y(),
                 bbx_min.z()),
   propagate_negative_(propagate_negative_distances),
+  propagation_threads_(1),
+  sparse_storage_(false),
+  obstacle_id_(NO_OBSTACLE_ID),
   max_distance_(max_distance)
 {
   initialize();
@@ -80,18 +123,44 @@ PropagationDistanceField::PropagationDistanceField(std::istream& is,
                                                    bool propagate_negative_distances) :
   DistanceField(0,0,0,0,0,0,0),
   propagate_negative_(propagate_negative_distances),
+  propagation_threads_(1),
+  sparse_storage_(false),
+  obstacle_id_(NO_OBSTACLE_ID),
   max_distance_(max_distance)
 {
   readFromStream(is);
 }
 
 void PropagationDistanceField::initialize()
+{
+  initializeTables();
+  mapped_file_.reset();
+  if (sparse_storage_)
+  {
+    voxel_grid_.reset();
+    sparse_grid_.reset(new SparseVoxelGrid<PropDistanceFieldVoxel>(size_x_, size_y_, size_z_,
+                                                                   resolution_,
+                                                                   origin_x_, origin_y_, origin_z_,
+                                                                   PropDistanceFieldVoxel(max_distance_sq_,0)));
+  }
+  else
+  {
+    sparse_grid_.reset();
+    voxel_grid_.reset(new VoxelGrid<PropDistanceFieldVoxel>(size_x_, size_y_, size_z_,
+                                                            resolution_,
+                                                            origin_x_, origin_y_, origin_z_,
+                                                            PropDistanceFieldVoxel(max_distance_sq_,0)));
+  }
+
+  // the number of cells may have changed
+  if (getGradientCaching())
+    setGradientCaching(true);
+  reset();
+}
+
+void PropagationDistanceField::initializeTables()
 {
   max_distance_sq_ = ceil(max_distance_/resolution_)*ceil(max_distance_/resolution_);
-  voxel_grid_.reset(new VoxelGrid<PropDistanceFieldVoxel>(size_x_, size_y_, size_z_,
-                                                          resolution_,
-                                                          origin_x_, origin_y_, origin_z_,
-                                                          PropDistanceFieldVoxel(max_distance_sq_,0)));
 
   initNeighborhoods();
 
@@ -102,8 +171,6 @@ void PropagationDistanceField::initialize()
   sqrt_table_.resize(max_distance_sq_+1);
   for (int i=0; i<=max_distance_sq_; ++i)
     sqrt_table_[i] = sqrt(double(i))*resolution_;
-
-  reset();
 }
 
 int PropagationDistanceField::eucDistSq(Eigen::Vector3i point1, Eigen::Vector3i point2)
@@ -161,6 +228,7 @@ void PropagationDistanceField::updatePointsInField(const EigenSTL::vector_Vector
     if( valid )
     {
       new_point_set.insert(voxel_loc);
+      tagObstacleVoxel(voxel_loc);
     }
   }
   compareEigen_Vector3i comp;
@@ -179,7 +247,7 @@ void PropagationDistanceField::updatePointsInField(const EigenSTL::vector_Vector
 
   std::vector<Eigen::Vector3i> new_not_in_current;
   for(unsigned int i = 0; i < new_not_old.size(); i++) {
-    if(voxel_grid_->getCell(new_not_old[i].x(),new_not_old[i].y(),new_not_old[i].z()).distance_square_ != 0) {
+    if(getVoxel(new_not_old[i].x(),new_not_old[i].y(),new_not_old[i].z()).distance_square_ != 0) {
       new_not_in_current.push_back(new_not_old[i]);
     }
     //logInform("Adding obstacle voxel %d %d %d", (*it).x(), (*it).y(), (*it).z());
@@ -210,7 +278,8 @@ void PropagationDistanceField::addPointsToField(const EigenSTL::vector_Vector3d&
 
     if( valid )
     {
-      if(voxel_grid_->getCell(voxel_loc.x(),voxel_loc.y(),voxel_loc.z()).distance_square_ > 0) {
+      tagObstacleVoxel(voxel_loc);
+      if(getVoxel(voxel_loc.x(),voxel_loc.y(),voxel_loc.z()).distance_square_ > 0) {
         voxel_points.push_back(voxel_loc);
       }
     }
@@ -233,7 +302,7 @@ void PropagationDistanceField::removePointsFromField(const EigenSTL::vector_Vect
     if( valid )
     {
       voxel_points.push_back(voxel_loc);
-      //if(voxel_grid_->getCell(voxel_loc.x(),voxel_loc.y(),voxel_loc.z()).distance_square_ == 0) {
+      //if(getVoxel(voxel_loc.x(),voxel_loc.y(),voxel_loc.z()).distance_square_ == 0) {
       //  voxel_locs.insert(voxel_loc);
       //}
     }
@@ -244,16 +313,18 @@ void PropagationDistanceField::removePointsFromField(const EigenSTL::vector_Vect
 
 void PropagationDistanceField::addNewObstacleVoxels(const std::vector<Eigen::Vector3i>& voxel_points)
 {
+  invalidateGradientCache();
   int initial_update_direction = getDirectionNumber(0,0,0);
   bucket_queue_[0].reserve(voxel_points.size());
   std::vector<Eigen::Vector3i> negative_stack;
   if(propagate_negative_) {
-    negative_stack.reserve(getXNumCells() * getYNumCells() * getZNumCells());
+    if (!sparse_grid_)
+      negative_stack.reserve(getXNumCells() * getYNumCells() * getZNumCells());
     negative_bucket_queue_[0].reserve(voxel_points.size());
   }
 
   for(unsigned int i = 0; i < voxel_points.size(); i++) {
-    PropDistanceFieldVoxel& voxel = voxel_grid_->getCell(voxel_points[i].x(), voxel_points[i].y(), voxel_points[i].z());
+    PropDistanceFieldVoxel& voxel = getVoxel(voxel_points[i].x(), voxel_points[i].y(), voxel_points[i].z());
     const Eigen::Vector3i &loc = voxel_points[i];
     voxel.distance_square_ = 0;
     voxel.closest_point_ = loc;
@@ -270,51 +341,7 @@ void PropagationDistanceField::addNewObstacleVoxels(const std::vector<Eigen::Vec
   propagatePositive();
 
   if(propagate_negative_) {
-    while(negative_stack.size() > 0)
-    {
-      Eigen::Vector3i loc = negative_stack.back();
-      negative_stack.pop_back();
-
-      for( int neighbor=0; neighbor<27; neighbor++ )
-      {
-        Eigen::Vector3i diff = getLocationDifference(neighbor);
-        Eigen::Vector3i nloc( loc.x() + diff.x(), loc.y() + diff.y(), loc.z() + diff.z() );
-
-        if( isCellValid(nloc.x(), nloc.y(), nloc.z()) )
-        {
-          PropDistanceFieldVoxel& nvoxel = voxel_grid_->getCell(nloc.x(), nloc.y(), nloc.z());
-          Eigen::Vector3i& close_point = nvoxel.closest_negative_point_;
-          if( !isCellValid( close_point.x(), close_point.y(), close_point.z() ) )
-          {
-            close_point = nloc;
-          }
-          PropDistanceFieldVoxel& closest_point_voxel = voxel_grid_->getCell( close_point.x(), close_point.y(), close_point.z() );
-
-          //our closest non-obstacle cell has become an obstacle
-          if( closest_point_voxel.negative_distance_square_ != 0 )
-          {
-            // find all neigbors inside pre-existing obstacles whose
-            // closest_negative_point_ is now an obstacle.  These must all be
-            // set to max_distance_sq_ so they will be re-propogated with a new
-            // closest_negative_point_ that is outside the obstacle.
-            if( nvoxel.negative_distance_square_!=max_distance_sq_)
-            {
-              nvoxel.negative_distance_square_ = max_distance_sq_;
-              nvoxel.closest_negative_point_.x() = PropDistanceFieldVoxel::UNINITIALIZED;
-              nvoxel.closest_negative_point_.y() = PropDistanceFieldVoxel::UNINITIALIZED;
-              nvoxel.closest_negative_point_.z() = PropDistanceFieldVoxel::UNINITIALIZED;
-              negative_stack.push_back(nloc);
-            }
-          }
-          else
-          {
-            //this cell still has a valid non-obstacle cell, so we need to propogate from it
-            nvoxel.negative_update_direction_ = initial_update_direction;
-            negative_bucket_queue_[0].push_back(nloc);
-          }
-        }
-      }
-    }
+    resetOrphanedNegativeVoxels(negative_stack);
     propagateNegative();
   }
 }
@@ -322,14 +349,17 @@ void PropagationDistanceField::addNewObstacleVoxels(const std::vector<Eigen::Vec
 void PropagationDistanceField::removeObstacleVoxels(const std::vector<Eigen::Vector3i>& voxel_points)
 //const VoxelSet& locations )
 {
+  invalidateGradientCache();
   std::vector<Eigen::Vector3i> stack;
   std::vector<Eigen::Vector3i> negative_stack;
   int initial_update_direction = getDirectionNumber(0,0,0);
 
-  stack.reserve(getXNumCells() * getYNumCells() * getZNumCells());
+  if (!sparse_grid_)
+    stack.reserve(getXNumCells() * getYNumCells() * getZNumCells());
   bucket_queue_[0].reserve(voxel_points.size());
   if(propagate_negative_) {
-    negative_stack.reserve(getXNumCells() * getYNumCells() * getZNumCells());
+    if (!sparse_grid_)
+      negative_stack.reserve(getXNumCells() * getYNumCells() * getZNumCells());
     negative_bucket_queue_[0].reserve(voxel_points.size());
   }
 
@@ -342,7 +372,9 @@ void PropagationDistanceField::removeObstacleVoxels(const std::vector<Eigen::Vec
   //   if (!valid)
   //     continue;
   for(unsigned int i = 0; i < voxel_points.size(); i++) {
-    PropDistanceFieldVoxel& voxel = voxel_grid_->getCell(voxel_points[i].x(), voxel_points[i].y(), voxel_points[i].z());
+    if (!obstacle_ids_.empty())
+      obstacle_ids_.erase(voxel_points[i]);
+    PropDistanceFieldVoxel& voxel = getVoxel(voxel_points[i].x(), voxel_points[i].y(), voxel_points[i].z());
     voxel.distance_square_ = max_distance_sq_;
     voxel.closest_point_ = voxel_points[i];
     voxel.update_direction_ = initial_update_direction; // not needed?
@@ -355,6 +387,18 @@ void PropagationDistanceField::removeObstacleVoxels(const std::vector<Eigen::Vec
     }
   }
 
+  resetOrphanedVoxels(stack);
+  propagatePositive();
+
+  if(propagate_negative_) {
+    propagateNegative();
+  }
+}
+
+void PropagationDistanceField::resetOrphanedVoxels(std::vector<Eigen::Vector3i>& stack)
+{
+  int initial_update_direction = getDirectionNumber(0,0,0);
+
   // Reset all neighbors who's closest point is now gone.
   while(stack.size() > 0)
   {
@@ -368,13 +412,13 @@ void PropagationDistanceField::removeObstacleVoxels(const std::vector<Eigen::Vec
 
       if( isCellValid(nloc.x(), nloc.y(), nloc.z()) )
       {
-        PropDistanceFieldVoxel& nvoxel = voxel_grid_->getCell(nloc.x(), nloc.y(), nloc.z());
+        PropDistanceFieldVoxel& nvoxel = getVoxel(nloc.x(), nloc.y(), nloc.z());
         Eigen::Vector3i& close_point = nvoxel.closest_point_;
         if( !isCellValid( close_point.x(), close_point.y(), close_point.z() ) )
         {
           close_point = nloc;
         }
-        PropDistanceFieldVoxel& closest_point_voxel = voxel_grid_->getCell( close_point.x(), close_point.y(), close_point.z() );
+        PropDistanceFieldVoxel& closest_point_voxel = getVoxel( close_point.x(), close_point.y(), close_point.z() );
 
         if( closest_point_voxel.distance_square_ != 0 )
         {       // closest point no longer exists
@@ -394,15 +438,65 @@ void PropagationDistanceField::removeObstacleVoxels(const std::vector<Eigen::Vec
       }
     }
   }
-  propagatePositive();
+}
 
-  if(propagate_negative_) {
-    propagateNegative();
+void PropagationDistanceField::resetOrphanedNegativeVoxels(std::vector<Eigen::Vector3i>& negative_stack)
+{
+  int initial_update_direction = getDirectionNumber(0,0,0);
+
+  while(negative_stack.size() > 0)
+  {
+    Eigen::Vector3i loc = negative_stack.back();
+    negative_stack.pop_back();
+
+    for( int neighbor=0; neighbor<27; neighbor++ )
+    {
+      Eigen::Vector3i diff = getLocationDifference(neighbor);
+      Eigen::Vector3i nloc( loc.x() + diff.x(), loc.y() + diff.y(), loc.z() + diff.z() );
+
+      if( isCellValid(nloc.x(), nloc.y(), nloc.z()) )
+      {
+        PropDistanceFieldVoxel& nvoxel = getVoxel(nloc.x(), nloc.y(), nloc.z());
+        Eigen::Vector3i& close_point = nvoxel.closest_negative_point_;
+        if( !isCellValid( close_point.x(), close_point.y(), close_point.z() ) )
+        {
+          close_point = nloc;
+        }
+        PropDistanceFieldVoxel& closest_point_voxel = getVoxel( close_point.x(), close_point.y(), close_point.z() );
+
+        //our closest non-obstacle cell has become an obstacle
+        if( closest_point_voxel.negative_distance_square_ != 0 )
+        {
+          // find all neigbors inside pre-existing obstacles whose
+          // closest_negative_point_ is now an obstacle.  These must all be
+          // set to max_distance_sq_ so they will be re-propogated with a new
+          // closest_negative_point_ that is outside the obstacle.
+          if( nvoxel.negative_distance_square_!=max_distance_sq_)
+          {
+            nvoxel.negative_distance_square_ = max_distance_sq_;
+            nvoxel.closest_negative_point_.x() = PropDistanceFieldVoxel::UNINITIALIZED;
+            nvoxel.closest_negative_point_.y() = PropDistanceFieldVoxel::UNINITIALIZED;
+            nvoxel.closest_negative_point_.z() = PropDistanceFieldVoxel::UNINITIALIZED;
+            negative_stack.push_back(nloc);
+          }
+        }
+        else
+        {
+          //this cell still has a valid non-obstacle cell, so we need to propogate from it
+          nvoxel.negative_update_direction_ = initial_update_direction;
+          negative_bucket_queue_[0].push_back(nloc);
+        }
+      }
+    }
   }
 }
 
 void PropagationDistanceField::propagatePositive()
 {
+  if (propagation_threads_ > 1 && !sparse_grid_ &&
+      propagateInSlabs(bucket_queue_, &PropDistanceFieldVoxel::distance_square_,
+                       &PropDistanceFieldVoxel::closest_point_, &PropDistanceFieldVoxel::update_direction_))
+    return;
 
   // now process the queue:
   for (unsigned int i=0; i<bucket_queue_.size(); ++i)
@@ -412,7 +506,7 @@ void PropagationDistanceField::propagatePositive()
     for ( ; list_it != list_end ; ++list_it)
     {
       const Eigen::Vector3i& loc = *list_it;
-      PropDistanceFieldVoxel* vptr = &voxel_grid_->getCell(loc.x(), loc.y(), loc.z());
+      PropDistanceFieldVoxel* vptr = &getVoxel(loc.x(), loc.y(), loc.z());
 
       // select the neighborhood list based on the update direction:
       std::vector<Eigen::Vector3i >* neighborhood;
@@ -438,7 +532,7 @@ void PropagationDistanceField::propagatePositive()
 
         // the real update code:
         // calculate the neighbor's new distance based on my closest filled voxel:
-        PropDistanceFieldVoxel* neighbor = &voxel_grid_->getCell(nloc.x(),nloc.y(),nloc.z());
+        PropDistanceFieldVoxel* neighbor = &getVoxel(nloc.x(),nloc.y(),nloc.z());
         int new_distance_sq = eucDistSq(vptr->closest_point_, nloc);
         if (new_distance_sq > max_distance_sq_)
           continue;
@@ -462,6 +556,10 @@ void PropagationDistanceField::propagatePositive()
 
 void PropagationDistanceField::propagateNegative()
 {
+  if (propagation_threads_ > 1 && !sparse_grid_ &&
+      propagateInSlabs(negative_bucket_queue_, &PropDistanceFieldVoxel::negative_distance_square_,
+                       &PropDistanceFieldVoxel::closest_negative_point_, &PropDistanceFieldVoxel::negative_update_direction_))
+    return;
 
   // now process the queue:
   for (unsigned int i=0; i<negative_bucket_queue_.size(); ++i)
@@ -471,7 +569,7 @@ void PropagationDistanceField::propagateNegative()
     for ( ; list_it != list_end ; ++list_it)
     {
       const Eigen::Vector3i& loc = *list_it;
-      PropDistanceFieldVoxel* vptr = &voxel_grid_->getCell(loc.x(), loc.y(), loc.z());
+      PropDistanceFieldVoxel* vptr = &getVoxel(loc.x(), loc.y(), loc.z());
 
       // select the neighborhood list based on the update direction:
       std::vector<Eigen::Vector3i >* neighborhood;
@@ -497,7 +595,7 @@ void PropagationDistanceField::propagateNegative()
 
         // the real update code:
         // calculate the neighbor's new distance based on my closest filled voxel:
-        PropDistanceFieldVoxel* neighbor = &voxel_grid_->getCell(nloc.x(),nloc.y(),nloc.z());
+        PropDistanceFieldVoxel* neighbor = &getVoxel(nloc.x(),nloc.y(),nloc.z());
         int new_distance_sq = eucDistSq(vptr->closest_negative_point_, nloc);
         if (new_distance_sq > max_distance_sq_)
           continue;
@@ -519,8 +617,165 @@ void PropagationDistanceField::propagateNegative()
   }
 }
 
+/// The state shared by the threads of PropagationDistanceField::propagateInSlabs()
+struct PropagationDistanceField::SlabPropagation
+{
+  SlabPropagation(unsigned int threads, int x_cells, std::size_t levels,
+                  VoxelIntMember distance, VoxelPointMember closest, VoxelIntMember direction) :
+    slab_count_(2 * threads),
+    slab_of_x_(x_cells),
+    queues_(2 * threads, std::vector<std::vector<Eigen::Vector3i> >(levels)),
+    offsets_(2 * threads * 3, 0),
+    level_(0),
+    distance_(distance),
+    closest_(closest),
+    direction_(direction)
+  {
+    for (unsigned int s = 0 ; s < slab_count_ ; ++s)
+      for (int x = s * x_cells / slab_count_ ; x < (int)((s + 1) * x_cells / slab_count_) ; ++x)
+        slab_of_x_[x] = s;
+  }
+
+  /// Find the first level from \e level on with cells to process; all queues are read, so no thread may be writing to them
+  std::size_t findNonEmptyLevel(std::size_t level) const
+  {
+    for ( ; level < queues_[0].size() ; ++level)
+      for (unsigned int s = 0 ; s < slab_count_ ; ++s)
+        if (!queues_[s][level].empty())
+          return level;
+    return level;
+  }
+
+  /// Twice the number of threads: in each phase, every thread processes one slab
+  unsigned int slab_count_;
+
+  /// For each X cell index, the slab it belongs to
+  std::vector<unsigned int> slab_of_x_;
+
+  /// For each slab and each distance level, the cells queued by the thread processing the slab
+  std::vector<std::vector<std::vector<Eigen::Vector3i> > > queues_;
+
+  /// For each slab, how far it has read the queues of the slab before it, its own, and the one after it, at the current level
+  std::vector<std::size_t> offsets_;
+
+  /// The level currently processed
+  std::size_t level_;
+
+  VoxelIntMember distance_;
+  VoxelPointMember closest_;
+  VoxelIntMember direction_;
+};
+
+bool PropagationDistanceField::propagateInSlabs(std::vector<std::vector<Eigen::Vector3i> >& bucket_queue,
+                                                VoxelIntMember distance, VoxelPointMember closest, VoxelIntMember direction)
+{
+  // updates reach one cell beyond a slab, so slabs processed at the same time need to be at least two cells apart
+  moveit::tools::ThreadPool &pool = moveit::tools::ThreadPool::Instance();
+  unsigned int threads = std::min(std::min(propagation_threads_, pool.getThreadCount()), (unsigned int)(getXNumCells() / 4));
+  if (threads < 2)
+    return false;
+
+  SlabPropagation sp(threads, getXNumCells(), bucket_queue.size(), distance, closest, direction);
+  for (std::size_t i = 0 ; i < bucket_queue.size() ; ++i)
+  {
+    for (std::size_t j = 0 ; j < bucket_queue[i].size() ; ++j)
+      sp.queues_[sp.slab_of_x_[bucket_queue[i][j].x()]][i].push_back(bucket_queue[i][j]);
+    bucket_queue[i].clear();
+  }
+  sp.level_ = sp.findNonEmptyLevel(0);
+
+  while (sp.level_ < sp.queues_[0].size())
+  {
+    // even slabs first, then odd slabs; each phase is one parallel call on the shared pool
+    pool.parallelFor(0, threads, boost::bind(&PropagationDistanceField::propagateSlabs, this, boost::ref(sp), 0, _1));
+    pool.parallelFor(0, threads, boost::bind(&PropagationDistanceField::propagateSlabs, this, boost::ref(sp), 1, _1));
+
+    // cells at the same level may have been queued for slabs that were already processed
+    bool more = false;
+    for (unsigned int s = 0 ; s < sp.slab_count_ && !more ; ++s)
+      for (unsigned int k = 0 ; k < 3 && !more ; ++k)
+        if (s + k >= 1 && s + k <= sp.slab_count_)
+          more = sp.offsets_[s * 3 + k] < sp.queues_[s + k - 1][sp.level_].size();
+    if (more)
+      continue;
+
+    for (unsigned int s = 0 ; s < sp.slab_count_ ; ++s)
+    {
+      sp.queues_[s][sp.level_].clear();
+      for (unsigned int k = 0 ; k < 3 ; ++k)
+        sp.offsets_[s * 3 + k] = 0;
+    }
+    sp.level_ = sp.findNonEmptyLevel(sp.level_ + 1);
+  }
+  return true;
+}
+
+void PropagationDistanceField::propagateSlabs(SlabPropagation& sp, unsigned int parity, std::size_t thread)
+{
+  propagateSlab(sp, 2 * thread + parity, sp.level_);
+}
+
+void PropagationDistanceField::propagateSlab(SlabPropagation& sp, unsigned int slab, unsigned int level)
+{
+  int D = level > 1 ? 1 : level;
+  for (unsigned int k = 0 ; k < 3 ; ++k)
+  {
+    if (slab + k < 1 || slab + k > sp.slab_count_)
+      continue;
+    const std::vector<Eigen::Vector3i>& queue = sp.queues_[slab + k - 1][level];
+    std::size_t& offset = sp.offsets_[slab * 3 + k];
+
+    // the queue of this slab may grow while it is read
+    for ( ; offset < queue.size() ; ++offset)
+    {
+      const Eigen::Vector3i loc = queue[offset];
+      if (sp.slab_of_x_[loc.x()] != slab)
+        continue;
+      PropDistanceFieldVoxel* vptr = &getVoxel(loc.x(), loc.y(), loc.z());
+      int update_direction = vptr->*sp.direction_;
+      if (update_direction < 0 || update_direction > 26)
+      {
+        logError("PROGRAMMING ERROR: Invalid update direction detected: %d", update_direction);
+        continue;
+      }
+
+      const std::vector<Eigen::Vector3i>& neighborhood = neighborhoods_[D][update_direction];
+      const Eigen::Vector3i closest_point = vptr->*sp.closest_;
+      for (unsigned int n = 0 ; n < neighborhood.size() ; n++)
+      {
+        const Eigen::Vector3i& diff = neighborhood[n];
+        Eigen::Vector3i nloc(loc.x() + diff.x(), loc.y() + diff.y(), loc.z() + diff.z());
+        if (!isCellValid(nloc.x(), nloc.y(), nloc.z()))
+          continue;
+
+        PropDistanceFieldVoxel* neighbor = &getVoxel(nloc.x(), nloc.y(), nloc.z());
+        int new_distance_sq = eucDistSq(closest_point, nloc);
+        if (new_distance_sq > max_distance_sq_)
+          continue;
+
+        if (new_distance_sq < neighbor->*sp.distance_)
+        {
+          neighbor->*sp.distance_ = new_distance_sq;
+          neighbor->*sp.closest_ = closest_point;
+          neighbor->*sp.direction_ = getDirectionNumber(diff.x(), diff.y(), diff.z());
+          sp.queues_[slab][new_distance_sq].push_back(nloc);
+        }
+      }
+    }
+  }
+}
+
 void PropagationDistanceField::reset()
 {
+  invalidateGradientCache();
+  obstacle_ids_.clear();
+  if (sparse_grid_)
+  {
+    // cells that were never written have no closest negative point;
+    // addNewObstacleVoxels() treats that as the cell itself
+    sparse_grid_->reset(PropDistanceFieldVoxel(max_distance_sq_,0));
+    return;
+  }
   voxel_grid_->reset(PropDistanceFieldVoxel(max_distance_sq_,0));
   for(int x = 0; x < getXNumCells(); x++)
   {
@@ -528,7 +783,7 @@ void PropagationDistanceField::reset()
     {
       for(int z = 0; z < getZNumCells(); z++)
       {
-        PropDistanceFieldVoxel& voxel = voxel_grid_->getCell(x,y,z);
+        PropDistanceFieldVoxel& voxel = getVoxel(x,y,z);
         voxel.closest_negative_point_.x() = x;
         voxel.closest_negative_point_.y() = y;
         voxel.closest_negative_point_.z() = z;
@@ -539,6 +794,121 @@ void PropagationDistanceField::reset()
   //object_voxel_locations_.clear();
 }
 
+bool PropagationDistanceField::shiftOrigin(int dx, int dy, int dz)
+{
+  if (sparse_grid_)
+  {
+    logError("The origin of a distance field with sparse storage cannot be shifted");
+    return false;
+  }
+  if (dx == 0 && dy == 0 && dz == 0)
+    return true;
+  invalidateGradientCache();
+
+  const Eigen::Vector3i d(dx, dy, dz);
+  const int num_cells[3] = { getXNumCells(), getYNumCells(), getZNumCells() };
+  voxel_grid_->shift(dx, dy, dz);
+  origin_x_ += dx * resolution_;
+  origin_y_ += dy * resolution_;
+  origin_z_ += dz * resolution_;
+
+  for (int k = 0 ; k < 3 ; ++k)
+    if (std::abs(d[k]) >= num_cells[k])
+    {
+      reset();
+      return true;
+    }
+
+  if (!obstacle_ids_.empty())
+  {
+    std::map<Eigen::Vector3i, int, compareEigen_Vector3i> obstacle_ids;
+    for (std::map<Eigen::Vector3i, int, compareEigen_Vector3i>::const_iterator it = obstacle_ids_.begin() ; it != obstacle_ids_.end() ; ++it)
+    {
+      Eigen::Vector3i loc = it->first - d;
+      if (isCellValid(loc.x(), loc.y(), loc.z()))
+        obstacle_ids[loc] = it->second;
+    }
+    obstacle_ids_.swap(obstacle_ids);
+  }
+
+  // the cells that entered the volume start without obstacles; the cells that remain keep their closest points,
+  // translated to the new indices, unless those points left the volume
+  int initial_update_direction = getDirectionNumber(0,0,0);
+  std::vector<Eigen::Vector3i> stack;
+  std::vector<Eigen::Vector3i> negative_stack;
+  for (int x = 0 ; x < num_cells[0] ; ++x)
+    for (int y = 0 ; y < num_cells[1] ; ++y)
+      for (int z = 0 ; z < num_cells[2] ; ++z)
+      {
+        const Eigen::Vector3i loc(x, y, z);
+        PropDistanceFieldVoxel& voxel = getVoxel(x, y, z);
+        bool exposed = false;
+        for (int k = 0 ; k < 3 && !exposed ; ++k)
+          exposed = d[k] > 0 ? loc[k] >= num_cells[k] - d[k] : loc[k] < -d[k];
+
+        if (exposed)
+        {
+          voxel = PropDistanceFieldVoxel(max_distance_sq_, 0);
+          voxel.closest_point_ = loc;
+          voxel.update_direction_ = initial_update_direction;
+          voxel.closest_negative_point_ = loc;
+          voxel.negative_update_direction_ = initial_update_direction;
+          stack.push_back(loc);
+          if (propagate_negative_)
+            negative_bucket_queue_[0].push_back(loc);
+          continue;
+        }
+
+        Eigen::Vector3i& closest = voxel.closest_point_;
+        if (isCellValid(closest.x(), closest.y(), closest.z()))
+        {
+          closest -= d;
+          if (!isCellValid(closest.x(), closest.y(), closest.z()))
+          {
+            voxel.distance_square_ = max_distance_sq_;
+            closest = loc;
+            voxel.update_direction_ = initial_update_direction;
+            stack.push_back(loc);
+          }
+        }
+        else
+          closest = loc;
+
+        if (!propagate_negative_)
+          continue;
+        Eigen::Vector3i& closest_negative = voxel.closest_negative_point_;
+        if (isCellValid(closest_negative.x(), closest_negative.y(), closest_negative.z()))
+        {
+          closest_negative -= d;
+          if (!isCellValid(closest_negative.x(), closest_negative.y(), closest_negative.z()))
+          {
+            voxel.negative_distance_square_ = max_distance_sq_;
+            closest_negative.x() = PropDistanceFieldVoxel::UNINITIALIZED;
+            closest_negative.y() = PropDistanceFieldVoxel::UNINITIALIZED;
+            closest_negative.z() = PropDistanceFieldVoxel::UNINITIALIZED;
+            negative_stack.push_back(loc);
+          }
+        }
+      }
+
+  resetOrphanedVoxels(stack);
+  propagatePositive();
+  if (propagate_negative_)
+  {
+    resetOrphanedNegativeVoxels(negative_stack);
+    propagateNegative();
+  }
+  return true;
+}
+
+bool PropagationDistanceField::recenter(double x, double y, double z)
+{
+  int dx = (int)floor((x - size_x_ / 2.0 - origin_x_) / resolution_ + 0.5);
+  int dy = (int)floor((y - size_y_ / 2.0 - origin_y_) / resolution_ + 0.5);
+  int dz = (int)floor((z - size_z_ / 2.0 - origin_z_) / resolution_ + 0.5);
+  return shiftOrigin(dx, dy, dz);
+}
+
 void PropagationDistanceField::initNeighborhoods()
 {
   // first initialize the direction number mapping:
@@ -556,6 +926,7 @@ void PropagationDistanceField::initNeighborhoods()
     }
   }
 
+  neighborhoods_.clear();
   neighborhoods_.resize(2);
   for (int n=0; n<2; n++)
   {
@@ -609,42 +980,260 @@ Eigen::Vector3i PropagationDistanceField::getLocationDifference(int directionNum
 
 double PropagationDistanceField::getDistance(double x, double y, double z) const
 {
+  if (sparse_grid_)
+    return getDistance((*sparse_grid_)(x,y,z));
   return getDistance((*voxel_grid_.get())(x,y,z));
 }
 
 double PropagationDistanceField::getDistance(int x, int y, int z) const
 {
-  return getDistance(voxel_grid_->getCell(x,y,z));
+  return getDistance(getVoxel(x,y,z));
+}
+
+int PropagationDistanceField::getClosestObstacleId(int x, int y, int z) const
+{
+  if (obstacle_ids_.empty())
+    return NO_OBSTACLE_ID;
+  const Eigen::Vector3i& closest = getVoxel(x,y,z).closest_point_;
+  if (!isCellValid(closest.x(), closest.y(), closest.z()))
+    return NO_OBSTACLE_ID;
+  std::map<Eigen::Vector3i, int, compareEigen_Vector3i>::const_iterator it = obstacle_ids_.find(closest);
+  return it == obstacle_ids_.end() ? NO_OBSTACLE_ID : it->second;
+}
+
+int PropagationDistanceField::getClosestObstacleId(double x, double y, double z, double& distance) const
+{
+  int cx, cy, cz;
+  if (!worldToGrid(x, y, z, cx, cy, cz))
+  {
+    distance = getUninitializedDistance();
+    return NO_OBSTACLE_ID;
+  }
+  distance = getDistance(getVoxel(cx, cy, cz));
+  return getClosestObstacleId(cx, cy, cz);
+}
+
+struct PropagationDistanceField::CellDistance
+{
+  CellDistance(const PropagationDistanceField &df) : df_(df)
+  {
+  }
+
+  double operator()(int x, int y, int z) const
+  {
+    return df_.PropagationDistanceField::getDistance(df_.getVoxel(x, y, z));
+  }
+
+  const PropagationDistanceField &df_;
+};
+
+bool PropagationDistanceField::getInterpolatedDistances(const EigenSTL::vector_Vector3d& points,
+                                                        std::vector<double>& distances) const
+{
+  return interpolateDistances(CellDistance(*this), points, distances, NULL);
+}
+
+bool PropagationDistanceField::getInterpolatedDistanceGradients(const EigenSTL::vector_Vector3d& points,
+                                                                std::vector<double>& distances,
+                                                                EigenSTL::vector_Vector3d& gradients) const
+{
+  return interpolateDistances(CellDistance(*this), points, distances, &gradients);
+}
+
+void PropagationDistanceField::setGradientCaching(bool flag)
+{
+  if (!flag)
+  {
+    std::vector<Eigen::Vector3f>().swap(gradient_cache_);
+    std::vector<char>().swap(gradient_block_valid_);
+    return;
+  }
+  gradient_cache_.resize((std::size_t)getXNumCells() * getYNumCells() * getZNumCells());
+  gradient_block_valid_.assign((std::size_t)getGradientBlockCount(DIM_X) * getGradientBlockCount(DIM_Y) *
+                               getGradientBlockCount(DIM_Z), 0);
+}
+
+void PropagationDistanceField::updateGradientCache() const
+{
+  if (gradient_block_valid_.empty())
+    return;
+  const int nbx = getGradientBlockCount(DIM_X);
+  const int nby = getGradientBlockCount(DIM_Y);
+  const int nbz = getGradientBlockCount(DIM_Z);
+  std::size_t block = 0;
+  for (int bx = 0 ; bx < nbx ; ++bx)
+    for (int by = 0 ; by < nby ; ++by)
+      for (int bz = 0 ; bz < nbz ; ++bz, ++block)
+        if (!gradient_block_valid_[block])
+          computeGradientBlock(bx, by, bz, block);
+}
+
+Eigen::Vector3f PropagationDistanceField::computeCellGradient(int x, int y, int z) const
+{
+  const int c[3] = { x, y, z };
+  const int num_cells[3] = { getXNumCells(), getYNumCells(), getZNumCells() };
+  CellDistance cell_distance(*this);
+  Eigen::Vector3f gradient;
+  for (int k = 0 ; k < 3 ; ++k)
+  {
+    int lo[3] = { x, y, z };
+    int hi[3] = { x, y, z };
+    if (c[k] > 0)
+      --lo[k];
+    if (c[k] < num_cells[k] - 1)
+      ++hi[k];
+    if (lo[k] == hi[k])
+      gradient[k] = 0.0f;
+    else
+      gradient[k] = (cell_distance(hi[0], hi[1], hi[2]) - cell_distance(lo[0], lo[1], lo[2])) /
+        ((hi[k] - lo[k]) * resolution_);
+  }
+  return gradient;
+}
+
+void PropagationDistanceField::computeGradientBlock(int bx, int by, int bz, std::size_t block) const
+{
+  const int ny = getYNumCells();
+  const int nz = getZNumCells();
+  const int x_end = std::min((bx + 1) << GRADIENT_BLOCK_LOG2, getXNumCells());
+  const int y_end = std::min((by + 1) << GRADIENT_BLOCK_LOG2, ny);
+  const int z_end = std::min((bz + 1) << GRADIENT_BLOCK_LOG2, nz);
+  for (int x = bx << GRADIENT_BLOCK_LOG2 ; x < x_end ; ++x)
+    for (int y = by << GRADIENT_BLOCK_LOG2 ; y < y_end ; ++y)
+      for (int z = bz << GRADIENT_BLOCK_LOG2 ; z < z_end ; ++z)
+        gradient_cache_[((std::size_t)x * ny + y) * nz + z] = computeCellGradient(x, y, z);
+  gradient_block_valid_[block] = 1;
+}
+
+const Eigen::Vector3f& PropagationDistanceField::getCachedGradient(int x, int y, int z) const
+{
+  const int bx = x >> GRADIENT_BLOCK_LOG2;
+  const int by = y >> GRADIENT_BLOCK_LOG2;
+  const int bz = z >> GRADIENT_BLOCK_LOG2;
+  const std::size_t block = ((std::size_t)bx * getGradientBlockCount(DIM_Y) + by) * getGradientBlockCount(DIM_Z) + bz;
+  if (!gradient_block_valid_[block])
+    computeGradientBlock(bx, by, bz, block);
+  return gradient_cache_[((std::size_t)x * getYNumCells() + y) * getZNumCells() + z];
+}
+
+double PropagationDistanceField::getDistanceGradient(double x, double y, double z,
+                                                     double& gradient_x, double& gradient_y, double& gradient_z,
+                                                     bool& in_bounds) const
+{
+  if (gradient_block_valid_.empty())
+    return DistanceField::getDistanceGradient(x, y, z, gradient_x, gradient_y, gradient_z, in_bounds);
+
+  int gx, gy, gz;
+  worldToGrid(x, y, z, gx, gy, gz);
+
+  // same bounds as DistanceField::getDistanceGradient(), so enabling the cache does not change the result
+  if (gx<1 || gy<1 || gz<1 || gx>=getXNumCells()-1 || gy>=getYNumCells()-1 || gz>=getZNumCells()-1)
+  {
+    gradient_x = 0.0;
+    gradient_y = 0.0;
+    gradient_z = 0.0;
+    in_bounds = false;
+    return getUninitializedDistance();
+  }
+
+  const Eigen::Vector3f& gradient = getCachedGradient(gx, gy, gz);
+  gradient_x = gradient.x();
+  gradient_y = gradient.y();
+  gradient_z = gradient.z();
+  in_bounds = true;
+  return getDistance(getVoxel(gx, gy, gz));
+}
+
+bool PropagationDistanceField::getSmoothDistanceGradients(const EigenSTL::vector_Vector3d& points,
+                                                          std::vector<double>& distances,
+                                                          EigenSTL::vector_Vector3d& gradients) const
+{
+  // the distances and the cell bounds are those of getInterpolatedDistances()
+  bool all_in_bounds = interpolateDistances(CellDistance(*this), points, distances, NULL);
+  gradients.resize(points.size());
+
+  const int num_cells[3] = { getXNumCells(), getYNumCells(), getZNumCells() };
+  const double origin[3] = { origin_x_, origin_y_, origin_z_ };
+  const double oo_resolution = 1.0 / resolution_;
+  const bool cached = !gradient_block_valid_.empty();
+
+  for (std::size_t i = 0 ; i < points.size() ; ++i)
+  {
+    int c[3];
+    double t[3];
+    bool in_bounds = true;
+    for (int k = 0 ; k < 3 ; ++k)
+    {
+      double u = (points[i][k] - origin[k]) * oo_resolution;
+      if (!(u >= -0.5 && u < num_cells[k] - 0.5) || num_cells[k] < 2)
+      {
+        in_bounds = false;
+        break;
+      }
+      u = std::min(std::max(u, 0.0), double(num_cells[k] - 1));
+      c[k] = std::min(int(u), num_cells[k] - 2);
+      t[k] = u - c[k];
+    }
+    Eigen::Vector3d& g = gradients[i];
+    g.setZero();
+    if (!in_bounds)
+      continue;
+
+    for (int dx = 0 ; dx < 2 ; ++dx)
+      for (int dy = 0 ; dy < 2 ; ++dy)
+        for (int dz = 0 ; dz < 2 ; ++dz)
+        {
+          double w = (dx ? t[0] : 1.0 - t[0]) * (dy ? t[1] : 1.0 - t[1]) * (dz ? t[2] : 1.0 - t[2]);
+          if (cached)
+            g += w * getCachedGradient(c[0] + dx, c[1] + dy, c[2] + dz).cast<double>();
+          else
+            g += w * computeCellGradient(c[0] + dx, c[1] + dy, c[2] + dz).cast<double>();
+        }
+  }
+  return all_in_bounds;
 }
 
 bool PropagationDistanceField::isCellValid(int x, int y, int z) const
 {
+  if (sparse_grid_)
+    return sparse_grid_->isCellValid(x,y,z);
   return voxel_grid_->isCellValid(x,y,z);
 }
 
 int PropagationDistanceField::getXNumCells() const
 {
+  if (sparse_grid_)
+    return sparse_grid_->getNumCells(DIM_X);
   return voxel_grid_->getNumCells(DIM_X);
 }
 
 int PropagationDistanceField::getYNumCells() const
 {
+  if (sparse_grid_)
+    return sparse_grid_->getNumCells(DIM_Y);
   return voxel_grid_->getNumCells(DIM_Y);
 }
 
 int PropagationDistanceField::getZNumCells() const
 {
+  if (sparse_grid_)
+    return sparse_grid_->getNumCells(DIM_Z);
   return voxel_grid_->getNumCells(DIM_Z);
 }
 
 bool PropagationDistanceField::gridToWorld(int x, int y, int z, double& world_x, double& world_y, double& world_z) const
 {
-  voxel_grid_->gridToWorld(x, y, z, world_x, world_y, world_z);
+  if (sparse_grid_)
+    sparse_grid_->gridToWorld(x, y, z, world_x, world_y, world_z);
+  else
+    voxel_grid_->gridToWorld(x, y, z, world_x, world_y, world_z);
   return true;
 }
 
 bool PropagationDistanceField::worldToGrid(double world_x, double world_y, double world_z, int& x, int& y, int& z) const
 {
+  if (sparse_grid_)
+    return sparse_grid_->worldToGrid(world_x, world_y, world_z, x, y, z);
   return voxel_grid_->worldToGrid(world_x, world_y, world_z, x, y, z);
 }
 
@@ -679,6 +1268,7 @@ bool PropagationDistanceField::writeToStream(std::ostream& os) const
     }
   }
   out.flush();
+  return true;
 }
 
 bool PropagationDistanceField::readFromStream(std::istream& is)
@@ -751,6 +1341,130 @@ bool PropagationDistanceField::readFromStream(std::istream& is)
     }
   }
   addNewObstacleVoxels(obs_points);
+  return true;
+}
+
+bool PropagationDistanceField::writeToBinaryFile(const std::string& filename) const
+{
+  BinaryFieldHeader header;
+  std::memset(&header, 0, sizeof(header));
+  std::memcpy(header.magic_, BINARY_FIELD_MAGIC, sizeof(header.magic_));
+  header.version_ = BINARY_FIELD_VERSION;
+  header.byte_order_ = BINARY_FIELD_BYTE_ORDER;
+  header.voxel_size_ = sizeof(PropDistanceFieldVoxel);
+  header.propagate_negative_ = propagate_negative_ ? 1 : 0;
+  header.num_cells_[DIM_X] = getXNumCells();
+  header.num_cells_[DIM_Y] = getYNumCells();
+  header.num_cells_[DIM_Z] = getZNumCells();
+  header.size_[DIM_X] = size_x_;
+  header.size_[DIM_Y] = size_y_;
+  header.size_[DIM_Z] = size_z_;
+  header.origin_[DIM_X] = origin_x_;
+  header.origin_[DIM_Y] = origin_y_;
+  header.origin_[DIM_Z] = origin_z_;
+  header.resolution_ = resolution_;
+  header.max_distance_ = max_distance_;
+
+  std::ofstream os(filename.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+  if (!os.good())
+  {
+    logError("Unable to open '%s' for writing the distance field", filename.c_str());
+    return false;
+  }
+  os.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+  // the voxels are written in the order they are stored in a (dense) VoxelGrid
+  for (int x = 0 ; x < getXNumCells() ; ++x)
+    for (int y = 0 ; y < getYNumCells() ; ++y)
+    {
+      if (voxel_grid_ && voxel_grid_->getCellOffset(DIM_Z) == 0)
+        os.write(reinterpret_cast<const char*>(&getVoxel(x, y, 0)), getZNumCells() * sizeof(PropDistanceFieldVoxel));
+      else
+        for (int z = 0 ; z < getZNumCells() ; ++z)
+          os.write(reinterpret_cast<const char*>(&getVoxel(x, y, z)), sizeof(PropDistanceFieldVoxel));
+    }
+  os.close();
+  if (os.fail())
+  {
+    logError("Unable to write the distance field to '%s'", filename.c_str());
+    return false;
+  }
+  return true;
+}
+
+bool PropagationDistanceField::mapBinaryFile(const std::string& filename)
+{
+  boost::shared_ptr<boost::iostreams::mapped_file> file(new boost::iostreams::mapped_file());
+  try
+  {
+    boost::iostreams::mapped_file_params params(filename);
+    params.flags = boost::iostreams::mapped_file::priv;
+    file->open(params);
+  }
+  catch (std::exception &ex)
+  {
+    logError("Unable to map distance field file '%s': %s", filename.c_str(), ex.what());
+    return false;
+  }
+
+  BinaryFieldHeader header;
+  if (file->size() < sizeof(header))
+  {
+    logError("Distance field file '%s' is too short", filename.c_str());
+    return false;
+  }
+  std::memcpy(&header, file->const_data(), sizeof(header));
+  if (std::memcmp(header.magic_, BINARY_FIELD_MAGIC, sizeof(header.magic_)) != 0 ||
+      header.version_ != BINARY_FIELD_VERSION)
+  {
+    logError("'%s' is not a distance field file of a supported version", filename.c_str());
+    return false;
+  }
+  if (header.byte_order_ != BINARY_FIELD_BYTE_ORDER || header.voxel_size_ != sizeof(PropDistanceFieldVoxel))
+  {
+    logError("Distance field file '%s' was written on an incompatible platform", filename.c_str());
+    return false;
+  }
+  std::size_t cells = (std::size_t)header.num_cells_[DIM_X] * header.num_cells_[DIM_Y] * header.num_cells_[DIM_Z];
+  if (file->size() != sizeof(header) + cells * sizeof(PropDistanceFieldVoxel))
+  {
+    logError("Distance field file '%s' has %u bytes, which does not match its header",
+             filename.c_str(), (unsigned int)file->size());
+    return false;
+  }
+
+  // the cell counts VoxelGrid computes from the size and resolution
+  double oo_resolution = 1.0 / header.resolution_;
+  for (int i = DIM_X ; i <= DIM_Z ; ++i)
+    if ((int)(header.size_[i] * oo_resolution) != header.num_cells_[i])
+    {
+      logError("The cell counts in distance field file '%s' do not match its size and resolution", filename.c_str());
+      return false;
+    }
+
+  size_x_ = header.size_[DIM_X];
+  size_y_ = header.size_[DIM_Y];
+  size_z_ = header.size_[DIM_Z];
+  origin_x_ = header.origin_[DIM_X];
+  origin_y_ = header.origin_[DIM_Y];
+  origin_z_ = header.origin_[DIM_Z];
+  resolution_ = header.resolution_;
+  inv_twice_resolution_ = 1.0/(2.0*resolution_);
+  max_distance_ = header.max_distance_;
+  propagate_negative_ = header.propagate_negative_ != 0;
+  sparse_storage_ = false;
+  initializeTables();
+
+  boost::shared_ptr<VoxelGrid<PropDistanceFieldVoxel> > grid(new VoxelGrid<PropDistanceFieldVoxel>());
+  grid->resize(size_x_, size_y_, size_z_, resolution_, origin_x_, origin_y_, origin_z_,
+               PropDistanceFieldVoxel(max_distance_sq_,0));
+  grid->setExternalData(reinterpret_cast<PropDistanceFieldVoxel*>(file->data() + sizeof(header)));
+  sparse_grid_.reset();
+  voxel_grid_ = grid;
+  mapped_file_ = file;
+  if (getGradientCaching())
+    setGradientCaching(true);
+  return true;
 }
 
 }
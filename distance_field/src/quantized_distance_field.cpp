@@ -0,0 +1,265 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2013, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#include <moveit/distance_field/quantized_distance_field.h>
+#include <console_bridge/console.h>
+#include <boost/iostreams/filtering_stream.hpp>
+#include <boost/iostreams/filter/zlib.hpp>
+#include <algorithm>
+#include <cmath>
+
+namespace distance_field
+{
+
+namespace
+{
+static const double QUANTIZATION_LEVELS = 32767.0;
+}
+
+struct QuantizedDistanceField::CellDistance
+{
+  CellDistance(const QuantizedDistanceField &df) : df_(df)
+  {
+  }
+
+  double operator()(int x, int y, int z) const
+  {
+    return df_.decode(df_.grid_.getCell(x, y, z));
+  }
+
+  const QuantizedDistanceField &df_;
+};
+
+QuantizedDistanceField::QuantizedDistanceField(const DistanceField& field, double max_distance)
+  : DistanceField(field.getSizeX(), field.getSizeY(), field.getSizeZ(), field.getResolution(),
+                  field.getOriginX(), field.getOriginY(), field.getOriginZ()),
+    max_distance_(max_distance)
+{
+  initialize();
+  quantize(field);
+}
+
+void QuantizedDistanceField::initialize()
+{
+  step_ = max_distance_ > 0.0 ? max_distance_ / QUANTIZATION_LEVELS : 1.0;
+  grid_.resize(size_x_, size_y_, size_z_, resolution_, origin_x_, origin_y_, origin_z_, encode(max_distance_));
+  reset();
+}
+
+boost::int16_t QuantizedDistanceField::encode(double distance) const
+{
+  double q = floor(distance / step_ + 0.5);
+  return static_cast<boost::int16_t>(std::min(std::max(q, -QUANTIZATION_LEVELS), QUANTIZATION_LEVELS));
+}
+
+bool QuantizedDistanceField::quantize(const DistanceField& field)
+{
+  if (field.getXNumCells() != getXNumCells() || field.getYNumCells() != getYNumCells() ||
+      field.getZNumCells() != getZNumCells())
+  {
+    logError("Cannot quantize a distance field of %d x %d x %d cells into one of %d x %d x %d cells",
+             field.getXNumCells(), field.getYNumCells(), field.getZNumCells(),
+             getXNumCells(), getYNumCells(), getZNumCells());
+    return false;
+  }
+  for (int x = 0 ; x < getXNumCells() ; ++x)
+    for (int y = 0 ; y < getYNumCells() ; ++y)
+      for (int z = 0 ; z < getZNumCells() ; ++z)
+        grid_.getCell(x, y, z) = encode(field.getDistance(x, y, z));
+  return true;
+}
+
+void QuantizedDistanceField::addPointsToField(const EigenSTL::vector_Vector3d& points)
+{
+  logError("Obstacles cannot be added to a quantized distance field; quantize() a field that contains them instead");
+}
+
+void QuantizedDistanceField::removePointsFromField(const EigenSTL::vector_Vector3d& points)
+{
+  logError("Obstacles cannot be removed from a quantized distance field; quantize() a field that does not contain them instead");
+}
+
+void QuantizedDistanceField::updatePointsInField(const EigenSTL::vector_Vector3d& old_points,
+                                                 const EigenSTL::vector_Vector3d& new_points)
+{
+  logError("Obstacles cannot be moved in a quantized distance field; quantize() the updated field instead");
+}
+
+void QuantizedDistanceField::reset()
+{
+  grid_.reset(encode(max_distance_));
+}
+
+double QuantizedDistanceField::getDistance(double x, double y, double z) const
+{
+  return decode(grid_(x, y, z));
+}
+
+double QuantizedDistanceField::getDistance(int x, int y, int z) const
+{
+  return decode(grid_.getCell(x, y, z));
+}
+
+bool QuantizedDistanceField::getInterpolatedDistances(const EigenSTL::vector_Vector3d& points,
+                                                      std::vector<double>& distances) const
+{
+  return interpolateDistances(CellDistance(*this), points, distances, NULL);
+}
+
+bool QuantizedDistanceField::getInterpolatedDistanceGradients(const EigenSTL::vector_Vector3d& points,
+                                                              std::vector<double>& distances,
+                                                              EigenSTL::vector_Vector3d& gradients) const
+{
+  return interpolateDistances(CellDistance(*this), points, distances, &gradients);
+}
+
+bool QuantizedDistanceField::isCellValid(int x, int y, int z) const
+{
+  return grid_.isCellValid(x, y, z);
+}
+
+int QuantizedDistanceField::getXNumCells() const
+{
+  return grid_.getNumCells(DIM_X);
+}
+
+int QuantizedDistanceField::getYNumCells() const
+{
+  return grid_.getNumCells(DIM_Y);
+}
+
+int QuantizedDistanceField::getZNumCells() const
+{
+  return grid_.getNumCells(DIM_Z);
+}
+
+bool QuantizedDistanceField::gridToWorld(int x, int y, int z, double& world_x, double& world_y, double& world_z) const
+{
+  grid_.gridToWorld(x, y, z, world_x, world_y, world_z);
+  return true;
+}
+
+bool QuantizedDistanceField::worldToGrid(double world_x, double world_y, double world_z, int& x, int& y, int& z) const
+{
+  return grid_.worldToGrid(world_x, world_y, world_z, x, y, z);
+}
+
+bool QuantizedDistanceField::writeToStream(std::ostream& os) const
+{
+  os << "resolution: " << resolution_ << std::endl;
+  os << "size_x: " << size_x_ << std::endl;
+  os << "size_y: " << size_y_ << std::endl;
+  os << "size_z: " << size_z_ << std::endl;
+  os << "origin_x: " << origin_x_ << std::endl;
+  os << "origin_y: " << origin_y_ << std::endl;
+  os << "origin_z: " << origin_z_ << std::endl;
+  os << "max_distance: " << max_distance_ << std::endl;
+
+  boost::iostreams::filtering_ostream out;
+  out.push(boost::iostreams::zlib_compressor());
+  out.push(os);
+
+  // little endian, regardless of the host
+  for (int x = 0 ; x < getXNumCells() ; ++x)
+    for (int y = 0 ; y < getYNumCells() ; ++y)
+      for (int z = 0 ; z < getZNumCells() ; ++z)
+      {
+        boost::uint16_t v = static_cast<boost::uint16_t>(grid_.getCell(x, y, z));
+        char bytes[2] = { static_cast<char>(v & 0xff), static_cast<char>(v >> 8) };
+        out.write(bytes, 2);
+      }
+  out.flush();
+  return os.good();
+}
+
+bool QuantizedDistanceField::readFromStream(std::istream& is)
+{
+  if (!is.good())
+    return false;
+
+  std::string temp;
+  is >> temp;
+  if (temp != "resolution:") return false;
+  is >> resolution_;
+  is >> temp;
+  if (temp != "size_x:") return false;
+  is >> size_x_;
+  is >> temp;
+  if (temp != "size_y:") return false;
+  is >> size_y_;
+  is >> temp;
+  if (temp != "size_z:") return false;
+  is >> size_z_;
+  is >> temp;
+  if (temp != "origin_x:") return false;
+  is >> origin_x_;
+  is >> temp;
+  if (temp != "origin_y:") return false;
+  is >> origin_y_;
+  is >> temp;
+  if (temp != "origin_z:") return false;
+  is >> origin_z_;
+  is >> temp;
+  if (temp != "max_distance:") return false;
+  is >> max_distance_;
+
+  inv_twice_resolution_ = 1.0 / (2.0 * resolution_);
+  initialize();
+
+  // this should be newline
+  char nl;
+  is.get(nl);
+
+  boost::iostreams::filtering_istream in;
+  in.push(boost::iostreams::zlib_decompressor());
+  in.push(is);
+
+  for (int x = 0 ; x < getXNumCells() ; ++x)
+    for (int y = 0 ; y < getYNumCells() ; ++y)
+      for (int z = 0 ; z < getZNumCells() ; ++z)
+      {
+        char bytes[2];
+        if (!in.read(bytes, 2))
+        {
+          logError("Unexpected end of the distance field stream");
+          return false;
+        }
+        boost::uint16_t v = static_cast<boost::uint16_t>(static_cast<unsigned char>(bytes[0]) |
+                                                         (static_cast<unsigned char>(bytes[1]) << 8));
+        grid_.getCell(x, y, z) = static_cast<boost::int16_t>(v);
+      }
+  return true;
+}
+
+}
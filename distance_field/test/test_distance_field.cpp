@@ -38,12 +38,16 @@
 
 #include <moveit/distance_field/voxel_grid.h>
 #include <moveit/distance_field/propagation_distance_field.h>
+#include <moveit/distance_field/euclidean_distance_transform_field.h>
+#include <moveit/distance_field/multi_resolution_distance_field.h>
+#include <moveit/distance_field/quantized_distance_field.h>
 #include <moveit/distance_field/find_internal_points.h>
 #include <console_bridge/console.h>
 #include <geometric_shapes/body_operations.h>
 #include <eigen_conversions/eigen_msg.h>
 #include <octomap/octomap.h>
 #include <boost/make_shared.hpp>
+#include <sstream>
 
 
 using namespace distance_field;
@@ -609,6 +613,574 @@ TEST(TestSignedPropagationDistanceField, TestShape)
   ASSERT_TRUE(areDistanceFieldsDistancesEqual(df, test_df));
 }
 
+TEST(TestSignedPropagationDistanceField, TestShapeCache)
+{
+  shapes::Box box(.3, .2, .25);
+
+  geometry_msgs::Pose p;
+  p.orientation.w = 1.0;
+  p.position.x = .5;
+  p.position.y = .5;
+  p.position.z = .5;
+
+  //the voxelization does not depend on the number of threads
+  bodies::Body* body = bodies::createBodyFromShape(&box);
+  Eigen::Affine3d pose_e;
+  tf::poseMsgToEigen(p, pose_e);
+  body->setPose(pose_e);
+  EigenSTL::vector_Vector3d serial_points, parallel_points;
+  findInternalPointsConvex(*body, .05, serial_points);
+  findInternalPointsConvex(*body, .05, parallel_points, 4);
+  delete body;
+  ASSERT_EQ(serial_points.size(), parallel_points.size());
+  for(unsigned int i = 0; i < serial_points.size(); i++) {
+    EXPECT_EQ(serial_points[i], parallel_points[i]);
+  }
+
+  geometry_msgs::Pose np;
+  np.orientation.x = sin(M_PI/8);
+  np.orientation.w = cos(M_PI/8);
+  np.position.x = .6;
+  np.position.y = .4;
+  np.position.z = .5;
+
+  PropagationDistanceField df(1.0, 1.0, 1.0, .05, 0.0, 0.0, 0.0, .3, true);
+  df.setShapeCacheEnabled(true);
+  df.setVoxelizationThreadCount(2);
+  df.addShapeToField(&box, p);
+  EXPECT_GT(countOccupiedCells(df), 0u);
+
+  //moving with the cache is equivalent to adding at the new pose with the cache
+  df.moveShapeInField(&box, p, np);
+  PropagationDistanceField test_df(1.0, 1.0, 1.0, .05, 0.0, 0.0, 0.0, .3, true);
+  test_df.setShapeCacheEnabled(true);
+  test_df.addShapeToField(&box, np);
+  EXPECT_TRUE(areDistanceFieldsDistancesEqual(df, test_df));
+
+  //the rotated box leaves no hole in its interior
+  int x, y, z;
+  ASSERT_TRUE(df.worldToGrid(.6, .4, .5, x, y, z));
+  EXPECT_EQ(df.getCell(x,y,z).distance_square_, 0);
+
+  df.removeShapeFromField(&box, np);
+  EXPECT_EQ(countOccupiedCells(df), 0u);
+}
+
+TEST(TestSignedPropagationDistanceField, TestObstacleIds)
+{
+  PropagationDistanceField df(1.0, 1.0, 1.0, .05, 0.0, 0.0, 0.0, .3, true);
+
+  shapes::Box box(.2, .2, .2);
+  geometry_msgs::Pose p;
+  p.orientation.w = 1.0;
+  p.position.x = .25;
+  p.position.y = .25;
+  p.position.z = .25;
+
+  EigenSTL::vector_Vector3d points;
+  points.push_back(Eigen::Vector3d(.8, .8, .8));
+
+  df.setObstacleId(1);
+  df.addShapeToField(&box, p);
+  df.setObstacleId(2);
+  df.addPointsToField(points);
+  df.setObstacleId(PropagationDistanceField::NO_OBSTACLE_ID);
+
+  double dist;
+  EXPECT_EQ(df.getClosestObstacleId(.25, .25, .25, dist), 1);
+  EXPECT_LT(dist, 0.0);
+  EXPECT_EQ(df.getClosestObstacleId(.45, .25, .25, dist), 1);
+  EXPECT_EQ(dist, df.getDistance(.45, .25, .25));
+  EXPECT_EQ(df.getClosestObstacleId(.7, .8, .8, dist), 2);
+  EXPECT_NEAR(dist, .1, 1e-6);
+
+  //beyond the maximum distance of any obstacle, or outside the field
+  EXPECT_EQ(df.getClosestObstacleId(.6, .25, .8, dist), PropagationDistanceField::NO_OBSTACLE_ID);
+  EXPECT_EQ(df.getClosestObstacleId(2.0, 2.0, 2.0, dist), PropagationDistanceField::NO_OBSTACLE_ID);
+
+  //cells lose their identifier when removed, and take the current one when added again
+  df.removePointsFromField(points);
+  EXPECT_EQ(df.getClosestObstacleId(.7, .8, .8, dist), PropagationDistanceField::NO_OBSTACLE_ID);
+  df.addPointsToField(points);
+  EXPECT_EQ(df.getClosestObstacleId(.8, .8, .8, dist), PropagationDistanceField::NO_OBSTACLE_ID);
+  EXPECT_EQ(df.getClosestObstacleId(.25, .25, .25, dist), 1);
+}
+
+TEST(TestSignedPropagationDistanceField, TestParallelPropagation)
+{
+  PropagationDistanceField df( width, height, depth, resolution, origin_x, origin_y, origin_z, max_dist, true);
+  df.setPropagationThreadCount(4);
+  EXPECT_EQ(4u, df.getPropagationThreadCount());
+
+  int numX = df.getXNumCells();
+  int numY = df.getYNumCells();
+  int numZ = df.getZNumCells();
+
+  shapes::Sphere sphere(.25);
+
+  geometry_msgs::Pose p;
+  p.orientation.w = 1.0;
+  p.position.x = .5;
+  p.position.y = .5;
+  p.position.z = .5;
+
+  geometry_msgs::Pose np;
+  np.orientation.w = 1.0;
+  np.position.x = .7;
+  np.position.y = .7;
+  np.position.z = .7;
+
+  df.addShapeToField(&sphere, p);
+
+  bodies::Body* body = bodies::createBodyFromShape(&sphere);
+  Eigen::Affine3d pose_e;
+  tf::poseMsgToEigen(p, pose_e);
+  body->setPose(pose_e);
+  EigenSTL::vector_Vector3d point_vec;
+  findInternalPointsConvex(*body, resolution, point_vec);
+  delete body;
+  check_distance_field(df, point_vec,
+                       numX, numY, numZ, true);
+
+  // moving the shape removes and adds obstacle cells
+  df.moveShapeInField(&sphere, p, np);
+
+  // the result matches serial propagation
+  PropagationDistanceField test_df( width, height, depth, resolution, origin_x, origin_y, origin_z, max_dist, true);
+  test_df.addShapeToField(&sphere, np);
+  ASSERT_TRUE(areDistanceFieldsDistancesEqual(df, test_df));
+}
+
+TEST(TestEuclideanDistanceTransformField, TestMatchesPropagation)
+{
+  EuclideanDistanceTransformField df( width, height, depth, resolution, origin_x, origin_y, origin_z, max_dist, true);
+  df.setThreadCount(3);
+  PropagationDistanceField test_df( width, height, depth, resolution, origin_x, origin_y, origin_z, max_dist, true);
+
+  shapes::Sphere sphere(.25);
+
+  geometry_msgs::Pose p;
+  p.orientation.w = 1.0;
+  p.position.x = .5;
+  p.position.y = .5;
+  p.position.z = .5;
+
+  geometry_msgs::Pose np;
+  np.orientation.w = 1.0;
+  np.position.x = .7;
+  np.position.y = .7;
+  np.position.z = .7;
+
+  EigenSTL::vector_Vector3d points;
+  points.push_back(point1);
+  points.push_back(point2);
+  points.push_back(point3);
+
+  df.addShapeToField(&sphere, p);
+  df.addPointsToField(points);
+  test_df.addShapeToField(&sphere, p);
+  test_df.addPointsToField(points);
+
+  for (int x=0; x<df.getXNumCells(); x++)
+    for (int y=0; y<df.getYNumCells(); y++)
+      for (int z=0; z<df.getZNumCells(); z++)
+        ASSERT_NEAR(test_df.getDistance(x,y,z), df.getDistance(x,y,z), 1e-5) << x << " " << y << " " << z;
+
+  df.moveShapeInField(&sphere, p, np);
+  test_df.moveShapeInField(&sphere, p, np);
+  for (int x=0; x<df.getXNumCells(); x++)
+    for (int y=0; y<df.getYNumCells(); y++)
+      for (int z=0; z<df.getZNumCells(); z++)
+        ASSERT_NEAR(test_df.getDistance(x,y,z), df.getDistance(x,y,z), 1e-5) << x << " " << y << " " << z;
+
+  // the stream format is shared with PropagationDistanceField
+  std::stringstream ss;
+  ASSERT_TRUE(df.writeToStream(ss));
+  PropagationDistanceField read_df(ss, max_dist, true);
+  ASSERT_TRUE(areDistanceFieldsDistancesEqual(test_df, read_df));
+
+  df.reset();
+  EXPECT_NEAR(max_dist, df.getDistance(0,0,0), 1e-6);
+}
+
+TEST(TestMultiResolutionDistanceField, TestMatchesFineField)
+{
+  const double fine_resolution = resolution / 4.0;
+  MultiResolutionDistanceField df( width, height, depth, resolution, origin_x, origin_y, origin_z, max_dist, true);
+  ASSERT_FALSE(df.addRefinedRegion(Eigen::Vector3d(0.25, 0.25, 0.25), Eigen::Vector3d(0.75, 0.75, 0.75), resolution));
+  ASSERT_TRUE(df.addRefinedRegion(Eigen::Vector3d(0.25, 0.25, 0.25), Eigen::Vector3d(0.75, 0.75, 0.75), fine_resolution));
+  EXPECT_EQ(1u, df.getRefinedRegionCount());
+  PropagationDistanceField fine_df( width, height, depth, fine_resolution, origin_x, origin_y, origin_z, max_dist, true);
+
+  shapes::Sphere sphere(.15);
+  geometry_msgs::Pose p;
+  p.orientation.w = 1.0;
+  p.position.x = .5;
+  p.position.y = .5;
+  p.position.z = .5;
+
+  EigenSTL::vector_Vector3d points;
+  points.push_back(point1);
+  points.push_back(point2);
+  points.push_back(point3);
+
+  df.addShapeToField(&sphere, p);
+  df.addPointsToField(points);
+  fine_df.addShapeToField(&sphere, p);
+  fine_df.addPointsToField(points);
+
+  EigenSTL::vector_Vector3d queries;
+  for (int x=0; x<fine_df.getXNumCells(); x++)
+    for (int y=0; y<fine_df.getYNumCells(); y++)
+      for (int z=0; z<fine_df.getZNumCells(); z++)
+      {
+        Eigen::Vector3d w;
+        fine_df.gridToWorld(x, y, z, w.x(), w.y(), w.z());
+        if (df.getResolutionAt(w.x(), w.y(), w.z()) == fine_resolution)
+          ASSERT_NEAR(fine_df.getDistance(x,y,z), df.getDistance(w.x(), w.y(), w.z()), 1e-6) << x << " " << y << " " << z;
+        else
+          ASSERT_NEAR(df.getCoarseField().getDistance(w.x(), w.y(), w.z()), df.getDistance(w.x(), w.y(), w.z()), 1e-6);
+        queries.push_back(w);
+      }
+
+  // the batch queries use the same level as the single queries
+  std::vector<double> distances;
+  std::vector<double> fine_distances;
+  df.getInterpolatedDistances(queries, distances);
+  fine_df.getInterpolatedDistances(queries, fine_distances);
+  for (std::size_t i = 0 ; i < queries.size() ; ++i)
+    if (df.getResolutionAt(queries[i].x(), queries[i].y(), queries[i].z()) == fine_resolution)
+      ASSERT_NEAR(fine_distances[i], distances[i], 1e-6) << i;
+
+  std::stringstream ss;
+  ASSERT_TRUE(df.writeToStream(ss));
+  MultiResolutionDistanceField read_df( width, height, depth, resolution, origin_x, origin_y, origin_z, max_dist, true);
+  ASSERT_TRUE(read_df.readFromStream(ss));
+  EXPECT_EQ(1u, read_df.getRefinedRegionCount());
+  ASSERT_TRUE(areDistanceFieldsDistancesEqual(df.getCoarseField(), read_df.getCoarseField()));
+  for (std::size_t i = 0 ; i < queries.size() ; ++i)
+    ASSERT_NEAR(df.getDistance(queries[i].x(), queries[i].y(), queries[i].z()),
+                read_df.getDistance(queries[i].x(), queries[i].y(), queries[i].z()), 1e-6) << i;
+
+  df.reset();
+  EXPECT_NEAR(max_dist, df.getDistance(0.5, 0.5, 0.5), 1e-6);
+}
+
+TEST(TestQuantizedDistanceField, TestMatchesSource)
+{
+  PropagationDistanceField df( width, height, depth, resolution, origin_x, origin_y, origin_z, max_dist, true);
+
+  shapes::Sphere sphere(.25);
+  geometry_msgs::Pose p;
+  p.orientation.w = 1.0;
+  p.position.x = .5;
+  p.position.y = .5;
+  p.position.z = .5;
+  df.addShapeToField(&sphere, p);
+
+  QuantizedDistanceField qdf(df, max_dist);
+  const double tolerance = qdf.getQuantizationStep() / 2.0 + 1e-9;
+  for (int x=0; x<df.getXNumCells(); x++)
+    for (int y=0; y<df.getYNumCells(); y++)
+      for (int z=0; z<df.getZNumCells(); z++)
+        ASSERT_NEAR(df.getDistance(x,y,z), qdf.getDistance(x,y,z), tolerance) << x << " " << y << " " << z;
+
+  EigenSTL::vector_Vector3d points;
+  points.push_back(Eigen::Vector3d(0.21, 0.33, 0.45));
+  points.push_back(Eigen::Vector3d(0.52, 0.48, 0.77));
+  std::vector<double> distances, quantized_distances;
+  EigenSTL::vector_Vector3d gradients, quantized_gradients;
+  ASSERT_TRUE(df.getInterpolatedDistanceGradients(points, distances, gradients));
+  ASSERT_TRUE(qdf.getInterpolatedDistanceGradients(points, quantized_distances, quantized_gradients));
+  for (std::size_t i = 0 ; i < points.size() ; ++i)
+  {
+    EXPECT_NEAR(distances[i], quantized_distances[i], tolerance);
+    EXPECT_NEAR(0.0, (gradients[i] - quantized_gradients[i]).norm(), 2.0 * tolerance / resolution);
+  }
+
+  // the field is read-only
+  points.clear();
+  points.push_back(point1);
+  qdf.addPointsToField(points);
+  EXPECT_NEAR(df.getDistance(1,0,0), qdf.getDistance(1,0,0), tolerance);
+
+  std::stringstream ss;
+  ASSERT_TRUE(qdf.writeToStream(ss));
+  QuantizedDistanceField read_df(df, 2.0 * max_dist);
+  ASSERT_TRUE(read_df.readFromStream(ss));
+  EXPECT_DOUBLE_EQ(qdf.getQuantizationStep(), read_df.getQuantizationStep());
+  for (int x=0; x<df.getXNumCells(); x++)
+    for (int y=0; y<df.getYNumCells(); y++)
+      for (int z=0; z<df.getZNumCells(); z++)
+        ASSERT_EQ(qdf.getDistance(x,y,z), read_df.getDistance(x,y,z));
+
+  qdf.reset();
+  EXPECT_NEAR(max_dist, qdf.getDistance(5,5,5), 1e-9);
+  ASSERT_TRUE(qdf.quantize(df));
+  EXPECT_NEAR(df.getDistance(5,5,5), qdf.getDistance(5,5,5), tolerance);
+}
+
+TEST(TestSignedPropagationDistanceField, TestShiftOrigin)
+{
+  PropagationDistanceField df( width, height, depth, resolution/2.0, origin_x, origin_y, origin_z, max_dist, true);
+
+  EigenSTL::vector_Vector3d points;
+  for (double x = -0.5; x < 1.5; x += 0.15)
+    for (double y = -0.5; y < 1.5; y += 0.2)
+      points.push_back(Eigen::Vector3d(x, y, 0.5 + 0.3 * sin(x + y)));
+  for (double x = 0.3; x < 0.6; x += resolution/2.0)
+    for (double y = 0.3; y < 0.6; y += resolution/2.0)
+      for (double z = 0.2; z < 0.5; z += resolution/2.0)
+        points.push_back(Eigen::Vector3d(x, y, z));
+  df.addPointsToField(points);
+
+  const int shifts[4][3] = { {3, 0, 0}, {-2, 5, 1}, {0, -7, -3}, {-1, -1, 2} };
+  for (int s = 0 ; s < 4 ; ++s)
+  {
+    ASSERT_TRUE(df.shiftOrigin(shifts[s][0], shifts[s][1], shifts[s][2]));
+    // the obstacles in the newly exposed cells are added by the caller
+    df.addPointsToField(points);
+
+    PropagationDistanceField test_df( width, height, depth, resolution/2.0, df.getOriginX(), df.getOriginY(), df.getOriginZ(), max_dist, true);
+    test_df.addPointsToField(points);
+    ASSERT_TRUE(areDistanceFieldsDistancesEqual(df, test_df)) << "shift " << s;
+  }
+
+  // shifting by the full size resets the field
+  ASSERT_TRUE(df.recenter(10.0, 10.0, 10.0));
+  EXPECT_NEAR(10.0 - width/2.0, df.getOriginX(), 1e-9);
+  EXPECT_NEAR(max_dist, df.getDistance(0, 0, 0), 1e-6);
+
+  PropagationDistanceField sparse_df( width, height, depth, resolution, origin_x, origin_y, origin_z, max_dist, true, true);
+  EXPECT_FALSE(sparse_df.shiftOrigin(1, 0, 0));
+}
+
+TEST(TestSignedPropagationDistanceField, TestGradientCache)
+{
+  PropagationDistanceField df( width, height, depth, resolution, origin_x, origin_y, origin_z, max_dist, true);
+  PropagationDistanceField test_df( width, height, depth, resolution, origin_x, origin_y, origin_z, max_dist, true);
+  EigenSTL::vector_Vector3d points;
+  points.push_back(point1);
+  points.push_back(point2);
+  df.addPointsToField(points);
+  test_df.addPointsToField(points);
+
+  EXPECT_FALSE(df.getGradientCaching());
+  df.setGradientCaching(true);
+  EXPECT_TRUE(df.getGradientCaching());
+
+  EigenSTL::vector_Vector3d more_points;
+  more_points.push_back(Eigen::Vector3d(0.3, 0.1, 0.2));
+  for (int pass = 0 ; pass < 2 ; ++pass)
+  {
+    if (pass == 1)
+    {
+      // the cache is brought up to date after the distances change
+      df.addPointsToField(more_points);
+      test_df.addPointsToField(more_points);
+      df.updateGradientCache();
+    }
+    for (int x = 0; x < df.getXNumCells(); x++)
+      for (int y = 0; y < df.getYNumCells(); y++)
+        for (int z = 0; z < df.getZNumCells(); z++)
+        {
+          double wx, wy, wz;
+          df.gridToWorld(x, y, z, wx, wy, wz);
+          double gx, gy, gz, tgx, tgy, tgz;
+          bool in_bounds, test_in_bounds;
+          double dist = df.getDistanceGradient(wx, wy, wz, gx, gy, gz, in_bounds);
+          double test_dist = test_df.getDistanceGradient(wx, wy, wz, tgx, tgy, tgz, test_in_bounds);
+          ASSERT_EQ(test_in_bounds, in_bounds);
+          ASSERT_EQ(test_dist, dist);
+          ASSERT_NEAR(tgx, gx, 1e-4);
+          ASSERT_NEAR(tgy, gy, 1e-4);
+          ASSERT_NEAR(tgz, gz, 1e-4);
+        }
+  }
+
+  // at interior cell centers, the smooth gradients are the central difference gradients
+  EigenSTL::vector_Vector3d queries;
+  for (int x = 1; x < df.getXNumCells() - 1; x++)
+    for (int y = 1; y < df.getYNumCells() - 1; y++)
+      for (int z = 1; z < df.getZNumCells() - 1; z++)
+      {
+        double wx, wy, wz;
+        df.gridToWorld(x, y, z, wx, wy, wz);
+        queries.push_back(Eigen::Vector3d(wx, wy, wz));
+      }
+  std::vector<double> distances, test_distances;
+  EigenSTL::vector_Vector3d gradients, test_gradients;
+  ASSERT_TRUE(df.getSmoothDistanceGradients(queries, distances, gradients));
+  ASSERT_TRUE(test_df.getSmoothDistanceGradients(queries, test_distances, test_gradients));
+  for (std::size_t i = 0 ; i < queries.size() ; ++i)
+  {
+    double gx, gy, gz;
+    bool in_bounds;
+    double dist = test_df.getDistanceGradient(queries[i].x(), queries[i].y(), queries[i].z(), gx, gy, gz, in_bounds);
+    ASSERT_NEAR(dist, distances[i], 1e-6);
+    ASSERT_NEAR(gx, gradients[i].x(), 1e-4);
+    ASSERT_NEAR(gy, gradients[i].y(), 1e-4);
+    ASSERT_NEAR(gz, gradients[i].z(), 1e-4);
+    // without the cache, the same gradients are computed on the fly
+    ASSERT_NEAR(test_gradients[i].x(), gradients[i].x(), 1e-4);
+    ASSERT_NEAR(test_gradients[i].y(), gradients[i].y(), 1e-4);
+    ASSERT_NEAR(test_gradients[i].z(), gradients[i].z(), 1e-4);
+  }
+
+  // the smooth gradients are continuous across cell faces
+  EigenSTL::vector_Vector3d across;
+  across.push_back(Eigen::Vector3d(origin_x + 3.0 * resolution - 1e-6, 0.3, 0.4));
+  across.push_back(Eigen::Vector3d(origin_x + 3.0 * resolution + 1e-6, 0.3, 0.4));
+  ASSERT_TRUE(df.getSmoothDistanceGradients(across, distances, gradients));
+  EXPECT_NEAR(0.0, (gradients[0] - gradients[1]).norm(), 1e-3);
+
+  across.push_back(Eigen::Vector3d(-10.0, 0.0, 0.0));
+  EXPECT_FALSE(df.getSmoothDistanceGradients(across, distances, gradients));
+  EXPECT_EQ(df.getUninitializedDistance(), distances[2]);
+  EXPECT_EQ(0.0, gradients[2].norm());
+}
+
+TEST(TestSignedPropagationDistanceField, TestParallelMarkers)
+{
+  PropagationDistanceField df( width, height, depth, resolution/2.0, origin_x, origin_y, origin_z, max_dist, true);
+  EigenSTL::vector_Vector3d points;
+  points.push_back(point1);
+  points.push_back(point3);
+  points.push_back(Eigen::Vector3d(0.5, 0.5, 0.5));
+  df.addPointsToField(points);
+
+  visualization_msgs::Marker iso, plane;
+  visualization_msgs::MarkerArray gradients;
+  df.getIsoSurfaceMarkers(0.0, 0.1, "base", ros::Time(), iso);
+  df.getPlaneMarkers(XYPlane, width, height, 0.5, Eigen::Vector3d(width/2.0, height/2.0, 0.0), "base", ros::Time(), plane);
+  df.getGradientMarkers(0.0, 0.2, "base", ros::Time(), gradients);
+  ASSERT_FALSE(iso.points.empty());
+  ASSERT_FALSE(gradients.markers.empty());
+  EXPECT_EQ(df.getXNumCells() * df.getYNumCells(), (int)plane.points.size());
+
+  // the markers do not depend on the number of threads
+  df.setVisualizationThreadCount(4);
+  visualization_msgs::Marker parallel_iso, parallel_plane;
+  visualization_msgs::MarkerArray parallel_gradients;
+  df.getIsoSurfaceMarkers(0.0, 0.1, "base", ros::Time(), parallel_iso);
+  df.getPlaneMarkers(XYPlane, width, height, 0.5, Eigen::Vector3d(width/2.0, height/2.0, 0.0), "base", ros::Time(), parallel_plane);
+  df.getGradientMarkers(0.0, 0.2, "base", ros::Time(), parallel_gradients);
+  ASSERT_EQ(iso.points.size(), parallel_iso.points.size());
+  for (std::size_t i = 0 ; i < iso.points.size() ; ++i)
+  {
+    EXPECT_EQ(iso.points[i].x, parallel_iso.points[i].x);
+    EXPECT_EQ(iso.points[i].y, parallel_iso.points[i].y);
+    EXPECT_EQ(iso.points[i].z, parallel_iso.points[i].z);
+  }
+  ASSERT_EQ(plane.points.size(), parallel_plane.points.size());
+  for (std::size_t i = 0 ; i < plane.points.size() ; ++i)
+  {
+    EXPECT_EQ(plane.points[i].x, parallel_plane.points[i].x);
+    EXPECT_EQ(plane.colors[i].b, parallel_plane.colors[i].b);
+  }
+  ASSERT_EQ(gradients.markers.size(), parallel_gradients.markers.size());
+  for (std::size_t i = 0 ; i < gradients.markers.size() ; ++i)
+  {
+    EXPECT_EQ((int)i, parallel_gradients.markers[i].id);
+    EXPECT_EQ(gradients.markers[i].pose.position.x, parallel_gradients.markers[i].pose.position.x);
+    EXPECT_EQ(gradients.markers[i].pose.position.z, parallel_gradients.markers[i].pose.position.z);
+  }
+
+  // with a stride, every other cell along each axis is shown
+  df.setVisualizationStride(2);
+  visualization_msgs::Marker decimated_plane;
+  df.getPlaneMarkers(XYPlane, width, height, 0.5, Eigen::Vector3d(width/2.0, height/2.0, 0.0), "base", ros::Time(), decimated_plane);
+  EXPECT_EQ(((df.getXNumCells() + 1) / 2) * ((df.getYNumCells() + 1) / 2), (int)decimated_plane.points.size());
+  EXPECT_NEAR(resolution, decimated_plane.scale.x, 1e-9);
+}
+
+TEST(TestSignedPropagationDistanceField, TestSparseStorage)
+{
+  PropagationDistanceField df( 4.0, 4.0, 2.0, 0.05, origin_x, origin_y, origin_z, max_dist, true, true);
+  PropagationDistanceField test_df( 4.0, 4.0, 2.0, 0.05, origin_x, origin_y, origin_z, max_dist, true);
+  ASSERT_TRUE(df.usesSparseStorage());
+  EXPECT_EQ(0u, df.getAllocatedCellCount());
+
+  shapes::Sphere sphere(.25);
+  geometry_msgs::Pose p;
+  p.orientation.w = 1.0;
+  p.position.x = .5;
+  p.position.y = .5;
+  p.position.z = .5;
+
+  EigenSTL::vector_Vector3d points;
+  points.push_back(point1);
+  points.push_back(point2);
+  points.push_back(Eigen::Vector3d(3.0,3.0,1.5));
+
+  df.addShapeToField(&sphere, p);
+  df.addPointsToField(points);
+  test_df.addShapeToField(&sphere, p);
+  test_df.addPointsToField(points);
+  ASSERT_TRUE(areDistanceFieldsDistancesEqual(df, test_df));
+
+  // only the surroundings of the obstacles are allocated
+  EXPECT_LT(df.getAllocatedCellCount(), test_df.getAllocatedCellCount() / 4);
+  EXPECT_NEAR(max_dist, df.getDistance(2.0,2.0,0.5), 1e-6);
+
+  points.resize(2);
+  df.removePointsFromField(points);
+  test_df.removePointsFromField(points);
+  ASSERT_TRUE(areDistanceFieldsDistancesEqual(df, test_df));
+
+  df.reset();
+  EXPECT_EQ(0u, df.getAllocatedCellCount());
+  EXPECT_NEAR(max_dist, df.getDistance(3.0,3.0,1.5), 1e-6);
+}
+
+TEST(TestSignedPropagationDistanceField, TestInterpolatedDistances)
+{
+  PropagationDistanceField df( width, height, depth, resolution, origin_x, origin_y, origin_z, max_dist, true);
+
+  shapes::Sphere sphere(.25);
+  geometry_msgs::Pose p;
+  p.orientation.w = 1.0;
+  p.position.x = .5;
+  p.position.y = .5;
+  p.position.z = .5;
+  df.addShapeToField(&sphere, p);
+
+  EigenSTL::vector_Vector3d points;
+  // a cell center, a point between two cell centers, a point inside a cell, and a point outside the field
+  points.push_back(Eigen::Vector3d(0.2,0.3,0.4));
+  points.push_back(Eigen::Vector3d(0.25,0.3,0.4));
+  points.push_back(Eigen::Vector3d(0.22,0.33,0.47));
+  points.push_back(Eigen::Vector3d(-1.0,0.5,0.5));
+
+  std::vector<double> distances;
+  EigenSTL::vector_Vector3d gradients;
+  EXPECT_FALSE(df.getInterpolatedDistanceGradients(points, distances, gradients));
+  ASSERT_EQ(points.size(), distances.size());
+  ASSERT_EQ(points.size(), gradients.size());
+
+  EXPECT_NEAR(df.getDistance(2,3,4), distances[0], 1e-9);
+  EXPECT_NEAR(0.5 * (df.getDistance(2,3,4) + df.getDistance(3,3,4)), distances[1], 1e-9);
+  EXPECT_NEAR((df.getDistance(3,3,4) - df.getDistance(2,3,4)) / resolution, gradients[1].x(), 1e-9);
+  EXPECT_EQ(df.getUninitializedDistance(), distances[3]);
+  EXPECT_EQ(0.0, gradients[3].norm());
+
+  // the gradient is the derivative of the interpolated distance
+  for (int k = 0 ; k < 3 ; ++k)
+  {
+    EigenSTL::vector_Vector3d offset_points(2, points[2]);
+    offset_points[0][k] += 1e-6;
+    offset_points[1][k] -= 1e-6;
+    std::vector<double> offset_distances;
+    EXPECT_TRUE(df.getInterpolatedDistances(offset_points, offset_distances));
+    EXPECT_NEAR((offset_distances[0] - offset_distances[1]) / 2e-6, gradients[2][k], 1e-4);
+  }
+
+  std::vector<double> distances_only;
+  df.getInterpolatedDistances(points, distances_only);
+  for (std::size_t i = 0 ; i < points.size() ; ++i)
+    EXPECT_EQ(distances[i], distances_only[i]);
+}
+
 static const double PERF_WIDTH = 3.0;
 static const double PERF_HEIGHT = 3.0;
 static const double PERF_DEPTH = 4.0;
@@ -849,6 +1421,52 @@ TEST(TestSignedPropagationDistanceField, TestOcTree)
   EXPECT_TRUE(areDistanceFieldsDistancesEqual(df_test_shape_1, df_test_shape_2));
 }
 
+TEST(TestSignedPropagationDistanceField, TestOcTreeChanges)
+{
+  PropagationDistanceField df(1.0, 1.0, 1.0, .05, 0.0, 0.0, 0.0, .3, true);
+
+  //octree finer than the field, so that several leaves share a cell
+  octomap::OcTree tree(.025);
+  for(float x = .2125; x < .5; x += .025) {
+    for(float y = .2125; y < .5; y += .025) {
+      for(float z = .2125; z < .5; z += .025) {
+        tree.updateNode(octomap::point3d(x,y,z), true);
+      }
+    }
+  }
+  df.addOcTreeToField(&tree);
+
+  tree.enableChangeDetection(true);
+  //new obstacle
+  for(float x = .6125; x < .8; x += .025) {
+    for(float y = .6125; y < .8; y += .025) {
+      tree.updateNode(octomap::point3d(x,y,.5125), true);
+    }
+  }
+  //free a slab of the old one, and a single leaf of a cell that stays occupied
+  for(int i = 0; i < 5; i++) {
+    for(float x = .2125; x < .5; x += .025) {
+      for(float y = .2125; y < .5; y += .025) {
+        tree.updateNode(octomap::point3d(x,y,.2125), false);
+        tree.updateNode(octomap::point3d(x,y,.2375), false);
+      }
+    }
+    tree.updateNode(octomap::point3d(.4125,.4125,.4125), false);
+  }
+  ASSERT_GT(tree.numChangesDetected(), 0u);
+
+  df.updateOcTreeChangesInField(&tree);
+  tree.resetChangeDetection();
+
+  PropagationDistanceField df_full(1.0, 1.0, 1.0, .05, 0.0, 0.0, 0.0, .3, true);
+  df_full.addOcTreeToField(&tree);
+  EXPECT_TRUE(areDistanceFieldsDistancesEqual(df, df_full));
+
+  int x, y, z;
+  ASSERT_TRUE(df.worldToGrid(.3, .3, .2125, x, y, z));
+  EXPECT_GT(df.getCell(x,y,z).distance_square_, 0);
+}
+
 TEST(TestSignedPropagationDistanceField, TestReadWrite)
 {
 
@@ -902,6 +1520,46 @@ TEST(TestSignedPropagationDistanceField, TestReadWrite)
   EXPECT_FALSE(areDistanceFieldsDistancesEqual(df, df3));
 }
 
+TEST(TestSignedPropagationDistanceField, TestBinaryFile)
+{
+  PropagationDistanceField df( width, height, depth, resolution, origin_x, origin_y, origin_z, max_dist, true);
+
+  shapes::Sphere sphere(.25);
+  geometry_msgs::Pose p;
+  p.orientation.w = 1.0;
+  p.position.x = .5;
+  p.position.y = .5;
+  p.position.z = .5;
+  df.addShapeToField(&sphere, p);
+
+  ASSERT_TRUE(df.writeToBinaryFile("test_small.dfb"));
+
+  // all parameters come from the file
+  PropagationDistanceField mapped_df( 0.2, 0.2, 0.2, 0.05, 0.0, 0.0, 0.0, 0.1, false);
+  ASSERT_TRUE(mapped_df.mapBinaryFile("test_small.dfb"));
+  EXPECT_EQ(df.getMaximumDistanceSquared(), mapped_df.getMaximumDistanceSquared());
+  ASSERT_TRUE(areDistanceFieldsDistancesEqual(df, mapped_df));
+
+  // the mapped field can still be modified, without changing the file
+  EigenSTL::vector_Vector3d points;
+  points.push_back(point1);
+  points.push_back(point3);
+  df.addPointsToField(points);
+  mapped_df.addPointsToField(points);
+  EXPECT_TRUE(areDistanceFieldsDistancesEqual(df, mapped_df));
+
+  PropagationDistanceField mapped_df2( 0.2, 0.2, 0.2, 0.05, 0.0, 0.0, 0.0, 0.1, false);
+  ASSERT_TRUE(mapped_df2.mapBinaryFile("test_small.dfb"));
+  EXPECT_FALSE(areDistanceFieldsDistancesEqual(df, mapped_df2));
+
+  // files in the stream format are rejected
+  std::ofstream f("test_small_stream.df", std::ios::out);
+  df.writeToStream(f);
+  f.close();
+  EXPECT_FALSE(mapped_df2.mapBinaryFile("test_small_stream.df"));
+  EXPECT_FALSE(mapped_df2.mapBinaryFile("does_not_exist.dfb"));
+}
+
 int main(int argc, char **argv){
   testing::InitGoogleTest(&argc, argv);
 
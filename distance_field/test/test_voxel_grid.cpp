@@ -96,6 +96,50 @@ TEST(TestVoxelGrid, TestReadWrite)
 
 }
 
+TEST(TestVoxelGrid, TestShift)
+{
+  int def=-100;
+  VoxelGrid<int> vg(0.05,0.04,0.03,0.01,0,0,0, def);
+
+  int numX = vg.getNumCells(DIM_X);
+  int numY = vg.getNumCells(DIM_Y);
+  int numZ = vg.getNumCells(DIM_Z);
+
+  // each cell holds a code of its world location
+  for (int x=0; x<numX; x++)
+    for (int y=0; y<numY; y++)
+      for (int z=0; z<numZ; z++)
+        vg.setCell(x,y,z,(x*10+y)*10+z);
+
+  vg.shift(2,-1,1);
+  EXPECT_NEAR(0.02, vg.getOrigin(DIM_X), 1e-9);
+  EXPECT_NEAR(-0.01, vg.getOrigin(DIM_Y), 1e-9);
+  EXPECT_NEAR(0.01, vg.getOrigin(DIM_Z), 1e-9);
+
+  // the cells that remain inside the volume keep their content
+  for (int x=0; x<numX; x++)
+    for (int y=0; y<numY; y++)
+      for (int z=0; z<numZ; z++)
+      {
+        int ox = x+2, oy = y-1, oz = z+1;
+        if (ox < numX && oy >= 0 && oz < numZ)
+          EXPECT_EQ((ox*10+oy)*10+oz, vg.getCell(x,y,z));
+      }
+  EXPECT_EQ(vg.getCell(0,1,0), vg(0.02,0.0,0.01));
+
+  // the newly exposed cells have storage of their own
+  vg.setCell(numX-1,0,numZ-1,-1);
+  EXPECT_EQ(-1, vg.getCell(numX-1,0,numZ-1));
+  EXPECT_EQ(((numX-1)*10+1)*10+2, vg.getCell(numX-3,2,numZ-2));
+
+  // shifting back restores the original indexing
+  vg.shift(-2,1,-1);
+  EXPECT_EQ(0, vg.getCellOffset(DIM_X));
+  EXPECT_EQ(0, vg.getCellOffset(DIM_Y));
+  EXPECT_EQ(0, vg.getCellOffset(DIM_Z));
+  EXPECT_EQ((3*10+2)*10+1, vg.getCell(3,2,1));
+}
+
 int main(int argc, char **argv){
   testing::InitGoogleTest(&argc, argv);
   return RUN_ALL_TESTS();
@@ -40,8 +40,10 @@
 // KDL
 #include <kdl/chain.hpp>
 #include <kdl/chainidsolver_recursive_newton_euler.hpp>
+#include <kdl/chainjnttojacsolver.hpp>
 
 #include <moveit/robot_state/robot_state.h>
+#include <moveit/robot_trajectory/robot_trajectory.h>
 #include <geometry_msgs/Vector3.h>
 #include <geometry_msgs/Wrench.h>
 
@@ -49,6 +51,22 @@
 namespace dynamics_solver
 {
 
+/**
+ * @brief Describes the first waypoint at which a computed torque exceeds
+ * the maximum torque of its joint; waypoint and joint are -1 if no
+ * torque exceeds its limit
+ */
+struct TorqueLimitViolation
+{
+  TorqueLimitViolation() : waypoint(-1), joint(-1), torque(0.0)
+  {
+  }
+
+  int waypoint;
+  int joint;
+  double torque;
+};
+
 /**
  * This solver currently computes the required torques given a
  * joint configuration, velocities, accelerations and external wrenches
@@ -90,6 +108,45 @@ public:
                   const std::vector<geometry_msgs::Wrench> &wrenches,
                   std::vector<double> &torques) const;
 
+  /**
+   * @brief Get the torques for a sequence of waypoints, with no external
+   * wrenches. The inputs and the output are waypoint-major matrices with
+   * one row of size = number of joints in the group per waypoint (in the
+   * same order as for getTorques() above). The solver workspace is
+   * allocated once for the whole sequence.
+   * @param waypoint_count The number of waypoints
+   * @param positions The joint angles at each waypoint
+   * @param velocities The joint velocities at each waypoint (NULL for zero velocities)
+   * @param accelerations The joint accelerations at each waypoint (NULL for zero accelerations)
+   * @param torques The computed torques are filled in here
+   * @param violation If not NULL, the first torque that exceeds getMaxTorques()
+   * is reported here (joints with a maximum torque of 0 are not checked)
+   * @return False if the torques could not be computed
+   */
+  bool getTorques(std::size_t waypoint_count,
+                  const double *positions,
+                  const double *velocities,
+                  const double *accelerations,
+                  double *torques,
+                  TorqueLimitViolation *violation = NULL) const;
+
+  /**
+   * @brief Get the torques at every waypoint of a trajectory, with no
+   * external wrenches. The velocities and accelerations stored in the
+   * waypoints are used; they are taken to be zero for waypoints that do
+   * not have them, so the trajectory should be time parameterized first.
+   * @param trajectory The trajectory; its waypoints must include the
+   * variables of this group
+   * @param torques The computed torques are filled in here, waypoint-major
+   * (size = number of waypoints * number of joints in the group)
+   * @param violation If not NULL, the first torque that exceeds getMaxTorques()
+   * is reported here (joints with a maximum torque of 0 are not checked)
+   * @return False if the torques could not be computed
+   */
+  bool getTorques(const robot_trajectory::RobotTrajectory &trajectory,
+                  std::vector<double> &torques,
+                  TorqueLimitViolation *violation = NULL) const;
+
   /**
    * @brief Get the maximum payload for this group (in kg). Payload is
    * the weight that this group can hold when the weight is attached to the origin
@@ -105,6 +162,18 @@ public:
                      double &payload,
                      unsigned int &joint_saturated) const;
 
+  /**
+   * @brief Get the maximum payload for this group (in kg) at each of a set
+   * of joint configurations (e.g., for a set of grasps), as for getMaxPayload()
+   * @param joint_angles The joint configurations; each must have size = number of joints in the group
+   * @param payloads The computed maximum payload for each configuration
+   * @param joints_saturated The first saturated joint for each configuration
+   * @return False if any of the joint configurations is of the wrong size
+   */
+  bool getMaxPayloads(const std::vector<std::vector<double> > &joint_angles,
+                      std::vector<double> &payloads,
+                      std::vector<unsigned int> &joints_saturated) const;
+
   /**
    * @brief Get torques corresponding to a particular payload value.  Payload is
    * the weight that this group can hold when the weight is attached to the origin
@@ -141,14 +210,24 @@ public:
   
 private:
 
+  struct Workspace;
+
+  bool computeTorques(Workspace &workspace, std::size_t waypoint, double *torques, TorqueLimitViolation *violation) const;
+
+  /** \brief Compute the torques at rest for the joint angles in \e workspace without a payload (the gravity torques)
+      and the torques added per unit of payload force; payload torques are linear in the payload */
+  bool computePayloadTorques(Workspace &workspace, double *gravity_torques, double *unit_torques) const;
+
+  void computeMaxPayload(const double *gravity_torques, const double *unit_torques,
+                         double &payload, unsigned int &joint_saturated) const;
+
   boost::shared_ptr<KDL::ChainIdSolver_RNE> chain_id_solver_; // KDL chain inverse dynamics
+  boost::shared_ptr<KDL::ChainJntToJacSolver> chain_jac_solver_; // KDL chain Jacobian
   KDL::Chain kdl_chain_; // KDL chain
 
   robot_model::RobotModelConstPtr robot_model_; 
   const robot_model::JointModelGroup* joint_model_group_; 
   
-  robot_state::RobotStatePtr state_; //robot state
-
   std::string base_name_, tip_name_; // base name, tip name
   unsigned int num_joints_, num_segments_; // number of joints in group, number of segments in group
   std::vector<double> max_torques_; // vector of max torques
@@ -48,23 +48,23 @@
 namespace dynamics_solver
 {
 
-namespace
+/** \brief The inputs and outputs of the inverse dynamics solver, reused for all the waypoints of a batch */
+struct DynamicsSolver::Workspace
 {
-inline geometry_msgs::Vector3 transformVector(const Eigen::Affine3d &transform,
-                                              const geometry_msgs::Vector3 &vector)
-{
-  Eigen::Vector3d p;
-  p = Eigen::Vector3d(vector.x, vector.y, vector.z);
-  p = transform.rotation()*p;
+  Workspace(unsigned int num_joints, unsigned int num_segments)
+    : angles(num_joints)
+    , velocities(num_joints)
+    , accelerations(num_joints)
+    , torques(num_joints)
+    , wrenches(num_segments, KDL::Wrench::Zero())
+    , jacobian(num_joints)
+  {
+  }
 
-  geometry_msgs::Vector3 result;
-  result.x = p.x();
-  result.y = p.y();
-  result.z = p.z();
-
-  return result;
-}
-}
+  KDL::JntArray angles, velocities, accelerations, torques;
+  KDL::Wrenches wrenches;
+  KDL::Jacobian jacobian;
+};
 
 DynamicsSolver::DynamicsSolver(const robot_model::RobotModelConstPtr &robot_model,
                                const std::string &group_name,
@@ -121,9 +121,6 @@ DynamicsSolver::DynamicsSolver(const robot_model::RobotModelConstPtr &robot_mode
   num_joints_ = kdl_chain_.getNrOfJoints();
   num_segments_ = kdl_chain_.getNrOfSegments();
 
-  state_.reset(new robot_state::RobotState(robot_model_));
-  state_->setToDefaultValues();
-  
   const std::vector<std::string> &joint_model_names = joint_model_group_->getJointModelNames();
   for (std::size_t i = 0; i < joint_model_names.size(); ++i)
   {
@@ -139,6 +136,7 @@ DynamicsSolver::DynamicsSolver(const robot_model::RobotModelConstPtr &robot_mode
   logDebug("Gravity norm set to %f", gravity_);
   
   chain_id_solver_.reset(new KDL::ChainIdSolver_RNE(kdl_chain_, gravity));
+  chain_jac_solver_.reset(new KDL::ChainJntToJacSolver(kdl_chain_));
 }
 
 bool DynamicsSolver::getTorques(const std::vector<double> &joint_angles,
@@ -211,55 +209,141 @@ bool DynamicsSolver::getTorques(const std::vector<double> &joint_angles,
   return true;
 }
 
-bool DynamicsSolver::getMaxPayload(const std::vector<double> &joint_angles,
-                                   double &payload,
-                                   unsigned int &joint_saturated) const
+bool DynamicsSolver::computeTorques(Workspace &workspace, std::size_t waypoint, double *torques, TorqueLimitViolation *violation) const
+{
+  if (chain_id_solver_->CartToJnt(workspace.angles, workspace.velocities, workspace.accelerations, workspace.wrenches, workspace.torques) < 0)
+  {
+    logError("Something went wrong computing torques at waypoint %u", (unsigned int)waypoint);
+    return false;
+  }
+
+  for (unsigned int i = 0; i < num_joints_; ++i)
+  {
+    torques[i] = workspace.torques(i);
+    if (violation && violation->waypoint < 0 && max_torques_[i] > 0.0 && fabs(torques[i]) > max_torques_[i])
+    {
+      violation->waypoint = waypoint;
+      violation->joint = i;
+      violation->torque = torques[i];
+    }
+  }
+  return true;
+}
+
+bool DynamicsSolver::getTorques(std::size_t waypoint_count,
+                                const double *positions,
+                                const double *velocities,
+                                const double *accelerations,
+                                double *torques,
+                                TorqueLimitViolation *violation) const
 {
   if (!joint_model_group_)
   {
     logDebug("Did not construct DynamicsSolver object properly. Check error logs.");
     return false;
   }
-  if (joint_angles.size() != num_joints_)
+  if (violation)
+    *violation = TorqueLimitViolation();
+
+  Workspace workspace(num_joints_, num_segments_);
+  for (std::size_t k = 0; k < waypoint_count; ++k)
   {
-    logError("Joint angles vector should be size %d", num_joints_);
+    const std::size_t row = k * num_joints_;
+    for (unsigned int i = 0; i < num_joints_; ++i)
+    {
+      workspace.angles(i) = positions[row + i];
+      workspace.velocities(i) = velocities ? velocities[row + i] : 0.0;
+      workspace.accelerations(i) = accelerations ? accelerations[row + i] : 0.0;
+    }
+    if (!computeTorques(workspace, k, torques + row, violation))
+      return false;
+  }
+  return true;
+}
+
+bool DynamicsSolver::getTorques(const robot_trajectory::RobotTrajectory &trajectory,
+                                std::vector<double> &torques,
+                                TorqueLimitViolation *violation) const
+{
+  if (!joint_model_group_)
+  {
+    logDebug("Did not construct DynamicsSolver object properly. Check error logs.");
     return false;
   }
-  std::vector<double> joint_velocities(num_joints_, 0.0), joint_accelerations(num_joints_, 0.0);
-  std::vector<double> torques(num_joints_, 0.0), zero_torques(num_joints_, 0.0);
+  const std::vector<int> &index = joint_model_group_->getVariableIndexList();
+  if (index.size() != num_joints_)
+  {
+    logError("Group '%s' has %u variables but the dynamics chain has %u joints",
+             joint_model_group_->getName().c_str(), (unsigned int)index.size(), num_joints_);
+    return false;
+  }
+  if (violation)
+    *violation = TorqueLimitViolation();
+
+  const std::size_t waypoint_count = trajectory.getWayPointCount();
+  torques.resize(waypoint_count * num_joints_);
+  Workspace workspace(num_joints_, num_segments_);
+  for (std::size_t k = 0; k < waypoint_count; ++k)
+  {
+    const robot_state::RobotState &waypoint = trajectory.getWayPoint(k);
+    const double *positions = waypoint.getVariablePositions();
+    const double *velocities = waypoint.hasVelocities() ? waypoint.getVariableVelocities() : NULL;
+    const double *accelerations = waypoint.hasAccelerations() ? waypoint.getVariableAccelerations() : NULL;
+    for (unsigned int i = 0; i < num_joints_; ++i)
+    {
+      workspace.angles(i) = positions[index[i]];
+      workspace.velocities(i) = velocities ? velocities[index[i]] : 0.0;
+      workspace.accelerations(i) = accelerations ? accelerations[index[i]] : 0.0;
+    }
+    if (!computeTorques(workspace, k, &torques[k * num_joints_], violation))
+      return false;
+  }
+  return true;
+}
 
-  std::vector<geometry_msgs::Wrench> wrenches(num_segments_);
-  if (!getTorques(joint_angles, joint_velocities, joint_accelerations, wrenches, zero_torques))
+bool DynamicsSolver::computePayloadTorques(Workspace &workspace, double *gravity_torques, double *unit_torques) const
+{
+  // at rest, the torques are the gravity torques plus the torques that balance the wrench of the payload. The
+  // payload force is along the z axis of the base frame and applied at the tip, where the Jacobian computed by KDL
+  // (expressed in the base frame) has its reference point; KDL subtracts external wrenches, so the torques for a
+  // unit force are the negated z row of the Jacobian
+  for (unsigned int i = 0; i < num_joints_; ++i)
+  {
+    workspace.velocities(i) = 0.0;
+    workspace.accelerations(i) = 0.0;
+  }
+  if (chain_id_solver_->CartToJnt(workspace.angles, workspace.velocities, workspace.accelerations, workspace.wrenches, workspace.torques) < 0 ||
+      chain_jac_solver_->JntToJac(workspace.angles, workspace.jacobian) < 0)
+  {
+    logError("Something went wrong computing payload torques");
     return false;
+  }
+  for (unsigned int i = 0; i < num_joints_; ++i)
+  {
+    gravity_torques[i] = workspace.torques(i);
+    unit_torques[i] = -workspace.jacobian(2, i);
+  }
+  return true;
+}
 
+void DynamicsSolver::computeMaxPayload(const double *gravity_torques, const double *unit_torques,
+                                       double &payload, unsigned int &joint_saturated) const
+{
   for (unsigned int i = 0; i < num_joints_; ++i)
   {
-    if (fabs(zero_torques[i]) >= max_torques_[i])
+    if (fabs(gravity_torques[i]) >= max_torques_[i])
     {
       payload = 0.0;
       joint_saturated = i;
-      return true;
+      return;
     }
   }
 
-  state_->setJointGroupPositions(joint_model_group_, joint_angles);
-  const Eigen::Affine3d &base_frame = state_->getFrameTransform(base_name_);
-  const Eigen::Affine3d &tip_frame = state_->getFrameTransform(tip_name_);
-  Eigen::Affine3d transform = tip_frame.inverse() * base_frame;
-  wrenches.back().force.z = 1.0;
-  wrenches.back().force = transformVector(transform, wrenches.back().force);
-  wrenches.back().torque = transformVector(transform, wrenches.back().torque);
-
-  logDebug("New wrench (local frame): %f %f %f", wrenches.back().force.x, wrenches.back().force.y, wrenches.back().force.z);
-
-  if (!getTorques(joint_angles, joint_velocities, joint_accelerations, wrenches, torques))
-    return false;
-
   double min_payload = std::numeric_limits<double>::max();
   for (unsigned int i = 0; i < num_joints_; ++i)
   {
-    double payload_joint = std::max<double>((max_torques_[i]-zero_torques[i])/(torques[i]-zero_torques[i]),(-max_torques_[i]-zero_torques[i])/(torques[i]-zero_torques[i]));//because we set the payload to 1.0
-    logDebug("Joint: %d, Actual Torque: %f, Max Allowed: %f, Gravity: %f", i, torques[i], max_torques_[i], zero_torques[i]);
+    double payload_joint = std::max<double>((max_torques_[i]-gravity_torques[i])/unit_torques[i],(-max_torques_[i]-gravity_torques[i])/unit_torques[i]);//because the payload force is 1.0
+    logDebug("Joint: %d, Unit Payload Torque: %f, Max Allowed: %f, Gravity: %f", i, unit_torques[i], max_torques_[i], gravity_torques[i]);
     logDebug("Joint: %d, Payload Allowed (N): %f", i, payload_joint);
     if (payload_joint < min_payload)
     {
@@ -269,6 +353,61 @@ bool DynamicsSolver::getMaxPayload(const std::vector<double> &joint_angles,
   }
   payload = min_payload/gravity_;
   logDebug("Max payload (kg): %f", payload);
+}
+
+bool DynamicsSolver::getMaxPayload(const std::vector<double> &joint_angles,
+                                   double &payload,
+                                   unsigned int &joint_saturated) const
+{
+  if (!joint_model_group_)
+  {
+    logDebug("Did not construct DynamicsSolver object properly. Check error logs.");
+    return false;
+  }
+  if (joint_angles.size() != num_joints_)
+  {
+    logError("Joint angles vector should be size %d", num_joints_);
+    return false;
+  }
+
+  Workspace workspace(num_joints_, num_segments_);
+  std::vector<double> gravity_torques(num_joints_), unit_torques(num_joints_);
+  for (unsigned int i = 0; i < num_joints_; ++i)
+    workspace.angles(i) = joint_angles[i];
+  if (!computePayloadTorques(workspace, &gravity_torques[0], &unit_torques[0]))
+    return false;
+  computeMaxPayload(&gravity_torques[0], &unit_torques[0], payload, joint_saturated);
+  return true;
+}
+
+bool DynamicsSolver::getMaxPayloads(const std::vector<std::vector<double> > &joint_angles,
+                                    std::vector<double> &payloads,
+                                    std::vector<unsigned int> &joints_saturated) const
+{
+  if (!joint_model_group_)
+  {
+    logDebug("Did not construct DynamicsSolver object properly. Check error logs.");
+    return false;
+  }
+  for (std::size_t k = 0; k < joint_angles.size(); ++k)
+    if (joint_angles[k].size() != num_joints_)
+    {
+      logError("Joint angles vector should be size %d", num_joints_);
+      return false;
+    }
+
+  payloads.resize(joint_angles.size());
+  joints_saturated.resize(joint_angles.size());
+  Workspace workspace(num_joints_, num_segments_);
+  std::vector<double> gravity_torques(num_joints_), unit_torques(num_joints_);
+  for (std::size_t k = 0; k < joint_angles.size(); ++k)
+  {
+    for (unsigned int i = 0; i < num_joints_; ++i)
+      workspace.angles(i) = joint_angles[k][i];
+    if (!computePayloadTorques(workspace, &gravity_torques[0], &unit_torques[0]))
+      return false;
+    computeMaxPayload(&gravity_torques[0], &unit_torques[0], payloads[k], joints_saturated[k]);
+  }
   return true;
 }
 
@@ -291,21 +430,15 @@ bool DynamicsSolver::getPayloadTorques(const std::vector<double> &joint_angles,
     logError("Joint torques vector should be size %d", num_joints_);
     return false;
   }
-  std::vector<double> joint_velocities(num_joints_, 0.0), joint_accelerations(num_joints_, 0.0);
-  std::vector<geometry_msgs::Wrench> wrenches(num_segments_);
-  state_->setJointGroupPositions(joint_model_group_, joint_angles);
-
-  const Eigen::Affine3d &base_frame = state_->getFrameTransform(base_name_);
-  const Eigen::Affine3d &tip_frame = state_->getFrameTransform(tip_name_);
-  Eigen::Affine3d transform = tip_frame.inverse()* base_frame;
-  wrenches.back().force.z = payload * gravity_;
-  wrenches.back().force = transformVector(transform, wrenches.back().force);
-  wrenches.back().torque = transformVector(transform, wrenches.back().torque);
 
-  logDebug("New wrench (local frame): %f %f %f", wrenches.back().force.x, wrenches.back().force.y, wrenches.back().force.z);
-
-  if (!getTorques(joint_angles, joint_velocities, joint_accelerations, wrenches, joint_torques))
+  Workspace workspace(num_joints_, num_segments_);
+  std::vector<double> unit_torques(num_joints_);
+  for (unsigned int i = 0; i < num_joints_; ++i)
+    workspace.angles(i) = joint_angles[i];
+  if (!computePayloadTorques(workspace, &joint_torques[0], &unit_torques[0]))
     return false;
+  for (unsigned int i = 0; i < num_joints_; ++i)
+    joint_torques[i] += payload * gravity_ * unit_torques[i];
   return true;
 }
 
@@ -39,6 +39,7 @@
 
 #include <moveit/robot_model/robot_model.h>
 #include <moveit/robot_state/robot_state.h>
+#include <moveit/robot_state/robot_state_batch.h>
 #include <moveit/transforms/transforms.h>
 #include <moveit/collision_detection/collision_world.h>
 
@@ -104,6 +105,24 @@ public:
    */
   virtual ConstraintEvaluationResult decide(const robot_state::RobotState &state, bool verbose = false) const = 0;
 
+  /**
+   * \brief Decide whether the constraint is satisfied for each state
+   * of a batch.  Only the states for which \e satisfied is true are
+   * evaluated, and \e satisfied is set to false for the ones that
+   * violate the constraint, so states rejected by earlier constraints
+   * cost nothing.
+   *
+   * The link transforms of the batch must be up to date (see
+   * robot_state::RobotStateBatch::update()).  The states of a batch
+   * have no attached bodies.  The default implementation copies each
+   * remaining state to a RobotState and calls the single state
+   * decide().
+   *
+   * @param [in] states The states used for evaluation
+   * @param [in,out] satisfied One flag per state in the batch
+   */
+  virtual void decide(const robot_state::RobotStateBatch &states, std::vector<bool> &satisfied) const;
+
   /** \brief This function returns true if this constraint is
       configured and able to decide whether states do meet the
       constraint or not. If this function returns false it means
@@ -166,8 +185,42 @@ public:
     return robot_model_;
   }
 
+  /**
+   * \brief Get the indices of the state variables the result of
+   * decide() depends on.  If none of these variables change, neither
+   * does the result.  The default implementation reports all the
+   * variables of the robot model.
+   *
+   * @param [out] variables The variable indices (in no particular order, possibly repeated)
+   */
+  virtual void getVariableDependencies(std::vector<int> &variables) const;
+
+  /**
+   * \brief Compute the gradient of the distance reported by decide()
+   * with respect to the variables of a group.  The link transforms of
+   * the state must be up to date.  The default implementation
+   * computes nothing and returns false.
+   *
+   * @param [in] state The state at which the gradient is computed
+   * @param [in] group The group whose variables the gradient is computed for
+   * @param [out] gradient One value for each variable of the group, in the order of the group's variables
+   *
+   * @return True if the gradient could be computed; false if the
+   * constraint does not support gradients or does not depend on the
+   * variables of the group
+   */
+  virtual bool computeDistanceGradient(const robot_state::RobotState &state, const robot_model::JointModelGroup *group,
+                                       Eigen::VectorXd &gradient) const;
+
 protected:
 
+  /** \brief Add the indices of the variables of the joints between \e link and the root of the model */
+  static void addLinkDependencies(const robot_model::LinkModel *link, std::vector<int> &variables);
+
+  /** \brief Add the indices of the variables that the transform of \e frame depends on. Frames that are not links
+      (e.g., attached bodies) are assumed to depend on all the variables */
+  void addFrameDependencies(const std::string &frame, std::vector<int> &variables) const;
+
   ConstraintType                  type_; /**< \brief The type of the constraint */
   robot_model::RobotModelConstPtr robot_model_; /**< \brief The kinematic model associated with this constraint */
   double                          constraint_weight_; /**< \brief The weight of a constraint is a multiplicative factor associated to the distance computed by the decide() function  */
@@ -241,6 +294,10 @@ public:
    */
   virtual bool equal(const KinematicConstraint &other, double margin) const;
   virtual ConstraintEvaluationResult decide(const robot_state::RobotState &state, bool verbose = false) const;
+  virtual void decide(const robot_state::RobotStateBatch &states, std::vector<bool> &satisfied) const;
+  virtual void getVariableDependencies(std::vector<int> &variables) const;
+  virtual bool computeDistanceGradient(const robot_state::RobotState &state, const robot_model::JointModelGroup *group,
+                                       Eigen::VectorXd &gradient) const;
   virtual bool enabled() const;
   virtual void clear();
   virtual void print(std::ostream &out = std::cout) const;
@@ -389,6 +446,10 @@ public:
   virtual bool equal(const KinematicConstraint &other, double margin) const;
   virtual void clear();
   virtual ConstraintEvaluationResult decide(const robot_state::RobotState &state, bool verbose = false) const;
+  virtual void decide(const robot_state::RobotStateBatch &states, std::vector<bool> &satisfied) const;
+  virtual void getVariableDependencies(std::vector<int> &variables) const;
+  virtual bool computeDistanceGradient(const robot_state::RobotState &state, const robot_model::JointModelGroup *group,
+                                       Eigen::VectorXd &gradient) const;
   virtual bool enabled() const;
   virtual void print(std::ostream &out = std::cout) const;
 
@@ -480,6 +541,19 @@ protected:
   std::string                   desired_rotation_frame_id_; /**< \brief The target frame of the transform tree */
   bool                          mobile_frame_; /**< \brief Whether or not the header frame is mobile or fixed */
   double                        absolute_x_axis_tolerance_, absolute_y_axis_tolerance_, absolute_z_axis_tolerance_; /**< \brief Storage for the tolerances */
+
+  /** \brief The tolerances mapped to bounds on matrix entries: tan() of the X and Z tolerances and sin() of the Y tolerance
+      (infinite for tolerances of at least pi/2), precomputed so that withinTolerance() needs no trigonometric functions */
+  double                        x_axis_bound_, y_axis_bound_, z_axis_bound_;
+
+private:
+
+  /** \brief The rotation of the link relative to the desired orientation, given the rotation of the link and (for
+      mobile frames) of the frame, both in the model frame */
+  Eigen::Matrix3d getRelativeRotation(const Eigen::Matrix3d &link_rotation, const Eigen::Matrix3d *frame_rotation) const;
+
+  /** \brief Decide whether the relative rotation \e diff is within the tolerances, from its entries */
+  bool withinTolerance(const Eigen::Matrix3d &diff) const;
 };
 
 
@@ -558,6 +632,10 @@ public:
   virtual bool equal(const KinematicConstraint &other, double margin) const;
   virtual void clear();
   virtual ConstraintEvaluationResult decide(const robot_state::RobotState &state, bool verbose = false) const;
+  virtual void decide(const robot_state::RobotStateBatch &states, std::vector<bool> &satisfied) const;
+  virtual void getVariableDependencies(std::vector<int> &variables) const;
+  virtual bool computeDistanceGradient(const robot_state::RobotState &state, const robot_model::JointModelGroup *group,
+                                       Eigen::VectorXd &gradient) const;
   virtual bool enabled() const;
   virtual void print(std::ostream &out = std::cout) const;
 
@@ -638,6 +716,28 @@ public:
   
 protected:
 
+  /** \brief A constraint region reduced to the quantities needed for a closed-form containment test.
+      Spheres, boxes and cylinders are tested directly; for other shapes only a bounding sphere is kept and
+      the body itself is queried when the point falls inside it. */
+  struct CompiledRegion
+  {
+    shapes::ShapeType type_; /**< \brief The type of the region's shape */
+    Eigen::Vector3d   center_; /**< \brief The center of the region (or of its bounding sphere) */
+    Eigen::Matrix3d   axes_; /**< \brief The axes of the region, as columns */
+    Eigen::Vector3d   half_extents_; /**< \brief Half extents along the axes (box) or the half length along the third axis (cylinder) */
+    double            radius2_; /**< \brief Squared radius (sphere, cylinder, bounding sphere) */
+  };
+
+  /** \brief Recompute the compiled regions and their bounding box from the constraint region bodies */
+  void compileRegions();
+
+  /** \brief Return the index of the first region containing \e pt, or the number of regions if none does.
+      The point is expressed in the frame the regions are posed in (the constraint frame for mobile frames) */
+  std::size_t findContainingRegion(const Eigen::Vector3d &pt, bool verbose = false) const;
+
+  /** \brief Check if \e pt is inside the region at index \e i; \e pt is expressed as for findContainingRegion() */
+  bool regionContains(std::size_t i, const Eigen::Vector3d &pt, bool verbose = false) const;
+
   Eigen::Vector3d                                   offset_; /**< \brief The target offset */
   bool                                              has_offset_; /**< \brief Whether the offset is substantially different than 0.0 */
   std::vector<bodies::BodyPtr>                      constraint_region_; /**< \brief The constraint region vector */
@@ -645,6 +745,9 @@ protected:
   bool                                              mobile_frame_; /**< \brief Whether or not a mobile frame is employed*/
   std::string                                       constraint_frame_id_; /**< \brief The constraint frame id */
   const robot_model::LinkModel *link_model_; /**< \brief The link model constraint subject */
+  std::vector<CompiledRegion>                       compiled_region_; /**< \brief The closed-form version of each constraint region */
+  Eigen::Vector3d                                   region_aabb_min_; /**< \brief Lower corner of the box enclosing all regions */
+  Eigen::Vector3d                                   region_aabb_max_; /**< \brief Upper corner of the box enclosing all regions */
 };
 
 /**
@@ -813,6 +916,7 @@ public:
   void getMarkers(const robot_state::RobotState &state, visualization_msgs::MarkerArray &markers) const;
 
   virtual bool enabled() const;
+  using KinematicConstraint::decide;
   virtual ConstraintEvaluationResult decide(const robot_state::RobotState &state, bool verbose = false) const;
   virtual void print(std::ostream &out = std::cout) const;
 
@@ -829,6 +933,29 @@ protected:
    */
   bool decideContact(const collision_detection::Contact &contact) const;
 
+  /**
+   * \brief Build the mesh approximating the visibility cone
+   *
+   * @param [in] sp The sensor pose
+   * @param [in] tp The target pose
+   * @param [in] points The points on the base of the cone, already transformed by the target pose
+   *
+   * @return The mesh; the caller takes ownership
+   */
+  shapes::Mesh* createVisibilityCone(const Eigen::Affine3d &sp, const Eigen::Affine3d &tp, const EigenSTL::vector_Vector3d &points) const;
+
+  /** \brief Check if the cone, given by its sensor and target poses, is too far from every robot link (other than
+      the sensor and target links) to possibly touch it. This is conservative: false does not imply a collision */
+  bool isConeClearOfRobot(const robot_state::RobotState &state, const Eigen::Affine3d &sp, const Eigen::Affine3d &tp) const;
+
+  /** \brief A sphere bounding a single collision shape of a link, expressed in the frame of that link */
+  struct LinkBound
+  {
+    const robot_model::LinkModel *link_;
+    Eigen::Vector3d               center_;
+    double                        radius_;
+  };
+
   collision_detection::CollisionRobotPtr collision_robot_; /**< \brief A copy of the collision robot maintained for collision checking the cone against robot links */
   bool                                   mobile_sensor_frame_; /**< \brief True if the sensor is a non-fixed frame relative to the transform frame */
   bool                                   mobile_target_frame_; /**< \brief True if the target is a non-fixed frame relative to the transform frame */
@@ -842,6 +969,56 @@ protected:
   double                                 target_radius_; /**< \brief Storage for the target radius */
   double                                 max_view_angle_; /**< \brief Storage for the max view angle */
   double                                 max_range_angle_; /**< \brief Storage for the max range angle */
+  shapes::ShapeConstPtr                  cone_; /**< \brief The cone mesh, if the sensor does not move relative to the target; it is expressed in the target frame */
+  std::vector<LinkBound>                 link_bounds_; /**< \brief Bounding spheres for the collision shapes of the robot links */
+};
+
+class KinematicConstraintSet;
+
+/**
+ * \brief Results of a previous KinematicConstraintSet::decide() call,
+ * kept so that constraints whose variables did not change are not
+ * evaluated again.
+ *
+ * A context is meant to be used for a sequence of states that differ
+ * in few variables (e.g., checking states along a path).  It can only
+ * detect changes in the variable values of the states: if anything
+ * else changes (e.g., objects are attached to the robot), clear() must
+ * be called.  A context can be used with one constraint set at a time;
+ * using it with another set, or after the set was modified, simply
+ * evaluates all the constraints again.
+ */
+class ConstraintEvaluationContext
+{
+public:
+
+  ConstraintEvaluationContext() : set_(NULL), set_version_(0), evaluated_(0)
+  {
+  }
+
+  /** \brief Forget previous results, so that the next evaluation considers all constraints */
+  void clear()
+  {
+    set_ = NULL;
+    variables_.clear();
+    results_.clear();
+  }
+
+  /** \brief Get the number of constraints that were actually evaluated during the last decide() call */
+  std::size_t getEvaluatedCount() const
+  {
+    return evaluated_;
+  }
+
+private:
+
+  friend class KinematicConstraintSet;
+
+  const KinematicConstraintSet           *set_; /**< \brief The set the results were computed for */
+  unsigned int                            set_version_; /**< \brief The version of the set the results were computed for */
+  std::vector<double>                     variables_; /**< \brief The variable values of the last evaluated state */
+  std::vector<ConstraintEvaluationResult> results_; /**< \brief The last result of each constraint in the set */
+  std::size_t                             evaluated_; /**< \brief The number of constraints evaluated by the last call */
 };
 
 /**
@@ -865,7 +1042,7 @@ public:
    * @param [in] model The kinematic model used for constraint evaluation
    */
   KinematicConstraintSet(const robot_model::RobotModelConstPtr &model) :
-    robot_model_(model)
+    robot_model_(model), version_(0)
   {
   }
 
@@ -958,6 +1135,53 @@ public:
    */
   ConstraintEvaluationResult decide(const robot_state::RobotState &state, std::vector<ConstraintEvaluationResult> &results, bool verbose = false) const;
 
+  /**
+   * \brief Determines, for each state of a batch, whether all
+   * constraints are satisfied.  Each constraint is evaluated for all
+   * the states still satisfying the previous ones, so states are
+   * dropped as soon as one constraint rejects them.  The link
+   * transforms of the batch must be up to date (see
+   * robot_state::RobotStateBatch::update()).
+   *
+   * @param [in] states The states to test
+   * @param [out] satisfied Whether each state satisfies all constraints
+   *
+   * @return The number of states that satisfy all constraints
+   */
+  std::size_t decide(const robot_state::RobotStateBatch &states, std::vector<bool> &satisfied) const;
+
+  /**
+   * \brief Determines whether all constraints are satisfied by state,
+   * using the results stored in \e context for the constraints that
+   * only depend on variables that did not change since the previous
+   * call with the same context.  The context is then updated with
+   * the results for \e state.  When \e verbose is true, all the
+   * constraints are evaluated.
+   *
+   * @param [in] state The state to test
+   * @param [in,out] context The results of the previous evaluation
+   * @param [in] verbose Whether to print the results of each constraint check.
+   *
+   * @return The same result decide(state, verbose) would return
+   */
+  ConstraintEvaluationResult decide(const robot_state::RobotState &state, ConstraintEvaluationContext &context, bool verbose = false) const;
+
+  /**
+   * \brief Move \e state towards satisfying all the constraints by
+   * changing the variables of \e group.  At every iteration, the
+   * violated constraints are linearized using their distance
+   * gradients (see KinematicConstraint::computeDistanceGradient()),
+   * and the minimum norm step that brings all their distances to zero
+   * is taken.  Joint bounds are enforced after every step.
+   *
+   * @param [in,out] state The state to project
+   * @param [in] group The group whose variables are changed
+   * @param [in] max_iterations The maximum number of steps to take
+   *
+   * @return True if the resulting state satisfies all constraints
+   */
+  bool project(robot_state::RobotState &state, const robot_model::JointModelGroup *group, unsigned int max_iterations = 10) const;
+
   /**
    * \brief Whether or not another KinematicConstraintSet is equal to
    * this one.
@@ -1037,6 +1261,18 @@ public:
     return all_constraints_;
   }
 
+  /**
+   * \brief Get the configured constraints in the set, in the order they
+   * are evaluated
+   *
+   *
+   * @return All the constraints of the set
+   */
+  const std::vector<KinematicConstraintPtr>& getKinematicConstraints() const
+  {
+    return kinematic_constraints_;
+  }
+
   /**
    * \brief Returns whether or not there are any constraints in the set
    *
@@ -1059,6 +1295,14 @@ protected:
   std::vector<moveit_msgs::VisibilityConstraint>  visibility_constraints_;/**<  \brief Messages corresponding to all internal visibility constraints */
   moveit_msgs::Constraints                        all_constraints_; /**<  \brief Messages corresponding to all internal constraints */
 
+  std::vector<std::vector<int> >                  dependencies_; /**<  \brief The sorted variable indices each constraint depends on */
+  unsigned int                                    version_; /**<  \brief Incremented every time the set of constraints changes */
+
+private:
+
+  /** \brief Add a configured constraint to the set */
+  void addConstraint(const KinematicConstraintPtr &constraint);
+
 };
 
 typedef boost::shared_ptr<KinematicConstraintSet> KinematicConstraintSetPtr; /**< \brief boost::shared_ptr to a KinematicConstraintSetPtr */
@@ -40,11 +40,13 @@
 #include <moveit/robot_state/conversions.h>
 #include <moveit/collision_detection_fcl/collision_robot_fcl.h>
 #include <moveit/collision_detection_fcl/collision_world_fcl.h>
+#include <moveit/profiler/profiler.h>
 #include <boost/scoped_ptr.hpp>
 #include <boost/math/constants/constants.hpp>
 #include <eigen_conversions/eigen_msg.h>
 #include <boost/bind.hpp>
 #include <limits>
+#include <algorithm>
 
 namespace kinematic_constraints
 {
@@ -58,6 +60,25 @@ static double normalizeAngle(double angle)
       v -= 2.0 * boost::math::constants::pi<double>();
   return v;
 }
+
+// compute the Jacobian of a point on a link for a group, with both the linear and angular parts expressed in the model frame
+static bool getModelFrameJacobian(const robot_state::RobotState &state, const robot_model::JointModelGroup *group,
+                                  const robot_model::LinkModel *link, const Eigen::Vector3d &point, Eigen::MatrixXd &jacobian)
+{
+  if (!group->isChain() || !group->isLinkUpdated(link->getName()))
+    return false;
+  if (!state.getJacobian(group, link, point, jacobian))
+    return false;
+  // the Jacobian is computed with respect to the parent link of the group's first joint
+  const robot_model::LinkModel *root = group->getJointModels()[0]->getParentLinkModel();
+  if (root)
+  {
+    const Eigen::Matrix3d &r = state.getGlobalLinkTransform(root).rotation();
+    jacobian.topRows(3) = r * jacobian.topRows(3);
+    jacobian.bottomRows(3) = r * jacobian.bottomRows(3);
+  }
+  return true;
+}
 }
 
 kinematic_constraints::KinematicConstraint::KinematicConstraint(const robot_model::RobotModelConstPtr &model) :
@@ -69,6 +90,51 @@ kinematic_constraints::KinematicConstraint::~KinematicConstraint()
 {
 }
 
+void kinematic_constraints::KinematicConstraint::decide(const robot_state::RobotStateBatch &states, std::vector<bool> &satisfied) const
+{
+  robot_state::RobotState state(states.getRobotModel());
+  for (std::size_t k = 0 ; k < states.size() ; ++k)
+    if (satisfied[k])
+    {
+      states.getState(k, state);
+      state.update();
+      satisfied[k] = decide(state).satisfied;
+    }
+}
+
+void kinematic_constraints::KinematicConstraint::getVariableDependencies(std::vector<int> &variables) const
+{
+  for (std::size_t i = 0 ; i < robot_model_->getVariableCount() ; ++i)
+    variables.push_back(i);
+}
+
+bool kinematic_constraints::KinematicConstraint::computeDistanceGradient(const robot_state::RobotState &state, const robot_model::JointModelGroup *group,
+                                                                        Eigen::VectorXd &gradient) const
+{
+  return false;
+}
+
+void kinematic_constraints::KinematicConstraint::addLinkDependencies(const robot_model::LinkModel *link, std::vector<int> &variables)
+{
+  while (link)
+  {
+    const robot_model::JointModel *joint = link->getParentJointModel();
+    if (!joint)
+      break;
+    for (std::size_t i = 0 ; i < joint->getVariableCount() ; ++i)
+      variables.push_back(joint->getFirstVariableIndex() + i);
+    link = joint->getParentLinkModel();
+  }
+}
+
+void kinematic_constraints::KinematicConstraint::addFrameDependencies(const std::string &frame, std::vector<int> &variables) const
+{
+  if (robot_model_->hasLinkModel(frame))
+    addLinkDependencies(robot_model_->getLinkModel(frame), variables);
+  else
+    KinematicConstraint::getVariableDependencies(variables);
+}
+
 bool kinematic_constraints::JointConstraint::configure(const moveit_msgs::JointConstraint &jc)
 {
   //clearing before we configure to get rid of any old data
@@ -235,6 +301,85 @@ kinematic_constraints::ConstraintEvaluationResult kinematic_constraints::JointCo
   return ConstraintEvaluationResult(result, constraint_weight_ * fabs(dif));
 }
 
+void kinematic_constraints::JointConstraint::decide(const robot_state::RobotStateBatch &states, std::vector<bool> &satisfied) const
+{
+  if (!joint_model_)
+    return;
+
+  const double *positions = states.getVariablePositions(joint_variable_index_);
+  const double above = joint_tolerance_above_ + 2.0 * std::numeric_limits<double>::epsilon();
+  const double below = -joint_tolerance_below_ - 2.0 * std::numeric_limits<double>::epsilon();
+  const std::size_t count = states.size();
+
+  if (joint_is_continuous_)
+  {
+    for (std::size_t k = 0 ; k < count ; ++k)
+      if (satisfied[k])
+      {
+        double dif = normalizeAngle(positions[k]) - joint_position_;
+        if (dif > boost::math::constants::pi<double>())
+          dif = 2.0*boost::math::constants::pi<double>() - dif;
+        else
+          if (dif < -boost::math::constants::pi<double>())
+            dif += 2.0*boost::math::constants::pi<double>();
+        satisfied[k] = dif <= above && dif >= below;
+      }
+  }
+  else
+  {
+    for (std::size_t k = 0 ; k < count ; ++k)
+      if (satisfied[k])
+      {
+        double dif = positions[k] - joint_position_;
+        satisfied[k] = dif <= above && dif >= below;
+      }
+  }
+}
+
+void kinematic_constraints::JointConstraint::getVariableDependencies(std::vector<int> &variables) const
+{
+  if (joint_model_ && joint_variable_index_ >= 0)
+    variables.push_back(joint_variable_index_);
+}
+
+bool kinematic_constraints::JointConstraint::computeDistanceGradient(const robot_state::RobotState &state, const robot_model::JointModelGroup *group,
+                                                                    Eigen::VectorXd &gradient) const
+{
+  if (!joint_model_)
+    return false;
+  const std::vector<int> &indices = group->getVariableIndexList();
+  std::vector<int>::const_iterator it = std::find(indices.begin(), indices.end(), joint_variable_index_);
+  if (it == indices.end())
+    return false;
+
+  // same difference as in decide(), keeping track of its derivative
+  double current_joint_position = state.getVariablePosition(joint_variable_index_);
+  double dif = 0.0;
+  double ddif = 1.0;
+  if (joint_is_continuous_)
+  {
+    dif = normalizeAngle(current_joint_position) - joint_position_;
+    if (dif > boost::math::constants::pi<double>())
+    {
+      dif = 2.0*boost::math::constants::pi<double>() - dif;
+      ddif = -1.0;
+    }
+    else
+      if (dif < -boost::math::constants::pi<double>())
+        dif += 2.0*boost::math::constants::pi<double>();
+  }
+  else
+    dif = current_joint_position - joint_position_;
+
+  gradient = Eigen::VectorXd::Zero(indices.size());
+  if (dif > 0.0)
+    gradient(it - indices.begin()) = constraint_weight_ * ddif;
+  else
+    if (dif < 0.0)
+      gradient(it - indices.begin()) = -constraint_weight_ * ddif;
+  return true;
+}
+
 bool kinematic_constraints::JointConstraint::enabled() const
 {
   return joint_model_;
@@ -363,9 +508,117 @@ bool kinematic_constraints::PositionConstraint::configure(const moveit_msgs::Pos
     else
       constraint_weight_ = pc.weight;
 
+  compileRegions();
+
   return !constraint_region_.empty();
 }
 
+void kinematic_constraints::PositionConstraint::compileRegions()
+{
+  compiled_region_.resize(constraint_region_.size());
+  region_aabb_min_.setConstant(std::numeric_limits<double>::infinity());
+  region_aabb_max_.setConstant(-std::numeric_limits<double>::infinity());
+
+  for (std::size_t i = 0 ; i < constraint_region_.size() ; ++i)
+  {
+    // for mobile frames the bodies are posed in the constraint frame; keep them in sync with the region poses
+    if (mobile_frame_)
+      constraint_region_[i]->setPose(constraint_region_pose_[i]);
+
+    const bodies::Body *body = constraint_region_[i].get();
+    const Eigen::Affine3d &pose = body->getPose();
+    const std::vector<double> &dims = body->getDimensions();
+    const double scale = body->getScale();
+    const double padding = body->getPadding();
+
+    CompiledRegion &cr = compiled_region_[i];
+    cr.type_ = body->getType();
+    cr.center_ = pose.translation();
+    cr.axes_ = pose.rotation();
+    cr.half_extents_.setZero();
+    cr.radius2_ = 0.0;
+
+    Eigen::Vector3d extents;
+    if (cr.type_ == shapes::SPHERE && dims.size() >= 1)
+    {
+      double r = dims[0] * scale + padding;
+      cr.radius2_ = r * r;
+      extents.setConstant(r);
+    }
+    else if (cr.type_ == shapes::BOX && dims.size() >= 3)
+    {
+      for (int j = 0 ; j < 3 ; ++j)
+        cr.half_extents_[j] = scale * dims[j] / 2.0 + padding;
+      extents = cr.axes_.cwiseAbs() * cr.half_extents_;
+    }
+    else if (cr.type_ == shapes::CYLINDER && dims.size() >= 2)
+    {
+      double r = dims[0] * scale + padding;
+      cr.radius2_ = r * r;
+      cr.half_extents_.z() = scale * dims[1] / 2.0 + padding;
+      // the extent of a disc of radius r with normal n along axis j is r * sqrt(1 - n_j^2)
+      for (int j = 0 ; j < 3 ; ++j)
+      {
+        double n = cr.axes_(j, 2);
+        extents[j] = fabs(n) * cr.half_extents_.z() + r * sqrt(std::max(0.0, 1.0 - n * n));
+      }
+    }
+    else
+    {
+      // meshes (and anything else) keep the generic test, guarded by their bounding sphere
+      cr.type_ = shapes::UNKNOWN_SHAPE;
+      bodies::BoundingSphere s;
+      body->computeBoundingSphere(s);
+      cr.center_ = s.center;
+      cr.radius2_ = s.radius * s.radius;
+      extents.setConstant(s.radius);
+    }
+    // a little slack so rounding never rejects a point the exact test would accept
+    extents.array() += 1e-9;
+    region_aabb_min_ = region_aabb_min_.cwiseMin(cr.center_ - extents);
+    region_aabb_max_ = region_aabb_max_.cwiseMax(cr.center_ + extents);
+  }
+}
+
+bool kinematic_constraints::PositionConstraint::regionContains(std::size_t i, const Eigen::Vector3d &pt, bool verbose) const
+{
+  const CompiledRegion &cr = compiled_region_[i];
+  const Eigen::Vector3d v = pt - cr.center_;
+  switch (cr.type_)
+  {
+  case shapes::SPHERE:
+    return v.squaredNorm() < cr.radius2_;
+  case shapes::BOX:
+    for (int j = 0 ; j < 3 ; ++j)
+      if (fabs(v.dot(cr.axes_.col(j))) > cr.half_extents_[j])
+        return false;
+    return true;
+  case shapes::CYLINDER:
+    {
+      if (fabs(v.dot(cr.axes_.col(2))) > cr.half_extents_.z())
+        return false;
+      double p1 = v.dot(cr.axes_.col(0));
+      double p2 = v.dot(cr.axes_.col(1));
+      return p1 * p1 + p2 * p2 < cr.radius2_;
+    }
+  default:
+    break;
+  }
+  if (v.squaredNorm() > cr.radius2_)
+    return false;
+  return constraint_region_[i]->containsPoint(pt, verbose);
+}
+
+std::size_t kinematic_constraints::PositionConstraint::findContainingRegion(const Eigen::Vector3d &pt, bool verbose) const
+{
+  if ((pt.array() < region_aabb_min_.array()).any() || (pt.array() > region_aabb_max_.array()).any())
+    return constraint_region_.size();
+  for (std::size_t i = 0 ; i < constraint_region_.size() ; ++i)
+    if (regionContains(i, pt, verbose))
+      return i;
+  return constraint_region_.size();
+}
+
 void kinematic_constraints::PositionConstraint::swapLinkModel(const robot_model::LinkModel *new_link, const Eigen::Affine3d &update)
 {
   if (!enabled())
@@ -373,6 +626,7 @@ void kinematic_constraints::PositionConstraint::swapLinkModel(const robot_model:
   link_model_ = new_link;
   for (std::size_t i = 0 ; i < constraint_region_pose_.size() ; ++i)
     constraint_region_pose_[i] = constraint_region_pose_[i] * update;
+  compileRegions();
 }
 
 bool kinematic_constraints::PositionConstraint::equal(const KinematicConstraint &other, double margin) const
@@ -442,28 +696,135 @@ kinematic_constraints::ConstraintEvaluationResult kinematic_constraints::Positio
   Eigen::Vector3d pt = state.getGlobalLinkTransform(link_model_) * offset_;
   if (mobile_frame_)
   {
-    for (std::size_t i = 0 ; i < constraint_region_.size() ; ++i)
+    // the regions are posed in the mobile frame, so bring the point to that frame instead of moving the regions
+    const Eigen::Affine3d &frame = state.getFrameTransform(constraint_frame_id_);
+    Eigen::Vector3d local = frame.inverse(Eigen::Isometry) * pt;
+    if (verbose)
     {
-      Eigen::Affine3d tmp = state.getFrameTransform(constraint_frame_id_) * constraint_region_pose_[i];
-      bool result = constraint_region_[i]->cloneAt(tmp)->containsPoint(pt, verbose);
-      if (result || (i + 1 == constraint_region_pose_.size()))
-        return finishPositionConstraintDecision(pt, tmp.translation(), link_model_->getName(), constraint_weight_, result, verbose);
-      else
-        finishPositionConstraintDecision(pt, tmp.translation(), link_model_->getName(), constraint_weight_, result, verbose);
+      for (std::size_t i = 0 ; i < constraint_region_.size() ; ++i)
+      {
+        bool result = regionContains(i, local, verbose);
+        Eigen::Vector3d desired = frame * constraint_region_pose_[i].translation();
+        if (result || (i + 1 == constraint_region_.size()))
+          return finishPositionConstraintDecision(pt, desired, link_model_->getName(), constraint_weight_, result, verbose);
+        else
+          finishPositionConstraintDecision(pt, desired, link_model_->getName(), constraint_weight_, result, verbose);
+      }
     }
+    std::size_t i = findContainingRegion(local);
+    bool result = i < constraint_region_.size();
+    if (!result)
+      i = constraint_region_.size() - 1;
+    return finishPositionConstraintDecision(pt, frame * constraint_region_pose_[i].translation(), link_model_->getName(), constraint_weight_, result, verbose);
   }
   else
   {
-    for (std::size_t i = 0 ; i < constraint_region_.size() ; ++i)
+    if (verbose)
     {
-      bool result = constraint_region_[i]->containsPoint(pt, true);
-      if (result || (i + 1 == constraint_region_.size()))
-        return finishPositionConstraintDecision(pt, constraint_region_[i]->getPose().translation(), link_model_->getName(), constraint_weight_, result, verbose);
-      else
-        finishPositionConstraintDecision(pt, constraint_region_[i]->getPose().translation(), link_model_->getName(), constraint_weight_, result, verbose);
+      for (std::size_t i = 0 ; i < constraint_region_.size() ; ++i)
+      {
+        bool result = regionContains(i, pt, verbose);
+        if (result || (i + 1 == constraint_region_.size()))
+          return finishPositionConstraintDecision(pt, constraint_region_[i]->getPose().translation(), link_model_->getName(), constraint_weight_, result, verbose);
+        else
+          finishPositionConstraintDecision(pt, constraint_region_[i]->getPose().translation(), link_model_->getName(), constraint_weight_, result, verbose);
+      }
+    }
+    std::size_t i = findContainingRegion(pt);
+    bool result = i < constraint_region_.size();
+    if (!result)
+      i = constraint_region_.size() - 1;
+    return finishPositionConstraintDecision(pt, constraint_region_[i]->getPose().translation(), link_model_->getName(), constraint_weight_, result, verbose);
+  }
+}
+
+void kinematic_constraints::PositionConstraint::decide(const robot_state::RobotStateBatch &states, std::vector<bool> &satisfied) const
+{
+  if (!link_model_ || constraint_region_.empty())
+    return;
+
+  const robot_model::LinkModel *frame_link = NULL;
+  if (mobile_frame_)
+  {
+    // only frames of links are known to the batch
+    if (robot_model_->hasLinkModel(constraint_frame_id_))
+      frame_link = robot_model_->getLinkModel(constraint_frame_id_);
+    else
+    {
+      KinematicConstraint::decide(states, satisfied);
+      return;
+    }
+  }
+
+  const std::size_t count = states.size();
+  const double *d = states.getGlobalLinkTransformData(link_model_);
+  Eigen::Affine3d frame;
+  for (std::size_t k = 0 ; k < count ; ++k)
+  {
+    if (!satisfied[k])
+      continue;
+    Eigen::Vector3d pt(d[9 * count + k], d[10 * count + k], d[11 * count + k]);
+    if (has_offset_)
+    {
+      pt.x() += d[k] * offset_.x() + d[3 * count + k] * offset_.y() + d[6 * count + k] * offset_.z();
+      pt.y() += d[count + k] * offset_.x() + d[4 * count + k] * offset_.y() + d[7 * count + k] * offset_.z();
+      pt.z() += d[2 * count + k] * offset_.x() + d[5 * count + k] * offset_.y() + d[8 * count + k] * offset_.z();
+    }
+    if (frame_link)
+    {
+      // the regions are posed in the mobile frame, so bring the point to that frame instead of moving the regions
+      states.getGlobalLinkTransform(frame_link, k, frame);
+      pt = frame.inverse(Eigen::Isometry) * pt;
     }
+    satisfied[k] = findContainingRegion(pt) < constraint_region_.size();
   }
-  return ConstraintEvaluationResult(false, 0.0);
+}
+
+void kinematic_constraints::PositionConstraint::getVariableDependencies(std::vector<int> &variables) const
+{
+  if (!enabled())
+    return;
+  addLinkDependencies(link_model_, variables);
+  if (mobile_frame_)
+    addFrameDependencies(constraint_frame_id_, variables);
+}
+
+bool kinematic_constraints::PositionConstraint::computeDistanceGradient(const robot_state::RobotState &state, const robot_model::JointModelGroup *group,
+                                                                       Eigen::VectorXd &gradient) const
+{
+  if (!enabled())
+    return false;
+  Eigen::MatrixXd jac;
+  if (!getModelFrameJacobian(state, group, link_model_, offset_, jac))
+    return false;
+  Eigen::MatrixXd dp = jac.topRows(3);
+
+  // the distance is measured to the same region center decide() uses
+  Eigen::Vector3d pt = state.getGlobalLinkTransform(link_model_) * offset_;
+  Eigen::Vector3d desired;
+  if (mobile_frame_)
+  {
+    const Eigen::Affine3d &frame = state.getFrameTransform(constraint_frame_id_);
+    std::size_t i = std::min(findContainingRegion(frame.inverse(Eigen::Isometry) * pt), constraint_region_.size() - 1);
+    desired = frame * constraint_region_pose_[i].translation();
+    // if the frame is moved by the group, so is the region center
+    Eigen::MatrixXd frame_jac;
+    if (robot_model_->hasLinkModel(constraint_frame_id_) &&
+        getModelFrameJacobian(state, group, robot_model_->getLinkModel(constraint_frame_id_), constraint_region_pose_[i].translation(), frame_jac))
+      dp -= frame_jac.topRows(3);
+  }
+  else
+  {
+    std::size_t i = std::min(findContainingRegion(pt), constraint_region_.size() - 1);
+    desired = constraint_region_[i]->getPose().translation();
+  }
+
+  Eigen::Vector3d e = pt - desired;
+  double n = e.norm();
+  gradient = Eigen::VectorXd::Zero(dp.cols());
+  if (n > std::numeric_limits<double>::epsilon())
+    gradient = (constraint_weight_ / n) * dp.transpose() * e;
+  return true;
 }
 
 void kinematic_constraints::PositionConstraint::print(std::ostream &out) const
@@ -480,6 +841,7 @@ void kinematic_constraints::PositionConstraint::clear()
   has_offset_ = false;
   constraint_region_.clear();
   constraint_region_pose_.clear();
+  compiled_region_.clear();
   mobile_frame_ = false;
   constraint_frame_id_ = "";
   link_model_ = NULL;
@@ -490,6 +852,41 @@ bool kinematic_constraints::PositionConstraint::enabled() const
   return link_model_ && !constraint_region_.empty();
 }
 
+namespace kinematic_constraints
+{
+// cos of the Y angle below which the X and Z angles are not determined by the matrix entries (gimbal lock)
+static const double ORIENTATION_SINGULARITY_COS = 1e-6;
+
+// The angles of the XYZ Euler decomposition of \e diff, each folded to min(|a|, pi - |a|). Both decompositions,
+// (a, b, c) and (a + pi, pi - b, c + pi), give the same folded angles, so they are read from the matrix entries:
+// for diff = Rx(a) Ry(b) Rz(c), diff(0,2) = sin(b), diff(1,2) / diff(2,2) = -tan(a) and diff(0,1) / diff(0,0) = -tan(c)
+static inline Eigen::Vector3d foldedXYZAngles(const Eigen::Matrix3d &diff)
+{
+  const double cos_y = sqrt(diff(0, 0) * diff(0, 0) + diff(0, 1) * diff(0, 1));
+  if (cos_y < ORIENTATION_SINGULARITY_COS)
+  {
+    // 0,1,2 corresponds to XYZ, the convention used in sampling constraints
+    Eigen::Vector3d xyz = diff.eulerAngles(0, 1, 2);
+    xyz(0) = std::min(fabs(xyz(0)), boost::math::constants::pi<double>() - fabs(xyz(0)));
+    xyz(1) = std::min(fabs(xyz(1)), boost::math::constants::pi<double>() - fabs(xyz(1)));
+    xyz(2) = std::min(fabs(xyz(2)), boost::math::constants::pi<double>() - fabs(xyz(2)));
+    return xyz;
+  }
+  return Eigen::Vector3d(atan2(fabs(diff(1, 2)), fabs(diff(2, 2))),
+                         atan2(fabs(diff(0, 2)), cos_y),
+                         atan2(fabs(diff(0, 1)), fabs(diff(0, 0))));
+}
+
+// upper bound on tan() (on sin() if \e use_sin) of a folded angle that is within \e tolerance; infinite if all angles are
+static inline double foldedAngleBound(double tolerance, bool use_sin)
+{
+  const double t = tolerance + std::numeric_limits<double>::epsilon();
+  if (t >= boost::math::constants::pi<double>() / 2.0)
+    return std::numeric_limits<double>::infinity();
+  return use_sin ? sin(t) : tan(t);
+}
+}
+
 bool kinematic_constraints::OrientationConstraint::configure(const moveit_msgs::OrientationConstraint &oc, const robot_state::Transforms &tf)
 {
   //clearing out any old data
@@ -547,6 +944,9 @@ bool kinematic_constraints::OrientationConstraint::configure(const moveit_msgs::
   absolute_z_axis_tolerance_ = fabs(oc.absolute_z_axis_tolerance);
   if (absolute_z_axis_tolerance_ < std::numeric_limits<double>::epsilon())
     logWarn("Near-zero value for absolute_z_axis_tolerance");
+  x_axis_bound_ = foldedAngleBound(absolute_x_axis_tolerance_, false);
+  y_axis_bound_ = foldedAngleBound(absolute_y_axis_tolerance_, true);
+  z_axis_bound_ = foldedAngleBound(absolute_z_axis_tolerance_, false);
 
   return link_model_ != NULL;
 }
@@ -586,6 +986,34 @@ void kinematic_constraints::OrientationConstraint::clear()
   desired_rotation_frame_id_ = "";
   mobile_frame_ = false;
   absolute_z_axis_tolerance_ = absolute_y_axis_tolerance_ = absolute_x_axis_tolerance_ = 0.0;
+  x_axis_bound_ = y_axis_bound_ = z_axis_bound_ = 0.0;
+}
+
+Eigen::Matrix3d kinematic_constraints::OrientationConstraint::getRelativeRotation(const Eigen::Matrix3d &link_rotation,
+                                                                                  const Eigen::Matrix3d *frame_rotation) const
+{
+  // rotations are orthonormal, so the inverse of the desired orientation in the mobile frame is its transpose
+  if (frame_rotation)
+    return desired_rotation_matrix_.transpose() * (frame_rotation->transpose() * link_rotation);
+  else
+    return desired_rotation_matrix_inv_ * link_rotation;
+}
+
+bool kinematic_constraints::OrientationConstraint::withinTolerance(const Eigen::Matrix3d &diff) const
+{
+  // same test as comparing the folded angles of foldedXYZAngles() to the tolerances, without computing the angles
+  const double cos_y2 = diff(0, 0) * diff(0, 0) + diff(0, 1) * diff(0, 1);
+  if (cos_y2 < ORIENTATION_SINGULARITY_COS * ORIENTATION_SINGULARITY_COS)
+  {
+    Eigen::Vector3d xyz = foldedXYZAngles(diff);
+    return xyz(2) < absolute_z_axis_tolerance_+std::numeric_limits<double>::epsilon()
+      && xyz(1) < absolute_y_axis_tolerance_+std::numeric_limits<double>::epsilon()
+      && xyz(0) < absolute_x_axis_tolerance_+std::numeric_limits<double>::epsilon();
+  }
+  // an infinite bound is written as a separate test, as it would give NaN when multiplied by a zero entry
+  return fabs(diff(0, 2)) < y_axis_bound_ &&
+    (x_axis_bound_ == std::numeric_limits<double>::infinity() || fabs(diff(1, 2)) < x_axis_bound_ * fabs(diff(2, 2))) &&
+    (z_axis_bound_ == std::numeric_limits<double>::infinity() || fabs(diff(0, 1)) < z_axis_bound_ * fabs(diff(0, 0)));
 }
 
 bool kinematic_constraints::OrientationConstraint::enabled() const
@@ -598,30 +1026,24 @@ kinematic_constraints::ConstraintEvaluationResult kinematic_constraints::Orienta
   if (!link_model_)
     return ConstraintEvaluationResult(true, 0.0);
 
-  Eigen::Vector3d xyz;
+  const Eigen::Matrix3d link_rotation = state.getGlobalLinkTransform(link_model_).rotation();
+  Eigen::Matrix3d diff;
   if (mobile_frame_)
   {
-    Eigen::Matrix3d tmp = state.getFrameTransform(desired_rotation_frame_id_).rotation() * desired_rotation_matrix_;
-    Eigen::Affine3d diff(tmp.inverse() * state.getGlobalLinkTransform(link_model_).rotation());
-    xyz = diff.rotation().eulerAngles(0, 1, 2);
-    // 0,1,2 corresponds to XYZ, the convention used in sampling constraints
+    const Eigen::Matrix3d frame_rotation = state.getFrameTransform(desired_rotation_frame_id_).rotation();
+    diff = getRelativeRotation(link_rotation, &frame_rotation);
   }
   else
-  {
-    Eigen::Affine3d diff(desired_rotation_matrix_inv_ * state.getGlobalLinkTransform(link_model_).rotation());
-    xyz = diff.rotation().eulerAngles(0, 1, 2); // 0,1,2 corresponds to XYZ, the convention used in sampling constraints
-  }
+    diff = getRelativeRotation(link_rotation, NULL);
 
-  xyz(0) = std::min(fabs(xyz(0)), boost::math::constants::pi<double>() - fabs(xyz(0)));
-  xyz(1) = std::min(fabs(xyz(1)), boost::math::constants::pi<double>() - fabs(xyz(1)));
-  xyz(2) = std::min(fabs(xyz(2)), boost::math::constants::pi<double>() - fabs(xyz(2)));
+  const Eigen::Vector3d xyz = foldedXYZAngles(diff);
   bool result = xyz(2) < absolute_z_axis_tolerance_+std::numeric_limits<double>::epsilon()
     && xyz(1) < absolute_y_axis_tolerance_+std::numeric_limits<double>::epsilon()
     && xyz(0) < absolute_x_axis_tolerance_+std::numeric_limits<double>::epsilon();
 
   if (verbose)
   {
-    Eigen::Quaterniond q_act(state.getGlobalLinkTransform(link_model_).rotation());
+    Eigen::Quaterniond q_act(link_rotation);
     Eigen::Quaterniond q_des(desired_rotation_matrix_);
     logInform("Orientation constraint %s for link '%s'. Quaternion desired: %f %f %f %f, quaternion actual: %f %f %f %f, error: x=%f, y=%f, z=%f, tolerance: x=%f, y=%f, z=%f",
              result ? "satisfied" : "violated", link_model_->getName().c_str(),
@@ -633,6 +1055,100 @@ kinematic_constraints::ConstraintEvaluationResult kinematic_constraints::Orienta
   return ConstraintEvaluationResult(result, constraint_weight_ * (xyz(0) + xyz(1) + xyz(2)));
 }
 
+void kinematic_constraints::OrientationConstraint::decide(const robot_state::RobotStateBatch &states, std::vector<bool> &satisfied) const
+{
+  if (!link_model_)
+    return;
+
+  const robot_model::LinkModel *frame_link = NULL;
+  if (mobile_frame_)
+  {
+    // only frames of links are known to the batch
+    if (robot_model_->hasLinkModel(desired_rotation_frame_id_))
+      frame_link = robot_model_->getLinkModel(desired_rotation_frame_id_);
+    else
+    {
+      KinematicConstraint::decide(states, satisfied);
+      return;
+    }
+  }
+
+  const std::size_t count = states.size();
+  const double *d = states.getGlobalLinkTransformData(link_model_);
+  Eigen::Matrix3d link_rotation;
+  Eigen::Affine3d frame;
+  for (std::size_t k = 0 ; k < count ; ++k)
+  {
+    if (!satisfied[k])
+      continue;
+    for (int e = 0 ; e < 9 ; ++e)
+      link_rotation.data()[e] = d[e * count + k];
+    Eigen::Matrix3d diff;
+    if (frame_link)
+    {
+      states.getGlobalLinkTransform(frame_link, k, frame);
+      const Eigen::Matrix3d frame_rotation = frame.rotation();
+      diff = getRelativeRotation(link_rotation, &frame_rotation);
+    }
+    else
+      diff = getRelativeRotation(link_rotation, NULL);
+
+    // only the outcome is needed, so no angles are computed
+    satisfied[k] = withinTolerance(diff);
+  }
+}
+
+void kinematic_constraints::OrientationConstraint::getVariableDependencies(std::vector<int> &variables) const
+{
+  if (!enabled())
+    return;
+  addLinkDependencies(link_model_, variables);
+  if (mobile_frame_)
+    addFrameDependencies(desired_rotation_frame_id_, variables);
+}
+
+bool kinematic_constraints::OrientationConstraint::computeDistanceGradient(const robot_state::RobotState &state, const robot_model::JointModelGroup *group,
+                                                                          Eigen::VectorXd &gradient) const
+{
+  if (!enabled())
+    return false;
+  Eigen::MatrixXd jac;
+  if (!getModelFrameJacobian(state, group, link_model_, Eigen::Vector3d(0.0, 0.0, 0.0), jac))
+    return false;
+  Eigen::MatrixXd w = jac.bottomRows(3);
+
+  Eigen::Matrix3d desired = desired_rotation_matrix_;
+  if (mobile_frame_)
+  {
+    desired = state.getFrameTransform(desired_rotation_frame_id_).rotation() * desired_rotation_matrix_;
+    // if the frame is rotated by the group, the relative angular velocity is what matters
+    Eigen::MatrixXd frame_jac;
+    if (robot_model_->hasLinkModel(desired_rotation_frame_id_) &&
+        getModelFrameJacobian(state, group, robot_model_->getLinkModel(desired_rotation_frame_id_), Eigen::Vector3d(0.0, 0.0, 0.0), frame_jac))
+      w -= frame_jac.bottomRows(3);
+  }
+  Eigen::Matrix3d diff = desired.inverse() * state.getGlobalLinkTransform(link_model_).rotation();
+  Eigen::Vector3d xyz = diff.eulerAngles(0, 1, 2);
+
+  // the angular velocity of diff is e * (rates of the XYZ Euler angles)
+  Eigen::Matrix3d e;
+  e.col(0) = Eigen::Vector3d::UnitX();
+  e.col(1) = Eigen::AngleAxisd(xyz(0), Eigen::Vector3d::UnitX()) * Eigen::Vector3d::UnitY();
+  e.col(2) = Eigen::AngleAxisd(xyz(0), Eigen::Vector3d::UnitX()) * Eigen::AngleAxisd(xyz(1), Eigen::Vector3d::UnitY()) * Eigen::Vector3d::UnitZ();
+  if (fabs(e.determinant()) < 1e-6)
+    return false; // the Euler angles are singular
+
+  // derivative of each term min(|a|, pi - |a|) of the distance with respect to its angle a
+  Eigen::Vector3d sign;
+  for (int k = 0 ; k < 3 ; ++k)
+  {
+    double sk = xyz(k) < 0.0 ? -1.0 : 1.0;
+    sign(k) = fabs(xyz(k)) <= boost::math::constants::pi<double>() - fabs(xyz(k)) ? sk : -sk;
+  }
+  gradient = constraint_weight_ * (w.transpose() * desired * e.inverse().transpose() * sign);
+  return true;
+}
+
 void kinematic_constraints::OrientationConstraint::print(std::ostream &out) const
 {
   if (link_model_)
@@ -649,6 +1165,36 @@ kinematic_constraints::VisibilityConstraint::VisibilityConstraint(const robot_mo
   KinematicConstraint(model), collision_robot_(new collision_detection::CollisionRobotFCL(model))
 {
   type_ = VISIBILITY_CONSTRAINT;
+
+  // bound the collision geometry of every link, so cones far from the robot need no collision check
+  const std::vector<const robot_model::LinkModel*> &links = model->getLinkModelsWithCollisionGeometry();
+  for (std::size_t i = 0 ; i < links.size() ; ++i)
+  {
+    const std::vector<shapes::ShapeConstPtr> &shapes = links[i]->getShapes();
+    for (std::size_t j = 0 ; j < shapes.size() ; ++j)
+    {
+      LinkBound lb;
+      lb.link_ = links[i];
+      boost::scoped_ptr<bodies::Body> body(bodies::createBodyFromShape(shapes[j].get()));
+      if (body)
+      {
+        body->setScale(collision_robot_->getLinkScale(links[i]->getName()));
+        body->setPadding(collision_robot_->getLinkPadding(links[i]->getName()));
+        body->setPose(links[i]->getCollisionOriginTransforms()[j]);
+        bodies::BoundingSphere bs;
+        body->computeBoundingSphere(bs);
+        lb.center_ = bs.center;
+        lb.radius_ = bs.radius;
+      }
+      else
+      {
+        // unbounded shapes (e.g., planes) are always considered close to the cone
+        lb.center_ = Eigen::Vector3d(0.0, 0.0, 0.0);
+        lb.radius_ = std::numeric_limits<double>::infinity();
+      }
+      link_bounds_.push_back(lb);
+    }
+  }
 }
 
 void kinematic_constraints::VisibilityConstraint::clear()
@@ -665,6 +1211,7 @@ void kinematic_constraints::VisibilityConstraint::clear()
   target_radius_ = -1.0;
   max_view_angle_ = 0.0;
   max_range_angle_ = 0.0;
+  cone_.reset();
 }
 
 bool kinematic_constraints::VisibilityConstraint::configure(const moveit_msgs::VisibilityConstraint &vc, const robot_state::Transforms &tf)
@@ -737,6 +1284,18 @@ bool kinematic_constraints::VisibilityConstraint::configure(const moveit_msgs::V
   max_range_angle_ = vc.max_range_angle;
   sensor_view_direction_ = vc.sensor_view_direction;
 
+  // if the sensor cannot move relative to the target, the cone is the same for every state;
+  // build it once, in the target frame, so the collision geometry computed for it is reused
+  if (target_radius_ > std::numeric_limits<double>::epsilon() && mobile_sensor_frame_ == mobile_target_frame_ &&
+      (!mobile_target_frame_ || robot_state::Transforms::sameFrame(sensor_frame_id_, target_frame_id_)))
+  {
+    EigenSTL::vector_Vector3d points(points_);
+    if (mobile_target_frame_)
+      for (std::size_t i = 0 ; i < points.size() ; ++i)
+        points[i] = target_pose_ * points_[i];
+    cone_.reset(createVisibilityCone(sensor_pose_, target_pose_, points));
+  }
+
   return target_radius_ > std::numeric_limits<double>::epsilon();
 }
 
@@ -791,6 +1350,12 @@ shapes::Mesh* kinematic_constraints::VisibilityConstraint::getVisibilityCone(con
     points = tempPoints.get();
   }
 
+  return createVisibilityCone(sp, tp, *points);
+}
+
+shapes::Mesh* kinematic_constraints::VisibilityConstraint::createVisibilityCone(const Eigen::Affine3d &sp, const Eigen::Affine3d &tp,
+                                                                                const EigenSTL::vector_Vector3d &points) const
+{
   // allocate memory for a mesh to represent the visibility cone
   shapes::Mesh *m = new shapes::Mesh();
   m->vertex_count = cone_sides_ + 2;
@@ -810,16 +1375,16 @@ shapes::Mesh* kinematic_constraints::VisibilityConstraint::getVisibilityCone(con
   m->vertices[5] = tp.translation().z();
 
   // the points that approximate the base disc
-  for (std::size_t i = 0 ; i < points->size() ; ++i)
+  for (std::size_t i = 0 ; i < points.size() ; ++i)
   {
-    m->vertices[i*3 + 6] = points->at(i).x();
-    m->vertices[i*3 + 7] = points->at(i).y();
-    m->vertices[i*3 + 8] = points->at(i).z();
+    m->vertices[i*3 + 6] = points[i].x();
+    m->vertices[i*3 + 7] = points[i].y();
+    m->vertices[i*3 + 8] = points[i].z();
   }
 
   // add the triangles
-  std::size_t p3 = points->size() * 3;
-  for (std::size_t i = 1 ; i < points->size() ; ++i)
+  std::size_t p3 = points.size() * 3;
+  for (std::size_t i = 1 ; i < points.size() ; ++i)
   {
     // triangle forming a side of the cone, using the sensor origin
     std::size_t i3 = (i - 1) * 3;
@@ -834,11 +1399,11 @@ shapes::Mesh* kinematic_constraints::VisibilityConstraint::getVisibilityCone(con
   }
 
   // last triangles
-  m->triangles[p3 - 3] = points->size() + 1;
+  m->triangles[p3 - 3] = points.size() + 1;
   m->triangles[p3 - 2] = 0;
   m->triangles[p3 - 1] = 2;
   p3 *= 2;
-  m->triangles[p3 - 3] = points->size() + 1;
+  m->triangles[p3 - 3] = points.size() + 1;
   m->triangles[p3 - 2] = 1;
   m->triangles[p3 - 1] = 2;
 
@@ -919,11 +1484,11 @@ kinematic_constraints::ConstraintEvaluationResult kinematic_constraints::Visibil
   if (target_radius_ <= std::numeric_limits<double>::epsilon())
     return ConstraintEvaluationResult(true, 0.0);
 
+  const Eigen::Affine3d &sp = mobile_sensor_frame_ ? state.getFrameTransform(sensor_frame_id_) * sensor_pose_ : sensor_pose_;
+  const Eigen::Affine3d &tp = mobile_target_frame_ ? state.getFrameTransform(target_frame_id_) * target_pose_ : target_pose_;
+
   if (max_view_angle_ > 0.0 || max_range_angle_ > 0.0)
   {
-    const Eigen::Affine3d &sp = mobile_sensor_frame_ ? state.getFrameTransform(sensor_frame_id_) * sensor_pose_ : sensor_pose_;
-    const Eigen::Affine3d &tp = mobile_target_frame_ ? state.getFrameTransform(target_frame_id_) * target_pose_ : target_pose_;
-
     //necessary to do subtraction as SENSOR_Z is 0 and SENSOR_X is 2
     const Eigen::Vector3d &normal2 = sp.rotation().col(2-sensor_view_direction_);
 
@@ -966,13 +1531,29 @@ kinematic_constraints::ConstraintEvaluationResult kinematic_constraints::Visibil
     }
   }
 
-  shapes::Mesh *m = getVisibilityCone(state);
+  if (isConeClearOfRobot(state, sp, tp))
+  {
+    if (verbose)
+      logInform("Visibility constraint satisfied. The visibility cone is away from all robot links.");
+    return ConstraintEvaluationResult(true, 0.0);
+  }
+
+  // reuse the cone if it does not change shape; only its pose is updated
+  shapes::ShapeConstPtr m = cone_;
+  Eigen::Affine3d cone_pose = Eigen::Affine3d::Identity();
+  if (m)
+  {
+    if (mobile_target_frame_)
+      cone_pose = state.getFrameTransform(target_frame_id_);
+  }
+  else
+    m.reset(getVisibilityCone(state));
   if (!m)
     return ConstraintEvaluationResult(false, 0.0);
 
   // add the visibility cone as an object
   collision_detection::CollisionWorldFCL collision_world;
-  collision_world.getWorld()->addToObject("cone", shapes::ShapeConstPtr(m), Eigen::Affine3d::Identity());
+  collision_world.getWorld()->addToObject("cone", m, cone_pose);
 
   // check for collisions between the robot and the cone
   collision_detection::CollisionRequest req;
@@ -994,6 +1575,38 @@ kinematic_constraints::ConstraintEvaluationResult kinematic_constraints::Visibil
   return ConstraintEvaluationResult(!res.collision, res.collision ? res.contacts.begin()->second.front().depth : 0.0);
 }
 
+bool kinematic_constraints::VisibilityConstraint::isConeClearOfRobot(const robot_state::RobotState &state, const Eigen::Affine3d &sp, const Eigen::Affine3d &tp) const
+{
+  // axis aligned bounds of the cone: the sensor origin and the points on its base
+  Eigen::Vector3d lo = sp.translation();
+  Eigen::Vector3d hi = lo;
+  for (std::size_t i = 0 ; i < points_.size() ; ++i)
+  {
+    Eigen::Vector3d p = mobile_target_frame_ ? Eigen::Vector3d(tp * points_[i]) : points_[i];
+    lo = lo.cwiseMin(p);
+    hi = hi.cwiseMax(p);
+  }
+
+  for (std::size_t i = 0 ; i < link_bounds_.size() ; ++i)
+  {
+    const LinkBound &lb = link_bounds_[i];
+    // contacts with the sensor or target links are allowed anyway
+    if (robot_state::Transforms::sameFrame(lb.link_->getName(), sensor_frame_id_) ||
+        robot_state::Transforms::sameFrame(lb.link_->getName(), target_frame_id_))
+      continue;
+    Eigen::Vector3d c = state.getGlobalLinkTransform(lb.link_) * lb.center_;
+    double d2 = 0.0;
+    for (int j = 0 ; j < 3 ; ++j)
+    {
+      double d = c[j] < lo[j] ? lo[j] - c[j] : (c[j] > hi[j] ? c[j] - hi[j] : 0.0);
+      d2 += d * d;
+    }
+    if (d2 <= lb.radius_ * lb.radius_)
+      return false;
+  }
+  return true;
+}
+
 bool kinematic_constraints::VisibilityConstraint::decideContact(const collision_detection::Contact &contact) const
 {
     if (contact.body_type_1 == collision_detection::BodyTypes::ROBOT_ATTACHED ||
@@ -1037,6 +1650,19 @@ void kinematic_constraints::KinematicConstraintSet::clear()
   position_constraints_.clear();
   orientation_constraints_.clear();
   visibility_constraints_.clear();
+  dependencies_.clear();
+  ++version_;
+}
+
+void kinematic_constraints::KinematicConstraintSet::addConstraint(const KinematicConstraintPtr &constraint)
+{
+  kinematic_constraints_.push_back(constraint);
+  std::vector<int> deps;
+  constraint->getVariableDependencies(deps);
+  std::sort(deps.begin(), deps.end());
+  deps.erase(std::unique(deps.begin(), deps.end()), deps.end());
+  dependencies_.push_back(deps);
+  ++version_;
 }
 
 bool kinematic_constraints::KinematicConstraintSet::add(const std::vector<moveit_msgs::JointConstraint> &jc)
@@ -1047,7 +1673,7 @@ bool kinematic_constraints::KinematicConstraintSet::add(const std::vector<moveit
     JointConstraint *ev = new JointConstraint(robot_model_);
     bool u = ev->configure(jc[i]);
     result = result && u;
-    kinematic_constraints_.push_back(KinematicConstraintPtr(ev));
+    addConstraint(KinematicConstraintPtr(ev));
     joint_constraints_.push_back(jc[i]);
     all_constraints_.joint_constraints.push_back(jc[i]);
   }
@@ -1062,7 +1688,7 @@ bool kinematic_constraints::KinematicConstraintSet::add(const std::vector<moveit
     PositionConstraint *ev = new PositionConstraint(robot_model_);
     bool u = ev->configure(pc[i], tf);
     result = result && u;
-    kinematic_constraints_.push_back(KinematicConstraintPtr(ev));
+    addConstraint(KinematicConstraintPtr(ev));
     position_constraints_.push_back(pc[i]);
     all_constraints_.position_constraints.push_back(pc[i]);
   }
@@ -1077,7 +1703,7 @@ bool kinematic_constraints::KinematicConstraintSet::add(const std::vector<moveit
     OrientationConstraint *ev = new OrientationConstraint(robot_model_);
     bool u = ev->configure(oc[i], tf);
     result = result && u;
-    kinematic_constraints_.push_back(KinematicConstraintPtr(ev));
+    addConstraint(KinematicConstraintPtr(ev));
     orientation_constraints_.push_back(oc[i]);
     all_constraints_.orientation_constraints.push_back(oc[i]);
   }
@@ -1092,7 +1718,7 @@ bool kinematic_constraints::KinematicConstraintSet::add(const std::vector<moveit
     VisibilityConstraint *ev = new VisibilityConstraint(robot_model_);
     bool u = ev->configure(vc[i], tf);
     result = result && u;
-    kinematic_constraints_.push_back(KinematicConstraintPtr(ev));
+    addConstraint(KinematicConstraintPtr(ev));
     visibility_constraints_.push_back(vc[i]);
     all_constraints_.visibility_constraints.push_back(vc[i]);
   }
@@ -1110,6 +1736,7 @@ bool kinematic_constraints::KinematicConstraintSet::add(const moveit_msgs::Const
 
 kinematic_constraints::ConstraintEvaluationResult kinematic_constraints::KinematicConstraintSet::decide(const robot_state::RobotState &state, bool verbose) const
 {
+  MOVEIT_CORE_PROBE("KinematicConstraintSet::decide");
   ConstraintEvaluationResult res(true, 0.0);
   for (unsigned int i = 0 ; i < kinematic_constraints_.size() ; ++i)
   {
@@ -1137,6 +1764,91 @@ kinematic_constraints::ConstraintEvaluationResult kinematic_constraints::Kinemat
   return result;
 }
 
+std::size_t kinematic_constraints::KinematicConstraintSet::decide(const robot_state::RobotStateBatch &states, std::vector<bool> &satisfied) const
+{
+  satisfied.assign(states.size(), true);
+  std::size_t remaining = states.size();
+  for (std::size_t i = 0 ; i < kinematic_constraints_.size() && remaining > 0 ; ++i)
+  {
+    kinematic_constraints_[i]->decide(states, satisfied);
+    remaining = std::count(satisfied.begin(), satisfied.end(), true);
+  }
+  return remaining;
+}
+
+kinematic_constraints::ConstraintEvaluationResult kinematic_constraints::KinematicConstraintSet::decide(const robot_state::RobotState &state,
+                                                                                                    ConstraintEvaluationContext &context,
+                                                                                                    bool verbose) const
+{
+  const std::size_t n = robot_model_->getVariableCount();
+  const double *values = state.getVariablePositions();
+  bool fresh = verbose || context.set_ != this || context.set_version_ != version_ ||
+    context.results_.size() != kinematic_constraints_.size() || context.variables_.size() != n;
+  if (fresh)
+    context.results_.resize(kinematic_constraints_.size());
+
+  ConstraintEvaluationResult res(true, 0.0);
+  context.evaluated_ = 0;
+  for (std::size_t i = 0 ; i < kinematic_constraints_.size() ; ++i)
+  {
+    bool changed = fresh;
+    const std::vector<int> &deps = dependencies_[i];
+    for (std::size_t j = 0 ; !changed && j < deps.size() ; ++j)
+      changed = context.variables_[deps[j]] != values[deps[j]];
+    if (changed)
+    {
+      context.results_[i] = kinematic_constraints_[i]->decide(state, verbose);
+      context.evaluated_++;
+    }
+    const ConstraintEvaluationResult &r = context.results_[i];
+    if (!r.satisfied)
+      res.satisfied = false;
+    res.distance += r.distance;
+  }
+
+  context.variables_.assign(values, values + n);
+  context.set_ = this;
+  context.set_version_ = version_;
+  return res;
+}
+
+bool kinematic_constraints::KinematicConstraintSet::project(robot_state::RobotState &state, const robot_model::JointModelGroup *group,
+                                                           unsigned int max_iterations) const
+{
+  std::vector<ConstraintEvaluationResult> results;
+  Eigen::MatrixXd g(kinematic_constraints_.size(), group->getVariableCount());
+  Eigen::VectorXd d(kinematic_constraints_.size());
+  Eigen::VectorXd gradient, values;
+  for (unsigned int it = 0 ; ; ++it)
+  {
+    state.update();
+    if (decide(state, results).satisfied)
+      return true;
+    if (it >= max_iterations)
+      return false;
+
+    // linearize the violated constraints
+    std::size_t rows = 0;
+    for (std::size_t i = 0 ; i < kinematic_constraints_.size() ; ++i)
+      if (!results[i].satisfied && kinematic_constraints_[i]->computeDistanceGradient(state, group, gradient))
+      {
+        g.row(rows) = gradient.transpose();
+        d(rows) = results[i].distance;
+        ++rows;
+      }
+    if (rows == 0)
+      return false;
+
+    Eigen::VectorXd step = g.topRows(rows).jacobiSvd(Eigen::ComputeThinU | Eigen::ComputeThinV).solve(-d.head(rows));
+    if (step.squaredNorm() < std::numeric_limits<double>::epsilon())
+      return false;
+    state.copyJointGroupPositions(group, values);
+    values += step;
+    state.setJointGroupPositions(group, values);
+    state.enforceBounds(group);
+  }
+}
+
 void kinematic_constraints::KinematicConstraintSet::print(std::ostream &out) const
 {
   out << kinematic_constraints_.size() << " kinematic constraints" << std::endl;
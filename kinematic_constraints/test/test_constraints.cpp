@@ -39,8 +39,10 @@
 #include <gtest/gtest.h>
 #include <urdf_parser/urdf_parser.h>
 #include <fstream>
+#include <algorithm>
 #include <eigen_conversions/eigen_msg.h>
 #include <boost/filesystem/path.hpp>
+#include <boost/math/constants/constants.hpp>
 
 class LoadPlanningModelsPr2 : public testing::Test
 {
@@ -522,6 +524,62 @@ TEST_F(LoadPlanningModelsPr2, PositionConstraintsMobile)
     EXPECT_TRUE(pc.decide(ks, false).satisfied);
 }
 
+TEST_F(LoadPlanningModelsPr2, PositionConstraintsCompiledRegions)
+{
+    robot_state::RobotState ks(kmodel);
+    ks.setToDefaultValues();
+    robot_state::Transforms tf(kmodel->getModelFrame());
+
+    kinematic_constraints::PositionConstraint pc(kmodel);
+    moveit_msgs::PositionConstraint pcm;
+
+    pcm.link_name = "l_wrist_roll_link";
+    pcm.header.frame_id = kmodel->getModelFrame();
+    pcm.weight = 1.0;
+
+    pcm.constraint_region.primitives.resize(3);
+    pcm.constraint_region.primitives[0].type = shape_msgs::SolidPrimitive::BOX;
+    pcm.constraint_region.primitives[0].dimensions.resize(3);
+    pcm.constraint_region.primitives[0].dimensions[shape_msgs::SolidPrimitive::BOX_X] = 0.6;
+    pcm.constraint_region.primitives[0].dimensions[shape_msgs::SolidPrimitive::BOX_Y] = 0.3;
+    pcm.constraint_region.primitives[0].dimensions[shape_msgs::SolidPrimitive::BOX_Z] = 0.4;
+    pcm.constraint_region.primitives[1].type = shape_msgs::SolidPrimitive::SPHERE;
+    pcm.constraint_region.primitives[1].dimensions.resize(1);
+    pcm.constraint_region.primitives[1].dimensions[shape_msgs::SolidPrimitive::SPHERE_RADIUS] = 0.25;
+    pcm.constraint_region.primitives[2].type = shape_msgs::SolidPrimitive::CYLINDER;
+    pcm.constraint_region.primitives[2].dimensions.resize(2);
+    pcm.constraint_region.primitives[2].dimensions[shape_msgs::SolidPrimitive::CYLINDER_HEIGHT] = 0.5;
+    pcm.constraint_region.primitives[2].dimensions[shape_msgs::SolidPrimitive::CYLINDER_RADIUS] = 0.2;
+
+    pcm.constraint_region.primitive_poses.resize(3);
+    Eigen::Quaterniond q(Eigen::AngleAxisd(0.7, Eigen::Vector3d(1.0, 2.0, 0.5).normalized()));
+    for (std::size_t i = 0 ; i < 3 ; ++i)
+    {
+      pcm.constraint_region.primitive_poses[i].position.x = 0.5;
+      pcm.constraint_region.primitive_poses[i].position.y = 0.1 + 0.3 * i;
+      pcm.constraint_region.primitive_poses[i].position.z = 0.8;
+      pcm.constraint_region.primitive_poses[i].orientation.x = q.x();
+      pcm.constraint_region.primitive_poses[i].orientation.y = q.y();
+      pcm.constraint_region.primitive_poses[i].orientation.z = q.z();
+      pcm.constraint_region.primitive_poses[i].orientation.w = q.w();
+    }
+    EXPECT_TRUE(pc.configure(pcm, tf));
+
+    // the closed-form tests must agree with the bodies they were compiled from
+    const std::vector<bodies::BodyPtr> &regions = pc.getConstraintRegions();
+    const robot_model::JointModelGroup *jmg = kmodel->getJointModelGroup("left_arm");
+    for (int k = 0 ; k < 500 ; ++k)
+    {
+      ks.setToRandomPositions(jmg);
+      ks.update();
+      Eigen::Vector3d pt = ks.getGlobalLinkTransform(pcm.link_name).translation();
+      bool expected = false;
+      for (std::size_t i = 0 ; !expected && i < regions.size() ; ++i)
+        expected = regions[i]->containsPoint(pt);
+      EXPECT_EQ(expected, pc.decide(ks).satisfied);
+    }
+}
+
 TEST_F(LoadPlanningModelsPr2, PositionConstraintsEquality)
 {
     robot_state::RobotState ks(kmodel);
@@ -666,6 +724,66 @@ TEST_F(LoadPlanningModelsPr2, OrientationConstraintsSimple)
     EXPECT_FALSE(oc.decide(ks).satisfied);
 }
 
+TEST_F(LoadPlanningModelsPr2, OrientationConstraintsEulerReference)
+{
+  robot_state::RobotState ks(kmodel);
+  ks.setToDefaultValues();
+  ks.update();
+  robot_state::Transforms tf(kmodel->getModelFrame());
+
+  moveit_msgs::OrientationConstraint ocm;
+  ocm.link_name = "r_wrist_roll_link";
+  ocm.header.frame_id = "torso_lift_link";
+  geometry_msgs::Pose p;
+  tf::poseEigenToMsg(ks.getFrameTransform(ocm.header.frame_id).inverse() * ks.getGlobalLinkTransform(ocm.link_name), p);
+  ocm.orientation = p.orientation;
+  ocm.absolute_x_axis_tolerance = 0.6;
+  ocm.absolute_y_axis_tolerance = 0.4;
+  ocm.absolute_z_axis_tolerance = 2.0;
+  ocm.weight = 1.0;
+
+  kinematic_constraints::OrientationConstraint oc(kmodel);
+  EXPECT_TRUE(oc.configure(ocm, tf));
+  Eigen::Quaterniond q;
+  tf::quaternionMsgToEigen(ocm.orientation, q);
+  const Eigen::Matrix3d desired = q.toRotationMatrix();
+
+  const std::size_t count = 200;
+  robot_state::RobotStateBatch batch(kmodel, count);
+  std::vector<bool> expected(count);
+  std::size_t satisfied_count = 0;
+  for (std::size_t k = 0 ; k < count ; ++k)
+  {
+    ks.setToRandomPositions();
+    ks.update();
+    batch.setState(k, ks);
+
+    // the tolerance test on the folded XYZ Euler angles, as the decision was originally computed
+    Eigen::Matrix3d diff = (ks.getFrameTransform(ocm.header.frame_id).rotation() * desired).inverse() *
+      ks.getGlobalLinkTransform(ocm.link_name).rotation();
+    Eigen::Vector3d xyz = diff.eulerAngles(0, 1, 2);
+    for (int i = 0 ; i < 3 ; ++i)
+      xyz(i) = std::min(fabs(xyz(i)), boost::math::constants::pi<double>() - fabs(xyz(i)));
+    expected[k] = xyz(0) < ocm.absolute_x_axis_tolerance && xyz(1) < ocm.absolute_y_axis_tolerance &&
+      xyz(2) < ocm.absolute_z_axis_tolerance;
+    if (expected[k])
+      ++satisfied_count;
+
+    kinematic_constraints::ConstraintEvaluationResult r = oc.decide(ks);
+    EXPECT_EQ((bool)expected[k], r.satisfied) << "state " << k;
+    EXPECT_NEAR(xyz(0) + xyz(1) + xyz(2), r.distance, 1e-6);
+  }
+  batch.update();
+  EXPECT_GT(satisfied_count, 0u);
+  EXPECT_LT(satisfied_count, count);
+
+  std::vector<bool> satisfied;
+  oc.decide(batch, satisfied);
+  ASSERT_EQ(satisfied.size(), count);
+  for (std::size_t k = 0 ; k < count ; ++k)
+    EXPECT_EQ((bool)expected[k], (bool)satisfied[k]) << "state " << k;
+}
+
 TEST_F(LoadPlanningModelsPr2, VisibilityConstraintsSimple)
 {
     robot_state::RobotState ks(kmodel);
@@ -854,6 +972,217 @@ TEST_F(LoadPlanningModelsPr2, TestKinematicConstraintSet)
   EXPECT_FALSE(kcs.decide(ks).satisfied);
 }
 
+TEST_F(LoadPlanningModelsPr2, TestKinematicConstraintSetBatch)
+{
+  robot_state::RobotState ks(kmodel);
+  ks.setToDefaultValues();
+  ks.update();
+  robot_state::Transforms tf(kmodel->getModelFrame());
+
+  moveit_msgs::Constraints constr;
+  constr.joint_constraints.resize(1);
+  constr.joint_constraints[0].joint_name = "head_pan_joint";
+  constr.joint_constraints[0].position = 0.4;
+  constr.joint_constraints[0].tolerance_above = 0.1;
+  constr.joint_constraints[0].tolerance_below = 0.05;
+  constr.joint_constraints[0].weight = 1.0;
+
+  constr.orientation_constraints.resize(1);
+  moveit_msgs::OrientationConstraint &ocm = constr.orientation_constraints[0];
+  ocm.link_name = "r_wrist_roll_link";
+  ocm.header.frame_id = kmodel->getModelFrame();
+  geometry_msgs::Pose p;
+  tf::poseEigenToMsg(ks.getGlobalLinkTransform(ocm.link_name), p);
+  ocm.orientation = p.orientation;
+  ocm.absolute_x_axis_tolerance = 0.1;
+  ocm.absolute_y_axis_tolerance = 0.1;
+  ocm.absolute_z_axis_tolerance = 0.1;
+  ocm.weight = 1.0;
+
+  // a region in a mobile frame
+  constr.position_constraints.resize(1);
+  moveit_msgs::PositionConstraint &pcm = constr.position_constraints[0];
+  pcm.link_name = "l_wrist_roll_link";
+  pcm.header.frame_id = "r_wrist_roll_link";
+  pcm.constraint_region.primitives.resize(1);
+  pcm.constraint_region.primitives[0].type = shape_msgs::SolidPrimitive::BOX;
+  pcm.constraint_region.primitives[0].dimensions.resize(3, 0.1);
+  pcm.constraint_region.primitive_poses.resize(1);
+  pcm.constraint_region.primitive_poses[0].position.y = 0.6;
+  pcm.constraint_region.primitive_poses[0].orientation.w = 1.0;
+  pcm.weight = 1.0;
+
+  kinematic_constraints::KinematicConstraintSet kcs(kmodel);
+  EXPECT_TRUE(kcs.add(constr, tf));
+
+  const std::size_t count = 50;
+  robot_state::RobotStateBatch batch(kmodel, count);
+  std::vector<bool> expected(count);
+  for (std::size_t k = 0 ; k < count ; ++k)
+  {
+    std::map<std::string, double> jvals;
+    jvals["head_pan_joint"] = 0.3 + 0.2 * k / count;
+    jvals["r_wrist_roll_joint"] = -0.2 + 0.4 * (k % 5) / 5.0;
+    jvals["l_shoulder_pan_joint"] = k % 2 ? 0.4 : -0.4;
+    ks.setVariablePositions(jvals);
+    ks.update();
+    batch.setState(k, ks);
+    expected[k] = kcs.decide(ks).satisfied;
+  }
+  batch.update();
+
+  std::vector<bool> satisfied;
+  std::size_t n = kcs.decide(batch, satisfied);
+  ASSERT_EQ(satisfied.size(), count);
+  EXPECT_EQ(n, (std::size_t)std::count(expected.begin(), expected.end(), true));
+  EXPECT_LT(n, count);
+  for (std::size_t k = 0 ; k < count ; ++k)
+    EXPECT_EQ((bool)expected[k], (bool)satisfied[k]) << "state " << k;
+}
+
+TEST_F(LoadPlanningModelsPr2, TestKinematicConstraintSetContext)
+{
+  robot_state::RobotState ks(kmodel);
+  ks.setToDefaultValues();
+  ks.update();
+  robot_state::Transforms tf(kmodel->getModelFrame());
+
+  moveit_msgs::Constraints constr;
+  constr.joint_constraints.resize(1);
+  constr.joint_constraints[0].joint_name = "head_pan_joint";
+  constr.joint_constraints[0].position = 0.4;
+  constr.joint_constraints[0].tolerance_above = 0.1;
+  constr.joint_constraints[0].tolerance_below = 0.05;
+  constr.joint_constraints[0].weight = 1.0;
+
+  constr.orientation_constraints.resize(1);
+  moveit_msgs::OrientationConstraint &ocm = constr.orientation_constraints[0];
+  ocm.link_name = "r_wrist_roll_link";
+  ocm.header.frame_id = kmodel->getModelFrame();
+  geometry_msgs::Pose p;
+  tf::poseEigenToMsg(ks.getGlobalLinkTransform(ocm.link_name), p);
+  ocm.orientation = p.orientation;
+  ocm.absolute_x_axis_tolerance = 0.1;
+  ocm.absolute_y_axis_tolerance = 0.1;
+  ocm.absolute_z_axis_tolerance = 0.1;
+  ocm.weight = 1.0;
+
+  constr.position_constraints.resize(1);
+  moveit_msgs::PositionConstraint &pcm = constr.position_constraints[0];
+  pcm.link_name = "l_wrist_roll_link";
+  pcm.header.frame_id = kmodel->getModelFrame();
+  pcm.constraint_region.primitives.resize(1);
+  pcm.constraint_region.primitives[0].type = shape_msgs::SolidPrimitive::SPHERE;
+  pcm.constraint_region.primitives[0].dimensions.resize(1, 0.2);
+  pcm.constraint_region.primitive_poses.resize(1);
+  tf::poseEigenToMsg(ks.getGlobalLinkTransform(pcm.link_name), pcm.constraint_region.primitive_poses[0]);
+  pcm.weight = 1.0;
+
+  kinematic_constraints::KinematicConstraintSet kcs(kmodel);
+  EXPECT_TRUE(kcs.add(constr, tf));
+
+  kinematic_constraints::ConstraintEvaluationContext context;
+  EXPECT_FALSE(kcs.decide(ks, context).satisfied);
+  EXPECT_EQ(context.getEvaluatedCount(), 3u);
+
+  // nothing changed
+  EXPECT_FALSE(kcs.decide(ks, context).satisfied);
+  EXPECT_EQ(context.getEvaluatedCount(), 0u);
+
+  // only the joint constraint depends on the head
+  std::map<std::string, double> jvals;
+  jvals["head_pan_joint"] = 0.4;
+  ks.setVariablePositions(jvals);
+  ks.update();
+  EXPECT_TRUE(kcs.decide(ks, context).satisfied);
+  EXPECT_EQ(context.getEvaluatedCount(), 1u);
+
+  // only the position constraint depends on the left arm
+  jvals["l_shoulder_pan_joint"] = 0.5;
+  ks.setVariablePositions(jvals);
+  ks.update();
+  kinematic_constraints::ConstraintEvaluationResult r = kcs.decide(ks, context);
+  EXPECT_EQ(context.getEvaluatedCount(), 1u);
+  EXPECT_FALSE(r.satisfied);
+  EXPECT_EQ(kcs.decide(ks).satisfied, r.satisfied);
+  EXPECT_NEAR(kcs.decide(ks).distance, r.distance, 1e-12);
+
+  // the torso moves both wrists
+  jvals["torso_lift_joint"] = 0.1;
+  ks.setVariablePositions(jvals);
+  ks.update();
+  kcs.decide(ks, context);
+  EXPECT_EQ(context.getEvaluatedCount(), 2u);
+
+  // modifying the set invalidates the context
+  kcs.add(constr.joint_constraints);
+  kcs.decide(ks, context);
+  EXPECT_EQ(context.getEvaluatedCount(), 4u);
+}
+
+TEST_F(LoadPlanningModelsPr2, TestKinematicConstraintSetProject)
+{
+  robot_state::RobotState ks(kmodel);
+  ks.setToDefaultValues();
+  ks.update();
+  robot_state::Transforms tf(kmodel->getModelFrame());
+  const robot_model::JointModelGroup *jmg = kmodel->getJointModelGroup("right_arm");
+
+  // the targets are taken from a different configuration of the arm
+  robot_state::RobotState goal(ks);
+  std::map<std::string, double> jvals;
+  jvals["r_shoulder_pan_joint"] = -0.3;
+  jvals["r_shoulder_lift_joint"] = 0.2;
+  jvals["r_elbow_flex_joint"] = -0.6;
+  goal.setVariablePositions(jvals);
+  goal.update();
+
+  moveit_msgs::Constraints constr;
+  constr.joint_constraints.resize(1);
+  constr.joint_constraints[0].joint_name = "r_wrist_flex_joint";
+  constr.joint_constraints[0].position = -0.5;
+  constr.joint_constraints[0].tolerance_above = 0.05;
+  constr.joint_constraints[0].tolerance_below = 0.05;
+  constr.joint_constraints[0].weight = 1.0;
+
+  constr.position_constraints.resize(1);
+  moveit_msgs::PositionConstraint &pcm = constr.position_constraints[0];
+  pcm.link_name = "r_wrist_roll_link";
+  pcm.header.frame_id = kmodel->getModelFrame();
+  pcm.constraint_region.primitives.resize(1);
+  pcm.constraint_region.primitives[0].type = shape_msgs::SolidPrimitive::SPHERE;
+  pcm.constraint_region.primitives[0].dimensions.resize(1, 0.02);
+  pcm.constraint_region.primitive_poses.resize(1);
+  tf::poseEigenToMsg(goal.getGlobalLinkTransform(pcm.link_name), pcm.constraint_region.primitive_poses[0]);
+  pcm.weight = 1.0;
+
+  kinematic_constraints::KinematicConstraintSet kcs(kmodel);
+  EXPECT_TRUE(kcs.add(constr, tf));
+  EXPECT_FALSE(kcs.decide(ks).satisfied);
+
+  // the position constraint gradient matches finite differences
+  kinematic_constraints::PositionConstraint pc(kmodel);
+  EXPECT_TRUE(pc.configure(pcm, tf));
+  Eigen::VectorXd gradient;
+  ASSERT_TRUE(pc.computeDistanceGradient(ks, jmg, gradient));
+  ASSERT_EQ(gradient.size(), (int)jmg->getVariableCount());
+  Eigen::VectorXd values;
+  ks.copyJointGroupPositions(jmg, values);
+  double d0 = pc.decide(ks).distance;
+  for (std::size_t i = 0 ; i < jmg->getVariableCount() ; ++i)
+  {
+    robot_state::RobotState moved(ks);
+    Eigen::VectorXd v = values;
+    v(i) += 1e-6;
+    moved.setJointGroupPositions(jmg, v);
+    moved.update();
+    EXPECT_NEAR(gradient(i), (pc.decide(moved).distance - d0) / 1e-6, 1e-4);
+  }
+
+  EXPECT_TRUE(kcs.project(ks, jmg, 20));
+  EXPECT_TRUE(kcs.decide(ks).satisfied);
+}
+
 TEST_F(LoadPlanningModelsPr2, TestKinematicConstraintSetEquality)
 {
   robot_state::RobotState ks(kmodel);
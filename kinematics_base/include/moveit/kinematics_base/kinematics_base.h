@@ -54,12 +54,17 @@ struct KinematicsQueryOptions
 {
   KinematicsQueryOptions() :
     lock_redundant_joints(false),
-    return_approximate_solution(false)
+    return_approximate_solution(false),
+    cancel(NULL)
   {
   }
 
   bool lock_redundant_joints;
   bool return_approximate_solution;
+
+  /** \brief If not NULL, the query is no longer needed once the pointed value becomes true
+      (e.g., another thread found a solution); solvers that check it may stop searching early */
+  const volatile bool *cancel;
 };
 
 
@@ -178,6 +183,25 @@ public:
                                 moveit_msgs::MoveItErrorCodes &error_code,
                                 const kinematics::KinematicsQueryOptions &options = kinematics::KinematicsQueryOptions()) const = 0;
 
+  /**
+   * @brief Search for joint angles that reach each of a set of poses, starting from the same seed.
+   * This is intended for evaluating many candidate poses at once (e.g., grasp poses). The default
+   * implementation calls searchPositionIK() for each pose; solvers can override it to share work
+   * between the poses or to solve them in parallel.
+   * @param ik_poses the desired poses of the link
+   * @param ik_seed_state an initial guess solution for the inverse kinematics, used for every pose
+   * @param timeout The amount of time (in seconds) available to the solver for each pose
+   * @param solutions one solution vector per pose; the vector is empty for poses that were not solved
+   * @param error_codes one error code per pose, encoding the reason for failure or success
+   * @return True if a valid solution was found for every pose, false otherwise
+   */
+  virtual bool searchPositionIKBatch(const std::vector<geometry_msgs::Pose> &ik_poses,
+                                     const std::vector<double> &ik_seed_state,
+                                     double timeout,
+                                     std::vector<std::vector<double> > &solutions,
+                                     std::vector<moveit_msgs::MoveItErrorCodes> &error_codes,
+                                     const kinematics::KinematicsQueryOptions &options = kinematics::KinematicsQueryOptions()) const;
+
   /**
    * @brief Given a set of joint angles and a set of links, compute their pose
    * @param link_names A set of links for which FK needs to be computed
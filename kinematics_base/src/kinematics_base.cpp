@@ -79,6 +79,35 @@ bool kinematics::KinematicsBase::setRedundantJoints(const std::vector<std::strin
   return redundant_joint_indices.size() == redundant_joint_names.size() ? setRedundantJoints(redundant_joint_indices) : false;
 }
 
+bool kinematics::KinematicsBase::searchPositionIKBatch(const std::vector<geometry_msgs::Pose> &ik_poses,
+                                                      const std::vector<double> &ik_seed_state,
+                                                      double timeout,
+                                                      std::vector<std::vector<double> > &solutions,
+                                                      std::vector<moveit_msgs::MoveItErrorCodes> &error_codes,
+                                                      const kinematics::KinematicsQueryOptions &options) const
+{
+  solutions.resize(ik_poses.size());
+  error_codes.resize(ik_poses.size());
+  bool result = true;
+  for (std::size_t i = 0 ; i < ik_poses.size() ; ++i)
+  {
+    // poses left when the query is cancelled are reported as not solved in time
+    if (options.cancel && *options.cancel)
+    {
+      solutions[i].clear();
+      error_codes[i].val = moveit_msgs::MoveItErrorCodes::TIMED_OUT;
+      result = false;
+    }
+    else
+      if (!searchPositionIK(ik_poses[i], ik_seed_state, timeout, solutions[i], error_codes[i], options))
+      {
+        solutions[i].clear();
+        result = false;
+      }
+  }
+  return result;
+}
+
 std::string kinematics::KinematicsBase::removeSlash(const std::string &str) const
 {
   return (!str.empty() && str[0] == '/') ? removeSlash(str.substr(1)) : str;
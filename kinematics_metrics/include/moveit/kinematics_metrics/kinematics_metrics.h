@@ -136,6 +136,41 @@ public:
                          double &condition_number,
                          bool translation = false) const;
 
+  /**
+   * @brief Get the manipulability index (as computed by getManipulabilityIndex())
+   * for a chain group at each of a set of states, e.g., to rank IK solutions.
+   * The Jacobian is computed in a preallocated workspace and the index from the
+   * determinant of the fixed size matrix JJ^T, so no memory is allocated per state.
+   * The link transforms of the states must be up to date.
+   * @param states The states to evaluate
+   * @param joint_model_group A pointer to the desired joint model group (must be a chain)
+   * @param manipulability_indices The computed manipulability index for each state
+   * @param threads The number of threads (of the shared moveit::tools::ThreadPool) the states are split across
+   * @return False if the Jacobian cannot be computed for the group
+   */
+  bool getManipulabilityIndices(const std::vector<const robot_state::RobotState*> &states,
+                                const robot_model::JointModelGroup *joint_model_group,
+                                std::vector<double> &manipulability_indices,
+                                bool translation = false,
+                                unsigned int threads = 1) const;
+
+  /**
+   * @brief Get the manipulability (as computed by getManipulability()) for a chain
+   * group at each of a set of states. The Jacobian and the SVD are computed in
+   * workspaces allocated once for all the states. The link transforms of the
+   * states must be up to date.
+   * @param states The states to evaluate
+   * @param joint_model_group A pointer to the desired joint model group (must be a chain)
+   * @param manipulabilities The computed manipulability for each state
+   * @param threads The number of threads (of the shared moveit::tools::ThreadPool) the states are split across
+   * @return False if the Jacobian cannot be computed for the group
+   */
+  bool getManipulabilities(const std::vector<const robot_state::RobotState*> &states,
+                           const robot_model::JointModelGroup *joint_model_group,
+                           std::vector<double> &manipulabilities,
+                           bool translation = false,
+                           unsigned int threads = 1) const;
+
   void setPenaltyMultiplier(double multiplier)
   {
     penalty_multiplier_ = fabs(multiplier);
@@ -164,6 +199,17 @@ private:
    */
   double getJointLimitsPenalty(const robot_state::RobotState &state, const robot_model::JointModelGroup *joint_model_group) const;
 
+  bool computeBatch(const std::vector<const robot_state::RobotState*> &states,
+                    const robot_model::JointModelGroup *joint_model_group,
+                    std::vector<double> &values, bool index, bool translation, unsigned int threads) const;
+
+  /** \brief Compute the manipulability index (or the manipulability if \e index is false) of states[begin, end),
+      using a copy of \e workspace */
+  void computeBatchRange(const std::vector<const robot_state::RobotState*> *states,
+                         const robot_state::JacobianWorkspace<> *workspace,
+                         bool index, bool translation, std::size_t begin, std::size_t end,
+                         std::vector<double> *values) const;
+
   double penalty_multiplier_;
 
 };
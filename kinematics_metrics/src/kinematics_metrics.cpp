@@ -35,8 +35,11 @@
 /* Author: Sachin Chitta */
 
 #include <moveit/kinematics_metrics/kinematics_metrics.h>
+#include <moveit/robot_state/jacobian_workspace.h>
+#include <moveit/background_processing/thread_pool.h>
 #include <Eigen/Eigenvalues>
 #include <boost/math/constants/constants.hpp>
+#include <boost/bind.hpp>
 
 namespace kinematics_metrics
 {
@@ -187,4 +190,82 @@ bool KinematicsMetrics::getManipulability(const robot_state::RobotState &state,
   return true;
 }
 
+bool KinematicsMetrics::getManipulabilityIndices(const std::vector<const robot_state::RobotState*> &states,
+                                                 const robot_model::JointModelGroup *joint_model_group,
+                                                 std::vector<double> &manipulability_indices,
+                                                 bool translation,
+                                                 unsigned int threads) const
+{
+  return computeBatch(states, joint_model_group, manipulability_indices, true, translation, threads);
+}
+
+bool KinematicsMetrics::getManipulabilities(const std::vector<const robot_state::RobotState*> &states,
+                                            const robot_model::JointModelGroup *joint_model_group,
+                                            std::vector<double> &manipulabilities,
+                                            bool translation,
+                                            unsigned int threads) const
+{
+  return computeBatch(states, joint_model_group, manipulabilities, false, translation, threads);
+}
+
+bool KinematicsMetrics::computeBatch(const std::vector<const robot_state::RobotState*> &states,
+                                     const robot_model::JointModelGroup *joint_model_group,
+                                     std::vector<double> &values, bool index, bool translation, unsigned int threads) const
+{
+  robot_state::JacobianWorkspace<> workspace;
+  if (!workspace.configure(joint_model_group))
+    return false;
+  values.resize(states.size());
+
+  // ranges of at least states.size() / threads states, so at most that many threads of the shared pool work at a time
+  moveit::tools::ThreadPool &pool = moveit::tools::ThreadPool::Instance();
+  std::size_t count = std::max<std::size_t>(1, std::min<std::size_t>(std::min(threads, pool.getThreadCount()), states.size()));
+  std::size_t range = (states.size() + count - 1) / count;
+  if (count == 1)
+    computeBatchRange(&states, &workspace, index, translation, 0, states.size(), &values);
+  else
+    pool.parallelForRange(0, states.size(), boost::bind(&KinematicsMetrics::computeBatchRange, this, &states, &workspace, index, translation,
+                                                        _1, _2, &values), range);
+  return true;
+}
+
+void KinematicsMetrics::computeBatchRange(const std::vector<const robot_state::RobotState*> *states,
+                                          const robot_state::JacobianWorkspace<> *workspace,
+                                          bool index, bool translation, std::size_t begin, std::size_t end,
+                                          std::vector<double> *values) const
+{
+  robot_state::JacobianWorkspace<> local_workspace(*workspace);
+  const int rows = translation ? 3 : 6;
+  Eigen::MatrixXd jacobian(rows, local_workspace.getJacobian().cols());
+  Eigen::JacobiSVD<Eigen::MatrixXd> svdsolver(rows, jacobian.cols());
+
+  for (std::size_t i = begin ; i < end ; ++i)
+  {
+    const robot_state::RobotState &state = *(*states)[i];
+    state.getJacobian(local_workspace);
+    const robot_state::JacobianWorkspace<>::Jacobian &j = local_workspace.getJacobian();
+    const double penalty = getJointLimitsPenalty(state, local_workspace.getGroup());
+    if (index)
+    {
+      if (translation)
+      {
+        Eigen::Matrix3d matrix = j.topRows<3>() * j.topRows<3>().transpose();
+        (*values)[i] = penalty * sqrt(matrix.determinant());
+      }
+      else
+      {
+        Eigen::Matrix<double, 6, 6> matrix = j * j.transpose();
+        (*values)[i] = penalty * sqrt(matrix.determinant());
+      }
+    }
+    else
+    {
+      jacobian = j.topRows(rows);
+      svdsolver.compute(jacobian);
+      const Eigen::VectorXd &singular_values = svdsolver.singularValues();
+      (*values)[i] = penalty * singular_values.minCoeff()/singular_values.maxCoeff();
+    }
+  }
+}
+
 } // namespace
@@ -0,0 +1,112 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2013, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#ifndef MOVEIT_PLANNING_INTERFACE_ASYNC_PLANNING_
+#define MOVEIT_PLANNING_INTERFACE_ASYNC_PLANNING_
+
+#include <moveit/planning_interface/planning_interface.h>
+#include <boost/thread.hpp>
+
+namespace planning_interface
+{
+
+MOVEIT_CLASS_FORWARD(PlanningJob);
+
+/** \brief A handle to a planning context that is solving in a background thread (see solveAsync()).
+
+    The solutions the context reports while it is running (see PlanningContext::setSolutionCallback()) are kept and
+    passed on to the callback of the job, so execution can start on the first feasible plan while the planner
+    keeps optimizing. If the context does not report any solution, its final solution is passed to the callback
+    when solve() returns. The callback is called from the planning thread.
+
+    The solution callback of the context is replaced while the job runs. Destroying the job terminates the
+    computation and waits for the planning thread to finish. */
+class PlanningJob
+{
+public:
+
+  /** \brief Start solving \e context in a new thread, passing each improved solution to \e callback */
+  PlanningJob(const PlanningContextPtr &context, const PlanningContext::SolutionCallbackFn &callback = PlanningContext::SolutionCallbackFn());
+
+  ~PlanningJob();
+
+  const PlanningContextPtr& getContext() const
+  {
+    return context_;
+  }
+
+  /** \brief Check if solve() has returned */
+  bool isDone() const;
+
+  /** \brief Wait until solve() returns, for at most \e timeout seconds (forever if \e timeout is negative).
+      Return true if solve() has returned */
+  bool wait(double timeout = -1.0) const;
+
+  /** \brief Ask the context to stop (see PlanningContext::terminate()); the best solution found so far is kept */
+  bool cancel();
+
+  /** \brief Check if a solution (intermediate or final) is available */
+  bool hasSolution() const;
+
+  /** \brief Copy the latest solution to \e res. Return false if there is none yet */
+  bool getLatestSolution(MotionPlanDetailedResponse &res) const;
+
+  /** \brief Wait for solve() to return and copy its response to \e res. Return the value returned by solve() */
+  bool getResponse(MotionPlanDetailedResponse &res) const;
+
+private:
+
+  void run();
+  void solutionFound(const MotionPlanDetailedResponse &res);
+
+  PlanningContextPtr                       context_;
+  PlanningContext::SolutionCallbackFn      callback_;
+
+  mutable boost::mutex                     lock_;
+  mutable boost::condition_variable        done_condition_;
+  bool                                     done_;
+  bool                                     solved_;
+  bool                                     has_solution_;
+  MotionPlanDetailedResponse               response_;
+  MotionPlanDetailedResponse               latest_solution_;
+  boost::thread                            thread_;
+};
+
+/** \brief Solve \e context in the background; \e callback receives the solutions found while planning */
+PlanningJobPtr solveAsync(const PlanningContextPtr &context,
+                          const PlanningContext::SolutionCallbackFn &callback = PlanningContext::SolutionCallbackFn());
+
+}
+
+#endif
@@ -40,7 +40,10 @@
 #include <moveit/macros/class_forward.h>
 #include <moveit/planning_interface/planning_request.h>
 #include <moveit/planning_interface/planning_response.h>
+#include <boost/function.hpp>
+#include <boost/thread/mutex.hpp>
 #include <string>
+#include <vector>
 #include <map>
 
 namespace planning_scene
@@ -79,6 +82,9 @@ class PlanningContext
 {
 public:
 
+  /** \brief Function type for receiving the solutions a context finds while solve() is still running */
+  typedef boost::function<void(const MotionPlanDetailedResponse&)> SolutionCallbackFn;
+
   /** \brief Construct a planning context named \e name for the group \e group */
   PlanningContext(const std::string &name, const std::string &group);
 
@@ -120,14 +126,36 @@ public:
   /** \brief Solve the motion planning problem and store the detailed result in \e res. This function should not clear data structures before computing. The constructor and clear() do that. */
   virtual bool solve(MotionPlanDetailedResponse &res) = 0;
 
+  /** \brief Set a function to be called from within solve(), from the thread running solve(), each time a better
+      solution is found before solve() returns (e.g., by anytime or portfolio planners). Contexts that do not support
+      this never call it; the final result is always the one returned by solve(). Set this before calling solve(). */
+  void setSolutionCallback(const SolutionCallbackFn &callback)
+  {
+    solution_callback_ = callback;
+  }
+
+  const SolutionCallbackFn& getSolutionCallback() const
+  {
+    return solution_callback_;
+  }
+
   /** \brief If solve() is running, terminate the computation. Return false if termination not possible. No-op if solve() is not running (returns true).*/
   virtual bool terminate() = 0;
 
-  /** \brief Clear the data structures used by the planner */
+  /** \brief Clear the data structures used by the planner. When contexts are reused (see PlannerManager::acquirePlanningContext()),
+      this is called between requests, so implementations should reset the planner state but keep allocated memory
+      (state spaces, samplers, nearest-neighbor structures) where possible. */
   virtual void clear() = 0;
 
 protected:
 
+  /** \brief Pass an improved solution to the solution callback, if one is set. Implementations call this from solve() */
+  void reportSolution(const MotionPlanDetailedResponse &res) const
+  {
+    if (solution_callback_)
+      solution_callback_(res);
+  }
+
   /// The name of this planning context
   std::string name_;
 
@@ -139,6 +167,9 @@ protected:
 
   /// The planning request for this context
   MotionPlanRequest request_;
+
+  /// The function intermediate solutions are reported to
+  SolutionCallbackFn solution_callback_;
 };
 
 MOVEIT_CLASS_FORWARD(PlanningContext);
@@ -148,7 +179,7 @@ class PlannerManager
 {
 public:
 
-  PlannerManager()
+  PlannerManager() : context_pool_size_(2)
   {
   }
 
@@ -180,6 +211,39 @@ public:
   PlanningContextPtr getPlanningContext(const planning_scene::PlanningSceneConstPtr& planning_scene,
                                         const MotionPlanRequest &req) const;
 
+  /// \brief Construct a context that runs one planning context per entry of \e configurations concurrently (see PortfolioPlanningContext).
+  /// Each entry is the name of a planner configuration (as in getPlannerConfigurations()) and is used as the planner_id of the request
+  /// passed to getPlanningContext(). If \e configurations is empty, all the configurations for the group of \e req are used.
+  /// Configurations for which no context can be built are skipped; an empty ptr is returned if no context can be built at all.
+  PlanningContextPtr getPortfolioPlanningContext(const planning_scene::PlanningSceneConstPtr& planning_scene,
+                                                 const MotionPlanRequest &req,
+                                                 const std::vector<std::string> &configurations,
+                                                 moveit_msgs::MoveItErrorCodes &error_code) const;
+
+  /// \brief Get a planning context for a request, reusing a context previously passed to releasePlanningContext() if possible.
+  /// Released contexts for the group of \e req are offered to reusePlanningContext(); if none is accepted, getPlanningContext() is called.
+  /// If the plugin does not support reuse (see canReusePlanningContexts()), this is the same as getPlanningContext().
+  PlanningContextPtr acquirePlanningContext(const planning_scene::PlanningSceneConstPtr& planning_scene,
+                                            const MotionPlanRequest &req,
+                                            moveit_msgs::MoveItErrorCodes &error_code) const;
+
+  /// \brief Return a context obtained from acquirePlanningContext() once solve() has finished. The context is cleared and kept
+  /// for later requests for the same group; the caller should not use it afterwards. At most getPlanningContextPoolSize()
+  /// contexts are kept per group; the others are destroyed.
+  void releasePlanningContext(const PlanningContextPtr &context) const;
+
+  /// \brief Destroy all the contexts kept for reuse
+  void clearPlanningContextPool() const;
+
+  /// \brief Set the maximum number of released contexts kept for each group (default is 2)
+  void setPlanningContextPoolSize(std::size_t size);
+
+  /// \brief Get the maximum number of released contexts kept for each group
+  std::size_t getPlanningContextPoolSize() const
+  {
+    return context_pool_size_;
+  }
+
   /// \brief Determine whether this plugin instance is able to represent this planning request
   virtual bool canServiceRequest(const MotionPlanRequest &req)  const = 0;
 
@@ -197,12 +261,32 @@ public:
 
 protected:
 
+  /// \brief Return true if the contexts built by this plugin can be reconfigured for new requests by reusePlanningContext().
+  /// The default is false; plugins that opt in get their released contexts pooled.
+  virtual bool canReusePlanningContexts() const;
+
+  /// \brief Prepare a released (and cleared) \e context for solving \e req. Return false if the context cannot be used for \e req,
+  /// in which case another context is tried or a new one is constructed. The default implementation accepts contexts for the
+  /// group of the request and only sets the planning scene and the request; plugins that configure contexts further
+  /// in getPlanningContext() (e.g., goals, planner selection) should override this.
+  virtual bool reusePlanningContext(const PlanningContextPtr &context,
+                                    const planning_scene::PlanningSceneConstPtr& planning_scene,
+                                    const MotionPlanRequest &req,
+                                    moveit_msgs::MoveItErrorCodes &error_code) const;
+
   /** \brief All the existing planning configurations. The name
       of the configuration is the key of the map. This name can
       be of the form "group_name[config_name]" if there are
       particular configurations specified for a group, or of the
       form "group_name" if default settings are to be used. */
   PlannerConfigurationMap config_settings_;
+
+private:
+
+  /// The released contexts, by group name
+  mutable std::map<std::string, std::vector<PlanningContextPtr> > context_pool_;
+  mutable boost::mutex context_pool_lock_;
+  std::size_t context_pool_size_;
 };
 
 MOVEIT_CLASS_FORWARD(PlannerManager);
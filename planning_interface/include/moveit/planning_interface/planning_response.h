@@ -37,36 +37,104 @@
 #ifndef MOVEIT_PLANNING_INTERFACE_PLANNING_RESPONSE_
 #define MOVEIT_PLANNING_INTERFACE_PLANNING_RESPONSE_
 
+#include <moveit/macros/class_forward.h>
 #include <moveit/robot_trajectory/robot_trajectory.h>
 #include <moveit_msgs/MoveItErrorCodes.h>
 #include <moveit_msgs/MotionPlanResponse.h>
 #include <moveit_msgs/MotionPlanDetailedResponse.h>
+#include <boost/thread/mutex.hpp>
 
 namespace planning_interface
 {
 
+MOVEIT_CLASS_FORWARD(TrajectoryMessageCache);
+
+/** \brief The message form of trajectories, computed the first time it is requested for each trajectory.
+
+    Plans are usually passed through several layers, each of which may need the message form. A response and its
+    copies share one cache, so each trajectory is converted at most once. Trajectories are considered
+    immutable once converted; code that modifies a trajectory in place after that must call clear(). */
+class TrajectoryMessageCache
+{
+public:
+
+  TrajectoryMessageCache() : conversions_(0)
+  {
+  }
+
+  /** \brief Get the start state and the message for \e trajectory, converting the trajectory if needed */
+  void getMessage(const robot_trajectory::RobotTrajectoryPtr &trajectory, moveit_msgs::RobotState &start, moveit_msgs::RobotTrajectory &msg);
+
+  /** \brief Forget all converted trajectories */
+  void clear();
+
+  /** \brief Get the number of conversions performed so far */
+  std::size_t getConversionCount() const;
+
+private:
+
+  struct Entry
+  {
+    /// the converted trajectory; keeping it alive means its address cannot be reused by another trajectory
+    robot_trajectory::RobotTrajectoryPtr trajectory_;
+    moveit_msgs::RobotState              start_;
+    moveit_msgs::RobotTrajectory         message_;
+  };
+
+  std::vector<Entry>   entries_;
+  std::size_t          conversions_;
+  mutable boost::mutex lock_;
+};
+
 struct MotionPlanResponse
 {
   MotionPlanResponse() :
-    planning_time_(0.0)
+    planning_time_(0.0),
+    message_cache_(new TrajectoryMessageCache())
   {
   }
 
+  /** \brief Fill \e msg; the trajectory is converted only the first time (see TrajectoryMessageCache) */
   void getMessage(moveit_msgs::MotionPlanResponse &msg) const;
 
+  /** \brief Exchange the contents of this response with \e other, without copying (e.g., to pass a result on) */
+  void swap(MotionPlanResponse &other);
+
   robot_trajectory::RobotTrajectoryPtr trajectory_;
   double planning_time_;
   moveit_msgs::MoveItErrorCodes error_code_;
+
+  /// The message form of the trajectory, shared with the copies of this response
+  TrajectoryMessageCachePtr message_cache_;
 };
 
 struct MotionPlanDetailedResponse
 {
+  MotionPlanDetailedResponse() :
+    message_cache_(new TrajectoryMessageCache())
+  {
+  }
+
+  /** \brief Fill \e msg; each trajectory is converted only the first time (see TrajectoryMessageCache) */
   void getMessage(moveit_msgs::MotionPlanDetailedResponse &msg) const;
 
+  /** \brief Exchange the contents of this response with \e other, without copying (e.g., to pass a result on) */
+  void swap(MotionPlanDetailedResponse &other);
+
   std::vector<robot_trajectory::RobotTrajectoryPtr> trajectory_;
   std::vector<std::string> description_;
   std::vector<double> processing_time_;
+
+  /// Optional, parallel to processing_time_: the CPU time of each processing step
+  std::vector<double> cpu_time_;
+
+  /// Optional, parallel to processing_time_: the net change in allocated heap memory (bytes) during each processing step
+  std::vector<long> memory_change_;
+
   moveit_msgs::MoveItErrorCodes error_code_;
+
+  /// The message form of the trajectories, shared with the copies of this response
+  TrajectoryMessageCachePtr message_cache_;
 };
 
 } // planning_interface
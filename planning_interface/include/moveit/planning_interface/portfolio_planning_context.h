@@ -0,0 +1,105 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2013, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#ifndef MOVEIT_PLANNING_INTERFACE_PORTFOLIO_PLANNING_CONTEXT_
+#define MOVEIT_PLANNING_INTERFACE_PORTFOLIO_PLANNING_CONTEXT_
+
+#include <moveit/planning_interface/planning_interface.h>
+#include <vector>
+
+namespace planning_interface
+{
+
+/** \brief A planning context that runs several planning contexts concurrently on the same problem.
+
+    Planner performance on hard queries varies a lot between algorithms and random seeds; running a portfolio
+    of planners in parallel reduces the time until some solution is found. By default, the first solution found
+    is returned and the remaining contexts are terminated. Alternatively, all contexts can be run until they finish
+    or the allowed planning time expires, and the shortest solution (in configuration space) is returned.
+    If a solution callback is set, the solutions of the contexts (including the intermediate ones they report)
+    are passed on to it as they are found, whenever they are shorter than the ones passed on before.
+
+    The contexts run on the threads of the shared moveit::tools::ThreadPool, while the calling thread waits for them;
+    if there are more contexts than threads, the remaining ones start as others finish, until the allowed planning
+    time expires. */
+class PortfolioPlanningContext : public PlanningContext
+{
+public:
+
+  /** \brief Construct a portfolio named \e name for group \e group, from already configured \e contexts */
+  PortfolioPlanningContext(const std::string &name, const std::string &group, const std::vector<PlanningContextPtr> &contexts);
+
+  virtual ~PortfolioPlanningContext();
+
+  /** \brief Get the contexts that are run in parallel */
+  const std::vector<PlanningContextPtr>& getContexts() const
+  {
+    return contexts_;
+  }
+
+  /** \brief If \e flag is true (default), return as soon as one context finds a solution. Otherwise, wait for all contexts
+      (up to the allowed planning time of the request) and return the shortest solution. */
+  void setReturnFirstSolution(bool flag)
+  {
+    return_first_solution_ = flag;
+  }
+
+  bool getReturnFirstSolution() const
+  {
+    return return_first_solution_;
+  }
+
+  /** \brief Get the index (in getContexts()) of the context whose solution was returned by the last call to solve(), or -1 */
+  int getLastSolvingContext() const
+  {
+    return last_solving_context_;
+  }
+
+  virtual bool solve(MotionPlanResponse &res);
+  virtual bool solve(MotionPlanDetailedResponse &res);
+  virtual bool terminate();
+  virtual void clear();
+
+private:
+
+  std::vector<PlanningContextPtr> contexts_;
+  bool return_first_solution_;
+  int last_solving_context_;
+};
+
+MOVEIT_CLASS_FORWARD(PortfolioPlanningContext);
+
+}
+
+#endif
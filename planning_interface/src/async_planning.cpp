@@ -0,0 +1,152 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2013, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#include <moveit/planning_interface/async_planning.h>
+#include <boost/bind.hpp>
+
+planning_interface::PlanningJob::PlanningJob(const PlanningContextPtr &context, const PlanningContext::SolutionCallbackFn &callback) :
+  context_(context),
+  callback_(callback),
+  done_(false),
+  solved_(false),
+  has_solution_(false),
+  thread_(boost::bind(&PlanningJob::run, this))
+{
+}
+
+planning_interface::PlanningJob::~PlanningJob()
+{
+  if (!isDone())
+    context_->terminate();
+  thread_.join();
+}
+
+void planning_interface::PlanningJob::run()
+{
+  context_->setSolutionCallback(boost::bind(&PlanningJob::solutionFound, this, _1));
+  MotionPlanDetailedResponse res;
+  bool solved = context_->solve(res);
+  context_->setSolutionCallback(PlanningContext::SolutionCallbackFn());
+
+  // contexts that do not report intermediate solutions still report their final one
+  bool report = false;
+  {
+    boost::mutex::scoped_lock slock(lock_);
+    solved_ = solved;
+    if (solved && !has_solution_)
+    {
+      latest_solution_ = res;
+      has_solution_ = true;
+      report = true;
+    }
+    response_.swap(res);
+  }
+  if (report && callback_)
+    callback_(response_);
+
+  {
+    boost::mutex::scoped_lock slock(lock_);
+    done_ = true;
+  }
+  done_condition_.notify_all();
+}
+
+void planning_interface::PlanningJob::solutionFound(const MotionPlanDetailedResponse &res)
+{
+  {
+    boost::mutex::scoped_lock slock(lock_);
+    latest_solution_ = res;
+    has_solution_ = true;
+  }
+  if (callback_)
+    callback_(res);
+}
+
+bool planning_interface::PlanningJob::isDone() const
+{
+  boost::mutex::scoped_lock slock(lock_);
+  return done_;
+}
+
+bool planning_interface::PlanningJob::wait(double timeout) const
+{
+  boost::mutex::scoped_lock slock(lock_);
+  if (timeout < 0.0)
+  {
+    while (!done_)
+      done_condition_.wait(slock);
+    return true;
+  }
+  boost::system_time deadline = boost::get_system_time() + boost::posix_time::microseconds((long)(timeout * 1000000.0));
+  while (!done_)
+    if (!done_condition_.timed_wait(slock, deadline))
+      break;
+  return done_;
+}
+
+bool planning_interface::PlanningJob::cancel()
+{
+  return context_->terminate();
+}
+
+bool planning_interface::PlanningJob::hasSolution() const
+{
+  boost::mutex::scoped_lock slock(lock_);
+  return has_solution_;
+}
+
+bool planning_interface::PlanningJob::getLatestSolution(MotionPlanDetailedResponse &res) const
+{
+  boost::mutex::scoped_lock slock(lock_);
+  if (!has_solution_)
+    return false;
+  res = latest_solution_;
+  return true;
+}
+
+bool planning_interface::PlanningJob::getResponse(MotionPlanDetailedResponse &res) const
+{
+  wait();
+  boost::mutex::scoped_lock slock(lock_);
+  res = response_;
+  return solved_;
+}
+
+planning_interface::PlanningJobPtr planning_interface::solveAsync(const PlanningContextPtr &context,
+                                                                  const PlanningContext::SolutionCallbackFn &callback)
+{
+  if (!context)
+    return PlanningJobPtr();
+  return PlanningJobPtr(new PlanningJob(context, callback));
+}
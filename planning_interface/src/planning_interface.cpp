@@ -35,7 +35,9 @@
 /* Author: Ioan Sucan */
 
 #include <moveit/planning_interface/planning_interface.h>
+#include <moveit/planning_interface/portfolio_planning_context.h>
 #include <boost/thread/mutex.hpp>
+#include <algorithm>
 #include <set>
 
 namespace
@@ -105,6 +107,135 @@ planning_interface::PlanningContextPtr planning_interface::PlannerManager::getPl
   return getPlanningContext(planning_scene, req, dummy);
 }
 
+planning_interface::PlanningContextPtr planning_interface::PlannerManager::getPortfolioPlanningContext(const planning_scene::PlanningSceneConstPtr& planning_scene,
+                                                                                                       const MotionPlanRequest &req,
+                                                                                                       const std::vector<std::string> &configurations,
+                                                                                                       moveit_msgs::MoveItErrorCodes &error_code) const
+{
+  std::vector<std::string> names = configurations;
+  if (names.empty())
+    for (PlannerConfigurationMap::const_iterator it = config_settings_.begin() ; it != config_settings_.end() ; ++it)
+      if (it->second.group == req.group_name)
+        names.push_back(it->first);
+
+  std::vector<PlanningContextPtr> contexts;
+  for (std::size_t i = 0 ; i < names.size() ; ++i)
+  {
+    MotionPlanRequest r = req;
+    r.planner_id = names[i];
+    PlanningContextPtr context = getPlanningContext(planning_scene, r, error_code);
+    if (context)
+      contexts.push_back(context);
+    else
+      logWarn("Unable to construct a planning context for configuration '%s'; it is not added to the portfolio", names[i].c_str());
+  }
+  if (contexts.empty())
+  {
+    logError("No planning contexts could be constructed for the portfolio for group '%s'", req.group_name.c_str());
+    if (error_code.val == moveit_msgs::MoveItErrorCodes::SUCCESS)
+      error_code.val = moveit_msgs::MoveItErrorCodes::INVALID_GROUP_NAME;
+    return PlanningContextPtr();
+  }
+
+  PortfolioPlanningContextPtr portfolio(new PortfolioPlanningContext("portfolio", req.group_name, contexts));
+  portfolio->setPlanningScene(planning_scene);
+  portfolio->setMotionPlanRequest(req);
+  error_code.val = moveit_msgs::MoveItErrorCodes::SUCCESS;
+  return portfolio;
+}
+
+planning_interface::PlanningContextPtr planning_interface::PlannerManager::acquirePlanningContext(const planning_scene::PlanningSceneConstPtr& planning_scene,
+                                                                                                  const MotionPlanRequest &req,
+                                                                                                  moveit_msgs::MoveItErrorCodes &error_code) const
+{
+  if (canReusePlanningContexts())
+  {
+    std::vector<PlanningContextPtr> candidates;
+    {
+      boost::mutex::scoped_lock slock(context_pool_lock_);
+      std::map<std::string, std::vector<PlanningContextPtr> >::iterator it = context_pool_.find(req.group_name);
+      if (it != context_pool_.end())
+        candidates.swap(it->second);
+    }
+
+    // try the most recently released context first; it is the most likely to have warm data structures
+    PlanningContextPtr context;
+    while (!candidates.empty() && !context)
+    {
+      if (reusePlanningContext(candidates.back(), planning_scene, req, error_code))
+        context = candidates.back();
+      candidates.pop_back();
+    }
+
+    // contexts not used for this request remain available
+    if (!candidates.empty())
+    {
+      boost::mutex::scoped_lock slock(context_pool_lock_);
+      std::vector<PlanningContextPtr> &pool = context_pool_[req.group_name];
+      pool.insert(pool.begin(), candidates.begin(), candidates.end());
+      if (pool.size() > context_pool_size_)
+        pool.erase(pool.begin(), pool.begin() + (pool.size() - context_pool_size_));
+    }
+
+    if (context)
+    {
+      logDebug("Reusing planning context '%s' for group '%s'", context->getName().c_str(), req.group_name.c_str());
+      return context;
+    }
+  }
+  return getPlanningContext(planning_scene, req, error_code);
+}
+
+void planning_interface::PlannerManager::releasePlanningContext(const PlanningContextPtr &context) const
+{
+  if (!context || context_pool_size_ == 0 || !canReusePlanningContexts())
+    return;
+  context->clear();
+  // do not keep the scene alive while the context is idle
+  context->setPlanningScene(planning_scene::PlanningSceneConstPtr());
+
+  boost::mutex::scoped_lock slock(context_pool_lock_);
+  std::vector<PlanningContextPtr> &pool = context_pool_[context->getGroupName()];
+  if (std::find(pool.begin(), pool.end(), context) != pool.end())
+    return;
+  pool.push_back(context);
+  if (pool.size() > context_pool_size_)
+    pool.erase(pool.begin());
+}
+
+void planning_interface::PlannerManager::clearPlanningContextPool() const
+{
+  boost::mutex::scoped_lock slock(context_pool_lock_);
+  context_pool_.clear();
+}
+
+void planning_interface::PlannerManager::setPlanningContextPoolSize(std::size_t size)
+{
+  boost::mutex::scoped_lock slock(context_pool_lock_);
+  context_pool_size_ = size;
+  for (std::map<std::string, std::vector<PlanningContextPtr> >::iterator it = context_pool_.begin() ; it != context_pool_.end() ; ++it)
+    if (it->second.size() > size)
+      it->second.erase(it->second.begin(), it->second.begin() + (it->second.size() - size));
+}
+
+bool planning_interface::PlannerManager::canReusePlanningContexts() const
+{
+  return false;
+}
+
+bool planning_interface::PlannerManager::reusePlanningContext(const PlanningContextPtr &context,
+                                                              const planning_scene::PlanningSceneConstPtr& planning_scene,
+                                                              const MotionPlanRequest &req,
+                                                              moveit_msgs::MoveItErrorCodes &error_code) const
+{
+  if (context->getGroupName() != req.group_name)
+    return false;
+  context->setPlanningScene(planning_scene);
+  context->setMotionPlanRequest(req);
+  error_code.val = moveit_msgs::MoveItErrorCodes::SUCCESS;
+  return true;
+}
+
 void planning_interface::PlannerManager::getPlanningAlgorithms(std::vector<std::string> &algs) const
 {
   // nothing by default
@@ -36,6 +36,52 @@
 
 #include <moveit/planning_interface/planning_response.h>
 #include <moveit/robot_state/conversions.h>
+#include <algorithm>
+
+void planning_interface::TrajectoryMessageCache::getMessage(const robot_trajectory::RobotTrajectoryPtr &trajectory,
+                                                          moveit_msgs::RobotState &start, moveit_msgs::RobotTrajectory &msg)
+{
+  boost::mutex::scoped_lock slock(lock_);
+  for (std::size_t i = 0 ; i < entries_.size() ; ++i)
+    if (entries_[i].trajectory_ == trajectory)
+    {
+      start = entries_[i].start_;
+      msg = entries_[i].message_;
+      return;
+    }
+
+  // trajectories that are only referenced by the cache cannot be requested again
+  std::size_t kept = 0;
+  for (std::size_t i = 0 ; i < entries_.size() ; ++i)
+    if (!entries_[i].trajectory_.unique())
+    {
+      if (kept != i)
+        std::swap(entries_[kept], entries_[i]);
+      kept++;
+    }
+  entries_.resize(kept);
+
+  entries_.resize(entries_.size() + 1);
+  Entry &e = entries_.back();
+  e.trajectory_ = trajectory;
+  robot_state::robotStateToRobotStateMsg(trajectory->getFirstWayPoint(), e.start_);
+  trajectory->getRobotTrajectoryMsg(e.message_);
+  conversions_++;
+  start = e.start_;
+  msg = e.message_;
+}
+
+void planning_interface::TrajectoryMessageCache::clear()
+{
+  boost::mutex::scoped_lock slock(lock_);
+  entries_.clear();
+}
+
+std::size_t planning_interface::TrajectoryMessageCache::getConversionCount() const
+{
+  boost::mutex::scoped_lock slock(lock_);
+  return conversions_;
+}
 
 void planning_interface::MotionPlanResponse::getMessage(moveit_msgs::MotionPlanResponse &msg) const
 {
@@ -43,12 +89,19 @@ void planning_interface::MotionPlanResponse::getMessage(moveit_msgs::MotionPlanR
   msg.planning_time = planning_time_;
   if (trajectory_ && !trajectory_->empty())
   {
-    robot_state::robotStateToRobotStateMsg(trajectory_->getFirstWayPoint(), msg.trajectory_start);
-    trajectory_->getRobotTrajectoryMsg(msg.trajectory);
+    message_cache_->getMessage(trajectory_, msg.trajectory_start, msg.trajectory);
     msg.group_name = trajectory_->getGroupName();
   }
 }
 
+void planning_interface::MotionPlanResponse::swap(MotionPlanResponse &other)
+{
+  trajectory_.swap(other.trajectory_);
+  std::swap(planning_time_, other.planning_time_);
+  std::swap(error_code_, other.error_code_);
+  message_cache_.swap(other.message_cache_);
+}
+
 void planning_interface::MotionPlanDetailedResponse::getMessage(moveit_msgs::MotionPlanDetailedResponse &msg) const
 {
   msg.error_code = error_code_;
@@ -63,17 +116,29 @@ void planning_interface::MotionPlanDetailedResponse::getMessage(moveit_msgs::Mot
   {
     if (trajectory_[i]->empty())
       continue;
+    msg.trajectory.resize(msg.trajectory.size() + 1);
+    moveit_msgs::RobotState start;
+    message_cache_->getMessage(trajectory_[i], start, msg.trajectory.back());
     if (first)
     {
       first = false;
-      robot_state::robotStateToRobotStateMsg(trajectory_[i]->getFirstWayPoint(), msg.trajectory_start);
+      msg.trajectory_start = start;
       msg.group_name = trajectory_[i]->getGroupName();
     }
-    msg.trajectory.resize(msg.trajectory.size() + 1);
-    trajectory_[i]->getRobotTrajectoryMsg(msg.trajectory.back());
     if (description_.size() > i)
       msg.description.push_back(description_[i]);
     if (processing_time_.size() > i)
       msg.processing_time.push_back(processing_time_[i]);
   }
 }
+
+void planning_interface::MotionPlanDetailedResponse::swap(MotionPlanDetailedResponse &other)
+{
+  trajectory_.swap(other.trajectory_);
+  description_.swap(other.description_);
+  processing_time_.swap(other.processing_time_);
+  cpu_time_.swap(other.cpu_time_);
+  memory_change_.swap(other.memory_change_);
+  std::swap(error_code_, other.error_code_);
+  message_cache_.swap(other.message_cache_);
+}
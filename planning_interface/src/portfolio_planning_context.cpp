@@ -0,0 +1,311 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2013, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#include <moveit/planning_interface/portfolio_planning_context.h>
+#include <moveit/background_processing/thread_pool.h>
+#include <boost/thread.hpp>
+#include <boost/bind.hpp>
+#include <ros/time.h>
+#include <limits>
+
+namespace
+{
+
+double trajectoryLength(const robot_trajectory::RobotTrajectoryPtr &trajectory)
+{
+  if (!trajectory || trajectory->empty())
+    return std::numeric_limits<double>::infinity();
+  double length = 0.0;
+  for (std::size_t i = 1 ; i < trajectory->getWayPointCount() ; ++i)
+    length += trajectory->getWayPoint(i - 1).distance(trajectory->getWayPoint(i));
+  return length;
+}
+
+double solutionLength(const planning_interface::MotionPlanResponse &res)
+{
+  return trajectoryLength(res.trajectory_);
+}
+
+double solutionLength(const planning_interface::MotionPlanDetailedResponse &res)
+{
+  return res.trajectory_.empty() ? std::numeric_limits<double>::infinity() : trajectoryLength(res.trajectory_.back());
+}
+
+// report the error of the first context that set one
+template<typename Response>
+moveit_msgs::MoveItErrorCodes getFailureCode(const std::vector<Response> &responses)
+{
+  for (std::size_t i = 0 ; i < responses.size() ; ++i)
+    if (responses[i].error_code_.val != moveit_msgs::MoveItErrorCodes::SUCCESS && responses[i].error_code_.val != 0)
+      return responses[i].error_code_;
+  moveit_msgs::MoveItErrorCodes error_code;
+  error_code.val = moveit_msgs::MoveItErrorCodes::PLANNING_FAILED;
+  return error_code;
+}
+
+void getDetailedResponse(const planning_interface::MotionPlanResponse &res, planning_interface::MotionPlanDetailedResponse &detailed)
+{
+  detailed.trajectory_.assign(1, res.trajectory_);
+  detailed.description_.assign(1, "plan");
+  detailed.processing_time_.assign(1, res.planning_time_);
+  detailed.error_code_ = res.error_code_;
+  detailed.message_cache_ = res.message_cache_;
+}
+
+void getDetailedResponse(const planning_interface::MotionPlanDetailedResponse &res, planning_interface::MotionPlanDetailedResponse &detailed)
+{
+  detailed = res;
+}
+
+// the results of the contexts running in parallel
+struct PortfolioRun
+{
+  PortfolioRun(std::size_t count) : solved_(count, false), finished_(0), first_solution_(-1), next_(0), stopped_(false),
+                                    caller_(boost::this_thread::get_id()), watched_(false),
+                                    best_reported_(std::numeric_limits<double>::infinity())
+  {
+  }
+
+  boost::mutex lock_;
+  boost::condition_variable condition_;
+  std::vector<bool> solved_;
+  std::size_t finished_;
+  int first_solution_;
+
+  // the next context to start; once stopped_ is set, no more contexts are started
+  std::size_t next_;
+  bool stopped_;
+
+  // the thread that called solve() watches the deadline, while the threads of the pool run the contexts
+  boost::thread::id caller_;
+  bool watched_;
+  boost::system_time deadline_;
+
+  // solutions of any context are passed on to the callback of the portfolio if they are shorter than the ones before
+  planning_interface::PlanningContext::SolutionCallbackFn report_;
+  boost::mutex report_lock_;
+  double best_reported_;
+};
+
+void reportSolution(PortfolioRun *run, const planning_interface::MotionPlanDetailedResponse &res)
+{
+  double length = solutionLength(res);
+  boost::mutex::scoped_lock slock(run->report_lock_);
+  if (length < run->best_reported_)
+  {
+    run->best_reported_ = length;
+    run->report_(res);
+  }
+}
+
+template<typename Response>
+void solveContext(const planning_interface::PlanningContextPtr &context, Response *res, std::size_t index, PortfolioRun *run)
+{
+  bool solved = context->solve(*res);
+  if (solved && run->report_)
+  {
+    planning_interface::MotionPlanDetailedResponse detailed;
+    getDetailedResponse(*res, detailed);
+    reportSolution(run, detailed);
+  }
+  boost::mutex::scoped_lock slock(run->lock_);
+  run->solved_[index] = solved;
+  run->finished_++;
+  if (solved && run->first_solution_ < 0)
+    run->first_solution_ = index;
+  run->condition_.notify_all();
+}
+
+// wait until all contexts finish, the first solution is found (if that is all that is needed) or the deadline passes,
+// then stop the contexts that are still running
+void watchPortfolio(const std::vector<planning_interface::PlanningContextPtr> &contexts, bool return_first_solution, PortfolioRun *run)
+{
+  {
+    boost::mutex::scoped_lock slock(run->lock_);
+    while (run->finished_ < contexts.size() && !(return_first_solution && run->first_solution_ >= 0))
+      if (!run->condition_.timed_wait(slock, run->deadline_))
+        break;
+    run->stopped_ = true;
+  }
+  // contexts that already finished ignore this
+  for (std::size_t i = 0 ; i < contexts.size() ; ++i)
+    contexts[i]->terminate();
+}
+
+// run by the calling thread and by the threads of the pool: the calling thread watches, the others start contexts until
+// none are left or the run is stopped
+template<typename Response>
+void runPortfolio(const std::vector<planning_interface::PlanningContextPtr> *contexts, std::vector<Response> *responses,
+                  bool return_first_solution, PortfolioRun *run)
+{
+  bool watch;
+  {
+    boost::mutex::scoped_lock slock(run->lock_);
+    watch = !run->watched_ && boost::this_thread::get_id() == run->caller_;
+    if (watch)
+      run->watched_ = true;
+  }
+  if (watch)
+  {
+    watchPortfolio(*contexts, return_first_solution, run);
+    return;
+  }
+
+  while (true)
+  {
+    std::size_t index;
+    {
+      boost::mutex::scoped_lock slock(run->lock_);
+      if (run->stopped_ || run->next_ >= contexts->size())
+        return;
+      index = run->next_++;
+    }
+    solveContext((*contexts)[index], &(*responses)[index], index, run);
+  }
+}
+
+template<typename Response>
+int solvePortfolio(const std::vector<planning_interface::PlanningContextPtr> &contexts, std::vector<Response> &responses,
+                   double allowed_time, bool return_first_solution,
+                   const planning_interface::PlanningContext::SolutionCallbackFn &report)
+{
+  responses.clear();
+  responses.resize(contexts.size());
+  PortfolioRun run(contexts.size());
+  run.report_ = report;
+  if (report)
+    for (std::size_t i = 0 ; i < contexts.size() ; ++i)
+      contexts[i]->setSolutionCallback(boost::bind(&reportSolution, &run, _1));
+  run.deadline_ = boost::get_system_time() + boost::posix_time::microseconds((long)(allowed_time * 1000000.0));
+
+  // the contexts run on the threads of the shared pool (as many at a time as it has threads besides the calling one);
+  // without such threads, they run one after the other on the calling thread, until the deadline or the first solution
+  moveit::tools::ThreadPool &pool = moveit::tools::ThreadPool::Instance();
+  unsigned int solvers = std::min<std::size_t>(contexts.size(), pool.getThreadCount() - 1);
+  if (solvers > 0)
+    pool.runConcurrently(boost::bind(&runPortfolio<Response>, &contexts, &responses, return_first_solution, &run), solvers + 1);
+  else
+    for (std::size_t i = 0 ; i < contexts.size() ; ++i)
+    {
+      if (boost::get_system_time() >= run.deadline_ || (return_first_solution && run.first_solution_ >= 0))
+        break;
+      solveContext(contexts[i], &responses[i], i, &run);
+    }
+  if (report)
+    for (std::size_t i = 0 ; i < contexts.size() ; ++i)
+      contexts[i]->setSolutionCallback(planning_interface::PlanningContext::SolutionCallbackFn());
+
+  if (return_first_solution)
+    return run.first_solution_;
+
+  int best = -1;
+  double best_length = std::numeric_limits<double>::infinity();
+  for (std::size_t i = 0 ; i < contexts.size() ; ++i)
+    if (run.solved_[i])
+    {
+      double length = solutionLength(responses[i]);
+      if (best < 0 || length < best_length)
+      {
+        best = i;
+        best_length = length;
+      }
+    }
+  return best;
+}
+
+}
+
+planning_interface::PortfolioPlanningContext::PortfolioPlanningContext(const std::string &name, const std::string &group,
+                                                                       const std::vector<PlanningContextPtr> &contexts) :
+  PlanningContext(name, group),
+  contexts_(contexts),
+  return_first_solution_(true),
+  last_solving_context_(-1)
+{
+}
+
+planning_interface::PortfolioPlanningContext::~PortfolioPlanningContext()
+{
+}
+
+bool planning_interface::PortfolioPlanningContext::solve(MotionPlanResponse &res)
+{
+  ros::WallTime start = ros::WallTime::now();
+  std::vector<MotionPlanResponse> responses;
+  last_solving_context_ = solvePortfolio(contexts_, responses, request_.allowed_planning_time, return_first_solution_, solution_callback_);
+  if (last_solving_context_ >= 0)
+  {
+    res.swap(responses[last_solving_context_]);
+    logDebug("Portfolio '%s' returns the solution of context '%s'", name_.c_str(), contexts_[last_solving_context_]->getName().c_str());
+  }
+  else
+  {
+    res.trajectory_.reset();
+    res.error_code_ = getFailureCode(responses);
+  }
+  res.planning_time_ = (ros::WallTime::now() - start).toSec();
+  return last_solving_context_ >= 0;
+}
+
+bool planning_interface::PortfolioPlanningContext::solve(MotionPlanDetailedResponse &res)
+{
+  std::vector<MotionPlanDetailedResponse> responses;
+  last_solving_context_ = solvePortfolio(contexts_, responses, request_.allowed_planning_time, return_first_solution_, solution_callback_);
+  if (last_solving_context_ >= 0)
+    res.swap(responses[last_solving_context_]);
+  else
+  {
+    res.trajectory_.clear();
+    res.description_.clear();
+    res.processing_time_.clear();
+    res.error_code_ = getFailureCode(responses);
+  }
+  return last_solving_context_ >= 0;
+}
+
+bool planning_interface::PortfolioPlanningContext::terminate()
+{
+  bool result = true;
+  for (std::size_t i = 0 ; i < contexts_.size() ; ++i)
+    if (!contexts_[i]->terminate())
+      result = false;
+  return result;
+}
+
+void planning_interface::PortfolioPlanningContext::clear()
+{
+  for (std::size_t i = 0 ; i < contexts_.size() ; ++i)
+    contexts_[i]->clear();
+  last_solving_context_ = -1;
+}
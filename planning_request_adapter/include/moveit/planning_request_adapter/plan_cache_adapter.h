@@ -0,0 +1,162 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2013, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#ifndef MOVEIT_PLANNING_REQUEST_ADAPTER_PLAN_CACHE_ADAPTER_
+#define MOVEIT_PLANNING_REQUEST_ADAPTER_PLAN_CACHE_ADAPTER_
+
+#include <moveit/planning_request_adapter/planning_request_adapter.h>
+#include <boost/thread/mutex.hpp>
+#include <boost/weak_ptr.hpp>
+#include <map>
+
+namespace planning_request_adapter
+{
+
+/** \brief Reuse the paths computed for previous requests, when they are still valid.
+
+    The paths computed successfully by the planner are kept, per planning group. For a new request, a cached path
+    is a candidate if its first state is within the start tolerance of the start state of the request (distance
+    computed for the variables of the planning group) and its last state satisfies one of the goal constraint sets
+    of the request. The candidate closest to the start state is re-validated against the scene of the request with
+    PlanningScene::isPathValid(), after it is rebased on the start state of the request (the first state is
+    replaced with the start state, and the variables that are not part of the group are set from the start state
+    for all waypoints), and returned without planning. Only the new start state is checked if the path was last
+    validated for the same scene at the same version (see PlanningScene::getVersion()), the same start state and
+    without path constraints. Paths that are no longer valid
+    are removed, and the planner is called to compute a new path. When the cache is full, the least recently used
+    path is removed.
+
+    The cached paths are stored as they are returned by the planner, so they keep the timing computed by adapters
+    that run inside this one. The cache can be saved to a file using the binary trajectory records of
+    robot_trajectory (see writeRobotTrajectory()). */
+class PlanCacheAdapter : public PlanningRequestAdapter
+{
+public:
+
+  PlanCacheAdapter();
+
+  virtual std::string getDescription() const
+  {
+    return "Plan Cache";
+  }
+
+  /** \brief Set the largest distance between the start state of a request and the first state of a cached path
+      for the path to be reused */
+  void setStartTolerance(double tolerance)
+  {
+    start_tolerance_ = tolerance;
+  }
+
+  double getStartTolerance() const
+  {
+    return start_tolerance_;
+  }
+
+  /** \brief Set the largest number of paths kept in the cache. Default is 1000. */
+  void setMaxEntries(std::size_t max_entries);
+
+  std::size_t getMaxEntries() const
+  {
+    return max_entries_;
+  }
+
+  /** \brief Get the number of paths in the cache */
+  std::size_t getEntryCount() const;
+
+  /** \brief Remove all paths from the cache */
+  void clear();
+
+  /** \brief Get the number of requests answered from the cache */
+  std::size_t getHitCount() const;
+
+  /** \brief Get the number of requests for which the planner was called */
+  std::size_t getMissCount() const;
+
+  /** \brief Get the number of cached paths removed because they were no longer valid */
+  std::size_t getInvalidatedCount() const;
+
+  /** \brief Add \e trajectory to the cache, as if it had been computed by the planner */
+  void insert(const robot_trajectory::RobotTrajectory &trajectory);
+
+  /** \brief Save the cached paths to \e filename. Returns false if the file could not be written. */
+  bool saveToFile(const std::string &filename) const;
+
+  /** \brief Add the paths saved in \e filename to the cache. The paths are always re-validated before they are
+      first reused. Returns false if the file could not be read or if any of its records is invalid.*/
+  bool loadFromFile(const std::string &filename, const robot_model::RobotModelConstPtr &model);
+
+  virtual bool adaptAndPlan(const PlannerFn &planner,
+                            const planning_scene::PlanningSceneConstPtr& planning_scene,
+                            const planning_interface::MotionPlanRequest &req,
+                            planning_interface::MotionPlanResponse &res,
+                            std::vector<std::size_t> &added_path_index) const;
+
+private:
+
+  struct Entry
+  {
+    robot_trajectory::RobotTrajectoryPtr trajectory_;
+    boost::uint64_t last_used_;
+
+    /// the scene, scene version and start state the path was last validated for without path constraints (if any)
+    boost::weak_ptr<const planning_scene::PlanningScene> validated_scene_;
+    boost::uint64_t validated_version_;
+    bool validated_diff_;
+    std::vector<double> validated_start_;
+  };
+
+  typedef std::map<std::string, std::vector<Entry> > EntryMap;
+
+  /// the index of the cached path of \e entries to reuse for \e req, or entries.size() if there is none
+  std::size_t findCandidate(const std::vector<Entry> &entries, const planning_scene::PlanningScene &scene,
+                            const robot_state::RobotState &start, const planning_interface::MotionPlanRequest &req) const;
+
+  void insertEntry(const robot_trajectory::RobotTrajectoryPtr &trajectory) const;
+  void evict() const;
+
+  double start_tolerance_;
+  std::size_t max_entries_;
+
+  mutable boost::mutex lock_;
+  mutable EntryMap entries_;
+  mutable std::size_t entry_count_;
+  mutable boost::uint64_t use_counter_;
+  mutable std::size_t hits_;
+  mutable std::size_t misses_;
+  mutable std::size_t invalidated_;
+};
+
+}
+
+#endif
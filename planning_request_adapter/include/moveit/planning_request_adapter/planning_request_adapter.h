@@ -90,6 +90,26 @@ public:
 typedef boost::shared_ptr<PlanningRequestAdapter> PlanningRequestAdapterPtr;
 typedef boost::shared_ptr<const PlanningRequestAdapter> PlanningRequestAdapterConstPtr;
 
+/// The resources used by one stage (an adapter or the planner) of a PlanningRequestAdapterChain
+struct PlanningStageStatistics
+{
+  PlanningStageStatistics() : wall_time_(0.0), cpu_time_(0.0), memory_change_(0)
+  {
+  }
+
+  /// The description of the adapter, or "planner"
+  std::string description_;
+
+  /// Wall time spent in this stage, excluding the stages it calls (seconds)
+  double wall_time_;
+
+  /// CPU time of the process spent in this stage, excluding the stages it calls (seconds)
+  double cpu_time_;
+
+  /// Net change in allocated heap memory caused by this stage (bytes); always 0 on platforms where this is not measured
+  long memory_change_;
+};
+
 /// Apply a sequence of adapters to a motion plan
 class PlanningRequestAdapterChain
 {
@@ -114,7 +134,34 @@ public:
                     planning_interface::MotionPlanResponse &res,
                     std::vector<std::size_t> &added_path_index) const;
 
+  /** \brief Same as above, but also report the resources used by each stage in \e statistics. Stages are listed in the order they
+      finish: the planner first, then the adapters from the last added to the first added. The statistics are also reported to
+      the profiler (moveit::tools::Profiler) as averages named "PlanningRequestAdapterChain:<stage>:{wall|cpu}_time". */
+  bool adaptAndPlan(const planning_interface::PlannerManagerPtr &planner,
+                    const planning_scene::PlanningSceneConstPtr& planning_scene,
+                    const planning_interface::MotionPlanRequest &req,
+                    planning_interface::MotionPlanResponse &res,
+                    std::vector<std::size_t> &added_path_index,
+                    std::vector<PlanningStageStatistics> &statistics) const;
+
+  /** \brief Plan and report each stage as an entry of \e res, in the same order as for the statistics above: the trajectory
+      as it was when the stage finished, the stage description, its wall time, CPU time and memory change. The last
+      trajectory is the final result. */
+  bool adaptAndPlan(const planning_interface::PlannerManagerPtr &planner,
+                    const planning_scene::PlanningSceneConstPtr& planning_scene,
+                    const planning_interface::MotionPlanRequest &req,
+                    planning_interface::MotionPlanDetailedResponse &res) const;
+
 private:
+
+  bool adaptAndPlan(const planning_interface::PlannerManagerPtr &planner,
+                    const planning_scene::PlanningSceneConstPtr& planning_scene,
+                    const planning_interface::MotionPlanRequest &req,
+                    planning_interface::MotionPlanResponse &res,
+                    std::vector<std::size_t> &added_path_index,
+                    std::vector<PlanningStageStatistics> &statistics,
+                    std::vector<robot_trajectory::RobotTrajectoryPtr> *snapshots) const;
+
   std::vector<PlanningRequestAdapterConstPtr> adapters_;
 };
 
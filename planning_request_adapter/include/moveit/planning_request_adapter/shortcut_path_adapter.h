@@ -0,0 +1,135 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2013, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#ifndef MOVEIT_PLANNING_REQUEST_ADAPTER_SHORTCUT_PATH_ADAPTER_
+#define MOVEIT_PLANNING_REQUEST_ADAPTER_SHORTCUT_PATH_ADAPTER_
+
+#include <moveit/planning_request_adapter/planning_request_adapter.h>
+
+namespace planning_request_adapter
+{
+
+/** \brief Shorten the paths computed by the planner by replacing sequences of waypoints with straight segments in
+    joint space, where these segments are valid.
+
+    The waypoints of the path are only ever removed, so a shortcut is identified by the two waypoints of the
+    original path it connects and the validity of each shortcut is computed at most once per path. For each kept
+    waypoint, the furthest waypoint reachable by a valid shortcut is searched for by doubling the jump and then
+    bisecting, which needs a logarithmic number of shortcut checks per kept waypoint. Shortcuts are checked for
+    collisions, feasibility and the path constraints of the request. By default, consecutive states along a
+    shortcut are checked with the continuous (two-state) collision checks of the collision detector, which allows
+    much larger steps than discrete checks.
+
+    The timing of the path is not preserved (all durations are set to 0), so this adapter should run before time
+    parameterization. Since the path only loses waypoints, the index values reported by adapters that run inside
+    this one refer to the path before it was shortened. */
+class ShortcutPathAdapter : public PlanningRequestAdapter
+{
+public:
+
+  ShortcutPathAdapter();
+
+  virtual std::string getDescription() const
+  {
+    return "Shortcut Path";
+  }
+
+  /** \brief Set the largest joint-space distance between consecutive states checked along a shortcut,
+      with discrete checks */
+  void setMaxCheckStep(double step)
+  {
+    max_check_step_ = step;
+  }
+
+  double getMaxCheckStep() const
+  {
+    return max_check_step_;
+  }
+
+  /** \brief Set the largest joint-space distance between consecutive states checked along a shortcut,
+      with continuous checks. The states in between are only checked for collisions. */
+  void setMaxContinuousCheckStep(double step)
+  {
+    max_continuous_check_step_ = step;
+  }
+
+  double getMaxContinuousCheckStep() const
+  {
+    return max_continuous_check_step_;
+  }
+
+  /** \brief Choose between continuous (the default) and discrete collision checks along shortcuts */
+  void setUseContinuousChecks(bool flag)
+  {
+    use_continuous_checks_ = flag;
+  }
+
+  bool getUseContinuousChecks() const
+  {
+    return use_continuous_checks_;
+  }
+
+  /** \brief Set the number of times shortcuts are searched for along the whole path */
+  void setMaxRounds(unsigned int rounds)
+  {
+    max_rounds_ = rounds;
+  }
+
+  unsigned int getMaxRounds() const
+  {
+    return max_rounds_;
+  }
+
+  /** \brief Shorten \e trajectory, keeping it valid for \e planning_scene and \e path_constraints.
+      Returns the number of waypoints removed. */
+  std::size_t shortcut(const planning_scene::PlanningSceneConstPtr &planning_scene, const moveit_msgs::Constraints &path_constraints,
+                       robot_trajectory::RobotTrajectory &trajectory) const;
+
+  virtual bool adaptAndPlan(const PlannerFn &planner,
+                            const planning_scene::PlanningSceneConstPtr& planning_scene,
+                            const planning_interface::MotionPlanRequest &req,
+                            planning_interface::MotionPlanResponse &res,
+                            std::vector<std::size_t> &added_path_index) const;
+
+private:
+
+  double max_check_step_;
+  double max_continuous_check_step_;
+  bool use_continuous_checks_;
+  unsigned int max_rounds_;
+};
+
+}
+
+#endif
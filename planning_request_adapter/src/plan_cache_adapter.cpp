@@ -0,0 +1,355 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2013, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#include <moveit/planning_request_adapter/plan_cache_adapter.h>
+#include <moveit/robot_trajectory/trajectory_serialization.h>
+#include <moveit/robot_state/conversions.h>
+#include <moveit/kinematic_constraints/kinematic_constraint.h>
+#include <moveit/kinematic_constraints/utils.h>
+#include <console_bridge/console.h>
+#include <fstream>
+#include <algorithm>
+#include <limits>
+
+namespace planning_request_adapter
+{
+
+namespace
+{
+
+// the cached paths are never shared with the responses, since adapters that run later modify the returned paths
+robot_trajectory::RobotTrajectoryPtr copyTrajectory(const robot_trajectory::RobotTrajectory &trajectory)
+{
+  robot_trajectory::RobotTrajectoryPtr copy(new robot_trajectory::RobotTrajectory(trajectory.getRobotModel(), trajectory.getGroupName()));
+  for (std::size_t i = 0 ; i < trajectory.getWayPointCount() ; ++i)
+    copy->addSuffixWayPoint(trajectory.getWayPoint(i), trajectory.getWayPointDurationFromPrevious(i));
+  return copy;
+}
+
+// the path the cached \e trajectory describes for its group, with the other variables (and the attached bodies)
+// taken from \e start; the first waypoint is \e start itself
+robot_trajectory::RobotTrajectoryPtr rebaseTrajectory(const robot_trajectory::RobotTrajectory &trajectory, const robot_state::RobotState &start)
+{
+  const robot_model::JointModelGroup *group = trajectory.getGroup();
+  const std::vector<int> &index = group->getVariableIndexList();
+  robot_trajectory::RobotTrajectoryPtr result(new robot_trajectory::RobotTrajectory(trajectory.getRobotModel(), trajectory.getGroupName()));
+  result->addSuffixWayPoint(start, trajectory.getWayPointDurationFromPrevious(0));
+  std::vector<double> positions;
+  for (std::size_t i = 1 ; i < trajectory.getWayPointCount() ; ++i)
+  {
+    const robot_state::RobotState &waypoint = trajectory.getWayPoint(i);
+    robot_state::RobotStatePtr state(new robot_state::RobotState(start));
+    waypoint.copyJointGroupPositions(group, positions);
+    state->setJointGroupPositions(group, positions);
+    if (waypoint.hasVelocities())
+    {
+      double *v = state->getVariableVelocities();
+      for (std::size_t j = 0 ; j < index.size() ; ++j)
+        v[index[j]] = waypoint.getVariableVelocities()[index[j]];
+    }
+    if (waypoint.hasAccelerations())
+    {
+      double *a = state->getVariableAccelerations();
+      for (std::size_t j = 0 ; j < index.size() ; ++j)
+        a[index[j]] = waypoint.getVariableAccelerations()[index[j]];
+    }
+    state->update();
+    result->addSuffixWayPoint(state, trajectory.getWayPointDurationFromPrevious(i));
+  }
+  return result;
+}
+
+}
+}
+
+planning_request_adapter::PlanCacheAdapter::PlanCacheAdapter() :
+  PlanningRequestAdapter(),
+  start_tolerance_(0.05),
+  max_entries_(1000),
+  entry_count_(0),
+  use_counter_(0),
+  hits_(0),
+  misses_(0),
+  invalidated_(0)
+{
+}
+
+void planning_request_adapter::PlanCacheAdapter::setMaxEntries(std::size_t max_entries)
+{
+  boost::mutex::scoped_lock slock(lock_);
+  max_entries_ = max_entries;
+  while (entry_count_ > max_entries_)
+    evict();
+}
+
+std::size_t planning_request_adapter::PlanCacheAdapter::getEntryCount() const
+{
+  boost::mutex::scoped_lock slock(lock_);
+  return entry_count_;
+}
+
+void planning_request_adapter::PlanCacheAdapter::clear()
+{
+  boost::mutex::scoped_lock slock(lock_);
+  entries_.clear();
+  entry_count_ = 0;
+}
+
+std::size_t planning_request_adapter::PlanCacheAdapter::getHitCount() const
+{
+  boost::mutex::scoped_lock slock(lock_);
+  return hits_;
+}
+
+std::size_t planning_request_adapter::PlanCacheAdapter::getMissCount() const
+{
+  boost::mutex::scoped_lock slock(lock_);
+  return misses_;
+}
+
+std::size_t planning_request_adapter::PlanCacheAdapter::getInvalidatedCount() const
+{
+  boost::mutex::scoped_lock slock(lock_);
+  return invalidated_;
+}
+
+void planning_request_adapter::PlanCacheAdapter::insert(const robot_trajectory::RobotTrajectory &trajectory)
+{
+  if (trajectory.empty() || !trajectory.getGroup())
+  {
+    logWarn("Only non-empty paths computed for a planning group can be cached");
+    return;
+  }
+  robot_trajectory::RobotTrajectoryPtr copy = copyTrajectory(trajectory);
+  boost::mutex::scoped_lock slock(lock_);
+  insertEntry(copy);
+}
+
+void planning_request_adapter::PlanCacheAdapter::insertEntry(const robot_trajectory::RobotTrajectoryPtr &trajectory) const
+{
+  if (max_entries_ == 0)
+    return;
+  while (entry_count_ >= max_entries_)
+    evict();
+  Entry e;
+  e.trajectory_ = trajectory;
+  e.last_used_ = ++use_counter_;
+  e.validated_version_ = 0;
+  e.validated_diff_ = false;
+  entries_[trajectory->getGroupName()].push_back(e);
+  entry_count_++;
+}
+
+void planning_request_adapter::PlanCacheAdapter::evict() const
+{
+  EntryMap::iterator oldest_group = entries_.end();
+  std::size_t oldest = 0;
+  for (EntryMap::iterator it = entries_.begin() ; it != entries_.end() ; ++it)
+    for (std::size_t i = 0 ; i < it->second.size() ; ++i)
+      if (oldest_group == entries_.end() || it->second[i].last_used_ < oldest_group->second[oldest].last_used_)
+      {
+        oldest_group = it;
+        oldest = i;
+      }
+  if (oldest_group == entries_.end())
+    return;
+  oldest_group->second[oldest] = oldest_group->second.back();
+  oldest_group->second.pop_back();
+  if (oldest_group->second.empty())
+    entries_.erase(oldest_group);
+  entry_count_--;
+}
+
+std::size_t planning_request_adapter::PlanCacheAdapter::findCandidate(const std::vector<Entry> &entries, const planning_scene::PlanningScene &scene,
+                                                                      const robot_state::RobotState &start,
+                                                                      const planning_interface::MotionPlanRequest &req) const
+{
+  // the goal constraints are only constructed if some path starts close enough
+  std::vector<kinematic_constraints::KinematicConstraintSetPtr> goals;
+  std::size_t best = entries.size();
+  double best_distance = std::numeric_limits<double>::infinity();
+  for (std::size_t i = 0 ; i < entries.size() ; ++i)
+  {
+    const robot_trajectory::RobotTrajectory &trajectory = *entries[i].trajectory_;
+    double d = start.distance(trajectory.getFirstWayPoint(), trajectory.getGroup());
+    if (d > start_tolerance_ || d >= best_distance)
+      continue;
+    if (goals.empty())
+      for (std::size_t j = 0 ; j < req.goal_constraints.size() ; ++j)
+      {
+        kinematic_constraints::KinematicConstraintSetPtr goal(new kinematic_constraints::KinematicConstraintSet(scene.getRobotModel()));
+        goal->add(req.goal_constraints[j], scene.getTransforms());
+        goals.push_back(goal);
+      }
+    for (std::size_t j = 0 ; j < goals.size() ; ++j)
+      if (goals[j]->decide(trajectory.getLastWayPoint()).satisfied)
+      {
+        best = i;
+        best_distance = d;
+        break;
+      }
+  }
+  return best;
+}
+
+bool planning_request_adapter::PlanCacheAdapter::saveToFile(const std::string &filename) const
+{
+  std::ofstream out(filename.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+  if (!out.good())
+  {
+    logError("Unable to open '%s' for writing the plan cache", filename.c_str());
+    return false;
+  }
+
+  // the paths are copied (shared) so the file is written without holding the lock
+  std::vector<robot_trajectory::RobotTrajectoryPtr> trajectories;
+  {
+    boost::mutex::scoped_lock slock(lock_);
+    for (EntryMap::const_iterator it = entries_.begin() ; it != entries_.end() ; ++it)
+      for (std::size_t i = 0 ; i < it->second.size() ; ++i)
+        trajectories.push_back(it->second[i].trajectory_);
+  }
+  for (std::size_t i = 0 ; i < trajectories.size() ; ++i)
+    if (!robot_trajectory::writeRobotTrajectory(out, *trajectories[i]))
+    {
+      logError("Unable to write the plan cache to '%s'", filename.c_str());
+      return false;
+    }
+  return true;
+}
+
+bool planning_request_adapter::PlanCacheAdapter::loadFromFile(const std::string &filename, const robot_model::RobotModelConstPtr &model)
+{
+  std::ifstream in(filename.c_str(), std::ios::in | std::ios::binary);
+  if (!in.good())
+  {
+    logError("Unable to open '%s' for reading the plan cache", filename.c_str());
+    return false;
+  }
+
+  robot_state::RobotState reference(model);
+  reference.setToDefaultValues();
+  std::size_t loaded = 0;
+  while (true)
+  {
+    robot_trajectory::RobotTrajectory trajectory(model, "");
+    if (!robot_trajectory::readRobotTrajectory(in, reference, trajectory))
+      break;
+    insert(trajectory);
+    loaded++;
+  }
+
+  // readRobotTrajectory() returns false both at the end of the file and for invalid records
+  in.peek();
+  if (!in.eof())
+  {
+    logError("Invalid record in plan cache '%s' after %u paths were loaded", filename.c_str(), (unsigned int)loaded);
+    return false;
+  }
+  logDebug("Loaded %u paths from plan cache '%s'", (unsigned int)loaded, filename.c_str());
+  return true;
+}
+
+bool planning_request_adapter::PlanCacheAdapter::adaptAndPlan(const PlannerFn &planner,
+                                                              const planning_scene::PlanningSceneConstPtr& planning_scene,
+                                                              const planning_interface::MotionPlanRequest &req,
+                                                              planning_interface::MotionPlanResponse &res,
+                                                              std::vector<std::size_t> &added_path_index) const
+{
+  if (!req.goal_constraints.empty() && planning_scene->getRobotModel()->hasJointModelGroup(req.group_name))
+  {
+    robot_state::RobotState start = planning_scene->getCurrentState();
+    robot_state::robotStateMsgToRobotState(planning_scene->getTransforms(), req.start_state, start);
+    start.update();
+    // a validation can be reused if the start state the path is rebased on depends only on the scene
+    bool reusable_validation = kinematic_constraints::isEmpty(req.path_constraints) && req.start_state.attached_collision_objects.empty();
+
+    boost::mutex::scoped_lock slock(lock_);
+    EntryMap::iterator it = entries_.find(req.group_name);
+    while (it != entries_.end())
+    {
+      std::vector<Entry> &entries = it->second;
+      std::size_t index = findCandidate(entries, *planning_scene, start, req);
+      if (index >= entries.size())
+        break;
+
+      // the path is validated as it will be returned, starting exactly at the start state of the request
+      Entry &e = entries[index];
+      robot_trajectory::RobotTrajectoryPtr trajectory = rebaseTrajectory(*e.trajectory_, start);
+      const double *positions = start.getVariablePositions();
+      bool validated = reusable_validation && e.validated_scene_.lock() == planning_scene &&
+        e.validated_version_ == planning_scene->getVersion() && e.validated_diff_ == req.start_state.is_diff &&
+        std::equal(e.validated_start_.begin(), e.validated_start_.end(), positions);
+      bool valid = validated ? planning_scene->isStateValid(trajectory->getFirstWayPoint(), req.group_name) :
+        planning_scene->isPathValid(*trajectory, req.path_constraints, req.goal_constraints, req.group_name);
+      if (valid)
+      {
+        e.last_used_ = ++use_counter_;
+        if (reusable_validation)
+        {
+          e.validated_scene_ = planning_scene;
+          e.validated_version_ = planning_scene->getVersion();
+          e.validated_diff_ = req.start_state.is_diff;
+          e.validated_start_.assign(positions, positions + start.getVariableCount());
+        }
+        hits_++;
+        res.trajectory_ = trajectory;
+        res.error_code_.val = moveit_msgs::MoveItErrorCodes::SUCCESS;
+        res.planning_time_ = 0.0;
+        return true;
+      }
+
+      logDebug("Cached path for group '%s' is no longer valid", req.group_name.c_str());
+      entries[index] = entries.back();
+      entries.pop_back();
+      entry_count_--;
+      invalidated_++;
+      if (entries.empty())
+      {
+        entries_.erase(it);
+        break;
+      }
+    }
+    misses_++;
+  }
+
+  bool result = planner(planning_scene, req, res);
+  if (result && res.trajectory_ && !res.trajectory_->empty() && res.trajectory_->getGroup())
+  {
+    robot_trajectory::RobotTrajectoryPtr copy = copyTrajectory(*res.trajectory_);
+    boost::mutex::scoped_lock slock(lock_);
+    insertEntry(copy);
+  }
+  return result;
+}
@@ -35,8 +35,15 @@
 /* Author: Ioan Sucan */
 
 #include <moveit/planning_request_adapter/planning_request_adapter.h>
+#include <moveit/profiler/profiler.h>
 #include <boost/bind.hpp>
+#include <boost/lexical_cast.hpp>
+#include <ros/time.h>
 #include <algorithm>
+#include <ctime>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
 
 // we could really use some c++11 lambda functions here :)
 
@@ -49,9 +56,13 @@ bool callPlannerInterfaceSolve(const planning_interface::PlannerManager *planner
                                const planning_interface::MotionPlanRequest &req,
                                planning_interface::MotionPlanResponse &res)
 {
-  planning_interface::PlanningContextPtr context = planner->getPlanningContext(planning_scene, req, res.error_code_);
+  planning_interface::PlanningContextPtr context = planner->acquirePlanningContext(planning_scene, req, res.error_code_);
   if (context)
-    return context->solve(res);
+  {
+    bool result = context->solve(res);
+    planner->releasePlanningContext(context);
+    return result;
+  }
   else
     return false;
 }
@@ -84,8 +95,8 @@ namespace
 
 // boost bind is not happy with overloading, so we add intermediate function objects
 
-bool callAdapter1(const PlanningRequestAdapter *adapter,
-                  const planning_interface::PlannerManagerPtr &planner,
+bool callAdapter2(const PlanningRequestAdapter *adapter,
+                  const PlanningRequestAdapter::PlannerFn &planner,
                   const planning_scene::PlanningSceneConstPtr& planning_scene,
                   const planning_interface::MotionPlanRequest &req,
                   planning_interface::MotionPlanResponse &res,
@@ -99,39 +110,84 @@ bool callAdapter1(const PlanningRequestAdapter *adapter,
   {
     logError("Exception caught executing adapter '%s': %s", adapter->getDescription().c_str(), ex.what());
     added_path_index.clear();
-    return callPlannerInterfaceSolve(planner.get(), planning_scene, req, res);
+    return planner(planning_scene, req, res);
   }
   catch(...)
   {
     logError("Exception caught executing adapter '%s'", adapter->getDescription().c_str());
     added_path_index.clear();
-    return callPlannerInterfaceSolve(planner.get(), planning_scene, req, res);
+    return planner(planning_scene, req, res);
   }
 }
 
-bool callAdapter2(const PlanningRequestAdapter *adapter,
-                  const PlanningRequestAdapter::PlannerFn &planner,
-                  const planning_scene::PlanningSceneConstPtr& planning_scene,
-                  const planning_interface::MotionPlanRequest &req,
-                  planning_interface::MotionPlanResponse &res,
-                  std::vector<std::size_t> &added_path_index)
+// the resources used by a stage of the chain, including the stages it calls
+struct StageRecord
 {
-  try
+  StageRecord() : wall_time_(0.0), cpu_time_(0.0), memory_change_(0), snapshot_wall_time_(0.0), snapshot_cpu_time_(0.0), snapshot_memory_(0)
   {
-    return adapter->adaptAndPlan(planner, planning_scene, req, res, added_path_index);
   }
-  catch(std::runtime_error &ex)
-  {
-    logError("Exception caught executing adapter '%s': %s", adapter->getDescription().c_str(), ex.what());
-    added_path_index.clear();
-    return planner(planning_scene, req, res);
-  }
-  catch(...)
+
+  double wall_time_;
+  double cpu_time_;
+  long memory_change_;
+
+  // resources used to copy the trajectory once the stage finished; these are not charged to any stage
+  double snapshot_wall_time_;
+  double snapshot_cpu_time_;
+  long snapshot_memory_;
+  robot_trajectory::RobotTrajectoryPtr trajectory_;
+};
+
+double getCPUTime()
+{
+  return (double)std::clock() / (double)CLOCKS_PER_SEC;
+}
+
+long getAllocatedMemory()
+{
+#ifdef __GLIBC__
+  struct mallinfo mi = mallinfo();
+  return (long)mi.uordblks + (long)mi.hblkhd;
+#else
+  return 0;
+#endif
+}
+
+robot_trajectory::RobotTrajectoryPtr copyTrajectory(const robot_trajectory::RobotTrajectory &trajectory)
+{
+  robot_trajectory::RobotTrajectoryPtr copy(new robot_trajectory::RobotTrajectory(trajectory.getRobotModel(), trajectory.getGroupName()));
+  for (std::size_t i = 0 ; i < trajectory.getWayPointCount() ; ++i)
+    copy->addSuffixWayPoint(trajectory.getWayPoint(i), trajectory.getWayPointDurationFromPrevious(i));
+  return copy;
+}
+
+bool callTimedStage(const PlanningRequestAdapter::PlannerFn &stage, StageRecord *record, bool snapshot,
+                    const planning_scene::PlanningSceneConstPtr& planning_scene,
+                    const planning_interface::MotionPlanRequest &req,
+                    planning_interface::MotionPlanResponse &res)
+{
+  ros::WallTime start = ros::WallTime::now();
+  double start_cpu = getCPUTime();
+  long start_memory = getAllocatedMemory();
+  bool result = stage(planning_scene, req, res);
+  record->wall_time_ = (ros::WallTime::now() - start).toSec();
+  record->cpu_time_ = getCPUTime() - start_cpu;
+  record->memory_change_ = getAllocatedMemory() - start_memory;
+
+  if (snapshot)
   {
-    logError("Exception caught executing adapter '%s'", adapter->getDescription().c_str());
-    added_path_index.clear();
-    return planner(planning_scene, req, res);
+    start = ros::WallTime::now();
+    start_cpu = getCPUTime();
+    start_memory = getAllocatedMemory();
+    if (res.trajectory_)
+      record->trajectory_ = copyTrajectory(*res.trajectory_);
+    else
+      record->trajectory_.reset();
+    record->snapshot_wall_time_ = (ros::WallTime::now() - start).toSec();
+    record->snapshot_cpu_time_ = getCPUTime() - start_cpu;
+    record->snapshot_memory_ = getAllocatedMemory() - start_memory;
   }
+  return result;
 }
 
 }
@@ -153,35 +209,113 @@ bool planning_request_adapter::PlanningRequestAdapterChain::adaptAndPlan(const p
                                                                          planning_interface::MotionPlanResponse &res,
                                                                          std::vector<std::size_t> &added_path_index) const
 {
-  // if there are no adapters, run the planner directly
-  if (adapters_.empty())
+  std::vector<PlanningStageStatistics> dummy;
+  return adaptAndPlan(planner, planning_scene, req, res, added_path_index, dummy, NULL);
+}
+
+bool planning_request_adapter::PlanningRequestAdapterChain::adaptAndPlan(const planning_interface::PlannerManagerPtr &planner,
+                                                                         const planning_scene::PlanningSceneConstPtr& planning_scene,
+                                                                         const planning_interface::MotionPlanRequest &req,
+                                                                         planning_interface::MotionPlanResponse &res,
+                                                                         std::vector<std::size_t> &added_path_index,
+                                                                         std::vector<PlanningStageStatistics> &statistics) const
+{
+  return adaptAndPlan(planner, planning_scene, req, res, added_path_index, statistics, NULL);
+}
+
+bool planning_request_adapter::PlanningRequestAdapterChain::adaptAndPlan(const planning_interface::PlannerManagerPtr &planner,
+                                                                         const planning_scene::PlanningSceneConstPtr& planning_scene,
+                                                                         const planning_interface::MotionPlanRequest &req,
+                                                                         planning_interface::MotionPlanDetailedResponse &res) const
+{
+  planning_interface::MotionPlanResponse stage_res;
+  std::vector<std::size_t> added_path_index;
+  std::vector<PlanningStageStatistics> statistics;
+  std::vector<robot_trajectory::RobotTrajectoryPtr> snapshots;
+  bool result = adaptAndPlan(planner, planning_scene, req, stage_res, added_path_index, statistics, &snapshots);
+
+  res.trajectory_.clear();
+  res.description_.clear();
+  res.processing_time_.clear();
+  res.cpu_time_.clear();
+  res.memory_change_.clear();
+  for (std::size_t i = 0 ; i < statistics.size() ; ++i)
   {
-    added_path_index.clear();
-    return callPlannerInterfaceSolve(planner.get(), planning_scene, req, res);
+    // stages that did not produce a trajectory are reported with an empty one
+    if (snapshots[i])
+      res.trajectory_.push_back(snapshots[i]);
+    else
+      res.trajectory_.push_back(robot_trajectory::RobotTrajectoryPtr(new robot_trajectory::RobotTrajectory(planning_scene->getRobotModel(), req.group_name)));
+    res.description_.push_back(statistics[i].description_);
+    res.processing_time_.push_back(statistics[i].wall_time_);
+    res.cpu_time_.push_back(statistics[i].cpu_time_);
+    res.memory_change_.push_back(statistics[i].memory_change_);
   }
-  else
+  res.error_code_ = stage_res.error_code_;
+  return result;
+}
+
+bool planning_request_adapter::PlanningRequestAdapterChain::adaptAndPlan(const planning_interface::PlannerManagerPtr &planner,
+                                                                         const planning_scene::PlanningSceneConstPtr& planning_scene,
+                                                                         const planning_interface::MotionPlanRequest &req,
+                                                                         planning_interface::MotionPlanResponse &res,
+                                                                         std::vector<std::size_t> &added_path_index,
+                                                                         std::vector<PlanningStageStatistics> &statistics,
+                                                                         std::vector<robot_trajectory::RobotTrajectoryPtr> *snapshots) const
+{
+  // the index values added by each adapter
+  std::vector<std::vector<std::size_t> > added_path_index_each(adapters_.size());
+
+  // the last record is for the planner
+  std::vector<StageRecord> records(adapters_.size() + 1);
+
+  // construct a function pointer for the planner and one for each adapter, in order, so that in the end we have a nested
+  // sequence of function pointers that call the adapters in the correct order; each one is timed
+  PlanningRequestAdapter::PlannerFn fn = boost::bind(&callTimedStage, PlanningRequestAdapter::PlannerFn(boost::bind(&callPlannerInterfaceSolve, planner.get(), _1, _2, _3)),
+                                                     &records.back(), snapshots != NULL, _1, _2, _3);
+  for (int i = adapters_.size() - 1 ; i >= 0 ; --i)
+    fn = boost::bind(&callTimedStage, PlanningRequestAdapter::PlannerFn(boost::bind(&callAdapter2, adapters_[i].get(), fn, _1, _2, _3, boost::ref(added_path_index_each[i]))),
+                     &records[i], snapshots != NULL, _1, _2, _3);
+  bool result = fn(planning_scene, req, res);
+  added_path_index.clear();
+
+  // merge the index values from each adapter
+  for (std::size_t i = 0 ; i < added_path_index_each.size() ; ++i)
+    for (std::size_t j = 0 ; j < added_path_index_each[i].size() ; ++j)
+    {
+      for (std::size_t k = 0 ; k < added_path_index.size() ; ++k)
+        if (added_path_index_each[i][j] <= added_path_index[k])
+          added_path_index[k]++;
+      added_path_index.push_back(added_path_index_each[i][j]);
+    }
+  std::sort(added_path_index.begin(), added_path_index.end());
+
+  // report the resources used by each stage, without the stages it calls, in the order the stages finished
+  statistics.resize(records.size());
+  if (snapshots)
+    snapshots->resize(records.size());
+  for (std::size_t i = 0 ; i < records.size() ; ++i)
   {
-    // the index values added by each adapter
-    std::vector<std::vector<std::size_t> > added_path_index_each(adapters_.size());
-
-    // if there are adapters, construct a function pointer for each, in order,
-    // so that in the end we have a nested sequence of function pointers that call the adapters in the correct order.
-    PlanningRequestAdapter::PlannerFn fn = boost::bind(&callAdapter1, adapters_.back().get(), planner, _1, _2, _3, boost::ref(added_path_index_each.back()));
-    for (int i = adapters_.size() - 2 ; i >= 0 ; --i)
-      fn = boost::bind(&callAdapter2, adapters_[i].get(), fn, _1, _2, _3, boost::ref(added_path_index_each[i]));
-    bool result = fn(planning_scene, req, res);
-    added_path_index.clear();
+    PlanningStageStatistics &stat = statistics[records.size() - 1 - i];
+    stat.description_ = i < adapters_.size() ? adapters_[i]->getDescription() : "planner";
+    if (stat.description_.empty())
+      stat.description_ = "adapter " + boost::lexical_cast<std::string>(i);
+    stat.wall_time_ = records[i].wall_time_;
+    stat.cpu_time_ = records[i].cpu_time_;
+    stat.memory_change_ = records[i].memory_change_;
+    if (i + 1 < records.size())
+    {
+      const StageRecord &inner = records[i + 1];
+      stat.wall_time_ -= inner.wall_time_ + inner.snapshot_wall_time_;
+      stat.cpu_time_ -= inner.cpu_time_ + inner.snapshot_cpu_time_;
+      stat.memory_change_ -= inner.memory_change_ + inner.snapshot_memory_;
+    }
+    if (snapshots)
+      (*snapshots)[records.size() - 1 - i] = records[i].trajectory_;
 
-    // merge the index values from each adapter
-    for (std::size_t i = 0 ; i < added_path_index_each.size() ; ++i)
-      for (std::size_t j = 0 ; j < added_path_index_each[i].size() ; ++j)
-      {
-        for (std::size_t k = 0 ; k < added_path_index.size() ; ++k)
-          if (added_path_index_each[i][j] <= added_path_index[k])
-            added_path_index[k]++;
-        added_path_index.push_back(added_path_index_each[i][j]);
-      }
-    std::sort(added_path_index.begin(), added_path_index.end());
-    return result;
+    moveit::tools::Profiler::Average("PlanningRequestAdapterChain:" + stat.description_ + ":wall_time", stat.wall_time_);
+    moveit::tools::Profiler::Average("PlanningRequestAdapterChain:" + stat.description_ + ":cpu_time", stat.cpu_time_);
   }
+
+  return result;
 }
@@ -0,0 +1,232 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2013, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#include <moveit/planning_request_adapter/shortcut_path_adapter.h>
+#include <moveit/kinematic_constraints/kinematic_constraint.h>
+#include <console_bridge/console.h>
+#include <map>
+#include <cmath>
+
+namespace planning_request_adapter
+{
+
+namespace
+{
+
+// Validity of the straight joint-space segments between waypoints of a trajectory, computed at most once per pair
+class ShortcutValidity
+{
+public:
+
+  ShortcutValidity(const planning_scene::PlanningScene &scene, const kinematic_constraints::KinematicConstraintSet &constraints,
+                   const robot_trajectory::RobotTrajectory &trajectory, bool continuous, double max_step) :
+    scene_(scene), constraints_(constraints), trajectory_(trajectory), group_(trajectory.getGroup()),
+    continuous_(continuous), max_step_(max_step), checks_(0)
+  {
+    req_.group_name = trajectory.getGroupName();
+  }
+
+  bool isValid(std::size_t from, std::size_t to)
+  {
+    std::pair<std::size_t, std::size_t> key(from, to);
+    std::map<std::pair<std::size_t, std::size_t>, bool>::const_iterator it = cache_.find(key);
+    if (it != cache_.end())
+      return it->second;
+    bool valid = check(trajectory_.getWayPoint(from), trajectory_.getWayPoint(to));
+    cache_[key] = valid;
+    return valid;
+  }
+
+  std::size_t getCheckCount() const
+  {
+    return checks_;
+  }
+
+private:
+
+  void interpolate(const robot_state::RobotState &from, const robot_state::RobotState &to, double t, robot_state::RobotState &state) const
+  {
+    if (group_)
+      from.interpolate(to, t, state, group_);
+    else
+      from.interpolate(to, t, state);
+    state.update();
+  }
+
+  bool isColliding(const robot_state::RobotState &from, const robot_state::RobotState &to)
+  {
+    // same as PlanningScene::checkCollision(): the world is checked against the padded robot,
+    // self-collisions with the unpadded one
+    collision_detection::CollisionResult res;
+    const collision_detection::AllowedCollisionMatrix &acm = scene_.getAllowedCollisionMatrix();
+    scene_.getCollisionWorld()->checkRobotCollision(req_, res, *scene_.getCollisionRobot(), from, to, acm);
+    if (!res.collision)
+      scene_.getCollisionRobotUnpadded()->checkSelfCollision(req_, res, from, to, acm);
+    return res.collision;
+  }
+
+  bool check(const robot_state::RobotState &from, const robot_state::RobotState &to)
+  {
+    ++checks_;
+    double distance = group_ ? from.distance(to, group_) : from.distance(to);
+    std::size_t steps = std::max<std::size_t>(1, (std::size_t)ceil(distance / max_step_));
+
+    // the ends of the segment are waypoints of the trajectory, which are assumed to be valid
+    robot_state::RobotState state1(from), state2(from);
+    const robot_state::RobotState *previous = &from;
+    for (std::size_t k = 1 ; k <= steps ; ++k)
+    {
+      robot_state::RobotState *current = k % 2 ? &state1 : &state2;
+      if (k < steps)
+      {
+        interpolate(from, to, (double)k / (double)steps, *current);
+        if (continuous_)
+        {
+          if (!scene_.isStateFeasible(*current) || (!constraints_.empty() && !scene_.isStateConstrained(*current, constraints_)))
+            return false;
+        }
+        else
+          if (!scene_.isStateValid(*current, constraints_, req_.group_name))
+            return false;
+      }
+      if (continuous_)
+      {
+        const robot_state::RobotState &next = k < steps ? *current : to;
+        if (isColliding(*previous, next))
+          return false;
+        previous = &next;
+      }
+    }
+    return true;
+  }
+
+  const planning_scene::PlanningScene &scene_;
+  const kinematic_constraints::KinematicConstraintSet &constraints_;
+  const robot_trajectory::RobotTrajectory &trajectory_;
+  const robot_model::JointModelGroup *group_;
+  bool continuous_;
+  double max_step_;
+  collision_detection::CollisionRequest req_;
+  std::map<std::pair<std::size_t, std::size_t>, bool> cache_;
+  std::size_t checks_;
+};
+
+}
+
+}
+
+planning_request_adapter::ShortcutPathAdapter::ShortcutPathAdapter() :
+  PlanningRequestAdapter(),
+  max_check_step_(0.05),
+  max_continuous_check_step_(0.5),
+  use_continuous_checks_(true),
+  max_rounds_(3)
+{
+}
+
+std::size_t planning_request_adapter::ShortcutPathAdapter::shortcut(const planning_scene::PlanningSceneConstPtr &planning_scene,
+                                                                   const moveit_msgs::Constraints &path_constraints,
+                                                                   robot_trajectory::RobotTrajectory &trajectory) const
+{
+  const std::size_t count = trajectory.getWayPointCount();
+  if (count < 3)
+    return 0;
+
+  kinematic_constraints::KinematicConstraintSet constraints(planning_scene->getRobotModel());
+  constraints.add(path_constraints, planning_scene->getTransforms());
+  ShortcutValidity validity(*planning_scene, constraints, trajectory, use_continuous_checks_,
+                            use_continuous_checks_ ? max_continuous_check_step_ : max_check_step_);
+
+  // the indices (in the original trajectory) of the waypoints that are kept
+  std::vector<std::size_t> kept(count);
+  for (std::size_t i = 0 ; i < count ; ++i)
+    kept[i] = i;
+
+  for (unsigned int round = 0 ; round < max_rounds_ ; ++round)
+  {
+    std::vector<std::size_t> next(1, kept[0]);
+    for (std::size_t a = 0 ; a + 1 < kept.size() ; )
+    {
+      // the segment to the next kept waypoint is valid; find a further one that is reachable as well, by doubling
+      // the jump until a shortcut is invalid and then bisecting between the two
+      std::size_t good = a + 1, bad = kept.size();
+      for (std::size_t step = 2 ; bad == kept.size() && good + 1 < kept.size() ; step *= 2)
+      {
+        std::size_t b = std::min(a + step, kept.size() - 1);
+        if (validity.isValid(kept[a], kept[b]))
+          good = b;
+        else
+          bad = b;
+      }
+      if (bad < kept.size())
+        while (bad - good > 1)
+        {
+          std::size_t b = (good + bad) / 2;
+          if (validity.isValid(kept[a], kept[b]))
+            good = b;
+          else
+            bad = b;
+        }
+      next.push_back(kept[good]);
+      a = good;
+    }
+    bool changed = next.size() < kept.size();
+    kept.swap(next);
+    if (!changed)
+      break;
+  }
+
+  logDebug("Shortcutting removed %u of %u waypoints using %u segment checks", (unsigned int)(count - kept.size()),
+           (unsigned int)count, (unsigned int)validity.getCheckCount());
+  if (kept.size() == count)
+    return 0;
+
+  robot_trajectory::RobotTrajectory result(trajectory.getRobotModel(), trajectory.getGroupName());
+  for (std::size_t i = 0 ; i < kept.size() ; ++i)
+    result.addSuffixWayPoint(trajectory.getWayPointPtr(kept[i]), 0.0);
+  trajectory.swap(result);
+  return count - kept.size();
+}
+
+bool planning_request_adapter::ShortcutPathAdapter::adaptAndPlan(const PlannerFn &planner,
+                                                                 const planning_scene::PlanningSceneConstPtr& planning_scene,
+                                                                 const planning_interface::MotionPlanRequest &req,
+                                                                 planning_interface::MotionPlanResponse &res,
+                                                                 std::vector<std::size_t> &added_path_index) const
+{
+  bool result = planner(planning_scene, req, res);
+  if (result && res.trajectory_)
+    shortcut(planning_scene, req.path_constraints, *res.trajectory_);
+  return result;
+}
@@ -0,0 +1,221 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2013, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+
+#include <gtest/gtest.h>
+#include <moveit/planning_request_adapter/plan_cache_adapter.h>
+#include <moveit/kinematic_constraints/utils.h>
+#include <moveit/robot_state/conversions.h>
+#include <moveit/test_resources/config.h>
+#include <urdf_parser/urdf_parser.h>
+#include <boost/filesystem.hpp>
+#include <boost/bind.hpp>
+#include <fstream>
+
+// a planner that moves the group in a straight line in joint space, from the start state to the goal state
+static bool linearPlanner(const robot_state::RobotState *goal, std::size_t *calls,
+                          const planning_scene::PlanningSceneConstPtr& scene,
+                          const planning_interface::MotionPlanRequest &req, planning_interface::MotionPlanResponse &res)
+{
+  ++(*calls);
+  robot_state::RobotState start = scene->getCurrentState();
+  robot_state::robotStateMsgToRobotState(scene->getTransforms(), req.start_state, start);
+  res.trajectory_.reset(new robot_trajectory::RobotTrajectory(scene->getRobotModel(), req.group_name));
+  const robot_model::JointModelGroup *jmg = res.trajectory_->getGroup();
+  for (int i = 0 ; i <= 10 ; ++i)
+  {
+    robot_state::RobotState waypoint(start);
+    start.interpolate(*goal, i / 10.0, waypoint, jmg);
+    waypoint.update();
+    res.trajectory_->addSuffixWayPoint(waypoint, 0.1);
+  }
+  res.error_code_.val = moveit_msgs::MoveItErrorCodes::SUCCESS;
+  return true;
+}
+
+class PlanCacheAdapterTest : public testing::Test
+{
+protected:
+
+  virtual void SetUp()
+  {
+    boost::shared_ptr<srdf::Model> srdf_model(new srdf::Model());
+    std::string xml_string;
+    std::fstream xml_file((boost::filesystem::path(MOVEIT_TEST_RESOURCES_DIR) / "urdf/robot.xml").string().c_str(), std::fstream::in);
+    while (xml_file.good())
+    {
+      std::string line;
+      std::getline(xml_file, line);
+      xml_string += (line + "\n");
+    }
+    xml_file.close();
+    boost::shared_ptr<urdf::ModelInterface> urdf_model = urdf::parseURDF(xml_string);
+    srdf_model->initFile(*urdf_model, (boost::filesystem::path(MOVEIT_TEST_RESOURCES_DIR) / "srdf/robot.xml").string());
+    scene_.reset(new planning_scene::PlanningScene(urdf_model, srdf_model));
+
+    jmg_ = scene_->getRobotModel()->getJointModelGroup("right_arm");
+    goal_.reset(new robot_state::RobotState(scene_->getCurrentState()));
+    goal_->setVariablePosition("r_shoulder_pan_joint", -0.5);
+    goal_->setVariablePosition("r_elbow_flex_joint", -0.5);
+    goal_->update();
+
+    req_.group_name = "right_arm";
+    req_.start_state.is_diff = true;
+    req_.goal_constraints.push_back(kinematic_constraints::constructGoalConstraints(*goal_, jmg_));
+    calls_ = 0;
+    planner_ = boost::bind(&linearPlanner, goal_.get(), &calls_, _1, _2, _3);
+  }
+
+  bool plan(const planning_request_adapter::PlanCacheAdapter &adapter, planning_interface::MotionPlanResponse &res)
+  {
+    std::vector<std::size_t> added_path_index;
+    return adapter.adaptAndPlan(planner_, scene_, req_, res, added_path_index);
+  }
+
+  planning_scene::PlanningScenePtr scene_;
+  const robot_model::JointModelGroup *jmg_;
+  robot_state::RobotStatePtr goal_;
+  planning_interface::MotionPlanRequest req_;
+  std::size_t calls_;
+  planning_request_adapter::PlanningRequestAdapter::PlannerFn planner_;
+};
+
+TEST_F(PlanCacheAdapterTest, ReuseValidPaths)
+{
+  planning_request_adapter::PlanCacheAdapter adapter;
+  planning_interface::MotionPlanResponse res;
+  ASSERT_TRUE(plan(adapter, res));
+  EXPECT_EQ(1, calls_);
+  EXPECT_EQ(1, adapter.getMissCount());
+  EXPECT_EQ(1, adapter.getEntryCount());
+
+  // the same request is answered from the cache, with a copy of the planned path
+  planning_interface::MotionPlanResponse cached;
+  ASSERT_TRUE(plan(adapter, cached));
+  EXPECT_EQ(1, calls_);
+  EXPECT_EQ(1, adapter.getHitCount());
+  ASSERT_TRUE(cached.trajectory_);
+  EXPECT_NE(res.trajectory_.get(), cached.trajectory_.get());
+  ASSERT_EQ(res.trajectory_->getWayPointCount(), cached.trajectory_->getWayPointCount());
+  EXPECT_EQ(0.0, cached.trajectory_->getLastWayPoint().distance(*goal_, jmg_));
+
+  // a start state within the tolerance reuses the path, which then starts at that state
+  req_.start_state.joint_state.name.push_back("r_shoulder_pan_joint");
+  req_.start_state.joint_state.position.push_back(-0.01);
+  ASSERT_TRUE(plan(adapter, cached));
+  EXPECT_EQ(1, calls_);
+  EXPECT_EQ(2, adapter.getHitCount());
+  EXPECT_EQ(-0.01, cached.trajectory_->getFirstWayPoint().getVariablePosition("r_shoulder_pan_joint"));
+
+  // but not one further away
+  req_.start_state.joint_state.position[0] = -0.2;
+  ASSERT_TRUE(plan(adapter, cached));
+  EXPECT_EQ(2, calls_);
+  EXPECT_EQ(2, adapter.getMissCount());
+  EXPECT_EQ(2, adapter.getEntryCount());
+
+  // nor a request for another goal
+  req_.start_state.joint_state.position[0] = 0.0;
+  goal_->setVariablePosition("r_elbow_flex_joint", -1.0);
+  goal_->update();
+  req_.goal_constraints[0] = kinematic_constraints::constructGoalConstraints(*goal_, jmg_);
+  ASSERT_TRUE(plan(adapter, cached));
+  EXPECT_EQ(3, calls_);
+  EXPECT_EQ(3, adapter.getEntryCount());
+
+  // the least recently used paths are removed first
+  adapter.setMaxEntries(1);
+  EXPECT_EQ(1, adapter.getEntryCount());
+  ASSERT_TRUE(plan(adapter, cached));
+  EXPECT_EQ(3, calls_);
+  adapter.clear();
+  EXPECT_EQ(0, adapter.getEntryCount());
+}
+
+TEST_F(PlanCacheAdapterTest, InvalidatePaths)
+{
+  planning_request_adapter::PlanCacheAdapter adapter;
+  planning_interface::MotionPlanResponse res;
+  ASSERT_TRUE(plan(adapter, res));
+  ASSERT_TRUE(plan(adapter, res));
+  EXPECT_EQ(1, calls_);
+
+  // an obstacle in the middle of the path makes the cached path invalid, so the planner is called again
+  const robot_state::RobotState &middle = res.trajectory_->getWayPoint(res.trajectory_->getWayPointCount() / 2);
+  scene_->getWorldNonConst()->addToObject("box", shapes::ShapeConstPtr(new shapes::Box(0.1, 0.1, 0.1)),
+                                          middle.getGlobalLinkTransform("r_wrist_roll_link"));
+  ASSERT_FALSE(scene_->isPathValid(*res.trajectory_, "right_arm"));
+  ASSERT_TRUE(plan(adapter, res));
+  EXPECT_EQ(2, calls_);
+  EXPECT_EQ(1, adapter.getInvalidatedCount());
+  EXPECT_EQ(1, adapter.getEntryCount());
+
+  // once the obstacle is gone, the new path is reused
+  scene_->getWorldNonConst()->removeObject("box");
+  ASSERT_TRUE(plan(adapter, res));
+  EXPECT_EQ(2, calls_);
+  EXPECT_EQ(1, adapter.getInvalidatedCount());
+}
+
+TEST_F(PlanCacheAdapterTest, SaveAndLoad)
+{
+  planning_request_adapter::PlanCacheAdapter adapter;
+  planning_interface::MotionPlanResponse res;
+  ASSERT_TRUE(plan(adapter, res));
+
+  boost::filesystem::path filename = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+  ASSERT_TRUE(adapter.saveToFile(filename.string()));
+
+  planning_request_adapter::PlanCacheAdapter loaded;
+  EXPECT_TRUE(loaded.loadFromFile(filename.string(), scene_->getRobotModel()));
+  boost::filesystem::remove(filename);
+  EXPECT_EQ(1, loaded.getEntryCount());
+
+  // the loaded path is validated and used without planning
+  planning_interface::MotionPlanResponse cached;
+  ASSERT_TRUE(plan(loaded, cached));
+  EXPECT_EQ(1, calls_);
+  EXPECT_EQ(1, loaded.getHitCount());
+  ASSERT_EQ(res.trajectory_->getWayPointCount(), cached.trajectory_->getWayPointCount());
+  for (std::size_t i = 0 ; i < cached.trajectory_->getWayPointCount() ; ++i)
+    EXPECT_EQ(0.0, cached.trajectory_->getWayPoint(i).distance(res.trajectory_->getWayPoint(i), jmg_));
+
+  EXPECT_FALSE(loaded.loadFromFile(filename.string(), scene_->getRobotModel()));
+}
+
+int main(int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,120 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2013, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#ifndef MOVEIT_PLANNING_SCENE_ASYNC_OCTOMAP_PROCESSOR_
+#define MOVEIT_PLANNING_SCENE_ASYNC_OCTOMAP_PROCESSOR_
+
+#include <moveit/planning_scene/planning_scene.h>
+#include <moveit/background_processing/background_processing.h>
+#include <octomap_msgs/OctomapWithPose.h>
+#include <geometry_msgs/Pose.h>
+#include <boost/noncopyable.hpp>
+#include <boost/function.hpp>
+#include <boost/thread/mutex.hpp>
+
+namespace planning_scene
+{
+
+/** \brief Decode octomap messages in a background thread, so that the thread updating a planning scene is not
+    blocked by it.
+
+    Messages are passed to processOctomapMsg(), which returns immediately. A worker thread deserializes the
+    octree and (optionally) builds its FCL collision geometry, which is cached and later used by the scene.
+    Updates are coalesced: if messages arrive faster than they are decoded, only the latest one is decoded.
+    The decoded octomap is swapped into a scene by the thread that owns the scene, with applyPendingUpdate(),
+    which only replaces the octomap object of the world. */
+class AsyncOctomapProcessor : private boost::noncopyable
+{
+public:
+
+  /** \brief Called from the worker thread when a decoded octomap is ready to be applied */
+  typedef boost::function<void()> UpdateReadyFn;
+
+  /** \brief If \e build_fcl_geometry is true, the FCL representation of the octree is constructed in the background too */
+  AsyncOctomapProcessor(bool build_fcl_geometry = true);
+
+  /** \brief Waits for the message being decoded, if any; pending messages are discarded */
+  ~AsyncOctomapProcessor();
+
+  void setUpdateReadyCallback(const UpdateReadyFn &callback);
+
+  /** \brief Queue \e map for decoding. A message that is queued but not yet being decoded is replaced. A message with
+      no data removes the octomap from the scene when applied. */
+  void processOctomapMsg(const octomap_msgs::OctomapWithPoseConstPtr &map);
+
+  /** \brief Same as above, but the message is copied */
+  void processOctomapMsg(const octomap_msgs::OctomapWithPose &map);
+
+  /** \brief True if a decoded octomap is waiting to be applied */
+  bool hasPendingUpdate() const;
+
+  /** \brief If a decoded octomap is waiting, replace the octomap of \e scene with it and return true. The frame of the
+      message is looked up in the transforms of \e scene */
+  bool applyPendingUpdate(PlanningScene &scene);
+
+  /** \brief The number of messages that were replaced by newer ones before they were decoded or applied (this includes
+      messages discarded at destruction) */
+  std::size_t getCoalescedCount() const;
+
+private:
+
+  /** \brief A decoded octomap */
+  struct Update
+  {
+    /// the octree shape; NULL if the octomap is to be removed
+    shapes::ShapeConstPtr                             shape_;
+    std::string                                       frame_id_;
+    geometry_msgs::Pose                               origin_;
+
+    /// the object the cached collision geometry refers to until the update is applied
+    boost::shared_ptr<collision_detection::World::Object> placeholder_;
+  };
+
+  void decode(const octomap_msgs::OctomapWithPoseConstPtr &map);
+
+  bool                                 build_fcl_geometry_;
+  UpdateReadyFn                        update_ready_callback_;
+
+  mutable boost::mutex                 lock_;
+  boost::shared_ptr<Update>            pending_;
+  /// the number of decoded octomaps that were replaced before being applied
+  std::size_t                          replaced_;
+
+  /// declared last so that the worker thread is stopped before the other members are destroyed
+  moveit::tools::BackgroundProcessing  worker_;
+};
+
+}
+
+#endif
@@ -0,0 +1,173 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2013, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#ifndef MOVEIT_PLANNING_SCENE_LAZY_VALIDITY_CHECKER_
+#define MOVEIT_PLANNING_SCENE_LAZY_VALIDITY_CHECKER_
+
+#include <moveit/planning_scene/planning_scene.h>
+#include <boost/noncopyable.hpp>
+#include <boost/unordered_map.hpp>
+#include <map>
+
+namespace planning_scene
+{
+
+/** \brief Deferred validity checking of states and motions, for planners (e.g., lazy roadmaps) that only check the
+    candidate paths they find.
+
+    States and edges (motions between two states) are registered without being checked, and are identified by the
+    handles that are returned. resolvePath() then checks a candidate path: the states and the interpolated states
+    along the edges that are not known yet are checked in order of decreasing likelihood of failure, estimated from
+    the results seen so far in the same region of the space of the group, using the threads set by
+    PlanningScene::setPathValidationThreadCount() (taken from the shared moveit::tools::ThreadPool). Checking stops as soon as a failure is found, so the states checked
+    are mostly the ones needed to reject the path. Results are remembered, so a state or part of an edge is checked
+    only once. Validity is the same as for PlanningScene::isStateValid() without constraints. */
+class LazyValidityChecker : private boost::noncopyable
+{
+public:
+
+  typedef std::size_t StateHandle;
+  typedef std::size_t EdgeHandle;
+
+  enum Status
+  {
+    UNKNOWN, VALID, INVALID
+  };
+
+  /** \brief Check states of \e scene, for \e group (the complete robot if empty). The scene must not change while
+      results are in use */
+  LazyValidityChecker(const PlanningSceneConstPtr &scene, const std::string &group = "");
+
+  /** \brief Set the largest distance between consecutive states checked along an edge (0.05 by default); this only
+      applies to edges added afterwards */
+  void setResolution(double resolution);
+
+  double getResolution() const
+  {
+    return resolution_;
+  }
+
+  /** \brief Set the size of the cells of the space of the group in which failures are counted (0.25 by default) */
+  void setRegionSize(double size);
+
+  double getRegionSize() const
+  {
+    return region_size_;
+  }
+
+  /** \brief Register \e state, without checking it */
+  StateHandle addState(const robot_state::RobotState &state);
+
+  /** \brief Register the motion between the states \e a and \e b, without checking it. The same handle is returned
+      for the same pair of states, in either order */
+  EdgeHandle addEdge(StateHandle a, StateHandle b);
+
+  const robot_state::RobotState& getState(StateHandle state) const
+  {
+    return *states_[state].state_;
+  }
+
+  Status getStateStatus(StateHandle state) const
+  {
+    return states_[state].status_;
+  }
+
+  /** \brief An edge is invalid as soon as one of its states is */
+  Status getEdgeStatus(EdgeHandle edge) const;
+
+  /** \brief Check the path through the states \e path, registering the edges between consecutive states as needed.
+      Return true if all the states and edges of the path are valid; otherwise, at least one of them is known to be
+      invalid when this function returns */
+  bool resolvePath(const std::vector<StateHandle> &path);
+
+  /** \brief The number of states checked so far */
+  std::size_t getCheckCount() const
+  {
+    return check_count_;
+  }
+
+  /** \brief Forget all states, edges and failure statistics */
+  void clear();
+
+private:
+
+  struct State
+  {
+    robot_state::RobotStatePtr state_;
+    Status                     status_;
+  };
+
+  struct Edge
+  {
+    StateHandle                from_;
+    StateHandle                to_;
+    Status                     status_;
+    /// the interior states, at (k + 1) / (checked_.size() + 1) along the edge, that were found valid
+    std::vector<unsigned char> checked_;
+  };
+
+  struct RegionStatistics
+  {
+    RegionStatistics() : checks_(0), failures_(0)
+    {
+    }
+
+    std::size_t checks_;
+    std::size_t failures_;
+  };
+
+  struct Check;
+  struct Resolution;
+
+  std::size_t getRegion(const robot_state::RobotState &state) const;
+  double getFailureLikelihood(std::size_t region) const;
+
+  PlanningSceneConstPtr                                    scene_;
+  std::string                                              group_name_;
+  const robot_model::JointModelGroup                      *group_;
+  double                                                   resolution_;
+  double                                                   region_size_;
+
+  std::vector<State>                                       states_;
+  std::vector<Edge>                                        edges_;
+  std::map<std::pair<StateHandle, StateHandle>, EdgeHandle> edge_index_;
+
+  /// keyed by the hash of the cell of a state; distinct cells may share statistics, which only affects the order of checks
+  boost::unordered_map<std::size_t, RegionStatistics>      regions_;
+  std::size_t                                              check_count_;
+};
+
+}
+
+#endif
@@ -53,8 +53,10 @@
 #include <boost/enable_shared_from_this.hpp>
 #include <boost/noncopyable.hpp>
 #include <boost/shared_ptr.hpp>
+#include <boost/scoped_ptr.hpp>
 #include <boost/function.hpp>
 #include <boost/concept_check.hpp>
+#include <boost/cstdint.hpp>
 
 /** \brief This namespace includes the central class for representing planning contexts */
 namespace planning_scene
@@ -79,6 +81,64 @@ typedef std::map<std::string, std_msgs::ColorRGBA> ObjectColorMap;
 /** \brief A map from object names (e.g., attached bodies, collision objects) to their types */
 typedef std::map<std::string, object_recognition_msgs::ObjectType> ObjectTypeMap;
 
+/** \brief The checks PlanningScene::isStateValid() and PlanningScene::isPathValid() run for each state */
+namespace ValidityStages
+{
+enum Type
+{
+  NONE,                     /**< \brief No check rejected the state */
+  BOUNDS,                   /**< \brief The variables of the checked group (or of the robot) are within their bounds */
+  JOINT_CONSTRAINTS,
+  POSITION_CONSTRAINTS,
+  ORIENTATION_CONSTRAINTS,
+  VISIBILITY_CONSTRAINTS,
+  FEASIBILITY,              /**< \brief The state feasibility predicate (see PlanningScene::setStateFeasibilityPredicate()) */
+  COLLISION,
+  STAGE_COUNT
+};
+}
+typedef ValidityStages::Type ValidityStage;
+
+/** \brief Measurements of one of the checks run by PlanningScene::isStateValid() */
+struct ValidityStageStatistics
+{
+  ValidityStageStatistics() : stage(ValidityStages::NONE), evaluations(0), rejections(0), time(0.0)
+  {
+  }
+
+  ValidityStage stage;
+  std::size_t   evaluations; // the number of states the check was run for
+  std::size_t   rejections;  // the number of states the check rejected
+  double        time;        // the total time spent in the check, in seconds
+};
+
+/** \brief A world object of a planning scene that a SceneVariant attaches to the robot */
+struct SceneVariantAttachment
+{
+  SceneVariantAttachment() : pose(Eigen::Affine3d::Identity())
+  {
+  }
+
+  std::string              object_id;
+  std::string              link_name;
+  Eigen::Affine3d          pose;        // the pose of the object (of its first shape) relative to the link
+  std::vector<std::string> touch_links;
+
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+};
+
+/** \brief A variant of a planning scene, where some world objects are moved, and some are attached to the robot
+    (see PlanningScene::checkCollisionVariants()). The pose of an object is the pose of its first shape; the other
+    shapes keep their pose relative to it. */
+struct SceneVariant
+{
+  typedef std::map<std::string, Eigen::Affine3d, std::less<std::string>,
+                   Eigen::aligned_allocator<std::pair<const std::string, Eigen::Affine3d> > > ObjectPoseMap;
+
+  ObjectPoseMap object_poses;
+  std::vector<SceneVariantAttachment, Eigen::aligned_allocator<SceneVariantAttachment> > attached_objects;
+};
+
 /** \brief This class maintains the representation of the
     environment as seen by a planning instance. The environment
     geometry, the robot geometry and state are maintained. */
@@ -132,6 +192,14 @@ public:
    * has the diffs specified by \e msg applied. */
   PlanningScenePtr diff(const moveit_msgs::PlanningScene &msg) const;
 
+  /** \brief Get a read-only copy of the scene as it is now, which later changes to this scene do not affect. Unlike
+   *  children created with diff(), the snapshot does not refer to this scene, so it can be used from other threads
+   *  while this scene keeps changing. Creating it copies the current state, ACM and transforms, but no collision
+   *  geometry: the world and the broad phase of the collision worlds are shared with this scene, copy on write.
+   *  As long as the scene does not change (see getVersion()) and a snapshot is in use, the same snapshot is
+   *  returned, so concurrent planners share it. This function can be called concurrently with other const functions. */
+  PlanningSceneConstPtr getSnapshot() const;
+
   /** \brief Get the parent scene (whith respect to which the diffs are maintained). This may be empty */
   const PlanningSceneConstPtr& getParent() const
   {
@@ -407,6 +475,44 @@ public:
                       const robot_state::RobotState &kstate,
                       const collision_detection::AllowedCollisionMatrix& acm) const;
 
+  /** \brief Check a batch of states for collisions, with respect to the allowed collision matrix of this scene.
+      The states are distributed over \e thread_count threads (if 0, the number of hardware threads is used).
+      If \e stop_at_first_collision is true, no states after the first one found in collision are checked.
+      The collision transforms of the states are expected to be up to date. \e res is filled with one result per state.
+      Return the index of the first state found in collision, or -1 if all states are collision free. */
+  int checkCollisionBatch(const collision_detection::CollisionRequest& req,
+                          std::vector<collision_detection::CollisionResult> &res,
+                          const std::vector<const robot_state::RobotState*> &states,
+                          bool stop_at_first_collision = false, unsigned int thread_count = 0) const
+  {
+    return checkCollisionBatch(req, res, states, getAllowedCollisionMatrix(), stop_at_first_collision, thread_count);
+  }
+
+  /** \brief Check a batch of states for collisions, with respect to a given allowed collision matrix (\e acm).
+      See the variant above for the meaning of the arguments. */
+  int checkCollisionBatch(const collision_detection::CollisionRequest& req,
+                          std::vector<collision_detection::CollisionResult> &res,
+                          const std::vector<const robot_state::RobotState*> &states,
+                          const collision_detection::AllowedCollisionMatrix& acm,
+                          bool stop_at_first_collision = false, unsigned int thread_count = 0) const;
+
+  /** \brief Check the waypoints of \e trajectory for collisions, with respect to the allowed collision matrix of this scene.
+      See the variant above for the meaning of the arguments. */
+  int checkCollisionBatch(const collision_detection::CollisionRequest& req,
+                          std::vector<collision_detection::CollisionResult> &res,
+                          const robot_trajectory::RobotTrajectory &trajectory,
+                          bool stop_at_first_collision = false, unsigned int thread_count = 0) const;
+
+  /** \brief Check a set of states for collisions in each of a set of variants of this scene, without constructing a
+      diff of the scene for each variant. \e colliding is filled with one vector per variant, with one entry per state.
+      The states are checked once against the world objects no variant changes (using the collision world of this scene);
+      only the objects a variant moves or attaches are then checked for each variant, along with self collisions of the
+      states that a variant attaches objects to. The collision transforms of the states are expected to be up to date. */
+  void checkCollisionVariants(const std::vector<const robot_state::RobotState*> &states,
+                              const std::vector<SceneVariant> &variants,
+                              std::vector<std::vector<bool> > &colliding,
+                              const std::string &group = "") const;
+
   /** \brief Check whether the current state is in collision,
       but use a collision_detection::CollisionRobot instance that has no padding.
       Since the function is non-const, the current state transforms are also updated if needed. */
@@ -658,11 +764,43 @@ public:
   
   /** \brief Load the geometry of the planning scene from a stream */
   void loadGeometryFromStream(std::istream &in);
+
+  /** \brief Save the complete planning scene to a stream, in a compact binary format: the world objects (including
+      mesh buffers and the octomap), the current state with its attached bodies, the allowed collision matrix, the
+      fixed transforms, link padding and scaling, and the object colors and types. The format is meant for recording
+      and replaying scenes on the same platform; it is not portable across architectures. Return true on success */
+  bool saveSnapshotToStream(std::ostream &out) const;
+
+  /** \brief Save the complete planning scene to the file \e filename (see saveSnapshotToStream()) */
+  bool saveSnapshotToFile(const std::string &filename) const;
+
+  /** \brief Replace the content of the planning scene with a snapshot produced by saveSnapshotToStream(), stored in the
+      buffer \e data of \e size bytes. The scene is not modified if the snapshot is invalid or was recorded for a
+      different robot model. Conditional collision checks (see AllowedCollisionMatrix) are not part of snapshots */
+  bool loadSnapshotFromMemory(const char *data, std::size_t size);
+
+  /** \brief Replace the content of the planning scene with a snapshot stored in the file \e filename. The file is
+      memory mapped, so the mesh and octomap data is only copied once, into the shapes of the scene */
+  bool loadSnapshotFromFile(const std::string &filename);
   
   /** \brief Fill the message \e scene with the differences between this instance of PlanningScene with respect to the parent.
       If there is no parent, everything is considered to be a diff and the function behaves like getPlanningSceneMsg() */
   void getPlanningSceneDiffMsg(moveit_msgs::PlanningScene &scene) const;
 
+  /** \brief Get the version of the scene. Every change made to the world of the scene, and every change made or possibly
+      made through the non-const accessors of the scene (e.g., getCurrentStateNonConst()), increases the version */
+  boost::uint64_t getVersion() const;
+
+  /** \brief Fill the message \e scene with the changes made to this instance of PlanningScene after it was at \e version
+      (see getVersion()). Only the parts of the scene that changed are included: the world objects that changed, and the
+      complete robot state, fixed transforms, allowed collision matrix, link padding and scaling or object colors if
+      they changed. The cost is proportional to the size of the changes, not to the size of the scene. The octomap is
+      included as a whole if it changed. Removing the octomap and removing all object colors or types cannot be
+      expressed in a diff message.
+      Changes are only known for recent versions; if \e version is too old (or was not produced by this scene), the
+      complete scene is written instead, as by getPlanningSceneMsg(), and false is returned */
+  bool getPlanningSceneDiffMsg(moveit_msgs::PlanningScene &scene, boost::uint64_t version) const;
+
   /** \brief Construct a message (\e scene) with all the necessary data so that the scene can be later reconstructed to be
       exactly the same using setPlanningSceneMsg() */
   void getPlanningSceneMsg(moveit_msgs::PlanningScene &scene) const;
@@ -691,6 +829,10 @@ public:
   void processOctomapMsg(const octomap_msgs::Octomap &map);
   void processOctomapPtr(const boost::shared_ptr<const octomap::OcTree> &octree, const Eigen::Affine3d &t);
 
+  /** \brief Replace the octomap of the scene with the shape \e octree (of type shapes::OCTREE), at pose \e t.
+      Unlike processOctomapPtr(), the shape itself is kept, so collision data already built for it (see AsyncOctomapProcessor) is used */
+  void processOctomapShape(const shapes::ShapeConstPtr &octree, const Eigen::Affine3d &t);
+
   /** \brief Set the current robot state to be \e state. If not
       all joint values are specified, the previously maintained
       joint values are kept. */
@@ -731,6 +873,12 @@ public:
       parent and the pointer to the parent is discarded. */
   void decoupleParent();
 
+  /** \brief Make this scene a diff with respect to the last scene in its chain of parents (the one that has no parent),
+      by merging the diffs of the scenes in between into this one. Only the data that differs from that last parent is
+      processed, and the data of scenes in between that are used only by this scene is taken over rather than copied.
+      The content of the scene does not change. This function is a no-op if the parent has no parent itself. */
+  void flattenParents();
+
   /** \brief Specify a predicate that decides whether states are considered valid or invalid for reasons beyond ones covered by collision checking and constraint evaluation.
       This is useful for setting up problem specific constraints (e.g., stability) */
   void setStateFeasibilityPredicate(const StateFeasibilityFn &fn)
@@ -756,6 +904,54 @@ public:
     return motion_feasibility_;
   }
 
+  /** \brief Set the number of threads isPathValid() distributes the waypoints of a path over (1 by default, which
+      means the waypoints are checked by the calling thread). The threads come from the shared moveit::tools::ThreadPool,
+      so at most its thread count is used. When using more than one thread, the state feasibility predicate must be safe
+      to call from multiple threads at the same time. */
+  void setPathValidationThreadCount(unsigned int thread_count)
+  {
+    path_validation_threads_ = thread_count > 0 ? thread_count : 1;
+  }
+
+  /** \brief Get the number of threads used by isPathValid() */
+  unsigned int getPathValidationThreadCount() const
+  {
+    return path_validation_threads_;
+  }
+
+  /** \brief Set the number of constraint sets, constructed from moveit_msgs::Constraints messages, that
+      isStateConstrained() and isStateValid() keep for the messages most recently checked (16 by default; 0 disables
+      the cache). A kept set is only reused for an identical message, and as long as the fixed frames its constraints
+      are expressed in have not changed. */
+  void setConstraintSetCacheSize(std::size_t size);
+
+  /** \brief Get the number of constraint sets kept for recently checked constraint messages */
+  std::size_t getConstraintSetCacheSize() const;
+
+  /** \brief Set the number of collision checks of isStateColliding() (and so isStateValid()) that are remembered, so that
+      checking the same state again does not require collision checking (0 by default, which disables the cache).
+      A check is reused for a state with the same attached bodies, checked for the same group, whose variables fall in the
+      same cells of the grid set by setStateValidityCacheTolerance(). All the remembered checks are dropped when the scene
+      (or one of its parents) changes (see getVersion()), or when its collision matrix or world is modified through a
+      held reference. Verbose checks are never cached. Feasibility and constraints are
+      evaluated for every call, as they do not only depend on the scene. */
+  void setStateValidityCacheSize(std::size_t size);
+
+  /** \brief Get the number of collision checks remembered by isStateColliding() */
+  std::size_t getStateValidityCacheSize() const;
+
+  /** \brief Set the resolution of the grid the variables of states are snapped to, to decide whether a remembered
+      collision check can be reused (0 by default, which means only identical states reuse a check). States in the same
+      cell are considered the same, so this should be well below the distance at which collisions are resolved */
+  void setStateValidityCacheTolerance(double tolerance);
+
+  /** \brief Get the resolution of the grid used to decide whether a remembered collision check can be reused */
+  double getStateValidityCacheTolerance() const;
+
+  /** \brief Get the number of collision checks answered from the cache (\e hits) and computed (\e misses) since the
+      cache was last configured */
+  void getStateValidityCacheStatistics(std::size_t &hits, std::size_t &misses) const;
+
   /** \brief Check if a given state is feasible, in accordance to the feasibility predicate specified by setStateFeasibilityPredicate(). Returns true if no feasibility predicate was specified. */
   bool isStateFeasible(const moveit_msgs::RobotState &state, bool verbose = false) const;
 
@@ -777,17 +973,45 @@ public:
   /** \brief Check if a given state is valid. This means checking for collisions and feasibility */
   bool isStateValid(const moveit_msgs::RobotState &state, const std::string &group = "", bool verbose = false) const;
 
-  /** \brief Check if a given state is valid. This means checking for collisions and feasibility */
-  bool isStateValid(const robot_state::RobotState &state, const std::string &group = "", bool verbose = false) const;
+  /** \brief Check if a given state is valid. This means checking for collisions and feasibility. If \e rejected_by is not NULL,
+      it is set to the check that rejected the state (ValidityStages::NONE if the state is valid) */
+  bool isStateValid(const robot_state::RobotState &state, const std::string &group = "", bool verbose = false,
+                    ValidityStage *rejected_by = NULL) const;
 
   /** \brief Check if a given state is valid. This means checking for collisions, feasibility  and whether the user specified validity conditions hold as well */
   bool isStateValid(const moveit_msgs::RobotState &state, const moveit_msgs::Constraints &constr, const std::string &group = "", bool verbose = false) const;
 
   /** \brief Check if a given state is valid. This means checking for collisions, feasibility  and whether the user specified validity conditions hold as well */
-  bool isStateValid(const robot_state::RobotState &state, const moveit_msgs::Constraints &constr, const std::string &group = "", bool verbose = false) const;
+  bool isStateValid(const robot_state::RobotState &state, const moveit_msgs::Constraints &constr, const std::string &group = "", bool verbose = false,
+                    ValidityStage *rejected_by = NULL) const;
 
-  /** \brief Check if a given state is valid. This means checking for collisions, feasibility  and whether the user specified validity conditions hold as well */
-  bool isStateValid(const robot_state::RobotState &state, const kinematic_constraints::KinematicConstraintSet &constr, const std::string &group = "", bool verbose = false) const;
+  /** \brief Check if a given state is valid. This means checking for collisions, feasibility  and whether the user specified validity conditions hold as well.
+      The checks (see ValidityStages) stop at the first one that fails, and run in the order given by getValidityStageOrder().
+      If \e rejected_by is not NULL, it is set to the check that rejected the state (ValidityStages::NONE if the state is valid) */
+  bool isStateValid(const robot_state::RobotState &state, const kinematic_constraints::KinematicConstraintSet &constr, const std::string &group = "", bool verbose = false,
+                    ValidityStage *rejected_by = NULL) const;
+
+  /** \brief Enable or disable the adaptive ordering of the checks run by isStateValid() and isPathValid() (enabled by default).
+      The checks initially run from the cheapest to the most expensive: bounds, joint, position, orientation and visibility constraints,
+      feasibility and collision. With adaptive ordering, the order is periodically updated so that the checks that reject the most
+      states per unit of measured time run first. The result of a check does not depend on the order. Disabling adaptive ordering
+      restores the initial order. */
+  void setAdaptiveValidityStageOrdering(bool flag);
+
+  /** \brief Check whether the order of the checks run by isStateValid() adapts to their measured cost and rejection rate */
+  bool getAdaptiveValidityStageOrdering() const;
+
+  /** \brief Get the order the checks of isStateValid() currently run in */
+  void getValidityStageOrder(std::vector<ValidityStage> &order) const;
+
+  /** \brief Get the measurements of the checks of isStateValid() (one entry per check, in the order of ValidityStages) */
+  void getValidityStageStatistics(std::vector<ValidityStageStatistics> &stats) const;
+
+  /** \brief Forget the measurements of the checks of isStateValid() and restore their initial order */
+  void resetValidityStageStatistics();
+
+  /** \brief Get the name of a check of isStateValid() */
+  static const char* getValidityStageName(ValidityStage stage);
 
   /** \brief Check if a given path is valid. Each state is checked for validity (collision avoidance and feasibility) */
   bool isPathValid(const moveit_msgs::RobotState &start_state,
@@ -814,7 +1038,10 @@ public:
                    const std::vector<moveit_msgs::Constraints>& goal_constraints,
                    const std::string &group = "", bool verbose = false, std::vector<std::size_t> *invalid_index = NULL) const;
 
-  /** \brief Check if a given path is valid. Each state is checked for validity (collision avoidance, feasibility and constraint satisfaction). It is also checked that the goal constraints are satisfied by the last state on the passed in trajectory. */
+  /** \brief Check if a given path is valid. Each state is checked for validity (collision avoidance, feasibility and constraint satisfaction). It is also checked that the goal constraints are satisfied by the last state on the passed in trajectory.
+      If \e invalid_index is NULL, the check stops as soon as an invalid state is found; the waypoints are then checked in coarse to fine order
+      (the end points first, then by repeated bisection), so that invalid segments are found early. The waypoints are distributed over
+      the number of threads specified by setPathValidationThreadCount(). */
   bool isPathValid(const robot_trajectory::RobotTrajectory &trajectory,
                    const moveit_msgs::Constraints& path_constraints,
                    const std::vector<moveit_msgs::Constraints>& goal_constraints,
@@ -854,6 +1081,12 @@ public:
   /** \brief Outputs debug information about the planning scene contents */
   void printKnownObjects(std::ostream& out) const;
 
+  /** \brief Get the estimated memory use, in bytes. The process-wide value of each subsystem accounted by
+      moveit::tools::MemoryAccounting (robot states, the collision geometry cache, distance fields, world objects
+      and octomaps) is reported under the subsystem name; the memory of the world objects and octomaps of this
+      scene is reported under "scene/world_objects" and "scene/octomap". */
+  void getMemoryUsage(std::map<std::string, boost::int64_t> &usage) const;
+
   /** \brief Check if a message includes any information about a planning scene, or it is just a default, empty message. */
   static bool isEmpty(const moveit_msgs::PlanningScene &msg);
 
@@ -879,6 +1112,9 @@ private:
   static robot_model::RobotModelPtr createRobotModel(const boost::shared_ptr<const urdf::ModelInterface> &urdf_model,
                                                      const boost::shared_ptr<const srdf::Model> &srdf_model);
 
+  /* Get the constraint set for a constraints message, from the constraint set cache if possible */
+  kinematic_constraints::KinematicConstraintSetConstPtr getConstraintSet(const moveit_msgs::Constraints &constr) const;
+
   void getPlanningSceneMsgCollisionObject(moveit_msgs::PlanningScene &scene, const std::string &ns) const;
   void getPlanningSceneMsgCollisionObjects(moveit_msgs::PlanningScene &scene) const;
   void getPlanningSceneMsgOctomap(moveit_msgs::PlanningScene &scene) const;
@@ -918,6 +1154,9 @@ private:
   typedef std::map<std::string, CollisionDetectorPtr>::iterator CollisionDetectorIterator;
   typedef std::map<std::string, CollisionDetectorPtr>::const_iterator CollisionDetectorConstIterator;
 
+  /* merge the diffs of the parent into this scene, so this scene becomes a diff with respect to the parent's parent */
+  void mergeParent();
+
   void allocateCollisionDetectors();
   void allocateCollisionDetectors(CollisionDetector& detector);
 
@@ -948,6 +1187,38 @@ private:
   StateFeasibilityFn                             state_feasibility_;
   MotionFeasibilityFn                            motion_feasibility_;
 
+  unsigned int                                   path_validation_threads_;
+
+  struct ConstraintSetCache;
+  boost::scoped_ptr<ConstraintSetCache>          constraint_set_cache_; // never NULL, never shared with parent/child
+
+  struct FrameIndexEntry;
+  struct FrameIndex;
+  boost::scoped_ptr<FrameIndex>                  frame_index_;          // never NULL, never shared with parent/child; observes world_
+
+  /* Find the source of frame \e id, recording it in frame_index_ if needed; return NULL if the frame is not known */
+  const FrameIndexEntry* lookupFrame(const std::string &id) const;
+
+  struct ChangeLog;
+  boost::scoped_ptr<ChangeLog>                   change_log_;           // never NULL, never shared with parent/child; observes world_
+
+  struct SnapshotCache;
+  boost::scoped_ptr<SnapshotCache>               snapshot_cache_;       // never NULL, never shared with parent/child
+
+  struct StateValidityCache;
+  boost::scoped_ptr<StateValidityCache>          state_validity_cache_; // never NULL, never shared with parent/child
+
+  struct ValidityStageOrdering;
+  boost::scoped_ptr<ValidityStageOrdering>       validity_stages_;      // never NULL, never shared with parent/child
+
+  /* Run the checks of isStateValid() in the order kept by validity_stages_; return the check that rejected the state */
+  ValidityStage checkStateValidity(const robot_state::RobotState &state, const kinematic_constraints::KinematicConstraintSet *constr,
+                                   const std::string &group, bool verbose) const;
+
+  /* The current state of this scene (copied from the parent if needed), with up to date transforms. Unlike
+     getCurrentStateNonConst(), this does not count as a change of the state */
+  robot_state::RobotState& updatedCurrentState();
+
   boost::scoped_ptr<ObjectColorMap>              object_colors_;
 
   // a map of object types
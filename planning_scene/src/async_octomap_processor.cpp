@@ -0,0 +1,141 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2013, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#include <moveit/planning_scene/async_octomap_processor.h>
+#include <moveit/collision_detection_fcl/collision_common.h>
+#include <geometric_shapes/shapes.h>
+#include <octomap_msgs/conversions.h>
+#include <eigen_conversions/eigen_msg.h>
+#include <boost/bind.hpp>
+
+planning_scene::AsyncOctomapProcessor::AsyncOctomapProcessor(bool build_fcl_geometry) :
+  build_fcl_geometry_(build_fcl_geometry),
+  replaced_(0)
+{
+}
+
+planning_scene::AsyncOctomapProcessor::~AsyncOctomapProcessor()
+{
+  worker_.clear();
+}
+
+void planning_scene::AsyncOctomapProcessor::setUpdateReadyCallback(const UpdateReadyFn &callback)
+{
+  boost::mutex::scoped_lock slock(lock_);
+  update_ready_callback_ = callback;
+}
+
+void planning_scene::AsyncOctomapProcessor::processOctomapMsg(const octomap_msgs::OctomapWithPose &map)
+{
+  processOctomapMsg(octomap_msgs::OctomapWithPoseConstPtr(new octomap_msgs::OctomapWithPose(map)));
+}
+
+void planning_scene::AsyncOctomapProcessor::processOctomapMsg(const octomap_msgs::OctomapWithPoseConstPtr &map)
+{
+  // a message still waiting in the queue is replaced by this one
+  worker_.addJob(boost::bind(&AsyncOctomapProcessor::decode, this, map), "decode octomap",
+                 moveit::tools::BackgroundProcessing::NORMAL, true);
+}
+
+void planning_scene::AsyncOctomapProcessor::decode(const octomap_msgs::OctomapWithPoseConstPtr &map)
+{
+  boost::shared_ptr<Update> update(new Update());
+  update->frame_id_ = map->header.frame_id;
+  update->origin_ = map->origin;
+  if (!map->octomap.data.empty())
+  {
+    if (map->octomap.id != "OcTree")
+    {
+      logError("Received ocomap is of type '%s' but type 'OcTree' is expected.", map->octomap.id.c_str());
+      return;
+    }
+    boost::shared_ptr<const octomap::OcTree> om(static_cast<octomap::OcTree*>(octomap_msgs::msgToMap(map->octomap)));
+    update->shape_.reset(new shapes::OcTree(om));
+
+    if (build_fcl_geometry_)
+    {
+      // the geometry is kept in the cache of collision_detection_fcl; when the scene adds the octomap object, the cached
+      // entry is only re-pointed to that object
+      update->placeholder_.reset(new collision_detection::World::Object(PlanningScene::OCTOMAP_NS));
+      collision_detection::createCollisionGeometry(update->shape_, update->placeholder_.get());
+    }
+  }
+
+  UpdateReadyFn callback;
+  {
+    boost::mutex::scoped_lock slock(lock_);
+    if (pending_)
+      ++replaced_;
+    pending_ = update;
+    callback = update_ready_callback_;
+  }
+  if (callback)
+    callback();
+}
+
+bool planning_scene::AsyncOctomapProcessor::hasPendingUpdate() const
+{
+  boost::mutex::scoped_lock slock(lock_);
+  return pending_.get() != NULL;
+}
+
+bool planning_scene::AsyncOctomapProcessor::applyPendingUpdate(PlanningScene &scene)
+{
+  boost::shared_ptr<Update> update;
+  {
+    boost::mutex::scoped_lock slock(lock_);
+    update.swap(pending_);
+  }
+  if (!update)
+    return false;
+
+  if (!update->shape_)
+  {
+    scene.processOctomapShape(shapes::ShapeConstPtr(), Eigen::Affine3d::Identity());
+    return true;
+  }
+
+  Eigen::Affine3d p;
+  tf::poseMsgToEigen(update->origin_, p);
+  if (!update->frame_id_.empty())
+    p = scene.getTransforms().getTransform(update->frame_id_) * p;
+  scene.processOctomapShape(update->shape_, p);
+  return true;
+}
+
+std::size_t planning_scene::AsyncOctomapProcessor::getCoalescedCount() const
+{
+  boost::mutex::scoped_lock slock(lock_);
+  return replaced_ + worker_.getJobStatistics(moveit::tools::BackgroundProcessing::NORMAL).removed_;
+}
@@ -0,0 +1,363 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2013, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#include <moveit/planning_scene/lazy_validity_checker.h>
+#include <moveit/background_processing/thread_pool.h>
+#include <boost/functional/hash.hpp>
+#include <boost/thread.hpp>
+#include <boost/bind.hpp>
+#include <algorithm>
+#include <cmath>
+#include <deque>
+
+namespace planning_scene
+{
+
+/* A state to check: a registered state, or an interior state of an edge */
+struct LazyValidityChecker::Check
+{
+  bool        edge_;
+  std::size_t index_;       // the handle of the state or edge
+  std::size_t sample_;      // the interior state of the edge
+  std::size_t region_;
+  double      likelihood_;  // the estimated likelihood of failure
+  std::size_t level_;       // the bisection level of the interior state of the edge (0 for states)
+
+  /* More likely failures first; for the same likelihood, coarser states along edges first */
+  bool operator<(const Check &other) const
+  {
+    if (likelihood_ != other.likelihood_)
+      return likelihood_ > other.likelihood_;
+    return level_ < other.level_;
+  }
+};
+
+namespace
+{
+
+/* The depth at which each of the \e count interior states of an edge is reached when the edge is bisected */
+void computeBisectionLevels(std::size_t count, std::vector<std::size_t> &levels)
+{
+  levels.assign(count, 0);
+  // intervals of segment indices, with the depth of their midpoint
+  std::deque<std::pair<std::pair<std::size_t, std::size_t>, std::size_t> > intervals;
+  intervals.push_back(std::make_pair(std::make_pair(0, count + 1), 0));
+  while (!intervals.empty())
+  {
+    std::size_t lo = intervals.front().first.first;
+    std::size_t hi = intervals.front().first.second;
+    std::size_t depth = intervals.front().second;
+    intervals.pop_front();
+    if (hi - lo < 2)
+      continue;
+    std::size_t mid = (lo + hi) / 2;
+    levels[mid - 1] = depth + 1;
+    intervals.push_back(std::make_pair(std::make_pair(lo, mid), depth + 1));
+    intervals.push_back(std::make_pair(std::make_pair(mid, hi), depth + 1));
+  }
+}
+}
+
+/* The checks of one call to resolvePath(), taken in order by the calling thread and the workers */
+struct LazyValidityChecker::Resolution
+{
+  Resolution(const LazyValidityChecker &checker, const std::vector<Check> &checks) :
+    checker_(checker), checks_(checks), results_(checks.size(), 0), next_(0), found_invalid_(false)
+  {
+  }
+
+  bool isStateValid(const robot_state::RobotState &state) const
+  {
+    return !checker_.scene_->isStateColliding(state, checker_.group_name_) && checker_.scene_->isStateFeasible(state);
+  }
+
+  bool next(std::size_t &index)
+  {
+    boost::mutex::scoped_lock slock(lock_);
+    if (next_ >= checks_.size() || found_invalid_)
+      return false;
+    index = next_++;
+    return true;
+  }
+
+  void run()
+  {
+    robot_state::RobotState scratch(*checker_.states_[0].state_);
+    std::size_t index;
+    while (next(index))
+    {
+      const Check &check = checks_[index];
+      bool valid;
+      if (check.edge_)
+      {
+        const Edge &edge = checker_.edges_[check.index_];
+        double t = (double)(check.sample_ + 1) / (double)(edge.checked_.size() + 1);
+        checker_.states_[edge.from_].state_->interpolate(*checker_.states_[edge.to_].state_, t, scratch);
+        scratch.update();
+        valid = isStateValid(scratch);
+      }
+      else
+        valid = isStateValid(*checker_.states_[check.index_].state_);
+      results_[index] = valid ? 1 : 2;
+      if (!valid)
+      {
+        boost::mutex::scoped_lock slock(lock_);
+        found_invalid_ = true;
+      }
+    }
+  }
+
+  const LazyValidityChecker       &checker_;
+  const std::vector<Check>        &checks_;
+
+  std::vector<unsigned char>       results_;   // 0 if not checked, 1 if valid, 2 if invalid
+  boost::mutex                     lock_;
+  std::size_t                      next_;
+  bool                             found_invalid_;
+};
+
+}
+
+planning_scene::LazyValidityChecker::LazyValidityChecker(const PlanningSceneConstPtr &scene, const std::string &group) :
+  scene_(scene), group_name_(group), group_(NULL), resolution_(0.05), region_size_(0.25), check_count_(0)
+{
+  if (!group.empty())
+  {
+    group_ = scene_->getRobotModel()->getJointModelGroup(group);
+    if (!group_)
+      logError("Group '%s' is not known; distances and regions are computed for the complete robot", group.c_str());
+  }
+}
+
+void planning_scene::LazyValidityChecker::setResolution(double resolution)
+{
+  if (resolution > 0.0)
+    resolution_ = resolution;
+  else
+    logError("The resolution of edges must be positive");
+}
+
+void planning_scene::LazyValidityChecker::setRegionSize(double size)
+{
+  if (size > 0.0)
+  {
+    region_size_ = size;
+    regions_.clear();
+  }
+  else
+    logError("The size of regions must be positive");
+}
+
+planning_scene::LazyValidityChecker::StateHandle planning_scene::LazyValidityChecker::addState(const robot_state::RobotState &state)
+{
+  State s;
+  s.state_.reset(new robot_state::RobotState(state));
+  s.state_->update();
+  s.status_ = UNKNOWN;
+  states_.push_back(s);
+  return states_.size() - 1;
+}
+
+planning_scene::LazyValidityChecker::EdgeHandle planning_scene::LazyValidityChecker::addEdge(StateHandle a, StateHandle b)
+{
+  std::pair<StateHandle, StateHandle> key(std::min(a, b), std::max(a, b));
+  std::map<std::pair<StateHandle, StateHandle>, EdgeHandle>::const_iterator it = edge_index_.find(key);
+  if (it != edge_index_.end())
+    return it->second;
+
+  Edge e;
+  e.from_ = key.first;
+  e.to_ = key.second;
+  e.status_ = UNKNOWN;
+  const robot_state::RobotState &from = *states_[e.from_].state_;
+  const robot_state::RobotState &to = *states_[e.to_].state_;
+  double d = group_ ? from.distance(to, group_) : from.distance(to);
+  std::size_t segments = std::max<std::size_t>(1, (std::size_t)ceil(d / resolution_));
+  e.checked_.resize(segments - 1, 0);
+  edges_.push_back(e);
+  edge_index_[key] = edges_.size() - 1;
+  return edges_.size() - 1;
+}
+
+planning_scene::LazyValidityChecker::Status planning_scene::LazyValidityChecker::getEdgeStatus(EdgeHandle edge) const
+{
+  const Edge &e = edges_[edge];
+  if (e.status_ == INVALID || states_[e.from_].status_ == INVALID || states_[e.to_].status_ == INVALID)
+    return INVALID;
+  return e.status_;
+}
+
+std::size_t planning_scene::LazyValidityChecker::getRegion(const robot_state::RobotState &state) const
+{
+  const double *positions = state.getVariablePositions();
+  std::size_t region = 0;
+  if (group_)
+  {
+    const std::vector<int> &index = group_->getVariableIndexList();
+    for (std::size_t i = 0 ; i < index.size() ; ++i)
+      boost::hash_combine(region, (long)floor(positions[index[i]] / region_size_));
+  }
+  else
+    for (std::size_t i = 0 ; i < state.getVariableCount() ; ++i)
+      boost::hash_combine(region, (long)floor(positions[i] / region_size_));
+  return region;
+}
+
+double planning_scene::LazyValidityChecker::getFailureLikelihood(std::size_t region) const
+{
+  // the mean of the posterior for a uniform prior: regions with no checks get 1/2
+  boost::unordered_map<std::size_t, RegionStatistics>::const_iterator it = regions_.find(region);
+  if (it == regions_.end())
+    return 0.5;
+  return (it->second.failures_ + 1.0) / (it->second.checks_ + 2.0);
+}
+
+bool planning_scene::LazyValidityChecker::resolvePath(const std::vector<StateHandle> &path)
+{
+  if (path.empty())
+    return true;
+
+  std::vector<EdgeHandle> path_edges;
+  for (std::size_t i = 1 ; i < path.size() ; ++i)
+    path_edges.push_back(addEdge(path[i - 1], path[i]));
+
+  // a path that is already known to be invalid needs no checks
+  for (std::size_t i = 0 ; i < path.size() ; ++i)
+    if (states_[path[i]].status_ == INVALID)
+      return false;
+  for (std::size_t i = 0 ; i < path_edges.size() ; ++i)
+    if (getEdgeStatus(path_edges[i]) == INVALID)
+      return false;
+
+  // collect the states of the path that are not known yet, each only once
+  std::vector<Check> checks;
+  std::vector<unsigned char> added_states(states_.size(), 0);
+  std::vector<unsigned char> added_edges(edges_.size(), 0);
+  robot_state::RobotState scratch(*states_[path[0]].state_);
+  std::vector<std::size_t> levels;
+  for (std::size_t i = 0 ; i < path.size() ; ++i)
+    if (states_[path[i]].status_ == UNKNOWN && !added_states[path[i]])
+    {
+      added_states[path[i]] = 1;
+      Check c;
+      c.edge_ = false;
+      c.index_ = path[i];
+      c.sample_ = 0;
+      c.region_ = getRegion(*states_[path[i]].state_);
+      c.likelihood_ = getFailureLikelihood(c.region_);
+      c.level_ = 0;
+      checks.push_back(c);
+    }
+  for (std::size_t i = 0 ; i < path_edges.size() ; ++i)
+  {
+    const Edge &e = edges_[path_edges[i]];
+    if (e.status_ != UNKNOWN || added_edges[path_edges[i]])
+      continue;
+    added_edges[path_edges[i]] = 1;
+    computeBisectionLevels(e.checked_.size(), levels);
+    for (std::size_t k = 0 ; k < e.checked_.size() ; ++k)
+      if (!e.checked_[k])
+      {
+        Check c;
+        c.edge_ = true;
+        c.index_ = path_edges[i];
+        c.sample_ = k;
+        double t = (double)(k + 1) / (double)(e.checked_.size() + 1);
+        states_[e.from_].state_->interpolate(*states_[e.to_].state_, t, scratch);
+        c.region_ = getRegion(scratch);
+        c.likelihood_ = getFailureLikelihood(c.region_);
+        c.level_ = levels[k];
+        checks.push_back(c);
+      }
+  }
+
+  std::stable_sort(checks.begin(), checks.end());
+
+  Resolution resolution(*this, checks);
+  unsigned int thread_count = std::min<std::size_t>(scene_->getPathValidationThreadCount(), checks.size());
+  if (thread_count <= 1)
+    resolution.run();
+  else
+  {
+    moveit::tools::ThreadPool &pool = moveit::tools::ThreadPool::Instance();
+    pool.runConcurrently(boost::bind(&Resolution::run, &resolution), std::min(thread_count, pool.getThreadCount()));
+  }
+
+  // record the results, and the failures for each region
+  for (std::size_t i = 0 ; i < checks.size() ; ++i)
+  {
+    if (!resolution.results_[i])
+      continue;
+    const Check &c = checks[i];
+    bool valid = resolution.results_[i] == 1;
+    ++check_count_;
+    RegionStatistics &stats = regions_[c.region_];
+    ++stats.checks_;
+    if (!valid)
+      ++stats.failures_;
+    if (c.edge_)
+    {
+      if (valid)
+        edges_[c.index_].checked_[c.sample_] = 1;
+      else
+        edges_[c.index_].status_ = INVALID;
+    }
+    else
+      states_[c.index_].status_ = valid ? VALID : INVALID;
+  }
+
+  bool valid = true;
+  for (std::size_t i = 0 ; i < path.size() ; ++i)
+    if (states_[path[i]].status_ != VALID)
+      valid = false;
+  for (std::size_t i = 0 ; i < path_edges.size() ; ++i)
+  {
+    Edge &e = edges_[path_edges[i]];
+    if (e.status_ == UNKNOWN && std::find(e.checked_.begin(), e.checked_.end(), 0) == e.checked_.end() &&
+        states_[e.from_].status_ == VALID && states_[e.to_].status_ == VALID)
+      e.status_ = VALID;
+    if (e.status_ != VALID)
+      valid = false;
+  }
+  return valid;
+}
+
+void planning_scene::LazyValidityChecker::clear()
+{
+  states_.clear();
+  edges_.clear();
+  edge_index_.clear();
+  regions_.clear();
+  check_count_ = 0;
+}
@@ -41,9 +41,29 @@
 #include <moveit/trajectory_processing/trajectory_tools.h>
 #include <moveit/robot_state/conversions.h>
 #include <moveit/exceptions/exceptions.h>
+#include <moveit/profiler/profiler.h>
+#include <moveit/profiler/memory_accounting.h>
+#include <moveit/background_processing/thread_pool.h>
 #include <octomap_msgs/conversions.h>
 #include <eigen_conversions/eigen_msg.h>
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+#include <boost/functional/hash.hpp>
+#include <boost/unordered_map.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/iostreams/device/array.hpp>
+#include <boost/iostreams/device/mapped_file.hpp>
+#include <boost/iostreams/stream.hpp>
+#include <ros/serialization.h>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <limits>
+#include <list>
 #include <set>
+#include <sstream>
 
 namespace planning_scene
 {
@@ -81,6 +101,21 @@ public:
     return scene_->getFrameTransform(from_frame);
   }
 
+  virtual bool canTransform(robot_state::FrameId from_frame) const
+  {
+    return Transforms::canTransform(from_frame) || canTransform(getFrameName(from_frame));
+  }
+
+  virtual bool isFixedFrame(robot_state::FrameId frame) const
+  {
+    return Transforms::isFixedFrame(frame) || isFixedFrame(getFrameName(frame));
+  }
+
+  virtual const Eigen::Affine3d& getTransform(robot_state::FrameId from_frame) const
+  {
+    return getTransform(getFrameName(from_frame));
+  }
+
 private:
 
   bool knowsObject(const std::string &id) const
@@ -96,6 +131,513 @@ private:
   const PlanningScene *scene_;
 };
 
+struct PlanningScene::ConstraintSetCache
+{
+  /* A frame a constraint set was expressed in, and its transform if it was fixed */
+  struct FrameDependency
+  {
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+    std::string     frame_;
+    bool            fixed_;
+    Eigen::Affine3d transform_;
+  };
+
+  struct Entry
+  {
+    std::size_t                                    hash_;
+    std::vector<uint8_t>                           message_;   // the serialized constraints message
+    std::vector<FrameDependency, Eigen::aligned_allocator<FrameDependency> > frames_;
+    kinematic_constraints::KinematicConstraintSetConstPtr set_;
+  };
+
+  ConstraintSetCache() : capacity_(16)
+  {
+  }
+
+  void addFrame(Entry &entry, const robot_state::Transforms &tf, const std::string &frame) const
+  {
+    for (std::size_t i = 0 ; i < entry.frames_.size() ; ++i)
+      if (entry.frames_[i].frame_ == frame)
+        return;
+    FrameDependency dep;
+    dep.frame_ = frame;
+    dep.fixed_ = tf.isFixedFrame(frame);
+    if (dep.fixed_)
+      dep.transform_ = tf.getTransform(frame);
+    entry.frames_.push_back(dep);
+  }
+
+  /* The frames whose transforms KinematicConstraintSet::add() may have used */
+  void recordFrames(Entry &entry, const robot_state::Transforms &tf, const moveit_msgs::Constraints &constr) const
+  {
+    for (std::size_t i = 0 ; i < constr.position_constraints.size() ; ++i)
+      addFrame(entry, tf, constr.position_constraints[i].header.frame_id);
+    for (std::size_t i = 0 ; i < constr.orientation_constraints.size() ; ++i)
+      addFrame(entry, tf, constr.orientation_constraints[i].header.frame_id);
+    for (std::size_t i = 0 ; i < constr.visibility_constraints.size() ; ++i)
+    {
+      addFrame(entry, tf, constr.visibility_constraints[i].target_pose.header.frame_id);
+      addFrame(entry, tf, constr.visibility_constraints[i].sensor_pose.header.frame_id);
+    }
+  }
+
+  bool framesUnchanged(const Entry &entry, const robot_state::Transforms &tf) const
+  {
+    for (std::size_t i = 0 ; i < entry.frames_.size() ; ++i)
+    {
+      const FrameDependency &dep = entry.frames_[i];
+      if (tf.isFixedFrame(dep.frame_) != dep.fixed_)
+        return false;
+      if (dep.fixed_ && tf.getTransform(dep.frame_).matrix() != dep.transform_.matrix())
+        return false;
+    }
+    return true;
+  }
+
+  boost::mutex      lock_;
+  std::size_t       capacity_;
+  std::list<Entry>  entries_;      // most recently used first
+};
+
+/* Where a frame name known to the scene comes from */
+struct PlanningScene::FrameIndexEntry
+{
+  enum Source
+  {
+    MODEL_FRAME,
+    LINK,
+    WORLD_OBJECT,
+    FIXED
+  };
+
+  Source                                     source_;
+  std::string                                name_;     // the frame name without the leading /
+  const robot_model::LinkModel              *link_;
+  collision_detection::World::ObjectConstPtr object_;
+  robot_state::FrameId                       fixed_id_;
+};
+
+/* The sources of the frames resolved so far, so that each frame is resolved with a single lookup */
+struct PlanningScene::FrameIndex
+{
+  /* Entries for world objects are dropped when the objects change; attached bodies depend on the state a frame is
+     resolved for, so they are checked at lookup time for the frames that an attached body could shadow */
+  void objectChanged(const collision_detection::World::ObjectConstPtr &obj, collision_detection::World::Action)
+  {
+    boost::mutex::scoped_lock slock(lock_);
+    entries_.erase(obj->id_);
+    entries_.erase('/' + obj->id_);
+  }
+
+  void clear()
+  {
+    boost::mutex::scoped_lock slock(lock_);
+    entries_.clear();
+  }
+
+  boost::mutex                                    lock_;
+  boost::unordered_map<std::string, FrameIndexEntry> entries_;   // keyed by the frame name both with and without the leading /
+  collision_detection::World::ObserverHandle      observer_handle_;
+};
+
+/* The last snapshot returned by getSnapshot(), while it is in use */
+struct PlanningScene::SnapshotCache
+{
+  SnapshotCache() : version_(0)
+  {
+  }
+
+  boost::mutex                         lock_;
+  boost::weak_ptr<const PlanningScene> snapshot_;
+  boost::uint64_t                      version_;
+};
+
+/* Collision checks of recent states, in an open addressing table split in shards that are locked separately */
+struct PlanningScene::StateValidityCache
+{
+  /* The number of slots a state is looked up in, starting at the slot its hash maps to */
+  static const std::size_t PROBE_LENGTH = 4;
+  static const std::size_t SHARD_COUNT = 16;
+
+  struct Slot
+  {
+    Slot() : generation_(0)
+    {
+    }
+
+    boost::uint64_t                      generation_;   // 0 for empty slots
+    std::size_t                          hash_;
+    std::size_t                          attached_;     // the hash of the attached bodies
+    std::string                          group_;
+    std::vector<boost::int64_t>          cells_;        // the grid cells of the variables
+    bool                                 colliding_;
+  };
+
+  struct Shard
+  {
+    Shard() : victim_(0), hits_(0), misses_(0)
+    {
+    }
+
+    boost::mutex                         lock_;
+    std::vector<Slot>                    slots_;
+    std::size_t                          victim_;       // the probe replaced when all the probed slots are in use
+    std::size_t                          hits_;
+    std::size_t                          misses_;
+  };
+
+  /* A key computed outside the locks */
+  struct Key
+  {
+    std::size_t                          hash_;
+    std::size_t                          attached_;
+    const std::string                   *group_;
+    std::vector<boost::int64_t>          cells_;
+  };
+
+  StateValidityCache() : size_(0), tolerance_(0.0), generation_(1), acm_version_(0), world_version_(0)
+  {
+  }
+
+  /* Drop all slots and set the capacity; the caller holds lock_ */
+  void reset(std::size_t size)
+  {
+    size_ = size;
+    std::size_t slots = size == 0 ? 0 : (size + SHARD_COUNT - 1) / SHARD_COUNT;
+    for (std::size_t i = 0 ; i < SHARD_COUNT ; ++i)
+    {
+      boost::mutex::scoped_lock slock(shards_[i].lock_);
+      shards_[i].slots_.clear();
+      shards_[i].slots_.resize(slots);
+      shards_[i].victim_ = 0;
+      shards_[i].hits_ = 0;
+      shards_[i].misses_ = 0;
+    }
+    ++generation_;
+    versions_.clear();
+  }
+
+  /* The generation of the slots that are valid for \e scene: slots filled before the scene or one of its parents
+     changed are left in place, but no longer match. The collision matrix and the world are compared separately, as
+     they can be modified through the references returned by the non-const accessors without changing the scene version */
+  boost::uint64_t getGeneration(const PlanningScene *scene)
+  {
+    boost::uint64_t acm_version = scene->getAllowedCollisionMatrix().getVersion();
+    boost::uint64_t world_version = scene->getWorld()->getVersion();
+    boost::mutex::scoped_lock slock(lock_);
+    std::size_t i = 0;
+    bool changed = acm_version != acm_version_ || world_version != world_version_;
+    acm_version_ = acm_version;
+    world_version_ = world_version;
+    for (const PlanningScene *s = scene ; s ; s = s->getParent().get(), ++i)
+    {
+      std::pair<const PlanningScene*, boost::uint64_t> v(s, s->getVersion());
+      if (i >= versions_.size())
+      {
+        versions_.push_back(v);
+        changed = true;
+      }
+      else
+        if (versions_[i] != v)
+        {
+          versions_[i] = v;
+          changed = true;
+        }
+    }
+    if (i != versions_.size())
+    {
+      versions_.resize(i);
+      changed = true;
+    }
+    if (changed)
+      ++generation_;
+    return generation_;
+  }
+
+  void computeKey(const robot_state::RobotState &state, const std::string &group, double tolerance, Key &key) const
+  {
+    const double *positions = state.getVariablePositions();
+    std::size_t count = state.getVariableCount();
+    key.cells_.resize(count);
+    for (std::size_t i = 0 ; i < count ; ++i)
+      if (tolerance > 0.0)
+        key.cells_[i] = (boost::int64_t)floor(positions[i] / tolerance);
+      else
+        memcpy(&key.cells_[i], &positions[i], sizeof(boost::int64_t));
+
+    std::vector<const robot_state::AttachedBody*> attached;
+    state.getAttachedBodies(attached);
+    key.attached_ = 0;
+    for (std::size_t i = 0 ; i < attached.size() ; ++i)
+    {
+      const robot_state::AttachedBody *ab = attached[i];
+      boost::hash_combine(key.attached_, ab->getName());
+      boost::hash_combine(key.attached_, ab->getAttachedLinkName());
+      for (std::size_t j = 0 ; j < ab->getShapes().size() ; ++j)
+      {
+        boost::hash_combine(key.attached_, ab->getShapes()[j].get());
+        const Eigen::Affine3d &t = ab->getFixedTransforms()[j];
+        boost::hash_range(key.attached_, t.data(), t.data() + 16);
+      }
+      boost::hash_range(key.attached_, ab->getTouchLinks().begin(), ab->getTouchLinks().end());
+    }
+
+    key.group_ = &group;
+    key.hash_ = boost::hash_range(key.cells_.begin(), key.cells_.end());
+    boost::hash_combine(key.hash_, group);
+    boost::hash_combine(key.hash_, key.attached_);
+  }
+
+  static bool matches(const Slot &slot, const Key &key, boost::uint64_t generation)
+  {
+    return slot.generation_ == generation && slot.hash_ == key.hash_ && slot.attached_ == key.attached_ &&
+      slot.group_ == *key.group_ && slot.cells_ == key.cells_;
+  }
+
+  /* Return true if a check is remembered for \e key, and set \e colliding to its result */
+  bool find(const Key &key, boost::uint64_t generation, bool &colliding)
+  {
+    Shard &shard = shards_[key.hash_ % SHARD_COUNT];
+    boost::mutex::scoped_lock slock(shard.lock_);
+    if (!shard.slots_.empty())
+    {
+      std::size_t home = (key.hash_ / SHARD_COUNT) % shard.slots_.size();
+      for (std::size_t i = 0 ; i < PROBE_LENGTH && i < shard.slots_.size() ; ++i)
+      {
+        const Slot &slot = shard.slots_[(home + i) % shard.slots_.size()];
+        if (matches(slot, key, generation))
+        {
+          colliding = slot.colliding_;
+          ++shard.hits_;
+          return true;
+        }
+      }
+    }
+    ++shard.misses_;
+    return false;
+  }
+
+  void insert(const Key &key, boost::uint64_t generation, bool colliding)
+  {
+    Shard &shard = shards_[key.hash_ % SHARD_COUNT];
+    boost::mutex::scoped_lock slock(shard.lock_);
+    if (shard.slots_.empty())
+      return;
+    std::size_t home = (key.hash_ / SHARD_COUNT) % shard.slots_.size();
+    std::size_t probes = std::min(PROBE_LENGTH, shard.slots_.size());
+    Slot *target = NULL;
+    for (std::size_t i = 0 ; i < probes ; ++i)
+    {
+      Slot &slot = shard.slots_[(home + i) % shard.slots_.size()];
+      if (slot.generation_ != generation || matches(slot, key, generation))
+      {
+        target = &slot;
+        break;
+      }
+    }
+    if (!target)
+      target = &shard.slots_[(home + shard.victim_++ % probes) % shard.slots_.size()];
+    target->generation_ = generation;
+    target->hash_ = key.hash_;
+    target->attached_ = key.attached_;
+    target->group_ = *key.group_;
+    target->cells_ = key.cells_;
+    target->colliding_ = colliding;
+  }
+
+  boost::mutex                                                 lock_;         // protects all but the shards
+  std::size_t                                                  size_;
+  double                                                       tolerance_;
+  boost::uint64_t                                              generation_;
+  std::vector<std::pair<const PlanningScene*, boost::uint64_t> > versions_;   // the scene versions generation_ is for
+  boost::uint64_t                                              acm_version_;   // the collision matrix version generation_ is for
+  boost::uint64_t                                              world_version_; // the world version generation_ is for
+  Shard                                                        shards_[SHARD_COUNT];
+};
+
+/* Measurements of the checks of isStateValid(), and the order they run in */
+struct PlanningScene::ValidityStageOrdering
+{
+  /* The number of states checked between updates of the order, and the number of evaluations of a check before
+     its measurements are trusted; checks with fewer evaluations run first, so they are measured */
+  static const std::size_t UPDATE_PERIOD = 64;
+  static const std::size_t MIN_EVALUATIONS = 16;
+
+  ValidityStageOrdering() : adaptive_(true)
+  {
+    reset();
+  }
+
+  void reset()
+  {
+    for (std::size_t i = 0 ; i < ValidityStages::STAGE_COUNT ; ++i)
+    {
+      stats_[i] = ValidityStageStatistics();
+      stats_[i].stage = (ValidityStage)i;
+    }
+    resetOrder();
+    checks_ = 0;
+  }
+
+  void resetOrder()
+  {
+    // the initial order is the order of ValidityStages, from the cheapest check to the most expensive one
+    for (std::size_t i = 0 ; i < STAGE_ORDER_SIZE ; ++i)
+      order_[i] = (ValidityStage)(i + 1);
+  }
+
+  /* Add the measurements of one call; called with lock_ held */
+  void record(const bool *evaluated, const double *time, ValidityStage rejected_by)
+  {
+    for (std::size_t i = 1 ; i < ValidityStages::STAGE_COUNT ; ++i)
+      if (evaluated[i])
+      {
+        stats_[i].evaluations++;
+        stats_[i].time += time[i];
+      }
+    if (rejected_by != ValidityStages::NONE)
+      stats_[rejected_by].rejections++;
+    if (adaptive_ && ++checks_ % UPDATE_PERIOD == 0)
+      updateOrder();
+  }
+
+  struct CompareScores
+  {
+    CompareScores(const double *score) : score_(score)
+    {
+    }
+
+    bool operator()(ValidityStage a, ValidityStage b) const
+    {
+      return score_[a] > score_[b];
+    }
+
+    const double *score_;
+  };
+
+  /* Order the checks by decreasing rejection rate per unit of time */
+  void updateOrder()
+  {
+    double score[ValidityStages::STAGE_COUNT];
+    for (std::size_t i = 0 ; i < ValidityStages::STAGE_COUNT ; ++i)
+    {
+      const ValidityStageStatistics &s = stats_[i];
+      if (s.evaluations < MIN_EVALUATIONS)
+        score[i] = std::numeric_limits<double>::infinity();
+      else
+        score[i] = ((double)s.rejections / (double)s.evaluations) / std::max(s.time / (double)s.evaluations, 1e-9);
+    }
+    resetOrder();
+    std::stable_sort(order_, order_ + STAGE_ORDER_SIZE, CompareScores(score));
+  }
+
+  static const std::size_t STAGE_ORDER_SIZE = ValidityStages::STAGE_COUNT - 1;
+
+  boost::mutex            lock_;
+  bool                    adaptive_;
+  std::size_t             checks_;
+  ValidityStage           order_[STAGE_ORDER_SIZE];
+  ValidityStageStatistics stats_[ValidityStages::STAGE_COUNT];
+};
+
+/* The versions at which the parts of the scene last changed, so diffs can be computed relative to earlier versions */
+struct PlanningScene::ChangeLog
+{
+  enum Component
+  {
+    STATE,
+    TRANSFORMS,
+    ACM,
+    PADDING,
+    COLORS,
+    COMPONENT_COUNT
+  };
+
+  /* The number of removed objects remembered; when there are more, the older half is forgotten */
+  static const std::size_t MAX_REMOVED_OBJECTS = 1024;
+
+  struct ObjectVersion
+  {
+    boost::uint64_t version_;
+    bool            removed_;
+  };
+
+  ChangeLog() : version_(0), first_version_(0), removed_count_(0)
+  {
+    for (int i = 0 ; i < COMPONENT_COUNT ; ++i)
+      component_versions_[i] = 0;
+  }
+
+  void componentChanged(Component component)
+  {
+    component_versions_[component] = ++version_;
+  }
+
+  void objectChanged(const std::string &id, bool removed)
+  {
+    std::map<std::string, ObjectVersion>::iterator it = objects_.find(id);
+    if (it == objects_.end())
+    {
+      it = objects_.insert(std::make_pair(id, ObjectVersion())).first;
+      it->second.removed_ = false;
+    }
+    else
+      changes_.erase(it->second.version_);
+    if (it->second.removed_ != removed)
+      removed ? ++removed_count_ : --removed_count_;
+    it->second.version_ = ++version_;
+    it->second.removed_ = removed;
+    changes_[version_] = id;
+    if (removed_count_ > MAX_REMOVED_OBJECTS)
+      forgetRemovedObjects();
+  }
+
+  void worldChanged(const collision_detection::World::ObjectConstPtr &obj, collision_detection::World::Action action)
+  {
+    objectChanged(obj->id_, action == collision_detection::World::DESTROY);
+  }
+
+  /* Forget the older half of the removed objects; diffs relative to the versions before them are no longer possible */
+  void forgetRemovedObjects()
+  {
+    std::vector<boost::uint64_t> versions;
+    versions.reserve(removed_count_);
+    for (std::map<std::string, ObjectVersion>::const_iterator it = objects_.begin() ; it != objects_.end() ; ++it)
+      if (it->second.removed_)
+        versions.push_back(it->second.version_);
+    std::nth_element(versions.begin(), versions.begin() + versions.size() / 2, versions.end());
+    boost::uint64_t limit = versions[versions.size() / 2];
+    for (std::map<std::string, ObjectVersion>::iterator it = objects_.begin() ; it != objects_.end() ; )
+      if (it->second.removed_ && it->second.version_ <= limit)
+      {
+        changes_.erase(it->second.version_);
+        objects_.erase(it++);
+        --removed_count_;
+      }
+      else
+        ++it;
+    first_version_ = std::max(first_version_, limit);
+  }
+
+  /* Forget all changes: diffs are only possible relative to the current version */
+  void clear()
+  {
+    objects_.clear();
+    changes_.clear();
+    removed_count_ = 0;
+    first_version_ = ++version_;
+  }
+
+  boost::uint64_t                            version_;
+  boost::uint64_t                            first_version_;   // the oldest version diffs can be computed relative to
+  boost::uint64_t                            component_versions_[COMPONENT_COUNT];
+  std::map<std::string, ObjectVersion>       objects_;         // the version at which each world object last changed
+  std::map<boost::uint64_t, std::string>     changes_;         // the world objects by the version at which they last changed
+  std::size_t                                removed_count_;
+  collision_detection::World::ObserverHandle observer_handle_;
+};
+
 }
 
 bool planning_scene::PlanningScene::isEmpty(const moveit_msgs::PlanningScene &msg)
@@ -151,6 +693,8 @@ planning_scene::PlanningScene::~PlanningScene()
 {
   if (current_world_object_update_callback_)
     world_->removeObserver(current_world_object_update_observer_handle_);
+  world_->removeObserver(frame_index_->observer_handle_);
+  world_->removeObserver(change_log_->observer_handle_);
 }
 
 void planning_scene::PlanningScene::initialize()
@@ -162,6 +706,16 @@ void planning_scene::PlanningScene::initialize()
   kstate_.reset(new robot_state::RobotState(kmodel_));
   kstate_->setToDefaultValues();
 
+  path_validation_threads_ = 1;
+  constraint_set_cache_.reset(new ConstraintSetCache());
+  frame_index_.reset(new FrameIndex());
+  frame_index_->observer_handle_ = world_->addObserver(boost::bind(&FrameIndex::objectChanged, frame_index_.get(), _1, _2));
+  change_log_.reset(new ChangeLog());
+  change_log_->observer_handle_ = world_->addObserver(boost::bind(&ChangeLog::worldChanged, change_log_.get(), _1, _2));
+  snapshot_cache_.reset(new SnapshotCache());
+  state_validity_cache_.reset(new StateValidityCache());
+  validity_stages_.reset(new ValidityStageOrdering());
+
   acm_.reset(new collision_detection::AllowedCollisionMatrix());
   // Use default collision operations in the SRDF to setup the acm
   const std::vector<std::string>& collision_links = kmodel_->getLinkModelNamesWithCollisionGeometry();
@@ -196,11 +750,24 @@ planning_scene::PlanningScene::PlanningScene(const PlanningSceneConstPtr &parent
     name_ = parent_->getName() + "+";
 
   kmodel_ = parent_->kmodel_;
+  path_validation_threads_ = parent_->path_validation_threads_;
+  constraint_set_cache_.reset(new ConstraintSetCache());
+  constraint_set_cache_->capacity_ = parent_->getConstraintSetCacheSize();
 
   // maintain a separate world.  Copy on write ensures that most of the object
   // info is shared until it is modified.
   world_.reset(new collision_detection::World(*parent_->world_));
   world_const_ = world_;
+  frame_index_.reset(new FrameIndex());
+  frame_index_->observer_handle_ = world_->addObserver(boost::bind(&FrameIndex::objectChanged, frame_index_.get(), _1, _2));
+  change_log_.reset(new ChangeLog());
+  change_log_->observer_handle_ = world_->addObserver(boost::bind(&ChangeLog::worldChanged, change_log_.get(), _1, _2));
+  snapshot_cache_.reset(new SnapshotCache());
+  state_validity_cache_.reset(new StateValidityCache());
+  validity_stages_.reset(new ValidityStageOrdering());
+  setAdaptiveValidityStageOrdering(parent_->getAdaptiveValidityStageOrdering());
+  setStateValidityCacheTolerance(parent_->getStateValidityCacheTolerance());
+  setStateValidityCacheSize(parent_->getStateValidityCacheSize());
 
   // record changes to the world
   world_diff_.reset(new collision_detection::WorldDiff(world_));
@@ -247,6 +814,23 @@ planning_scene::PlanningScenePtr planning_scene::PlanningScene::diff(const movei
   return result;
 }
 
+planning_scene::PlanningSceneConstPtr planning_scene::PlanningScene::getSnapshot() const
+{
+  boost::mutex::scoped_lock slock(snapshot_cache_->lock_);
+  PlanningSceneConstPtr snapshot = snapshot_cache_->snapshot_.lock();
+  if (snapshot && snapshot_cache_->version_ == getVersion())
+    return snapshot;
+
+  // the snapshot is only kept while it is in use, as it makes the next change of the
+  // collision worlds of this scene copy their broad phase
+  PlanningScenePtr result = diff();
+  result->name_ = name_;
+  result->decoupleParent();
+  snapshot_cache_->snapshot_ = result;
+  snapshot_cache_->version_ = getVersion();
+  return result;
+}
+
 void planning_scene::PlanningScene::CollisionDetector::copyPadding(const planning_scene::PlanningScene::CollisionDetector& src)
 {
   if (!crobot_)
@@ -352,6 +936,7 @@ bool planning_scene::PlanningScene::setActiveCollisionDetector(const std::string
   if (it != collision_.end())
   {
     active_collision_ = it->second;
+    change_log_->componentChanged(ChangeLog::PADDING);
     return true;
   }
   else
@@ -423,9 +1008,15 @@ void planning_scene::PlanningScene::clearDiffs()
     return;
 
   // clear everything, reset the world, record diffs
+  world_->removeObserver(frame_index_->observer_handle_);
+  world_->removeObserver(change_log_->observer_handle_);
   world_.reset(new collision_detection::World(*parent_->world_));
   world_const_ = world_;
   world_diff_.reset(new collision_detection::WorldDiff(world_));
+  frame_index_->clear();
+  frame_index_->observer_handle_ = world_->addObserver(boost::bind(&FrameIndex::objectChanged, frame_index_.get(), _1, _2));
+  change_log_->clear();
+  change_log_->observer_handle_ = world_->addObserver(boost::bind(&ChangeLog::worldChanged, change_log_.get(), _1, _2));
   if (current_world_object_update_callback_)
     current_world_object_update_observer_handle_ = world_->addObserver(current_world_object_update_callback_);
 
@@ -467,7 +1058,7 @@ void planning_scene::PlanningScene::pushDiffs(const PlanningScenePtr &scene)
     return;
 
   if (ftf_)
-    scene->getTransformsNonConst().setAllTransforms(ftf_->getAllTransforms());
+    scene->getTransformsNonConst().setAllTransforms(*ftf_);
 
   if (kstate_)
     scene->getCurrentStateNonConst() = *kstate_;
@@ -485,6 +1076,9 @@ void planning_scene::PlanningScene::pushDiffs(const PlanningScenePtr &scene)
 
   if (world_diff_)
   {
+    // the observers of the target world are notified once, after all the changes are applied;
+    // objects are shared with this scene's world rather than copied
+    collision_detection::World::ScopedBatch batch(*scene->world_);
     for (collision_detection::WorldDiff::const_iterator it = world_diff_->begin() ; it != world_diff_->end() ; ++it)
     {
       if (it->second == collision_detection::World::DESTROY)
@@ -494,9 +1088,7 @@ void planning_scene::PlanningScene::pushDiffs(const PlanningScenePtr &scene)
       }
       else
       {
-        const collision_detection::World::Object& obj = *world_->getObject(it->first);
-        scene->world_->removeObject(obj.id_);
-        scene->world_->addToObject(obj.id_, obj.shapes_, obj.shape_poses_);
+        scene->world_->setObject(world_->getObject(it->first));
         if (hasObjectColor(it->first))
           scene->setObjectColor(it->first, getObjectColor(it->first));
         if (hasObjectType(it->first))
@@ -509,7 +1101,7 @@ void planning_scene::PlanningScene::pushDiffs(const PlanningScenePtr &scene)
 void planning_scene::PlanningScene::checkCollision(const collision_detection::CollisionRequest& req, collision_detection::CollisionResult &res)
 {
   if (getCurrentState().dirtyCollisionBodyTransforms())
-    checkCollision(req, res, getCurrentStateNonConst());
+    checkCollision(req, res, updatedCurrentState());
   else
     checkCollision(req, res, getCurrentState());
 }
@@ -530,7 +1122,7 @@ void planning_scene::PlanningScene::checkCollision(const collision_detection::Co
 void planning_scene::PlanningScene::checkSelfCollision(const collision_detection::CollisionRequest& req, collision_detection::CollisionResult &res)
 { 
   if (getCurrentState().dirtyCollisionBodyTransforms())
-    checkSelfCollision(req, res, getCurrentStateNonConst());
+    checkSelfCollision(req, res, updatedCurrentState());
   else
     checkSelfCollision(req, res, getCurrentState());
 }
@@ -548,11 +1140,177 @@ void planning_scene::PlanningScene::checkCollision(const collision_detection::Co
     getCollisionRobotUnpadded()->checkSelfCollision(req, res, kstate, acm);
 }
 
+namespace planning_scene
+{
+namespace
+{
+void checkBatchElement(const PlanningScene *scene, const collision_detection::CollisionRequest *req,
+                       const std::vector<const robot_state::RobotState*> *states, const collision_detection::AllowedCollisionMatrix *acm,
+                       std::size_t index, collision_detection::CollisionResult &res)
+{
+  scene->checkCollision(*req, res, *(*states)[index], *acm);
+}
+}
+}
+
+int planning_scene::PlanningScene::checkCollisionBatch(const collision_detection::CollisionRequest& req,
+                                                       std::vector<collision_detection::CollisionResult> &res,
+                                                       const std::vector<const robot_state::RobotState*> &states,
+                                                       const collision_detection::AllowedCollisionMatrix& acm,
+                                                       bool stop_at_first_collision, unsigned int thread_count) const
+{
+  // make sure the compiled version of the collision matrix is computed once, and not by every thread
+  acm.getCompiled();
+  return collision_detection::checkCollisionBatch(boost::bind(&checkBatchElement, this, &req, &states, &acm, _1, _2),
+                                                  states.size(), res, stop_at_first_collision, thread_count);
+}
+
+int planning_scene::PlanningScene::checkCollisionBatch(const collision_detection::CollisionRequest& req,
+                                                       std::vector<collision_detection::CollisionResult> &res,
+                                                       const robot_trajectory::RobotTrajectory &trajectory,
+                                                       bool stop_at_first_collision, unsigned int thread_count) const
+{
+  std::vector<const robot_state::RobotState*> states(trajectory.getWayPointCount());
+  for (std::size_t i = 0 ; i < states.size() ; ++i)
+    states[i] = &trajectory.getWayPoint(i);
+  return checkCollisionBatch(req, res, states, getAllowedCollisionMatrix(), stop_at_first_collision, thread_count);
+}
+
+void planning_scene::PlanningScene::checkCollisionVariants(const std::vector<const robot_state::RobotState*> &states,
+                                                           const std::vector<SceneVariant> &variants,
+                                                           std::vector<std::vector<bool> > &colliding,
+                                                           const std::string &group) const
+{
+  MOVEIT_CORE_PROBE("PlanningScene::checkCollisionVariants");
+  colliding.assign(variants.size(), std::vector<bool>(states.size(), false));
+  if (states.empty() || variants.empty())
+    return;
+
+  // the objects some variant changes; they are left out of the check against the world of this scene
+  std::set<std::string> varied;
+  for (std::size_t k = 0 ; k < variants.size() ; ++k)
+  {
+    const SceneVariant &v = variants[k];
+    for (SceneVariant::ObjectPoseMap::const_iterator it = v.object_poses.begin() ; it != v.object_poses.end() ; ++it)
+      if (world_->hasObject(it->first))
+        varied.insert(it->first);
+      else
+        logWarn("Scene variant %u moves unknown object '%s'", (unsigned int)k, it->first.c_str());
+    for (std::size_t j = 0 ; j < v.attached_objects.size() ; ++j)
+      if (world_->hasObject(v.attached_objects[j].object_id))
+        varied.insert(v.attached_objects[j].object_id);
+      else
+        logWarn("Scene variant %u attaches unknown object '%s'", (unsigned int)k, v.attached_objects[j].object_id.c_str());
+  }
+
+  const collision_detection::AllowedCollisionMatrix &acm = getAllowedCollisionMatrix();
+  collision_detection::AllowedCollisionMatrix static_acm(acm);
+  for (std::set<std::string>::const_iterator it = varied.begin() ; it != varied.end() ; ++it)
+    static_acm.setDefaultEntry(*it, true);
+  acm.getCompiled();
+  static_acm.getCompiled();
+
+  collision_detection::CollisionRequest req;
+  req.group_name = group;
+
+  // the checks shared by all the variants that do not attach objects
+  std::vector<bool> shared_colliding(states.size(), false);
+  for (std::size_t i = 0 ; i < states.size() ; ++i)
+  {
+    collision_detection::CollisionResult res;
+    getCollisionWorld()->checkRobotCollision(req, res, *getCollisionRobot(), *states[i], static_acm);
+    if (!res.collision)
+      getCollisionRobotUnpadded()->checkSelfCollision(req, res, *states[i], acm);
+    shared_colliding[i] = res.collision;
+  }
+
+  for (std::size_t k = 0 ; k < variants.size() ; ++k)
+  {
+    const SceneVariant &v = variants[k];
+
+    // the attached objects, with the transforms of their shapes relative to their link
+    std::vector<const SceneVariantAttachment*> attached;
+    std::vector<collision_detection::World::ObjectConstPtr> attached_objects;
+    std::vector<EigenSTL::vector_Affine3d> attach_trans;
+    for (std::size_t j = 0 ; j < v.attached_objects.size() ; ++j)
+    {
+      collision_detection::World::ObjectConstPtr obj = world_->getObject(v.attached_objects[j].object_id);
+      if (!obj || obj->shapes_.empty())
+        continue;
+      if (!getRobotModel()->hasLinkModel(v.attached_objects[j].link_name))
+      {
+        logWarn("Scene variant %u attaches object '%s' to unknown link '%s'", (unsigned int)k,
+                v.attached_objects[j].object_id.c_str(), v.attached_objects[j].link_name.c_str());
+        continue;
+      }
+      Eigen::Affine3d first_inv = obj->shape_poses_[0].inverse();
+      attach_trans.push_back(EigenSTL::vector_Affine3d(obj->shape_poses_.size()));
+      for (std::size_t s = 0 ; s < obj->shape_poses_.size() ; ++s)
+        attach_trans.back()[s] = v.attached_objects[j].pose * first_inv * obj->shape_poses_[s];
+      attached.push_back(&v.attached_objects[j]);
+      attached_objects.push_back(obj);
+    }
+
+    // the varied objects that stay in the world, at their pose in this variant
+    collision_detection::WorldPtr variant_world(new collision_detection::World());
+    for (std::set<std::string>::const_iterator it = varied.begin() ; it != varied.end() ; ++it)
+    {
+      bool is_attached = false;
+      for (std::size_t j = 0 ; j < attached.size() && !is_attached ; ++j)
+        is_attached = attached[j]->object_id == *it;
+      if (is_attached)
+        continue;
+      collision_detection::World::ObjectConstPtr obj = world_->getObject(*it);
+      SceneVariant::ObjectPoseMap::const_iterator moved = v.object_poses.find(*it);
+      if (moved == v.object_poses.end() || obj->shapes_.empty())
+        variant_world->addToObject(*it, obj->shapes_, obj->shape_poses_);
+      else
+      {
+        Eigen::Affine3d offset = moved->second * obj->shape_poses_[0].inverse();
+        EigenSTL::vector_Affine3d poses(obj->shape_poses_.size());
+        for (std::size_t s = 0 ; s < poses.size() ; ++s)
+          poses[s] = offset * obj->shape_poses_[s];
+        variant_world->addToObject(*it, obj->shapes_, poses);
+      }
+    }
+    collision_detection::CollisionWorldPtr variant_cworld = active_collision_->alloc_->allocateWorld(variant_world);
+
+    for (std::size_t i = 0 ; i < states.size() ; ++i)
+    {
+      collision_detection::CollisionResult res;
+      if (attached.empty())
+      {
+        if (shared_colliding[i])
+        {
+          colliding[k][i] = true;
+          continue;
+        }
+        variant_cworld->checkRobotCollision(req, res, *getCollisionRobot(), *states[i], acm);
+      }
+      else
+      {
+        // the attached objects change the robot, so the checks of the state are not shared
+        robot_state::RobotState state(*states[i]);
+        for (std::size_t j = 0 ; j < attached.size() ; ++j)
+          state.attachBody(attached[j]->object_id, attached_objects[j]->shapes_, attach_trans[j],
+                           attached[j]->touch_links, attached[j]->link_name);
+        state.updateCollisionBodyTransforms();
+        getCollisionWorld()->checkRobotCollision(req, res, *getCollisionRobot(), state, static_acm);
+        if (!res.collision)
+          variant_cworld->checkRobotCollision(req, res, *getCollisionRobot(), state, acm);
+        if (!res.collision)
+          getCollisionRobotUnpadded()->checkSelfCollision(req, res, state, acm);
+      }
+      colliding[k][i] = res.collision;
+    }
+  }
+}
+
 void planning_scene::PlanningScene::checkCollisionUnpadded(const collision_detection::CollisionRequest& req,
                                                            collision_detection::CollisionResult &res)
 {
   if (getCurrentState().dirtyCollisionBodyTransforms())
-    checkCollisionUnpadded(req, res, getCurrentStateNonConst(), getAllowedCollisionMatrix());
+    checkCollisionUnpadded(req, res, updatedCurrentState(), getAllowedCollisionMatrix());
   else
     checkCollisionUnpadded(req, res, getCurrentState(), getAllowedCollisionMatrix());
 }
@@ -576,7 +1334,7 @@ void planning_scene::PlanningScene::checkCollisionUnpadded(const collision_detec
 void planning_scene::PlanningScene::getCollidingPairs(collision_detection::CollisionResult::ContactMap &contacts)
 {
   if (getCurrentState().dirtyCollisionBodyTransforms())
-    getCollidingPairs(contacts, getCurrentStateNonConst(), getAllowedCollisionMatrix());
+    getCollidingPairs(contacts, updatedCurrentState(), getAllowedCollisionMatrix());
   else
     getCollidingPairs(contacts, getCurrentState(), getAllowedCollisionMatrix());
 }
@@ -597,7 +1355,7 @@ void planning_scene::PlanningScene::getCollidingPairs(collision_detection::Colli
 void planning_scene::PlanningScene::getCollidingLinks(std::vector<std::string> &links)
 {
   if (getCurrentState().dirtyCollisionBodyTransforms())
-    getCollidingLinks(links, getCurrentStateNonConst(), getAllowedCollisionMatrix());
+    getCollidingLinks(links, updatedCurrentState(), getAllowedCollisionMatrix());
   else
     getCollidingLinks(links, getCurrentState(), getAllowedCollisionMatrix());
 }
@@ -621,6 +1379,7 @@ void planning_scene::PlanningScene::getCollidingLinks(std::vector<std::string> &
 
 const collision_detection::CollisionRobotPtr& planning_scene::PlanningScene::getCollisionRobotNonConst()
 {
+  change_log_->componentChanged(ChangeLog::PADDING);
   if (!active_collision_->crobot_)
   {
     active_collision_->crobot_ = active_collision_->alloc_->allocateRobot(active_collision_->parent_->getCollisionRobot());
@@ -630,6 +1389,12 @@ const collision_detection::CollisionRobotPtr& planning_scene::PlanningScene::get
 }
 
 robot_state::RobotState& planning_scene::PlanningScene::getCurrentStateNonConst()
+{
+  change_log_->componentChanged(ChangeLog::STATE);
+  return updatedCurrentState();
+}
+
+robot_state::RobotState& planning_scene::PlanningScene::updatedCurrentState()
 {
   if (!kstate_)
   {
@@ -665,6 +1430,7 @@ void planning_scene::PlanningScene::setCollisionObjectUpdateCallback(const colli
 
 collision_detection::AllowedCollisionMatrix& planning_scene::PlanningScene::getAllowedCollisionMatrixNonConst()
 {
+  change_log_->componentChanged(ChangeLog::ACM);
   if (!acm_)
     acm_.reset(new collision_detection::AllowedCollisionMatrix(parent_->getAllowedCollisionMatrix()));
   return *acm_;
@@ -672,17 +1438,18 @@ collision_detection::AllowedCollisionMatrix& planning_scene::PlanningScene::getA
 
 const robot_state::Transforms& planning_scene::PlanningScene::getTransforms()
 {
-  getCurrentStateNonConst().update();
+  updatedCurrentState();
   return const_cast<const PlanningScene*>(this)->getTransforms();
 }
 
 robot_state::Transforms& planning_scene::PlanningScene::getTransformsNonConst()
 {
-  getCurrentStateNonConst().update();
+  change_log_->componentChanged(ChangeLog::TRANSFORMS);
+  updatedCurrentState();
   if (!ftf_)
   {
     ftf_.reset(new SceneTransforms(this));
-    ftf_->setAllTransforms(parent_->getTransforms().getAllTransforms());
+    ftf_->setAllTransforms(parent_->getTransforms());
   }
   return *ftf_;
 }
@@ -703,7 +1470,8 @@ void planning_scene::PlanningScene::getPlanningSceneDiffMsg(moveit_msgs::Plannin
   else
     scene_msg.robot_state = moveit_msgs::RobotState();
 
-  if (acm_)
+  // a matrix copied from the parent but not modified since has the parent's version
+  if (acm_ && (!parent_ || acm_->getVersion() != parent_->getAllowedCollisionMatrix().getVersion()))
     acm_->getMessage(scene_msg.allowed_collision_matrix);
   else
     scene_msg.allowed_collision_matrix = moveit_msgs::AllowedCollisionMatrix();
@@ -758,6 +1526,64 @@ void planning_scene::PlanningScene::getPlanningSceneDiffMsg(moveit_msgs::Plannin
   }
 }
 
+boost::uint64_t planning_scene::PlanningScene::getVersion() const
+{
+  return change_log_->version_;
+}
+
+bool planning_scene::PlanningScene::getPlanningSceneDiffMsg(moveit_msgs::PlanningScene &scene_msg, boost::uint64_t version) const
+{
+  if (version < change_log_->first_version_ || version > change_log_->version_)
+  {
+    getPlanningSceneMsg(scene_msg);
+    return false;
+  }
+
+  scene_msg = moveit_msgs::PlanningScene();
+  scene_msg.name = name_;
+  scene_msg.robot_model_name = getRobotModel()->getName();
+  scene_msg.is_diff = true;
+  scene_msg.robot_state.is_diff = true;
+
+  const boost::uint64_t *changed = change_log_->component_versions_;
+  if (changed[ChangeLog::TRANSFORMS] > version)
+    getTransforms().copyTransforms(scene_msg.fixed_frame_transforms);
+  if (changed[ChangeLog::STATE] > version)
+  {
+    // the complete state is sent, so attached bodies that were removed are removed by the receiver too
+    robot_state::robotStateToRobotStateMsg(getCurrentState(), scene_msg.robot_state, true);
+    scene_msg.robot_state.is_diff = false;
+  }
+  if (changed[ChangeLog::ACM] > version)
+    getAllowedCollisionMatrix().getMessage(scene_msg.allowed_collision_matrix);
+  if (changed[ChangeLog::PADDING] > version)
+  {
+    getCollisionRobot()->getPadding(scene_msg.link_padding);
+    getCollisionRobot()->getScale(scene_msg.link_scale);
+  }
+  if (changed[ChangeLog::COLORS] > version)
+    getPlanningSceneMsgObjectColors(scene_msg);
+
+  // only the world objects that changed after the requested version are visited
+  for (std::map<boost::uint64_t, std::string>::const_iterator it = change_log_->changes_.upper_bound(version) ;
+       it != change_log_->changes_.end() ; ++it)
+  {
+    if (it->second == OCTOMAP_NS)
+      getPlanningSceneMsgOctomap(scene_msg);
+    else if (!world_->hasObject(it->second))
+    {
+      moveit_msgs::CollisionObject co;
+      co.header.frame_id = getPlanningFrame();
+      co.id = it->second;
+      co.operation = moveit_msgs::CollisionObject::REMOVE;
+      scene_msg.world.collision_objects.push_back(co);
+    }
+    else
+      getPlanningSceneMsgCollisionObject(scene_msg, it->second);
+  }
+  return true;
+}
+
 namespace planning_scene
 {
 namespace
@@ -1028,32 +1854,572 @@ void planning_scene::PlanningScene::loadGeometryFromStream(std::istream &in)
   } while (true);
 }
 
+namespace planning_scene
+{
+namespace
+{
+// "MISNAP" followed by the format version and a value used to detect snapshots recorded with a different byte order
+const char SNAPSHOT_MAGIC[6] = { 'M', 'I', 'S', 'N', 'A', 'P' };
+const boost::uint32_t SNAPSHOT_VERSION = 1;
+const boost::uint32_t SNAPSHOT_BYTE_ORDER = 0x01020304;
+
+template<typename T>
+void writeSnapshotValue(std::ostream &out, const T &value)
+{
+  out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+void writeSnapshotBuffer(std::ostream &out, const void *data, std::size_t size)
+{
+  if (size > 0)
+    out.write(static_cast<const char*>(data), size);
+}
+
+void writeSnapshotString(std::ostream &out, const std::string &str)
+{
+  writeSnapshotValue(out, (boost::uint32_t)str.size());
+  writeSnapshotBuffer(out, str.data(), str.size());
+}
+
+void writeSnapshotPose(std::ostream &out, const Eigen::Affine3d &pose)
+{
+  Eigen::Quaterniond q(pose.rotation());
+  double v[7] = { pose.translation().x(), pose.translation().y(), pose.translation().z(), q.x(), q.y(), q.z(), q.w() };
+  writeSnapshotBuffer(out, v, sizeof(v));
+}
+
+bool writeSnapshotShape(std::ostream &out, const shapes::Shape *shape)
+{
+  writeSnapshotValue(out, (boost::uint8_t)shape->type);
+  switch (shape->type)
+  {
+  case shapes::SPHERE:
+    writeSnapshotValue(out, static_cast<const shapes::Sphere*>(shape)->radius);
+    break;
+  case shapes::CYLINDER:
+    writeSnapshotValue(out, static_cast<const shapes::Cylinder*>(shape)->radius);
+    writeSnapshotValue(out, static_cast<const shapes::Cylinder*>(shape)->length);
+    break;
+  case shapes::CONE:
+    writeSnapshotValue(out, static_cast<const shapes::Cone*>(shape)->radius);
+    writeSnapshotValue(out, static_cast<const shapes::Cone*>(shape)->length);
+    break;
+  case shapes::BOX:
+    writeSnapshotBuffer(out, static_cast<const shapes::Box*>(shape)->size, 3 * sizeof(double));
+    break;
+  case shapes::PLANE:
+    {
+      const shapes::Plane *p = static_cast<const shapes::Plane*>(shape);
+      double v[4] = { p->a, p->b, p->c, p->d };
+      writeSnapshotBuffer(out, v, sizeof(v));
+    }
+    break;
+  case shapes::MESH:
+    {
+      const shapes::Mesh *m = static_cast<const shapes::Mesh*>(shape);
+      boost::uint8_t normals = (m->triangle_normals ? 1 : 0) | (m->vertex_normals ? 2 : 0);
+      writeSnapshotValue(out, (boost::uint32_t)m->vertex_count);
+      writeSnapshotValue(out, (boost::uint32_t)m->triangle_count);
+      writeSnapshotValue(out, normals);
+      writeSnapshotBuffer(out, m->vertices, m->vertex_count * 3 * sizeof(double));
+      writeSnapshotBuffer(out, m->triangles, m->triangle_count * 3 * sizeof(unsigned int));
+      if (m->triangle_normals)
+        writeSnapshotBuffer(out, m->triangle_normals, m->triangle_count * 3 * sizeof(double));
+      if (m->vertex_normals)
+        writeSnapshotBuffer(out, m->vertex_normals, m->vertex_count * 3 * sizeof(double));
+    }
+    break;
+  case shapes::OCTREE:
+    {
+      std::stringstream data;
+      static_cast<const shapes::OcTree*>(shape)->octree->writeBinaryConst(data);
+      writeSnapshotString(out, data.str());
+    }
+    break;
+  default:
+    return false;
+  }
+  return true;
+}
+
+/** \brief Read the data of a snapshot directly from a buffer, checking for truncation */
+class SnapshotReader
+{
+public:
+
+  SnapshotReader(const char *data, std::size_t size) : data_(data), size_(size), pos_(0), ok_(true)
+  {
+  }
+
+  /** \brief Get a pointer to the next \e size bytes and skip over them; NULL if fewer bytes are left */
+  const char* next(std::size_t size)
+  {
+    if (!ok_ || size > size_ - pos_)
+    {
+      ok_ = false;
+      return NULL;
+    }
+    const char *data = data_ + pos_;
+    pos_ += size;
+    return data;
+  }
+
+  bool read(void *dest, std::size_t size)
+  {
+    const char *data = next(size);
+    if (data && size > 0)
+      memcpy(dest, data, size);
+    return data != NULL;
+  }
+
+  template<typename T>
+  bool read(T &value)
+  {
+    return read(&value, sizeof(T));
+  }
+
+  bool read(std::string &str)
+  {
+    boost::uint32_t size;
+    if (!read(size))
+      return false;
+    const char *data = next(size);
+    if (data)
+      str.assign(data, size);
+    return data != NULL;
+  }
+
+  bool read(Eigen::Affine3d &pose)
+  {
+    double v[7];
+    if (!read(v, sizeof(v)))
+      return false;
+    pose = Eigen::Translation3d(v[0], v[1], v[2]) * Eigen::Quaterniond(v[6], v[3], v[4], v[5]).normalized();
+    return true;
+  }
+
+  bool ok() const
+  {
+    return ok_;
+  }
+
+private:
+
+  const char *data_;
+  std::size_t size_;
+  std::size_t pos_;
+  bool        ok_;
+};
+
+shapes::Shape* readSnapshotShape(SnapshotReader &in)
+{
+  boost::uint8_t type;
+  if (!in.read(type))
+    return NULL;
+  switch (type)
+  {
+  case shapes::SPHERE:
+    {
+      double r;
+      return in.read(r) ? new shapes::Sphere(r) : NULL;
+    }
+  case shapes::CYLINDER:
+    {
+      double r, l;
+      return in.read(r) && in.read(l) ? new shapes::Cylinder(r, l) : NULL;
+    }
+  case shapes::CONE:
+    {
+      double r, l;
+      return in.read(r) && in.read(l) ? new shapes::Cone(r, l) : NULL;
+    }
+  case shapes::BOX:
+    {
+      double v[3];
+      return in.read(v, sizeof(v)) ? new shapes::Box(v[0], v[1], v[2]) : NULL;
+    }
+  case shapes::PLANE:
+    {
+      double v[4];
+      return in.read(v, sizeof(v)) ? new shapes::Plane(v[0], v[1], v[2], v[3]) : NULL;
+    }
+  case shapes::MESH:
+    {
+      boost::uint32_t vertex_count, triangle_count;
+      boost::uint8_t normals;
+      if (!in.read(vertex_count) || !in.read(triangle_count) || !in.read(normals))
+        return NULL;
+      // check the size of the data before allocating the mesh, in case the counts are corrupted
+      std::size_t vertex_size = (std::size_t)vertex_count * 3 * sizeof(double);
+      std::size_t triangle_size = (std::size_t)triangle_count * 3 * sizeof(unsigned int);
+      std::size_t normal_size = (std::size_t)triangle_count * 3 * sizeof(double);
+      std::size_t size = vertex_size + triangle_size;
+      if (normals & 1)
+        size += normal_size;
+      if (normals & 2)
+        size += vertex_size;
+      const char *data = in.next(size);
+      if (!data)
+        return NULL;
+
+      // the buffers are copied straight into the mesh
+      shapes::Mesh *m = new shapes::Mesh(vertex_count, triangle_count);
+      memcpy(m->vertices, data, vertex_size);
+      data += vertex_size;
+      memcpy(m->triangles, data, triangle_size);
+      data += triangle_size;
+      if (normals & 1)
+      {
+        if (!m->triangle_normals)
+          m->triangle_normals = new double[triangle_count * 3];
+        memcpy(m->triangle_normals, data, normal_size);
+        data += normal_size;
+      }
+      else
+        m->computeTriangleNormals();
+      if (normals & 2)
+      {
+        if (!m->vertex_normals)
+          m->vertex_normals = new double[vertex_count * 3];
+        memcpy(m->vertex_normals, data, vertex_size);
+      }
+      return m;
+    }
+  case shapes::OCTREE:
+    {
+      boost::uint32_t size;
+      if (!in.read(size))
+        return NULL;
+      const char *data = in.next(size);
+      if (!data)
+        return NULL;
+      boost::iostreams::stream<boost::iostreams::array_source> stream(data, size);
+      boost::shared_ptr<octomap::OcTree> tree(new octomap::OcTree(0.1));
+      if (!tree->readBinary(stream))
+        return NULL;
+      return new shapes::OcTree(tree);
+    }
+  default:
+    logError("Unknown shape type %d in planning scene snapshot", (int)type);
+    return NULL;
+  }
+}
+
+struct SnapshotObject
+{
+  std::string                        id_;
+  std::vector<shapes::ShapeConstPtr> shapes_;
+  EigenSTL::vector_Affine3d          shape_poses_;
+};
+
+}
+}
+
+bool planning_scene::PlanningScene::saveSnapshotToStream(std::ostream &out) const
+{
+  out.write(SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+  writeSnapshotValue(out, SNAPSHOT_VERSION);
+  writeSnapshotValue(out, SNAPSHOT_BYTE_ORDER);
+  writeSnapshotString(out, getRobotModel()->getName());
+
+  // everything except the world is small, and is stored as a serialized message
+  moveit_msgs::PlanningSceneComponents comp;
+  comp.components =
+    moveit_msgs::PlanningSceneComponents::SCENE_SETTINGS |
+    moveit_msgs::PlanningSceneComponents::ROBOT_STATE_ATTACHED_OBJECTS |
+    moveit_msgs::PlanningSceneComponents::TRANSFORMS |
+    moveit_msgs::PlanningSceneComponents::ALLOWED_COLLISION_MATRIX |
+    moveit_msgs::PlanningSceneComponents::LINK_PADDING_AND_SCALING |
+    moveit_msgs::PlanningSceneComponents::OBJECT_COLORS;
+  moveit_msgs::PlanningScene scene_msg;
+  getPlanningSceneMsg(scene_msg, comp);
+  boost::uint32_t msg_size = ros::serialization::serializationLength(scene_msg);
+  std::vector<boost::uint8_t> buffer(msg_size);
+  ros::serialization::OStream msg_stream(buffer.empty() ? NULL : &buffer[0], msg_size);
+  ros::serialization::serialize(msg_stream, scene_msg);
+  writeSnapshotValue(out, msg_size);
+  writeSnapshotBuffer(out, buffer.empty() ? NULL : &buffer[0], msg_size);
+
+  // the world objects (including the octomap) are stored with their raw shape data
+  writeSnapshotValue(out, (boost::uint32_t)world_->size());
+  for (collision_detection::World::const_iterator it = world_->begin() ; it != world_->end() ; ++it)
+  {
+    const collision_detection::World::Object &obj = *it->second;
+    writeSnapshotString(out, obj.id_);
+    writeSnapshotValue(out, (boost::uint32_t)obj.shapes_.size());
+    for (std::size_t i = 0 ; i < obj.shapes_.size() ; ++i)
+    {
+      writeSnapshotPose(out, obj.shape_poses_[i]);
+      if (!writeSnapshotShape(out, obj.shapes_[i].get()))
+      {
+        logError("Cannot save shape of type %d of object '%s' to a planning scene snapshot", (int)obj.shapes_[i]->type, obj.id_.c_str());
+        return false;
+      }
+    }
+  }
+
+  ObjectTypeMap types;
+  getKnownObjectTypes(types);
+  writeSnapshotValue(out, (boost::uint32_t)types.size());
+  for (ObjectTypeMap::const_iterator it = types.begin() ; it != types.end() ; ++it)
+  {
+    writeSnapshotString(out, it->first);
+    writeSnapshotString(out, it->second.key);
+    writeSnapshotString(out, it->second.db);
+  }
+
+  return out.good();
+}
+
+bool planning_scene::PlanningScene::saveSnapshotToFile(const std::string &filename) const
+{
+  std::ofstream out(filename.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+  if (!out.good())
+  {
+    logError("Unable to open '%s' for writing a planning scene snapshot", filename.c_str());
+    return false;
+  }
+  if (!saveSnapshotToStream(out))
+    return false;
+  out.close();
+  return !out.fail();
+}
+
+bool planning_scene::PlanningScene::loadSnapshotFromMemory(const char *data, std::size_t size)
+{
+  SnapshotReader in(data, size);
+  const char *magic = in.next(sizeof(SNAPSHOT_MAGIC));
+  boost::uint32_t version = 0, byte_order = 0;
+  in.read(version);
+  in.read(byte_order);
+  if (!magic || memcmp(magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0 || byte_order != SNAPSHOT_BYTE_ORDER)
+  {
+    logError("The data is not a planning scene snapshot, or was recorded on a platform with a different byte order");
+    return false;
+  }
+  if (version != SNAPSHOT_VERSION)
+  {
+    logError("Planning scene snapshot has version %u, but only version %u is supported", version, SNAPSHOT_VERSION);
+    return false;
+  }
+  std::string robot_model_name;
+  if (!in.read(robot_model_name))
+  {
+    logError("Planning scene snapshot is truncated");
+    return false;
+  }
+  if (robot_model_name != getRobotModel()->getName())
+  {
+    logError("Planning scene snapshot was recorded for robot model '%s' but model '%s' is loaded",
+             robot_model_name.c_str(), getRobotModel()->getName().c_str());
+    return false;
+  }
+
+  // everything is read before the scene is changed, so invalid snapshots leave the scene as it was
+  moveit_msgs::PlanningScene scene_msg;
+  boost::uint32_t msg_size = 0;
+  in.read(msg_size);
+  const char *msg_data = in.next(msg_size);
+  if (msg_data)
+  {
+    try
+    {
+      ros::serialization::IStream msg_stream(reinterpret_cast<boost::uint8_t*>(const_cast<char*>(msg_data)), msg_size);
+      ros::serialization::deserialize(msg_stream, scene_msg);
+    }
+    catch (ros::serialization::StreamOverrunException &ex)
+    {
+      logError("Unable to decode the planning scene snapshot: %s", ex.what());
+      return false;
+    }
+  }
+
+  boost::uint32_t object_count = 0;
+  in.read(object_count);
+  std::vector<SnapshotObject> objects;
+  for (boost::uint32_t i = 0 ; i < object_count && in.ok() ; ++i)
+  {
+    objects.resize(objects.size() + 1);
+    SnapshotObject &obj = objects.back();
+    boost::uint32_t shape_count = 0;
+    in.read(obj.id_);
+    in.read(shape_count);
+    for (boost::uint32_t j = 0 ; j < shape_count && in.ok() ; ++j)
+    {
+      Eigen::Affine3d pose;
+      if (!in.read(pose))
+        break;
+      shapes::Shape *shape = readSnapshotShape(in);
+      if (!shape)
+      {
+        logError("Unable to read shape %u of object '%s' from planning scene snapshot", j, obj.id_.c_str());
+        return false;
+      }
+      obj.shapes_.push_back(shapes::ShapeConstPtr(shape));
+      obj.shape_poses_.push_back(pose);
+    }
+  }
+
+  boost::uint32_t type_count = 0;
+  in.read(type_count);
+  ObjectTypeMap types;
+  for (boost::uint32_t i = 0 ; i < type_count && in.ok() ; ++i)
+  {
+    std::string id;
+    object_recognition_msgs::ObjectType type;
+    in.read(id);
+    in.read(type.key);
+    in.read(type.db);
+    types[id] = type;
+  }
+
+  if (!in.ok())
+  {
+    logError("Planning scene snapshot is truncated");
+    return false;
+  }
+
+  setPlanningSceneMsg(scene_msg);
+  {
+    // the collision worlds process the objects all at once
+    collision_detection::World::ScopedBatch batch(*world_);
+    for (std::size_t i = 0 ; i < objects.size() ; ++i)
+      world_->addToObject(objects[i].id_, objects[i].shapes_, objects[i].shape_poses_);
+  }
+  for (ObjectTypeMap::const_iterator it = types.begin() ; it != types.end() ; ++it)
+    setObjectType(it->first, it->second);
+
+  return true;
+}
+
+bool planning_scene::PlanningScene::loadSnapshotFromFile(const std::string &filename)
+{
+  boost::iostreams::mapped_file_source file;
+  try
+  {
+    file.open(filename);
+  }
+  catch (std::exception &ex)
+  {
+    logError("Unable to open planning scene snapshot '%s': %s", filename.c_str(), ex.what());
+    return false;
+  }
+  return loadSnapshotFromMemory(file.data(), file.size());
+}
+
 void planning_scene::PlanningScene::setCurrentState(const moveit_msgs::RobotState &state)
 {
+  change_log_->componentChanged(ChangeLog::STATE);
   if (parent_)
   {
     if (!kstate_)
     {
-      kstate_.reset(new robot_state::RobotState(parent_->getCurrentState()));
-      kstate_->setAttachedBodyUpdateCallback(current_state_attached_body_callback_);
+      kstate_.reset(new robot_state::RobotState(parent_->getCurrentState()));
+      kstate_->setAttachedBodyUpdateCallback(current_state_attached_body_callback_);
+    }
+    robot_state::robotStateMsgToRobotState(getTransforms(), state, *kstate_);
+  }
+  else
+    robot_state::robotStateMsgToRobotState(*ftf_, state, *kstate_);
+  
+  // we add object types to the planning scene, if any are specified
+  for (std::size_t i = 0 ; i < state.attached_collision_objects.size() ; ++i)
+  {
+    const moveit_msgs::CollisionObject &o = state.attached_collision_objects[i].object;
+    if (!o.id.empty() && o.operation == moveit_msgs::CollisionObject::ADD && (!o.type.db.empty() || !o.type.key.empty()))
+      setObjectType(o.id, o.type);
+  }
+}
+
+void planning_scene::PlanningScene::setCurrentState(const robot_state::RobotState &state)
+{
+  getCurrentStateNonConst() = state;
+}
+
+void planning_scene::PlanningScene::mergeParent()
+{
+  // if this scene is the only user of the parent, the parent is destroyed once this scene
+  // stops pointing to it, so its data can be taken over instead of copied
+  const bool take = parent_.unique();
+  const PlanningScene &parent = *parent_;
+
+  if (!ftf_ && parent.ftf_)
+  {
+    ftf_.reset(new SceneTransforms(this));
+    ftf_->setAllTransforms(*parent.ftf_);
+  }
+
+  if (!kstate_ && parent.kstate_)
+  {
+    if (take)
+      kstate_ = parent.kstate_;
+    else
+      kstate_.reset(new robot_state::RobotState(*parent.kstate_));
+    kstate_->setAttachedBodyUpdateCallback(current_state_attached_body_callback_);
+  }
+
+  if (!acm_ && parent.acm_)
+  {
+    if (take)
+      acm_ = parent.acm_;
+    else
+      acm_.reset(new collision_detection::AllowedCollisionMatrix(*parent.acm_));
+  }
+
+  for (CollisionDetectorIterator it = collision_.begin() ; it != collision_.end() ; ++it)
+  {
+    CollisionDetectorConstIterator jt = parent.collision_.find(it->first);
+    if (jt == parent.collision_.end())
+      continue;
+    const CollisionDetector &pdet = *jt->second;
+    if (!it->second->crobot_ && pdet.crobot_)
+    {
+      it->second->crobot_ = take ? pdet.crobot_ : it->second->alloc_->allocateRobot(pdet.crobot_const_);
+      it->second->crobot_const_ = it->second->crobot_;
+    }
+    if (!it->second->crobot_unpadded_ && pdet.crobot_unpadded_)
+    {
+      it->second->crobot_unpadded_ = take ? pdet.crobot_unpadded_ : it->second->alloc_->allocateRobot(pdet.crobot_unpadded_const_);
+      it->second->crobot_unpadded_const_ = it->second->crobot_unpadded_;
+    }
+    it->second->parent_ = pdet.parent_;
+  }
+
+  // the world already includes the parent's changes; only the record of the changes needs merging
+  if (world_diff_ && parent.world_diff_)
+    for (collision_detection::WorldDiff::const_iterator it = parent.world_diff_->begin() ; it != parent.world_diff_->end() ; ++it)
+    {
+      collision_detection::WorldDiff::const_iterator own = world_diff_->find(it->first);
+      if (own == world_diff_->end())
+        world_diff_->set(it->first, it->second);
+      else if (own->second != collision_detection::World::DESTROY && it->second != collision_detection::World::DESTROY)
+        world_diff_->set(it->first, own->second | it->second);
     }
-    robot_state::robotStateMsgToRobotState(getTransforms(), state, *kstate_);
+
+  if (parent.object_colors_)
+  {
+    if (!object_colors_)
+      object_colors_.reset(new ObjectColorMap());
+    for (ObjectColorMap::const_iterator it = parent.object_colors_->begin() ; it != parent.object_colors_->end() ; ++it)
+      object_colors_->insert(*it);
   }
-  else
-    robot_state::robotStateMsgToRobotState(*ftf_, state, *kstate_);
-  
-  // we add object types to the planning scene, if any are specified
-  for (std::size_t i = 0 ; i < state.attached_collision_objects.size() ; ++i)
+
+  if (parent.object_types_)
   {
-    const moveit_msgs::CollisionObject &o = state.attached_collision_objects[i].object;
-    if (!o.id.empty() && o.operation == moveit_msgs::CollisionObject::ADD && (!o.type.db.empty() || !o.type.key.empty()))
-      setObjectType(o.id, o.type);
+    if (!object_types_)
+      object_types_.reset(new ObjectTypeMap());
+    for (ObjectTypeMap::const_iterator it = parent.object_types_->begin() ; it != parent.object_types_->end() ; ++it)
+      object_types_->insert(*it);
   }
+
+  PlanningSceneConstPtr grandparent = parent.parent_;
+  parent_ = grandparent;
 }
 
-void planning_scene::PlanningScene::setCurrentState(const robot_state::RobotState &state)
+void planning_scene::PlanningScene::flattenParents()
 {
-  getCurrentStateNonConst() = state;
+  while (parent_ && parent_->parent_)
+    mergeParent();
 }
 
 void planning_scene::PlanningScene::decoupleParent()
@@ -1061,31 +2427,50 @@ void planning_scene::PlanningScene::decoupleParent()
   if (!parent_)
     return;
 
+  flattenParents();
+
+  // as in mergeParent(), the data of a parent used only by this scene is taken over
+  const bool take = parent_.unique();
+
   if (!ftf_)
   {
     ftf_.reset(new SceneTransforms(this));
-    ftf_->setAllTransforms(parent_->getTransforms().getAllTransforms());
+    ftf_->setAllTransforms(parent_->getTransforms());
   }
 
   if (!kstate_)
   {
-    kstate_.reset(new robot_state::RobotState(parent_->getCurrentState()));
+    if (take)
+      kstate_ = parent_->kstate_;
+    else
+      kstate_.reset(new robot_state::RobotState(parent_->getCurrentState()));
     kstate_->setAttachedBodyUpdateCallback(current_state_attached_body_callback_);
   }
 
   if (!acm_)
-    acm_.reset(new collision_detection::AllowedCollisionMatrix(parent_->getAllowedCollisionMatrix()));
+  {
+    if (take)
+      acm_ = parent_->acm_;
+    else
+      acm_.reset(new collision_detection::AllowedCollisionMatrix(parent_->getAllowedCollisionMatrix()));
+  }
 
   for (CollisionDetectorIterator it = collision_.begin() ; it != collision_.end() ; ++it)
   {
     if (!it->second->crobot_)
     {
-      it->second->crobot_ = it->second->alloc_->allocateRobot(it->second->parent_->getCollisionRobot());
+      if (take && it->second->parent_->crobot_)
+        it->second->crobot_ = it->second->parent_->crobot_;
+      else
+        it->second->crobot_ = it->second->alloc_->allocateRobot(it->second->parent_->getCollisionRobot());
       it->second->crobot_const_ = it->second->crobot_;
     }
     if (!it->second->crobot_unpadded_)
     {
-      it->second->crobot_unpadded_ = it->second->alloc_->allocateRobot(it->second->parent_->getCollisionRobotUnpadded());
+      if (take && it->second->parent_->crobot_unpadded_)
+        it->second->crobot_unpadded_ = it->second->parent_->crobot_unpadded_;
+      else
+        it->second->crobot_unpadded_ = it->second->alloc_->allocateRobot(it->second->parent_->getCollisionRobotUnpadded());
       it->second->crobot_unpadded_const_ = it->second->crobot_unpadded_;
     }
     it->second->parent_.reset();
@@ -1141,6 +2526,7 @@ void planning_scene::PlanningScene::setPlanningSceneDiffMsg(const moveit_msgs::P
     if (!ftf_)
       ftf_.reset(new SceneTransforms(this));
     ftf_->setTransforms(scene_msg.fixed_frame_transforms);
+    change_log_->componentChanged(ChangeLog::TRANSFORMS);
   }
 
   // if at least some joints have been specified, we set them
@@ -1151,10 +2537,14 @@ void planning_scene::PlanningScene::setPlanningSceneDiffMsg(const moveit_msgs::P
 
   // if at least some links are mentioned in the allowed collision matrix, then we have an update
   if (!scene_msg.allowed_collision_matrix.entry_names.empty())
+  {
     acm_.reset(new collision_detection::AllowedCollisionMatrix(scene_msg.allowed_collision_matrix));
+    change_log_->componentChanged(ChangeLog::ACM);
+  }
 
   if (!scene_msg.link_padding.empty() || !scene_msg.link_scale.empty())
   {
+    change_log_->componentChanged(ChangeLog::PADDING);
     for (CollisionDetectorIterator it = collision_.begin() ; it != collision_.end() ; ++it)
     {
       if (!it->second->crobot_)
@@ -1199,6 +2589,9 @@ void planning_scene::PlanningScene::setPlanningSceneMsg(const moveit_msgs::Plann
   ftf_->setTransforms(scene_msg.fixed_frame_transforms);
   setCurrentState(scene_msg.robot_state);
   acm_.reset(new collision_detection::AllowedCollisionMatrix(scene_msg.allowed_collision_matrix));
+  change_log_->componentChanged(ChangeLog::TRANSFORMS);
+  change_log_->componentChanged(ChangeLog::ACM);
+  change_log_->componentChanged(ChangeLog::PADDING);
   for (CollisionDetectorIterator it = collision_.begin() ; it != collision_.end() ; ++it)
   {
     if (!it->second->crobot_)
@@ -1210,6 +2603,7 @@ void planning_scene::PlanningScene::setPlanningSceneMsg(const moveit_msgs::Plann
     it->second->crobot_->setScale(scene_msg.link_scale);
   }
   object_colors_.reset(new ObjectColorMap());
+  change_log_->componentChanged(ChangeLog::COLORS);
   for (std::size_t i = 0 ; i < scene_msg.object_colors.size() ; ++i)
     setObjectColor(scene_msg.object_colors[i].id, scene_msg.object_colors[i].color);
   world_->clearObjects();
@@ -1314,6 +2708,13 @@ void planning_scene::PlanningScene::processOctomapPtr(const boost::shared_ptr<co
   world_->addToObject(OCTOMAP_NS, shapes::ShapeConstPtr(new shapes::OcTree(octree)), t);
 }
 
+void planning_scene::PlanningScene::processOctomapShape(const shapes::ShapeConstPtr &octree, const Eigen::Affine3d &t)
+{
+  world_->removeObject(OCTOMAP_NS);
+  if (octree)
+    world_->addToObject(OCTOMAP_NS, octree, t);
+}
+
 bool planning_scene::PlanningScene::processAttachedCollisionObjectMsg(const moveit_msgs::AttachedCollisionObject &object)
 {
   if (object.object.operation == moveit_msgs::CollisionObject::ADD && !getRobotModel()->hasLinkModel(object.link_name))
@@ -1328,6 +2729,7 @@ bool planning_scene::PlanningScene::processAttachedCollisionObjectMsg(const move
     return false;
   }
 
+  change_log_->componentChanged(ChangeLog::STATE);
   if (!kstate_) // there must be a parent in this case
   {
     kstate_.reset(new robot_state::RobotState(parent_->getCurrentState()));
@@ -1658,21 +3060,8 @@ bool planning_scene::PlanningScene::processCollisionObjectMsg(const moveit_msgs:
         new_poses.push_back(t * p);
       }
 
-      collision_detection::World::ObjectConstPtr obj = world_->getObject(object.id);
-      if (obj->shapes_.size() == new_poses.size())
-      {
-        std::vector<shapes::ShapeConstPtr> shapes = obj->shapes_;
-        obj.reset();
-        world_->removeObject(object.id);
-        world_->addToObject(object.id, shapes, new_poses);
-      }
-      else
-      {
-        logError("Number of supplied poses (%u) for object '%s' does not match number of shapes (%u). Not moving.",
-                 (unsigned int)new_poses.size(), object.id.c_str(), (unsigned int)obj->shapes_.size());
-        return false;
-      }
-      return true;
+      // only the poses change, so the collision world can update the object in place
+      return world_->setShapePoses(object.id, new_poses);
     }
     else
       logError("World object '%s' does not exist. Cannot move.", object.id.c_str());
@@ -1690,28 +3079,85 @@ const Eigen::Affine3d& planning_scene::PlanningScene::getFrameTransform(const st
 const Eigen::Affine3d& planning_scene::PlanningScene::getFrameTransform(const std::string &id)
 {
   if (getCurrentState().dirtyLinkTransforms())
-    return getFrameTransform(getCurrentStateNonConst(), id);
+    return getFrameTransform(updatedCurrentState(), id);
   else
     return getFrameTransform(getCurrentState(), id);
 }
 
+const planning_scene::PlanningScene::FrameIndexEntry* planning_scene::PlanningScene::lookupFrame(const std::string &id) const
+{
+  if (id.empty())
+    return NULL;
+  boost::mutex::scoped_lock slock(frame_index_->lock_);
+  boost::unordered_map<std::string, FrameIndexEntry>::const_iterator it = frame_index_->entries_.find(id);
+  if (it != frame_index_->entries_.end())
+    return &it->second;
+
+  // the precedence is the same as for the lookups done without the index: links, world objects, fixed transforms
+  FrameIndexEntry entry;
+  entry.name_ = id[0] == '/' ? id.substr(1) : id;
+  entry.link_ = NULL;
+  entry.fixed_id_ = -1;
+  if (kmodel_->hasLinkModel(entry.name_))
+  {
+    entry.link_ = kmodel_->getLinkModel(entry.name_);
+    entry.source_ = '/' + entry.name_ == kmodel_->getModelFrame() ? FrameIndexEntry::MODEL_FRAME : FrameIndexEntry::LINK;
+  }
+  else if (world_->hasObject(entry.name_))
+  {
+    entry.source_ = FrameIndexEntry::WORLD_OBJECT;
+    entry.object_ = world_->getObject(entry.name_);
+  }
+  else if (getTransforms().Transforms::canTransform(entry.name_))
+  {
+    entry.source_ = FrameIndexEntry::FIXED;
+    entry.fixed_id_ = robot_state::Transforms::internFrame(entry.name_);
+  }
+  else
+    return NULL;   // unknown frames are not recorded, as they may become known later
+
+  frame_index_->entries_['/' + entry.name_] = entry;
+  return &(frame_index_->entries_[entry.name_] = entry);
+}
+
 const Eigen::Affine3d& planning_scene::PlanningScene::getFrameTransform(const robot_state::RobotState &state, const std::string &id) const
 {
-  if (!id.empty() && id[0] == '/')
-    return getFrameTransform(id.substr(1));
-  if (state.knowsFrameTransform(id))
-    return state.getFrameTransform(id);
-  if (getWorld()->hasObject(id))
+  static const Eigen::Affine3d identity = Eigen::Affine3d::Identity();
+  const FrameIndexEntry *entry = lookupFrame(id);
+  if (entry)
   {
-    collision_detection::World::ObjectConstPtr obj = getWorld()->getObject(id);
-    if (obj->shape_poses_.size() > 1)
+    if (entry->source_ == FrameIndexEntry::MODEL_FRAME)
+      return identity;
+    if (entry->source_ == FrameIndexEntry::LINK)
+      return state.getGlobalLinkTransform(entry->link_);
+
+    // bodies attached in the state take precedence over world objects and fixed transforms
+    if (state.hasAttachedBody(entry->name_))
     {
-      logWarn("More than one shapes in object '%s'. Using first one to decide transform");
-      return obj->shape_poses_[0];
+      const EigenSTL::vector_Affine3d &tf = state.getAttachedBody(entry->name_)->getGlobalCollisionBodyTransforms();
+      if (tf.size() == 1)
+        return tf[0];
+    }
+    if (entry->source_ == FrameIndexEntry::WORLD_OBJECT)
+    {
+      if (entry->object_->shape_poses_.size() > 1)
+      {
+        logWarn("More than one shapes in object '%s'. Using first one to decide transform", entry->name_.c_str());
+        return entry->object_->shape_poses_[0];
+      }
+      else
+        if (entry->object_->shape_poses_.size() == 1)
+          return entry->object_->shape_poses_[0];
     }
     else
-      if (obj->shape_poses_.size() == 1)
-        return obj->shape_poses_[0];
+      return getTransforms().Transforms::getTransform(entry->fixed_id_);
+  }
+  else if (!id.empty())
+  {
+    // frames not known to the scene may still be bodies attached in the state
+    const std::string &name = id[0] == '/' ? id.substr(1) : id;
+    if (state.knowsFrameTransform(name))
+      return state.getFrameTransform(name);
   }
   return getTransforms().Transforms::getTransform(id);
 }
@@ -1723,16 +3169,16 @@ bool planning_scene::PlanningScene::knowsFrameTransform(const std::string &id) c
 
 bool planning_scene::PlanningScene::knowsFrameTransform(const robot_state::RobotState &state, const std::string &id) const
 {
-  if (!id.empty() && id[0] == '/')
-    return knowsFrameTransform(id.substr(1));
-  if (state.knowsFrameTransform(id))
+  const FrameIndexEntry *entry = lookupFrame(id);
+  if (!entry)
+    return !id.empty() && state.knowsFrameTransform(id[0] == '/' ? id.substr(1) : id);
+  if (entry->source_ == FrameIndexEntry::MODEL_FRAME || entry->source_ == FrameIndexEntry::LINK)
     return true;
-  if (getWorld()->hasObject(id))
-  {
-    collision_detection::World::ObjectConstPtr obj = getWorld()->getObject(id);
-    return obj->shape_poses_.size() == 1;
-  }
-  return getTransforms().Transforms::canTransform(id);
+  if (state.knowsFrameTransform(entry->name_))
+    return true;
+  if (entry->source_ == FrameIndexEntry::WORLD_OBJECT)
+    return entry->object_->shape_poses_.size() == 1;
+  return getTransforms().Transforms::canTransform(entry->fixed_id_);
 }
 
 bool planning_scene::PlanningScene::hasObjectType(const std::string &id) const
@@ -1765,12 +3211,17 @@ void planning_scene::PlanningScene::setObjectType(const std::string &id, const o
   if (!object_types_)
     object_types_.reset(new ObjectTypeMap());
   (*object_types_)[id] = type;
+  // types are sent as part of the collision objects
+  if (world_->hasObject(id))
+    change_log_->objectChanged(id, false);
 }
 
 void planning_scene::PlanningScene::removeObjectType(const std::string &id)
 {
   if (object_types_)
     object_types_->erase(id);
+  if (world_->hasObject(id))
+    change_log_->objectChanged(id, false);
 }
 
 void planning_scene::PlanningScene::getKnownObjectTypes(ObjectTypeMap &kc) const
@@ -1822,12 +3273,14 @@ void planning_scene::PlanningScene::setObjectColor(const std::string &id, const
   if (!object_colors_)
     object_colors_.reset(new ObjectColorMap());
   (*object_colors_)[id] = color;
+  change_log_->componentChanged(ChangeLog::COLORS);
 }
 
 void planning_scene::PlanningScene::removeObjectColor(const std::string &id)
 {
   if (object_colors_)
     object_colors_->erase(id);
+  change_log_->componentChanged(ChangeLog::COLORS);
 }
 
 bool planning_scene::PlanningScene::isStateColliding(const moveit_msgs::RobotState &state, const std::string &group, bool verbose) const
@@ -1840,18 +3293,43 @@ bool planning_scene::PlanningScene::isStateColliding(const moveit_msgs::RobotSta
 bool planning_scene::PlanningScene::isStateColliding(const std::string &group, bool verbose)
 {
   if (getCurrentState().dirtyCollisionBodyTransforms())
-    return isStateColliding(getCurrentStateNonConst(), group, verbose);
+    return isStateColliding(updatedCurrentState(), group, verbose);
   else
     return isStateColliding(getCurrentState(), group, verbose);
 }
 
 bool planning_scene::PlanningScene::isStateColliding(const robot_state::RobotState &state, const std::string &group, bool verbose) const
 {
+  StateValidityCache &cache = *state_validity_cache_;
+  StateValidityCache::Key key;
+  boost::uint64_t generation = 0;
+  if (!verbose)
+  {
+    double tolerance;
+    std::size_t size;
+    {
+      boost::mutex::scoped_lock slock(cache.lock_);
+      tolerance = cache.tolerance_;
+      size = cache.size_;
+    }
+    if (size > 0)
+    {
+      generation = cache.getGeneration(this);
+      cache.computeKey(state, group, tolerance, key);
+      bool colliding;
+      if (cache.find(key, generation, colliding))
+        return colliding;
+    }
+  }
+
   collision_detection::CollisionRequest req;
   req.verbose = verbose;
   req.group_name = group;
   collision_detection::CollisionResult  res;
   checkCollision(req, res, state);
+
+  if (generation > 0)
+    cache.insert(key, generation, res.collision);
   return res.collision;
 }
 
@@ -1883,14 +3361,118 @@ bool planning_scene::PlanningScene::isStateConstrained(const moveit_msgs::RobotS
 
 bool planning_scene::PlanningScene::isStateConstrained(const robot_state::RobotState &state, const moveit_msgs::Constraints &constr, bool verbose) const
 {
-  kinematic_constraints::KinematicConstraintSetPtr ks(new kinematic_constraints::KinematicConstraintSet(getRobotModel()));
-  ks->add(constr, getTransforms());
+  kinematic_constraints::KinematicConstraintSetConstPtr ks = getConstraintSet(constr);
   if (ks->empty())
     return true;
   else
     return isStateConstrained(state, *ks, verbose);
 }
 
+void planning_scene::PlanningScene::setConstraintSetCacheSize(std::size_t size)
+{
+  boost::mutex::scoped_lock slock(constraint_set_cache_->lock_);
+  constraint_set_cache_->capacity_ = size;
+  if (constraint_set_cache_->entries_.size() > size)
+    constraint_set_cache_->entries_.resize(size);
+}
+
+std::size_t planning_scene::PlanningScene::getConstraintSetCacheSize() const
+{
+  boost::mutex::scoped_lock slock(constraint_set_cache_->lock_);
+  return constraint_set_cache_->capacity_;
+}
+
+void planning_scene::PlanningScene::setStateValidityCacheSize(std::size_t size)
+{
+  boost::mutex::scoped_lock slock(state_validity_cache_->lock_);
+  state_validity_cache_->reset(size);
+}
+
+std::size_t planning_scene::PlanningScene::getStateValidityCacheSize() const
+{
+  boost::mutex::scoped_lock slock(state_validity_cache_->lock_);
+  return state_validity_cache_->size_;
+}
+
+void planning_scene::PlanningScene::setStateValidityCacheTolerance(double tolerance)
+{
+  boost::mutex::scoped_lock slock(state_validity_cache_->lock_);
+  state_validity_cache_->tolerance_ = tolerance > 0.0 ? tolerance : 0.0;
+  state_validity_cache_->reset(state_validity_cache_->size_);
+}
+
+double planning_scene::PlanningScene::getStateValidityCacheTolerance() const
+{
+  boost::mutex::scoped_lock slock(state_validity_cache_->lock_);
+  return state_validity_cache_->tolerance_;
+}
+
+void planning_scene::PlanningScene::getStateValidityCacheStatistics(std::size_t &hits, std::size_t &misses) const
+{
+  hits = misses = 0;
+  for (std::size_t i = 0 ; i < StateValidityCache::SHARD_COUNT ; ++i)
+  {
+    boost::mutex::scoped_lock slock(state_validity_cache_->shards_[i].lock_);
+    hits += state_validity_cache_->shards_[i].hits_;
+    misses += state_validity_cache_->shards_[i].misses_;
+  }
+}
+
+kinematic_constraints::KinematicConstraintSetConstPtr planning_scene::PlanningScene::getConstraintSet(const moveit_msgs::Constraints &constr) const
+{
+  ConstraintSetCache &cache = *constraint_set_cache_;
+  const robot_state::Transforms &tf = getTransforms();
+  {
+    boost::mutex::scoped_lock slock(cache.lock_);
+    if (cache.capacity_ == 0)
+    {
+      slock.unlock();
+      kinematic_constraints::KinematicConstraintSetPtr ks(new kinematic_constraints::KinematicConstraintSet(getRobotModel()));
+      ks->add(constr, tf);
+      return ks;
+    }
+  }
+
+  ConstraintSetCache::Entry entry;
+  entry.message_.resize(ros::serialization::serializationLength(constr));
+  if (!entry.message_.empty())
+  {
+    ros::serialization::OStream stream(&entry.message_[0], entry.message_.size());
+    ros::serialization::serialize(stream, constr);
+  }
+  entry.hash_ = boost::hash_range(entry.message_.begin(), entry.message_.end());
+
+  {
+    boost::mutex::scoped_lock slock(cache.lock_);
+    for (std::list<ConstraintSetCache::Entry>::iterator it = cache.entries_.begin() ; it != cache.entries_.end() ; ++it)
+      if (it->hash_ == entry.hash_ && it->message_ == entry.message_)
+      {
+        if (cache.framesUnchanged(*it, tf))
+        {
+          cache.entries_.splice(cache.entries_.begin(), cache.entries_, it);
+          return it->set_;
+        }
+        cache.entries_.erase(it);
+        break;
+      }
+  }
+
+  // construct the set outside the lock; concurrent misses on the same message may both construct it
+  kinematic_constraints::KinematicConstraintSetPtr ks(new kinematic_constraints::KinematicConstraintSet(getRobotModel()));
+  ks->add(constr, tf);
+  cache.recordFrames(entry, tf, constr);
+  entry.set_ = ks;
+
+  boost::mutex::scoped_lock slock(cache.lock_);
+  if (cache.capacity_ > 0)
+  {
+    cache.entries_.push_front(entry);
+    if (cache.entries_.size() > cache.capacity_)
+      cache.entries_.pop_back();
+  }
+  return ks;
+}
+
 bool planning_scene::PlanningScene::isStateConstrained(const moveit_msgs::RobotState &state, const kinematic_constraints::KinematicConstraintSet &constr, bool verbose) const
 {
   robot_state::RobotState s(getCurrentState());
@@ -1903,10 +3485,13 @@ bool planning_scene::PlanningScene::isStateConstrained(const robot_state::RobotS
   return constr.decide(state, verbose).satisfied;
 }
 
-bool planning_scene::PlanningScene::isStateValid(const robot_state::RobotState &state, const std::string &group, bool verbose) const
+bool planning_scene::PlanningScene::isStateValid(const robot_state::RobotState &state, const std::string &group, bool verbose,
+                                                 ValidityStage *rejected_by) const
 {
-  static const moveit_msgs::Constraints emp_constraints;
-  return isStateValid(state, emp_constraints, group, verbose);
+  ValidityStage stage = checkStateValidity(state, NULL, group, verbose);
+  if (rejected_by)
+    *rejected_by = stage;
+  return stage == ValidityStages::NONE;
 }
 
 bool planning_scene::PlanningScene::isStateValid(const moveit_msgs::RobotState &state, const std::string &group, bool verbose) const
@@ -1922,22 +3507,173 @@ bool planning_scene::PlanningScene::isStateValid(const moveit_msgs::RobotState &
   return isStateValid(s, constr, group, verbose);
 }
 
-bool planning_scene::PlanningScene::isStateValid(const robot_state::RobotState &state, const moveit_msgs::Constraints &constr, const std::string &group, bool verbose) const
+bool planning_scene::PlanningScene::isStateValid(const robot_state::RobotState &state, const moveit_msgs::Constraints &constr, const std::string &group, bool verbose,
+                                                 ValidityStage *rejected_by) const
 {
-  if (isStateColliding(state, group, verbose))
-    return false;
-  if (!isStateFeasible(state, verbose))
-    return false;
-  return isStateConstrained(state, constr, verbose);
+  kinematic_constraints::KinematicConstraintSetConstPtr ks = getConstraintSet(constr);
+  return isStateValid(state, *ks, group, verbose, rejected_by);
 }
 
-bool planning_scene::PlanningScene::isStateValid(const robot_state::RobotState &state, const kinematic_constraints::KinematicConstraintSet &constr, const std::string &group, bool verbose) const
+bool planning_scene::PlanningScene::isStateValid(const robot_state::RobotState &state, const kinematic_constraints::KinematicConstraintSet &constr, const std::string &group, bool verbose,
+                                                 ValidityStage *rejected_by) const
 {
-  if (isStateColliding(state, group, verbose))
-    return false;
-  if (!isStateFeasible(state, verbose))
-    return false;
-  return isStateConstrained(state, constr, verbose);
+  ValidityStage stage = checkStateValidity(state, constr.empty() ? NULL : &constr, group, verbose);
+  if (rejected_by)
+    *rejected_by = stage;
+  return stage == ValidityStages::NONE;
+}
+
+namespace planning_scene
+{
+namespace
+{
+kinematic_constraints::KinematicConstraint::ConstraintType getConstraintType(ValidityStage stage)
+{
+  switch (stage)
+  {
+  case ValidityStages::JOINT_CONSTRAINTS:
+    return kinematic_constraints::KinematicConstraint::JOINT_CONSTRAINT;
+  case ValidityStages::POSITION_CONSTRAINTS:
+    return kinematic_constraints::KinematicConstraint::POSITION_CONSTRAINT;
+  case ValidityStages::ORIENTATION_CONSTRAINTS:
+    return kinematic_constraints::KinematicConstraint::ORIENTATION_CONSTRAINT;
+  case ValidityStages::VISIBILITY_CONSTRAINTS:
+    return kinematic_constraints::KinematicConstraint::VISIBILITY_CONSTRAINT;
+  default:
+    return kinematic_constraints::KinematicConstraint::UNKNOWN_CONSTRAINT;
+  }
+}
+}
+}
+
+planning_scene::ValidityStage planning_scene::PlanningScene::checkStateValidity(const robot_state::RobotState &state,
+                                                                                const kinematic_constraints::KinematicConstraintSet *constr,
+                                                                                const std::string &group, bool verbose) const
+{
+  ValidityStageOrdering &stages = *validity_stages_;
+  ValidityStage order[ValidityStageOrdering::STAGE_ORDER_SIZE];
+  {
+    boost::mutex::scoped_lock slock(stages.lock_);
+    std::copy(stages.order_, stages.order_ + ValidityStageOrdering::STAGE_ORDER_SIZE, order);
+  }
+
+  // the types of constraints in the set, so that the stages without constraints are skipped
+  bool has_constraints[ValidityStages::STAGE_COUNT] = { false };
+  if (constr)
+  {
+    const std::vector<kinematic_constraints::KinematicConstraintPtr> &kc = constr->getKinematicConstraints();
+    for (std::size_t i = 0 ; i < kc.size() ; ++i)
+      for (std::size_t j = ValidityStages::JOINT_CONSTRAINTS ; j <= ValidityStages::VISIBILITY_CONSTRAINTS ; ++j)
+        if (kc[i]->getType() == getConstraintType((ValidityStage)j))
+          has_constraints[j] = true;
+  }
+
+  bool evaluated[ValidityStages::STAGE_COUNT] = { false };
+  double time[ValidityStages::STAGE_COUNT] = { 0.0 };
+  ValidityStage rejected_by = ValidityStages::NONE;
+  for (std::size_t k = 0 ; k < ValidityStageOrdering::STAGE_ORDER_SIZE && rejected_by == ValidityStages::NONE ; ++k)
+  {
+    ValidityStage stage = order[k];
+    if (stage == ValidityStages::FEASIBILITY && !state_feasibility_)
+      continue;
+    if (stage >= ValidityStages::JOINT_CONSTRAINTS && stage <= ValidityStages::VISIBILITY_CONSTRAINTS && !has_constraints[stage])
+      continue;
+
+    boost::posix_time::ptime start = boost::posix_time::microsec_clock::universal_time();
+    bool valid = true;
+    switch (stage)
+    {
+    case ValidityStages::BOUNDS:
+      {
+        const robot_model::JointModelGroup *jmg = group.empty() ? NULL : getRobotModel()->getJointModelGroup(group);
+        valid = jmg ? state.satisfiesBounds(jmg) : state.satisfiesBounds();
+      }
+      break;
+    case ValidityStages::FEASIBILITY:
+      valid = state_feasibility_(state, verbose);
+      break;
+    case ValidityStages::COLLISION:
+      valid = !isStateColliding(state, group, verbose);
+      break;
+    default:
+      {
+        kinematic_constraints::KinematicConstraint::ConstraintType type = getConstraintType(stage);
+        const std::vector<kinematic_constraints::KinematicConstraintPtr> &kc = constr->getKinematicConstraints();
+        for (std::size_t i = 0 ; i < kc.size() && valid ; ++i)
+          if (kc[i]->getType() == type)
+            valid = kc[i]->decide(state, verbose).satisfied;
+      }
+      break;
+    }
+    evaluated[stage] = true;
+    time[stage] = (boost::posix_time::microsec_clock::universal_time() - start).total_microseconds() * 1e-6;
+    if (!valid)
+      rejected_by = stage;
+  }
+
+  if (verbose && rejected_by != ValidityStages::NONE)
+    logInform("State rejected by the %s check", getValidityStageName(rejected_by));
+
+  boost::mutex::scoped_lock slock(stages.lock_);
+  stages.record(evaluated, time, rejected_by);
+  return rejected_by;
+}
+
+void planning_scene::PlanningScene::setAdaptiveValidityStageOrdering(bool flag)
+{
+  boost::mutex::scoped_lock slock(validity_stages_->lock_);
+  validity_stages_->adaptive_ = flag;
+  if (!flag)
+    validity_stages_->resetOrder();
+}
+
+bool planning_scene::PlanningScene::getAdaptiveValidityStageOrdering() const
+{
+  boost::mutex::scoped_lock slock(validity_stages_->lock_);
+  return validity_stages_->adaptive_;
+}
+
+void planning_scene::PlanningScene::getValidityStageOrder(std::vector<ValidityStage> &order) const
+{
+  boost::mutex::scoped_lock slock(validity_stages_->lock_);
+  order.assign(validity_stages_->order_, validity_stages_->order_ + ValidityStageOrdering::STAGE_ORDER_SIZE);
+}
+
+void planning_scene::PlanningScene::getValidityStageStatistics(std::vector<ValidityStageStatistics> &stats) const
+{
+  boost::mutex::scoped_lock slock(validity_stages_->lock_);
+  stats.assign(validity_stages_->stats_, validity_stages_->stats_ + ValidityStages::STAGE_COUNT);
+}
+
+void planning_scene::PlanningScene::resetValidityStageStatistics()
+{
+  boost::mutex::scoped_lock slock(validity_stages_->lock_);
+  validity_stages_->reset();
+}
+
+const char* planning_scene::PlanningScene::getValidityStageName(ValidityStage stage)
+{
+  switch (stage)
+  {
+  case ValidityStages::NONE:
+    return "none";
+  case ValidityStages::BOUNDS:
+    return "bounds";
+  case ValidityStages::JOINT_CONSTRAINTS:
+    return "joint constraints";
+  case ValidityStages::POSITION_CONSTRAINTS:
+    return "position constraints";
+  case ValidityStages::ORIENTATION_CONSTRAINTS:
+    return "orientation constraints";
+  case ValidityStages::VISIBILITY_CONSTRAINTS:
+    return "visibility constraints";
+  case ValidityStages::FEASIBILITY:
+    return "feasibility";
+  case ValidityStages::COLLISION:
+    return "collision";
+  default:
+    return "unknown";
+  }
 }
 
 bool planning_scene::PlanningScene::isPathValid(const moveit_msgs::RobotState &start_state,
@@ -1985,61 +3721,159 @@ bool planning_scene::PlanningScene::isPathValid(const moveit_msgs::RobotState &s
   return isPathValid(t, path_constraints, goal_constraints, group, verbose, invalid_index);
 }
 
+namespace planning_scene
+{
+namespace
+{
+
+// order the indices 0 .. n-1 so that the end points come first, followed by the midpoints of repeatedly bisected intervals
+void computeBisectionOrder(std::size_t n, std::vector<std::size_t> &order)
+{
+  order.clear();
+  if (n == 0)
+    return;
+  order.reserve(n);
+  order.push_back(n - 1);
+  if (n == 1)
+    return;
+  order.push_back(0);
+  std::deque<std::pair<std::size_t, std::size_t> > intervals;
+  intervals.push_back(std::make_pair(0, n - 1));
+  while (!intervals.empty())
+  {
+    std::size_t lo = intervals.front().first;
+    std::size_t hi = intervals.front().second;
+    intervals.pop_front();
+    if (hi - lo < 2)
+      continue;
+    std::size_t mid = (lo + hi) / 2;
+    order.push_back(mid);
+    intervals.push_back(std::make_pair(lo, mid));
+    intervals.push_back(std::make_pair(mid, hi));
+  }
+}
+
+struct PathValidation
+{
+  PathValidation(const PlanningScene &scene, const robot_trajectory::RobotTrajectory &trajectory,
+                 const kinematic_constraints::KinematicConstraintSet &path_constraints,
+                 const std::string &group, bool verbose, const std::vector<std::size_t> &order, bool stop_at_first) :
+    scene_(scene), trajectory_(trajectory), path_constraints_(path_constraints), group_(group), verbose_(verbose),
+    order_(order), stop_at_first_(stop_at_first), valid_(order.size(), 1), next_(0), found_invalid_(false)
+  {
+  }
+
+  bool isStateValid(const robot_state::RobotState &st) const
+  {
+    return scene_.isStateValid(st, path_constraints_, group_, verbose_);
+  }
+
+  bool next(std::size_t &index)
+  {
+    boost::mutex::scoped_lock slock(lock_);
+    if (next_ >= order_.size() || (stop_at_first_ && found_invalid_))
+      return false;
+    index = order_[next_++];
+    return true;
+  }
+
+  void run()
+  {
+    std::size_t index;
+    while (next(index))
+      if (!isStateValid(trajectory_.getWayPoint(index)))
+      {
+        valid_[index] = 0;
+        boost::mutex::scoped_lock slock(lock_);
+        found_invalid_ = true;
+      }
+  }
+
+  const PlanningScene                                &scene_;
+  const robot_trajectory::RobotTrajectory            &trajectory_;
+  const kinematic_constraints::KinematicConstraintSet &path_constraints_;
+  const std::string                                  &group_;
+  bool                                                verbose_;
+  const std::vector<std::size_t>                     &order_;
+  bool                                                stop_at_first_;
+
+  std::vector<unsigned char>                          valid_;
+  boost::mutex                                        lock_;
+  std::size_t                                         next_;
+  bool                                                found_invalid_;
+};
+
+}
+}
+
 bool planning_scene::PlanningScene::isPathValid(const robot_trajectory::RobotTrajectory &trajectory,
                                                 const moveit_msgs::Constraints& path_constraints,
                                                 const std::vector<moveit_msgs::Constraints>& goal_constraints,
                                                 const std::string &group, bool verbose, std::vector<std::size_t> *invalid_index) const
 {
-  bool result = true;
+  MOVEIT_CORE_PROBE("PlanningScene::isPathValid");
   if (invalid_index)
     invalid_index->clear();
-  kinematic_constraints::KinematicConstraintSet ks_p(getRobotModel());
-  ks_p.add(path_constraints, getTransforms());
   std::size_t n_wp = trajectory.getWayPointCount();
-  for (std::size_t i = 0 ; i < n_wp ; ++i)
-  {
-    const robot_state::RobotState &st = trajectory.getWayPoint(i);
-
-    bool this_state_valid = true;
-    if (isStateColliding(st, group, verbose))
-      this_state_valid = false;
-    if (!isStateFeasible(st, verbose))
-      this_state_valid = false;
-    if (!ks_p.empty() && !ks_p.decide(st, verbose).satisfied)
-      this_state_valid = false;
+  if (n_wp == 0)
+    return true;
 
-    if (!this_state_valid)
-    {
-      if (invalid_index)
-        invalid_index->push_back(i);
-      else
-        return false;
-      result = false;
-    }
+  kinematic_constraints::KinematicConstraintSet ks_p(getRobotModel());
+  ks_p.add(path_constraints, getTransforms());
 
-    // check goal for last state
-    if (i + 1 == n_wp && !goal_constraints.empty())
+  // check the goal for the last state first; if that fails and we do not need to report indices, we are done
+  bool goal_satisfied = true;
+  if (!goal_constraints.empty())
+  {
+    const robot_state::RobotState &last = trajectory.getLastWayPoint();
+    goal_satisfied = false;
+    for (std::size_t k = 0 ; k < goal_constraints.size() ; ++k)
     {
-      bool found = false;
-      for (std::size_t k = 0 ; k < goal_constraints.size() ; ++k)
-      {
-        if (isStateConstrained(st, goal_constraints[k]))
-        {
-          found = true;
-          break;
-        }
-      }
-      if (!found)
+      kinematic_constraints::KinematicConstraintSet ks_g(getRobotModel());
+      ks_g.add(goal_constraints[k], getTransforms());
+      if (ks_g.empty() || isStateConstrained(last, ks_g))
       {
-        if (verbose)
-          logInform("Goal not satisfied");
-        if (invalid_index)
-          invalid_index->push_back(i);
-        result = false;
+        goal_satisfied = true;
+        break;
       }
     }
+    if (!goal_satisfied)
+    {
+      if (verbose)
+        logInform("Goal not satisfied");
+      if (!invalid_index)
+        return false;
+    }
   }
-  return result;
+
+  // when all invalid states are to be reported, the waypoints are checked in order; otherwise coarse to fine
+  std::vector<std::size_t> order;
+  if (invalid_index)
+  {
+    order.resize(n_wp);
+    for (std::size_t i = 0 ; i < n_wp ; ++i)
+      order[i] = i;
+  }
+  else
+    computeBisectionOrder(n_wp, order);
+
+  PathValidation validation(*this, trajectory, ks_p, group, verbose, order, invalid_index == NULL);
+  unsigned int thread_count = std::min<std::size_t>(path_validation_threads_, n_wp);
+  if (thread_count <= 1)
+    validation.run();
+  else
+  {
+    moveit::tools::ThreadPool &pool = moveit::tools::ThreadPool::Instance();
+    pool.runConcurrently(boost::bind(&PathValidation::run, &validation), std::min(thread_count, pool.getThreadCount()));
+  }
+
+  if (!invalid_index)
+    return !validation.found_invalid_;
+
+  for (std::size_t i = 0 ; i < n_wp ; ++i)
+    if (!validation.valid_[i] || (i + 1 == n_wp && !goal_satisfied))
+      invalid_index->push_back(i);
+  return invalid_index->empty();
 }
 
 
@@ -2083,27 +3917,21 @@ void planning_scene::PlanningScene::getCostSources(const robot_trajectory::Robot
   creq.max_cost_sources = max_costs;
   creq.group_name = group_name;
   creq.cost = true;
-  std::set<collision_detection::CostSource> cs;
+  // only the most costly sources over the whole trajectory are kept as the waypoints are checked
+  collision_detection::CostSourceAccumulator cs(max_costs);
   std::set<collision_detection::CostSource> cs_start;
   std::size_t n_wp = trajectory.getWayPointCount();
   for (std::size_t i = 0 ; i < n_wp ; ++i)
   {
     collision_detection::CollisionResult cres;
     checkCollision(creq, cres, trajectory.getWayPoint(i));
-    cs.insert(cres.cost_sources.begin(), cres.cost_sources.end());
+    cs.add(cres.cost_sources);
     if (i == 0)
       cs_start.swap(cres.cost_sources);
   }
 
-  if (cs.size() <= max_costs)
-    costs.swap(cs);
-  else
-  {
-    costs.clear();
-    std::size_t i = 0;
-    for (std::set<collision_detection::CostSource>::iterator it = cs.begin() ; i < max_costs ; ++it, ++i)
-      costs.insert(*it);
-  }
+  costs.clear();
+  cs.swap(costs);
 
   collision_detection::removeCostSources(costs, cs_start, overlap_fraction);
   collision_detection::removeOverlapping(costs, overlap_fraction);
@@ -2143,3 +3971,12 @@ void planning_scene::PlanningScene::printKnownObjects(std::ostream& out) const
     out << "\t " << attached_bodies[i]->getName() << "\n";
   }
 }
+
+void planning_scene::PlanningScene::getMemoryUsage(std::map<std::string, boost::int64_t> &usage) const
+{
+  moveit::tools::MemoryAccounting::GetUsage(usage);
+  std::size_t shape_bytes, octree_bytes;
+  getWorld()->getMemoryUsage(shape_bytes, octree_bytes);
+  usage["scene/world_objects"] = shape_bytes;
+  usage["scene/octomap"] = octree_bytes;
+}
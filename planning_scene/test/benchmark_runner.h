@@ -0,0 +1,282 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2013, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#ifndef MOVEIT_PLANNING_SCENE_TEST_BENCHMARK_RUNNER_
+#define MOVEIT_PLANNING_SCENE_TEST_BENCHMARK_RUNNER_
+
+// A minimal harness for the core benchmarks. Every benchmark is a function of the iteration index; the number of
+// iterations is doubled until one repetition takes at least the minimum time, and then a number of repetitions is
+// timed. Results are printed as a table and optionally written as JSON in the format Google Benchmark uses, so that
+// the usual comparison tools can be used to track regressions across releases.
+//
+// Command line options: --json <file> --min_time <seconds> --repetitions <count> --filter <substring>
+
+#include <ros/time.h>
+#include <boost/function.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/thread.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace moveit_benchmark
+{
+
+typedef boost::function<void(std::size_t)> BenchmarkFn;
+
+struct BenchmarkResult
+{
+  std::string name_;
+  std::size_t iterations_;
+  std::size_t repetitions_;
+  double mean_;
+  double median_;
+  double min_;
+  double stddev_;
+  std::map<std::string, double> counters_;
+};
+
+class BenchmarkRunner
+{
+public:
+
+  BenchmarkRunner(int argc, char **argv) : executable_(argc > 0 ? argv[0] : ""), min_time_(0.1), repetitions_(5), ok_(true)
+  {
+    for (int i = 1 ; i < argc ; ++i)
+    {
+      std::string arg = argv[i];
+      if (i + 1 >= argc)
+      {
+        std::cerr << "Missing value for option '" << arg << "'" << std::endl;
+        ok_ = false;
+        break;
+      }
+      std::string value = argv[++i];
+      try
+      {
+        if (arg == "--json")
+          json_file_ = value;
+        else if (arg == "--min_time")
+          min_time_ = boost::lexical_cast<double>(value);
+        else if (arg == "--repetitions")
+          repetitions_ = std::max<std::size_t>(1, boost::lexical_cast<std::size_t>(value));
+        else if (arg == "--filter")
+          filter_ = value;
+        else
+        {
+          std::cerr << "Unknown option '" << arg << "'" << std::endl;
+          ok_ = false;
+        }
+      }
+      catch(boost::bad_lexical_cast &)
+      {
+        std::cerr << "Invalid value '" << value << "' for option '" << arg << "'" << std::endl;
+        ok_ = false;
+      }
+    }
+  }
+
+  /// Return false if the command line could not be parsed
+  bool ok() const
+  {
+    return ok_;
+  }
+
+  bool enabled(const std::string &name) const
+  {
+    return filter_.empty() || name.find(filter_) != std::string::npos;
+  }
+
+  /// Time \e fn and record the result under \e name; return the mean time per iteration in nanoseconds (or -1 if disabled)
+  double run(const std::string &name, const BenchmarkFn &fn)
+  {
+    if (!enabled(name))
+      return -1.0;
+
+    // find the number of iterations that takes at least min_time_
+    std::size_t iterations = 1;
+    while (true)
+    {
+      double t = time(fn, iterations);
+      if (t >= min_time_ || iterations >= (1u << 30))
+        break;
+      // aim slightly above the minimum time, but at most a 10x increase per step
+      double factor = t > 0.0 ? std::min(10.0, 1.4 * min_time_ / t) : 10.0;
+      iterations = std::max(iterations + 1, (std::size_t)(iterations * factor));
+    }
+
+    std::vector<double> per_op(repetitions_);
+    for (std::size_t r = 0 ; r < repetitions_ ; ++r)
+      per_op[r] = time(fn, iterations) * 1e9 / (double)iterations;
+
+    BenchmarkResult result;
+    result.name_ = name;
+    result.iterations_ = iterations;
+    result.repetitions_ = repetitions_;
+    result.mean_ = 0.0;
+    for (std::size_t r = 0 ; r < per_op.size() ; ++r)
+      result.mean_ += per_op[r];
+    result.mean_ /= (double)per_op.size();
+    result.stddev_ = 0.0;
+    for (std::size_t r = 0 ; r < per_op.size() ; ++r)
+      result.stddev_ += (per_op[r] - result.mean_) * (per_op[r] - result.mean_);
+    result.stddev_ = per_op.size() > 1 ? sqrt(result.stddev_ / (double)(per_op.size() - 1)) : 0.0;
+    std::sort(per_op.begin(), per_op.end());
+    result.min_ = per_op.front();
+    result.median_ = per_op.size() % 2 ? per_op[per_op.size() / 2] : 0.5 * (per_op[per_op.size() / 2 - 1] + per_op[per_op.size() / 2]);
+    results_.push_back(result);
+
+    char line[512];
+    snprintf(line, sizeof(line), "%-60s %14.1f ns %14.1f ns %12u", name.c_str(), result.median_, result.stddev_, (unsigned int)iterations);
+    std::cout << line << std::endl;
+    return result.mean_;
+  }
+
+  /// Attach an additional value (e.g., memory use) to the last result recorded under \e name
+  void addCounter(const std::string &name, const std::string &counter, double value)
+  {
+    for (std::size_t i = results_.size() ; i > 0 ; --i)
+      if (results_[i - 1].name_ == name)
+      {
+        results_[i - 1].counters_[counter] = value;
+        break;
+      }
+  }
+
+  void setContext(const std::string &key, const std::string &value)
+  {
+    context_[key] = value;
+  }
+
+  const std::vector<BenchmarkResult>& getResults() const
+  {
+    return results_;
+  }
+
+  /// Write the JSON file, if one was requested; return false on failure
+  bool write() const
+  {
+    if (json_file_.empty())
+      return true;
+    std::ofstream out(json_file_.c_str());
+    if (!out.good())
+    {
+      std::cerr << "Unable to open '" << json_file_ << "' for writing" << std::endl;
+      return false;
+    }
+
+    char date[64];
+    std::time_t now = std::time(NULL);
+    std::strftime(date, sizeof(date), "%Y-%m-%d %H:%M:%S", std::localtime(&now));
+
+    out << "{" << std::endl << "  \"context\": {" << std::endl;
+    out << "    \"date\": \"" << date << "\"," << std::endl;
+    out << "    \"executable\": \"" << escape(executable_) << "\"," << std::endl;
+    out << "    \"num_cpus\": " << boost::thread::hardware_concurrency() << "," << std::endl;
+#ifdef NDEBUG
+    out << "    \"library_build_type\": \"release\"";
+#else
+    out << "    \"library_build_type\": \"debug\"";
+#endif
+    for (std::map<std::string, std::string>::const_iterator it = context_.begin() ; it != context_.end() ; ++it)
+      out << "," << std::endl << "    \"" << escape(it->first) << "\": \"" << escape(it->second) << "\"";
+    out << std::endl << "  }," << std::endl << "  \"benchmarks\": [";
+
+    char buffer[256];
+    for (std::size_t i = 0 ; i < results_.size() ; ++i)
+    {
+      const BenchmarkResult &r = results_[i];
+      out << (i ? "," : "") << std::endl << "    {" << std::endl;
+      out << "      \"name\": \"" << escape(r.name_) << "\"," << std::endl;
+      out << "      \"run_name\": \"" << escape(r.name_) << "\"," << std::endl;
+      out << "      \"run_type\": \"iteration\"," << std::endl;
+      out << "      \"iterations\": " << r.iterations_ << "," << std::endl;
+      out << "      \"repetitions\": " << r.repetitions_ << "," << std::endl;
+      snprintf(buffer, sizeof(buffer), "      \"real_time\": %.3f,\n      \"cpu_time\": %.3f,\n      \"time_unit\": \"ns\",\n"
+               "      \"mean\": %.3f,\n      \"median\": %.3f,\n      \"min\": %.3f,\n      \"stddev\": %.3f",
+               r.median_, r.median_, r.mean_, r.median_, r.min_, r.stddev_);
+      out << buffer;
+      for (std::map<std::string, double>::const_iterator it = r.counters_.begin() ; it != r.counters_.end() ; ++it)
+      {
+        snprintf(buffer, sizeof(buffer), "%.6g", it->second);
+        out << "," << std::endl << "      \"" << escape(it->first) << "\": " << buffer;
+      }
+      out << std::endl << "    }";
+    }
+    out << std::endl << "  ]" << std::endl << "}" << std::endl;
+    return out.good();
+  }
+
+private:
+
+  static double time(const BenchmarkFn &fn, std::size_t iterations)
+  {
+    ros::WallTime start = ros::WallTime::now();
+    for (std::size_t i = 0 ; i < iterations ; ++i)
+      fn(i);
+    return (ros::WallTime::now() - start).toSec();
+  }
+
+  static std::string escape(const std::string &s)
+  {
+    std::string result;
+    for (std::size_t i = 0 ; i < s.size() ; ++i)
+    {
+      if (s[i] == '"' || s[i] == '\\')
+        result += '\\';
+      result += s[i];
+    }
+    return result;
+  }
+
+  std::string executable_;
+  std::string json_file_;
+  std::string filter_;
+  double min_time_;
+  std::size_t repetitions_;
+  bool ok_;
+  std::map<std::string, std::string> context_;
+  std::vector<BenchmarkResult> results_;
+};
+
+}
+
+#endif
@@ -0,0 +1,298 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2013, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+// Measures how planning scene operations scale with the size of the world. For every world size (10 to 10000
+// objects of mixed shape types, by default) and octomap density (none, sparse, dense) a world is populated and
+// collision checks, diffs, message export and collision object updates are timed. The time and heap memory spent
+// building each world are reported as counters of the collision check benchmark.
+//
+// Usage: benchmark_scene_scaling [--max_objects <count>] [--json <file>] [--min_time <seconds>]
+//                                [--repetitions <count>] [--filter <substring>]
+
+#include <moveit/test_resources/config.h>
+#include <moveit/planning_scene/planning_scene.h>
+#include <geometric_shapes/shape_operations.h>
+#include <octomap/octomap.h>
+#include <random_numbers/random_numbers.h>
+#include <urdf_parser/urdf_parser.h>
+#include <boost/bind.hpp>
+#include <boost/filesystem/path.hpp>
+#include <fstream>
+#include <iostream>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+#include "benchmark_runner.h"
+
+namespace
+{
+
+static const std::size_t STATE_COUNT = 32;
+
+struct OctomapDensity
+{
+  const char *name_;
+  double occupancy_;
+};
+
+const OctomapDensity OCTOMAP_DENSITIES[] = { { "none", 0.0 },
+                                             { "sparse", 0.01 },
+                                             { "dense", 0.1 } };
+
+struct ScalingData
+{
+  planning_scene::PlanningScenePtr scene_;
+  std::vector<robot_state::RobotStatePtr> states_;
+  std::vector<std::string> object_ids_;
+  double sink_;
+};
+
+long getAllocatedMemory()
+{
+#ifdef __GLIBC__
+  struct mallinfo mi = mallinfo();
+  return (long)mi.uordblks + (long)mi.hblkhd;
+#else
+  return 0;
+#endif
+}
+
+std::string readFile(const std::string &path)
+{
+  std::ifstream file(path.c_str());
+  return std::string((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+}
+
+shapes::ShapeConstPtr makeShape(random_numbers::RandomNumberGenerator &rng, std::size_t kind)
+{
+  switch (kind % 5)
+  {
+    case 0:
+      return shapes::ShapeConstPtr(new shapes::Box(rng.uniformReal(0.02, 0.2), rng.uniformReal(0.02, 0.2), rng.uniformReal(0.02, 0.2)));
+    case 1:
+      return shapes::ShapeConstPtr(new shapes::Sphere(rng.uniformReal(0.02, 0.1)));
+    case 2:
+      return shapes::ShapeConstPtr(new shapes::Cylinder(rng.uniformReal(0.02, 0.1), rng.uniformReal(0.05, 0.3)));
+    case 3:
+      return shapes::ShapeConstPtr(new shapes::Cone(rng.uniformReal(0.02, 0.1), rng.uniformReal(0.05, 0.3)));
+    default:
+    {
+      // a small convex mesh: a box converted to triangles
+      boost::scoped_ptr<shapes::Box> box(new shapes::Box(rng.uniformReal(0.02, 0.2), rng.uniformReal(0.02, 0.2), rng.uniformReal(0.02, 0.2)));
+      return shapes::ShapeConstPtr(shapes::createMeshFromShape(box.get()));
+    }
+  }
+}
+
+Eigen::Affine3d randomPose(random_numbers::RandomNumberGenerator &rng)
+{
+  // objects are scattered in a 10m x 10m x 2m volume centered at the robot, so most are far from it
+  double q[4];
+  rng.quaternion(q);
+  Eigen::Affine3d pose(Eigen::Quaterniond(q[3], q[0], q[1], q[2]));
+  pose.translation() = Eigen::Vector3d(rng.uniformReal(-5.0, 5.0), rng.uniformReal(-5.0, 5.0), rng.uniformReal(0.0, 2.0));
+  return pose;
+}
+
+void populateWorld(ScalingData &data, std::size_t object_count, const OctomapDensity &density)
+{
+  random_numbers::RandomNumberGenerator rng(object_count + 1);
+  collision_detection::World &world = *data.scene_->getWorldNonConst();
+  data.object_ids_.clear();
+  for (std::size_t i = 0 ; i < object_count ; ++i)
+  {
+    std::string id = "object_" + boost::lexical_cast<std::string>(i);
+    world.addToObject(id, makeShape(rng, i), randomPose(rng));
+    data.object_ids_.push_back(id);
+  }
+
+  if (density.occupancy_ > 0.0)
+  {
+    // a 4m x 4m x 2m volume around the robot at 5cm resolution
+    boost::shared_ptr<octomap::OcTree> tree(new octomap::OcTree(0.05));
+    for (double x = -2.0 ; x < 2.0 ; x += 0.05)
+      for (double y = -2.0 ; y < 2.0 ; y += 0.05)
+        for (double z = 0.0 ; z < 2.0 ; z += 0.05)
+          if (rng.uniform01() < density.occupancy_)
+            tree->updateNode(octomap::point3d(x, y, z), true);
+    tree->updateInnerOccupancy();
+    data.scene_->processOctomapPtr(tree, Eigen::Affine3d::Identity());
+  }
+}
+
+void benchmarkCollision(ScalingData *data, std::size_t i)
+{
+  collision_detection::CollisionRequest req;
+  collision_detection::CollisionResult res;
+  data->scene_->checkCollision(req, res, const_cast<const robot_state::RobotState&>(*data->states_[i % STATE_COUNT]));
+  data->sink_ += res.collision;
+}
+
+void benchmarkDiff(ScalingData *data, std::size_t)
+{
+  planning_scene::PlanningScenePtr diff = data->scene_->diff();
+  data->sink_ += diff->getWorld()->size();
+}
+
+void benchmarkDiffCollision(ScalingData *data, std::size_t i)
+{
+  // a diff that changes one object, then a collision check on it
+  planning_scene::PlanningScenePtr diff = data->scene_->diff();
+  if (!data->object_ids_.empty())
+    diff->getWorldNonConst()->moveShapeInObject(data->object_ids_[i % data->object_ids_.size()],
+                                                diff->getWorld()->getObject(data->object_ids_[i % data->object_ids_.size()])->shapes_[0],
+                                                Eigen::Affine3d(Eigen::Translation3d(5.0, 5.0, (i % 100) * 0.01)));
+  collision_detection::CollisionRequest req;
+  collision_detection::CollisionResult res;
+  diff->checkCollision(req, res, const_cast<const robot_state::RobotState&>(*data->states_[i % STATE_COUNT]));
+  data->sink_ += res.collision;
+}
+
+void benchmarkSceneMsg(ScalingData *data, std::size_t)
+{
+  moveit_msgs::PlanningScene msg;
+  data->scene_->getPlanningSceneMsg(msg);
+  data->sink_ += msg.world.collision_objects.size();
+}
+
+void benchmarkAddObjectMsg(ScalingData *data, std::size_t i)
+{
+  // ADD replaces the object if it already exists, so the world keeps its size
+  moveit_msgs::CollisionObject co;
+  co.header.frame_id = data->scene_->getPlanningFrame();
+  co.id = "benchmark_object";
+  co.operation = moveit_msgs::CollisionObject::ADD;
+  co.primitives.resize(1);
+  co.primitives[0].type = shape_msgs::SolidPrimitive::BOX;
+  co.primitives[0].dimensions.resize(3, 0.1);
+  co.primitive_poses.resize(1);
+  co.primitive_poses[0].position.x = 3.0 + (i % 100) * 0.01;
+  co.primitive_poses[0].orientation.w = 1.0;
+  data->sink_ += data->scene_->processCollisionObjectMsg(co);
+}
+
+void benchmarkMoveObjectMsg(ScalingData *data, std::size_t i)
+{
+  if (data->object_ids_.empty())
+    return;
+  const std::string &id = data->object_ids_[i % data->object_ids_.size()];
+  moveit_msgs::CollisionObject co;
+  co.header.frame_id = data->scene_->getPlanningFrame();
+  co.id = id;
+  co.operation = moveit_msgs::CollisionObject::MOVE;
+  co.primitive_poses.resize(data->scene_->getWorld()->getObject(id)->shapes_.size());
+  for (std::size_t k = 0 ; k < co.primitive_poses.size() ; ++k)
+  {
+    co.primitive_poses[k].position.x = 5.0 - (i % 100) * 0.01;
+    co.primitive_poses[k].position.y = 5.0;
+    co.primitive_poses[k].orientation.w = 1.0;
+  }
+  data->sink_ += data->scene_->processCollisionObjectMsg(co);
+}
+
+}
+
+int main(int argc, char **argv)
+{
+  std::size_t max_objects = 10000;
+  std::vector<char*> runner_args(1, argv[0]);
+  for (int i = 1 ; i < argc ; ++i)
+    if (std::string(argv[i]) == "--max_objects" && i + 1 < argc)
+      max_objects = boost::lexical_cast<std::size_t>(argv[++i]);
+    else
+      runner_args.push_back(argv[i]);
+  moveit_benchmark::BenchmarkRunner runner(runner_args.size(), &runner_args[0]);
+  if (!runner.ok())
+    return 1;
+
+  boost::shared_ptr<urdf::ModelInterface> urdf_model = urdf::parseURDF(readFile((boost::filesystem::path(MOVEIT_TEST_RESOURCES_DIR) / "urdf/robot.xml").string()));
+  if (!urdf_model)
+  {
+    std::cerr << "Unable to load the PR2 URDF from " << MOVEIT_TEST_RESOURCES_DIR << std::endl;
+    return 1;
+  }
+  boost::shared_ptr<srdf::Model> srdf_model(new srdf::Model());
+  srdf_model->initFile(*urdf_model, (boost::filesystem::path(MOVEIT_TEST_RESOURCES_DIR) / "srdf/robot.xml").string());
+  robot_model::RobotModelPtr model(new robot_model::RobotModel(urdf_model, srdf_model));
+  runner.setContext("robot", model->getName());
+
+  ScalingData data;
+  data.sink_ = 0.0;
+  robot_state::RobotState state(model);
+  for (std::size_t i = 0 ; i < STATE_COUNT ; ++i)
+  {
+    state.setToRandomPositions();
+    state.update();
+    data.states_.push_back(robot_state::RobotStatePtr(new robot_state::RobotState(state)));
+  }
+
+  for (std::size_t object_count = 10 ; object_count <= max_objects ; object_count *= 10)
+    for (std::size_t d = 0 ; d < sizeof(OCTOMAP_DENSITIES) / sizeof(OCTOMAP_DENSITIES[0]) ; ++d)
+    {
+      std::string suffix = "/objects:" + boost::lexical_cast<std::string>(object_count) + "/octomap:" + OCTOMAP_DENSITIES[d].name_;
+
+      long memory_before = getAllocatedMemory();
+      ros::WallTime start = ros::WallTime::now();
+      data.scene_.reset(new planning_scene::PlanningScene(model));
+      populateWorld(data, object_count, OCTOMAP_DENSITIES[d]);
+      // the first check builds the collision world's acceleration structures
+      benchmarkCollision(&data, 0);
+      double populate_time = (ros::WallTime::now() - start).toSec();
+      long world_memory = getAllocatedMemory() - memory_before;
+
+      if (runner.run("collision/full" + suffix, boost::bind(&benchmarkCollision, &data, _1)) >= 0.0)
+      {
+        runner.addCounter("collision/full" + suffix, "populate_time_s", populate_time);
+        runner.addCounter("collision/full" + suffix, "world_heap_bytes", world_memory);
+      }
+      runner.run("planning_scene/diff" + suffix, boost::bind(&benchmarkDiff, &data, _1));
+      runner.run("planning_scene/diff_move_collision" + suffix, boost::bind(&benchmarkDiffCollision, &data, _1));
+      if (runner.enabled("planning_scene/get_msg" + suffix))
+      {
+        memory_before = getAllocatedMemory();
+        moveit_msgs::PlanningScene msg;
+        data.scene_->getPlanningSceneMsg(msg);
+        long msg_memory = getAllocatedMemory() - memory_before;
+        runner.run("planning_scene/get_msg" + suffix, boost::bind(&benchmarkSceneMsg, &data, _1));
+        runner.addCounter("planning_scene/get_msg" + suffix, "msg_heap_bytes", msg_memory);
+      }
+      runner.run("planning_scene/process_collision_object_add" + suffix, boost::bind(&benchmarkAddObjectMsg, &data, _1));
+      runner.run("planning_scene/process_collision_object_move" + suffix, boost::bind(&benchmarkMoveObjectMsg, &data, _1));
+    }
+
+  if (data.sink_ == -1.0)
+    std::cout << data.sink_ << std::endl;
+  return runner.write() ? 0 : 1;
+}
@@ -36,10 +36,15 @@
 
 #include <gtest/gtest.h>
 #include <moveit/planning_scene/planning_scene.h>
+#include <moveit/planning_scene/async_octomap_processor.h>
+#include <moveit/planning_scene/lazy_validity_checker.h>
+#include <octomap_msgs/conversions.h>
 #include <urdf_parser/urdf_parser.h>
 #include <fstream>
+#include <sstream>
 #include <moveit/test_resources/config.h>
 #include <boost/filesystem/path.hpp>
+#include <boost/thread/mutex.hpp>
 
 
 boost::shared_ptr<urdf::ModelInterface> loadRobotModel()
@@ -128,6 +133,682 @@ TEST(PlanningScene, MakeAttachedDiff)
   ps->checkCollision(req, res);
 }
 
+TEST(PlanningScene, ConstraintSetCache)
+{
+  boost::shared_ptr<urdf::ModelInterface> urdf_model = loadRobotModel();
+  boost::shared_ptr<srdf::Model> srdf_model(new srdf::Model());
+  planning_scene::PlanningScene ps(urdf_model, srdf_model);
+
+  const robot_state::RobotState &state = ps.getCurrentState();
+  Eigen::Affine3d pose = state.getGlobalLinkTransform("r_wrist_roll_link");
+  ps.getWorldNonConst()->addToObject("box", shapes::ShapeConstPtr(new shapes::Box(0.1, 0.1, 0.1)), pose);
+
+  // a small region around the origin of the box, which is at the link
+  moveit_msgs::Constraints constr;
+  constr.position_constraints.resize(1);
+  moveit_msgs::PositionConstraint &pc = constr.position_constraints[0];
+  pc.header.frame_id = "box";
+  pc.link_name = "r_wrist_roll_link";
+  pc.constraint_region.primitives.resize(1);
+  pc.constraint_region.primitives[0].type = shape_msgs::SolidPrimitive::SPHERE;
+  pc.constraint_region.primitives[0].dimensions.resize(1, 0.05);
+  pc.constraint_region.primitive_poses.resize(1);
+  pc.constraint_region.primitive_poses[0].orientation.w = 1.0;
+  pc.weight = 1.0;
+
+  EXPECT_EQ(ps.getConstraintSetCacheSize(), 16);
+  EXPECT_TRUE(ps.isStateConstrained(state, constr));
+  EXPECT_TRUE(ps.isStateConstrained(state, constr));
+
+  // moving the frame the constraint is expressed in must not reuse the cached set
+  ps.getWorldNonConst()->removeObject("box");
+  pose.translation().x() += 1.0;
+  ps.getWorldNonConst()->addToObject("box", shapes::ShapeConstPtr(new shapes::Box(0.1, 0.1, 0.1)), pose);
+  EXPECT_FALSE(ps.isStateConstrained(state, constr));
+
+  pc.constraint_region.primitives[0].dimensions[0] = 2.0;
+  EXPECT_TRUE(ps.isStateConstrained(state, constr));
+
+  ps.setConstraintSetCacheSize(0);
+  EXPECT_TRUE(ps.isStateConstrained(state, constr));
+}
+
+TEST(PlanningScene, StateValidityCache)
+{
+  boost::shared_ptr<urdf::ModelInterface> urdf_model = loadRobotModel();
+  boost::shared_ptr<srdf::Model> srdf_model(new srdf::Model());
+  planning_scene::PlanningScene ps(urdf_model, srdf_model);
+
+  robot_state::RobotState state = ps.getCurrentState();
+  state.setVariablePosition("r_shoulder_pan_joint", 0.001);
+  state.update();
+  Eigen::Affine3d pose = state.getGlobalLinkTransform("r_wrist_roll_link");
+  ps.getWorldNonConst()->addToObject("box", shapes::ShapeConstPtr(new shapes::Box(0.1, 0.1, 0.1)), pose);
+
+  EXPECT_EQ(ps.getStateValidityCacheSize(), 0);
+  ps.setStateValidityCacheSize(64);
+  std::size_t hits, misses;
+  EXPECT_TRUE(ps.isStateColliding(state));
+  EXPECT_TRUE(ps.isStateColliding(state));
+  ps.getStateValidityCacheStatistics(hits, misses);
+  EXPECT_EQ(hits, 1);
+  EXPECT_EQ(misses, 1);
+
+  // without a tolerance, only identical states reuse a check
+  state.setVariablePosition("r_shoulder_pan_joint", 0.002);
+  EXPECT_TRUE(ps.isStateColliding(state));
+  ps.getStateValidityCacheStatistics(hits, misses);
+  EXPECT_EQ(misses, 2);
+
+  ps.setStateValidityCacheTolerance(0.01);
+  EXPECT_TRUE(ps.isStateColliding(state));
+  state.setVariablePosition("r_shoulder_pan_joint", 0.003);
+  EXPECT_TRUE(ps.isStateColliding(state));
+  ps.getStateValidityCacheStatistics(hits, misses);
+  EXPECT_EQ(hits, 1);
+  EXPECT_EQ(misses, 1);
+
+  // changes to the scene drop the remembered checks, also for diffs of the scene
+  ps.getWorldNonConst()->removeObject("box");
+  EXPECT_FALSE(ps.isStateColliding(state));
+
+  planning_scene::PlanningScenePtr parent(new planning_scene::PlanningScene(urdf_model, srdf_model));
+  parent->setStateValidityCacheSize(64);
+  planning_scene::PlanningScenePtr child = parent->diff();
+  EXPECT_EQ(child->getStateValidityCacheSize(), 64);
+  child->getWorldNonConst()->addToObject("box", shapes::ShapeConstPtr(new shapes::Box(0.1, 0.1, 0.1)), pose);
+  EXPECT_TRUE(child->isStateColliding(state));
+  parent->getAllowedCollisionMatrixNonConst().setDefaultEntry("box", true);
+  EXPECT_FALSE(child->isStateColliding(state));
+
+  // so do modifications through references obtained before the checks
+  collision_detection::WorldPtr world = ps.getWorldNonConst();
+  collision_detection::AllowedCollisionMatrix &acm = ps.getAllowedCollisionMatrixNonConst();
+  EXPECT_FALSE(ps.isStateColliding(state));
+  world->addToObject("box", shapes::ShapeConstPtr(new shapes::Box(0.1, 0.1, 0.1)), pose);
+  EXPECT_TRUE(ps.isStateColliding(state));
+  acm.setDefaultEntry("box", true);
+  EXPECT_FALSE(ps.isStateColliding(state));
+}
+
+static bool rejectAll(const robot_state::RobotState&, bool)
+{
+  return false;
+}
+
+TEST(PlanningScene, ValidityStages)
+{
+  boost::shared_ptr<urdf::ModelInterface> urdf_model = loadRobotModel();
+  boost::shared_ptr<srdf::Model> srdf_model(new srdf::Model());
+  planning_scene::PlanningScene ps(urdf_model, srdf_model);
+
+  robot_state::RobotState state = ps.getCurrentState();
+  Eigen::Affine3d pose = state.getGlobalLinkTransform("r_wrist_roll_link");
+  ps.getWorldNonConst()->addToObject("box", shapes::ShapeConstPtr(new shapes::Box(0.1, 0.1, 0.1)), pose);
+
+  // a region the link is not in
+  moveit_msgs::Constraints constr;
+  constr.position_constraints.resize(1);
+  moveit_msgs::PositionConstraint &pc = constr.position_constraints[0];
+  pc.header.frame_id = ps.getPlanningFrame();
+  pc.link_name = "r_wrist_roll_link";
+  pc.constraint_region.primitives.resize(1);
+  pc.constraint_region.primitives[0].type = shape_msgs::SolidPrimitive::SPHERE;
+  pc.constraint_region.primitives[0].dimensions.resize(1, 0.05);
+  pc.constraint_region.primitive_poses.resize(1);
+  pc.constraint_region.primitive_poses[0].position.x = 10.0;
+  pc.constraint_region.primitive_poses[0].orientation.w = 1.0;
+  pc.weight = 1.0;
+
+  // the constraints are checked before collisions, so the colliding state is rejected without collision checking
+  planning_scene::ValidityStage stage;
+  EXPECT_FALSE(ps.isStateValid(state, constr, "", false, &stage));
+  EXPECT_EQ(planning_scene::ValidityStages::POSITION_CONSTRAINTS, stage);
+  std::vector<planning_scene::ValidityStageStatistics> stats;
+  ps.getValidityStageStatistics(stats);
+  ASSERT_EQ(planning_scene::ValidityStages::STAGE_COUNT, stats.size());
+  EXPECT_EQ(1, stats[planning_scene::ValidityStages::BOUNDS].evaluations);
+  EXPECT_EQ(1, stats[planning_scene::ValidityStages::POSITION_CONSTRAINTS].rejections);
+  EXPECT_EQ(0, stats[planning_scene::ValidityStages::COLLISION].evaluations);
+
+  EXPECT_FALSE(ps.isStateValid(state, "", false, &stage));
+  EXPECT_EQ(planning_scene::ValidityStages::COLLISION, stage);
+
+  ps.setStateFeasibilityPredicate(&rejectAll);
+  EXPECT_FALSE(ps.isStateValid(state, "", false, &stage));
+  EXPECT_EQ(planning_scene::ValidityStages::FEASIBILITY, stage);
+  ps.setStateFeasibilityPredicate(planning_scene::StateFeasibilityFn());
+
+  robot_state::RobotState out_of_bounds(state);
+  out_of_bounds.setVariablePosition("r_shoulder_pan_joint", 100.0);
+  EXPECT_FALSE(ps.isStateValid(out_of_bounds, "", false, &stage));
+  EXPECT_EQ(planning_scene::ValidityStages::BOUNDS, stage);
+
+  ps.getWorldNonConst()->removeObject("box");
+  EXPECT_TRUE(ps.isStateValid(state, "", false, &stage));
+  EXPECT_EQ(planning_scene::ValidityStages::NONE, stage);
+
+  // the order adapts to the checks that reject states, but the results do not depend on it
+  for (std::size_t i = 0 ; i < 200 ; ++i)
+    EXPECT_FALSE(ps.isStateValid(state, constr));
+  std::vector<planning_scene::ValidityStage> order;
+  ps.getValidityStageOrder(order);
+  ASSERT_EQ(planning_scene::ValidityStages::STAGE_COUNT - 1, order.size());
+  EXPECT_TRUE(ps.getAdaptiveValidityStageOrdering());
+  EXPECT_TRUE(ps.isStateValid(state));
+
+  ps.setAdaptiveValidityStageOrdering(false);
+  ps.getValidityStageOrder(order);
+  for (std::size_t i = 0 ; i < order.size() ; ++i)
+    EXPECT_EQ(i + 1, (std::size_t)order[i]);
+  ps.resetValidityStageStatistics();
+  ps.getValidityStageStatistics(stats);
+  EXPECT_EQ(0, stats[planning_scene::ValidityStages::POSITION_CONSTRAINTS].evaluations);
+}
+
+// a feasibility predicate that rejects the states with a given position of r_shoulder_pan_joint
+struct RejectPanPosition
+{
+  RejectPanPosition(double position, unsigned int *calls, boost::mutex *lock) : position_(position), calls_(calls), lock_(lock)
+  {
+  }
+
+  bool operator()(const robot_state::RobotState &state, bool) const
+  {
+    {
+      boost::mutex::scoped_lock slock(*lock_);
+      ++(*calls_);
+    }
+    return fabs(state.getVariablePosition("r_shoulder_pan_joint") - position_) > 1e-9;
+  }
+
+  double        position_;
+  unsigned int *calls_;
+  boost::mutex *lock_;
+};
+
+TEST(PlanningScene, ParallelPathValidation)
+{
+  boost::shared_ptr<urdf::ModelInterface> urdf_model = loadRobotModel();
+  boost::shared_ptr<srdf::Model> srdf_model(new srdf::Model());
+  planning_scene::PlanningScene ps(urdf_model, srdf_model);
+  ps.setPathValidationThreadCount(4);
+  EXPECT_EQ(4u, ps.getPathValidationThreadCount());
+
+  robot_trajectory::RobotTrajectory trajectory(ps.getRobotModel(), "");
+  robot_state::RobotState state = ps.getCurrentState();
+  const std::size_t n_wp = 101;
+  for (std::size_t i = 0 ; i < n_wp ; ++i)
+  {
+    state.setVariablePosition("r_shoulder_pan_joint", -0.01 * i);
+    trajectory.addSuffixWayPoint(state, 0.1);
+  }
+
+  unsigned int calls = 0;
+  boost::mutex lock;
+
+  // a valid path is valid with any number of threads
+  ps.setStateFeasibilityPredicate(RejectPanPosition(10.0, &calls, &lock));
+  EXPECT_TRUE(ps.isPathValid(trajectory));
+  EXPECT_EQ(n_wp, calls);
+  std::vector<std::size_t> invalid;
+  EXPECT_TRUE(ps.isPathValid(trajectory, "", false, &invalid));
+  EXPECT_TRUE(invalid.empty());
+
+  // an invalid waypoint in the middle is found, and reported when indices are requested
+  ps.setStateFeasibilityPredicate(RejectPanPosition(-0.01 * 37, &calls, &lock));
+  EXPECT_FALSE(ps.isPathValid(trajectory));
+  EXPECT_FALSE(ps.isPathValid(trajectory, "", false, &invalid));
+  ASSERT_EQ(1u, invalid.size());
+  EXPECT_EQ(37u, invalid[0]);
+
+  // the end points are checked first, and the workers stop once an invalid waypoint is found
+  ps.setStateFeasibilityPredicate(RejectPanPosition(-0.01 * (n_wp - 1), &calls, &lock));
+  calls = 0;
+  EXPECT_FALSE(ps.isPathValid(trajectory));
+  EXPECT_LT(calls, n_wp / 2);
+
+  // the single threaded check gives the same results
+  ps.setPathValidationThreadCount(1);
+  EXPECT_FALSE(ps.isPathValid(trajectory, "", false, &invalid));
+  ASSERT_EQ(1u, invalid.size());
+  EXPECT_EQ(n_wp - 1, invalid[0]);
+}
+
+TEST(PlanningScene, CollisionBatch)
+{
+  boost::shared_ptr<urdf::ModelInterface> urdf_model = loadRobotModel();
+  boost::shared_ptr<srdf::Model> srdf_model(new srdf::Model());
+  planning_scene::PlanningScene ps(urdf_model, srdf_model);
+
+  // a sweep of the right arm, with a box in the middle of it
+  robot_trajectory::RobotTrajectory trajectory(ps.getRobotModel(), "");
+  robot_state::RobotState state = ps.getCurrentState();
+  for (int i = 0 ; i <= 40 ; ++i)
+  {
+    state.setVariablePosition("r_shoulder_pan_joint", -0.025 * i);
+    state.update();
+    trajectory.addSuffixWayPoint(state, 0.1);
+  }
+  ps.getWorldNonConst()->addToObject("box", shapes::ShapeConstPtr(new shapes::Box(0.1, 0.1, 0.1)),
+                                     trajectory.getWayPoint(20).getGlobalLinkTransform("r_wrist_roll_link"));
+
+  std::vector<const robot_state::RobotState*> states(trajectory.getWayPointCount());
+  std::vector<bool> expected(states.size());
+  int first = -1;
+  collision_detection::CollisionRequest req;
+  for (std::size_t i = 0 ; i < states.size() ; ++i)
+  {
+    states[i] = &trajectory.getWayPoint(i);
+    collision_detection::CollisionResult res;
+    robot_state::RobotState copy(*states[i]);
+    ps.checkCollision(req, res, copy);
+    expected[i] = res.collision;
+    if (res.collision && first < 0)
+      first = i;
+  }
+  ASSERT_GE(first, 0);
+  EXPECT_FALSE(expected.front());
+  EXPECT_FALSE(expected.back());
+
+  // the results are the same as those of the checks of single states, with any number of threads
+  unsigned int thread_counts[] = { 1, 4, 0 };
+  for (std::size_t t = 0 ; t < sizeof(thread_counts) / sizeof(thread_counts[0]) ; ++t)
+  {
+    std::vector<collision_detection::CollisionResult> res;
+    EXPECT_EQ(first, ps.checkCollisionBatch(req, res, states, false, thread_counts[t]));
+    ASSERT_EQ(states.size(), res.size());
+    for (std::size_t i = 0 ; i < res.size() ; ++i)
+      EXPECT_EQ(expected[i], res[i].collision);
+
+    // the waypoints of the trajectory give the same results
+    EXPECT_EQ(first, ps.checkCollisionBatch(req, res, trajectory, false, thread_counts[t]));
+    for (std::size_t i = 0 ; i < res.size() ; ++i)
+      EXPECT_EQ(expected[i], res[i].collision);
+
+    // when stopping at the first collision, the states after it are not reported in collision
+    EXPECT_EQ(first, ps.checkCollisionBatch(req, res, states, true, thread_counts[t]));
+    ASSERT_EQ(states.size(), res.size());
+    for (int i = 0 ; i < first ; ++i)
+      EXPECT_FALSE(res[i].collision);
+    EXPECT_TRUE(res[first].collision);
+  }
+
+  // the allowed collision matrix is respected
+  collision_detection::AllowedCollisionMatrix acm = ps.getAllowedCollisionMatrix();
+  acm.setDefaultEntry("box", true);
+  std::vector<collision_detection::CollisionResult> res;
+  EXPECT_EQ(-1, ps.checkCollisionBatch(req, res, states, acm, false, 4));
+  for (std::size_t i = 0 ; i < res.size() ; ++i)
+    EXPECT_FALSE(res[i].collision);
+}
+
+TEST(PlanningScene, CollisionVariants)
+{
+  boost::shared_ptr<urdf::ModelInterface> urdf_model = loadRobotModel();
+  boost::shared_ptr<srdf::Model> srdf_model(new srdf::Model());
+  planning_scene::PlanningScene ps(urdf_model, srdf_model);
+
+  const robot_state::RobotState &state = ps.getCurrentState();
+  Eigen::Affine3d wrist = state.getGlobalLinkTransform("r_wrist_roll_link");
+  Eigen::Affine3d away = Eigen::Affine3d(Eigen::Translation3d(10.0, 0.0, 0.0));
+  ps.getWorldNonConst()->addToObject("box", shapes::ShapeConstPtr(new shapes::Box(0.1, 0.1, 0.1)), away);
+  ps.getWorldNonConst()->addToObject("other_box", shapes::ShapeConstPtr(new shapes::Box(0.1, 0.1, 0.1)), away);
+
+  std::vector<planning_scene::SceneVariant> variants(4);
+  variants[1].object_poses["box"] = wrist;
+  variants[2].object_poses["box"] = wrist;
+  variants[2].attached_objects.resize(1);
+  variants[2].attached_objects[0].object_id = "box";
+  variants[2].attached_objects[0].link_name = "r_wrist_roll_link";
+  variants[2].attached_objects[0].pose = Eigen::Affine3d(Eigen::Translation3d(1.0, 0.0, 0.0));
+  variants[3].object_poses["other_box"] = wrist;
+
+  std::vector<const robot_state::RobotState*> states(1, &state);
+  std::vector<std::vector<bool> > colliding;
+  ps.checkCollisionVariants(states, variants, colliding);
+  ASSERT_EQ(4, colliding.size());
+  ASSERT_EQ(1, colliding[0].size());
+  EXPECT_FALSE(colliding[0][0]);
+  EXPECT_TRUE(colliding[1][0]);
+  // attaching the box takes precedence over moving it
+  EXPECT_FALSE(colliding[2][0]);
+  EXPECT_TRUE(colliding[3][0]);
+
+  // the same results as for diffs of the scene
+  planning_scene::PlanningScenePtr parent(new planning_scene::PlanningScene(urdf_model, srdf_model));
+  parent->getWorldNonConst()->addToObject("box", shapes::ShapeConstPtr(new shapes::Box(0.1, 0.1, 0.1)), away);
+  planning_scene::PlanningScenePtr child = parent->diff();
+  child->getWorldNonConst()->moveShapeInObject("box", child->getWorld()->getObject("box")->shapes_[0], wrist);
+  EXPECT_TRUE(child->isStateColliding(state));
+  EXPECT_FALSE(parent->isStateColliding(state));
+}
+
+TEST(PlanningScene, LazyValidityChecker)
+{
+  boost::shared_ptr<urdf::ModelInterface> urdf_model = loadRobotModel();
+  boost::shared_ptr<srdf::Model> srdf_model(new srdf::Model());
+  planning_scene::PlanningScenePtr ps(new planning_scene::PlanningScene(urdf_model, srdf_model));
+
+  // only collisions with the world matter here
+  const std::vector<std::string> &links = ps->getRobotModel()->getLinkModelNamesWithCollisionGeometry();
+  ps->getAllowedCollisionMatrixNonConst().setEntry(links, links, true);
+
+  robot_state::RobotState state = ps->getCurrentState();
+  state.update();
+  Eigen::Affine3d pose = state.getGlobalLinkTransform("r_wrist_roll_link");
+  ps->getWorldNonConst()->addToObject("box", shapes::ShapeConstPtr(new shapes::Box(0.1, 0.1, 0.1)), pose);
+
+  planning_scene::LazyValidityChecker checker(ps);
+  state.setVariablePosition("r_shoulder_pan_joint", -0.5);
+  planning_scene::LazyValidityChecker::StateHandle a = checker.addState(state);
+  state.setVariablePosition("r_shoulder_pan_joint", 0.5);
+  planning_scene::LazyValidityChecker::StateHandle b = checker.addState(state);
+  state.setVariablePosition("r_shoulder_pan_joint", -0.3);
+  planning_scene::LazyValidityChecker::StateHandle c = checker.addState(state);
+  EXPECT_EQ(checker.getCheckCount(), 0);
+
+  // the motion from a to b sweeps the arm through the box
+  std::vector<planning_scene::LazyValidityChecker::StateHandle> path;
+  path.push_back(a);
+  path.push_back(b);
+  EXPECT_FALSE(checker.resolvePath(path));
+  EXPECT_EQ(checker.getEdgeStatus(checker.addEdge(b, a)), planning_scene::LazyValidityChecker::INVALID);
+  std::size_t count = checker.getCheckCount();
+  EXPECT_GT(count, 0);
+  EXPECT_FALSE(checker.resolvePath(path));
+  EXPECT_EQ(checker.getCheckCount(), count);
+
+  path[1] = c;
+  EXPECT_TRUE(checker.resolvePath(path));
+  EXPECT_EQ(checker.getStateStatus(a), planning_scene::LazyValidityChecker::VALID);
+  EXPECT_EQ(checker.getStateStatus(c), planning_scene::LazyValidityChecker::VALID);
+  EXPECT_EQ(checker.getEdgeStatus(checker.addEdge(a, c)), planning_scene::LazyValidityChecker::VALID);
+  count = checker.getCheckCount();
+  EXPECT_TRUE(checker.resolvePath(path));
+  EXPECT_EQ(checker.getCheckCount(), count);
+}
+
+TEST(PlanningScene, FrameTransforms)
+{
+  boost::shared_ptr<urdf::ModelInterface> urdf_model = loadRobotModel();
+  boost::shared_ptr<srdf::Model> srdf_model(new srdf::Model());
+  planning_scene::PlanningScenePtr ps(new planning_scene::PlanningScene(urdf_model, srdf_model));
+
+  const robot_state::RobotState &state = ps->getCurrentState();
+  EXPECT_TRUE(ps->knowsFrameTransform("r_wrist_roll_link"));
+  EXPECT_TRUE(ps->getFrameTransform("/r_wrist_roll_link").isApprox(state.getGlobalLinkTransform("r_wrist_roll_link")));
+  EXPECT_TRUE(ps->getFrameTransform(ps->getPlanningFrame()).isApprox(Eigen::Affine3d::Identity()));
+  EXPECT_FALSE(ps->knowsFrameTransform("box"));
+
+  // world objects are resolved, and the index follows their changes
+  Eigen::Affine3d pose(Eigen::Translation3d(1.0, 0.0, 0.0));
+  ps->getWorldNonConst()->addToObject("box", shapes::ShapeConstPtr(new shapes::Box(0.1, 0.1, 0.1)), pose);
+  EXPECT_TRUE(ps->knowsFrameTransform("box"));
+  EXPECT_TRUE(ps->getFrameTransform("box").isApprox(pose));
+  Eigen::Affine3d moved(Eigen::Translation3d(2.0, 0.0, 0.0));
+  ps->getWorldNonConst()->moveShapeInObject("box", ps->getWorld()->getObject("box")->shapes_[0], moved);
+  EXPECT_TRUE(ps->getFrameTransform("/box").isApprox(moved));
+
+  // fixed frames are shadowed by world objects of the same name
+  Eigen::Affine3d fixed(Eigen::Translation3d(0.0, 3.0, 0.0));
+  ps->getTransformsNonConst().setTransform(fixed, "/marker");
+  EXPECT_TRUE(ps->getFrameTransform("marker").isApprox(fixed));
+  ps->getWorldNonConst()->addToObject("marker", shapes::ShapeConstPtr(new shapes::Sphere(0.1)), pose);
+  EXPECT_TRUE(ps->getFrameTransform("marker").isApprox(pose));
+  ps->getWorldNonConst()->removeObject("marker");
+  EXPECT_TRUE(ps->getFrameTransform("marker").isApprox(fixed));
+
+  // diffs have their own index
+  planning_scene::PlanningScenePtr diff = ps->diff();
+  EXPECT_TRUE(diff->getFrameTransform("box").isApprox(moved));
+  diff->getWorldNonConst()->removeObject("box");
+  EXPECT_FALSE(diff->knowsFrameTransform("box"));
+  EXPECT_TRUE(ps->knowsFrameTransform("box"));
+  diff->clearDiffs();
+  EXPECT_TRUE(diff->getFrameTransform("box").isApprox(moved));
+}
+
+TEST(PlanningScene, Snapshot)
+{
+  boost::shared_ptr<urdf::ModelInterface> urdf_model = loadRobotModel();
+  boost::shared_ptr<srdf::Model> srdf_model(new srdf::Model());
+  planning_scene::PlanningScenePtr ps(new planning_scene::PlanningScene(urdf_model, srdf_model));
+
+  Eigen::Affine3d pose(Eigen::Translation3d(1.0, 0.5, 0.0) * Eigen::AngleAxisd(0.3, Eigen::Vector3d::UnitZ()));
+  shapes::Mesh *mesh = new shapes::Mesh(3, 1);
+  for (unsigned int i = 0 ; i < 9 ; ++i)
+    mesh->vertices[i] = i % 4 == 0 ? 1.0 : 0.0;
+  for (unsigned int i = 0 ; i < 3 ; ++i)
+    mesh->triangles[i] = i;
+  mesh->computeTriangleNormals();
+  ps->getWorldNonConst()->addToObject("mesh", shapes::ShapeConstPtr(mesh), pose);
+  ps->getWorldNonConst()->addToObject("box", shapes::ShapeConstPtr(new shapes::Box(0.1, 0.2, 0.3)), Eigen::Affine3d::Identity());
+  ps->getWorldNonConst()->addToObject("box", shapes::ShapeConstPtr(new shapes::Sphere(0.4)), pose);
+  std_msgs::ColorRGBA color;
+  color.r = 1.0; color.a = 0.5;
+  ps->setObjectColor("box", color);
+  object_recognition_msgs::ObjectType type;
+  type.key = "crate";
+  ps->setObjectType("box", type);
+  ps->getAllowedCollisionMatrixNonConst().setEntry("box", "r_wrist_roll_link", true);
+  ps->getTransformsNonConst().setTransform(pose, "/marker");
+  ps->getCurrentStateNonConst().setVariablePosition("r_shoulder_pan_joint", 0.25);
+  ps->setName("recorded");
+
+  std::stringstream snapshot;
+  EXPECT_TRUE(ps->saveSnapshotToStream(snapshot));
+  std::string data = snapshot.str();
+
+  planning_scene::PlanningScenePtr loaded(new planning_scene::PlanningScene(urdf_model, srdf_model));
+  loaded->getWorldNonConst()->addToObject("stale", shapes::ShapeConstPtr(new shapes::Sphere(0.1)), pose);
+  ASSERT_TRUE(loaded->loadSnapshotFromMemory(data.data(), data.size()));
+  EXPECT_EQ("recorded", loaded->getName());
+  EXPECT_EQ(2, loaded->getWorld()->size());
+  EXPECT_FALSE(loaded->getWorld()->hasObject("stale"));
+  collision_detection::World::ObjectConstPtr obj = loaded->getWorld()->getObject("mesh");
+  ASSERT_TRUE(obj);
+  ASSERT_EQ(1, obj->shapes_.size());
+  EXPECT_TRUE(obj->shape_poses_[0].isApprox(pose));
+  const shapes::Mesh *loaded_mesh = static_cast<const shapes::Mesh*>(obj->shapes_[0].get());
+  ASSERT_EQ(shapes::MESH, loaded_mesh->type);
+  ASSERT_EQ(3, loaded_mesh->vertex_count);
+  for (unsigned int i = 0 ; i < 9 ; ++i)
+    EXPECT_EQ(mesh->vertices[i], loaded_mesh->vertices[i]);
+  EXPECT_EQ(2, loaded->getWorld()->getObject("box")->shapes_.size());
+  EXPECT_TRUE(loaded->hasObjectColor("box"));
+  EXPECT_FLOAT_EQ(0.5, loaded->getObjectColor("box").a);
+  EXPECT_TRUE(loaded->hasObjectType("box"));
+  EXPECT_EQ("crate", loaded->getObjectType("box").key);
+  collision_detection::AllowedCollision::Type allowed;
+  EXPECT_TRUE(loaded->getAllowedCollisionMatrix().getEntry("box", "r_wrist_roll_link", allowed));
+  EXPECT_EQ(collision_detection::AllowedCollision::ALWAYS, allowed);
+  EXPECT_TRUE(loaded->getFrameTransform("marker").isApprox(pose));
+  EXPECT_DOUBLE_EQ(0.25, loaded->getCurrentState().getVariablePosition("r_shoulder_pan_joint"));
+
+  // invalid snapshots leave the scene unchanged
+  EXPECT_FALSE(loaded->loadSnapshotFromMemory(data.data(), data.size() / 2));
+  EXPECT_FALSE(loaded->loadSnapshotFromMemory("not a snapshot", 14));
+  EXPECT_EQ(2, loaded->getWorld()->size());
+}
+
+TEST(PlanningScene, DiffSinceVersion)
+{
+  boost::shared_ptr<urdf::ModelInterface> urdf_model = loadRobotModel();
+  boost::shared_ptr<srdf::Model> srdf_model(new srdf::Model());
+  planning_scene::PlanningScenePtr ps(new planning_scene::PlanningScene(urdf_model, srdf_model));
+  Eigen::Affine3d pose(Eigen::Translation3d(1.0, 0.0, 0.0));
+  ps->getWorldNonConst()->addToObject("box", shapes::ShapeConstPtr(new shapes::Box(0.1, 0.1, 0.1)), pose);
+  ps->getWorldNonConst()->addToObject("sphere", shapes::ShapeConstPtr(new shapes::Sphere(0.1)), pose);
+
+  // a consumer starts from the complete scene
+  planning_scene::PlanningScene consumer(urdf_model, srdf_model);
+  moveit_msgs::PlanningScene msg;
+  ps->getPlanningSceneMsg(msg);
+  consumer.setPlanningSceneMsg(msg);
+  boost::uint64_t version = ps->getVersion();
+
+  // no changes, nothing to send
+  EXPECT_TRUE(ps->getPlanningSceneDiffMsg(msg, version));
+  EXPECT_TRUE(msg.world.collision_objects.empty());
+  EXPECT_TRUE(msg.robot_state.joint_state.name.empty());
+  EXPECT_TRUE(msg.allowed_collision_matrix.entry_names.empty());
+
+  // only the changed parts are sent
+  Eigen::Affine3d moved(Eigen::Translation3d(2.0, 0.0, 0.0));
+  ps->getWorldNonConst()->moveShapeInObject("box", ps->getWorld()->getObject("box")->shapes_[0], moved);
+  ps->getWorldNonConst()->removeObject("sphere");
+  ps->getWorldNonConst()->addToObject("cylinder", shapes::ShapeConstPtr(new shapes::Cylinder(0.1, 0.2)), pose);
+  ps->getWorldNonConst()->addToObject("temporary", shapes::ShapeConstPtr(new shapes::Sphere(0.1)), pose);
+  ps->getWorldNonConst()->removeObject("temporary");
+  EXPECT_LT(version, ps->getVersion());
+  EXPECT_TRUE(ps->getPlanningSceneDiffMsg(msg, version));
+  EXPECT_TRUE(msg.is_diff);
+  EXPECT_EQ(4, msg.world.collision_objects.size());
+  EXPECT_TRUE(msg.robot_state.joint_state.name.empty());
+  consumer.usePlanningSceneMsg(msg);
+  EXPECT_EQ(2, consumer.getWorld()->size());
+  EXPECT_TRUE(consumer.getWorld()->getObject("box")->shape_poses_[0].isApprox(moved));
+  EXPECT_FALSE(consumer.getWorld()->hasObject("sphere"));
+  EXPECT_TRUE(consumer.getWorld()->hasObject("cylinder"));
+  version = ps->getVersion();
+
+  ps->getCurrentStateNonConst().setVariablePosition("r_shoulder_pan_joint", 0.25);
+  EXPECT_TRUE(ps->getPlanningSceneDiffMsg(msg, version));
+  EXPECT_TRUE(msg.world.collision_objects.empty());
+  EXPECT_FALSE(msg.robot_state.joint_state.name.empty());
+  consumer.usePlanningSceneMsg(msg);
+  EXPECT_DOUBLE_EQ(0.25, consumer.getCurrentState().getVariablePosition("r_shoulder_pan_joint"));
+
+  // versions the scene does not know about produce the complete scene
+  EXPECT_FALSE(ps->getPlanningSceneDiffMsg(msg, ps->getVersion() + 1));
+  EXPECT_FALSE(msg.is_diff);
+  EXPECT_EQ(2, msg.world.collision_objects.size());
+
+  // clearing the diffs of a scene forgets all earlier versions
+  planning_scene::PlanningScenePtr child = ps->diff();
+  version = child->getVersion();
+  child->getWorldNonConst()->removeObject("box");
+  EXPECT_TRUE(child->getPlanningSceneDiffMsg(msg, version));
+  EXPECT_EQ(1, msg.world.collision_objects.size());
+  child->clearDiffs();
+  EXPECT_FALSE(child->getPlanningSceneDiffMsg(msg, version));
+  EXPECT_TRUE(child->getPlanningSceneDiffMsg(msg, child->getVersion()));
+}
+
+TEST(PlanningScene, Snapshots)
+{
+  boost::shared_ptr<urdf::ModelInterface> urdf_model = loadRobotModel();
+  boost::shared_ptr<srdf::Model> srdf_model(new srdf::Model());
+  planning_scene::PlanningScenePtr ps(new planning_scene::PlanningScene(urdf_model, srdf_model));
+  Eigen::Affine3d pose(Eigen::Translation3d(1.0, 0.0, 0.0));
+  ps->getWorldNonConst()->addToObject("box", shapes::ShapeConstPtr(new shapes::Box(0.1, 0.1, 0.1)), pose);
+
+  // the same snapshot is shared while the scene does not change
+  planning_scene::PlanningSceneConstPtr snapshot = ps->getSnapshot();
+  EXPECT_FALSE(snapshot->getParent());
+  EXPECT_EQ(snapshot, ps->getSnapshot());
+  EXPECT_TRUE(snapshot->getWorld()->hasObject("box"));
+
+  // changes to the scene do not affect the snapshot
+  Eigen::Affine3d moved(Eigen::Translation3d(2.0, 0.0, 0.0));
+  ps->getWorldNonConst()->moveShapeInObject("box", ps->getWorld()->getObject("box")->shapes_[0], moved);
+  ps->getWorldNonConst()->addToObject("sphere", shapes::ShapeConstPtr(new shapes::Sphere(0.1)), pose);
+  ps->getCurrentStateNonConst().setVariablePosition("r_shoulder_pan_joint", 0.25);
+  ps->getAllowedCollisionMatrixNonConst().setEntry("box", "r_wrist_roll_link", true);
+  EXPECT_TRUE(snapshot->getWorld()->getObject("box")->shape_poses_[0].isApprox(pose));
+  EXPECT_FALSE(snapshot->getWorld()->hasObject("sphere"));
+  EXPECT_NE(0.25, snapshot->getCurrentState().getVariablePosition("r_shoulder_pan_joint"));
+  EXPECT_FALSE(snapshot->getAllowedCollisionMatrix().hasEntry("box", "r_wrist_roll_link"));
+
+  // collision checks use the geometry of the snapshot
+  collision_detection::CollisionRequest req;
+  collision_detection::CollisionResult res;
+  snapshot->checkCollision(req, res, snapshot->getCurrentState());
+
+  planning_scene::PlanningSceneConstPtr next = ps->getSnapshot();
+  EXPECT_NE(snapshot, next);
+  EXPECT_TRUE(next->getWorld()->hasObject("sphere"));
+  EXPECT_TRUE(next->getWorld()->getObject("box")->shape_poses_[0].isApprox(moved));
+  EXPECT_DOUBLE_EQ(0.25, next->getCurrentState().getVariablePosition("r_shoulder_pan_joint"));
+}
+
+TEST(PlanningScene, FlattenParents)
+{
+  boost::shared_ptr<urdf::ModelInterface> urdf_model = loadRobotModel();
+  boost::shared_ptr<srdf::Model> srdf_model(new srdf::Model());
+  planning_scene::PlanningScenePtr ps(new planning_scene::PlanningScene(urdf_model, srdf_model));
+  Eigen::Affine3d pose(Eigen::Translation3d(1.0, 0.0, 0.0));
+  ps->getWorldNonConst()->addToObject("box", shapes::ShapeConstPtr(new shapes::Box(0.1, 0.1, 0.1)), pose);
+  ps->getWorldNonConst()->addToObject("cylinder", shapes::ShapeConstPtr(new shapes::Cylinder(0.1, 0.1)), pose);
+
+  // a chain of diffs, each changing something different
+  planning_scene::PlanningScenePtr first = ps->diff();
+  first->getCurrentStateNonConst().setVariablePosition("r_shoulder_pan_joint", 0.25);
+  first->getWorldNonConst()->addToObject("sphere", shapes::ShapeConstPtr(new shapes::Sphere(0.1)), pose);
+  first->getWorldNonConst()->removeObject("cylinder");
+  planning_scene::PlanningScenePtr second = first->diff();
+  first.reset();
+  second->getAllowedCollisionMatrixNonConst().setEntry("box", "r_wrist_roll_link", true);
+  planning_scene::PlanningScenePtr last = second->diff();
+  Eigen::Affine3d moved(Eigen::Translation3d(2.0, 0.0, 0.0));
+  last->getWorldNonConst()->moveShapeInObject("sphere", last->getWorld()->getObject("sphere")->shapes_[0], moved);
+
+  last->flattenParents();
+  EXPECT_EQ(ps, last->getParent());
+  EXPECT_DOUBLE_EQ(0.25, last->getCurrentState().getVariablePosition("r_shoulder_pan_joint"));
+  EXPECT_TRUE(last->getAllowedCollisionMatrix().hasEntry("box", "r_wrist_roll_link"));
+  EXPECT_TRUE(last->getWorld()->getObject("sphere")->shape_poses_[0].isApprox(moved));
+  EXPECT_FALSE(last->getWorld()->hasObject("cylinder"));
+  // the scene in between is still in use, and must not change
+  EXPECT_TRUE(second->getAllowedCollisionMatrix().hasEntry("box", "r_wrist_roll_link"));
+  EXPECT_DOUBLE_EQ(0.25, second->getCurrentState().getVariablePosition("r_shoulder_pan_joint"));
+
+  // the merged diffs are relative to the last parent
+  planning_scene::PlanningScenePtr target = ps->diff();
+  last->pushDiffs(target);
+  EXPECT_DOUBLE_EQ(0.25, target->getCurrentState().getVariablePosition("r_shoulder_pan_joint"));
+  EXPECT_TRUE(target->getWorld()->getObject("sphere")->shape_poses_[0].isApprox(moved));
+  EXPECT_TRUE(target->getWorld()->hasObject("box"));
+  EXPECT_FALSE(target->getWorld()->hasObject("cylinder"));
+
+  last->decoupleParent();
+  EXPECT_FALSE(last->getParent());
+  EXPECT_DOUBLE_EQ(0.25, last->getCurrentState().getVariablePosition("r_shoulder_pan_joint"));
+  EXPECT_TRUE(last->getWorld()->hasObject("box"));
+}
+
+TEST(PlanningScene, AsyncOctomap)
+{
+  boost::shared_ptr<urdf::ModelInterface> urdf_model = loadRobotModel();
+  boost::shared_ptr<srdf::Model> srdf_model(new srdf::Model());
+  planning_scene::PlanningScene ps(urdf_model, srdf_model);
+
+  octomap::OcTree tree(0.1);
+  tree.updateNode(octomap::point3d(1.0, 0.0, 0.0), true);
+  octomap_msgs::OctomapWithPose map;
+  map.header.frame_id = ps.getPlanningFrame();
+  map.origin.orientation.w = 1.0;
+  octomap_msgs::fullMapToMsg(tree, map.octomap);
+
+  planning_scene::AsyncOctomapProcessor processor;
+  EXPECT_FALSE(processor.applyPendingUpdate(ps));
+  processor.processOctomapMsg(map);
+  for (int i = 0 ; i < 1000 && !processor.hasPendingUpdate() ; ++i)
+    boost::this_thread::sleep(boost::posix_time::milliseconds(5));
+  ASSERT_TRUE(processor.applyPendingUpdate(ps));
+  ASSERT_TRUE(ps.getWorld()->hasObject(planning_scene::PlanningScene::OCTOMAP_NS));
+  EXPECT_EQ(shapes::OCTREE, ps.getWorld()->getObject(planning_scene::PlanningScene::OCTOMAP_NS)->shapes_[0]->type);
+  EXPECT_FALSE(processor.hasPendingUpdate());
+
+  // a message without data removes the octomap
+  processor.processOctomapMsg(octomap_msgs::OctomapWithPose());
+  for (int i = 0 ; i < 1000 && !processor.hasPendingUpdate() ; ++i)
+    boost::this_thread::sleep(boost::posix_time::milliseconds(5));
+  ASSERT_TRUE(processor.applyPendingUpdate(ps));
+  EXPECT_FALSE(ps.getWorld()->hasObject(planning_scene::PlanningScene::OCTOMAP_NS));
+}
+
 int main(int argc, char **argv)
 {
   testing::InitGoogleTest(&argc, argv);
@@ -0,0 +1,104 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2013, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#ifndef MOVEIT_PROFILER_MEMORY_ACCOUNTING_
+#define MOVEIT_PROFILER_MEMORY_ACCOUNTING_
+
+#include <map>
+#include <string>
+#include <iostream>
+#include <boost/cstdint.hpp>
+
+namespace moveit
+{
+namespace tools
+{
+
+/** \brief Byte counters for the data structures that typically dominate the memory use of a planning process.
+    The counters are maintained by the code that allocates the corresponding data (e.g., RobotState,
+    the FCL geometry cache, distance fields, the collision world) and can be read at any time. Updates only touch
+    data local to the calling thread, so they are cheap enough for frequently allocated objects; reading the counters
+    sums the values of all threads. Unlike the rest of the profiler, accounting is always enabled. The reported values
+    are estimates of the memory owned by each subsystem, not of the memory requested from the allocator. */
+class MemoryAccounting
+{
+public:
+
+  /** \brief The subsystems memory is accounted for */
+  enum Subsystem
+    {
+      /** \brief Variable and transform storage of robot_state::RobotState instances */
+      ROBOT_STATE,
+
+      /** \brief Geometry (and bounding volume hierarchies) cached for FCL collision checking */
+      COLLISION_GEOMETRY_CACHE,
+
+      /** \brief Voxel storage of distance fields */
+      DISTANCE_FIELD,
+
+      /** \brief Shapes of the objects in collision worlds (octrees excluded) */
+      WORLD_OBJECTS,
+
+      /** \brief Octrees (e.g., octomaps) in collision worlds */
+      OCTOMAP,
+
+      SUBSYSTEM_COUNT
+    };
+
+  /** \brief Account for \e bytes allocated by \e subsystem */
+  static void Add(Subsystem subsystem, boost::int64_t bytes);
+
+  /** \brief Account for \e bytes released by \e subsystem */
+  static void Release(Subsystem subsystem, boost::int64_t bytes)
+  {
+    Add(subsystem, -bytes);
+  }
+
+  /** \brief Get the number of bytes currently accounted for \e subsystem */
+  static boost::int64_t Get(Subsystem subsystem);
+
+  /** \brief Get the name of \e subsystem, as used in GetUsage() */
+  static const std::string& GetName(Subsystem subsystem);
+
+  /** \brief Get the number of bytes accounted for each subsystem, by subsystem name */
+  static void GetUsage(std::map<std::string, boost::int64_t> &usage);
+
+  /** \brief Print the accounted memory of each subsystem */
+  static void Print(std::ostream &out = std::cout);
+};
+
+}
+}
+
+#endif
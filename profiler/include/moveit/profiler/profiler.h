@@ -52,12 +52,81 @@
 
 #endif
 
+#include <map>
+#include <string>
+#include <vector>
+#include <boost/cstdint.hpp>
+
+namespace moveit
+{
+namespace tools
+{
+
+/** \brief Statistics of a block of time (or probe) counted by the profiler, as returned by Profiler::getStatistics().
+    Times are in seconds; the percentiles are estimated from a log-bucketed histogram (relative error below 25%) */
+struct ProfiledBlock
+{
+  ProfiledBlock(void) : total(0.0), shortest(0.0), longest(0.0), parts(0), p50(0.0), p90(0.0), p99(0.0), p999(0.0)
+  {
+  }
+
+  std::string       name;
+  double            total;
+  double            shortest;
+  double            longest;
+  unsigned long int parts;
+  double            p50;
+  double            p90;
+  double            p99;
+  double            p999;
+};
+
+/** \brief Mean and standard deviation of a value averaged by the profiler */
+struct ProfiledAverage
+{
+  ProfiledAverage(void) : mean(0.0), stddev(0.0), parts(0)
+  {
+  }
+
+  double            mean;
+  double            stddev;
+  unsigned long int parts;
+};
+
+/** \brief The data collected by the profiler, merged over all threads */
+struct ProfilerStatistics
+{
+  ProfilerStatistics(void) : total(0.0)
+  {
+  }
+
+  /** \brief Total counted time (seconds) */
+  double                                   total;
+  std::map<std::string, unsigned long int> events;
+  std::map<std::string, ProfiledAverage>   averages;
+
+  /** \brief Blocks of time counted with begin()/end(), sorted by decreasing total time */
+  std::vector<ProfiledBlock>               blocks;
+
+  /** \brief Probes (see Profiler::ScopedProbe), sorted by decreasing total time; events counted for probes are in \e events */
+  std::vector<ProfiledBlock>               probes;
+
+  /** \brief Bytes accounted for each subsystem (see MemoryAccounting), at the time the statistics were collected */
+  std::map<std::string, boost::int64_t>    memory;
+};
+
+}
+}
+
 #if MOVEIT_ENABLE_PROFILING
 
 #include <map>
+#include <deque>
 #include <string>
 #include <iostream>
+#include <vector>
 #include <boost/thread.hpp>
+#include <boost/cstdint.hpp>
 #include <boost/noncopyable.hpp>
 #include <boost/date_time/posix_time/posix_time.hpp>
 
@@ -122,22 +191,98 @@ public:
     bool      wasRunning_;
   };
 
+  /** \brief Identifier of a probe, as returned by RegisterProbe() */
+  typedef unsigned int ProbeId;
+
+  /** \brief The maximum number of distinct probes */
+  static const ProbeId MAX_PROBES = 128;
+
+  /** \brief A histogram of durations (in nanoseconds) with logarithmically spaced buckets: each power of two is split
+      in SUB_BUCKETS equal parts, which bounds the relative error of the reported percentiles, for any duration up to
+      about half an hour */
+  struct Histogram
+  {
+    static const unsigned int SUB_BUCKETS = 4;
+    static const unsigned int BUCKETS = 164;
+
+    Histogram(void)
+    {
+      clear();
+    }
+
+    void clear(void);
+
+    void add(boost::uint64_t duration);
+
+    void merge(const Histogram &other);
+
+    /** \brief Estimate the duration below which a fraction \e p of the added durations lie */
+    double percentile(double p) const;
+
+    volatile boost::uint64_t counts[BUCKETS];
+  };
+
+  /** \brief Measure the time until this instance goes out of scope and add it to the probe \e id.
+      Unlike ScopedBlock, no lock is taken and no string is constructed, so probes are cheap enough to be
+      left in code that is called at high rates (e.g., collision checks). When the profiler is neither running nor
+      tracing, the clock is not read and nothing is recorded. */
+  class ScopedProbe
+  {
+  public:
+    ScopedProbe(ProbeId id, Profiler &prof = Profiler::Instance()) : id_(id), prof_(prof),
+                                                                     active_(prof.running_ || prof.tracing_),
+                                                                     start_(active_ ? Profiler::Now() : 0)
+    {
+    }
+
+    ~ScopedProbe(void)
+    {
+      if (!active_)
+        return;
+      boost::uint64_t end = Profiler::Now();
+      prof_.probe(id_, end - start_);
+      if (prof_.tracing_)
+        prof_.trace(id_, start_, end);
+    }
+
+  private:
+
+    ProbeId         id_;
+    Profiler       &prof_;
+    bool            active_;
+    boost::uint64_t start_;
+  };
+
   /** \brief Return an instance of the class */
   static Profiler& Instance(void);
 
   /** \brief Constructor. It is allowed to separately instantiate this
       class (not only as a singleton) */
-  Profiler(bool printOnDestroy = false, bool autoStart = false) : running_(false), printOnDestroy_(printOnDestroy)
-  {
-    if (autoStart)
-      start();
-  }
+  Profiler(bool printOnDestroy = false, bool autoStart = false);
 
   /** \brief Destructor */
-  ~Profiler(void)
+  ~Profiler(void);
+
+  /** \brief Get the identifier of the probe named \e name, registering it if needed. This takes a lock and is meant to be
+      called once per probe, typically to initialize a static variable (see MOVEIT_PROFILER_PROBE). Identifiers are shared by all
+      profiler instances. When more than MAX_PROBES names are registered, the returned identifier refers to an overflow probe. */
+  static ProbeId RegisterProbe(const std::string &name);
+
+  /** \brief A steady timestamp, in nanoseconds, as used by probes */
+  static boost::uint64_t Now(void);
+
+  /** \brief Add a measured \e duration (in nanoseconds) to the probe \e id, if the profiler is running. This only touches
+      data local to the calling thread. */
+  void probe(ProbeId id, boost::uint64_t duration);
+
+  /** \brief Count an event for the probe \e id, for a number of times, if the profiler is running. Like probe(), this
+      does not take a lock. */
+  void probeEvent(ProbeId id, const unsigned int times = 1);
+
+  /** \brief Count an event for the probe \e id, for a number of times */
+  static void ProbeEvent(ProbeId id, const unsigned int times = 1)
   {
-    if (printOnDestroy_ && !data_.empty())
-      status();
+    Instance().probeEvent(id, times);
   }
 
   /** \brief Start counting time */
@@ -227,6 +372,51 @@ public:
       events to the console (using msg::Console) */
   void console(void);
 
+  /** \brief Get the collected data, merged over all threads */
+  static void GetStatistics(ProfilerStatistics &stats)
+  {
+    Instance().getStatistics(stats);
+  }
+
+  /** \brief Start recording a timeline of blocks (begin()/end(), ScopedBlock) and probes (ScopedProbe). Each thread keeps
+      its last \e capacity events in a ring buffer. Starting again discards the events recorded so far. */
+  static void StartTracing(std::size_t capacity = 65536)
+  {
+    Instance().startTracing(capacity);
+  }
+
+  /** \brief Stop recording the timeline; the recorded events are kept until the next startTracing() */
+  static void StopTracing(void)
+  {
+    Instance().stopTracing();
+  }
+
+  /** \brief Write the recorded timeline in the Chrome trace event (JSON) format */
+  static void WriteTrace(std::ostream &out)
+  {
+    Instance().writeTrace(out);
+  }
+
+  /** \brief Start recording a timeline of blocks and probes (see StartTracing()) */
+  void startTracing(std::size_t capacity = 65536);
+
+  /** \brief Stop recording the timeline */
+  void stopTracing(void);
+
+  /** \brief Write the recorded timeline in the Chrome trace event (JSON) format, which can be loaded by chrome://tracing
+      and the Perfetto UI. Events that are recorded while this function runs may be missing or incomplete, so this is best
+      called after stopTracing(). */
+  void writeTrace(std::ostream &out);
+
+  /** \brief Check if a timeline is being recorded */
+  bool tracing(void) const
+  {
+    return tracing_;
+  }
+
+  /** \brief Get the collected data, merged over all threads */
+  void getStatistics(ProfilerStatistics &stats);
+
   /** \brief Check if the profiler is counting time or not */
   bool running(void) const
   {
@@ -260,6 +450,9 @@ private:
     /** \brief Number of times a chunk of time was added to this structure */
     unsigned long int parts;
 
+    /** \brief The distribution of the counted time intervals */
+    Histogram histogram;
+
     /** \brief The point in time when counting time started */
     boost::posix_time::ptime start;
 
@@ -279,6 +472,7 @@ private:
         shortest = dt;
       total = total + dt;
       ++parts;
+      histogram.add(dt.total_microseconds() * 1000);
     }
   };
 
@@ -308,14 +502,116 @@ private:
     std::map<std::string, TimeInfo>          time;
   };
 
+  /** \brief Information maintained for a probe, by a single thread. Other threads only read it (in status()), so values
+      read while the probe is in use may be slightly out of date */
+  struct ProbeInfo
+  {
+    ProbeInfo(void) : total(0), shortest(0), longest(0), parts(0), events(0)
+    {
+    }
+
+    /** \brief Total time measured (ns) */
+    volatile boost::uint64_t total;
+
+    /** \brief The shortest and longest measured durations (ns) */
+    volatile boost::uint64_t shortest;
+    volatile boost::uint64_t longest;
+
+    /** \brief Number of durations added */
+    volatile boost::uint64_t parts;
+
+    /** \brief Number of events counted */
+    volatile boost::uint64_t events;
+
+    /** \brief The distribution of the measured durations */
+    Histogram histogram;
+  };
+
+  /** \brief The probes of one thread */
+  /** \brief An interval recorded for the timeline. Names below MAX_PROBES are probe identifiers; the others index traceNames_
+      (offset by MAX_PROBES) */
+  struct TraceEvent
+  {
+    boost::uint32_t name;
+    boost::uint64_t start;
+    boost::uint64_t end;
+  };
+
+  /** \brief The probes of one thread */
+  struct ProbeThread
+  {
+    ProbeThread(Profiler *owner) : owner(owner), traceNext(0), traceCount(0), traceSession(0)
+    {
+    }
+
+    /** \brief The profiler the data is reported to */
+    Profiler         *owner;
+
+    boost::thread::id id;
+    ProbeInfo         probes[MAX_PROBES];
+
+    /** \brief Ring buffer of the timeline events of this thread (written only by this thread) */
+    std::vector<TraceEvent> trace;
+    std::size_t             traceNext;
+    boost::uint64_t         traceCount;
+
+    /** \brief The tracing session the buffer belongs to */
+    unsigned int            traceSession;
+  };
+
+  ProbeThread* getProbeThread(void);
+
+  /** \brief Record an interval in the timeline of the calling thread */
+  void trace(boost::uint32_t name, boost::uint64_t start, boost::uint64_t end);
+
+  /** \brief The timeline of a thread that has finished, oldest events first */
+  struct FinishedTrace
+  {
+    boost::thread::id       id;
+    std::vector<TraceEvent> trace;
+  };
+
+  /** \brief The number of timelines of finished threads kept for writeTrace(); older ones are dropped */
+  static const std::size_t MAX_FINISHED_TRACES = 64;
+
+  /** \brief Cleanup function for probeThread_, called when a thread exits: see retireProbeThread() */
+  static void releaseProbeThread(ProbeThread *pt);
+
+  /** \brief Add the probes of a finished thread to finishedProbes_, keep its timeline if it belongs to the current
+      tracing session and free its data */
+  void retireProbeThread(ProbeThread *pt);
+
+  /** \brief Add the probe data \e p to \e c */
+  static void mergeProbe(ProbeInfo &c, const ProbeInfo &p);
+
   void printThreadInfo(std::ostream &out, const PerThread &data);
 
+  void printProbeInfo(std::ostream &out, const std::vector<ProbeInfo> &probes);
+
+  /** \brief Combine the data of all threads; the caller holds lock_ */
+  void mergeThreads(PerThread &combined, std::vector<ProbeInfo> &probes) const;
+
   boost::mutex                           lock_;
   std::map<boost::thread::id, PerThread> data_;
   TimeInfo                               tinfo_;
-  bool                                   running_;
+  volatile bool                          running_;
   bool                                   printOnDestroy_;
 
+  /** \brief The probes of the calling thread; the data is owned by probeThreads_ until the thread exits */
+  boost::thread_specific_ptr<ProbeThread> probeThread_;
+  std::vector<ProbeThread*>               probeThreads_;
+
+  /** \brief The combined probes and the recent timelines of the threads that have finished */
+  std::vector<ProbeInfo>                  finishedProbes_;
+  std::deque<FinishedTrace>               finishedTraces_;
+
+  /** \brief Timeline recording state */
+  volatile bool                           tracing_;
+  std::size_t                             traceCapacity_;
+  unsigned int                            traceSession_;
+  std::map<std::string, boost::uint32_t>  traceNames_;
+  std::map<boost::thread::id, std::map<std::string, boost::uint64_t> > traceStart_;
+
 };
 }
 }
@@ -324,6 +620,7 @@ private:
 
 #include <string>
 #include <iostream>
+#include "moveit/profiler/memory_accounting.h"
 
 /* If profiling is disabled, provide empty implementations for the
    public functions */
@@ -362,6 +659,21 @@ public:
     }
   };
 
+  typedef unsigned int ProbeId;
+
+  class ScopedProbe
+  {
+  public:
+
+    ScopedProbe(ProbeId, Profiler & = Profiler::Instance())
+    {
+    }
+
+    ~ScopedProbe(void)
+    {
+    }
+  };
+
   static Profiler& Instance(void);
 
   Profiler(bool = true, bool = true)
@@ -372,6 +684,23 @@ public:
   {
   }
 
+  static ProbeId RegisterProbe(const std::string &)
+  {
+    return 0;
+  }
+
+  void probe(ProbeId, unsigned long long)
+  {
+  }
+
+  void probeEvent(ProbeId, const unsigned int = 1)
+  {
+  }
+
+  static void ProbeEvent(ProbeId, const unsigned int = 1)
+  {
+  }
+
   static void Start(void)
   {
   }
@@ -444,6 +773,47 @@ public:
   {
   }
 
+  static void GetStatistics(ProfilerStatistics &stats)
+  {
+    stats = ProfilerStatistics();
+    MemoryAccounting::GetUsage(stats.memory);
+  }
+
+  void getStatistics(ProfilerStatistics &stats)
+  {
+    stats = ProfilerStatistics();
+    MemoryAccounting::GetUsage(stats.memory);
+  }
+
+  static void StartTracing(std::size_t = 0)
+  {
+  }
+
+  static void StopTracing(void)
+  {
+  }
+
+  static void WriteTrace(std::ostream &)
+  {
+  }
+
+  void startTracing(std::size_t = 0)
+  {
+  }
+
+  void stopTracing(void)
+  {
+  }
+
+  void writeTrace(std::ostream &)
+  {
+  }
+
+  bool tracing(void) const
+  {
+    return false;
+  }
+
   bool running(void) const
   {
     return false;
@@ -461,4 +831,27 @@ public:
 
 #endif
 
+#define MOVEIT_PROFILER_CONCAT_IMPL(a, b) a ## b
+#define MOVEIT_PROFILER_CONCAT(a, b) MOVEIT_PROFILER_CONCAT_IMPL(a, b)
+
+/** \brief Measure the time until the end of the enclosing scope with the probe named \e name. The name is registered only once. */
+#define MOVEIT_PROFILER_PROBE(name)                                     \
+  static const moveit::tools::Profiler::ProbeId MOVEIT_PROFILER_CONCAT(moveit_profiler_probe_id_, __LINE__) = \
+    moveit::tools::Profiler::RegisterProbe(name);                       \
+  moveit::tools::Profiler::ScopedProbe MOVEIT_PROFILER_CONCAT(moveit_profiler_probe_, __LINE__)(MOVEIT_PROFILER_CONCAT(moveit_profiler_probe_id_, __LINE__))
+
+/** The MOVEIT_ENABLE_PROBES macro controls the probes built into the MoveIt! libraries (MOVEIT_CORE_PROBE).
+    They are compiled out by default; defining it to 1 (with profiling enabled) builds them in. Probes that are built in
+    only record data while the profiler is running. */
+#ifndef MOVEIT_ENABLE_PROBES
+#  define MOVEIT_ENABLE_PROBES 0
+#endif
+
+/** \brief A probe in a hot path of the MoveIt! libraries; reports call counts and time under \e name */
+#if MOVEIT_ENABLE_PROBES
+#  define MOVEIT_CORE_PROBE(name) MOVEIT_PROFILER_PROBE(name)
+#else
+#  define MOVEIT_CORE_PROBE(name)
+#endif
+
 #endif
@@ -0,0 +1,156 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2013, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#include "moveit/profiler/memory_accounting.h"
+#include <boost/thread.hpp>
+#include <vector>
+#include <algorithm>
+
+namespace
+{
+
+// the names of the subsystems, in the order of moveit::tools::MemoryAccounting::Subsystem
+const char* SUBSYSTEM_NAMES[moveit::tools::MemoryAccounting::SUBSYSTEM_COUNT] =
+  {
+    "robot_state",
+    "collision_geometry_cache",
+    "distance_field",
+    "world_objects",
+    "octomap"
+  };
+
+// the counters of one thread; they are written only by that thread, other threads only read them
+struct ThreadCounters
+{
+  ThreadCounters(void)
+  {
+    std::fill(bytes, bytes + moveit::tools::MemoryAccounting::SUBSYSTEM_COUNT, 0);
+  }
+
+  volatile boost::int64_t bytes[moveit::tools::MemoryAccounting::SUBSYSTEM_COUNT];
+};
+
+void retireThreadCounters(ThreadCounters *tc);
+
+// the counters of all live threads, and the totals of the threads that exited
+struct Counters
+{
+  Counters(void) : current_(&retireThreadCounters)
+  {
+  }
+
+  boost::mutex                               lock_;
+  std::vector<ThreadCounters*>               threads_;
+  ThreadCounters                             retired_;
+  boost::thread_specific_ptr<ThreadCounters> current_;
+};
+
+// never destroyed, so memory can be released during static destruction
+Counters& getCounters(void)
+{
+  static Counters *c = new Counters();
+  return *c;
+}
+
+// allocations and releases often happen in different threads, so the values of exiting threads are kept
+void retireThreadCounters(ThreadCounters *tc)
+{
+  Counters &c = getCounters();
+  boost::mutex::scoped_lock slock(c.lock_);
+  for (int i = 0 ; i < moveit::tools::MemoryAccounting::SUBSYSTEM_COUNT ; ++i)
+    c.retired_.bytes[i] += tc->bytes[i];
+  c.threads_.erase(std::remove(c.threads_.begin(), c.threads_.end(), tc), c.threads_.end());
+  delete tc;
+}
+
+ThreadCounters* getThreadCounters(void)
+{
+  Counters &c = getCounters();
+  ThreadCounters *tc = c.current_.get();
+  if (!tc)
+  {
+    tc = new ThreadCounters();
+    c.current_.reset(tc);
+    boost::mutex::scoped_lock slock(c.lock_);
+    c.threads_.push_back(tc);
+  }
+  return tc;
+}
+
+}
+
+void moveit::tools::MemoryAccounting::Add(Subsystem subsystem, boost::int64_t bytes)
+{
+  if (subsystem < 0 || subsystem >= SUBSYSTEM_COUNT || bytes == 0)
+    return;
+  getThreadCounters()->bytes[subsystem] += bytes;
+}
+
+boost::int64_t moveit::tools::MemoryAccounting::Get(Subsystem subsystem)
+{
+  if (subsystem < 0 || subsystem >= SUBSYSTEM_COUNT)
+    return 0;
+  Counters &c = getCounters();
+  boost::mutex::scoped_lock slock(c.lock_);
+  boost::int64_t total = c.retired_.bytes[subsystem];
+  for (std::size_t i = 0 ; i < c.threads_.size() ; ++i)
+    total += c.threads_[i]->bytes[subsystem];
+  return total;
+}
+
+const std::string& moveit::tools::MemoryAccounting::GetName(Subsystem subsystem)
+{
+  static std::vector<std::string> names(SUBSYSTEM_NAMES, SUBSYSTEM_NAMES + SUBSYSTEM_COUNT);
+  static const std::string unknown = "unknown";
+  if (subsystem < 0 || subsystem >= SUBSYSTEM_COUNT)
+    return unknown;
+  return names[subsystem];
+}
+
+void moveit::tools::MemoryAccounting::GetUsage(std::map<std::string, boost::int64_t> &usage)
+{
+  usage.clear();
+  for (int i = 0 ; i < SUBSYSTEM_COUNT ; ++i)
+    usage[GetName(Subsystem(i))] = Get(Subsystem(i));
+}
+
+void moveit::tools::MemoryAccounting::Print(std::ostream &out)
+{
+  out << "Accounted memory:" << std::endl;
+  for (int i = 0 ; i < SUBSYSTEM_COUNT ; ++i)
+  {
+    boost::int64_t bytes = Get(Subsystem(i));
+    out << "  " << GetName(Subsystem(i)) << ": " << bytes << " bytes (" << (double)bytes / (1024.0 * 1024.0) << " MB)" << std::endl;
+  }
+}
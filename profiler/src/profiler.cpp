@@ -35,6 +35,7 @@
 /* Author: Ioan Sucan */
 
 #include "moveit/profiler/profiler.h"
+#include "moveit/profiler/memory_accounting.h"
 
 moveit::tools::Profiler& moveit::tools::Profiler::Instance(void)
 {
@@ -46,8 +47,264 @@ moveit::tools::Profiler& moveit::tools::Profiler::Instance(void)
 
 #include <console_bridge/console.h>
 #include <vector>
+#include <set>
 #include <algorithm>
 #include <sstream>
+#include <limits>
+#include <cmath>
+#include <cstdio>
+#include <time.h>
+
+namespace
+{
+
+// the names of the registered probes; the last identifier is used for probes registered beyond the maximum
+struct ProbeNames
+{
+  boost::mutex             lock_;
+  std::vector<std::string> names_;
+};
+
+ProbeNames& getProbeNames()
+{
+  static ProbeNames pn;
+  return pn;
+}
+
+// the profilers that exist; a thread that exits after a profiler is destroyed must not touch its data
+struct LiveProfilers
+{
+  boost::mutex                               lock_;
+  std::set<const moveit::tools::Profiler*>   profilers_;
+};
+
+LiveProfilers& getLiveProfilers()
+{
+  static LiveProfilers lp;
+  return lp;
+}
+
+std::vector<std::string> getProbeNamesCopy()
+{
+  ProbeNames &pn = getProbeNames();
+  boost::mutex::scoped_lock slock(pn.lock_);
+  return pn.names_;
+}
+
+}
+
+moveit::tools::Profiler::Profiler(bool printOnDestroy, bool autoStart) :
+  running_(false), printOnDestroy_(printOnDestroy), probeThread_(&Profiler::releaseProbeThread),
+  finishedProbes_(MAX_PROBES), tracing_(false), traceCapacity_(0), traceSession_(0)
+{
+  LiveProfilers &lp = getLiveProfilers();
+  lp.lock_.lock();
+  lp.profilers_.insert(this);
+  lp.lock_.unlock();
+  if (autoStart)
+    start();
+}
+
+moveit::tools::Profiler::~Profiler(void)
+{
+  if (printOnDestroy_ && (!data_.empty() || !probeThreads_.empty()))
+    status();
+  LiveProfilers &lp = getLiveProfilers();
+  lp.lock_.lock();
+  lp.profilers_.erase(this);
+  lp.lock_.unlock();
+  // the data of the threads still running is freed here; release() keeps probeThread_ from cleaning up the calling thread's
+  probeThread_.release();
+  for (std::size_t i = 0 ; i < probeThreads_.size() ; ++i)
+    delete probeThreads_[i];
+}
+
+void moveit::tools::Profiler::releaseProbeThread(ProbeThread *pt)
+{
+  LiveProfilers &lp = getLiveProfilers();
+  boost::mutex::scoped_lock slock(lp.lock_);
+  if (lp.profilers_.find(pt->owner) != lp.profilers_.end())
+    pt->owner->retireProbeThread(pt);
+}
+
+void moveit::tools::Profiler::retireProbeThread(ProbeThread *pt)
+{
+  lock_.lock();
+  probeThreads_.erase(std::remove(probeThreads_.begin(), probeThreads_.end(), pt), probeThreads_.end());
+  for (ProbeId j = 0 ; j < MAX_PROBES ; ++j)
+    mergeProbe(finishedProbes_[j], pt->probes[j]);
+  if (pt->traceSession == traceSession_ && pt->traceCount > 0)
+  {
+    finishedTraces_.push_back(FinishedTrace());
+    FinishedTrace &ft = finishedTraces_.back();
+    ft.id = pt->id;
+    std::size_t n = std::min<boost::uint64_t>(pt->traceCount, pt->trace.size());
+    std::size_t begin = pt->traceCount > pt->trace.size() ? pt->traceNext : 0;
+    ft.trace.reserve(n);
+    for (std::size_t j = 0 ; j < n ; ++j)
+      ft.trace.push_back(pt->trace[(begin + j) % pt->trace.size()]);
+    if (finishedTraces_.size() > MAX_FINISHED_TRACES)
+      finishedTraces_.pop_front();
+  }
+  lock_.unlock();
+  delete pt;
+}
+
+void moveit::tools::Profiler::mergeProbe(ProbeInfo &c, const ProbeInfo &p)
+{
+  if (p.parts > 0 && (c.parts == 0 || p.shortest < c.shortest))
+    c.shortest = p.shortest;
+  if (p.longest > c.longest)
+    c.longest = p.longest;
+  c.total += p.total;
+  c.parts += p.parts;
+  c.events += p.events;
+  c.histogram.merge(p.histogram);
+}
+
+moveit::tools::Profiler::ProbeId moveit::tools::Profiler::RegisterProbe(const std::string &name)
+{
+  ProbeNames &pn = getProbeNames();
+  boost::mutex::scoped_lock slock(pn.lock_);
+  for (std::size_t i = 0 ; i < pn.names_.size() ; ++i)
+    if (pn.names_[i] == name)
+      return i;
+  if (pn.names_.size() + 1 >= MAX_PROBES)
+  {
+    if (pn.names_.size() + 1 == MAX_PROBES)
+    {
+      logWarn("Too many profiler probes registered; '%s' and later probes are counted together", name.c_str());
+      pn.names_.push_back("(other probes)");
+    }
+    return MAX_PROBES - 1;
+  }
+  pn.names_.push_back(name);
+  return pn.names_.size() - 1;
+}
+
+boost::uint64_t moveit::tools::Profiler::Now(void)
+{
+#if defined(CLOCK_MONOTONIC)
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (boost::uint64_t)ts.tv_sec * 1000000000ULL + (boost::uint64_t)ts.tv_nsec;
+#else
+  static const boost::posix_time::ptime epoch = boost::posix_time::microsec_clock::universal_time();
+  return (boost::uint64_t)(boost::posix_time::microsec_clock::universal_time() - epoch).total_microseconds() * 1000ULL;
+#endif
+}
+
+void moveit::tools::Profiler::Histogram::clear(void)
+{
+  for (unsigned int i = 0 ; i < BUCKETS ; ++i)
+    counts[i] = 0;
+}
+
+namespace
+{
+
+// the bucket of a duration: values below SUB_BUCKETS have their own bucket, larger values are bucketed by
+// their highest set bit (e) and the SUB_BUCKETS values of the next two bits
+inline unsigned int histogramBucket(boost::uint64_t v)
+{
+  static const unsigned int SUB = moveit::tools::Profiler::Histogram::SUB_BUCKETS;
+  if (v < SUB)
+    return v;
+  unsigned int e = 0;
+  for (boost::uint64_t x = v ; x > 1 ; x >>= 1)
+    ++e;
+  unsigned int b = SUB * (e - 1) + ((v >> (e - 2)) & (SUB - 1));
+  return std::min(b, moveit::tools::Profiler::Histogram::BUCKETS - 1);
+}
+
+// the smallest value in a bucket, and the width of the bucket
+inline void histogramBucketRange(unsigned int b, double &low, double &width)
+{
+  static const unsigned int SUB = moveit::tools::Profiler::Histogram::SUB_BUCKETS;
+  if (b < SUB)
+  {
+    low = b;
+    width = 1.0;
+  }
+  else
+  {
+    unsigned int e = b / SUB + 1;
+    width = (double)(1ULL << (e - 2));
+    low = (double)(SUB + b % SUB) * width;
+  }
+}
+
+}
+
+void moveit::tools::Profiler::Histogram::add(boost::uint64_t duration)
+{
+  counts[histogramBucket(duration)]++;
+}
+
+void moveit::tools::Profiler::Histogram::merge(const Histogram &other)
+{
+  for (unsigned int i = 0 ; i < BUCKETS ; ++i)
+    counts[i] += other.counts[i];
+}
+
+double moveit::tools::Profiler::Histogram::percentile(double p) const
+{
+  boost::uint64_t total = 0;
+  for (unsigned int i = 0 ; i < BUCKETS ; ++i)
+    total += counts[i];
+  if (total == 0)
+    return 0.0;
+  boost::uint64_t rank = (boost::uint64_t)ceil(p * (double)total);
+  if (rank < 1)
+    rank = 1;
+  boost::uint64_t seen = 0;
+  for (unsigned int i = 0 ; i < BUCKETS ; ++i)
+  {
+    seen += counts[i];
+    if (seen >= rank)
+    {
+      double low, width;
+      histogramBucketRange(i, low, width);
+      return low + width / 2.0;
+    }
+  }
+  return 0.0;
+}
+
+moveit::tools::Profiler::ProbeThread* moveit::tools::Profiler::getProbeThread(void)
+{
+  ProbeThread *pt = probeThread_.get();
+  if (!pt)
+  {
+    pt = new ProbeThread(this);
+    pt->id = boost::this_thread::get_id();
+    probeThread_.reset(pt);
+    lock_.lock();
+    probeThreads_.push_back(pt);
+    lock_.unlock();
+  }
+  return pt;
+}
+
+void moveit::tools::Profiler::probe(ProbeId id, boost::uint64_t duration)
+{
+  if (id >= MAX_PROBES || !running_)
+    return;
+  ProbeInfo &p = getProbeThread()->probes[id];
+  if (p.parts == 0 || duration < p.shortest)
+    p.shortest = duration;
+  if (duration > p.longest)
+    p.longest = duration;
+  p.total += duration;
+  p.parts++;
+  p.histogram.add(duration);
+}
+
+void moveit::tools::Profiler::probeEvent(ProbeId id, const unsigned int times)
+{
+  if (id < MAX_PROBES && running_)
+    getProbeThread()->probes[id].events += times;
+}
 
 void moveit::tools::Profiler::start(void)
 {
@@ -75,6 +332,20 @@ void moveit::tools::Profiler::clear(void)
 {
   lock_.lock();
   data_.clear();
+  // probes still in use by other threads may lose a measurement that is in progress
+  for (std::size_t i = 0 ; i < probeThreads_.size() ; ++i)
+    for (ProbeId j = 0 ; j < MAX_PROBES ; ++j)
+    {
+      ProbeInfo &p = probeThreads_[i]->probes[j];
+      p.total = 0;
+      p.shortest = 0;
+      p.longest = 0;
+      p.parts = 0;
+      p.events = 0;
+      p.histogram.clear();
+    }
+  finishedProbes_.clear();
+  finishedProbes_.resize(MAX_PROBES);
   tinfo_ = TimeInfo();
   if (running_)
     tinfo_.set();
@@ -102,6 +373,8 @@ void moveit::tools::Profiler::begin(const std::string &name)
 {
   lock_.lock();
   data_[boost::this_thread::get_id()].time[name].set();
+  if (tracing_)
+    traceStart_[boost::this_thread::get_id()][name] = Now();
   lock_.unlock();
 }
 
@@ -109,6 +382,158 @@ void moveit::tools::Profiler::end(const std::string &name)
 {
   lock_.lock();
   data_[boost::this_thread::get_id()].time[name].update();
+  boost::uint64_t start = 0;
+  boost::uint32_t trace_name = 0;
+  if (tracing_)
+  {
+    std::map<std::string, boost::uint64_t> &starts = traceStart_[boost::this_thread::get_id()];
+    std::map<std::string, boost::uint64_t>::iterator it = starts.find(name);
+    if (it != starts.end())
+    {
+      start = it->second;
+      starts.erase(it);
+      std::map<std::string, boost::uint32_t>::iterator jt = traceNames_.find(name);
+      if (jt == traceNames_.end())
+        jt = traceNames_.insert(std::make_pair(name, (boost::uint32_t)(MAX_PROBES + traceNames_.size()))).first;
+      trace_name = jt->second;
+    }
+  }
+  lock_.unlock();
+  if (start > 0)
+    trace(trace_name, start, Now());
+}
+
+void moveit::tools::Profiler::startTracing(std::size_t capacity)
+{
+  lock_.lock();
+  traceCapacity_ = std::max<std::size_t>(capacity, 1);
+  traceSession_++;
+  traceStart_.clear();
+  finishedTraces_.clear();
+  tracing_ = true;
+  lock_.unlock();
+}
+
+void moveit::tools::Profiler::stopTracing(void)
+{
+  tracing_ = false;
+}
+
+void moveit::tools::Profiler::trace(boost::uint32_t name, boost::uint64_t start, boost::uint64_t end)
+{
+  ProbeThread *pt = getProbeThread();
+  if (pt->traceSession != traceSession_)
+  {
+    // the buffer is (re)allocated once per session, under the lock, so writeTrace() never sees it change size
+    lock_.lock();
+    pt->trace.clear();
+    pt->trace.resize(traceCapacity_);
+    pt->traceNext = 0;
+    pt->traceCount = 0;
+    pt->traceSession = traceSession_;
+    lock_.unlock();
+  }
+  TraceEvent &e = pt->trace[pt->traceNext];
+  e.name = name;
+  e.start = start;
+  e.end = end;
+  pt->traceNext = (pt->traceNext + 1) % pt->trace.size();
+  pt->traceCount++;
+}
+
+namespace
+{
+
+void writeJSONString(std::ostream &out, const std::string &s)
+{
+  out << '"';
+  for (std::size_t i = 0 ; i < s.size() ; ++i)
+  {
+    char c = s[i];
+    if (c == '"' || c == '\\')
+      out << '\\' << c;
+    else if ((unsigned char)c < 0x20)
+    {
+      char buf[8];
+      snprintf(buf, sizeof(buf), "\\u%04x", (unsigned int)c);
+      out << buf;
+    }
+    else
+      out << c;
+  }
+  out << '"';
+}
+
+}
+
+void moveit::tools::Profiler::writeTrace(std::ostream &out)
+{
+  std::vector<std::string> probe_names = getProbeNamesCopy();
+  lock_.lock();
+  std::vector<std::string> block_names(traceNames_.size());
+  for (std::map<std::string, boost::uint32_t>::const_iterator it = traceNames_.begin() ; it != traceNames_.end() ; ++it)
+    block_names[it->second - MAX_PROBES] = it->first;
+
+  // the timelines of the running threads, oldest events first, followed by those of the finished threads
+  std::vector<FinishedTrace> timelines(probeThreads_.size());
+  for (std::size_t i = 0 ; i < probeThreads_.size() ; ++i)
+  {
+    const ProbeThread &pt = *probeThreads_[i];
+    timelines[i].id = pt.id;
+    if (pt.traceSession != traceSession_)
+      continue;
+    std::size_t n = std::min<boost::uint64_t>(pt.traceCount, pt.trace.size());
+    std::size_t begin = pt.traceCount > pt.trace.size() ? pt.traceNext : 0;
+    timelines[i].trace.reserve(n);
+    for (std::size_t j = 0 ; j < n ; ++j)
+      timelines[i].trace.push_back(pt.trace[(begin + j) % pt.trace.size()]);
+  }
+  timelines.insert(timelines.end(), finishedTraces_.begin(), finishedTraces_.end());
+
+  // timestamps are written in microseconds, relative to the earliest event
+  boost::uint64_t origin = std::numeric_limits<boost::uint64_t>::max();
+  for (std::size_t i = 0 ; i < timelines.size() ; ++i)
+    for (std::size_t j = 0 ; j < timelines[i].trace.size() ; ++j)
+      origin = std::min(origin, timelines[i].trace[j].start);
+
+  std::ios_base::fmtflags flags = out.flags();
+  std::streamsize precision = out.precision();
+  out.setf(std::ios::fixed);
+  out.precision(3);
+  out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+  bool first = true;
+  for (std::size_t i = 0 ; i < timelines.size() ; ++i)
+  {
+    const FinishedTrace &tl = timelines[i];
+    std::stringstream thread_name;
+    thread_name << "thread " << tl.id;
+    out << (first ? "" : ",") << std::endl << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << i << ",\"args\":{\"name\":";
+    writeJSONString(out, thread_name.str());
+    out << "}}";
+    first = false;
+
+    for (std::size_t j = 0 ; j < tl.trace.size() ; ++j)
+    {
+      const TraceEvent &e = tl.trace[j];
+      const std::string *name = NULL;
+      if (e.name < MAX_PROBES)
+      {
+        if (e.name < probe_names.size())
+          name = &probe_names[e.name];
+      }
+      else if (e.name - MAX_PROBES < block_names.size())
+        name = &block_names[e.name - MAX_PROBES];
+      if (!name || e.end < e.start)
+        continue;
+      out << "," << std::endl << "{\"name\":";
+      writeJSONString(out, *name);
+      out << ",\"cat\":\"" << (e.name < MAX_PROBES ? "probe" : "block") << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << i
+          << ",\"ts\":" << (double)(e.start - origin) / 1000.0 << ",\"dur\":" << (double)(e.end - e.start) / 1000.0 << "}";
+    }
+  }
+  out << std::endl << "]}" << std::endl;
+  out.flags(flags);
+  out.precision(precision);
   lock_.unlock();
 }
 
@@ -122,6 +547,37 @@ inline double to_seconds(const boost::posix_time::time_duration &d)
 
 }
 
+void moveit::tools::Profiler::mergeThreads(PerThread &combined, std::vector<ProbeInfo> &probes) const
+{
+  for (std::map<boost::thread::id, PerThread>::const_iterator it = data_.begin() ; it != data_.end() ; ++it)
+  {
+    for (std::map<std::string, unsigned long int>::const_iterator iev = it->second.events.begin() ; iev != it->second.events.end(); ++iev)
+      combined.events[iev->first] += iev->second;
+    for (std::map<std::string, AvgInfo>::const_iterator iavg = it->second.avg.begin() ; iavg != it->second.avg.end(); ++iavg)
+    {
+      combined.avg[iavg->first].total += iavg->second.total;
+      combined.avg[iavg->first].totalSqr += iavg->second.totalSqr;
+      combined.avg[iavg->first].parts += iavg->second.parts;
+    }
+    for (std::map<std::string, TimeInfo>::const_iterator itm = it->second.time.begin() ; itm != it->second.time.end(); ++itm)
+    {
+      TimeInfo &tc = combined.time[itm->first];
+      tc.total = tc.total + itm->second.total;
+      tc.parts = tc.parts + itm->second.parts;
+      if (tc.shortest > itm->second.shortest)
+        tc.shortest = itm->second.shortest;
+      if (tc.longest < itm->second.longest)
+        tc.longest = itm->second.longest;
+      tc.histogram.merge(itm->second.histogram);
+    }
+  }
+
+  probes = finishedProbes_;
+  for (std::size_t i = 0 ; i < probeThreads_.size() ; ++i)
+    for (ProbeId j = 0 ; j < MAX_PROBES ; ++j)
+      mergeProbe(probes[j], probeThreads_[i]->probes[j]);
+}
+
 void moveit::tools::Profiler::status(std::ostream &out, bool merge)
 {
   stop();
@@ -134,36 +590,109 @@ void moveit::tools::Profiler::status(std::ostream &out, bool merge)
   if (merge)
   {
     PerThread combined;
-    for (std::map<boost::thread::id, PerThread>::const_iterator it = data_.begin() ; it != data_.end() ; ++it)
-    {
-      for (std::map<std::string, unsigned long int>::const_iterator iev = it->second.events.begin() ; iev != it->second.events.end(); ++iev)
-        combined.events[iev->first] += iev->second;
-      for (std::map<std::string, AvgInfo>::const_iterator iavg = it->second.avg.begin() ; iavg != it->second.avg.end(); ++iavg)
-      {
-        combined.avg[iavg->first].total += iavg->second.total;
-        combined.avg[iavg->first].totalSqr += iavg->second.totalSqr;
-        combined.avg[iavg->first].parts += iavg->second.parts;
-      }
-      for (std::map<std::string, TimeInfo>::const_iterator itm = it->second.time.begin() ; itm != it->second.time.end(); ++itm)
-      {
-        TimeInfo &tc = combined.time[itm->first];
-        tc.total = tc.total + itm->second.total;
-        tc.parts = tc.parts + itm->second.parts;
-        if (tc.shortest > itm->second.shortest)
-          tc.shortest = itm->second.shortest;
-        if (tc.longest < itm->second.longest)
-          tc.longest = itm->second.longest;
-      }
-    }
+    std::vector<ProbeInfo> probes;
+    mergeThreads(combined, probes);
     printThreadInfo(out, combined);
+    printProbeInfo(out, probes);
   }
   else
+  {
     for (std::map<boost::thread::id, PerThread>::const_iterator it = data_.begin() ; it != data_.end() ; ++it)
     {
       out << "Thread " << it->first << ":" << std::endl;
       printThreadInfo(out, it->second);
     }
+    for (std::size_t i = 0 ; i < probeThreads_.size() ; ++i)
+    {
+      out << "Probes of thread " << probeThreads_[i]->id << ":" << std::endl;
+      std::vector<ProbeInfo> probes(probeThreads_[i]->probes, probeThreads_[i]->probes + MAX_PROBES);
+      printProbeInfo(out, probes);
+    }
+    out << "Probes of finished threads:" << std::endl;
+    printProbeInfo(out, finishedProbes_);
+  }
+  MemoryAccounting::Print(out);
+  lock_.unlock();
+}
+
+namespace
+{
+
+template<typename T>
+double clampPercentile(double value, T shortest, T longest)
+{
+  return std::max((double)shortest, std::min((double)longest, value));
+}
+
+struct SortBlocksByTotal
+{
+  bool operator()(const moveit::tools::ProfiledBlock &a, const moveit::tools::ProfiledBlock &b) const
+  {
+    return a.total > b.total;
+  }
+};
+
+}
+
+void moveit::tools::Profiler::getStatistics(ProfilerStatistics &stats)
+{
+  stats = ProfilerStatistics();
+  PerThread combined;
+  std::vector<ProbeInfo> probes;
+  lock_.lock();
+  mergeThreads(combined, probes);
+  stats.total = to_seconds(tinfo_.total);
+  if (running_)
+    stats.total += to_seconds(boost::posix_time::microsec_clock::universal_time() - tinfo_.start);
   lock_.unlock();
+
+  stats.events = combined.events;
+  for (std::map<std::string, AvgInfo>::const_iterator ia = combined.avg.begin() ; ia != combined.avg.end() ; ++ia)
+  {
+    ProfiledAverage &a = stats.averages[ia->first];
+    a.parts = ia->second.parts;
+    a.mean = ia->second.total / (double)ia->second.parts;
+    a.stddev = ia->second.parts > 1 ? sqrt(fabs(ia->second.totalSqr - (double)a.parts * a.mean * a.mean) / ((double)a.parts - 1.)) : 0.0;
+  }
+
+  for (std::map<std::string, TimeInfo>::const_iterator itm = combined.time.begin() ; itm != combined.time.end() ; ++itm)
+  {
+    ProfiledBlock b;
+    b.name = itm->first;
+    b.total = to_seconds(itm->second.total);
+    b.shortest = to_seconds(itm->second.shortest);
+    b.longest = to_seconds(itm->second.longest);
+    b.parts = itm->second.parts;
+    b.p50 = clampPercentile(itm->second.histogram.percentile(0.5) / 1e9, b.shortest, b.longest);
+    b.p90 = clampPercentile(itm->second.histogram.percentile(0.9) / 1e9, b.shortest, b.longest);
+    b.p99 = clampPercentile(itm->second.histogram.percentile(0.99) / 1e9, b.shortest, b.longest);
+    b.p999 = clampPercentile(itm->second.histogram.percentile(0.999) / 1e9, b.shortest, b.longest);
+    stats.blocks.push_back(b);
+  }
+  std::sort(stats.blocks.begin(), stats.blocks.end(), SortBlocksByTotal());
+
+  std::vector<std::string> names = getProbeNamesCopy();
+  for (std::size_t i = 0 ; i < names.size() && i < probes.size() ; ++i)
+  {
+    const ProbeInfo &p = probes[i];
+    if (p.events > 0)
+      stats.events[names[i]] += p.events;
+    if (p.parts == 0)
+      continue;
+    ProfiledBlock b;
+    b.name = names[i];
+    b.total = (double)p.total / 1e9;
+    b.shortest = (double)p.shortest / 1e9;
+    b.longest = (double)p.longest / 1e9;
+    b.parts = p.parts;
+    b.p50 = clampPercentile(p.histogram.percentile(0.5) / 1e9, b.shortest, b.longest);
+    b.p90 = clampPercentile(p.histogram.percentile(0.9) / 1e9, b.shortest, b.longest);
+    b.p99 = clampPercentile(p.histogram.percentile(0.99) / 1e9, b.shortest, b.longest);
+    b.p999 = clampPercentile(p.histogram.percentile(0.999) / 1e9, b.shortest, b.longest);
+    stats.probes.push_back(b);
+  }
+  std::sort(stats.probes.begin(), stats.probes.end(), SortBlocksByTotal());
+  MemoryAccounting::GetUsage(stats.memory);
 }
 
 void moveit::tools::Profiler::console(void)
@@ -267,6 +796,10 @@ void moveit::tools::Profiler::printThreadInfo(std::ostream &out, const PerThread
       out << ", " << pavg << " s on average";
       if (pavg < 1.0)
         out << " (" << 1.0/pavg << " /s)";
+      out << ", p50 = " << clampPercentile(d.histogram.percentile(0.5) / 1e9, tS, tL)
+          << " s, p90 = " << clampPercentile(d.histogram.percentile(0.9) / 1e9, tS, tL)
+          << " s, p99 = " << clampPercentile(d.histogram.percentile(0.99) / 1e9, tS, tL)
+          << " s, p999 = " << clampPercentile(d.histogram.percentile(0.999) / 1e9, tS, tL) << " s";
     }
     out << std::endl;
     unaccounted -= time[i].value;
@@ -283,4 +816,38 @@ void moveit::tools::Profiler::printThreadInfo(std::ostream &out, const PerThread
   out << std::endl;
 }
 
+void moveit::tools::Profiler::printProbeInfo(std::ostream &out, const std::vector<ProbeInfo> &probes)
+{
+  std::vector<std::string> names = getProbeNamesCopy();
+
+  std::vector<dataDoubleVal> time;
+  for (std::size_t i = 0 ; i < names.size() && i < probes.size() ; ++i)
+    if (probes[i].parts > 0 || probes[i].events > 0)
+    {
+      dataDoubleVal next = {names[i], (double)probes[i].total / 1e9};
+      time.push_back(next);
+    }
+  if (time.empty())
+    return;
+  std::sort(time.begin(), time.end(), SortDoubleByValue());
+
+  out << "Probes:" << std::endl;
+  for (std::size_t i = 0 ; i < time.size() ; ++i)
+  {
+    const ProbeInfo &p = probes[std::find(names.begin(), names.end(), time[i].name) - names.begin()];
+    out << time[i].name << ": ";
+    if (p.parts > 0)
+      out << time[i].value << "s, [" << (double)p.shortest / 1e9 << "s --> " << (double)p.longest / 1e9 << " s], "
+          << p.parts << " parts, " << time[i].value / (double)p.parts << " s on average"
+          << ", p50 = " << clampPercentile(p.histogram.percentile(0.5), p.shortest, p.longest) / 1e9
+          << " s, p90 = " << clampPercentile(p.histogram.percentile(0.9), p.shortest, p.longest) / 1e9
+          << " s, p99 = " << clampPercentile(p.histogram.percentile(0.99), p.shortest, p.longest) / 1e9
+          << " s, p999 = " << clampPercentile(p.histogram.percentile(0.999), p.shortest, p.longest) / 1e9 << " s";
+    if (p.events > 0)
+      out << (p.parts > 0 ? ", " : "") << p.events << " events";
+    out << std::endl;
+  }
+  out << std::endl;
+}
+
 #endif
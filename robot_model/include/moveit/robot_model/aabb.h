@@ -0,0 +1,67 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2013, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#ifndef MOVEIT_CORE_ROBOT_MODEL_AABB_
+#define MOVEIT_CORE_ROBOT_MODEL_AABB_
+
+#include <geometric_shapes/shapes.h>
+#include <Eigen/Geometry>
+#include <vector>
+
+namespace moveit
+{
+namespace core
+{
+
+/** \brief Compute the axis-aligned bounding box of \e shape in the frame of the shape, as its \e center and \e extents
+    (the full size along each axis). Unlike shapes::computeShapeExtents(), this accounts for meshes that are not centered
+    at their origin. */
+void computeShapeAABB(const shapes::Shape *shape, Eigen::Vector3d &center, Eigen::Vector3d &extents);
+
+/** \brief Compute the axis-aligned bounding box of a box with \e center and \e extents, after it is transformed by \e transform */
+inline void transformAABB(const Eigen::Affine3d &transform, const Eigen::Vector3d &center, const Eigen::Vector3d &extents,
+                          Eigen::Vector3d &transformed_center, Eigen::Vector3d &transformed_extents)
+{
+  transformed_center = transform * center;
+  transformed_extents = transform.linear().cwiseAbs() * extents;
+}
+
+/** \brief Grow \e aabb, in the format (minx, maxx, miny, maxy, minz, maxz), to contain the box with \e center and \e extents.
+    An empty \e aabb is initialized to the box. */
+void mergeAABB(const Eigen::Vector3d &center, const Eigen::Vector3d &extents, std::vector<double> &aabb);
+
+}
+}
+
+#endif
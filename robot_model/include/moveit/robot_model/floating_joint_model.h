@@ -55,6 +55,8 @@ public:
   virtual void getVariableRandomPositions(random_numbers::RandomNumberGenerator &rng, double *values, const Bounds &other_bounds) const;
   virtual void getVariableRandomPositionsNearBy(random_numbers::RandomNumberGenerator &rng, double *values, const Bounds &other_bounds,
                                                 const double *near, const double distance) const;
+  virtual unsigned int getUnitSampleDimension() const;
+  virtual void getVariablePositionsFromUnitSample(const double *sample, double *values, const Bounds &other_bounds) const;
   virtual bool enforcePositionBounds(double *values, const Bounds &other_bounds) const;
   virtual bool satisfiesPositionBounds(const double *values, const Bounds &other_bounds, double margin) const;
 
@@ -0,0 +1,93 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2013, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#ifndef MOVEIT_CORE_ROBOT_MODEL_FORWARD_KINEMATICS_KERNEL_
+#define MOVEIT_CORE_ROBOT_MODEL_FORWARD_KINEMATICS_KERNEL_
+
+#include <Eigen/Geometry>
+#include <iostream>
+#include <string>
+
+namespace moveit
+{
+namespace core
+{
+
+class RobotModel;
+
+/** \brief A function that computes the global transforms of all the links of a robot model (in the order of
+    RobotModel::getLinkModels()) from the positions of all its variables (in the order of
+    RobotModel::getVariableNames()), including the positions of mimic joints */
+typedef void (*ForwardKinematicsFunction)(const double *positions, Eigen::Affine3d *link_transforms);
+
+/** \brief A forward kinematics function specialized for one robot model, typically generated by
+    generateForwardKinematicsCode(), together with the signature of the model it was generated for.
+
+    When registered with RobotModel::setForwardKinematicsKernel(), RobotState::updateLinkTransforms() calls the
+    function instead of composing the transforms of the joints one link at a time. */
+struct ForwardKinematicsKernel
+{
+  ForwardKinematicsKernel() : function(NULL)
+  {
+  }
+
+  ForwardKinematicsKernel(ForwardKinematicsFunction fn, const std::string &sig) : function(fn), signature(sig)
+  {
+  }
+
+  /** \brief The function computing the link transforms (NULL if there is no kernel) */
+  ForwardKinematicsFunction function;
+
+  /** \brief The signature of the model the function was generated for, see computeForwardKinematicsSignature() */
+  std::string signature;
+};
+
+/** \brief Compute a signature of the kinematic structure of \e model: the links, their joints, joint types, axes,
+    origin transforms and variable indices. A kernel only computes valid transforms for a model of the same
+    signature. */
+std::string computeForwardKinematicsSignature(const RobotModel &model);
+
+/** \brief Write C++ code for a forward kinematics kernel specialized to \e model.
+
+    The generated code computes the transform of each link in order, with the joint origin transforms and axes
+    folded into constants, terms with zero coefficients removed and fixed-size Eigen types, so no virtual calls
+    or checks on the joint types remain. It only depends on Eigen and this header, and defines the function
+    <tt>moveit::core::ForwardKinematicsKernel \e function_name()</tt>, which returns the kernel to pass to
+    RobotModel::setForwardKinematicsKernel(). Returns false if the model contains joints of unknown type. */
+bool generateForwardKinematicsCode(const RobotModel &model, const std::string &function_name, std::ostream &out);
+
+}
+}
+
+#endif
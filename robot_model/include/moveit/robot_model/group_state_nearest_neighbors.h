@@ -0,0 +1,140 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2013, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#ifndef MOVEIT_CORE_ROBOT_MODEL_GROUP_STATE_NEAREST_NEIGHBORS_
+#define MOVEIT_CORE_ROBOT_MODEL_GROUP_STATE_NEAREST_NEIGHBORS_
+
+#include <moveit/robot_model/joint_model_group.h>
+#include <vector>
+#include <utility>
+
+namespace moveit
+{
+namespace core
+{
+
+/** \brief A nearest neighbor index over states of a joint model group, for planners that build roadmaps or trees
+    in the configuration space of a group.
+
+    States are the values of the variables of the group (as used by JointModelGroup::distance()) and are identified
+    by the index at which they were added. They are kept in a vantage point tree, which only relies on
+    JointModelGroup::distance() being a metric. States added since the tree was last built are searched linearly;
+    the tree is rebuilt when their number exceeds the number of states in the tree (or a small minimum), so the
+    cost of additions is amortized. Queries do not modify the structure, so they can be run concurrently from multiple threads. */
+class GroupStateNearestNeighbors
+{
+public:
+
+  GroupStateNearestNeighbors(const JointModelGroup *group);
+
+  const JointModelGroup* getJointModelGroup() const
+  {
+    return group_;
+  }
+
+  /** \brief Add a state (JointModelGroup::getVariableCount() values) and return its index */
+  std::size_t add(const double *values);
+
+  /** \brief Add a state and return its index */
+  std::size_t add(const std::vector<double> &values);
+
+  /** \brief Get the number of states added */
+  std::size_t size() const
+  {
+    return stride_ ? states_.size() / stride_ : 0;
+  }
+
+  bool empty() const
+  {
+    return states_.empty();
+  }
+
+  /** \brief Get the values of the state with index \e index */
+  const double* getState(std::size_t index) const
+  {
+    return &states_[index * stride_];
+  }
+
+  void clear();
+
+  /** \brief Find the state closest to \e values. Return false if no states were added */
+  bool nearest(const double *values, std::size_t &index) const;
+
+  /** \brief Find the \e k states closest to \e values, in order of increasing distance */
+  void nearestK(const double *values, std::size_t k, std::vector<std::size_t> &indices) const;
+
+  /** \brief Find the states at distance at most \e radius from \e values, in order of increasing distance */
+  void nearestR(const double *values, double radius, std::vector<std::size_t> &indices) const;
+
+private:
+
+  struct Node
+  {
+    std::size_t state;
+    double threshold;
+    int inside;
+    int outside;
+  };
+
+  /** \brief The candidates found while searching: a max-heap on distance, holding at most a given number of states */
+  typedef std::vector<std::pair<double, std::size_t> > Candidates;
+
+  double distance(const double *values, std::size_t index) const
+  {
+    return group_->distance(values, getState(index));
+  }
+
+  void rebuild();
+  int build(std::vector<std::pair<double, std::size_t> > &items, std::size_t begin, std::size_t end);
+  void search(int node, const double *values, std::size_t k, double radius, Candidates &candidates) const;
+  void consider(std::size_t index, double d, std::size_t k, double radius, Candidates &candidates) const;
+  void search(const double *values, std::size_t k, double radius, std::vector<std::size_t> &indices) const;
+
+  const JointModelGroup *group_;
+  std::size_t stride_;
+
+  /// the values of all states, one after the other
+  std::vector<double> states_;
+
+  /// the nodes of the tree; the root is the first node
+  std::vector<Node> nodes_;
+
+  /// the states added since the tree was built
+  std::vector<std::size_t> pending_;
+};
+
+}
+}
+
+#endif
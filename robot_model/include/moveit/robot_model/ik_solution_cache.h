@@ -0,0 +1,134 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2013, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#ifndef MOVEIT_CORE_ROBOT_MODEL_IK_SOLUTION_CACHE_
+#define MOVEIT_CORE_ROBOT_MODEL_IK_SOLUTION_CACHE_
+
+#include <moveit/macros/class_forward.h>
+#include <Eigen/Geometry>
+#include <boost/thread/mutex.hpp>
+#include <string>
+#include <vector>
+#include <map>
+
+namespace moveit
+{
+namespace core
+{
+
+/** \brief A cache of IK solutions, indexed by the pose they were computed for.
+
+    Poses are those of the tip frame of a kinematics solver, in the base frame of that solver. They are
+    binned by their position (in voxels of size \e position_resolution) and by their orientation
+    (quaternion components quantized with step \e orientation_resolution). Solutions are stored in the
+    order of the solver's joints. A lookup returns the solutions stored in the bin of the queried pose
+    and in the neighbouring position bins, closest pose first.
+
+    Access to the cache is synchronized, so it can be shared between threads. */
+class IKSolutionCache
+{
+public:
+
+  /** \brief A cached solution, together with the pose it reaches (unaligned types, so entries can be kept in std containers) */
+  struct Entry
+  {
+    Eigen::Vector3d                          position_;
+    Eigen::Quaternion<double, Eigen::DontAlign> orientation_;
+    std::vector<double>                      solution_;
+  };
+
+  IKSolutionCache(double position_resolution = 0.02, double orientation_resolution = 0.1, std::size_t max_solutions_per_bin = 4);
+
+  /** \brief Set the tolerances within which a cached solution is considered to reach a queried pose; defaults are 1mm and 1e-3 rad */
+  void setTolerances(double position_tolerance, double orientation_tolerance);
+
+  double getPositionTolerance() const
+  {
+    return position_tolerance_;
+  }
+
+  double getOrientationTolerance() const
+  {
+    return orientation_tolerance_;
+  }
+
+  /** \brief Remember that \e solution reaches \e pose. If the bin of this pose is full, the oldest solution in it is discarded */
+  void insert(const Eigen::Affine3d &pose, const std::vector<double> &solution);
+
+  /** \brief Get the cached entries close to \e pose, sorted by increasing distance to it */
+  void getEntries(const Eigen::Affine3d &pose, std::vector<Entry> &entries) const;
+
+  /** \brief Check if the pose reached by \e entry is within the tolerances of \e pose */
+  bool reaches(const Entry &entry, const Eigen::Affine3d &pose) const;
+
+  /** \brief Get the number of cached solutions */
+  std::size_t size() const;
+
+  void clear();
+
+  /** \brief Write the cached solutions to a file. Returns false if the file cannot be written */
+  bool saveToFile(const std::string &filename) const;
+
+  /** \brief Add the solutions stored in a file to the cache. Returns false if the file cannot be read or is not a cache file */
+  bool loadFromFile(const std::string &filename);
+
+private:
+
+  struct Key
+  {
+    int v[7];
+    bool operator<(const Key &other) const;
+  };
+
+  Key computeKey(const Eigen::Vector3d &position, const Eigen::Quaterniond &orientation) const;
+  static Eigen::Quaterniond canonicalOrientation(const Eigen::Affine3d &pose);
+  void insertEntry(const Entry &entry);
+
+  double position_resolution_;
+  double orientation_resolution_;
+  std::size_t max_solutions_per_bin_;
+  double position_tolerance_;
+  double orientation_tolerance_;
+
+  std::map<Key, std::vector<Entry> > bins_;
+  std::size_t size_;
+  mutable boost::mutex lock_;
+};
+
+MOVEIT_CLASS_FORWARD(IKSolutionCache);
+
+}
+}
+
+#endif
@@ -258,7 +258,26 @@ public:
   /** \brief Provide random values for the joint variables (within specified bounds). Enough memory is assumed to be allocated. */
   virtual void getVariableRandomPositionsNearBy(random_numbers::RandomNumberGenerator &rng, double *values, const Bounds &other_bounds,
                                                 const double *near, const double distance) const = 0;
-  
+
+  /** \brief Get the number of values in [0, 1) that getVariablePositionsFromUnitSample() needs. This is the number of
+      variables for most joints, but fewer for joints with redundant variables (e.g., 6 for a floating joint) */
+  virtual unsigned int getUnitSampleDimension() const
+  {
+    return getVariableCount();
+  }
+
+  /** \brief Map a point \e sample of the unit cube (of getUnitSampleDimension() values, e.g., from a QuasiRandomSequence)
+      to values for the joint variables (within default bounds), such that uniformly distributed samples give uniformly
+      distributed values. Enough memory is assumed to be allocated. */
+  void getVariablePositionsFromUnitSample(const double *sample, double *values) const
+  {
+    getVariablePositionsFromUnitSample(sample, values, variable_bounds_);
+  }
+
+  /** \brief Map a point \e sample of the unit cube to values for the joint variables (within specified bounds). The default
+      implementation interpolates linearly between the bounds of each variable, and uses 0 for unbounded variables. */
+  virtual void getVariablePositionsFromUnitSample(const double *sample, double *values, const Bounds &other_bounds) const;
+
   /** @} */
 
   /** @name Functionality specific to verifying bounds
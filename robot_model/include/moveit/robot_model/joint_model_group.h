@@ -40,6 +40,9 @@
 
 #include <moveit/robot_model/joint_model.h>
 #include <moveit/robot_model/link_model.h>
+#include <moveit/robot_model/ik_solution_cache.h>
+#include <moveit/robot_model/reachability_map.h>
+#include <moveit/robot_model/kinematics_solver_pool.h>
 #include <moveit/kinematics_base/kinematics_base.h>
 #include <srdfdom/model.h>
 #include <boost/function.hpp>
@@ -78,6 +81,7 @@ public:
     KinematicsSolver() 
       : default_ik_timeout_(0.5)
       , default_ik_attempts_(2)
+      , pool_size_(1)
     {
     }
     
@@ -91,6 +95,7 @@ public:
     {
       solver_instance_.reset();
       solver_instance_const_.reset();
+      pool_.reset();
       bijection_.clear();
     }
     
@@ -109,6 +114,18 @@ public:
     double default_ik_timeout_;
 
     unsigned int default_ik_attempts_;
+
+    /// The instances of the solver that can be leased for computing IK; solver_instance_ is one of them
+    KinematicsSolverPoolPtr pool_;
+
+    /// The maximum number of instances in \e pool_
+    unsigned int pool_size_;
+
+    /// Optional cache of previously computed IK solutions
+    IKSolutionCachePtr ik_cache_;
+
+    /// Optional map of the workspace reachable by the tip of the solver
+    ReachabilityMapConstPtr reachability_map_;
   };
   
   /// Map from group instances to allocator functions & bijections
@@ -262,6 +279,13 @@ public:
     return updated_link_model_with_geometry_set_;
   }
 
+  /** \brief Return the same data as getUpdatedLinkModelsWithGeometry() but as a mask indexed by LinkModel::getLinkIndex():
+      the value for a link is true if the link is in getUpdatedLinkModelsWithGeometry() */
+  const std::vector<bool>& getUpdatedLinkModelsWithGeometryMask() const
+  {
+    return updated_link_model_with_geometry_mask_;
+  }
+
   /** \brief Get the names of the links returned by getUpdatedLinkModels() */
   const std::vector<std::string>& getUpdatedLinkModelsWithGeometryNames() const
   {
@@ -288,6 +312,27 @@ public:
     return variable_index_list_;
   }
 
+  /** \brief Get the index locations in the complete robot state for the variables of the active joints in this group
+      (the variables of mimic joints are not included) */
+  const std::vector<int>& getActiveVariableIndexList() const
+  {
+    return active_variable_index_list_;
+  }
+
+  /** \brief Return true if all the active joints of this group are revolute or prismatic, so their variables can be
+      interpolated all at once, with the wrap-around of continuous joints given by getInterpolationWrapMask() */
+  bool hasLinearlyInterpolableJoints() const
+  {
+    return has_linearly_interpolable_joints_;
+  }
+
+  /** \brief For each variable in getActiveVariableIndexList(), 1.0 if the variable wraps around (it belongs to a
+      continuous revolute joint) and 0.0 otherwise */
+  const std::vector<double>& getInterpolationWrapMask() const
+  {
+    return interpolation_wrap_mask_;
+  }
+
   /** \brief Get the index of a variable within the group. Return -1 on error. */
   int getVariableGroupIndex(const std::string &variable) const;  
   
@@ -359,6 +404,20 @@ public:
   }  
   
   void getVariableRandomPositions(random_numbers::RandomNumberGenerator &rng, double *values, const JointBoundsVector &active_joint_bounds) const;
+
+  /** \brief Get the number of values in [0, 1) getVariablePositionsFromUnitSample() needs for this group: the sum of
+      JointModel::getUnitSampleDimension() over the active joints */
+  unsigned int getUnitSampleDimension() const;
+
+  /** \brief Map a point \e sample of the unit cube (e.g., from a QuasiRandomSequence of dimension getUnitSampleDimension())
+      to values for the state of the joint group, including its mimic joints */
+  void getVariablePositionsFromUnitSample(const double *sample, double *values) const
+  {
+    getVariablePositionsFromUnitSample(sample, values, active_joint_models_bounds_);
+  }
+
+  /** \brief Map a point \e sample of the unit cube to values for the state of the joint group, within the specified bounds */
+  void getVariablePositionsFromUnitSample(const double *sample, double *values, const JointBoundsVector &active_joint_bounds) const;
   
   /** \brief Compute random values for the state of the joint group */
   void getVariableRandomPositionsNearBy(random_numbers::RandomNumberGenerator &rng, double *values, const JointBoundsVector &active_joint_bounds,
@@ -391,6 +450,11 @@ public:
   double getMaximumExtent(const JointBoundsVector &active_joint_bounds) const;
   
   double distance(const double *state1, const double *state2) const;  
+
+  /** \brief Compute the same distance as distance(), but for the variables of this group within two full robot states
+      (arrays indexed like RobotState::getVariablePositions()) */
+  double distanceFullState(const double *state1, const double *state2) const;
+
   void interpolate(const double *from, const double *to, double t, double *state) const;
   
   /** \brief Get the number of variables that describe this joint group. This includes variables necessary for mimic joints, so will always be >=
@@ -493,12 +557,68 @@ public:
     return group_kinematics_.first.solver_instance_;
   }
 
+  /** \brief Lease an instance of the kinematics solver of this group for exclusive use by the caller, so IK can be
+      computed from several threads. The instance is returned when the last copy of the returned pointer is released.
+      If all instances are leased and the pool is at its maximum size (see setSolverInstancePoolSize()), this function
+      waits until an instance is returned. Returns NULL if no solver is instantiated for this group */
+  kinematics::KinematicsBasePtr acquireSolverInstance() const
+  {
+    return group_kinematics_.first.pool_ ? group_kinematics_.first.pool_->acquire() : kinematics::KinematicsBasePtr();
+  }
+
+  /** \brief Same as acquireSolverInstance(), but returns NULL instead of waiting when no instance is available */
+  kinematics::KinematicsBasePtr tryAcquireSolverInstance() const
+  {
+    return group_kinematics_.first.pool_ ? group_kinematics_.first.pool_->tryAcquire() : kinematics::KinematicsBasePtr();
+  }
+
+  /** \brief Set the maximum number of kinematics solver instances that can be leased at the same time (default 1).
+      Instances are allocated lazily, when needed */
+  void setSolverInstancePoolSize(unsigned int size);
+
+  unsigned int getSolverInstancePoolSize() const
+  {
+    return group_kinematics_.first.pool_size_;
+  }
+
+  /** \brief Get the pool of kinematics solver instances of this group (NULL if no solver is instantiated) */
+  const KinematicsSolverPoolPtr& getSolverInstancePool() const
+  {
+    return group_kinematics_.first.pool_;
+  }
+
   bool canSetStateFromIK(const std::string &tip) const;
 
+  /** \brief Set a cache of IK solutions to be used by RobotState::setFromIK() for this group (NULL disables caching).
+      Solutions are stored for the pose of the solver's tip frame, in the solver's base frame */
+  void setIKSolutionCache(const IKSolutionCachePtr &cache)
+  {
+    group_kinematics_.first.ik_cache_ = cache;
+  }
+
+  /** \brief Get the cache of IK solutions used for this group, if any */
+  const IKSolutionCachePtr& getIKSolutionCache() const
+  {
+    return group_kinematics_.first.ik_cache_;
+  }
+
+  /** \brief Set the map of the workspace reachable by the tip of the solver of this group (NULL to disable it).
+      IK constraint samplers configured for this group use it to focus on reachable poses */
+  void setReachabilityMap(const ReachabilityMapConstPtr &map)
+  {
+    group_kinematics_.first.reachability_map_ = map;
+  }
+
+  /** \brief Get the reachability map of this group, if any */
+  const ReachabilityMapConstPtr& getReachabilityMap() const
+  {
+    return group_kinematics_.first.reachability_map_;
+  }
+
   bool setRedundantJoints(const std::vector<std::string> &joints)
   {
-    if (group_kinematics_.first.solver_instance_)
-      return group_kinematics_.first.solver_instance_->setRedundantJoints(joints);
+    if (group_kinematics_.first.pool_)
+      return group_kinematics_.first.pool_->setRedundantJoints(joints);
     return false;
   }
 
@@ -590,6 +710,18 @@ protected:
 
   /** \brief The list of index values this group includes, with respect to a full robot state; this includes mimic joints. */
   std::vector<int>                                           variable_index_list_;
+
+  /** \brief The index values of the variables of the active joints, with respect to a full robot state */
+  std::vector<int>                                           active_variable_index_list_;
+
+  /** \brief True if all active joints are revolute or prismatic */
+  bool                                                       has_linearly_interpolable_joints_;
+
+  /** \brief For each index in active_variable_index_list_, 1.0 if the variable is a continuous joint angle, 0.0 otherwise */
+  std::vector<double>                                        interpolation_wrap_mask_;
+
+  /** \brief For each index in active_variable_index_list_, the distance factor of the joint the variable belongs to */
+  std::vector<double>                                        distance_weights_;
     
   /** \brief For each active joint model in this group, hold the index at which the corresponding joint state starts in the group state */
   std::vector<int>                                           active_joint_model_start_index_;
@@ -628,6 +760,9 @@ protected:
   /** \brief The list of downstream link models in the order they should be updated (may include links that are not in this group) */
   std::set<const LinkModel*>                                 updated_link_model_with_geometry_set_;
 
+  /** \brief The same links as \e updated_link_model_with_geometry_vector_, as a mask indexed by link index */
+  std::vector<bool>                                          updated_link_model_with_geometry_mask_;
+
   /** \brief The list of downstream link names in the order they should be updated (may include links that are not in this group) */
   std::vector<std::string>                                   updated_link_model_with_geometry_name_vector_;
 
@@ -0,0 +1,152 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2013, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#ifndef MOVEIT_CORE_ROBOT_MODEL_KINEMATICS_SOLVER_POOL_
+#define MOVEIT_CORE_ROBOT_MODEL_KINEMATICS_SOLVER_POOL_
+
+#include <moveit/macros/class_forward.h>
+#include <moveit/kinematics_base/kinematics_base.h>
+#include <boost/enable_shared_from_this.hpp>
+#include <boost/function.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <string>
+#include <vector>
+
+namespace moveit
+{
+namespace core
+{
+
+MOVEIT_CLASS_FORWARD(KinematicsSolverPool);
+
+/** \brief A pool of instances of a kinematics solver, so that IK can be computed from several threads.
+
+    Most kinematics solvers are not reentrant, so an instance must only be used by one thread at a time. Instances
+    are leased with acquire(): the returned pointer is for the exclusive use of the caller and the instance goes back
+    to the pool when the last copy of that pointer is released. New instances are allocated lazily, when all existing
+    ones are leased, up to the maximum size of the pool; after that, acquire() waits for an instance to be returned.
+
+    The pool must be held by a boost::shared_ptr. The default timeout and the redundant joints set on the pool are
+    applied to all its instances, including the ones allocated later; they should not be changed while IK is
+    being computed with leased instances. */
+class KinematicsSolverPool : public boost::enable_shared_from_this<KinematicsSolverPool>
+{
+public:
+
+  /** \brief Function type that allocates a new instance of the solver */
+  typedef boost::function<kinematics::KinematicsBasePtr()> AllocatorFn;
+
+  /** \brief Construct a pool that starts with instance \e solver and allocates more instances with \e allocator */
+  KinematicsSolverPool(const kinematics::KinematicsBasePtr &solver, const AllocatorFn &allocator, unsigned int max_size = 1);
+
+  /** \brief Lease an instance, waiting for one to be returned if the pool is at its maximum size.
+      Returns NULL only if the pool has no instances at all */
+  kinematics::KinematicsBasePtr acquire();
+
+  /** \brief Lease an instance if one is available or can be allocated; never waits. Returns NULL otherwise */
+  kinematics::KinematicsBasePtr tryAcquire();
+
+  /** \brief Lease instances with tryAcquire() until \e solvers holds \e count of them or none is available. The pool
+      first grows to \e count instances if needed (see growMaxSize()), so later calls reuse the instances allocated here.
+      Leased instances whose redundant joints differ from \e redundant_joints (if not empty) are given those. */
+  void tryAcquire(std::size_t count, const std::vector<unsigned int> &redundant_joints,
+                  std::vector<kinematics::KinematicsBaseConstPtr> &solvers);
+
+  /** \brief Set the maximum number of instances (at least 1). Instances that already exist are kept */
+  void setMaxSize(unsigned int max_size);
+
+  /** \brief Raise the maximum number of instances to \e max_size, unless it is larger already or an allocation failed
+      before (in which case the pool keeps the instances it has) */
+  void growMaxSize(unsigned int max_size);
+
+  unsigned int getMaxSize() const;
+
+  /** \brief Get the number of instances allocated so far */
+  unsigned int getSize() const;
+
+  /** \brief Get the number of instances currently leased */
+  unsigned int getLeasedCount() const;
+
+  void setDefaultTimeout(double timeout);
+
+  /** \brief Set the redundant joints of all instances. Returns false if any instance rejected them */
+  bool setRedundantJoints(const std::vector<std::string> &joints);
+
+private:
+
+  /** \brief Returns the leased instance \e solver to the pool when the last copy of the lease is released */
+  struct Release
+  {
+    Release(const KinematicsSolverPoolPtr &pool, const kinematics::KinematicsBasePtr &solver) : pool_(pool), solver_(solver)
+    {
+    }
+
+    void operator()(kinematics::KinematicsBase*)
+    {
+      pool_->release(solver_);
+    }
+
+    KinematicsSolverPoolPtr       pool_;
+    kinematics::KinematicsBasePtr solver_;
+  };
+
+  kinematics::KinematicsBasePtr acquire(bool wait);
+  kinematics::KinematicsBasePtr lease(const kinematics::KinematicsBasePtr &solver);
+  void release(const kinematics::KinematicsBasePtr &solver);
+
+  AllocatorFn                                allocator_;
+  unsigned int                               max_size_;
+  double                                     default_timeout_;
+  std::vector<std::string>                   redundant_joints_;
+  bool                                       has_redundant_joints_;
+
+  /** \brief Set when the allocator failed; the pool does not grow after that */
+  bool                                       allocation_failed_;
+
+  /** \brief All instances, and the ones not currently leased */
+  std::vector<kinematics::KinematicsBasePtr> instances_;
+  std::vector<kinematics::KinematicsBasePtr> free_;
+
+  /** \brief The number of instances being allocated (counted against the maximum size) */
+  unsigned int                               allocating_;
+
+  mutable boost::mutex                       lock_;
+  boost::condition_variable                  returned_;
+};
+
+}
+}
+
+#endif
@@ -183,6 +183,13 @@ public:
     return shape_extents_;
   }
 
+  /** \brief Get the center of the axis-aligned bounding box of the link's geometry, in the frame of the link
+      (its extents are given by getShapeExtentsAtOrigin()) */
+  const Eigen::Vector3d& getCenteredBoundingBoxOffset() const
+  {
+    return centered_bounding_box_offset_;
+  }
+
   /** \brief Get the set of links that are attached to this one via fixed transforms */
   const LinkTransformMap& getAssociatedFixedTransforms() const
   {
@@ -253,6 +260,9 @@ private:
   /** \brief The extents if shape (dimensions of axis aligned bounding box when shape is at origin */
   Eigen::Vector3d                    shape_extents_;
 
+  /** \brief The center of the axis aligned bounding box of the shapes, in the frame of the link */
+  Eigen::Vector3d                    centered_bounding_box_offset_;
+
   /** \brief Filename associated with the visual geometry mesh of this link. If empty, no mesh was used. */
   std::string                        visual_mesh_filename_;
 
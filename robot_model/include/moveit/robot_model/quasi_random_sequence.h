@@ -0,0 +1,135 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2013, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#ifndef MOVEIT_CORE_ROBOT_MODEL_QUASI_RANDOM_SEQUENCE_
+#define MOVEIT_CORE_ROBOT_MODEL_QUASI_RANDOM_SEQUENCE_
+
+#include <moveit/macros/class_forward.h>
+#include <boost/cstdint.hpp>
+#include <vector>
+
+namespace moveit
+{
+namespace core
+{
+
+/** \brief A low-discrepancy sequence of points in the unit cube [0, 1)^d.
+
+    Consecutive points of such a sequence cover the cube more evenly than independent uniform samples, so fewer samples
+    are needed for the same coverage. Three sequences are available:
+    \li HALTON: the radical inverses of the point index in the first d prime bases. Best for low dimensions.
+    \li SOBOL: the Sobol sequence in base 2, with the direction numbers of Joe and Kuo for the first 21
+    dimensions (further dimensions use generated direction numbers).
+    \li LATTICE: the Kronecker sequence x_i = frac(i * alpha), with alpha the square roots of the first d primes.
+    It is the cheapest to compute and has no preferred number of points.
+
+    The sequence is deterministic: two instances with the same type, dimension and seed produce the same points, so
+    each thread can own an instance with its own seed. A seed of 0 gives the plain sequence; other seeds randomize it
+    while preserving its uniformity (a random shift modulo 1 for HALTON and LATTICE, a random digital shift for SOBOL).
+    The origin, which all plain sequences start with, is skipped. Instances are not thread-safe. */
+class QuasiRandomSequence
+{
+public:
+
+  enum Type
+  {
+    HALTON, SOBOL, LATTICE
+  };
+
+  QuasiRandomSequence(Type type, unsigned int dimension, boost::uint32_t seed = 0);
+
+  Type getType() const
+  {
+    return type_;
+  }
+
+  unsigned int getDimension() const
+  {
+    return dimension_;
+  }
+
+  boost::uint32_t getSeed() const
+  {
+    return seed_;
+  }
+
+  /** \brief Get the index of the next point in the sequence (the first point has index 1) */
+  boost::uint64_t getIndex() const
+  {
+    return index_;
+  }
+
+  /** \brief Continue the sequence from the point with index \e index (e.g., to split one sequence between threads) */
+  void setIndex(boost::uint64_t index);
+
+  /** \brief Compute the next point of the sequence; \e point must have room for getDimension() values */
+  void next(double *point);
+
+  void next(std::vector<double> &point)
+  {
+    point.resize(dimension_);
+    if (dimension_ > 0)
+      next(&point[0]);
+  }
+
+private:
+
+  void initSobol();
+
+  Type                          type_;
+  unsigned int                  dimension_;
+  boost::uint32_t               seed_;
+  boost::uint64_t               index_;
+
+  /// the prime bases for HALTON (and the primes LATTICE takes the square roots of)
+  std::vector<unsigned int>     bases_;
+
+  /// the increments for LATTICE
+  std::vector<double>           alpha_;
+
+  /// the random shift modulo 1 for HALTON and LATTICE
+  std::vector<double>           shift_;
+
+  /// the direction numbers (32 per dimension), the current point and the digital shift for SOBOL
+  std::vector<boost::uint32_t>  direction_;
+  std::vector<boost::uint32_t>  sobol_point_;
+  std::vector<boost::uint32_t>  digital_shift_;
+};
+
+MOVEIT_CLASS_FORWARD(QuasiRandomSequence);
+
+}
+}
+
+#endif
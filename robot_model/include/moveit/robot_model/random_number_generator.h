@@ -0,0 +1,62 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2013, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#ifndef MOVEIT_CORE_ROBOT_MODEL_RANDOM_NUMBER_GENERATOR_
+#define MOVEIT_CORE_ROBOT_MODEL_RANDOM_NUMBER_GENERATOR_
+
+#include <random_numbers/random_numbers.h>
+#include <boost/cstdint.hpp>
+
+namespace moveit
+{
+namespace core
+{
+
+/** \brief Get the random number generator of the calling thread.
+
+    Each thread has one generator, constructed the first time it is needed. Code that samples
+    with short-lived objects (e.g., temporary robot states) uses it instead of constructing and
+    seeding a generator of its own, which is comparatively expensive and serializes threads on the
+    seeding of new generators. */
+random_numbers::RandomNumberGenerator& getThreadRandomNumberGenerator();
+
+/** \brief Replace the random number generator of the calling thread with one seeded by \e seed, so that the
+    samples that follow are reproducible. References previously obtained from getThreadRandomNumberGenerator()
+    in this thread are no longer valid after this call. */
+void seedThreadRandomNumberGenerator(boost::uint32_t seed);
+
+}
+}
+
+#endif
@@ -0,0 +1,141 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2013, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#ifndef MOVEIT_CORE_ROBOT_MODEL_REACHABILITY_MAP_
+#define MOVEIT_CORE_ROBOT_MODEL_REACHABILITY_MAP_
+
+#include <moveit/macros/class_forward.h>
+#include <Eigen/Geometry>
+#include <boost/cstdint.hpp>
+#include <string>
+#include <vector>
+#include <map>
+
+namespace moveit
+{
+namespace core
+{
+
+/** \brief A voxelized map of the workspace reachable by the tip frame of a group, relative to a base frame.
+
+    Each voxel of size \e resolution keeps the set of orientations of the tip frame seen in it, binned by the
+    direction of the z axis of the tip into ORIENTATION_BINS bins of equal area. The number of orientation bins
+    reached in a voxel is a measure of how dexterous the group is at that position. The map is typically computed
+    offline (see RobotState::addToReachabilityMap()) by forward kinematics on many random states, written to a
+    binary file and loaded when needed. The map is not synchronized: it must not be modified while it is used
+    from multiple threads. */
+class ReachabilityMap
+{
+public:
+
+  static const unsigned int ORIENTATION_BINS = 64;
+
+  ReachabilityMap(const std::string &base_frame = "", const std::string &tip_frame = "", double resolution = 0.05);
+
+  const std::string& getBaseFrame() const
+  {
+    return base_frame_;
+  }
+
+  const std::string& getTipFrame() const
+  {
+    return tip_frame_;
+  }
+
+  double getResolution() const
+  {
+    return resolution_;
+  }
+
+  /** \brief Record that the tip frame can reach \e pose, expressed in the base frame */
+  void insert(const Eigen::Affine3d &pose);
+
+  /** \brief Get the number of orientation bins reached in the voxel that contains \e position
+      (0 if the position was never reached) */
+  unsigned int getOrientationCount(const Eigen::Vector3d &position) const;
+
+  /** \brief Check if the orientation bin of \e pose was reached in the voxel that contains its position */
+  bool isReachable(const Eigen::Affine3d &pose) const;
+
+  /** \brief Get the largest number of orientation bins reached in any voxel */
+  unsigned int getMaxOrientationCount() const
+  {
+    return max_count_;
+  }
+
+  /** \brief Get the number of reachable voxels */
+  std::size_t size() const
+  {
+    return voxels_.size();
+  }
+
+  /** \brief Get the centers of the reachable voxels and the number of orientation bins reached in each of them */
+  void getVoxels(std::vector<Eigen::Vector3d> &centers, std::vector<unsigned int> &counts) const;
+
+  void clear();
+
+  /** \brief Write the map to a binary file. Returns false if the file cannot be written */
+  bool saveToFile(const std::string &filename) const;
+
+  /** \brief Replace the map by the one stored in a binary file. Returns false if the file cannot be read or is not a map file */
+  bool loadFromFile(const std::string &filename);
+
+private:
+
+  struct Key
+  {
+    boost::int32_t v[3];
+    bool operator<(const Key &other) const;
+  };
+
+  Key computeKey(const Eigen::Vector3d &position) const;
+  Eigen::Vector3d getVoxelCenter(const Key &key) const;
+  static unsigned int computeOrientationBin(const Eigen::Affine3d &pose);
+  static unsigned int countBins(boost::uint64_t bins);
+
+  std::string base_frame_;
+  std::string tip_frame_;
+  double resolution_;
+
+  /// the orientation bins reached in each voxel (one bit per bin)
+  std::map<Key, boost::uint64_t> voxels_;
+  unsigned int max_count_;
+};
+
+MOVEIT_CLASS_FORWARD(ReachabilityMap);
+
+}
+}
+
+#endif
@@ -94,6 +94,11 @@ protected:
 private:
   
   double x2_, y2_, z2_, xy_, xz_, yz_;  
+
+  /* if the axis is one of the coordinate axes (as it is for most joints), its index (0 for x, 1 for y, 2 for z)
+     and direction (1.0 or -1.0); otherwise the index is -1 */
+  int axis_index_;
+  double axis_sign_;
   
 };
 
@@ -51,8 +51,10 @@
 #include <moveit/robot_model/planar_joint_model.h>
 #include <moveit/robot_model/revolute_joint_model.h>
 #include <moveit/robot_model/prismatic_joint_model.h>
+#include <moveit/robot_model/forward_kinematics_kernel.h>
 
 #include <Eigen/Geometry>
+#include <algorithm>
 #include <iostream>
 
 /** \brief Main namespace for MoveIt! */
@@ -68,9 +70,23 @@ class RobotModel
 {
 public:
   
+  /** \brief How getCommonRoot() queries are answered */
+  enum CommonRootsMethod
+    {
+      /** \brief Use COMMON_ROOTS_TABLE for models with few joints and COMMON_ROOTS_SPARSE otherwise */
+      COMMON_ROOTS_AUTO,
+
+      /** \brief A table with an entry for every pair of joints (memory quadratic in the number of joints) */
+      COMMON_ROOTS_TABLE,
+
+      /** \brief A sparse table over an Euler tour of the kinematic tree (memory N log N in the number of joints) */
+      COMMON_ROOTS_SPARSE
+    };
+
   /** \brief Construct a kinematic model from a parsed description and a list of planning groups */
   RobotModel(const boost::shared_ptr<const urdf::ModelInterface> &urdf_model,
-             const boost::shared_ptr<const srdf::Model> &srdf_model);
+             const boost::shared_ptr<const srdf::Model> &srdf_model,
+             CommonRootsMethod common_roots = COMMON_ROOTS_AUTO);
   
   /** \brief Destructor. Clear all memory. */
   ~RobotModel();
@@ -184,6 +200,18 @@ public:
     return multi_dof_joints_;
   }  
 
+  /** \brief The names of the joints returned by getSingleDOFJointModels(), in the same order */
+  const std::vector<std::string>& getSingleDOFJointModelNames() const
+  {
+    return single_dof_joint_names_;
+  }
+
+  /** \brief The names of the joints returned by getMultiDOFJointModels(), in the same order */
+  const std::vector<std::string>& getMultiDOFJointModelNames() const
+  {
+    return multi_dof_joint_names_;
+  }
+
   /** \brief Get the array of continuous joints, in the order they appear
       in the robot state. */
   const std::vector<const JointModel*>& getContinuousJointModels() const
@@ -413,12 +441,41 @@ public:
       return b;
     if (!b)
       return a;
-    return joint_model_vector_[common_joint_roots_[a->getJointIndex() * joint_model_vector_.size() + b->getJointIndex()]];
+    if (!common_joint_roots_.empty())
+      return joint_model_vector_[common_joint_roots_[a->getJointIndex() * joint_model_vector_.size() + b->getJointIndex()]];
+
+    // range minimum query (by depth) between the first occurrences of the two joints in the Euler tour
+    int l = euler_first_[a->getJointIndex()];
+    int r = euler_first_[b->getJointIndex()];
+    if (l > r)
+      std::swap(l, r);
+    const int k = euler_log2_[r - l + 1];
+    const int *level = &euler_sparse_[k * euler_tour_size_];
+    const int j1 = level[l];
+    const int j2 = level[r - (1 << k) + 1];
+    return joint_model_vector_[euler_depth_[j1] <= euler_depth_[j2] ? j1 : j2];
   }
   
   /// A map of known kinematics solvers (associated to their group name)
   void setKinematicsAllocators(const std::map<std::string, SolverAllocatorFn> &allocators);
 
+  /** \brief Use \e kernel (typically generated by generateForwardKinematicsCode()) to compute the link transforms in
+      RobotState::updateLinkTransforms(). Returns false, and keeps the current kernel, if \e kernel was generated for
+      a model with a different signature. */
+  bool setForwardKinematicsKernel(const ForwardKinematicsKernel &kernel);
+
+  /** \brief Go back to computing the link transforms from the joint models */
+  void clearForwardKinematicsKernel()
+  {
+    fk_kernel_ = ForwardKinematicsKernel();
+  }
+
+  /** \brief The registered forward kinematics kernel; its function is NULL if there is none */
+  const ForwardKinematicsKernel& getForwardKinematicsKernel() const
+  {
+    return fk_kernel_;
+  }
+
 protected:
 
   void computeFixedTransforms(const LinkModel *link, const Eigen::Affine3d &transform, LinkTransformMap &associated_transforms);
@@ -441,6 +498,8 @@ protected:
 
   boost::shared_ptr<const urdf::ModelInterface> urdf_;
 
+  /** \brief The kernel used to compute all the link transforms, if any */
+  ForwardKinematicsKernel                       fk_kernel_;
 
   // LINKS
 
@@ -501,6 +560,10 @@ protected:
  
   std::vector<const JointModel*>                multi_dof_joints_;
 
+  std::vector<std::string>                      single_dof_joint_names_;
+
+  std::vector<std::string>                      multi_dof_joint_names_;
+
   /** \brief For every two joints, the index of the common root for thw joints is stored.
       
       for jointA, jointB
@@ -510,6 +573,19 @@ protected:
    */
   std::vector<int>                              common_joint_roots_;
 
+  /** \brief The method used for computing common roots */
+  CommonRootsMethod                             common_roots_method_;
+
+  /** \brief When common_joint_roots_ is empty, common roots are computed from a sparse table over an Euler tour of the
+      joint tree: euler_first_ is the position at which each joint first appears in the tour, euler_depth_ the depth
+      of each joint, and level k of euler_sparse_ holds, for each position i of the tour, the index of the least deep
+      joint in the tour positions [i, i + 2^k). euler_log2_ holds floor(log2(n)). */
+  std::vector<int>                              euler_first_;
+  std::vector<int>                              euler_depth_;
+  std::vector<int>                              euler_sparse_;
+  std::vector<int>                              euler_log2_;
+  int                                           euler_tour_size_;
+
   // INDEXING
 
   /** \brief The names of the DOF that make up this state (this is just a sequence of joint variable names; not necessarily joint names!) */
@@ -577,6 +653,9 @@ protected:
 
   /** \brief For every pair of joints, pre-compute the common roots of the joints */
   void computeCommonRoots();
+
+  /** \brief Build the Euler tour sparse table used by getCommonRoot() for COMMON_ROOTS_SPARSE */
+  void computeCommonRootsSparse();
   
   /** \brief (This function is mostly intended for internal use). Given a parent link, build up (recursively),
       the kinematic model by walking  down the tree*/
@@ -593,7 +672,7 @@ protected:
   LinkModel* constructLinkModel(const urdf::Link *urdf_link);
 
   /** \brief Given a geometry spec from the URDF and a filename (for a mesh), construct the corresponding shape object*/
-  shapes::ShapePtr constructShape(const urdf::Geometry *geom);
+  shapes::ShapeConstPtr constructShape(const urdf::Geometry *geom);
 };
 
 MOVEIT_CLASS_FORWARD(RobotModel);
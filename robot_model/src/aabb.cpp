@@ -0,0 +1,82 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2013, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#include <moveit/robot_model/aabb.h>
+#include <geometric_shapes/shape_operations.h>
+#include <algorithm>
+
+void moveit::core::computeShapeAABB(const shapes::Shape *shape, Eigen::Vector3d &center, Eigen::Vector3d &extents)
+{
+  if (shape->type == shapes::MESH)
+  {
+    const shapes::Mesh *mesh = static_cast<const shapes::Mesh*>(shape);
+    if (mesh->vertex_count > 0)
+    {
+      Eigen::Vector3d lo(mesh->vertices[0], mesh->vertices[1], mesh->vertices[2]);
+      Eigen::Vector3d hi = lo;
+      for (unsigned int i = 1 ; i < mesh->vertex_count ; ++i)
+      {
+        const Eigen::Vector3d v(mesh->vertices[3 * i], mesh->vertices[3 * i + 1], mesh->vertices[3 * i + 2]);
+        lo = lo.cwiseMin(v);
+        hi = hi.cwiseMax(v);
+      }
+      center = (lo + hi) / 2.0;
+      extents = hi - lo;
+      return;
+    }
+  }
+  center = Eigen::Vector3d::Zero();
+  extents = shapes::computeShapeExtents(shape);
+}
+
+void moveit::core::mergeAABB(const Eigen::Vector3d &center, const Eigen::Vector3d &extents, std::vector<double> &aabb)
+{
+  const Eigen::Vector3d lo = center - extents / 2.0;
+  const Eigen::Vector3d hi = center + extents / 2.0;
+  if (aabb.empty())
+  {
+    aabb.resize(6);
+    for (int i = 0 ; i < 3 ; ++i)
+    {
+      aabb[2 * i] = lo[i];
+      aabb[2 * i + 1] = hi[i];
+    }
+  }
+  else
+    for (int i = 0 ; i < 3 ; ++i)
+    {
+      aabb[2 * i] = std::min(aabb[2 * i], lo[i]);
+      aabb[2 * i + 1] = std::max(aabb[2 * i + 1], hi[i]);
+    }
+}
@@ -271,6 +271,30 @@ void moveit::core::FloatingJointModel::getVariableRandomPositions(random_numbers
   values[6] = q[3];
 }
 
+unsigned int moveit::core::FloatingJointModel::getUnitSampleDimension() const
+{
+  return 6;
+}
+
+void moveit::core::FloatingJointModel::getVariablePositionsFromUnitSample(const double *sample, double *values, const Bounds &bounds) const
+{
+  for (int i = 0 ; i < 3 ; ++i)
+    if (bounds[i].max_position_ >= std::numeric_limits<double>::infinity() || bounds[i].min_position_ <= -std::numeric_limits<double>::infinity())
+      values[i] = 0.0;
+    else
+      values[i] = bounds[i].min_position_ + sample[i] * (bounds[i].max_position_ - bounds[i].min_position_);
+
+  // uniform quaternion from three values in [0, 1) (K. Shoemake, Uniform random rotations, Graphics Gems III)
+  double r1 = sqrt(1.0 - sample[3]);
+  double r2 = sqrt(sample[3]);
+  double t1 = 2.0 * boost::math::constants::pi<double>() * sample[4];
+  double t2 = 2.0 * boost::math::constants::pi<double>() * sample[5];
+  values[3] = sin(t1) * r1;
+  values[4] = cos(t1) * r1;
+  values[5] = sin(t2) * r2;
+  values[6] = cos(t2) * r2;
+}
+
 void moveit::core::FloatingJointModel::getVariableRandomPositionsNearBy(random_numbers::RandomNumberGenerator &rng, double *values, const Bounds &bounds,
                                                                         const double *near, const double distance) const
 {
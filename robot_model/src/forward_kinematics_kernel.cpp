@@ -0,0 +1,329 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2013, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#include <moveit/robot_model/forward_kinematics_kernel.h>
+#include <moveit/robot_model/robot_model.h>
+#include <boost/cstdint.hpp>
+#include <sstream>
+#include <limits>
+#include <cmath>
+
+namespace moveit
+{
+namespace core
+{
+namespace
+{
+
+std::string formatNumber(double value)
+{
+  std::stringstream ss;
+  ss.precision(17);
+  ss << value;
+  std::string s = ss.str();
+  // keep the literals of type double
+  if (s.find_first_of(".en") == std::string::npos)
+    s += ".0";
+  return s;
+}
+
+/// An entry of a generated transform: a constant plus a sum of terms, each a constant coefficient times a
+/// variable expression; coefficients that are zero up to rounding are dropped
+class LinearExpression
+{
+public:
+
+  LinearExpression(double constant = 0.0) : constant_(prune(constant))
+  {
+  }
+
+  void add(double coefficient, const std::string &term)
+  {
+    coefficient = prune(coefficient);
+    if (coefficient != 0.0)
+      terms_.push_back(std::make_pair(coefficient, term));
+  }
+
+  std::string str() const
+  {
+    std::string s;
+    for (std::size_t i = 0 ; i < terms_.size() ; ++i)
+    {
+      double coefficient = terms_[i].first;
+      if (coefficient < 0.0)
+      {
+        s += i == 0 ? "-" : " - ";
+        coefficient = -coefficient;
+      }
+      else if (i > 0)
+        s += " + ";
+      if (coefficient != 1.0)
+        s += formatNumber(coefficient) + " * ";
+      s += terms_[i].second;
+    }
+    if (s.empty())
+      return formatNumber(constant_);
+    if (constant_ != 0.0)
+      s = formatNumber(constant_) + (s[0] == '-' ? " " : " + ") + s;
+    return s;
+  }
+
+private:
+
+  static double prune(double value)
+  {
+    // the entries of rotations computed from URDF angles are often off from 0 or 1 by rounding errors only
+    return std::fabs(value) <= std::numeric_limits<double>::epsilon() ? 0.0 : value;
+  }
+
+  double constant_;
+  std::vector<std::pair<double, std::string> > terms_;
+};
+
+std::string variable(const JointModel *joint, int offset)
+{
+  std::stringstream ss;
+  ss << "positions[" << joint->getFirstVariableIndex() + offset << "]";
+  return ss.str();
+}
+
+/// Fill \e local (row-major, 3 rows and 4 columns) with the transform of \e link relative to its parent link:
+/// the joint origin transform times the transform of the joint; \e prologue receives the code that computes the
+/// variable expressions the entries refer to
+bool computeLocalTransform(const LinkModel *link, std::vector<LinearExpression> &local, std::string &prologue)
+{
+  const JointModel *joint = link->getParentJointModel();
+  const Eigen::Matrix3d r = link->getJointOriginTransform().linear();
+  const Eigen::Vector3d p = link->getJointOriginTransform().translation();
+
+  local.assign(12, LinearExpression());
+  for (int i = 0 ; i < 3 ; ++i)
+    local[i * 4 + 3] = LinearExpression(p(i));
+
+  switch (joint->getType())
+  {
+  case JointModel::FIXED:
+    for (int i = 0 ; i < 3 ; ++i)
+      for (int j = 0 ; j < 3 ; ++j)
+        local[i * 4 + j] = LinearExpression(r(i, j));
+    break;
+
+  case JointModel::REVOLUTE:
+    {
+      const Eigen::Vector3d &a = static_cast<const RevoluteJointModel*>(joint)->getAxis();
+      prologue = "    const double c = std::cos(" + variable(joint, 0) + ");\n"
+        "    const double s = std::sin(" + variable(joint, 0) + ");\n";
+      int axis_index = -1;
+      for (int k = 0 ; k < 3 ; ++k)
+        if (std::fabs(a(k)) == 1.0)
+          axis_index = k;
+      if (axis_index >= 0)
+      {
+        // rotation about a coordinate axis: the column of the axis is constant, the other two mix
+        const int i = axis_index;
+        const int j = (i + 1) % 3;
+        const int k = (i + 2) % 3;
+        const double sign = a(i);
+        for (int m = 0 ; m < 3 ; ++m)
+        {
+          local[m * 4 + i] = LinearExpression(r(m, i));
+          local[m * 4 + j].add(r(m, j), "c");
+          local[m * 4 + j].add(sign * r(m, k), "s");
+          local[m * 4 + k].add(-sign * r(m, j), "s");
+          local[m * 4 + k].add(r(m, k), "c");
+        }
+      }
+      else
+      {
+        // Rodrigues' formula, c * I + s * [a]x + (1 - c) * a * a^T, premultiplied by the origin rotation
+        prologue += "    const double v = 1.0 - c;\n";
+        Eigen::Matrix3d skew;
+        skew << 0.0, -a.z(), a.y(),
+          a.z(), 0.0, -a.x(),
+          -a.y(), a.x(), 0.0;
+        const Eigen::Matrix3d rs = r * skew;
+        const Eigen::Vector3d ra = r * a;
+        for (int m = 0 ; m < 3 ; ++m)
+          for (int n = 0 ; n < 3 ; ++n)
+          {
+            local[m * 4 + n].add(r(m, n), "c");
+            local[m * 4 + n].add(rs(m, n), "s");
+            local[m * 4 + n].add(ra(m) * a(n), "v");
+          }
+      }
+    }
+    break;
+
+  case JointModel::PRISMATIC:
+    {
+      const Eigen::Vector3d ra = r * static_cast<const PrismaticJointModel*>(joint)->getAxis();
+      for (int m = 0 ; m < 3 ; ++m)
+      {
+        for (int n = 0 ; n < 3 ; ++n)
+          local[m * 4 + n] = LinearExpression(r(m, n));
+        local[m * 4 + 3].add(ra(m), variable(joint, 0));
+      }
+    }
+    break;
+
+  case JointModel::PLANAR:
+    prologue = "    const double c = std::cos(" + variable(joint, 2) + ");\n"
+      "    const double s = std::sin(" + variable(joint, 2) + ");\n";
+    for (int m = 0 ; m < 3 ; ++m)
+    {
+      local[m * 4 + 0].add(r(m, 0), "c");
+      local[m * 4 + 0].add(r(m, 1), "s");
+      local[m * 4 + 1].add(-r(m, 0), "s");
+      local[m * 4 + 1].add(r(m, 1), "c");
+      local[m * 4 + 2] = LinearExpression(r(m, 2));
+      local[m * 4 + 3].add(r(m, 0), variable(joint, 0));
+      local[m * 4 + 3].add(r(m, 1), variable(joint, 1));
+    }
+    break;
+
+  case JointModel::FLOATING:
+    prologue = "    const Eigen::Matrix3d rq = Eigen::Quaterniond(" + variable(joint, 6) + ", " + variable(joint, 3) + ", " +
+      variable(joint, 4) + ", " + variable(joint, 5) + ").toRotationMatrix();\n";
+    for (int m = 0 ; m < 3 ; ++m)
+    {
+      for (int n = 0 ; n < 3 ; ++n)
+        for (int k = 0 ; k < 3 ; ++k)
+        {
+          std::stringstream term;
+          term << "rq(" << k << ", " << n << ")";
+          local[m * 4 + n].add(r(m, k), term.str());
+        }
+      for (int k = 0 ; k < 3 ; ++k)
+        local[m * 4 + 3].add(r(m, k), variable(joint, k));
+    }
+    break;
+
+  default:
+    logError("Cannot generate forward kinematics for joint '%s' of type '%s'",
+             joint->getName().c_str(), joint->getTypeName().c_str());
+    return false;
+  }
+  return true;
+}
+
+}
+}
+}
+
+std::string moveit::core::computeForwardKinematicsSignature(const RobotModel &model)
+{
+  std::stringstream ss;
+  ss.precision(17);
+  ss << model.getName() << ' ' << model.getVariableCount() << '\n';
+  const std::vector<const LinkModel*> &links = model.getLinkModels();
+  for (std::size_t i = 0 ; i < links.size() ; ++i)
+  {
+    const JointModel *joint = links[i]->getParentJointModel();
+    ss << links[i]->getName() << ' ' << (links[i]->getParentLinkModel() ? links[i]->getParentLinkModel()->getLinkIndex() : -1) << ' '
+       << joint->getName() << ' ' << joint->getType() << ' ' << joint->getFirstVariableIndex();
+    const Eigen::Matrix4d &origin = links[i]->getJointOriginTransform().matrix();
+    for (int m = 0 ; m < 3 ; ++m)
+      for (int n = 0 ; n < 4 ; ++n)
+        ss << ' ' << origin(m, n);
+    if (joint->getType() == JointModel::REVOLUTE)
+      ss << ' ' << static_cast<const RevoluteJointModel*>(joint)->getAxis().transpose();
+    else if (joint->getType() == JointModel::PRISMATIC)
+      ss << ' ' << static_cast<const PrismaticJointModel*>(joint)->getAxis().transpose();
+    ss << '\n';
+  }
+
+  // 64 bit FNV-1a hash of the description
+  const std::string description = ss.str();
+  boost::uint64_t hash = 14695981039346656037ULL;
+  for (std::size_t i = 0 ; i < description.size() ; ++i)
+  {
+    hash ^= (unsigned char)description[i];
+    hash *= 1099511628211ULL;
+  }
+  std::string signature(16, '0');
+  for (int i = 15 ; i >= 0 ; --i, hash >>= 4)
+    signature[i] = "0123456789abcdef"[hash & 0xF];
+  return signature;
+}
+
+bool moveit::core::generateForwardKinematicsCode(const RobotModel &model, const std::string &function_name, std::ostream &out)
+{
+  std::stringstream body;
+  const std::vector<const LinkModel*> &links = model.getLinkModels();
+  for (std::size_t i = 0 ; i < links.size() ; ++i)
+  {
+    const LinkModel *link = links[i];
+    const LinkModel *parent = link->getParentLinkModel();
+    const JointModel *joint = link->getParentJointModel();
+    std::vector<LinearExpression> local;
+    std::string prologue;
+    if (!computeLocalTransform(link, local, prologue))
+      return false;
+
+    body << "  // link '" << link->getName() << "', " << joint->getTypeName() << " joint '" << joint->getName() << "'\n";
+    if (parent && joint->getType() == JointModel::FIXED && link->jointOriginTransformIsIdentity())
+    {
+      body << "  link_transforms[" << i << "] = link_transforms[" << parent->getLinkIndex() << "];\n";
+      continue;
+    }
+    body << "  {\n" << prologue << "    Eigen::Matrix4d local;\n    local <<";
+    for (int m = 0 ; m < 3 ; ++m)
+    {
+      for (int n = 0 ; n < 4 ; ++n)
+        body << (n == 0 ? " " : ", ") << local[m * 4 + n].str();
+      body << ",\n     ";
+    }
+    body << " 0.0, 0.0, 0.0, 1.0;\n";
+    if (parent)
+      body << "    link_transforms[" << i << "].matrix().noalias() = link_transforms[" << parent->getLinkIndex() << "].matrix() * local;\n";
+    else
+      body << "    link_transforms[" << i << "].matrix() = local;\n";
+    body << "  }\n";
+  }
+
+  out << "// Forward kinematics for robot model '" << model.getName() << "', " << links.size() << " links and "
+      << model.getVariableCount() << " variables.\n"
+      << "// Generated by moveit::core::generateForwardKinematicsCode(); do not edit.\n\n"
+      << "#include <moveit/robot_model/forward_kinematics_kernel.h>\n"
+      << "#include <cmath>\n\n"
+      << "namespace\n{\n\n"
+      << "void " << function_name << "_compute(const double *positions, Eigen::Affine3d *link_transforms)\n{\n"
+      << body.str()
+      << "}\n\n}\n\n"
+      << "moveit::core::ForwardKinematicsKernel " << function_name << "()\n{\n"
+      << "  return moveit::core::ForwardKinematicsKernel(&" << function_name << "_compute, \""
+      << computeForwardKinematicsSignature(model) << "\");\n"
+      << "}\n";
+  return true;
+}
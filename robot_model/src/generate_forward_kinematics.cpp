@@ -0,0 +1,88 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2013, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#include <moveit/robot_model/robot_model.h>
+#include <urdf_parser/urdf_parser.h>
+#include <fstream>
+#include <sstream>
+#include <cstdio>
+
+int main(int argc, char **argv)
+{
+  if (argc != 4 && argc != 5)
+  {
+    fprintf(stderr, "Usage: %s <urdf file> <srdf file> <function name> [output file]\n", argv[0]);
+    return 1;
+  }
+
+  std::ifstream urdf_file(argv[1]);
+  if (!urdf_file.good())
+  {
+    fprintf(stderr, "Unable to read URDF file '%s'\n", argv[1]);
+    return 1;
+  }
+  std::stringstream urdf_string;
+  urdf_string << urdf_file.rdbuf();
+  boost::shared_ptr<urdf::ModelInterface> urdf_model = urdf::parseURDF(urdf_string.str());
+  if (!urdf_model)
+  {
+    fprintf(stderr, "Unable to parse URDF file '%s'\n", argv[1]);
+    return 1;
+  }
+  boost::shared_ptr<srdf::Model> srdf_model(new srdf::Model());
+  if (!srdf_model->initFile(*urdf_model, argv[2]))
+  {
+    fprintf(stderr, "Unable to parse SRDF file '%s'\n", argv[2]);
+    return 1;
+  }
+
+  moveit::core::RobotModel model(urdf_model, srdf_model);
+  std::stringstream code;
+  if (!moveit::core::generateForwardKinematicsCode(model, argv[3], code))
+    return 1;
+
+  if (argc == 5)
+  {
+    std::ofstream out(argv[4]);
+    out << code.str();
+    if (!out.good())
+    {
+      fprintf(stderr, "Unable to write '%s'\n", argv[4]);
+      return 1;
+    }
+  }
+  else
+    printf("%s", code.str().c_str());
+  return 0;
+}
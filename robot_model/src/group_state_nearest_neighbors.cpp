@@ -0,0 +1,204 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2013, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#include <moveit/robot_model/group_state_nearest_neighbors.h>
+#include <cassert>
+#include <algorithm>
+#include <limits>
+
+namespace moveit
+{
+namespace core
+{
+namespace
+{
+
+// the tree is not built for fewer states than this; they are searched linearly
+const std::size_t MIN_TREE_SIZE = 16;
+
+}
+}
+}
+
+moveit::core::GroupStateNearestNeighbors::GroupStateNearestNeighbors(const JointModelGroup *group)
+  : group_(group)
+  , stride_(group->getVariableCount())
+{
+}
+
+std::size_t moveit::core::GroupStateNearestNeighbors::add(const double *values)
+{
+  const std::size_t index = size();
+  states_.insert(states_.end(), values, values + stride_);
+  pending_.push_back(index);
+  if (pending_.size() > std::max(MIN_TREE_SIZE, nodes_.size()))
+    rebuild();
+  return index;
+}
+
+std::size_t moveit::core::GroupStateNearestNeighbors::add(const std::vector<double> &values)
+{
+  assert(values.size() == stride_);
+  return add(&values[0]);
+}
+
+void moveit::core::GroupStateNearestNeighbors::clear()
+{
+  states_.clear();
+  nodes_.clear();
+  pending_.clear();
+}
+
+void moveit::core::GroupStateNearestNeighbors::rebuild()
+{
+  const std::size_t count = size();
+  std::vector<std::pair<double, std::size_t> > items(count);
+  for (std::size_t i = 0 ; i < count ; ++i)
+    items[i].second = i;
+  nodes_.clear();
+  nodes_.reserve(count);
+  build(items, 0, count);
+  pending_.clear();
+}
+
+int moveit::core::GroupStateNearestNeighbors::build(std::vector<std::pair<double, std::size_t> > &items, std::size_t begin, std::size_t end)
+{
+  if (begin == end)
+    return -1;
+
+  const int id = nodes_.size();
+  Node node;
+  node.state = items[begin].second;
+  node.threshold = 0.0;
+  node.inside = -1;
+  node.outside = -1;
+  nodes_.push_back(node);
+  if (end - begin == 1)
+    return id;
+
+  // split the remaining states at the median of their distance to the vantage point:
+  // the ones in [begin + 1, mid) are at most at the threshold, the ones in [mid, end) at least at the threshold
+  const double *vantage = getState(node.state);
+  for (std::size_t i = begin + 1 ; i < end ; ++i)
+    items[i].first = distance(vantage, items[i].second);
+  const std::size_t mid = begin + 1 + (end - begin - 1) / 2;
+  std::nth_element(items.begin() + begin + 1, items.begin() + mid, items.begin() + end);
+  const double threshold = items[mid].first;
+  const int inside = build(items, begin + 1, mid);
+  const int outside = build(items, mid, end);
+  nodes_[id].threshold = threshold;
+  nodes_[id].inside = inside;
+  nodes_[id].outside = outside;
+  return id;
+}
+
+void moveit::core::GroupStateNearestNeighbors::consider(std::size_t index, double d, std::size_t k, double radius, Candidates &candidates) const
+{
+  if (d > radius)
+    return;
+  if (candidates.size() < k)
+  {
+    candidates.push_back(std::make_pair(d, index));
+    std::push_heap(candidates.begin(), candidates.end());
+  }
+  else
+    if (d < candidates.front().first)
+    {
+      std::pop_heap(candidates.begin(), candidates.end());
+      candidates.back() = std::make_pair(d, index);
+      std::push_heap(candidates.begin(), candidates.end());
+    }
+}
+
+void moveit::core::GroupStateNearestNeighbors::search(int node, const double *values, std::size_t k, double radius, Candidates &candidates) const
+{
+  if (node < 0)
+    return;
+  const Node &n = nodes_[node];
+  const double d = distance(values, n.state);
+  consider(n.state, d, k, radius, candidates);
+
+  // by the triangle inequality, a subtree can only hold states closer than tau if the query is within tau of its side of the threshold
+  if (d < n.threshold)
+  {
+    search(n.inside, values, k, radius, candidates);
+    const double tau = candidates.size() < k ? radius : candidates.front().first;
+    if (d + tau >= n.threshold)
+      search(n.outside, values, k, radius, candidates);
+  }
+  else
+  {
+    search(n.outside, values, k, radius, candidates);
+    const double tau = candidates.size() < k ? radius : candidates.front().first;
+    if (d - tau <= n.threshold)
+      search(n.inside, values, k, radius, candidates);
+  }
+}
+
+void moveit::core::GroupStateNearestNeighbors::search(const double *values, std::size_t k, double radius, std::vector<std::size_t> &indices) const
+{
+  indices.clear();
+  if (k == 0 || empty())
+    return;
+  Candidates candidates;
+  candidates.reserve(std::min(k, size()));
+  if (!nodes_.empty())
+    search(0, values, k, radius, candidates);
+  for (std::size_t i = 0 ; i < pending_.size() ; ++i)
+    consider(pending_[i], distance(values, pending_[i]), k, radius, candidates);
+  std::sort_heap(candidates.begin(), candidates.end());
+  indices.resize(candidates.size());
+  for (std::size_t i = 0 ; i < candidates.size() ; ++i)
+    indices[i] = candidates[i].second;
+}
+
+bool moveit::core::GroupStateNearestNeighbors::nearest(const double *values, std::size_t &index) const
+{
+  std::vector<std::size_t> indices;
+  search(values, 1, std::numeric_limits<double>::infinity(), indices);
+  if (indices.empty())
+    return false;
+  index = indices[0];
+  return true;
+}
+
+void moveit::core::GroupStateNearestNeighbors::nearestK(const double *values, std::size_t k, std::vector<std::size_t> &indices) const
+{
+  search(values, k, std::numeric_limits<double>::infinity(), indices);
+}
+
+void moveit::core::GroupStateNearestNeighbors::nearestR(const double *values, double radius, std::vector<std::size_t> &indices) const
+{
+  search(values, size(), radius, indices);
+}
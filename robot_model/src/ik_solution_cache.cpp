@@ -0,0 +1,237 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2013, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#include <moveit/robot_model/ik_solution_cache.h>
+#include <console_bridge/console.h>
+#include <algorithm>
+#include <fstream>
+#include <limits>
+#include <cmath>
+
+namespace moveit
+{
+namespace core
+{
+namespace
+{
+struct EntryDistance
+{
+  double distance_;
+  const IKSolutionCache::Entry *entry_;
+
+  bool operator<(const EntryDistance &other) const
+  {
+    return distance_ < other.distance_;
+  }
+};
+}
+}
+}
+
+moveit::core::IKSolutionCache::IKSolutionCache(double position_resolution, double orientation_resolution, std::size_t max_solutions_per_bin) :
+  position_resolution_(position_resolution), orientation_resolution_(orientation_resolution),
+  max_solutions_per_bin_(std::max<std::size_t>(max_solutions_per_bin, 1)),
+  position_tolerance_(1e-3), orientation_tolerance_(1e-3), size_(0)
+{
+}
+
+bool moveit::core::IKSolutionCache::Key::operator<(const Key &other) const
+{
+  return std::lexicographical_compare(v, v + 7, other.v, other.v + 7);
+}
+
+void moveit::core::IKSolutionCache::setTolerances(double position_tolerance, double orientation_tolerance)
+{
+  position_tolerance_ = position_tolerance;
+  orientation_tolerance_ = orientation_tolerance;
+}
+
+Eigen::Quaterniond moveit::core::IKSolutionCache::canonicalOrientation(const Eigen::Affine3d &pose)
+{
+  // q and -q are the same orientation; use the one with w >= 0 so both fall in the same bin
+  Eigen::Quaterniond q(pose.rotation());
+  if (q.w() < 0.0)
+    q.coeffs() = -q.coeffs();
+  return q;
+}
+
+moveit::core::IKSolutionCache::Key moveit::core::IKSolutionCache::computeKey(const Eigen::Vector3d &position, const Eigen::Quaterniond &orientation) const
+{
+  Key k;
+  for (int i = 0 ; i < 3 ; ++i)
+    k.v[i] = (int)floor(position[i] / position_resolution_);
+  for (int i = 0 ; i < 4 ; ++i)
+    k.v[3 + i] = (int)floor(orientation.coeffs()[i] / orientation_resolution_);
+  return k;
+}
+
+void moveit::core::IKSolutionCache::insert(const Eigen::Affine3d &pose, const std::vector<double> &solution)
+{
+  Entry e;
+  e.position_ = pose.translation();
+  e.orientation_ = canonicalOrientation(pose);
+  e.solution_ = solution;
+  boost::mutex::scoped_lock slock(lock_);
+  insertEntry(e);
+}
+
+void moveit::core::IKSolutionCache::insertEntry(const Entry &entry)
+{
+  std::vector<Entry> &bin = bins_[computeKey(entry.position_, entry.orientation_)];
+  if (bin.size() >= max_solutions_per_bin_)
+  {
+    bin.erase(bin.begin());
+    size_--;
+  }
+  bin.push_back(entry);
+  size_++;
+}
+
+void moveit::core::IKSolutionCache::getEntries(const Eigen::Affine3d &pose, std::vector<Entry> &entries) const
+{
+  entries.clear();
+  Eigen::Vector3d p = pose.translation();
+  Eigen::Quaterniond q = canonicalOrientation(pose);
+  Key k = computeKey(p, q);
+
+  boost::mutex::scoped_lock slock(lock_);
+  std::vector<EntryDistance> found;
+  // look in the bin of the pose and in the neighbouring position bins
+  Key n = k;
+  for (n.v[0] = k.v[0] - 1 ; n.v[0] <= k.v[0] + 1 ; ++n.v[0])
+    for (n.v[1] = k.v[1] - 1 ; n.v[1] <= k.v[1] + 1 ; ++n.v[1])
+      for (n.v[2] = k.v[2] - 1 ; n.v[2] <= k.v[2] + 1 ; ++n.v[2])
+      {
+        std::map<Key, std::vector<Entry> >::const_iterator it = bins_.find(n);
+        if (it == bins_.end())
+          continue;
+        for (std::size_t i = 0 ; i < it->second.size() ; ++i)
+        {
+          const Entry &e = it->second[i];
+          EntryDistance ed;
+          ed.distance_ = (e.position_ - p).norm() / position_resolution_ + e.orientation_.angularDistance(q) / orientation_resolution_;
+          ed.entry_ = &e;
+          found.push_back(ed);
+        }
+      }
+  std::sort(found.begin(), found.end());
+  entries.reserve(found.size());
+  for (std::size_t i = 0 ; i < found.size() ; ++i)
+    entries.push_back(*found[i].entry_);
+}
+
+bool moveit::core::IKSolutionCache::reaches(const Entry &entry, const Eigen::Affine3d &pose) const
+{
+  return (entry.position_ - pose.translation()).norm() <= position_tolerance_ &&
+    entry.orientation_.angularDistance(canonicalOrientation(pose)) <= orientation_tolerance_;
+}
+
+std::size_t moveit::core::IKSolutionCache::size() const
+{
+  boost::mutex::scoped_lock slock(lock_);
+  return size_;
+}
+
+void moveit::core::IKSolutionCache::clear()
+{
+  boost::mutex::scoped_lock slock(lock_);
+  bins_.clear();
+  size_ = 0;
+}
+
+bool moveit::core::IKSolutionCache::saveToFile(const std::string &filename) const
+{
+  std::ofstream out(filename.c_str());
+  if (!out.good())
+  {
+    logError("Unable to open '%s' for writing the IK solution cache", filename.c_str());
+    return false;
+  }
+  out.precision(std::numeric_limits<double>::digits10 + 2);
+
+  boost::mutex::scoped_lock slock(lock_);
+  out << "ik_solution_cache " << size_ << std::endl;
+  for (std::map<Key, std::vector<Entry> >::const_iterator it = bins_.begin() ; it != bins_.end() ; ++it)
+    for (std::size_t i = 0 ; i < it->second.size() ; ++i)
+    {
+      const Entry &e = it->second[i];
+      out << e.position_.x() << " " << e.position_.y() << " " << e.position_.z() << " "
+          << e.orientation_.x() << " " << e.orientation_.y() << " " << e.orientation_.z() << " " << e.orientation_.w() << " "
+          << e.solution_.size();
+      for (std::size_t j = 0 ; j < e.solution_.size() ; ++j)
+        out << " " << e.solution_[j];
+      out << std::endl;
+    }
+  return out.good();
+}
+
+bool moveit::core::IKSolutionCache::loadFromFile(const std::string &filename)
+{
+  std::ifstream in(filename.c_str());
+  if (!in.good())
+  {
+    logError("Unable to open '%s' for reading the IK solution cache", filename.c_str());
+    return false;
+  }
+  std::string marker;
+  std::size_t count = 0;
+  in >> marker >> count;
+  if (!in.good() || marker != "ik_solution_cache")
+  {
+    logError("File '%s' does not contain an IK solution cache", filename.c_str());
+    return false;
+  }
+
+  std::vector<Entry> entries(count);
+  for (std::size_t i = 0 ; i < count ; ++i)
+  {
+    Entry &e = entries[i];
+    std::size_t n = 0;
+    in >> e.position_.x() >> e.position_.y() >> e.position_.z()
+       >> e.orientation_.x() >> e.orientation_.y() >> e.orientation_.z() >> e.orientation_.w() >> n;
+    e.solution_.resize(n);
+    for (std::size_t j = 0 ; j < n ; ++j)
+      in >> e.solution_[j];
+    if (in.fail())
+    {
+      logError("Unable to parse entry %u of the IK solution cache in '%s'", (unsigned int)i, filename.c_str());
+      return false;
+    }
+  }
+
+  boost::mutex::scoped_lock slock(lock_);
+  for (std::size_t i = 0 ; i < entries.size() ; ++i)
+    insertEntry(entries[i]);
+  return true;
+}
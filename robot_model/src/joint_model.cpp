@@ -39,6 +39,7 @@
 #include <moveit/robot_model/joint_model.h>
 #include <moveit/robot_model/link_model.h>
 #include <algorithm>
+#include <limits>
 
 moveit::core::JointModel::JointModel(const std::string& name)
   : name_(name)
@@ -110,6 +111,15 @@ bool moveit::core::JointModel::satisfiesVelocityBounds(const double *values, con
   return true;
 }
 
+void moveit::core::JointModel::getVariablePositionsFromUnitSample(const double *sample, double *values, const Bounds &other_bounds) const
+{
+  for (std::size_t i = 0 ; i < other_bounds.size() ; ++i)
+    if (other_bounds[i].max_position_ >= std::numeric_limits<double>::infinity() || other_bounds[i].min_position_ <= -std::numeric_limits<double>::infinity())
+      values[i] = 0.0;
+    else
+      values[i] = other_bounds[i].min_position_ + sample[i] * (other_bounds[i].max_position_ - other_bounds[i].min_position_);
+}
+
 const moveit::core::VariableBounds& moveit::core::JointModel::getVariableBounds(const std::string& variable) const
 {
   return variable_bounds_[getLocalVariableIndex(variable)];
@@ -40,8 +40,11 @@
 #include <moveit/robot_model/revolute_joint_model.h>
 #include <moveit/exceptions/exceptions.h>
 #include <console_bridge/console.h>
+#include <boost/bind.hpp>
 #include <boost/lexical_cast.hpp>
+#include <boost/math/constants/constants.hpp>
 #include <algorithm>
+#include <cmath>
 #include "order_robot_model_items.inc"
 
 namespace moveit
@@ -99,6 +102,34 @@ bool jointPrecedes(const JointModel *a, const JointModel *b)
   return false;
 }
 
+// Distance between the active variables of two states when all active joints are revolute or prismatic: the same
+// value RevoluteJointModel and PrismaticJointModel compute, without a virtual call per joint. The wrap-around of
+// continuous joints is applied through the mask rather than a branch, so the loop has no data dependent control
+// flow and the compiler can vectorize it.
+inline double linearVariableDistance(double a, double b, double wrap, double weight)
+{
+  const double dj = fabs(a - b);
+  const double wrapped = std::min(dj, 2.0 * boost::math::constants::pi<double>() - dj);
+  return weight * (dj + wrap * (wrapped - dj));
+}
+
+double linearDistance(const double *state1, const double *state2, const double *wrap, const double *weight, std::size_t count)
+{
+  double d = 0.0;
+  for (std::size_t i = 0 ; i < count ; ++i)
+    d += linearVariableDistance(state1[i], state2[i], wrap[i], weight[i]);
+  return d;
+}
+
+double linearDistance(const double *state1, const double *state2, const int *index,
+                      const double *wrap, const double *weight, std::size_t count)
+{
+  double d = 0.0;
+  for (std::size_t i = 0 ; i < count ; ++i)
+    d += linearVariableDistance(state1[index[i]], state2[index[i]], wrap[i], weight[i]);
+  return d;
+}
+
 }
 }
 }
@@ -110,6 +141,7 @@ moveit::core::JointModelGroup::JointModelGroup(const std::string& group_name,
   : parent_model_(parent_model)
   , name_(group_name)
   , common_root_(NULL)
+  , has_linearly_interpolable_joints_(true)
   , variable_count_(0)
   , is_contiguous_index_list_(true)
   , is_chain_(false)
@@ -139,6 +171,18 @@ moveit::core::JointModelGroup::JointModelGroup(const std::string& group_name,
         active_joint_model_name_vector_.push_back(joint_model_vector_[i]->getName());
         active_joint_model_start_index_.push_back(variable_count_);
         active_joint_models_bounds_.push_back(&joint_model_vector_[i]->getVariableBounds());
+
+        // revolute and prismatic joints interpolate their single variable linearly (continuous joints wrap around)
+        const JointModel::JointType type = joint_model_vector_[i]->getType();
+        if (type != JointModel::REVOLUTE && type != JointModel::PRISMATIC)
+          has_linearly_interpolable_joints_ = false;
+        double wrap = type == JointModel::REVOLUTE && static_cast<const RevoluteJointModel*>(joint_model_vector_[i])->isContinuous() ? 1.0 : 0.0;
+        for (std::size_t j = 0; j < name_order.size(); ++j)
+        {
+          active_variable_index_list_.push_back(joint_model_vector_[i]->getFirstVariableIndex() + j);
+          interpolation_wrap_mask_.push_back(wrap);
+          distance_weights_.push_back(joint_model_vector_[i]->getDistanceFactor());
+        }
       }
       else
         mimic_joints_.push_back(joint_model_vector_[i]);
@@ -232,6 +276,7 @@ moveit::core::JointModelGroup::JointModelGroup(const std::string& group_name,
     const std::vector<const LinkModel*> &links = joint_roots_[i]->getDescendantLinkModels();
     updated_link_model_set_.insert(links.begin(), links.end());
   }
+  updated_link_model_with_geometry_mask_.resize(parent_model->getLinkModelCount(), false);
   for (std::set<const LinkModel*>::iterator it = updated_link_model_set_.begin(); it != updated_link_model_set_.end(); ++it)
   {
     updated_link_model_name_set_.insert((*it)->getName());
@@ -241,6 +286,7 @@ moveit::core::JointModelGroup::JointModelGroup(const std::string& group_name,
       updated_link_model_with_geometry_vector_.push_back(*it);
       updated_link_model_with_geometry_set_.insert(*it);
       updated_link_model_with_geometry_name_set_.insert((*it)->getName());
+      updated_link_model_with_geometry_mask_[(*it)->getLinkIndex()] = true;
     }
   }
   std::sort(updated_link_model_vector_.begin(), updated_link_model_vector_.end(), OrderLinksByIndex());
@@ -315,12 +361,38 @@ void moveit::core::JointModelGroup::getVariableRandomPositions(random_numbers::R
                                                                const JointBoundsVector &active_joint_bounds) const
 {
   assert(active_joint_bounds.size() == active_joint_model_vector_.size());
-  for (std::size_t i = 0 ; i < active_joint_model_vector_.size() ; ++i)
-    active_joint_model_vector_[i]->getVariableRandomPositions(rng, values + active_joint_model_start_index_[i], *active_joint_bounds[i]);
+  if (has_linearly_interpolable_joints_)
+    // same as RevoluteJointModel and PrismaticJointModel do, without a virtual call per joint
+    for (std::size_t i = 0 ; i < active_joint_model_vector_.size() ; ++i)
+      values[active_joint_model_start_index_[i]] = rng.uniformReal((*active_joint_bounds[i])[0].min_position_, (*active_joint_bounds[i])[0].max_position_);
+  else
+    for (std::size_t i = 0 ; i < active_joint_model_vector_.size() ; ++i)
+      active_joint_model_vector_[i]->getVariableRandomPositions(rng, values + active_joint_model_start_index_[i], *active_joint_bounds[i]);
   
   updateMimicJoints(values);
 }
 
+unsigned int moveit::core::JointModelGroup::getUnitSampleDimension() const
+{
+  unsigned int dim = 0;
+  for (std::size_t i = 0 ; i < active_joint_model_vector_.size() ; ++i)
+    dim += active_joint_model_vector_[i]->getUnitSampleDimension();
+  return dim;
+}
+
+void moveit::core::JointModelGroup::getVariablePositionsFromUnitSample(const double *sample, double *values,
+                                                                       const JointBoundsVector &active_joint_bounds) const
+{
+  assert(active_joint_bounds.size() == active_joint_model_vector_.size());
+  for (std::size_t i = 0 ; i < active_joint_model_vector_.size() ; ++i)
+  {
+    active_joint_model_vector_[i]->getVariablePositionsFromUnitSample(sample, values + active_joint_model_start_index_[i], *active_joint_bounds[i]);
+    sample += active_joint_model_vector_[i]->getUnitSampleDimension();
+  }
+
+  updateMimicJoints(values);
+}
+
 void moveit::core::JointModelGroup::getVariableRandomPositionsNearBy(random_numbers::RandomNumberGenerator &rng, double *values,
                                                                      const JointBoundsVector &active_joint_bounds,
                                                                      const double *near, double distance) const
@@ -369,6 +441,17 @@ void moveit::core::JointModelGroup::getVariableRandomPositionsNearBy(random_numb
 bool moveit::core::JointModelGroup::satisfiesPositionBounds(const double *state, const JointBoundsVector &active_joint_bounds, double margin) const
 {
   assert(active_joint_bounds.size() == active_joint_model_vector_.size());
+  if (has_linearly_interpolable_joints_)
+  {
+    for (std::size_t i = 0 ; i < active_joint_model_vector_.size() ; ++i)
+    {
+      const double v = state[active_joint_model_start_index_[i]];
+      const VariableBounds &b = (*active_joint_bounds[i])[0];
+      if (v < b.min_position_ - margin || v > b.max_position_ + margin)
+        return false;
+    }
+    return true;
+  }
   for (std::size_t i = 0 ; i < active_joint_model_vector_.size() ; ++i)
     if (!active_joint_model_vector_[i]->satisfiesPositionBounds(state + active_joint_model_start_index_[i], *active_joint_bounds[i], margin))
       return false;
@@ -380,8 +463,26 @@ bool moveit::core::JointModelGroup::enforcePositionBounds(double *state, const J
   assert(active_joint_bounds.size() == active_joint_model_vector_.size());
   bool change = false;
   for (std::size_t i = 0 ; i < active_joint_model_vector_.size() ; ++i)
-    if (active_joint_model_vector_[i]->enforcePositionBounds(state + active_joint_model_start_index_[i], *active_joint_bounds[i]))
-      change = true;
+    if (has_linearly_interpolable_joints_ && interpolation_wrap_mask_[i] == 0.0)
+    {
+      // bounded revolute and prismatic joints are clamped to their bounds
+      double &v = state[active_joint_model_start_index_[i]];
+      const VariableBounds &b = (*active_joint_bounds[i])[0];
+      if (v < b.min_position_)
+      {
+        v = b.min_position_;
+        change = true;
+      }
+      else
+        if (v > b.max_position_)
+        {
+          v = b.max_position_;
+          change = true;
+        }
+    }
+    else
+      if (active_joint_model_vector_[i]->enforcePositionBounds(state + active_joint_model_start_index_[i], *active_joint_bounds[i]))
+        change = true;
   if (change)
     updateMimicJoints(state);
   return change;  
@@ -397,6 +498,16 @@ double moveit::core::JointModelGroup::getMaximumExtent(const JointBoundsVector &
 
 double moveit::core::JointModelGroup::distance(const double *state1, const double *state2) const
 {
+  if (has_linearly_interpolable_joints_)
+  {
+    if (distance_weights_.empty())
+      return 0.0;
+    // without mimic joints the active variables are the first ones in the group state, so no indexing is needed
+    if (mimic_joints_.empty())
+      return linearDistance(state1, state2, &interpolation_wrap_mask_[0], &distance_weights_[0], distance_weights_.size());
+    return linearDistance(state1, state2, &active_joint_model_start_index_[0],
+                          &interpolation_wrap_mask_[0], &distance_weights_[0], distance_weights_.size());
+  }
   double d = 0.0;
   for (std::size_t i = 0 ; i < active_joint_model_vector_.size() ; ++i)
     d += active_joint_model_vector_[i]->getDistanceFactor() * 
@@ -404,6 +515,24 @@ double moveit::core::JointModelGroup::distance(const double *state1, const doubl
   return d;
 }
 
+double moveit::core::JointModelGroup::distanceFullState(const double *state1, const double *state2) const
+{
+  if (has_linearly_interpolable_joints_)
+  {
+    if (distance_weights_.empty())
+      return 0.0;
+    return linearDistance(state1, state2, &active_variable_index_list_[0],
+                          &interpolation_wrap_mask_[0], &distance_weights_[0], distance_weights_.size());
+  }
+  double d = 0.0;
+  for (std::size_t i = 0 ; i < active_joint_model_vector_.size() ; ++i)
+  {
+    const int idx = active_joint_model_vector_[i]->getFirstVariableIndex();
+    d += active_joint_model_vector_[i]->getDistanceFactor() * active_joint_model_vector_[i]->distance(state1 + idx, state2 + idx);
+  }
+  return d;
+}
+
 void moveit::core::JointModelGroup::interpolate(const double *from, const double *to, double t, double *state) const
 {
   // we interpolate values only for active joint models (non-mimic)
@@ -482,8 +611,8 @@ int moveit::core::JointModelGroup::getVariableGroupIndex(const std::string &vari
 void moveit::core::JointModelGroup::setDefaultIKTimeout(double ik_timeout)
 {
   group_kinematics_.first.default_ik_timeout_ = ik_timeout;
-  if (group_kinematics_.first.solver_instance_)
-    group_kinematics_.first.solver_instance_->setDefaultTimeout(ik_timeout);
+  if (group_kinematics_.first.pool_)
+    group_kinematics_.first.pool_->setDefaultTimeout(ik_timeout);
   for (KinematicsSolverMap::iterator it = group_kinematics_.second.begin() ; it != group_kinematics_.second.end() ; ++it)
     it->second.default_ik_timeout_ = ik_timeout;
 }
@@ -495,6 +624,13 @@ void moveit::core::JointModelGroup::setDefaultIKAttempts(unsigned int ik_attempt
     it->second.default_ik_attempts_ = ik_attempts;
 }
 
+void moveit::core::JointModelGroup::setSolverInstancePoolSize(unsigned int size)
+{
+  group_kinematics_.first.pool_size_ = std::max(1u, size);
+  if (group_kinematics_.first.pool_)
+    group_kinematics_.first.pool_->setMaxSize(group_kinematics_.first.pool_size_);
+}
+
 bool moveit::core::JointModelGroup::computeIKIndexBijection(const std::vector<std::string> &ik_jnames, std::vector<unsigned int> &joint_bijection) const
 {
   joint_bijection.clear();
@@ -526,6 +662,8 @@ void moveit::core::JointModelGroup::setSolverAllocators(const std::pair<SolverAl
     {
       group_kinematics_.first.solver_instance_->setDefaultTimeout(group_kinematics_.first.default_ik_timeout_);
       group_kinematics_.first.solver_instance_const_ = group_kinematics_.first.solver_instance_;
+      group_kinematics_.first.pool_.reset(new KinematicsSolverPool(group_kinematics_.first.solver_instance_,
+                                                                   boost::bind(solvers.first, this), group_kinematics_.first.pool_size_));
       if (!computeIKIndexBijection(group_kinematics_.first.solver_instance_->getJointNames(),
                                    group_kinematics_.first.bijection_))
         group_kinematics_.first.reset();
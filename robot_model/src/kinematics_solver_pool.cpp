@@ -0,0 +1,203 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2013, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#include <moveit/robot_model/kinematics_solver_pool.h>
+#include <console_bridge/console.h>
+#include <algorithm>
+
+moveit::core::KinematicsSolverPool::KinematicsSolverPool(const kinematics::KinematicsBasePtr &solver, const AllocatorFn &allocator,
+                                                         unsigned int max_size)
+  : allocator_(allocator)
+  , max_size_(std::max(1u, max_size))
+  , default_timeout_(solver ? solver->getDefaultTimeout() : 0.0)
+  , has_redundant_joints_(false)
+  , allocation_failed_(false)
+  , allocating_(0)
+{
+  if (solver)
+  {
+    instances_.push_back(solver);
+    free_.push_back(solver);
+  }
+}
+
+kinematics::KinematicsBasePtr moveit::core::KinematicsSolverPool::acquire()
+{
+  return acquire(true);
+}
+
+kinematics::KinematicsBasePtr moveit::core::KinematicsSolverPool::tryAcquire()
+{
+  return acquire(false);
+}
+
+void moveit::core::KinematicsSolverPool::tryAcquire(std::size_t count, const std::vector<unsigned int> &redundant_joints,
+                                                    std::vector<kinematics::KinematicsBaseConstPtr> &solvers)
+{
+  growMaxSize(count);
+  while (solvers.size() < count)
+  {
+    kinematics::KinematicsBasePtr solver = acquire(false);
+    if (!solver)
+      break;
+    if (!redundant_joints.empty())
+    {
+      std::vector<unsigned int> solver_redundant_joints;
+      solver->getRedundantJoints(solver_redundant_joints);
+      if (solver_redundant_joints != redundant_joints)
+        solver->setRedundantJoints(redundant_joints);
+    }
+    solvers.push_back(solver);
+  }
+}
+
+kinematics::KinematicsBasePtr moveit::core::KinematicsSolverPool::acquire(bool wait)
+{
+  boost::mutex::scoped_lock slock(lock_);
+  while (free_.empty())
+  {
+    if (allocator_ && instances_.size() + allocating_ < max_size_)
+    {
+      // allocating an instance may take a while (e.g., loading a plugin), so it is done without holding the lock
+      ++allocating_;
+      double timeout = default_timeout_;
+      std::vector<std::string> redundant_joints = redundant_joints_;
+      bool has_redundant_joints = has_redundant_joints_;
+      slock.unlock();
+      kinematics::KinematicsBasePtr solver = allocator_();
+      if (solver)
+      {
+        solver->setDefaultTimeout(timeout);
+        if (has_redundant_joints)
+          solver->setRedundantJoints(redundant_joints);
+      }
+      slock.lock();
+      --allocating_;
+      // allocators that always return the same instance cannot be used to grow the pool
+      if (solver && std::find(instances_.begin(), instances_.end(), solver) != instances_.end())
+        solver.reset();
+      if (solver)
+      {
+        instances_.push_back(solver);
+        return lease(solver);
+      }
+      // do not try again; the pool keeps the instances it has
+      logWarn("Unable to allocate a kinematics solver instance. The pool is limited to %u instances.", (unsigned int)instances_.size());
+      max_size_ = std::max<std::size_t>(1, instances_.size());
+      allocation_failed_ = true;
+    }
+    else
+    {
+      if (!wait || (instances_.empty() && allocating_ == 0))
+        return kinematics::KinematicsBasePtr();
+      returned_.wait(slock);
+    }
+  }
+  kinematics::KinematicsBasePtr solver = free_.back();
+  free_.pop_back();
+  return lease(solver);
+}
+
+kinematics::KinematicsBasePtr moveit::core::KinematicsSolverPool::lease(const kinematics::KinematicsBasePtr &solver)
+{
+  return kinematics::KinematicsBasePtr(solver.get(), Release(shared_from_this(), solver));
+}
+
+void moveit::core::KinematicsSolverPool::release(const kinematics::KinematicsBasePtr &solver)
+{
+  {
+    boost::mutex::scoped_lock slock(lock_);
+    free_.push_back(solver);
+  }
+  returned_.notify_one();
+}
+
+void moveit::core::KinematicsSolverPool::setMaxSize(unsigned int max_size)
+{
+  {
+    boost::mutex::scoped_lock slock(lock_);
+    max_size_ = std::max(1u, max_size);
+  }
+  // waiting threads may now be able to allocate
+  returned_.notify_all();
+}
+
+void moveit::core::KinematicsSolverPool::growMaxSize(unsigned int max_size)
+{
+  {
+    boost::mutex::scoped_lock slock(lock_);
+    if (allocation_failed_ || max_size <= max_size_)
+      return;
+    max_size_ = max_size;
+  }
+  returned_.notify_all();
+}
+
+unsigned int moveit::core::KinematicsSolverPool::getMaxSize() const
+{
+  boost::mutex::scoped_lock slock(lock_);
+  return max_size_;
+}
+
+unsigned int moveit::core::KinematicsSolverPool::getSize() const
+{
+  boost::mutex::scoped_lock slock(lock_);
+  return instances_.size();
+}
+
+unsigned int moveit::core::KinematicsSolverPool::getLeasedCount() const
+{
+  boost::mutex::scoped_lock slock(lock_);
+  return instances_.size() - free_.size();
+}
+
+void moveit::core::KinematicsSolverPool::setDefaultTimeout(double timeout)
+{
+  boost::mutex::scoped_lock slock(lock_);
+  default_timeout_ = timeout;
+  for (std::size_t i = 0 ; i < instances_.size() ; ++i)
+    instances_[i]->setDefaultTimeout(timeout);
+}
+
+bool moveit::core::KinematicsSolverPool::setRedundantJoints(const std::vector<std::string> &joints)
+{
+  boost::mutex::scoped_lock slock(lock_);
+  redundant_joints_ = joints;
+  has_redundant_joints_ = true;
+  bool result = true;
+  for (std::size_t i = 0 ; i < instances_.size() ; ++i)
+    if (!instances_[i]->setRedundantJoints(joints))
+      result = false;
+  return result;
+}
@@ -36,6 +36,7 @@
 
 #include <moveit/robot_model/link_model.h>
 #include <moveit/robot_model/joint_model.h>
+#include <moveit/robot_model/aabb.h>
 #include <geometric_shapes/shape_operations.h>
 
 moveit::core::LinkModel::LinkModel(const std::string &name) 
@@ -48,6 +49,8 @@ moveit::core::LinkModel::LinkModel(const std::string &name)
   , link_index_(-1)
 {
   joint_origin_transform_.setIdentity();
+  shape_extents_.setZero();
+  centered_bounding_box_offset_.setZero();
 }
 
 moveit::core::LinkModel::~LinkModel()
@@ -73,32 +76,28 @@ void moveit::core::LinkModel::setGeometry(const std::vector<shapes::ShapeConstPt
   collision_origin_transform_ = origins;
   collision_origin_transform_is_identity_.resize(collision_origin_transform_.size());
   
-  Eigen::Vector3d a = Eigen::Vector3d(0.0, 0.0, 0.0);
-  Eigen::Vector3d b = Eigen::Vector3d(0.0, 0.0, 0.0);
-  
+  std::vector<double> aabb;
   for (std::size_t i = 0 ; i < shapes_.size() ; ++i)
   {
     collision_origin_transform_is_identity_[i] = (collision_origin_transform_[i].rotation().isIdentity() && 
                                                   collision_origin_transform_[i].translation().norm() < std::numeric_limits<double>::epsilon()) ? 1 : 0;
-    Eigen::Vector3d ei = shapes::computeShapeExtents(shapes_[i].get());
-    Eigen::Vector3d p1 = collision_origin_transform_[i] * (-ei / 2.0);
-    Eigen::Vector3d p2 = collision_origin_transform_[i] * (-p1);
-    
-    if (i == 0)
-    {
-      a = p1;
-      b = p2;
-    }
-    else
-    {
-      for (int i = 0 ; i < 3 ; ++i)
-        a[i] = std::min(a[i], p1[i]);
-      for (int i = 0 ; i < 3 ; ++i)
-        b[i] = std::max(b[i], p2[i]);
-    }
+    Eigen::Vector3d center, extents;
+    computeShapeAABB(shapes_[i].get(), center, extents);
+    Eigen::Vector3d link_center, link_extents;
+    transformAABB(collision_origin_transform_[i], center, extents, link_center, link_extents);
+    mergeAABB(link_center, link_extents, aabb);
+  }
+
+  if (aabb.empty())
+  {
+    shape_extents_ = Eigen::Vector3d::Zero();
+    centered_bounding_box_offset_ = Eigen::Vector3d::Zero();
+  }
+  else
+  {
+    shape_extents_ = Eigen::Vector3d(aabb[1] - aabb[0], aabb[3] - aabb[2], aabb[5] - aabb[4]);
+    centered_bounding_box_offset_ = Eigen::Vector3d(aabb[1] + aabb[0], aabb[3] + aabb[2], aabb[5] + aabb[4]) / 2.0;
   }
-  
-  shape_extents_ = b - a;
 }
 
 void moveit::core::LinkModel::setVisualMesh(const std::string &visual_mesh, const Eigen::Affine3d &origin, const Eigen::Vector3d &scale)
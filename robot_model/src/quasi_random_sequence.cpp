@@ -0,0 +1,314 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2013, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#include <moveit/robot_model/quasi_random_sequence.h>
+#include <random_numbers/random_numbers.h>
+#include <cmath>
+
+namespace moveit
+{
+namespace core
+{
+namespace
+{
+
+const unsigned int SOBOL_BITS = 32;
+
+// Sobol direction numbers of Joe and Kuo (new-joe-kuo-6.21201) for dimensions 2 to 21: the degree s of the primitive
+// polynomial, its coefficients a and the initial direction numbers m_1 .. m_s
+struct SobolInit
+{
+  unsigned int s_;
+  unsigned int a_;
+  unsigned int m_[7];
+};
+
+const SobolInit SOBOL_TABLE[] =
+{
+  { 1, 0,  { 1 } },
+  { 2, 1,  { 1, 3 } },
+  { 3, 1,  { 1, 3, 1 } },
+  { 3, 2,  { 1, 1, 1 } },
+  { 4, 1,  { 1, 1, 3, 3 } },
+  { 4, 4,  { 1, 3, 5, 13 } },
+  { 5, 2,  { 1, 1, 5, 5, 17 } },
+  { 5, 4,  { 1, 1, 5, 5, 5 } },
+  { 5, 7,  { 1, 1, 7, 11, 19 } },
+  { 5, 11, { 1, 1, 5, 1, 1 } },
+  { 5, 13, { 1, 1, 1, 3, 11 } },
+  { 5, 14, { 1, 3, 5, 5, 31 } },
+  { 6, 1,  { 1, 3, 3, 9, 7, 49 } },
+  { 6, 13, { 1, 1, 1, 15, 21, 21 } },
+  { 6, 16, { 1, 3, 1, 13, 27, 49 } },
+  { 6, 19, { 1, 1, 1, 15, 7, 5 } },
+  { 6, 22, { 1, 3, 1, 15, 13, 25 } },
+  { 6, 25, { 1, 1, 5, 5, 19, 61 } },
+  { 7, 1,  { 1, 3, 7, 11, 23, 15, 103 } },
+  { 7, 4,  { 1, 3, 7, 13, 13, 15, 69 } }
+};
+const unsigned int SOBOL_TABLE_SIZE = sizeof(SOBOL_TABLE) / sizeof(SOBOL_TABLE[0]);
+
+// product of the polynomials a and b over GF(2), modulo the polynomial p of degree s
+boost::uint64_t mulMod(boost::uint64_t a, boost::uint64_t b, boost::uint64_t p, unsigned int s)
+{
+  boost::uint64_t r = 0;
+  while (b)
+  {
+    if (b & 1)
+      r ^= a;
+    b >>= 1;
+    a <<= 1;
+    if ((a >> s) & 1)
+      a ^= p;
+  }
+  return r;
+}
+
+// x^e modulo the polynomial p of degree s
+boost::uint64_t powXMod(boost::uint64_t e, boost::uint64_t p, unsigned int s)
+{
+  boost::uint64_t r = 1, x = 2;
+  while (e)
+  {
+    if (e & 1)
+      r = mulMod(r, x, p, s);
+    x = mulMod(x, x, p, s);
+    e >>= 1;
+  }
+  return r;
+}
+
+// check whether x^s + a_1 x^(s-1) + ... + a_(s-1) x + 1 is primitive over GF(2), with the bits of a holding a_1 .. a_(s-1)
+bool isPrimitive(unsigned int s, boost::uint64_t a)
+{
+  if (s == 1)
+    return true;
+  const boost::uint64_t p = (boost::uint64_t(1) << s) | (a << 1) | 1;
+  const boost::uint64_t order = (boost::uint64_t(1) << s) - 1;
+  if (powXMod(order, p, s) != 1)
+    return false;
+  // x must not have a smaller order, i.e., a divisor order / q for any prime factor q of the order
+  boost::uint64_t n = order;
+  for (boost::uint64_t q = 2 ; q * q <= n ; ++q)
+    if (n % q == 0)
+    {
+      if (powXMod(order / q, p, s) == 1)
+        return false;
+      while (n % q == 0)
+        n /= q;
+    }
+  return n == 1 || powXMod(order / n, p, s) != 1;
+}
+
+// the digits of index in the given base, read after the decimal point
+inline double radicalInverse(boost::uint64_t index, unsigned int base)
+{
+  const double inv_base = 1.0 / base;
+  double f = inv_base, r = 0.0;
+  while (index > 0)
+  {
+    r += f * (index % base);
+    index /= base;
+    f *= inv_base;
+  }
+  return r;
+}
+
+inline double fractionalPart(double x)
+{
+  return x - floor(x);
+}
+
+}
+}
+}
+
+moveit::core::QuasiRandomSequence::QuasiRandomSequence(Type type, unsigned int dimension, boost::uint32_t seed) :
+  type_(type), dimension_(dimension), seed_(seed), index_(1)
+{
+  if (type_ == HALTON || type_ == LATTICE)
+    for (unsigned int n = 2 ; bases_.size() < dimension_ ; ++n)
+    {
+      bool prime = true;
+      for (std::size_t k = 0 ; k < bases_.size() && bases_[k] * bases_[k] <= n ; ++k)
+        if (n % bases_[k] == 0)
+        {
+          prime = false;
+          break;
+        }
+      if (prime)
+        bases_.push_back(n);
+    }
+
+  if (type_ == SOBOL)
+    initSobol();
+  else
+    if (type_ == LATTICE)
+    {
+      // the square roots of distinct primes are linearly independent over the rationals, and each of them has a
+      // periodic continued fraction, so every coordinate (not only the whole point) is evenly distributed
+      alpha_.resize(dimension_);
+      for (unsigned int j = 0 ; j < dimension_ ; ++j)
+        alpha_[j] = fractionalPart(sqrt((double)bases_[j]));
+    }
+
+  if (seed_ != 0)
+  {
+    random_numbers::RandomNumberGenerator rng(seed_);
+    if (type_ == SOBOL)
+    {
+      digital_shift_.resize(dimension_);
+      for (unsigned int j = 0 ; j < dimension_ ; ++j)
+        digital_shift_[j] = (boost::uint32_t(rng.uniformInteger(0, 0xFFFF)) << 16) | boost::uint32_t(rng.uniformInteger(0, 0xFFFF));
+    }
+    else
+    {
+      shift_.resize(dimension_);
+      for (unsigned int j = 0 ; j < dimension_ ; ++j)
+        shift_[j] = rng.uniform01();
+    }
+  }
+  else
+    if (type_ == SOBOL)
+      digital_shift_.resize(dimension_, 0);
+    else
+      shift_.resize(dimension_, 0.0);
+
+  setIndex(1);
+}
+
+void moveit::core::QuasiRandomSequence::initSobol()
+{
+  direction_.resize(dimension_ * SOBOL_BITS);
+  if (dimension_ == 0)
+    return;
+
+  // the first dimension is the van der Corput sequence in base 2
+  for (unsigned int k = 0 ; k < SOBOL_BITS ; ++k)
+    direction_[k] = boost::uint32_t(1) << (SOBOL_BITS - 1 - k);
+
+  // the polynomials after those in the table are the next primitive polynomials, by degree and then by coefficients;
+  // their initial direction numbers are odd numbers from a fixed linear congruential generator
+  unsigned int s = SOBOL_TABLE[SOBOL_TABLE_SIZE - 1].s_;
+  boost::uint64_t a = SOBOL_TABLE[SOBOL_TABLE_SIZE - 1].a_;
+  boost::uint32_t lcg = 12345;
+  std::vector<boost::uint32_t> m;
+  for (unsigned int j = 1 ; j < dimension_ ; ++j)
+  {
+    unsigned int deg;
+    boost::uint64_t coef;
+    m.clear();
+    if (j - 1 < SOBOL_TABLE_SIZE)
+    {
+      deg = SOBOL_TABLE[j - 1].s_;
+      coef = SOBOL_TABLE[j - 1].a_;
+      m.assign(SOBOL_TABLE[j - 1].m_, SOBOL_TABLE[j - 1].m_ + deg);
+    }
+    else
+    {
+      do
+      {
+        if (++a >= (boost::uint64_t(1) << (s - 1)))
+        {
+          ++s;
+          a = 0;
+        }
+      }
+      while (!isPrimitive(s, a));
+      deg = s;
+      coef = a;
+      for (unsigned int k = 1 ; k <= deg ; ++k)
+      {
+        lcg = lcg * 1103515245u + 12345u;
+        m.push_back(((lcg >> 8) & ((boost::uint32_t(1) << k) - 1)) | 1);
+      }
+    }
+
+    boost::uint32_t *v = &direction_[j * SOBOL_BITS];
+    for (unsigned int k = 0 ; k < deg && k < SOBOL_BITS ; ++k)
+      v[k] = m[k] << (SOBOL_BITS - 1 - k);
+    for (unsigned int k = deg ; k < SOBOL_BITS ; ++k)
+    {
+      v[k] = v[k - deg] ^ (v[k - deg] >> deg);
+      for (unsigned int l = 1 ; l < deg ; ++l)
+        if ((coef >> (deg - 1 - l)) & 1)
+          v[k] ^= v[k - l];
+    }
+  }
+}
+
+void moveit::core::QuasiRandomSequence::setIndex(boost::uint64_t index)
+{
+  index_ = index;
+  if (type_ == SOBOL)
+  {
+    // the point with index n is the combination of the direction numbers selected by the Gray code of n
+    sobol_point_.assign(dimension_, 0);
+    const boost::uint64_t gray = index ^ (index >> 1);
+    for (unsigned int k = 0 ; k < SOBOL_BITS ; ++k)
+      if ((gray >> k) & 1)
+        for (unsigned int j = 0 ; j < dimension_ ; ++j)
+          sobol_point_[j] ^= direction_[j * SOBOL_BITS + k];
+  }
+}
+
+void moveit::core::QuasiRandomSequence::next(double *point)
+{
+  switch (type_)
+  {
+  case HALTON:
+    for (unsigned int j = 0 ; j < dimension_ ; ++j)
+      point[j] = fractionalPart(radicalInverse(index_, bases_[j]) + shift_[j]);
+    break;
+  case SOBOL:
+    {
+      static const double SCALE = 1.0 / 4294967296.0;
+      for (unsigned int j = 0 ; j < dimension_ ; ++j)
+        point[j] = (sobol_point_[j] ^ digital_shift_[j]) * SCALE;
+      // going from index n to n + 1 changes the Gray code in the bit of the lowest zero bit of n
+      unsigned int c = 0;
+      for (boost::uint64_t n = index_ ; n & 1 ; n >>= 1)
+        ++c;
+      if (c < SOBOL_BITS)
+        for (unsigned int j = 0 ; j < dimension_ ; ++j)
+          sobol_point_[j] ^= direction_[j * SOBOL_BITS + c];
+    }
+    break;
+  case LATTICE:
+    for (unsigned int j = 0 ; j < dimension_ ; ++j)
+      point[j] = fractionalPart(shift_[j] + alpha_[j] * index_);
+    break;
+  }
+  ++index_;
+}
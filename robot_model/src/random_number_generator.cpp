@@ -0,0 +1,68 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2013, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#include <moveit/robot_model/random_number_generator.h>
+#include <boost/thread/tss.hpp>
+
+namespace moveit
+{
+namespace core
+{
+namespace
+{
+boost::thread_specific_ptr<random_numbers::RandomNumberGenerator>& getThreadGeneratorStorage()
+{
+  static boost::thread_specific_ptr<random_numbers::RandomNumberGenerator> storage;
+  return storage;
+}
+}
+}
+}
+
+random_numbers::RandomNumberGenerator& moveit::core::getThreadRandomNumberGenerator()
+{
+  boost::thread_specific_ptr<random_numbers::RandomNumberGenerator> &storage = getThreadGeneratorStorage();
+  random_numbers::RandomNumberGenerator *rng = storage.get();
+  if (!rng)
+  {
+    rng = new random_numbers::RandomNumberGenerator();
+    storage.reset(rng);
+  }
+  return *rng;
+}
+
+void moveit::core::seedThreadRandomNumberGenerator(boost::uint32_t seed)
+{
+  getThreadGeneratorStorage().reset(new random_numbers::RandomNumberGenerator(seed));
+}
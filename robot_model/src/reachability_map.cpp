@@ -0,0 +1,232 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2013, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#include <moveit/robot_model/reachability_map.h>
+#include <boost/math/constants/constants.hpp>
+#include <console_bridge/console.h>
+#include <algorithm>
+#include <fstream>
+#include <cstring>
+#include <cmath>
+
+namespace moveit
+{
+namespace core
+{
+namespace
+{
+const char REACHABILITY_MAP_MAGIC[8] = { 'M', 'V', 'T', 'R', 'M', 'A', 'P', '1' };
+
+template<typename T>
+void writeValue(std::ofstream &out, const T &value)
+{
+  out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template<typename T>
+bool readValue(std::ifstream &in, T &value)
+{
+  in.read(reinterpret_cast<char*>(&value), sizeof(T));
+  return in.good();
+}
+
+void writeString(std::ofstream &out, const std::string &value)
+{
+  writeValue(out, (boost::uint32_t)value.size());
+  out.write(value.data(), value.size());
+}
+
+bool readString(std::ifstream &in, std::string &value)
+{
+  boost::uint32_t n = 0;
+  if (!readValue(in, n) || n > 4096)
+    return false;
+  value.resize(n);
+  if (n > 0)
+    in.read(&value[0], n);
+  return in.good();
+}
+}
+}
+}
+
+moveit::core::ReachabilityMap::ReachabilityMap(const std::string &base_frame, const std::string &tip_frame, double resolution) :
+  base_frame_(base_frame), tip_frame_(tip_frame), resolution_(resolution), max_count_(0)
+{
+  // frames are link names; solvers sometimes report them with a leading slash
+  if (!base_frame_.empty() && base_frame_[0] == '/')
+    base_frame_.erase(0, 1);
+  if (!tip_frame_.empty() && tip_frame_[0] == '/')
+    tip_frame_.erase(0, 1);
+}
+
+bool moveit::core::ReachabilityMap::Key::operator<(const Key &other) const
+{
+  return std::lexicographical_compare(v, v + 3, other.v, other.v + 3);
+}
+
+moveit::core::ReachabilityMap::Key moveit::core::ReachabilityMap::computeKey(const Eigen::Vector3d &position) const
+{
+  Key k;
+  for (int i = 0 ; i < 3 ; ++i)
+    k.v[i] = (boost::int32_t)floor(position[i] / resolution_);
+  return k;
+}
+
+Eigen::Vector3d moveit::core::ReachabilityMap::getVoxelCenter(const Key &key) const
+{
+  return Eigen::Vector3d((key.v[0] + 0.5) * resolution_, (key.v[1] + 0.5) * resolution_, (key.v[2] + 0.5) * resolution_);
+}
+
+unsigned int moveit::core::ReachabilityMap::computeOrientationBin(const Eigen::Affine3d &pose)
+{
+  // 8 bins in azimuth times 8 bins in the cosine of the polar angle: all bins have the same area on the sphere
+  Eigen::Vector3d z = pose.rotation().col(2);
+  double azimuth = atan2(z.y(), z.x()) + boost::math::constants::pi<double>();
+  unsigned int a = std::min(7u, (unsigned int)(azimuth / (2.0 * boost::math::constants::pi<double>()) * 8.0));
+  unsigned int c = std::min(7u, (unsigned int)(std::max(0.0, (z.z() + 1.0) * 0.5) * 8.0));
+  return a * 8 + c;
+}
+
+unsigned int moveit::core::ReachabilityMap::countBins(boost::uint64_t bins)
+{
+  unsigned int count = 0;
+  for ( ; bins ; bins &= bins - 1)
+    ++count;
+  return count;
+}
+
+void moveit::core::ReachabilityMap::insert(const Eigen::Affine3d &pose)
+{
+  boost::uint64_t &bins = voxels_[computeKey(pose.translation())];
+  bins |= boost::uint64_t(1) << computeOrientationBin(pose);
+  max_count_ = std::max(max_count_, countBins(bins));
+}
+
+unsigned int moveit::core::ReachabilityMap::getOrientationCount(const Eigen::Vector3d &position) const
+{
+  std::map<Key, boost::uint64_t>::const_iterator it = voxels_.find(computeKey(position));
+  return it == voxels_.end() ? 0 : countBins(it->second);
+}
+
+bool moveit::core::ReachabilityMap::isReachable(const Eigen::Affine3d &pose) const
+{
+  std::map<Key, boost::uint64_t>::const_iterator it = voxels_.find(computeKey(pose.translation()));
+  return it != voxels_.end() && ((it->second >> computeOrientationBin(pose)) & 1);
+}
+
+void moveit::core::ReachabilityMap::getVoxels(std::vector<Eigen::Vector3d> &centers, std::vector<unsigned int> &counts) const
+{
+  centers.clear();
+  counts.clear();
+  centers.reserve(voxels_.size());
+  counts.reserve(voxels_.size());
+  for (std::map<Key, boost::uint64_t>::const_iterator it = voxels_.begin() ; it != voxels_.end() ; ++it)
+  {
+    centers.push_back(getVoxelCenter(it->first));
+    counts.push_back(countBins(it->second));
+  }
+}
+
+void moveit::core::ReachabilityMap::clear()
+{
+  voxels_.clear();
+  max_count_ = 0;
+}
+
+bool moveit::core::ReachabilityMap::saveToFile(const std::string &filename) const
+{
+  std::ofstream out(filename.c_str(), std::ios::binary);
+  if (!out.good())
+  {
+    logError("Unable to open '%s' for writing the reachability map", filename.c_str());
+    return false;
+  }
+  out.write(REACHABILITY_MAP_MAGIC, sizeof(REACHABILITY_MAP_MAGIC));
+  writeString(out, base_frame_);
+  writeString(out, tip_frame_);
+  writeValue(out, resolution_);
+  writeValue(out, (boost::uint64_t)voxels_.size());
+  for (std::map<Key, boost::uint64_t>::const_iterator it = voxels_.begin() ; it != voxels_.end() ; ++it)
+  {
+    out.write(reinterpret_cast<const char*>(it->first.v), sizeof(it->first.v));
+    writeValue(out, it->second);
+  }
+  return out.good();
+}
+
+bool moveit::core::ReachabilityMap::loadFromFile(const std::string &filename)
+{
+  std::ifstream in(filename.c_str(), std::ios::binary);
+  if (!in.good())
+  {
+    logError("Unable to open '%s' for reading the reachability map", filename.c_str());
+    return false;
+  }
+  char magic[sizeof(REACHABILITY_MAP_MAGIC)];
+  in.read(magic, sizeof(magic));
+  std::string base_frame, tip_frame;
+  double resolution = 0.0;
+  boost::uint64_t count = 0;
+  if (!in.good() || memcmp(magic, REACHABILITY_MAP_MAGIC, sizeof(magic)) != 0 ||
+      !readString(in, base_frame) || !readString(in, tip_frame) || !readValue(in, resolution) || !readValue(in, count) ||
+      !(resolution > 0.0))
+  {
+    logError("File '%s' does not contain a reachability map", filename.c_str());
+    return false;
+  }
+
+  std::map<Key, boost::uint64_t> voxels;
+  unsigned int max_count = 0;
+  for (boost::uint64_t i = 0 ; i < count ; ++i)
+  {
+    Key k;
+    boost::uint64_t bins = 0;
+    in.read(reinterpret_cast<char*>(k.v), sizeof(k.v));
+    if (!readValue(in, bins))
+    {
+      logError("Unable to read voxel %u of the reachability map in '%s'", (unsigned int)i, filename.c_str());
+      return false;
+    }
+    voxels[k] = bins;
+    max_count = std::max(max_count, countBins(bins));
+  }
+
+  base_frame_ = base_frame;
+  tip_frame_ = tip_frame;
+  resolution_ = resolution;
+  voxels_.swap(voxels);
+  max_count_ = max_count;
+  return true;
+}
@@ -51,6 +51,8 @@ moveit::core::RevoluteJointModel::RevoluteJointModel(const std::string& name)
   , xy_(0.0)
   , xz_(0.0)
   , yz_(0.0)
+  , axis_index_(-1)
+  , axis_sign_(1.0)
 {
   type_ = REVOLUTE;
   variable_names_.push_back(name_);
@@ -76,6 +78,14 @@ void moveit::core::RevoluteJointModel::setAxis(const Eigen::Vector3d &axis)
   xy_ = axis_.x() * axis_.y();
   xz_ = axis_.x() * axis_.z();
   yz_ = axis_.y() * axis_.z();
+
+  axis_index_ = -1;
+  for (int i = 0 ; i < 3 ; ++i)
+    if (axis_[(i + 1) % 3] == 0.0 && axis_[(i + 2) % 3] == 0.0 && axis_[i] != 0.0)
+    {
+      axis_index_ = i;
+      axis_sign_ = axis_[i] > 0.0 ? 1.0 : -1.0;
+    }
 }
 
 void moveit::core::RevoluteJointModel::setContinuous(bool flag)
@@ -205,6 +215,28 @@ void moveit::core::RevoluteJointModel::computeTransform(const double *joint_valu
 {
   const double c = cos(joint_values[0]);
   const double s = sin(joint_values[0]);
+
+  // column major
+  double *d = transf.data();
+
+  if (axis_index_ >= 0)
+  {
+    // rotation about a coordinate axis: only the entries of the other two axes depend on the angle
+    const int i = axis_index_;
+    const int j = (i + 1) % 3;
+    const int k = (i + 2) % 3;
+    const double ss = axis_sign_ * s;
+    for (int n = 0 ; n < 16 ; ++n)
+      d[n] = 0.0;
+    d[5 * i] = 1.0;
+    d[5 * j] = c;
+    d[5 * k] = c;
+    d[4 * j + k] = ss;
+    d[4 * k + j] = -ss;
+    d[15] = 1.0;
+    return;
+  }
+
   const double t = 1.0 - c;
   const double txy = t * xy_;
   const double txz = t * xz_;
@@ -214,9 +246,6 @@ void moveit::core::RevoluteJointModel::computeTransform(const double *joint_valu
   const double ys = axis_.y() * s;
   const double xs = axis_.x() * s;
 
-  // column major
-  double *d = transf.data();
-
   d[0] = t * x2_ + c;
   d[1] = txy + zs;
   d[2] = txz - ys;
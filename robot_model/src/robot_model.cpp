@@ -38,6 +38,9 @@
 #include <moveit/robot_model/robot_model.h>
 #include <geometric_shapes/shape_operations.h>
 #include <boost/math/constants/constants.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/tuple/tuple.hpp>
+#include <boost/tuple/tuple_comparison.hpp>
 #include <moveit/profiler/profiler.h>
 #include <algorithm>
 #include <limits>
@@ -48,7 +51,10 @@
 /* ------------------------ RobotModel ------------------------ */
 
 moveit::core::RobotModel::RobotModel(const boost::shared_ptr<const urdf::ModelInterface> &urdf_model,
-                                     const boost::shared_ptr<const srdf::Model> &srdf_model)
+                                     const boost::shared_ptr<const srdf::Model> &srdf_model,
+                                     CommonRootsMethod common_roots)
+  : common_roots_method_(common_roots)
+  , euler_tour_size_(0)
 {
   root_joint_ = NULL;
   urdf_ = urdf_model;
@@ -197,6 +203,16 @@ void computeCommonRootsHelper(const JointModel *joint, std::vector<int> &common_
 
 void moveit::core::RobotModel::computeCommonRoots()
 {
+  // the table has an entry for every pair of joints; for large models, use the (more compact) sparse representation
+  static const std::size_t MAX_TABLE_JOINTS = 128;
+  common_joint_roots_.clear();
+  if (common_roots_method_ == COMMON_ROOTS_SPARSE ||
+      (common_roots_method_ == COMMON_ROOTS_AUTO && joint_model_vector_.size() > MAX_TABLE_JOINTS))
+  {
+    computeCommonRootsSparse();
+    return;
+  }
+
   // compute common roots for all pairs of joints; 
   // there are 3 cases of pairs (X, Y):
   //    X != Y && X and Y are not descendants of one another
@@ -223,6 +239,57 @@ void moveit::core::RobotModel::computeCommonRoots()
   }  
 }
 
+void moveit::core::RobotModel::computeCommonRootsSparse()
+{
+  const int n = joint_model_vector_.size();
+  euler_first_.assign(n, 0);
+  euler_depth_.assign(n, 0);
+  std::vector<int> tour;
+  tour.reserve(2 * n);
+
+  // iterative depth first traversal of the joint tree; every time a joint is visited (on the way down, or when returning
+  // from one of its children) it is appended to the tour
+  std::vector<std::pair<const JointModel*, std::size_t> > stack;
+  if (root_joint_)
+    stack.push_back(std::make_pair(root_joint_, 0));
+  while (!stack.empty())
+  {
+    const JointModel *joint = stack.back().first;
+    const std::size_t next_child = stack.back().second;
+    if (next_child == 0)
+    {
+      euler_first_[joint->getJointIndex()] = tour.size();
+      euler_depth_[joint->getJointIndex()] = stack.size() - 1;
+    }
+    tour.push_back(joint->getJointIndex());
+    const LinkModel *link = joint->getChildLinkModel();
+    if (link && next_child < link->getChildJointModels().size())
+    {
+      stack.back().second++;
+      stack.push_back(std::make_pair(link->getChildJointModels()[next_child], 0));
+    }
+    else
+      stack.pop_back();
+  }
+
+  euler_tour_size_ = tour.size();
+  euler_log2_.assign(euler_tour_size_ + 1, 0);
+  for (int i = 2 ; i <= euler_tour_size_ ; ++i)
+    euler_log2_[i] = euler_log2_[i / 2] + 1;
+
+  const int levels = euler_log2_[euler_tour_size_] + 1;
+  euler_sparse_.resize(levels * euler_tour_size_);
+  std::copy(tour.begin(), tour.end(), euler_sparse_.begin());
+  for (int k = 1 ; k < levels ; ++k)
+  {
+    const int *prev = &euler_sparse_[(k - 1) * euler_tour_size_];
+    int *level = &euler_sparse_[k * euler_tour_size_];
+    const int half = 1 << (k - 1);
+    for (int i = 0 ; i + (1 << k) <= euler_tour_size_ ; ++i)
+      level[i] = euler_depth_[prev[i]] <= euler_depth_[prev[i + half]] ? prev[i] : prev[i + half];
+  }
+}
+
 void moveit::core::RobotModel::computeDescendants()
 {
   // compute the list of descendants for all joints
@@ -284,9 +351,15 @@ void moveit::core::RobotModel::buildJointInfo()
       std::size_t vc = joint_model_vector_[i]->getVariableCount();
       variable_count_ += vc;
       if (vc == 1)
+      {
         single_dof_joints_.push_back(joint_model_vector_[i]);
+        single_dof_joint_names_.push_back(joint_model_vector_[i]->getName());
+      }
       else
+      {
         multi_dof_joints_.push_back(joint_model_vector_[i]);
+        multi_dof_joint_names_.push_back(joint_model_vector_[i]->getName());
+      }
     }
   }
   
@@ -997,7 +1070,67 @@ moveit::core::LinkModel* moveit::core::RobotModel::constructLinkModel(const urdf
   return result;
 }
 
-shapes::ShapePtr moveit::core::RobotModel::constructShape(const urdf::Geometry *geom)
+namespace moveit
+{
+namespace core
+{
+namespace
+{
+
+/* Meshes loaded for robot links, shared by all the models in the process. Models that are constructed repeatedly
+   from the same description (or links that use the same mesh file) then load each mesh only once, and since the
+   shapes are the same objects, the collision geometry cached for them is shared as well. Only weak references
+   are kept, so meshes no model uses anymore are freed. */
+class MeshResourceCache
+{
+public:
+
+  typedef boost::tuple<std::string, double, double, double> Key;
+
+  shapes::ShapeConstPtr get(const std::string &filename, const Eigen::Vector3d &scale)
+  {
+    const Key key(filename, scale.x(), scale.y(), scale.z());
+    {
+      boost::mutex::scoped_lock slock(lock_);
+      std::map<Key, boost::weak_ptr<const shapes::Shape> >::const_iterator it = meshes_.find(key);
+      if (it != meshes_.end())
+        if (shapes::ShapeConstPtr mesh = it->second.lock())
+          return mesh;
+    }
+
+    // load the mesh without holding the lock; this is the expensive part
+    shapes::ShapeConstPtr mesh(shapes::createMeshFromResource(filename, scale));
+    if (!mesh)
+      return mesh;
+
+    boost::mutex::scoped_lock slock(lock_);
+    // remove the meshes that are no longer in use
+    for (std::map<Key, boost::weak_ptr<const shapes::Shape> >::iterator it = meshes_.begin() ; it != meshes_.end() ; )
+      if (it->second.expired())
+        meshes_.erase(it++);
+      else
+        ++it;
+    meshes_[key] = mesh;
+    return mesh;
+  }
+
+private:
+
+  boost::mutex lock_;
+  std::map<Key, boost::weak_ptr<const shapes::Shape> > meshes_;
+};
+
+MeshResourceCache& getMeshResourceCache()
+{
+  static MeshResourceCache cache;
+  return cache;
+}
+
+}
+}
+}
+
+shapes::ShapeConstPtr moveit::core::RobotModel::constructShape(const urdf::Geometry *geom)
 {
   moveit::tools::Profiler::ScopedBlock prof_block("RobotModel::constructShape");
 
@@ -1021,11 +1154,7 @@ shapes::ShapePtr moveit::core::RobotModel::constructShape(const urdf::Geometry *
     {
       const urdf::Mesh *mesh = static_cast<const urdf::Mesh*>(geom);
       if (!mesh->filename.empty())
-      {
-        Eigen::Vector3d scale(mesh->scale.x, mesh->scale.y, mesh->scale.z);
-        shapes::Mesh *m = shapes::createMeshFromResource(mesh->filename, scale);
-        result = m;
-      }
+        return getMeshResourceCache().get(mesh->filename, Eigen::Vector3d(mesh->scale.x, mesh->scale.y, mesh->scale.z));
     }
     break;
   default:
@@ -1033,7 +1162,7 @@ shapes::ShapePtr moveit::core::RobotModel::constructShape(const urdf::Geometry *
     break;
   }
 
-  return shapes::ShapePtr(result);
+  return shapes::ShapeConstPtr(result);
 }
 
 bool moveit::core::RobotModel::hasJointModel(const std::string &name) const
@@ -1212,6 +1341,24 @@ void moveit::core::RobotModel::interpolate(const double *from, const double *to,
   updateMimicJoints(state);
 }
 
+bool moveit::core::RobotModel::setForwardKinematicsKernel(const ForwardKinematicsKernel &kernel)
+{
+  if (!kernel.function)
+  {
+    logError("No forward kinematics function specified for model '%s'", model_name_.c_str());
+    return false;
+  }
+  std::string signature = computeForwardKinematicsSignature(*this);
+  if (kernel.signature != signature)
+  {
+    logError("The forward kinematics kernel was generated for a model of signature %s, but model '%s' has signature %s",
+             kernel.signature.c_str(), model_name_.c_str(), signature.c_str());
+    return false;
+  }
+  fk_kernel_ = kernel;
+  return true;
+}
+
 void moveit::core::RobotModel::setKinematicsAllocators(const std::map<std::string, SolverAllocatorFn> &allocators)
 {
   // we first set all the "simple" allocators -- where a group has one IK solver
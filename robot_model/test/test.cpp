@@ -35,11 +35,23 @@
 /* Author: Ioan Sucan */
 
 #include <moveit/robot_model/robot_model.h>
+#include <moveit/robot_model/ik_solution_cache.h>
+#include <moveit/robot_model/quasi_random_sequence.h>
+#include <moveit/robot_model/reachability_map.h>
+#include <moveit/robot_model/random_number_generator.h>
+#include <moveit/robot_model/group_state_nearest_neighbors.h>
 #include <moveit/test_resources/config.h>
 #include <urdf_parser/urdf_parser.h>
 #include <fstream>
+#include <sstream>
+#include <set>
+#include <algorithm>
 #include <gtest/gtest.h>
 #include <boost/filesystem/path.hpp>
+#include <boost/filesystem/operations.hpp>
+#include <boost/math/constants/constants.hpp>
+#include <boost/thread.hpp>
+#include <boost/bind.hpp>
 #include <moveit/profiler/profiler.h>
 
 class LoadPlanningModelsPr2 : public testing::Test
@@ -104,6 +116,322 @@ TEST_F(LoadPlanningModelsPr2, Model)
   
 }
 
+static const moveit::core::JointModel* getParentJoint(const moveit::core::JointModel *joint)
+{
+  const moveit::core::LinkModel *parent = joint->getParentLinkModel();
+  return parent ? parent->getParentJointModel() : NULL;
+}
+
+TEST_F(LoadPlanningModelsPr2, CommonRoots)
+{
+  moveit::core::RobotModel sparse(urdf_model, srdf_model, moveit::core::RobotModel::COMMON_ROOTS_SPARSE);
+
+  const std::vector<const moveit::core::JointModel*> &joints = sparse.getJointModels();
+  for (std::size_t i = 0 ; i < joints.size() ; ++i)
+  {
+    std::set<const moveit::core::JointModel*> ancestors;
+    for (const moveit::core::JointModel *j = joints[i] ; j ; j = getParentJoint(j))
+      ancestors.insert(j);
+    for (std::size_t k = 0 ; k < joints.size() ; ++k)
+    {
+      // the deepest ancestor of joint k that is also an ancestor of joint i
+      const moveit::core::JointModel *expected = joints[k];
+      while (ancestors.find(expected) == ancestors.end())
+        expected = getParentJoint(expected);
+      EXPECT_EQ(expected, sparse.getCommonRoot(joints[i], joints[k]));
+    }
+  }
+}
+
+TEST_F(LoadPlanningModelsPr2, SharedMeshes)
+{
+  // the meshes of a second model built from the same description are the ones loaded for the first
+  moveit::core::RobotModel other(urdf_model, srdf_model);
+  const std::vector<const moveit::core::LinkModel*> &links = robot_model->getLinkModelsWithCollisionGeometry();
+  for (std::size_t i = 0 ; i < links.size() ; ++i)
+  {
+    const moveit::core::LinkModel *other_link = other.getLinkModel(links[i]->getName());
+    ASSERT_EQ(links[i]->getShapes().size(), other_link->getShapes().size());
+    for (std::size_t j = 0 ; j < links[i]->getShapes().size() ; ++j)
+      if (links[i]->getShapes()[j]->type == shapes::MESH)
+        EXPECT_EQ(links[i]->getShapes()[j].get(), other_link->getShapes()[j].get());
+      else
+        EXPECT_NE(links[i]->getShapes()[j].get(), other_link->getShapes()[j].get());
+  }
+}
+
+TEST_F(LoadPlanningModelsPr2, GroupDistance)
+{
+  random_numbers::RandomNumberGenerator rng(7);
+  const std::vector<const moveit::core::JointModelGroup*> &groups = robot_model->getJointModelGroups();
+  std::vector<double> full1, full2;
+  for (std::size_t i = 0 ; i < groups.size() ; ++i)
+  {
+    const std::vector<int> &index = groups[i]->getVariableIndexList();
+    const std::vector<const moveit::core::JointModel*> &active = groups[i]->getActiveJointModels();
+    for (int t = 0 ; t < 10 ; ++t)
+    {
+      robot_model->getVariableRandomPositions(rng, full1);
+      robot_model->getVariableRandomPositions(rng, full2);
+      std::vector<double> local1(index.size()), local2(index.size());
+      for (std::size_t j = 0 ; j < index.size() ; ++j)
+      {
+        local1[j] = full1[index[j]];
+        local2[j] = full2[index[j]];
+      }
+      double expected = 0.0;
+      for (std::size_t j = 0 ; j < active.size() ; ++j)
+      {
+        const int k = active[j]->getFirstVariableIndex();
+        expected += active[j]->getDistanceFactor() * active[j]->distance(&full1[k], &full2[k]);
+      }
+      EXPECT_NEAR(expected, groups[i]->distanceFullState(&full1[0], &full2[0]), 1e-9);
+      if (!index.empty())
+        EXPECT_NEAR(expected, groups[i]->distance(&local1[0], &local2[0]), 1e-9);
+    }
+  }
+}
+
+TEST_F(LoadPlanningModelsPr2, GroupStateNearestNeighbors)
+{
+  const moveit::core::JointModelGroup *group = robot_model->getJointModelGroup("right_arm");
+  ASSERT_TRUE(group != NULL);
+  random_numbers::RandomNumberGenerator rng(11);
+  moveit::core::GroupStateNearestNeighbors nn(group);
+  std::vector<std::vector<double> > states;
+  std::vector<double> query;
+  for (std::size_t i = 0 ; i < 500 ; ++i)
+  {
+    states.resize(states.size() + 1);
+    group->getVariableRandomPositions(rng, states.back());
+    EXPECT_EQ(i, nn.add(states.back()));
+    if (i % 23 != 0)
+      continue;
+
+    // compare against a linear scan
+    group->getVariableRandomPositions(rng, query);
+    std::vector<std::pair<double, std::size_t> > expected;
+    for (std::size_t j = 0 ; j < states.size() ; ++j)
+      expected.push_back(std::make_pair(group->distance(&query[0], &states[j][0]), j));
+    std::sort(expected.begin(), expected.end());
+
+    std::size_t nearest;
+    ASSERT_TRUE(nn.nearest(&query[0], nearest));
+    EXPECT_EQ(expected[0].second, nearest);
+
+    std::vector<std::size_t> result;
+    nn.nearestK(&query[0], 5, result);
+    ASSERT_EQ(std::min<std::size_t>(5, states.size()), result.size());
+    for (std::size_t j = 0 ; j < result.size() ; ++j)
+      EXPECT_EQ(expected[j].second, result[j]);
+
+    const double radius = expected[expected.size() / 2].first;
+    nn.nearestR(&query[0], radius, result);
+    std::size_t count = 0;
+    while (count < expected.size() && expected[count].first <= radius)
+      ++count;
+    ASSERT_EQ(count, result.size());
+    for (std::size_t j = 0 ; j < result.size() ; ++j)
+      EXPECT_EQ(expected[j].second, result[j]);
+  }
+  EXPECT_EQ(states.size(), nn.size());
+  nn.clear();
+  std::size_t nearest;
+  EXPECT_FALSE(nn.nearest(&query[0], nearest));
+}
+
+namespace
+{
+void noForwardKinematics(const double *positions, Eigen::Affine3d *link_transforms)
+{
+}
+}
+
+TEST_F(LoadPlanningModelsPr2, ForwardKinematicsKernel)
+{
+  std::stringstream code;
+  ASSERT_TRUE(moveit::core::generateForwardKinematicsCode(*robot_model, "pr2ForwardKinematics", code));
+  const std::string signature = moveit::core::computeForwardKinematicsSignature(*robot_model);
+  EXPECT_EQ(16u, signature.size());
+  EXPECT_NE(std::string::npos, code.str().find("moveit::core::ForwardKinematicsKernel pr2ForwardKinematics()"));
+  EXPECT_NE(std::string::npos, code.str().find("\"" + signature + "\""));
+  const std::vector<const moveit::core::LinkModel*> &links = robot_model->getLinkModels();
+  for (std::size_t i = 0 ; i < links.size() ; ++i)
+    EXPECT_NE(std::string::npos, code.str().find("// link '" + links[i]->getName() + "'"));
+
+  // kernels are only accepted for models of the same signature
+  moveit::core::RobotModel model(urdf_model, srdf_model);
+  EXPECT_EQ(signature, moveit::core::computeForwardKinematicsSignature(model));
+  EXPECT_FALSE(model.getForwardKinematicsKernel().function);
+  EXPECT_FALSE(model.setForwardKinematicsKernel(moveit::core::ForwardKinematicsKernel(&noForwardKinematics, "0123456789abcdef")));
+  EXPECT_FALSE(model.getForwardKinematicsKernel().function);
+  EXPECT_TRUE(model.setForwardKinematicsKernel(moveit::core::ForwardKinematicsKernel(&noForwardKinematics, signature)));
+  EXPECT_TRUE(model.getForwardKinematicsKernel().function == &noForwardKinematics);
+  model.clearForwardKinematicsKernel();
+  EXPECT_FALSE(model.getForwardKinematicsKernel().function);
+}
+
+namespace
+{
+void getGenerator(random_numbers::RandomNumberGenerator **rng)
+{
+  *rng = &moveit::core::getThreadRandomNumberGenerator();
+}
+}
+
+TEST(ThreadRandomNumberGenerator, PerThreadAndSeedable)
+{
+  random_numbers::RandomNumberGenerator *rng = &moveit::core::getThreadRandomNumberGenerator();
+  EXPECT_EQ(rng, &moveit::core::getThreadRandomNumberGenerator());
+
+  random_numbers::RandomNumberGenerator *other = NULL;
+  boost::thread thread(boost::bind(&getGenerator, &other));
+  thread.join();
+  EXPECT_TRUE(other != NULL);
+  EXPECT_NE(rng, other);
+
+  moveit::core::seedThreadRandomNumberGenerator(42);
+  std::vector<double> values;
+  for (int i = 0 ; i < 10 ; ++i)
+    values.push_back(moveit::core::getThreadRandomNumberGenerator().uniform01());
+  moveit::core::seedThreadRandomNumberGenerator(42);
+  for (int i = 0 ; i < 10 ; ++i)
+    EXPECT_EQ(values[i], moveit::core::getThreadRandomNumberGenerator().uniform01());
+}
+
+TEST(IKSolutionCache, InsertLookupAndPersist)
+{
+  moveit::core::IKSolutionCache cache(0.05, 0.1, 2);
+  Eigen::Affine3d pose = Eigen::Translation3d(0.31, 0.12, 0.23) * Eigen::AngleAxisd(0.3, Eigen::Vector3d::UnitZ());
+  std::vector<double> sol(3, 0.5);
+  cache.insert(pose, sol);
+  sol[0] = 1.0;
+  cache.insert(pose * Eigen::Translation3d(0.01, 0.0, 0.0), sol);
+  EXPECT_EQ(2u, cache.size());
+
+  // the closest entry comes first and is the only one that reaches the pose
+  std::vector<moveit::core::IKSolutionCache::Entry> entries;
+  cache.getEntries(pose, entries);
+  ASSERT_EQ(2u, entries.size());
+  EXPECT_DOUBLE_EQ(0.5, entries[0].solution_[0]);
+  EXPECT_TRUE(cache.reaches(entries[0], pose));
+  EXPECT_FALSE(cache.reaches(entries[1], pose));
+
+  // far away poses have no candidates
+  cache.getEntries(Eigen::Translation3d(1.0, 1.0, 1.0) * pose, entries);
+  EXPECT_TRUE(entries.empty());
+
+  // bins keep a limited number of solutions; the oldest ones are dropped first
+  cache.insert(pose, sol);
+  cache.insert(pose, sol);
+  EXPECT_EQ(2u, cache.size());
+  cache.getEntries(pose, entries);
+  ASSERT_EQ(2u, entries.size());
+  EXPECT_DOUBLE_EQ(1.0, entries[0].solution_[0]);
+  EXPECT_DOUBLE_EQ(1.0, entries[1].solution_[0]);
+
+  std::string filename = (boost::filesystem::temp_directory_path() / "moveit_ik_cache_test.txt").string();
+  EXPECT_TRUE(cache.saveToFile(filename));
+  moveit::core::IKSolutionCache loaded(0.05, 0.1, 2);
+  EXPECT_TRUE(loaded.loadFromFile(filename));
+  EXPECT_EQ(cache.size(), loaded.size());
+  loaded.getEntries(pose, entries);
+  ASSERT_FALSE(entries.empty());
+  EXPECT_TRUE(loaded.reaches(entries[0], pose));
+}
+
+TEST(QuasiRandomSequence, Uniformity)
+{
+  const moveit::core::QuasiRandomSequence::Type types[] = { moveit::core::QuasiRandomSequence::HALTON,
+                                                            moveit::core::QuasiRandomSequence::SOBOL,
+                                                            moveit::core::QuasiRandomSequence::LATTICE };
+  for (int t = 0 ; t < 3 ; ++t)
+  {
+    // every one of 64 equal intervals of each coordinate gets close to its share of 1024 points
+    moveit::core::QuasiRandomSequence seq(types[t], 30, 3);
+    std::vector<std::vector<int> > count(30, std::vector<int>(64, 0));
+    std::vector<double> p;
+    for (int i = 0 ; i < 1024 ; ++i)
+    {
+      seq.next(p);
+      ASSERT_EQ(30u, p.size());
+      for (std::size_t j = 0 ; j < p.size() ; ++j)
+      {
+        ASSERT_GE(p[j], 0.0);
+        ASSERT_LT(p[j], 1.0);
+        count[j][(int)(p[j] * 64)]++;
+      }
+    }
+    for (std::size_t j = 0 ; j < count.size() ; ++j)
+      for (std::size_t k = 0 ; k < count[j].size() ; ++k)
+      {
+        EXPECT_GE(count[j][k], 6);
+        EXPECT_LE(count[j][k], 26);
+      }
+  }
+}
+
+TEST(QuasiRandomSequence, Reproducible)
+{
+  moveit::core::QuasiRandomSequence a(moveit::core::QuasiRandomSequence::SOBOL, 5, 11);
+  moveit::core::QuasiRandomSequence b(moveit::core::QuasiRandomSequence::SOBOL, 5, 11);
+  moveit::core::QuasiRandomSequence c(moveit::core::QuasiRandomSequence::SOBOL, 5, 12);
+  std::vector<double> pa, pb, pc;
+  for (int i = 0 ; i < 100 ; ++i)
+  {
+    a.next(pa);
+    b.next(pb);
+    c.next(pc);
+    for (std::size_t j = 0 ; j < pa.size() ; ++j)
+      EXPECT_EQ(pa[j], pb[j]);
+  }
+  EXPECT_NE(pa[0], pc[0]);
+
+  // jumping ahead gives the same points as stepping
+  EXPECT_EQ(101u, a.getIndex());
+  for (int i = 0 ; i < 20 ; ++i)
+    a.next(pa);
+  b.setIndex(120);
+  b.next(pb);
+  for (std::size_t j = 0 ; j < pa.size() ; ++j)
+    EXPECT_EQ(pa[j], pb[j]);
+}
+
+TEST(ReachabilityMap, InsertLookupAndPersist)
+{
+  moveit::core::ReachabilityMap map("/base", "tip", 0.1);
+  EXPECT_EQ("base", map.getBaseFrame());
+  EXPECT_EQ(0u, map.getOrientationCount(Eigen::Vector3d(0.05, 0.05, 0.05)));
+
+  // two orientations with different z axes in the same voxel, and the same orientation twice in another one
+  Eigen::Affine3d pose(Eigen::Translation3d(0.05, 0.05, 0.05));
+  map.insert(pose);
+  map.insert(pose * Eigen::AngleAxisd(boost::math::constants::pi<double>(), Eigen::Vector3d::UnitX()));
+  Eigen::Affine3d other(Eigen::Translation3d(0.35, -0.05, 0.05));
+  map.insert(other);
+  map.insert(other);
+  EXPECT_EQ(2u, map.size());
+  EXPECT_EQ(2u, map.getOrientationCount(Eigen::Vector3d(0.01, 0.09, 0.02)));
+  EXPECT_EQ(1u, map.getOrientationCount(other.translation()));
+  EXPECT_EQ(2u, map.getMaxOrientationCount());
+  EXPECT_TRUE(map.isReachable(pose));
+  EXPECT_FALSE(map.isReachable(other * Eigen::AngleAxisd(boost::math::constants::pi<double>(), Eigen::Vector3d::UnitY())));
+
+  std::string filename = (boost::filesystem::temp_directory_path() / "moveit_reachability_map_test.bin").string();
+  EXPECT_TRUE(map.saveToFile(filename));
+  moveit::core::ReachabilityMap loaded;
+  EXPECT_TRUE(loaded.loadFromFile(filename));
+  EXPECT_EQ("base", loaded.getBaseFrame());
+  EXPECT_EQ("tip", loaded.getTipFrame());
+  EXPECT_DOUBLE_EQ(0.1, loaded.getResolution());
+  EXPECT_EQ(2u, loaded.size());
+  EXPECT_EQ(2u, loaded.getMaxOrientationCount());
+  EXPECT_TRUE(loaded.isReachable(pose));
+
+  // files of other kinds are refused
+  EXPECT_FALSE(loaded.loadFromFile((boost::filesystem::temp_directory_path() / "moveit_ik_cache_test.txt").string()));
+  EXPECT_EQ(2u, loaded.size());
+}
 
 int main(int argc, char **argv)
 {
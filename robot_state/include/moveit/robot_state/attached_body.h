@@ -40,6 +40,7 @@
 #include <moveit/robot_model/link_model.h>
 #include <eigen_stl_containers/eigen_stl_containers.h>
 #include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
 #include <trajectory_msgs/JointTrajectory.h>
 #include <set>
 
@@ -53,7 +54,12 @@ typedef boost::function<void(AttachedBody *body, bool attached)> AttachedBodyCal
 
 /** @brief Object defining bodies that can be attached to robot
  *  links. This is useful when handling objects picked up by
- *  the robot. */
+ *  the robot.
+ *
+ *  Everything except the global transforms of the shapes is
+ *  shared between copies of an attached body, so copying one (and
+ *  thus copying a RobotState that holds objects) is cheap. The shared
+ *  data is copied only when one of the copies is modified. */
 class AttachedBody
 {
 public:
@@ -65,31 +71,34 @@ public:
                const EigenSTL::vector_Affine3d &attach_trans,
                const std::set<std::string> &touch_links,
                const trajectory_msgs::JointTrajectory &attach_posture);
+
+  /** \brief Construct a copy of \e other; the description of the body is shared with \e other, not copied */
+  AttachedBody(const AttachedBody &other);
   
   ~AttachedBody();
   
   /** \brief Get the name of the attached body */
   const std::string& getName() const
   {
-    return id_;
+    return data_->id_;
   }
 
   /** \brief Get the name of the link this body is attached to */
   const std::string& getAttachedLinkName() const
   {
-    return parent_link_model_->getName();
+    return data_->parent_link_model_->getName();
   }
 
   /** \brief Get the model of the link this body is attached to */
   const LinkModel* getAttachedLink() const
   {
-    return parent_link_model_;
+    return data_->parent_link_model_;
   }
 
   /** \brief Get the shapes that make up this attached body */
   const std::vector<shapes::ShapeConstPtr>& getShapes() const
   {
-    return shapes_;
+    return data_->shapes_;
   }
 
   /** \brief Get the fixed transform (the transforms to the shapes associated with this body) */
@@ -97,19 +106,31 @@ public:
   /** \brief Get the links that the attached body is allowed to touch */
   const std::set<std::string>& getTouchLinks() const
   {
-    return touch_links_;
+    return data_->touch_links_;
   }
 
   /** \brief Return the posture that is necessary for the object to be released, (if any). This is useful for example when storing
       the configuration of a gripper holding an object */
   const trajectory_msgs::JointTrajectory& getDetachPosture() const
   {
-    return detach_posture_;
+    return data_->detach_posture_;
   }
 
   const EigenSTL::vector_Affine3d& getFixedTransforms() const
   {
-    return attach_trans_;
+    return data_->attach_trans_;
+  }
+
+  /** \brief Get the centers of the axis-aligned bounding boxes of the shapes, each in the frame of its shape */
+  const EigenSTL::vector_Vector3d& getShapeBoundingBoxCenters() const
+  {
+    return data_->shape_aabb_centers_;
+  }
+
+  /** \brief Get the extents of the axis-aligned bounding boxes of the shapes, each in the frame of its shape */
+  const EigenSTL::vector_Vector3d& getShapeBoundingBoxExtents() const
+  {
+    return data_->shape_aabb_extents_;
   }
 
   /** \brief Get the global transforms for the collision bodies */
@@ -128,30 +149,46 @@ public:
   void computeTransform(const Eigen::Affine3d &parent_link_global_transform)
   {
     for (std::size_t i = 0; i < global_collision_body_transforms_.size() ; ++i)
-      global_collision_body_transforms_[i] = parent_link_global_transform * attach_trans_[i];
+      global_collision_body_transforms_[i] = parent_link_global_transform * data_->attach_trans_[i];
   }
   
 private:
 
-  /** \brief The link that owns this attached body */
-  const LinkModel                   *parent_link_model_;
+  /** \brief The description of the attached body, which copies share */
+  struct Data
+  {
+    /** \brief The link that owns this attached body */
+    const LinkModel                   *parent_link_model_;
 
-  /** \brief string id for reference */
-  std::string                        id_;
+    /** \brief string id for reference */
+    std::string                        id_;
 
-  /** \brief The geometries of the attached body */
-  std::vector<shapes::ShapeConstPtr> shapes_;
+    /** \brief The geometries of the attached body */
+    std::vector<shapes::ShapeConstPtr> shapes_;
 
-  /** \brief The constant transforms applied to the link (needs to be specified by user) */
-  EigenSTL::vector_Affine3d          attach_trans_;
+    /** \brief The constant transforms applied to the link (needs to be specified by user) */
+    EigenSTL::vector_Affine3d          attach_trans_;
 
-  /** \brief The set of links this body is allowed to touch */
-  std::set<std::string>              touch_links_;
+    /** \brief The set of links this body is allowed to touch */
+    std::set<std::string>              touch_links_;
+
+    /** \brief Posture of links for releasing the object (if any). This is useful for example when storing
+        the configuration of a gripper holding an object */
+    trajectory_msgs::JointTrajectory   detach_posture_;
+
+    /** \brief The axis-aligned bounding boxes of the shapes, each in the frame of its shape */
+    EigenSTL::vector_Vector3d          shape_aabb_centers_;
+    EigenSTL::vector_Vector3d          shape_aabb_extents_;
+  };
+
+  /** \brief Make sure the data of this body is not shared with other bodies, so it can be modified */
+  Data& getMutableData();
+
+  /** \brief Compute the bounding boxes of the shapes, after they are set or changed */
+  void updateShapeBoundingBoxes();
+
+  boost::shared_ptr<Data>            data_;
 
-  /** \brief Posture of links for releasing the object (if any). This is useful for example when storing
-      the configuration of a gripper holding an object */
-  trajectory_msgs::JointTrajectory   detach_posture_;
-  
   /** \brief The global transforms for these attached bodies (computed by forward kinematics) */
   EigenSTL::vector_Affine3d          global_collision_body_transforms_;
 };
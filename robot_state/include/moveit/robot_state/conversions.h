@@ -85,6 +85,35 @@ void robotStateToRobotStateMsg(const RobotState& state, moveit_msgs::RobotState
  */
 void robotStateToJointStateMsg(const RobotState& state, sensor_msgs::JointState &joint_state);
 
+/**
+ * @brief Repeatedly convert kinematic states to a robot state message that is kept between calls, for
+ * publishing states at a high rate. The buffers of the message are reused, and the attached bodies are only
+ * converted again when they changed (see RobotState::getAttachedBodiesVersion())
+ */
+class RobotStateMsgConverter
+{
+public:
+  RobotStateMsgConverter();
+
+  /** @brief Update the kept message to represent \e state and return it. The returned reference
+      stays valid until the converter is destroyed; its content changes on the next call. */
+  const moveit_msgs::RobotState& convert(const RobotState& state, bool copy_attached_bodies = true);
+
+  /** @brief Get the message produced by the last call to convert() */
+  const moveit_msgs::RobotState& getMessage() const
+  {
+    return msg_;
+  }
+
+  /** @brief Release the kept message; the next call to convert() converts everything again */
+  void reset();
+
+private:
+  moveit_msgs::RobotState msg_;
+  boost::uint64_t         attached_bodies_version_;
+  bool                    attached_bodies_valid_;
+};
+
 }
 }
 
@@ -0,0 +1,206 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2013, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#ifndef MOVEIT_CORE_ROBOT_STATE_DIFF_IK_WORKSPACE_
+#define MOVEIT_CORE_ROBOT_STATE_DIFF_IK_WORKSPACE_
+
+#include <moveit/robot_state/jacobian_workspace.h>
+#include <Eigen/Cholesky>
+
+namespace moveit
+{
+namespace core
+{
+
+/** \brief Preallocated differential IK for a chain group, intended for servoing loops running at high rates.
+
+    Unlike RobotState::setFromDiffIK(), all storage is allocated when the workspace is configured: computing a
+    variable velocity or integrating it afterwards performs no heap allocation, no name lookups and takes no locks.
+
+    The variable velocity for a twist v is computed with damped least squares, qdot = J^T (J J^T + l^2 I)^-1 v.
+    The damping l is zero away from singularities and grows up to the maximum damping as the manipulability
+    sqrt(det(J J^T)) drops below the manipulability threshold. A secondary task that pushes the bounded
+    variables towards the middle of their range is projected into the null space of the Jacobian. Finally, the
+    velocity is scaled uniformly (preserving its direction) so that the variable velocity bounds are respected.
+
+    Twists are 6-vectors (linear velocity first, then angular velocity) for the origin of the tip link. They are
+    expressed in the frame of the parent link of the first joint of the group, like the Jacobian computed by
+    JacobianWorkspace, or in the frame of the tip link if setTwistInTipFrame() is enabled.
+
+    A workspace is not thread safe; use one workspace per thread. */
+class DiffIKWorkspace
+{
+public:
+
+  typedef Eigen::Matrix<double, 6, 1> Twist;
+
+  DiffIKWorkspace();
+
+  /** \brief Construct a workspace for the tip \e link (the last link of the group if \e link is NULL) of \e group */
+  DiffIKWorkspace(const JointModelGroup *group, const LinkModel *link = NULL);
+
+  /** \brief Allocate the storage for the chain of \e group ending at \e link (the last link of the group if
+      \e link is NULL). Return false if the Jacobian of the chain cannot be computed (see JacobianWorkspace) */
+  bool configure(const JointModelGroup *group, const LinkModel *link = NULL);
+
+  /** \brief Check if configure() was successful */
+  bool isConfigured() const
+  {
+    return jacobian_.isConfigured();
+  }
+
+  const JointModelGroup* getGroup() const
+  {
+    return jacobian_.getGroup();
+  }
+
+  const LinkModel* getLink() const
+  {
+    return jacobian_.getLink();
+  }
+
+  /** \brief Set the damping used at singular configurations (default 0.05) */
+  void setMaximumDamping(double damping)
+  {
+    max_damping_ = damping;
+  }
+
+  double getMaximumDamping() const
+  {
+    return max_damping_;
+  }
+
+  /** \brief Set the manipulability below which damping is applied (default 0.01) */
+  void setManipulabilityThreshold(double threshold)
+  {
+    manipulability_threshold_ = threshold;
+  }
+
+  double getManipulabilityThreshold() const
+  {
+    return manipulability_threshold_;
+  }
+
+  /** \brief Set the gain of the null space motion away from position bounds (default 0.5; 0 disables it).
+      At a position bound, the secondary task asks for a velocity of \e gain towards the middle of the range */
+  void setJointLimitGain(double gain)
+  {
+    joint_limit_gain_ = gain;
+  }
+
+  double getJointLimitGain() const
+  {
+    return joint_limit_gain_;
+  }
+
+  /** \brief Interpret twists as expressed in the frame of the tip link (false by default) */
+  void setTwistInTipFrame(bool flag)
+  {
+    twist_in_tip_frame_ = flag;
+  }
+
+  bool getTwistInTipFrame() const
+  {
+    return twist_in_tip_frame_;
+  }
+
+  /** \brief Compute the velocity of the group variables that realizes \e twist at \e state. The link transforms of
+      \e state must be up to date. The result is available from getVariableVelocity(). Return false if the
+      workspace is not configured */
+  bool computeVariableVelocity(const RobotState &state, const Twist &twist);
+
+  /** \brief Compute the variable velocity for \e twist (see computeVariableVelocity()), integrate it for \e dt
+      seconds and update the link transforms of \e state. Return false if the workspace is not configured */
+  bool setFromDiffIK(RobotState &state, const Twist &twist, double dt);
+
+  /** \brief The variable velocity computed by the last call, in the order of the variables of the group */
+  const Eigen::VectorXd& getVariableVelocity() const
+  {
+    return qdot_;
+  }
+
+  /** \brief The manipulability of the chain at the last call */
+  double getManipulability() const
+  {
+    return manipulability_;
+  }
+
+  /** \brief The damping used at the last call */
+  double getDamping() const
+  {
+    return damping_;
+  }
+
+  /** \brief The Jacobian computed at the last call (see JacobianWorkspace) */
+  const JacobianWorkspace<>::Jacobian& getJacobian() const
+  {
+    return jacobian_.getJacobian();
+  }
+
+private:
+
+  JacobianWorkspace<>        jacobian_;
+  const LinkModel           *root_link_;
+
+  /** \brief The indices of the group variables in the state; the bounds of unbounded variables are not used */
+  std::vector<int>           variable_index_;
+  Eigen::VectorXd            min_position_;
+  Eigen::VectorXd            max_position_;
+  Eigen::VectorXd            max_velocity_;
+  std::vector<unsigned char> position_bounded_;
+  std::vector<unsigned char> velocity_bounded_;
+
+  double                     max_damping_;
+  double                     manipulability_threshold_;
+  double                     joint_limit_gain_;
+  bool                       twist_in_tip_frame_;
+
+  Eigen::Matrix<double, 6, 6>              jjt_;
+  Eigen::LLT<Eigen::Matrix<double, 6, 6> > llt_;
+  Twist                      task_;
+  Twist                      y_;
+  Eigen::VectorXd            qdot_;
+  Eigen::VectorXd            secondary_;
+  Eigen::VectorXd            positions_;
+  double                     manipulability_;
+  double                     damping_;
+
+public:
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+};
+
+}
+}
+
+#endif
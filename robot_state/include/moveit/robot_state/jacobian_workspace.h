@@ -0,0 +1,249 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2013, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#ifndef MOVEIT_CORE_ROBOT_STATE_JACOBIAN_WORKSPACE_
+#define MOVEIT_CORE_ROBOT_STATE_JACOBIAN_WORKSPACE_
+
+#include <moveit/robot_state/robot_state.h>
+#include <moveit/robot_model/revolute_joint_model.h>
+#include <moveit/robot_model/prismatic_joint_model.h>
+#include <vector>
+
+namespace moveit
+{
+namespace core
+{
+
+/** \brief Preallocated storage for repeatedly computing the Jacobian of a chain group with RobotState::getJacobian().
+
+    The chain between the tip link and the group root is analyzed once, when the workspace is configured: the joints that
+    contribute columns, their axes and their column indices are cached. Computing the Jacobian afterwards performs no
+    heap allocation and no name lookups. When the number of variables of the group is known at compile time, it can be
+    passed as \e DOF, in which case the Jacobian is a fixed size matrix. The Jacobian has 6 rows (linear velocity first,
+    then angular velocity) and is expressed in the frame of the parent link of the first joint of the group.
+
+    A workspace is not thread safe; use one workspace per thread. */
+template<int DOF>
+class JacobianWorkspace
+{
+public:
+
+  typedef Eigen::Matrix<double, 6, DOF> Jacobian;
+
+  JacobianWorkspace() : group_(NULL), link_(NULL), root_link_(NULL)
+  {
+  }
+
+  /** \brief Construct a workspace for the Jacobian of the point on \e link (the last link of the group
+      if \e link is NULL) with respect to the variables of \e group */
+  JacobianWorkspace(const JointModelGroup *group, const LinkModel *link = NULL) : group_(NULL), link_(NULL), root_link_(NULL)
+  {
+    configure(group, link);
+  }
+
+  /** \brief Analyze the chain of \e group ending at \e link (the last link of the group if \e link is NULL).
+      Return false if the group is not a chain, if the link is not part of it or if the number of variables
+      of the group does not match \e DOF */
+  bool configure(const JointModelGroup *group, const LinkModel *link = NULL)
+  {
+    group_ = NULL;
+    link_ = NULL;
+    root_link_ = NULL;
+    segments_.clear();
+
+    if (!group->isChain())
+    {
+      logError("The group '%s' is not a chain. Cannot compute Jacobian.", group->getName().c_str());
+      return false;
+    }
+    if (!link)
+      link = group->getLinkModels().back();
+    if (!group->isLinkUpdated(link->getName()))
+    {
+      logError("Link name '%s' does not exist in the chain '%s' or is not a child for this chain", link->getName().c_str(), group->getName().c_str());
+      return false;
+    }
+    int columns = group->getVariableCount();
+    if (DOF != Eigen::Dynamic && DOF != columns)
+    {
+      logError("Group '%s' has %d variables but the Jacobian workspace was instantiated for %d", group->getName().c_str(), columns, DOF);
+      return false;
+    }
+
+    const JointModel *root_joint_model = group->getJointModels()[0];
+    for (const LinkModel *l = link ; l ; )
+    {
+      const JointModel *pjm = l->getParentJointModel();
+      if (pjm->getVariableCount() > 0)
+      {
+        Segment s;
+        s.link_index_ = l->getLinkIndex();
+        s.type_ = pjm->getType();
+        s.column_ = group->getVariableGroupIndex(pjm->getVariableNames()[0]);
+        if (s.type_ == JointModel::REVOLUTE)
+          s.axis_ = static_cast<const RevoluteJointModel*>(pjm)->getAxis();
+        else
+          if (s.type_ == JointModel::PRISMATIC)
+            s.axis_ = static_cast<const PrismaticJointModel*>(pjm)->getAxis();
+          else
+            if (s.type_ == JointModel::PLANAR)
+              s.axis_ = Eigen::Vector3d::UnitZ();
+            else
+            {
+              logError("Unknown type of joint in Jacobian computation");
+              segments_.clear();
+              return false;
+            }
+        segments_.push_back(s);
+      }
+      if (pjm == root_joint_model)
+        break;
+      l = pjm->getParentLinkModel();
+    }
+
+    root_link_ = root_joint_model->getParentLinkModel();
+    jacobian_.resize(6, columns);
+    group_ = group;
+    link_ = link;
+    return true;
+  }
+
+  /** \brief Check if configure() was successful */
+  bool isConfigured() const
+  {
+    return group_ != NULL;
+  }
+
+  const JointModelGroup* getGroup() const
+  {
+    return group_;
+  }
+
+  const LinkModel* getLink() const
+  {
+    return link_;
+  }
+
+  /** \brief The Jacobian computed by the last call to RobotState::getJacobian() for this workspace */
+  const Jacobian& getJacobian() const
+  {
+    return jacobian_;
+  }
+
+private:
+
+  friend class RobotState;
+
+  /** \brief A joint along the chain that contributes columns to the Jacobian */
+  struct Segment
+  {
+    /** \brief The child link of the joint; the joint axis is expressed in the frame of this link */
+    int                  link_index_;
+    JointModel::JointType type_;
+
+    /** \brief The column of the first variable of the joint */
+    int                  column_;
+
+    /** \brief The joint axis (the rotation axis for planar joints), in the frame of the child link */
+    Eigen::Vector3d      axis_;
+  };
+
+  const JointModelGroup *group_;
+  const LinkModel       *link_;
+  const LinkModel       *root_link_;
+  std::vector<Segment>   segments_;
+  Jacobian               jacobian_;
+
+public:
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+};
+
+template<int DOF>
+bool RobotState::getJacobian(JacobianWorkspace<DOF> &workspace, const Eigen::Vector3d &reference_point_position) const
+{
+  BOOST_VERIFY(checkLinkTransforms());
+  if (!workspace.isConfigured())
+  {
+    logError("Jacobian workspace is not configured. Cannot compute Jacobian.");
+    return false;
+  }
+
+  typename JacobianWorkspace<DOF>::Jacobian &jacobian = workspace.jacobian_;
+  jacobian.setZero();
+
+  // the columns are computed in the model frame and rotated into the frame of the root link at the end
+  const Eigen::Vector3d point = global_link_transforms_[workspace.link_->getLinkIndex()] * reference_point_position;
+  for (std::size_t i = 0 ; i < workspace.segments_.size() ; ++i)
+  {
+    const typename JacobianWorkspace<DOF>::Segment &s = workspace.segments_[i];
+    const Eigen::Affine3d &t = global_link_transforms_[s.link_index_];
+    const Eigen::Vector3d axis = t.linear() * s.axis_;
+    switch (s.type_)
+    {
+    case JointModel::REVOLUTE:
+      jacobian.template block<3, 1>(0, s.column_) += axis.cross(point - t.translation());
+      jacobian.template block<3, 1>(3, s.column_) += axis;
+      break;
+    case JointModel::PRISMATIC:
+      jacobian.template block<3, 1>(0, s.column_) += axis;
+      break;
+    case JointModel::PLANAR:
+      jacobian.template block<3, 1>(0, s.column_) += t.linear().col(0);
+      jacobian.template block<3, 1>(0, s.column_ + 1) += t.linear().col(1);
+      jacobian.template block<3, 1>(0, s.column_ + 2) += axis.cross(point - t.translation());
+      jacobian.template block<3, 1>(3, s.column_ + 2) += axis;
+      break;
+    default:
+      break;
+    }
+  }
+
+  if (workspace.root_link_)
+  {
+    const Eigen::Matrix3d rt = global_link_transforms_[workspace.root_link_->getLinkIndex()].linear().transpose();
+    for (int c = 0 ; c < jacobian.cols() ; ++c)
+    {
+      Eigen::Vector3d v = rt * jacobian.template block<3, 1>(0, c);
+      jacobian.template block<3, 1>(0, c) = v;
+      v = rt * jacobian.template block<3, 1>(3, c);
+      jacobian.template block<3, 1>(3, c) = v;
+    }
+  }
+  return true;
+}
+
+}
+}
+
+#endif
@@ -39,6 +39,9 @@
 #define MOVEIT_CORE_ROBOT_STATE_
 
 #include <moveit/robot_model/robot_model.h>
+#include <moveit/robot_model/quasi_random_sequence.h>
+#include <moveit/robot_model/reachability_map.h>
+#include <moveit/robot_model/random_number_generator.h>
 #include <moveit/robot_state/attached_body.h>
 #include <sensor_msgs/JointState.h>
 #include <visualization_msgs/MarkerArray.h>
@@ -46,6 +49,8 @@
 #include <cassert>
 
 #include <boost/assert.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/cstdint.hpp>
 
 namespace moveit
 {
@@ -53,11 +58,95 @@ namespace core
 {
 
 MOVEIT_CLASS_FORWARD(RobotState); 
+MOVEIT_CLASS_FORWARD(RobotStateMemoryPool);
 
 /** \brief Signature for functions that can verify that if the group \e joint_group in \e robot_state is set to \e joint_group_variable_values
     the state is valid or not. Returns true if the state is valid. This call is allowed to modify \e robot_state (e.g., set \e joint_group_variable_values) */
 typedef boost::function<bool(RobotState *robot_state, const JointModelGroup *joint_group, const double *joint_group_variable_values)> GroupStateValidityCallbackFn;
 
+/** \brief Signature for functions that rank solutions for the group \e joint_group, given as \e joint_group_variable_values (lower is better).
+    \e robot_state can be used (and modified) to evaluate the cost */
+typedef boost::function<double(RobotState *robot_state, const JointModelGroup *joint_group, const double *joint_group_variable_values)> GroupStateCostFn;
+
+/** \brief Options for computing Cartesian paths (see RobotState::computeCartesianPath()) */
+struct CartesianPathOptions
+{
+  CartesianPathOptions() : adaptive(false), min_step(0.001), max_joint_step(0.0), max_deviation(0.0), threads(1)
+  {
+  }
+
+  /** \brief Take steps of up to max_step along the path and halve them (down to \e min_step) only where the
+      consecutive states do not satisfy \e max_joint_step and \e max_deviation. When this is false, uniform steps are taken
+      and the remaining adaptive options are ignored. */
+  bool adaptive;
+
+  /** \brief The smallest Cartesian step taken along the path in adaptive mode */
+  double min_step;
+
+  /** \brief The largest joint-space distance allowed between consecutive states in adaptive mode (0 to disable). Consecutive
+      states that are further apart than this even at \e min_step are considered a jump, and the path is truncated before them. */
+  double max_joint_step;
+
+  /** \brief The largest distance allowed in adaptive mode between the straight line and the position of the link at
+      the joint-space midpoint of two consecutive states (0 to disable) */
+  double max_deviation;
+
+  /** \brief The number of threads used to solve the segments of paths with multiple waypoints */
+  unsigned int threads;
+};
+
+/** \brief A cache of the memory blocks used by instances of RobotState for a particular robot model.
+
+    Every RobotState allocates a single block of memory for its transforms, variable values
+    and flags; the size of that block only depends on the robot model. States constructed
+    with a pool (and copies of such states) take their block from the pool and return it
+    when they are destroyed, so code that creates and destroys many states reuses memory
+    instead of going through the global allocator each time. A pool can be shared by
+    multiple threads. States keep a shared pointer to their pool. */
+class RobotStateMemoryPool
+{
+public:
+
+  /** \brief Construct a pool for states of \e robot_model. At most \e max_cached_blocks unused blocks are kept. */
+  RobotStateMemoryPool(const RobotModelConstPtr &robot_model, std::size_t max_cached_blocks = 1024);
+  ~RobotStateMemoryPool();
+
+  const RobotModelConstPtr& getRobotModel() const
+  {
+    return robot_model_;
+  }
+
+  /** \brief The size in bytes of one memory block */
+  std::size_t getBlockSize() const
+  {
+    return block_size_;
+  }
+
+  /** \brief Get a block of getBlockSize() bytes, reusing a cached block if one is available */
+  void* allocate();
+
+  /** \brief Return a block obtained from allocate() to the pool */
+  void release(void *block);
+
+  /** \brief Free all the cached blocks */
+  void clear();
+
+  /** \brief The number of unused blocks currently held by the pool */
+  std::size_t getCachedBlockCount() const;
+
+private:
+
+  RobotModelConstPtr  robot_model_;
+  std::size_t         block_size_;
+  std::size_t         max_cached_blocks_;
+  std::vector<void*>  free_blocks_;
+  mutable boost::mutex lock_;
+};
+
+/** \brief Preallocated storage for the Jacobian of a chain group, with \e DOF columns (see jacobian_workspace.h) */
+template<int DOF = Eigen::Dynamic>
+class JacobianWorkspace;
+
 /** \brief Representation of a robot's state. This includes position,
     velocity, acceleration and effort.
     
@@ -82,14 +171,41 @@ public:
   /** \brief A state can be constructed from a specified robot model. No values are initialized.
       Call setToDefaultValues() if a state needs to provide valid information. */
   RobotState(const RobotModelConstPtr &robot_model);
+
+  /** \brief Construct a state whose memory is taken from \e memory_pool (and returned to it on destruction).
+      Copies of this state use the same pool. No values are initialized. */
+  RobotState(const RobotStateMemoryPoolPtr &memory_pool);
   ~RobotState();
   
+  /** \brief The data that is copied from another state */
+  enum CopyMode
+    {
+      /** \brief Copy only the positions; velocities, accelerations and efforts are not kept and all transforms are marked dirty */
+      COPY_POSITIONS,
+      /** \brief Copy positions, velocities, accelerations and efforts; all transforms are marked dirty */
+      COPY_VARIABLES,
+      /** \brief Copy the variables, the transforms and the information about which of the transforms are dirty */
+      COPY_FULL
+    };
+
   /** \brief Copy constructor. */
   RobotState(const RobotState &other);
+
+  /** \brief Construct a copy of \e other, copying only the data specified by \e mode */
+  RobotState(const RobotState &other, CopyMode mode);
   
   /** \brief Copy operator */
   RobotState& operator=(const RobotState &other);
 
+  /** \brief Copy the data specified by \e mode from \e other, which must be a state of the same robot model. The attached
+      bodies are always copied. When the copy is about to be modified so that (almost) all transforms are
+      recomputed anyway (e.g., interpolation of the full state), copying only the variables avoids copying the transforms. */
+  void copyFrom(const RobotState &other, CopyMode mode = COPY_FULL);
+
+  /** \brief Exchange the contents of this state and \e other in constant time. Nothing is allocated or copied, so this
+      can be used to move a state where a copy would otherwise be made. */
+  void swap(RobotState &other);
+
   /** \brief Get the robot model this state is constructed for. */
   const RobotModelConstPtr& getRobotModel() const
   {
@@ -170,6 +286,10 @@ public:
   /** \brief Set the positions of a set of variables. If unknown variable names are specified, an exception is thrown.
       Additionally, \e missing_variables is filled with the names of the variables that are not set. */
   void setVariablePositions(const std::vector<std::string>& variable_names, const std::vector<double>& variable_position);
+
+  /** \brief Set the positions of a set of variables, given by their indices in the state (see RobotModel::getVariableIndex()).
+      This avoids looking up variable names when the same set of variables is set repeatedly. */
+  void setVariablePositions(const std::vector<int>& variable_indices, const std::vector<double>& variable_position);
   
   /** \brief Set the position of a single variable. An exception is thrown if the variable name is not known */
   void setVariablePosition(const std::string &variable, double value)
@@ -255,6 +375,9 @@ public:
   /** \brief Set the velocities of a set of variables. If unknown variable names are specified, an exception is thrown. */
   void setVariableVelocities(const std::vector<std::string>& variable_names, const std::vector<double>& variable_velocity);
 
+  /** \brief Set the velocities of a set of variables, given by their indices in the state. */
+  void setVariableVelocities(const std::vector<int>& variable_indices, const std::vector<double>& variable_velocity);
+
   /** \brief Set the velocity of a variable. If an unknown variable name is specified, an exception is thrown. */
   void setVariableVelocity(const std::string &variable, double value)
   {
@@ -335,6 +458,9 @@ public:
 
   /** \brief Set the accelerations of a set of variables. If unknown variable names are specified, an exception is thrown. */    
   void setVariableAccelerations(const std::vector<std::string>& variable_names, const std::vector<double>& variable_acceleration);
+
+  /** \brief Set the accelerations of a set of variables, given by their indices in the state. */
+  void setVariableAccelerations(const std::vector<int>& variable_indices, const std::vector<double>& variable_acceleration);
   
   /** \brief Set the acceleration of a variable. If an unknown variable name is specified, an exception is thrown. */
   void setVariableAcceleration(const std::string &variable, double value)
@@ -416,6 +542,9 @@ public:
   /** \brief Set the effort of a set of variables. If unknown variable names are specified, an exception is thrown. */    
   void setVariableEffort(const std::vector<std::string>& variable_names, const std::vector<double>& variable_acceleration);
 
+  /** \brief Set the effort of a set of variables, given by their indices in the state. */
+  void setVariableEffort(const std::vector<int>& variable_indices, const std::vector<double>& variable_effort);
+
   /** \brief Set the effort of a variable. If an unknown variable name is specified, an exception is thrown. */  
   void setVariableEffort(const std::string &variable, double value)
   {
@@ -675,6 +804,28 @@ as the new values that correspond to the group */
                  const GroupStateValidityCallbackFn &constraint = GroupStateValidityCallbackFn(),
                  const kinematics::KinematicsQueryOptions &options = kinematics::KinematicsQueryOptions());
   
+  /** \brief Same as setFromIK(), but the attempts are processed concurrently by \e threads threads of the shared
+      moveit::tools::ThreadPool, each using its own solver instance leased from the group's solver pool (which grows
+      to \e threads instances if needed, so instances are reused by later calls). The first attempt is
+      seeded with the current state, the others with random states. If no \e cost function is given,
+      the first solution found is used and the remaining attempts are cancelled (queries in progress are
+      notified through KinematicsQueryOptions::cancel). Otherwise, all attempts are processed and the
+      solution of lowest cost is used. Each thread calls \e constraint and \e cost on its own copy of
+      this state. With fewer than two threads (or without a solver allocator), this is setFromIK().
+      @param pose The pose the \e tip link in the chain needs to achieve
+      @param tip The name of the frame for which IK is attempted.
+      @param threads The number of worker threads
+      @param attempts The number of times IK is attempted
+      @param timeout The timeout passed to the kinematics solver on each attempt
+      @param constraint A state validity constraint to be required for IK solutions
+      @param cost If specified, the function used to select among solutions */
+  bool setFromIKParallel(const JointModelGroup *group,
+                         const Eigen::Affine3d &pose, const std::string &tip,
+                         unsigned int threads, unsigned int attempts = 0, double timeout = 0.0,
+                         const GroupStateValidityCallbackFn &constraint = GroupStateValidityCallbackFn(),
+                         const GroupStateCostFn &cost = GroupStateCostFn(),
+                         const kinematics::KinematicsQueryOptions &options = kinematics::KinematicsQueryOptions());
+
   /** \brief  Warning: This function inefficiently copies all transforms around.
       If the group consists of a set of sub-groups that are each a chain and a solver
       is available for each sub-group, then the joint values can be set by computing inverse kinematics.
@@ -805,6 +956,30 @@ as the new values that correspond to the group */
                               const GroupStateValidityCallbackFn &validCallback = GroupStateValidityCallbackFn(),
                               const kinematics::KinematicsQueryOptions &options = kinematics::KinematicsQueryOptions());
 
+  /** \brief Same as computeCartesianPath() above, with the steps taken along the path specified by \e path_options.
+      In adaptive mode, \e jump_threshold is not used (see CartesianPathOptions::max_joint_step) and at the end of the
+      call the state of the group corresponds to the last state in \e traj. The states in \e traj take their memory from
+      the memory pool of this state, or from a pool created for this call if this state does not have one. */
+  double computeCartesianPath(const JointModelGroup *group, std::vector<RobotStatePtr> &traj, const LinkModel *link,
+                              const Eigen::Affine3d &target, bool global_reference_frame, double max_step, double jump_threshold,
+                              const CartesianPathOptions &path_options,
+                              const GroupStateValidityCallbackFn &validCallback = GroupStateValidityCallbackFn(),
+                              const kinematics::KinematicsQueryOptions &options = kinematics::KinematicsQueryOptions());
+
+  /** \brief Same as computeCartesianPath() above, with the steps taken along the path specified by \e path_options.
+      If CartesianPathOptions::threads is larger than 1 and the group has a solver allocator, the IK solutions at the
+      waypoints are computed first, each seeded with the solution at the previous waypoint, and the segments between
+      them are then solved concurrently on the shared moveit::tools::ThreadPool, each thread with its own solver instance
+      (leased from the group's solver pool, which grows to CartesianPathOptions::threads instances if needed) and its
+      own copy of this state.
+      A segment whose start does not match the end of the segment before it (the IK solutions took different branches)
+      is solved again, from the end of the previous segment. \e validCallback may be called concurrently. */
+  double computeCartesianPath(const JointModelGroup *group, std::vector<RobotStatePtr> &traj, const LinkModel *link,
+                              const EigenSTL::vector_Affine3d &waypoints, bool global_reference_frame, double max_step, double jump_threshold,
+                              const CartesianPathOptions &path_options,
+                              const GroupStateValidityCallbackFn &validCallback = GroupStateValidityCallbackFn(),
+                              const kinematics::KinematicsQueryOptions &options = kinematics::KinematicsQueryOptions());
+
   /** \brief Compute the Jacobian with reference to a particular point on a given link, for a specified group.
    * \param group The group to compute the Jacobian for 
    * \param link_name The name of the link
@@ -848,6 +1023,30 @@ as the new values that correspond to the group */
     updateLinkTransforms();
     return const_cast<const RobotState*>(this)->getJacobian(group, reference_point_position);
   }
+
+  /** \brief Compute the Jacobian for the group and link \e workspace was configured for, with reference to a point
+   * on that link. The result is stored in the workspace and no memory is allocated. See JacobianWorkspace.
+   * Using this function requires including moveit/robot_state/jacobian_workspace.h
+   * \param workspace The configured workspace the Jacobian is computed in
+   * \param reference_point_position The reference point position (with respect to the link of the workspace)
+   * \return True if jacobian was successfully computed, false otherwise
+   */
+  template<int DOF>
+  bool getJacobian(JacobianWorkspace<DOF> &workspace, const Eigen::Vector3d &reference_point_position = Eigen::Vector3d(0.0, 0.0, 0.0)) const;
+
+  /** \brief Compute the Jacobian for the group and link \e workspace was configured for, with reference to a point
+   * on that link. The result is stored in the workspace and no memory is allocated. See JacobianWorkspace.
+   * Using this function requires including moveit/robot_state/jacobian_workspace.h
+   * \param workspace The configured workspace the Jacobian is computed in
+   * \param reference_point_position The reference point position (with respect to the link of the workspace)
+   * \return True if jacobian was successfully computed, false otherwise
+   */
+  template<int DOF>
+  bool getJacobian(JacobianWorkspace<DOF> &workspace, const Eigen::Vector3d &reference_point_position = Eigen::Vector3d(0.0, 0.0, 0.0))
+  {
+    updateLinkTransforms();
+    return const_cast<const RobotState*>(this)->getJacobian(workspace, reference_point_position);
+  }
   
   /** \brief Given a twist for a particular link (\e tip), compute the corresponding velocity for every variable and store it in \e qdot */
   void computeVariableVelocity(const JointModelGroup *jmg, Eigen::VectorXd &qdot,
@@ -887,6 +1086,18 @@ as the new values that correspond to the group */
   void setToRandomPositionsNearBy(const JointModelGroup *group, const RobotState &near, double distance);
   void setToRandomPositionsNearBy(const JointModelGroup *group, const RobotState &near, const std::vector<double> &distances);
 
+  /** \brief Set the group to the state that corresponds to the next point of the low-discrepancy sequence \e sequence.
+      The dimension of the sequence must be group->getUnitSampleDimension(); return false otherwise. Consecutive calls
+      cover the space of the group more evenly than setToRandomPositions(). */
+  bool setToQuasiRandomPositions(const JointModelGroup *group, QuasiRandomSequence &sequence);
+
+  /** \brief Add \e samples random states of the group to the reachability map \e map: for each state, the pose of the tip
+      frame of the map is recorded in its base frame. States rejected by \e validity (e.g., states in collision) are not
+      recorded. The other variables are taken from this state, which is not modified. Returns the number of recorded states,
+      or 0 if the frames of the map are not known. */
+  std::size_t addToReachabilityMap(const JointModelGroup *group, ReachabilityMap &map, std::size_t samples,
+                                   const GroupStateValidityCallbackFn &validity = GroupStateValidityCallbackFn()) const;
+
   /** @} */
   
   /** \name Updating and getting transforms
@@ -897,7 +1108,8 @@ as the new values that correspond to the group */
       If updating link transforms or joint transorms is needed, the corresponding updates are also triggered. */
   void updateCollisionBodyTransforms();
   
-  /** \brief Update the reference frame transforms for links. This call is needed before using the transforms of links for coordinate transforms. */
+  /** \brief Update the reference frame transforms for links. This call is needed before using the transforms of links for coordinate transforms.
+      If a forward kinematics kernel is registered with the robot model (RobotModel::setForwardKinematicsKernel()), it computes the transforms. */
   void updateLinkTransforms();
   
   /** \brief Update all transforms. */
@@ -923,6 +1135,18 @@ as the new values that correspond to the group */
     return global_link_transforms_[link->getLinkIndex()];
   }
   
+  /** \brief Get the global transform of \e link, computing only the transforms of the links on the chain from the
+      root of the dirty subtree that includes \e link, instead of all the dirty links. The other links are left
+      dirty, and so is the state (see dirtyLinkTransforms()); a later update recomputes the chain again. This is
+      cheaper than getGlobalLinkTransform() when only one (or a few) links of a large dirty subtree are needed, e.g.,
+      the tip of a group after setting its joint values. Attached bodies are not updated. */
+  const Eigen::Affine3d& getGlobalLinkTransformFromChain(const LinkModel *link);
+
+  const Eigen::Affine3d& getGlobalLinkTransformFromChain(const std::string &link_name)
+  {
+    return getGlobalLinkTransformFromChain(robot_model_->getLinkModel(link_name));
+  }
+
   const Eigen::Affine3d& getCollisionBodyTransforms(const std::string &link_name, std::size_t index)
   {
     return getCollisionBodyTransform(robot_model_->getLinkModel(link_name), index);
@@ -945,7 +1169,7 @@ as the new values that correspond to the group */
     unsigned char &dirty = dirty_joint_transforms_[idx];
     if (dirty)
     {
-      joint->computeTransform(position_ + joint->getFirstVariableIndex(), variable_joint_transforms_[idx]);
+      computeJointTransform(joint, position_ + joint->getFirstVariableIndex(), variable_joint_transforms_[idx]);
       dirty = 0;
     }
     return variable_joint_transforms_[idx];
@@ -1152,6 +1376,26 @@ as the new values that correspond to the group */
   /** \brief Get all bodies attached to the model corresponding to this state */
   void getAttachedBodies(std::vector<const AttachedBody*> &attached_bodies) const;
 
+  /** \brief Check if any bodies are attached to this state */
+  bool hasAttachedBodies() const
+  {
+    return !attached_bodies_by_link_.empty();
+  }
+
+  /** \brief Get the number of bodies attached to this state */
+  std::size_t getAttachedBodyCount() const
+  {
+    return attached_bodies_by_link_.size();
+  }
+
+  /** \brief Get a number that changes every time bodies are attached to or detached from this state. Copies of
+      a state have the same version as the state they were copied from, and versions are never reused by
+      other changes, so two states with the same version have the same attached bodies */
+  boost::uint64_t getAttachedBodiesVersion() const
+  {
+    return attached_bodies_version_;
+  }
+
   /** \brief Get all bodies attached to a particular group the model corresponding to this state */
   void getAttachedBodies(std::vector<const AttachedBody*> &attached_bodies, const JointModelGroup *lm) const;
 
@@ -1179,24 +1423,35 @@ as the new values that correspond to the group */
   void setAttachedBodyUpdateCallback(const AttachedBodyCallback &callback);
   /** @} */
 
-  /** \brief Compute an axis-aligned bounding box that contains the current state. 
-      The format for \e aabb is (minx, miny, minz, maxx, maxy, maxz) */
+  /** \brief Compute an axis-aligned bounding box that contains the current state, attached bodies included.
+      The format for \e aabb is (minx, maxx, miny, maxy, minz, maxz) */
   void computeAABB(std::vector<double> &aabb) const;
 
-  /** \brief Compute an axis-aligned bounding box that contains the current state. 
-      The format for \e aabb is (minx, miny, minz, maxx, maxy, maxz) */
+  /** \brief Compute an axis-aligned bounding box that contains the current state, attached bodies included.
+      The format for \e aabb is (minx, maxx, miny, maxy, minz, maxz) */
   void computeAABB(std::vector<double> &aabb)
   {
     updateLinkTransforms();
     const_cast<const RobotState*>(this)->computeAABB(aabb);
   }
+
+  /** \brief Compute an axis-aligned bounding box that contains the links of \e group and the bodies attached to them.
+      The format for \e aabb is (minx, maxx, miny, maxy, minz, maxz) */
+  void computeAABB(const JointModelGroup *group, std::vector<double> &aabb) const;
+
+  /** \brief Compute an axis-aligned bounding box that contains the links of \e group and the bodies attached to them.
+      The format for \e aabb is (minx, maxx, miny, maxy, minz, maxz) */
+  void computeAABB(const JointModelGroup *group, std::vector<double> &aabb)
+  {
+    updateLinkTransforms();
+    const_cast<const RobotState*>(this)->computeAABB(group, aabb);
+  }
   
-  /** \brief Return the instance of a random number generator */
+  /** \brief Return the random number generator used for sampling this state. This is the generator of the
+      calling thread (see getThreadRandomNumberGenerator()); states do not allocate generators of their own. */
   random_numbers::RandomNumberGenerator& getRandomNumberGenerator()
   {
-    if (!rng_)
-      rng_ = new random_numbers::RandomNumberGenerator();
-    return *rng_;
+    return getThreadRandomNumberGenerator();
   }
 
   /** \brief Get the transformation matrix from the model frame to the frame identified by \e id */
@@ -1274,12 +1529,40 @@ private:
 
   void allocMemory();
 
-  void copyFrom(const RobotState &other);
+  /** \brief Add \e attached_body to the bodies of this state, replacing the entry for a body of the same name */
+  void addAttachedBody(AttachedBody *attached_body);
+
+  /** \brief Remove \e attached_body from attached_bodies_by_link_ (it is not deleted) */
+  void removeAttachedBodyFromLinkIndex(const AttachedBody *attached_body);
+
+  /** \brief Grow \e aabb to contain the geometry of \e link and the bodies attached to it */
+  void addLinkToAABB(const LinkModel *link, std::vector<double> &aabb) const;
+
+  /** \brief Get the range of attached_bodies_by_link_ with the bodies attached to \e link */
+  std::pair<std::vector<AttachedBody*>::const_iterator, std::vector<AttachedBody*>::const_iterator>
+  getAttachedBodyRange(const LinkModel *link) const;
+
+  /* compute the transform of a joint; revolute and prismatic joints, which most robots are made of, are
+     handled without a virtual call */
+  static void computeJointTransform(const JointModel *joint, const double *joint_values, Eigen::Affine3d &transf)
+  {
+    switch (joint->getType())
+    {
+    case JointModel::REVOLUTE:
+      static_cast<const RevoluteJointModel*>(joint)->RevoluteJointModel::computeTransform(joint_values, transf);
+      break;
+    case JointModel::PRISMATIC:
+      static_cast<const PrismaticJointModel*>(joint)->PrismaticJointModel::computeTransform(joint_values, transf);
+      break;
+    default:
+      joint->computeTransform(joint_values, transf);
+    }
+  }
   
   void markDirtyJointTransforms(const JointModel *joint)
   {
     dirty_joint_transforms_[joint->getJointIndex()] = 1;
-    dirty_link_transforms_ = dirty_link_transforms_ == NULL ? joint : robot_model_->getCommonRoot(dirty_link_transforms_, joint);
+    addDirtyRoot(joint, dirty_link_transforms_, dirty_link_roots_, dirty_link_root_count_);
   }
   
   void markDirtyJointTransforms(const JointModelGroup *group)
@@ -1287,8 +1570,20 @@ private:
     const std::vector<const JointModel*> &jm = group->getActiveJointModels();
     for (std::size_t i = 0 ; i < jm.size() ; ++i)
       dirty_joint_transforms_[jm[i]->getJointIndex()] = 1;
-    dirty_link_transforms_ = dirty_link_transforms_ == NULL ? group->getCommonRoot() : robot_model_->getCommonRoot(dirty_link_transforms_, group->getCommonRoot());
+    addDirtyRoot(group->getCommonRoot(), dirty_link_transforms_, dirty_link_roots_, dirty_link_root_count_);
   }
+
+  /** \brief Mark all link transforms as dirty */
+  void markAllDirtyLinkTransforms()
+  {
+    dirty_link_transforms_ = robot_model_->getRootJoint();
+    dirty_link_root_count_ = 0;
+  }
+
+  /** \brief Record that the subtree starting at \e joint is dirty. \e common is the common root of
+      everything that is dirty; \e roots holds the (disjoint) dirty subtrees, unless \e count is 0,
+      in which case the whole subtree of \e common is considered dirty. */
+  void addDirtyRoot(const JointModel *joint, const JointModel *&common, const JointModel **roots, unsigned char &count) const;
   
   void markVelocity();
   void markAcceleration();
@@ -1317,6 +1612,37 @@ private:
   }
   
   void updateLinkTransformsInternal(const JointModel *start);
+
+  /** \brief Compute the global transform of \e link from that of its parent link */
+  void updateLinkTransform(const LinkModel *link);
+
+  /** \brief Compute the global transforms of the links from \e top down to \e link, which descends from \e top */
+  void updateLinkTransformChain(const LinkModel *top, const LinkModel *link);
+
+  /** \brief Express \e pose, specified for frame \e tip in the model frame, as a query for \e solver:
+      the pose of the solver's tip frame in the solver's base frame. Returns false if this is not possible */
+  bool computeIKQuery(const kinematics::KinematicsBase &solver, const Eigen::Affine3d &pose, const std::string &tip,
+                      geometry_msgs::Pose &ik_query);
+
+  /** \brief The implementation of setFromIK() for a single pose, using \e solver instead of the group's solver instance */
+  bool setFromIKWithSolver(const kinematics::KinematicsBaseConstPtr &solver, const JointModelGroup *group,
+                           const Eigen::Affine3d &pose, const std::string &tip, const std::vector<double> &consistency_limits,
+                           unsigned int attempts, double timeout, const GroupStateValidityCallbackFn &constraint,
+                           const kinematics::KinematicsQueryOptions &options);
+
+  /** \brief Compute a Cartesian path from this state to \e target (in the model frame), using \e solver for IK and \e pool
+      for the states added to \e traj. */
+  double computeCartesianPathSegment(const JointModelGroup *group, std::vector<RobotStatePtr> &traj, const LinkModel *link,
+                                     const Eigen::Affine3d &target, double max_step, double jump_threshold,
+                                     const CartesianPathOptions &path_options, const kinematics::KinematicsBaseConstPtr &solver,
+                                     const RobotStateMemoryPoolPtr &pool, const GroupStateValidityCallbackFn &validCallback,
+                                     const kinematics::KinematicsQueryOptions &options);
+
+  /** \brief The segments of a Cartesian path that are solved concurrently */
+  struct CartesianPathSegments;
+
+  /** \brief Solve segments of \e segments until none are left, with the solver instance and the copy of the state of \e thread */
+  static void computeCartesianPathSegments(CartesianPathSegments *segments, std::size_t thread);
   
   void getMissingKeys(const std::map<std::string, double> &variable_map, std::vector<std::string> &missing_variables) const;
   void getStateTreeJointString(std::ostream& ss, const JointModel* jm, const std::string& pfx0, bool last) const;
@@ -1333,6 +1659,9 @@ private:
     
   RobotModelConstPtr                     robot_model_;
   void                                  *memory_;
+
+  /** \brief The pool \e memory_ was obtained from (NULL if it was allocated with malloc()) */
+  RobotStateMemoryPoolPtr                memory_pool_;
   
   double                                *position_;
   double                                *velocity_;
@@ -1342,8 +1671,19 @@ private:
   bool                                   has_acceleration_;
   bool                                   has_effort_;
   
+  /** \brief The maximum number of separate dirty subtrees that are tracked before falling back to their common root */
+  enum { MAX_DIRTY_ROOTS = 4 };
+
   const JointModel                      *dirty_link_transforms_;
   const JointModel                      *dirty_collision_body_transforms_;
+
+  /** \brief The disjoint subtrees whose link transforms are dirty; this allows updating only the
+      branches that changed (e.g., one arm of a dual arm robot), instead of the whole subtree of
+      \e dirty_link_transforms_ */
+  const JointModel                      *dirty_link_roots_[MAX_DIRTY_ROOTS];
+  unsigned char                          dirty_link_root_count_;
+  const JointModel                      *dirty_collision_body_roots_[MAX_DIRTY_ROOTS];
+  unsigned char                          dirty_collision_body_root_count_;
   
   Eigen::Affine3d                       *variable_joint_transforms_; // this points to an element in transforms_, so it is aligned 
   Eigen::Affine3d                       *global_link_transforms_;  // this points to an element in transforms_, so it is aligned 
@@ -1353,15 +1693,16 @@ private:
   /** \brief The attached bodies that are part of this state (from all links) */
   std::map<std::string, AttachedBody*>   attached_body_map_;
 
+  /** \brief The same attached bodies, sorted by the index of the link they are attached to. The bodies of a link are
+      found without looking at the others, and updating transforms does not walk the map. */
+  std::vector<AttachedBody*>             attached_bodies_by_link_;
+
+  /** \brief See getAttachedBodiesVersion() */
+  boost::uint64_t                        attached_bodies_version_;
+
   /** \brief This event is called when there is a change in the attached bodies for this state;
       The event specifies the body that changed and whether it was just attached or about to be detached. */
   AttachedBodyCallback                   attached_body_update_callback_;
-
-  /** \brief For certain operations a state needs a random number generator. However, it may be slightly expensive
-      to allocate the random number generator if many state instances are generated. For this reason, the generator
-      is allocated on a need basis, by the getRandomNumberGenerator() function. Never use the rng_ member directly, but call
-      getRandomNumberGenerator() instead. */
-  random_numbers::RandomNumberGenerator *rng_;
 };
 
 /** \brief Operator overload for printing variable bounds to a stream */
@@ -0,0 +1,149 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2013, Willow Garage, Inc.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of Willow Garage, Inc. nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+#ifndef MOVEIT_CORE_ROBOT_STATE_ROBOT_STATE_BATCH_
+#define MOVEIT_CORE_ROBOT_STATE_ROBOT_STATE_BATCH_
+
+#include <moveit/robot_state/robot_state.h>
+#include <vector>
+
+namespace moveit
+{
+namespace core
+{
+
+MOVEIT_CLASS_FORWARD(RobotStateBatch);
+
+/** \brief A set of robot states for which forward kinematics is computed together.
+
+    The variable positions are stored in structure-of-arrays layout: for each variable, the values
+    for all the states in the batch are contiguous. Forward kinematics traverses the kinematic tree
+    once and, for every link, computes the transforms of all states in tight loops over the states,
+    which the compiler can vectorize. This is meant for code that generates many states at once
+    (e.g., samplers or IK seeding), where computing FK one RobotState at a time is the bottleneck.
+
+    Only link transforms are computed; attached bodies and collision body transforms are not. */
+class RobotStateBatch
+{
+public:
+
+  /** \brief Construct a batch of \e count states for the model \e robot_model. The positions are set to the default values of the model. */
+  RobotStateBatch(const RobotModelConstPtr &robot_model, std::size_t count = 0);
+
+  const RobotModelConstPtr& getRobotModel() const
+  {
+    return robot_model_;
+  }
+
+  /** \brief The number of states in the batch */
+  std::size_t size() const
+  {
+    return count_;
+  }
+
+  /** \brief Change the number of states in the batch. Newly added states get the default values of the model. */
+  void resize(std::size_t count);
+
+  /** \brief Get the positions of the variable with index \e variable_index, for all the states in the batch (size() values).
+      Modifying the values requires a call to update() before link transforms are read again. */
+  double* getVariablePositions(std::size_t variable_index)
+  {
+    dirty_ = true;
+    return &positions_[variable_index * count_];
+  }
+
+  /** \brief Get the positions of the variable with index \e variable_index, for all the states in the batch (size() values). */
+  const double* getVariablePositions(std::size_t variable_index) const
+  {
+    return &positions_[variable_index * count_];
+  }
+
+  void setVariablePosition(std::size_t variable_index, std::size_t state_index, double value)
+  {
+    positions_[variable_index * count_ + state_index] = value;
+    dirty_ = true;
+  }
+
+  double getVariablePosition(std::size_t variable_index, std::size_t state_index) const
+  {
+    return positions_[variable_index * count_ + state_index];
+  }
+
+  /** \brief Copy the variable positions of \e state to the state with index \e state_index of the batch */
+  void setState(std::size_t state_index, const RobotState &state);
+
+  /** \brief Copy the variable positions of the state with index \e state_index of the batch to \e state */
+  void getState(std::size_t state_index, RobotState &state) const;
+
+  /** \brief Compute the link transforms for all states in the batch, if positions changed since the last call
+      (or always, if \e force is true). Values of mimic joints are updated from the joints they mimic. */
+  void update(bool force = false);
+
+  /** \brief Get the transform of \e link, for the state with index \e state_index. Requires update() to have been called. */
+  void getGlobalLinkTransform(const LinkModel *link, std::size_t state_index, Eigen::Affine3d &transform) const;
+
+  /** \brief Get the raw transform data of \e link. The data consists of 12 arrays of size() values each: the first nine
+      are the entries of the rotation matrix in column major order and the last three are the translation.
+      Requires update() to have been called. */
+  const double* getGlobalLinkTransformData(const LinkModel *link) const
+  {
+    assert(!dirty_);
+    return &link_transforms_[link->getLinkIndex() * 12 * count_];
+  }
+
+private:
+
+  void updateMimicJoints();
+  void computeJointTransforms(const JointModel *joint, double *joint_transform);
+
+  RobotModelConstPtr  robot_model_;
+  std::size_t         count_;
+
+  /** \brief Variable positions, indexed as [variable][state] */
+  std::vector<double> positions_;
+
+  /** \brief Link transforms, indexed as [link][element][state] */
+  std::vector<double> link_transforms_;
+
+  /** \brief Scratch space for computing the transforms of one joint, for all states */
+  std::vector<double> joint_transforms_;
+  std::vector<double> joint_values_;
+
+  bool                dirty_;
+};
+
+}
+}
+
+#endif
@@ -0,0 +1,143 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2013, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#ifndef MOVEIT_CORE_ROBOT_STATE_ROBOT_STATE_POSITIONS_
+#define MOVEIT_CORE_ROBOT_STATE_ROBOT_STATE_POSITIONS_
+
+#include <moveit/robot_state/robot_state.h>
+#include <cstddef>
+
+namespace moveit
+{
+namespace core
+{
+
+/** \brief A compact value type that holds only the variable positions of a robot state.
+
+    A RobotState also stores the joint, link and collision body transforms, which is several KB
+    for larger robots. Code that keeps very many states that only rarely need forward kinematics
+    (e.g., the vertices of a roadmap) can store them as RobotStatePositions instead, and convert to
+    a RobotState when the transforms are needed. Up to INLINE_CAPACITY values are stored inside the
+    object itself, so no memory is allocated for small groups; the robot model is not stored. */
+class RobotStatePositions
+{
+public:
+
+  /** \brief The number of values stored without allocating memory */
+  enum { INLINE_CAPACITY = 7 };
+
+  /** \brief Construct an empty set of positions */
+  RobotStatePositions();
+
+  /** \brief Construct \e size positions, all set to \e value */
+  explicit RobotStatePositions(std::size_t size, double value = 0.0);
+
+  /** \brief Copy the positions of all the variables of \e state */
+  explicit RobotStatePositions(const RobotState &state);
+
+  /** \brief Copy the positions of the variables of \e group, from \e state */
+  RobotStatePositions(const RobotState &state, const JointModelGroup *group);
+
+  RobotStatePositions(const RobotStatePositions &other);
+  ~RobotStatePositions();
+
+  RobotStatePositions& operator=(const RobotStatePositions &other);
+
+  /** \brief The number of values */
+  std::size_t size() const
+  {
+    return size_;
+  }
+
+  bool empty() const
+  {
+    return size_ == 0;
+  }
+
+  /** \brief Change the number of values; existing values are kept and new ones are set to 0 */
+  void resize(std::size_t size);
+
+  double* data()
+  {
+    return size_ > INLINE_CAPACITY ? storage_.heap_ : storage_.inline_;
+  }
+
+  const double* data() const
+  {
+    return size_ > INLINE_CAPACITY ? storage_.heap_ : storage_.inline_;
+  }
+
+  double& operator[](std::size_t index)
+  {
+    return data()[index];
+  }
+
+  double operator[](std::size_t index) const
+  {
+    return data()[index];
+  }
+
+  /** \brief Copy the positions of all the variables of \e state */
+  void setFromState(const RobotState &state);
+
+  /** \brief Copy the positions of the variables of \e group, from \e state */
+  void setFromState(const RobotState &state, const JointModelGroup *group);
+
+  /** \brief Set the positions of all the variables of \e state. Return false if the number of values does not match. */
+  bool copyToState(RobotState &state) const;
+
+  /** \brief Set the positions of the variables of \e group in \e state. Return false if the number of values does not match. */
+  bool copyToState(RobotState &state, const JointModelGroup *group) const;
+
+  /** \brief Exchange the values with the ones of \e other, without allocating memory */
+  void swap(RobotStatePositions &other);
+
+private:
+
+  /** \brief Make room for \e size values; the current values are not kept */
+  void allocate(std::size_t size);
+  void assign(const double *values, std::size_t size);
+
+  std::size_t size_;
+  union Storage
+  {
+    double  inline_[INLINE_CAPACITY];
+    double *heap_;
+  } storage_;
+};
+
+}
+}
+
+#endif
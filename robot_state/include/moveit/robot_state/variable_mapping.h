@@ -0,0 +1,121 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2013, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#ifndef MOVEIT_CORE_ROBOT_STATE_VARIABLE_MAPPING_
+#define MOVEIT_CORE_ROBOT_STATE_VARIABLE_MAPPING_
+
+#include <moveit/robot_state/robot_state.h>
+#include <sensor_msgs/JointState.h>
+
+namespace moveit
+{
+namespace core
+{
+
+/** \brief The indices in a robot state of a list of variable names, resolved once.
+
+    Setting values by name (e.g., from a sensor_msgs::JointState) looks up every name in the
+    robot model, on every call. When the same list of names is used repeatedly (messages
+    from the same source, the points of a trajectory), a VariableMapping constructed for that
+    list sets the values by index instead. Use matches() to check whether a message still has
+    the names the mapping was constructed for. */
+class VariableMapping
+{
+public:
+
+  /** \brief Construct an empty mapping */
+  VariableMapping();
+
+  /** \brief Construct the mapping for the variables \e names of \e robot_model. As for RobotModel::getVariableIndex(),
+      an exception is thrown for unknown variable names. */
+  VariableMapping(const RobotModelConstPtr &robot_model, const std::vector<std::string> &names);
+
+  const RobotModelConstPtr& getRobotModel() const
+  {
+    return robot_model_;
+  }
+
+  /** \brief The variable names the mapping was constructed for */
+  const std::vector<std::string>& getVariableNames() const
+  {
+    return names_;
+  }
+
+  /** \brief The index in the robot state of each of the variable names */
+  const std::vector<int>& getVariableIndices() const
+  {
+    return indices_;
+  }
+
+  std::size_t size() const
+  {
+    return indices_.size();
+  }
+
+  /** \brief Check if the mapping was constructed for \e robot_model and the list of variables \e names */
+  bool matches(const RobotModelConstPtr &robot_model, const std::vector<std::string> &names) const
+  {
+    return robot_model_ == robot_model && names_ == names;
+  }
+
+  /** \brief Set the positions of the mapped variables in \e state; \e values is in the order of the names of the mapping */
+  void setVariablePositions(RobotState &state, const std::vector<double> &values) const;
+
+  /** \brief Set the velocities of the mapped variables in \e state; \e values is in the order of the names of the mapping */
+  void setVariableVelocities(RobotState &state, const std::vector<double> &values) const;
+
+  /** \brief Set the accelerations of the mapped variables in \e state; \e values is in the order of the names of the mapping */
+  void setVariableAccelerations(RobotState &state, const std::vector<double> &values) const;
+
+  /** \brief Set the efforts of the mapped variables in \e state; \e values is in the order of the names of the mapping */
+  void setVariableEffort(RobotState &state, const std::vector<double> &values) const;
+
+  /** \brief Set the positions and velocities in \e msg to \e state, like RobotState::setVariableValues().
+      The names in \e msg must be the ones the mapping was constructed for. */
+  void setVariableValues(RobotState &state, const sensor_msgs::JointState &msg) const;
+
+  /** \brief Copy the positions of the mapped variables from \e state to \e values, in the order of the names of the mapping */
+  void copyVariablePositions(const RobotState &state, std::vector<double> &values) const;
+
+private:
+
+  RobotModelConstPtr       robot_model_;
+  std::vector<std::string> names_;
+  std::vector<int>         indices_;
+};
+
+}
+}
+
+#endif
@@ -35,6 +35,7 @@
 /* Author: Ioan Sucan */
 
 #include <moveit/robot_state/attached_body.h>
+#include <moveit/robot_model/aabb.h>
 
 moveit::core::AttachedBody::AttachedBody(const LinkModel *parent_link_model,
                                          const std::string &id,
@@ -42,52 +43,80 @@ moveit::core::AttachedBody::AttachedBody(const LinkModel *parent_link_model,
                                          const EigenSTL::vector_Affine3d &attach_trans,
                                          const std::set<std::string> &touch_links,
                                          const trajectory_msgs::JointTrajectory &detach_posture)
-  : parent_link_model_(parent_link_model)
-  , id_(id)
-  , shapes_(shapes)
-  , attach_trans_(attach_trans)
-  , touch_links_(touch_links)
-  , detach_posture_(detach_posture)
+  : data_(new Data())
 {
+  data_->parent_link_model_ = parent_link_model;
+  data_->id_ = id;
+  data_->shapes_ = shapes;
+  data_->attach_trans_ = attach_trans;
+  data_->touch_links_ = touch_links;
+  data_->detach_posture_ = detach_posture;
   global_collision_body_transforms_.resize(attach_trans.size());
   for(std::size_t i = 0 ; i < global_collision_body_transforms_.size() ; ++i)
     global_collision_body_transforms_[i].setIdentity();
+  updateShapeBoundingBoxes();
+}
+
+moveit::core::AttachedBody::AttachedBody(const AttachedBody &other)
+  : data_(other.data_)
+  , global_collision_body_transforms_(other.global_collision_body_transforms_)
+{
 }
 
 moveit::core::AttachedBody::~AttachedBody()
 {
 }
 
+moveit::core::AttachedBody::Data& moveit::core::AttachedBody::getMutableData()
+{
+  if (!data_.unique())
+    data_.reset(new Data(*data_));
+  return *data_;
+}
+
+void moveit::core::AttachedBody::updateShapeBoundingBoxes()
+{
+  Data &data = getMutableData();
+  data.shape_aabb_centers_.resize(data.shapes_.size());
+  data.shape_aabb_extents_.resize(data.shapes_.size());
+  for (std::size_t i = 0 ; i < data.shapes_.size() ; ++i)
+    computeShapeAABB(data.shapes_[i].get(), data.shape_aabb_centers_[i], data.shape_aabb_extents_[i]);
+}
+
 void moveit::core::AttachedBody::setScale(double scale)
 {
-  for (std::size_t i = 0 ; i < shapes_.size() ; ++i)
+  std::vector<shapes::ShapeConstPtr> &body_shapes = getMutableData().shapes_;
+  for (std::size_t i = 0 ; i < body_shapes.size() ; ++i)
   {
     // if this shape is only owned here (and because this is a non-const function), we can safely const-cast:
-    if (shapes_[i].unique())
-      const_cast<shapes::Shape*>(shapes_[i].get())->scale(scale);
+    if (body_shapes[i].unique())
+      const_cast<shapes::Shape*>(body_shapes[i].get())->scale(scale);
     else
     {
       // if the shape is owned elsewhere, we make a copy:
-      shapes::Shape *copy = shapes_[i]->clone();
+      shapes::Shape *copy = body_shapes[i]->clone();
       copy->scale(scale);
-      shapes_[i].reset(copy);
+      body_shapes[i].reset(copy);
     }
   }
+  updateShapeBoundingBoxes();
 }
 
 void moveit::core::AttachedBody::setPadding(double padding)
 {
-  for (std::size_t i = 0 ; i < shapes_.size() ; ++i)
+  std::vector<shapes::ShapeConstPtr> &body_shapes = getMutableData().shapes_;
+  for (std::size_t i = 0 ; i < body_shapes.size() ; ++i)
   {
     // if this shape is only owned here (and because this is a non-const function), we can safely const-cast:
-    if (shapes_[i].unique())
-      const_cast<shapes::Shape*>(shapes_[i].get())->padd(padding);
+    if (body_shapes[i].unique())
+      const_cast<shapes::Shape*>(body_shapes[i].get())->padd(padding);
     else
     {
       // if the shape is owned elsewhere, we make a copy:
-      shapes::Shape *copy = shapes_[i]->clone();
+      shapes::Shape *copy = body_shapes[i]->clone();
       copy->padd(padding);
-      shapes_[i].reset(copy);
+      body_shapes[i].reset(copy);
     }
   }
+  updateShapeBoundingBoxes();
 }
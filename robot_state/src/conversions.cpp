@@ -60,6 +60,27 @@ static bool _jointStateToRobotState(const sensor_msgs::JointState &joint_state,
     return false;
   }
   
+  // messages produced by robotStateToJointStateMsg() list the single-DOF joints of the model in order;
+  // for those the positions can be copied by index, without looking up every name
+  const std::vector<std::string> &model_names = state.getRobotModel()->getSingleDOFJointModelNames();
+  if (joint_state.name == model_names)
+  {
+    const std::vector<const JointModel*> &js = state.getRobotModel()->getSingleDOFJointModels();
+    for (std::size_t i = 0 ; i < js.size() ; ++i)
+      state.setJointPositions(js[i], &joint_state.position[i]);
+    if (joint_state.velocity.size() == js.size())
+      for (std::size_t i = 0 ; i < js.size() ; ++i)
+        state.setVariableVelocity(js[i]->getFirstVariableIndex(), joint_state.velocity[i]);
+    if (missing)
+    {
+      missing->clear();
+      const std::vector<const JointModel*> &mdof = state.getRobotModel()->getMultiDOFJointModels();
+      for (std::size_t i = 0 ; i < mdof.size() ; ++i)
+        missing->insert(mdof[i]->getVariableNames().begin(), mdof[i]->getVariableNames().end());
+    }
+    return true;
+  }
+  
   state.setVariableValues(joint_state);
   if (missing)
   {
@@ -132,23 +153,26 @@ static bool _multiDOFJointsToRobotState(const sensor_msgs::MultiDOFJointState &m
 static inline void _robotStateToMultiDOFJointState(const RobotState& state, sensor_msgs::MultiDOFJointState &mjs)
 {
   const std::vector<const JointModel*> &js = state.getRobotModel()->getMultiDOFJointModels();
-  mjs.joint_names.clear();
-  mjs.transforms.clear();
+  const std::vector<std::string> &names = state.getRobotModel()->getMultiDOFJointModelNames();
+  // keep the buffers of the message; the names only need to be copied the first time
+  if (mjs.joint_names != names)
+    mjs.joint_names = names;
+  mjs.transforms.resize(js.size());
+  mjs.twist.clear();
+  mjs.wrench.clear();
   for (std::size_t i = 0 ; i < js.size() ; ++i)
   {
-    geometry_msgs::Transform p;
     if (state.dirtyJointTransform(js[i]))
     {
       Eigen::Affine3d t;
       t.setIdentity();
       js[i]->computeTransform(state.getJointPositions(js[i]), t);
-      tf::transformEigenToMsg(t, p);
+      tf::transformEigenToMsg(t, mjs.transforms[i]);
     }
     else
-      tf::transformEigenToMsg(state.getJointTransform(js[i]), p);
-    mjs.joint_names.push_back(js[i]->getName());
-    mjs.transforms.push_back(p);
+      tf::transformEigenToMsg(state.getJointTransform(js[i]), mjs.transforms[i]);
   }
+  mjs.header = std_msgs::Header();
   mjs.header.frame_id = state.getRobotModel()->getModelFrame();
 }
 
@@ -404,6 +428,7 @@ void moveit::core::robotStateToRobotStateMsg(const RobotState& state, moveit_msg
 {
   robotStateToJointStateMsg(state, robot_state.joint_state);
   _robotStateToMultiDOFJointState(state, robot_state.multi_dof_joint_state);
+  robot_state.is_diff = false;
   if (copy_attached_bodies)
   {
     std::vector<const AttachedBody*> attached_bodies;
@@ -417,19 +442,63 @@ void moveit::core::robotStateToRobotStateMsg(const RobotState& state, moveit_msg
 void moveit::core::robotStateToJointStateMsg(const RobotState& state, sensor_msgs::JointState &joint_state)
 {
   const std::vector<const JointModel*> &js = state.getRobotModel()->getSingleDOFJointModels();
-  joint_state = sensor_msgs::JointState();
-  
+  const std::vector<std::string> &names = state.getRobotModel()->getSingleDOFJointModelNames();
+
+  // the message is filled in place so that its buffers are reused when it is converted to repeatedly;
+  // the names are only copied when the message did not already hold them
+  if (joint_state.name != names)
+    joint_state.name = names;
+  joint_state.position.resize(js.size());
   for (std::size_t i = 0 ; i < js.size() ; ++i)
+    joint_state.position[i] = state.getVariablePosition(js[i]->getFirstVariableIndex());
+  if (state.hasVelocities())
   {
-    joint_state.name.push_back(js[i]->getName());
-    joint_state.position.push_back(state.getVariablePosition(js[i]->getFirstVariableIndex()));
-    if (state.hasVelocities())
-      joint_state.velocity.push_back(state.getVariableVelocity(js[i]->getFirstVariableIndex()));
+    joint_state.velocity.resize(js.size());
+    for (std::size_t i = 0 ; i < js.size() ; ++i)
+      joint_state.velocity[i] = state.getVariableVelocity(js[i]->getFirstVariableIndex());
   }
-  
-  // if inconsistent number of velocities are specified, discard them
-  if (joint_state.velocity.size() != joint_state.position.size())
+  else
     joint_state.velocity.clear();
+  joint_state.effort.clear();
 
+  joint_state.header = std_msgs::Header();
   joint_state.header.frame_id = state.getRobotModel()->getModelFrame();
 }
+
+moveit::core::RobotStateMsgConverter::RobotStateMsgConverter()
+  : attached_bodies_version_(0)
+  , attached_bodies_valid_(false)
+{
+}
+
+const moveit_msgs::RobotState& moveit::core::RobotStateMsgConverter::convert(const RobotState& state, bool copy_attached_bodies)
+{
+  robotStateToJointStateMsg(state, msg_.joint_state);
+  _robotStateToMultiDOFJointState(state, msg_.multi_dof_joint_state);
+  msg_.is_diff = false;
+  if (copy_attached_bodies)
+  {
+    if (!attached_bodies_valid_ || attached_bodies_version_ != state.getAttachedBodiesVersion())
+    {
+      std::vector<const AttachedBody*> attached_bodies;
+      state.getAttachedBodies(attached_bodies);
+      msg_.attached_collision_objects.resize(attached_bodies.size());
+      for (std::size_t i = 0 ; i < attached_bodies.size() ; ++i)
+        _attachedBodyToMsg(*attached_bodies[i], msg_.attached_collision_objects[i]);
+      attached_bodies_version_ = state.getAttachedBodiesVersion();
+      attached_bodies_valid_ = true;
+    }
+  }
+  else
+  {
+    msg_.attached_collision_objects.clear();
+    attached_bodies_valid_ = false;
+  }
+  return msg_;
+}
+
+void moveit::core::RobotStateMsgConverter::reset()
+{
+  msg_ = moveit_msgs::RobotState();
+  attached_bodies_valid_ = false;
+}
@@ -0,0 +1,187 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2013, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#include <moveit/robot_state/diff_ik_workspace.h>
+#include <algorithm>
+#include <cmath>
+
+moveit::core::DiffIKWorkspace::DiffIKWorkspace()
+  : root_link_(NULL)
+  , max_damping_(0.05)
+  , manipulability_threshold_(0.01)
+  , joint_limit_gain_(0.5)
+  , twist_in_tip_frame_(false)
+  , manipulability_(0.0)
+  , damping_(0.0)
+{
+}
+
+moveit::core::DiffIKWorkspace::DiffIKWorkspace(const JointModelGroup *group, const LinkModel *link)
+  : root_link_(NULL)
+  , max_damping_(0.05)
+  , manipulability_threshold_(0.01)
+  , joint_limit_gain_(0.5)
+  , twist_in_tip_frame_(false)
+  , manipulability_(0.0)
+  , damping_(0.0)
+{
+  configure(group, link);
+}
+
+bool moveit::core::DiffIKWorkspace::configure(const JointModelGroup *group, const LinkModel *link)
+{
+  if (!jacobian_.configure(group, link))
+    return false;
+  root_link_ = group->getJointModels()[0]->getParentLinkModel();
+
+  const std::vector<std::string> &names = group->getVariableNames();
+  const std::size_t n = names.size();
+  variable_index_ = group->getVariableIndexList();
+  min_position_.setZero(n);
+  max_position_.setZero(n);
+  max_velocity_.setZero(n);
+  position_bounded_.assign(n, 0);
+  velocity_bounded_.assign(n, 0);
+  for (std::size_t i = 0 ; i < n ; ++i)
+  {
+    const VariableBounds &b = group->getParentModel().getVariableBounds(names[i]);
+    if (b.position_bounded_ && b.max_position_ > b.min_position_)
+    {
+      position_bounded_[i] = 1;
+      min_position_(i) = b.min_position_;
+      max_position_(i) = b.max_position_;
+    }
+    if (b.velocity_bounded_)
+    {
+      velocity_bounded_[i] = 1;
+      max_velocity_(i) = std::min(fabs(b.min_velocity_), fabs(b.max_velocity_));
+    }
+  }
+  qdot_.setZero(n);
+  secondary_.setZero(n);
+  positions_.setZero(n);
+  manipulability_ = 0.0;
+  damping_ = 0.0;
+  return true;
+}
+
+bool moveit::core::DiffIKWorkspace::computeVariableVelocity(const RobotState &state, const Twist &twist)
+{
+  if (!isConfigured())
+  {
+    logError("Differential IK workspace is not configured. Cannot compute variable velocity.");
+    return false;
+  }
+  if (!state.getJacobian(jacobian_))
+    return false;
+  const JacobianWorkspace<>::Jacobian &J = jacobian_.getJacobian();
+
+  // bring the twist to the frame of the Jacobian
+  if (twist_in_tip_frame_)
+  {
+    Eigen::Matrix3d r = state.getGlobalLinkTransform(jacobian_.getLink()).linear();
+    if (root_link_)
+      r = state.getGlobalLinkTransform(root_link_).linear().transpose() * r;
+    task_.head<3>() = r * twist.head<3>();
+    task_.tail<3>() = r * twist.tail<3>();
+  }
+  else
+    task_ = twist;
+
+  // all products are evaluated coefficient-wise; the general matrix product would allocate blocking buffers
+  jjt_ = J.lazyProduct(J.transpose());
+  double det = jjt_.determinant();
+  manipulability_ = det > 0.0 ? sqrt(det) : 0.0;
+  damping_ = manipulability_ < manipulability_threshold_ ? max_damping_ * (1.0 - manipulability_ / manipulability_threshold_) : 0.0;
+  jjt_.diagonal().array() += damping_ * damping_;
+  llt_.compute(jjt_);
+  if (llt_.info() != Eigen::Success)
+  {
+    // chains with fewer than 6 variables are always singular and need the full damping
+    damping_ = max_damping_;
+    jjt_ = J.lazyProduct(J.transpose());
+    jjt_.diagonal().array() += damping_ * damping_;
+    llt_.compute(jjt_);
+    if (llt_.info() != Eigen::Success)
+    {
+      logError("Singular Jacobian for group '%s' and no damping is set", jacobian_.getGroup()->getName().c_str());
+      qdot_.setZero();
+      return false;
+    }
+  }
+  y_ = llt_.solve(task_);
+  qdot_ = J.transpose().lazyProduct(y_);
+
+  // move the bounded variables towards the middle of their range, in the null space of the Jacobian
+  if (joint_limit_gain_ > 0.0)
+  {
+    for (std::size_t i = 0 ; i < position_bounded_.size() ; ++i)
+      if (position_bounded_[i])
+        secondary_(i) = joint_limit_gain_ * (min_position_(i) + max_position_(i) - 2.0 * state.getVariablePosition(variable_index_[i])) /
+          (max_position_(i) - min_position_(i));
+      else
+        secondary_(i) = 0.0;
+    task_ = J.lazyProduct(secondary_);
+    y_ = llt_.solve(task_);
+    qdot_ += secondary_;
+    qdot_ -= J.transpose().lazyProduct(y_);
+  }
+
+  // scale the velocity uniformly, so the direction of motion is preserved
+  double scale = 1.0;
+  for (std::size_t i = 0 ; i < velocity_bounded_.size() ; ++i)
+    if (velocity_bounded_[i])
+    {
+      double v = fabs(qdot_(i));
+      if (v * scale > max_velocity_(i))
+        scale = max_velocity_(i) / v;
+    }
+  if (scale < 1.0)
+    qdot_ *= scale;
+  return true;
+}
+
+bool moveit::core::DiffIKWorkspace::setFromDiffIK(RobotState &state, const Twist &twist, double dt)
+{
+  state.updateLinkTransforms();
+  if (!computeVariableVelocity(state, twist))
+    return false;
+  for (std::size_t i = 0 ; i < variable_index_.size() ; ++i)
+    positions_(i) = state.getVariablePosition(variable_index_[i]) + dt * qdot_(i);
+  const JointModelGroup *group = jacobian_.getGroup();
+  state.setJointGroupPositions(group, positions_.data());
+  state.enforceBounds(group);
+  state.updateLinkTransforms();
+  return true;
+}
@@ -36,12 +36,105 @@
 /* Author: Ioan Sucan, Sachin Chitta, Acorn Pooley, Mario Prats */
 
 #include <moveit/robot_state/robot_state.h>
+#include <moveit/robot_model/aabb.h>
 #include <moveit/transforms/transforms.h>
 #include <geometric_shapes/shape_operations.h>
 #include <eigen_conversions/eigen_msg.h>
 #include <moveit/backtrace/backtrace.h>
 #include <moveit/profiler/profiler.h>
+#include <moveit/profiler/memory_accounting.h>
+#include <moveit/background_processing/thread_pool.h>
 #include <boost/bind.hpp>
+#include <boost/thread.hpp>
+#include <boost/math/constants/constants.hpp>
+
+namespace moveit
+{
+namespace core
+{
+namespace
+{
+
+int getDirtyJointTransformsDoubleCount(const RobotModel &robot_model)
+{
+  return 1 + robot_model.getJointModelCount() / (sizeof(double)/sizeof(unsigned char));
+}
+
+std::size_t getMemoryBlockSize(const RobotModel &robot_model)
+{
+  return sizeof(Eigen::Affine3d) * (robot_model.getJointModelCount() + robot_model.getLinkModelCount() + robot_model.getLinkGeometryCount())
+    + sizeof(double) * (robot_model.getVariableCount() * 3 + getDirtyJointTransformsDoubleCount(robot_model)) + 15;
+}
+
+// attached body versions are unique in the process, so equal versions of two states imply equal attached bodies
+boost::mutex attached_bodies_version_lock;
+boost::uint64_t attached_bodies_version_counter = 0;
+
+boost::uint64_t newAttachedBodiesVersion()
+{
+  boost::mutex::scoped_lock slock(attached_bodies_version_lock);
+  return ++attached_bodies_version_counter;
+}
+
+}
+}
+}
+
+moveit::core::RobotStateMemoryPool::RobotStateMemoryPool(const RobotModelConstPtr &robot_model, std::size_t max_cached_blocks)
+  : robot_model_(robot_model)
+  , block_size_(getMemoryBlockSize(*robot_model))
+  , max_cached_blocks_(max_cached_blocks)
+{
+}
+
+moveit::core::RobotStateMemoryPool::~RobotStateMemoryPool()
+{
+  clear();
+}
+
+void* moveit::core::RobotStateMemoryPool::allocate()
+{
+  {
+    boost::mutex::scoped_lock slock(lock_);
+    if (!free_blocks_.empty())
+    {
+      void *block = free_blocks_.back();
+      free_blocks_.pop_back();
+      return block;
+    }
+  }
+  moveit::tools::MemoryAccounting::Add(moveit::tools::MemoryAccounting::ROBOT_STATE, block_size_);
+  return malloc(block_size_);
+}
+
+void moveit::core::RobotStateMemoryPool::release(void *block)
+{
+  {
+    boost::mutex::scoped_lock slock(lock_);
+    if (free_blocks_.size() < max_cached_blocks_)
+    {
+      free_blocks_.push_back(block);
+      return;
+    }
+  }
+  moveit::tools::MemoryAccounting::Release(moveit::tools::MemoryAccounting::ROBOT_STATE, block_size_);
+  free(block);
+}
+
+void moveit::core::RobotStateMemoryPool::clear()
+{
+  boost::mutex::scoped_lock slock(lock_);
+  for (std::size_t i = 0 ; i < free_blocks_.size() ; ++i)
+    free(free_blocks_[i]);
+  moveit::tools::MemoryAccounting::Release(moveit::tools::MemoryAccounting::ROBOT_STATE, block_size_ * free_blocks_.size());
+  free_blocks_.clear();
+}
+
+std::size_t moveit::core::RobotStateMemoryPool::getCachedBlockCount() const
+{
+  boost::mutex::scoped_lock slock(lock_);
+  return free_blocks_.size();
+}
 
 moveit::core::RobotState::RobotState(const RobotModelConstPtr &robot_model)
   : robot_model_(robot_model)
@@ -50,37 +143,76 @@ moveit::core::RobotState::RobotState(const RobotModelConstPtr &robot_model)
   , has_effort_(false)
   , dirty_link_transforms_(robot_model_->getRootJoint())
   , dirty_collision_body_transforms_(NULL)
-  , rng_(NULL)
+  , dirty_link_root_count_(0)
+  , dirty_collision_body_root_count_(0)
+  , attached_bodies_version_(0)
 {
   allocMemory();
   
   // all transforms are dirty initially
-  const int nr_doubles_for_dirty_joint_transforms = 1 + robot_model_->getJointModelCount() / (sizeof(double)/sizeof(unsigned char));
+  const int nr_doubles_for_dirty_joint_transforms = getDirtyJointTransformsDoubleCount(*robot_model_);
+  memset(dirty_joint_transforms_, 1, sizeof(double) * nr_doubles_for_dirty_joint_transforms);
+}
+
+moveit::core::RobotState::RobotState(const RobotStateMemoryPoolPtr &memory_pool)
+  : robot_model_(memory_pool->getRobotModel())
+  , memory_pool_(memory_pool)
+  , has_velocity_(false)
+  , has_acceleration_(false)
+  , has_effort_(false)
+  , dirty_link_transforms_(robot_model_->getRootJoint())
+  , dirty_collision_body_transforms_(NULL)
+  , dirty_link_root_count_(0)
+  , dirty_collision_body_root_count_(0)
+  , attached_bodies_version_(0)
+{
+  allocMemory();
+
+  // all transforms are dirty initially
+  const int nr_doubles_for_dirty_joint_transforms = getDirtyJointTransformsDoubleCount(*robot_model_);
   memset(dirty_joint_transforms_, 1, sizeof(double) * nr_doubles_for_dirty_joint_transforms);
 }
 
 moveit::core::RobotState::RobotState(const RobotState &other)
-  : rng_(NULL)
 {
   robot_model_ = other.robot_model_;
+  memory_pool_ = other.memory_pool_;
   allocMemory();
   copyFrom(other);
 }
 
+moveit::core::RobotState::RobotState(const RobotState &other, CopyMode mode)
+{
+  robot_model_ = other.robot_model_;
+  memory_pool_ = other.memory_pool_;
+  allocMemory();
+  copyFrom(other, mode);
+}
+
 moveit::core::RobotState::~RobotState()
 {
-  free(memory_);
-  if (rng_)
-    delete rng_;
+  if (memory_pool_)
+    memory_pool_->release(memory_);
+  else
+  {
+    // blocks of a memory pool are accounted for by the pool
+    moveit::tools::MemoryAccounting::Release(moveit::tools::MemoryAccounting::ROBOT_STATE, getMemoryBlockSize(*robot_model_));
+    free(memory_);
+  }
 }
 
 void moveit::core::RobotState::allocMemory(void)
 {
   // memory for the dirty joint transforms
-  const int nr_doubles_for_dirty_joint_transforms = 1 + robot_model_->getJointModelCount() / (sizeof(double)/sizeof(unsigned char));
-  const size_t bytes = sizeof(Eigen::Affine3d) * (robot_model_->getJointModelCount() + robot_model_->getLinkModelCount() + robot_model_->getLinkGeometryCount())
-    + sizeof(double) * (robot_model_->getVariableCount() * 3 + nr_doubles_for_dirty_joint_transforms) + 15;
-  memory_ = malloc(bytes);
+  const int nr_doubles_for_dirty_joint_transforms = getDirtyJointTransformsDoubleCount(*robot_model_);
+  if (memory_pool_)
+    memory_ = memory_pool_->allocate();
+  else
+  {
+    const std::size_t block_size = getMemoryBlockSize(*robot_model_);
+    moveit::tools::MemoryAccounting::Add(moveit::tools::MemoryAccounting::ROBOT_STATE, block_size);
+    memory_ = malloc(block_size);
+  }
 
   // make the memory for transforms align at 16 bytes
   variable_joint_transforms_ = reinterpret_cast<Eigen::Affine3d*>(((uintptr_t)memory_ + 15) & ~ (uintptr_t)0x0F);
@@ -100,40 +232,101 @@ moveit::core::RobotState& moveit::core::RobotState::operator=(const RobotState &
   return *this;
 }
 
-void moveit::core::RobotState::copyFrom(const RobotState &other)
+void moveit::core::RobotState::copyFrom(const RobotState &other, CopyMode mode)
 {
-  has_velocity_ = other.has_velocity_;
-  has_acceleration_ = other.has_acceleration_;
-  has_effort_ = other.has_effort_;
-  
-  dirty_collision_body_transforms_ = other.dirty_collision_body_transforms_;
-  dirty_link_transforms_ = other.dirty_link_transforms_;
+  if (this == &other)
+    return;
+  if (robot_model_ != other.robot_model_)
+  {
+    logError("Cannot copy a state of robot model '%s' to a state of robot model '%s'",
+             other.robot_model_->getName().c_str(), robot_model_->getName().c_str());
+    return;
+  }
 
-  if (dirty_link_transforms_ == robot_model_->getRootJoint())
+  if (mode == COPY_POSITIONS)
   {
-    // everything is dirty; no point in copying transforms; copy positions, potentially velocity & acceleration
+    has_velocity_ = false;
+    has_acceleration_ = false;
+    has_effort_ = false;
+  }
+  else
+  {
+    has_velocity_ = other.has_velocity_;
+    has_acceleration_ = other.has_acceleration_;
+    has_effort_ = other.has_effort_;
+  }
+  
+  if (mode != COPY_FULL || other.dirty_link_transforms_ == robot_model_->getRootJoint())
+  {
+    // everything is (or will be) dirty; no point in copying transforms; copy positions, potentially velocity & acceleration
     memcpy(position_, other.position_, robot_model_->getVariableCount() * sizeof(double) *
            (1 + ((has_velocity_ || has_acceleration_ || has_effort_) ? 1 : 0) + ((has_acceleration_ || has_effort_) ? 1 : 0)));
     
     // mark all transforms as dirty
-    const int nr_doubles_for_dirty_joint_transforms = 1 + robot_model_->getJointModelCount() / (sizeof(double)/sizeof(unsigned char));
+    const int nr_doubles_for_dirty_joint_transforms = getDirtyJointTransformsDoubleCount(*robot_model_);
     memset(dirty_joint_transforms_, 1, sizeof(double) * nr_doubles_for_dirty_joint_transforms);
+    dirty_link_transforms_ = robot_model_->getRootJoint();
+    dirty_collision_body_transforms_ = NULL;
+    dirty_link_root_count_ = 0;
+    dirty_collision_body_root_count_ = 0;
   }
   else
   {
+    dirty_collision_body_transforms_ = other.dirty_collision_body_transforms_;
+    dirty_link_transforms_ = other.dirty_link_transforms_;
+    dirty_link_root_count_ = other.dirty_link_root_count_;
+    dirty_collision_body_root_count_ = other.dirty_collision_body_root_count_;
+    std::copy(other.dirty_link_roots_, other.dirty_link_roots_ + dirty_link_root_count_, dirty_link_roots_);
+    std::copy(other.dirty_collision_body_roots_, other.dirty_collision_body_roots_ + dirty_collision_body_root_count_, dirty_collision_body_roots_);
+
     // copy all the memory; maybe avoid copying velocity and acceleration if possible
-    const int nr_doubles_for_dirty_joint_transforms = 1 + robot_model_->getJointModelCount() / (sizeof(double)/sizeof(unsigned char));
+    const int nr_doubles_for_dirty_joint_transforms = getDirtyJointTransformsDoubleCount(*robot_model_);
     const size_t bytes = sizeof(Eigen::Affine3d) * (robot_model_->getJointModelCount() + robot_model_->getLinkModelCount() + robot_model_->getLinkGeometryCount())
       + sizeof(double) * (robot_model_->getVariableCount() * (1 + ((has_velocity_ || has_acceleration_ || has_effort_) ? 1 : 0) +
                                                               ((has_acceleration_ || has_effort_ ) ? 1 : 0)) + nr_doubles_for_dirty_joint_transforms);
     memcpy(variable_joint_transforms_, other.variable_joint_transforms_, bytes);
   }
   
-  // copy attached bodies
+  // copy attached bodies; their description is shared with the bodies of \e other, and their transforms are
+  // up to date unless the link transforms are dirty, in which case they are recomputed with the links
   clearAttachedBodies();
-  for (std::map<std::string, AttachedBody*>::const_iterator it = other.attached_body_map_.begin() ; it != other.attached_body_map_.end() ; ++it)
-    attachBody(it->second->getName(), it->second->getShapes(), it->second->getFixedTransforms(),
-               it->second->getTouchLinks(), it->second->getAttachedLinkName(), it->second->getDetachPosture());
+  for (std::size_t i = 0 ; i < other.attached_bodies_by_link_.size() ; ++i)
+  {
+    AttachedBody *ab = new AttachedBody(*other.attached_bodies_by_link_[i]);
+    addAttachedBody(ab);
+    if (attached_body_update_callback_)
+      attached_body_update_callback_(ab, true);
+  }
+  attached_bodies_version_ = other.attached_bodies_version_;
+}
+
+void moveit::core::RobotState::swap(RobotState &other)
+{
+  // the pointers into the memory block move with the block, so they remain valid
+  robot_model_.swap(other.robot_model_);
+  std::swap(memory_, other.memory_);
+  memory_pool_.swap(other.memory_pool_);
+  std::swap(position_, other.position_);
+  std::swap(velocity_, other.velocity_);
+  std::swap(acceleration_, other.acceleration_);
+  std::swap(effort_, other.effort_);
+  std::swap(has_velocity_, other.has_velocity_);
+  std::swap(has_acceleration_, other.has_acceleration_);
+  std::swap(has_effort_, other.has_effort_);
+  std::swap(dirty_link_transforms_, other.dirty_link_transforms_);
+  std::swap(dirty_collision_body_transforms_, other.dirty_collision_body_transforms_);
+  std::swap_ranges(dirty_link_roots_, dirty_link_roots_ + MAX_DIRTY_ROOTS, other.dirty_link_roots_);
+  std::swap(dirty_link_root_count_, other.dirty_link_root_count_);
+  std::swap_ranges(dirty_collision_body_roots_, dirty_collision_body_roots_ + MAX_DIRTY_ROOTS, other.dirty_collision_body_roots_);
+  std::swap(dirty_collision_body_root_count_, other.dirty_collision_body_root_count_);
+  std::swap(variable_joint_transforms_, other.variable_joint_transforms_);
+  std::swap(global_link_transforms_, other.global_link_transforms_);
+  std::swap(global_collision_body_transforms_, other.global_collision_body_transforms_);
+  std::swap(dirty_joint_transforms_, other.dirty_joint_transforms_);
+  attached_body_map_.swap(other.attached_body_map_);
+  attached_bodies_by_link_.swap(other.attached_bodies_by_link_);
+  std::swap(attached_bodies_version_, other.attached_bodies_version_);
+  attached_body_update_callback_.swap(other.attached_body_update_callback_);
 }
 
 bool moveit::core::RobotState::checkJointTransforms(const JointModel *joint) const
@@ -200,7 +393,7 @@ void moveit::core::RobotState::setToRandomPositions()
   random_numbers::RandomNumberGenerator &rng = getRandomNumberGenerator();
   robot_model_->getVariableRandomPositions(rng, position_);
   memset(dirty_joint_transforms_, 1, robot_model_->getJointModelCount() * sizeof(unsigned char));
-  dirty_link_transforms_ = robot_model_->getRootJoint();
+  markAllDirtyLinkTransforms();
   // mimic values are correctly set in RobotModel
 }
 
@@ -216,6 +409,54 @@ void moveit::core::RobotState::setToRandomPositions(const JointModelGroup *group
   markDirtyJointTransforms(group);
 }
 
+bool moveit::core::RobotState::setToQuasiRandomPositions(const JointModelGroup *group, QuasiRandomSequence &sequence)
+{
+  if (sequence.getDimension() != group->getUnitSampleDimension())
+  {
+    logError("Quasi-random sequence of dimension %u cannot be used for group '%s', which needs dimension %u",
+             sequence.getDimension(), group->getName().c_str(), group->getUnitSampleDimension());
+    return false;
+  }
+  std::vector<double> sample;
+  sequence.next(sample);
+  const std::vector<const JointModel*> &joints = group->getActiveJointModels();
+  const double *s = sample.empty() ? NULL : &sample[0];
+  for (std::size_t i = 0 ; i < joints.size() ; ++i)
+  {
+    joints[i]->getVariablePositionsFromUnitSample(s, position_ + joints[i]->getFirstVariableIndex());
+    s += joints[i]->getUnitSampleDimension();
+  }
+  updateMimicJoint(group->getMimicJointModels());
+  markDirtyJointTransforms(group);
+  return true;
+}
+
+std::size_t moveit::core::RobotState::addToReachabilityMap(const JointModelGroup *group, ReachabilityMap &map, std::size_t samples,
+                                                            const GroupStateValidityCallbackFn &validity) const
+{
+  if (!knowsFrameTransform(map.getBaseFrame()) || !knowsFrameTransform(map.getTipFrame()))
+  {
+    logError("Frames '%s' and '%s' of the reachability map are not known", map.getBaseFrame().c_str(), map.getTipFrame().c_str());
+    return 0;
+  }
+  RobotState state(*this);
+  std::vector<double> values;
+  std::size_t recorded = 0;
+  for (std::size_t i = 0 ; i < samples ; ++i)
+  {
+    state.setToRandomPositions(group);
+    if (validity)
+    {
+      state.copyJointGroupPositions(group, values);
+      if (!validity(&state, group, &values[0]))
+        continue;
+    }
+    map.insert(state.getFrameTransform(map.getBaseFrame()).inverse() * state.getFrameTransform(map.getTipFrame()));
+    recorded++;
+  }
+  return recorded;
+}
+
 void moveit::core::RobotState::setToRandomPositionsNearBy(const JointModelGroup *group, const RobotState &near, const std::vector<double> &distances)
 {
   // we do not make calls to RobotModel for random number generation because mimic joints
@@ -261,7 +502,7 @@ void moveit::core::RobotState::setToDefaultValues()
   // set velocity & acceleration to 0
   memset(velocity_, 0, sizeof(double) * 2 * robot_model_->getVariableCount());
   memset(dirty_joint_transforms_, 1, robot_model_->getJointModelCount() * sizeof(unsigned char));
-  dirty_link_transforms_ = robot_model_->getRootJoint();
+  markAllDirtyLinkTransforms();
 }
 
 void moveit::core::RobotState::setVariablePositions(const double *position)
@@ -273,7 +514,7 @@ void moveit::core::RobotState::setVariablePositions(const double *position)
   
   // Since all joint values have potentially changed, we will need to recompute all transforms
   memset(dirty_joint_transforms_, 1, robot_model_->getJointModelCount() * sizeof(unsigned char));
-  dirty_link_transforms_ = robot_model_->getRootJoint();
+  markAllDirtyLinkTransforms();
 }
 
 void moveit::core::RobotState::setVariablePositions(const std::map<std::string, double> &variable_map)
@@ -316,6 +557,19 @@ void moveit::core::RobotState::setVariablePositions(const std::vector<std::strin
   }
 }
 
+void moveit::core::RobotState::setVariablePositions(const std::vector<int>& variable_indices, const std::vector<double>& variable_position)
+{
+  assert(variable_indices.size() == variable_position.size());
+  for (std::size_t i = 0 ; i < variable_indices.size() ; ++i)
+  {
+    const int index = variable_indices[i];
+    position_[index] = variable_position[i];
+    const JointModel *jm = robot_model_->getJointOfVariable(index);
+    markDirtyJointTransforms(jm);
+    updateMimicJoint(jm);
+  }
+}
+
 void moveit::core::RobotState::setVariableVelocities(const std::map<std::string, double> &variable_map)
 {
   markVelocity();
@@ -337,6 +591,14 @@ void moveit::core::RobotState::setVariableVelocities(const std::vector<std::stri
     velocity_[robot_model_->getVariableIndex(variable_names[i])] = variable_velocity[i];  
 }
 
+void moveit::core::RobotState::setVariableVelocities(const std::vector<int>& variable_indices, const std::vector<double>& variable_velocity)
+{
+  markVelocity();
+  assert(variable_indices.size() == variable_velocity.size());
+  for (std::size_t i = 0 ; i < variable_indices.size() ; ++i)
+    velocity_[variable_indices[i]] = variable_velocity[i];
+}
+
 void moveit::core::RobotState::setVariableAccelerations(const std::map<std::string, double> &variable_map)
 {
   markAcceleration();
@@ -358,6 +620,14 @@ void moveit::core::RobotState::setVariableAccelerations(const std::vector<std::s
     acceleration_[robot_model_->getVariableIndex(variable_names[i])] = variable_acceleration[i];  
 }
 
+void moveit::core::RobotState::setVariableAccelerations(const std::vector<int>& variable_indices, const std::vector<double>& variable_acceleration)
+{
+  markAcceleration();
+  assert(variable_indices.size() == variable_acceleration.size());
+  for (std::size_t i = 0 ; i < variable_indices.size() ; ++i)
+    acceleration_[variable_indices[i]] = variable_acceleration[i];
+}
+
 void moveit::core::RobotState::setVariableEffort(const std::map<std::string, double> &variable_map)
 {
   markEffort();
@@ -379,6 +649,14 @@ void moveit::core::RobotState::setVariableEffort(const std::vector<std::string>&
     effort_[robot_model_->getVariableIndex(variable_names[i])] = variable_effort[i];  
 }
 
+void moveit::core::RobotState::setVariableEffort(const std::vector<int>& variable_indices, const std::vector<double>& variable_effort)
+{
+  markEffort();
+  assert(variable_indices.size() == variable_effort.size());
+  for (std::size_t i = 0 ; i < variable_indices.size() ; ++i)
+    effort_[variable_indices[i]] = variable_effort[i];
+}
+
 void moveit::core::RobotState::setJointGroupPositions(const JointModelGroup *group, const double *gstate)
 {
   const std::vector<int> &il = group->getVariableIndexList();
@@ -426,7 +704,7 @@ void moveit::core::RobotState::update(bool force)
   if (force)
   {
     memset(dirty_joint_transforms_, 1, robot_model_->getJointModelCount() * sizeof(unsigned char));
-    dirty_link_transforms_ = robot_model_->getRootJoint();
+    markAllDirtyLinkTransforms();
   }
   
   // this actually triggers all needed updates
@@ -440,18 +718,23 @@ void moveit::core::RobotState::updateCollisionBodyTransforms()
   
   if (dirty_collision_body_transforms_ != NULL)
   {
-    const std::vector<const LinkModel*> &links = dirty_collision_body_transforms_->getDescendantLinkModels();
-    dirty_collision_body_transforms_ = NULL; 
-
-    for (std::size_t i = 0 ; i < links.size() ; ++i)
+    const JointModel * const *roots = dirty_collision_body_root_count_ > 0 ? dirty_collision_body_roots_ : &dirty_collision_body_transforms_;
+    const std::size_t root_count = dirty_collision_body_root_count_ > 0 ? dirty_collision_body_root_count_ : 1;
+    for (std::size_t r = 0 ; r < root_count ; ++r)
     {
-      const EigenSTL::vector_Affine3d &ot = links[i]->getCollisionOriginTransforms();
-      const std::vector<int> &ot_id = links[i]->areCollisionOriginTransformsIdentity();
-      const int index_co = links[i]->getFirstCollisionBodyTransformIndex();
-      const int index_l = links[i]->getLinkIndex();
-      for (std::size_t j = 0 ; j < ot.size() ; ++j)
-        global_collision_body_transforms_[index_co + j].matrix().noalias() = ot_id[j] ? global_link_transforms_[index_l].matrix() : global_link_transforms_[index_l].matrix() * ot[j].matrix();
+      const std::vector<const LinkModel*> &links = roots[r]->getDescendantLinkModels();
+      for (std::size_t i = 0 ; i < links.size() ; ++i)
+      {
+        const EigenSTL::vector_Affine3d &ot = links[i]->getCollisionOriginTransforms();
+        const std::vector<int> &ot_id = links[i]->areCollisionOriginTransformsIdentity();
+        const int index_co = links[i]->getFirstCollisionBodyTransformIndex();
+        const int index_l = links[i]->getLinkIndex();
+        for (std::size_t j = 0 ; j < ot.size() ; ++j)
+          global_collision_body_transforms_[index_co + j].matrix().noalias() = ot_id[j] ? global_link_transforms_[index_l].matrix() : global_link_transforms_[index_l].matrix() * ot[j].matrix();
+      }
     }
+    dirty_collision_body_transforms_ = NULL;
+    dirty_collision_body_root_count_ = 0;
   }
 }
 
@@ -459,71 +742,142 @@ void moveit::core::RobotState::updateLinkTransforms()
 {
   if (dirty_link_transforms_ != NULL)
   {
-    updateLinkTransformsInternal(dirty_link_transforms_);
-    if (dirty_collision_body_transforms_)
-      dirty_collision_body_transforms_ = robot_model_->getCommonRoot(dirty_collision_body_transforms_, dirty_link_transforms_);
+    MOVEIT_CORE_PROBE("RobotState::updateLinkTransforms");
+    // a registered kernel computes all the link transforms at once; those outside the dirty subtrees do not change,
+    // so only the collision bodies of the dirty subtrees need an update
+    const ForwardKinematicsFunction fk = robot_model_->getForwardKinematicsKernel().function;
+    if (fk)
+    {
+      fk(position_, global_link_transforms_);
+      for (std::size_t i = 0 ; i < attached_bodies_by_link_.size() ; ++i)
+        attached_bodies_by_link_[i]->computeTransform(global_link_transforms_[attached_bodies_by_link_[i]->getAttachedLink()->getLinkIndex()]);
+    }
+
+    if (dirty_link_root_count_ > 0)
+      for (unsigned char r = 0 ; r < dirty_link_root_count_ ; ++r)
+      {
+        if (!fk)
+          updateLinkTransformsInternal(dirty_link_roots_[r]);
+        addDirtyRoot(dirty_link_roots_[r], dirty_collision_body_transforms_, dirty_collision_body_roots_, dirty_collision_body_root_count_);
+      }
     else
-      dirty_collision_body_transforms_ = dirty_link_transforms_;
+    {
+      if (!fk)
+        updateLinkTransformsInternal(dirty_link_transforms_);
+      addDirtyRoot(dirty_link_transforms_, dirty_collision_body_transforms_, dirty_collision_body_roots_, dirty_collision_body_root_count_);
+    }
     dirty_link_transforms_ = NULL;
+    dirty_link_root_count_ = 0;
   }
 }
 
-void moveit::core::RobotState::updateLinkTransformsInternal(const JointModel *start)
-{  
-  const std::vector<const LinkModel*> &links = start->getDescendantLinkModels();
-  if (links.size() > 0)
-  { 
-    const LinkModel *parent = links[0]->getParentLinkModel();
-    if (parent)
+const Eigen::Affine3d& moveit::core::RobotState::getGlobalLinkTransformFromChain(const LinkModel *link)
+{
+  if (dirty_link_transforms_ != NULL)
+  {
+    // find the top most link of the chain that is in a dirty subtree; the links above it are up to date
+    const LinkModel *top = NULL;
+    for (const LinkModel *l = link ; l ; l = l->getParentLinkModel())
     {
-      if (links[0]->parentJointIsFixed())
-        global_link_transforms_[links[0]->getLinkIndex()].matrix().noalias() = 
-          global_link_transforms_[parent->getLinkIndex()].matrix() * links[0]->getJointOriginTransform().matrix();
-      else
+      const JointModel *joint = l->getParentJointModel();
+      if (dirty_link_root_count_ == 0)
       {
-        if (links[0]->jointOriginTransformIsIdentity())
-          global_link_transforms_[links[0]->getLinkIndex()].matrix().noalias() =
-            global_link_transforms_[parent->getLinkIndex()].matrix() * getJointTransform(links[0]->getParentJointModel()).matrix();
-        else
-          global_link_transforms_[links[0]->getLinkIndex()].matrix().noalias() = 
-            global_link_transforms_[parent->getLinkIndex()].matrix()
-            * links[0]->getJointOriginTransform().matrix()
-            * getJointTransform(links[0]->getParentJointModel()).matrix();
+        if (joint == dirty_link_transforms_)
+          top = l;
       }
-    }
-    else
-    {
-      if (links[0]->jointOriginTransformIsIdentity())
-        global_link_transforms_[links[0]->getLinkIndex()] = getJointTransform(links[0]->getParentJointModel());
       else
-        global_link_transforms_[links[0]->getLinkIndex()].matrix().noalias() = links[0]->getJointOriginTransform().matrix() * getJointTransform(links[0]->getParentJointModel()).matrix();
+        for (unsigned char r = 0 ; r < dirty_link_root_count_ ; ++r)
+          if (joint == dirty_link_roots_[r])
+          {
+            top = l;
+            break;
+          }
     }
-    
-    // we know the rest of the links have parents
-    for (std::size_t i = 1 ; i < links.size() ; ++i)
+    if (top)
+      updateLinkTransformChain(top, link);
+  }
+  return global_link_transforms_[link->getLinkIndex()];
+}
+
+void moveit::core::RobotState::updateLinkTransformChain(const LinkModel *top, const LinkModel *link)
+{
+  if (link != top)
+    updateLinkTransformChain(top, link->getParentLinkModel());
+  updateLinkTransform(link);
+}
+
+void moveit::core::RobotState::addDirtyRoot(const JointModel *joint, const JointModel *&common, const JointModel **roots, unsigned char &count) const
+{
+  if (common == NULL)
+  {
+    common = joint;
+    roots[0] = joint;
+    count = 1;
+    return;
+  }
+
+  common = robot_model_->getCommonRoot(common, joint);
+  if (count == 0)
+    return;
+
+  unsigned char kept = 0;
+  for (unsigned char i = 0 ; i < count ; ++i)
+  {
+    const JointModel *c = robot_model_->getCommonRoot(roots[i], joint);
+    // joint is in a subtree that is already dirty
+    if (c == roots[i])
+      return;
+    // drop subtrees that are included in the subtree of joint
+    if (c != joint)
+      roots[kept++] = roots[i];
+  }
+  count = kept;
+
+  if (count < MAX_DIRTY_ROOTS)
+    roots[count++] = joint;
+  else
+    // too many separate subtrees; update everything under their common root instead
+    count = 0;
+}
+
+void moveit::core::RobotState::updateLinkTransform(const LinkModel *link)
+{
+  const LinkModel *parent = link->getParentLinkModel();
+  Eigen::Affine3d &transform = global_link_transforms_[link->getLinkIndex()];
+  if (parent)
+  {
+    if (link->parentJointIsFixed())
+      transform.matrix().noalias() = global_link_transforms_[parent->getLinkIndex()].matrix() * link->getJointOriginTransform().matrix();
+    else
     {
-      if (links[i]->parentJointIsFixed())
-        global_link_transforms_[links[i]->getLinkIndex()].matrix().noalias() = 
-          global_link_transforms_[links[i]->getParentLinkModel()->getLinkIndex()].matrix()
-          * links[i]->getJointOriginTransform().matrix();
+      if (link->jointOriginTransformIsIdentity())
+        transform.matrix().noalias() =
+          global_link_transforms_[parent->getLinkIndex()].matrix() * getJointTransform(link->getParentJointModel()).matrix();
       else
-      {
-        if (links[i]->jointOriginTransformIsIdentity())
-          global_link_transforms_[links[i]->getLinkIndex()].matrix().noalias() =
-            global_link_transforms_[links[i]->getParentLinkModel()->getLinkIndex()].matrix()
-            * getJointTransform(links[i]->getParentJointModel()).matrix();
-        else
-          global_link_transforms_[links[i]->getLinkIndex()].matrix().noalias() = 
-            global_link_transforms_[links[i]->getParentLinkModel()->getLinkIndex()] .matrix()
-            * links[i]->getJointOriginTransform().matrix()
-            * getJointTransform(links[i]->getParentJointModel()).matrix();
-      }
+        transform.matrix().noalias() =
+          global_link_transforms_[parent->getLinkIndex()].matrix()
+          * link->getJointOriginTransform().matrix()
+          * getJointTransform(link->getParentJointModel()).matrix();
     }
   }
-  
+  else
+  {
+    if (link->jointOriginTransformIsIdentity())
+      transform = getJointTransform(link->getParentJointModel());
+    else
+      transform.matrix().noalias() = link->getJointOriginTransform().matrix() * getJointTransform(link->getParentJointModel()).matrix();
+  }
+}
+
+void moveit::core::RobotState::updateLinkTransformsInternal(const JointModel *start)
+{
+  const std::vector<const LinkModel*> &links = start->getDescendantLinkModels();
+  for (std::size_t i = 0 ; i < links.size() ; ++i)
+    updateLinkTransform(links[i]);
+
   // update attached bodies tf; these are usually very few, so we update them all
-  for (std::map<std::string, AttachedBody*>::const_iterator it = attached_body_map_.begin() ; it != attached_body_map_.end() ; ++it)
-    it->second->computeTransform(global_link_transforms_[it->second->getAttachedLink()->getLinkIndex()]);
+  for (std::size_t i = 0 ; i < attached_bodies_by_link_.size() ; ++i)
+    attached_bodies_by_link_[i]->computeTransform(global_link_transforms_[attached_bodies_by_link_[i]->getAttachedLink()->getLinkIndex()]);
 }
 
 void moveit::core::RobotState::updateStateWithLinkAt(const LinkModel *link, const Eigen::Affine3d& transform, bool backward)
@@ -531,10 +885,7 @@ void moveit::core::RobotState::updateStateWithLinkAt(const LinkModel *link, cons
   updateLinkTransforms(); // no link transforms must be dirty, otherwise the transform we set will be overwritten
   
   // update the fact that collision body transforms are out of date
-  if (dirty_collision_body_transforms_)
-    dirty_collision_body_transforms_ = robot_model_->getCommonRoot(dirty_collision_body_transforms_, link->getParentJointModel());
-  else
-    dirty_collision_body_transforms_ = link->getParentJointModel();
+  addDirtyRoot(link->getParentJointModel(), dirty_collision_body_transforms_, dirty_collision_body_roots_, dirty_collision_body_root_count_);
   
   global_link_transforms_[link->getLinkIndex()] = transform;
 
@@ -555,7 +906,7 @@ void moveit::core::RobotState::updateStateWithLinkAt(const LinkModel *link, cons
 
       // update the transform of the parent
       global_link_transforms_[parent_link->getLinkIndex()] = global_link_transforms_[child_link->getLinkIndex()] *
-        (child_link->getJointOriginTransform() * variable_joint_transforms_[child_link->getParentJointModel()->getJointIndex()]).inverse();
+        (child_link->getJointOriginTransform() * getJointTransform(child_link->getParentJointModel())).inverse();
 
       // update link transforms for descendant links only (leaving the transform for the current link untouched)
       // with the exception of the child link we are coming backwards from
@@ -571,8 +922,8 @@ void moveit::core::RobotState::updateStateWithLinkAt(const LinkModel *link, cons
   }
   
   // update attached bodies tf; these are usually very few, so we update them all
-  for (std::map<std::string, AttachedBody*>::const_iterator it = attached_body_map_.begin() ; it != attached_body_map_.end() ; ++it)
-    it->second->computeTransform(global_link_transforms_[it->second->getAttachedLink()->getLinkIndex()]);
+  for (std::size_t i = 0 ; i < attached_bodies_by_link_.size() ; ++i)
+    attached_bodies_by_link_[i]->computeTransform(global_link_transforms_[attached_bodies_by_link_[i]->getAttachedLink()->getLinkIndex()]);
 }
 
 bool moveit::core::RobotState::satisfiesBounds(double margin) const
@@ -655,14 +1006,7 @@ std::pair<double, const moveit::core::JointModel*> moveit::core::RobotState::get
 
 double moveit::core::RobotState::distance(const RobotState &other, const JointModelGroup *joint_group) const
 {
-  double d = 0.0;
-  const std::vector<const JointModel*> &jm = joint_group->getActiveJointModels();
-  for (std::size_t i = 0 ; i < jm.size() ; ++i)
-  {
-    const int idx = jm[i]->getFirstVariableIndex();
-    d += jm[i]->getDistanceFactor() * jm[i]->distance(position_ + idx, other.position_ + idx);
-  }
-  return d;  
+  return joint_group->distanceFullState(position_, other.position_);
 }
 
 void moveit::core::RobotState::interpolate(const RobotState &to, double t, RobotState &state) const
@@ -670,16 +1014,59 @@ void moveit::core::RobotState::interpolate(const RobotState &to, double t, Robot
   robot_model_->interpolate(getVariablePositions(), to.getVariablePositions(), t, state.getVariablePositions());
   
   memset(state.dirty_joint_transforms_, 1, state.robot_model_->getJointModelCount() * sizeof(unsigned char));
-  state.dirty_link_transforms_ = state.robot_model_->getRootJoint();
+  state.markAllDirtyLinkTransforms();
+}
+
+namespace moveit
+{
+namespace core
+{
+namespace
+{
+// Same as RevoluteJointModel::interpolate() and PrismaticJointModel::interpolate(), for n variables at once; wrap[i]
+// is 1.0 for continuous joints and 0.0 otherwise. There are no branches, so the loop can be vectorized.
+inline void interpolateVariables(const double *from, const double *to, const double *wrap, double t, std::size_t n, double *state)
+{
+  const double pi = boost::math::constants::pi<double>();
+  for (std::size_t i = 0 ; i < n ; ++i)
+  {
+    // continuous joints move along the shorter way around the circle; if that crosses -pi/pi, the result is
+    // wrapped back to [-pi, pi]
+    double diff = to[i] - from[i];
+    double offset = wrap[i] * (diff > pi ? -2.0 * pi : (diff < -pi ? 2.0 * pi : 0.0));
+    double value = from[i] + (diff + offset) * t;
+    double crossed = offset != 0.0 ? 1.0 : 0.0;
+    state[i] = value + crossed * (value > pi ? -2.0 * pi : (value < -pi ? 2.0 * pi : 0.0));
+  }
+}
+}
+}
 }
 
 void moveit::core::RobotState::interpolate(const RobotState &to, double t, RobotState &state, const JointModelGroup *joint_group) const
 {
-  const std::vector<const JointModel*> &jm = joint_group->getActiveJointModels();
-  for (std::size_t i = 0 ; i < jm.size() ; ++i)
+  if (joint_group->hasLinearlyInterpolableJoints())
+  {
+    const std::vector<int> &idx = joint_group->getActiveVariableIndexList();
+    const std::vector<double> &wrap = joint_group->getInterpolationWrapMask();
+    if (!idx.empty())
+    {
+      // the indices are increasing, so they are contiguous if they span as many variables as there are
+      if ((std::size_t)(idx.back() - idx.front()) + 1 == idx.size())
+        interpolateVariables(position_ + idx[0], to.position_ + idx[0], &wrap[0], t, idx.size(), state.position_ + idx[0]);
+      else
+        for (std::size_t i = 0 ; i < idx.size() ; ++i)
+          interpolateVariables(position_ + idx[i], to.position_ + idx[i], &wrap[i], t, 1, state.position_ + idx[i]);
+    }
+  }
+  else
   {
-    const int idx = jm[i]->getFirstVariableIndex();
-    jm[i]->interpolate(position_ + idx, to.position_ + idx, t, state.position_ + idx);
+    const std::vector<const JointModel*> &jm = joint_group->getActiveJointModels();
+    for (std::size_t i = 0 ; i < jm.size() ; ++i)
+    {
+      const int idx = jm[i]->getFirstVariableIndex();
+      jm[i]->interpolate(position_ + idx, to.position_ + idx, t, state.position_ + idx);
+    }
   }
   state.markDirtyJointTransforms(joint_group);
   state.updateMimicJoint(joint_group->getMimicJointModels());
@@ -707,9 +1094,60 @@ const moveit::core::AttachedBody* moveit::core::RobotState::getAttachedBody(cons
     return it->second;
 }
 
+namespace moveit
+{
+namespace core
+{
+namespace
+{
+bool attachedLinkIndexLess(const AttachedBody *a, const AttachedBody *b)
+{
+  return a->getAttachedLink()->getLinkIndex() < b->getAttachedLink()->getLinkIndex();
+}
+
+struct AttachedLinkIndexLess
+{
+  bool operator()(const AttachedBody *a, int link_index) const
+  {
+    return a->getAttachedLink()->getLinkIndex() < link_index;
+  }
+
+  bool operator()(int link_index, const AttachedBody *b) const
+  {
+    return link_index < b->getAttachedLink()->getLinkIndex();
+  }
+};
+}
+}
+}
+
+void moveit::core::RobotState::addAttachedBody(AttachedBody *attached_body)
+{
+  AttachedBody *&entry = attached_body_map_[attached_body->getName()];
+  if (entry)
+    removeAttachedBodyFromLinkIndex(entry);
+  entry = attached_body;
+  attached_bodies_by_link_.insert(std::upper_bound(attached_bodies_by_link_.begin(), attached_bodies_by_link_.end(),
+                                                   attached_body, &attachedLinkIndexLess), attached_body);
+  attached_bodies_version_ = newAttachedBodiesVersion();
+}
+
+void moveit::core::RobotState::removeAttachedBodyFromLinkIndex(const AttachedBody *attached_body)
+{
+  std::vector<AttachedBody*>::iterator it = std::find(attached_bodies_by_link_.begin(), attached_bodies_by_link_.end(), attached_body);
+  if (it != attached_bodies_by_link_.end())
+    attached_bodies_by_link_.erase(it);
+}
+
+std::pair<std::vector<moveit::core::AttachedBody*>::const_iterator, std::vector<moveit::core::AttachedBody*>::const_iterator>
+moveit::core::RobotState::getAttachedBodyRange(const LinkModel *link) const
+{
+  return std::equal_range(attached_bodies_by_link_.begin(), attached_bodies_by_link_.end(), link->getLinkIndex(), AttachedLinkIndexLess());
+}
+
 void moveit::core::RobotState::attachBody(AttachedBody *attached_body)
 {
-  attached_body_map_[attached_body->getName()] = attached_body;
+  addAttachedBody(attached_body);
   attached_body->computeTransform(getGlobalLinkTransform(attached_body->getAttachedLink()));
   if (attached_body_update_callback_)
     attached_body_update_callback_(attached_body, true);
@@ -724,7 +1162,7 @@ void moveit::core::RobotState::attachBody(const std::string &id,
 {
   const LinkModel *l = robot_model_->getLinkModel(link);
   AttachedBody *ab = new AttachedBody(l, id, shapes, attach_trans, touch_links, detach_posture);
-  attached_body_map_[id] = ab;
+  addAttachedBody(ab);
   ab->computeTransform(getGlobalLinkTransform(l));
   if (attached_body_update_callback_)
     attached_body_update_callback_(ab, true);
@@ -748,10 +1186,8 @@ void moveit::core::RobotState::getAttachedBodies(std::vector<const AttachedBody*
 
 void moveit::core::RobotState::getAttachedBodies(std::vector<const AttachedBody*> &attached_bodies, const LinkModel *lm) const
 {
-  attached_bodies.clear();
-  for (std::map<std::string, AttachedBody*>::const_iterator it = attached_body_map_.begin() ; it != attached_body_map_.end() ;  ++it)
-    if (it->second->getAttachedLink() == lm)
-      attached_bodies.push_back(it->second);
+  std::pair<std::vector<AttachedBody*>::const_iterator, std::vector<AttachedBody*>::const_iterator> range = getAttachedBodyRange(lm);
+  attached_bodies.assign(range.first, range.second);
 }
 
 void moveit::core::RobotState::clearAttachedBodies()
@@ -762,25 +1198,26 @@ void moveit::core::RobotState::clearAttachedBodies()
       attached_body_update_callback_(it->second, false);
     delete it->second;
   }
+  if (!attached_body_map_.empty())
+    attached_bodies_version_ = newAttachedBodiesVersion();
   attached_body_map_.clear();
+  attached_bodies_by_link_.clear();
 }
 
 void moveit::core::RobotState::clearAttachedBodies(const LinkModel *link)
 {
-  std::map<std::string, AttachedBody*>::iterator it = attached_body_map_.begin();
-  while (it != attached_body_map_.end())
+  std::pair<std::vector<AttachedBody*>::const_iterator, std::vector<AttachedBody*>::const_iterator> range = getAttachedBodyRange(link);
+  if (range.first != range.second)
+    attached_bodies_version_ = newAttachedBodiesVersion();
+  for (std::vector<AttachedBody*>::const_iterator it = range.first ; it != range.second ; ++it)
   {
-    if (it->second->getAttachedLink() != link)
-    {
-      ++it;
-      continue;
-    }
     if (attached_body_update_callback_)
-      attached_body_update_callback_(it->second, false);
-    delete it->second;
-    std::map<std::string, AttachedBody*>::iterator del = it++;
-    attached_body_map_.erase(del);
+      attached_body_update_callback_(*it, false);
+    attached_body_map_.erase((*it)->getName());
+    delete *it;
   }
+  attached_bodies_by_link_.erase(attached_bodies_by_link_.begin() + (range.first - attached_bodies_by_link_.begin()),
+                                 attached_bodies_by_link_.begin() + (range.second - attached_bodies_by_link_.begin()));
 }
 
 void moveit::core::RobotState::clearAttachedBodies(const JointModelGroup *group)
@@ -795,9 +1232,11 @@ void moveit::core::RobotState::clearAttachedBodies(const JointModelGroup *group)
     }
     if (attached_body_update_callback_)
       attached_body_update_callback_(it->second, false);
+    removeAttachedBodyFromLinkIndex(it->second);
     delete it->second;
     std::map<std::string, AttachedBody*>::iterator del = it++;
     attached_body_map_.erase(del);
+    attached_bodies_version_ = newAttachedBodiesVersion();
   }
 }
 
@@ -808,8 +1247,10 @@ bool moveit::core::RobotState::clearAttachedBody(const std::string &id)
   {
     if (attached_body_update_callback_)
       attached_body_update_callback_(it->second, false);
+    removeAttachedBodyFromLinkIndex(it->second);
     delete it->second;
     attached_body_map_.erase(it);
+    attached_bodies_version_ = newAttachedBodiesVersion();
     return true;
   }
   else
@@ -893,24 +1334,24 @@ void moveit::core::RobotState::getRobotMarkers(visualization_msgs::MarkerArray&
     if (!lm)
       continue;
     if (include_attached)
-      for (std::map<std::string, AttachedBody*>::const_iterator it = attached_body_map_.begin() ; it != attached_body_map_.end() ; ++it)
-        if (it->second->getAttachedLink() == lm)
+    {
+      std::pair<std::vector<AttachedBody*>::const_iterator, std::vector<AttachedBody*>::const_iterator> range = getAttachedBodyRange(lm);
+      for (std::vector<AttachedBody*>::const_iterator it = range.first ; it != range.second ; ++it)
+        for (std::size_t j = 0 ; j < (*it)->getShapes().size() ; ++j)
         {
-          for (std::size_t j = 0 ; j < it->second->getShapes().size() ; ++j)
+          visualization_msgs::Marker att_mark;
+          att_mark.header.frame_id = robot_model_->getModelFrame();
+          att_mark.header.stamp = tm;
+          if (shapes::constructMarkerFromShape((*it)->getShapes()[j].get(), att_mark))
           {
-            visualization_msgs::Marker att_mark;
-            att_mark.header.frame_id = robot_model_->getModelFrame();
-            att_mark.header.stamp = tm;
-            if (shapes::constructMarkerFromShape(it->second->getShapes()[j].get(), att_mark))
-            {
-              // if the object is invisible (0 volume) we skip it
-              if (fabs(att_mark.scale.x * att_mark.scale.y * att_mark.scale.z) < std::numeric_limits<float>::epsilon())
-                continue;
-              tf::poseEigenToMsg(it->second->getGlobalCollisionBodyTransforms()[j], att_mark.pose);
-              arr.markers.push_back(att_mark);
-            }
+            // if the object is invisible (0 volume) we skip it
+            if (fabs(att_mark.scale.x * att_mark.scale.y * att_mark.scale.z) < std::numeric_limits<float>::epsilon())
+              continue;
+            tf::poseEigenToMsg((*it)->getGlobalCollisionBodyTransforms()[j], att_mark.pose);
+            arr.markers.push_back(att_mark);
           }
         }
+    }
     
     if (lm->getShapes().empty())
       continue;
@@ -1205,24 +1646,16 @@ bool ikCallbackFnAdapter(RobotState *state, const JointModelGroup *group, const
 }
 }
 
-bool moveit::core::RobotState::setFromIK(const JointModelGroup *jmg, const Eigen::Affine3d &pose_in, const std::string &tip_in,
-                                         const std::vector<double> &consistency_limits, unsigned int attempts, double timeout,
-                                         const GroupStateValidityCallbackFn &constraint, const kinematics::KinematicsQueryOptions &options)
+bool moveit::core::RobotState::computeIKQuery(const kinematics::KinematicsBase &solver, const Eigen::Affine3d &pose_in, const std::string &tip_in,
+                                              geometry_msgs::Pose &ik_query)
 {
-  const kinematics::KinematicsBaseConstPtr& solver = jmg->getSolverInstance();
-  if (!solver)
-  {
-    logError("No kinematics solver instantiated for group '%s'", jmg->getName().c_str());
-    return false;
-  }
-
   Eigen::Affine3d pose = pose_in;
   std::string tip = tip_in;
   if (!tip.empty() && tip[0] == '/')
     tip = tip.substr(1);
   
   // bring the pose to the frame of the IK solver
-  const std::string &ik_frame = solver->getBaseFrame();
+  const std::string &ik_frame = solver.getBaseFrame();
   if (!Transforms::sameFrame(ik_frame, robot_model_->getModelFrame()))
   {
     const LinkModel *lm = getLinkModel((!ik_frame.empty() && ik_frame[0] == '/') ? ik_frame.substr(1) : ik_frame);
@@ -1232,7 +1665,7 @@ bool moveit::core::RobotState::setFromIK(const JointModelGroup *jmg, const Eigen
   }
 
   // see if the tip frame can be transformed via fixed transforms to the frame known to the IK solver
-  std::string tip_frame = solver->getTipFrame();
+  std::string tip_frame = solver.getTipFrame();
 
   // remove the frame '/' if there is one, so we can avoid calling Transforms::sameFrame() which may copy strings more often that we need to
   if (!tip_frame.empty() && tip_frame[0] == '/')
@@ -1274,17 +1707,8 @@ bool moveit::core::RobotState::setFromIK(const JointModelGroup *jmg, const Eigen
     return false;
   }
 
-  // if no timeout has been specified, use the default one
-  if (timeout < std::numeric_limits<double>::epsilon())
-    timeout = jmg->getDefaultIKTimeout();
-
-  if (attempts == 0)
-    attempts = jmg->getDefaultIKAttempts();
-  
-  const std::vector<unsigned int> &bij = jmg->getKinematicsSolverJointBijection();
   Eigen::Quaterniond quat(pose.rotation());
   Eigen::Vector3d point(pose.translation());
-  geometry_msgs::Pose ik_query;
   ik_query.position.x = point.x();
   ik_query.position.y = point.y();
   ik_query.position.z = point.z();
@@ -1293,6 +1717,67 @@ bool moveit::core::RobotState::setFromIK(const JointModelGroup *jmg, const Eigen
   ik_query.orientation.z = quat.z();
   ik_query.orientation.w = quat.w();
 
+  return true;
+}
+
+bool moveit::core::RobotState::setFromIK(const JointModelGroup *jmg, const Eigen::Affine3d &pose_in, const std::string &tip_in,
+                                         const std::vector<double> &consistency_limits, unsigned int attempts, double timeout,
+                                         const GroupStateValidityCallbackFn &constraint, const kinematics::KinematicsQueryOptions &options)
+{
+  // solvers are generally not reentrant, so an instance is leased for the duration of the call
+  kinematics::KinematicsBasePtr solver = jmg->acquireSolverInstance();
+  return setFromIKWithSolver(solver, jmg, pose_in, tip_in, consistency_limits, attempts, timeout, constraint, options);
+}
+
+bool moveit::core::RobotState::setFromIKWithSolver(const kinematics::KinematicsBaseConstPtr &solver, const JointModelGroup *jmg,
+                                                   const Eigen::Affine3d &pose_in, const std::string &tip_in,
+                                                   const std::vector<double> &consistency_limits, unsigned int attempts, double timeout,
+                                                   const GroupStateValidityCallbackFn &constraint, const kinematics::KinematicsQueryOptions &options)
+{
+  MOVEIT_CORE_PROBE("RobotState::setFromIK");
+  if (!solver)
+  {
+    logError("No kinematics solver instantiated for group '%s'", jmg->getName().c_str());
+    return false;
+  }
+
+  geometry_msgs::Pose ik_query;
+  if (!computeIKQuery(*solver, pose_in, tip_in, ik_query))
+    return false;
+
+  // if no timeout has been specified, use the default one
+  if (timeout < std::numeric_limits<double>::epsilon())
+    timeout = jmg->getDefaultIKTimeout();
+
+  if (attempts == 0)
+    attempts = jmg->getDefaultIKAttempts();
+  
+  const std::vector<unsigned int> &bij = jmg->getKinematicsSolverJointBijection();
+
+  // solutions cached for nearby poses are returned if they reach the pose and are valid, or used as seeds otherwise
+  const IKSolutionCachePtr &cache = jmg->getIKSolutionCache();
+  Eigen::Affine3d ik_pose;
+  std::vector<IKSolutionCache::Entry> cached;
+  if (cache)
+  {
+    tf::poseMsgToEigen(ik_query, ik_pose);
+    cache->getEntries(ik_pose, cached);
+    if (consistency_limits.empty())
+      for (std::size_t c = 0 ; c < cached.size() ; ++c)
+        if (cached[c].solution_.size() == bij.size() && cache->reaches(cached[c], ik_pose))
+        {
+          std::vector<double> solution(bij.size());
+          for (std::size_t i = 0 ; i < bij.size() ; ++i)
+            solution[bij[i]] = cached[c].solution_[i];
+          if (!constraint || constraint(this, jmg, &solution[0]))
+          {
+            setJointGroupPositions(jmg, solution);
+            return true;
+          }
+        }
+  }
+  std::size_t next_cached = 0;
+
   kinematics::KinematicsBase::IKCallbackFn ik_callback_fn;
   if (constraint)
     ik_callback_fn = boost::bind(&ikCallbackFnAdapter, this, jmg, constraint, _1, _2, _3);
@@ -1311,6 +1796,8 @@ bool moveit::core::RobotState::setFromIK(const JointModelGroup *jmg, const Eigen
       for (std::size_t i = 0 ; i < bij.size() ; ++i)
         seed[i] = initial_values[bij[i]];
     }
+    else if (next_cached < cached.size() && cached[next_cached].solution_.size() == bij.size())
+      seed = cached[next_cached++].solution_;
     else
     {
       // sample a random seed
@@ -1340,12 +1827,171 @@ bool moveit::core::RobotState::setFromIK(const JointModelGroup *jmg, const Eigen
       for (std::size_t i = 0 ; i < bij.size() ; ++i)
         solution[bij[i]] = ik_sol[i];
       setJointGroupPositions(jmg, solution);
+      if (cache)
+        cache->insert(ik_pose, ik_sol);
       return true;
     }
   }
   return false;
 }
 
+namespace moveit
+{
+namespace core
+{
+namespace
+{
+struct ParallelIKData
+{
+  ParallelIKData() : next_seed(0), done(false), found(false), best_cost(0.0)
+  {
+  }
+
+  const JointModelGroup *jmg;
+  geometry_msgs::Pose ik_query;
+  double timeout;
+  const std::vector<double> *consistency_limits;
+  const GroupStateValidityCallbackFn *constraint;
+  const GroupStateCostFn *cost;
+  kinematics::KinematicsQueryOptions options;
+  std::vector<std::vector<double> > seeds;
+
+  boost::mutex lock;
+  std::size_t next_seed;
+  volatile bool done;
+  bool found;
+  double best_cost;
+  std::vector<double> best;
+};
+
+void parallelIKWorker(ParallelIKData *data, const std::vector<kinematics::KinematicsBaseConstPtr> *solvers,
+                      const std::vector<RobotStatePtr> *states, std::size_t t)
+{
+  const kinematics::KinematicsBase *solver = (*solvers)[t].get();
+  RobotState *state = (*states)[t].get();
+  const std::vector<unsigned int> &bij = data->jmg->getKinematicsSolverJointBijection();
+  kinematics::KinematicsBase::IKCallbackFn ik_callback_fn;
+  if (*data->constraint)
+    ik_callback_fn = boost::bind(&ikCallbackFnAdapter, state, data->jmg, *data->constraint, _1, _2, _3);
+
+  std::vector<double> solution(bij.size());
+  while (!data->done)
+  {
+    std::size_t k;
+    {
+      boost::mutex::scoped_lock slock(data->lock);
+      if (data->next_seed >= data->seeds.size())
+        break;
+      k = data->next_seed++;
+    }
+
+    std::vector<double> ik_sol;
+    moveit_msgs::MoveItErrorCodes error;
+    if (!(ik_callback_fn ?
+          solver->searchPositionIK(data->ik_query, data->seeds[k], data->timeout, *data->consistency_limits, ik_sol, ik_callback_fn, error, data->options) :
+          solver->searchPositionIK(data->ik_query, data->seeds[k], data->timeout, *data->consistency_limits, ik_sol, error, data->options)))
+      continue;
+
+    for (std::size_t i = 0 ; i < bij.size() ; ++i)
+      solution[bij[i]] = ik_sol[i];
+    double c = *data->cost ? (*data->cost)(state, data->jmg, &solution[0]) : 0.0;
+
+    boost::mutex::scoped_lock slock(data->lock);
+    if (data->done)
+      break;
+    if (!data->found || c < data->best_cost)
+    {
+      data->found = true;
+      data->best_cost = c;
+      data->best = solution;
+    }
+    // without a cost, the first solution is the answer
+    if (!*data->cost)
+      data->done = true;
+  }
+}
+}
+}
+}
+
+bool moveit::core::RobotState::setFromIKParallel(const JointModelGroup *jmg, const Eigen::Affine3d &pose_in, const std::string &tip_in,
+                                                 unsigned int threads, unsigned int attempts, double timeout,
+                                                 const GroupStateValidityCallbackFn &constraint, const GroupStateCostFn &cost,
+                                                 const kinematics::KinematicsQueryOptions &options)
+{
+  const SolverAllocatorFn &allocator = jmg->getGroupKinematics().first.allocator_;
+  if (threads < 2 || !allocator)
+    return setFromIK(jmg, pose_in, tip_in, attempts, timeout, constraint, options);
+
+  kinematics::KinematicsBaseConstPtr solver = jmg->acquireSolverInstance();
+  if (!solver)
+  {
+    logError("No kinematics solver instantiated for group '%s'", jmg->getName().c_str());
+    return false;
+  }
+
+  ParallelIKData data;
+  if (!computeIKQuery(*solver, pose_in, tip_in, data.ik_query))
+    return false;
+
+  // if no timeout has been specified, use the default one
+  if (timeout < std::numeric_limits<double>::epsilon())
+    timeout = jmg->getDefaultIKTimeout();
+
+  if (attempts == 0)
+    attempts = jmg->getDefaultIKAttempts();
+
+  static std::vector<double> consistency_limits;
+  data.jmg = jmg;
+  data.timeout = timeout;
+  data.consistency_limits = &consistency_limits;
+  data.constraint = &constraint;
+  data.cost = &cost;
+  data.options = options;
+  data.options.cancel = &data.done;
+
+  // the seeds are the same as for setFromIK(): the current state first, random states after that
+  const std::vector<unsigned int> &bij = jmg->getKinematicsSolverJointBijection();
+  std::vector<unsigned int> red_joints;
+  solver->getRedundantJoints(red_joints);
+  std::vector<double> initial_values;
+  copyJointGroupPositions(jmg, initial_values);
+  random_numbers::RandomNumberGenerator &rng = getRandomNumberGenerator();
+  std::vector<double> random_values;
+  data.seeds.resize(attempts, std::vector<double>(bij.size()));
+  for (std::size_t i = 0 ; i < bij.size() ; ++i)
+    data.seeds[0][i] = initial_values[bij[i]];
+  for (unsigned int st = 1 ; st < attempts ; ++st)
+  {
+    jmg->getVariableRandomPositions(rng, random_values);
+    for (std::size_t i = 0 ; i < bij.size() ; ++i)
+      data.seeds[st][i] = random_values[bij[i]];
+    if (options.lock_redundant_joints)
+      for (std::size_t i = 0 ; i < red_joints.size() ; ++i)
+        data.seeds[st][red_joints[i]] = initial_values[bij[red_joints[i]]];
+  }
+
+  // the first thread uses the leased instance; the others lease more instances from the pool of the group,
+  // and run on the shared thread pool
+  moveit::tools::ThreadPool &pool = moveit::tools::ThreadPool::Instance();
+  threads = std::min(std::min(threads, attempts), pool.getThreadCount());
+  std::vector<kinematics::KinematicsBaseConstPtr> solvers(1, solver);
+  jmg->getSolverInstancePool()->tryAcquire(threads, red_joints, solvers);
+  if (solvers.size() < threads)
+    logDebug("Only %u kinematics solver instances are available for group '%s'. Using %u threads for IK.",
+             (unsigned int)solvers.size(), jmg->getName().c_str(), (unsigned int)solvers.size());
+
+  std::vector<RobotStatePtr> states(solvers.size());
+  for (std::size_t t = 0 ; t < solvers.size() ; ++t)
+    states[t].reset(new RobotState(*this));
+  pool.parallelFor(0, solvers.size(), boost::bind(&parallelIKWorker, &data, &solvers, &states, _1));
+
+  if (!data.found)
+    return false;
+  setJointGroupPositions(jmg, data.best);
+  return true;
+}
+
 bool moveit::core::RobotState::setFromIK(const JointModelGroup *jmg, const EigenSTL::vector_Affine3d &poses_in, const std::vector<std::string> &tips_in,
                                          unsigned int attempts, double timeout,
                                          const GroupStateValidityCallbackFn &constraint, const kinematics::KinematicsQueryOptions &options)
@@ -1576,10 +2222,102 @@ double moveit::core::RobotState::computeCartesianPath(const JointModelGroup *gro
   return (distance * computeCartesianPath(group, traj, link, target_pose, true, max_step, jump_threshold, validCallback, options));
 }
 
+namespace moveit
+{
+namespace core
+{
+namespace
+{
+// the largest joint-space distance between the end of a segment of a Cartesian path and the start of the next one,
+// for segments solved concurrently to be joined
+const double CARTESIAN_SEGMENT_JOIN_TOLERANCE = 1e-4;
+
+RobotStatePtr copyState(const RobotState &state, const RobotStateMemoryPoolPtr &pool)
+{
+  RobotStatePtr copy(new RobotState(pool));
+  *copy = state;
+  return copy;
+}
+}
+
+struct RobotState::CartesianPathSegments
+{
+  CartesianPathSegments() : next(0)
+  {
+  }
+
+  const JointModelGroup *group;
+  const LinkModel *link;
+  double max_step;
+  double jump_threshold;
+  const CartesianPathOptions *path_options;
+  const GroupStateValidityCallbackFn *valid_callback;
+  const kinematics::KinematicsQueryOptions *options;
+  RobotStateMemoryPoolPtr pool;
+
+  // the group values each segment starts from, and the pose (in the model frame) it ends at
+  std::vector<std::vector<double> > seeds;
+  EigenSTL::vector_Affine3d targets;
+
+  std::vector<std::vector<RobotStatePtr> > trajectories;
+  std::vector<double> fractions;
+
+  // the solver instance and the copy of the state of each thread
+  std::vector<kinematics::KinematicsBaseConstPtr> solvers;
+  std::vector<RobotStatePtr> states;
+
+  boost::mutex lock;
+  std::size_t next;
+};
+}
+}
+
+void moveit::core::RobotState::computeCartesianPathSegments(CartesianPathSegments *segments, std::size_t thread)
+{
+  RobotState &state = *segments->states[thread];
+  const kinematics::KinematicsBaseConstPtr &solver = segments->solvers[thread];
+  while (true)
+  {
+    std::size_t k;
+    {
+      boost::mutex::scoped_lock slock(segments->lock);
+      if (segments->next >= segments->seeds.size())
+        break;
+      k = segments->next++;
+    }
+    state.setJointGroupPositions(segments->group, segments->seeds[k]);
+    segments->fractions[k] = state.computeCartesianPathSegment(segments->group, segments->trajectories[k], segments->link, segments->targets[k],
+                                                         segments->max_step, segments->jump_threshold, *segments->path_options, solver,
+                                                         segments->pool, *segments->valid_callback, *segments->options);
+  }
+}
+
+double moveit::core::RobotState::computeCartesianPath(const JointModelGroup *group, std::vector<RobotStatePtr> &traj, const LinkModel *link,
+                                                      const Eigen::Affine3d &target, bool global_reference_frame, double max_step, double jump_threshold,
+                                                      const GroupStateValidityCallbackFn &validCallback,
+                                                      const kinematics::KinematicsQueryOptions &options)
+{
+  return computeCartesianPath(group, traj, link, target, global_reference_frame, max_step, jump_threshold, CartesianPathOptions(), validCallback, options);
+}
+
 double moveit::core::RobotState::computeCartesianPath(const JointModelGroup *group, std::vector<RobotStatePtr> &traj, const LinkModel *link,
                                                       const Eigen::Affine3d &target, bool global_reference_frame, double max_step, double jump_threshold,
+                                                      const CartesianPathOptions &path_options,
                                                       const GroupStateValidityCallbackFn &validCallback,
                                                       const kinematics::KinematicsQueryOptions &options)
+{
+  // the target can be in the local reference frame (in which case we rotate it)
+  Eigen::Affine3d rotated_target = global_reference_frame ? target : getGlobalLinkTransform(link) * target;
+  RobotStateMemoryPoolPtr pool = memory_pool_ ? memory_pool_ : RobotStateMemoryPoolPtr(new RobotStateMemoryPool(robot_model_));
+  return computeCartesianPathSegment(group, traj, link, rotated_target, max_step, jump_threshold, path_options,
+                                     group->getSolverInstance(), pool, validCallback, options);
+}
+
+double moveit::core::RobotState::computeCartesianPathSegment(const JointModelGroup *group, std::vector<RobotStatePtr> &traj, const LinkModel *link,
+                                                             const Eigen::Affine3d &target, double max_step, double jump_threshold,
+                                                             const CartesianPathOptions &path_options, const kinematics::KinematicsBaseConstPtr &solver,
+                                                             const RobotStateMemoryPoolPtr &pool, const GroupStateValidityCallbackFn &validCallback,
+                                                             const kinematics::KinematicsQueryOptions &options)
 {
   const std::vector<const JointModel*> &cjnt = group->getContinuousJointModels();
   // make sure that continuous joints wrap
@@ -1589,45 +2327,92 @@ double moveit::core::RobotState::computeCartesianPath(const JointModelGroup *gro
   // this is the Cartesian pose we start from, and we move in the direction indicated
   Eigen::Affine3d start_pose = getGlobalLinkTransform(link);
 
-  // the target can be in the local reference frame (in which case we rotate it)
-  Eigen::Affine3d rotated_target = global_reference_frame ? target : start_pose * target;
-  
-  bool test_joint_space_jump = jump_threshold > 0.0;
+  const bool adaptive = path_options.adaptive;
+  bool test_joint_space_jump = jump_threshold > 0.0 && !adaptive;
   
-  // decide how many steps we will need for this trajectory
-  double distance = (rotated_target.translation() - start_pose.translation()).norm();
+  // decide how many steps we will need for this trajectory; in adaptive mode, these are the largest steps taken
+  double distance = (target.translation() - start_pose.translation()).norm();
   unsigned int steps = (test_joint_space_jump ? 5 : 1) + (unsigned int)floor(distance / max_step);
-  
+  const double max_fraction = 1.0 / (double)steps;
+  const double min_fraction = path_options.min_step > 0.0 && distance * max_fraction > path_options.min_step ?
+    path_options.min_step / distance : max_fraction;
+
   traj.clear();
-  traj.push_back(RobotStatePtr(new RobotState(*this)));
+  traj.push_back(copyState(*this, pool));
   
   std::vector<double> dist_vector;
   double total_dist = 0.0;
+
+  // in adaptive mode, steps that are rejected are retried from the last state on the path
+  std::vector<double> last_values;
+  RobotStatePtr midpoint;
+  if (adaptive)
+  {
+    copyJointGroupPositions(group, last_values);
+    if (path_options.max_deviation > 0.0)
+      midpoint = copyState(*this, pool);
+  }
   
+  static const std::vector<double> consistency_limits;
   double last_valid_percentage = 0.0;
+  double fraction = max_fraction;
   Eigen::Quaterniond start_quaternion(start_pose.rotation());
-  Eigen::Quaterniond target_quaternion(rotated_target.rotation());
-  for (unsigned int i = 1; i <= steps ; ++i)
+  Eigen::Quaterniond target_quaternion(target.rotation());
+  while (last_valid_percentage < 1.0)
   {
-    double percentage = (double)i / (double)steps;
+    double percentage = adaptive ? std::min(1.0, last_valid_percentage + fraction) : (double)traj.size() / (double)steps;
 
     Eigen::Affine3d pose(start_quaternion.slerp(percentage, target_quaternion));
-    pose.translation() = percentage * rotated_target.translation() + (1 - percentage) * start_pose.translation();
+    pose.translation() = percentage * target.translation() + (1 - percentage) * start_pose.translation();
 
-    if (setFromIK(group, pose, link->getName(), 1, 0.0, validCallback, options))
+    bool valid = setFromIKWithSolver(solver, group, pose, link->getName(), consistency_limits, 1, 0.0, validCallback, options);
+    if (valid && adaptive)
     {
-      traj.push_back(RobotStatePtr(new RobotState(*this)));
+      if (path_options.max_joint_step > 0.0 && traj.back()->distance(*this, group) > path_options.max_joint_step)
+        valid = false;
+      else
+        if (midpoint)
+        {
+          // the link should stay close to the straight line in between the two states as well
+          traj.back()->interpolate(*this, 0.5, *midpoint, group);
+          double mid_percentage = (last_valid_percentage + percentage) / 2.0;
+          Eigen::Vector3d expected = mid_percentage * target.translation() + (1 - mid_percentage) * start_pose.translation();
+          if ((midpoint->getGlobalLinkTransform(link).translation() - expected).norm() > path_options.max_deviation)
+            valid = false;
+        }
+    }
 
-      // compute the distance to the previous point (infinity norm)
-      if (test_joint_space_jump)
+    if (!valid)
+    {
+      if (adaptive)
       {
-        double dist_prev_point = traj.back()->distance(*traj[traj.size() - 2], group);
-        dist_vector.push_back(dist_prev_point);
-        total_dist += dist_prev_point;
+        setJointGroupPositions(group, last_values);
+        if (fraction > min_fraction)
+        {
+          fraction = std::max(min_fraction, fraction / 2.0);
+          continue;
+        }
+        logDebug("Truncating Cartesian path: no valid step of at least %lf", path_options.min_step);
       }
-    }
-    else
       break;
+    }
+
+    traj.push_back(copyState(*this, pool));
+
+    // compute the distance to the previous point (infinity norm)
+    if (test_joint_space_jump)
+    {
+      double dist_prev_point = traj.back()->distance(*traj[traj.size() - 2], group);
+      dist_vector.push_back(dist_prev_point);
+      total_dist += dist_prev_point;
+    }
+
+    // after an accepted step, try a larger one
+    if (adaptive)
+    {
+      copyJointGroupPositions(group, last_values);
+      fraction = std::min(max_fraction, fraction * 2.0);
+    }
     last_valid_percentage = percentage;
   }
 
@@ -1653,11 +2438,95 @@ double moveit::core::RobotState::computeCartesianPath(const JointModelGroup *gro
                                                       const GroupStateValidityCallbackFn &validCallback,
                                                       const kinematics::KinematicsQueryOptions &options)
 {
+  return computeCartesianPath(group, traj, link, waypoints, global_reference_frame, max_step, jump_threshold, CartesianPathOptions(), validCallback, options);
+}
+
+double moveit::core::RobotState::computeCartesianPath(const JointModelGroup *group, std::vector<RobotStatePtr> &traj, const LinkModel *link,
+                                                      const EigenSTL::vector_Affine3d &waypoints, bool global_reference_frame, double max_step, double jump_threshold,
+                                                      const CartesianPathOptions &path_options,
+                                                      const GroupStateValidityCallbackFn &validCallback,
+                                                      const kinematics::KinematicsQueryOptions &options)
+{
+  CartesianPathSegments segments;
+  const SolverAllocatorFn &allocator = group->getGroupKinematics().first.allocator_;
+  const kinematics::KinematicsBaseConstPtr& solver = group->getSolverInstance();
+  if (path_options.threads > 1 && waypoints.size() > 1 && allocator && solver)
+  {
+    segments.group = group;
+    segments.link = link;
+    segments.max_step = max_step;
+    segments.jump_threshold = jump_threshold;
+    segments.path_options = &path_options;
+    segments.valid_callback = &validCallback;
+    segments.options = &options;
+    segments.pool = memory_pool_ ? memory_pool_ : RobotStateMemoryPoolPtr(new RobotStateMemoryPool(robot_model_));
+
+    // the segments end at the waypoints, expressed in the model frame
+    Eigen::Affine3d pose = getGlobalLinkTransform(link);
+    for (std::size_t i = 0 ; i < waypoints.size() ; ++i)
+    {
+      pose = global_reference_frame ? waypoints[i] : pose * waypoints[i];
+      segments.targets.push_back(pose);
+    }
+
+    // each segment starts from the IK solution at the previous waypoint; the segments after the first waypoint
+    // without a solution are solved sequentially
+    RobotState seed_state(*this);
+    segments.seeds.resize(1);
+    copyJointGroupPositions(group, segments.seeds[0]);
+    for (std::size_t i = 0 ; i + 1 < waypoints.size() ; ++i)
+    {
+      if (!seed_state.setFromIK(group, segments.targets[i], link->getName(), 1, 0.0, validCallback, options))
+        break;
+      segments.seeds.resize(i + 2);
+      seed_state.copyJointGroupPositions(group, segments.seeds[i + 1]);
+    }
+    segments.trajectories.resize(segments.seeds.size());
+    segments.fractions.resize(segments.seeds.size(), 0.0);
+
+    // every thread leases a solver instance from the pool of the group; if none is available, the group's own
+    // instance is used by a single thread
+    moveit::tools::ThreadPool &pool = moveit::tools::ThreadPool::Instance();
+    std::size_t threads = std::min<std::size_t>(std::min<std::size_t>(path_options.threads, segments.seeds.size()), pool.getThreadCount());
+    std::vector<unsigned int> red_joints;
+    solver->getRedundantJoints(red_joints);
+    if (group->getSolverInstancePool())
+      group->getSolverInstancePool()->tryAcquire(threads, red_joints, segments.solvers);
+    if (segments.solvers.empty())
+      segments.solvers.push_back(solver);
+
+    segments.states.resize(segments.solvers.size());
+    for (std::size_t t = 0 ; t < segments.solvers.size() ; ++t)
+      segments.states[t] = copyState(*this, segments.pool);
+    pool.parallelFor(0, segments.solvers.size(), boost::bind(&RobotState::computeCartesianPathSegments, &segments, _1));
+
+    // the leased instances go back to the pool of the group
+    segments.solvers.clear();
+  }
+
   double percentage_solved = 0.0;
   for (std::size_t i = 0; i < waypoints.size(); ++i)
   {
     std::vector<RobotStatePtr> waypoint_traj;
-    double wp_percentage_solved = computeCartesianPath(group, waypoint_traj, link, waypoints[i], global_reference_frame, max_step, jump_threshold, validCallback);
+    double wp_percentage_solved;
+    // a segment solved concurrently is used if it starts where the previous one ended
+    if (i < segments.trajectories.size() && !segments.trajectories[i].empty() &&
+        segments.trajectories[i].front()->distance(*this, group) <= CARTESIAN_SEGMENT_JOIN_TOLERANCE)
+    {
+      waypoint_traj.swap(segments.trajectories[i]);
+      wp_percentage_solved = segments.fractions[i];
+      std::vector<double> values;
+      waypoint_traj.back()->copyJointGroupPositions(group, values);
+      setJointGroupPositions(group, values);
+    }
+    else
+      if (segments.targets.empty())
+        wp_percentage_solved = computeCartesianPath(group, waypoint_traj, link, waypoints[i], global_reference_frame, max_step, jump_threshold,
+                                                    path_options, validCallback, options);
+      else
+        wp_percentage_solved = computeCartesianPath(group, waypoint_traj, link, segments.targets[i], true, max_step, jump_threshold,
+                                                    path_options, validCallback, options);
+
     if (fabs(wp_percentage_solved - 1.0) < std::numeric_limits<double>::epsilon())
     {
       percentage_solved = (double)(i + 1) / (double)waypoints.size();
@@ -1674,64 +2543,55 @@ double moveit::core::RobotState::computeCartesianPath(const JointModelGroup *gro
   return percentage_solved;
 }
 
-namespace
-{
-static inline void updateAABB(const Eigen::Affine3d &t, const Eigen::Vector3d &e, std::vector<double> &aabb)
+void moveit::core::RobotState::addLinkToAABB(const LinkModel *link, std::vector<double> &aabb) const
 {
-  Eigen::Vector3d v = e / 2.0;
-  Eigen::Vector3d c2 = t * v;
-  v = -v;
-  Eigen::Vector3d c1 = t * v;
-  if (aabb.empty())
+  Eigen::Vector3d center, extents;
+  if (!link->getShapes().empty())
   {
-    aabb.resize(6);
-    aabb[0] = c1.x();
-    aabb[2] = c1.y();
-    aabb[4] = c1.z();
-    aabb[1] = c2.x();
-    aabb[3] = c2.y();
-    aabb[5] = c2.z();
+    transformAABB(global_link_transforms_[link->getLinkIndex()], link->getCenteredBoundingBoxOffset(), link->getShapeExtentsAtOrigin(),
+                  center, extents);
+    mergeAABB(center, extents, aabb);
   }
-  else
+
+  std::pair<std::vector<AttachedBody*>::const_iterator, std::vector<AttachedBody*>::const_iterator> range = getAttachedBodyRange(link);
+  for (std::vector<AttachedBody*>::const_iterator it = range.first ; it != range.second ; ++it)
   {
-    if (aabb[0] > c1.x())
-      aabb[0] = c1.x();
-    if (aabb[2] > c1.y())
-      aabb[2] = c1.y();
-    if (aabb[4] > c1.z())
-      aabb[4] = c1.z();
-    if (aabb[1] < c2.x())
-      aabb[1] = c2.x();
-    if (aabb[3] < c2.y())
-      aabb[3] = c2.y();
-    if (aabb[5] < c2.z())
-      aabb[5] = c2.z();
+    const EigenSTL::vector_Affine3d &ts = (*it)->getGlobalCollisionBodyTransforms();
+    const EigenSTL::vector_Vector3d &cs = (*it)->getShapeBoundingBoxCenters();
+    const EigenSTL::vector_Vector3d &es = (*it)->getShapeBoundingBoxExtents();
+    for (std::size_t i = 0 ; i < ts.size() ; ++i)
+    {
+      transformAABB(ts[i], cs[i], es[i], center, extents);
+      mergeAABB(center, extents, aabb);
+    }
   }
 }
-}
 
-void robot_state::RobotState::computeAABB(std::vector<double> &aabb) const
+void moveit::core::RobotState::computeAABB(std::vector<double> &aabb) const
 {
   BOOST_VERIFY(checkLinkTransforms());
   
   aabb.clear();
-  std::vector<const LinkModel*> links = robot_model_->getLinkModelsWithCollisionGeometry();
+  const std::vector<const LinkModel*> &links = robot_model_->getLinkModelsWithCollisionGeometry();
   for (std::size_t i = 0 ; i < links.size() ; ++i)
-  {
-    const Eigen::Affine3d &t = getGlobalLinkTransform(links[i]);
-    const Eigen::Vector3d &e = links[i]->getShapeExtentsAtOrigin();
-    updateAABB(t, e, aabb);
-  }
-  for (std::map<std::string, AttachedBody*>::const_iterator it = attached_body_map_.begin() ; it != attached_body_map_.end() ; ++it)
-  {
-    const EigenSTL::vector_Affine3d &ts = it->second->getGlobalCollisionBodyTransforms();
-    const std::vector<shapes::ShapeConstPtr> &ss = it->second->getShapes();
-    for (std::size_t i = 0 ; i < ts.size() ; ++i)
-    {
-      Eigen::Vector3d e = shapes::computeShapeExtents(ss[i].get());
-      updateAABB(ts[i], e, aabb);
-    }
-  }
+    addLinkToAABB(links[i], aabb);
+  // bodies attached to links without geometry
+  for (std::size_t i = 0 ; i < attached_bodies_by_link_.size() ; ++i)
+    if (attached_bodies_by_link_[i]->getAttachedLink()->getShapes().empty() &&
+        (i == 0 || attached_bodies_by_link_[i - 1]->getAttachedLink() != attached_bodies_by_link_[i]->getAttachedLink()))
+      addLinkToAABB(attached_bodies_by_link_[i]->getAttachedLink(), aabb);
+  if (aabb.empty())
+    aabb.resize(6, 0.0);
+}
+
+void moveit::core::RobotState::computeAABB(const JointModelGroup *group, std::vector<double> &aabb) const
+{
+  BOOST_VERIFY(checkLinkTransforms());
+
+  aabb.clear();
+  const std::vector<const LinkModel*> &links = group->getLinkModels();
+  for (std::size_t i = 0 ; i < links.size() ; ++i)
+    addLinkToAABB(links[i], aabb);
   if (aabb.empty())
     aabb.resize(6, 0.0);
 }
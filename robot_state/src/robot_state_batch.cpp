@@ -0,0 +1,333 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2013, Willow Garage, Inc.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of Willow Garage, Inc. nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+#include <moveit/robot_state/robot_state_batch.h>
+#include <moveit/robot_model/revolute_joint_model.h>
+#include <moveit/robot_model/prismatic_joint_model.h>
+#include <algorithm>
+#include <cmath>
+
+namespace moveit
+{
+namespace core
+{
+namespace
+{
+
+// A transform is stored as 12 arrays of n values: the rotation in column major order, followed by the translation.
+// Element e of state k is at t[e * n + k].
+
+void affineToElements(const Eigen::Affine3d &transform, double *e)
+{
+  for (int col = 0 ; col < 4 ; ++col)
+    for (int row = 0 ; row < 3 ; ++row)
+      e[col * 3 + row] = transform(row, col);
+}
+
+void setConstant(const double *e, double *t, std::size_t n)
+{
+  for (int i = 0 ; i < 12 ; ++i)
+    std::fill(t + i * n, t + (i + 1) * n, e[i]);
+}
+
+// c = a * b, where b is the same for all states
+void multiplyBatchConstant(const double *a, const double *b, double *c, std::size_t n)
+{
+  for (int col = 0 ; col < 4 ; ++col)
+    for (int row = 0 ; row < 3 ; ++row)
+    {
+      const double *a0 = a + row * n;
+      const double *a1 = a + (3 + row) * n;
+      const double *a2 = a + (6 + row) * n;
+      const double b0 = b[col * 3];
+      const double b1 = b[col * 3 + 1];
+      const double b2 = b[col * 3 + 2];
+      double *r = c + (col * 3 + row) * n;
+      if (col < 3)
+        for (std::size_t k = 0 ; k < n ; ++k)
+          r[k] = a0[k] * b0 + a1[k] * b1 + a2[k] * b2;
+      else
+      {
+        const double *at = a + (9 + row) * n;
+        for (std::size_t k = 0 ; k < n ; ++k)
+          r[k] = a0[k] * b0 + a1[k] * b1 + a2[k] * b2 + at[k];
+      }
+    }
+}
+
+// c = a * b, where a is the same for all states
+void multiplyConstantBatch(const double *a, const double *b, double *c, std::size_t n)
+{
+  for (int col = 0 ; col < 4 ; ++col)
+    for (int row = 0 ; row < 3 ; ++row)
+    {
+      const double a0 = a[row];
+      const double a1 = a[3 + row];
+      const double a2 = a[6 + row];
+      const double *b0 = b + (col * 3) * n;
+      const double *b1 = b + (col * 3 + 1) * n;
+      const double *b2 = b + (col * 3 + 2) * n;
+      double *r = c + (col * 3 + row) * n;
+      if (col < 3)
+        for (std::size_t k = 0 ; k < n ; ++k)
+          r[k] = a0 * b0[k] + a1 * b1[k] + a2 * b2[k];
+      else
+      {
+        const double at = a[9 + row];
+        for (std::size_t k = 0 ; k < n ; ++k)
+          r[k] = a0 * b0[k] + a1 * b1[k] + a2 * b2[k] + at;
+      }
+    }
+}
+
+// c = a * b
+void multiplyBatchBatch(const double *a, const double *b, double *c, std::size_t n)
+{
+  for (int col = 0 ; col < 4 ; ++col)
+    for (int row = 0 ; row < 3 ; ++row)
+    {
+      const double *a0 = a + row * n;
+      const double *a1 = a + (3 + row) * n;
+      const double *a2 = a + (6 + row) * n;
+      const double *b0 = b + (col * 3) * n;
+      const double *b1 = b + (col * 3 + 1) * n;
+      const double *b2 = b + (col * 3 + 2) * n;
+      double *r = c + (col * 3 + row) * n;
+      if (col < 3)
+        for (std::size_t k = 0 ; k < n ; ++k)
+          r[k] = a0[k] * b0[k] + a1[k] * b1[k] + a2[k] * b2[k];
+      else
+      {
+        const double *at = a + (9 + row) * n;
+        for (std::size_t k = 0 ; k < n ; ++k)
+          r[k] = a0[k] * b0[k] + a1[k] * b1[k] + a2[k] * b2[k] + at[k];
+      }
+    }
+}
+
+}
+}
+}
+
+moveit::core::RobotStateBatch::RobotStateBatch(const RobotModelConstPtr &robot_model, std::size_t count)
+  : robot_model_(robot_model)
+  , count_(0)
+  , dirty_(true)
+{
+  resize(count);
+}
+
+void moveit::core::RobotStateBatch::resize(std::size_t count)
+{
+  const std::size_t nv = robot_model_->getVariableCount();
+  std::vector<double> defaults(nv);
+  if (nv > 0)
+    robot_model_->getVariableDefaultPositions(&defaults[0]);
+
+  std::vector<double> positions(nv * count);
+  const std::size_t keep = std::min(count, count_);
+  for (std::size_t v = 0 ; v < nv ; ++v)
+  {
+    std::copy(positions_.begin() + v * count_, positions_.begin() + v * count_ + keep, positions.begin() + v * count);
+    std::fill(positions.begin() + v * count + keep, positions.begin() + (v + 1) * count, defaults[v]);
+  }
+  positions_.swap(positions);
+  count_ = count;
+
+  link_transforms_.resize(robot_model_->getLinkModelCount() * 12 * count_);
+  joint_transforms_.resize(24 * count_);
+  dirty_ = true;
+}
+
+void moveit::core::RobotStateBatch::setState(std::size_t state_index, const RobotState &state)
+{
+  const double *values = state.getVariablePositions();
+  const std::size_t nv = robot_model_->getVariableCount();
+  for (std::size_t v = 0 ; v < nv ; ++v)
+    positions_[v * count_ + state_index] = values[v];
+  dirty_ = true;
+}
+
+void moveit::core::RobotStateBatch::getState(std::size_t state_index, RobotState &state) const
+{
+  const std::size_t nv = robot_model_->getVariableCount();
+  std::vector<double> values(nv);
+  for (std::size_t v = 0 ; v < nv ; ++v)
+    values[v] = positions_[v * count_ + state_index];
+  if (nv > 0)
+    state.setVariablePositions(&values[0]);
+}
+
+void moveit::core::RobotStateBatch::updateMimicJoints()
+{
+  const std::vector<const JointModel*> &mim = robot_model_->getMimicJointModels();
+  for (std::size_t i = 0 ; i < mim.size() ; ++i)
+  {
+    double *out = &positions_[mim[i]->getFirstVariableIndex() * count_];
+    const double *in = &positions_[mim[i]->getMimic()->getFirstVariableIndex() * count_];
+    const double factor = mim[i]->getMimicFactor();
+    const double offset = mim[i]->getMimicOffset();
+    for (std::size_t k = 0 ; k < count_ ; ++k)
+      out[k] = factor * in[k] + offset;
+  }
+}
+
+void moveit::core::RobotStateBatch::computeJointTransforms(const JointModel *joint, double *t)
+{
+  const std::size_t n = count_;
+  const double *q = &positions_[joint->getFirstVariableIndex() * n];
+  switch (joint->getType())
+  {
+  case JointModel::REVOLUTE:
+    {
+      const Eigen::Vector3d &axis = static_cast<const RevoluteJointModel*>(joint)->getAxis();
+      const double x = axis.x(), y = axis.y(), z = axis.z();
+      const double x2 = x * x, y2 = y * y, z2 = z * z, xy = x * y, xz = x * z, yz = y * z;
+      for (std::size_t k = 0 ; k < n ; ++k)
+      {
+        const double c = cos(q[k]);
+        const double s = sin(q[k]);
+        const double v = 1.0 - c;
+        t[k]         = v * x2 + c;
+        t[n + k]     = v * xy + z * s;
+        t[2 * n + k] = v * xz - y * s;
+        t[3 * n + k] = v * xy - z * s;
+        t[4 * n + k] = v * y2 + c;
+        t[5 * n + k] = v * yz + x * s;
+        t[6 * n + k] = v * xz + y * s;
+        t[7 * n + k] = v * yz - x * s;
+        t[8 * n + k] = v * z2 + c;
+      }
+      std::fill(t + 9 * n, t + 12 * n, 0.0);
+    }
+    break;
+  case JointModel::PRISMATIC:
+    {
+      static const double identity[9] = { 1.0, 0.0, 0.0, 0.0, 1.0, 0.0, 0.0, 0.0, 1.0 };
+      for (int i = 0 ; i < 9 ; ++i)
+        std::fill(t + i * n, t + (i + 1) * n, identity[i]);
+      const Eigen::Vector3d &axis = static_cast<const PrismaticJointModel*>(joint)->getAxis();
+      for (int i = 0 ; i < 3 ; ++i)
+      {
+        const double a = axis[i];
+        double *r = t + (9 + i) * n;
+        for (std::size_t k = 0 ; k < n ; ++k)
+          r[k] = a * q[k];
+      }
+    }
+    break;
+  default:
+    {
+      // planar and floating joints are uncommon and have several variables; compute their transforms one state at a time
+      const std::size_t nv = joint->getVariableCount();
+      joint_values_.resize(nv);
+      Eigen::Affine3d transform;
+      double e[12];
+      for (std::size_t k = 0 ; k < n ; ++k)
+      {
+        for (std::size_t j = 0 ; j < nv ; ++j)
+          joint_values_[j] = q[j * n + k];
+        joint->computeTransform(nv > 0 ? &joint_values_[0] : NULL, transform);
+        affineToElements(transform, e);
+        for (int i = 0 ; i < 12 ; ++i)
+          t[i * n + k] = e[i];
+      }
+    }
+    break;
+  }
+}
+
+void moveit::core::RobotStateBatch::update(bool force)
+{
+  if (!dirty_ && !force)
+    return;
+  dirty_ = false;
+  if (count_ == 0)
+    return;
+
+  updateMimicJoints();
+
+  const std::size_t n = count_;
+  double *joint_transform = &joint_transforms_[0];
+  double *product = &joint_transforms_[12 * n];
+  double origin[12];
+
+  const std::vector<const LinkModel*> &links = robot_model_->getRootJoint()->getDescendantLinkModels();
+  for (std::size_t i = 0 ; i < links.size() ; ++i)
+  {
+    const LinkModel *link = links[i];
+    const LinkModel *parent = link->getParentLinkModel();
+    double *out = &link_transforms_[link->getLinkIndex() * 12 * n];
+    const double *parent_transform = parent ? &link_transforms_[parent->getLinkIndex() * 12 * n] : NULL;
+    affineToElements(link->getJointOriginTransform(), origin);
+
+    if (link->parentJointIsFixed())
+    {
+      if (parent_transform)
+        multiplyBatchConstant(parent_transform, origin, out, n);
+      else
+        setConstant(origin, out, n);
+      continue;
+    }
+
+    computeJointTransforms(link->getParentJointModel(), joint_transform);
+    if (link->jointOriginTransformIsIdentity())
+    {
+      if (parent_transform)
+        multiplyBatchBatch(parent_transform, joint_transform, out, n);
+      else
+        std::copy(joint_transform, joint_transform + 12 * n, out);
+    }
+    else
+    {
+      if (parent_transform)
+      {
+        multiplyBatchConstant(parent_transform, origin, product, n);
+        multiplyBatchBatch(product, joint_transform, out, n);
+      }
+      else
+        multiplyConstantBatch(origin, joint_transform, out, n);
+    }
+  }
+}
+
+void moveit::core::RobotStateBatch::getGlobalLinkTransform(const LinkModel *link, std::size_t state_index, Eigen::Affine3d &transform) const
+{
+  assert(!dirty_);
+  const double *t = &link_transforms_[link->getLinkIndex() * 12 * count_ + state_index];
+  transform.setIdentity();
+  for (int col = 0 ; col < 4 ; ++col)
+    for (int row = 0 ; row < 3 ; ++row)
+      transform(row, col) = t[(col * 3 + row) * count_];
+}
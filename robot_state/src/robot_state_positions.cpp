@@ -0,0 +1,161 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2013, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#include <moveit/robot_state/robot_state_positions.h>
+#include <cstring>
+#include <algorithm>
+
+moveit::core::RobotStatePositions::RobotStatePositions()
+  : size_(0)
+{
+}
+
+moveit::core::RobotStatePositions::RobotStatePositions(std::size_t size, double value)
+  : size_(0)
+{
+  resize(size);
+  std::fill(data(), data() + size_, value);
+}
+
+moveit::core::RobotStatePositions::RobotStatePositions(const RobotState &state)
+  : size_(0)
+{
+  setFromState(state);
+}
+
+moveit::core::RobotStatePositions::RobotStatePositions(const RobotState &state, const JointModelGroup *group)
+  : size_(0)
+{
+  setFromState(state, group);
+}
+
+moveit::core::RobotStatePositions::RobotStatePositions(const RobotStatePositions &other)
+  : size_(0)
+{
+  assign(other.data(), other.size_);
+}
+
+moveit::core::RobotStatePositions::~RobotStatePositions()
+{
+  if (size_ > INLINE_CAPACITY)
+    delete[] storage_.heap_;
+}
+
+moveit::core::RobotStatePositions& moveit::core::RobotStatePositions::operator=(const RobotStatePositions &other)
+{
+  if (this != &other)
+    assign(other.data(), other.size_);
+  return *this;
+}
+
+void moveit::core::RobotStatePositions::resize(std::size_t size)
+{
+  if (size == size_)
+    return;
+  if (size > INLINE_CAPACITY || size_ > INLINE_CAPACITY)
+  {
+    // the values move between the inline and the allocated storage (or to a new allocation)
+    double buffer[INLINE_CAPACITY];
+    double *values = size > INLINE_CAPACITY ? new double[size] : buffer;
+    const std::size_t keep = std::min(size, size_);
+    memcpy(values, data(), keep * sizeof(double));
+    std::fill(values + keep, values + size, 0.0);
+    if (size_ > INLINE_CAPACITY)
+      delete[] storage_.heap_;
+    if (size > INLINE_CAPACITY)
+      storage_.heap_ = values;
+    else
+      memcpy(storage_.inline_, buffer, size * sizeof(double));
+  }
+  else
+    std::fill(storage_.inline_ + size_, storage_.inline_ + size, 0.0);
+  size_ = size;
+}
+
+void moveit::core::RobotStatePositions::allocate(std::size_t size)
+{
+  if (size == size_)
+    return;
+  if (size_ > INLINE_CAPACITY)
+    delete[] storage_.heap_;
+  if (size > INLINE_CAPACITY)
+    storage_.heap_ = new double[size];
+  size_ = size;
+}
+
+void moveit::core::RobotStatePositions::assign(const double *values, std::size_t size)
+{
+  allocate(size);
+  memcpy(data(), values, size * sizeof(double));
+}
+
+void moveit::core::RobotStatePositions::setFromState(const RobotState &state)
+{
+  assign(state.getVariablePositions(), state.getVariableCount());
+}
+
+void moveit::core::RobotStatePositions::setFromState(const RobotState &state, const JointModelGroup *group)
+{
+  allocate(group->getVariableCount());
+  state.copyJointGroupPositions(group, data());
+}
+
+bool moveit::core::RobotStatePositions::copyToState(RobotState &state) const
+{
+  if (size_ != state.getVariableCount())
+  {
+    logError("Cannot set %u variable positions for a state with %u variables", (unsigned int)size_, (unsigned int)state.getVariableCount());
+    return false;
+  }
+  state.setVariablePositions(data());
+  return true;
+}
+
+bool moveit::core::RobotStatePositions::copyToState(RobotState &state, const JointModelGroup *group) const
+{
+  if (size_ != group->getVariableCount())
+  {
+    logError("Cannot set %u variable positions for group '%s', which has %u variables",
+             (unsigned int)size_, group->getName().c_str(), (unsigned int)group->getVariableCount());
+    return false;
+  }
+  state.setJointGroupPositions(group, data());
+  return true;
+}
+
+void moveit::core::RobotStatePositions::swap(RobotStatePositions &other)
+{
+  std::swap(size_, other.size_);
+  std::swap(storage_, other.storage_);
+}
@@ -0,0 +1,107 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2013, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#include <moveit/robot_state/variable_mapping.h>
+
+namespace moveit
+{
+namespace core
+{
+namespace
+{
+bool checkValueCount(const VariableMapping &mapping, const std::vector<double> &values)
+{
+  if (values.size() != mapping.size())
+  {
+    logError("Expected %u values for the mapped variables but got %u", (unsigned int)mapping.size(), (unsigned int)values.size());
+    return false;
+  }
+  return true;
+}
+}
+}
+}
+
+moveit::core::VariableMapping::VariableMapping()
+{
+}
+
+moveit::core::VariableMapping::VariableMapping(const RobotModelConstPtr &robot_model, const std::vector<std::string> &names)
+  : robot_model_(robot_model)
+  , names_(names)
+  , indices_(names.size())
+{
+  for (std::size_t i = 0 ; i < names.size() ; ++i)
+    indices_[i] = robot_model->getVariableIndex(names[i]);
+}
+
+void moveit::core::VariableMapping::setVariablePositions(RobotState &state, const std::vector<double> &values) const
+{
+  if (checkValueCount(*this, values))
+    state.setVariablePositions(indices_, values);
+}
+
+void moveit::core::VariableMapping::setVariableVelocities(RobotState &state, const std::vector<double> &values) const
+{
+  if (checkValueCount(*this, values))
+    state.setVariableVelocities(indices_, values);
+}
+
+void moveit::core::VariableMapping::setVariableAccelerations(RobotState &state, const std::vector<double> &values) const
+{
+  if (checkValueCount(*this, values))
+    state.setVariableAccelerations(indices_, values);
+}
+
+void moveit::core::VariableMapping::setVariableEffort(RobotState &state, const std::vector<double> &values) const
+{
+  if (checkValueCount(*this, values))
+    state.setVariableEffort(indices_, values);
+}
+
+void moveit::core::VariableMapping::setVariableValues(RobotState &state, const sensor_msgs::JointState &msg) const
+{
+  if (!msg.position.empty())
+    setVariablePositions(state, msg.position);
+  if (!msg.velocity.empty())
+    setVariableVelocities(state, msg.velocity);
+}
+
+void moveit::core::VariableMapping::copyVariablePositions(const RobotState &state, std::vector<double> &values) const
+{
+  values.resize(indices_.size());
+  const double *positions = state.getVariablePositions();
+  for (std::size_t i = 0 ; i < indices_.size() ; ++i)
+    values[i] = positions[indices_[i]];
+}
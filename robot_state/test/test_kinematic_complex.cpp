@@ -36,6 +36,11 @@
 
 #include <moveit/robot_model/robot_model.h>
 #include <moveit/robot_state/robot_state.h>
+#include <moveit/robot_state/robot_state_batch.h>
+#include <moveit/robot_state/robot_state_positions.h>
+#include <moveit/robot_state/variable_mapping.h>
+#include <moveit/robot_state/jacobian_workspace.h>
+#include <moveit/robot_state/diff_ik_workspace.h>
 #include <moveit/test_resources/config.h>
 #include <moveit/robot_state/conversions.h>
 #include <urdf_parser/urdf_parser.h>
@@ -275,6 +280,608 @@ TEST_F(LoadPlanningModelsPr2, FullTest)
   ASSERT_EQ(attached_bodies_2.size(), 0);
 }
 
+TEST_F(LoadPlanningModelsPr2, SeparateDirtyBranches)
+{
+  moveit::core::RobotState ks(robot_model);
+  ks.setToDefaultValues();
+  ks.update();
+
+  // moving joints on separate branches only marks those branches as dirty
+  ks.setVariablePosition("r_shoulder_pan_joint", 0.3);
+  ks.setVariablePosition("l_shoulder_pan_joint", -0.3);
+  ks.setVariablePosition("r_wrist_roll_joint", 0.1);
+  ks.setVariablePosition("head_pan_joint", 0.2);
+  ks.setVariablePosition("l_wrist_flex_joint", -0.4);
+  ks.update();
+  EXPECT_FALSE(ks.dirty());
+
+  moveit::core::RobotState ks2(robot_model);
+  ks2.setToDefaultValues();
+  ks2.setVariablePosition("r_shoulder_pan_joint", 0.3);
+  ks2.setVariablePosition("l_shoulder_pan_joint", -0.3);
+  ks2.setVariablePosition("r_wrist_roll_joint", 0.1);
+  ks2.setVariablePosition("head_pan_joint", 0.2);
+  ks2.setVariablePosition("l_wrist_flex_joint", -0.4);
+  ks2.update(true);
+
+  const std::vector<const moveit::core::LinkModel*> &links = robot_model->getLinkModels();
+  for (std::size_t i = 0 ; i < links.size() ; ++i)
+  {
+    EXPECT_TRUE(ks.getGlobalLinkTransform(links[i]).isApprox(ks2.getGlobalLinkTransform(links[i]))) << links[i]->getName();
+    for (std::size_t j = 0 ; j < links[i]->getCollisionOriginTransforms().size() ; ++j)
+      EXPECT_TRUE(ks.getCollisionBodyTransform(links[i], j).isApprox(ks2.getCollisionBodyTransform(links[i], j))) << links[i]->getName();
+  }
+}
+
+TEST_F(LoadPlanningModelsPr2, ChainTransforms)
+{
+  moveit::core::RobotState ks(robot_model);
+  ks.setToDefaultValues();
+  ks.update();
+
+  moveit::core::RobotState ks2(ks);
+  ks.setVariablePosition("r_shoulder_pan_joint", 0.3);
+  ks.setVariablePosition("r_wrist_roll_joint", 0.1);
+  ks.setVariablePosition("torso_lift_joint", 0.1);
+  ks2.setVariablePosition("r_shoulder_pan_joint", 0.3);
+  ks2.setVariablePosition("r_wrist_roll_joint", 0.1);
+  ks2.setVariablePosition("torso_lift_joint", 0.1);
+  ks2.update(true);
+
+  // only the chain to the requested link is computed; the state stays dirty
+  EXPECT_TRUE(ks.getGlobalLinkTransformFromChain("r_gripper_palm_link").isApprox(ks2.getGlobalLinkTransform("r_gripper_palm_link")));
+  EXPECT_TRUE(ks.dirtyLinkTransforms());
+  EXPECT_TRUE(ks.getGlobalLinkTransformFromChain("l_gripper_palm_link").isApprox(ks2.getGlobalLinkTransform("l_gripper_palm_link")));
+  EXPECT_TRUE(ks.getGlobalLinkTransformFromChain("base_link").isApprox(ks2.getGlobalLinkTransform("base_link")));
+
+  ks.update();
+  const std::vector<const moveit::core::LinkModel*> &links = robot_model->getLinkModels();
+  for (std::size_t i = 0 ; i < links.size() ; ++i)
+    EXPECT_TRUE(ks.getGlobalLinkTransform(links[i]).isApprox(ks2.getGlobalLinkTransform(links[i]))) << links[i]->getName();
+}
+
+TEST_F(LoadPlanningModelsPr2, MemoryPool)
+{
+  moveit::core::RobotStateMemoryPoolPtr pool(new moveit::core::RobotStateMemoryPool(robot_model, 2));
+  {
+    moveit::core::RobotState ks(pool);
+    ks.setToRandomPositions();
+    moveit::core::RobotState ks2(ks);
+    moveit::core::RobotState ks3(ks2);
+    EXPECT_EQ(pool->getCachedBlockCount(), 0);
+    ks3.update();
+    EXPECT_TRUE(ks3.getGlobalLinkTransform("r_gripper_palm_link").isApprox(ks.getGlobalLinkTransform("r_gripper_palm_link")));
+  }
+  EXPECT_EQ(pool->getCachedBlockCount(), 2);
+
+  moveit::core::RobotState ks(pool);
+  EXPECT_EQ(pool->getCachedBlockCount(), 1);
+  ks.setToDefaultValues();
+  moveit::core::RobotState ks2(robot_model);
+  ks2.setToDefaultValues();
+  EXPECT_TRUE(ks.getGlobalLinkTransform("r_gripper_palm_link").isApprox(ks2.getGlobalLinkTransform("r_gripper_palm_link")));
+
+  pool->clear();
+  EXPECT_EQ(pool->getCachedBlockCount(), 0);
+}
+
+TEST_F(LoadPlanningModelsPr2, BatchFK)
+{
+  static const std::size_t N = 17;
+  moveit::core::RobotStateBatch batch(robot_model, N);
+  std::vector<moveit::core::RobotStatePtr> states(N);
+  for (std::size_t k = 0 ; k < N ; ++k)
+  {
+    states[k].reset(new moveit::core::RobotState(robot_model));
+    states[k]->setToRandomPositions();
+    states[k]->update();
+    batch.setState(k, *states[k]);
+  }
+  batch.update();
+
+  const std::vector<const moveit::core::LinkModel*> &links = robot_model->getLinkModels();
+  for (std::size_t k = 0 ; k < N ; ++k)
+    for (std::size_t i = 0 ; i < links.size() ; ++i)
+    {
+      Eigen::Affine3d t;
+      batch.getGlobalLinkTransform(links[i], k, t);
+      EXPECT_TRUE(t.isApprox(states[k]->getGlobalLinkTransform(links[i]), 1e-9)) << links[i]->getName();
+    }
+
+  moveit::core::RobotState copy(robot_model);
+  batch.getState(3, copy);
+  copy.update();
+  EXPECT_TRUE(copy.getGlobalLinkTransform("r_gripper_palm_link").isApprox(states[3]->getGlobalLinkTransform("r_gripper_palm_link"), 1e-9));
+}
+
+TEST_F(LoadPlanningModelsPr2, JacobianWorkspace)
+{
+  const moveit::core::JointModelGroup *jmg = robot_model->getJointModelGroup("right_arm");
+  ASSERT_TRUE(jmg != NULL);
+  ASSERT_TRUE(jmg->isChain());
+
+  moveit::core::JacobianWorkspace<> dynamic_workspace(jmg);
+  moveit::core::JacobianWorkspace<7> fixed_workspace(jmg);
+  EXPECT_TRUE(dynamic_workspace.isConfigured());
+  EXPECT_TRUE(fixed_workspace.isConfigured());
+
+  // the DOF the workspace is instantiated for has to match the group
+  moveit::core::JacobianWorkspace<6> wrong_workspace;
+  EXPECT_FALSE(wrong_workspace.configure(jmg));
+
+  moveit::core::RobotState state(robot_model);
+  Eigen::Vector3d reference_point(0.1, 0.02, -0.03);
+  for (int k = 0 ; k < 10 ; ++k)
+  {
+    state.setToRandomPositions();
+    Eigen::MatrixXd expected;
+    ASSERT_TRUE(state.getJacobian(jmg, jmg->getLinkModels().back(), reference_point, expected));
+    ASSERT_TRUE(state.getJacobian(dynamic_workspace, reference_point));
+    ASSERT_TRUE(state.getJacobian(fixed_workspace, reference_point));
+    EXPECT_TRUE(dynamic_workspace.getJacobian().isApprox(expected, 1e-9));
+    EXPECT_TRUE(fixed_workspace.getJacobian().isApprox(expected, 1e-9));
+  }
+}
+
+TEST_F(LoadPlanningModelsPr2, DiffIKWorkspace)
+{
+  const moveit::core::JointModelGroup *jmg = robot_model->getJointModelGroup("right_arm");
+  ASSERT_TRUE(jmg != NULL);
+  moveit::core::DiffIKWorkspace workspace(jmg);
+  ASSERT_TRUE(workspace.isConfigured());
+
+  moveit::core::RobotState state(robot_model);
+  state.setToDefaultValues();
+  state.setVariablePosition("r_shoulder_lift_joint", 0.2);
+  state.setVariablePosition("r_elbow_flex_joint", -1.0);
+  state.setVariablePosition("r_wrist_flex_joint", -0.5);
+  state.update();
+
+  moveit::core::DiffIKWorkspace::Twist twist;
+  twist << 0.02, -0.01, 0.03, 0.01, 0.02, -0.01;
+
+  // without damping the twist is realized exactly, with or without the null space motion
+  workspace.setManipulabilityThreshold(0.0);
+  workspace.setJointLimitGain(0.0);
+  ASSERT_TRUE(workspace.computeVariableVelocity(state, twist));
+  EXPECT_EQ(0.0, workspace.getDamping());
+  Eigen::VectorXd realized = workspace.getJacobian() * workspace.getVariableVelocity();
+  for (int i = 0 ; i < 6 ; ++i)
+    EXPECT_NEAR(twist(i), realized(i), 1e-6);
+  Eigen::VectorXd plain = workspace.getVariableVelocity();
+
+  workspace.setJointLimitGain(0.1);
+  ASSERT_TRUE(workspace.computeVariableVelocity(state, twist));
+  realized = workspace.getJacobian() * workspace.getVariableVelocity();
+  for (int i = 0 ; i < 6 ; ++i)
+    EXPECT_NEAR(twist(i), realized(i), 1e-6);
+  EXPECT_GT((workspace.getVariableVelocity() - plain).norm(), 1e-6);
+
+  // large twists are scaled to the velocity bounds
+  ASSERT_TRUE(workspace.computeVariableVelocity(state, twist * 1000.0));
+  const std::vector<std::string> &names = jmg->getVariableNames();
+  for (std::size_t i = 0 ; i < names.size() ; ++i)
+  {
+    const moveit::core::VariableBounds &b = robot_model->getVariableBounds(names[i]);
+    if (b.velocity_bounded_)
+      EXPECT_LE(fabs(workspace.getVariableVelocity()(i)), b.max_velocity_ + 1e-9);
+  }
+
+  // a short step moves the tip along the twist
+  const moveit::core::LinkModel *tip = jmg->getLinkModels().back();
+  Eigen::Vector3d start = state.getGlobalLinkTransform(tip).translation();
+  ASSERT_TRUE(workspace.setFromDiffIK(state, twist, 0.01));
+  EXPECT_FALSE(state.dirtyLinkTransforms());
+  Eigen::Vector3d step = state.getGlobalLinkTransform(tip).translation() - start;
+  Eigen::Matrix3d root = state.getGlobalLinkTransform(jmg->getJointModels()[0]->getParentLinkModel()).linear();
+  EXPECT_TRUE((root.transpose() * step).isApprox(twist.head<3>() * 0.01, 1e-2));
+}
+
+TEST_F(LoadPlanningModelsPr2, GroupInterpolation)
+{
+  const moveit::core::JointModelGroup *jmg = robot_model->getJointModelGroup("right_arm");
+  ASSERT_TRUE(jmg != NULL);
+  ASSERT_TRUE(jmg->hasLinearlyInterpolableJoints());
+  EXPECT_FALSE(jmg->getContinuousJointModels().empty());
+
+  moveit::core::RobotState from(robot_model), to(robot_model), result(robot_model);
+  std::vector<double> expected(robot_model->getVariableCount());
+  const std::vector<const moveit::core::JointModel*> &jm = jmg->getActiveJointModels();
+  for (int k = 0 ; k < 20 ; ++k)
+  {
+    from.setToRandomPositions();
+    to.setToRandomPositions();
+    result = from;
+    double t = (double)k / 19.0;
+    from.interpolate(to, t, result, jmg);
+    for (std::size_t i = 0 ; i < jm.size() ; ++i)
+    {
+      const int idx = jm[i]->getFirstVariableIndex();
+      jm[i]->interpolate(from.getVariablePositions() + idx, to.getVariablePositions() + idx, t, &expected[idx]);
+      EXPECT_NEAR(expected[idx], result.getVariablePosition(idx), 1e-12) << jm[i]->getName();
+    }
+  }
+}
+
+TEST_F(LoadPlanningModelsPr2, GroupJointKernels)
+{
+  const moveit::core::JointModelGroup *jmg = robot_model->getJointModelGroup("right_arm");
+  ASSERT_TRUE(jmg != NULL);
+  ASSERT_TRUE(jmg->hasLinearlyInterpolableJoints());
+  const std::vector<const moveit::core::JointModel*> &jm = jmg->getActiveJointModels();
+
+  moveit::core::RobotState state1(robot_model), state2(robot_model);
+  std::vector<double> v1, v2;
+  for (int k = 0 ; k < 20 ; ++k)
+  {
+    state1.setToRandomPositions();
+    state2.setToRandomPositions();
+    state1.copyJointGroupPositions(jmg, v1);
+    state2.copyJointGroupPositions(jmg, v2);
+    // move some values out of bounds
+    for (std::size_t i = 0 ; i < v2.size() ; i += 2)
+      v2[i] += 4.0;
+
+    double expected_distance = 0.0;
+    std::vector<double> expected_bounded = v2;
+    bool expected_change = false;
+    for (std::size_t i = 0 ; i < jm.size() ; ++i)
+    {
+      const int idx = jmg->getVariableGroupIndex(jm[i]->getName());
+      expected_distance += jm[i]->getDistanceFactor() * jm[i]->distance(&v1[idx], &v2[idx]);
+      if (jm[i]->enforcePositionBounds(&expected_bounded[idx]))
+        expected_change = true;
+    }
+    EXPECT_NEAR(expected_distance, jmg->distance(&v1[0], &v2[0]), 1e-12);
+    EXPECT_FALSE(jmg->satisfiesPositionBounds(&v2[0]));
+    std::vector<double> bounded = v2;
+    EXPECT_EQ(expected_change, jmg->enforcePositionBounds(&bounded[0]));
+    for (std::size_t i = 0 ; i < bounded.size() ; ++i)
+      EXPECT_NEAR(expected_bounded[i], bounded[i], 1e-12);
+    EXPECT_TRUE(jmg->satisfiesPositionBounds(&bounded[0]));
+
+    // joint transforms match the rotation about the axis of the joint
+    for (std::size_t i = 0 ; i < jm.size() ; ++i)
+      if (jm[i]->getType() == moveit::core::JointModel::REVOLUTE)
+      {
+        const Eigen::Vector3d &axis = static_cast<const moveit::core::RevoluteJointModel*>(jm[i])->getAxis();
+        Eigen::Affine3d expected(Eigen::AngleAxisd(state1.getVariablePosition(jm[i]->getFirstVariableIndex()), axis));
+        EXPECT_TRUE(expected.isApprox(state1.getJointTransform(jm[i]), 1e-12)) << jm[i]->getName();
+      }
+  }
+}
+
+TEST_F(LoadPlanningModelsPr2, CopyModes)
+{
+  moveit::core::RobotState ks(robot_model);
+  ks.setToRandomPositions();
+  std::vector<double> vel(ks.getVariableCount(), 0.5);
+  ks.setVariableVelocities(vel);
+  ks.update();
+  const Eigen::Affine3d palm = ks.getGlobalLinkTransform("r_gripper_palm_link");
+
+  moveit::core::RobotState full(ks, moveit::core::RobotState::COPY_FULL);
+  EXPECT_FALSE(full.dirty());
+  EXPECT_TRUE(full.hasVelocities());
+
+  moveit::core::RobotState vars(ks, moveit::core::RobotState::COPY_VARIABLES);
+  EXPECT_TRUE(vars.dirtyLinkTransforms());
+  EXPECT_TRUE(vars.hasVelocities());
+  EXPECT_EQ(0.5, vars.getVariableVelocity(0));
+
+  moveit::core::RobotState pos(robot_model);
+  pos.copyFrom(ks, moveit::core::RobotState::COPY_POSITIONS);
+  EXPECT_TRUE(pos.dirtyLinkTransforms());
+  EXPECT_FALSE(pos.hasVelocities());
+
+  for (std::size_t i = 0 ; i < ks.getVariableCount() ; ++i)
+  {
+    EXPECT_EQ(ks.getVariablePosition(i), full.getVariablePosition(i));
+    EXPECT_EQ(ks.getVariablePosition(i), vars.getVariablePosition(i));
+    EXPECT_EQ(ks.getVariablePosition(i), pos.getVariablePosition(i));
+  }
+  vars.update();
+  pos.update();
+  EXPECT_TRUE(palm.isApprox(full.getGlobalLinkTransform("r_gripper_palm_link")));
+  EXPECT_TRUE(palm.isApprox(vars.getGlobalLinkTransform("r_gripper_palm_link")));
+  EXPECT_TRUE(palm.isApprox(pos.getGlobalLinkTransform("r_gripper_palm_link")));
+
+  // swapping exchanges the contents, transforms included
+  moveit::core::RobotState other(robot_model);
+  other.setToDefaultValues();
+  other.update();
+  const Eigen::Affine3d default_palm = other.getGlobalLinkTransform("r_gripper_palm_link");
+  other.swap(full);
+  EXPECT_FALSE(other.dirty());
+  EXPECT_TRUE(other.hasVelocities());
+  EXPECT_FALSE(full.hasVelocities());
+  EXPECT_TRUE(palm.isApprox(other.getGlobalLinkTransform("r_gripper_palm_link")));
+  EXPECT_TRUE(default_palm.isApprox(full.getGlobalLinkTransform("r_gripper_palm_link")));
+  full.setToRandomPositions();
+  full.update();
+  EXPECT_TRUE(palm.isApprox(other.getGlobalLinkTransform("r_gripper_palm_link")));
+}
+
+TEST_F(LoadPlanningModelsPr2, StatePositions)
+{
+  moveit::core::RobotState ks(robot_model);
+  ks.setToRandomPositions();
+  ks.update();
+
+  moveit::core::RobotStatePositions full(ks);
+  ASSERT_EQ(ks.getVariableCount(), full.size());
+  for (std::size_t i = 0 ; i < full.size() ; ++i)
+    EXPECT_EQ(ks.getVariablePosition(i), full[i]);
+
+  const moveit::core::JointModelGroup *jmg = robot_model->getJointModelGroup("right_arm");
+  ASSERT_TRUE(jmg != NULL);
+  ASSERT_LE(jmg->getVariableCount(), (unsigned int)moveit::core::RobotStatePositions::INLINE_CAPACITY);
+  moveit::core::RobotStatePositions arm(ks, jmg);
+  std::vector<double> arm_values;
+  ks.copyJointGroupPositions(jmg, arm_values);
+  ASSERT_EQ(arm_values.size(), arm.size());
+  for (std::size_t i = 0 ; i < arm.size() ; ++i)
+    EXPECT_EQ(arm_values[i], arm[i]);
+
+  moveit::core::RobotState ks2(robot_model);
+  ks2.setToDefaultValues();
+  EXPECT_FALSE(arm.copyToState(ks2)); // wrong size
+  EXPECT_TRUE(full.copyToState(ks2));
+  ks2.update();
+  EXPECT_TRUE(ks.getGlobalLinkTransform("r_gripper_palm_link").isApprox(ks2.getGlobalLinkTransform("r_gripper_palm_link")));
+
+  // copies, swaps and resizing across the inline capacity keep the values
+  moveit::core::RobotStatePositions copy(arm);
+  copy.swap(full);
+  EXPECT_EQ(arm.size(), full.size());
+  EXPECT_EQ(ks.getVariableCount(), copy.size());
+  copy = full;
+  EXPECT_EQ(arm.size(), copy.size());
+  copy.resize(arm.size() + 20);
+  for (std::size_t i = 0 ; i < arm.size() ; ++i)
+    EXPECT_EQ(arm[i], copy[i]);
+  EXPECT_EQ(0.0, copy[arm.size() + 19]);
+  copy.resize(2);
+  EXPECT_EQ(arm[1], copy[1]);
+
+  ks2 = ks;
+  ks2.setToRandomPositions(jmg);
+  EXPECT_TRUE(arm.copyToState(ks2, jmg));
+  ks2.update();
+  EXPECT_TRUE(ks.getGlobalLinkTransform("r_gripper_palm_link").isApprox(ks2.getGlobalLinkTransform("r_gripper_palm_link")));
+}
+
+TEST_F(LoadPlanningModelsPr2, VariableMapping)
+{
+  moveit::core::RobotState ks(robot_model);
+  ks.setToDefaultValues();
+
+  sensor_msgs::JointState msg;
+  msg.name.push_back("r_shoulder_pan_joint");
+  msg.name.push_back("torso_lift_joint");
+  msg.name.push_back("l_elbow_flex_joint");
+  msg.position.push_back(0.1);
+  msg.position.push_back(0.2);
+  msg.position.push_back(-0.3);
+  msg.velocity.push_back(1.0);
+  msg.velocity.push_back(2.0);
+  msg.velocity.push_back(3.0);
+
+  moveit::core::VariableMapping mapping(robot_model, msg.name);
+  EXPECT_TRUE(mapping.matches(robot_model, msg.name));
+  ASSERT_EQ(3u, mapping.size());
+  for (std::size_t i = 0 ; i < msg.name.size() ; ++i)
+    EXPECT_EQ(robot_model->getVariableIndex(msg.name[i]), mapping.getVariableIndices()[i]);
+
+  moveit::core::RobotState expected(ks);
+  expected.setVariableValues(msg);
+  mapping.setVariableValues(ks, msg);
+  for (std::size_t i = 0 ; i < ks.getVariableCount() ; ++i)
+  {
+    EXPECT_EQ(expected.getVariablePosition(i), ks.getVariablePosition(i));
+    EXPECT_EQ(expected.getVariableVelocity(i), ks.getVariableVelocity(i));
+  }
+  ks.update();
+  expected.update();
+  EXPECT_TRUE(expected.getGlobalLinkTransform("r_gripper_palm_link").isApprox(ks.getGlobalLinkTransform("r_gripper_palm_link")));
+
+  std::vector<double> values;
+  mapping.copyVariablePositions(ks, values);
+  EXPECT_EQ(msg.position, values);
+
+  // a wrong number of values is ignored
+  values.pop_back();
+  mapping.setVariablePositions(ks, values);
+  EXPECT_EQ(-0.3, ks.getVariablePosition("l_elbow_flex_joint"));
+
+  msg.name.pop_back();
+  EXPECT_FALSE(mapping.matches(robot_model, msg.name));
+  msg.name.push_back("no_such_joint");
+  EXPECT_THROW(moveit::core::VariableMapping(robot_model, msg.name), moveit::Exception);
+}
+
+TEST_F(LoadPlanningModelsPr2, AttachedBodiesByLink)
+{
+  moveit::core::RobotState ks(robot_model);
+  ks.setToDefaultValues();
+  EXPECT_FALSE(ks.hasAttachedBodies());
+
+  std::vector<shapes::ShapeConstPtr> shapes(1, shapes::ShapeConstPtr(new shapes::Sphere(0.1)));
+  EigenSTL::vector_Affine3d poses(1, Eigen::Affine3d::Identity());
+  std::set<std::string> touch_links;
+  ks.attachBody("r1", shapes, poses, touch_links, "r_gripper_palm_link");
+  ks.attachBody("l1", shapes, poses, touch_links, "l_gripper_palm_link");
+  ks.attachBody("r2", shapes, poses, touch_links, "r_gripper_palm_link");
+  ks.attachBody("b1", shapes, poses, touch_links, "base_link");
+  EXPECT_TRUE(ks.hasAttachedBodies());
+  EXPECT_EQ(4u, ks.getAttachedBodyCount());
+
+  std::vector<const moveit::core::AttachedBody*> ab;
+  ks.getAttachedBodies(ab, robot_model->getLinkModel("r_gripper_palm_link"));
+  ASSERT_EQ(2u, ab.size());
+  EXPECT_TRUE(ab[0]->getName() == "r1" || ab[0]->getName() == "r2");
+  EXPECT_TRUE(ab[1]->getName() == "r1" || ab[1]->getName() == "r2");
+  ks.getAttachedBodies(ab, robot_model->getLinkModel("r_gripper_l_finger_link"));
+  EXPECT_TRUE(ab.empty());
+
+  // transforms of attached bodies follow the link they are attached to
+  ks.setToRandomPositions();
+  ks.update();
+  EXPECT_TRUE(ks.getGlobalLinkTransform("l_gripper_palm_link").isApprox(ks.getAttachedBody("l1")->getGlobalCollisionBodyTransforms()[0]));
+
+  // replacing a body keeps a single entry for it
+  ks.attachBody("r2", shapes, poses, touch_links, "base_link");
+  EXPECT_EQ(4u, ks.getAttachedBodyCount());
+  ks.getAttachedBodies(ab, robot_model->getLinkModel("base_link"));
+  EXPECT_EQ(2u, ab.size());
+
+  moveit::core::RobotState copy(ks);
+  EXPECT_EQ(4u, copy.getAttachedBodyCount());
+  copy.getAttachedBodies(ab, robot_model->getLinkModel("r_gripper_palm_link"));
+  ASSERT_EQ(1u, ab.size());
+  EXPECT_EQ("r1", ab[0]->getName());
+
+  ks.clearAttachedBodies(robot_model->getLinkModel("base_link"));
+  EXPECT_EQ(2u, ks.getAttachedBodyCount());
+  EXPECT_FALSE(ks.hasAttachedBody("b1"));
+  EXPECT_FALSE(ks.hasAttachedBody("r2"));
+  EXPECT_TRUE(ks.clearAttachedBody("l1"));
+  ks.getAttachedBodies(ab, robot_model->getLinkModel("l_gripper_palm_link"));
+  EXPECT_TRUE(ab.empty());
+  ks.clearAttachedBodies();
+  EXPECT_FALSE(ks.hasAttachedBodies());
+  EXPECT_EQ(4u, copy.getAttachedBodyCount());
+}
+
+TEST_F(LoadPlanningModelsPr2, SharedAttachedBodies)
+{
+  moveit::core::RobotState ks(robot_model);
+  ks.setToDefaultValues();
+  std::vector<shapes::ShapeConstPtr> shapes(1, shapes::ShapeConstPtr(new shapes::Sphere(0.1)));
+  EigenSTL::vector_Affine3d poses(1, Eigen::Affine3d::Identity());
+  std::set<std::string> touch_links;
+  touch_links.insert("r_gripper_l_finger_link");
+  ks.attachBody("ball", shapes, poses, touch_links, "r_gripper_palm_link");
+  ks.update();
+
+  // copies of the state share the description of the attached body
+  moveit::core::RobotState copy(ks);
+  const moveit::core::AttachedBody *ab = ks.getAttachedBody("ball");
+  const moveit::core::AttachedBody *ab_copy = copy.getAttachedBody("ball");
+  ASSERT_TRUE(ab_copy != NULL);
+  EXPECT_NE(ab, ab_copy);
+  EXPECT_EQ(&ab->getTouchLinks(), &ab_copy->getTouchLinks());
+  EXPECT_EQ(ab->getShapes()[0], ab_copy->getShapes()[0]);
+  EXPECT_TRUE(ab->getGlobalCollisionBodyTransforms()[0].isApprox(ab_copy->getGlobalCollisionBodyTransforms()[0]));
+
+  // transforms are not shared
+  copy.setToRandomPositions();
+  copy.update();
+  EXPECT_TRUE(copy.getGlobalLinkTransform("r_gripper_palm_link").isApprox(ab_copy->getGlobalCollisionBodyTransforms()[0]));
+  EXPECT_TRUE(ks.getGlobalLinkTransform("r_gripper_palm_link").isApprox(ab->getGlobalCollisionBodyTransforms()[0]));
+
+  // modifying a copy does not change the original
+  moveit::core::AttachedBody padded(*ab);
+  padded.setPadding(0.1);
+  EXPECT_NE(&ab->getTouchLinks(), &padded.getTouchLinks());
+  EXPECT_EQ(ab->getTouchLinks(), padded.getTouchLinks());
+  EXPECT_NEAR(0.1, static_cast<const shapes::Sphere*>(ab->getShapes()[0].get())->radius, 1e-12);
+  EXPECT_NEAR(0.2, static_cast<const shapes::Sphere*>(padded.getShapes()[0].get())->radius, 1e-12);
+}
+
+TEST_F(LoadPlanningModelsPr2, ComputeAABB)
+{
+  moveit::core::RobotState ks(robot_model);
+  ks.setToRandomPositions();
+  ks.update();
+
+  std::vector<double> aabb;
+  ks.computeAABB(aabb);
+  ASSERT_EQ(6u, aabb.size());
+  const std::vector<const moveit::core::LinkModel*> &links = robot_model->getLinkModelsWithCollisionGeometry();
+  for (std::size_t i = 0 ; i < links.size() ; ++i)
+  {
+    // the bounding box of each link, at the origin of the link, is inside the box of the state
+    const Eigen::Vector3d c = ks.getGlobalLinkTransform(links[i]) * links[i]->getCenteredBoundingBoxOffset();
+    for (int k = 0 ; k < 3 ; ++k)
+    {
+      EXPECT_LE(aabb[2 * k], c[k]);
+      EXPECT_GE(aabb[2 * k + 1], c[k]);
+    }
+  }
+
+  const moveit::core::JointModelGroup *jmg = robot_model->getJointModelGroup("right_arm");
+  std::vector<double> group_aabb;
+  ks.computeAABB(jmg, group_aabb);
+  ASSERT_EQ(6u, group_aabb.size());
+  for (int k = 0 ; k < 3 ; ++k)
+  {
+    EXPECT_LE(aabb[2 * k], group_aabb[2 * k]);
+    EXPECT_GE(aabb[2 * k + 1], group_aabb[2 * k + 1]);
+  }
+
+  // an attached sphere far from the robot extends the box to exactly where the sphere ends
+  std::vector<shapes::ShapeConstPtr> shapes(1, shapes::ShapeConstPtr(new shapes::Sphere(0.1)));
+  EigenSTL::vector_Affine3d poses(1, Eigen::Affine3d::Identity());
+  const moveit::core::LinkModel *tip = jmg->getLinkModels().back();
+  poses[0].translation() = ks.getGlobalLinkTransform(tip).inverse() * Eigen::Vector3d(20.0, 0.0, 0.0);
+  ks.attachBody("ball", shapes, poses, std::set<std::string>(), tip->getName());
+  ks.computeAABB(aabb);
+  EXPECT_NEAR(20.1, aabb[1], 1e-9);
+  ks.computeAABB(jmg, group_aabb);
+  EXPECT_NEAR(20.1, group_aabb[1], 1e-9);
+}
+
+TEST_F(LoadPlanningModelsPr2, StateMsgConverter)
+{
+  moveit::core::RobotState ks(robot_model);
+  ks.setToRandomPositions();
+  ks.update();
+  std::vector<shapes::ShapeConstPtr> shapes(1, shapes::ShapeConstPtr(new shapes::Sphere(0.1)));
+  EigenSTL::vector_Affine3d poses(1, Eigen::Affine3d::Identity());
+  std::set<std::string> touch_links;
+  boost::uint64_t version = ks.getAttachedBodiesVersion();
+  ks.attachBody("ball", shapes, poses, touch_links, "r_gripper_palm_link");
+  EXPECT_NE(version, ks.getAttachedBodiesVersion());
+  version = ks.getAttachedBodiesVersion();
+
+  // copies have the same attached bodies version, until they change
+  moveit::core::RobotState copy(ks);
+  EXPECT_EQ(version, copy.getAttachedBodiesVersion());
+  EXPECT_FALSE(copy.clearAttachedBody("missing"));
+  EXPECT_EQ(version, copy.getAttachedBodiesVersion());
+  EXPECT_TRUE(copy.clearAttachedBody("ball"));
+  EXPECT_NE(version, copy.getAttachedBodiesVersion());
+
+  moveit::core::RobotStateMsgConverter converter;
+  const moveit_msgs::RobotState &msg = converter.convert(ks);
+  moveit_msgs::RobotState expected;
+  moveit::core::robotStateToRobotStateMsg(ks, expected);
+  EXPECT_EQ(expected.joint_state.name, msg.joint_state.name);
+  EXPECT_EQ(expected.joint_state.position, msg.joint_state.position);
+  EXPECT_EQ(expected.multi_dof_joint_state.joint_names, msg.multi_dof_joint_state.joint_names);
+  ASSERT_EQ(1u, msg.attached_collision_objects.size());
+  EXPECT_EQ("ball", msg.attached_collision_objects[0].object.id);
+
+  // converting again reuses the message, and the attached bodies follow the state
+  const double *positions = &msg.joint_state.position[0];
+  ks.setToRandomPositions();
+  converter.convert(ks);
+  EXPECT_EQ(positions, &msg.joint_state.position[0]);
+  moveit::core::robotStateToRobotStateMsg(ks, expected);
+  EXPECT_EQ(expected.joint_state.position, msg.joint_state.position);
+  converter.convert(copy);
+  EXPECT_TRUE(msg.attached_collision_objects.empty());
+
+  // messages in the order of the model are read back exactly
+  moveit::core::RobotState back(robot_model);
+  back.setToDefaultValues();
+  EXPECT_TRUE(moveit::core::robotStateMsgToRobotState(converter.convert(ks), back));
+  for (std::size_t i = 0 ; i < robot_model->getVariableCount() ; ++i)
+    EXPECT_NEAR(ks.getVariablePosition(i), back.getVariablePosition(i), 1e-9);
+  EXPECT_TRUE(back.hasAttachedBody("ball"));
+}
+
 int main(int argc, char **argv)
 {
   testing::InitGoogleTest(&argc, argv);
@@ -107,6 +107,7 @@ public:
   }
 
   /** @brief  Returns the duration after start that a waypoint will be reached.
+   *  The durations from start are cached, so this is constant time unless the durations changed since the last call.
    *  @param  The waypoint index.
    *  @return The duration from start; retuns -1.0 if index is out of range.
    */
@@ -125,6 +126,7 @@ public:
     if (duration_from_previous_.size() <= index)
       duration_from_previous_.resize(index + 1, 0.0);
     duration_from_previous_[index] = value;
+    invalidateDurationsFromStart(index);
   }
 
   bool empty() const
@@ -154,6 +156,7 @@ public:
     state->update();
     waypoints_.push_front(state);
     duration_from_previous_.push_front(dt);
+    invalidateDurationsFromStart(0);
   }
 
   void insertWayPoint(std::size_t index, const robot_state::RobotState &state, double dt)
@@ -166,6 +169,7 @@ public:
     state->update();
     waypoints_.insert(waypoints_.begin() + index, state);
     duration_from_previous_.insert(duration_from_previous_.begin() + index, dt);
+    invalidateDurationsFromStart(index);
   }
 
   void append(const RobotTrajectory &source, double dt);
@@ -199,6 +203,12 @@ public:
 
   void reverse();
 
+  /** \brief Replace the waypoints with states spaced \e dt apart in time, computed in one pass by linear interpolation
+      between the original waypoints (see getStateAtDurationFromStart()). The last waypoint is kept, so the last duration
+      may be shorter than \e dt. If a group is set, only the variables of the group are interpolated; all other values
+      (including velocities and accelerations) are copied from the preceding original waypoint. */
+  void resample(double dt);
+
   void unwind();
   void unwind(const robot_state::RobotState &state);
 
@@ -210,6 +220,13 @@ public:
    */
   void findWayPointIndicesForDurationAfterStart(const double& duration, int& before, int& after, double &blend) const;
 
+  /** @brief Same as findWayPointIndicesForDurationAfterStart() above, but the search starts at the waypoint index \e cursor,
+   *  which is updated to the index found. When the queried durations increase monotonically (e.g., for playback), passing
+   *  the same cursor to each call (starting at 0) makes the lookup constant time on average. The cursor is only a hint:
+   *  any value gives the same result.
+   */
+  void findWayPointIndicesForDurationAfterStart(const double& duration, int& before, int& after, double &blend, std::size_t &cursor) const;
+
   // TODO support visitor function for interpolation, or at least different types.
   /** @brief Gets a robot state corresponding to a supplied duration from start for the trajectory, using linear time interpolation.
    *  @param The duration from start.
@@ -219,12 +236,38 @@ public:
   bool getStateAtDurationFromStart(const double request_duration,
                                    robot_state::RobotStatePtr& output_state) const;
 
+  /** @brief Same as getStateAtDurationFromStart() above, with the waypoint lookup starting at \e cursor
+   *  (see findWayPointIndicesForDurationAfterStart()).
+   */
+  bool getStateAtDurationFromStart(const double request_duration,
+                                   robot_state::RobotStatePtr& output_state, std::size_t &cursor) const;
+
 private:
 
+  /** \brief Mark the cached durations from start as out of date, from waypoint \e index on */
+  void invalidateDurationsFromStart(std::size_t index)
+  {
+    if (duration_from_start_count_ > index)
+      duration_from_start_count_ = index;
+  }
+
+  /** \brief Bring the cached durations from start up to date */
+  void updateDurationsFromStart() const;
+
+  /** \brief Compute the output of findWayPointIndicesForDurationAfterStart() from the index of the first waypoint that is
+      reached at or after \e duration */
+  void getBlendForWayPointIndex(std::size_t index, double duration, int& before, int& after, double &blend) const;
+
   robot_model::RobotModelConstPtr robot_model_;
   const robot_model::JointModelGroup *group_;
   std::deque<robot_state::RobotStatePtr> waypoints_;
   std::deque<double> duration_from_previous_;
+
+  /** \brief The durations from start of the waypoints (the prefix sums of duration_from_previous_). Only the first
+      duration_from_start_count_ values are up to date; the rest are computed on demand, so updating the cache from a
+      const function is not safe if other threads query the same trajectory at the same time. */
+  mutable std::vector<double> duration_from_start_;
+  mutable std::size_t duration_from_start_count_;
 };
 
 typedef boost::shared_ptr<RobotTrajectory> RobotTrajectoryPtr;
@@ -0,0 +1,185 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2013, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#ifndef MOVEIT_ROBOT_TRAJECTORY_ROBOT_TRAJECTORY_BUFFER_
+#define MOVEIT_ROBOT_TRAJECTORY_ROBOT_TRAJECTORY_BUFFER_
+
+#include <moveit/robot_trajectory/robot_trajectory.h>
+#include <vector>
+
+namespace robot_trajectory
+{
+
+/** \brief A compact representation of a trajectory: the positions, velocities and accelerations of all waypoints are
+    stored in one contiguous buffer (one row per waypoint, with the positions, velocities and accelerations of all the
+    variables of the robot model, in that order), next to the durations between waypoints. No RobotState is kept for
+    the waypoints; states are only constructed on demand, with getWayPoint(). This makes passes over all waypoints
+    (time parameterization, conversion to messages, etc.) operate on flat memory. */
+class RobotTrajectoryBuffer
+{
+public:
+  RobotTrajectoryBuffer(const robot_model::RobotModelConstPtr &robot_model, const std::string &group);
+
+  /** \brief Construct a buffer with the same content as \e trajectory */
+  explicit RobotTrajectoryBuffer(const RobotTrajectory &trajectory);
+
+  const robot_model::RobotModelConstPtr& getRobotModel() const
+  {
+    return robot_model_;
+  }
+
+  const robot_model::JointModelGroup* getGroup() const
+  {
+    return group_;
+  }
+
+  const std::string& getGroupName() const;
+
+  std::size_t getWayPointCount() const
+  {
+    return durations_.size();
+  }
+
+  bool empty() const
+  {
+    return durations_.empty();
+  }
+
+  /** \brief True if velocities are stored for the waypoints (if they were set for all waypoints added so far) */
+  bool hasVelocities() const
+  {
+    return has_velocities_;
+  }
+
+  /** \brief True if accelerations are stored for the waypoints (if they were set for all waypoints added so far) */
+  bool hasAccelerations() const
+  {
+    return has_accelerations_;
+  }
+
+  /** \brief Get the positions of the variables at waypoint \e index; the array has RobotModel::getVariableCount() elements */
+  const double* getWayPointPositions(std::size_t index) const
+  {
+    return &data_[index * row_size_];
+  }
+
+  double* getWayPointPositions(std::size_t index)
+  {
+    return &data_[index * row_size_];
+  }
+
+  const double* getWayPointVelocities(std::size_t index) const
+  {
+    return &data_[index * row_size_ + variable_count_];
+  }
+
+  double* getWayPointVelocities(std::size_t index)
+  {
+    return &data_[index * row_size_ + variable_count_];
+  }
+
+  const double* getWayPointAccelerations(std::size_t index) const
+  {
+    return &data_[index * row_size_ + 2 * variable_count_];
+  }
+
+  double* getWayPointAccelerations(std::size_t index)
+  {
+    return &data_[index * row_size_ + 2 * variable_count_];
+  }
+
+  const std::vector<double>& getWayPointDurations() const
+  {
+    return durations_;
+  }
+
+  double getWayPointDurationFromPrevious(std::size_t index) const
+  {
+    return durations_[index];
+  }
+
+  void setWayPointDurationFromPrevious(std::size_t index, double value)
+  {
+    durations_[index] = value;
+  }
+
+  /** \brief Returns the duration after start that waypoint \e index will be reached */
+  double getWayPointDurationFromStart(std::size_t index) const;
+
+  /** \brief Reserve memory for \e count waypoints */
+  void reserve(std::size_t count);
+
+  void clear();
+
+  /** \brief Append the values of \e state as a new waypoint. Velocities and accelerations are kept only if all waypoints have them. */
+  void addSuffixWayPoint(const robot_state::RobotState &state, double dt);
+
+  /** \brief Append a waypoint with the positions \e positions (RobotModel::getVariableCount() elements). */
+  void addSuffixWayPoint(const double *positions, double dt);
+
+  /** \brief Set the variable values of \e state to the ones of waypoint \e index. Velocities and accelerations are
+      copied if they are available. */
+  void getWayPoint(std::size_t index, robot_state::RobotState &state) const;
+
+  /** \brief Replace the content of this buffer with that of \e trajectory */
+  void setRobotTrajectory(const RobotTrajectory &trajectory);
+
+  /** \brief Fill \e trajectory with one RobotState per waypoint. The states are constructed as copies of \e reference_state
+      (so that attached bodies are kept), with the variable values of the waypoints. */
+  void getRobotTrajectory(const robot_state::RobotState &reference_state, RobotTrajectory &trajectory) const;
+
+  /** \brief Same as RobotTrajectory::getRobotTrajectoryMsg(), computed directly from the buffer */
+  void getRobotTrajectoryMsg(moveit_msgs::RobotTrajectory &trajectory) const;
+
+private:
+
+  void addRow(double dt);
+
+  robot_model::RobotModelConstPtr     robot_model_;
+  const robot_model::JointModelGroup *group_;
+  std::size_t                         variable_count_;
+  std::size_t                         row_size_;
+
+  std::vector<double>                 data_;
+  std::vector<double>                 durations_;
+  bool                                has_velocities_;
+  bool                                has_accelerations_;
+};
+
+typedef boost::shared_ptr<RobotTrajectoryBuffer> RobotTrajectoryBufferPtr;
+typedef boost::shared_ptr<const RobotTrajectoryBuffer> RobotTrajectoryBufferConstPtr;
+
+}
+
+#endif
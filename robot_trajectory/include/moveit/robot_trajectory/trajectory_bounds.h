@@ -0,0 +1,110 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2013, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#ifndef MOVEIT_ROBOT_TRAJECTORY_TRAJECTORY_BOUNDS_
+#define MOVEIT_ROBOT_TRAJECTORY_TRAJECTORY_BOUNDS_
+
+#include <moveit/robot_trajectory/robot_trajectory.h>
+#include <vector>
+
+namespace robot_trajectory
+{
+
+/** \brief The position and velocity bounds of the active joints of a group, compiled into flat arrays (indexed by
+    the variables of single-dof joints, with a mask for continuous joints), so that the bounds of all the waypoints of a
+    trajectory can be checked or enforced in one pass, without calls to the joint models for every waypoint. Joints
+    with multiple variables (planar, floating) are still handled by their joint models.
+
+    The bounds are copied when the table is constructed; if the bounds of the joints change, call update(). The
+    results are the same as for RobotState::satisfiesBounds() and RobotState::enforceBounds() called for every
+    waypoint. */
+class TrajectoryBounds
+{
+public:
+  TrajectoryBounds(const robot_model::JointModelGroup *group);
+
+  const robot_model::JointModelGroup* getGroup() const
+  {
+    return group_;
+  }
+
+  /** \brief Copy the bounds of the joints of the group again */
+  void update();
+
+  /** \brief Check whether \e state satisfies the bounds of the group (velocities are checked only if the state has
+      velocities) */
+  bool satisfiesBounds(const robot_state::RobotState &state, double margin = 0.0) const;
+
+  /** \brief Return the index of the first waypoint of \e trajectory that does not satisfy the bounds, or
+      trajectory.getWayPointCount() if all waypoints satisfy them */
+  std::size_t findFirstViolation(const RobotTrajectory &trajectory, double margin = 0.0) const;
+
+  /** \brief Check whether all waypoints of \e trajectory satisfy the bounds */
+  bool satisfiesBounds(const RobotTrajectory &trajectory, double margin = 0.0) const
+  {
+    return findFirstViolation(trajectory, margin) == trajectory.getWayPointCount();
+  }
+
+  /** \brief Bring \e state within bounds: positions are clamped (continuous joints are wrapped to [-pi, pi]) and so are
+      velocities, if the state has them. Return true if the state was changed. */
+  bool enforceBounds(robot_state::RobotState &state) const;
+
+  /** \brief Bring all waypoints of \e trajectory within bounds. Return the index of the first waypoint that was
+      changed, or trajectory.getWayPointCount() if no waypoint was changed. */
+  std::size_t enforceBounds(RobotTrajectory &trajectory) const;
+
+private:
+
+  const robot_model::JointModelGroup *group_;
+
+  /// the single-dof active joints of the group and, for each of them, the index of its variable in the state
+  std::vector<const robot_model::JointModel*> joints_;
+  std::vector<int> index_;
+
+  /// the bounds of the variables in index_
+  std::vector<double> min_position_;
+  std::vector<double> max_position_;
+  std::vector<double> min_velocity_;
+  std::vector<double> max_velocity_;
+
+  /// 1 for the variables of continuous joints, which are wrapped instead of clamped
+  std::vector<char> continuous_;
+
+  /// the remaining active joints, checked and enforced through their joint models
+  std::vector<const robot_model::JointModel*> other_joints_;
+};
+
+}
+
+#endif
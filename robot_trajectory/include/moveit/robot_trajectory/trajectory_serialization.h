@@ -0,0 +1,233 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2013, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#ifndef MOVEIT_ROBOT_TRAJECTORY_TRAJECTORY_SERIALIZATION_
+#define MOVEIT_ROBOT_TRAJECTORY_TRAJECTORY_SERIALIZATION_
+
+#include <moveit/robot_trajectory/robot_trajectory.h>
+#include <boost/cstdint.hpp>
+#include <iostream>
+#include <vector>
+
+namespace robot_trajectory
+{
+
+/** \brief Binary records for logging states and trajectories.
+
+    A record starts with a fixed header of BINARY_RECORD_HEADER_SIZE bytes:
+
+    | offset | type     | content                                                  |
+    |--------|----------|----------------------------------------------------------|
+    | 0      | char[4]  | "MVBR"                                                   |
+    | 4      | uint16   | format version (BINARY_RECORD_VERSION)                   |
+    | 6      | uint8    | record kind (BinaryRecordKind)                           |
+    | 7      | uint8    | flags (BinaryRecordFlags)                                |
+    | 8      | uint64   | hash of the robot model (computeRobotModelHash())        |
+    | 16     | uint64   | size of the record in bytes, header included             |
+    | 24     | uint32   | number of variables                                      |
+    | 28     | uint32   | number of waypoints (1 for states)                       |
+    | 32     | uint32   | size of the name table in bytes                          |
+    | 36     | uint32   | reserved (0)                                             |
+
+    The name table follows: the group name and then the variable names, each as a uint32 length and the
+    characters. Then come the data sections: the durations from the previous waypoint (float64, trajectories
+    only), the positions, and the velocities and accelerations if the corresponding flags are set. Values are
+    stored by variable (all the waypoints of the first variable, then of the second, ...) as float64, or
+    float32 if BINARY_RECORD_FLOAT32 is set. Every section, the name table included, is padded to a multiple
+    of 8 bytes, so records can be concatenated in a file and accessed in place when the file is memory mapped.
+    Numbers are in the byte order of the machine that wrote the record. */
+static const std::size_t BINARY_RECORD_HEADER_SIZE = 40;
+static const boost::uint16_t BINARY_RECORD_VERSION = 1;
+
+enum BinaryRecordKind
+{
+  BINARY_RECORD_STATE = 0,
+  BINARY_RECORD_TRAJECTORY = 1
+};
+
+enum BinaryRecordFlags
+{
+  BINARY_RECORD_FLOAT32 = 1,
+  BINARY_RECORD_VELOCITIES = 2,
+  BINARY_RECORD_ACCELERATIONS = 4
+};
+
+/** \brief Compute a hash of the model name and the names of the variables, in order. Records written for a
+    model with the same hash are read without looking up variable names. */
+boost::uint64_t computeRobotModelHash(const robot_model::RobotModel &model);
+
+/** \brief Append a record for \e state to \e buffer. If \e single_precision is true, values are stored as float32 */
+void serializeRobotState(const robot_state::RobotState &state, std::vector<char> &buffer, bool single_precision = false);
+
+/** \brief Append a record for \e trajectory to \e buffer. Velocities (accelerations) are stored only if all
+    waypoints have them. If \e single_precision is true, values are stored as float32 */
+void serializeRobotTrajectory(const RobotTrajectory &trajectory, std::vector<char> &buffer, bool single_precision = false);
+
+/** \brief A read-only view of a record that is already in memory (e.g., in a memory mapped file). No data is
+    copied; the memory must stay valid while the view is used. */
+class BinaryRecordView
+{
+public:
+
+  BinaryRecordView();
+
+  /** \brief Parse the record at the start of \e data (at most \e size bytes are read). Check isValid() after construction. */
+  BinaryRecordView(const char *data, std::size_t size);
+
+  /** \brief True if a complete record of a known version was found */
+  bool isValid() const
+  {
+    return data_ != NULL;
+  }
+
+  /** \brief The size of the record in bytes; the next record of a stream starts this many bytes after this one */
+  std::size_t getRecordSize() const
+  {
+    return record_size_;
+  }
+
+  BinaryRecordKind getKind() const
+  {
+    return kind_;
+  }
+
+  boost::uint64_t getModelHash() const
+  {
+    return model_hash_;
+  }
+
+  bool isSinglePrecision() const
+  {
+    return flags_ & BINARY_RECORD_FLOAT32;
+  }
+
+  bool hasVelocities() const
+  {
+    return flags_ & BINARY_RECORD_VELOCITIES;
+  }
+
+  bool hasAccelerations() const
+  {
+    return flags_ & BINARY_RECORD_ACCELERATIONS;
+  }
+
+  const std::string& getGroupName() const
+  {
+    return group_name_;
+  }
+
+  const std::vector<std::string>& getVariableNames() const
+  {
+    return variable_names_;
+  }
+
+  std::size_t getVariableCount() const
+  {
+    return variable_names_.size();
+  }
+
+  std::size_t getWayPointCount() const
+  {
+    return waypoint_count_;
+  }
+
+  /** \brief The duration from the previous waypoint (0 for states) */
+  double getWayPointDurationFromPrevious(std::size_t waypoint) const;
+
+  double getPosition(std::size_t waypoint, std::size_t variable) const
+  {
+    return getValue(positions_, waypoint, variable);
+  }
+
+  double getVelocity(std::size_t waypoint, std::size_t variable) const
+  {
+    return velocities_ ? getValue(velocities_, waypoint, variable) : 0.0;
+  }
+
+  double getAcceleration(std::size_t waypoint, std::size_t variable) const
+  {
+    return accelerations_ ? getValue(accelerations_, waypoint, variable) : 0.0;
+  }
+
+  /** \brief Get the positions of \e variable at all waypoints, if the record is in double precision (NULL otherwise) */
+  const double* getPositionColumn(std::size_t variable) const
+  {
+    return isSinglePrecision() ? NULL : reinterpret_cast<const double*>(positions_) + variable * waypoint_count_;
+  }
+
+  /** \brief Get the positions of \e variable at all waypoints, if the record is in single precision (NULL otherwise) */
+  const float* getPositionColumnFloat(std::size_t variable) const
+  {
+    return isSinglePrecision() ? reinterpret_cast<const float*>(positions_) + variable * waypoint_count_ : NULL;
+  }
+
+private:
+
+  double getValue(const char *section, std::size_t waypoint, std::size_t variable) const;
+
+  const char              *data_;
+  std::size_t              record_size_;
+  BinaryRecordKind         kind_;
+  boost::uint8_t           flags_;
+  boost::uint64_t          model_hash_;
+  std::size_t              waypoint_count_;
+  std::string              group_name_;
+  std::vector<std::string> variable_names_;
+  const char              *durations_;
+  const char              *positions_;
+  const char              *velocities_;
+  const char              *accelerations_;
+};
+
+/** \brief Set the variables of \e state from a state record. Variables are matched by name if the record was
+    written for a different model; variables not in the record keep their values. Returns false if the record
+    is not a valid state record. */
+bool deserializeRobotState(const BinaryRecordView &record, robot_state::RobotState &state);
+
+/** \brief Replace the content of \e trajectory with the waypoints of a trajectory record. The waypoints are copies
+    of \e reference_state with the variable values of the record. Returns false if the record is not a valid
+    trajectory record. */
+bool deserializeRobotTrajectory(const BinaryRecordView &record, const robot_state::RobotState &reference_state,
+                                RobotTrajectory &trajectory);
+
+/** \brief Write a record for \e trajectory to \e out. Returns false if writing failed */
+bool writeRobotTrajectory(std::ostream &out, const RobotTrajectory &trajectory, bool single_precision = false);
+
+/** \brief Read the next record from \e in into \e trajectory. Returns false at the end of the stream or if the
+    record is not a valid trajectory record. */
+bool readRobotTrajectory(std::istream &in, const robot_state::RobotState &reference_state, RobotTrajectory &trajectory);
+
+}
+
+#endif
@@ -36,13 +36,16 @@
 
 #include <moveit/robot_trajectory/robot_trajectory.h>
 #include <moveit/robot_state/conversions.h>
+#include <moveit/robot_state/variable_mapping.h>
 #include <eigen_conversions/eigen_msg.h>
 #include <boost/math/constants/constants.hpp>
 #include <numeric>
+#include <algorithm>
 
 robot_trajectory::RobotTrajectory::RobotTrajectory(const robot_model::RobotModelConstPtr &kmodel, const std::string &group) :
   robot_model_(kmodel),
-  group_(group.empty() ? NULL : kmodel->getJointModelGroup(group))
+  group_(group.empty() ? NULL : kmodel->getJointModelGroup(group)),
+  duration_from_start_count_(0)
 {
 }
 
@@ -73,6 +76,8 @@ void robot_trajectory::RobotTrajectory::swap(robot_trajectory::RobotTrajectory &
   std::swap(group_, other.group_);
   waypoints_.swap(other.waypoints_);
   duration_from_previous_.swap(other.duration_from_previous_);
+  duration_from_start_.swap(other.duration_from_start_);
+  std::swap(duration_from_start_count_, other.duration_from_start_count_);
 }
 
 void robot_trajectory::RobotTrajectory::append(const RobotTrajectory &source, double dt)
@@ -82,6 +87,7 @@ void robot_trajectory::RobotTrajectory::append(const RobotTrajectory &source, do
   duration_from_previous_.insert(duration_from_previous_.end(), source.duration_from_previous_.begin(), source.duration_from_previous_.end());
   if (duration_from_previous_.size() > index)
     duration_from_previous_[index] += dt;
+  invalidateDurationsFromStart(index);
 }
 
 void robot_trajectory::RobotTrajectory::reverse()
@@ -93,6 +99,44 @@ void robot_trajectory::RobotTrajectory::reverse()
     std::reverse(duration_from_previous_.begin(), duration_from_previous_.end());
     duration_from_previous_.pop_back();
   }
+  invalidateDurationsFromStart(0);
+}
+
+void robot_trajectory::RobotTrajectory::resample(double dt)
+{
+  if (waypoints_.empty() || dt <= 0.0)
+    return;
+
+  // the first waypoint keeps its duration from the previous point
+  const double start = getWaypointDurationFromStart(0);
+  const double total = getWaypointDurationFromStart(waypoints_.size() - 1);
+  std::deque<robot_state::RobotStatePtr> waypoints;
+  std::deque<double> durations;
+  std::size_t cursor = 0;
+  for (std::size_t i = 0 ; start + i * dt < total ; ++i)
+  {
+    int before = 0, after = 0;
+    double blend = 1.0;
+    findWayPointIndicesForDurationAfterStart(start + i * dt, before, after, blend, cursor);
+    // when the full state is interpolated all transforms become dirty, so they are not copied
+    robot_state::RobotStatePtr state(new robot_state::RobotState(*waypoints_[before], group_ ? robot_state::RobotState::COPY_FULL :
+                                                                 robot_state::RobotState::COPY_VARIABLES));
+    if (group_)
+      waypoints_[before]->interpolate(*waypoints_[after], blend, *state, group_);
+    else
+      waypoints_[before]->interpolate(*waypoints_[after], blend, *state);
+    state->update();
+    waypoints.push_back(state);
+    durations.push_back(i == 0 ? start : dt);
+  }
+
+  // the trajectory still ends at the last waypoint
+  durations.push_back(waypoints.empty() ? total : total - (start + (waypoints.size() - 1) * dt));
+  waypoints.push_back(waypoints_.back());
+
+  waypoints_.swap(waypoints);
+  duration_from_previous_.swap(durations);
+  invalidateDurationsFromStart(0);
 }
 
 void robot_trajectory::RobotTrajectory::unwind()
@@ -179,25 +223,44 @@ void robot_trajectory::RobotTrajectory::clear()
 {
   waypoints_.clear();
   duration_from_previous_.clear();
+  invalidateDurationsFromStart(0);
+}
+
+namespace
+{
+
+// copy the values at the indices \e index of \e values into \e out, reusing the memory of \e out
+inline void copyVariables(const double *values, const std::vector<int> &index, std::vector<double> &out)
+{
+  out.resize(index.size());
+  for (std::size_t j = 0 ; j < index.size() ; ++j)
+    out[j] = values[index[j]];
+}
+
 }
 
 void robot_trajectory::RobotTrajectory::getRobotTrajectoryMsg(moveit_msgs::RobotTrajectory &trajectory) const
 {
-  trajectory = moveit_msgs::RobotTrajectory();
+  // the points already in the message are reused, so the memory allocated for them is not freed and allocated again
+  trajectory.joint_trajectory.header = std_msgs::Header();
+  trajectory.joint_trajectory.joint_names.clear();
+  trajectory.multi_dof_joint_trajectory.header = std_msgs::Header();
+  trajectory.multi_dof_joint_trajectory.joint_names.clear();
   if (waypoints_.empty())
+  {
+    trajectory.joint_trajectory.points.clear();
+    trajectory.multi_dof_joint_trajectory.points.clear();
     return;
+  }
   const std::vector<const robot_model::JointModel*> &jnt = group_ ? group_->getActiveJointModels() : robot_model_->getActiveJointModels();
 
-  std::vector<const robot_model::JointModel*> onedof;
+  std::vector<int> onedof;
   std::vector<const robot_model::JointModel*> mdof;
-  trajectory.joint_trajectory.joint_names.clear();
-  trajectory.multi_dof_joint_trajectory.joint_names.clear();
-
   for (std::size_t i = 0 ; i < jnt.size() ; ++i)
     if (jnt[i]->getVariableCount() == 1)
     {
       trajectory.joint_trajectory.joint_names.push_back(jnt[i]->getName());
-      onedof.push_back(jnt[i]);
+      onedof.push_back(jnt[i]->getFirstVariableIndex());
     }
     else
     {
@@ -208,15 +271,15 @@ void robot_trajectory::RobotTrajectory::getRobotTrajectoryMsg(moveit_msgs::Robot
   {
     trajectory.joint_trajectory.header.frame_id = robot_model_->getModelFrame();
     trajectory.joint_trajectory.header.stamp = ros::Time(0);
-    trajectory.joint_trajectory.points.resize(waypoints_.size());
   }
+  trajectory.joint_trajectory.points.resize(onedof.empty() ? 0 : waypoints_.size());
 
   if (!mdof.empty())
   {
     trajectory.multi_dof_joint_trajectory.header.frame_id = robot_model_->getModelFrame();
     trajectory.multi_dof_joint_trajectory.header.stamp = ros::Time(0);
-    trajectory.multi_dof_joint_trajectory.points.resize(waypoints_.size());
   }
+  trajectory.multi_dof_joint_trajectory.points.resize(mdof.empty() ? 0 : waypoints_.size());
 
   static const ros::Duration zero_duration(0.0);
   double total_time = 0.0;
@@ -224,48 +287,43 @@ void robot_trajectory::RobotTrajectory::getRobotTrajectoryMsg(moveit_msgs::Robot
   {
     if (duration_from_previous_.size() > i)
       total_time += duration_from_previous_[i];
+    const robot_state::RobotState &waypoint = *waypoints_[i];
 
     if (!onedof.empty())
     {
-      trajectory.joint_trajectory.points[i].positions.resize(onedof.size());
-      trajectory.joint_trajectory.points[i].velocities.reserve(onedof.size());
-
-      for (std::size_t j = 0 ; j < onedof.size() ; ++j)
-      {
-        trajectory.joint_trajectory.points[i].positions[j] = waypoints_[i]->getVariablePosition(onedof[j]->getFirstVariableIndex());
-        // if we have velocities/accelerations/effort, copy those too
-        if (waypoints_[i]->hasVelocities())
-          trajectory.joint_trajectory.points[i].velocities.push_back(waypoints_[i]->getVariableVelocity(onedof[j]->getFirstVariableIndex()));
-        if (waypoints_[i]->hasAccelerations())
-          trajectory.joint_trajectory.points[i].accelerations.push_back(waypoints_[i]->getVariableAcceleration(onedof[j]->getFirstVariableIndex()));
-        if (waypoints_[i]->hasEffort())
-          trajectory.joint_trajectory.points[i].effort.push_back(waypoints_[i]->getVariableEffort(onedof[j]->getFirstVariableIndex()));
-      }
-      // clear velocities if we have an incomplete specification
-      if (trajectory.joint_trajectory.points[i].velocities.size() != onedof.size())
-        trajectory.joint_trajectory.points[i].velocities.clear();
-      // clear accelerations if we have an incomplete specification
-      if (trajectory.joint_trajectory.points[i].accelerations.size() != onedof.size())
-        trajectory.joint_trajectory.points[i].accelerations.clear();
-      // clear effort if we have an incomplete specification
-      if (trajectory.joint_trajectory.points[i].effort.size() != onedof.size())
-        trajectory.joint_trajectory.points[i].effort.clear();
+      trajectory_msgs::JointTrajectoryPoint &point = trajectory.joint_trajectory.points[i];
+      copyVariables(waypoint.getVariablePositions(), onedof, point.positions);
+      // if we have velocities/accelerations/effort, copy those too
+      if (waypoint.hasVelocities())
+        copyVariables(waypoint.getVariableVelocities(), onedof, point.velocities);
+      else
+        point.velocities.clear();
+      if (waypoint.hasAccelerations())
+        copyVariables(waypoint.getVariableAccelerations(), onedof, point.accelerations);
+      else
+        point.accelerations.clear();
+      if (waypoint.hasEffort())
+        copyVariables(waypoint.getVariableEffort(), onedof, point.effort);
+      else
+        point.effort.clear();
 
       if (duration_from_previous_.size() > i)
-        trajectory.joint_trajectory.points[i].time_from_start = ros::Duration(total_time);
+        point.time_from_start = ros::Duration(total_time);
       else
-        trajectory.joint_trajectory.points[i].time_from_start = zero_duration;
+        point.time_from_start = zero_duration;
     }
     if (!mdof.empty())
     {
-      trajectory.multi_dof_joint_trajectory.points[i].transforms.resize(mdof.size());
+      trajectory_msgs::MultiDOFJointTrajectoryPoint &point = trajectory.multi_dof_joint_trajectory.points[i];
+      point.transforms.resize(mdof.size());
       for (std::size_t j = 0 ; j < mdof.size() ; ++j)
-        tf::transformEigenToMsg(waypoints_[i]->getJointTransform(mdof[j]),
-                                trajectory.multi_dof_joint_trajectory.points[i].transforms[j]);
+        tf::transformEigenToMsg(waypoint.getJointTransform(mdof[j]), point.transforms[j]);
+      point.velocities.clear();
+      point.accelerations.clear();
       if (duration_from_previous_.size() > i)
-        trajectory.multi_dof_joint_trajectory.points[i].time_from_start = ros::Duration(total_time);
+        point.time_from_start = ros::Duration(total_time);
       else
-        trajectory.multi_dof_joint_trajectory.points[i].time_from_start = zero_duration;
+        point.time_from_start = zero_duration;
     }
   }
 }
@@ -274,23 +332,26 @@ void robot_trajectory::RobotTrajectory::setRobotTrajectoryMsg(const robot_state:
                                                               const trajectory_msgs::JointTrajectory &trajectory)
 {
   // make a copy just in case the next clear() removes the memory for the reference passed in
-  robot_state::RobotState copy = reference_state;
+  robot_state::RobotState copy(reference_state, robot_state::RobotState::COPY_VARIABLES);
   clear();
   std::size_t state_count = trajectory.points.size();
   ros::Time last_time_stamp = trajectory.header.stamp;
   ros::Time this_time_stamp = last_time_stamp;
-  
+
+  // look up the variables only once; this throws an exception for unknown variables, as RobotState does
+  const robot_state::VariableMapping mapping(robot_model_, trajectory.joint_names);
+
   for (std::size_t i = 0 ; i < state_count ; ++i)
   {
     this_time_stamp = trajectory.header.stamp + trajectory.points[i].time_from_start;
-    robot_state::RobotStatePtr st(new robot_state::RobotState(copy));
-    st->setVariablePositions(trajectory.joint_names, trajectory.points[i].positions);
+    robot_state::RobotStatePtr st(new robot_state::RobotState(copy, robot_state::RobotState::COPY_VARIABLES));
+    mapping.setVariablePositions(*st, trajectory.points[i].positions);
     if (!trajectory.points[i].velocities.empty())
-      st->setVariableVelocities(trajectory.joint_names, trajectory.points[i].velocities);
+      mapping.setVariableVelocities(*st, trajectory.points[i].velocities);
     if (!trajectory.points[i].accelerations.empty())
-      st->setVariableAccelerations(trajectory.joint_names, trajectory.points[i].accelerations);
+      mapping.setVariableAccelerations(*st, trajectory.points[i].accelerations);
     if (!trajectory.points[i].effort.empty())
-      st->setVariableEffort(trajectory.joint_names, trajectory.points[i].effort);
+      mapping.setVariableEffort(*st, trajectory.points[i].effort);
     addSuffixWayPoint(st, (this_time_stamp - last_time_stamp).toSec());
     last_time_stamp = this_time_stamp;
   }
@@ -300,40 +361,48 @@ void robot_trajectory::RobotTrajectory::setRobotTrajectoryMsg(const robot_state:
                                                               const moveit_msgs::RobotTrajectory &trajectory)
 {
   // make a copy just in case the next clear() removes the memory for the reference passed in
-  robot_state::RobotState copy = reference_state;
+  robot_state::RobotState copy(reference_state, robot_state::RobotState::COPY_VARIABLES);
   clear();
-  
+
   std::size_t state_count = std::max(trajectory.joint_trajectory.points.size(),
                                      trajectory.multi_dof_joint_trajectory.points.size());
   ros::Time last_time_stamp = trajectory.joint_trajectory.points.empty() ?
     trajectory.multi_dof_joint_trajectory.header.stamp : trajectory.joint_trajectory.header.stamp;
   ros::Time this_time_stamp = last_time_stamp;
-  
+
+  // look up the variables and joints only once; this throws an exception for unknown variables, as RobotState does
+  const robot_state::VariableMapping mapping(robot_model_, trajectory.joint_trajectory.joint_names);
+  std::vector<const robot_model::JointModel*> mdof(trajectory.multi_dof_joint_trajectory.joint_names.size());
+  for (std::size_t j = 0 ; j < mdof.size() ; ++j)
+    mdof[j] = robot_model_->getJointModel(trajectory.multi_dof_joint_trajectory.joint_names[j]);
+
   for (std::size_t i = 0 ; i < state_count ; ++i)
   {
-    robot_state::RobotStatePtr st(new robot_state::RobotState(copy));
+    robot_state::RobotStatePtr st(new robot_state::RobotState(copy, robot_state::RobotState::COPY_VARIABLES));
     if (trajectory.joint_trajectory.points.size() > i)
     {
-      st->setVariablePositions(trajectory.joint_trajectory.joint_names, trajectory.joint_trajectory.points[i].positions);
-      if (!trajectory.joint_trajectory.points[i].velocities.empty())
-        st->setVariableVelocities(trajectory.joint_trajectory.joint_names, trajectory.joint_trajectory.points[i].velocities);
-      if (!trajectory.joint_trajectory.points[i].accelerations.empty())
-        st->setVariableAccelerations(trajectory.joint_trajectory.joint_names, trajectory.joint_trajectory.points[i].accelerations);
-      if (!trajectory.joint_trajectory.points[i].effort.empty())
-        st->setVariableEffort(trajectory.joint_trajectory.joint_names, trajectory.joint_trajectory.points[i].effort);
-      this_time_stamp = trajectory.joint_trajectory.header.stamp + trajectory.joint_trajectory.points[i].time_from_start;
+      const trajectory_msgs::JointTrajectoryPoint &point = trajectory.joint_trajectory.points[i];
+      mapping.setVariablePositions(*st, point.positions);
+      if (!point.velocities.empty())
+        mapping.setVariableVelocities(*st, point.velocities);
+      if (!point.accelerations.empty())
+        mapping.setVariableAccelerations(*st, point.accelerations);
+      if (!point.effort.empty())
+        mapping.setVariableEffort(*st, point.effort);
+      this_time_stamp = trajectory.joint_trajectory.header.stamp + point.time_from_start;
     }
     if (trajectory.multi_dof_joint_trajectory.points.size() > i)
     {
-      for (std::size_t j = 0 ; j < trajectory.multi_dof_joint_trajectory.joint_names.size() ; ++j)
-      {
-        Eigen::Affine3d t;
-        tf::transformMsgToEigen(trajectory.multi_dof_joint_trajectory.points[i].transforms[j], t);
-        st->setJointPositions(trajectory.multi_dof_joint_trajectory.joint_names[j], t);
-      }
+      for (std::size_t j = 0 ; j < mdof.size() ; ++j)
+        if (mdof[j])
+        {
+          Eigen::Affine3d t;
+          tf::transformMsgToEigen(trajectory.multi_dof_joint_trajectory.points[i].transforms[j], t);
+          st->setJointPositions(mdof[j], t);
+        }
       this_time_stamp = trajectory.multi_dof_joint_trajectory.header.stamp + trajectory.multi_dof_joint_trajectory.points[i].time_from_start;
     }
-    
+
     addSuffixWayPoint(st, (this_time_stamp - last_time_stamp).toSec());
     last_time_stamp = this_time_stamp;
   }
@@ -347,7 +416,55 @@ void robot_trajectory::RobotTrajectory::setRobotTrajectoryMsg(const robot_state:
   setRobotTrajectoryMsg(st, trajectory);
 }
 
+namespace
+{
+// the number of waypoints a cursor is advanced one by one before falling back to binary search
+const std::size_t CURSOR_LINEAR_STEPS = 8;
+}
+
+void robot_trajectory::RobotTrajectory::updateDurationsFromStart() const
+{
+  const std::size_t count = duration_from_previous_.size();
+  duration_from_start_.resize(count);
+  if (duration_from_start_count_ > count)
+    duration_from_start_count_ = count;
+  double time = duration_from_start_count_ > 0 ? duration_from_start_[duration_from_start_count_ - 1] : 0.0;
+  for (std::size_t i = duration_from_start_count_ ; i < count ; ++i)
+  {
+    time += duration_from_previous_[i];
+    duration_from_start_[i] = time;
+  }
+  duration_from_start_count_ = count;
+}
+
+void robot_trajectory::RobotTrajectory::getBlendForWayPointIndex(std::size_t index, double duration, int& before, int& after, double &blend) const
+{
+  std::size_t num_points = std::min(waypoints_.size(), duration_from_start_.size());
+  if (num_points == 0)
+  {
+    before = 0;
+    after = 0;
+    blend = 0.0;
+    return;
+  }
+  before = std::max<int>((int)index - 1, 0);
+  after = std::min<int>(index, num_points - 1);
+
+  // Compute duration blend
+  if (after == before)
+    blend = 1.0;
+  else
+    blend = (duration - duration_from_start_[before]) / duration_from_previous_[index];
+}
+
 void robot_trajectory::RobotTrajectory::findWayPointIndicesForDurationAfterStart(const double& duration, int& before, int& after, double &blend) const
+{
+  std::size_t cursor = 0;
+  findWayPointIndicesForDurationAfterStart(duration, before, after, blend, cursor);
+}
+
+void robot_trajectory::RobotTrajectory::findWayPointIndicesForDurationAfterStart(const double& duration, int& before, int& after, double &blend,
+                                                                                 std::size_t &cursor) const
 {
   if (duration < 0.0)
   {
@@ -357,24 +474,23 @@ void robot_trajectory::RobotTrajectory::findWayPointIndicesForDurationAfterStart
     return;
   }
 
-  // Find indicies
-  std::size_t index = 0, num_points = waypoints_.size();
-  double running_duration = 0.0;
-  for ( ; index < num_points; ++index)
+  // Find indicies: the first waypoint reached at or after duration
+  updateDurationsFromStart();
+  const std::vector<double> &times = duration_from_start_;
+  std::size_t index;
+  if (cursor < times.size() && (cursor == 0 || times[cursor - 1] < duration))
   {
-    running_duration += duration_from_previous_[index];
-    if (running_duration >= duration)
-      break;
+    index = cursor;
+    for (std::size_t k = 0 ; k < CURSOR_LINEAR_STEPS && index < times.size() && times[index] < duration ; ++k)
+      ++index;
+    if (index < times.size() && times[index] < duration)
+      index = std::lower_bound(times.begin() + index, times.end(), duration) - times.begin();
   }
-  before = std::max<int>(index - 1, 0);
-  after = std::min<int>(index, num_points - 1);
-
-  // Compute duration blend
-  double before_time = running_duration - duration_from_previous_[index];
-  if (after == before)
-    blend = 1.0;
   else
-    blend = (duration - before_time) / duration_from_previous_[index];
+    index = std::lower_bound(times.begin(), times.end(), duration) - times.begin();
+  cursor = index;
+
+  getBlendForWayPointIndex(index, duration, before, after, blend);
 }
 
 double robot_trajectory::RobotTrajectory::getWaypointDurationFromStart(std::size_t index) const
@@ -383,21 +499,26 @@ double robot_trajectory::RobotTrajectory::getWaypointDurationFromStart(std::size
     return 0.0;
   if (index >= duration_from_previous_.size())
     index = duration_from_previous_.size() - 1;
-  
-  double time = 0.0;
-  for (std::size_t i = 0; i <= index; ++i)
-    time += duration_from_previous_[i];
-  return time;
+
+  updateDurationsFromStart();
+  return duration_from_start_[index];
 }
 
 bool robot_trajectory::RobotTrajectory::getStateAtDurationFromStart(const double request_duration, robot_state::RobotStatePtr& output_state) const
+{
+  std::size_t cursor = 0;
+  return getStateAtDurationFromStart(request_duration, output_state, cursor);
+}
+
+bool robot_trajectory::RobotTrajectory::getStateAtDurationFromStart(const double request_duration, robot_state::RobotStatePtr& output_state,
+                                                                    std::size_t &cursor) const
 {
   if (!getWayPointCount())
     return false;
 
   int before = 0, after = 0;
   double blend = 1.0;
-  findWayPointIndicesForDurationAfterStart(request_duration, before, after, blend);
+  findWayPointIndicesForDurationAfterStart(request_duration, before, after, blend, cursor);
   //logDebug("Interpolating %.3f of the way between index %d and %d.", blend, before, after);
   waypoints_[before]->interpolate(*waypoints_[after], blend, *output_state);
   return true;
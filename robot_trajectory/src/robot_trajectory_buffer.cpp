@@ -0,0 +1,242 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2013, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#include <moveit/robot_trajectory/robot_trajectory_buffer.h>
+#include <eigen_conversions/eigen_msg.h>
+#include <algorithm>
+
+robot_trajectory::RobotTrajectoryBuffer::RobotTrajectoryBuffer(const robot_model::RobotModelConstPtr &robot_model, const std::string &group) :
+  robot_model_(robot_model),
+  group_(group.empty() ? NULL : robot_model->getJointModelGroup(group)),
+  variable_count_(robot_model->getVariableCount()),
+  row_size_(3 * variable_count_),
+  has_velocities_(true),
+  has_accelerations_(true)
+{
+}
+
+robot_trajectory::RobotTrajectoryBuffer::RobotTrajectoryBuffer(const RobotTrajectory &trajectory) :
+  robot_model_(trajectory.getRobotModel()),
+  group_(trajectory.getGroup()),
+  variable_count_(robot_model_->getVariableCount()),
+  row_size_(3 * variable_count_),
+  has_velocities_(true),
+  has_accelerations_(true)
+{
+  setRobotTrajectory(trajectory);
+}
+
+const std::string& robot_trajectory::RobotTrajectoryBuffer::getGroupName() const
+{
+  if (group_)
+    return group_->getName();
+  static const std::string empty;
+  return empty;
+}
+
+double robot_trajectory::RobotTrajectoryBuffer::getWayPointDurationFromStart(std::size_t index) const
+{
+  if (durations_.empty())
+    return 0.0;
+  if (index >= durations_.size())
+    index = durations_.size() - 1;
+  double duration = 0.0;
+  for (std::size_t i = 0 ; i <= index ; ++i)
+    duration += durations_[i];
+  return duration;
+}
+
+void robot_trajectory::RobotTrajectoryBuffer::reserve(std::size_t count)
+{
+  data_.reserve(count * row_size_);
+  durations_.reserve(count);
+}
+
+void robot_trajectory::RobotTrajectoryBuffer::clear()
+{
+  data_.clear();
+  durations_.clear();
+  has_velocities_ = true;
+  has_accelerations_ = true;
+}
+
+void robot_trajectory::RobotTrajectoryBuffer::addRow(double dt)
+{
+  data_.resize(data_.size() + row_size_, 0.0);
+  durations_.push_back(dt);
+}
+
+void robot_trajectory::RobotTrajectoryBuffer::addSuffixWayPoint(const robot_state::RobotState &state, double dt)
+{
+  addRow(dt);
+  double *row = getWayPointPositions(durations_.size() - 1);
+  const double *p = state.getVariablePositions();
+  std::copy(p, p + variable_count_, row);
+  if (state.hasVelocities())
+  {
+    const double *v = state.getVariableVelocities();
+    std::copy(v, v + variable_count_, row + variable_count_);
+  }
+  else
+    has_velocities_ = false;
+  if (state.hasAccelerations())
+  {
+    const double *a = state.getVariableAccelerations();
+    std::copy(a, a + variable_count_, row + 2 * variable_count_);
+  }
+  else
+    has_accelerations_ = false;
+}
+
+void robot_trajectory::RobotTrajectoryBuffer::addSuffixWayPoint(const double *positions, double dt)
+{
+  addRow(dt);
+  std::copy(positions, positions + variable_count_, getWayPointPositions(durations_.size() - 1));
+  has_velocities_ = false;
+  has_accelerations_ = false;
+}
+
+void robot_trajectory::RobotTrajectoryBuffer::getWayPoint(std::size_t index, robot_state::RobotState &state) const
+{
+  state.setVariablePositions(getWayPointPositions(index));
+  if (has_velocities_)
+    state.setVariableVelocities(getWayPointVelocities(index));
+  if (has_accelerations_)
+    state.setVariableAccelerations(getWayPointAccelerations(index));
+}
+
+void robot_trajectory::RobotTrajectoryBuffer::setRobotTrajectory(const RobotTrajectory &trajectory)
+{
+  clear();
+  const std::size_t count = trajectory.getWayPointCount();
+  reserve(count);
+  for (std::size_t i = 0 ; i < count ; ++i)
+    addSuffixWayPoint(trajectory.getWayPoint(i), trajectory.getWayPointDurationFromPrevious(i));
+}
+
+void robot_trajectory::RobotTrajectoryBuffer::getRobotTrajectory(const robot_state::RobotState &reference_state, RobotTrajectory &trajectory) const
+{
+  trajectory.clear();
+  for (std::size_t i = 0 ; i < durations_.size() ; ++i)
+  {
+    robot_state::RobotStatePtr st(new robot_state::RobotState(reference_state));
+    getWayPoint(i, *st);
+    trajectory.addSuffixWayPoint(st, durations_[i]);
+  }
+}
+
+void robot_trajectory::RobotTrajectoryBuffer::getRobotTrajectoryMsg(moveit_msgs::RobotTrajectory &trajectory) const
+{
+  trajectory = moveit_msgs::RobotTrajectory();
+  if (durations_.empty())
+    return;
+  const std::vector<const robot_model::JointModel*> &jnt = group_ ? group_->getActiveJointModels() : robot_model_->getActiveJointModels();
+
+  std::vector<const robot_model::JointModel*> onedof;
+  std::vector<const robot_model::JointModel*> mdof;
+  for (std::size_t i = 0 ; i < jnt.size() ; ++i)
+    if (jnt[i]->getVariableCount() == 1)
+    {
+      trajectory.joint_trajectory.joint_names.push_back(jnt[i]->getName());
+      onedof.push_back(jnt[i]);
+    }
+    else
+    {
+      trajectory.multi_dof_joint_trajectory.joint_names.push_back(jnt[i]->getName());
+      mdof.push_back(jnt[i]);
+    }
+
+  const std::size_t count = durations_.size();
+  if (!onedof.empty())
+  {
+    trajectory.joint_trajectory.header.frame_id = robot_model_->getModelFrame();
+    trajectory.joint_trajectory.header.stamp = ros::Time(0);
+    trajectory.joint_trajectory.points.resize(count);
+  }
+  if (!mdof.empty())
+  {
+    trajectory.multi_dof_joint_trajectory.header.frame_id = robot_model_->getModelFrame();
+    trajectory.multi_dof_joint_trajectory.header.stamp = ros::Time(0);
+    trajectory.multi_dof_joint_trajectory.points.resize(count);
+  }
+
+  // the variable indices of the single dof joints, so the inner loops only index into the flat rows
+  std::vector<int> index(onedof.size());
+  for (std::size_t j = 0 ; j < onedof.size() ; ++j)
+    index[j] = onedof[j]->getFirstVariableIndex();
+
+  Eigen::Affine3d transform;
+  double total_time = 0.0;
+  for (std::size_t i = 0 ; i < count ; ++i)
+  {
+    total_time += durations_[i];
+    const ros::Duration time_from_start(total_time);
+    const double *p = getWayPointPositions(i);
+
+    if (!onedof.empty())
+    {
+      trajectory_msgs::JointTrajectoryPoint &point = trajectory.joint_trajectory.points[i];
+      point.positions.resize(onedof.size());
+      for (std::size_t j = 0 ; j < onedof.size() ; ++j)
+        point.positions[j] = p[index[j]];
+      if (has_velocities_)
+      {
+        const double *v = getWayPointVelocities(i);
+        point.velocities.resize(onedof.size());
+        for (std::size_t j = 0 ; j < onedof.size() ; ++j)
+          point.velocities[j] = v[index[j]];
+      }
+      if (has_accelerations_)
+      {
+        const double *a = getWayPointAccelerations(i);
+        point.accelerations.resize(onedof.size());
+        for (std::size_t j = 0 ; j < onedof.size() ; ++j)
+          point.accelerations[j] = a[index[j]];
+      }
+      point.time_from_start = time_from_start;
+    }
+
+    if (!mdof.empty())
+    {
+      trajectory_msgs::MultiDOFJointTrajectoryPoint &point = trajectory.multi_dof_joint_trajectory.points[i];
+      point.transforms.resize(mdof.size());
+      for (std::size_t j = 0 ; j < mdof.size() ; ++j)
+      {
+        mdof[j]->computeTransform(p + mdof[j]->getFirstVariableIndex(), transform);
+        tf::transformEigenToMsg(transform, point.transforms[j]);
+      }
+      point.time_from_start = time_from_start;
+    }
+  }
+}
@@ -0,0 +1,188 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2013, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#include <moveit/robot_trajectory/trajectory_bounds.h>
+#include <boost/math/constants/constants.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace
+{
+
+inline double wrapAngle(double v)
+{
+  // same as RevoluteJointModel::enforcePositionBounds() for continuous joints
+  if (v <= -boost::math::constants::pi<double>() || v > boost::math::constants::pi<double>())
+  {
+    v = fmod(v, 2.0 * boost::math::constants::pi<double>());
+    if (v <= -boost::math::constants::pi<double>())
+      v += 2.0 * boost::math::constants::pi<double>();
+    else
+      if (v > boost::math::constants::pi<double>())
+        v -= 2.0 * boost::math::constants::pi<double>();
+  }
+  return v;
+}
+
+}
+
+robot_trajectory::TrajectoryBounds::TrajectoryBounds(const robot_model::JointModelGroup *group) :
+  group_(group)
+{
+  update();
+}
+
+void robot_trajectory::TrajectoryBounds::update()
+{
+  joints_.clear();
+  index_.clear();
+  min_position_.clear();
+  max_position_.clear();
+  min_velocity_.clear();
+  max_velocity_.clear();
+  continuous_.clear();
+  other_joints_.clear();
+
+  const std::vector<const robot_model::JointModel*> &jm = group_->getActiveJointModels();
+  for (std::size_t i = 0 ; i < jm.size() ; ++i)
+    if (jm[i]->getType() == robot_model::JointModel::REVOLUTE || jm[i]->getType() == robot_model::JointModel::PRISMATIC)
+    {
+      const robot_model::VariableBounds &b = jm[i]->getVariableBounds()[0];
+      joints_.push_back(jm[i]);
+      index_.push_back(jm[i]->getFirstVariableIndex());
+      min_position_.push_back(b.min_position_);
+      max_position_.push_back(b.max_position_);
+      min_velocity_.push_back(b.min_velocity_);
+      max_velocity_.push_back(b.max_velocity_);
+      continuous_.push_back(jm[i]->getType() == robot_model::JointModel::REVOLUTE &&
+                            static_cast<const robot_model::RevoluteJointModel*>(jm[i])->isContinuous() ? 1 : 0);
+    }
+    else
+      other_joints_.push_back(jm[i]);
+}
+
+bool robot_trajectory::TrajectoryBounds::satisfiesBounds(const robot_state::RobotState &state, double margin) const
+{
+  const std::size_t n = index_.size();
+  const double *p = state.getVariablePositions();
+  bool violated = false;
+  for (std::size_t k = 0 ; k < n ; ++k)
+  {
+    const double v = p[index_[k]];
+    violated |= (v < min_position_[k] - margin) | (v > max_position_[k] + margin);
+  }
+  if (state.hasVelocities())
+  {
+    const double *dp = state.getVariableVelocities();
+    for (std::size_t k = 0 ; k < n ; ++k)
+    {
+      const double v = dp[index_[k]];
+      violated |= (v < min_velocity_[k] - margin) | (v > max_velocity_[k] + margin);
+    }
+  }
+  if (violated)
+    return false;
+
+  for (std::size_t k = 0 ; k < other_joints_.size() ; ++k)
+    if (!state.satisfiesBounds(other_joints_[k], margin))
+      return false;
+  return true;
+}
+
+std::size_t robot_trajectory::TrajectoryBounds::findFirstViolation(const RobotTrajectory &trajectory, double margin) const
+{
+  const std::size_t count = trajectory.getWayPointCount();
+  for (std::size_t i = 0 ; i < count ; ++i)
+    if (!satisfiesBounds(trajectory.getWayPoint(i), margin))
+      return i;
+  return count;
+}
+
+bool robot_trajectory::TrajectoryBounds::enforceBounds(robot_state::RobotState &state) const
+{
+  bool changed = false;
+  const std::size_t n = index_.size();
+  const double *p = state.getVariablePositions();
+  for (std::size_t k = 0 ; k < n ; ++k)
+  {
+    const double v = p[index_[k]];
+    const double e = continuous_[k] ? wrapAngle(v) : std::min(std::max(v, min_position_[k]), max_position_[k]);
+    if (e != v)
+    {
+      // setting the joint position marks the transforms dirty and updates mimic joints
+      state.setJointPositions(joints_[k], &e);
+      changed = true;
+    }
+  }
+
+  if (state.hasVelocities())
+  {
+    double *dp = state.getVariableVelocities();
+    for (std::size_t k = 0 ; k < n ; ++k)
+    {
+      double &v = dp[index_[k]];
+      const double e = std::min(std::max(v, min_velocity_[k]), max_velocity_[k]);
+      if (e != v)
+      {
+        v = e;
+        changed = true;
+      }
+    }
+  }
+
+  for (std::size_t k = 0 ; k < other_joints_.size() ; ++k)
+  {
+    const robot_model::JointModel *joint = other_joints_[k];
+    const std::size_t size = joint->getVariableCount() * sizeof(double);
+    std::vector<double> before(state.getJointPositions(joint), state.getJointPositions(joint) + joint->getVariableCount());
+    if (state.hasVelocities())
+      before.insert(before.end(), state.getJointVelocities(joint), state.getJointVelocities(joint) + joint->getVariableCount());
+    state.enforceBounds(joint);
+    if (memcmp(&before[0], state.getJointPositions(joint), size) != 0 ||
+        (state.hasVelocities() && memcmp(&before[joint->getVariableCount()], state.getJointVelocities(joint), size) != 0))
+      changed = true;
+  }
+  return changed;
+}
+
+std::size_t robot_trajectory::TrajectoryBounds::enforceBounds(RobotTrajectory &trajectory) const
+{
+  const std::size_t count = trajectory.getWayPointCount();
+  std::size_t first = count;
+  for (std::size_t i = 0 ; i < count ; ++i)
+    if (enforceBounds(*trajectory.getWayPointPtr(i)) && first == count)
+      first = i;
+  return first;
+}
@@ -0,0 +1,452 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2013, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#include <moveit/robot_trajectory/trajectory_serialization.h>
+#include <console_bridge/console.h>
+#include <cstring>
+#include <map>
+
+namespace robot_trajectory
+{
+namespace
+{
+static const char BINARY_RECORD_MAGIC[4] = { 'M', 'V', 'B', 'R' };
+
+std::size_t padded(std::size_t size)
+{
+  return (size + 7) & ~static_cast<std::size_t>(7);
+}
+
+template<typename T>
+void writeValue(char *dest, T value)
+{
+  memcpy(dest, &value, sizeof(T));
+}
+
+template<typename T>
+T readValue(const char *src)
+{
+  T value;
+  memcpy(&value, src, sizeof(T));
+  return value;
+}
+
+std::size_t nameTableSize(const std::string &group_name, const std::vector<std::string> &names)
+{
+  std::size_t size = 4 + group_name.size();
+  for (std::size_t i = 0 ; i < names.size() ; ++i)
+    size += 4 + names[i].size();
+  return padded(size);
+}
+
+char* writeName(char *dest, const std::string &name)
+{
+  writeValue<boost::uint32_t>(dest, name.size());
+  memcpy(dest + 4, name.data(), name.size());
+  return dest + 4 + name.size();
+}
+
+// write one data section; get(w) returns the array of variable values at waypoint w
+template<typename T, typename Getter>
+char* writeColumns(char *dest, std::size_t variable_count, std::size_t waypoint_count, const Getter &get)
+{
+  T *out = reinterpret_cast<T*>(dest);
+  for (std::size_t w = 0 ; w < waypoint_count ; ++w)
+  {
+    const double *values = get(w);
+    for (std::size_t v = 0 ; v < variable_count ; ++v)
+      out[v * waypoint_count + w] = static_cast<T>(values[v]);
+  }
+  return dest + padded(variable_count * waypoint_count * sizeof(T));
+}
+
+struct StatePositions
+{
+  StatePositions(const robot_state::RobotState *const *states) : states_(states) {}
+  const double* operator()(std::size_t w) const { return states_[w]->getVariablePositions(); }
+  const robot_state::RobotState *const *states_;
+};
+
+struct StateVelocities
+{
+  StateVelocities(const robot_state::RobotState *const *states) : states_(states) {}
+  const double* operator()(std::size_t w) const { return states_[w]->getVariableVelocities(); }
+  const robot_state::RobotState *const *states_;
+};
+
+struct StateAccelerations
+{
+  StateAccelerations(const robot_state::RobotState *const *states) : states_(states) {}
+  const double* operator()(std::size_t w) const { return states_[w]->getVariableAccelerations(); }
+  const robot_state::RobotState *const *states_;
+};
+
+template<typename T>
+char* writeSections(char *dest, const robot_state::RobotState *const *states, std::size_t variable_count,
+                    std::size_t waypoint_count, boost::uint8_t flags)
+{
+  dest = writeColumns<T>(dest, variable_count, waypoint_count, StatePositions(states));
+  if (flags & BINARY_RECORD_VELOCITIES)
+    dest = writeColumns<T>(dest, variable_count, waypoint_count, StateVelocities(states));
+  if (flags & BINARY_RECORD_ACCELERATIONS)
+    dest = writeColumns<T>(dest, variable_count, waypoint_count, StateAccelerations(states));
+  return dest;
+}
+
+void serializeStates(const robot_model::RobotModel &model, const std::string &group_name,
+                     const std::vector<const robot_state::RobotState*> &states, const std::deque<double> *durations,
+                     bool single_precision, std::vector<char> &buffer)
+{
+  const std::vector<std::string> &names = model.getVariableNames();
+  const std::size_t variable_count = names.size();
+  const std::size_t waypoint_count = states.size();
+
+  boost::uint8_t flags = single_precision ? BINARY_RECORD_FLOAT32 : 0;
+  bool velocities = !states.empty();
+  bool accelerations = !states.empty();
+  for (std::size_t i = 0 ; i < states.size() ; ++i)
+  {
+    velocities = velocities && states[i]->hasVelocities();
+    accelerations = accelerations && states[i]->hasAccelerations();
+  }
+  if (velocities)
+    flags |= BINARY_RECORD_VELOCITIES;
+  if (accelerations)
+    flags |= BINARY_RECORD_ACCELERATIONS;
+
+  const std::size_t names_size = nameTableSize(group_name, names);
+  const std::size_t section_size = padded(variable_count * waypoint_count * (single_precision ? sizeof(float) : sizeof(double)));
+  const std::size_t record_size = BINARY_RECORD_HEADER_SIZE + names_size +
+    (durations ? padded(waypoint_count * sizeof(double)) : 0) +
+    section_size * (1 + (velocities ? 1 : 0) + (accelerations ? 1 : 0));
+
+  const std::size_t start = buffer.size();
+  buffer.resize(start + record_size, 0);
+  char *dest = &buffer[start];
+
+  memcpy(dest, BINARY_RECORD_MAGIC, 4);
+  writeValue<boost::uint16_t>(dest + 4, BINARY_RECORD_VERSION);
+  writeValue<boost::uint8_t>(dest + 6, durations ? BINARY_RECORD_TRAJECTORY : BINARY_RECORD_STATE);
+  writeValue<boost::uint8_t>(dest + 7, flags);
+  writeValue<boost::uint64_t>(dest + 8, computeRobotModelHash(model));
+  writeValue<boost::uint64_t>(dest + 16, record_size);
+  writeValue<boost::uint32_t>(dest + 24, variable_count);
+  writeValue<boost::uint32_t>(dest + 28, waypoint_count);
+  writeValue<boost::uint32_t>(dest + 32, names_size);
+  writeValue<boost::uint32_t>(dest + 36, 0);
+  dest += BINARY_RECORD_HEADER_SIZE;
+
+  char *names_end = writeName(dest, group_name);
+  for (std::size_t i = 0 ; i < variable_count ; ++i)
+    names_end = writeName(names_end, names[i]);
+  dest += names_size;
+
+  if (durations)
+  {
+    for (std::size_t i = 0 ; i < waypoint_count ; ++i)
+      writeValue<double>(dest + i * sizeof(double), (*durations)[i]);
+    dest += padded(waypoint_count * sizeof(double));
+  }
+
+  if (waypoint_count > 0)
+  {
+    if (single_precision)
+      writeSections<float>(dest, &states[0], variable_count, waypoint_count, flags);
+    else
+      writeSections<double>(dest, &states[0], variable_count, waypoint_count, flags);
+  }
+}
+
+/// for every variable of the record, the index of the variable in the model (-1 if the model does not have it)
+void getVariableMap(const BinaryRecordView &record, const robot_model::RobotModel &model, std::vector<int> &index)
+{
+  index.resize(record.getVariableCount());
+  if (record.getModelHash() == computeRobotModelHash(model) && record.getVariableCount() == model.getVariableCount())
+  {
+    for (std::size_t i = 0 ; i < index.size() ; ++i)
+      index[i] = i;
+    return;
+  }
+
+  const std::vector<std::string> &model_names = model.getVariableNames();
+  std::map<std::string, int> model_index;
+  for (std::size_t i = 0 ; i < model_names.size() ; ++i)
+    model_index[model_names[i]] = i;
+
+  const std::vector<std::string> &names = record.getVariableNames();
+  std::size_t missing = 0;
+  for (std::size_t i = 0 ; i < names.size() ; ++i)
+  {
+    std::map<std::string, int>::const_iterator it = model_index.find(names[i]);
+    if (it == model_index.end())
+    {
+      index[i] = -1;
+      ++missing;
+    }
+    else
+      index[i] = it->second;
+  }
+  if (missing > 0)
+    logWarn("%u variables of the record are not known to model '%s' and are ignored", (unsigned int)missing, model.getName().c_str());
+}
+
+void setWayPoint(const BinaryRecordView &record, std::size_t waypoint, const std::vector<int> &index, robot_state::RobotState &state)
+{
+  const double *current = state.getVariablePositions();
+  std::vector<double> positions(current, current + state.getVariableCount());
+  for (std::size_t i = 0 ; i < index.size() ; ++i)
+    if (index[i] >= 0)
+      positions[index[i]] = record.getPosition(waypoint, i);
+  state.setVariablePositions(&positions[0]);
+  if (record.hasVelocities())
+  {
+    double *velocities = state.getVariableVelocities();
+    for (std::size_t i = 0 ; i < index.size() ; ++i)
+      if (index[i] >= 0)
+        velocities[index[i]] = record.getVelocity(waypoint, i);
+  }
+  if (record.hasAccelerations())
+  {
+    double *accelerations = state.getVariableAccelerations();
+    for (std::size_t i = 0 ; i < index.size() ; ++i)
+      if (index[i] >= 0)
+        accelerations[index[i]] = record.getAcceleration(waypoint, i);
+  }
+}
+
+}
+}
+
+boost::uint64_t robot_trajectory::computeRobotModelHash(const robot_model::RobotModel &model)
+{
+  // FNV-1a over the model name and the variable names; a 0 byte separates names
+  boost::uint64_t hash = 14695981039346656037ULL;
+  const std::vector<std::string> &names = model.getVariableNames();
+  for (std::size_t i = 0 ; i <= names.size() ; ++i)
+  {
+    const std::string &name = i == 0 ? model.getName() : names[i - 1];
+    for (std::size_t j = 0 ; j <= name.size() ; ++j)
+    {
+      hash ^= j < name.size() ? static_cast<unsigned char>(name[j]) : 0;
+      hash *= 1099511628211ULL;
+    }
+  }
+  return hash;
+}
+
+void robot_trajectory::serializeRobotState(const robot_state::RobotState &state, std::vector<char> &buffer, bool single_precision)
+{
+  std::vector<const robot_state::RobotState*> states(1, &state);
+  serializeStates(*state.getRobotModel(), std::string(), states, NULL, single_precision, buffer);
+}
+
+void robot_trajectory::serializeRobotTrajectory(const RobotTrajectory &trajectory, std::vector<char> &buffer, bool single_precision)
+{
+  std::vector<const robot_state::RobotState*> states(trajectory.getWayPointCount());
+  for (std::size_t i = 0 ; i < states.size() ; ++i)
+    states[i] = &trajectory.getWayPoint(i);
+  serializeStates(*trajectory.getRobotModel(), trajectory.getGroupName(), states, &trajectory.getWayPointDurations(),
+                  single_precision, buffer);
+}
+
+robot_trajectory::BinaryRecordView::BinaryRecordView() :
+  data_(NULL), record_size_(0), kind_(BINARY_RECORD_STATE), flags_(0), model_hash_(0), waypoint_count_(0),
+  durations_(NULL), positions_(NULL), velocities_(NULL), accelerations_(NULL)
+{
+}
+
+robot_trajectory::BinaryRecordView::BinaryRecordView(const char *data, std::size_t size) :
+  data_(NULL), record_size_(0), kind_(BINARY_RECORD_STATE), flags_(0), model_hash_(0), waypoint_count_(0),
+  durations_(NULL), positions_(NULL), velocities_(NULL), accelerations_(NULL)
+{
+  if (size < BINARY_RECORD_HEADER_SIZE || memcmp(data, BINARY_RECORD_MAGIC, 4) != 0)
+  {
+    logError("Data does not start with a binary state or trajectory record");
+    return;
+  }
+  boost::uint16_t version = readValue<boost::uint16_t>(data + 4);
+  if (version != BINARY_RECORD_VERSION)
+  {
+    logError("Unsupported binary record version: %u (expected %u)", (unsigned int)version, (unsigned int)BINARY_RECORD_VERSION);
+    return;
+  }
+  boost::uint8_t kind = readValue<boost::uint8_t>(data + 6);
+  boost::uint8_t flags = readValue<boost::uint8_t>(data + 7);
+  boost::uint64_t record_size = readValue<boost::uint64_t>(data + 16);
+  std::size_t variable_count = readValue<boost::uint32_t>(data + 24);
+  std::size_t waypoint_count = readValue<boost::uint32_t>(data + 28);
+  std::size_t names_size = readValue<boost::uint32_t>(data + 32);
+  if (kind > BINARY_RECORD_TRAJECTORY || record_size > size)
+  {
+    logError("Binary record is truncated or of unknown kind");
+    return;
+  }
+
+  const std::size_t value_size = (flags & BINARY_RECORD_FLOAT32) ? sizeof(float) : sizeof(double);
+  const std::size_t section_size = padded(variable_count * waypoint_count * value_size);
+  const std::size_t durations_size = kind == BINARY_RECORD_TRAJECTORY ? padded(waypoint_count * sizeof(double)) : 0;
+  const std::size_t expected_size = BINARY_RECORD_HEADER_SIZE + names_size + durations_size + section_size *
+    (1 + ((flags & BINARY_RECORD_VELOCITIES) ? 1 : 0) + ((flags & BINARY_RECORD_ACCELERATIONS) ? 1 : 0));
+  if (expected_size != record_size)
+  {
+    logError("Inconsistent size of binary record: %llu bytes (expected %llu)", (unsigned long long)record_size, (unsigned long long)expected_size);
+    return;
+  }
+
+  // read the name table
+  const char *names = data + BINARY_RECORD_HEADER_SIZE;
+  const char *names_end = names + names_size;
+  std::vector<std::string> variable_names(variable_count);
+  for (std::size_t i = 0 ; i <= variable_count ; ++i)
+  {
+    if (names + 4 > names_end || names + 4 + readValue<boost::uint32_t>(names) > names_end)
+    {
+      logError("Invalid name table in binary record");
+      return;
+    }
+    std::size_t length = readValue<boost::uint32_t>(names);
+    (i == 0 ? group_name_ : variable_names[i - 1]).assign(names + 4, length);
+    names += 4 + length;
+  }
+  variable_names_.swap(variable_names);
+
+  data_ = data;
+  record_size_ = record_size;
+  kind_ = static_cast<BinaryRecordKind>(kind);
+  flags_ = flags;
+  model_hash_ = readValue<boost::uint64_t>(data + 8);
+  waypoint_count_ = waypoint_count;
+
+  const char *section = names_end;
+  if (durations_size > 0)
+  {
+    durations_ = section;
+    section += durations_size;
+  }
+  positions_ = section;
+  section += section_size;
+  if (flags & BINARY_RECORD_VELOCITIES)
+  {
+    velocities_ = section;
+    section += section_size;
+  }
+  if (flags & BINARY_RECORD_ACCELERATIONS)
+    accelerations_ = section;
+}
+
+double robot_trajectory::BinaryRecordView::getWayPointDurationFromPrevious(std::size_t waypoint) const
+{
+  return durations_ ? readValue<double>(durations_ + waypoint * sizeof(double)) : 0.0;
+}
+
+double robot_trajectory::BinaryRecordView::getValue(const char *section, std::size_t waypoint, std::size_t variable) const
+{
+  const std::size_t index = variable * waypoint_count_ + waypoint;
+  if (isSinglePrecision())
+    return readValue<float>(section + index * sizeof(float));
+  else
+    return readValue<double>(section + index * sizeof(double));
+}
+
+bool robot_trajectory::deserializeRobotState(const BinaryRecordView &record, robot_state::RobotState &state)
+{
+  if (!record.isValid() || record.getKind() != BINARY_RECORD_STATE || record.getWayPointCount() != 1)
+  {
+    logError("Binary record does not contain a robot state");
+    return false;
+  }
+  std::vector<int> index;
+  getVariableMap(record, *state.getRobotModel(), index);
+  setWayPoint(record, 0, index, state);
+  return true;
+}
+
+bool robot_trajectory::deserializeRobotTrajectory(const BinaryRecordView &record, const robot_state::RobotState &reference_state,
+                                                  RobotTrajectory &trajectory)
+{
+  if (!record.isValid() || record.getKind() != BINARY_RECORD_TRAJECTORY)
+  {
+    logError("Binary record does not contain a robot trajectory");
+    return false;
+  }
+  std::vector<int> index;
+  getVariableMap(record, *trajectory.getRobotModel(), index);
+
+  trajectory.clear();
+  if (!record.getGroupName().empty())
+    trajectory.setGroupName(record.getGroupName());
+  for (std::size_t i = 0 ; i < record.getWayPointCount() ; ++i)
+  {
+    robot_state::RobotStatePtr state(new robot_state::RobotState(reference_state));
+    setWayPoint(record, i, index, *state);
+    trajectory.addSuffixWayPoint(state, record.getWayPointDurationFromPrevious(i));
+  }
+  return true;
+}
+
+bool robot_trajectory::writeRobotTrajectory(std::ostream &out, const RobotTrajectory &trajectory, bool single_precision)
+{
+  std::vector<char> buffer;
+  serializeRobotTrajectory(trajectory, buffer, single_precision);
+  out.write(&buffer[0], buffer.size());
+  return out.good();
+}
+
+bool robot_trajectory::readRobotTrajectory(std::istream &in, const robot_state::RobotState &reference_state, RobotTrajectory &trajectory)
+{
+  // keep the buffer 8-byte aligned, as records are when memory mapped
+  std::vector<double> buffer(BINARY_RECORD_HEADER_SIZE / sizeof(double));
+  char *data = reinterpret_cast<char*>(&buffer[0]);
+  if (!in.read(data, BINARY_RECORD_HEADER_SIZE))
+    return false;
+  if (memcmp(data, BINARY_RECORD_MAGIC, 4) != 0)
+  {
+    logError("Stream does not contain a binary state or trajectory record");
+    return false;
+  }
+  boost::uint64_t record_size = readValue<boost::uint64_t>(data + 16);
+  if (record_size < BINARY_RECORD_HEADER_SIZE || record_size % sizeof(double) != 0)
+  {
+    logError("Invalid size of binary record: %llu bytes", (unsigned long long)record_size);
+    return false;
+  }
+  buffer.resize(record_size / sizeof(double));
+  data = reinterpret_cast<char*>(&buffer[0]);
+  if (!in.read(data + BINARY_RECORD_HEADER_SIZE, record_size - BINARY_RECORD_HEADER_SIZE))
+  {
+    logError("Binary record is truncated");
+    return false;
+  }
+  return deserializeRobotTrajectory(BinaryRecordView(data, record_size), reference_state, trajectory);
+}
@@ -0,0 +1,349 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2013, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+
+#include <gtest/gtest.h>
+#include <moveit/robot_trajectory/robot_trajectory_buffer.h>
+#include <moveit/robot_trajectory/trajectory_serialization.h>
+#include <moveit/test_resources/config.h>
+#include <urdf_parser/urdf_parser.h>
+#include <boost/filesystem/path.hpp>
+#include <fstream>
+#include <sstream>
+
+class LoadPr2Model : public testing::Test
+{
+protected:
+
+  virtual void SetUp()
+  {
+    boost::shared_ptr<srdf::Model> srdf_model(new srdf::Model());
+    std::string xml_string;
+    std::fstream xml_file((boost::filesystem::path(MOVEIT_TEST_RESOURCES_DIR) / "urdf/robot.xml").string().c_str(), std::fstream::in);
+    while (xml_file.good())
+    {
+      std::string line;
+      std::getline(xml_file, line);
+      xml_string += (line + "\n");
+    }
+    xml_file.close();
+    boost::shared_ptr<urdf::ModelInterface> urdf_model = urdf::parseURDF(xml_string);
+    srdf_model->initFile(*urdf_model, (boost::filesystem::path(MOVEIT_TEST_RESOURCES_DIR) / "srdf/robot.xml").string());
+    robot_model_.reset(new robot_model::RobotModel(urdf_model, srdf_model));
+  }
+
+  // a trajectory of the whole robot where all variables change, with velocities and accelerations
+  void makeTrajectory(robot_trajectory::RobotTrajectory &trajectory, std::size_t count, bool derivatives)
+  {
+    robot_state::RobotState state(robot_model_);
+    state.setToDefaultValues();
+    const std::size_t n = robot_model_->getVariableCount();
+    for (std::size_t i = 0 ; i < count ; ++i)
+    {
+      std::vector<double> positions(state.getVariablePositions(), state.getVariablePositions() + n);
+      std::vector<double> velocities(n), accelerations(n);
+      for (std::size_t j = 0 ; j < n ; ++j)
+      {
+        positions[j] += 0.001 * (i + j);
+        velocities[j] = 0.01 * i - 0.001 * j;
+        accelerations[j] = 0.1 * j;
+      }
+      state.setVariablePositions(positions);
+      // keep the orientation of the floating base normalized
+      state.enforceBounds();
+      if (derivatives)
+      {
+        state.setVariableVelocities(velocities);
+        state.setVariableAccelerations(accelerations);
+      }
+      trajectory.addSuffixWayPoint(state, 0.1 + 0.01 * i);
+    }
+  }
+
+  robot_model::RobotModelPtr robot_model_;
+};
+
+TEST_F(LoadPr2Model, BufferMatchesTrajectory)
+{
+  robot_trajectory::RobotTrajectory trajectory(robot_model_, "");
+  makeTrajectory(trajectory, 20, true);
+
+  robot_trajectory::RobotTrajectoryBuffer buffer(trajectory);
+  ASSERT_EQ(trajectory.getWayPointCount(), buffer.getWayPointCount());
+  EXPECT_TRUE(buffer.hasVelocities());
+  EXPECT_TRUE(buffer.hasAccelerations());
+  EXPECT_EQ("", buffer.getGroupName());
+
+  const std::size_t n = robot_model_->getVariableCount();
+  double duration = 0.0;
+  for (std::size_t i = 0 ; i < buffer.getWayPointCount() ; ++i)
+  {
+    const robot_state::RobotState &st = trajectory.getWayPoint(i);
+    for (std::size_t j = 0 ; j < n ; ++j)
+    {
+      EXPECT_EQ(st.getVariablePosition(j), buffer.getWayPointPositions(i)[j]);
+      EXPECT_EQ(st.getVariableVelocity(j), buffer.getWayPointVelocities(i)[j]);
+      EXPECT_EQ(st.getVariableAcceleration(j), buffer.getWayPointAccelerations(i)[j]);
+    }
+    EXPECT_EQ(trajectory.getWayPointDurationFromPrevious(i), buffer.getWayPointDurationFromPrevious(i));
+    duration += trajectory.getWayPointDurationFromPrevious(i);
+    EXPECT_NEAR(duration, buffer.getWayPointDurationFromStart(i), 1e-12);
+  }
+
+  // converting back gives the same waypoints
+  robot_state::RobotState reference(robot_model_);
+  reference.setToDefaultValues();
+  robot_trajectory::RobotTrajectory copy(robot_model_, "");
+  buffer.getRobotTrajectory(reference, copy);
+  ASSERT_EQ(trajectory.getWayPointCount(), copy.getWayPointCount());
+  for (std::size_t i = 0 ; i < copy.getWayPointCount() ; ++i)
+  {
+    EXPECT_EQ(0.0, copy.getWayPoint(i).distance(trajectory.getWayPoint(i)));
+    EXPECT_EQ(trajectory.getWayPointDurationFromPrevious(i), copy.getWayPointDurationFromPrevious(i));
+  }
+}
+
+TEST_F(LoadPr2Model, BufferTrajectoryMsg)
+{
+  robot_trajectory::RobotTrajectory trajectory(robot_model_, "");
+  makeTrajectory(trajectory, 10, true);
+  robot_trajectory::RobotTrajectoryBuffer buffer(trajectory);
+
+  moveit_msgs::RobotTrajectory expected, msg;
+  trajectory.getRobotTrajectoryMsg(expected);
+  buffer.getRobotTrajectoryMsg(msg);
+
+  EXPECT_EQ(expected.joint_trajectory.joint_names, msg.joint_trajectory.joint_names);
+  ASSERT_EQ(expected.joint_trajectory.points.size(), msg.joint_trajectory.points.size());
+  for (std::size_t i = 0 ; i < msg.joint_trajectory.points.size() ; ++i)
+  {
+    const trajectory_msgs::JointTrajectoryPoint &e = expected.joint_trajectory.points[i];
+    const trajectory_msgs::JointTrajectoryPoint &p = msg.joint_trajectory.points[i];
+    EXPECT_EQ(e.positions, p.positions);
+    EXPECT_EQ(e.velocities, p.velocities);
+    EXPECT_EQ(e.accelerations, p.accelerations);
+    EXPECT_NEAR(e.time_from_start.toSec(), p.time_from_start.toSec(), 1e-9);
+  }
+
+  // the floating base of the robot is a multi dof joint
+  EXPECT_EQ(expected.multi_dof_joint_trajectory.joint_names, msg.multi_dof_joint_trajectory.joint_names);
+  ASSERT_EQ(expected.multi_dof_joint_trajectory.points.size(), msg.multi_dof_joint_trajectory.points.size());
+  for (std::size_t i = 0 ; i < msg.multi_dof_joint_trajectory.points.size() ; ++i)
+  {
+    const trajectory_msgs::MultiDOFJointTrajectoryPoint &e = expected.multi_dof_joint_trajectory.points[i];
+    const trajectory_msgs::MultiDOFJointTrajectoryPoint &p = msg.multi_dof_joint_trajectory.points[i];
+    ASSERT_EQ(e.transforms.size(), p.transforms.size());
+    for (std::size_t j = 0 ; j < p.transforms.size() ; ++j)
+    {
+      EXPECT_NEAR(e.transforms[j].translation.x, p.transforms[j].translation.x, 1e-9);
+      EXPECT_NEAR(e.transforms[j].translation.y, p.transforms[j].translation.y, 1e-9);
+      EXPECT_NEAR(e.transforms[j].translation.z, p.transforms[j].translation.z, 1e-9);
+      EXPECT_NEAR(e.transforms[j].rotation.w, p.transforms[j].rotation.w, 1e-9);
+      EXPECT_NEAR(e.transforms[j].rotation.z, p.transforms[j].rotation.z, 1e-9);
+    }
+  }
+}
+
+TEST_F(LoadPr2Model, BufferWithoutDerivatives)
+{
+  robot_trajectory::RobotTrajectory trajectory(robot_model_, "right_arm");
+  makeTrajectory(trajectory, 5, false);
+  robot_trajectory::RobotTrajectoryBuffer buffer(trajectory);
+  EXPECT_EQ("right_arm", buffer.getGroupName());
+  EXPECT_FALSE(buffer.hasVelocities());
+  EXPECT_FALSE(buffer.hasAccelerations());
+
+  // waypoints given as positions only
+  robot_trajectory::RobotTrajectoryBuffer positions(robot_model_, "right_arm");
+  positions.reserve(trajectory.getWayPointCount());
+  for (std::size_t i = 0 ; i < trajectory.getWayPointCount() ; ++i)
+    positions.addSuffixWayPoint(trajectory.getWayPoint(i).getVariablePositions(), trajectory.getWayPointDurationFromPrevious(i));
+  ASSERT_EQ(buffer.getWayPointCount(), positions.getWayPointCount());
+  EXPECT_FALSE(positions.hasVelocities());
+
+  robot_state::RobotState st(robot_model_);
+  st.setToDefaultValues();
+  positions.getWayPoint(3, st);
+  EXPECT_EQ(0.0, st.distance(trajectory.getWayPoint(3)));
+
+  moveit_msgs::RobotTrajectory expected, msg;
+  trajectory.getRobotTrajectoryMsg(expected);
+  positions.getRobotTrajectoryMsg(msg);
+  EXPECT_EQ(expected.joint_trajectory.joint_names, msg.joint_trajectory.joint_names);
+  ASSERT_EQ(expected.joint_trajectory.points.size(), msg.joint_trajectory.points.size());
+  EXPECT_EQ(expected.joint_trajectory.points.back().positions, msg.joint_trajectory.points.back().positions);
+  EXPECT_TRUE(msg.joint_trajectory.points.back().velocities.empty());
+
+  positions.clear();
+  EXPECT_TRUE(positions.empty());
+  EXPECT_EQ(0.0, positions.getWayPointDurationFromStart(0));
+}
+
+TEST_F(LoadPr2Model, BinaryStateRecord)
+{
+  robot_trajectory::RobotTrajectory trajectory(robot_model_, "");
+  makeTrajectory(trajectory, 3, true);
+  const robot_state::RobotState &state = trajectory.getLastWayPoint();
+
+  std::vector<char> buffer;
+  robot_trajectory::serializeRobotState(state, buffer);
+  ASSERT_EQ(0, buffer.size() % 8);
+  robot_trajectory::BinaryRecordView record(&buffer[0], buffer.size());
+  ASSERT_TRUE(record.isValid());
+  EXPECT_EQ(robot_trajectory::BINARY_RECORD_STATE, record.getKind());
+  EXPECT_EQ(buffer.size(), record.getRecordSize());
+  EXPECT_EQ(robot_trajectory::computeRobotModelHash(*robot_model_), record.getModelHash());
+  EXPECT_EQ(robot_model_->getVariableNames(), record.getVariableNames());
+  EXPECT_EQ(1, record.getWayPointCount());
+  EXPECT_TRUE(record.hasVelocities());
+  EXPECT_TRUE(record.hasAccelerations());
+  EXPECT_FALSE(record.isSinglePrecision());
+  ASSERT_TRUE(record.getPositionColumn(0) != NULL);
+  EXPECT_EQ(state.getVariablePosition(0), record.getPositionColumn(0)[0]);
+
+  robot_state::RobotState copy(robot_model_);
+  copy.setToDefaultValues();
+  EXPECT_TRUE(robot_trajectory::deserializeRobotState(record, copy));
+  const std::size_t n = robot_model_->getVariableCount();
+  for (std::size_t j = 0 ; j < n ; ++j)
+  {
+    EXPECT_EQ(state.getVariablePosition(j), copy.getVariablePosition(j));
+    EXPECT_EQ(state.getVariableVelocity(j), copy.getVariableVelocity(j));
+    EXPECT_EQ(state.getVariableAcceleration(j), copy.getVariableAcceleration(j));
+  }
+
+  // single precision values are rounded to float
+  buffer.clear();
+  robot_trajectory::serializeRobotState(state, buffer, true);
+  robot_trajectory::BinaryRecordView single(&buffer[0], buffer.size());
+  ASSERT_TRUE(single.isValid());
+  EXPECT_TRUE(single.isSinglePrecision());
+  EXPECT_TRUE(single.getPositionColumn(0) == NULL);
+  ASSERT_TRUE(single.getPositionColumnFloat(0) != NULL);
+  copy.setToDefaultValues();
+  EXPECT_TRUE(robot_trajectory::deserializeRobotState(single, copy));
+  for (std::size_t j = 0 ; j < n ; ++j)
+    EXPECT_EQ((float)state.getVariablePosition(j), (float)copy.getVariablePosition(j));
+
+  // a state record is not a trajectory, and incomplete records are rejected
+  robot_trajectory::RobotTrajectory other(robot_model_, "");
+  EXPECT_FALSE(robot_trajectory::deserializeRobotTrajectory(single, copy, other));
+  EXPECT_FALSE(robot_trajectory::BinaryRecordView(&buffer[0], buffer.size() - 8).isValid());
+  EXPECT_FALSE(robot_trajectory::BinaryRecordView(&buffer[0], robot_trajectory::BINARY_RECORD_HEADER_SIZE - 1).isValid());
+}
+
+TEST_F(LoadPr2Model, BinaryTrajectoryRecords)
+{
+  robot_trajectory::RobotTrajectory first(robot_model_, "right_arm");
+  makeTrajectory(first, 12, true);
+  robot_trajectory::RobotTrajectory second(robot_model_, "");
+  makeTrajectory(second, 7, false);
+
+  // records are concatenated in one buffer and read in place
+  std::vector<char> buffer;
+  robot_trajectory::serializeRobotTrajectory(first, buffer);
+  std::size_t first_size = buffer.size();
+  robot_trajectory::serializeRobotTrajectory(second, buffer);
+
+  robot_trajectory::BinaryRecordView record(&buffer[0], buffer.size());
+  ASSERT_TRUE(record.isValid());
+  EXPECT_EQ(robot_trajectory::BINARY_RECORD_TRAJECTORY, record.getKind());
+  EXPECT_EQ(first_size, record.getRecordSize());
+  EXPECT_EQ("right_arm", record.getGroupName());
+  EXPECT_EQ(first.getWayPointCount(), record.getWayPointCount());
+  EXPECT_TRUE(record.hasVelocities());
+
+  robot_state::RobotState reference(robot_model_);
+  reference.setToDefaultValues();
+  robot_trajectory::RobotTrajectory copy(robot_model_, "");
+  ASSERT_TRUE(robot_trajectory::deserializeRobotTrajectory(record, reference, copy));
+  EXPECT_EQ("right_arm", copy.getGroupName());
+  ASSERT_EQ(first.getWayPointCount(), copy.getWayPointCount());
+  const std::size_t n = robot_model_->getVariableCount();
+  for (std::size_t i = 0 ; i < copy.getWayPointCount() ; ++i)
+  {
+    EXPECT_EQ(first.getWayPointDurationFromPrevious(i), copy.getWayPointDurationFromPrevious(i));
+    EXPECT_EQ(first.getWayPointDurationFromPrevious(i), record.getWayPointDurationFromPrevious(i));
+    for (std::size_t j = 0 ; j < n ; ++j)
+    {
+      EXPECT_EQ(first.getWayPoint(i).getVariablePosition(j), copy.getWayPoint(i).getVariablePosition(j));
+      EXPECT_EQ(first.getWayPoint(i).getVariableVelocity(j), copy.getWayPoint(i).getVariableVelocity(j));
+      EXPECT_EQ(first.getWayPoint(i).getVariableAcceleration(j), copy.getWayPoint(i).getVariableAcceleration(j));
+    }
+  }
+
+  robot_trajectory::BinaryRecordView next(&buffer[0] + record.getRecordSize(), buffer.size() - record.getRecordSize());
+  ASSERT_TRUE(next.isValid());
+  EXPECT_EQ(second.getWayPointCount(), next.getWayPointCount());
+  EXPECT_FALSE(next.hasVelocities());
+  EXPECT_FALSE(next.hasAccelerations());
+  EXPECT_EQ(0.0, next.getVelocity(0, 0));
+  for (std::size_t i = 0 ; i < next.getWayPointCount() ; ++i)
+    for (std::size_t j = 0 ; j < n ; ++j)
+      EXPECT_EQ(second.getWayPoint(i).getVariablePosition(j), next.getPosition(i, j));
+}
+
+TEST_F(LoadPr2Model, BinaryTrajectoryStream)
+{
+  robot_trajectory::RobotTrajectory first(robot_model_, "");
+  makeTrajectory(first, 5, true);
+  robot_trajectory::RobotTrajectory second(robot_model_, "");
+  makeTrajectory(second, 9, true);
+
+  std::stringstream stream;
+  EXPECT_TRUE(robot_trajectory::writeRobotTrajectory(stream, first));
+  EXPECT_TRUE(robot_trajectory::writeRobotTrajectory(stream, second, true));
+
+  robot_state::RobotState reference(robot_model_);
+  reference.setToDefaultValues();
+  robot_trajectory::RobotTrajectory copy(robot_model_, "");
+  ASSERT_TRUE(robot_trajectory::readRobotTrajectory(stream, reference, copy));
+  ASSERT_EQ(first.getWayPointCount(), copy.getWayPointCount());
+  for (std::size_t i = 0 ; i < copy.getWayPointCount() ; ++i)
+    EXPECT_EQ(0.0, copy.getWayPoint(i).distance(first.getWayPoint(i)));
+
+  ASSERT_TRUE(robot_trajectory::readRobotTrajectory(stream, reference, copy));
+  ASSERT_EQ(second.getWayPointCount(), copy.getWayPointCount());
+  for (std::size_t i = 0 ; i < copy.getWayPointCount() ; ++i)
+    EXPECT_NEAR(0.0, copy.getWayPoint(i).distance(second.getWayPoint(i)), 1e-5);
+
+  // the end of the stream
+  EXPECT_FALSE(robot_trajectory::readRobotTrajectory(stream, reference, copy));
+}
+
+int main(int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
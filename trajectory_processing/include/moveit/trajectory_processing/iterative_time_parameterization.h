@@ -61,10 +61,15 @@ private:
   unsigned int max_iterations_;         /// @brief maximum number of iterations to find solution
   double max_time_change_per_it_;       /// @brief maximum allowed time change per iteration in seconds
 
-  void applyVelocityConstraints(robot_trajectory::RobotTrajectory& rob_trajectory,
+  /// @brief positions holds the variables of the group for each waypoint, one waypoint after the other
+  void applyVelocityConstraints(const std::vector<double> &positions,
+                                const std::vector<double> &max_velocity,
                                 std::vector<double> &time_diff) const;
 
-  void applyAccelerationConstraints(robot_trajectory::RobotTrajectory& rob_trajectory,
+  /// @brief start_velocity is either empty or holds the velocity of each variable at the first waypoint
+  void applyAccelerationConstraints(const std::vector<double> &positions,
+                                    const std::vector<double> &max_acceleration,
+                                    const std::vector<double> &start_velocity,
                                     std::vector<double> & time_diff) const;
 
   double findT1( const double d1, const double d2, double t1, const double t2, const double a_max) const;
@@ -0,0 +1,75 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2013, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#ifndef MOVEIT_TRAJECTORY_PROCESSING_JERK_LIMITED_PARAMETERIZATION_
+#define MOVEIT_TRAJECTORY_PROCESSING_JERK_LIMITED_PARAMETERIZATION_
+
+#include <moveit/robot_trajectory/robot_trajectory.h>
+#include <map>
+
+namespace trajectory_processing
+{
+
+/// \brief This class computes the timestamps of a trajectory so that its accelerations are continuous and its jerk
+/// is bounded, while respecting the velocity and acceleration limits of the variables.
+///
+/// The waypoints are interpolated by a cubic spline, so the acceleration is piecewise linear and the jerk piecewise
+/// constant. The trajectory starts and ends at rest with zero acceleration; to allow that, one waypoint is inserted
+/// in the first and one in the last segment of the trajectory, and their positions are chosen by the spline. The
+/// durations of the segments that violate a limit are increased until all limits hold. Jerk limits can be set per
+/// variable; variables without one use the default jerk limit.
+class JerkLimitedTimeParameterization
+{
+public:
+  JerkLimitedTimeParameterization(unsigned int max_iterations = 100, double default_max_jerk = 10.0);
+  ~JerkLimitedTimeParameterization();
+
+  /// Set the maximum jerk magnitude for the variable \e variable
+  void setJerkLimit(const std::string &variable, double max_jerk);
+
+  /// Get the maximum jerk magnitude for the variable \e variable
+  double getJerkLimit(const std::string &variable) const;
+
+  bool computeTimeStamps(robot_trajectory::RobotTrajectory& trajectory) const;
+
+private:
+
+  unsigned int max_iterations_;         /// @brief maximum number of iterations to find solution
+  double default_max_jerk_;             /// @brief the jerk limit of variables without a specified limit
+  std::map<std::string, double> max_jerk_;
+};
+
+}
+
+#endif
@@ -0,0 +1,97 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2013, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#ifndef MOVEIT_TRAJECTORY_PROCESSING_TIME_OPTIMAL_PARAMETERIZATION_
+#define MOVEIT_TRAJECTORY_PROCESSING_TIME_OPTIMAL_PARAMETERIZATION_
+
+#include <moveit/robot_trajectory/robot_trajectory.h>
+
+namespace trajectory_processing
+{
+
+/// \brief This class computes the timestamps of a trajectory so that it is traversed in minimum time along its path,
+/// while respecting the velocity and acceleration limits of the variables.
+///
+/// The path is parameterized by the waypoint index s, and its derivatives are estimated by finite differences at the
+/// waypoints. The squared path velocity x = ds/dt^2 is then computed by reachability analysis in the phase plane:
+/// a backward pass computes the largest x at each waypoint from which the trajectory can still come to rest at the
+/// last waypoint, and a forward pass accelerates as much as possible within those bounds. Both passes run in time
+/// linear in the number of waypoints. The trajectory starts and ends at rest.
+class TimeOptimalParameterization
+{
+public:
+  TimeOptimalParameterization();
+  ~TimeOptimalParameterization();
+
+  bool computeTimeStamps(robot_trajectory::RobotTrajectory& trajectory) const;
+};
+
+/// \brief Time-optimal parameterization for trajectories that grow by appending waypoints (e.g., for teleoperation).
+///
+/// The state of the previous call is kept, and when waypoints are appended only the last \e window timed waypoints
+/// and the new ones are re-timed, so the cost of a call does not depend on the length of the trajectory. The window is
+/// extended further back only when the new waypoints do not allow stopping from the velocity reached at its start.
+/// Between calls the trajectory must only be extended with addSuffixWayPoint(); any other change requires reset().
+/// As for TimeOptimalParameterization, the last waypoint is always reached at rest.
+class IncrementalTimeOptimalParameterization
+{
+public:
+  IncrementalTimeOptimalParameterization(std::size_t window = 50);
+  ~IncrementalTimeOptimalParameterization();
+
+  bool computeTimeStamps(robot_trajectory::RobotTrajectory& trajectory);
+
+  /// Forget the trajectory timed so far; the next call re-times the trajectory it is passed from the start
+  void reset();
+
+private:
+
+  void unwindSuffix(robot_trajectory::RobotTrajectory& trajectory, std::size_t first) const;
+
+  std::size_t window_;
+  const robot_model::JointModelGroup *group_;
+  std::size_t timed_count_;
+  std::vector<double> max_velocity_;
+  std::vector<double> max_acceleration_;
+
+  /// positions and path derivatives of the waypoints (waypoint-major), and the squared path velocity at each waypoint
+  std::vector<double> positions_;
+  std::vector<double> d_;
+  std::vector<double> dd_;
+  std::vector<double> x_;
+};
+
+}
+
+#endif
@@ -38,6 +38,7 @@
 #define MOVEIT_TRAJECTORY_PROCESSING_TRAJECTORY_TOOLS_
 
 #include <moveit_msgs/RobotTrajectory.h>
+#include <moveit/robot_trajectory/robot_trajectory.h>
 
 namespace trajectory_processing
 {
@@ -45,6 +46,15 @@ namespace trajectory_processing
 bool isTrajectoryEmpty(const moveit_msgs::RobotTrajectory &trajectory);
 std::size_t trajectoryWaypointCount(const moveit_msgs::RobotTrajectory &trajectory);
 
+/** \brief Get the maximum velocity and acceleration magnitudes of the variables of \e group, in the order of
+    JointModelGroup::getVariableNames(). The defaults are used for variables without bounds. */
+void getVariableLimits(const robot_model::JointModelGroup *group, std::vector<double> &max_velocity, std::vector<double> &max_acceleration,
+                       double default_velocity = 1.0, double default_acceleration = 1.0);
+
+/** \brief Copy the positions of the variables of the group of \e trajectory for all waypoints into \e positions,
+    one waypoint after the other */
+void getWayPointPositions(const robot_trajectory::RobotTrajectory &trajectory, std::vector<double> &positions);
+
 }
 
 #endif
@@ -35,9 +35,11 @@
 /* Author: Ken Anderson */
 
 #include <moveit/trajectory_processing/iterative_time_parameterization.h>
+#include <moveit/trajectory_processing/trajectory_tools.h>
 #include <moveit_msgs/JointLimits.h>
 #include <console_bridge/console.h>
 #include <moveit/robot_state/conversions.h>
+#include <moveit/profiler/profiler.h>
 
 namespace trajectory_processing
 {
@@ -98,80 +100,86 @@ void printStats(const trajectory_msgs::JointTrajectory& trajectory, const std::v
 }
 
 // Applies velocity
-void IterativeParabolicTimeParameterization::applyVelocityConstraints(robot_trajectory::RobotTrajectory& rob_trajectory,
+void IterativeParabolicTimeParameterization::applyVelocityConstraints(const std::vector<double> &positions,
+                                                                      const std::vector<double> &max_velocity,
                                                                       std::vector<double> &time_diff) const
 {
-  const robot_model::JointModelGroup *group = rob_trajectory.getGroup();
-  const std::vector<std::string> &vars = group->getVariableNames();
-  const std::vector<int> &idx = group->getVariableIndexList();
-  const robot_model::RobotModel &rmodel = group->getParentModel();
-  const int num_points = rob_trajectory.getWayPointCount();
+  const std::size_t num_vars = max_velocity.size();
+  const std::size_t num_points = time_diff.size() + 1;
 
-  for (int i = 0 ; i < num_points-1 ; ++i)
+  for (std::size_t i = 0 ; i < num_points-1 ; ++i)
   {
-    const robot_state::RobotStatePtr &curr_waypoint = rob_trajectory.getWayPointPtr(i);
-    const robot_state::RobotStatePtr &next_waypoint = rob_trajectory.getWayPointPtr(i+1);
-    
-    for (std::size_t j = 0 ; j < vars.size() ; ++j)
+    const double *curr_waypoint = &positions[i * num_vars];
+    const double *next_waypoint = curr_waypoint + num_vars;
+    for (std::size_t j = 0 ; j < num_vars ; ++j)
     {
-      double v_max = 1.0;
-      const robot_model::VariableBounds &b = rmodel.getVariableBounds(vars[j]);
-      if (b.velocity_bounded_)
-        v_max = std::min(fabs(b.max_velocity_), fabs(b.min_velocity_));
-      const double dq1 = curr_waypoint->getVariablePosition(idx[j]);
-      const double dq2 = next_waypoint->getVariablePosition(idx[j]);
-      const double t_min = std::abs(dq2-dq1) / v_max;
+      const double t_min = std::abs(next_waypoint[j] - curr_waypoint[j]) / max_velocity[j];
       if (t_min > time_diff[i])
         time_diff[i] = t_min;
     }
   }
 }
 
-// Iteratively expand dt1 interval by a constant factor until within acceleration constraint
-// In the future we may want to solve to quadratic equation to get the exact timing interval.
-// To do this, use the CubicTrajectory::quadSolve() function in cubic_trajectory.h
+namespace
+{
+
+// Get the smallest duration t >= dt of the segment whose duration is being changed, such that the acceleration
+// at the point between two segments is within a_max. The other segment has duration other_dt and velocity
+// other_v, and dq is the displacement over the changed segment. The acceleration constraint
+// |2 (dq / t - other_v) / (t + other_dt)| <= a_max is equivalent to two quadratic inequalities in t, each of
+// which is violated only between the roots of its polynomial.
+double findDuration(double dq, double dt, double other_dt, double other_v, double a_max)
+{
+  if (a_max <= 0.0)
+    return dt;
+  const double a = a_max / 2.0;
+  const double b[2] = { a * other_dt + other_v, a * other_dt - other_v };
+  const double c[2] = { -dq, dq };
+
+  // moving past the violated interval of one polynomial may enter the interval of the other one
+  for (int iteration = 0 ; iteration < 3 ; ++iteration)
+  {
+    bool changed = false;
+    for (int k = 0 ; k < 2 ; ++k)
+    {
+      const double disc = b[k] * b[k] - 4.0 * a * c[k];
+      if (disc <= 0.0)
+        continue;
+      const double sq = sqrt(disc);
+      const double r_lo = (-b[k] - sq) / (2.0 * a);
+      const double r_hi = (-b[k] + sq) / (2.0 * a);
+      if (dt > r_lo && dt < r_hi)
+      {
+        dt = r_hi;
+        changed = true;
+      }
+    }
+    if (!changed)
+      break;
+  }
+  return dt;
+}
+
+}
+
+// Find the smallest duration of the first of two segments (of displacements dq1, dq2) that respects the acceleration limit
 double IterativeParabolicTimeParameterization::findT1(const double dq1,
                                                       const double dq2,
                                                       double dt1,
                                                       const double dt2,
                                                       const double a_max) const
 {
-  const double mult_factor = 1.01;
-  double v1 = (dq1)/dt1;
-  double v2 = (dq2)/dt2;
-  double a = 2.0*(v2-v1)/(dt1+dt2);
-
-  while( std::abs( a ) > a_max )
-  {
-    v1 = (dq1)/dt1;
-    v2 = (dq2)/dt2;
-    a = 2.0*(v2-v1)/(dt1+dt2);
-    dt1 *= mult_factor;
-  }
-
-  return dt1;
+  return findDuration(dq1, dt1, dt2, dq2 / dt2, a_max);
 }
 
+// Find the smallest duration of the second of two segments (of displacements dq1, dq2) that respects the acceleration limit
 double IterativeParabolicTimeParameterization::findT2(const double dq1,
                                                       const double dq2,
                                                       const double dt1,
                                                       double dt2,
                                                       const double a_max) const
 {
-  const double mult_factor = 1.01;
-  double v1 = (dq1)/dt1;
-  double v2 = (dq2)/dt2;
-  double a = 2.0*(v2-v1)/(dt1+dt2);
-
-  while( std::abs( a ) > a_max )
-  {
-    v1 = (dq1)/dt1;
-    v2 = (dq2)/dt2;
-    a = 2.0*(v2-v1)/(dt1+dt2);
-    dt2 *= mult_factor;
-  }
-
-  return dt2;
+  return findDuration(dq2, dt2, dt1, dq1 / dt1, a_max);
 }
 
 namespace
@@ -293,22 +301,15 @@ void updateTrajectory(robot_trajectory::RobotTrajectory& rob_trajectory,
 
 
 // Applies Acceleration constraints
-void IterativeParabolicTimeParameterization::applyAccelerationConstraints(robot_trajectory::RobotTrajectory& rob_trajectory,
+void IterativeParabolicTimeParameterization::applyAccelerationConstraints(const std::vector<double> &positions,
+                                                                          const std::vector<double> &max_acceleration,
+                                                                          const std::vector<double> &start_velocity,
                                                                           std::vector<double> & time_diff) const
 {
-  robot_state::RobotStatePtr prev_waypoint;
-  robot_state::RobotStatePtr curr_waypoint;
-  robot_state::RobotStatePtr next_waypoint;
-
-  const robot_model::JointModelGroup *group = rob_trajectory.getGroup();
-  const std::vector<std::string> &vars = group->getVariableNames();
-  const std::vector<int> &idx = group->getVariableIndexList();
-  const robot_model::RobotModel &rmodel = group->getParentModel();
-  
-  const int num_points = rob_trajectory.getWayPointCount();
-  const unsigned int num_joints = group->getVariableCount();
+  const std::size_t num_joints = max_acceleration.size();
+  const int num_points = time_diff.size() + 1;
   int num_updates = 0;
-  int iteration = 0;
+  unsigned int iteration = 0;
   bool backwards = false;
   double q1;
   double q2;
@@ -326,35 +327,23 @@ void IterativeParabolicTimeParameterization::applyAccelerationConstraints(robot_
 
     // In this case we iterate through the joints on the outer loop.
     // This is so that any time interval increases have a chance to get propogated through the trajectory
-    for (unsigned int j = 0; j < num_joints ; ++j)
+    for (std::size_t j = 0; j < num_joints ; ++j)
     {
+      const double a_max = max_acceleration[j];
+
       // Loop forwards, then backwards
       for (int count = 0; count < 2; ++count)
       {
         for (int i = 0 ; i < num_points-1; ++i)
         {
           int index = backwards ? (num_points-1)-i : i;
-          
-          curr_waypoint = rob_trajectory.getWayPointPtr(index);
 
-          if (index > 0)
-            prev_waypoint = rob_trajectory.getWayPointPtr(index-1);
-          
-          if (index < num_points-1)
-            next_waypoint = rob_trajectory.getWayPointPtr(index+1);
-
-          // Get acceleration limits
-          double a_max = 1.0;
-          const robot_model::VariableBounds &b = rmodel.getVariableBounds(vars[j]);
-          if (b.acceleration_bounded_)
-            a_max = std::min(fabs(b.max_acceleration_), fabs(b.min_acceleration_));
-          
           if (index == 0)
-          { 
+          {
             // First point
-            q1 = next_waypoint->getVariablePosition(idx[j]);
-            q2 = curr_waypoint->getVariablePosition(idx[j]);
-            q3 = next_waypoint->getVariablePosition(idx[j]);
+            q1 = positions[(index + 1) * num_joints + j];
+            q2 = positions[index * num_joints + j];
+            q3 = q1;
 
             dt1 = dt2 = time_diff[index];
             assert(!backwards);
@@ -363,42 +352,33 @@ void IterativeParabolicTimeParameterization::applyAccelerationConstraints(robot_
             if (index < num_points-1)
             {
               // middle points
-              q1 = prev_waypoint->getVariablePosition(idx[j]);
-              q2 = curr_waypoint->getVariablePosition(idx[j]);
-              q3 = next_waypoint->getVariablePosition(idx[j]);
-              
+              q1 = positions[(index - 1) * num_joints + j];
+              q2 = positions[index * num_joints + j];
+              q3 = positions[(index + 1) * num_joints + j];
+
               dt1 = time_diff[index-1];
               dt2 = time_diff[index];
             }
             else
-            { 
+            {
               // last point - careful, there are only numpoints-1 time intervals
-              q1 = prev_waypoint->getVariablePosition(idx[j]);
-              q2 = curr_waypoint->getVariablePosition(idx[j]);
-              q3 = prev_waypoint->getVariablePosition(idx[j]);
-              
+              q1 = positions[(index - 1) * num_joints + j];
+              q2 = positions[index * num_joints + j];
+              q3 = q1;
+
               dt1 = dt2 = time_diff[index-1];
               assert(backwards);
             }
-          
+
           if (dt1 == 0.0 || dt2 == 0.0)
           {
             v1 = 0.0;
             v2 = 0.0;
             a = 0.0;
-          } 
+          }
           else
           {
-            bool start_velocity = false;
-            if (index == 0)
-            {
-              if (curr_waypoint->hasVelocities())
-              {
-                start_velocity = true;
-                v1 = curr_waypoint->getVariableVelocity(idx[j]);
-              }
-            }
-            v1 = start_velocity ? v1 : (q2-q1)/dt1;
+            v1 = (index == 0 && !start_velocity.empty()) ? start_velocity[j] : (q2-q1)/dt1;
             v2 = (q3-q2)/dt2;
             a = 2.0*(v2-v1)/(dt1+dt2);
           }
@@ -416,19 +396,6 @@ void IterativeParabolicTimeParameterization::applyAccelerationConstraints(robot_
               time_diff[index-1] = dt1;
             }
             num_updates++;
-            
-            if (dt1 == 0.0 || dt2 == 0.0)
-            {
-              v1 = 0.0;
-              v2 = 0.0;
-              a = 0.0;
-            } 
-            else
-            {
-              v1 = (q2-q1)/dt1;
-              v2 = (q3-q2)/dt2;
-              a = 2*(v2-v1)/(dt1+dt2);
-            }
           }
         }
         backwards = !backwards;
@@ -440,6 +407,7 @@ void IterativeParabolicTimeParameterization::applyAccelerationConstraints(robot_
 
 bool IterativeParabolicTimeParameterization::computeTimeStamps(robot_trajectory::RobotTrajectory& trajectory) const
 {
+  MOVEIT_CORE_PROBE("IterativeParabolicTimeParameterization::computeTimeStamps");
   if (trajectory.empty())
     return true;
 
@@ -461,11 +429,27 @@ bool IterativeParabolicTimeParameterization::computeTimeStamps(robot_trajectory:
   // this lib does not actually work properly when angles wrap around, so we need to unwind the path first
   trajectory.unwind();
 
+  // the limits and positions of the variables are copied once, so the constraints are applied on flat arrays
+  const std::vector<int> &idx = group->getVariableIndexList();
+  const std::size_t num_vars = idx.size();
+  std::vector<double> max_velocity, max_acceleration;
+  getVariableLimits(group, max_velocity, max_acceleration, DEFAULT_VEL_MAX, DEFAULT_ACCEL_MAX);
+  std::vector<double> positions;
+  getWayPointPositions(trajectory, positions);
+
   const int num_points = trajectory.getWayPointCount();
+  std::vector<double> start_velocity;
+  if (trajectory.getWayPoint(0).hasVelocities())
+  {
+    start_velocity.resize(num_vars);
+    for (std::size_t j = 0 ; j < num_vars ; ++j)
+      start_velocity[j] = trajectory.getWayPoint(0).getVariableVelocity(idx[j]);
+  }
+
   std::vector<double> time_diff(num_points-1, 0.0);       // the time difference between adjacent points
-  
-  applyVelocityConstraints(trajectory, time_diff);
-  applyAccelerationConstraints(trajectory, time_diff);
+
+  applyVelocityConstraints(positions, max_velocity, time_diff);
+  applyAccelerationConstraints(positions, max_acceleration, start_velocity, time_diff);
   
   updateTrajectory(trajectory, time_diff);
   return true;
@@ -0,0 +1,339 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2013, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#include <moveit/trajectory_processing/jerk_limited_parameterization.h>
+#include <moveit/trajectory_processing/trajectory_tools.h>
+#include <console_bridge/console.h>
+#include <algorithm>
+#include <cmath>
+
+namespace trajectory_processing
+{
+
+namespace
+{
+
+const double DEFAULT_VEL_MAX = 1.0;
+const double DEFAULT_ACCEL_MAX = 1.0;
+
+// no segment of the spline is shorter than this (seconds)
+const double MIN_SEGMENT_DURATION = 1e-4;
+
+// limits are considered satisfied if they are exceeded by at most this fraction
+const double LIMIT_TOLERANCE = 1e-3;
+
+// Solve the tridiagonal system with sub-diagonal a, diagonal b and super-diagonal c (a[0] and c.back() are not
+// used); d holds the right hand side and is replaced by the solution. b and d are modified.
+void solveTridiagonal(const std::vector<double> &a, std::vector<double> &b, const std::vector<double> &c, std::vector<double> &d)
+{
+  const std::size_t n = d.size();
+  for (std::size_t i = 1 ; i < n ; ++i)
+  {
+    double m = a[i] / b[i - 1];
+    b[i] -= m * c[i - 1];
+    d[i] -= m * d[i - 1];
+  }
+  d[n - 1] /= b[n - 1];
+  for (std::size_t i = n - 1 ; i > 0 ; --i)
+    d[i - 1] = (d[i - 1] - c[i - 1] * d[i]) / b[i - 1];
+}
+
+// add value to the coefficient of column col in row r of a tridiagonal system
+void addCoefficient(std::vector<double> &lower, std::vector<double> &diag, std::vector<double> &upper,
+                    std::size_t r, std::size_t col, double value)
+{
+  if (col + 1 == r)
+    lower[r] += value;
+  else
+    if (col == r)
+      diag[r] += value;
+    else
+      upper[r] += value;
+}
+
+// Compute the accelerations acc at the knots of the cubic spline through the positions x, where h holds the
+// durations between knots (x.size() >= 4). The spline starts and ends at rest with zero acceleration. The positions
+// x[1] and x[n - 2] are not interpolated: they are set so that the boundary conditions hold.
+void computeSpline(const std::vector<double> &h, std::vector<double> &x, std::vector<double> &acc)
+{
+  const std::size_t n = x.size();
+  const std::size_t m = n - 2;
+
+  // the unknowns are acc[1] .. acc[n - 2]; the free positions are affine in the accelerations at their knots:
+  // x[1] = x[0] + acc[1] * h[0]^2 / 6 and x[n - 2] = x[n - 1] + acc[n - 2] * h[n - 2]^2 / 6
+  const double d_first = h[0] * h[0] / 6.0;
+  const double d_last = h[n - 2] * h[n - 2] / 6.0;
+
+  std::vector<double> lower(m, 0.0), diag(m, 0.0), upper(m, 0.0), rhs(m, 0.0);
+  for (std::size_t i = 1 ; i <= m ; ++i)
+  {
+    // continuity of velocity at knot i:
+    // h[i-1] acc[i-1] + 2 (h[i-1] + h[i]) acc[i] + h[i] acc[i+1] = 6 (x[i+1] - x[i]) / h[i] - 6 (x[i] - x[i-1]) / h[i-1]
+    const std::size_t r = i - 1;
+    diag[r] += 2.0 * (h[i - 1] + h[i]);
+    if (i > 1)
+      lower[r] += h[i - 1];
+    if (i < m)
+      upper[r] += h[i];
+
+    const double k[3] = { 6.0 / h[i - 1], -6.0 / h[i - 1] - 6.0 / h[i], 6.0 / h[i] };
+    for (std::size_t s = 0 ; s < 3 ; ++s)
+    {
+      const std::size_t j = i - 1 + s;
+      if (j == 1)
+      {
+        rhs[r] += k[s] * x[0];
+        addCoefficient(lower, diag, upper, r, 0, -k[s] * d_first);
+      }
+      else
+        if (j == n - 2)
+        {
+          rhs[r] += k[s] * x[n - 1];
+          addCoefficient(lower, diag, upper, r, m - 1, -k[s] * d_last);
+        }
+        else
+          rhs[r] += k[s] * x[j];
+    }
+  }
+  solveTridiagonal(lower, diag, upper, rhs);
+
+  acc.resize(n);
+  acc[0] = 0.0;
+  acc[n - 1] = 0.0;
+  for (std::size_t i = 0 ; i < m ; ++i)
+    acc[i + 1] = rhs[i];
+  x[1] = x[0] + acc[1] * d_first;
+  x[n - 2] = x[n - 1] + acc[n - 2] * d_last;
+}
+
+// velocity of the spline at the start of segment i
+inline double segmentStartVelocity(const std::vector<double> &h, const std::vector<double> &x,
+                                   const std::vector<double> &acc, std::size_t i)
+{
+  return (x[i + 1] - x[i]) / h[i] - h[i] * (2.0 * acc[i] + acc[i + 1]) / 6.0;
+}
+
+}
+
+JerkLimitedTimeParameterization::JerkLimitedTimeParameterization(unsigned int max_iterations, double default_max_jerk) :
+  max_iterations_(max_iterations), default_max_jerk_(default_max_jerk)
+{
+}
+
+JerkLimitedTimeParameterization::~JerkLimitedTimeParameterization()
+{
+}
+
+void JerkLimitedTimeParameterization::setJerkLimit(const std::string &variable, double max_jerk)
+{
+  max_jerk_[variable] = fabs(max_jerk);
+}
+
+double JerkLimitedTimeParameterization::getJerkLimit(const std::string &variable) const
+{
+  std::map<std::string, double>::const_iterator it = max_jerk_.find(variable);
+  return it == max_jerk_.end() ? default_max_jerk_ : it->second;
+}
+
+bool JerkLimitedTimeParameterization::computeTimeStamps(robot_trajectory::RobotTrajectory& trajectory) const
+{
+  if (trajectory.empty())
+    return true;
+
+  const robot_model::JointModelGroup *group = trajectory.getGroup();
+  if (!group)
+  {
+    logError("It looks like the planner did not set the group the plan was computed for");
+    return false;
+  }
+
+  const std::vector<const robot_model::JointModel*> &jnt = group->getJointModels();
+  for (std::size_t i = 0 ; i < jnt.size() ; ++i)
+    if (jnt[i]->getVariableCount() > 1)
+    {
+      logWarn("Time parametrization works for single-dof joints only");
+      return false;
+    }
+
+  if (default_max_jerk_ <= 0.0)
+  {
+    logError("The default jerk limit must be positive");
+    return false;
+  }
+
+  // the spline is continuous, so angles that wrap around need to be unwound first
+  trajectory.unwind();
+
+  std::vector<double> max_velocity, max_acceleration;
+  getVariableLimits(group, max_velocity, max_acceleration, DEFAULT_VEL_MAX, DEFAULT_ACCEL_MAX);
+  const std::vector<std::string> &names = group->getVariableNames();
+  const std::size_t num_vars = names.size();
+  std::vector<double> max_jerk(num_vars);
+  for (std::size_t j = 0 ; j < num_vars ; ++j)
+  {
+    max_jerk[j] = getJerkLimit(names[j]);
+    if (max_jerk[j] <= 0.0)
+    {
+      logError("The jerk limit for variable '%s' must be positive", names[j].c_str());
+      return false;
+    }
+  }
+
+  std::vector<double> positions;
+  getWayPointPositions(trajectory, positions);
+  const std::size_t num_points = trajectory.getWayPointCount();
+  trajectory.setWayPointDurationFromPrevious(0, 0.0);
+  if (num_points == 1)
+    return true;
+
+  // the knots of the spline are the waypoints plus the two inserted ones, at index 1 and num_knots - 2
+  const std::size_t num_knots = num_points + 2;
+  std::vector<std::vector<double> > x(num_vars, std::vector<double>(num_knots, 0.0));
+  for (std::size_t j = 0 ; j < num_vars ; ++j)
+  {
+    x[j][0] = positions[j];
+    for (std::size_t i = 1 ; i < num_points ; ++i)
+      x[j][i + 1] = positions[i * num_vars + j];
+    x[j][num_knots - 1] = x[j][num_knots - 2];
+  }
+
+  // initial segment durations: each waypoint-to-waypoint segment takes at least as long as any variable needs for it
+  // when only one of the limits is considered
+  std::vector<double> segment(num_points - 1);
+  for (std::size_t i = 0 ; i + 1 < num_points ; ++i)
+  {
+    double t = MIN_SEGMENT_DURATION;
+    for (std::size_t j = 0 ; j < num_vars ; ++j)
+    {
+      double dq = fabs(positions[(i + 1) * num_vars + j] - positions[i * num_vars + j]);
+      t = std::max(t, dq / max_velocity[j]);
+      t = std::max(t, sqrt(dq / max_acceleration[j]));
+      t = std::max(t, cbrt(dq / max_jerk[j]));
+    }
+    segment[i] = t;
+  }
+
+  // the inserted knots split the first and last segments
+  std::vector<double> h(num_knots - 1);
+  if (num_points == 2)
+    h[0] = h[1] = h[2] = segment[0] / 3.0;
+  else
+  {
+    h[0] = h[1] = segment[0] / 2.0;
+    for (std::size_t i = 1 ; i + 2 < num_points ; ++i)
+      h[i + 1] = segment[i];
+    h[num_knots - 3] = h[num_knots - 2] = segment.back() / 2.0;
+  }
+
+  // increase the durations of the segments that violate limits until all limits hold
+  std::vector<std::vector<double> > acc(num_vars);
+  std::vector<double> factor(num_knots - 1);
+  double max_factor = 0.0;
+  for (unsigned int iteration = 0 ; iteration <= max_iterations_ ; ++iteration)
+  {
+    std::fill(factor.begin(), factor.end(), 1.0);
+    for (std::size_t j = 0 ; j < num_vars ; ++j)
+    {
+      computeSpline(h, x[j], acc[j]);
+      const std::vector<double> &a = acc[j];
+      for (std::size_t i = 0 ; i + 1 < num_knots ; ++i)
+      {
+        // scaling the duration of a segment by f scales its velocities by 1/f, accelerations by 1/f^2 and jerk by 1/f^3
+        double jerk = (a[i + 1] - a[i]) / h[i];
+        double v0 = segmentStartVelocity(h, x[j], a, i);
+        double v = std::max(fabs(v0), fabs(v0 + a[i] * h[i] + jerk * h[i] * h[i] / 2.0));
+        // the velocity may peak inside the segment, where the acceleration crosses zero
+        if (a[i] * a[i + 1] < 0.0)
+        {
+          double t = -a[i] / jerk;
+          v = std::max(v, fabs(v0 + a[i] * t + jerk * t * t / 2.0));
+        }
+        double f = std::max(v / max_velocity[j], 1.0);
+        f = std::max(f, sqrt(std::max(fabs(a[i]), fabs(a[i + 1])) / max_acceleration[j]));
+        f = std::max(f, cbrt(fabs(jerk) / max_jerk[j]));
+        factor[i] = std::max(factor[i], f);
+      }
+    }
+
+    max_factor = *std::max_element(factor.begin(), factor.end());
+    if (max_factor <= 1.0 + LIMIT_TOLERANCE || iteration == max_iterations_)
+      break;
+    for (std::size_t i = 0 ; i < h.size() ; ++i)
+      if (factor[i] > 1.0 + LIMIT_TOLERANCE)
+        h[i] *= factor[i];
+  }
+
+  // if the iterations did not converge, slow down the whole trajectory; scaling all durations by the same factor
+  // leaves the positions of the inserted knots unchanged and scales the accelerations by 1 / max_factor^2
+  if (max_factor > 1.0 + LIMIT_TOLERANCE)
+  {
+    logDebug("Jerk-limited time parameterization did not converge in %u iterations; scaling trajectory by %lf",
+             max_iterations_, max_factor);
+    for (std::size_t i = 0 ; i < h.size() ; ++i)
+      h[i] *= max_factor;
+    for (std::size_t j = 0 ; j < num_vars ; ++j)
+      for (std::size_t i = 0 ; i < num_knots ; ++i)
+        acc[j][i] /= max_factor * max_factor;
+  }
+
+  // insert the additional waypoints
+  const std::vector<int> &idx = group->getVariableIndexList();
+  robot_state::RobotStatePtr second(new robot_state::RobotState(trajectory.getFirstWayPoint()));
+  robot_state::RobotStatePtr second_last(new robot_state::RobotState(trajectory.getLastWayPoint()));
+  for (std::size_t j = 0 ; j < num_vars ; ++j)
+  {
+    second->setVariablePosition(idx[j], x[j][1]);
+    second_last->setVariablePosition(idx[j], x[j][num_knots - 2]);
+  }
+  second->update();
+  second_last->update();
+  trajectory.insertWayPoint(1, second, 0.0);
+  trajectory.insertWayPoint(num_knots - 2, second_last, 0.0);
+
+  for (std::size_t i = 0 ; i < num_knots ; ++i)
+  {
+    robot_state::RobotState &waypoint = *trajectory.getWayPointPtr(i);
+    if (i > 0)
+      trajectory.setWayPointDurationFromPrevious(i, h[i - 1]);
+    for (std::size_t j = 0 ; j < num_vars ; ++j)
+    {
+      waypoint.setVariableVelocity(idx[j], i + 1 < num_knots ? segmentStartVelocity(h, x[j], acc[j], i) : 0.0);
+      waypoint.setVariableAcceleration(idx[j], acc[j][i]);
+    }
+  }
+
+  return true;
+}
+
+}
@@ -0,0 +1,374 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2013, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#include <moveit/trajectory_processing/time_optimal_parameterization.h>
+#include <moveit/trajectory_processing/trajectory_tools.h>
+#include <console_bridge/console.h>
+#include <boost/math/constants/constants.hpp>
+#include <limits>
+#include <cmath>
+
+namespace trajectory_processing
+{
+
+namespace
+{
+
+const double DEFAULT_VEL_MAX = 1.0;
+const double DEFAULT_ACCEL_MAX = 1.0;
+
+// path derivatives smaller than this are considered 0
+const double DERIVATIVE_EPSILON = 1e-9;
+
+// bound used for the squared path velocity where the limits do not bound it (e.g., for repeated waypoints)
+const double MAX_SQUARED_PATH_VELOCITY = 1e12;
+
+// The acceleration of variable j along the path is d_j * u + dd_j * x, where d and dd are the first and second
+// derivatives of the path with respect to s, x = (ds/dt)^2 and u = d^2s/dt^2. For a given x, the acceleration limit
+// of a variable with d_j != 0 bounds u between alpha_lo_j + beta_j * x and alpha_hi_j + beta_j * x.
+struct PathPoint
+{
+  std::vector<double> alpha_lo_;
+  std::vector<double> alpha_hi_;
+  std::vector<double> beta_;
+
+  // the largest x for which the velocity and acceleration limits can be satisfied at this point
+  double max_x_;
+
+  double minU(double x) const
+  {
+    double u = -std::numeric_limits<double>::infinity();
+    for (std::size_t j = 0 ; j < beta_.size() ; ++j)
+      u = std::max(u, alpha_lo_[j] + beta_[j] * x);
+    return u;
+  }
+
+  double maxU(double x) const
+  {
+    double u = std::numeric_limits<double>::infinity();
+    for (std::size_t j = 0 ; j < beta_.size() ; ++j)
+      u = std::min(u, alpha_hi_[j] + beta_[j] * x);
+    return u;
+  }
+};
+
+void computePathPoint(const double *d, const double *dd, const std::vector<double> &max_velocity,
+                      const std::vector<double> &max_acceleration, PathPoint &p)
+{
+  p.alpha_lo_.clear();
+  p.alpha_hi_.clear();
+  p.beta_.clear();
+  p.max_x_ = MAX_SQUARED_PATH_VELOCITY;
+  for (std::size_t j = 0 ; j < max_velocity.size() ; ++j)
+    if (fabs(d[j]) > DERIVATIVE_EPSILON)
+    {
+      p.max_x_ = std::min(p.max_x_, (max_velocity[j] * max_velocity[j]) / (d[j] * d[j]));
+      p.alpha_lo_.push_back(-max_acceleration[j] / fabs(d[j]));
+      p.alpha_hi_.push_back(max_acceleration[j] / fabs(d[j]));
+      p.beta_.push_back(-dd[j] / d[j]);
+    }
+    else
+      // the variable does not move with s, so only the curvature term contributes to its acceleration
+      if (fabs(dd[j]) > DERIVATIVE_EPSILON)
+        p.max_x_ = std::min(p.max_x_, max_acceleration[j] / fabs(dd[j]));
+
+  // the bounds on u must define a non-empty interval
+  for (std::size_t j = 0 ; j < p.beta_.size() ; ++j)
+    for (std::size_t k = 0 ; k < p.beta_.size() ; ++k)
+      if (p.beta_[j] > p.beta_[k])
+        p.max_x_ = std::min(p.max_x_, (p.alpha_hi_[k] - p.alpha_lo_[j]) / (p.beta_[j] - p.beta_[k]));
+}
+
+// the largest x at point p from which a state with x in [0, next_max_x] is reachable at the next point, ds further
+double maxControllableX(const PathPoint &p, double next_max_x, double ds)
+{
+  double x = p.max_x_;
+  for (std::size_t j = 0 ; j < p.beta_.size() ; ++j)
+  {
+    // decelerating as much as possible must reach at most next_max_x: x + 2 ds (alpha_lo_j + beta_j x) <= next_max_x
+    double c = 1.0 + 2.0 * ds * p.beta_[j];
+    if (c > 0.0)
+      x = std::min(x, (next_max_x - 2.0 * ds * p.alpha_lo_[j]) / c);
+    // accelerating as much as possible must not need a negative x: x + 2 ds (alpha_hi_j + beta_j x) >= 0
+    else
+      if (c < 0.0)
+        x = std::min(x, 2.0 * ds * p.alpha_hi_[j] / -c);
+  }
+  return std::max(x, 0.0);
+}
+
+
+// Time the waypoints [first, num_points) of the path, given the squared path velocity x[first]; the last waypoint is
+// reached at rest. The positions and the d, dd and x arrays cover all waypoints, and only the entries from first on
+// are updated (along with the durations, velocities and accelerations of the corresponding waypoints, except for the
+// duration of waypoint first itself). Returns false if the end cannot be reached at rest from x[first].
+bool timePath(robot_trajectory::RobotTrajectory &trajectory, const std::vector<double> &positions,
+              const std::vector<double> &max_velocity, const std::vector<double> &max_acceleration,
+              std::size_t first, std::vector<double> &d, std::vector<double> &dd, std::vector<double> &x)
+{
+  const std::size_t num_vars = max_velocity.size();
+  const std::size_t num_points = trajectory.getWayPointCount();
+  const std::vector<int> &idx = trajectory.getGroup()->getVariableIndexList();
+
+  // the path is parameterized by the waypoint index, so consecutive waypoints are at distance 1
+  const double ds = 1.0;
+
+  // derivatives of the path at the waypoints, by finite differences
+  for (std::size_t i = first ; i < num_points ; ++i)
+  {
+    std::size_t prev = i > 0 ? i - 1 : i;
+    std::size_t next = i + 1 < num_points ? i + 1 : i;
+    for (std::size_t j = 0 ; j < num_vars ; ++j)
+    {
+      d[i * num_vars + j] = (positions[next * num_vars + j] - positions[prev * num_vars + j]) / ((next - prev) * ds);
+      dd[i * num_vars + j] = prev < i && next > i ?
+        (positions[next * num_vars + j] - 2.0 * positions[i * num_vars + j] + positions[prev * num_vars + j]) / (ds * ds) : 0.0;
+    }
+  }
+
+  // backward pass: the largest squared path velocity at each point from which the end can be reached at rest
+  const std::size_t count = num_points - first;
+  std::vector<PathPoint> points(count);
+  std::vector<double> max_x(count, 0.0);
+  for (std::size_t k = count - 1 ; k-- > 0 ; )
+  {
+    std::size_t i = first + k;
+    computePathPoint(&d[i * num_vars], &dd[i * num_vars], max_velocity, max_acceleration, points[k]);
+    max_x[k] = maxControllableX(points[k], max_x[k + 1], ds);
+  }
+  if (x[first] > max_x[0] * (1.0 + DERIVATIVE_EPSILON) + DERIVATIVE_EPSILON)
+    return false;
+
+  // forward pass: accelerate as much as possible without leaving the controllable states
+  for (std::size_t k = 0 ; k + 1 < count ; ++k)
+    x[first + k + 1] = std::max(0.0, std::min(max_x[k + 1], x[first + k] + 2.0 * ds * points[k].maxU(x[first + k])));
+
+  // the time to traverse each segment; segments traversed from rest to rest (if the path stops) use the time of
+  // a bang-bang motion at the acceleration limits
+  std::vector<double> u(count, 0.0);
+  for (std::size_t i = first ; i + 1 < num_points ; ++i)
+  {
+    double denominator = sqrt(x[i]) + sqrt(x[i + 1]);
+    double dt = 0.0;
+    if (denominator > std::numeric_limits<double>::epsilon())
+      dt = 2.0 * ds / denominator;
+    for (std::size_t j = 0 ; j < num_vars ; ++j)
+    {
+      double dq = fabs(positions[(i + 1) * num_vars + j] - positions[i * num_vars + j]);
+      if (denominator <= std::numeric_limits<double>::epsilon())
+        dt = std::max(dt, 2.0 * sqrt(dq / max_acceleration[j]));
+      // the finite differences approximate the path, so the velocity over the segment is checked as well
+      dt = std::max(dt, dq / max_velocity[j]);
+    }
+    trajectory.setWayPointDurationFromPrevious(i + 1, dt);
+    u[i - first] = (x[i + 1] - x[i]) / (2.0 * ds);
+  }
+  if (count > 1)
+    u[count - 1] = u[count - 2];
+
+  for (std::size_t i = first ; i < num_points ; ++i)
+  {
+    robot_state::RobotState &waypoint = *trajectory.getWayPointPtr(i);
+    double sdot = sqrt(x[i]);
+    for (std::size_t j = 0 ; j < num_vars ; ++j)
+    {
+      waypoint.setVariableVelocity(idx[j], d[i * num_vars + j] * sdot);
+      waypoint.setVariableAcceleration(idx[j], d[i * num_vars + j] * u[i - first] + dd[i * num_vars + j] * x[i]);
+    }
+  }
+
+  return true;
+}
+
+bool checkGroup(const robot_model::JointModelGroup *group)
+{
+  if (!group)
+  {
+    logError("It looks like the planner did not set the group the plan was computed for");
+    return false;
+  }
+
+  const std::vector<const robot_model::JointModel*> &jnt = group->getJointModels();
+  for (std::size_t i = 0 ; i < jnt.size() ; ++i)
+    if (jnt[i]->getVariableCount() > 1)
+    {
+      logWarn("Time parametrization works for single-dof joints only");
+      return false;
+    }
+  return true;
+}
+
+}
+
+TimeOptimalParameterization::TimeOptimalParameterization()
+{
+}
+
+TimeOptimalParameterization::~TimeOptimalParameterization()
+{
+}
+
+bool TimeOptimalParameterization::computeTimeStamps(robot_trajectory::RobotTrajectory& trajectory) const
+{
+  if (trajectory.empty())
+    return true;
+
+  const robot_model::JointModelGroup *group = trajectory.getGroup();
+  if (!checkGroup(group))
+    return false;
+
+  // the path is assumed to be continuous, so angles that wrap around need to be unwound first
+  trajectory.unwind();
+
+  std::vector<double> max_velocity, max_acceleration;
+  getVariableLimits(group, max_velocity, max_acceleration, DEFAULT_VEL_MAX, DEFAULT_ACCEL_MAX);
+  std::vector<double> positions;
+  getWayPointPositions(trajectory, positions);
+
+  const std::size_t num_vars = max_velocity.size();
+  const std::size_t num_points = trajectory.getWayPointCount();
+  trajectory.setWayPointDurationFromPrevious(0, 0.0);
+  if (num_points == 1)
+    return true;
+
+  std::vector<double> d(num_points * num_vars), dd(num_points * num_vars), x(num_points, 0.0);
+  return timePath(trajectory, positions, max_velocity, max_acceleration, 0, d, dd, x);
+}
+
+IncrementalTimeOptimalParameterization::IncrementalTimeOptimalParameterization(std::size_t window) :
+  window_(std::max<std::size_t>(window, 1)), group_(NULL), timed_count_(0)
+{
+}
+
+IncrementalTimeOptimalParameterization::~IncrementalTimeOptimalParameterization()
+{
+}
+
+void IncrementalTimeOptimalParameterization::reset()
+{
+  group_ = NULL;
+  timed_count_ = 0;
+  max_velocity_.clear();
+  max_acceleration_.clear();
+  positions_.clear();
+  d_.clear();
+  dd_.clear();
+  x_.clear();
+}
+
+void IncrementalTimeOptimalParameterization::unwindSuffix(robot_trajectory::RobotTrajectory& trajectory, std::size_t first) const
+{
+  // same as RobotTrajectory::unwind(), but only for the waypoints from first on; the waypoint before first is
+  // already unwound
+  const std::vector<const robot_model::JointModel*> &cont_joints = group_->getContinuousJointModels();
+  for (std::size_t i = std::max<std::size_t>(first, 1) ; i < trajectory.getWayPointCount() ; ++i)
+  {
+    robot_state::RobotState &waypoint = *trajectory.getWayPointPtr(i);
+    const robot_state::RobotState &previous = trajectory.getWayPoint(i - 1);
+    for (std::size_t j = 0 ; j < cont_joints.size() ; ++j)
+    {
+      double prev = previous.getJointPositions(cont_joints[j])[0];
+      double value = waypoint.getJointPositions(cont_joints[j])[0];
+      double offset = 0.0;
+      while (value + offset - prev > boost::math::constants::pi<double>())
+        offset -= 2.0 * boost::math::constants::pi<double>();
+      while (value + offset - prev < -boost::math::constants::pi<double>())
+        offset += 2.0 * boost::math::constants::pi<double>();
+      if (offset != 0.0)
+      {
+        value += offset;
+        waypoint.setJointPositions(cont_joints[j], &value);
+      }
+    }
+    waypoint.update();
+  }
+}
+
+bool IncrementalTimeOptimalParameterization::computeTimeStamps(robot_trajectory::RobotTrajectory& trajectory)
+{
+  if (trajectory.empty())
+  {
+    reset();
+    return true;
+  }
+
+  // start over if the trajectory is not an extension of the one timed last
+  const std::size_t num_points = trajectory.getWayPointCount();
+  if (trajectory.getGroup() != group_ || num_points < timed_count_)
+    reset();
+
+  if (timed_count_ == 0)
+  {
+    if (!checkGroup(trajectory.getGroup()))
+      return false;
+    group_ = trajectory.getGroup();
+    getVariableLimits(group_, max_velocity_, max_acceleration_, DEFAULT_VEL_MAX, DEFAULT_ACCEL_MAX);
+    trajectory.setWayPointDurationFromPrevious(0, 0.0);
+  }
+
+  if (num_points == timed_count_)
+    return true;
+
+  // only the appended waypoints need to be unwound and copied
+  unwindSuffix(trajectory, timed_count_);
+  const std::size_t num_vars = max_velocity_.size();
+  const std::vector<int> &idx = group_->getVariableIndexList();
+  positions_.resize(num_points * num_vars);
+  for (std::size_t i = timed_count_ ; i < num_points ; ++i)
+  {
+    const robot_state::RobotState &waypoint = trajectory.getWayPoint(i);
+    for (std::size_t j = 0 ; j < num_vars ; ++j)
+      positions_[i * num_vars + j] = waypoint.getVariablePosition(idx[j]);
+  }
+  d_.resize(num_points * num_vars);
+  dd_.resize(num_points * num_vars);
+  x_.resize(num_points, 0.0);
+
+  // the previous timing brought the trajectory to rest at its last waypoint; only the waypoints within the window
+  // before it are re-timed, so the time spent does not depend on the length of the trajectory. If the new waypoints
+  // do not allow stopping in time from the velocity fixed at the start of the window, the window is extended. This
+  // always terminates, since the trajectory starts at rest.
+  std::size_t first = timed_count_ > window_ ? timed_count_ - window_ : 0;
+  timed_count_ = num_points;
+  if (num_points == 1)
+    return true;
+  while (!timePath(trajectory, positions_, max_velocity_, max_acceleration_, first, d_, dd_, x_))
+  {
+    logDebug("Extending the re-timed window to waypoint %u", (unsigned int)first);
+    first = first > window_ ? first - window_ : 0;
+  }
+  return true;
+}
+
+}
@@ -35,6 +35,8 @@
 /* Author: Ioan Sucan */
 
 #include <moveit/trajectory_processing/trajectory_tools.h>
+#include <algorithm>
+#include <cmath>
 
 namespace trajectory_processing
 {
@@ -49,4 +51,34 @@ std::size_t trajectoryWaypointCount(const moveit_msgs::RobotTrajectory &trajecto
   return std::max(trajectory.joint_trajectory.points.size(), trajectory.multi_dof_joint_trajectory.points.size());
 }
 
+void getVariableLimits(const robot_model::JointModelGroup *group, std::vector<double> &max_velocity, std::vector<double> &max_acceleration,
+                       double default_velocity, double default_acceleration)
+{
+  const std::vector<std::string> &vars = group->getVariableNames();
+  const robot_model::RobotModel &rmodel = group->getParentModel();
+  max_velocity.assign(vars.size(), default_velocity);
+  max_acceleration.assign(vars.size(), default_acceleration);
+  for (std::size_t j = 0 ; j < vars.size() ; ++j)
+  {
+    const robot_model::VariableBounds &b = rmodel.getVariableBounds(vars[j]);
+    if (b.velocity_bounded_)
+      max_velocity[j] = std::min(fabs(b.max_velocity_), fabs(b.min_velocity_));
+    if (b.acceleration_bounded_)
+      max_acceleration[j] = std::min(fabs(b.max_acceleration_), fabs(b.min_acceleration_));
+  }
+}
+
+void getWayPointPositions(const robot_trajectory::RobotTrajectory &trajectory, std::vector<double> &positions)
+{
+  const std::vector<int> &idx = trajectory.getGroup()->getVariableIndexList();
+  const std::size_t num_points = trajectory.getWayPointCount();
+  positions.resize(num_points * idx.size());
+  for (std::size_t i = 0 ; i < num_points ; ++i)
+  {
+    const robot_state::RobotState &waypoint = trajectory.getWayPoint(i);
+    for (std::size_t j = 0 ; j < idx.size() ; ++j)
+      positions[i * idx.size() + j] = waypoint.getVariablePosition(idx[j]);
+  }
+}
+
 }
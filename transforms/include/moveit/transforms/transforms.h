@@ -42,7 +42,12 @@
 #include <Eigen/Geometry>
 #include <boost/shared_ptr.hpp>
 #include <boost/noncopyable.hpp>
+#include <boost/thread/mutex.hpp>
 #include <moveit/macros/class_forward.h>
+#include <eigen_stl_containers/eigen_stl_containers.h>
+#include <Eigen/StdVector>
+#include <map>
+#include <vector>
 
 namespace moveit
 {
@@ -55,6 +60,10 @@ MOVEIT_CLASS_FORWARD(Transforms);
 typedef std::map<std::string, Eigen::Affine3d, std::less<std::string>,
                  Eigen::aligned_allocator<std::pair<const std::string, Eigen::Affine3d> > > FixedTransformsMap;
 
+/// @brief The integer identifier of an interned frame name (see Transforms::internFrame()). Identifiers are shared by
+/// all instances of Transforms and remain valid for the lifetime of the process; -1 denotes an invalid frame.
+typedef int FrameId;
+
 /** @brief Provides an implementation of a snapshot of a transform tree that can be easily queried for
     transforming different quantities. Transforms are maintained as a list of transforms to a particular frame.
     All stored transforms are considered fixed. */
@@ -74,12 +83,32 @@ public:
   /** \brief Check if two frames end up being the same once the missing / are added as prefix (if they are missing) */
   static bool sameFrame(const std::string &frame1, const std::string &frame2);
 
+  /** \brief Get the identifier of a frame name, assigning a new one if the name was not seen before. Names that differ
+      only by the leading / get the same identifier. Return -1 for an empty name. */
+  static FrameId internFrame(const std::string &frame);
+
+  /** \brief Get the name of an interned frame (with the leading /); an empty string is returned for invalid identifiers */
+  static const std::string& getFrameName(FrameId id);
+
   /**
    * @brief Get the planning frame corresponding to this set of transforms
    * @return The planning frame
    */
   const std::string& getTargetFrame() const;
 
+  /** \brief Get the identifier of the planning frame */
+  FrameId getTargetFrameId() const
+  {
+    return target_frame_id_;
+  }
+
+  /** \brief Get a number that changes every time the set of stored transforms is modified, so that data derived from
+      the transforms can be cached */
+  std::size_t getVersion() const
+  {
+    return version_;
+  }
+
   /**
    * \name Setting and retrieving transforms maintained in this class
    */
@@ -88,6 +117,8 @@ public:
   /**
    * @brief Return all the transforms
    * @return A map from string names of frames to corresponding Eigen::Affine3d (w.r.t the planning frame)
+   *
+   * The map is rebuilt only after the transforms change (see getVersion()).
    */
   const FixedTransformsMap& getAllTransforms() const;
 
@@ -104,6 +135,13 @@ public:
    */
   void setTransform(const Eigen::Affine3d &t, const std::string &from_frame);
 
+  /**
+   * @brief Set a transform in the transform tree (adding it if necessary)
+   * @param t The input transform (w.r.t the target frame)
+   * @param from_frame The identifier of the frame for which the input transform is specified
+   */
+  void setTransform(const Eigen::Affine3d &t, FrameId from_frame);
+
   /**
    * @brief Set a transform in the transform tree (adding it if necessary)
    * @param transform The input transform (the frame_id must match the target frame)
@@ -121,6 +159,11 @@ public:
    */
   void setAllTransforms(const FixedTransformsMap &transforms);
 
+  /**
+   * @brief Set all the transforms to the fixed transforms of \e other (which must have the same target frame)
+   */
+  void setAllTransforms(const Transforms &other);
+
   /**@}*/
 
   /**
@@ -171,6 +214,60 @@ public:
   {
     t_out = getTransform(from_frame) * t_in;
   }
+
+  /**
+   * @brief Transform a set of points in from_frame to the target_frame. The frame is looked up once for the whole set.
+   * @param from_frame The frame in which the input points are specified
+   * @param p_in The input points (in from_frame)
+   * @param p_out The resultant (transformed) points; this can be the same vector as \e p_in
+   */
+  void transformPoints(const std::string &from_frame, const EigenSTL::vector_Vector3d &p_in, EigenSTL::vector_Vector3d &p_out) const
+  {
+    transformPoints(getTransform(from_frame), p_in, p_out);
+  }
+
+  /** @brief Transform a set of points from the frame with identifier \e from_frame to the target_frame */
+  void transformPoints(FrameId from_frame, const EigenSTL::vector_Vector3d &p_in, EigenSTL::vector_Vector3d &p_out) const
+  {
+    transformPoints(getTransform(from_frame), p_in, p_out);
+  }
+
+  /**
+   * @brief Transform a set of points in from_frame to the target_frame, with the coordinates stored in separate arrays
+   * (which is the layout that lends itself best to vectorization). The output arrays can be the same as the input arrays.
+   * @param from_frame The frame in which the input points are specified
+   * @param x_in, y_in, z_in The coordinates of the input points (in from_frame)
+   * @param count The number of points
+   * @param x_out, y_out, z_out The coordinates of the resultant (transformed) points
+   */
+  void transformPoints(const std::string &from_frame, const double *x_in, const double *y_in, const double *z_in, std::size_t count,
+                       double *x_out, double *y_out, double *z_out) const
+  {
+    transformPoints(getTransform(from_frame), x_in, y_in, z_in, count, x_out, y_out, z_out);
+  }
+
+  /**
+   * @brief Transform a set of vectors in from_frame to the target_frame (only the rotation is applied, as for transformVector3())
+   * @param from_frame The frame in which the input vectors are specified
+   * @param v_in The input vectors (in from_frame)
+   * @param v_out The resultant (transformed) vectors; this can be the same vector as \e v_in
+   */
+  void transformVectors(const std::string &from_frame, const EigenSTL::vector_Vector3d &v_in, EigenSTL::vector_Vector3d &v_out) const;
+
+  /**
+   * @brief Transform a set of poses in from_frame to the target_frame
+   * @param from_frame The frame in which the input poses are specified
+   * @param t_in The input poses (in from_frame)
+   * @param t_out The resultant (transformed) poses; this can be the same vector as \e t_in
+   */
+  void transformPoses(const std::string &from_frame, const EigenSTL::vector_Affine3d &t_in, EigenSTL::vector_Affine3d &t_out) const;
+
+  /** @brief Apply the transform \e t to a set of points; this can be used for transforms obtained with getTransform() */
+  static void transformPoints(const Eigen::Affine3d &t, const EigenSTL::vector_Vector3d &p_in, EigenSTL::vector_Vector3d &p_out);
+
+  /** @brief Apply the transform \e t to a set of points; see transformPoints() for the layout of the arguments */
+  static void transformPoints(const Eigen::Affine3d &t, const double *x_in, const double *y_in, const double *z_in, std::size_t count,
+                              double *x_out, double *y_out, double *z_out);
   /**@}*/
 
   /**
@@ -190,11 +287,65 @@ public:
    */
   virtual const Eigen::Affine3d& getTransform(const std::string &from_frame) const;
 
+  /**
+   * @brief Check whether data can be transformed from a particular frame, given its identifier
+   */
+  virtual bool canTransform(FrameId from_frame) const;
+
+  /**
+   * @brief Check whether a frame stays constant as the state of the robot model changes, given its identifier
+   */
+  virtual bool isFixedFrame(FrameId frame) const;
+
+  /**
+   * @brief Get transform for from_frame (w.r.t target frame), given its identifier
+   */
+  virtual const Eigen::Affine3d& getTransform(FrameId from_frame) const;
+
 protected:
 
+  /** \brief Get the stored transform for a frame, or NULL if there is none. This does not log errors. */
+  const Eigen::Affine3d* findTransform(const std::string &frame) const;
+
+  /** \brief Get the stored transform for a frame identifier, or NULL if there is none. This does not log errors. */
+  const Eigen::Affine3d* findTransform(FrameId frame) const;
+
   std::string        target_frame_;
-  FixedTransformsMap transforms_;
+  FrameId            target_frame_id_;
+
+private:
+
+  struct FrameEntry
+  {
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+    FrameId         id_;
+    std::size_t     hash_;
+    std::string     name_;
+    Eigen::Affine3d transform_;
+  };
+
+  void clear();
+  void insert(FrameId id, const std::string &name, const Eigen::Affine3d &t);
+  void rehash(std::size_t size);
+  void place(std::size_t index);
+  int findByName(const std::string &frame) const;
+  int findById(FrameId id) const;
+
+  /** \brief The stored transforms, in insertion order */
+  std::vector<FrameEntry, Eigen::aligned_allocator<FrameEntry> > entries_;
+
+  /** \brief Open addressing hash tables (with linear probing) of indices into entries_, keyed by name and by identifier;
+      their size is a power of 2 and -1 marks empty slots */
+  std::vector<int> by_name_;
+  std::vector<int> by_id_;
+
+  std::size_t version_;
 
+  /** \brief The map returned by getAllTransforms(), valid if all_transforms_version_ matches version_ */
+  mutable FixedTransformsMap all_transforms_;
+  mutable std::size_t all_transforms_version_;
+  mutable boost::mutex all_transforms_lock_;
 };
 
 }
@@ -38,8 +38,60 @@
 #include <eigen_conversions/eigen_msg.h>
 #include <boost/algorithm/string/trim.hpp>
 #include <console_bridge/console.h>
+#include <boost/unordered_map.hpp>
+#include <deque>
 
-moveit::core::Transforms::Transforms(const std::string &target_frame) : target_frame_(target_frame)
+namespace
+{
+
+// The process-wide table of interned frame names
+struct FrameNameTable
+{
+  boost::mutex lock_;
+  boost::unordered_map<std::string, moveit::core::FrameId> ids_;
+  // a deque, so that references to names stay valid as names are added
+  std::deque<std::string> names_;
+};
+
+FrameNameTable& getFrameNameTable()
+{
+  static FrameNameTable table;
+  return table;
+}
+
+inline std::size_t hashStep(std::size_t hash, char c)
+{
+  return (hash ^ (unsigned char)c) * 16777619u;
+}
+
+// FNV-1a hash of the frame name with the leading / added if it is missing, without building that string
+std::size_t hashFrameName(const std::string &frame)
+{
+  std::size_t hash = 2166136261u;
+  if (frame.empty() || frame[0] != '/')
+    hash = hashStep(hash, '/');
+  for (std::size_t i = 0 ; i < frame.size() ; ++i)
+    hash = hashStep(hash, frame[i]);
+  return hash;
+}
+
+inline std::size_t hashFrameId(moveit::core::FrameId id)
+{
+  return (std::size_t)id * 2654435761u;
+}
+
+// compare a stored name (which always starts with /) to a name that may be missing the leading /
+inline bool sameFrameName(const std::string &stored, const std::string &frame)
+{
+  if (!frame.empty() && frame[0] == '/')
+    return stored == frame;
+  return stored.size() == frame.size() + 1 && stored.compare(1, std::string::npos, frame) == 0;
+}
+
+}
+
+moveit::core::Transforms::Transforms(const std::string &target_frame) : target_frame_(target_frame), target_frame_id_(-1),
+                                                                         version_(1), all_transforms_version_(0)
 {
   boost::trim(target_frame_);
   if (target_frame_.empty())
@@ -51,7 +103,8 @@ moveit::core::Transforms::Transforms(const std::string &target_frame) : target_f
       logWarn("Frame '%s' specified as target frame for MoveIt Transforms. Assuming '/%s' instead.", target_frame_.c_str(), target_frame_.c_str());
       target_frame_ = '/' + target_frame_;
     }
-    transforms_[target_frame_] = Eigen::Affine3d::Identity();
+    target_frame_id_ = internFrame(target_frame_);
+    insert(target_frame_id_, target_frame_, Eigen::Affine3d::Identity());
   }
 }
 
@@ -66,6 +119,32 @@ bool moveit::core::Transforms::sameFrame(const std::string &frame1, const std::s
   return frame1 == frame2;
 }
 
+moveit::core::FrameId moveit::core::Transforms::internFrame(const std::string &frame)
+{
+  if (frame.empty())
+    return -1;
+  std::string name = frame[0] == '/' ? frame : '/' + frame;
+  FrameNameTable &table = getFrameNameTable();
+  boost::mutex::scoped_lock slock(table.lock_);
+  boost::unordered_map<std::string, FrameId>::const_iterator it = table.ids_.find(name);
+  if (it != table.ids_.end())
+    return it->second;
+  FrameId id = table.names_.size();
+  table.names_.push_back(name);
+  table.ids_[name] = id;
+  return id;
+}
+
+const std::string& moveit::core::Transforms::getFrameName(FrameId id)
+{
+  static const std::string empty;
+  FrameNameTable &table = getFrameNameTable();
+  boost::mutex::scoped_lock slock(table.lock_);
+  if (id < 0 || id >= (FrameId)table.names_.size())
+    return empty;
+  return table.names_[id];
+}
+
 moveit::core::Transforms::~Transforms()
 {
 }
@@ -75,32 +154,202 @@ const std::string& moveit::core::Transforms::getTargetFrame() const
   return target_frame_;
 }
 
+void moveit::core::Transforms::clear()
+{
+  entries_.clear();
+  by_name_.clear();
+  by_id_.clear();
+}
+
+void moveit::core::Transforms::rehash(std::size_t size)
+{
+  by_name_.assign(size, -1);
+  by_id_.assign(size, -1);
+  for (std::size_t i = 0 ; i < entries_.size() ; ++i)
+    place(i);
+}
+
+void moveit::core::Transforms::place(std::size_t index)
+{
+  std::size_t mask = by_name_.size() - 1;
+  std::size_t s = entries_[index].hash_ & mask;
+  while (by_name_[s] >= 0)
+    s = (s + 1) & mask;
+  by_name_[s] = index;
+  s = hashFrameId(entries_[index].id_) & mask;
+  while (by_id_[s] >= 0)
+    s = (s + 1) & mask;
+  by_id_[s] = index;
+}
+
+void moveit::core::Transforms::insert(FrameId id, const std::string &name, const Eigen::Affine3d &t)
+{
+  int index = findById(id);
+  if (index >= 0)
+  {
+    entries_[index].transform_ = t;
+    return;
+  }
+  FrameEntry entry;
+  entry.id_ = id;
+  entry.hash_ = hashFrameName(name);
+  entry.name_ = name;
+  entry.transform_ = t;
+  entries_.push_back(entry);
+  // keep the load factor of the tables at most 1/2, so probe sequences stay short
+  if (by_name_.size() < entries_.size() * 2)
+    rehash(std::max<std::size_t>(16, by_name_.size() * 2));
+  else
+    place(entries_.size() - 1);
+}
+
+int moveit::core::Transforms::findByName(const std::string &frame) const
+{
+  if (by_name_.empty() || frame.empty())
+    return -1;
+  std::size_t hash = hashFrameName(frame);
+  std::size_t mask = by_name_.size() - 1;
+  for (std::size_t s = hash & mask ; by_name_[s] >= 0 ; s = (s + 1) & mask)
+  {
+    const FrameEntry &e = entries_[by_name_[s]];
+    if (e.hash_ == hash && sameFrameName(e.name_, frame))
+      return by_name_[s];
+  }
+  return -1;
+}
+
+int moveit::core::Transforms::findById(FrameId id) const
+{
+  if (by_id_.empty() || id < 0)
+    return -1;
+  std::size_t mask = by_id_.size() - 1;
+  for (std::size_t s = hashFrameId(id) & mask ; by_id_[s] >= 0 ; s = (s + 1) & mask)
+    if (entries_[by_id_[s]].id_ == id)
+      return by_id_[s];
+  return -1;
+}
+
+const Eigen::Affine3d* moveit::core::Transforms::findTransform(const std::string &frame) const
+{
+  int index = findByName(frame);
+  return index >= 0 ? &entries_[index].transform_ : NULL;
+}
+
+const Eigen::Affine3d* moveit::core::Transforms::findTransform(FrameId frame) const
+{
+  int index = findById(frame);
+  return index >= 0 ? &entries_[index].transform_ : NULL;
+}
+
 const moveit::core::FixedTransformsMap& moveit::core::Transforms::getAllTransforms() const
 {
-  return transforms_;
+  boost::mutex::scoped_lock slock(all_transforms_lock_);
+  if (all_transforms_version_ != version_)
+  {
+    all_transforms_.clear();
+    for (std::size_t i = 0 ; i < entries_.size() ; ++i)
+      all_transforms_[entries_[i].name_] = entries_[i].transform_;
+    all_transforms_version_ = version_;
+  }
+  return all_transforms_;
 }
 
 void moveit::core::Transforms::setAllTransforms(const FixedTransformsMap &transforms)
 {
-  transforms_ = transforms;
+  clear();
+  for (FixedTransformsMap::const_iterator it = transforms.begin() ; it != transforms.end() ; ++it)
+  {
+    FrameId id = internFrame(it->first);
+    if (id >= 0)
+      insert(id, getFrameName(id), it->second);
+  }
+  ++version_;
+}
+
+void moveit::core::Transforms::setAllTransforms(const Transforms &other)
+{
+  if (&other == this)
+    return;
+  if (other.target_frame_id_ != target_frame_id_)
+  {
+    logError("Cannot copy transforms to frame '%s' as transforms to frame '%s'", other.target_frame_.c_str(), target_frame_.c_str());
+    return;
+  }
+  entries_ = other.entries_;
+  by_name_ = other.by_name_;
+  by_id_ = other.by_id_;
+  ++version_;
 }
 
 bool moveit::core::Transforms::isFixedFrame(const std::string &frame) const
 {
-  if (frame.empty())
-    return false;
-  else
-    return (frame[0] == '/' ? transforms_.find(frame) : transforms_.find('/' + frame)) != transforms_.end();
+  return findByName(frame) >= 0;
 }
 
-const Eigen::Affine3d& moveit::core::Transforms::getTransform(const std::string &from_frame) const
+bool moveit::core::Transforms::isFixedFrame(FrameId frame) const
+{
+  return findById(frame) >= 0;
+}
+
+void moveit::core::Transforms::transformVectors(const std::string &from_frame, const EigenSTL::vector_Vector3d &v_in, EigenSTL::vector_Vector3d &v_out) const
+{
+  Eigen::Affine3d r = Eigen::Affine3d::Identity();
+  r.linear() = getTransform(from_frame).rotation();
+  transformPoints(r, v_in, v_out);
+}
+
+void moveit::core::Transforms::transformPoses(const std::string &from_frame, const EigenSTL::vector_Affine3d &t_in, EigenSTL::vector_Affine3d &t_out) const
+{
+  t_out.resize(t_in.size());
+  const Eigen::Affine3d &t = getTransform(from_frame);
+  for (std::size_t i = 0 ; i < t_in.size() ; ++i)
+    t_out[i] = t * t_in[i];
+}
+
+void moveit::core::Transforms::transformPoints(const Eigen::Affine3d &t, const EigenSTL::vector_Vector3d &p_in, EigenSTL::vector_Vector3d &p_out)
+{
+  p_out.resize(p_in.size());
+  if (p_in.empty())
+    return;
+  // the points of an EigenSTL::vector_Vector3d are stored contiguously, so they are processed as one array of coordinates;
+  // each point is read before it is written, so the input and output can be the same
+  const Eigen::Matrix4d &m = t.matrix();
+  const double m00 = m(0, 0), m01 = m(0, 1), m02 = m(0, 2), m03 = m(0, 3);
+  const double m10 = m(1, 0), m11 = m(1, 1), m12 = m(1, 2), m13 = m(1, 3);
+  const double m20 = m(2, 0), m21 = m(2, 1), m22 = m(2, 2), m23 = m(2, 3);
+  const double *in = p_in[0].data();
+  double *out = p_out[0].data();
+  for (std::size_t i = 0, n = 3 * p_in.size() ; i < n ; i += 3)
+  {
+    const double x = in[i], y = in[i + 1], z = in[i + 2];
+    out[i] = m00 * x + m01 * y + m02 * z + m03;
+    out[i + 1] = m10 * x + m11 * y + m12 * z + m13;
+    out[i + 2] = m20 * x + m21 * y + m22 * z + m23;
+  }
+}
+
+void moveit::core::Transforms::transformPoints(const Eigen::Affine3d &t, const double *x_in, const double *y_in, const double *z_in, std::size_t count,
+                                               double *x_out, double *y_out, double *z_out)
 {
-  if (!from_frame.empty())
+  // the coefficients are kept in locals so that the loop has no dependencies between iterations and can be vectorized
+  const Eigen::Matrix4d &m = t.matrix();
+  const double m00 = m(0, 0), m01 = m(0, 1), m02 = m(0, 2), m03 = m(0, 3);
+  const double m10 = m(1, 0), m11 = m(1, 1), m12 = m(1, 2), m13 = m(1, 3);
+  const double m20 = m(2, 0), m21 = m(2, 1), m22 = m(2, 2), m23 = m(2, 3);
+  for (std::size_t i = 0 ; i < count ; ++i)
   {
-    FixedTransformsMap::const_iterator it = (from_frame[0] == '/' ? transforms_.find(from_frame) : transforms_.find('/' + from_frame));
-    if (it != transforms_.end())
-      return it->second;
+    const double x = x_in[i], y = y_in[i], z = z_in[i];
+    x_out[i] = m00 * x + m01 * y + m02 * z + m03;
+    y_out[i] = m10 * x + m11 * y + m12 * z + m13;
+    z_out[i] = m20 * x + m21 * y + m22 * z + m23;
   }
+}
+
+const Eigen::Affine3d& moveit::core::Transforms::getTransform(const std::string &from_frame) const
+{
+  const Eigen::Affine3d *t = findTransform(from_frame);
+  if (t)
+    return *t;
 
   logError("Unable to transform from frame '%s' to frame '%s'. Returning identity.", from_frame.c_str(), target_frame_.c_str());
 
@@ -109,12 +358,27 @@ const Eigen::Affine3d& moveit::core::Transforms::getTransform(const std::string
   return identity;
 }
 
+const Eigen::Affine3d& moveit::core::Transforms::getTransform(FrameId from_frame) const
+{
+  const Eigen::Affine3d *t = findTransform(from_frame);
+  if (t)
+    return *t;
+
+  logError("Unable to transform from frame '%s' (id %d) to frame '%s'. Returning identity.", getFrameName(from_frame).c_str(), from_frame, target_frame_.c_str());
+
+  // return identity
+  static const Eigen::Affine3d identity = Eigen::Affine3d::Identity();
+  return identity;
+}
+
 bool moveit::core::Transforms::canTransform(const std::string &from_frame) const
 {
-  if (from_frame.empty())
-    return false;
-  else
-    return (from_frame[0] == '/' ? transforms_.find(from_frame) : transforms_.find('/' + from_frame)) != transforms_.end();
+  return findByName(from_frame) >= 0;
+}
+
+bool moveit::core::Transforms::canTransform(FrameId from_frame) const
+{
+  return findById(from_frame) >= 0;
 }
 
 void moveit::core::Transforms::setTransform(const Eigen::Affine3d &t, const std::string &from_frame)
@@ -124,15 +388,24 @@ void moveit::core::Transforms::setTransform(const Eigen::Affine3d &t, const std:
   else
   {
     if (from_frame[0] != '/')
-    {
       logWarn("Transform specified for frame '%s'. Assuming '/%s' instead", from_frame.c_str(), from_frame.c_str());
-      transforms_['/' + from_frame] = t;
-    }
-    else
-      transforms_[from_frame] = t;
+    FrameId id = internFrame(from_frame);
+    insert(id, getFrameName(id), t);
+    ++version_;
   }
 }
 
+void moveit::core::Transforms::setTransform(const Eigen::Affine3d &t, FrameId from_frame)
+{
+  const std::string &name = getFrameName(from_frame);
+  if (name.empty())
+    logError("Cannot record transform for unknown frame id %d", from_frame);
+  else
+  {
+    insert(from_frame, name, t);
+    ++version_;
+  }
+}
 void moveit::core::Transforms::setTransform(const geometry_msgs::TransformStamped &transform)
 {
   if (sameFrame(transform.child_frame_id, target_frame_))
@@ -155,9 +428,10 @@ void moveit::core::Transforms::setTransforms(const std::vector<geometry_msgs::Tr
 
 void moveit::core::Transforms::copyTransforms(std::vector<geometry_msgs::TransformStamped> &transforms) const
 {
-  transforms.resize(transforms_.size());
+  const FixedTransformsMap &all = getAllTransforms();
+  transforms.resize(all.size());
   std::size_t i = 0;
-  for (FixedTransformsMap::const_iterator it = transforms_.begin() ; it != transforms_.end() ; ++it, ++i)
+  for (FixedTransformsMap::const_iterator it = all.begin() ; it != all.end() ; ++it, ++i)
   {
     transforms[i].child_frame_id = target_frame_;
     transforms[i].header.frame_id = it->first;
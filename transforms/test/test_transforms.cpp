@@ -37,6 +37,7 @@
 #include <moveit/transforms/transforms.h>
 #include <urdf_parser/urdf_parser.h>
 #include <fstream>
+#include <sstream>
 #include <gtest/gtest.h>
 
 TEST(Transforms, Simple)
@@ -62,6 +63,96 @@ TEST(Transforms, Simple)
   EXPECT_TRUE(tf.isFixedFrame("global"));
 }
 
+TEST(Transforms, FrameIds)
+{
+  moveit::core::Transforms tf("global");
+
+  Eigen::Affine3d t1(Eigen::Translation3d(1.0, 2.0, 3.0));
+  tf.setTransform(t1, "/some_frame_1");
+  moveit::core::FrameId id1 = moveit::core::Transforms::internFrame("some_frame_1");
+  EXPECT_EQ(id1, moveit::core::Transforms::internFrame("/some_frame_1"));
+  EXPECT_EQ("/some_frame_1", moveit::core::Transforms::getFrameName(id1));
+  EXPECT_EQ(tf.getTargetFrameId(), moveit::core::Transforms::internFrame("global"));
+  EXPECT_TRUE(tf.isFixedFrame(id1));
+  EXPECT_TRUE(tf.canTransform(tf.getTargetFrameId()));
+  EXPECT_TRUE(tf.getTransform(id1).isApprox(t1));
+  EXPECT_FALSE(tf.canTransform(moveit::core::Transforms::internFrame("some_frame_2")));
+  EXPECT_FALSE(tf.canTransform(moveit::core::FrameId(-1)));
+
+  // updating a transform by id is seen through the name, and changes the version
+  std::size_t version = tf.getVersion();
+  Eigen::Affine3d t2(Eigen::Translation3d(0.0, 1.0, 0.0));
+  tf.setTransform(t2, id1);
+  EXPECT_NE(version, tf.getVersion());
+  EXPECT_TRUE(tf.getTransform("some_frame_1").isApprox(t2));
+
+  // many frames, to exercise the growth of the hash tables
+  for (int i = 0 ; i < 500 ; ++i)
+  {
+    std::stringstream ss;
+    ss << "/frame_" << i;
+    tf.setTransform(Eigen::Affine3d(Eigen::Translation3d(i, 0.0, 0.0)), ss.str());
+  }
+  EXPECT_EQ(502, tf.getAllTransforms().size());
+  EXPECT_DOUBLE_EQ(321.0, tf.getTransform("frame_321").translation().x());
+
+  moveit::core::Transforms copy("global");
+  copy.setAllTransforms(tf);
+  EXPECT_DOUBLE_EQ(321.0, copy.getTransform(moveit::core::Transforms::internFrame("frame_321")).translation().x());
+  copy.setAllTransforms(tf.getAllTransforms());
+  EXPECT_TRUE(copy.getTransform("some_frame_1").isApprox(t2));
+  EXPECT_TRUE(copy.isFixedFrame("global"));
+}
+
+
+TEST(Transforms, Batch)
+{
+  moveit::core::Transforms tf("global");
+  Eigen::Affine3d t(Eigen::Translation3d(10.0, 1.0, 0.0) * Eigen::AngleAxisd(0.5, Eigen::Vector3d::UnitY()));
+  tf.setTransform(t, "some_frame");
+
+  EigenSTL::vector_Vector3d points;
+  for (int i = 0 ; i < 37 ; ++i)
+    points.push_back(Eigen::Vector3d(i, -0.5 * i, 0.25 * i + 1.0));
+
+  EigenSTL::vector_Vector3d out;
+  tf.transformPoints("some_frame", points, out);
+  ASSERT_EQ(points.size(), out.size());
+  for (std::size_t i = 0 ; i < points.size() ; ++i)
+    EXPECT_TRUE(out[i].isApprox(t * points[i]));
+
+  EigenSTL::vector_Vector3d vectors;
+  tf.transformVectors("some_frame", points, vectors);
+  for (std::size_t i = 0 ; i < points.size() ; ++i)
+  {
+    Eigen::Vector3d v;
+    tf.transformVector3("some_frame", points[i], v);
+    EXPECT_TRUE(vectors[i].isApprox(v));
+  }
+
+  // the coordinates in separate arrays, transformed in place
+  std::vector<double> x(points.size()), y(points.size()), z(points.size());
+  for (std::size_t i = 0 ; i < points.size() ; ++i)
+  {
+    x[i] = points[i].x();
+    y[i] = points[i].y();
+    z[i] = points[i].z();
+  }
+  tf.transformPoints("some_frame", &x[0], &y[0], &z[0], x.size(), &x[0], &y[0], &z[0]);
+  for (std::size_t i = 0 ; i < points.size() ; ++i)
+    EXPECT_TRUE(Eigen::Vector3d(x[i], y[i], z[i]).isApprox(out[i]));
+
+  // in place, with the frame given by identifier
+  tf.transformPoints(moveit::core::Transforms::internFrame("some_frame"), points, points);
+  for (std::size_t i = 0 ; i < points.size() ; ++i)
+    EXPECT_TRUE(points[i].isApprox(out[i]));
+
+  EigenSTL::vector_Affine3d poses(3, Eigen::Affine3d(Eigen::AngleAxisd(0.3, Eigen::Vector3d::UnitZ())));
+  EigenSTL::vector_Affine3d poses_out;
+  tf.transformPoses("some_frame", poses, poses_out);
+  ASSERT_EQ(3, poses_out.size());
+  EXPECT_TRUE(poses_out[2].isApprox(t * poses[2]));
+}
 
 int main(int argc, char **argv)
 {